@@ -26,11 +26,13 @@
 #include "InterSpec_config.h"
 
 #include <memory>
+#include <vector>
 
 #include "InterSpec/AuxWindow.h"
 
 
 //Forward declarations
+class PeakDef;
 class PeakModel;
 class InterSpec;
 
@@ -95,6 +97,35 @@ protected:
   Wt::WCheckBox *m_fitAmplitude;
   
   Wt::WText *m_chart;
+  Wt::WText *m_chi2Txt;
+  
+  /** Per-channel quantities of the candidate peaks ROI, so that as the user edits the peak, the
+   chi2 of the preview can be updated without re-evaluating everything.
+   
+   When only the amplitude changes, the chi2 is recomputed from the cached data, continuum, and
+   unit-amplitude peak shape, with no erf evaluations; when the mean or width changes, only the
+   peak shape is recomputed; the continuum is only recomputed when it, or the ROI, changes.
+   */
+  struct PreviewChi2Cache
+  {
+    std::shared_ptr<const SpecUtils::Measurement> m_data_source;
+    bool m_continuum_valid = false;
+    size_t m_first_channel = 0;
+    std::vector<double> m_data;
+    std::vector<double> m_continuum;
+    
+    /** Peak counts, in each channel, for a peak with amplitude of 1.0, at #m_shape_mean and #m_shape_sigma. */
+    std::vector<double> m_unit_peak;
+    double m_shape_mean = -1.0;
+    double m_shape_sigma = -1.0;
+  };//struct PreviewChi2Cache
+  
+  PreviewChi2Cache m_chi2Cache;
+  
+  /** Updates #m_chi2Cache as necessary, and returns the chi2/DOF of the candidate peak, or -1.0
+   if it cant be computed.
+   */
+  double updatePreviewChi2( const std::shared_ptr<const SpecUtils::Measurement> &meas );
   
 public:
   
@@ -32,20 +32,18 @@
 #include <vector>
 
 #include "InterSpec/BatchPeak.h"
+#include "InterSpec/ShieldingSourceFitCalc.h"
 
 // Forward declarations
 class PeakDef;
 class SpecMeas;
+class MaterialDB;
 class DetectorPeakResponse;
 namespace SpecUtils
 {
   class Measurement;
 }//namespace SpecUtils
 
-namespace ShieldingSourceFitCalc
-{
-  struct ModelFitResults;
-}
 
 /** The functions necessary to batch-fit activity and shielding.  */
 namespace BatchActivity
@@ -60,7 +58,18 @@ namespace BatchActivity
   struct BatchActivityFitOptions
     : public BatchPeak::BatchPeakFitOptions
   {
-    std::shared_ptr<DetectorPeakResponse> drf_override;
+    /** If non-null, the DRF to use instead of the exemplars.  Const, as it is shared by all the
+     files being fit concurrently.
+     */
+    std::shared_ptr<const DetectorPeakResponse> drf_override;
+    
+    /** The maximum wall-clock time, in seconds, the activity/shielding fit of a single file may
+     take before it is stopped, and the file marked as failed; zero or negative means no limit.
+     
+     Elapsed time is checked each time the fit reports progress (every couple of seconds), so the
+     actual time taken may be a little longer than this.
+     */
+    double max_fit_seconds = 0.0;
   };//struct BatchActivityFitOptions
   
   
@@ -129,6 +138,59 @@ namespace BatchActivity
   };//struct BatchActivityFitResult
   
   
+  /** The Shielding/Source fit model, and DRF, of an exemplar N42 file; these are the same for every
+   file fit using the exemplar, so are parsed once, and shared between fits (see #exemplar_bundle).
+   */
+  struct ExemplarBundle
+  {
+    std::shared_ptr<const SpecMeas> m_exemplar;
+    
+    /** Success if the model was parsed, otherwise the first problem found with the model. */
+    BatchActivityFitResult::ResultCode m_result_code;
+    std::string m_error_msg;
+    
+    /** The DRF saved in the exemplar; may be nullptr. */
+    std::shared_ptr<const DetectorPeakResponse> m_drf;
+    
+    /** The distance of the model, or NaN if it was not specified, or was invalid; only required if
+     the DRF is not fixed-geometry.
+     */
+    double m_distance;
+    
+    GammaInteractionCalc::GeometryType m_geometry;
+    ShieldingSourceFitCalc::ShieldingSourceFitOptions m_fit_options;
+    std::vector<ShieldingSourceFitCalc::ShieldingInfo> m_shieldings;
+    std::vector<ShieldingSourceFitCalc::SourceFitDef> m_sources;
+  };//struct ExemplarBundle
+  
+  
+  /** Returns the parsed Shielding/Source model of `exemplar`.
+   
+   Bundles are cached (for a handful of the most recently used exemplars), so fitting many files,
+   or repeated batch requests, with the same exemplar only parse the model once.
+   
+   Throws exception if `exemplar` or `matdb` are nullptr; problems with the model are instead
+   indicated by #ExemplarBundle::m_result_code.
+   */
+  std::shared_ptr<const ExemplarBundle> exemplar_bundle( std::shared_ptr<const SpecMeas> exemplar,
+                                                         std::shared_ptr<const MaterialDB> matdb );
+  
+  
+  /** Returns the parsed exemplar file at `filename`, or nullptr if it could not be parsed.
+   
+   Files are cached by their path and a hash of their contents, so an exemplar used again (e.g.,
+   by a later batch request) wont be re-parsed, unless the file has changed.
+   */
+  std::shared_ptr<const SpecMeas> load_exemplar_file( const std::string &filename );
+  
+  
+  /** Returns the shielding material database, parsed from the static data directory the first time
+   this function is called, and then shared by all fits; throws exception if it (or the nuclide
+   decay database) can not be loaded.
+   */
+  std::shared_ptr<const MaterialDB> material_db();
+  
+  
   
   /** Fits the peaks, activities, and shieldins
    
@@ -143,12 +205,15 @@ namespace BatchActivity
    @param filename The name of the spectrum file to fit peaks to.
    @param options The options to use for fitting peaks; note, not all options are used, as some of them are only applicable to
           #fit_peaks_in_files
+   @param cached_materialdb If non-null, the shielding material database to use; otherwise it will be parsed from the static
+          data directory.  Is only read from, so may be shared between concurrent calls.
    */
   BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filename,
                           std::set<int> exemplar_sample_nums,
                           std::shared_ptr<const SpecMeas> cached_exemplar_n42,
                           const std::string &filename,
-                          const BatchActivityFitOptions &options );
+                          const BatchActivityFitOptions &options,
+                          std::shared_ptr<const MaterialDB> cached_materialdb = nullptr );
   
 }//namespace BatchPeak
 
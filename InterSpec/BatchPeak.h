@@ -27,9 +27,11 @@
 
 #include <set>
 #include <deque>
+#include <iosfwd>
 #include <memory>
 #include <string>
 #include <vector>
+#include <functional>
 
 // Forward declarations
 class PeakDef;
@@ -69,6 +71,36 @@ namespace BatchPeak
     std::string output_dir;
     std::string background_subtract_file;
     std::set<int> background_subtract_samples;
+    
+    /** The number of files to fit concurrently; results are still written out in input order.
+     A value of zero means to use the number of logical CPU cores.
+     */
+    unsigned int num_threads = 1;
+    
+    /** If non-empty, the path of a file that each input files results are appended to (and flushed) as soon as that file
+     is done, instead of only being available once the whole batch finishes.  If the path ends in ".jsonl" or ".json",
+     each file gets a single line of JSON, otherwise the peaks are written as CSV rows (with the header written once).
+     */
+    std::string results_stream_file;
+    
+    /** If true, input files that already have their outputs (the peak CSV, and N42 if #write_n42_with_peaks) in
+     #output_dir are skipped, and #results_stream_file is appended to rather than refusing to overwrite it; this allows
+     restarting a batch that was killed part way through.  Requires #output_dir be specified.
+     */
+    bool resume = false;
+    
+    /** If true, after the peaks are fit to the summed spectrum, their areas are tracked across each individual sample of the
+     file (see #fit_peak_time_series), and written to "<out-dir>/<file>_peak_time_series.csv".  Intended for search and portal
+     files with many short samples.
+     */
+    bool track_peaks_over_time = false;
+    
+    /** If "svg" or "png", a chart of each files fit spectrum and peaks is written to
+     "<out-dir>/<file>_spectrum.<ext>", and for files with more than one sample, a chart of the count rates to
+     "<out-dir>/<file>_time_series.<ext>"; rendered on the server by ChartImageRenderer.  Empty for no chart images.
+     Requires #output_dir be specified.
+     */
+    std::string chart_image_format;
   };//struct BatchPeakFitOptions
   
   
@@ -77,6 +109,24 @@ namespace BatchPeak
                           const std::vector<std::string> &files,
                           const BatchPeakFitOptions &options );
   
+  /** The peak areas for a single sample of a file; see #fit_peak_time_series. */
+  struct PeakTimeSeriesSample
+  {
+    int sample_number;
+    float live_time;
+    float real_time;
+    
+    /** The area, and its uncertainty, of each peak; same order as the peaks passed to #fit_peak_time_series. */
+    std::vector<double> areas;
+    std::vector<double> area_uncerts;
+    
+    /** The number of ROIs that were fit for this sample; the others were statistically consistent with the last fit of that ROI,
+     so its areas were scaled by live-time instead.
+     */
+    size_t num_rois_fit;
+  };//struct PeakTimeSeriesSample
+  
+  
   struct BatchPeakFitResult
   {
     std::string file_path;
@@ -96,6 +146,9 @@ namespace BatchPeak
     /** Background spectrum that was subtracted from the foreground, to make `spectrum`, if any. */
     std::shared_ptr<const SpecUtils::Measurement> background;
     
+    /** The per-sample areas of `fit_peaks`, if BatchPeakFitOptions::track_peaks_over_time was specified. */
+    std::vector<PeakTimeSeriesSample> time_series;
+    
     bool success;
     std::vector<std::string> warnings;
   };//struct BatchPeakFitResult
@@ -124,6 +177,69 @@ namespace BatchPeak
                           std::set<int> foreground_sample_numbers,
                           const BatchPeakFitOptions &options );
   
+  
+  /** Fits the areas of `peaks` in each of the `sample_numbers` of `meas` (summing the `detectors` of each sample).
+   
+   The peaks are normally the result of fitting the summed spectrum, `summed`; their means, widths, skew, ROI ranges, and continuum
+   types are held fixed, so each sample only needs the linear (amplitude and continuum coefficient) least-squares solve.  The
+   channel energies of `summed` are used for each sample if they have the same number of channels (so a refit energy
+   calibration is applied to the samples too).
+   
+   Samples are processed in order, and each ROI remembers its last fit; if the total counts in the ROI for the next sample are
+   consistent, to within `consistency_nsigma` standard deviations, with that fit (scaled by live-time), the ROI is not refit and the
+   areas are scaled instead.  A value of zero (or less) for `consistency_nsigma` fits every ROI of every sample.
+   
+   ROIs with an external continuum are not tracked, and have zero areas and uncertainties.
+   */
+  std::vector<PeakTimeSeriesSample> fit_peak_time_series( const SpecMeas &meas,
+                                            const std::shared_ptr<const SpecUtils::Measurement> &summed,
+                                            const std::deque<std::shared_ptr<const PeakDef>> &peaks,
+                                            const std::set<int> &sample_numbers,
+                                            const std::vector<std::string> &detectors,
+                                            const double consistency_nsigma );
+  
+  
+  /** Escapes `input` so it can be placed between double-quotes in a JSON string. */
+  std::string json_escape( const std::string &input );
+  
+  
+  /** Writes a single line of JSON (terminated by a newline), with the success, warnings, and
+   `fit_peaks` for one input file; this is the format of the ".jsonl" results stream file.
+   */
+  void write_json_line( std::ostream &output, const std::string &filename,
+                        const BatchPeakFitResult &fit_results,
+                        const std::deque<std::shared_ptr<const PeakDef>> &fit_peaks );
+  
+  
+  /** Calls `work(index)` for each index in [0, num_items), using up to `num_threads` worker
+   threads, and calls `commit(index)` - on the calling thread, and in index order - as soon as
+   `work` for that index, and all previous indexes, has completed.
+   
+   Workers will not get more than `max_in_flight` items ahead of the last committed item, so the
+   caller can release per-item results in `commit`, and memory use stays bounded regardless of
+   the number of items.
+   
+   If `work` or `commit` throws an exception, no further items are started, and the exception is
+   re-thrown from this function once the in-progress items finish (the same as a serial loop
+   would have thrown after committing the previous items).
+   
+   @param num_threads The number of worker threads; zero means use the number of CPUs available to
+          this process (see #resolve_num_threads), and one means do everything serially on the
+          calling thread.
+   @param max_in_flight The maximum number of items worked, but not yet committed; if less than
+          the number of threads, the number of threads will be used.
+   */
+  void run_in_order( const size_t num_items,
+                     size_t num_threads,
+                     size_t max_in_flight,
+                     const std::function<void(size_t)> &work,
+                     const std::function<void(size_t)> &commit );
+  
+  
+  /** Returns `num_threads`, or if it is zero (meaning "use all cores"), the number of CPUs this
+   process can use (see `SharedThreadPool::available_cpu_count()`).
+   */
+  size_t resolve_num_threads( const size_t num_threads );
 }//namespace BatchPeak
 
 #endif //BatchPeak_h
@@ -0,0 +1,71 @@
+#ifndef BatchService_h
+#define BatchService_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+namespace Wt
+{
+  class WServer;
+}//namespace Wt
+
+/** A headless HTTP/JSON interface to the batch analysis tools (BatchPeak, BatchActivity, and
+ RelActCalcAuto), so that many spectra can be analyzed by a long-running server, instead of
+ starting a new process, and re-loading the nuclear data, materials, DRFs, and exemplar files, for
+ each one.  Requests do not create a Wt session.
+ 
+ Endpoints (GET or POST, answered only for requests from the local machine):
+ - "/api/batch/peaks": fits the exemplar peaks to the spectrum, like the "--batch-peak-fit" command
+   line option.
+ - "/api/batch/activity": fits peaks, and then the shielding/source model of the exemplar, like the
+   "--batch-act-fit" command line option.
+ - "/api/batch/relact": runs the "Isotopics by nuclides" (RelActCalcAuto) analysis saved in the
+   exemplar N42 file (only if built with USE_REL_ACT_TOOL).
+ 
+ Parameters:
+ - "exemplar": (required) the path, on the server, of the exemplar N42 file (for "peaks", may
+   instead be a peak CSV file).  Parsed exemplars are kept in memory, and are re-used until the
+   files modification time or size changes.
+ - "exemplar_samples": comma-separated sample numbers of the exemplar to use.
+ - "file": the path, on the server, of the spectrum file to analyze; or instead, the spectrum file
+   may be uploaded as the "spectrum" field of a multipart form POST.
+ - "samples": comma-separated foreground sample numbers; if not given, they will be guessed.
+ - "refit_energy_cal", "use_exemplar_energy_cal": "1" to enable these BatchPeak options.
+ - "drf_file", "drf_name": (activity only) the DRF to use instead of the exemplars.
+ - "max_fit_seconds": (activity only) the maximum time to allow for the fit.
+ 
+ The analysis is run on the ComputeScheduler, at ComputeScheduler::Priority::Batch, with requests
+ from each client queued fairly against each other, and against sessions jobs.  A JSON object
+ with the results is returned; HTTP status 400 indicates invalid parameters, and 500 an error
+ during the analysis.
+ */
+namespace BatchService
+{
+  /** Adds the resources described above to the server; should be called before the server is
+   started.  Calling more than once has no effect.
+   */
+  void add_resources_to_server( Wt::WServer *server );
+}//namespace BatchService
+
+#endif //BatchService_h
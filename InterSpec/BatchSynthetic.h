@@ -0,0 +1,178 @@
+#ifndef BatchSynthetic_h
+#define BatchSynthetic_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Forward declarations
+class DetectorPeakResponse;
+namespace SandiaDecay
+{
+  struct Nuclide;
+}//namespace SandiaDecay
+
+namespace SpecUtils
+{
+  enum class SaveSpectrumAsType : int;
+}//namespace SpecUtils
+
+
+/** Functions to generate synthetic spectrum files, of arbitrary size, from a detector response
+ function (DRF) and nuclide decay data, along with the ground truth used to make them.
+ 
+ These files are intended for scaling and regression tests of the analysis code (file loading,
+ peak fitting, activity fitting, etc.), where a known answer, and control over the file size, is
+ more useful than realism.  The peaks are Gaussians with the DRF resolution and efficiency, the
+ continuum is the GADRAS scatter-table continuum through the specified shielding (scaled by the DRF
+ efficiency at each channel), and each record is an independent Poisson draw of the expected
+ spectrum; in-detector Compton scattering, escape peaks, sum peaks, and dead-time are not modeled.
+ */
+namespace BatchSynthetic
+{
+  /** A nuclide, and its activity and age, to put into the synthetic spectra. */
+  struct SyntheticSource
+  {
+    const SandiaDecay::Nuclide *nuclide = nullptr;
+    
+    /** Activity of the parent nuclide, at the given age, in units of PhysicalUnits::bq. */
+    double activity = 0.0;
+    
+    /** Age of the nuclide, in units of PhysicalUnits::second. */
+    double age = 0.0;
+  };//struct SyntheticSource
+  
+  
+  /** Parses a source from a string like "Cs137,1uCi,20y" or "U238, 10 kBq" (age defaults to the
+   nuclides default prompt-equilibrium age if not specified).
+   
+   Throws exception on invalid nuclide, activity, or age.
+   */
+  SyntheticSource source_from_string( const std::string &input );
+  
+  
+  struct SyntheticSpectrumOptions
+  {
+    /** The DRF to use; must be valid, and have resolution information. */
+    std::shared_ptr<DetectorPeakResponse> drf;
+    
+    std::vector<SyntheticSource> sources;
+    
+    /** Source to detector distance, in units of PhysicalUnits::cm; ignored for fixed geometry DRFs. */
+    double distance = 100.0;
+    
+    /** Live time of each record, in units of PhysicalUnits::second; real time is set the same. */
+    double live_time = 300.0;
+    
+    size_t num_channels = 4096;
+    
+    /** Upper energy of the last channel, in keV; a linear energy calibration starting at 0 keV is used. */
+    float max_energy = 3000.0f;
+    
+    /** Atomic number, and areal density (in g/cm2), of the shielding; if the areal density is
+     zero, no shielding attenuation, or scatter continuum, will be included.
+     */
+    float shield_atomic_number = 26.0f;
+    float shield_areal_density = 1.0f;
+    
+    /** The number of records (sample numbers) to put in each output file. */
+    size_t records_per_file = 1;
+    
+    /** The number of output files to write. */
+    size_t num_files = 1;
+    
+    /** Seed for the random number generator, so the same options always give the same files. */
+    uint32_t seed = 1;
+    
+    /** Directory to write output to; must exist. */
+    std::string output_dir;
+    
+    /** The base name of the output files; file index and extension will be appended. */
+    std::string base_name = "synthetic";
+    
+    /** The format to write; must be set, and currently only `SaveSpectrumAsType::N42_2012` and
+     `SaveSpectrumAsType::Pcf` (both of which can hold any number of records) are supported.
+     */
+    SpecUtils::SaveSpectrumAsType format;
+    
+    /** If true, will refuse to overwrite existing files. */
+    bool refuse_overwrite = true;
+  };//struct SyntheticSpectrumOptions
+  
+  
+  /** A gamma line that contributed to the synthetic spectra. */
+  struct SyntheticLine
+  {
+    const SandiaDecay::Nuclide *parent = nullptr;
+    
+    /** Energy of the line, in keV. */
+    float energy = 0.0f;
+    
+    /** Number of gammas, per second, emitted from the source (pre-shielding). */
+    double source_rate = 0.0;
+    
+    /** The expected (pre-noise) number of counts in the full-energy peak, for a single record. */
+    double expected_counts = 0.0;
+    
+    /** FWHM of the peak, in keV. */
+    float fwhm = 0.0f;
+  };//struct SyntheticLine
+  
+  
+  /** Computes the expected (noise free) channel counts, for a single record, along with the lines
+   that contribute to it.
+   
+   \param options The specification of the spectrum to compute.
+   \param lower_channel_energies The lower energies of each channel; will have one more entry than
+          there are channels.
+   \param expected_counts The expected counts of each channel (peaks and continuum).
+   \param lines The gamma lines that are within the energy range of the spectrum.
+   
+   Throws exception on invalid options (no DRF, DRF without resolution, no sources, etc.).
+   */
+  void expected_spectrum( const SyntheticSpectrumOptions &options,
+                          std::vector<float> &lower_channel_energies,
+                          std::vector<double> &expected_counts,
+                          std::vector<SyntheticLine> &lines );
+  
+  
+  /** Writes #SyntheticSpectrumOptions::num_files spectrum files, each with
+   #SyntheticSpectrumOptions::records_per_file Poisson-noise records of the expected spectrum, to
+   the output directory.
+   
+   Alongside each spectrum file a "<name>_truth.csv" file is written with the source definitions,
+   the expected full-energy-peak counts of each line, and the total actual counts of each record.
+   
+   Returns the paths of the spectrum files written.
+   
+   Throws exception on invalid options, or if files can not be written.
+   */
+  std::vector<std::string> generate_synthetic_files( const SyntheticSpectrumOptions &options );
+}//namespace BatchSynthetic
+
+#endif //BatchSynthetic_h
@@ -0,0 +1,121 @@
+#ifndef ChannelPrefixSum_h
+#define ChannelPrefixSum_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <vector>
+
+namespace SpecUtils
+{
+  class Measurement;
+  class EnergyCalibration;
+}
+
+
+/** Cumulative sums of a spectrums channel counts, and of its counts weighted by energy, so that the
+ counts (or mean energy) within any channel or energy range can be found in constant time, instead of
+ walking the channels.
+ 
+ Counts are assumed to be uniformly distributed within each channel, so for ranges that dont fall on
+ channel boundaries, the fraction of the channel within the range is used; this matches
+ `SpecUtils::Measurement::gamma_integral(...)`.
+ 
+ Instances are immutable, so may be shared between threads; use #get to retrieve them from a small
+ process-wide cache, so multiple tools (and repeated edits of an energy range) share one computation.
+ */
+class ChannelPrefixSum
+{
+public:
+  /** Computes the sums.
+   
+   @param counts The channel counts; must not be null.
+   @param cal The energy calibration; may be null or invalid, in which case only #channelSum may be
+          used.
+   
+   Throws std::exception if counts is null, or if the calibration has a different number of channels.
+   */
+  ChannelPrefixSum( const std::shared_ptr<const std::vector<float>> &counts,
+                    const std::shared_ptr<const SpecUtils::EnergyCalibration> &cal );
+  
+  size_t numChannels() const;
+  
+  /** Returns if an energy calibration was available, and hence energy ranges can be used. */
+  bool hasEnergyCalibration() const;
+  
+  /** Returns the sum of channels `first` through `last`, inclusive.
+   
+   Same semantics as `SpecUtils::Measurement::gamma_channels_sum(...)`: the order of the channels
+   doesnt matter, and the range is clamped to the spectrum.
+   */
+  double channelSum( size_t first, size_t last ) const;
+  
+  /** Returns the counts between the two energies, taking the fraction of the channels the energies
+   fall in.  Returns zero if there is no energy calibration.
+   */
+  double integral( double lower_energy, double upper_energy ) const;
+  
+  /** Returns the sum of counts times energy between the two energies; dividing by #integral gives
+   the mean energy of the counts in the range.
+   */
+  double energyWeightedIntegral( double lower_energy, double upper_energy ) const;
+  
+  /** Returns the cumulative sums for the spectrum, from a process-wide cache keyed on the spectrums
+   (immutable) counts and energy calibration objects.  Returns nullptr if the spectrum is null or has
+   no gamma counts.
+   */
+  static std::shared_ptr<const ChannelPrefixSum> get( const std::shared_ptr<const SpecUtils::Measurement> &meas );
+  
+  /** Convenience function equivalent to `meas->gamma_integral(lower_energy,upper_energy)`, but using
+   the cached sums; returns zero if the spectrum is null.
+   */
+  static double gamma_integral( const std::shared_ptr<const SpecUtils::Measurement> &meas,
+                                double lower_energy, double upper_energy );
+  
+  /** Convenience function equivalent to `meas->gamma_channels_sum(first,last)`, but using the cached
+   sums; returns zero if the spectrum is null.
+   */
+  static double gamma_channels_sum( const std::shared_ptr<const SpecUtils::Measurement> &meas,
+                                    size_t first, size_t last );
+  
+protected:
+  /** Returns the channel `energy` falls in, and the fraction of that channel below `energy`; the
+   channel will be the number of channels if `energy` is above the spectrum.
+   */
+  void channel_and_fraction( const double energy, size_t &channel, double &fraction ) const;
+  
+  std::shared_ptr<const std::vector<float>> m_counts;
+  std::shared_ptr<const std::vector<float>> m_energies;
+  
+  /** `m_cumulative[i]` is the sum of channels `[0,i)`; has one more entry than number of channels. */
+  std::vector<double> m_cumulative;
+  
+  /** `m_cumulative_energy[i]` is the sum, over channels `[0,i)`, of counts times channel center
+   energy; empty if no energy calibration.
+   */
+  std::vector<double> m_cumulative_energy;
+};//class ChannelPrefixSum
+
+#endif //ChannelPrefixSum_h
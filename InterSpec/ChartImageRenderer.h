@@ -0,0 +1,161 @@
+#ifndef ChartImageRenderer_h
+#define ChartImageRenderer_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Forward declarations
+class PeakDef;
+struct ColorTheme;
+namespace SpecUtils
+{
+  class SpecFile;
+  class Measurement;
+}//namespace SpecUtils
+
+
+/** Renders spectrum and time-series charts straight to SVG or PNG images, on the server, without
+ any widgets, WApplication, or browser involved.
+ 
+ The charts are drawn with a WPainter onto a Wt::WSvgImage, or Wt::WRasterImage (if Wt was built
+ with raster image support), so these functions may be called from batch analysis, the REST
+ service, or any thread of the GUI (e.g., to make file thumbnails).  Histograms with more channels
+ (or time samples) than there are pixel columns are decimated to the min/max envelope of each
+ column, so drawing cost depends on the image width, not the number of channels.
+ 
+ The look is deliberately simpler than the interactive D3 charts; there is no legend, reference
+ lines, or peak labels.
+ */
+namespace ChartImageRenderer
+{
+  enum class ImageFormat
+  {
+    Svg,
+    Png
+  };//enum class ImageFormat
+  
+  
+  /** Returns if Wt was built with WRasterImage support, i.e., if ImageFormat::Png may be used. */
+  bool png_supported();
+  
+  
+  /** Options common to all the charts. */
+  struct ChartImageOptions
+  {
+    int width_px = 800;
+    int height_px = 400;
+    ImageFormat format = ImageFormat::Svg;
+    
+    /** Colors to use; if nullptr, the default (light) colors are used. */
+    std::shared_ptr<const ColorTheme> theme;
+    
+    /** If true, axis titles are omitted, and padding minimized, to maximize the plot area; intended
+     for thumbnails.
+     */
+    bool compact = false;
+    
+    /** If non-empty, drawn at the top of the chart. */
+    std::string title;
+  };//struct ChartImageOptions
+  
+  
+  struct SpectrumImageOptions : public ChartImageOptions
+  {
+    /** Energy range to draw; if the upper energy is not larger than the lower, the full range of
+     the foreground is drawn.
+     */
+    double lower_energy = 0.0;
+    double upper_energy = 0.0;
+    
+    bool log_y = true;
+  };//struct SpectrumImageOptions
+  
+  
+  /** The minimum and maximum value of the points that fall into a single pixel column. */
+  struct MinMaxColumn
+  {
+    /** The x value (energy, or time) of the left edge of the column. */
+    double x;
+    double min_y;
+    double max_y;
+  };//struct MinMaxColumn
+  
+  
+  /** Decimates the `npoints` points, with x-values `x` (must be increasing), and y-values `y`, that
+   are within [x_lower, x_upper], into `ncolumns` equal-width columns, keeping the min and max
+   y-value in each column.  Columns with no points are omitted.
+   */
+  std::vector<MinMaxColumn> decimate_min_max( const float *x, const float *y, const size_t npoints,
+                                              const double x_lower, const double x_upper,
+                                              const int ncolumns );
+  
+  
+  /** Writes the spectrum chart image to `output`.
+   
+   @param foreground The spectrum to draw; must be non-null and have gamma counts.
+   @param background If non-null, drawn, scaled by the live-time ratio to the foreground.
+   @param peaks Gaussian peaks, and their continuums, are drawn over the foreground.
+   
+   Throws std::exception if the spectrum is invalid, or the image format isnt supported.
+   */
+  void render_spectrum( std::ostream &output,
+                        const std::shared_ptr<const SpecUtils::Measurement> &foreground,
+                        const std::shared_ptr<const SpecUtils::Measurement> &background,
+                        const std::deque<std::shared_ptr<const PeakDef>> &peaks,
+                        const SpectrumImageOptions &options );
+  
+  
+  /** Writes the gamma (and if present, neutron) count rate, of each sample number of `spec`, summed
+   over all detectors, to `output`.
+   
+   Throws std::exception if there are no samples, or the image format isnt supported.
+   */
+  void render_time_series( std::ostream &output,
+                           const SpecUtils::SpecFile &spec,
+                           const ChartImageOptions &options );
+  
+  
+  /** Convenience function to write a chart to a file; the image format is determined by the
+   extension (".png" or ".svg") of `filename`, overriding `options.format`.
+   
+   Throws std::exception on failure.
+   */
+  void write_spectrum_image( const std::string &filename,
+                             const std::shared_ptr<const SpecUtils::Measurement> &foreground,
+                             const std::shared_ptr<const SpecUtils::Measurement> &background,
+                             const std::deque<std::shared_ptr<const PeakDef>> &peaks,
+                             SpectrumImageOptions options );
+  
+  void write_time_series_image( const std::string &filename,
+                                const SpecUtils::SpecFile &spec,
+                                ChartImageOptions options );
+}//namespace ChartImageRenderer
+
+#endif //ChartImageRenderer_h
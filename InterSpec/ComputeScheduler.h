@@ -0,0 +1,88 @@
+#ifndef ComputeScheduler_h
+#define ComputeScheduler_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+#include <functional>
+
+
+/** Runs CPU-heavy analysis jobs (peak searches, DRF fits, shielding/source and relative activity
+ fits, etc.) on a dedicated set of threads, so they do not compete with handling web requests on the
+ Wt server io_service threads.
+ 
+ Jobs are queued per priority, and within each priority, per session; sessions take turns having
+ their next job run, so one user starting many jobs does not delay other users jobs.
+ At most #maxConcurrency jobs are run at a time; one thread is always left available for
+ #Priority::Interactive jobs (if the limit is more than one), so long-running batch jobs cant
+ starve interactive ones.
+ 
+ Like jobs posted to the Wt io_service, jobs should use `Wt::WServer::post(sessionid, ...)` to get
+ back to their session to update the GUI.
+ */
+class ComputeScheduler
+{
+public:
+  enum class Priority : int
+  {
+    /** Jobs the user is actively waiting on, that are expected to be fairly quick (e.g., fitting a
+     FWHM functional form, or an automated peak search).
+     */
+    Interactive = 0,
+    
+    /** Long-running jobs (e.g., shielding/source fits, relative activity calculations). */
+    Batch = 1
+  };//enum class Priority
+  
+  /** Queues a job to run.
+   
+   @param session_id The Wt session the job is for, used for fair queuing; may be empty for jobs
+          not associated with a session.
+   @param priority The priority class of the job.
+   @param job The function to run; exceptions thrown by it will be caught and logged.
+   @param supersede_key If non-empty, any job for the same session, with the same priority and
+          key, that has not yet started running will be removed from the queue (without being called)
+          before this job is queued.  Only use this for jobs where just the most recent result matters,
+          and that can be safely dropped (e.g., re-fitting as the user changes options).
+   */
+  static void post( const std::string &session_id,
+                    const Priority priority,
+                    std::function<void()> job,
+                    const std::string &supersede_key = "" );
+  
+  /** Removes all queued, but not yet started, jobs for the session; for use when a session ends. */
+  static void removeQueuedJobs( const std::string &session_id );
+  
+  /** The maximum number of jobs that will be ran at a time.
+   Defaults to the number of CPUs available to the process (minimum of two); see
+   SharedThreadPool::available_cpu_count.
+   */
+  static size_t maxConcurrency();
+  
+  /** Sets the maximum number of jobs ran at a time; values less than one are treated as one. */
+  static void setMaxConcurrency( const size_t max_jobs );
+};//class ComputeScheduler
+
+#endif //ComputeScheduler_h
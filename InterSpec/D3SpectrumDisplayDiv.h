@@ -4,8 +4,10 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <set>
 #include <chrono>
 #include <memory>
+#include <string>
 #include <vector>
 #include <utility>
 
@@ -336,6 +338,42 @@ protected:
   void renderBackgroundToClient();
   void renderSecondDataToClient();
   
+  /** Executes the JS to set a spectrum on the client (or queues it if not rendered yet), unless it
+   is identical to the JS last sent for that spectrum, as tracked by `last_hash`.
+   */
+  void sendSpectrumJsToClient( const std::string &js, size_t &last_hash );
+  
+  /** What the client has cached in one of its keyed stores (used for ROIs and reference lines), so
+   that only items that have changed need to be sent.
+   */
+  struct ClientKeyedStore
+  {
+    /** Version of the client store; zero if unknown, in which case everything gets sent. */
+    unsigned int m_version;
+    
+    /** Keys (hashes of the JSON) of the items the client has cached. */
+    std::set<std::string> m_keys;
+    
+    ClientKeyedStore() : m_version( 0 ), m_keys() {}
+  };//struct ClientKeyedStore
+  
+  /** Returns a JS expression that evaluates to the array of `items` (each a JSON object), by sending
+   only the items the client doesnt already have in the keyed store named `name`, along with the
+   ordered list of keys.  Items are keyed by a hash of their JSON, so a changed item is sent as an
+   insert of the new item, and a delete of the old one.
+   
+   The client side checks the version it has against the one the delta is based on; if they dont
+   match (e.g., the chart was re-created), the expression evaluates to null, and the client asks for
+   the full list to be re-sent (see #keyedStoreResyncCallback).
+   */
+  std::string keyedStoreDeltaJs( const std::string &name, const std::vector<std::string> &items,
+                                 ClientKeyedStore &store );
+  
+  /** Called from the client when it couldnt apply a keyed store delta; resets our knowledge of the
+   client store, and schedules sending the full contents.
+   */
+  void keyedStoreResyncCallback( const std::string &name );
+  
   
   void defineJavaScript();
   
@@ -450,6 +488,8 @@ protected:
   
   std::unique_ptr<Wt::JSignal<> > m_legendClosedJS;
   
+  std::unique_ptr<Wt::JSignal<std::string> > m_keyedStoreResyncJS;
+  
   // Wt Signals
   //for all the bellow, the doubles are all the <x,y> coordinated of the action
   //  where x is in energy, and y is in counts.
@@ -552,11 +592,32 @@ protected:
    */
   std::vector<std::string> m_pendingJs;
   
+  /** Hashes of the JS last sent to the client to set the foreground, background, and secondary
+   spectra (zero if unknown).  Used to avoid re-sending identical spectrum JSON, which can be
+   hundreds of kB for high-resolution spectra, when a re-summed spectrum or scale factor hasnt
+   actually changed.  Reset whenever the client-side chart is (re)created.
+   */
+  size_t m_foregroundJsHash;
+  size_t m_backgroundJsHash;
+  size_t m_secondaryJsHash;
+  
+  /** State of the client-side keyed stores of foreground ROIs, and reference lines. */
+  ClientKeyedStore m_clientRoiStore;
+  ClientKeyedStore m_clientRefLineStore;
+  
   
   std::chrono::steady_clock::time_point m_last_drag_time;
   std::shared_ptr<const PeakContinuum> m_continuum_being_drug;
   std::vector<std::shared_ptr<const PeakDef>> m_last_being_drug_peaks;
   
+  /** The {first, last} channels of the ROI that `m_last_being_drug_peaks` were fit over.
+   
+   Most drag updates do not move the ROI edge across a channel boundary, and since the fit only
+   depends on which channels are in the ROI, we can re-use `m_last_being_drug_peaks` for these,
+   instead of re-fitting.
+   */
+  std::pair<size_t,size_t> m_last_drag_channels;
+  
 #if( INCLUDE_ANALYSIS_TEST_SUITE )
   friend class SpectrumViewerTester;
 #endif
@@ -4,11 +4,12 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <tuple>
 #include <memory>
 #include <vector>
 #include <utility>
 
-//#include <boost/optional.hpp>
+#include <boost/optional.hpp>
 
 #include <Wt/WColor>
 #include <Wt/WEvent>
@@ -25,6 +26,7 @@ struct ColorTheme;
 namespace Wt
 {
   class WCssTextRule;
+  class WMemoryResource;
 }//namespace Wt
 
 namespace SpecUtils
@@ -81,6 +83,9 @@ public:
   void setHighlightedIntervals( const std::set<int> &sample_numbers,
                                 const SpecUtils::SpectrumType type );
   
+  /** Renders the time chart on the server (see ChartImageRenderer), and prompts the user to
+   download it.  If Wt wasnt built with PNG support, a SVG is downloaded instead.
+   */
   void saveChartToPng( const std::string &filename );
 
   /** Signal when the user clicks on the chart.
@@ -169,6 +174,24 @@ protected:
   void setDataToClient();
   void setHighlightRegionsToClient();
   
+  /** Per-sample gamma sums over an energy range, for each displayed detector; defined in D3TimeChart.cpp. */
+  struct EnergyRangeSums;
+  
+  /** Returns the gamma counts between the energies (either bound may be omitted) of each displayed
+   detector, for each sample sent to the client, computing them if they arent already cached.
+   
+   If `use_full_sum` is true, and the energy range covers a records full spectrum, the records total
+   gamma count sum is used (as for the counts to plot), otherwise the integral is always computed
+   (as for the normalization range).
+   
+   Results are cached per energy range, so toggling between, or returning to, a filter the user has
+   already used does not have to re-integrate every spectrum.  Cached results are checked against
+   the records gamma counts and energy calibrations before being used.
+   */
+  std::shared_ptr<const EnergyRangeSums> energyRangeSums( const boost::optional<float> &lowerEnergy,
+                                                          const boost::optional<float> &upperEnergy,
+                                                          const bool use_full_sum );
+  
   /** Shows or hides the user-selectable filters to control what the mouse/touch selects and energy range. */
   void showFilters( const bool show );
   
@@ -257,6 +280,11 @@ protected:
   std::shared_ptr<const SpecUtils::SpecFile> m_spec;
   std::vector<std::string> m_detectors_to_display;
   
+  /** Cache for #energyRangeSums, keyed by {has lower energy, lower energy, has upper energy, upper
+   energy, use full sum}.  Cleared when the data or displayed detectors change.
+   */
+  std::map<std::tuple<bool,float,bool,float,bool>,std::shared_ptr<EnergyRangeSums>> m_energyRangeSums;
+  
   struct HighlightRegion
   {
     int start_sample_number;
@@ -324,6 +352,9 @@ protected:
   
   std::map<std::string,Wt::WCssTextRule *> m_cssRules;
   
+  /** The image last created by #saveChartToPng, for the user to download. */
+  Wt::WMemoryResource *m_imageResource;
+  
   /** JS calls requested before the widget has been rendered, so wouldnt have
      ended up doing anything are saved here, and then executed once the widget
      is rendered.
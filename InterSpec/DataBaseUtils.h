@@ -43,21 +43,15 @@ namespace  Wt
 }//namespace  Wt
 
 
-#if( USE_MYSQL_DB )
 //Before 20141014, we were having trouble keeping a single MySQL connection
 //  pool open on Hekili, so we switched to creating a new connection everytime
-//  a session is created.  This adds overhead whenever a new InterSpec
-//  is created, but avoid the issue of stale connections.
-//  Ideally we would like to fix the timeout issue with MySQL, so this
-//  workaround doesnt have to be used, but its kinda a pain to diagnose and
-//  debug this issue.
-//  If you are using the SQLite3 database backend, then this problem doesnt
-//  exist, so we will default to using a global connection pool to avoid this
-//  extra overhead.
-#define USE_GLOBAL_DATABASE_CONNECTION_POOL 0
-#else
+//  a session is created.  This added overhead whenever a new InterSpec
+//  was created (and lost Wt::Dbo's per-connection cache of prepared
+//  statements), but avoided the issue of stale connections.
+//  The global pool now checks connections that have been idle for a while
+//  (see DataBaseUtils.cpp) before handing them out, and replaces them if they
+//  have gone stale, so we use the global pool for MySQL as well.
 #define USE_GLOBAL_DATABASE_CONNECTION_POOL 1
-#endif
 
 namespace DataBaseUtils
 {
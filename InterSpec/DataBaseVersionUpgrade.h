@@ -42,6 +42,9 @@ namespace DataBaseVersionUpgrade
    
   std::shared_ptr<Wt::Dbo::Session>
               getSession( std::unique_ptr<Wt::Dbo::SqlConnection> &db );
+  
+  /** Deletes SpectrumFileBlob entries no longer referenced by any file; errors are logged, not thrown. */
+  void removeUnreferencedBlobs( std::unique_ptr<Wt::Dbo::SqlConnection> &db );
 }//namespace DataBaseVersionUpgrade
 
 #endif
@@ -35,13 +35,18 @@ namespace Wt
   class WTreeView;
 }//namespace Wt
 
+namespace DbStateBrowserImp
+{
+  class StateListModel;
+}//namespace DbStateBrowserImp
+
 class DbStateBrowser : public AuxWindow
 {
 protected:
   
   std::shared_ptr<DataBaseUtils::DbSession> m_session;
   InterSpec  *m_viewer;
-  Wt::Dbo::QueryModel< Wt::Dbo::ptr<UserState> >    *m_model;
+  DbStateBrowserImp::StateListModel *m_model;
   Wt::WTreeView      *m_table;
   Wt::WPushButton     *m_loadButton;
 public:
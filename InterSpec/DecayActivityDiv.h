@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <deque>
 #include <string>
 #include <vector>
 #include <memory>
@@ -224,6 +225,37 @@ public:
   int m_currentNumXPoints;
   
   SandiaDecay::NuclideMixture            *m_currentMixture;
+  
+  /** A string encoding the nuclides, activities, and ages m_currentMixture was last filled from, so
+   updateInitialMixture() can skip re-building the mixture (and having SandiaDecay re-solve the decay
+   chains) when nothing has changed.
+   */
+  mutable std::string m_currentMixtureKey;
+  
+  /** The y-values of each nuclide, at each time-point of the chart, before dividing by the display
+   units.  Kept so re-drawing the chart for a mixture and time range already computed (e.g., changing
+   activity units, or zooming back out) does not have to re-evaluate anything.
+   */
+  struct ActivityTable
+  {
+    std::string mixture_key;
+    double end_time;
+    int num_rows;
+    int y_axis_type;
+    std::vector<const SandiaDecay::Nuclide *> nuclides;
+    
+    /** Indexed as `row*nuclides.size() + nuclide_index`; NaN or Inf values should be skipped. */
+    std::vector<double> values;
+  };//struct ActivityTable
+  
+  /** Most recently used table is at the front. */
+  std::deque<std::shared_ptr<const ActivityTable>> m_activityTableCache;
+  
+  /** Returns the table for the current mixture, y-axis type, time range and resolution, computing
+   it if it isnt cached.
+   */
+  std::shared_ptr<const ActivityTable> activityTable( const int y_axis_type, const double end_time,
+                                                      const int num_rows );
 
 
   //Functions for dealing with adding new nuclides
@@ -27,6 +27,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 #include <Wt/WPainter>
 #include <Wt/WPaintedWidget>
@@ -35,6 +36,7 @@
 namespace Wt
 {
   class WDialog;
+  class WServer;
   class WComboBox;
   class WPaintDevice;
 }//namespace Wt
@@ -98,6 +100,14 @@ public:
   void setJsonForDecaysFrom( const SandiaDecay::Nuclide * const nuclide );
   void setJsonForDecaysThrough( const SandiaDecay::Nuclide * const nuclide );
   
+  /** Adds a server-wide resource that serves the (process-wide cached) decay chain JSON, so clients
+   load the chain data from a URL that browsers and proxies can cache, instead of it being sent inline
+   with the JavaScript.  If this is not called, the JSON is sent inline (but still cached).
+   
+   Must be called before the server is started.
+   */
+  static void addJsonResourceToServer( Wt::WServer *server );
+  
   /** Emmited in setNuclide(...), when nuclide actually changes */
   Wt::Signal<const SandiaDecay::Nuclide *> &nuclideChanged();
   
@@ -139,6 +149,12 @@ protected:
    */
   void showDecaysThrough( const std::string nuc );
   
+  /** Sends the decay data for #m_nuclide to the client, using the process-wide cache of chain JSON,
+   and building the JSON (with `write_json`) if it isnt already cached.
+   */
+  void setDecayDataJson( const bool decayFrom,
+                         const std::function<void(Wt::WStringStream &)> &write_json );
+  
 private:
   /** Whether to use Curies or Bequerels for displaying specific activity. */
   bool m_useCurie;
@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <mutex>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -57,9 +58,74 @@ private:
   
   static std::mutex sm_dataBaseMutex;
   static SandiaDecay::SandiaDecayDataBase sm_dataBase;
+  
+  /** Set (after #sm_dataBase is fully initialized) so that #database() and #initialized() can
+   return without locking #sm_dataBaseMutex; once the database is initialized it is never
+   modified again.
+   */
+  static std::atomic<bool> sm_initialized;
 };//class DecayDataBaseServer
 
 
+/** A process-wide, bounded, cache of the photons given off by a single nuclide (and its progeny)
+ after it has aged; the same nuclide and age get decayed many times per user action by the
+ reference lines, shielding/source fits, isotope ID, relative activity, etc.
+ 
+ Results are for 1 becquerel of the parent nuclide at time zero (i.e., before aging), so callers
+ should multiply by the initial activity of their parent nuclide.  Ages are quantized to
+ #sm_ageSignificantFigures significant figures, and the result is computed at the quantized age,
+ so all callers of a given key get identical results.
+ 
+ Thread safe.
+ */
+class DecayedPhotonCache
+{
+public:
+  enum class Emissions
+  {
+    /** Gammas, x-rays, and annihilation photons; same as `NuclideMixture::photons(...)`. */
+    Photons,
+    
+    /** Gammas and annihilation photons; same as `NuclideMixture::gammas(..., true)`. */
+    GammasAndAnnihilation,
+    
+    /** Only gammas; same as `NuclideMixture::gammas(..., false)`. */
+    Gammas
+  };//enum class Emissions
+  
+  typedef std::shared_ptr<const std::vector<SandiaDecay::EnergyRatePair>> PhotonsPtr;
+  
+  /** Returns the photons of 1 Bq (at time zero) of `nuclide`, after aging `age` (in units of
+   SandiaDecay::second).
+   
+   Throws exception if `nuclide` is null, or `age` is negative or not finite.
+   */
+  static PhotonsPtr photons( const SandiaDecay::Nuclide *nuclide, const double age,
+                             const Emissions emissions,
+                             const SandiaDecay::NuclideMixture::HowToOrder order );
+  
+  /** Returns the photons of `nuclide` that has `activity` after aging `age`, i.e., the same as
+   adding the nuclide to a mixture using `NuclideMixture::addAgedNuclideByActivity(...)`, and
+   getting the photons at time zero.
+   
+   Returns an empty vector if the parents activity at `age` is too small to scale from.
+   */
+  static std::vector<SandiaDecay::EnergyRatePair> photons_for_aged_activity(
+                                         const SandiaDecay::Nuclide *nuclide, const double activity,
+                                         const double age, const Emissions emissions,
+                                         const SandiaDecay::NuclideMixture::HowToOrder order );
+  
+  /** The age (rounded to #sm_ageSignificantFigures) results are computed, and cached, at. */
+  static double quantize_age( const double age );
+  
+  /** Removes all cached results. */
+  static void clear();
+  
+  static const int sm_ageSignificantFigures = 7;
+  static const size_t sm_maxEntries = 2048;
+};//class DecayedPhotonCache
+
+
 class EnergyToNuclideServer
 {
   public:
@@ -78,6 +144,35 @@ class EnergyToNuclideServer
   // - TODO - should consider switching from a vector to a deque
   typedef std::vector<EnergyNuclidePair> EnergyNuclidePairVec;
   
+  /** An entry of the (unfiltered) index of all gammas and annihilation photons in the database,
+   holding the quantities #initGammaToNuclideMatches filters on, so the index can be filtered
+   for any half-life and intensity limits without having to be rebuilt.
+   */
+  struct IndexedGamma
+  {
+    float energy;
+    const SandiaDecay::Nuclide *nuclide;
+    
+    /** The fraction of the photons (counting two per positron) from the decay of `nuclide` that
+     this line makes up.
+     */
+    float intensity;
+    
+    /** The half-life of `nuclide`. */
+    double halfLife;
+    
+    /** The largest half-life of any of the forebearers of `nuclide`; zero if it has none. */
+    double maxForebearerHalfLife;
+    
+    /** Returns if this line would be kept by #initGammaToNuclideMatches for the given limits. */
+    bool passes( const double min_halflife, const double min_gamma_intensity ) const;
+    
+    bool operator<( const IndexedGamma &rhs ) const;
+  };//struct IndexedGamma
+  
+  /** Sorted by energy; lines with the same energy are in database order. */
+  typedef std::vector<IndexedGamma> GammaIndex;
+  
 public:
   //matcher() will throw if it is unable to initialse the database
   //  so you may wish to call DecayDataBaseServer::setDecayXmlFile(...) or
@@ -89,6 +184,11 @@ public:
 
   static void unintialize();
   
+  /** Returns the unfiltered index of all gammas; built the first time this function is called
+   (which may throw if the decay database can not be initialized), and never modified afterwards.
+   */
+  static std::shared_ptr<const GammaIndex> gammaIndex();
+  
   static void setLowerLimits( const double halfLife, const double branchRatio );
   static double minHalfLife();
   static double minBranchingRatio();
@@ -98,6 +198,15 @@ private:
   static double sm_halfLife;
   static double sm_branchRatio;
   static std::shared_ptr< const EnergyNuclidePairVec > sm_energyToNuclide;
+  static std::shared_ptr< const GammaIndex > sm_gammaIndex;
+  
+  /** Set (after #sm_gammaIndex is assigned) so #gammaIndex() can return without locking #sm_mutex;
+   #sm_gammaIndex is never changed after it is first built.
+   */
+  static std::atomic<bool> sm_gammaIndexReady;
+  
+  /** Returns #sm_gammaIndex, building it if necessary; #sm_mutex must be locked. */
+  static std::shared_ptr<const GammaIndex> gammaIndexLocked();
 
 
 public:
@@ -127,6 +236,16 @@ public:
                                  const double min_halflife,
                                  const double min_gamma_intensity );
   
+  /** Builds the unfiltered index of all gammas in the database. */
+  static void initGammaIndex( const SandiaDecay::SandiaDecayDataBase *database, GammaIndex &results );
+  
+  /** Fills `results` with the entries of `index` passing the limits (see
+   #initGammaToNuclideMatches); the same result as #initGammaToNuclideMatches, but in O(N).
+   */
+  static void filterGammaIndex( const GammaIndex &index, EnergyNuclidePairVec &results,
+                                const double min_halflife,
+                                const double min_gamma_intensity );
+  
   //nuclidesWithGammaInRange(...) returns nuclides with gammas in the specified
   //  range.  Note that the range are inclusive, and it is assumed gammaToNuc
   //  is sorted.
@@ -134,6 +253,14 @@ public:
                                                         float highE,
                                                         const EnergyNuclidePairVec &gammaToNuc );
   
+  //nuclidesWithGammaInRange(...) returns nuclides with gammas in the specified
+  //  range, that pass the half-life and intensity limits (see initGammaToNuclideMatches), using
+  //  gammaIndex(); takes O(log(N) + k), and does not change, or depend on, setLowerLimits(...).
+  static std::vector<const SandiaDecay::Nuclide *> nuclidesWithGammaInRange( float lowE,
+                                                        float highE,
+                                                        const double min_halflife,
+                                                        const double min_gamma_intensity );
+  
   //nuclidesWithGammaInRange(...) returns nuclides with gammas in the specified
   //  range by looping over all input candidates.
   //  Can be computationally very slow if aging is allowed.
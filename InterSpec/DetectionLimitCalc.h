@@ -25,8 +25,11 @@
 
 #include "InterSpec_config.h"
 
+#include <vector>
 #include <memory>
+#include <vector>
 #include <ostream>
+#include <functional>
 
 #include "InterSpec/PeakDef.h"
 
@@ -43,6 +46,11 @@ namespace SpecUtils
 class Measurement;
 }//namespace SpecUtils
 
+namespace SandiaDecay
+{
+struct Nuclide;
+}//namespace SandiaDecay
+
 
 /** This header/src file holds the non-gui aware code for calculating minimum detectable activity (MDA), and detection confidence
  intervals.
@@ -270,6 +278,100 @@ std::pair<size_t,size_t> round_roi_to_channels( std::shared_ptr<const SpecUtils:
 CurrieMdaResult currie_mda_calc( const CurrieMdaInput &input );
 
 
+/** Performs #currie_mda_calc for each of the inputs, in parallel, returning results in the same order as the inputs.
+ 
+ The Currie-style result is in counts, so it does not depend on distance, activity, or shielding (these only enter when converting the
+ counts to activity); identical inputs are only computed once, so a sweep over these quantities only costs a single calculation per ROI.
+ 
+ Will throw exception if any of the inputs are invalid.
+ */
+std::vector<CurrieMdaResult> currie_mda_calc( const std::vector<CurrieMdaInput> &inputs );
+
+
+/** The input to #currie_mda_all_lines: a nuclide, and the measurement geometry, to compute a Currie-style MDA for each of its
+ significant photopeaks.
+ */
+struct NuclideCurrieMdaInput
+{
+  /** The spectrum to compute limits on; its live-time is used to convert counts to activity. */
+  std::shared_ptr<const SpecUtils::Measurement> spectrum;
+  
+  const SandiaDecay::Nuclide *nuclide;
+  
+  /** Age of the nuclide, in seconds (i.e., SandiaDecay units), for the progeny photopeaks. */
+  double age;
+  
+  /** Must have a valid efficiency and resolution. */
+  std::shared_ptr<const DetectorPeakResponse> drf;
+  
+  /** Distance (in PhysicalUnits) from source to detector; not used for fixed-geometry DRFs.
+   Air attenuation is included for non-zero distances, for non-fixed-geometry DRFs.
+   */
+  double distance;
+  
+  /** Fraction of gammas, of a given energy (in keV), that make it through the shielding.
+   
+   If empty, a transmission of 1.0 is used.
+   */
+  std::function<double(float)> transmission;
+  
+  /** Photopeaks whose expected detected counts are less than this fraction of the largest photopeaks are not considered;
+   typically something like 0.001.
+   */
+  double min_relative_yield;
+  
+  /** The half-width, in FWHM, of the region of each photopeak; 1.25 is recommended by ISO 11929:2010. */
+  float num_fwhm;
+  
+  /** Number of channels on each side of the peak region used to estimate the continuum. */
+  size_t num_side_channels;
+  
+  /** See #CurrieMdaInput::detection_probability. */
+  double detection_probability;
+  
+  /** See #CurrieMdaInput::additional_uncertainty. */
+  float additional_uncertainty;
+  
+  /** Default constructor sets a reasonable default for each (non-pointer) member. */
+  NuclideCurrieMdaInput();
+};//struct NuclideCurrieMdaInput
+
+
+/** The Currie-style limit for a single ROI of #currie_mda_all_lines. */
+struct NuclideLineCurrieMda
+{
+  /** The photopeak energies (in keV) and their yields (per decay) in this ROI; photopeaks whose regions would overlap are
+   combined into a single ROI, since the gross counts in the region include all of them.
+   */
+  std::vector<std::pair<float,double>> energies_and_yields;
+  
+  /** Expected counts in the ROI, per Bq of the nuclide, accounting for shielding, attenuation, efficiency, and live-time. */
+  double counts_per_bq;
+  
+  CurrieMdaResult result;
+  
+  /** The minimum detectable activity (in PhysicalUnits), i.e., `result.detection_limit / counts_per_bq`. */
+  double mda;
+  
+  /** The activity (in PhysicalUnits) corresponding to `result.upper_limit`. */
+  double upper_limit_activity;
+  
+  /** The activity (in PhysicalUnits) corresponding to `result.lower_limit`; may be negative. */
+  double lower_limit_activity;
+};//struct NuclideLineCurrieMda
+
+
+/** Computes Currie-style limits for all significant photopeaks of a nuclide, returning results ranked by #NuclideLineCurrieMda::mda,
+ so the first entry gives the nuclides MDA.
+ 
+ The ROIs are computed in parallel (see the vector form of #currie_mda_calc), with the continuum sums shared via the spectrums
+ channel prefix-sum, and overlapping regions are combined.  ROIs that dont fit within the spectrum are skipped.
+ 
+ Will throw exception if input is invalid, or no photopeaks could be evaluated.
+ */
+std::vector<NuclideLineCurrieMda> currie_mda_all_lines( const NuclideCurrieMdaInput &input );
+
+
 /** How the continuum for peaks should be normalized.
  */
 enum class DeconContinuumNorm : int
@@ -443,6 +545,38 @@ struct DeconComputeResults
  */
 DeconComputeResults decon_compute_peaks( const DeconComputeInput &input );
 
+
+/** A single point of a grid of deconvolution computations; see #decon_compute_peaks_grid. */
+struct DeconGridPoint
+{
+  double distance;
+  double activity;
+  
+  /** See #DeconComputeInput::shielding_thickness. */
+  double shielding_thickness;
+  
+  /** Fraction of gammas, of a given energy (in keV), through the shielding of this point, relative to the base input; i.e., each
+   #DeconRoiInfo::PeakInfo::counts_per_bq_into_4pi is multiplied by this value.
+   
+   If empty, a transmission of 1.0 is used.
+   */
+  std::function<double(float)> transmission;
+  
+  /** Default constructor that just zeros things out. */
+  DeconGridPoint();
+};//struct DeconGridPoint
+
+
+/** Computes #decon_compute_peaks for each (distance, activity, shielding) point, with the other quantities taken from \p base_input.
+ 
+ The ROI continuums (including the fits for #DeconContinuumNorm::FixedByFullRange) are shared between all points, and the points
+ are computed in parallel.  Results are returned in the same order as \p points.
+ 
+ Throws exception if any of the points are invalid, or there is an error during the calculation.
+ */
+std::vector<DeconComputeResults> decon_compute_peaks_grid( const DeconComputeInput &base_input,
+                                                           const std::vector<DeconGridPoint> &points );
+
   
 struct DeconActivityOrDistanceLimitResult
 {
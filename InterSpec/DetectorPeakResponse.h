@@ -80,6 +80,7 @@ namespace rapidxml
 
 //Forward declarations
 struct FormulaWrapper;
+struct DrfLookupTables;
 
 
 class DetectorPeakResponse
@@ -531,6 +532,15 @@ public:
   Returns null function if not available.
   */
   std::function<float( float )> intrinsicEfficiencyFcn() const;
+  
+  /** Returns #intrinsicEfficiency for each of the energies, in a single call.
+   
+   For formula based efficiencies, the (compiled) formula is evaluated for all energies at once, which is considerably faster than
+   calling #intrinsicEfficiency for each energy; e.g., for getting the efficiency of every channel of a spectrum.
+   
+   Will throw `std::runtime_exception` if this object has not been initialized.
+   */
+  std::vector<float> intrinsicEfficiencies( const std::vector<float> &energies ) const;
 
   /** Gives the fraction of gammas or x-rays from a point source that would strike the detector crystal.
    
@@ -541,6 +551,9 @@ public:
    
    Note: For a detector diameter of 5cm, you might start running into numerical accuracy
    issues for distances around 100 km.
+   
+   This is the exact, closed-form, on-axis solid angle (a single sqrt), so is cheap enough to call
+   for every efficiency evaluation; there is no need to tabulate or cache it.
    */
   static double fractionalSolidAngle( const double detector_diameter,
                                      const double observation_distance ) noexcept;
@@ -555,7 +568,9 @@ public:
    @param source_radius The radius of the flat, round plane, source, in units of PhysicalUnits.
    
    Note: Source is assumed to be flat round plane.
-   Note: see pg 119 in Knoll for details on approximation used.
+   Note: see pg 119 in Knoll for details on approximation used; it is a series in
+         (source_radius/distance)^2, so is only accurate when the source and detector radii are
+         somewhat smaller than the distance.
    */
   static double fractionalSolidAngle( const double detector_diameter,
                                      const double observation_distance,
@@ -578,6 +593,22 @@ public:
                                     ResolutionFnctForm fcnFrm,
                                     const std::vector<float> &pars );
 
+  /** Sets the relative accuracy of optional lookup tables for #intrinsicEfficiency and #peakResolutionFWHM.
+   
+   When the accuracy is greater than zero, a dense energy grid (uniform in log-energy, over the DRFs energy range, or 10 keV to
+   3 MeV if not defined) of each quantity is lazily computed the first time it is needed, and then evaluated with monotone cubic
+   interpolation; the grid is made dense enough that interpolation is within \p rel_accuracy at grid midpoints, or else the table
+   isnt used.  Energies outside the grid are evaluated directly.  This makes formula based efficiencies (which are slow to evaluate,
+   and serialize across threads) about as cheap as the other forms.
+   
+   The tables are re-built whenever the DRF changes (i.e., its hash changes).
+   The default accuracy is zero, meaning no lookup tables are used.  This setting is not serialized.
+   */
+  void setLookupTableAccuracy( const double rel_accuracy );
+  
+  /** Returns value set by #setLookupTableAccuracy; zero if lookup tables are not used. */
+  double lookupTableAccuracy() const;
+  
   
   //Simple accessors
   float detectorDiameter() const;
@@ -720,12 +751,20 @@ public:
 protected:
   void computeHash();
   
+  /** Creates a new (empty) #m_lookupTables for the current hash value, if lookup tables are enabled; called whenever the DRF
+   may have changed.
+   */
+  void resetLookupTables();
+  
 protected:
   //intrinsicEfficiencyFrom...(...) functions assume energy is input in keV
   float intrinsicEfficiencyFromPairs( float energy ) const;
   float intrinsicEfficiencyFromFcn( float energy ) const;
   float intrinsicEfficiencyFromExpLnEqn( float energy ) const;
   
+  /** Evaluates the intrinsic efficiency without using lookup tables. */
+  float intrinsicEfficiencyNoLookup( const float energy ) const;
+  
   std::string m_name;
   std::string m_description;
 
@@ -825,6 +864,14 @@ protected:
    */
   EffGeometryType m_geomType;
   
+  /** Relative accuracy of the lookup tables; zero if not being used.  See #setLookupTableAccuracy. */
+  double m_lookupTableAccuracy;
+  
+  /** The lazily computed lookup tables; only used if its hash value matches #m_hash.  Copies of this DRF will share the tables,
+   until one of them is modified.
+   */
+  std::shared_ptr<DrfLookupTables> m_lookupTables;
+  
   /** On 20230916 updated from version 0 to 1, to account for `m_fixedGeometry` - will still write version 0 if
    `m_geomType == EffGeometryType::FarField`.
    
@@ -118,5 +118,35 @@ namespace DoseCalc
                                     const float atomic_number,
                                     const float distance,
                                     const GadrasScatterTable &scatter );
+  
+  
+  /** A shielding and distance to compute dose for; see #gamma_dose_with_shielding. */
+  struct ShieldingConfiguration
+  {
+    /** Areal density of shielding, in units of PhysicalUnits. */
+    float areal_density;
+    
+    /** Atomic number of the shielding. */
+    float atomic_number;
+    
+    /** Distance from center of source to location of interest, in units of PhysicalUnits. */
+    float distance;
+  };//struct ShieldingConfiguration
+  
+  
+  /** Computes #gamma_dose_with_shielding for each of the configurations (e.g., a sweep over
+   shielding thickness, material, and distance), in parallel, returning the doses in the same order
+   as the configurations.
+   
+   Configurations that only differ in distance, and are all within the distance air attenuation
+   starts being accounted for (3 m), share a single calculation, since dose then just goes as
+   one over distance squared.
+   
+   Will throw exception if any of the configurations are invalid.
+   */
+  std::vector<double> gamma_dose_with_shielding( const std::vector<float> &energies,
+                                    const std::vector<float> &intensity,
+                                    const std::vector<ShieldingConfiguration> &configurations,
+                                    const GadrasScatterTable &scatter );
 }//namespace DoseCalc
 #endif //DoseCalc_h
@@ -148,7 +148,7 @@ protected:
   //  PhysicalUnits.
   double currentDose();
   
-  std::unique_ptr<GadrasScatterTable> m_scatter;
+  std::shared_ptr<const GadrasScatterTable> m_scatter;
   
   InterSpec *m_viewer;
   Wt::WSuggestionPopup *m_materialSuggest;
@@ -47,13 +47,33 @@ protected:
   Wt::WStandardItemModel* m_efficiencyModel;
   
   std::shared_ptr<const DetectorPeakResponse> m_detector;
-
+  
+  /** The number of energies the currently shown curves were sampled at; zero if no curves. */
+  int m_numSampledPoints;
+  
+  /** Width of the chart, in pixels, as of the last #layoutSizeChanged call; -1 before it's known. */
+  int m_layoutWidth;
+  
+  /** The number of energies to sample the curves at, based on the chart width; there is no point
+   sending the client more than about one point per two pixels.
+   */
+  int numSamplePoints() const;
+  
+  /** Re-samples the curves of #m_detector into the model, and sets up the series and axes. */
+  void sampleCurves();
+  
+  virtual void layoutSizeChanged( int width, int height );
   
 public:
   DrfChart( Wt::WContainerWidget *parent = 0 );
   
   void handleColorThemeChange( std::shared_ptr<const ColorTheme> theme );
   
+  /** Shows the efficiency and FWHM of `det`.
+   
+   Does nothing if `det` is the same DRF as currently shown (as determined by
+   #DetectorPeakResponse::hashValue), so is cheap to call as users browse DRFs.
+   */
   void updateChart( std::shared_ptr<const DetectorPeakResponse> det );
 };//class DrfChart
 
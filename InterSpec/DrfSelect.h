@@ -219,6 +219,13 @@ public:
       Throws exception in error; returned detector should always be valid.
    */
   static std::shared_ptr<DetectorPeakResponse> initAGadrasDetectorFromDirectory( const std::string &directory );
+  
+  /** Loads the persistent GADRAS DRF index, and brings it up to date for the generic DRFs in the
+   static data directory, so the first session to show the DRF selection doesnt have to do this.
+   
+   Blocking; intended to be called from a background thread at server start.
+   */
+  static void indexGenericGadrasDetectors();
 
   //Will init detector in the static and user data folders, and return the first DRF that matches
   //  DetectorType, or the manufacturer/model.
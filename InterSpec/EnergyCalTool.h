@@ -173,6 +173,12 @@ public:
   
   void refreshGuiFromFiles();
   
+  /** Called once the user releases a right-mouse-drag on the spectrum chart; shows (or updates) the
+   #EnergyCalGraphicalConfirm dialog for shifting `xstart` to `xfinish`.
+   
+   While dragging, the chart only draws the recalibration lines client-side; no calibration is
+   changed on the server until the user applies it from the dialog.
+   */
   void handleGraphicalRecalRequest( double xstart, double xfinish );
   
   void deleteGraphicalRecalConfirmWindow();
@@ -46,8 +46,8 @@ public:
   Wt::Signal<std::string,std::string > &fileDrop(); //<display_name,spool_name>
 
 protected:
-  //XXX - It's assuming handleRequest(...) is only called once all the data
-  //      is uploaded.  See implementation for other possible issues.
+  //Wt only calls handleRequest(...) once all the data is uploaded; the data
+  //  is then written to a spool file, and fileDrop() emitted.
   virtual void handleRequest( const Wt::Http::Request& request,
                               Wt::Http::Response& response );
 
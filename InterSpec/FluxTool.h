@@ -47,6 +47,7 @@
 //  for the moment until I do some more testing.
 #define FLUX_USE_COPY_TO_CLIPBOARD 1
 
+class PeakDef;
 class InterSpec;
 class FluxToolWidget;
 class DetectorDisplay;
@@ -204,10 +205,47 @@ protected:
   std::vector<std::array<double,FluxColumns::FluxNumColumns>> m_data;
   std::vector<std::array<double,FluxColumns::FluxNumColumns>> m_uncertainties;
   
+  /** If the last #refreshPeakTable gave the same number of rows as before, this has an entry for
+   each row of #m_data, indicating if that rows values changed; the table model then only needs to
+   re-render those rows.  Empty if the rows were added or removed.
+   */
+  std::vector<bool> m_rowChanged;
+  
   friend class FluxToolWindow;
   friend class FluxToolImp::FluxModel;
   friend class FluxToolImp::FluxCsvResource;
 };//class FluxToolWidget
 
+
+namespace FluxToolImp
+{
+  /** The values of a single row of the flux table (i.e., for a single peak). */
+  struct FluxRow
+  {
+    std::string nuclide;
+    std::array<double,FluxToolWidget::FluxColumns::FluxNumColumns> data;
+    std::array<double,FluxToolWidget::FluxColumns::FluxNumColumns> uncertainties;
+  };//struct FluxRow
+  
+  /** Computes the flux table rows for the peaks; this is what #FluxToolWidget displays, but does
+   not use any widget or session state, so can be used to make batch flux reports.
+   
+   The DRF intrinsic efficiency is evaluated for all the peak energies in a single
+   DetectorPeakResponse::intrinsicEfficiencies call, and the geometric efficiency is only
+   computed once, since it doesnt depend on energy.
+   
+   \param peaks The peaks to compute the flux for; a row is returned for each peak, in order.
+   \param drf The detector response function; must be valid.
+   \param distance The distance the source is at; ignored for fixed-geometry DRFs.
+   \param live_time The live-time, in seconds, of the spectrum the peaks were fit from.
+   
+   Throws std::exception if DRF is invalid, or the live-time is not positive.
+   */
+  std::vector<FluxRow> compute_fluxes( const std::vector<PeakDef> &peaks,
+                                       const DetectorPeakResponse &drf,
+                                       const double distance,
+                                       const float live_time );
+}//namespace FluxToolImp
+
 #endif //FluxTool_h
 
@@ -129,6 +129,72 @@ public:
   std::vector<float> m_neutron_group_flux;
 };//class GadrasGamFile
 
+
+/** Read-only access to a file (or buffer) holding one or more .gam records, one after another; e.x., a library of sources made by
+ concatenating the .gam files written by #GadrasGamFile::write_gam.
+ 
+ On construction only the start of each record is located (no numbers are parsed), and on POSIX systems the file is memory-mapped
+ rather than read, so opening a large library, and then decoding one of its records via #record, costs about the same as parsing a
+ single .gam file.
+ */
+class GadrasGamLibrary
+{
+public:
+  /** Information about a record, found when indexing the library. */
+  struct RecordInfo
+  {
+    /** Byte offset of the start of the record. */
+    size_t m_begin;
+    
+    /** Byte offset one past the end of the record. */
+    size_t m_end;
+    
+    GadrasGamFile::GamFileVersion m_version;
+    
+    /** The "Description" header value, for #GadrasGamFile::GamFileVersion::Version_2_1; empty otherwise. */
+    std::string m_description;
+  };//struct RecordInfo
+  
+  
+  /** Opens, and indexes, the file.
+   Throws exception if the file can not be read, or contains no .gam records.
+   */
+  explicit GadrasGamLibrary( const std::string &filename );
+  
+  /** Indexes the passed in file contents.
+   Throws exception if there are no .gam records.
+   */
+  explicit GadrasGamLibrary( std::vector<char> &&contents );
+  
+  GadrasGamLibrary( const GadrasGamLibrary & ) = delete;
+  GadrasGamLibrary &operator=( const GadrasGamLibrary & ) = delete;
+  
+  ~GadrasGamLibrary();
+  
+  /** The records found, in the order they are in the file. */
+  const std::vector<RecordInfo> &records() const;
+  
+  /** Decodes the record at `index`; throws exception if `index` is invalid, or the record is not formatted properly.
+   Is thread-safe.
+   */
+  GadrasGamFile record( const size_t index ) const;
+  
+protected:
+  /** Fills #m_records from #m_data. */
+  void build_index();
+  
+  const char *m_data;
+  size_t m_size;
+  
+  /** Holds the data when it isnt memory-mapped. */
+  std::vector<char> m_buffer;
+  
+  /** If #m_data is memory-mapped, and needs to be unmapped. */
+  bool m_mapped;
+  
+  std::vector<RecordInfo> m_records;
+};//class GadrasGamLibrary
+
 #endif //GadrasGamFileParser_h
 
 
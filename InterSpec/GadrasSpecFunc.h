@@ -23,8 +23,10 @@
  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <mutex>
 #include <string>
 #include <vector>
+#include <memory>
 
 
 /** \brief Computes the scattered continuum for a given energy gamma, through
@@ -49,6 +51,14 @@ public:
   /** Destructor */
   ~GadrasScatterTable();
   
+  /** Returns a process-wide instance for the given data file, reading the file the first time it is
+   requested.  The table is never modified after construction, so it can be safely shared between
+   sessions and threads.
+   
+   Throws std::runtime_error() under the same conditions as the constructor.
+   */
+  static std::shared_ptr<const GadrasScatterTable> instance( const std::string &datafile );
+  
   /** Calculates scattered continuum for given energy gamma, through specified
    * shielding.
    *
@@ -80,7 +90,43 @@ public:
                      const float fractionAdHydrogen,
                      const std::vector<float> &binning ) const;
   
+  /** Computes the continuum for many gamma lines through the same shielding, adding them all into
+   #answer; equivalent to calling #getContinuum for each line and summing the results, but without
+   per-line allocations, and with each line only rebinned onto the output bins below its energy.
+   
+   \param answer Where the summed continuum is added to; must already be the same size as
+                 #binning (it is not zeroed).
+   \param uncollided Will be resized to the number of lines, and filled with the number of
+                     un-collided gammas of each line, through the shielding.
+   \param sourceEnergies Energy of each gamma line, in keV.
+   \param sourceIntensities Number of gammas emitted for each line; must be same size as
+                            #sourceEnergies.
+   
+   Other parameters, and exceptions thrown, are the same as #getContinuum.
+   */
+  void addContinuum( std::vector<double> &answer,
+                     std::vector<float> &uncollided,
+                     const std::vector<float> &sourceEnergies,
+                     const std::vector<float> &sourceIntensities,
+                     const float atomicNumber,
+                     const float arealDensity,
+                     const float fractionAdHydrogen,
+                     const std::vector<float> &binning ) const;
+  
 protected:
+  /** Computes the scattered flux, in the tables 32 output groups (with lower energies of
+   `sourceEnergy*i/31`), normalized to the source intensity, but not yet divided by 3.7E10.
+   
+   \returns Number of un-collided gammas at source energy through the shielding.
+   */
+  float scatteredFlux( float (&flux)[32],
+                       const float sourceEnergy,
+                       const float sourceIntensity,
+                       const float atomicNumber,
+                       const float arealDensity,
+                       const float fractionAdHydrogen ) const;
+  
+
   static const int sm_num_areal_density = 9;
   static const int sm_num_atomic_number = 6;
   static const int sm_num_input_energy = 16;
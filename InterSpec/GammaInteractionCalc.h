@@ -29,6 +29,7 @@
 #include <set>
 #include <tuple>
 #include <array>
+#include <mutex>
 #include <atomic>
 #include <vector>
 #include <utility>
@@ -101,6 +102,13 @@ double transmition_length_coefficient( const Material *material, float energy );
 double transmition_coefficient_material( const Material *material, float energy,
                                 float length );
 
+/** Same as #transmition_length_coefficient, but for all of `energies` at once; uses
+ MassAttenuation::massAttenuationCoeficients, so repeated calls for the same material and energies
+ (e.g., when redrawing a shielding preview) are served from a cache.
+ */
+std::vector<double> transmition_length_coefficients( const Material *material,
+                                                     const std::vector<float> &energies );
+
 
 /** A convenience call to #transmition_coefficient_material that uses a static (compile-time defined) definition of air.
  
@@ -188,6 +196,14 @@ int DistributedSrcCalc_integrand_single_cyl_end_on( const int *ndim, const doubl
 int DistributedSrcCalc_integrand_rectangular( const int *ndim, const double xx[],
                                                    const int *ncomp, double ff[], void *userdata );
 
+/** Batched integrand for Cuba library (see #Integrate::BatchIntegrand); evaluates the `*nvec`
+ points using the appropriate `DistributedSrcCalc::eval_*` function for the geometry, which is only
+ determined once per batch.
+ @param userdata must be pointer to a DistributedSrcCalc object.
+ */
+int DistributedSrcCalc_batch_integrand( const int *ndim, const double xx[], const int *ncomp,
+                                        double ff[], void *userdata, const int *nvec );
+
 
 //point_to_line_dist(...): calculates the distance from 'point' to the line
 //  passing through 'l0' and 'l1'
@@ -327,6 +343,15 @@ struct DistributedSrcCalc
   
   void eval_rect( const double xx[], const int *ndimptr,
                         double ff[], const int *ncompptr ) const noexcept;
+  
+  /** Fills `ff[1]` through `ff[ncomp-1]` from the path lengths through each layer (followed by the
+   path length through air), and the energy-independent part of the integrand (volume element, solid
+   angle, and in-situ distribution), using #m_componentTransLenCoefs.
+   
+   Called by the `eval_*` functions when more than one component is requested.
+   */
+  void eval_extra_components( double ff[], const int ncomp, const double *path_lengths,
+                              const double geom_factor ) const noexcept;
 
   GeometryType m_geometry;
   
@@ -389,9 +414,74 @@ struct DistributedSrcCalc
   const SandiaDecay::Nuclide *m_nuclide;
   
   
+  /** Transmission length coefficients for additional energies to integrate at the same time as the
+   primary energy, as extra components of the integrand; the path lengths through each layer do not
+   depend on energy, so these are computed only once per integration point.
+   
+   Each additional component has `m_dimensionsTransLenAndType.size() + 1` contiguous entries: the
+   coefficient for each layer, followed by the coefficient for air (should be zero if
+   #m_attenuateForAir is false).  Empty (the default) for a single-component integrand.
+   */
+  std::vector<double> m_componentTransLenCoefs;
+  
+  /** The integrals of the additional components of #m_componentTransLenCoefs; only filled out by
+   #ShieldingSourceChi2Fcn::selfShieldingIntegration.
+   */
+  std::vector<double> m_componentIntegrals;
+  
   /** TODO: Setting the integral value as part of the DistributedSrcCalc is poor form - need to fix */
   double integral;
 };//struct DistributedSrcCalc
+
+
+/** A tabulation of the geometry of a #DistributedSrcCalc on a fixed tensor-product Gauss-Legendre grid over
+ the unit hyper-cube the `DistributedSrcCalc::eval_*` functions integrate over.
+ 
+ The integrand for all geometries has the form G(x) * exp( -sum_i mu_i * L_i(x) ), where G(x) is the volume
+ element times the solid angle (and in-situ distribution), mu_i is the transmission length coefficient of
+ layer i (or air), and L_i(x) is the path length through that layer (or one, for generic shieldings).  G and L_i
+ only depend on the dimensions of the shieldings, so are computed once here, and then the integral can be
+ evaluated for any set of transmission length coefficients (i.e., each gamma energy, or when only densities or
+ atomic numbers change) without re-tracing rays.
+ 
+ G and L_i are extracted by evaluating the geometries integrand with all coefficients zero, and then with one
+ coefficient non-zero at a time, so the ray-tracing code is shared with the adaptive Cuhre integration.
+ */
+struct DistributedSrcPathLengths
+{
+  /** Tabulates the geometry of `calc`, using `num_points` Gauss-Legendre nodes along each dimension of the
+   integral.  The transmission length coefficients of `calc` are not used.
+   
+   Throws exception if the geometry integrand throws an exception.
+   */
+  DistributedSrcPathLengths( const DistributedSrcCalc &calc, const size_t num_points );
+  
+  /** Returns true if the two calculators have the same geometry, source shell, shielding dimensions and
+   types, detector size and distance, air attenuation, and in-situ distribution; i.e., they could share a
+   tabulation.  Transmission length coefficients and energies are not compared.
+   */
+  static bool same_geometry( const DistributedSrcCalc &lhs, const DistributedSrcCalc &rhs );
+  
+  /** Returns if `calc` can be integrated using this tabulation. */
+  bool matches( const DistributedSrcCalc &calc ) const;
+  
+  /** Returns the integral of `calc`, using its transmission length coefficients.
+   
+   `calc` must match this tabulation (asserted, but not checked in release builds).
+   */
+  double integrate( const DistributedSrcCalc &calc ) const;
+  
+  /** The calculator this tabulation was made from; used for matching. */
+  DistributedSrcCalc m_calc;
+  
+  /** The quadrature weight, times G, for each node; zero where the integrand is zero. */
+  std::vector<double> m_weights;
+  
+  /** The path length through each layer, followed by the path length through air, at each node; the lengths
+   for each node are contiguous (i.e., index is `node*(m_calc.m_dimensionsTransLenAndType.size() + 1) + layer`).
+   */
+  std::vector<double> m_path_lengths;
+};//struct DistributedSrcPathLengths
   
 
 class ShieldingSourceChi2Fcn
@@ -481,7 +571,64 @@ public:
      */
     std::vector<std::tuple<const SandiaDecay::Nuclide *,TraceActivityType,double>> trace_sources;
   };//struct ShieldLayerInfo
-
+  
+  
+  /** The quantities of a fit that depend only on the peaks, shielding materials, and detector -
+   and not on any of the fit parameters - computed once, and then shared (read-only) between
+   every #ShieldingSourceChi2Fcn setup for the same problem (e.g., the re-fits done while
+   computing uncertainties, multi-start fits, or batch analysis of many files using the same
+   peaks and shieldings).
+   
+   The photons from each source nuclide depend on its (possibly fit) age, so are not held
+   here; they are instead cached by nuclide/age in #energy_chi_contributions.
+   */
+  struct FitContext
+  {
+    /** The (sorted and unique) peak energies everything is precomputed for. */
+    std::vector<double> energies;
+    
+    /** The material of each shielding layer; nullptr for generic shieldings. */
+    std::vector<std::shared_ptr<const Material>> materials;
+    
+    /** The linear attenuation coefficient of each non-generic shielding, at each of
+     #energies; the energies for each material are contiguous (i.e., index is
+     `material_index*energies.size() + energy_index`).  Generic shieldings have NaN entries,
+     since their atomic number is a fit parameter.
+     */
+    std::vector<double> material_atten_coefs;
+    
+    /** The linear attenuation coefficient of air, at each of #energies. */
+    std::vector<double> air_atten_coefs;
+    
+    /** The detector the efficiencies were computed for. */
+    std::shared_ptr<const DetectorPeakResponse> detector;
+    
+    /** The intrinsic efficiency of #detector, at each of #energies; empty if no valid detector. */
+    std::vector<double> detector_intrinsic_effs;
+    
+    /** Returns if this context was computed for the given inputs; materials and detector are
+     compared by pointer.
+     */
+    bool matches( const std::vector<double> &sorted_energies,
+                  const std::vector<std::shared_ptr<const Material>> &layer_materials,
+                  const std::shared_ptr<const DetectorPeakResponse> &drf ) const;
+  };//struct FitContext
+  
+  
+  /** Computes the #FitContext for the given peaks, shielding materials, and detector.
+   
+   The returned context may be passed to #create (or the constructor) of any number of
+   fit functions for the same setup, to avoid recomputing it for each of them.
+   */
+  static std::shared_ptr<const FitContext> createFitContext( const std::vector<PeakDef> &peaks,
+                                  const std::vector<std::shared_ptr<const Material>> &materials,
+                                  std::shared_ptr<const DetectorPeakResponse> detector );
+  
+  /** Creates the chi2 function, and the starting parameters, for the given setup.
+   
+   If `context` is non-null, and was computed for the same peaks, materials, and detector, it
+   will be shared by the returned function; otherwise a new context will be computed.
+   */
   static std::pair<std::shared_ptr<ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParameters> create(
                                      const double distance,
                                      const GammaInteractionCalc::GeometryType geometry,
@@ -492,7 +639,8 @@ public:
                                      std::shared_ptr<const SpecUtils::Measurement> background,
                                      std::deque<std::shared_ptr<const PeakDef>> foreground_peaks,
                                      std::shared_ptr<const std::deque<std::shared_ptr<const PeakDef>>> background_peaks,
-                                     const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options );
+                                     const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options,
+                                     std::shared_ptr<const FitContext> context = nullptr );
   
 protected:
   ShieldingSourceChi2Fcn(
@@ -503,7 +651,8 @@ protected:
                       std::shared_ptr<const DetectorPeakResponse> detector,
                       const std::vector<ShieldingSourceFitCalc::ShieldingInfo> &shieldings,
                       const GeometryType geometry,
-                      const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options );
+                      const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options,
+                      std::shared_ptr<const FitContext> context = nullptr );
 
 public:
   virtual ~ShieldingSourceChi2Fcn();
@@ -511,12 +660,23 @@ public:
   /** Returns the geometry of this ShieldingSourceChi2Fcn */
   const GeometryType geometry() const;
   
+  /** Returns the (shared, read-only) precomputed quantities of this fit; may be passed to
+   #create to set up another fit of the same problem without recomputing them.
+   */
+  std::shared_ptr<const FitContext> fitContext() const;
+  
   /** Causes exception to be thrown if DoEval() is called afterwards. */
   void cancelFit();
   
   /** Similar to #cancelFit, but status will be set to #CalcStatus::CanceledNoUpdate */
   void cancelFitWithNoUpdate();
   
+  /** Similar to #cancelFit, but status will be set to #CalcStatus::Timeout, the same as if the
+   zombie timer (see #fittingIsStarting) had fired; useful when there is no Wt server to run
+   the zombie timer, such as in batch mode.
+   */
+  void cancelFitWithTimeout();
+  
 
   
   /** Information tracked during test evaluation of the Chi2.  Set this object
@@ -664,6 +824,9 @@ public:
   
   /** Performs evaluation of Chi2, for parameters x.
    
+   Safe to call from multiple threads at once (e.g., for parallel AN scans, multi-start fits, or
+   Hessians); the nuclide mixture cache used is per-thread.
+   
    May through CancelException (if user or time limit cancelled computation), or other std::exception (on other error type).
    */
   virtual double DoEval( const std::vector<double> &x ) const;
@@ -680,6 +843,11 @@ public:
   //  first.
   typedef std::map< const SandiaDecay::Nuclide *, SandiaDecay::NuclideMixture> NucMixtureCache;
   
+  /** Same as #DoEval, but with the caller providing the nuclide mixture cache to use as working
+   space; a given cache must only be used by one thread at a time.
+   */
+  double DoEval( const std::vector<double> &x, NucMixtureCache &workspace ) const;
+  
   //If 'info' is non-null then it will be filled with information about how much
   //  each nuclide/peak was attributed to each detected peak (currently not
   //  implemented)
@@ -861,6 +1029,36 @@ public:
 protected:
   
   void zombieCallback( const boost::system::error_code &ec );
+  
+  /** Throws #CancelException if the computation has been cancelled (see #cancelFit).
+   
+   Called at the start of #DoEval, and between the expensive self-attenuation steps of
+   #energy_chi_contributions, so a cancel takes effect without waiting for a whole evaluation.
+   */
+  void throwIfCancelled() const;
+  
+  /** Sets #m_context to `context` if it was computed for the current #m_peaks, #m_materials,
+   and #m_detector, and otherwise to a newly computed context.
+   */
+  void cache_attenuation_coefficients( std::shared_ptr<const FitContext> context );
+  
+  /** Returns the same value as #transmition_length_coefficient, but using the precomputed
+   value, if `material` is the material of shielding `material_index`, and `energy` is one of
+   the peak energies.
+   */
+  double material_attenuation_coef( const size_t material_index,
+                                    const Material *material,
+                                    const double energy ) const;
+  
+  /** Returns the same value as #transmission_length_coefficient_air, using precomputed value
+   if `energy` is one of the peak energies.
+   */
+  double air_attenuation_coef( const double energy ) const;
+  
+  /** Returns the same value as `m_detector->intrinsicEfficiency(energy)`, using the precomputed
+   value if `energy` is one of the peak energies.
+   */
+  double detector_intrinsic_eff( const double energy ) const;
 
 
 protected:
@@ -898,8 +1096,25 @@ protected:
   
   std::vector<ShieldingSourceFitCalc::SourceFitDef> m_initialSrcDefinitions;
   
-  //A cache of nuclide mixtures to
-  mutable NucMixtureCache m_mixtureCache;
+  /** The attenuation coefficients and detector efficiencies at the peak energies; never null
+   after construction, and possibly shared with other fit functions.
+   */
+  std::shared_ptr<const FitContext> m_context;
+  
+  /** The geometry tabulations used by the last call to #energy_chi_contributions, when
+   `ShieldingSourceFitOptions::fast_self_atten_integration` is true; re-used if the dimensions
+   of the shieldings have not changed.
+   */
+  mutable std::vector<std::shared_ptr<const DistributedSrcPathLengths>> m_pathLengthCache;
+  
+  /** Protects #m_pathLengthCache, for when multiple fits are being performed in parallel. */
+  mutable std::mutex m_pathLengthCacheMutex;
+  
+  /** Number of Gauss-Legendre nodes, per dimension, used for the fast self-attenuation integration. */
+  static const size_t sm_numGaussLegendrePoints2D = 64;
+  static const size_t sm_numGaussLegendrePoints3D = 32;
+  
+  /** Maximum number of entries in a NucMixtureCache, before it is cleared. */
   static const size_t sm_maxMixtureCacheSize = 10000;
 };//class ShieldingSourceChi2Fcn
 
@@ -40,6 +40,12 @@ namespace Integrate
   
   typedef int (*Integrand)( const int *ndim, const double *xx, const int *ncomp, double *ff, void *userdata );
   
+  /** Integrand that is evaluated for up to `*nvec` points per call; `xx` holds `*nvec` consecutive
+   points of `*ndim` coordinates, and `ff` receives `*nvec` consecutive sets of `*ncomp` values.
+   */
+  typedef int (*BatchIntegrand)( const int *ndim, const double *xx, const int *ncomp, double *ff,
+                                 void *userdata, const int *nvec );
+  
   enum IntegrationFlags
   {
     LastImportanceFcnt = 4
@@ -59,6 +65,52 @@ namespace Integrate
                       double &integral,
                       double &error,
                       double &prob );
+  
+  /** Same as the other #CuhreIntegrate, but for an integrand with `ncomp` components; `integral`,
+   `error`, and `prob` must each point to `ncomp` entries.  Integration proceeds until all components
+   reach the requested accuracy.
+   */
+  void CuhreIntegrate( const int ndim,
+                      const int ncomp,
+                      Integrate::Integrand integrand,
+                      void *userdata,
+                      const double epsrel,
+                      const double epsabs,
+                      const unsigned int flags,
+                      const size_t mineval,
+                      const size_t maxeval,
+                      int &pnregions,
+                      int &pneval,
+                      int &pfail,
+                      double *integral,
+                      double *error,
+                      double *prob );
+  
+  /** Same as the multi-component #CuhreIntegrate, but the integrand is handed the points of each
+   cubature rule in batches of up to `nvec` points, so the per-point work can be done in tight
+   loops (and the per-call overhead is paid once per batch).
+   */
+  void CuhreIntegrate( const int ndim,
+                      const int ncomp,
+                      const int nvec,
+                      Integrate::BatchIntegrand integrand,
+                      void *userdata,
+                      const double epsrel,
+                      const double epsabs,
+                      const unsigned int flags,
+                      const size_t mineval,
+                      const size_t maxeval,
+                      int &pnregions,
+                      int &pneval,
+                      int &pfail,
+                      double *integral,
+                      double *error,
+                      double *prob );
+  
+  /** The maximum number of components a single #CuhreIntegrate call can integrate; fixed when Cuba
+   is compiled.
+   */
+  int cuhre_max_components();
 }//namespace Integrate
 
 #endif //ifndef Integrate_h
@@ -518,6 +518,14 @@ public:
   //  sampleNumbersAddded() when the user wants to change displayed sample numbers
   void changeDisplayedSampleNums( const std::set<int> &samples,
                                  const SpecUtils::SpectrumType type );
+  
+  /** Appends records to the foreground file, e.g., as they arrive during a live acquisition (see
+   #SpecMeas::appendMeasurements).  The time chart is updated, and if the most recent sample was
+   being displayed, the new samples are added to the displayed foreground.
+   
+   Returns the sample numbers the records were added as.
+   */
+  std::set<int> appendForegroundMeasurements( const std::vector<std::shared_ptr<SpecUtils::Measurement>> &meas );
 
   
   //liveTime(): returns the live time of the desired spectrum.  Will return 0.0
@@ -637,6 +645,14 @@ public:
                               const std::string sessionid,
                               boost::function<void(void)> update );
   
+  /** Returns the material database parsed from the static data directory; the file is only parsed
+   the first time this is called (or after a previous failure), and sessions copy their materials
+   from this database, so each session doesnt have to re-parse the file.
+   
+   Throws exception if the file cant be parsed.
+   */
+  static std::shared_ptr<const MaterialDB> staticMaterialDb();
+  
   //pushMaterialSuggestionsToUsers(): should be called from application loop, to
   //  fill m_shieldingSuggestion (from m_materialDB) and then push to the user.
   void pushMaterialSuggestionsToUsers();
@@ -1183,6 +1199,9 @@ public:
   
   ReferencePhotopeakDisplay *referenceLinesWidget();
   
+  /** Returns the Nuclide Search widget, creating it (and placing it into its tab, or window) if
+   it has not been created yet.
+   */
   IsotopeSearchByEnergy *nuclideSearch();
   
   PeakInfoDisplay *peakInfoDisplay();
@@ -1380,8 +1399,8 @@ protected:
   //  not.
   WContainerWidget       *m_nuclideSearchContainer;
   
-  //m_nuclideSearch: Nuclide Search widget.  Will always be a valid pointer,
-  //  although not always in the DOM (specifically when tool tabs are hidden).
+  //m_nuclideSearch: Nuclide Search widget.  Created on first use by nuclideSearch(), so may be
+  //  nullptr; once created, will not always be in the DOM (specifically when tool tabs are hidden).
   IsotopeSearchByEnergy  *m_nuclideSearch;
   
   //DataBaseUtils::DbSession is an indirect way to holds the Wt::Dbo::Session
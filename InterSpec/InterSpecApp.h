@@ -123,6 +123,16 @@ public:
   //Note that currently this function requires locking a mutex, as well as some
   //  other not-super-fast actions.
   static std::string tempDirectory();
+  
+  /** Returns the passed in resource URL (relative to the doc-root, e.g.
+   "InterSpec_resources/InterSpec.css") with a "?v=<hash of file contents>"
+   query string appended, so browsers can cache the file indefinitely, but will
+   still fetch it again when a new build changes its contents.
+   
+   The hash is computed once per resource, per process; if the file can not be
+   read, the URL is returned unchanged.
+   */
+  static std::string fingerprintedResourceUrl( const std::string &resource );
 
   
   /** Returns a int, representing compile date.
@@ -155,8 +165,14 @@ public:
   
   static std::set<InterSpecApp *> runningInstances();
   
-  //Need put put in a function that will minimize memmorry usage of all cuurently
-  //  running sessions.
+  /** Releases as much memory as practical, without the user losing any work; intended to be called
+   when the OS signals memory pressure (e.x., iOS memory warnings, or Android `onTrimMemory`).
+   
+   Clears the process-wide decay and reference-line caches, and posts to each running session to
+   release its spectrum file memory (see #SpecMeasManager::releaseIdleMemory), so may be called
+   from any thread.
+   */
+  static void releaseMemoryOfAllSessions();
 #endif
 
 #if( defined(WIN32) && BUILD_AS_ELECTRON_APP )
@@ -240,7 +256,22 @@ public:
    */
   static const std::set<std::string> &languagesAvailable();
   
+  /** The number of seconds without any user interaction after which a session releases the memory it
+   can recover on demand (see SpecMeasManager::releaseIdleMemory).  A value of zero or less disables this.
+   
+   Default is 15 minutes for web deployments, and disabled otherwise.
+   */
+  static int idleMemoryReleaseSeconds();
+  
+  /** Sets the value returned by #idleMemoryReleaseSeconds; affects sessions created afterwards. */
+  static void setIdleMemoryReleaseSeconds( const int seconds );
+  
 protected:
+  /** Called periodically (server-side, so it doesnt require the client to be connected) to release
+   memory if the session has been idle longer than #idleMemoryReleaseSeconds.
+   */
+  void checkIfIdle();
+  
 
   //notify(): over-riding WApplication::notify in order to catch any exceptions
   //  that may happen during event handling
@@ -293,6 +324,9 @@ protected:
   std::chrono::steady_clock::time_point m_lastAccessTime;
   std::chrono::steady_clock::time_point::duration m_activeTimeInSession;
   
+  /** If memory has been released since the last user interaction; see #checkIfIdle. */
+  bool m_idleMemoryReleased;
+  
 #define OPTIMISTICALLY_SAVE_USER_STATE 0
   //If OPTIMISTICALLY_SAVE_USER_STATE is enabled, then the users state will
   //  attempt to be saved whenever a 'onbeforeunload' is recieved.  The downside
@@ -93,6 +93,18 @@ namespace InterSpecServer
 #endif
                    );
   
+  /** Sets the prefix Wt will start all session IDs with; must be called before the server is started.
+   
+   To spread sessions over several InterSpec server processes (so a crash, or a long computation, in
+   one process doesnt affect sessions of the others), start each process with a unique prefix, and
+   have the reverse proxy route requests to the process whose prefix the requests session ID starts
+   with (Wt puts the session ID in the "wtd" URL argument, or in a cookie).
+   All processes should use the same user database; using MySQL is recommended for this.
+   
+   An empty prefix (the default) disables the prefix.
+   */
+  void set_session_id_prefix( const std::string &prefix );
+  
 
   void killServer();
   
@@ -209,6 +221,19 @@ namespace InterSpecServer
   if the URL was used.
   */
   bool pass_app_url_to_session( const char *session_token, const std::string &url );
+  
+  /** Appends the records of a spectrum file to the foreground spectrum file of a session, e.g., for
+   each new sample written out by a detector during a live acquisition.
+   
+   The file is parsed before the session is locked, and the records are added after the last sample
+   of the foreground (see #InterSpec::appendForegroundMeasurements); the time chart, and if the most
+   recent sample was being displayed, the foreground spectrum, are updated.  The file may be deleted
+   once this call returns.
+   
+   \returns the number of samples added; zero if the session doesnt have a foreground loaded, -1 if
+   the file could not be parsed, and -2 if session_token is invalid.
+   */
+  int append_file_to_session( const char *session_token, const std::string &file_path );
 
   /** Sets a file to open upon session load.
    
@@ -54,6 +54,7 @@ struct UseDrfPref;
 class UserFileInDb;
 class ColorThemeInfo;
 class UserFileInDbData;
+class SpectrumFileBlob;
 struct ShieldingSourceModel;
 
 
@@ -72,7 +73,7 @@ namespace rapidxml
 //The database this InterSpec is using; if higher than database registry, will
 //  automatically update tables at next execution
 //  See DataBaseVersionUpgrade.cpp/.h
-#define DB_SCHEMA_VERSION 12
+#define DB_SCHEMA_VERSION 15
 
 
 namespace Wt
@@ -151,6 +152,19 @@ std::chrono::system_clock::time_point to_time_point( const boost::posix_time::pt
 //mapDbClasses(...) Maps the database classes to Dbo::Session
 void mapDbClasses( Wt::Dbo::Session *session );
 
+/** Creates the secondary indices the database uses, if they dont already exist.
+ 
+ Dbo::Session::createTables() only creates primary-key indices, so this should be called after
+ creating tables (and is called when upgrading to schema versions 14 and 15).  Currently adds indices
+ on the {user, type, save time} of UserState, and the {user, upload time} of UserFileInDb, so listing
+ a users saved states or files doesnt require a table scan.  Also adds a unique index on
+ SpectrumFileBlob.ContentHash, so the same contents can not be stored twice, and an index on
+ UserFileInDbData.BlobHash, for checking if a blob is still referenced.
+ 
+ Errors creating an index are printed to stderr, but otherwise ignored.
+ */
+void createDbIndices( Wt::Dbo::Session *session );
+
 
 class UserOption
 {
@@ -279,7 +293,9 @@ public:
   T preferenceValue( const std::string &name ) const;
   
   //setPreferenceValue(): Sets preference value for named preference to both
-  //  the InterSpecUser in memory and the database.
+  //  the InterSpecUser in memory and the database.  The in-memory value is
+  //  updated immediately, while the database write is deferred until after the
+  //  current event has been handled (see #flushPendingPreferenceWrites).
   //  If the preference isnt already in memory, and its not in
   //  data/default_preferences.xml then will throw an exception
   //  Note the reason for passing InterSpecUser and viewer pointers is so
@@ -303,11 +319,38 @@ public:
                                  const bool &value,
                                  InterSpec *viewer );
   
+  /** Writes any preference values that have been set (or defaulted) in memory, but not yet written
+   to the database.
+   
+   Normally called automatically, via WServer::post, after the current event is handled; call
+   directly before reading preferences from the database (e.g., #userOptionsToXml), or when the
+   session is ending.
+   */
+  static void flushPendingPreferenceWrites( InterSpec *viewer );
+  
 protected:
   template<typename T>
   static void setPreferenceValueWorker( Wt::Dbo::ptr<InterSpecUser> user,
                                  const std::string &name, const T &value,
                                  InterSpec *viewer );
+  
+  /** Sets the in-memory preference value, and queues writing it to the database.
+   
+   If there is no current WApplication to post the deferred write to, the write is done before
+   returning.
+   */
+  static void queuePreferenceWrite( Wt::Dbo::ptr<InterSpecUser> user,
+                                    const std::string &name,
+                                    const UserOption::DataType type,
+                                    const std::string &value,
+                                    InterSpec *viewer );
+  
+  /** Creates or updates the UserOption database entry for the preference. */
+  static void writePreferenceToDb( Wt::Dbo::ptr<InterSpecUser> user,
+                                   std::shared_ptr<DataBaseUtils::DbSession> sql,
+                                   const std::string &name,
+                                   const UserOption::DataType type,
+                                   const std::string &value );
 
 public:
   
@@ -470,6 +513,14 @@ protected:
   //These are mutable so Dbo::ptr<t>.modify() dont need to be called
   mutable PreferenceMap m_preferences;
   
+  /** Preference values that have been set in #m_preferences, but not yet written to the database;
+   keyed by preference name, with values of the type and string representation of the value.
+   */
+  mutable std::map<std::string,std::pair<UserOption::DataType,std::string>> m_pendingPreferenceWrites;
+  
+  /** If a call to #flushPendingPreferenceWrites has been posted to the WServer, but not yet done. */
+  mutable bool m_preferenceWriteScheduled;
+  
   /** Holds callbacks set from #addCallbackWhenChanged, for boolean preferences.
    
    I believe using a Wt::Signals::signal allows makes it so we can connect widget slots (function
@@ -642,12 +693,15 @@ private:
 //  compressed: 65806 bytes   vs 99409    bytes; savings: 34% ("Alphas on Boron.Chn")
 //  compressed: 94017 bytes   vs 198993   bytes; savings: 53% ("detector problem at 548.spc")
 //  compressed: 66315 bytes   vs 99429    bytes; savings: 33% ("fertilizer_TexasA&M.chn")
-//I have not yet looked at how much, or if, time the compressing saves when
-//  placing into or reading from the database
+//N42-2012 XML (what we currently serialize to the database) compresses better
+//  still - usually by more than 50%.  Compression is done at a reduced zlib
+//  level (see InterSpecUser.cpp) to keep the CPU cost of auto-saves low.
 
 //ALLOW_SAVE_TO_DB_COMPRESSION: use gzip compression to save to database.
+//  Entries are flagged by UserFileInDbData::gzipCompressed, so previously
+//  saved uncompressed entries are still read fine.
 //  Could probably allow for iOS and Android, but I havent tested this...
-#define ALLOW_SAVE_TO_DB_COMPRESSION 0
+#define ALLOW_SAVE_TO_DB_COMPRESSION 1
 
 #endif //HAS_ZLIB_SUPPORT
 
@@ -696,9 +750,39 @@ public:
   SerializedFileFormat fileFormat;
   
   //fileData: the actual data of the serialized SpecMeas object, may be
-  //  compressed.
+  //  compressed.  Will be empty if the data has been moved into the
+  //  SpectrumFileBlob table (i.e., if blobHash is non-empty).
   FileData_t fileData;
   
+  /** If non-empty, the serialized data is held in the content-addressed SpectrumFileBlob table,
+   under this hash, rather than in #fileData.
+   */
+  std::string blobHash;
+  
+  /** Moves #fileData into the SpectrumFileBlob table, re-using an existing entry with identical
+   contents if there is one; #fileData is then cleared, and #blobHash set.
+   
+   Does nothing if the data is already in the SpectrumFileBlob table, or there is no data.
+   
+   Should only be called from within an active transaction.  Throws if the data could not be added to
+   the SpectrumFileBlob table.
+   */
+  void moveDataToBlobStore( Wt::Dbo::Session &session );
+  
+  /** Deletes the SpectrumFileBlob entry for \p hash, if no UserFileInDbData references it anymore.
+   
+   Should be called, from within an active transaction, after changing the data of an entry that
+   may have had a non-empty #blobHash.
+   */
+  static void removeBlobIfUnreferenced( Wt::Dbo::Session &session, const std::string &hash );
+  
+  /** Deletes all SpectrumFileBlob entries that no UserFileInDbData references.
+   
+   Deleting UserFileInDb entries cascades to their UserFileInDbData, but not to the SpectrumFileBlob
+   entries they referenced; so this is called at startup to clean up after these deletions.
+   */
+  static void removeUnreferencedBlobs( Wt::Dbo::Session &session );
+  
   //setFileData(...): serializes spectrumFile to fileData as a binary native
   //  file format.
   //  Will throw FileToLargeForDbException if serialization is larger than
@@ -714,10 +798,16 @@ public:
                     const SerializedFileFormat format );
   
   //decodeSpectrum(): de-serializes data currently in fileData.
-  //  Will throw if de-serialization fails, otherwise will always return
-  //  a valid SpecMeas object.
+  //  Will throw if de-serialization fails, or if the data is held in the
+  //  SpectrumFileBlob table, otherwise will always return a valid SpecMeas
+  //  object.
   std::shared_ptr<SpecMeas> decodeSpectrum() const;
   
+  //decodeSpectrum( session ): same as decodeSpectrum(), but if the data is
+  //  held in the SpectrumFileBlob table, it will be retrieved using 'session'.
+  //  Should not be called from within an active transaction.
+  std::shared_ptr<SpecMeas> decodeSpectrum( DataBaseUtils::DbSession &session ) const;
+  
   template<class Action>
   void persist( Action &a )
   {
@@ -725,10 +815,39 @@ public:
     Wt::Dbo::field( a, gzipCompressed, "gzipCompressed" );
     Wt::Dbo::field( a, fileFormat, "FileFormat" );
     Wt::Dbo::field( a, fileData, "FileData" );
+    Wt::Dbo::field( a, blobHash, "BlobHash" );
   }//void persist( Action &a )
 };//class UserFileInDbData
 
 
+/** Content-addressed storage of serialized spectrum files.
+ 
+ Write-protected copies of a file (e.g., one for every save of a state), or the same unmodified file
+ saved by multiple users, serialize to identical bytes; rather than having a full copy of these
+ bytes for each UserFileInDbData, they are stored once in this table - keyed by a hash of their
+ contents - and referenced by UserFileInDbData::blobHash.
+ */
+class SpectrumFileBlob
+{
+public:
+  /** Hex-encoded SHA-1 of #fileData, followed by a dash and the number of bytes. */
+  std::string contentHash;
+  
+  /** The serialized file; see UserFileInDbData::fileData. */
+  FileData_t fileData;
+  
+  /** Returns the #contentHash value for the given data. */
+  static std::string hashOf( const FileData_t &data );
+  
+  template<class Action>
+  void persist( Action &a )
+  {
+    Wt::Dbo::field( a, contentHash, "ContentHash", 64 );
+    Wt::Dbo::field( a, fileData, "FileData" );
+  }//void persist( Action &a )
+};//class SpectrumFileBlob
+
+
 class ColorThemeInfo
 {
   /** The current user color theme is determined by a (int) user preference,
@@ -1138,74 +1257,20 @@ void InterSpecUser::setPreferenceValueWorker( Wt::Dbo::ptr<InterSpecUser> user,
     throw std::runtime_error( "InterSpecUser::setPreferenceValue() must be called"
                              " with same db session as user" );
   
-  std::vector< Wt::Dbo::ptr<UserOption> > options;
-  {//begin interacting with the database
-    DataBaseUtils::DbTransaction transaction( *sql );
-    Wt::Dbo::collection< Wt::Dbo::ptr<UserOption> > optioncol
-                                    = user->m_dbPreferences.find()
-                                         .where( "name=?" ).bind( name );
-    std::copy( optioncol.begin(), optioncol.end(), std::back_inserter(options) );
-    transaction.commit();
-  }//end interacting with the database
-  
-  Wt::Dbo::ptr<UserOption> option;
-  const size_t noptions = options.size();
-  if( noptions == 0 )
-  {
-    UserOption *newoption = new UserOption();
-    newoption->m_name = name;
-    newoption->m_user = user;
-    
-    if( typeid(value) == typeid(std::string) )
-      newoption->m_type = UserOption::String;
-    else if( typeid(value) == typeid(double) || typeid(value) == typeid(float) )
-      newoption->m_type = UserOption::Decimal;
-    else if( typeid(value) == typeid(int)
-            || typeid(value) == typeid(unsigned int)
-            || typeid(value) == typeid(long long) )
-      newoption->m_type = UserOption::Integer;
-    else if( typeid(value) == typeid(bool) )
-      newoption->m_type = UserOption::Boolean;
-    else
-    {
-      delete newoption;
-      throw std::runtime_error( "setPreferenceValue(...): invalid type: "
-                               + std::string(typeid(value).name()) );
-    }
-    
-    DataBaseUtils::DbTransaction transaction( *sql );
-    option = sql->session()->add( newoption );
-    transaction.commit();
-  }else if( noptions == 1 )
-  {
-    option = options.front();
-  }else
-  {
-    //Hmmm, not sure how this happened, but I have made it here for "ColorThemeIndex".
-    //  We will take the first option and
-#if( PERFORM_DEVELOPER_CHECKS )
-    char buffer[1024];
-    snprintf( buffer, sizeof(buffer), "Invalid number of preferences (%i) for %s for user %s; will"
-                                      " remove all of them after the first from the database.",
-              static_cast<int>(noptions), name.c_str(), user->userName().c_str() );
-    log_developer_error( __func__, buffer );
-#endif
-    
-    option = options.front();
-    for( size_t i = 1; i < noptions; ++i )
-    {
-      try
-      {
-        DataBaseUtils::DbTransaction transaction( *sql );
-        options[i].remove();
-      }catch(...)
-      {
-        std::cerr << "Caught exception removing duplicate preference from database" << std::endl;
-      }
-    }//for( size_t i = 1; i < noptions; ++i )
-    
-    //throw runtime_error( "Invalid number of preferences for " + name + " for user " + user->userName() );
-  }//if( noptions == 0 ) / else / else
+  UserOption::DataType type;
+  if( typeid(value) == typeid(std::string) )
+    type = UserOption::String;
+  else if( typeid(value) == typeid(double) || typeid(value) == typeid(float) )
+    type = UserOption::Decimal;
+  else if( typeid(value) == typeid(int)
+          || typeid(value) == typeid(unsigned int)
+          || typeid(value) == typeid(long long) )
+    type = UserOption::Integer;
+  else if( typeid(value) == typeid(bool) )
+    type = UserOption::Boolean;
+  else
+    throw std::runtime_error( "setPreferenceValue(...): invalid type: "
+                             + std::string(typeid(value).name()) );
   
   std::stringstream valuestrm;
   valuestrm << value;
@@ -1213,17 +1278,7 @@ void InterSpecUser::setPreferenceValueWorker( Wt::Dbo::ptr<InterSpecUser> user,
   if( strval.size() > UserOption::sm_max_value_str_len )
     strval = strval.substr( 0, UserOption::sm_max_value_str_len );
   
-  {//begin interacting with the database
-    DataBaseUtils::DbTransaction transaction( *sql );
-    option.modify()->m_value = strval;
-    transaction.commit();
-//    std::cerr << "Commited " << option->m_name << " value of "
-//              << option->m_value << " to user " << option->m_user.id()
-//              << " with ID=" << option.id() << std::endl;
-  }//end interacting with the database
-  
-  user->m_preferences[name] = option->value();
-
+  queuePreferenceWrite( user, name, type, strval, viewer );
 }//setPreferenceValueWorker(...)
 
 
@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -149,6 +150,12 @@ protected:
   std::vector< const ReactionGamma::Reaction * > m_candidatesReactions;
   std::vector<Wt::WString> m_customSuggests;
   
+  /** The (lowercase) alpha sub-strings, and resulting candidate elements, of the last call to
+   #filter; used to narrow down candidates as the user continues typing.
+   */
+  std::vector<std::string> m_prevAlphaStrs;
+  std::set<const SandiaDecay::Element *> m_prevCandidateElements;
+  
   //m_typePrefix: Is empty for most user inputs, but if the user is inputting
   //  single or double escape peaks, then may be "S.E. " or "D.E. ", and is
   //  only returned as part of data(...) for nuclides and reactions.
@@ -25,6 +25,7 @@
 
 #include "InterSpec_config.h"
 
+#include <atomic>
 #include <vector>
 #include <memory>
 
@@ -224,6 +225,11 @@ protected:
   Wt::Signals::connection m_refLineClearConnection;
   Wt::WSplitButton *m_assignPeakToSelected;
   int m_currentSearch;
+  
+  /** Mirrors #m_currentSearch, but is shared with the background search jobs, so superseded
+   searches can stop early.
+   */
+  std::shared_ptr<std::atomic<int>> m_latestSearchNumber;
   Wt::WText *m_searching;
   RowStretchTreeView *m_results;
   NativeFloatSpinBox *m_minBranchRatio;
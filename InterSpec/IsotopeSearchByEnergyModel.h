@@ -25,10 +25,13 @@
 
 #include "InterSpec_config.h"
 
+#include <deque>
+#include <atomic>
 #include <vector>
 #include <memory>
 
 #include <boost/any.hpp>
+#include <boost/function.hpp>
 
 #include <Wt/WString>
 #include <Wt/WModelIndex>
@@ -126,9 +129,44 @@ public:
     Wt::SortOrder sortOrder;
     std::shared_ptr<void> undoSentry;
     boost::function< void(void) > searchdoneCallback;
+    
+    /** The search inputs not in the fields above; used, with the fields above, to identify
+     identical searches (see #sameInputs).
+     */
+    double min_br = 0.0;
+    double min_halflife = 0.0;
+    int rad_sources = 0;
+    
+    /** The number of this search, and the (shared) number of the most recently started search
+     in the session; if they differ this search has been superseded, and will stop as soon as
+     practical, without updating the results table.
+     */
+    int search_number = 0;
+    std::shared_ptr<const std::atomic<int>> latest_search_number;
+    
+    /** If non-null, results will be posted to the GUI as each type of source (gammas, x-rays,
+     reactions) is completed, by filling out `partial_results->matches` and posting
+     `partial_update_fcn` to the session; the final results are still delivered as before.
+     */
+    std::shared_ptr<SearchWorkingSpace> partial_results;
+    boost::function< void(void) > partial_update_fcn;
+    
+    /** Returns true if a newer search has been started. */
+    bool superseded() const;
+    
+    /** Returns if the inputs (energies, windows, peaks, DRF, displayed data, limits, sources,
+     and sort order) are identical; `shared_ptr`s are compared by pointer.
+     */
+    bool sameInputs( const SearchWorkingSpace &rhs ) const;
   };//struct SearchWorkingSpace
   
   void updateSearchResults( std::shared_ptr<SearchWorkingSpace> workingspace );
+  
+  /** Returns the results of a previous search, in this session, with identical inputs to
+   `inputs`, or nullptr if there are none cached.
+   */
+  std::shared_ptr<const SearchWorkingSpace> cachedSearch( const SearchWorkingSpace &inputs ) const;
+  
   static void setSearchEnergies( std::shared_ptr<SearchWorkingSpace> workingspace,
                                 const double minbr,
                                 const double minHalfLife,
@@ -188,7 +226,8 @@ public:
                                       const std::shared_ptr<const SpecUtils::Measurement> displayed_measurement,
                                       const std::vector<std::shared_ptr<const PeakDef>> &user_peaks,
                                       const std::vector<std::shared_ptr<const PeakDef>> &automated_search_peaks,
-                                      SearchResults &answer );
+                                      SearchResults &answer,
+                                      const boost::function<bool(void)> &cancelled = boost::function<bool(void)>() );
   
   //xraysWithAllEnergies(...): fairly inefficient
   static void xraysWithAllEnergies( const std::vector<double> &energies,
@@ -218,6 +257,11 @@ protected:
   std::vector<double> m_windows;
   std::vector<double> m_energies;
   std::vector< std::vector<IsotopeMatch> > m_matches;
+  
+  /** Inputs and results of the most recent (completed, not superseded) searches, most recent
+   first; see #cachedSearch.
+   */
+  std::deque<std::shared_ptr<const SearchWorkingSpace>> m_searchCache;
 };//IsotopeSearchByEnergyModel
 
 
@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <set>
+#include <memory>
 #include <string>
 #include <vector>
 #include <functional>
@@ -122,6 +123,31 @@ protected:
   
   void handleLoadSamples( const std::string &samples, const std::string &meas_type );
   
+  /** Loads the sample numbers as the specified spectrum type ("foreground", "background", or
+   "secondary"); throws exception on error.
+   */
+  void loadSamples( const std::set<int> &samples, const std::string &meas_type );
+  
+  /** Sends the GPS data to the client; if there are a lot of GPS points, a spatial index is
+   created, and only summary information is sent, with the client then requesting points for its
+   current viewport.  Arguments are the same as for #createGeoLocationJson.
+   */
+  void setMapData( const std::set<int> &sample_to_include,
+                   const std::vector<std::string> &detector_names,
+                   const std::set<int> &foreground_samples,
+                   const std::set<int> &background_samples,
+                   const std::set<int> &secondary_samples,
+                   const bool dont_update_zoom );
+  
+  /** Sends the points, or clusters of points, within the viewport to the client. */
+  void handleViewChanged( double south, double west, double north, double east, int zoom );
+  
+  /** Loads the samples within user-drawn polygons, when not all points are on the client.
+   @param polygons JSON array of polygons, each of which is an array of rings (the first being
+          the outline, the rest being areas cut out), each of which is an array of [lon,lat].
+   */
+  void handleLoadSamplesInArea( const std::string &polygons, const std::string &meas_type );
+  
   std::shared_ptr<const SpecMeas> m_meas;
   
   
@@ -131,8 +157,14 @@ protected:
   const std::string m_jsmap;
   
   Wt::JSignal<std::string,std::string> m_displaySamples;
+  Wt::JSignal<double,double,double,double,int> m_viewChanged;
+  Wt::JSignal<std::string,std::string> m_loadSamplesInArea;
   Wt::Signal<SpecUtils::SpectrumType, std::shared_ptr<const SpecMeas>, std::set<int>> m_loadSelected;
   
+  /** Spatial index for files with many GPS points; nullptr when all points are sent to client. */
+  struct GpsIndex;
+  std::unique_ptr<GpsIndex> m_gps_index;
+  
   
   /** JS calls requested before the widget has been rendered, so wouldnt have
      ended up doing anything are saved here, and then executed once the widget
@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <deque>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -105,6 +106,61 @@ namespace MakeDrfFit
                              std::vector<float> &result,
                              std::vector<float> &uncerts );
   
+  
+  /** The input to fit the FWHM and/or intrinsic efficiency of a single DRF; see #performDrfFits. */
+  struct DrfFitInput
+  {
+    /** The peaks to fit the FWHM to; if null or empty, the FWHM will not be fit. */
+    std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > peaks;
+    DetectorPeakResponse::ResolutionFnctForm fwhm_form;
+    bool high_resolution;
+    int sqrt_eqn_order;
+    
+    /** Starting values for the FWHM fit; see #performResolutionFit. */
+    std::vector<float> fwhm_starting_values;
+    
+    /** The efficiency data points to fit; if empty, the efficiency will not be fit. */
+    std::vector<DetEffDataPoint> eff_data;
+    int eff_fcn_order;
+    
+    DrfFitInput();
+  };//struct DrfFitInput
+  
+  
+  struct DrfFitResult
+  {
+    /** If a FWHM fit was performed, and succeeded. */
+    bool fwhm_fit;
+    /** The chi2 returned by #performResolutionFit. */
+    double fwhm_chi2;
+    std::vector<float> fwhm_coefficients;
+    std::vector<float> fwhm_uncertainties;
+    /** Error message if the FWHM fit failed. */
+    std::string fwhm_error;
+    
+    /** If an efficiency fit was performed, and succeeded. */
+    bool eff_fit;
+    /** The chi2/dof returned by #performEfficiencyFit. */
+    double eff_chi2_dof;
+    std::vector<float> eff_coefficients;
+    std::vector<float> eff_uncertainties;
+    /** Error message if the efficiency fit failed. */
+    std::string eff_error;
+    
+    DrfFitResult();
+  };//struct DrfFitResult
+  
+  
+  /** Performs the FWHM and efficiency fits for many DRFs (e.g., a batch of detectors characterized using the same
+   sources), with all the fits done in parallel.
+   
+   Results are in the same order as the inputs.  A fit failing for one DRF does not effect the others; instead the
+   error message is put in the #DrfFitResult for that DRF.
+   
+   Inputs with identical efficiency data and function order are only fit once.
+   */
+  std::vector<DrfFitResult> performDrfFits( const std::vector<DrfFitInput> &inputs );
+  
 }//namespace MakeDrfFit
 
 #endif  //MakeDrfFit_h
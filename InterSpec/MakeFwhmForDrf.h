@@ -25,7 +25,9 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 #include <utility>
 
@@ -105,6 +107,20 @@ protected:
   void doRefitWork();
   void setEquationToChart();
   
+  /** The result of fitting a single FWHM functional form to the peaks. */
+  struct FwhmFormFit
+  {
+    bool success = false;
+    double chi2 = 0.0;
+    std::vector<float> parameters, uncertainties;
+    std::string error_msg;
+  };//struct FwhmFormFit
+  
+  /** Fits every FWHM functional form (and each sqrt-polynomial order) to the peaks, concurrently,
+   placing the results into #m_fitCache.
+   */
+  void fitAllFwhmForms( const std::vector<std::shared_ptr<const PeakDef>> &peaks, const bool highres );
+  
   std::vector<std::shared_ptr<const PeakDef>> get_user_peaks();
   void startAutomatedPeakSearch();
   void setPeaksFromAutoSearch( std::vector<std::shared_ptr<const PeakDef>> user_peaks,
@@ -131,6 +147,13 @@ protected:
   std::vector<float> m_parameters;
   std::vector<float> m_uncertainties;
   
+  /** Fit results keyed by {ResolutionFnctForm, sqrt eqn order (or -1)}, for #m_fitCachePeaks, so
+   changing the equation type or order does not need a refit.
+   */
+  std::map<std::pair<int,int>,FwhmFormFit> m_fitCache;
+  std::vector<std::shared_ptr<const PeakDef>> m_fitCachePeaks;
+  bool m_fitCacheHighRes;
+  
   Wt::WText *m_error;
   Wt::WText *m_equation;
   
@@ -28,6 +28,8 @@
 #include <string>
 #include <vector>
 #include <atomic>
+#include <memory>
+#include <utility>
 #include <stdexcept>
 
 #define USE_SNL_GAMMA_ATTENUATION_VALUES 0
@@ -46,6 +48,24 @@ namespace MassAttenuation
   void set_data_directory( const std::string &dir );
 #endif
   
+  /** Writes the cross-sections in the text files of `txt_dir` (e.g., "data/em_xs_data"), to a
+      versioned and checksummed binary file, `filename`.
+   
+      If the file "em_xs_data.bin" exists in the 'em_xs_data' directory, and is valid, it will be
+      memory-mapped (and so shared between processes) instead of parsing the text files when
+      cross-sections are first used.  The text files remain the source of truth: the binary file
+      records a hash of each text file, and if a text file is present, but doesnt match, that
+      element is read from the text file instead.  The binary file is not kept in the repository;
+      deployments that want the faster startup can generate it with this function.
+   
+      Throws exception on error.
+   */
+#ifdef _WIN32
+  void write_binary_xs_data( const std::wstring &txt_dir, const std::wstring &filename );
+#else
+  void write_binary_xs_data( const std::string &txt_dir, const std::string &filename );
+#endif
+  
   /** Tests if the directory pointed to by 'dir' has a sub-directory
       'em_xs_data' with valid data files.
    
@@ -112,6 +132,38 @@ namespace MassAttenuation
   float massAttenuationCoeficientFracAN( const float atomic_number, const float energy );
   
   
+  /** Gives the total mass attenuation coefficient (compton + pair production + photo electric,
+   same as #massAttenuationCoeficient) of a mixture of elements, at each of the energies given.
+   
+   Intended for plotting attenuation curves, or updating shielding previews, where the same
+   material and energy grid is evaluated over and over; results are kept in a process-wide cache
+   keyed on the mixture and energy grid, so repeated calls with the same arguments are just a
+   lookup.  Energies do not need to be sorted, but a sorted grid is interpolated in a single pass
+   over each elements tables.
+   
+   \param mass_fractions The {atomic number, weight} of each element; the returned coefficient is
+          the weight-weighted sum of the elemental coefficients, so weights are usually mass
+          fractions (that sum to 1.0), or the chemical-formula mass fractions.
+   \param energies The energies (in PhysicalUnits) to evaluate at.
+   \returns The mass attenuation coefficients (in PhysicalUnits), one for each input energy.
+   
+   Throws the same exceptions as #massAttenuationCoeficient.  Thread safe.
+   */
+  std::shared_ptr<const std::vector<float>>
+  massAttenuationCoeficients( const std::vector<std::pair<int,float>> &mass_fractions,
+                              const std::vector<float> &energies );
+  
+  /** Same as the other #massAttenuationCoeficients, but for a single sub-process.
+   
+   Like the single-energy version for a process, will throw std::runtime_error if any energy is
+   outside the range of the cross-section data.
+   */
+  std::shared_ptr<const std::vector<float>>
+  massAttenuationCoeficients( const std::vector<std::pair<int,float>> &mass_fractions,
+                              const std::vector<float> &energies,
+                              MassAttenuation::GammaEmProcces process );
+  
+  
   /** Compute the total attenuation coefficient using GADRASs CrossSection.lib.
    * Assumes "data/CrossSection.lib" (from GADRAS) exists, and upon first calling
    * of this function will read it in; if reading fails, will throw
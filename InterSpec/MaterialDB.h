@@ -25,6 +25,7 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -162,6 +163,14 @@ public:
   void parseG4MaterialFile( const std::string &file,
                             const SandiaDecay::SandiaDecayDataBase *db );
 
+  /** Adds a copy of each material in `other` (except the void material, and materials with a
+   name already in this database) to this database.
+   
+   Lets each session start from a database parsed only once per process, while still being able
+   to add its own materials (e.g., via #parseChemicalFormula) without effecting other sessions.
+   */
+  void copyMaterialsFrom( const MaterialDB &other );
+
 
   //writeGadrasStyleMaterialFile(...):
   //  Writes the materials back out to a GADRAS compatible format, using Windows
@@ -237,6 +246,11 @@ protected:
   std::vector<const Material *> m_materials;
   std::vector<std::string> m_materialNames;  //one-to-one correspondance to m_materials
   
+  /** The materials created by #parseChemicalFormula, keyed by the formula text they were parsed
+   from; the Materials are owned by #m_materials.  Protected by #m_mutex.
+   */
+  std::map<std::string,const Material *> m_formulaMaterials;
+  
   //m_initFailure: if a timeout while waiting for the database to be initialized
   //  has occured, then skip the waiting for subsequent calls.
   mutable bool m_initFailure;
@@ -0,0 +1,152 @@
+#ifndef MonteCarloUncertainty_h
+#define MonteCarloUncertainty_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+class PeakDef;
+
+namespace SpecUtils
+{
+  class Measurement;
+}
+
+
+/** Monte-Carlo (bootstrap) estimates of the uncertainties of fit results.
+ 
+ The uncertainties reported by the fits (peaks, relative activity, shielding/source) come from the
+ linearized covariance at the best-fit point, which can be poor for low-statistics data, parameters
+ near limits, or strongly non-linear models.  Instead, the data (e.x., the spectrum, with Poisson
+ fluctuations) or the fit parameters (from their covariance) can be resampled, and the fit repeated
+ many times, giving the distribution of each result.
+ 
+ Each trial is ran as a task on the #SharedThreadPool, and uses its own random number generator,
+ seeded from the trial number, so results do not depend on the number of threads, or the order
+ trials complete in.  Trial functions should warm-start from the nominal solution, and share any
+ immutable fit inputs (e.x., nuclide data, DRF, materials) between trials, rather than re-creating
+ them for each trial.
+ */
+namespace MonteCarloUncertainty
+{
+  /** Performs a single trial, returning the quantities of interest (the same number, and meaning, as
+   the nominal values), or throws an exception if the trial failed (e.x., the fit didnt converge).
+   
+   Called from multiple threads at once.
+   */
+  typedef std::function<std::vector<double>( std::mt19937_64 &rng, const size_t trial )> TrialFunction;
+  
+  
+  /** The distribution of the quantities of interest over the trials. */
+  struct Distribution
+  {
+    /** The quantities of interest from the nominal fit. */
+    std::vector<double> nominal;
+    
+    /** The results of each successful trial; each the same size as #nominal. */
+    std::vector<std::vector<double>> samples;
+    
+    /** The number of trials that failed, and are not included in #samples. */
+    size_t num_failed;
+    
+    /** The mean of quantity `index` over the trials; throws if no trials succeeded, or invalid index. */
+    double mean( const size_t index ) const;
+    
+    /** The sample standard deviation of quantity `index`; throws if fewer than two trials succeeded. */
+    double standard_deviation( const size_t index ) const;
+    
+    /** The value of quantity `index` that a fraction `p` (between 0 and 1) of trials are below, using
+     linear interpolation between samples; e.x., `quantile(i,0.025)` and `quantile(i,0.975)` give
+     a 95% interval.  Throws if no trials succeeded.
+     */
+    double quantile( const size_t index, const double p ) const;
+    
+    /** Returns the values of quantity `index` over the (successful) trials, sorted. */
+    std::vector<double> sorted_values( const size_t index ) const;
+    
+    Distribution();
+  };//struct Distribution
+  
+  
+  /** Runs `num_trials` trials in parallel.
+   
+   @param nominal The quantities of interest from the nominal fit.
+   @param trial The function to perform a single trial.
+   @param num_trials The number of trials; something like 1000 is typical.
+   @param seed The seed to derive each trials random number generator from; the same seed gives the
+          same results.
+   @param cancel If non-null, and becomes true, trials not yet started are skipped (and are not
+          counted as failed).
+   
+   Throws exception if `trial` returns a different number of values than `nominal`.
+   */
+  Distribution run_trials( const std::vector<double> &nominal,
+                           const TrialFunction &trial,
+                           const size_t num_trials,
+                           const uint64_t seed = 0,
+                           const std::atomic<bool> *cancel = nullptr );
+  
+  
+  /** Returns a copy of `nominal`, with the counts in each gamma channel replaced by a Poisson
+   fluctuation of the original counts.
+   
+   The energy calibration, and all other information, is shared with/copied from `nominal`.
+   */
+  std::shared_ptr<SpecUtils::Measurement> poisson_resample( const SpecUtils::Measurement &nominal,
+                                                            std::mt19937_64 &rng );
+  
+  
+  /** Returns parameter values drawn from a multivariate normal distribution with means `values` and
+   covariance `covariance` (e.x., from a fits covariance matrix), for propagating fit uncertainties
+   into derived quantities.
+   
+   Parameters with zero variance are left at their nominal values.
+   Throws exception if `covariance` is not `values.size()` square, or is not positive semi-definite.
+   */
+  std::vector<double> gaussian_resample( const std::vector<double> &values,
+                                         const std::vector<std::vector<double>> &covariance,
+                                         std::mt19937_64 &rng );
+  
+  
+  /** Distribution of the amplitudes of peaks that share a ROI, by Poisson resampling `spectrum`, and
+   refitting the peaks (starting from `peaks`) for each trial.
+   
+   The nominal values, and the order of the values of each trial, are the amplitudes of `peaks`, as
+   ordered by mean.  Trials where a peak is lost in the refit are counted as failed.
+   
+   Throws exception if no peaks are passed in, or they dont all share a continuum.
+   */
+  Distribution peak_amplitude_distribution( const std::shared_ptr<const SpecUtils::Measurement> &spectrum,
+                                            const std::vector<std::shared_ptr<const PeakDef>> &peaks,
+                                            const size_t num_trials,
+                                            const uint64_t seed = 0 );
+}//namespace MonteCarloUncertainty
+
+#endif //MonteCarloUncertainty_h
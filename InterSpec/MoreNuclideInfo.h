@@ -119,9 +119,22 @@ namespace MoreNuclideInfo
   };//class RefInfo
 
 
+  /** The additional nuclide information database.
+   
+   When initialized, the XML file is only scanned to index where each <Nuc> element is within the
+   file, and to read the (small) <References> section; the individual <Nuc> elements are read from
+   the file, and decoded, the first time they are asked for, and then cached for the life of the
+   instance.  Most sessions only ever look at a handful of nuclides, so this keeps both the
+   initialization time, and memory use, down.
+   */
   class MoreNucInfoDb
   {
   public:
+    /** Returns the information for the nuclide (or reaction, or other name in the XML), reading it
+     from the XML file if this is the first time its been asked for.
+     
+     Returned pointer will stay valid for the life of this MoreNucInfoDb.  Thread safe.
+     */
     const NucInfo *info( const std::string &nuc ) const;
     const NucInfo *info(const SandiaDecay::Nuclide *nuc) const;
 
@@ -137,20 +150,42 @@ namespace MoreNuclideInfo
      */
     static void remove_global_instance();
   
-    std::map<const SandiaDecay::Nuclide *, NucInfo> m_nuc_infos;
-    std::map<std::string, NucInfo> m_other_infos;
     std::map<std::string, RefInfo> m_references;
 
     /// Make sure move constructor is created
     MoreNucInfoDb( MoreNucInfoDb && ) = default;
 
+    /** Returns the memory of the index, references, and the entries decoded so far. */
     size_t memsize() const;
   
     MoreNucInfoDb();
   private:
-
+    /** Location of a <Nuc> element within the XML file. */
+    struct NucLocation
+    {
+      size_t m_offset = 0;
+      size_t m_length = 0;
+    };//struct NucLocation
+    
     /** Throws exception on failure. */
     void init();
+    
+    /** Reads the <Nuc> element at `location` from the XML file, and decodes it.
+     
+     Throws exception on failure.
+     */
+    NucInfo decode( const NucLocation &location ) const;
+    
+    /** The XML file the index was built from. */
+    std::string m_filename;
+    
+    /** Where each nuclide, or other entry, is within #m_filename. */
+    std::map<const SandiaDecay::Nuclide *, NucLocation> m_nuc_index;
+    std::map<std::string, NucLocation> m_other_index;
+    
+    /** The entries decoded so far; protected by a file-scope mutex, so this class stays movable. */
+    mutable std::map<const SandiaDecay::Nuclide *, NucInfo> m_nuc_infos;
+    mutable std::map<std::string, NucInfo> m_other_infos;
   };//class MoreNucInfoDb
 
 }//namespace MoreNuclideInfo
@@ -0,0 +1,121 @@
+#ifndef ParallelHessian_h
+#define ParallelHessian_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <vector>
+#include <functional>
+
+namespace ROOT
+{
+  namespace Minuit2
+  {
+    class FCNBase;
+  }
+}
+
+class PeakFitChi2Fcn;
+class MultiPeakFitChi2Fcn;
+
+
+/** Computes the Hessian (and from it the covariance matrix) of a chi2, or negative log-likelihood,
+ function by central finite differences, with the function evaluations spread over multiple threads.
+ 
+ Minuit computes the Hessian, at the end of a fit, with O(N^2) function evaluations, one after the
+ other; for fits with many parameters, or expensive functions (large ROIs, self-attenuating
+ shielding), this can be the majority of the wall time.  Since each of the evaluations is
+ independent, they can instead be ran concurrently.
+ 
+ The only requirement on the function is that it can be evaluated from multiple threads at once;
+ each worker thread asks an #EvaluatorFactory for its own #Evaluator, so functions that need scratch
+ space (e.g., #PeakFitChi2Fcn, which re-uses PeakDef objects between evaluations), can give each
+ thread its own.
+ */
+namespace ParallelHessian
+{
+  /** Evaluates the function at the given parameter values.  A given Evaluator is only ever called
+   from a single thread.
+   */
+  typedef std::function<double(const std::vector<double> &)> Evaluator;
+  
+  /** Creates an Evaluator; called once by each worker thread. */
+  typedef std::function<Evaluator()> EvaluatorFactory;
+  
+  
+  struct HessianResult
+  {
+    /** The matrix of second derivatives, d^2f/(dx_i dx_j); symmetric. */
+    std::vector<std::vector<double>> hessian;
+    
+    /** The covariance matrix, `2*up*inverse(hessian)`; empty if the Hessian could not be inverted,
+     or is not positive-definite.
+     */
+    std::vector<std::vector<double>> covariance;
+    
+    /** The square root of the diagonal of #covariance; empty if #covariance is. */
+    std::vector<double> errors;
+    
+    /** Number of times the function was evaluated. */
+    size_t num_fcn_calls = 0;
+  };//struct HessianResult
+  
+  
+  /** Computes the Hessian, and covariance, of a function at `x`.
+   
+   \param factory Creates the per-thread function evaluators.
+   \param x The point to evaluate the Hessian at; normally the minimum found by a fit.
+   \param steps The finite-difference step for each parameter; must be the same size as `x`, with
+          no negative entries.  A step of zero means the parameter is fixed; its row and column of
+          the Hessian and covariance are zero.  A reasonable choice is around a tenth of the
+          parameters expected uncertainty.  It is the callers responsibility to make sure
+          `x +- steps` is within any parameter limits.
+   \param up The change in function value that corresponds to one-sigma (1.0 for a chi2, 0.5 for
+          a negative log-likelihood), i.e., the same as `ROOT::Minuit2::FCNBase::Up()`.
+   \param num_threads The number of threads to use; if zero, uses the hardware concurrency.
+   
+   Throws exception if `steps` is not the same size as `x`, or if the function evaluation throws.
+   */
+  HessianResult compute( const EvaluatorFactory &factory,
+                         const std::vector<double> &x,
+                         const std::vector<double> &steps,
+                         const double up,
+                         size_t num_threads = 0 );
+  
+  
+  /** Evaluator factory for a Minuit function whose `operator()` is already safe to call from
+   multiple threads at once, e.g., `GammaInteractionCalc::ShieldingSourceChi2Fcn`.
+   
+   `fcn` must outlive the returned factory, and the evaluators it creates.
+   */
+  EvaluatorFactory evaluator_factory( const ROOT::Minuit2::FCNBase &fcn );
+  
+  /** Evaluator factory for #PeakFitChi2Fcn, where each evaluator has its own working peaks. */
+  EvaluatorFactory evaluator_factory( const PeakFitChi2Fcn &fcn );
+  
+  /** Evaluator factory for #MultiPeakFitChi2Fcn, where each evaluator has its own working peaks. */
+  EvaluatorFactory evaluator_factory( const MultiPeakFitChi2Fcn &fcn );
+}//namespace ParallelHessian
+
+#endif //ParallelHessian_h
@@ -58,6 +58,22 @@ namespace PeakDists
    */
   double boost_erfc_imp( double z );
   
+  /** Array version of `boost_erf_imp(double)`; sets `result[i] = boost_erf_imp(z[i])` for `n` values.
+   
+   Consecutive arguments that fall in the same interval of the rational approximation are grouped
+   together and evaluated in tight loops without branches or math-library calls, which the compiler
+   is able to auto-vectorize (on x86-64 Linux, an AVX2 version is selected at runtime, if the CPU
+   supports it).  Since channel-edge energies are monotonic, the arguments for a peak are too, so
+   there are only a handful of these runs; unsorted input is fine, but will be slower.
+   
+   Uses its own `exp` implementation (so it can be vectorized), so results may differ from the
+   scalar version in the last couple bits.
+   */
+  void boost_erf_imp( const double * const z, double * const result, const size_t n );
+  
+  /** Array version of `boost_erfc_imp(double)`; see the array version of `boost_erf_imp(...)`. */
+  void boost_erfc_imp( const double * const z, double * const result, const size_t n );
+  
   
   /** Function to semi-efficiently integrate the gaussian plus optionally skew distribution over an energy range.
    
@@ -82,6 +98,34 @@ namespace PeakDists
                                           const float * const lower_energies,
                                           double *peak_count_channels );
   
+  /** Adds the partial derivatives of the per-channel photopeak integrals (as computed by
+   `photopeak_function_integral(...)`) with respect to the peak mean, sigma, and skew parameters.
+   
+   The derivative with respect to amplitude is just `photopeak_function_integral(...)` with an
+   amplitude of 1.0, so is not computed here.
+   
+   For `PeakDef::SkewType::NoSkew` the derivatives are analytic; for the skewed distributions they
+   are central differences of this one peaks channel integrals.
+   
+   @param d_mean Where the derivatives with respect to mean are _added_ to; must have at least
+          `nchannel` entries, or be nullptr if not wanted.
+   @param d_sigma Where the derivatives with respect to sigma are _added_ to; must have at least
+          `nchannel` entries, or be nullptr if not wanted.
+   @param d_skew Where the derivatives with respect to the skew parameters are _added_ to; must
+          have at least `nchannel*PeakDef::num_skew_parameters(skew_type)` entries, with the
+          derivatives for the i'th skew parameter starting at `d_skew + i*nchannel`.  May be nullptr.
+   */
+  void photopeak_function_integral_derivatives( const double mean,
+                                                const double sigma,
+                                                const double amplitude,
+                                                const PeakDef::SkewType skew_type,
+                                                const double * const skew_parameters,
+                                                const size_t nchannel,
+                                                const float * const lower_energies,
+                                                double *d_mean,
+                                                double *d_sigma,
+                                                double *d_skew );
+  
   
   
   
@@ -116,6 +160,30 @@ namespace PeakDists
                               const size_t nchannel );
   
   
+  /** Returns erf(z) interpolated from a precomputed table, instead of evaluating the rational
+   approximation of `boost_erf_imp(...)`.
+   
+   Results are within about 1E-10 (absolute) of `boost_erf_imp(z)`; this is plenty for fitting
+   low-resolution (e.g., NaI or LaBr) spectra, where statistical uncertainties are many orders of
+   magnitude larger, but exact erf is still used by default everywhere.
+   */
+  double erf_tabulated( const double z );
+  
+  /** Same as `gaussian_integral(mean,sigma,x0,x1)`, but using `erf_tabulated(...)`. */
+  double gaussian_integral_tabulated( const double peak_mean, const double peak_sigma,
+                                      const double x0, const double x1 );
+  
+  /** Same as the array version of `gaussian_integral(...)` (including only computing within
+   +-8 sigma of the mean), but using `erf_tabulated(...)`.
+   */
+  void gaussian_integral_tabulated( const double peak_mean,
+                                    const double peak_sigma,
+                                    const double peak_amplitude,
+                                    const float * const energies,
+                                    double *channels,
+                                    const size_t nchannel );
+  
+  
   
   /** Returns the integral of a unit-area Bortel function, between `x1` and `x2`. */
   double bortel_integral( const double mean, const double sigma, const double skew,
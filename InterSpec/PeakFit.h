@@ -28,6 +28,7 @@
 #include <deque>
 #include <tuple>
 #include <vector>
+#include <functional>
 
 #include "Minuit2/FCNBase.h"
 
@@ -68,6 +69,20 @@ struct SavitzyGolayCoeffs
                std::vector<float> &output ) const;
   void smooth( const float *input, const int nSamples,
                std::vector<float> &output ) const;
+  
+  /** Same as above, but writes into a caller-provided buffer that must hold
+   at least `nSamples` entries; no memory is allocated.
+   */
+  void smooth( const float *input, const int nSamples, float *output ) const;
+  
+  /** Returns a shared, immutable, set of coefficients.
+   
+   Computing the coefficients requires a matrix inversion, so for the handful of
+   (bins_left, bins_right, order, derivative) combinations peak searching uses,
+   it is a lot cheaper to compute them once and re-use them.  Thread safe.
+   */
+  static std::shared_ptr<const SavitzyGolayCoeffs> cached( int bins_left, int bins_right,
+                                                           int order, int derivative );
 };//struct SavitzyGolayCoeffs
 
 
@@ -86,15 +101,57 @@ const char *calculateContinuum( float *spectrum, int ssize,
                                        bool smoothing, int smoothWindow,
                                        bool compton );
 
+/** SNIP peak-clipping continuum estimate of `spectrum`, done in place.
+ 
+ Gives the same result as #calculateContinuum with smoothing and Compton-edge estimation turned off,
+ but the clipping pass for each window is a branch-free loop over contiguous memory (so the compiler
+ can vectorize it), and the working buffer is kept per-thread, so repeated calls dont allocate.
+ 
+ @param maxWindow The largest clipping half-width, in channels (i.e., `numberIterations` of
+        #calculateContinuum); the cost is O(nchannels * maxWindow).
+ @param filterOrder One of kBackOrder2, kBackOrder4, kBackOrder6, or kBackOrder8.
+ @param increasingWindow If true, clip with windows 1 through `maxWindow`, otherwise from
+        `maxWindow` down to 1.
+ @returns nullptr on success, or a description of the problem (in which case `spectrum` is not
+          modified), same as #calculateContinuum.
+ */
+const char *snipContinuum( float *spectrum, const size_t nchannels, const int maxWindow,
+                           const int filterOrder, const bool increasingWindow );
+
 //estimateContinuum(): estimates continuum for the data passed in using
 //  "standard" parameters
 std::shared_ptr<SpecUtils::Measurement> estimateContinuum( std::shared_ptr<const SpecUtils::Measurement> data );
 
+/** The channel counts of the continuum #estimateContinuum returns.
+ 
+ Results are cached (process-wide) by the contents of the measurements gamma counts, so the auto
+ peak search, isotope ID, and the display asking for the continuum of the same spectrum only
+ compute it once.  Returns nullptr if `data` has no gamma counts.
+ */
+std::shared_ptr<const std::vector<float>> estimateContinuumCounts( const std::shared_ptr<const SpecUtils::Measurement> &data );
+
 std::vector<float> findPeaksByRelaxation( float *source, float *dest, int ssize,
                                           float sigma, double threshold,
                                           bool bckgrndRemove, int nIterations,
                                           bool markov, int averWindow );
 
+/** Same as the above #findPeaksByRelaxation, but for the gamma counts of `data`.
+ 
+ @param dest Will be resized to the number of channels of `data`, and filled with the deconvolved
+        spectrum; channels outside the range searched are zero.
+ @param limitToSpectroscopicExtent If true, only the channels within
+        ExperimentalPeakSearch::find_spectroscopic_extent(...) are searched, which for most
+        spectra removes a lot of empty channels at the top of the spectrum; note that results may
+        differ slightly from searching the whole spectrum, near the edges of the extent.
+ @returns The peak positions, in channels of `data`.
+ */
+std::vector<float> findPeaksByRelaxation( const std::shared_ptr<const SpecUtils::Measurement> &data,
+                                          std::vector<float> &dest,
+                                          float sigma, double threshold,
+                                          bool bckgrndRemove, int nIterations,
+                                          bool markov, int averWindow,
+                                          const bool limitToSpectroscopicExtent );
+
 std::vector< std::vector<PeakDef> >
          causilyDisconnectedPeaks( const double x0, const double x1,
                                    const double ncausality,
@@ -134,6 +191,23 @@ void smoothSpectrum( const std::vector<float> &spectrum, const int side_bins,
                     const int order, const int derivative,
                     std::vector<float> &results );
 
+/** Computes the Savitzky-Golay smoothed spectrum, and its second derivative, in
+ a single pass over the data; gives identical results to calling
+ #smoothSpectrum with `derivative` of 0, and 2, but only reads through the
+ spectrum once.
+ 
+ If `smoothed` or `second_deriv` already have enough capacity, no memory is
+ allocated.
+ */
+void smoothSpectrumAndSecondDerivative( const std::vector<float> &spectrum,
+                                        const int side_bins, const int order,
+                                        std::vector<float> &smoothed,
+                                        std::vector<float> &second_deriv );
+void smoothSpectrumAndSecondDerivative( std::shared_ptr<const SpecUtils::Measurement> meas,
+                                        const int side_bins, const int order,
+                                        std::vector<float> &smoothed,
+                                        std::vector<float> &second_deriv );
+
 #define PRINT_DEBUG_INFO_FOR_PEAK_SEARCH_FIT_LEVEL 0
 
 //expected_peak_width_limits(): gives the extremes of expected peak
@@ -393,6 +467,36 @@ double chi2_for_region( const PeakShrdVec &peaks,
                         const int lowBin,
                         const int highBin );
 
+/** Thresholds for the closed-form screen done before the full evaluations of
+ chi2_significance_test(...) and check_lowres_single_peak_fit(...).
+ 
+ The screen solves for the candidate peaks amplitude, with its shape fixed, and a linear continuum
+ over the peaks ROI, giving the likelihood-ratio statistic (the improvement in chi2) of adding the
+ peak.  Candidates below #reject_below_likelihood_ratio are rejected, and in
+ chi2_significance_test(...) candidates above #accept_above_likelihood_ratio (that also pass the
+ requested tests using the closed-form chi2s) are accepted, without the full evaluation; everything
+ in between gets the full evaluation.
+ */
+struct PeakScreenThresholds
+{
+  /** If false, no screening is done, and the full evaluations are always done. */
+  bool enabled;
+  
+  /** Default 1.0; i.e., the best-fit amplitude is less than 1 sigma from zero. */
+  double reject_below_likelihood_ratio;
+  
+  /** Default 400; i.e., the best-fit amplitude is more than 20 sigma from zero. */
+  double accept_above_likelihood_ratio;
+  
+  PeakScreenThresholds();
+};//struct PeakScreenThresholds
+
+/** Sets the thresholds used for all subsequent peak screening; thread safe. */
+void set_peak_screen_thresholds( const PeakScreenThresholds &thresholds );
+
+/** Returns the current peak screening thresholds; thread safe. */
+PeakScreenThresholds peak_screen_thresholds();
+
 //stat_threshold: this is how incompatible with background/continuum the data
 //                must be, before a peak is allowed to exist.  Reasonable
 //                numbers for this are probably between 1 and 5.
@@ -411,11 +515,33 @@ bool chi2_significance_test( PeakDef peak,
 
 namespace ExperimentalAutomatedPeakSearch
 {
+  /** Searches the spectrum for peaks, returning the input peaks, plus the found peaks.
+   
+   If `singleThreaded` is false, causally independent candidate peaks are fit concurrently, but
+   results are committed in the same order as the single-threaded search, so the answer is the
+   same either way.
+   
+   If `progress` is non-null, it is called from the searching thread as candidates are committed,
+   with the number of candidate peaks processed so far, and the total number of candidates.
+   */
   std::vector<std::shared_ptr<const PeakDef> >
               search_for_peaks( const std::shared_ptr<const SpecUtils::Measurement> meas,
                                 const std::shared_ptr<const DetectorPeakResponse> drf,
                                 std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > origpeaks,
-                                const bool singleThreaded );
+                                const bool singleThreaded,
+                                const std::function<void(size_t,size_t)> &progress = std::function<void(size_t,size_t)>() );
+  
+  /** Sets the number of channels at, or above, which #search_for_peaks finds candidate peaks on a
+   copy of the spectrum with channels combined (by a power of two, keeping at least half this many
+   channels, and keeping peaks at least a few channels wide if the DRF has resolution info), before
+   fitting the candidates at full resolution.
+   
+   Default is 16385 (i.e., only 32k and larger spectra); a value of 0 disables.
+   */
+  void set_coarse_candidate_search_min_channels( const size_t nchannels );
+  
+  /** Returns the value set by #set_coarse_candidate_search_min_channels. */
+  size_t coarse_candidate_search_min_channels();
 }//namespace ExperimentalAutomatedPeakSearch
 
 
@@ -44,12 +44,13 @@
 #include "Minuit2/SimplexMinimizer.h"
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMinimize.h"
+#include "Minuit2/FCNGradientBase.h"
 
 namespace SpecUtils{ class Measurement; }
 
 
 class PeakFitChi2Fcn
-    : public ROOT::Minuit2::FCNBase
+    : public ROOT::Minuit2::FCNGradientBase
 //      , public ROOT::Math::IBaseFunctionMultiDim //implemented, but not actually used, so left commented out
 {
   //This class is a first attempt at better fitting than simple ROOT fitting,
@@ -61,7 +62,6 @@ class PeakFitChi2Fcn
   //  - A -2*ln(liklihood) based figure of merrit method should be implemented.
   //  - Should fully integrate MultiPeakFitChi2Fcn into this class (along with
   //    checking of benchmarks)
-  //  - Try inherriting from FCNGradientBase so can provide gradient
 
 public:
   //FitPars gives the order of parameters.
@@ -126,6 +126,36 @@ public:
   virtual double operator()( const double *x ) const;
   virtual double operator()( const std::vector<double>& params ) const;  //does the work
   double chi2( const double *params ) const;
+  
+  /** Same as `chi2(params)`, but uses `peaks` as scratch space, instead of the shared
+   `m_workingPeaks`, so may be called from multiple threads at once, as long as each thread passes
+   in its own vector (which may be empty; it will be resized as needed).
+   */
+  double chi2( const double *params, std::vector<PeakDef> &peaks ) const;
+  
+  /** Returns the gradient of `chi2(...)` with respect to each of the `m_npeaks*NumFitPars`
+   parameters.
+   
+   The chi2 is differentiated analytically with respect to the per-channel peak and continuum
+   counts, which are in turn differentiated using
+   `PeakDists::photopeak_function_integral_derivatives(...)`, and the (linear) dependence of the
+   continuum on its coefficients.  The channels each peak contributes to, and the degrees of
+   freedom, are taken as constant, and the multi-peak punishment is differenced numerically.
+   Parameters that are only used to carry information (ex., `ContinuumInfoField`) have a gradient
+   of zero.
+   */
+  virtual std::vector<double> Gradient( const std::vector<double> &params ) const;
+  
+  /** Same as `Gradient(params)`, but using `peaks` as scratch space; see
+   `chi2( const double *, std::vector<PeakDef> & )`.
+   */
+  std::vector<double> Gradient( const std::vector<double> &params, std::vector<PeakDef> &peaks ) const;
+  
+  /** Returns false, so Minuit does not compare `Gradient(...)` to its numerical gradient before
+   minimizing; the fit ranges changing with peak width make the chi2 not quite smooth, which can
+   fail this comparison even when the gradient is correct, and Minuit asserts on failure.
+   */
+  virtual bool CheckGradient() const;
 
   double evalMultiPeakPunishment( const std::vector<const PeakDef *> &peaks ) const;
   
@@ -186,6 +216,16 @@ protected:
   std::shared_ptr<const SpecUtils::Measurement> m_data;
   std::shared_ptr<const SpecUtils::Measurement> m_continium;
   
+  /** Peaks re-used by `chi2(...)` and `Gradient(...)` for every evaluation, so the PeakDef and
+   PeakContinuum objects (and their heap allocations) are created once per fit, rather than once
+   per Minuit iteration.  Only ever used as scratch space; the final peaks are always created by
+   the callers call to `parametersToPeaks(...)`.
+   
+   Because of this, `operator()`, `chi2(params)`, and `Gradient(params)` must not be called by
+   more than one thread at a time; use the overloads that take a `peaks` argument for that.
+   */
+  mutable std::vector<PeakDef> m_workingPeaks;
+  
 private:
   virtual double DoEval( const double *x ) const;
 };//class PeakFitChi2Fcn
@@ -308,9 +348,25 @@ protected:
   double m_reldiff_punish_weight;
   
   
-  //If sm_call_opt_integrate is true, then will re-use the following peaks to
-  //  avoid allocation overhead and such - currently only for development
-  //  (looks to speed things up by maybe 8% or so?)
+  /** The number of polynomial continuum coefficients (e.g., 2 for a linear continuum), if the
+   continuum is a plain polynomial (Constant, Linear, Quadratic, or Cubic), or zero otherwise.
+   */
+  size_t m_numPolyContinuumPars;
+  
+  /** Since the channel energies are fixed for the ROI, we precompute the integral over each
+   channel of each term of the polynomial continuum (relative to `m_rangeLow`, which the
+   continuum uses as its reference energy), in the constructor.  The continuum counts in each
+   channel, for all evaluations, are then just a dot product with the continuum coefficients.
+   
+   Indexed as `[relchannel*m_numPolyContinuumPars + order]`; empty if continuum is not a plain
+   polynomial, in which case `PeakContinuum::offset_integral(...)` is used.
+   */
+  std::vector<double> m_continuumBasis;
+  
+  //Peaks re-used by every call to DoEval(...), to avoid the allocation overhead
+  //  of creating the PeakDef and PeakContinuum objects on every Minuit iteration.
+  //  Because of this, only `DoEval( x, peaks )`, with a `peaks` for each thread, may be called
+  //  from multiple threads at once.
   mutable std::vector<PeakDef> m_workingpeaks;
 };//class MultiPeakFitChi2Fcn
 
@@ -379,6 +435,9 @@ public:
                                const float lowerROI, const float upperROI );
   
   virtual double Up() const;
+  
+  //operator()(...) and DoEval(...) keep no state between calls, so may be
+  //  called from multiple threads at once.
   virtual double operator()( const std::vector<double> &params ) const;
   virtual double DoEval( const double *x ) const;
   
@@ -49,6 +49,47 @@ void fit_peak_for_user_click_LM( std::vector< std::shared_ptr<const PeakDef> > &
                                 const double area0,
                                 const float roiLowerEnergy,
                                 const float roiUpperEnergy );
+  
+  
+/** The result of #fit_peaks_jointly for a single detector. */
+struct JointDetectorFit
+{
+  /** The fit peaks for this detector, sorted by mean, and sharing a (per-detector) continuum. */
+  std::vector< std::shared_ptr<const PeakDef> > peaks;
+  
+  /** The fit energy offset of this detector, relative to the first detector; zero for the first detector. */
+  double energy_offset;
+  
+  /** The fit multiplier of peak widths for this detector, relative to the first detector; one for the first. */
+  double fwhm_scale;
+  
+  double chi2;
+  double dof;
+};//struct JointDetectorFit
+  
+  
+/** Jointly fits the peaks of a single ROI across multiple detectors that recorded the same source
+ at the same time (e.x., the panels of a portal, or the elements of an array).
+ 
+ Peak means, and widths (a single width, or a linear width across the ROI, for multiple peaks) are
+ shared between all detectors, up to a per-detector energy offset and width multiplier (for the first
+ detector these are fixed to 0 and 1); peak amplitudes and continuum are fit separately for each
+ detector, by linear least squares (see #fit_amp_and_offset) for each evaluation of the shared
+ parameters.  The detectors are evaluated in parallel, so the wall time is about that of fitting a
+ single detector, but without the loss of resolution from summing the detectors.
+ 
+ @param detectors The spectrum of each detector; must all have valid energy calibrations covering the ROI.
+ @param starting_peaks The peaks to fit, e.x., from fitting the summed spectrum; must all share a continuum,
+        which defines the ROI and continuum type.  Peaks whose mean is not fit-for keep their mean fixed
+        (up to the detector offset); the skew, if any, of the first peak is used for all, and not fit.
+ 
+ @returns The fit for each detector, in the same order as `detectors`.
+ 
+ Throws exception on invalid input, or if the fit fails.
+ */
+std::vector<JointDetectorFit> fit_peaks_jointly(
+                          const std::vector< std::shared_ptr<const SpecUtils::Measurement> > &detectors,
+                          const std::vector< std::shared_ptr<const PeakDef> > &starting_peaks );
 }//namespace PeakFitLM
 
 
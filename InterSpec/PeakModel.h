@@ -137,6 +137,11 @@ public:
   
   std::shared_ptr<const std::deque< PeakModel::PeakShrdPtr > > peaks() const;
   std::vector<PeakDef> peakVec() const;
+  
+  /** Approximate memory used by this model.  The PeakDef objects themselves are owned by the SpecMeas
+   the peaks belong to, so are not included (see #SpecMeas::memsize).
+   */
+  size_t memsize() const;
 
   //definePeakXRangeAndChi2(...): Inorder to save cpu (and mostly memorry access
   //  time) later on, this function will define the lower and upper energy range
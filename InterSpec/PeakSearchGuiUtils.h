@@ -30,6 +30,7 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <functional>
 
 #include <boost/function.hpp>
 
@@ -146,6 +147,8 @@ void assign_nuclide_from_reference_lines( PeakDef &peak,
 //  main event loop thread, and is done regardless of succesfulness of the
 //  peak search.  'callback' is intended to be a bound function call to
 //  setPeaksFromSearch(...) or setHintPeaks(...).
+//  If 'progress' is non-null, it is called from the worker thread as
+//  candidate peaks are fit (see ExperimentalAutomatedPeakSearch::search_for_peaks).
 void search_for_peaks_worker( std::weak_ptr<const SpecUtils::Measurement> weak_data,
                              std::shared_ptr<const DetectorPeakResponse> drf,
                              std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > existingPeaks,
@@ -154,7 +157,8 @@ void search_for_peaks_worker( std::weak_ptr<const SpecUtils::Measurement> weak_d
                                std::shared_ptr<std::vector<std::shared_ptr<const PeakDef> > > resultpeaks,
                                boost::function<void(void)> callback,
                                const std::string sessionID,
-                               const bool singleThread);
+                               const bool singleThread,
+                               const std::function<void(size_t,size_t)> progress = std::function<void(size_t,size_t)>() );
   
 /** Assigns peak nuclides/xrays/reactions from the reference photopeak lines by
    modifying the peaks passed in.  
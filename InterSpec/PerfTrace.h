@@ -0,0 +1,116 @@
+#ifndef PerfTrace_h
+#define PerfTrace_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+#include <cstdint>
+
+/** Low-overhead timing of hot paths, that can be downloaded as Chrome trace-event JSON (viewable in
+ chrome://tracing or https://ui.perfetto.dev), to help explain latency spikes.
+ 
+ Instrumentation is placed with the #INTERSPEC_TRACE_SCOPE macro, which compiles to nothing unless
+ InterSpec is built with the `PERFORMANCE_TRACING` CMake option.  When enabled, each thread records
+ completed events into its own fixed-size ring buffer (so old events are overwritten, and memory
+ use is bounded), tagged with the Wt session they were for, if known.
+ 
+ When built as a web-server, the traces are available from "/admin/trace" (from localhost only);
+ add "?session=<first 8 chars of session ID>" to limit to a single session.
+ */
+namespace PerfTrace
+{
+  /** Microseconds since an arbitrary, but fixed, epoch (steady clock). */
+  int64_t now_us();
+  
+  /** Records a completed event.
+   
+   @param name The event name; must be a string literal, or otherwise outlive the program, as only
+          the pointer is stored.
+   @param start_us Start time, from #now_us
+   @param duration_us Duration of the event, in microseconds.
+   */
+  void record( const char *name, const int64_t start_us, const int64_t duration_us );
+  
+  /** Returns the currently buffered events, of all threads, as Chrome trace-event JSON.
+   
+   @param session_prefix If non-empty, only events for sessions whose ID starts with this are
+          returned; otherwise all events are returned.
+   */
+  std::string chrome_trace_json( const std::string &session_prefix = "" );
+  
+  /** Discards all buffered events. */
+  void clear();
+  
+  /** Times the scope it is declared in; use via #INTERSPEC_TRACE_SCOPE. */
+  class ScopedTimer
+  {
+  public:
+    explicit ScopedTimer( const char *name );
+    ~ScopedTimer();
+    
+    ScopedTimer( const ScopedTimer & ) = delete;
+    ScopedTimer &operator=( const ScopedTimer & ) = delete;
+    
+  private:
+    const char * const m_name;
+    const int64_t m_start_us;
+  };//class ScopedTimer
+  
+  
+  /** Associates events recorded by this thread, while in scope, with a session; for worker threads
+   (e.g., ComputeScheduler jobs) that dont have a WApplication instance to get the session from.
+   */
+  class SessionScope
+  {
+  public:
+    explicit SessionScope( const std::string &session_id );
+    ~SessionScope();
+    
+    SessionScope( const SessionScope & ) = delete;
+    SessionScope &operator=( const SessionScope & ) = delete;
+    
+  private:
+    const std::string *m_previous;
+  };//class SessionScope
+}//namespace PerfTrace
+
+
+#if( PERFORMANCE_TRACING )
+#define INTERSPEC_TRACE_CONCAT_IMPL(a,b) a##b
+#define INTERSPEC_TRACE_CONCAT(a,b) INTERSPEC_TRACE_CONCAT_IMPL(a,b)
+
+/** Times the enclosing scope; `name` must be a string literal. */
+#define INTERSPEC_TRACE_SCOPE(name) \
+  PerfTrace::ScopedTimer INTERSPEC_TRACE_CONCAT(interspec_trace_timer_,__LINE__)( name )
+
+/** Associates events on this thread, for the enclosing scope, with the given session ID. */
+#define INTERSPEC_TRACE_SESSION(session_id) \
+  PerfTrace::SessionScope INTERSPEC_TRACE_CONCAT(interspec_trace_session_,__LINE__)( session_id )
+#else
+#define INTERSPEC_TRACE_SCOPE(name)
+#define INTERSPEC_TRACE_SESSION(session_id)
+#endif
+
+#endif //PerfTrace_h
@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <mutex>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <memory>
@@ -65,6 +66,12 @@ class ReactionGammaServer
 {
 public:
   static const ReactionGamma *database();
+  
+  /** Loads the database, if not already loaded, catching and logging any errors.
+   Intended to be posted to a background thread at server start, so the first session to use
+   reactions does not have to wait on parsing the XML.
+   */
+  static void initialize();
 
   /** Sets the XML file name to use; intended to be called near start of program
       execution.  Must be called before ReactionGammaServer::database() is ever
@@ -79,6 +86,11 @@ private:
   static std::string sm_xmlFileLocation; //defaults to data/sandia.reactiongamma.xml
   static std::mutex sm_dataBaseMutex;
   static std::unique_ptr<ReactionGamma> sm_dataBase;
+  
+  /** Set to sm_dataBase, once it is fully initialized, so #database() can return without locking
+   #sm_dataBaseMutex; the database is never modified after being created.
+   */
+  static std::atomic<const ReactionGamma *> sm_dataBasePtr;
 };
 
 
@@ -236,6 +248,15 @@ protected:
 protected:
   const SandiaDecay::SandiaDecayDataBase *m_decayDatabase;
   std::vector<const Reaction *> m_reactions[NumReactionType];
+  
+  /** Index of the reactions in #m_reactions by the atomic number of their target (element, or
+   nuclide); within each entry, reactions are in the same order as they appear in #m_reactions, by
+   ReactionType.  Annihilation is not included, as it has no target.
+   */
+  std::vector<std::vector<const Reaction *>> m_reactionsByAtomicNumber;
+  
+  /** Returns the reactions whose target has the given atomic number. */
+  const std::vector<const Reaction *> &reactions_for_atomic_number( const int atomic_number ) const;
 };//class ReactionGamma
 
 #endif   //ReactionGamma
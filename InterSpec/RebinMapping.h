@@ -0,0 +1,115 @@
+#ifndef RebinMapping_h
+#define RebinMapping_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace SpecUtils
+{
+  class EnergyCalibration;
+}
+
+
+/** A precomputed, sparse, channel-overlap matrix for rebinning spectra from one channel binning to
+ another.
+ 
+ Rebinning is linear in the channel counts, so rather than re-walking both sets of channel edges
+ each time (as `SpecUtils::rebin_by_lower_edge(...)` does), the fraction of each input channel
+ that falls within each output channel is computed once, and every subsequent rebin is just a
+ sparse matrix-vector product.  Since the non-zero input channels for an output channel are always
+ contiguous, each output channel only stores the index of its first input channel, and the weights
+ (usually one or two of them, when the binnings are of similar widths).
+ 
+ Counts are assumed to be uniformly distributed within each input channel, and counts outside of
+ the output energy range are dropped; this matches `SpecUtils::rebin_by_lower_edge(...)`.
+ */
+class RebinMapping
+{
+public:
+  /** Creates the mapping between the two binnings.
+   
+   @param orig_edges The lower energies of the input channels, plus the upper energy of the last
+          channel (i.e., what `SpecUtils::EnergyCalibration::channel_energies()` returns).
+   @param new_edges The lower energies of the output channels, plus upper energy of last channel.
+   
+   Throws std::exception if either binning has fewer than two channels, or isnt non-decreasing.
+   */
+  RebinMapping( const std::vector<float> &orig_edges, const std::vector<float> &new_edges );
+  
+  /** Rebins the counts.
+   
+   @param orig_counts The input channel counts; must have #numInputChannels entries.
+   @param new_counts Will be resized to #numOutputChannels and filled with the rebinned counts.
+   
+   Throws std::exception if orig_counts is the wrong size.
+   */
+  void rebin( const std::vector<float> &orig_counts, std::vector<float> &new_counts ) const;
+  
+  size_t numInputChannels() const;
+  size_t numOutputChannels() const;
+  
+  /** Returns the mapping between the two energy calibrations, from a small process-wide cache.
+   
+   The cache is keyed on the (immutable) EnergyCalibration objects themselves, so repeatedly
+   rebinning spectra that share calibrations (e.g., a background to each foreground sample,
+   or summing many records of a file with a couple different calibrations) only computes the
+   mapping once.
+   
+   Throws std::exception if either calibration is invalid or has no channel energies.
+   */
+  static std::shared_ptr<const RebinMapping> mapping(
+                           const std::shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                           const std::shared_ptr<const SpecUtils::EnergyCalibration> &new_cal );
+  
+  /** Convenience function equivalent to
+   `SpecUtils::rebin_by_lower_edge( *orig_cal->channel_energies(), orig_counts,
+                                    *new_cal->channel_energies(), new_counts )`
+   but using the cached mapping between the calibrations.
+   */
+  static void rebin( const std::shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                     const std::vector<float> &orig_counts,
+                     const std::shared_ptr<const SpecUtils::EnergyCalibration> &new_cal,
+                     std::vector<float> &new_counts );
+  
+protected:
+  size_t m_num_input_channels;
+  
+  /** For each output channel, the index of the first input channel that overlaps it. */
+  std::vector<uint32_t> m_first_input;
+  
+  /** For each output channel, the index into #m_weights of its first weight; has one more entry
+   than the number of output channels, so the number of weights for channel `i` is
+   `m_weight_start[i+1] - m_weight_start[i]`.
+   */
+  std::vector<uint32_t> m_weight_start;
+  
+  /** The fraction of each overlapping input channel that is within the output channel. */
+  std::vector<float> m_weights;
+};//class RebinMapping
+
+#endif //RebinMapping_h
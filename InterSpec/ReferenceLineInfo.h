@@ -229,6 +229,19 @@ struct ReferenceLineInfo
    */
   static std::shared_ptr<ReferenceLineInfo> generateRefLineInfo( RefLineInput input );
   
+  /** The same as #generateRefLineInfo, but always computes the lines.
+   
+   #generateRefLineInfo keeps a process-wide (i.e., shared between all sessions) LRU cache of
+   the lines for the most recently requested inputs, and returns a copy of the cached lines if
+   the input matches.
+   */
+  static std::shared_ptr<ReferenceLineInfo> generateRefLineInfoNoCache( RefLineInput input );
+  
+  /** Removes all entries from the process-wide cache used by #generateRefLineInfo; e.x., when the
+   OS signals memory pressure.
+   */
+  static void clearCache();
+  
   /** The additional nuclide mixtures and one-off sources defined in `data/add_ref_line.xml` */
   static std::vector<std::string> additional_ref_line_sources();
   
@@ -402,6 +402,11 @@ protected:
 
   const size_t m_max_prev_nucs = 8; //arbitrary
   
+  /** Incremented each time a background wait for the "more nuclide info" database is started, so
+   only the most recent one updates the associated nuclides display.
+   */
+  size_t m_associatedNucsGeneration = 0;
+  
   std::deque<RefLineInput> m_prevNucs;
   
   /** Name of "external" RID algorithm used, as set by #setExternalRidResults. */
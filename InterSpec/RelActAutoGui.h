@@ -25,6 +25,7 @@
 
 #include "InterSpec_config.h"
 
+#include <list>
 #include <atomic>
 #include <memory>
 #include <utility>
@@ -61,6 +62,7 @@ namespace Wt
   class WMenu;
   class WText;
   class WCheckBox;
+  class WTimer;
   class WComboBox;
 }//namespace Wt
 
@@ -326,6 +328,21 @@ protected:
   std::shared_ptr<std::atomic_bool> m_cancel_calc;
   std::shared_ptr<RelActCalcAuto::RelActAutoSolution> m_solution;
   
+  /** When options are changed while a calculation is running (or one was just requested), the
+   running calculation is canceled, and this single-shot timer is (re)started, so a quick
+   succession of changes only results in a single new calculation, once the user pauses.
+   */
+  Wt::WTimer *m_calc_debounce_timer;
+  
+  /** Hash of the inputs to the calculation currently running; used to key #m_solution_cache. */
+  size_t m_calc_inputs_hash;
+  
+  /** Recent successful solutions, most recent first, keyed by a hash of the calculation inputs
+   (options, energy ranges, nuclides, free peaks, and spectra); used so flipping back to a recent
+   configuration shows its results immediately, instead of re-solving.
+   */
+  std::list<std::pair<size_t,std::shared_ptr<RelActCalcAuto::RelActAutoSolution>>> m_solution_cache;
+  
   /** A good amount of calculation time is spent determining all the "auto-searched" peaks
    and consequently the FWHM DRF, so we will cache these so we only compute them
    */
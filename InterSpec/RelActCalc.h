@@ -92,6 +92,12 @@ double eval_eqn( const double energy, const RelEffEqnForm eqn_form, const std::v
 double eval_eqn_uncertainty( const double energy, const RelEffEqnForm eqn_form,
                              const std::vector<std::vector<double>> &covariance );
 
+/** Same as above, but for many energies at once, such as when drawing an uncertainty band; the
+ result has the same number of entries as `energies`.
+ */
+std::vector<double> eval_eqn_uncertainty( const std::vector<double> &energies, const RelEffEqnForm eqn_form,
+                                          const std::vector<std::vector<double>> &covariance );
+
 
 
 /** A struct to specify the relative masses of the Pu and Am241 nuclides that
@@ -30,6 +30,7 @@
 #include <memory>
 #include <vector>
 #include <ostream>
+#include <functional>
 
 #include "InterSpec/PeakDef.h" //for PeakContinuum::OffsetType and PeakDef::SkewType
 
@@ -356,6 +357,11 @@ struct RelActAutoSolution
    */
   double mass_enrichment_fraction( const SandiaDecay::Nuclide *nuclide ) const;
   
+  /** Returns the same values as #mass_enrichment_fraction, for every entry of #m_rel_activities
+   (in the same order), but summing up the element masses only once.
+   */
+  std::vector<double> mass_enrichment_fractions() const;
+  
   /** Returns the mass ratio of two nuclides.
    
    Throws exception if either input \c nuclide is nullptr, or was not in the problem.
@@ -381,6 +387,11 @@ struct RelActAutoSolution
     NotInitiated,
     FailedToSetupProblem,
     FailToSolveProblem,
+    
+    /** The calculation was cancelled; if cancelled while the non-linear solver was iterating,
+     the solution will be filled out using the best parameters found before cancelling (but
+     without uncertainties).
+     */
     UserCanceled
   };//
   
@@ -482,10 +493,40 @@ struct RelActAutoSolution
   int m_num_microseconds_eval;
 };//struct RelEffSolution
 
+/** Information passed to the progress callback of #solve, after each iteration of the
+ non-linear solver.
+ */
+struct SolveProgress
+{
+  /** The iteration number of the solver; note that #solve may call the solver multiple times
+   (as it refines the energy ranges), in which case this starts back at zero for each call.
+   */
+  size_t iteration;
+  
+  /** The chi2 of the current parameters. */
+  double chi2;
+  
+  /** The current parameter values; see #RelActAutoSolution::m_final_parameters. */
+  std::vector<double> parameters;
+};//struct SolveProgress
+
+
 /**
  
  @param rel_eff_order The number of energy dependent terms to have in the relative efficiency
         equation (e.g., one more parameter than this will be fit for).
+ @param warm_start A previous (successful) solution to take starting parameter values from; the
+        energy calibration, FWHM, relative efficiency, nuclide activity/age, floating peak, and
+        skew values of this solution are used wherever they are compatible with the current
+        options (e.g., same equation forms), and nuclides/peaks are matched up by nuclide and
+        energy.  When the relative efficiency and all nuclide activities can be taken from this
+        solution, the initial "manual" estimate of them is skipped.  Values are clamped to the
+        current parameter limits.  Pass nullptr (the default) to start from scratch.
+ @param cancel_calc If set to true while the solve is ongoing, the solve will stop at the next
+        opportunity, and a solution with status #RelActAutoSolution::Status::UserCanceled, that is
+        filled out from the best parameters found so far, will be returned.
+ @param progress_fcn If non-null, called from the calculation thread after each iteration of the
+        non-linear solver.  Should be quick to return, as it holds up the solve.
  */
 RelActAutoSolution solve( const Options options,
                          const std::vector<RoiRange> energy_ranges,
@@ -495,10 +536,55 @@ RelActAutoSolution solve( const Options options,
                          std::shared_ptr<const SpecUtils::Measurement> background,
                          std::shared_ptr<const DetectorPeakResponse> drf,
                          std::vector<std::shared_ptr<const PeakDef>> all_peaks,
-                         std::shared_ptr<std::atomic_bool> cancel_calc = nullptr
+                         std::shared_ptr<std::atomic_bool> cancel_calc = nullptr,
+                         std::shared_ptr<const RelActAutoSolution> warm_start = nullptr,
+                         std::function<void(const SolveProgress &)> progress_fcn = nullptr
                          );
 
 
+/** A spectrum, and the information that goes along with it, for fitting multiple spectra at once.
+ */
+struct SpectrumInput
+{
+  std::shared_ptr<const SpecUtils::Measurement> foreground;
+  
+  /** The background to subtract; may be nullptr. */
+  std::shared_ptr<const SpecUtils::Measurement> background;
+  
+  /** May be nullptr, see #solve. */
+  std::shared_ptr<const DetectorPeakResponse> drf;
+  
+  /** Peaks fit in the foreground; if empty, an automated peak search will be done. */
+  std::vector<std::shared_ptr<const PeakDef>> all_peaks;
+};//struct SpectrumInput
+
+
+/** Fits multiple spectra of the same item (e.g., from multiple detectors, or multiple dwell
+ periods) at once.
+ 
+ The relative efficiency curve, and the nuclide relative activities and ages are shared between
+ all the spectra, while each spectrum has its own energy calibration adjustment, FWHM, peak skew,
+ and floating peak amplitudes.
+ 
+ Each spectrum is first solved individually (in parallel) using the single-spectrum #solve, which
+ determines the final energy ranges for that spectrum and provides the starting parameter values;
+ then all spectra are fit simultaneously, with the residuals of the spectra computed in parallel.
+ 
+ Returns one solution per input spectrum, in the same order as `spectra`.  The shared quantities
+ are the same in each solution, while `m_chi2` and the fit peaks are for just that spectrum.  If
+ any of the individual solves are not successful, the individual solutions are returned instead.
+ 
+ Throws exception if `spectra` is empty, or on invalid input (same as the single-spectrum solve).
+ */
+std::vector<RelActAutoSolution> solve( const Options options,
+                                       const std::vector<RoiRange> energy_ranges,
+                                       const std::vector<NucInputInfo> nuclides,
+                                       const std::vector<FloatingPeak> extra_peaks,
+                                       const std::vector<SpectrumInput> spectra,
+                                       std::shared_ptr<std::atomic_bool> cancel_calc = nullptr
+                                       );
+
+
 }//namespace RelActCalcAuto
 
 #endif //RelActCalcAuto_h
@@ -25,6 +25,7 @@
 
 #include "InterSpec_config.h"
 
+#include <utility>
 #include <vector>
 
 #include <boost/multi_array.hpp>
@@ -129,6 +130,7 @@ public:
   
   
   //Returns the min and max counts within a given time and energy range.
+  //  Answered from m_countRangeTable with four lookups, regardless of the size of the range.
   //  20180131 - NOT TESTED WELL, and there apears to be a Wt bug for toggling between log and linear views
   std::pair<float,float> minMaxCounts( const float time_min, const float time_max,
                                        const float e_min, const float e_max ) const;
@@ -171,6 +173,10 @@ public:
   
   
 protected:
+  //buildCountRangeTable(): fills out m_countRangeTable from m_counts, if it
+  //  hasnt already been built since the last call to update(...).
+  void buildCountRangeTable() const;
+  
   //m_minCounts: holds the current minimum number of counts of any data bin
   float m_minCounts;
   
@@ -209,6 +215,14 @@ protected:
   //  and energy channel.  Indexed as m_counts[row/2][column/2],
   //  or equivalently m_counts[sample_number][energy_channel]
   boost::multi_array<float, 2> m_counts;
+  
+  //m_countRangeTable: a two-dimensional sparse table (a min/max pyramid) of
+  //  m_counts, so the min and max counts of any rectangular range of bins can be
+  //  found by combining four overlapping power-of-two sized blocks.
+  //  Indexed as m_countRangeTable[ky][kx][row*ncolumns + channel], which holds
+  //  the {min,max} of the 2^ky time samples by 2^kx channels starting at
+  //  m_counts[row][channel].  Built when first needed, and cleared by update(...).
+  mutable std::vector<std::vector<std::vector<std::pair<float,float>>>> m_countRangeTable;
 };//class SearchMode3DDataModel
 
 
@@ -0,0 +1,143 @@
+#ifndef ServerMetrics_h
+#define ServerMetrics_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+/** A small registry of process-wide operational metrics (counters, gauges, and latency histograms),
+ that can be exposed in the Prometheus/OpenMetrics text format; when built as a web-server, they are
+ served at "/metrics" (from localhost only) by InterSpecServer.
+ 
+ Updating a metric is lock-free (a relaxed atomic add or two); only looking a metric up by name
+ takes a lock, so call sites should keep a reference to the metric, e.g.:
+ \code{.cpp}
+ static ServerMetrics::Counter &hits = ServerMetrics::counter( "interspec_cache_hits_total",
+                                                  "Number of cache hits.", "cache=\"ref_lines\"" );
+ hits.increment();
+ \endcode
+ Metrics are never removed, so these references remain valid for the life of the program.
+ */
+namespace ServerMetrics
+{
+  class Counter
+  {
+  public:
+    Counter();
+    void increment( const uint64_t n = 1 );
+    uint64_t value() const;
+    
+  private:
+    std::atomic<uint64_t> m_value;
+  };//class Counter
+  
+  
+  class Gauge
+  {
+  public:
+    Gauge();
+    void set( const int64_t value );
+    void add( const int64_t delta );
+    int64_t value() const;
+    
+  private:
+    std::atomic<int64_t> m_value;
+  };//class Gauge
+  
+  
+  /** A histogram of durations, in seconds, with fixed buckets from 1 ms to about 1 minute. */
+  class Histogram
+  {
+  public:
+    static const size_t sm_num_buckets = 12;
+    
+    /** The upper bound (inclusive), in seconds, of each bucket; there is an implicit "+Inf" bucket. */
+    static const std::array<double,sm_num_buckets> sm_bucket_bounds;
+    
+    Histogram();
+    
+    void observe( const double seconds );
+    
+    /** Number of observations less than or equal to each bucket bound; not cumulative. */
+    uint64_t bucketCount( const size_t bucket ) const;
+    
+    /** Number of observations larger than the last bucket bound. */
+    uint64_t overflowCount() const;
+    
+    uint64_t count() const;
+    double sum() const;
+    
+  private:
+    std::array<std::atomic<uint64_t>,sm_num_buckets> m_buckets;
+    std::atomic<uint64_t> m_overflow;
+    std::atomic<uint64_t> m_count;
+    
+    /** Sum of observations, in microseconds, so we can use an integer atomic. */
+    std::atomic<uint64_t> m_sum_us;
+  };//class Histogram
+  
+  
+  /** Records the time from construction to destruction into a histogram. */
+  class ScopedLatency
+  {
+  public:
+    explicit ScopedLatency( Histogram &histogram );
+    ~ScopedLatency();
+    
+    ScopedLatency( const ScopedLatency & ) = delete;
+    ScopedLatency &operator=( const ScopedLatency & ) = delete;
+    
+  private:
+    Histogram &m_histogram;
+    const std::chrono::steady_clock::time_point m_start;
+  };//class ScopedLatency
+  
+  
+  /** Returns the counter with the given name and labels, creating it if necessary.
+   
+   @param name The metric name, e.g., "interspec_jobs_total".
+   @param help Description of the metric; only the first one registered for a name is used.
+   @param labels The label set, in Prometheus syntax, without the braces, e.g., `type="peak_search"`;
+          may be empty.
+   
+   Throws std::exception if the name is already registered as a different type of metric.
+   */
+  Counter &counter( const std::string &name, const std::string &help, const std::string &labels = "" );
+  
+  /** Returns the gauge with the given name and labels; see #counter. */
+  Gauge &gauge( const std::string &name, const std::string &help, const std::string &labels = "" );
+  
+  /** Returns the histogram with the given name and labels; see #counter. */
+  Histogram &histogram( const std::string &name, const std::string &help, const std::string &labels = "" );
+  
+  /** Returns all metrics in the Prometheus text exposition format (version 0.0.4). */
+  std::string prometheus_text();
+}//namespace ServerMetrics
+
+#endif //ServerMetrics_h
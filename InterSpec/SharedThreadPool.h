@@ -0,0 +1,107 @@
+#ifndef SharedThreadPool_h
+#define SharedThreadPool_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <functional>
+
+/** A single, process-wide, pool of worker threads for the numeric code (peak fitting, shielding
+ fits, detection limits, etc.) to spread its work over.
+ 
+ Previously each call site created its own `SpecUtilsAsync::ThreadPool`, so nested parallel
+ sections, or many sessions computing at once, could end up with many more threads than cores.
+ Here the workers are created once, the first time the pool is used, and there is one per
+ logical core.
+ 
+ Work is posted through a #TaskGroup.  #TaskGroup::join runs the groups own not-yet-started tasks
+ on the calling thread, rather than just blocking, so a task may itself create a TaskGroup and
+ join it (i.e., nested parallelism) without deadlocking, even when every worker is busy.
+ 
+ This is for the parallel loops within a calculation; see ComputeScheduler for queuing the
+ calculations themselves.
+ */
+namespace SharedThreadPool
+{
+  struct TaskGroupState;
+  
+  /** A set of tasks that can be waited on together; same usage as `SpecUtilsAsync::ThreadPool`:
+   #post each task, then #join.
+   
+   Not itself thread safe; i.e., post from, and join on, a single thread (tasks may use their own
+   TaskGroups).
+   */
+  class TaskGroup
+  {
+  public:
+    TaskGroup();
+    
+    /** Waits for any outstanding tasks; exceptions from tasks are discarded. */
+    ~TaskGroup();
+    
+    /** Queues a task to be ran by the pool (or by #join). */
+    void post( std::function<void()> task );
+    
+    /** Returns once all posted tasks have completed, executing queued tasks of this group on the
+     calling thread while it waits.
+     
+     If any task threw an exception, the first one is re-thrown (after all tasks have completed).
+     */
+    void join();
+    
+  private:
+    TaskGroup( const TaskGroup & ) = delete;
+    TaskGroup &operator=( const TaskGroup & ) = delete;
+    
+    std::shared_ptr<TaskGroupState> m_state;
+  };//class TaskGroup
+  
+  
+  /** Number of worker threads in the pool; starts the pool, if not already started. */
+  size_t num_workers();
+  
+  /** The number of CPUs this process can actually use: the smaller of the number of logical cores,
+   the number of CPUs in this threads affinity mask, and the cgroup CPU quota (rounded up) if
+   there is one (e.g., when running in a container with a CPU limit).  Always at least one.
+   
+   The affinity mask and cgroup limits are only checked on Linux.
+   */
+  size_t available_cpu_count();
+  
+  /** Sets the number of workers, and if each worker should be pinned to a single CPU (of the ones
+   in the affinity mask, assigned in order), to use when the pool is started.
+   
+   Defaults are from the `SHARED_THREAD_POOL_WORKERS` and `SHARED_THREAD_POOL_PIN_WORKERS` CMake
+   options.  Pinning keeps the workers, and so the memory they touch, on the same cores (and
+   socket), rather than having the OS migrate them; it only has an effect on Linux.
+   
+   @param num_workers The number of worker threads; zero means use #available_cpu_count.
+   @param pin_workers Whether to pin each worker to a CPU.
+   @returns false (without changing anything) if the pool has already been started.
+   */
+  bool configure( const size_t num_workers, const bool pin_workers );
+}//namespace SharedThreadPool
+
+#endif //SharedThreadPool_h
@@ -617,7 +617,12 @@ protected:
   /** Undoes the changes from #setWidgetStateForFitStarting */
   void setWidgetStateForFitBeingDone();
   
-  void updateChi2ChartActual();
+  /** Updates the chi2/scale chart and calculation log.
+   
+   If `results` is a final fit that contains the per-peak chi2 contributions, those are used,
+   rather than re-evaluating the model from the current GUI state.
+   */
+  void updateChi2ChartActual( std::shared_ptr<const ShieldingSourceFitCalc::ModelFitResults> results = nullptr );
   virtual void layoutSizeChanged( int width, int height ) override;
   
 protected:
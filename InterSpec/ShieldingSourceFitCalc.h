@@ -26,11 +26,15 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <tuple>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <boost/function.hpp>
 
+#include <Wt/WColor>
+
 #if( INCLUDE_ANALYSIS_TEST_SUITE || PERFORM_DEVELOPER_CHECKS || BUILD_AS_UNIT_TEST_SUITE )
 #include <boost/optional.hpp>
 #endif
@@ -229,7 +233,7 @@ namespace ShieldingSourceFitCalc
     ShieldingInfo();
     
     rapidxml::xml_node<char> *serialize( rapidxml::xml_node<char> *parent_node ) const;
-    void deSerialize( const rapidxml::xml_node<char> *shield_node, MaterialDB *materialDb );
+    void deSerialize( const rapidxml::xml_node<char> *shield_node, const MaterialDB *materialDb );
     
     /** Encodes current tool state to app-url format.  Returned string is just the query portion of URL;
      so will look something like "V=1&G=S&D1=1.2cm", and it will not be url-encoded.
@@ -279,6 +283,15 @@ namespace ShieldingSourceFitCalc
      */
     bool multithread_self_atten = true;
     
+    /** If true, self-attenuating sources are integrated on a fixed Gauss-Legendre grid, where the path-length
+     geometry is computed once per set of shielding dimensions, and re-used for all energies, and for subsequent
+     evaluations where only densities or atomic numbers have changed.  If false, an adaptive Cuhre integration is
+     performed for each energy of each source.
+     
+     \sa GammaInteractionCalc::DistributedSrcPathLengths
+     */
+    bool fast_self_atten_integration = false;
+    
     /** if >=0.0 then not just the photpeak the fit peak is assigned to will be used, but also other photopeaks within
      `photopeak_cluster_sigma` of the fit peaks sigma will be used to calc expected as well.
      The only place this variable is currently referenced is in `ShieldingSourceChi2Fcn::energy_chi_contributions`.
@@ -352,6 +365,20 @@ namespace ShieldingSourceFitCalc
     std::vector<ShieldingSourceFitCalc::IsoFitStruct> fit_src_info;
     
     ShieldingSourceFitOptions options;
+    
+    /** The {energy,chi,scale,PeakColor,scale_uncert} of each peak, at the final parameter values, as
+     given by `ShieldingSourceChi2Fcn::energy_chi_contributions(...)`; lets the GUI display the fit
+     results without re-evaluating the model.
+     
+     Only filled out for `FitStatus::Final`, and will be empty if the evaluation failed.
+     */
+    std::vector<std::tuple<double,double,double,Wt::WColor,double>> energy_chi_contributions;
+    
+    /** The calculation log from evaluating #energy_chi_contributions. */
+    std::vector<std::string> energy_chi_calc_log;
+    
+    /** The number of free (non-fixed) parameters in the fit. */
+    unsigned int num_fit_params = 0;
   };//struct ModelFitResults
     
   
@@ -388,6 +415,121 @@ namespace ShieldingSourceFitCalc
                   std::shared_ptr<ModelFitResults> results,
                   boost::function<void()> finished_fcn );
   
+  
+  /** A single minimization result from #fit_model_multi_start or #chi2_profile_scan. */
+  struct ModelFitSolution
+  {
+    double chi2;
+    
+    /** If Minuit reported the found minimum as valid. */
+    bool is_valid;
+    
+    int num_fcn_calls;
+    
+    /** The parameter values the minimization started from. */
+    std::vector<double> startValues;
+    
+    std::vector<double> paramValues;
+    std::vector<double> paramErrors;
+  };//struct ModelFitSolution
+  
+  
+  /** Performs `num_starts` Minuit fits of the model, in parallel, from different starting points, to
+   reduce the chance of ending up in a local minimum; the best of these is then fit with #fit_model,
+   to fill out `results` (including the generic shielding atomic number scan, if applicable).
+   
+   The first start is from the values of `inputPrams`; the rest are a Latin-hypercube sampling of the
+   free parameters between their limits.  Parameters without both limits are sampled within three
+   "errors" (i.e., initial step sizes) of their input value, clamped to any limit they have.
+   
+   \param chi2Fcn The initialized ShieldingSourceChi2Fcn object; shared by all the fits.
+   \param inputPrams The fit input parameters; not modified.
+   \param num_starts The number of starting points, including the input values.
+   \param seed Seed for the Latin-hypercube sampling, so results are reproducible.
+   \param results Where to put the results of the final fit, as from #fit_model.
+   
+   \return The solution from each starting point, sorted by increasing chi2.
+   */
+  std::vector<ModelFitSolution> fit_model_multi_start(
+                                std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                                std::shared_ptr<const ROOT::Minuit2::MnUserParameters> inputPrams,
+                                const size_t num_starts,
+                                const unsigned int seed,
+                                std::shared_ptr<ModelFitResults> results );
+  
+  
+  /** Computes the chi2 profile of a single parameter: for each of `values`, the parameter named
+   `par_name` is fixed to that value, and the chi2 is minimized with respect to all other free
+   parameters.  The points are computed in parallel.
+   
+   Useful for seeing how well constrained a quantity, like a shielding thickness or areal density, is,
+   or if there are other local minima.
+   
+   \return The solution for each of `values`, in the same order.
+   
+   Throws exception if `par_name` is not a parameter of `inputPrams`.
+   */
+  std::vector<ModelFitSolution> chi2_profile_scan(
+                                std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                                const ROOT::Minuit2::MnUserParameters &inputPrams,
+                                const std::string &par_name,
+                                const std::vector<double> &values );
+  
+  
+  /** The asymmetric (MINOS) uncertainty of a single fit parameter, from #minos_errors. */
+  struct ParameterMinosError
+  {
+    std::string name;
+    
+    /** Index of the parameter, within the input MnUserParameters. */
+    unsigned int index;
+    
+    /** The best-fit value of the parameter. */
+    double value;
+    
+    /** The (negative) offset from #value to the lower edge of the interval. */
+    double lower;
+    
+    /** The (positive) offset from #value to the upper edge of the interval. */
+    double upper;
+    
+    bool lower_valid;
+    bool upper_valid;
+    
+    int num_fcn_calls;
+  };//struct ParameterMinosError
+  
+  
+  /** Computes the MINOS errors of each free parameter of a model fit, with the parameters computed
+   in parallel.
+   
+   Each parameters MINOS error is its own series of constrained minimizations, independent of the
+   other parameters.  Minuit2 objects use non-thread-safe reference counting, so each thread
+   re-converges its own minimum from `bestFitPrams` (which is quick, as it starts at the minimum),
+   and then runs MnMinos for its parameter; the chi2 function is shared between threads, as for
+   #fit_model_multi_start.
+   
+   \param chi2Fcn The initialized ShieldingSourceChi2Fcn object; shared by all the scans.
+   \param bestFitPrams The fit parameters, with values set to the best fit values, and errors to
+          the parabolic errors (e.g., #ModelFitResults::paramValues and
+          #ModelFitResults::paramErrors); these errors are also used as the initial step sizes.
+   
+   \return The MINOS error for each free parameter, in the order of the parameters.  If there is an
+           exception for a parameter (e.g., the fit being canceled), its errors are marked invalid.
+   */
+  std::vector<ParameterMinosError> minos_errors(
+                              std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                              const ROOT::Minuit2::MnUserParameters &bestFitPrams );
+  
+  /** Sets whether #fit_model first minimizes the chi2 as a least-squares problem (per-peak chis as
+   residuals) using ceres' Levenberg-Marquardt, before running Minuit2 from that point for the final
+   fit and covariance.  Defaults to true; has no effect if built without ceres (i.e., `USE_REL_ACT_TOOL`).
+   */
+  void set_least_squares_presolve( const bool use );
+  
+  /** Returns if #fit_model will do the least-squares pre-solve. */
+  bool least_squares_presolve_enabled();
+  
   /** The maximum time (in milliseconds) a model fit can take before the fit is
       aborted.  This generally will only ever be applicable to fits with
       self-attenuators, where there is a ton of peaks, or things go really
@@ -407,9 +549,9 @@ namespace ShieldingSourceFitCalc
   /** How often (in milliseconds) to update the GUI during a model fit.
       This generally will only ever be applicable to fits with self-attenuators.
       
-      Initialized to 2000 (e.g., every two seconds)
+      Initialized to 250 (e.g., four times a second)
    */
-  const size_t sm_model_update_frequency_ms = 2000;
+  const size_t sm_model_update_frequency_ms = 250;
 }//namespace ShieldingSourceFitCalc
 
 #endif //ShieldingSourceFitCalc_h
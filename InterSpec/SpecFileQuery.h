@@ -168,6 +168,12 @@ namespace SpecFileQuery
     
     bool test( const SpecFileInfoToQuery &meas ) const;
     
+    /** Returns a SQL expression, in terms of the columns SpecFileInfoToQuery is persisted to the
+     database with, that evaluates to the same result as #test.  Returns "NULL" if the test cant be
+     expressed in SQL (e.g., regex tests, or fields stored as blobs), or might not give identical results.
+     */
+    std::string sql_condition() const;
+    
     std::string summary() const;
     
     //Throw exception with explanation if not valid
@@ -214,7 +220,8 @@ namespace SpecFileQuery
       (Note: If I dont get permission to add pugixml (which I want to start
       using instead of rapid XML anyway) then a very cripled subset of xpath
       will be used)
-     -The Event XML is reparsed and tested for each spectrum file in a directory
+     -The Event XML is parsed once per directory, and its values cached with each spectrum files
+      information (see SpecFileQueryDbCache), so repeated searches dont re-parse it.
      -All string comparisons are case insensitive.
    */
   class EventXmlTest
@@ -255,6 +262,11 @@ namespace SpecFileQuery
      */
     bool test( const SpecFileInfoToQuery &meas ) const;
     
+    /** Returns a SQL expression, over the SpecFileQueryDbCache event XML value table, that evaluates
+     to the same result as #test; or "NULL" for date and regex tests, which cant be done exactly in SQL.
+     */
+    std::string sql_condition() const;
+    
     /** Returns a summary string of the search. */
     std::string summary() const;
     
@@ -312,11 +324,25 @@ namespace SpecFileQuery
     
     std::string summary() const;
     
+    /** Returns a SQL expression over the SpecFileInfoToQuery database columns that evaluates to 0 (false)
+     only for entries that #test would definitely reject.  Conditions that cant be expressed in SQL are
+     treated as NULL, so with SQLs three-valued logic the expression will be NULL when the result
+     depends on them; these entries must still be tested with #test.
+     
+     Returns an empty string if none of the conditions can be expressed in SQL.
+     */
+    std::string sql_prefilter() const;
+    
   protected:
     static bool evaluate( std::vector<boost::any> fields, const SpecFileInfoToQuery &meas );
     
     static std::ostream &print_equation( std::vector<boost::any> fields, std::ostream &strm );
     
+    /** Converts `fields` to a SQL expression, for #sql_prefilter.  Returns false if the expression
+     is malformed.  `any_known` is set true if any condition could be expressed in SQL.
+     */
+    static bool to_sql( std::vector<boost::any> fields, std::string &sql, bool &any_known );
+    
     std::vector<boost::any> m_fields;  //Either LogicType or SpecTest
   };
 }//namespace SpecFileQuery_h
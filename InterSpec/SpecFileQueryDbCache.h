@@ -26,11 +26,15 @@
 #include "InterSpec_config.h"
 
 #include <set>
+#include <map>
 #include <mutex>
 #include <ctime>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
+#include <functional>
+#include <unordered_map>
 #include <condition_variable>
 
 #include <Wt/Dbo/Dbo>
@@ -39,6 +43,11 @@
 #include "SpecUtils/SpecFile.h"
 #include "SpecUtils/EnergyCalibration.h"
 
+namespace SpecFileQuery
+{
+  class SpecLogicTest;
+}
+
 //Forward declarations and Wt::Dbo::overhead ish. 
 namespace Wt {
   namespace Dbo {
@@ -65,6 +74,15 @@ namespace Wt {
       static bool read(std::set<float> &v, SqlStatement *statement, int column, int size);
     };
         
+    template<>
+    struct sql_value_traits<std::vector<float>, void>
+    {
+      static const bool specialized = true;
+      static std::string type(SqlConnection *conn, int size);
+      static void bind(const std::vector<float> &v, SqlStatement *statement, int column, int size);
+      static bool read(std::vector<float> &v, SqlStatement *statement, int column, int size);
+    };
+        
     template<>
     struct sql_value_traits<std::set<size_t>, void>
     {
@@ -231,6 +249,28 @@ struct SpecFileInfoToQuery
    */
   std::map<std::string,std::vector<std::string>> event_xml_filter_values;
   
+  /** Compact description of the shape of the foreground gamma spectrum (or, if no foreground,
+   the background), used to find similar spectra; see #compute_spectral_features.
+   Empty if the file has no gamma spectra.
+   */
+  std::vector<float> spectral_features;
+  
+  /** The number of bins of #spectral_features. */
+  static const size_t sm_num_spectral_features = 64;
+  
+  /** Returns the spectral features of the sum of the passed in measurements.
+   
+   Counts are summed into #sm_num_spectral_features logarithmically spaced energy bins between
+   30 keV and 3 MeV (so detectors of different resolution and calibration are comparable), then the
+   square root of each bins fraction of the total counts is taken; the result is a unit vector whose
+   dot product with another spectrums features is the Bhattacharyya coefficient of the two (1.0 for
+   identical shapes, regardless of the number of counts, and 0.0 for no overlap).
+   
+   Returns an empty vector if there are no gamma counts in the energy range.
+   */
+  static std::vector<float> compute_spectral_features(
+                      const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &meas );
+  
   //bool peaks_fit;
   //std::vector<std::tuple<float,float,float>> peak_info; //mean, fwhm, rate
   
@@ -278,6 +318,7 @@ struct SpecFileInfoToQuery
     Wt::Dbo::field( a, start_time_ioi, "start_time_ioi" );
     Wt::Dbo::field( a, start_times, "start_times" );
     Wt::Dbo::field( a, event_xml_filter_values, "event_xml_filter_values" );
+    Wt::Dbo::field( a, spectral_features, "spectral_features" );
     
     //bool peaks_fit;
     //std::vector<std::tuple<float,float,float>> peak_info; //mean, fwhm, rate
@@ -339,6 +380,14 @@ public:
    */
   const std::vector<EventXmlFilterInfo> &xml_filters() const;
   
+  /** Sets `info.event_xml_filter_values` from the Event XML file next to `filepath`.
+   
+   Since the same Event XML file applies to every spectrum file in a directory, the values extracted
+   for each directory are kept for the lifetime of this object, so the XML is only parsed once per
+   directory, rather than once per spectrum file.
+   */
+  void fill_event_xml_values( SpecFileInfoToQuery &info, const std::string &filepath );
+  
   /** Returns the #SpecFileInfoToQuery information for a given
       file on the filesystem.  If database caching is enabled, will first check
       the database for the information, and if found, return that (assuming
@@ -348,6 +397,79 @@ public:
       will also be stored to the databsae.
    */
   std::unique_ptr<SpecFileInfoToQuery> spec_file_info( const std::string &filepath );
+  
+  /** The database entry values needed to skip a file that #sql_rejected_files says fails a query. */
+  struct SqlRejectedFile
+  {
+    /** The file size when the entry was cached; the entry is only valid if the file still has this size. */
+    long long file_size;
+    bool is_spectrum_file;
+    std::string uuid;
+  };//struct SqlRejectedFile
+  
+  /** Evaluates SpecFileQuery::SpecLogicTest::sql_prefilter in the database, and returns the entries it
+   definitely rejects, keyed by #file_path_hash.  This lets a search skip loading and testing most
+   cached files, and only check the remaining predicates in C++.
+   
+   Returns an empty map if database caching isnt being used, or none of the query can be done in SQL.
+   */
+  std::unordered_map<long long,SqlRejectedFile> sql_rejected_files( const SpecFileQuery::SpecLogicTest &query );
+  
+  /** The hash of a file path, used as the database key. */
+  static long long file_path_hash( const std::string &filepath );
+  
+  /** Returns the regular files under the base path (recursively if `recursive`) that are no larger than
+   `max_file_size`, and for which `name_filter` (if non-null) returns true.
+   
+   An index of the contents and modification time of each directory is kept, so directories that havent changed
+   since the previous call are not listed again; only their modification time is checked.  Since a directories
+   modification time changes whenever files are added, removed, or renamed in it, this avoids listing and stat-ing
+   every file of very large, or network, file systems.  If the cache is persisted, the index is saved next to the
+   database, so it is also used by later sessions.
+   
+   File sizes are from when the directory was last listed; files modified in-place are still re-checked by
+   #spec_file_info.
+   
+   @param progress If non-null, called periodically with the number of files found so far.
+   @param stop If non-null and becomes true, listing stops and the files found so far are returned.
+   
+   Is thread-safe, but concurrent calls will be serialized.
+   */
+  std::vector<std::string> indexed_files( const bool recursive,
+                                          const size_t max_file_size,
+                                          bool (*name_filter)( const std::string &path ),
+                                          const std::function<void(size_t)> &progress,
+                                          const std::atomic<bool> *stop );
+  
+  /** Returns true if #indexed_files has completed for the base path (in this session, or a persisted one), in which
+   case a search can call #indexed_files to rescan only changed directories, instead of walking the whole tree.
+   */
+  bool has_directory_index( const bool recursive );
+  
+  /** A result of #similar_files. */
+  struct SimilarFile
+  {
+    std::string file_path;
+    
+    /** The dot product of the files #SpecFileInfoToQuery::spectral_features with the query features;
+     between 0.0 and 1.0, with larger being more similar.
+     */
+    float similarity;
+  };//struct SimilarFile
+  
+  /** Returns (up to) the `max_results` cached files whose spectra are most similar to `features` (as
+   from #SpecFileInfoToQuery::compute_spectral_features), most similar first.
+   
+   Uses an approximate nearest-neighbour (inverted file) index of all files in the database that is
+   built on first use, and rebuilt once files have been added to the database since; so only files
+   that have already been cached (e.x., by #cache_results) are considered, and very rarely a similar
+   file may be missed.  For multi-million file archives building the index takes a number of seconds,
+   after which each query takes milliseconds.
+   
+   Returns an empty result if database caching isnt being used.
+   Is thread-safe.
+   */
+  std::vector<SimilarFile> similar_files( const std::vector<float> &features, const size_t max_results );
 
 protected:
   bool open_db( const std::string &path, const bool create_tables );
@@ -361,6 +483,52 @@ protected:
   /** Constructs a unique file */
   static std::string construct_persisted_db_filename( std::string basepath );
   
+  /** The contents of a single directory, as of its last listing. */
+  struct DirectoryIndexEntry
+  {
+    /** Modification time of the directory when it was listed; -1 if the listing shouldnt be trusted. */
+    int64_t m_mtime;
+    
+    /** The regular files (filename only) and their sizes. */
+    std::vector<std::pair<std::string,uint64_t>> m_files;
+    
+    /** The sub-directories to recurse into (filename only). */
+    std::vector<std::string> m_subdirs;
+  };//struct DirectoryIndexEntry
+  
+  /** Loads #m_dir_index from the persisted file, if the cache is persisted, and it hasnt been loaded yet.
+   You should have a lock on m_dir_index_mutex while calling this function.
+   */
+  void load_directory_index();
+  
+  /** Saves #m_dir_index next to the persisted database; does nothing if the cache isnt persisted.
+   You should have a lock on m_dir_index_mutex while calling this function.
+   */
+  void save_directory_index();
+  
+  /** Inverted file index of the spectral features of the database entries; see #similar_files. */
+  struct SpectralSimilarityIndex
+  {
+    /** The unit-normalized cluster centroids, each #SpecFileInfoToQuery::sm_num_spectral_features long. */
+    std::vector<float> m_centroids;
+    
+    /** For each centroid, the indexes (into #m_paths) of the entries assigned to it. */
+    std::vector<std::vector<uint32_t>> m_lists;
+    
+    /** The file path of each entry. */
+    std::vector<std::string> m_paths;
+    
+    /** The features of each entry, quantized to 8 bits (the features are all between 0 and 1), to keep
+     memory use to ~64 bytes per entry, plus the path.
+     */
+    std::vector<uint8_t> m_codes;
+  };//struct SpectralSimilarityIndex
+  
+  /** Builds #m_similarity_index from the database.
+   You should have a lock on m_similarity_mutex (but not m_db_mutex) while calling this function.
+   */
+  void build_similarity_index();
+  
 protected:
   bool m_use_db_caching;
   bool m_using_persist_caching;
@@ -378,6 +546,26 @@ protected:
   std::unique_ptr<Wt::Dbo::Session> m_db_session;
   
   const std::vector<EventXmlFilterInfo> m_xmlfilters;
+  
+  /** Protects #m_dir_index, #m_dir_index_loaded, and #m_dir_index_complete */
+  std::mutex m_dir_index_mutex;
+  bool m_dir_index_loaded;
+  /** If a full #indexed_files listing has been done; index 0 for non-recursive, index 1 for recursive. */
+  bool m_dir_index_complete[2];
+  /** Directory path to its contents */
+  std::map<std::string,DirectoryIndexEntry> m_dir_index;
+  
+  /** Protects #m_event_xml_dir_values */
+  std::mutex m_event_xml_mutex;
+  /** Directory path to the values extracted from its Event XML file; see #fill_event_xml_values. */
+  std::map<std::string,std::map<std::string,std::vector<std::string>>> m_event_xml_dir_values;
+  
+  /** Protects #m_similarity_index; always obtained before m_db_mutex, if both are needed. */
+  std::mutex m_similarity_mutex;
+  std::unique_ptr<SpectralSimilarityIndex> m_similarity_index;
+  
+  /** Set whenever an entry is added to the database, so #similar_files knows to rebuild its index. */
+  std::atomic<bool> m_similarity_index_stale;
 };//class SpecFileQueryDbCache
 
 
@@ -41,6 +41,7 @@
 class SpecMeas;
 class InterSpec;
 class AnaResultDisplay;
+class SpecFileRecordModel;
 namespace SpecUtils{ class Measurement; }
 namespace SpecUtils{ enum class SpectrumType : int; }
 
@@ -56,6 +57,7 @@ namespace Wt
   class WIntValidator;
   class WInteractWidget;
   class WSelectionBox;
+  class WTableView;
 }//namespace Wt
 
 
@@ -98,6 +100,15 @@ protected:
   void handleUserChangeSampleNum();
   void handleUserIncrementSampleNum( bool increment );
 
+  /** Called when the user clicks a row of the record table; displays that record. */
+  void handleRecordTableSelection();
+
+  /** Called when the user changes the text of the record-table filter. */
+  void handleRecordFilterChanged();
+
+  /** Selects, and scrolls to, the record-table row of the currently displayed record. */
+  void syncRecordTableSelection();
+
   void handleSpectrumTypeChanged();
   void handleAllowModifyStatusChange();
 
@@ -135,6 +146,14 @@ protected:
   Wt::WInteractWidget  *m_prevSampleNumButton;
   Wt::WIntValidator    *m_displaySampleNumValidator;
 
+  /** Table listing every record in the file; only the rows scrolled into view are sent to the
+   client, and sorting/filtering is done server-side on an index into SpecMeas::measurements().
+   */
+  Wt::WGroupBox        *m_recordsDiv;
+  Wt::WLineEdit        *m_recordFilter;
+  Wt::WTableView       *m_recordTable;
+  SpecFileRecordModel  *m_recordModel;
+
   //These following fields are specific to a single Measurment object
   Wt::WText *m_gammaCPS;
   Wt::WText *m_gammaSum;
@@ -25,9 +25,14 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <set>
+#include <list>
 #include <deque>
 #include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 #include <Wt/WSignal>
 
@@ -110,6 +115,14 @@ public:
    */
   virtual bool load_N42_from_data( char *data, char *data_end );
   
+  /** Loads the spectra, and InterSpec specific information (peaks, DRF, displayed samples, etc),
+   from an already parsed N42 document.
+   
+   The <RadMeasurement> (and 2006 N42 equivalent) elements are decoded by
+   SpecUtils::SpecFile::load_from_N42_document, which walks a complete DOM, so there is currently no
+   streaming (element at a time) way to load N42 files; #load_N42_file memory-maps large files and
+   parses them in-situ, so the DOM itself is mostly node structures pointing into the file data.
+   */
   virtual void load_N42_from_doc( rapidxml::xml_document<char> &doc );
   
   virtual bool save2012N42File( const std::string &filename );
@@ -133,12 +146,83 @@ public:
   /** Adds reading back in peak information (only from InterSpec exported SPE files though). */
   virtual bool load_from_iaea( std::istream &istr );
   
+  /** Creates the N42-2012 document, with the InterSpec specific information appended.
+   
+   The <RadMeasurement> elements (and their channel data) are created by
+   SpecUtils::SpecFile::create_2012_N42_xml, which formats the spectra of different records on its
+   thread pool; only the (comparatively small) InterSpec specific elements are made here.
+   */
   virtual std::shared_ptr< ::rapidxml::xml_document<char> > create_2012_N42_xml() const;
   
   /** Same as #SpecFile::set_energy_calibration, but marks this SpecMeas as modified. */
   virtual void set_energy_calibration( const std::shared_ptr<const SpecUtils::EnergyCalibration> &cal,
                                       const std::shared_ptr<const SpecUtils::Measurement> &measurement );
   
+  /** Sets the energy calibration of many measurements, marking this SpecMeas as modified if any calibration changed.
+   
+   Intended for applying a calibration change to files with many records that share a small number of
+   #SpecUtils::EnergyCalibration objects; each unique old/new calibration pair is only compared once, and the
+   calibration objects are shared as given (no copies are made).
+   */
+  void set_energy_calibrations( const std::vector<std::pair<std::shared_ptr<const SpecUtils::Measurement>,
+                                                  std::shared_ptr<const SpecUtils::EnergyCalibration>>> &meas_cals );
+  
+  /** Same as #SpecFile::sum_measurements, but uses a lazily built running-sum index over the sample
+   numbers, so summing a large range of samples (e.g., as the user drags a selection across the time
+   chart) costs roughly O(channels), instead of O(samples x channels).
+   
+   The index stores a running sum of channel counts every few samples (not every sample), to keep its
+   memory use to a small fraction of the spectra themselves; the partial blocks at each end of a
+   contiguous range of samples are summed directly.
+   
+   The index is only used when every record being summed shares the exact \p energy_cal object, and
+   has gamma data; otherwise, or when only a few samples are being summed, this just calls
+   #SpecFile::sum_measurements.  Records are checked against the index on every call, so changes to
+   the file are picked up (by rebuilding the index) without needing any explicit invalidation.
+   
+   Meta-information (start time, detector name, remarks, etc), other than the live time, real time,
+   and neutron counts, is taken from the first record summed.
+   */
+  std::shared_ptr<SpecUtils::Measurement> sum_measurements_indexed( const std::set<int> &sample_nums,
+                                    const std::vector<std::string> &det_names,
+                                    const std::shared_ptr<const SpecUtils::EnergyCalibration> &energy_cal ) const;
+  
+  /** Computes and caches the sum of the given samples, so a later #sum_measurements_indexed call, for
+   exactly these samples and detectors, only has to copy the cached result.
+   
+   Intended to be called from a background thread for the samples the user is likely to step to next
+   (e.g., the next and previous few samples in CompactFileManager).  The cache is limited to
+   #sm_maxPrefetchedSumBytes, discarding the least recently added sums first.  Cached sums are checked
+   against the current records before use, so modifying the file does not give stale results.
+   
+   Does nothing if the samples are already cached, or are invalid.
+   */
+  void prefetch_sum( const std::set<int> &sample_nums, const std::vector<std::string> &det_names ) const;
+  
+  /** Maximum memory used by the sums cached by #prefetch_sum. */
+  static const size_t sm_maxPrefetchedSumBytes = 16*1024*1024;
+  
+  /** Approximate memory used by this object; i.e., #SpecUtils::SpecFile::memmorysize, plus the peaks,
+   automated search peaks, and the indexes and prefetched sums for #sum_measurements_indexed.
+   */
+  size_t memsize() const;
+  
+  /** Releases the indexes and prefetched sums used by #sum_measurements_indexed; they will be re-built
+   when next needed.
+   */
+  void clearSumIndexes() const;
+  
+  /** Appends records to this file, e.g., as they arrive from a detector during a live acquisition.
+   
+   The sample numbers of the new records are shifted (keeping their relative order) to follow the
+   last sample already in the file, and the SpecFile is cleaned-up without re-ordering any samples.
+   Any indexes used by #sum_measurements_indexed are extended with only the new samples, so summing
+   a growing range of samples stays cheap as the file grows.
+   
+   Returns the sample numbers of the added records.
+   */
+  std::set<int> appendMeasurements( const std::vector<std::shared_ptr<SpecUtils::Measurement>> &meas );
+  
   //guessDetectorTypeFromFileName(...): not called by default
   static SpecUtils::DetectorType guessDetectorTypeFromFileName( std::string name );
   
@@ -234,6 +318,44 @@ public:
   
   //peaksHaveBeenAdded(): marks this SpecUtils::SpecFile object as
   void setModified();
+  
+  /** What part of a spectrum a content hash covers. */
+  enum class HashScope
+  {
+    /** Gamma channel counts, live time, and real time. */
+    Counts,
+    
+    /** Energy calibration type, coefficients, deviation pairs, and number of channels. */
+    Calibration,
+    
+    /** Counts and calibration, as well as neutron counts, sample number, detector name, and start
+     time; for #SpecMeas::contentHash, also the peaks.
+     */
+    Full
+  };//enum class HashScope
+  
+  /** A fast 64-bit content hash of `meas`, for use as a cache key (e.x., RID results, continuums,
+   or de-duplicating stored spectra).
+   
+   The hash of the gamma counts is computed once per counts vector, and remembered (SpecUtils
+   replaces, rather than modifies, the counts vector when a Measurement is changed), so repeated
+   calls are on the order of a hash-table lookup, regardless of the number of channels.
+   
+   Hashes are stable between runs on the same platform, but should not be persisted or compared
+   between platforms.
+   */
+  static uint64_t contentHash( const SpecUtils::Measurement &meas, const HashScope scope );
+  
+  /** Combined content hash of all the Measurements in this file, in order; for #HashScope::Full
+   also includes the peaks of all sample number sets.  Should be called from the thread that owns
+   this SpecMeas (e.x., the session thread), as peaks are not otherwise protected.
+   */
+  uint64_t contentHash( const HashScope scope ) const;
+  
+  /** The XXH64 hash of `len` bytes starting at `data`; the hash function #contentHash is built on.
+   Gives the same values as the reference XXH64 implementation (on little endian hosts).
+   */
+  static uint64_t xxh64( const void *data, const size_t len, const uint64_t seed );
 
   /** The database UserState table index for the state associated with the passed in sample numbers.
    
@@ -413,6 +535,20 @@ protected:
    */
   std::map<std::set<int>,long long int> m_dbUserStateIndexes;
   
+  /** Running-sum index used by #sum_measurements_indexed; defined in SpecMeas.cpp. */
+  struct SampleSumIndex;
+  
+  /** The running-sum indexes, keyed by the (sorted) detector names summed.
+   Protected by `mutex_`; only a few detector combinations are kept at a time.
+   */
+  mutable std::map<std::vector<std::string>,std::shared_ptr<SampleSumIndex>> m_sampleSumIndexes;
+  
+  /** A sum computed by #prefetch_sum; defined in SpecMeas.cpp. */
+  struct PrefetchedSum;
+  
+  /** Sums computed by #prefetch_sum, most recently added first.  Protected by `mutex_`. */
+  mutable std::list<std::shared_ptr<const PrefetchedSum>> m_prefetchedSums;
+  
   /** Version of XML serialization of the <DHS:InterSpec> node.
    Changes:
    - Added version field to xml 20200807, with initial value 1.  Added <DisplayedDetectors> field.
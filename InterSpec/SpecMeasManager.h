@@ -25,6 +25,8 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <set>
 #include <deque>
 #include <mutex>
 #include <memory>
@@ -32,6 +34,7 @@
 #include <string>
 
 #include <boost/any.hpp>
+#include <boost/function.hpp>
 #include <boost/asio/deadline_timer.hpp>
 
 #include <Wt/WString>
@@ -307,6 +310,15 @@ public:
   //  trying to save them to disk
   void clearTempSpectrumInfoCache();
   
+  /** Releases memory that can be transparently recovered when next needed; called when the session has
+   been idle for a while (see InterSpecApp::idleMemoryReleaseSeconds).
+   
+   Spectrum files not being displayed are serialized to their temporary files (and the database, if the
+   user preference is to do so) and released from memory, to be re-parsed if the user uses them again;
+   pending database saves are written, and the summing indexes of the displayed files are released.
+   */
+  void releaseIdleMemory();
+  
   //addToTempSpectrumInfoCache(...): places the SpecMeas into
   //  m_tempSpectrumInfoCache (if not already in) so it will remain in memorry.
   //  The function then goes through m_tempSpectrumInfoCache and deletes older
@@ -368,8 +380,32 @@ public:
   //saveToDatabase(...): saves the SpecMeas to the database in another thread;
   //  must be called from a thread where WApplication::instance() is available
   //  to ensure thread safety.
+  //  Saves are write-behind: requests made within sm_dbWriteBehindMs of each
+  //  other are coalesced, and then a copy of each SpecMeas is serialized and
+  //  written on the server io_service, so the session thread does not wait on
+  //  serialization or the database.  See #flushPendingDbSaves.
   void saveToDatabase( std::shared_ptr<const SpecMeas> meas ) const;
   
+  /** Takes an immutable snapshot (deep copy) of each file with a pending save request, on the
+   session thread, and posts writing them to the database to the server io_service.
+   
+   Called sm_dbWriteBehindMs after the first save request since the last flush, as well as from the
+   destructor so pending saves arent lost when the session ends.
+   */
+  void flushPendingDbSaves() const;
+  
+  /** Schedules a call to #flushPendingDbSaves, sm_dbWriteBehindMs from now, if one isnt already scheduled. */
+  void scheduleDbSaveFlush() const;
+  
+  /** Called in the session thread when a save posted by #flushPendingDbSaves finishes.
+   
+   If the save failed, marks \p meas as modified again, so it will be saved by the next request.  If
+   saves for \p header were requested while this one was in progress, schedules writing them.
+   */
+  void dbSaveFinished( std::shared_ptr<SpectraFileHeader> header,
+                       std::shared_ptr<SpecMeas> meas,
+                       const bool saved ) const;
+  
   void storeSpectraInDb();
   void finishStoreAsSpectrumInDb( Wt::WLineEdit *name,
                                   Wt::WTextArea *description,
@@ -438,6 +474,19 @@ public:
                        SimpleDialog *dialog,
                        Wt::WApplication *app );
 
+  /** Opens multiple files from the filesystem (e.g., selected together in the desktop "Open" dialog).
+
+   The files are decoded concurrently on the server io_service thread-pool, rather than one after
+   another on the session thread, with a status dialog updated as each file finishes parsing.
+   Decoded files are then passed to InterSpec::userOpenFile(...) in the same order as \p paths,
+   regardless of the order parsing finishes in.
+
+   If only a single path is given, this is equivalent to InterSpec::userOpenFileFromFilesystem(...).
+
+   Must be called from within the application event loop (i.e., holding the WApplication::UpdateLock).
+   */
+  void openFilesFromFilesystem( const std::vector<std::string> &paths );
+
 #if( USE_QR_CODES )
   void handleSpectrumUrl( std::string &&url );
   void displaySpectrumQrCode( const SpecUtils::SpectrumType type );
@@ -486,6 +535,33 @@ protected:
   
   /** Deletes the dialog, but only if the passed in dialog is the same as `m_processingUploadDialog` */
   void checkCloseUploadDialog( SimpleDialog *dialog, Wt::WApplication *app );
+
+  /** Decodes a spectrum file; this is intended to be called off of the session thread, so it does
+   not touch any member variables.
+
+   Returns nullptr if the file could not be accessed or decoded.
+   */
+  static std::shared_ptr<SpecMeas> parseFileWorker( const std::string &displayName,
+                                                    const std::string &path );
+
+  /** Calls `display` once the files queued to be parsed before sequence number \p seq (see
+   #m_nextParseSequence) have all been displayed; if they already have, `display` is called
+   immediately.
+
+   Must be called from the session thread.
+   */
+  void displayParsedInOrder( const size_t seq, boost::function<void()> display );
+
+  /** Finishes opening a file dropped onto the app, whose parsing was done by #parseFileWorker.
+
+   If \p meas is null, the file is handled as a zip file, or non-spectrum file, like in
+   #handleFileDropWorker.
+   */
+  void finishFileDrop( const std::string &name,
+                       const std::string &spoolName,
+                       const SpecUtils::SpectrumType type,
+                       SimpleDialog *dialog,
+                       std::shared_ptr<SpecMeas> meas );
   
 private:
   Wt::WContainerWidget *createButtonBar();
@@ -548,6 +624,29 @@ protected:
    */
   std::unique_ptr<boost::asio::deadline_timer> m_processingUploadTimer;
 
+  /** Sequence number assigned to the next file queued for parsing (dropped onto the app, or opened
+   via #openFilesFromFilesystem).  Files may finish parsing (on the io_service thread-pool) in any
+   order, so these numbers are used to display them in the order the user selected them.
+
+   This, #m_nextParseToDisplay, and #m_parsedAwaitingDisplay are only accessed from the session thread.
+   */
+  size_t m_nextParseSequence;
+
+  /** The sequence number of the next parsed file to be displayed. */
+  size_t m_nextParseToDisplay;
+
+  /** Files that have finished parsing, but are waiting on files queued before them to be displayed. */
+  std::map<size_t,boost::function<void()>> m_parsedAwaitingDisplay;
+
+  /** The per-session memory budget for spectrum files not otherwise referenced; files are evicted, least
+   recently used first, by serializing them to a temporary file (see SpectraFileHeader::saveToFileSystem),
+   and are re-parsed when next needed.
+
+   Note that this budget is per-file, not per-record: a single large multi-record (e.g., portal or
+   search-mode) file in use is held fully in memory.  Loading channel counts on-demand, per record,
+   would need support from SpecUtils::Measurement, whose gamma counts are owned by, and accessed
+   directly through, that class.
+   */
 #if( !defined(MAX_SPECTRUM_MEMMORY_SIZE_MB) ||  MAX_SPECTRUM_MEMMORY_SIZE_MB < 0 )
   static const size_t sm_maxTempCacheSize = 0;
 #else
@@ -557,6 +656,24 @@ protected:
   const static size_t sm_minNumBytesShowUploadProgressDialog = 100 * 1024;
   
   mutable std::deque< std::shared_ptr<const SpecMeas> > m_tempSpectrumInfoCache;
+  
+#if( USE_DB_TO_STORE_SPECTRA )
+  /** How long after the first save request, saveToDatabase(...) waits for more requests before
+   writing to the database.
+   */
+  static const int sm_dbWriteBehindMs = 1500;
+  
+  /** Files with a pending save to the database, see #saveToDatabase; only accessed from the session thread. */
+  mutable std::map<std::shared_ptr<SpectraFileHeader>,std::shared_ptr<SpecMeas>> m_pendingDbSaves;
+  
+  /** If a call to #flushPendingDbSaves has been scheduled. */
+  mutable bool m_dbSaveScheduled;
+  
+  /** Files with a save posted by #flushPendingDbSaves that hasnt finished yet; only accessed from the
+   session thread.
+   */
+  mutable std::set<std::shared_ptr<SpectraFileHeader>> m_dbSavesInFlight;
+#endif
 };//class SpecMeasManager
 
 #endif
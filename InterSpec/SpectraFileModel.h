@@ -95,6 +95,14 @@ public:
   virtual ~SpectraHeader();
 
   void init( const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &sample_measurements );
+  
+  /** Sets the cheap-to-compute values (times, counts, source type, sample number). */
+  void init_summary( const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &sample_measurements );
+  
+  /** Sets the values only needed for display in the tree view (detector names and numbers,
+   remarks, speed, and start time).
+   */
+  void init_details( const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &sample_measurements );
 
   float live_time;
   float real_time;
@@ -183,6 +191,22 @@ public:
 
   std::shared_ptr<SpecMeas> parseFile() const;
   
+  /** Approximate memory used by this header, and by the SpecMeas, if it is currently in memory
+   (a file cached to disk or the database, but not otherwise referenced, does not count).
+   */
+  size_t memsize() const;
+  
+  /** Returns the header for the sample at `row` (i.e., index into #m_samples), with all fields,
+   including the detector names, remarks, and start time, filled out.
+   
+   When a file is set, only the summary fields of #m_samples are computed (see
+   SpectraHeader::init_summary); the remaining fields are computed by this function the first time
+   a row is accessed, which may require parsing the file back into memory.
+   
+   Throws std::out_of_range if `row` is invalid.
+   */
+  const SpectraHeader &sampleHeader( const size_t row ) const;
+  
   int numSamples() const;
   Wt::WString displayName() const;
   const Wt::WDateTime &uploadTime() const;
@@ -236,8 +260,9 @@ public:
                               std::shared_ptr<SpectraFileHeader> header );
   
   //saveToDatabaseWorker(...): an exception safe version of the above.  If
-  //  the operation fails a message is printed out to the user.
-  static void saveToDatabaseWorker( std::shared_ptr<SpecMeas> measurment,
+  //  the operation fails a message is printed out to the user.  Returns if
+  //  the spectrum was saved.
+  static bool saveToDatabaseWorker( std::shared_ptr<SpecMeas> measurment,
                                     std::shared_ptr<SpectraFileHeader> header );
   
   //saveToDatabaseFromTempFile(): saves the SpecMeas to the database,
@@ -321,7 +346,14 @@ public:
   int m_numDetectors;
   bool m_hasNeutronDetector;
   Wt::WDateTime m_spectrumTime;
-  std::vector<SpectraHeader>     m_samples;
+  
+  /** Per-sample information, sorted by sample number; only the fields set by
+   SpectraHeader::init_summary are valid until #sampleHeader is called for a row.
+   */
+  mutable std::vector<SpectraHeader> m_samples;
+  
+  /** Whether SpectraHeader::init_details has been called for each entry of #m_samples. */
+  mutable std::vector<bool> m_sampleDetailsComputed;
   
   //m_modifiedSinceDecode: only updated when writing to file, or database, and
   //  exists to catch the edge case where the SpecMeas object has been written
@@ -351,6 +383,9 @@ public:
 
   mutable std::recursive_mutex m_mutex; //XXX - right now only used in a couple select places
   typedef std::lock_guard<std::recursive_mutex>  RecursiveLock;
+  
+  /** Held for the duration of #saveToDatabase, so saves of this file are not written concurrently. */
+  mutable std::mutex m_dbSaveMutex;
 
   Wt::Dbo::ptr<InterSpecUser> m_user;
   std::shared_ptr<DataBaseUtils::DbSession> m_sql;  //same as m_viewer uses
@@ -462,6 +497,9 @@ public:
 
   virtual Wt::WFlags<Wt::ItemFlag> flags( const Wt::WModelIndex &index ) const;  //should return ItemIsSelectable for SpectraFiles with one Measurement, or for SpectraHeaders
 
+  /** Approximate memory used by all the spectrum files in this model; see #SpectraFileHeader::memsize. */
+  size_t memsize() const;
+
 protected:
   std::vector< std::shared_ptr<SpectraFileHeader> > m_spectra;
 };//class SpectraFileModel
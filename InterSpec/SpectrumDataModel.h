@@ -199,6 +199,46 @@ public:
   //  changed.
   Wt::Signal<ColumnType> &dataSet();
   
+  
+  /** The first, minimum, maximum, and last values (and the rows and x-values they occur at) of the
+   rows within a single pixel column; see #envelope.
+   */
+  struct EnvelopeColumn
+  {
+    int first_row, min_row, max_row, last_row;
+    double first_x, first_y;
+    double min_x, min_y;
+    double max_x, max_y;
+    double last_x, last_y;
+  };//struct EnvelopeColumn
+  
+  /** Returns a decimated view of the rows of `column` with x-values between `xmin` and `xmax`, as the
+   envelope of the rows falling within each of `npixels` equal-width columns (empty columns are
+   omitted); drawing a line through each columns first, min, max, and last points (in x order) gives
+   the same picture as drawing every row, when there are many rows per pixel.
+   
+   The result for the last few (column, x-range, width) combinations is cached, so repainting without
+   changing zoom, or rendering multiple series, doesnt re-iterate every row; the cache is cleared
+   whenever the data changes.
+   */
+  const std::vector<EnvelopeColumn> &envelope( const int column, const double xmin, const double xmax,
+                                               const int npixels ) const;
+  
+protected:
+  /** Clears #m_envelopeCache; connected to the data changing signals of this model. */
+  void clearEnvelopeCache();
+  
+  struct EnvelopeCacheEntry
+  {
+    int column;
+    double xmin, xmax;
+    int npixels;
+    std::vector<EnvelopeColumn> points;
+  };//struct EnvelopeCacheEntry
+  
+  /** Most recently used first; see #envelope. */
+  mutable std::vector<std::shared_ptr<EnvelopeCacheEntry>> m_envelopeCache;
+  
 protected:
   int        m_rebinFactor;
   std::shared_ptr<const SpecUtils::Measurement> m_data;
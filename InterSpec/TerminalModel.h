@@ -52,7 +52,11 @@
 
 //Forward declarations
 class InterSpec;
-namespace SpecUtils{ class Measurement; }
+namespace SpecUtils
+{
+  class Measurement;
+  class EnergyCalibration;
+}
 
 namespace mup
 {
@@ -134,6 +138,18 @@ public:  // Function methods (for parser, can combine with expressions)
   double drfGeometricEff( const std::string &distance );
   double drfEfficiency( const double energy, const std::string &distance );
   
+  // Bulk versions of the above; each evaluates a whole array of arguments in a single native loop.
+  //  Where two array arguments are taken, a single scalar is used for every element of the other array.
+  std::vector<double> gammaIntegralsAt( const std::vector<double>& energyLow, const std::vector<double>& energyHigh );
+  std::vector<double> gammaIntegralsFor( const std::string& histogram, const std::vector<double>& energyLow, const std::vector<double>& energyHigh );
+  std::vector<double> gammaSumsAt( const std::vector<double>& startBin, const std::vector<double>& endBin );
+  std::vector<double> gammaSumsFor( const std::string& histogram, const std::vector<double>& startBin, const std::vector<double>& endBin );
+  std::vector<double> peakAreas();
+  std::vector<double> peakMeans();
+  std::vector<double> drfFWHMs( const std::vector<double>& energies );
+  std::vector<double> drfIntrinsicEffs( const std::vector<double>& energies );
+  std::vector<double> drfEfficiencies( const std::vector<double>& energies, const std::string& distance );
+  
 protected:  /* Command methods (complete actions on Spectrum, cannot be used with parser)
              To add a new command in the Terminal tool:
                  1. Add the corresponding CommandType enum inside the TerminalModel Header file.
@@ -215,6 +231,14 @@ protected:  // Internal helper methods
     float gammaFunctionTwoArgFor( const std::string& histogram, const double arg1, const double arg2,
                                         float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) );
     
+    std::vector<double> gammaArrayFunction( const std::vector<double>& arg1, const std::vector<double>& arg2,
+                                            float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) );
+    std::vector<double> gammaArrayFunctionFor( const std::string& histogram, const std::vector<double>& arg1, const std::vector<double>& arg2,
+                                               float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) );
+    std::vector<double> gammaArrayFunctionFor( std::shared_ptr<const SpecUtils::Measurement> histogram,
+                                               const std::vector<double>& arg1, const std::vector<double>& arg2,
+                                               float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) );
+    
     float gammaChannel( std::shared_ptr<const SpecUtils::Measurement> histogram, const double energy );
     float gammaChannelContent( std::shared_ptr<const SpecUtils::Measurement> histogram, const double energy );
     float gammaChannelLowerEnergy( std::shared_ptr<const SpecUtils::Measurement> histogram, const double channel );
@@ -227,6 +251,15 @@ protected:  // Internal helper methods
     
     bool energyIsWithinPeak( PeakModel::PeakShrdPtr peak, const double energy );
     
+    /** Evaluates an expression using a parser that is cached by the expression text, so re-evaluating
+     the same expression (e.g., from a script) skips re-tokenizing and re-creating the RPN.
+     Throws mup::ParserError (or other exceptions) on error, in which case the expression is not cached.
+     */
+    mup::Value evaluateCachedExpression( const std::string &expression );
+    
+    /** Clears cached expressions; must be called whenever a variable is defined or removed from #m_parser. */
+    void clearCachedExpressions();
+    
 private:
     // Terminal Model Members
     std::unique_ptr<mup::ParserX>   m_parser;
@@ -238,6 +271,9 @@ private:
     std::shared_ptr<const SpecUtils::Measurement> m_backgroundHistogram;
     std::shared_ptr<const SpecUtils::Measurement> m_secondaryHistogram;
     
+    /** Parsers, copied from #m_parser, with their expression already set; keyed by expression text. */
+    std::map<std::string,std::unique_ptr<mup::ParserX>> m_compiledExpressions;
+    
     /* To add a new command/function into the Drop-Down helper list:
      FOR COMMANDS ONLY:
             1.  Inside the void TerminalModel::addCommand(const std::string& command, CommandType type) method, create a new case inside the 
@@ -74,7 +74,7 @@ public:
   /** The approximate maximum number of undo/redo steps that should be kept in memory.
    
    A value of zero indicates unlimited, a negative value indicates disabled.
-   Default value is 250, but may be set be the `DesktopAppConfig` mechanism
+   Default value is 250 (100 when built with `LOW_MEMORY_PROFILE`), but may be set be the `DesktopAppConfig` mechanism
    */
   static int maxUndoRedoSteps();
   
@@ -84,6 +84,19 @@ public:
    */
   static void setMaxUndoRedoSteps( const int steps );
   
+  /** The approximate maximum number of bytes of memory the undo/redo steps of a session should take up, as
+   estimated from the `approx_bytes` passed into #addUndoRedoStep.
+   A value of zero indicates unlimited.
+   
+   Default value is 32 MB (8 MB when built with `LOW_MEMORY_PROFILE`).
+   */
+  static size_t maxUndoRedoMemory();
+  
+  /** Sets the approximate maximum number of bytes of memory for the undo/redo steps of each session.
+   Set to `0` for unlimited.
+   */
+  static void setMaxUndoRedoMemory( const size_t bytes );
+  
   /** Adds an undo/redo step.
    
    If the user has "undo" one or more times, then the undo/redo functions of the undid steps will swapped and new
@@ -96,6 +109,11 @@ public:
    
    If you are currently executing an undo or redo step, the new step passed in will not be added.
    
+   The `approx_bytes` argument is the approximate memory the undo and redo functions hold onto (e.g., the peaks,
+   serialized state, etc. they captured); it is used to limit the memory used by undo/redo history, see
+   #maxUndoRedoMemory.  If zero, a small fixed size is assumed.  Anything captured by both undo and redo should
+   be held via a `std::shared_ptr<const T>`, and only counted once.
+   
    Be careful of:
    - If you capture any shared pointers, particularly to SpecMeas objects, keep in mind you could create dependency
       cycles that could cause the object to never destruct, even if all other shared pointers are gone.  Using std::weak_ptr<SpecMeas>
@@ -103,7 +121,8 @@ public:
    */
   void addUndoRedoStep( std::function<void()> undo,
                         std::function<void()> redo,
-                        const std::string &description );
+                        const std::string &description,
+                        const size_t approx_bytes = 0 );
   
   bool canUndo() const;
   bool canRedo() const;
@@ -135,6 +154,9 @@ public:
   /** Clears all undo/redo history. */
   void clearUndoRedu();
   
+  /** Approximate memory held by the undo/redo history, as estimated when the steps were added. */
+  size_t memsize() const;
+  
   /** A struct that will insert a single peak-change undo/redo step, for all changes between the construction of
    the first `PeakModelChange` and the  last `PeakModelChange` destructed, for an InterSpec session.
    */
@@ -206,7 +228,11 @@ protected:
                             const std::set<int> &sample_nums,
                             const std::vector<std::string> &detector_names );
   
-  /** Limits total number of steps held in #m_steps plus #m_prev to be less than that retunred by #maxUndoRedoSteps */
+  /** Limits total number of steps held in #m_steps plus #m_prev to be less than that retunred by #maxUndoRedoSteps,
+   and their estimated memory to be less than #maxUndoRedoMemory; the oldest steps are removed first.
+   
+   Also removes history for spectrum files that no longer exist.
+   */
   void limitTotalStepsInMemory();
   
 protected:
@@ -219,6 +245,9 @@ protected:
     std::function<void()> m_redo;
     std::string m_description;
     std::chrono::time_point<std::chrono::system_clock> m_time;
+    
+    /** Approximate memory used by this step, including what the undo/redo functions hold onto. */
+    size_t m_num_bytes;
   };//struct UndoRedoStep
   
   /** Each new Undo/Redo step, we will `push` onto #m_steps.  But if we have executed an undo step,
@@ -238,6 +267,9 @@ protected:
   /** The total number of undo/redo steps in memory, for all spectrum files (i.e., for all entries in #m_prev).*/
   size_t m_num_steps_in_mem;
   
+  /** The approximate memory used by all the undo/redo steps in #m_steps and #m_prev. */
+  size_t m_num_bytes_in_mem;
+  
   /** Eventually we want to have `SpecMeas` itself track its history, but for the moment we'll just track it here. */
   typedef std::tuple<std::weak_ptr<SpecMeas>,std::set<int> > spec_key_t;
   static bool spec_key_equal( const spec_key_t &lhs, const spec_key_t &rhs );
@@ -28,7 +28,9 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
 #include <iostream>
+#include <functional>
 #include <stdint.h>
 
 /** ZipArchive opens a ZIP file and allows you to extract files it contains.
@@ -73,5 +75,74 @@ namespace ZipArchive
   size_t read_file_from_zip( std::istream &instrm,
                              std::shared_ptr<const ZipFileHeader> header,
                              std::ostream &output );
+  
+  
+  /** A zip file that is memory-mapped (or on Windows, read fully into memory), with its central
+   directory parsed once on construction.
+   
+   Entries can then be accessed randomly without any seeking or re-reading of headers; stored
+   (uncompressed) entries can be accessed directly in the mapping without any copies, and
+   deflated entries are inflated straight into caller provided buffers.
+   
+   All const member functions are thread-safe, so independent entries may be decoded in parallel.
+   */
+  class MappedZipFile
+  {
+  public:
+    /** Opens and maps the file, and reads its central directory.
+     
+     @param filename UTF-8 path to the zip file.
+     
+     Throws std::exception with descriptive message upon error, or no files found.
+     */
+    explicit MappedZipFile( const std::string &filename );
+    ~MappedZipFile();
+    
+    MappedZipFile( const MappedZipFile & ) = delete;
+    MappedZipFile &operator=( const MappedZipFile & ) = delete;
+    
+    /** The entries in the zip file; garunteed to have at least one entry. */
+    const FilenameToZipHeaderMap &headers() const;
+    
+    /** Returns the header for the specified file, or nullptr if it is not in the archive. */
+    std::shared_ptr<const ZipFileHeader> header( const std::string &filename ) const;
+    
+    /** Returns a pointer to, and size of, the entries data as stored in the file; for uncompressed
+     entries this is the file contents, without any copying, for deflated entries this is the
+     raw deflate stream.
+     
+     Pointer is valid for the lifetime of this object.  Throws if header is invalid for this file.
+     */
+    std::pair<const char *,size_t> stored_data( const ZipFileHeader &header ) const;
+    
+    /** Writes the (inflated, if necessary) file contents into a caller supplied buffer.
+     
+     Throws if `buffer_size` is less than the headers uncompressed size, or on error.
+     Returns the number of bytes written.
+     */
+    size_t read_file( const ZipFileHeader &header, char *buffer, const size_t buffer_size ) const;
+    
+    /** Convenience function to read the file contents into the a vector, which will be resized to
+     the files uncompressed size.  Throws on error.
+     */
+    size_t read_file( const ZipFileHeader &header, std::vector<char> &output ) const;
+    
+    /** Streams the (inflated, if necessary) file contents to the output stream, a chunk at a time.
+     Throws on error.  Returns number of bytes written.
+     */
+    size_t read_file( const ZipFileHeader &header, std::ostream &output ) const;
+    
+  protected:
+    /** Inflates, or copies, the entry, calling `consumer` with each chunk of output. */
+    size_t decode( const ZipFileHeader &header,
+                   const std::function<void(const char *,size_t)> &consumer ) const;
+    
+    const char *m_data;
+    size_t m_size;
+#if( defined(_WIN32) )
+    std::vector<char> m_buffer;
+#endif
+    FilenameToZipHeaderMap m_headers;
+  };//class MappedZipFile
 }//namespace ZipArchive
 #endif
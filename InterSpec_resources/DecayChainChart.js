@@ -196,6 +196,38 @@ DecayChainChart.prototype.setHideSmallBrDecayLines = function( hide ){
   this.redraw();
 }
 
+/* Loads the decay data from the given URL, then calls setDecayData(...).
+ If url is null, sets the decay data to empty.
+ Only the most recently requested URL will be loaded, if multiple requests are outstanding.
+ */
+DecayChainChart.prototype.setDecayDataFromUrl = function( url, decayFrom ){
+  let self = this;
+  this.pendingDataUrl = url;
+  
+  if( !url )
+  {
+    this.setDecayData( [], decayFrom );
+    return;
+  }
+  
+  fetch( url )
+    .then( function(response){
+      if( !response.ok )
+        throw new Error( 'HTTP status ' + response.status );
+      return response.json();
+    })
+    .then( function(data){
+      if( self.pendingDataUrl === url )
+        self.setDecayData( data, decayFrom );
+    })
+    .catch( function(e){
+      console.log( 'DecayChainChart.setDecayDataFromUrl: Error loading ' + url, e );
+      if( self.pendingDataUrl === url )
+        self.setDecayData( [], decayFrom );
+    });
+}//setDecayDataFromUrl(...)
+
+
 DecayChainChart.prototype.setDecayData = function( data, decayFrom ){
   //console.log( 'data=', data );
   
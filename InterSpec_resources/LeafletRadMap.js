@@ -191,6 +191,9 @@ LeafletRadMap = function (elem,options) {
   this.map.on('zoomend',   (e) => { self.isAutoZoomed = false; });
 
   this.map.on('resize', (e) => { self.handleResize(); });
+  
+  // For files with a lot of GPS points, the server only sends us the points in the current view
+  this.map.on('moveend', (e) => { self.requestViewData(); });
 
   // For debugging; it would be nice to display this somewhere maybe
   this.map.on('click', (e) => {
@@ -206,10 +209,10 @@ LeafletRadMap.prototype.handleResize = function() {
   //        loading (unfortunately), not just when the the user changes
   //        things.
 
-  if( !this.isAutoZoomed || !this.markerLayer )
+  if( !this.isAutoZoomed || (!this.markerLayer && !this.isTiled()) )
     return;
 
-  const markerBounds = this.markerLayer.getBounds();
+  const markerBounds = this.dataBounds();
   if( !markerBounds )
     return;
 
@@ -279,21 +282,43 @@ LeafletRadMap.prototype.updateMarkerLegend = function(){
 LeafletRadMap.prototype.handleUserDrawingUpdate = function(){
   const self = this;
 
-  const wantedSamples = this.getSelectedSampleNumbers();
+  // If we only have the points for the current view, we will estimate the number of selected
+  //  measurements from the points and clusters we have, and let the server find the actual
+  //  measurements within the drawn polygons.
+  const isTiled = self.isTiled();
+  const polygons = isTiled ? self.getSelectionPolygons() : null;
+  const wantedSamples = isTiled ? [] : this.getSelectedSampleNumbers();
+  let numWanted = wantedSamples.length;
   
-  if( wantedSamples.length === 0 ){
+  if( isTiled ){
+    if( polygons.length < 1 ){
+      numWanted = self.data.numSamples;
+    }else{
+      for( const m of self.markers ){
+        const latLng = m.getLatLng();
+        if( self.isInSelection( polygons, [latLng.lng,latLng.lat] ) )
+          numWanted += (typeof m.numSamples === "number") ? m.numSamples : 1;
+      }
+    }
+  }//if( isTiled )
+  
+  if( numWanted === 0 ){
     self.btnsDiv.innerHTML = '<div class="NoSamplesSel"><p>No measurements selected</p></div>';
     return;
   }
 
   function sendToInterSpec(evt, spectype, samples){
-    self.WtEmit( self.parent.id, {name: 'loadSamples', eventObject: evt}, samples, spectype );
+    if( isTiled )
+      self.WtEmit( self.parent.id, {name: 'loadSamplesInArea', eventObject: evt}, JSON.stringify(polygons), spectype );
+    else
+      self.WtEmit( self.parent.id, {name: 'loadSamples', eventObject: evt}, samples, spectype );
   }
 
   self.btnsDiv.innerHTML = '';
 
   const msg = document.createElement('div');
-  msg.innerHTML = self.options.loadTxt + " " + wantedSamples.length + " " + self.options.measurementsAsTxt + ":";
+  const numWantedTxt = ((isTiled && (polygons.length > 0)) ? "~" : "") + numWanted;
+  msg.innerHTML = self.options.loadTxt + " " + numWantedTxt + " " + self.options.measurementsAsTxt + ":";
   self.btnsDiv.appendChild( msg );
 
   const foreground = document.createElement('button');
@@ -326,10 +351,11 @@ LeafletRadMap.prototype.handleUserDrawingUpdate = function(){
 };//LeafletRadMap.prototype.handleUserDrawingUpdate
 
 
-/** Returns the sample numbers of measurements currently within the drawn on polygons; or if no shapes
- * are drawn, returns all sample numbers.
+/** Returns the polygons the user has drawn, as GeoJSON coordinates.
+ * Each entry in the returned array is itself an array of polygons; the first polygon of each entry
+ * is the outline polygon, and the remaining polygons are the exclude polygons.
  */
-LeafletRadMap.prototype.getSelectedSampleNumbers = function(){
+LeafletRadMap.prototype.getSelectionPolygons = function(){
   const self = this;
 
   const layers = self.map.pm.getGeomanDrawLayers();
@@ -363,52 +389,67 @@ LeafletRadMap.prototype.getSelectedSampleNumbers = function(){
     }
   }//for( const feature of shapeGJ.features )
 
-  let contained_samples = [];
-  if( !self.markerLayer )
-    return contained_samples;
+  return polygons;
+};//LeafletRadMap.prototype.getSelectionPolygons
 
-  // Now loop over all the markers, and find the ones in the polygons we want
-  self.markerLayer.eachLayer(layer => {
-    const latLng = layer.getLatLng();
-    const coords = [latLng.lng,latLng.lat];
 
-    if( polygons.length < 1 ){
-      contained_samples.push( layer.sampleNumber );
-      return;
-    }
-      
+/** Returns if the [lng,lat] coordinates are inside the polygons returned by getSelectionPolygons();
+ * if no polygons are drawn, returns true.
+ */
+LeafletRadMap.prototype.isInSelection = function( polygons, coords ){
+  if( polygons.length < 1 )
+    return true;
 
-    let isInAnyOutline = false, isInAnyExclude = false;
+  let isInAnyOutline = false, isInAnyExclude = false;
+  
+  for( const coordinates of polygons ) {
+    // I think 'feature' is an object the user has drawn.  Should be polygon, but may have excluded regions
     
-    for( const coordinates of polygons ) {
-      // I think 'feature' is an object the user has drawn.  Should be polygon, but may have excluded regions
+    //console.log( 'feature.geometry.coordinates', feature.geometry.coordinates );
+    const outline_polys = [], exclude_polys = [];
+    if( coordinates.length > 0 )
+      outline_polys.push( coordinates[0] );
       
-      //console.log( 'feature.geometry.coordinates', feature.geometry.coordinates );
-      const outline_polys = [], exclude_polys = [];
-      if( coordinates.length > 0 )
-        outline_polys.push( coordinates[0] );
-        
-      for( let i = 1; i < coordinates.length; ++i )
-        exclude_polys.push( coordinates[i] );
-
-      for (const poly of outline_polys ) {
-        const isIn = d3.polygonContains( poly, coords );
-        if( isIn ){
-          isInAnyOutline = true;
-          //console.log( 'Is in outline, ', layer.sampleNumber );
-        }
+    for( let i = 1; i < coordinates.length; ++i )
+      exclude_polys.push( coordinates[i] );
+
+    for (const poly of outline_polys ) {
+      const isIn = d3.polygonContains( poly, coords );
+      if( isIn ){
+        isInAnyOutline = true;
+        //console.log( 'Is in outline, ', layer.sampleNumber );
       }
+    }
 
-      for (const poly of exclude_polys ) {
-        const isIn = d3.polygonContains( poly, coords );
-        if( isIn ){
-          isInAnyExclude = true;
-          //console.log( 'Is in exclude' );
-        }
+    for (const poly of exclude_polys ) {
+      const isIn = d3.polygonContains( poly, coords );
+      if( isIn ){
+        isInAnyExclude = true;
+        //console.log( 'Is in exclude' );
       }
-    }//for( const coordinates of polygons )
+    }
+  }//for( const coordinates of polygons )
+
+  return isInAnyOutline && !isInAnyExclude;
+};//LeafletRadMap.prototype.isInSelection
+
+
+/** Returns the sample numbers of measurements currently within the drawn on polygons; or if no shapes
+ * are drawn, returns all sample numbers.
+ */
+LeafletRadMap.prototype.getSelectedSampleNumbers = function(){
+  const self = this;
+
+  const polygons = self.getSelectionPolygons();
+
+  let contained_samples = [];
+  if( !self.markerLayer )
+    return contained_samples;
 
-    if( isInAnyOutline && !isInAnyExclude )
+  // Now loop over all the markers, and find the ones in the polygons we want
+  self.markerLayer.eachLayer(layer => {
+    const latLng = layer.getLatLng();
+    if( self.isInSelection( polygons, [latLng.lng,latLng.lat] ) )
       contained_samples.push( layer.sampleNumber );
   } );//self.markerLayer.eachLayer(layer => {
 
@@ -468,27 +509,92 @@ LeafletRadMap.prototype.displayTypeClass = function( disp ) {
 
 LeafletRadMap.prototype.setData = function( data, dont_update_zoom ) {
   this.data = data;
+  this.viewData = null;
+  this.lastViewRequest = null;
   this.refresh( dont_update_zoom );
+  
+  if( this.isTiled() )
+    this.requestViewData();
 }//LeafletRadMap.prototype.setData(...)
 
 
-LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
+/** Returns true if the server is only sending us the points for the current view, because there
+ * are too many points in the file to send all of them.
+ */
+LeafletRadMap.prototype.isTiled = function() {
+  return !!(this.data && this.data.tiled);
+}//LeafletRadMap.prototype.isTiled()
+
+
+/** Returns the L.LatLngBounds of all the data, or null if there is no data. */
+LeafletRadMap.prototype.dataBounds = function() {
+  if( this.isTiled() )
+    return this.data.bounds ? L.latLngBounds( this.data.bounds ) : null;
+  return this.markerLayer ? this.markerLayer.getBounds() : null;
+}//LeafletRadMap.prototype.dataBounds()
+
+
+/** When all the points arent on the client, requests the points within the current view from the
+ * server; the server will call setViewData(...) in response.
+ */
+LeafletRadMap.prototype.requestViewData = function() {
+  const self = this;
+  if( !self.isTiled() )
+    return;
+  
+  const b = self.map.getBounds();
+  const zoom = self.map.getZoom();
+  const request = [b.getSouth(), b.getWest(), b.getNorth(), b.getEast(), zoom];
+  
+  if( self.lastViewRequest && self.lastViewRequest.every( (v,i) => v === request[i] ) )
+    return;
+  self.lastViewRequest = request;
+  
+  // Panning can cause many 'moveend' events, so wait a moment before asking the server
+  if( self.viewRequestTimeout )
+    window.clearTimeout( self.viewRequestTimeout );
+  
+  self.viewRequestTimeout = window.setTimeout( function(){
+    self.viewRequestTimeout = null;
+    self.WtEmit( self.parent.id, {name: 'viewChanged'}, request[0], request[1], request[2], request[3], request[4] );
+  }, 150 );
+}//LeafletRadMap.prototype.requestViewData()
+
+
+/** Called by the server with the points, and clusters of points, in the current view. */
+LeafletRadMap.prototype.setViewData = function( viewData ) {
+  if( !this.isTiled() )
+    return;
+  
+  this.viewData = viewData;
+  this.refresh( true, true );
+}//LeafletRadMap.prototype.setViewData(...)
+
+
+LeafletRadMap.prototype.refresh = function( dont_update_zoom, is_view_update ){
   const self = this;
 
-  const ndata = this.data && this.data.samples ? this.data.samples.length : 0;
+  const isTiled = this.isTiled();
  
   //Remove previous markers
   if( this.markerLayer ){
     this.markerLayer.remove();
     this.markerLayer = null;
   }
+  
+  if( this.clusterLayer ){
+    this.clusterLayer.remove();
+    this.clusterLayer = null;
+  }
 
-  // Remove all user drawn shapes
-  this.map.eachLayer( function(layer){
-    if (layer._path != null) {
-      layer.remove();
-    }
-  });
+  // Remove all user drawn shapes, unless we are just updating the points for the current view
+  if( !is_view_update ){
+    this.map.eachLayer( function(layer){
+      if (layer._path != null) {
+        layer.remove();
+      }
+    });
+  }
 
   if( this.heatmap ){
     this.heatmap.remove();
@@ -507,7 +613,12 @@ LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
   //  we will use seperate Sets for lat and lon
   const unique_lat = new Set(), unique_lon = new Set();
 
-  const measurements = this.data ? this.data.samples : [];
+  let measurements = this.data ? this.data.samples : [];
+  let clusters = [];
+  if( isTiled ){
+    measurements = (this.viewData && this.viewData.samples) ? this.viewData.samples : [];
+    clusters = (this.viewData && this.viewData.clusters) ? this.viewData.clusters : [];
+  }
 
 
   this.markers = [];
@@ -542,6 +653,13 @@ LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
     }//if( sample.nNDet > 0 )
   }//for( sample of measurements )
 
+  // When we only have the points in view, use the ranges for the whole file, so colors stay
+  //  consistent as the user pans around.
+  if( isTiled ){
+    self.minGammaCps = this.data.minGammaCps;
+    self.maxGammaCps = this.data.maxGammaCps;
+  }
+
   if( self.minGammaCps >= self.maxGammaCps )
     self.minGammaCps = 0;
   self.gammaCpsRange = (self.maxGammaCps > self.minGammaCps) ? (self.maxGammaCps - self.minGammaCps) : 1;
@@ -653,8 +771,55 @@ LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
     self.markers.push( marker );
   }//for( sample of data.samples )
   
+  
+  // Clusters of points the server has aggregated, because there are too many in view to send.
+  for( const cluster of clusters )
+  {
+    const lat_lon = cluster.gps;
+    const gamma_cps = (typeof cluster.gSum === "number") ? cluster.gSum / (cluster.gLT > 0 ? cluster.gLT : 1) : -1;
+    const max_gamma_cps = (typeof cluster.maxGCps === "number") ? cluster.maxGCps : 0;
+    const max_rel_rate = Math.max( 0, (max_gamma_cps - self.minGammaCps) / self.gammaCpsRange );
+    
+    let marker = new L.marker( [lat_lon[0], lat_lon[1]], { 
+      icon: L.divIcon({
+        className: 'RadMapMarker',
+        iconSize: [22, 22],
+        html: '<div style="background-color: '
+                + self.gradColorForFrac(max_rel_rate, self.grad_colors)
+                + '" class="RadMapMarkerMulti ' + self.displayTypeClass(cluster.disp) + '">'
+                + '<div>' + cluster.n + '</div>'
+              + '</div>'
+      }),
+      pmIgnore: true,
+      riseOnHover: true,
+      draggable: false
+    } );
+    
+    let html = "<table class=\"MapMousePopup\">";
+    html += `<tr><td>Measurements</td><td>${cluster.n}</td></tr>`;
+    if( gamma_cps >= 0 ){
+      html += `<tr><td>${self.options.gammaTxt} ${self.options.cpsText}</td><td>${gamma_cps.toFixed(2)}</td></tr>`;
+      html += `<tr><td>Max ${self.options.gammaTxt} ${self.options.cpsText}</td><td>${max_gamma_cps.toFixed(2)}</td></tr>`;
+      html += `<tr><td>${self.options.liveTimeTxt}</td><td>${cluster.gLT.toFixed(3)}</td></tr>`;
+    }
+    if( typeof cluster.nSum === "number" )
+      html += `<tr><td>Neutron ${self.options.cpsText}</td><td>${(cluster.nSum / (cluster.nRT > 0 ? cluster.nRT : 1)).toFixed(4)}</td></tr>`;
+    html += `</table>`;
+    
+    marker.bindPopup( html );
+    marker.on('mouseover', function(){ marker.openPopup( marker.getLatLng() ); });
+    
+    marker.numSamples = cluster.n;
+    marker.rateIntensity = max_rel_rate;
+    marker.displayType = (typeof cluster.disp === "number") ? cluster.disp : 3;
+    if( gamma_cps >= 0 )
+      this.heatMapData.push( [lat_lon[0], lat_lon[1], max_rel_rate] );
+    
+    self.markers.push( marker );
+  }//for( const cluster of clusters )
+  
   // Dont show drawing controls for 0 or 1 items.
-  if( ((unique_lat.size > 1) || (unique_lon.size > 1)) != this.map.pm.controlsVisible() ){
+  if( (isTiled || (unique_lat.size > 1) || (unique_lon.size > 1)) != this.map.pm.controlsVisible() ){
     this.map.pm.toggleControls();
   }
     
@@ -669,7 +834,7 @@ LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
   };
   
   
-  if( (unique_lat.size > 1) || (unique_lon.size > 1) ){
+  if( isTiled || (unique_lat.size > 1) || (unique_lon.size > 1) ){
     self.heatMapButton = L.easyButton({
       leafletClasses: true,
   
@@ -733,12 +898,26 @@ LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
       }
     });
 
-    for( const m of self.markers )
-      self.markerLayer.addLayer( m );
+    // Clusters from the server are already aggregated, so dont put them in the markerClusterGroup
+    self.clusterLayer = L.layerGroup();
+    
+    for( const m of self.markers ){
+      if( typeof m.numSamples === "number" )
+        self.clusterLayer.addLayer( m );
+      else
+        self.markerLayer.addLayer( m );
+    }
     self.map.addLayer(self.markerLayer);
-
+    self.map.addLayer(self.clusterLayer);
+  }//if( self.markers.length )
+  
+  const markerBounds = self.dataBounds();
+  
+  if( markerBounds && (self.markers.length || isTiled) ){
     if( !dont_update_zoom ){
-      const markerBounds = self.markerLayer.getBounds();
+      if( isTiled )
+        self.map.invalidateSize();
+      
       const diagMeters = markerBounds.getNorthWest().distanceTo( markerBounds.getSouthEast() );
       
       if( diagMeters > 10 ){
@@ -755,7 +934,7 @@ LeafletRadMap.prototype.refresh = function( dont_update_zoom ){
     self.map.setView([37.67640130843344, -121.70667619429008], 15); 
   }
 
-  if( (self.markers.length) > 1 && self.markerGradientStops ){
+  if( (isTiled || (self.markers.length > 1)) && self.markerGradientStops ){
     self.gradientLegendDiv.style.display = null;
     self.bottomDiv.style.display = null;
 
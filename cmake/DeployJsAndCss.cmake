@@ -14,28 +14,56 @@ endif()
 find_package_handle_standard_args(UglifyCSS DEFAULT_MSG UglifyCSS_EXECUTABLE)
 
 
+# When PRECOMPRESS_WEB_RESOURCES is on, each deployed file also gets a "<file>.gz"
+#  sibling; Wt's built-in http server sends this (with "Content-Encoding: gzip")
+#  instead of compressing the file on every request.
+if( PRECOMPRESS_WEB_RESOURCES )
+  if(NOT GZIP_EXECUTABLE)
+    find_program(GZIP_EXECUTABLE gzip)
+  endif()
+  
+  if( NOT GZIP_EXECUTABLE )
+    message( WARNING "PRECOMPRESS_WEB_RESOURCES is on, but gzip was not found; resources will not be precompressed." )
+  endif( NOT GZIP_EXECUTABLE )
+endif( PRECOMPRESS_WEB_RESOURCES )
+
+
+macro( precompress_command output )
+  set( _precompress_command "" )
+  if( PRECOMPRESS_WEB_RESOURCES AND GZIP_EXECUTABLE )
+    set( _precompress_command COMMAND ${GZIP_EXECUTABLE} -9 -n -k -f \"${output}\" )
+  endif( PRECOMPRESS_WEB_RESOURCES AND GZIP_EXECUTABLE )
+endmacro( precompress_command )
+
+
 macro( deploy_js_resource input output )
 message( "Will deploy JS ${input} to ${output}")
+  precompress_command( ${output} )
   if( UglifyJS_EXECUTABLE )
     message( "Will uglify ${input} to ${output} using ${UglifyJS_EXECUTABLE}")
     add_custom_command(
         OUTPUT ${output}
-        COMMAND ${UglifyJS_EXECUTABLE} -c -o \"${output}\" \"${input}\" MAIN_DEPENDENCY ${input} )
+        COMMAND ${UglifyJS_EXECUTABLE} -c -o \"${output}\" \"${input}\"
+        ${_precompress_command} MAIN_DEPENDENCY ${input} )
   else( UglifyJS_EXECUTABLE )
     message( "Will COPY ${input} to ${output}")
-    add_custom_command( OUTPUT ${output} COMMAND ${CMAKE_COMMAND} -E copy ${input} ${output} MAIN_DEPENDENCY ${input} )
+    add_custom_command( OUTPUT ${output} COMMAND ${CMAKE_COMMAND} -E copy ${input} ${output}
+        ${_precompress_command} MAIN_DEPENDENCY ${input} )
   endif( UglifyJS_EXECUTABLE )
 endmacro( deploy_js_resource )
 
 macro( deploy_css_resource input output )
    message( "Will deploy CSS ${input} to ${output}")
+  precompress_command( ${output} )
   if( UglifyCSS_EXECUTABLE )
     message( "Will uglify ${input} to ${output} using ${UglifyCSS_EXECUTABLE}")
     add_custom_command(
         OUTPUT ${output}
-        COMMAND ${UglifyCSS_EXECUTABLE} --output \"${output}\" \"${input}\" MAIN_DEPENDENCY ${input} )
+        COMMAND ${UglifyCSS_EXECUTABLE} --output \"${output}\" \"${input}\"
+        ${_precompress_command} MAIN_DEPENDENCY ${input} )
   else( UglifyCSS_EXECUTABLE )
     message( "Will COPY ${input} to ${output}")
-    add_custom_command( OUTPUT ${output} COMMAND ${CMAKE_COMMAND} -E copy ${input} ${output} MAIN_DEPENDENCY ${input} )
+    add_custom_command( OUTPUT ${output} COMMAND ${CMAKE_COMMAND} -E copy ${input} ${output}
+        ${_precompress_command} MAIN_DEPENDENCY ${input} )
   endif( UglifyCSS_EXECUTABLE )
 endmacro( deploy_css_resource )
\ No newline at end of file
@@ -0,0 +1,33 @@
+# Script-mode helper, run at install time when PRECOMPRESS_WEB_RESOURCES is on:
+#   cmake -DGZIP_EXECUTABLE=/usr/bin/gzip -DRESOURCE_DIR=<dir> -P PrecompressWebResources.cmake
+#
+# Writes a "<file>.gz" next to every JS, CSS, SVG, and JSON file under RESOURCE_DIR
+#  (that is large enough to benefit), so the web server can send the compressed
+#  copy, instead of compressing the file for each request.
+
+if( NOT GZIP_EXECUTABLE OR NOT RESOURCE_DIR )
+  message( FATAL_ERROR "GZIP_EXECUTABLE and RESOURCE_DIR must be specified" )
+endif()
+
+file( GLOB_RECURSE _resource_files
+      "${RESOURCE_DIR}/*.js"
+      "${RESOURCE_DIR}/*.css"
+      "${RESOURCE_DIR}/*.svg"
+      "${RESOURCE_DIR}/*.json"
+)
+
+foreach( _file ${_resource_files} )
+  # file(SIZE ...) needs CMake 3.14, so instead read (at most) the first 1025 bytes as hex, to tell
+  #  if the file is over a kilobyte; two hex characters per byte.
+  file( READ "${_file}" _file_head LIMIT 1025 HEX )
+  string( LENGTH "${_file_head}" _file_head_length )
+  math( EXPR _file_size "${_file_head_length} / 2" )
+  
+  # Below about a kilobyte, the gzip header and HTTP overhead eat most of the gain
+  if( _file_size GREATER 1024 )
+    execute_process( COMMAND ${GZIP_EXECUTABLE} -9 -n -k -f "${_file}" RESULT_VARIABLE _gzip_result )
+    if( NOT _gzip_result EQUAL 0 )
+      message( WARNING "Failed to precompress ${_file}" )
+    endif()
+  endif( _file_size GREATER 1024 )
+endforeach()
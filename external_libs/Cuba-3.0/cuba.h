@@ -18,6 +18,12 @@ extern "C" {
 typedef int (*integrand_t)(const int *ndim, const double x[],
   const int *ncomp, double f[], void *userdata);
 
+	/* Integrand that is handed up to *nvec points at once; x holds
+	   *nvec consecutive points of ndim coordinates, and f receives
+	   *nvec consecutive sets of ncomp values.  Only used by CuhreVec. */
+typedef int (*integrand_vec_t)(const int *ndim, const double x[],
+  const int *ncomp, double f[], void *userdata, const int *nvec);
+
 typedef void (*peakfinder_t)(const int *ndim, const double b[],
   int *n, double x[]);
 
@@ -91,6 +97,16 @@ void Cuhre(const int ndim, const int ncomp,
   const int flags, const int mineval, const int maxeval,
   const int key,
   int *nregions, int *neval, int *fail,
+  double integral[], double error[], double prob[]);
+
+	/* Same as Cuhre, but the integrand is called with batches of up to
+	   nvec points (all the points of a cubature rule, for typical nvec). */
+void CuhreVec(const int ndim, const int ncomp,
+  integrand_vec_t integrand, void *userdata, const int nvec,
+  const double epsrel, const double epsabs,
+  const int flags, const int mineval, const int maxeval,
+  const int key,
+  int *nregions, int *neval, int *fail,
   double integral[], double error[], double prob[]);
 
 void llCuhre(const int ndim, const int ncomp,
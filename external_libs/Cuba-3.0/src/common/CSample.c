@@ -12,6 +12,20 @@ static inline
 number SampleRaw(cThis *t, number n, creal *x, real *f
   VES_ONLY(, creal *w, ccount iter))
 {
+#ifdef CUHRE
+  if( t->integrandvec ) {
+    while( n > 0 ) {
+      ccount nv = IMin(n, t->nvec);
+      if( t->integrandvec(&t->ndim, x, &t->ncomp, f, t->userdata, &nv)
+            == ABORT ) return -1;
+      x += nv*t->ndim;
+      f += nv*t->ncomp;
+      n -= nv;
+    }
+    return 0;
+  }
+#endif
+
   for( ; n; --n ) {
     if( t->integrand(&t->ndim, x, &t->ncomp, f, t->userdata
           VES_ONLY(, w++, &iter)
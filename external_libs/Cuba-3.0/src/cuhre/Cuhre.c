@@ -26,6 +26,39 @@ Extern void EXPORT(Cuhre)(ccount ndim, ccount ncomp,
   t.ndim = ndim;
   t.ncomp = ncomp;
   t.integrand = integrand;
+  t.integrandvec = NULL;
+  t.nvec = 1;
+  t.userdata = userdata;
+  t.epsrel = epsrel;
+  t.epsabs = epsabs;
+  t.flags = flags;
+  t.mineval = mineval;
+  t.maxeval = maxeval;
+  t.key = key;
+  t.nregions = 0;
+  t.neval = 0;
+ 
+  *pfail = Integrate(&t, integral, error, prob);
+  *pnregions = t.nregions;
+  *pneval = t.neval;
+}
+
+/*********************************************************************/
+
+Extern void EXPORT(CuhreVec)(ccount ndim, ccount ncomp,
+  IntegrandVec integrand, void *userdata, ccount nvec,
+  creal epsrel, creal epsabs,
+  cint flags, cnumber mineval, cnumber maxeval,
+  ccount key,
+  count *pnregions, number *pneval, int *pfail,
+  real *integral, real *error, real *prob)
+{
+  This t;
+  t.ndim = ndim;
+  t.ncomp = ncomp;
+  t.integrand = NULL;
+  t.integrandvec = integrand;
+  t.nvec = IMax(nvec, 1);
   t.userdata = userdata;
   t.epsrel = epsrel;
   t.epsabs = epsabs;
@@ -55,6 +88,8 @@ Extern void EXPORT(cuhre)(ccount *pndim, ccount *pncomp,
   t.ndim = *pndim;
   t.ncomp = *pncomp;
   t.integrand = integrand;
+  t.integrandvec = NULL;
+  t.nvec = 1;
   t.userdata = userdata;
   t.epsrel = *pepsrel;
   t.epsabs = *pepsabs;
@@ -38,11 +38,14 @@ typedef struct {
 typedef const Rule cRule;
 
 typedef int (*Integrand)(ccount *, creal *, ccount *, real *, void *);
+typedef int (*IntegrandVec)(ccount *, creal *, ccount *, real *, void *, ccount *);
 
 typedef struct _this {
   count ndim, ncomp;
 #ifndef MLVERSION
   Integrand integrand;
+  IntegrandVec integrandvec;
+  count nvec;
   void *userdata;
 #ifdef HAVE_FORK
   int ncores, *child;
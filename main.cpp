@@ -68,7 +68,7 @@ int main( int argc, char **argv )
   std::string docroot, wt_config, user_data_dir;
   
 #if( BUILD_FOR_WEB_DEPLOYMENT )
-  std::string http_address = "127.0.0.1";
+  std::string http_address = "127.0.0.1", session_id_prefix;
   static_assert( !BUILD_AS_LOCAL_SERVER, "Web and local server should not both be enabled");
 #endif
   
@@ -86,6 +86,10 @@ int main( int argc, char **argv )
   ( "http-address", po::value<std::string>(&http_address),
    "The network HTTP address to bind the web-server too; '127.0.0.1' is localhost, while '0.0.0.0' will serve the web-app to the external network."
    )
+  ( "session-id-prefix", po::value<std::string>(&session_id_prefix),
+   "Prefix for all session IDs of this process; when running multiple InterSpec processes behind a"
+   " reverse proxy, give each process a unique prefix, and route requests by it."
+   )
 #endif
   ("userdatadir", po::value<std::string>(&user_data_dir),
    "The directory to store user data to, or to look in for custom user data (serial_to_model.csv, etc)."
@@ -287,6 +291,11 @@ int main( int argc, char **argv )
 #endif
   
   
+#if( BUILD_FOR_WEB_DEPLOYMENT )
+  if( !session_id_prefix.empty() )
+    InterSpecServer::set_session_id_prefix( session_id_prefix );
+#endif
+  
   // Start the InterSpec server
   const int rval = InterSpecServer::start_server( argv[0], user_data_dir.c_str(),
                                                  docroot.c_str(),
@@ -23,8 +23,10 @@
 
 #include "InterSpec_config.h"
 
+#include <cmath>
 #include <string>
 #include <limits>
+#include <vector>
 
 #include <Wt/WText>
 #include <Wt/WLabel>
@@ -37,6 +39,7 @@
 #include <Wt/WPushButton>
 
 #include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
 #include "SpecUtils/Filesystem.h"
 
 #include "InterSpec/PeakDef.h"
@@ -84,7 +87,9 @@ m_fitBtn( nullptr ),
 m_fitEnergy( nullptr ),
 m_fitFWHM( nullptr ),
 m_fitAmplitude( nullptr ),
-m_chart( nullptr )
+m_chart( nullptr ),
+m_chi2Txt( nullptr ),
+m_chi2Cache{}
 {
   m_viewer->useMessageResourceBundle( "AddNewPeakDialog" );
   
@@ -223,6 +228,9 @@ m_chart( nullptr )
   m_chart = new WText( "", Wt::XHTMLUnsafeText );
   m_chart->setInline( false );
   table->elementAt(0,2)->addWidget( m_chart );
+  m_chi2Txt = new WText( "", table->elementAt(0,2) );
+  m_chi2Txt->setInline( false );
+  m_chi2Txt->decorationStyle().setFont( fitCbFont );
   table->elementAt(0,2)->setRowSpan( 7 );
   if( m_isPhone )
   {
@@ -342,9 +350,91 @@ void AddNewPeakDialog::updateCandidatePeakPreview()
   {
     m_chart->setText( WString::tr("anpd-err-preview") );
   }
+  
+  const double chi2dof = updatePreviewChi2( meas );
+  if( chi2dof >= 0.0 )
+  {
+    m_candidatePeak->set_coefficient( chi2dof, PeakDef::Chi2DOF );
+    m_chi2Txt->setText( WString::tr("anpd-chi2-dof").arg( SpecUtils::printCompact(chi2dof, 4) ) );
+  }else
+  {
+    m_chi2Txt->setText( "" );
+  }
 }//void updateCandidatePeakPreview()
 
 
+double AddNewPeakDialog::updatePreviewChi2( const std::shared_ptr<const SpecUtils::Measurement> &meas )
+{
+  PreviewChi2Cache &cache = m_chi2Cache;
+  
+  if( !meas || !meas->channel_energies() || (meas->num_gamma_channels() < 7) )
+  {
+    cache = PreviewChi2Cache{};
+    return -1.0;
+  }
+  
+  const shared_ptr<const PeakContinuum> continuum = m_candidatePeak->continuum();
+  
+  if( cache.m_data_source != meas )
+    cache.m_continuum_valid = false;
+  
+  const vector<float> &energies = *meas->channel_energies();
+  
+  if( !cache.m_continuum_valid )
+  {
+    const size_t first_channel = meas->find_gamma_channel( m_candidatePeak->lowerX() );
+    const size_t last_channel = std::min( meas->find_gamma_channel( m_candidatePeak->upperX() ),
+                                          meas->num_gamma_channels() - 1 );
+    const size_t nchannel = (last_channel >= first_channel) ? (1 + last_channel - first_channel) : size_t(0);
+    
+    cache.m_data_source = meas;
+    cache.m_first_channel = first_channel;
+    cache.m_data.resize( nchannel );
+    cache.m_continuum.resize( nchannel );
+    
+    for( size_t i = 0; i < nchannel; ++i )
+    {
+      const size_t channel = first_channel + i;
+      cache.m_data[i] = meas->gamma_channel_content( channel );
+      cache.m_continuum[i] = continuum->offset_integral( energies[channel], energies[channel+1], meas );
+    }
+    
+    cache.m_continuum_valid = true;
+    cache.m_shape_mean = cache.m_shape_sigma = -1.0;
+  }//if( !cache.m_continuum_valid )
+  
+  const size_t nchannel = cache.m_data.size();
+  if( nchannel < 1 )
+    return -1.0;
+  
+  if( (cache.m_shape_mean != m_candidatePeak->mean())
+     || (cache.m_shape_sigma != m_candidatePeak->sigma()) )
+  {
+    PeakDef unit_peak = *m_candidatePeak;
+    unit_peak.setAmplitude( 1.0 );
+    
+    cache.m_unit_peak.assign( nchannel, 0.0 );
+    unit_peak.gauss_integral( &(energies[cache.m_first_channel]), &(cache.m_unit_peak[0]), nchannel );
+    
+    cache.m_shape_mean = m_candidatePeak->mean();
+    cache.m_shape_sigma = m_candidatePeak->sigma();
+  }//if( peak shape changed )
+  
+  const double amplitude = m_candidatePeak->amplitude();
+  
+  double chi2 = 0.0;
+  for( size_t i = 0; i < nchannel; ++i )
+  {
+    const double ndata = cache.m_data[i];
+    const double uncert = (ndata > 0.0) ? sqrt(ndata) : 1.0;
+    const double chi = (ndata - cache.m_continuum[i] - amplitude*cache.m_unit_peak[i]) / uncert;
+    chi2 += chi*chi;
+  }
+  
+  return chi2 / nchannel;
+}//double updatePreviewChi2(...)
+
+
 void AddNewPeakDialog::roiTypeChanged()
 {
   auto meas = m_viewer->displayedHistogram(SpecUtils::SpectrumType::Foreground);
@@ -391,6 +481,8 @@ void AddNewPeakDialog::roiTypeChanged()
     }
   }//switch( m_continuumType->currentIndex() )
   
+  m_chi2Cache.m_continuum_valid = false;
+  
   m_renderFlags |= RenderActions::UpdatePreview;
   scheduleRender();
 }//void roiTypeChanged()
@@ -504,6 +596,7 @@ void AddNewPeakDialog::doFit()
   }else
   {
     *m_candidatePeak = results[0];
+    m_chi2Cache.m_continuum_valid = false;
     m_energySB->setValue( m_candidatePeak->mean() );
     m_fwhmSB->setValue( m_candidatePeak->fwhm() );
     m_areaSB->setValue( m_candidatePeak->amplitude() );
@@ -23,8 +23,10 @@
  
 #include "InterSpec_config.h"
 
+#include <map>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 
 // Some includes to get terminal width (and UTF-8 cl arguments on Windows)
@@ -123,36 +125,60 @@ namespace AppUtils
   
   std::map<std::string,std::string> query_str_key_values( const std::string &query_str )
   {
+    // Share links are parsed in bulk when ingesting many of them at once, so we'll walk the query
+    //  string in place, and only allocate the final key and value strings.
+    const auto is_space = []( const char c ) -> bool {
+      return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\v') || (c == '\f') || (c == '\r');
+    };
+    
     map<string,string> parts;
-    vector<string> components;
-    SpecUtils::split( components, query_str, "&" );
     
-    for( string comp : components )
+    const char * const query_end = query_str.data() + query_str.size();
+    const char *comp_begin = query_str.data();
+    
+    while( comp_begin < query_end )
     {
-      SpecUtils::trim( comp );
-      if( comp.empty() )
+      const char *comp_end = std::find( comp_begin, query_end, '&' );
+      const char * const next_comp = (comp_end == query_end) ? query_end : (comp_end + 1);
+      
+      // Trim the component
+      while( (comp_begin < comp_end) && is_space(*comp_begin) )
+        ++comp_begin;
+      while( (comp_end > comp_begin) && is_space(*(comp_end - 1)) )
+        --comp_end;
+      
+      if( comp_begin == comp_end )
+      {
+        comp_begin = next_comp;
         continue;
+      }
       
-      auto pos = comp.find('=');
-      if( pos == string::npos )
-        pos = comp.find(':');
+      const char *sep = std::find( comp_begin, comp_end, '=' );
+      if( sep == comp_end )
+        sep = std::find( comp_begin, comp_end, ':' );
       
-      if( pos == string::npos )
+      if( sep == comp_end )
+      {
+        comp_begin = next_comp;
         continue;
+      }
       
-      string key = comp.substr(0,pos);
-      string value = comp.substr(pos+1);
-      SpecUtils::trim(key);
-      SpecUtils::to_upper_ascii(key);
+      const char *key_end = sep;
+      while( (key_end > comp_begin) && is_space(*(key_end - 1)) )
+        --key_end;
       
-      if( key.empty() )
-        throw runtime_error( "fromAppUrl: query portion '" + comp + "' has empty name" );
+      if( key_end == comp_begin )
+        throw runtime_error( "fromAppUrl: query portion '" + string(comp_begin, comp_end) + "' has empty name" );
       
-      if( parts.count(key) )
-        throw runtime_error( "fromAppUrl: query portion contains duplicate key '" + key + "'" );
+      string key( comp_begin, key_end );
+      SpecUtils::to_upper_ascii( key );
       
-      parts[key] = value;
-    }//for( string comp : components )
+      const auto insert_result = parts.emplace( std::move(key), string(sep + 1, comp_end) );
+      if( !insert_result.second )
+        throw runtime_error( "fromAppUrl: query portion contains duplicate key '" + insert_result.first->first + "'" );
+      
+      comp_begin = next_comp;
+    }//while( comp_begin < query_end )
     
     return parts;
   }//std::map<std::string,std::string> split_query_str( const std::string &query )
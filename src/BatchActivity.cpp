@@ -23,6 +23,11 @@
 #include "InterSpec_config.h"
 
 #include <set>
+#include <list>
+#include <mutex>
+#include <limits>
+#include <functional>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <fstream>
@@ -60,6 +65,181 @@
 
 using namespace std;
 
+namespace
+{
+  /** Parses the shielding material database from the static data directory; throws exception on error.
+   
+   The database is only parsed once, and then shared by all callers, so that exemplar bundles (which
+   reference its materials) can be re-used between calls.
+   */
+  shared_ptr<const MaterialDB> load_material_db( const SandiaDecay::SandiaDecayDataBase * const db )
+  {
+    static std::mutex s_matdb_mutex;
+    static shared_ptr<const MaterialDB> s_matdb;
+    
+    std::lock_guard<std::mutex> lock( s_matdb_mutex );
+    if( s_matdb )
+      return s_matdb;
+    
+    auto matdb = make_shared<MaterialDB>();
+    const string materialfile = SpecUtils::append_path( InterSpec::staticDataDirectory(), "MaterialDataBase.txt" );
+    matdb->parseGadrasMaterialFile( materialfile, db, false );
+    s_matdb = matdb;
+    
+    return matdb;
+  }//load_material_db(...)
+  
+  
+  /** The maximum number of exemplar files, and model bundles, to keep cached. */
+  const size_t ns_max_cached_exemplars = 8;
+  
+  struct CachedBundle
+  {
+    std::weak_ptr<const SpecMeas> m_exemplar;
+    std::weak_ptr<const MaterialDB> m_matdb;
+    std::shared_ptr<const BatchActivity::ExemplarBundle> m_bundle;
+  };//struct CachedBundle
+  
+  std::mutex ns_bundle_cache_mutex;
+  std::list<CachedBundle> ns_bundle_cache;  //most recently used at front
+  
+  struct CachedExemplarFile
+  {
+    std::string m_filename;
+    size_t m_content_hash;
+    std::shared_ptr<const SpecMeas> m_exemplar;
+  };//struct CachedExemplarFile
+  
+  std::mutex ns_exemplar_file_cache_mutex;
+  std::list<CachedExemplarFile> ns_exemplar_file_cache;  //most recently used at front
+  
+  
+  /** Parses the Shielding/Source model, and DRF, of the exemplar; see #BatchActivity::exemplar_bundle. */
+  shared_ptr<BatchActivity::ExemplarBundle> parse_exemplar_bundle( const shared_ptr<const SpecMeas> &exemplar,
+                                                                   const MaterialDB *matdb )
+  {
+    using BatchActivity::BatchActivityFitResult;
+    
+    auto bundle = make_shared<BatchActivity::ExemplarBundle>();
+    bundle->m_exemplar = exemplar;
+    bundle->m_result_code = BatchActivityFitResult::ResultCode::UnknownStatus;
+    bundle->m_drf = exemplar->detector();
+    bundle->m_distance = std::numeric_limits<double>::quiet_NaN();
+    bundle->m_geometry = GammaInteractionCalc::GeometryType::NumGeometryType;
+    
+    const string exemplar_filename = exemplar->filename();
+    
+    const rapidxml::xml_document<char> *model_xml = exemplar->shieldingSourceModel();
+    const rapidxml::xml_node<char> *base_node = model_xml ? model_xml->first_node() : nullptr;
+    if( !base_node )
+    {
+      bundle->m_error_msg = "Exemplar file did not have a Shielding/Source fit model in it";
+      bundle->m_result_code = BatchActivityFitResult::ResultCode::NoInputSrcShieldModel;
+      return bundle;
+    }
+    
+    try
+    {
+      const rapidxml::xml_node<char> *dist_node = base_node->first_node( "Distance" );
+      const string diststr = SpecUtils::xml_value_str( dist_node );
+      bundle->m_distance = PhysicalUnits::stringToDistance( diststr );
+    }catch( std::exception & )
+    {
+      // Distance is only needed for non-fixed-geometry DRFs, so we'll leave it as NaN, and let
+      //  the caller decide.
+    }//try / catch to get distance
+    
+    const rapidxml::xml_node<char> *geom_node = base_node->first_node( "Geometry" );
+    const string geomstr = SpecUtils::xml_value_str( geom_node );
+    
+    for( GammaInteractionCalc::GeometryType type = GammaInteractionCalc::GeometryType(0);
+        type != GammaInteractionCalc::GeometryType::NumGeometryType;
+        type = GammaInteractionCalc::GeometryType(static_cast<int>(type) + 1) )
+    {
+      if( SpecUtils::iequals_ascii(geomstr, GammaInteractionCalc::to_str(type)) )
+      {
+        bundle->m_geometry = type;
+        break;
+      }
+    }//for( loop over geometry types )
+    
+    if( bundle->m_geometry == GammaInteractionCalc::GeometryType::NumGeometryType )
+    {
+      bundle->m_error_msg = "Geometry type not specified.";
+      bundle->m_result_code = BatchActivityFitResult::ResultCode::InvalidGeometry;
+      return bundle;
+    }//if( geometry == GammaInteractionCalc::GeometryType::NumGeometryType )
+    
+    try
+    {
+      bundle->m_fit_options.deSerialize( base_node );
+    }catch( std::exception &e )
+    {
+      bundle->m_error_msg = "Exemplar file '" + exemplar_filename + "' Options invalid: " + string(e.what());
+      bundle->m_result_code = BatchActivityFitResult::ResultCode::InvalidFitOptions;
+      return bundle;
+    }
+    
+    const rapidxml::xml_node<char> *shieldings_node = base_node->first_node( "Shieldings" );
+    if( !shieldings_node )
+    {
+      bundle->m_error_msg = "No Shieldings node specified in Shield/Src fit model.";
+      bundle->m_result_code = BatchActivityFitResult::ResultCode::NoShieldingsNode;
+      return bundle;
+    }
+    
+    XML_FOREACH_CHILD(shield_node, shieldings_node, "Shielding")
+    {
+      try
+      {
+        ShieldingSourceFitCalc::ShieldingInfo info;
+        info.deSerialize( shield_node, matdb );
+        bundle->m_shieldings.push_back( std::move(info) );
+      }catch( std::exception &e )
+      {
+        bundle->m_error_msg = "Invalid Shielding node: " + string(e.what());
+        bundle->m_result_code = BatchActivityFitResult::ResultCode::ErrorParsingShielding;
+        return bundle;
+      }
+    }//XML_FOREACH_CHILD(shield_node, shieldings_node, "Shielding")
+    
+    const rapidxml::xml_node<char> *srcs_node = base_node->first_node( "Nuclides" );
+    if( !srcs_node )
+    {
+      bundle->m_error_msg = "Exemplar file '" + exemplar_filename + "' missing Nuclides (sources) node.";
+      bundle->m_result_code = BatchActivityFitResult::ResultCode::MissingNuclidesNode;
+      return bundle;
+    }//if( !srcs_node )
+    
+    XML_FOREACH_CHILD( src_node, srcs_node, "Nuclide" )
+    {
+      try
+      {
+        ShieldingSourceFitCalc::SourceFitDef info;
+        info.deSerialize( src_node );
+        bundle->m_sources.push_back( std::move(info) );
+      }catch( std::exception &e )
+      {
+        bundle->m_error_msg = "Exemplar file '" + exemplar_filename + "' has invalid Nuclides node: " + string(e.what());
+        bundle->m_result_code = BatchActivityFitResult::ResultCode::InvalidNuclideNode;
+        return bundle;
+      }// try / catch
+    }//XML_FOREACH_CHILD( src_node, srcs_node, "Nuclide" )
+    
+    if( bundle->m_sources.empty() )
+    {
+      bundle->m_error_msg = "Exemplar file '" + exemplar_filename + "' no sources defined.";
+      bundle->m_result_code = BatchActivityFitResult::ResultCode::NoSourceNuclides;
+      return bundle;
+    }//if( src_definitions.empty() )
+    
+    bundle->m_result_code = BatchActivityFitResult::ResultCode::Success;
+    
+    return bundle;
+  }//parse_exemplar_bundle(...)
+}//namespace
+
+
 namespace BatchActivity
 {
 
@@ -220,6 +400,105 @@ shared_ptr<DetectorPeakResponse> init_drf_from_name( std::string drf_file, std::
   
   return nullptr;
 }//shared_ptr<DetectorPeakResponse> init_drf_from_name( std::string drf_file, std::string drf-name )
+
+
+shared_ptr<const ExemplarBundle> exemplar_bundle( shared_ptr<const SpecMeas> exemplar,
+                                                  shared_ptr<const MaterialDB> matdb )
+{
+  if( !exemplar || !matdb )
+    throw runtime_error( "exemplar_bundle: invalid input." );
+  
+  {
+    std::lock_guard<std::mutex> lock( ns_bundle_cache_mutex );
+    for( auto iter = begin(ns_bundle_cache); iter != end(ns_bundle_cache); ++iter )
+    {
+      if( (iter->m_exemplar.lock() == exemplar) && (iter->m_matdb.lock() == matdb) )
+      {
+        ns_bundle_cache.splice( begin(ns_bundle_cache), ns_bundle_cache, iter );
+        return iter->m_bundle;
+      }
+    }//for( loop over cached bundles )
+  }
+  
+  const shared_ptr<const ExemplarBundle> bundle = parse_exemplar_bundle( exemplar, matdb.get() );
+  
+  std::lock_guard<std::mutex> lock( ns_bundle_cache_mutex );
+  
+  // Remove entries whose exemplar, or material database, no longer exists.
+  ns_bundle_cache.remove_if( []( const CachedBundle &entry ){
+    return entry.m_exemplar.expired() || entry.m_matdb.expired();
+  } );
+  
+  CachedBundle entry;
+  entry.m_exemplar = exemplar;
+  entry.m_matdb = matdb;
+  entry.m_bundle = bundle;
+  ns_bundle_cache.push_front( entry );
+  
+  while( ns_bundle_cache.size() > ns_max_cached_exemplars )
+    ns_bundle_cache.pop_back();
+  
+  return bundle;
+}//exemplar_bundle(...)
+
+
+shared_ptr<const SpecMeas> load_exemplar_file( const std::string &filename )
+{
+  // Hashing the file contents is far quicker than parsing the file, and unlike the modification
+  //  time, isnt fooled by a file being replaced by a copy.
+  std::vector<char> data;
+  try
+  {
+    SpecUtils::load_file_data( filename.c_str(), data );
+  }catch( std::exception & )
+  {
+    return nullptr;
+  }
+  
+  const size_t content_hash = std::hash<string>()( string( begin(data), end(data) ) );
+  
+  {
+    std::lock_guard<std::mutex> lock( ns_exemplar_file_cache_mutex );
+    for( auto iter = begin(ns_exemplar_file_cache); iter != end(ns_exemplar_file_cache); ++iter )
+    {
+      if( (iter->m_filename == filename) && (iter->m_content_hash == content_hash) )
+      {
+        ns_exemplar_file_cache.splice( begin(ns_exemplar_file_cache), ns_exemplar_file_cache, iter );
+        return iter->m_exemplar;
+      }
+    }//for( loop over cached files )
+  }
+  
+  auto exemplar = make_shared<SpecMeas>();
+  if( !exemplar->load_file( filename, SpecUtils::ParserType::Auto ) )
+    return nullptr;
+  
+  std::lock_guard<std::mutex> lock( ns_exemplar_file_cache_mutex );
+  ns_exemplar_file_cache.remove_if( [&filename]( const CachedExemplarFile &entry ){
+    return (entry.m_filename == filename);
+  } );
+  
+  CachedExemplarFile entry;
+  entry.m_filename = filename;
+  entry.m_content_hash = content_hash;
+  entry.m_exemplar = exemplar;
+  ns_exemplar_file_cache.push_front( entry );
+  
+  while( ns_exemplar_file_cache.size() > ns_max_cached_exemplars )
+    ns_exemplar_file_cache.pop_back();
+  
+  return exemplar;
+}//shared_ptr<const SpecMeas> load_exemplar_file( const std::string &filename )
+  
+  
+std::shared_ptr<const MaterialDB> material_db()
+{
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  if( !db )
+    throw runtime_error( "Could not initialize nuclide DecayDataBase." );
+  
+  return load_material_db( db );
+}//std::shared_ptr<const MaterialDB> material_db()
   
   
 void fit_activities_in_files( const std::string &exemplar_filename,
@@ -250,15 +529,20 @@ void fit_activities_in_files( const std::string &exemplar_filename,
   
   
   
-  std::shared_ptr<const SpecMeas> cached_exemplar_n42;
-  for( const string filename : files )
+  // The material database is only read from while fitting, so we will parse it once, and share
+  //  it between all the fits.
+  shared_ptr<const MaterialDB> matdb;
+  try
   {
-    const BatchActivityFitResult fit_results
-                 = fit_activities_in_file( exemplar_filename, exemplar_sample_nums,
-                                     cached_exemplar_n42, filename, options );
-    
-    if( !cached_exemplar_n42 )
-      cached_exemplar_n42 = fit_results.m_exemplar_file;
+    matdb = load_material_db( db );
+  }catch( std::exception &e )
+  {
+    throw runtime_error( "Could not initialize shielding material database: " + string(e.what()) );
+  }
+  
+  // Writes out the results for a file; always called from this thread, and in the order of
+  //  the input files, regardless of how many files are being fit concurrently.
+  auto write_results = [&warnings, &options]( const string &filename, const BatchActivityFitResult &fit_results ){
     warnings.insert(end(warnings), begin(fit_results.m_warnings), end(fit_results.m_warnings) );
     
     
@@ -477,7 +761,37 @@ void fit_activities_in_files( const std::string &exemplar_filename,
       cout << endl;
     }
      */
-  }//for( const string filename : files )
+  };//write_results lambda
+  
+  // Fit the first file by itself, so the exemplar file is parsed only once, and then shared
+  //  (read-only) with all the other fits.
+  std::shared_ptr<const SpecMeas> cached_exemplar_n42;
+  {
+    const BatchActivityFitResult fit_results
+                 = fit_activities_in_file( exemplar_filename, exemplar_sample_nums,
+                                     cached_exemplar_n42, files.front(), options, matdb );
+    cached_exemplar_n42 = fit_results.m_exemplar_file;
+    write_results( files.front(), fit_results );
+  }
+  
+  // Each file gets fit on a worker thread, with fit results only kept around until they are
+  //  written out, so memory use is bounded by the number of files in flight, not the number of
+  //  input files.
+  const size_t num_remaining = files.size() - 1;
+  const size_t num_threads = BatchPeak::resolve_num_threads( options.num_threads );
+  const size_t max_in_flight = 2*num_threads;
+  vector<unique_ptr<BatchActivityFitResult>> results( num_remaining );
+  
+  BatchPeak::run_in_order( num_remaining, num_threads, max_in_flight,
+    [&]( const size_t index ){
+      results[index].reset( new BatchActivityFitResult( fit_activities_in_file( exemplar_filename,
+                          exemplar_sample_nums, cached_exemplar_n42, files[index + 1], options, matdb ) ) );
+    },
+    [&]( const size_t index ){
+      assert( results[index] );
+      write_results( files[index + 1], *results[index] );
+      results[index].reset();
+    } );
     
   if( !warnings.empty() )
     cerr << endl << endl;
@@ -491,7 +805,8 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
                           std::set<int> exemplar_sample_nums,
                           std::shared_ptr<const SpecMeas> cached_exemplar_n42,
                           const std::string &filename,
-                          const BatchActivityFitOptions &options )
+                          const BatchActivityFitOptions &options,
+                          std::shared_ptr<const MaterialDB> cached_materialdb )
 {
   //  TODO: allow specifying, not just in the exemplar N42.  Also note InterSpec defines a URL encoding for model as well
   BatchActivityFitResult result;
@@ -504,15 +819,13 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
   
   if( !cached_exemplar_n42 )
   {
-    auto tmp = make_shared<SpecMeas>();
-    if( !tmp->load_file( exemplar_filename, SpecUtils::ParserType::Auto ) )
+    cached_exemplar_n42 = load_exemplar_file( exemplar_filename );
+    if( !cached_exemplar_n42 )
     {
       result.m_error_msg = "Could not load exemplar '" + exemplar_filename + "'.";
       result.m_result_code = BatchActivityFitResult::ResultCode::CouldntOpenExemplar;
       return result;
-    }//if( !meas->load_file( filename, ParserType::Auto ) )
-    
-    cached_exemplar_n42 = tmp;
+    }//if( !cached_exemplar_n42 )
   }//if( !cached_exemplar_n42 )
   
   result.m_exemplar_file = cached_exemplar_n42;
@@ -525,11 +838,11 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
     return result;
   }
   
-  MaterialDB matdb;
-  const string materialfile = SpecUtils::append_path( InterSpec::staticDataDirectory(), "MaterialDataBase.txt" );
+  shared_ptr<const MaterialDB> matdb = cached_materialdb;
   try
   {
-    matdb.parseGadrasMaterialFile( materialfile, db, false );
+    if( !matdb )
+      matdb = load_material_db( db );
   }catch( std::exception &e )
   {
     result.m_error_msg = "Could not initialize shielding material database.";
@@ -537,7 +850,7 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
     return result;
   }
   
-  const Material * const iron = matdb.material("Fe (iron)");
+  const Material * const iron = matdb->material("Fe (iron)");
   if( !iron )
   {
     result.m_error_msg = "Couldnt access materials from shielding database.";
@@ -805,12 +1118,13 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
   }//if( backfile )
   
   
-  const rapidxml::xml_document<char> *model_xml = cached_exemplar_n42->shieldingSourceModel();
-  const rapidxml::xml_node<char> *base_node = model_xml ? model_xml->first_node() : nullptr;
-  if( !base_node )
+  // The exemplar's model is the same for every file, so is only parsed the first time its used.
+  const shared_ptr<const ExemplarBundle> bundle = exemplar_bundle( cached_exemplar_n42, matdb );
+  assert( bundle );
+  if( bundle->m_result_code == BatchActivityFitResult::ResultCode::NoInputSrcShieldModel )
   {
-    result.m_error_msg = "Exemplar file did not have a Shielding/Source fit model in it";
-    result.m_result_code = BatchActivityFitResult::ResultCode::NoInputSrcShieldModel;
+    result.m_error_msg = bundle->m_error_msg;
+    result.m_result_code = bundle->m_result_code;
     return result;
   }
   
@@ -825,7 +1139,7 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
   
   shared_ptr<const DetectorPeakResponse> detector = options.drf_override;
   if( !detector )
-    detector = cached_exemplar_n42->detector();
+    detector = bundle->m_drf;
   
   if( !detector )
   {
@@ -838,56 +1152,27 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
   double distance = 1*PhysicalUnits::meter;
   if( !detector->isFixedGeometry() )
   {
-    try
-    {
-      const rapidxml::xml_node<char> *dist_node = base_node->first_node( "Distance" );
-      const string diststr = SpecUtils::xml_value_str( dist_node );
-      distance = PhysicalUnits::stringToDistance( diststr );
-    }catch( std::exception &e )
+    distance = bundle->m_distance;
+    if( IsNan(distance) )
     {
       result.m_error_msg = "Failed to get distance.";
       result.m_result_code = BatchActivityFitResult::ResultCode::InvalidDistance;
       return result;
-    }//try / catch to get distance
-  }//if( !detector->isFixedGeometry() )
-  
-  GammaInteractionCalc::GeometryType geometry = GammaInteractionCalc::GeometryType::NumGeometryType;
-  
-  const rapidxml::xml_node<char> *geom_node = base_node->first_node( "Geometry" );
-  const string geomstr = SpecUtils::xml_value_str( geom_node );
-  
-  for( GammaInteractionCalc::GeometryType type = GammaInteractionCalc::GeometryType(0);
-      type != GammaInteractionCalc::GeometryType::NumGeometryType;
-      type = GammaInteractionCalc::GeometryType(static_cast<int>(type) + 1) )
-  {
-    if( SpecUtils::iequals_ascii(geomstr, GammaInteractionCalc::to_str(type)) )
-    {
-      geometry = type;
-      break;
     }
-  }//for( loop over geometry types )
+  }//if( !detector->isFixedGeometry() )
   
-  if( geometry == GammaInteractionCalc::GeometryType::NumGeometryType )
+  if( bundle->m_result_code != BatchActivityFitResult::ResultCode::Success )
   {
-    result.m_error_msg = "Geometry type not specified.";
-    result.m_result_code = BatchActivityFitResult::ResultCode::InvalidGeometry;
+    result.m_error_msg = bundle->m_error_msg;
+    result.m_result_code = bundle->m_result_code;
     return result;
-  }//if( geometry == GammaInteractionCalc::GeometryType::NumGeometryType )
+  }
   
+  const GammaInteractionCalc::GeometryType geometry = bundle->m_geometry;
+  const vector<ShieldingSourceFitCalc::ShieldingInfo> &shield_definitions = bundle->m_shieldings;
+  const vector<ShieldingSourceFitCalc::SourceFitDef> &src_definitions = bundle->m_sources;
+  ShieldingSourceFitCalc::ShieldingSourceFitOptions fit_options = bundle->m_fit_options;
   
-  vector<ShieldingSourceFitCalc::ShieldingInfo> shield_definitions;
-  vector<ShieldingSourceFitCalc::SourceFitDef> src_definitions;
-  ShieldingSourceFitCalc::ShieldingSourceFitOptions fit_options;
-  try
-  {
-    fit_options.deSerialize( base_node );
-  }catch( std::exception &e )
-  {
-    result.m_error_msg = "Exemplar file '" + exemplar_filename + "' Options invalid: " + string(e.what());
-    result.m_result_code = BatchActivityFitResult::ResultCode::InvalidFitOptions;
-    return result;
-  }
-
   // Check that if options said to use background-subtraction, that we actually can.
   //  I'm a little mixed here - perhaps if no background is specified, we should just ignore this,
   //  or just create a warning???
@@ -910,61 +1195,6 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
     //result.m_result_code = BatchActivityFitResult::ResultCode::ExemplarUsedBackSubButNoBackground;
     //return result;
   }
-                                           
-  const rapidxml::xml_node<char> *shieldings_node = base_node->first_node( "Shieldings" );
-  if( !shieldings_node )
-  {
-    result.m_error_msg = "No Shieldings node specified in Shield/Src fit model.";
-    result.m_result_code = BatchActivityFitResult::ResultCode::NoShieldingsNode;
-    return result;
-  }
-      
-  XML_FOREACH_CHILD(shield_node, shieldings_node, "Shielding")
-  {
-    try
-    {
-      ShieldingSourceFitCalc::ShieldingInfo info;
-      info.deSerialize( shield_node, &matdb );
-      shield_definitions.push_back( std::move(info) );
-    }catch( std::exception &e )
-    {
-      result.m_error_msg = "Invalid Shielding node: " + string(e.what());
-      result.m_result_code = BatchActivityFitResult::ResultCode::ErrorParsingShielding;
-      return result;
-    }
-  }//XML_FOREACH_CHILD(shield_node, shieldings_node, "Shielding")
-      
-      
-  const rapidxml::xml_node<char> *srcs_node = base_node->first_node( "Nuclides" );
-  if( !srcs_node )
-  {
-    result.m_error_msg = "Exemplar file '" + exemplar_filename + "' missing Nuclides (sources) node.";
-    result.m_result_code = BatchActivityFitResult::ResultCode::MissingNuclidesNode;
-    return result;
-  }//if( !srcs_node )
-      
-  XML_FOREACH_CHILD( src_node, srcs_node, "Nuclide" )
-  {
-    try
-    {
-      ShieldingSourceFitCalc::SourceFitDef info;
-      info.deSerialize( src_node );
-      src_definitions.push_back( std::move(info) );
-    }catch( std::exception &e )
-    {
-      result.m_error_msg = "Exemplar file '" + exemplar_filename + "' has invalid Nuclides node: " + string(e.what());
-      result.m_result_code = BatchActivityFitResult::ResultCode::InvalidNuclideNode;
-      return result;
-    }// try / catch
-  }//XML_FOREACH_CHILD( src_node, srcs_node, "Nuclide" )
-      
-  
-  if( src_definitions.empty() )
-  {
-    result.m_error_msg = "Exemplar file '" + exemplar_filename + "' no sources defined.";
-    result.m_result_code = BatchActivityFitResult::ResultCode::NoSourceNuclides;
-    return result;
-  }//if( src_definitions.empty() )
   
   // TODO: We may not have fit peaks for all `src_definitions`.  We should remove these sources, and add warnings about it
 
@@ -981,8 +1211,24 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
   auto fit_results = make_shared<ShieldingSourceFitCalc::ModelFitResults>();
   result.m_fit_results = fit_results;
   
-  auto progress_fcn = [progress](){
-    // We dont really care too much probably right now
+  // The progress function gets called every `sm_model_update_frequency_ms`, so we will use it to
+  //  enforce the per-file time budget (the zombie timer `fit_model` sets up needs a Wt server).
+  //  We capture a weak pointer to the chi2 function, as it holds on to this callback.
+  const double max_fit_seconds = options.max_fit_seconds;
+  const weak_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> weak_chi2_fcn = fcn_pars.first;
+  auto progress_fcn = [progress, max_fit_seconds, weak_chi2_fcn](){
+    if( max_fit_seconds <= 0.0 )
+      return;
+    
+    double elapsed = 0.0;
+    {
+      std::lock_guard<std::mutex> lock( progress->m_mutex );
+      elapsed = progress->elapsedTime;
+    }
+    
+    const shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2_fcn = weak_chi2_fcn.lock();
+    if( chi2_fcn && (elapsed > max_fit_seconds) )
+      chi2_fcn->cancelFitWithTimeout();
   };
       
   bool finished_fit_called = false;
@@ -996,6 +1242,14 @@ BatchActivityFitResult fit_activities_in_file( const std::string &exemplar_filen
   
   result.m_result_code = BatchActivityFitResult::ResultCode::Success;
   
+  if( fit_results->successful == ShieldingSourceFitCalc::ModelFitResults::FitStatus::TimedOut )
+  {
+    result.m_error_msg = "Fit did not finish within " + std::to_string(options.max_fit_seconds)
+                         + " seconds.";
+    result.m_result_code = BatchActivityFitResult::ResultCode::FitNotSuccessful;
+    return result;
+  }
+  
   if( fit_results->successful != ShieldingSourceFitCalc::ModelFitResults::FitStatus::Final )
   {
     result.m_error_msg = "Fit not successful.";
@@ -27,13 +27,19 @@
 
 #include <boost/program_options.hpp>
 
+#include "SpecUtils/SpecFile.h"
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/StringAlgo.h"
 
 #include "InterSpec/AppUtils.h"
 #include "InterSpec/BatchPeak.h"
 #include "InterSpec/BatchActivity.h"
+#include "InterSpec/BatchSynthetic.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/BatchCommandLine.h"
+#include "InterSpec/MassAttenuationTool.h"
+#include "InterSpec/DecayDataBaseServer.h"
 #include "InterSpec/DetectorPeakResponse.h"
 
 using namespace std;
@@ -96,6 +102,78 @@ namespace
     return sampleNumToLoad;
   }//set<int> sequenceStrToSampleNums( string fulltxt )
   
+  
+  /** The static data a batch sub-command may use; combined as a bit-mask, so each sub-command can
+   declare up-front what it needs.
+   */
+  enum StaticData : unsigned
+  {
+    NuclideDecayData = 0x01,
+    ShieldingMaterialData = 0x02,
+    AttenuationCrossSections = 0x04
+  };//enum StaticData
+  
+  
+  /** Loads the static data a sub-command declared it needs on the shared thread pool, each database
+   in parallel with the others, while the calling thread carries on parsing the exemplar, DRF, and
+   input files.  Nothing a sub-command didnt ask for is loaded.
+   
+   The databases are each only ever loaded once, with consumers blocking until they are ready, so it
+   is fine for the sub-command to ask for data that is still loading.  Errors are not reported here;
+   the sub-command gets the error (with its usual message) when it asks for the data.
+   
+   Destruction waits for any outstanding loads.
+   */
+  class StaticDataPreloader
+  {
+  public:
+    explicit StaticDataPreloader( const unsigned needed )
+    {
+      if( needed & StaticData::NuclideDecayData )
+        m_loads.post( [](){ DecayDataBaseServer::initialize(); } );
+      
+      if( needed & StaticData::ShieldingMaterialData )
+      {
+        // Parsing materials needs the decay database, so this will wait on the above load.
+        m_loads.post( [](){
+          try
+          {
+            BatchActivity::material_db();
+          }catch( std::exception & )
+          {
+          }
+        } );
+      }//if( needed & StaticData::ShieldingMaterialData )
+      
+      if( needed & StaticData::AttenuationCrossSections )
+      {
+        // If the binary cross-section file is present it gets memory-mapped by the first element
+        //  loaded, and the rest are cheap; otherwise each element is parsed from its text file, so
+        //  we'll spread the elements over a few tasks.
+        const int num_tasks = 4;
+        for( int task = 0; task < num_tasks; ++task )
+        {
+          m_loads.post( [task,num_tasks](){
+            for( int an = MassAttenuation::sm_min_xs_atomic_number + task;
+                an <= MassAttenuation::sm_max_xs_atomic_number; an += num_tasks )
+            {
+              try
+              {
+                MassAttenuation::massAttenuationCoeficient( an, 100.0f );
+              }catch( std::exception & )
+              {
+                return;
+              }
+            }//for( loop over atomic numbers )
+          } );
+        }//for( loop over tasks )
+      }//if( needed & StaticData::AttenuationCrossSections )
+    }//StaticDataPreloader constructor
+    
+  private:
+    SharedThreadPool::TaskGroup m_loads;
+  };//class StaticDataPreloader
+  
 }//namespace
 
 namespace BatchCommandLine
@@ -112,6 +190,7 @@ int run_batch_command( int argc, char **argv )
   cl_desc.add_options()
   ("batch-peak-fit", "Batch-fit peaks.")
   ("batch-act-fit", "Batch shielding/source fit.")
+  ("batch-synthesize", "Generate synthetic spectrum files, with ground truth, for scaling tests.")
   ;
   
   po::variables_map cl_vm;
@@ -136,17 +215,140 @@ int run_batch_command( int argc, char **argv )
   
   const bool batch_peak_fit = cl_vm.count("batch-peak-fit");
   const bool batch_act_fit = cl_vm.count("batch-act-fit");
+  const bool batch_synthesize = cl_vm.count("batch-synthesize");
   
-  if( batch_peak_fit || batch_act_fit )
+  if( batch_synthesize )
+  {
+    try
+    {
+      if( batch_peak_fit || batch_act_fit )
+        throw std::runtime_error( "You may not specify 'batch-synthesize' with 'batch-peak-fit' or 'batch-act-fit'." );
+      
+      vector<std::string> source_strs;
+      string drf_file, drf_name, distance_str, live_time_str, output_path, base_name, format_str;
+      unsigned int num_channels, records_per_file, num_files, seed;
+      float max_energy, shield_an, shield_ad;
+      bool overwrite;
+      
+      po::options_description synth_cl_desc("Allowed synthetic spectrum options", term_width, min_description_length);
+      synth_cl_desc.add_options()
+      ("help,h",  "Produce help message")
+      ("source", po::value<vector<std::string>>(&source_strs)->multitoken(),
+       "One or more sources, each of the form 'nuclide,activity[,age]', ex. 'Cs137,1uCi,20y'."
+       " If age is not specified, the nuclides default age will be used."
+       )
+      ("drf-file",  po::value<string>(&drf_file)->default_value(""),
+       "Path to a file containing DRF to use.")
+      ("drf-name",  po::value<string>(&drf_name)->default_value(""),
+       "The name of a DRF to use; either within the file specified by 'drf-file'"
+       " (which may have multiple DRFs), or built-in, or previously used in InterSpec.")
+      ("distance", po::value<string>(&distance_str)->default_value("1 m"),
+       "Source to detector distance; ignored for fixed-geometry DRFs.")
+      ("live-time", po::value<string>(&live_time_str)->default_value("300 s"),
+       "Live time of each record.")
+      ("num-channels", po::value<unsigned int>(&num_channels)->default_value(4096),
+       "Number of channels of each spectrum.")
+      ("max-energy", po::value<float>(&max_energy)->default_value(3000.0f),
+       "Upper energy, in keV, of the last channel.")
+      ("shield-an", po::value<float>(&shield_an)->default_value(26.0f),
+       "Atomic number of the shielding, used for attenuation and the scatter continuum.")
+      ("shield-ad", po::value<float>(&shield_ad)->default_value(1.0f),
+       "Areal density, in g/cm2, of the shielding; if zero, there will be no continuum.")
+      ("records-per-file", po::value<unsigned int>(&records_per_file)->default_value(1),
+       "The number of records (each an independent Poisson sample) to put in each file.")
+      ("num-files", po::value<unsigned int>(&num_files)->default_value(1),
+       "The number of files to write.")
+      ("seed", po::value<unsigned int>(&seed)->default_value(1),
+       "Random number seed; the same options and seed always produce the same files.")
+      ("format", po::value<string>(&format_str)->default_value("N42"),
+       "Output format; either 'N42' (2012 N42), or 'PCF'.")
+      ("out-dir", po::value<string>(&output_path)->default_value(""),
+       "The (existing) directory to write the files to.")
+      ("base-name", po::value<string>(&base_name)->default_value("synthetic"),
+       "Base name of the output files; the file index and extension will be appended.")
+      ("overwrite-output-files", po::value<bool>(&overwrite)->default_value(false),
+       "Allow overwriting existing output files.")
+      ;
+      
+      po::variables_map synth_vm;
+      try
+      {
+        po::parsed_options parsed_synth_opts
+        = po::command_line_parser(argc,argv)
+          .allow_unregistered()
+          .options(synth_cl_desc)
+          .run();
+        
+        po::store( parsed_synth_opts, synth_vm );
+        po::notify( synth_vm );
+      }catch( std::exception &e )
+      {
+        std::cerr << "Command line argument error: " << e.what() << std::endl << std::endl;
+        std::cout << synth_cl_desc << std::endl;
+        return 1;
+      }//try catch
+      
+      if( synth_vm.count("help") )
+      {
+        std::cout << "Available command-line options for generating synthetic spectra are:\n";
+        std::cout << synth_cl_desc << std::endl;
+        return 0;
+      }//if( synth_vm.count("help") )
+      
+      unsigned needed_data = StaticData::NuclideDecayData;
+      if( shield_ad > 0.0f )
+        needed_data |= StaticData::AttenuationCrossSections;
+      const StaticDataPreloader preloader( needed_data );
+      
+      BatchSynthetic::SyntheticSpectrumOptions options;
+      options.drf = BatchActivity::init_drf_from_name( drf_file, drf_name );
+      if( !options.drf )
+        throw runtime_error( "You must specify a DRF using 'drf-file' and/or 'drf-name'." );
+      
+      for( const string &src : source_strs )
+        options.sources.push_back( BatchSynthetic::source_from_string( src ) );
+      
+      options.distance = PhysicalUnits::stringToDistance( distance_str );
+      options.live_time = PhysicalUnits::stringToTimeDuration( live_time_str );
+      options.num_channels = num_channels;
+      options.max_energy = max_energy;
+      options.shield_atomic_number = shield_an;
+      options.shield_areal_density = shield_ad;
+      options.records_per_file = records_per_file;
+      options.num_files = num_files;
+      options.seed = seed;
+      options.output_dir = output_path;
+      options.base_name = base_name;
+      options.refuse_overwrite = !overwrite;
+      
+      if( SpecUtils::iequals_ascii( format_str, "N42" ) || SpecUtils::iequals_ascii( format_str, "N42-2012" ) )
+        options.format = SpecUtils::SaveSpectrumAsType::N42_2012;
+      else if( SpecUtils::iequals_ascii( format_str, "PCF" ) )
+        options.format = SpecUtils::SaveSpectrumAsType::Pcf;
+      else
+        throw runtime_error( "Invalid output format '" + format_str + "'; must be 'N42' or 'PCF'." );
+      
+      const vector<string> written = BatchSynthetic::generate_synthetic_files( options );
+      for( const string &filename : written )
+        cout << "Wrote '" << filename << "'" << endl;
+    }catch( std::exception &e )
+    {
+      successful = false;
+      cerr << "Error generating synthetic spectra: " << e.what() << endl;
+    }
+  }else if( batch_peak_fit || batch_act_fit )
   {
     try
     {
       if( batch_peak_fit && batch_act_fit )
         throw std::runtime_error( "You may not specify both 'batch-peak-fit' and 'batch-act-fit'." );
       
-      bool output_stdout, refit_energy_cal, use_exemplar_energy_cal, write_n42_with_peaks, show_nonfit_peaks;
+      bool output_stdout, refit_energy_cal, use_exemplar_energy_cal, write_n42_with_peaks, show_nonfit_peaks, resume;
+      bool track_peaks_over_time;
+      string chart_image_format;
+      unsigned int num_threads;
       vector<std::string> input_files;
-      string exemplar_path, output_path, exemplar_samples, background_sub_file, background_samples;
+      string exemplar_path, output_path, exemplar_samples, background_sub_file, background_samples, results_stream_file;
       
       po::options_description peak_cl_desc("Allowed batch peak-fit, and activity-fit options", term_width, min_description_length);
       peak_cl_desc.add_options()
@@ -192,10 +394,35 @@ int run_batch_command( int argc, char **argv )
       ("include-nonfit-peaks", po::value<bool>(&show_nonfit_peaks)->default_value(false),
        "Include peaks that are not fit into the output CSV peak results."
        )
+      ("num-threads", po::value<unsigned int>(&num_threads)->default_value(1),
+       "The number of input files to fit at once; a value of 0 will use all CPU cores."
+       " Results are written out in the same order as the input files, regardless of this value."
+       )
+      ("stream-results", po::value<string>(&results_stream_file)->default_value(""),
+       "File to append each input files results to as soon as they are available."
+       " If the file extension is '.jsonl' or '.json', results are written as one line of JSON per"
+       " input file, otherwise all peaks are written to a single CSV."
+       )
+      ("resume", po::value<bool>(&resume)->default_value(false),
+       "Skip input files whose CSV (and N42, if 'write-n42-with-peaks') output already exists in"
+       " 'out-dir', and append to the 'stream-results' file; use to restart an interrupted batch."
+       )
+      ("peak-time-series", po::value<bool>(&track_peaks_over_time)->default_value(false),
+       "After fitting the peaks to the summed spectrum, also fit their areas in every sample of the"
+       " file, holding the peak shapes fixed, and write the areas to"
+       " '<out-dir>/<file>_peak_time_series.csv'.  Intended for search/portal files."
+       )
+      ("chart-images", po::value<string>(&chart_image_format)->default_value(""),
+       "If 'svg' or 'png', write a chart of each fit spectrum, with its peaks, to"
+       " '<out-dir>/<file>_spectrum.<ext>', and for files with multiple samples a chart of the"
+       " count rates to '<out-dir>/<file>_time_series.<ext>'.  Charts are rendered without a"
+       " browser."
+       )
       ;
       
       
       string drf_file, drf_name;
+      double max_fit_seconds;
       po::options_description activity_cl_desc("Activity-fit options", term_width, min_description_length);
       activity_cl_desc.add_options()
       ("drf-file",  po::value<string>(&drf_file)->default_value(""),
@@ -209,6 +436,10 @@ int run_batch_command( int argc, char **argv )
        "The sample numbers from the background file to use; if left empty will try to determine, and fail if not unique.\n\t"
        "Only applicable if the background subtraction file is specified."
        )
+      ("max-fit-seconds", po::value<double>(&max_fit_seconds)->default_value(0.0),
+       "The maximum time, in seconds, the activity/shielding fit for a single file may take"
+       " before it is stopped and marked as failed; zero means no limit."
+       )
       ;
       
       po::variables_map cl_vm;
@@ -251,6 +482,13 @@ int run_batch_command( int argc, char **argv )
         return 0;
       }//if( cl_vm.count("help") )
       
+      // Peak fitting only needs nuclides (to assign to peaks); reaction gammas, DRFs, and the like
+      //  are left to be loaded when, and if, they are first used.
+      unsigned needed_data = StaticData::NuclideDecayData;
+      if( batch_act_fit )
+        needed_data |= (StaticData::ShieldingMaterialData | StaticData::AttenuationCrossSections);
+      const StaticDataPreloader preloader( needed_data );
+      
       set<int> exemplar_sample_nums;
       if( !exemplar_samples.empty() )
         exemplar_sample_nums = sequenceStrToSampleNums( exemplar_samples );
@@ -288,6 +526,11 @@ int run_batch_command( int argc, char **argv )
       options.output_dir = output_path;
       options.background_subtract_file = background_sub_file;
       options.background_subtract_samples = background_sample_nums;
+      options.num_threads = num_threads;
+      options.results_stream_file = results_stream_file;
+      options.resume = resume;
+      options.track_peaks_over_time = track_peaks_over_time;
+      options.chart_image_format = chart_image_format;
       
       if( batch_peak_fit )
       {
@@ -297,7 +540,8 @@ int run_batch_command( int argc, char **argv )
       
       if( batch_act_fit )
       {
-        options.drf_override = BatchActivity::init_drf_from_name( drf_file, drf_name ); 
+        options.drf_override = BatchActivity::init_drf_from_name( drf_file, drf_name );
+        options.max_fit_seconds = max_fit_seconds;
         
         //cerr << "batch-act-fit no implemented yet" << endl;
         //throw runtime_error( "Not implemented yet" );
@@ -313,7 +557,7 @@ int run_batch_command( int argc, char **argv )
   }else
   {
     successful = false;
-    cerr << "Please specify either 'batch-peak-fit', or 'batch-act-fit'" << endl;
+    cerr << "Please specify either 'batch-peak-fit', 'batch-act-fit', or 'batch-synthesize'" << endl;
   }//if( batch_peak_fit || batch_act_fit )
   
 
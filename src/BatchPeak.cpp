@@ -23,11 +23,21 @@
 #include "InterSpec_config.h"
 
 #include <set>
+#include <cmath>
 #include <string>
+#include <mutex>
+#include <deque>
+#include <algorithm>
 #include <vector>
+#include <thread>
 #include <fstream>
+#include <sstream>
+#include <numeric>
 #include <iostream>
 #include <exception>
+#include <condition_variable>
+
+#include "SandiaDecay/SandiaDecay.h"
 
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/StringAlgo.h"
@@ -38,14 +48,153 @@
 #include "InterSpec/BatchPeak.h"
 #include "InterSpec/EnergyCal.h"
 #include "InterSpec/PeakModel.h"
+#include "InterSpec/RebinMapping.h"
+#include "InterSpec/ReactionGamma.h"
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/ChartImageRenderer.h"
 #include "InterSpec/DecayDataBaseServer.h"
 
 
 using namespace std;
 
+namespace
+{
+  /** The path the N42 file, with peaks, for `filename` gets written to. */
+  string output_n42_path( const string &output_dir, const string &filename )
+  {
+    string outn42 = SpecUtils::append_path( output_dir, SpecUtils::filename(filename) );
+    if( !SpecUtils::iequals_ascii(SpecUtils::file_extension(filename), ".n42") )
+      outn42 += ".n42";
+    return outn42;
+  }//output_n42_path(...)
+  
+  
+  /** The path the peak CSV for `filename` gets written to. */
+  string output_csv_path( const string &output_dir, const string &filename )
+  {
+    return SpecUtils::append_path( output_dir, SpecUtils::filename(filename) ) + ".CSV";
+  }//output_csv_path(...)
+  
+  
+  /** The path the per-sample peak areas for `filename` get written to. */
+  string output_time_series_path( const string &output_dir, const string &filename )
+  {
+    return SpecUtils::append_path( output_dir, SpecUtils::filename(filename) ) + "_peak_time_series.csv";
+  }//output_time_series_path(...)
+  
+  
+  /** The path a chart image for `filename` gets written to; `suffix` is like "_spectrum", and
+   `format` is "svg" or "png".
+   */
+  string output_chart_path( const string &output_dir, const string &filename,
+                            const string &suffix, const string &format )
+  {
+    return SpecUtils::append_path( output_dir, SpecUtils::filename(filename) ) + suffix + "." + format;
+  }//output_chart_path(...)
+  
+  
+  /** Writes the per-sample areas of `peaks` as a CSV, with one row per sample. */
+  void write_time_series_csv( ostream &output,
+                              const deque<shared_ptr<const PeakDef>> &peaks,
+                              const vector<BatchPeak::PeakTimeSeriesSample> &time_series )
+  {
+    output << "SampleNumber,LiveTime(s),RealTime(s),NumRoisFit";
+    for( const shared_ptr<const PeakDef> &peak : peaks )
+    {
+      const string energy = SpecUtils::printCompact( peak->mean(), 6 );
+      output << "," << energy << " keV Area," << energy << " keV Area Uncert";
+    }
+    output << "\n";
+    
+    for( const BatchPeak::PeakTimeSeriesSample &sample : time_series )
+    {
+      output << sample.sample_number << "," << sample.live_time << "," << sample.real_time
+             << "," << sample.num_rois_fit;
+      for( size_t i = 0; i < sample.areas.size(); ++i )
+        output << "," << sample.areas[i] << "," << sample.area_uncerts[i];
+      output << "\n";
+    }
+  }//write_time_series_csv(...)
+}//namespace
+
+
 namespace BatchPeak
 {
 
+string json_escape( const string &input )
+{
+  string answer;
+  answer.reserve( input.size() + 2 );
+  for( const char c : input )
+  {
+    switch( c )
+    {
+      case '"':  answer += "\\\""; break;
+      case '\\': answer += "\\\\"; break;
+      case '\n': answer += "\\n";  break;
+      case '\r': answer += "\\r";  break;
+      case '\t': answer += "\\t";  break;
+      default:
+        if( static_cast<unsigned char>(c) < 0x20 )
+        {
+          char buffer[8];
+          snprintf( buffer, sizeof(buffer), "\\u%04x", static_cast<int>(c) );
+          answer += buffer;
+        }else
+        {
+          answer += c;
+        }
+    }//switch( c )
+  }//for( const char c : input )
+  
+  return answer;
+}//json_escape(...)
+
+
+void write_json_line( ostream &output, const string &filename,
+                      const BatchPeakFitResult &fit_results,
+                      const deque<shared_ptr<const PeakDef>> &fit_peaks )
+{
+  output << "{\"file\":\"" << json_escape(filename) << "\""
+         << ",\"success\":" << (fit_results.success ? "true" : "false");
+  
+  output << ",\"warnings\":[";
+  for( size_t i = 0; i < fit_results.warnings.size(); ++i )
+    output << (i ? "," : "") << "\"" << json_escape(fit_results.warnings[i]) << "\"";
+  output << "]";
+  
+  output << ",\"peaks\":[";
+  for( size_t i = 0; i < fit_peaks.size(); ++i )
+  {
+    const PeakDef &peak = *fit_peaks[i];
+    
+    string source;
+    if( peak.parentNuclide() )
+      source = peak.parentNuclide()->symbol;
+    else if( peak.reaction() )
+      source = peak.reaction()->name();
+    else if( peak.xrayElement() )
+      source = peak.xrayElement()->symbol + "-xray";
+    
+    output << (i ? "," : "") << "{\"mean\":" << peak.mean()
+           << ",\"meanUncert\":" << peak.meanUncert()
+           << ",\"fwhm\":" << peak.fwhm()
+           << ",\"amplitude\":" << peak.amplitude()
+           << ",\"amplitudeUncert\":" << peak.amplitudeUncert()
+           << ",\"chi2dof\":" << peak.chi2dof();
+    if( !source.empty() )
+    {
+      output << ",\"source\":\"" << json_escape(source) << "\"";
+      if( peak.hasSourceGammaAssigned() )
+        output << ",\"sourceEnergy\":" << peak.gammaParticleEnergy();
+    }
+    output << "}";
+  }//for( size_t i = 0; i < fit_peaks.size(); ++i )
+  
+  output << "]}\n";
+}//write_json_line(...)
+
+
 void fit_energy_cal_from_fit_peaks( shared_ptr<SpecUtils::Measurement> &raw, vector<PeakDef> peaks, const size_t num_coefs )
 {
   if( !raw || raw->num_gamma_channels() < 16 )
@@ -110,26 +259,144 @@ void fit_energy_cal_from_fit_peaks( shared_ptr<SpecUtils::Measurement> &raw, vec
   
   raw->set_energy_calibration( updated_cal );
   
-  cout << "Updated energy calibration using ROIs from exemplar.\n\tCoefficients:\n";
+  // We may be fitting multiple files at once, so compose the whole message, and then print it
+  //  in one go, so it doesnt get interleaved with output from other files.
+  stringstream msg;
+  msg << "Updated energy calibration using ROIs from exemplar.\n\tCoefficients:\n";
   assert( fit_coefs.size() == orig_cal->coefficients().size() );
   for( size_t i = 0; i < fit_coefs.size(); ++i )
-    cout << "\t\t" << std::setprecision(6) << std::setw(12) << orig_cal->coefficients().at(i)
-    << "\t-->\t" << std::setprecision(6) << std::setw(12) << fit_coefs[i] << endl;
+    msg << "\t\t" << std::setprecision(6) << std::setw(12) << orig_cal->coefficients().at(i)
+    << "\t-->\t" << std::setprecision(6) << std::setw(12) << fit_coefs[i] << "\n";
   
-  cout << "This moved peak energies:" << endl;
+  msg << "This moved peak energies:\n";
   for( const auto &peak : peaks )
   {
     const double energy = peak.mean();
     const double orig = orig_cal->channel_for_energy( energy );
     const double now = updated_cal->channel_for_energy( energy );
-    cout << "\t" << std::setprecision(6) << std::setw(12) << energy << " keV from channel "
+    msg << "\t" << std::setprecision(6) << std::setw(12) << energy << " keV from channel "
     << std::setprecision(6) << std::setw(12) << orig << " to "
-    << std::setprecision(6) << std::setw(12) << now << endl;
+    << std::setprecision(6) << std::setw(12) << now << "\n";
   }
   
-  cout << endl << endl;
+  msg << "\n\n";
+  
+  static std::mutex s_cout_mutex;
+  std::lock_guard<std::mutex> lock( s_cout_mutex );
+  cout << msg.str() << std::flush;
 }//void fit_energy_cal_from_fit_peaks(...)
 
+
+size_t resolve_num_threads( const size_t num_threads )
+{
+  if( num_threads )
+    return num_threads;
+  
+  return SharedThreadPool::available_cpu_count();
+}//size_t resolve_num_threads( const size_t num_threads )
+
+
+void run_in_order( const size_t num_items,
+                   size_t num_threads,
+                   size_t max_in_flight,
+                   const std::function<void(size_t)> &work,
+                   const std::function<void(size_t)> &commit )
+{
+  num_threads = std::min( resolve_num_threads( num_threads ), num_items );
+  
+  if( num_threads <= 1 )
+  {
+    for( size_t index = 0; index < num_items; ++index )
+    {
+      work( index );
+      commit( index );
+    }
+    return;
+  }//if( num_threads <= 1 )
+  
+  max_in_flight = std::max( max_in_flight, num_threads );
+  
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t next_index = 0;       //The next item a worker should start on
+  size_t num_committed = 0;    //The number of items `commit` has been called for
+  bool stop = false;           //Set when an exception was encountered
+  vector<char> done( num_items, 0 );
+  vector<std::exception_ptr> errors( num_items );
+  
+  auto worker = [&](){
+    while( true )
+    {
+      size_t index = 0;
+      {
+        std::unique_lock<std::mutex> lock( mutex );
+        cv.wait( lock, [&](){
+          return stop || (next_index >= num_items) || ((next_index - num_committed) < max_in_flight);
+        } );
+        
+        if( stop || (next_index >= num_items) )
+          return;
+        index = next_index++;
+      }
+      
+      std::exception_ptr error;
+      try
+      {
+        work( index );
+      }catch( ... )
+      {
+        error = std::current_exception();
+      }
+      
+      {
+        std::lock_guard<std::mutex> lock( mutex );
+        errors[index] = error;
+        done[index] = 1;
+      }
+      cv.notify_all();
+    }//while( true )
+  };//worker
+  
+  vector<std::thread> threads;
+  for( size_t i = 0; i < num_threads; ++i )
+    threads.emplace_back( worker );
+  
+  std::exception_ptr error;
+  for( size_t index = 0; !error && (index < num_items); ++index )
+  {
+    {
+      std::unique_lock<std::mutex> lock( mutex );
+      cv.wait( lock, [&](){ return done[index] != 0; } );
+      error = errors[index];
+    }
+    
+    if( !error )
+    {
+      try
+      {
+        commit( index );
+      }catch( ... )
+      {
+        error = std::current_exception();
+      }
+    }//if( !error )
+    
+    {
+      std::lock_guard<std::mutex> lock( mutex );
+      num_committed = index + 1;
+      if( error )
+        stop = true;
+    }
+    cv.notify_all();
+  }//for( loop over items, in order )
+  
+  for( std::thread &t : threads )
+    t.join();
+  
+  if( error )
+    std::rethrow_exception( error );
+}//void run_in_order(...)
+
   
 void fit_peaks_in_files( const std::string &exemplar_filename,
                           const std::set<int> &exemplar_sample_nums,
@@ -157,27 +424,87 @@ void fit_peaks_in_files( const std::string &exemplar_filename,
     throw runtime_error( message );
   }//if( !db )
   
-  std::shared_ptr<const SpecMeas> cached_exemplar_n42;
-  for( const string filename : files )
+  if( options.resume && options.output_dir.empty() )
+    throw runtime_error( "Resuming a batch requires an output directory be specified." );
+  
+  string chart_format = options.chart_image_format;
+  SpecUtils::to_lower_ascii( chart_format );
+  if( !chart_format.empty() )
   {
-    const BatchPeakFitResult fit_results
-                 = fit_peaks_in_file( exemplar_filename, exemplar_sample_nums,
-                                     cached_exemplar_n42, filename, nullptr, {}, options );
+    if( (chart_format != "svg") && (chart_format != "png") )
+      throw runtime_error( "Chart image format must be 'svg' or 'png' (not '" + options.chart_image_format + "')." );
+    
+    if( options.output_dir.empty() )
+      throw runtime_error( "Writing chart images requires an output directory be specified." );
     
-    if( !cached_exemplar_n42 )
-      cached_exemplar_n42 = fit_results.exemplar;
+    if( (chart_format == "png") && !ChartImageRenderer::png_supported() )
+      throw runtime_error( "This build does not support writing PNG images; use 'svg' instead." );
+  }//if( !chart_format.empty() )
+  
+  // When resuming, skip the files that a previous run already wrote all the outputs for
+  vector<string> files_to_fit;
+  for( const string &filename : files )
+  {
+    const bool done = options.resume
+                      && SpecUtils::is_file( output_csv_path(options.output_dir, filename) )
+                      && (!options.write_n42_with_peaks
+                          || SpecUtils::is_file( output_n42_path(options.output_dir, filename) ));
+    if( done )
+      cout << "Skipping '" << filename << "', as its output already exists." << endl;
+    else
+      files_to_fit.push_back( filename );
+  }//for( const string &filename : files )
+  
+  if( files_to_fit.empty() )
+    return;
+  
+  // Results for each file get appended to `results_stream`, and flushed, as soon as they are
+  //  available, so an interrupted run still has everything that was completed.
+  const string &stream_path = options.results_stream_file;
+  const string stream_ext = SpecUtils::file_extension( stream_path );
+  const bool stream_json = SpecUtils::iequals_ascii(stream_ext, ".jsonl")
+                           || SpecUtils::iequals_ascii(stream_ext, ".json");
+  bool stream_needs_csv_header = true;
+  unique_ptr<ofstream> results_stream;
+  if( !stream_path.empty() )
+  {
+    const bool exists = SpecUtils::is_file( stream_path );
+    if( exists && !options.resume )
+      throw runtime_error( "Results stream file ('" + stream_path + "') already exists;"
+                           " will not overwrite it." );
+    
+    stream_needs_csv_header = (!exists || (SpecUtils::file_size(stream_path) == 0));
+    
+    const ios_base::openmode mode = ios::out | ios::binary | ios::app;
+#ifdef _WIN32
+    const std::wstring wstream_path = SpecUtils::convert_from_utf8_to_utf16(stream_path);
+    results_stream.reset( new ofstream( wstream_path.c_str(), mode ) );
+#else
+    results_stream.reset( new ofstream( stream_path.c_str(), mode ) );
+#endif
+    if( !(*results_stream) )
+      throw runtime_error( "Unable to open results stream file ('" + stream_path + "') for writing." );
+  }//if( !stream_path.empty() )
+  
+  // Writes out the results for a file; always called from this thread, and in the order of
+  //  the input files, so output is the same no matter how many threads are used to fit.
+  auto write_results = [&]( const string &filename, const BatchPeakFitResult &fit_results ){
     warnings.insert(end(warnings), begin(fit_results.warnings), end(fit_results.warnings) );
     
+    if( results_stream && stream_json && !fit_results.success )
+    {
+      write_json_line( *results_stream, filename, fit_results, fit_results.fit_peaks );
+      results_stream->flush();
+    }
+    
     if( !fit_results.success )
-      continue;
+      return;
     
     assert( fit_results.measurement );
     
     if( options.write_n42_with_peaks && fit_results.measurement )
     {
-      string outn42 = SpecUtils::append_path(options.output_dir, SpecUtils::filename(filename) );
-      if( !SpecUtils::iequals_ascii(SpecUtils::file_extension(filename), ".n42") )
-        outn42 += ".n42";
+      const string outn42 = output_n42_path( options.output_dir, filename );
       
       if( SpecUtils::is_file( outn42 ) )
       {
@@ -218,7 +545,7 @@ void fit_peaks_in_files( const std::string &exemplar_filename,
     if( !options.output_dir.empty() )
     {
       const string leaf_name = SpecUtils::filename(filename);
-      string outcsv = SpecUtils::append_path(options.output_dir, leaf_name) + ".CSV";
+      const string outcsv = output_csv_path( options.output_dir, filename );
       
       if( SpecUtils::is_file( outcsv ) )
       {
@@ -241,6 +568,72 @@ void fit_peaks_in_files( const std::string &exemplar_filename,
           cout << "Have written '" << outcsv << "'" << endl;
         }
       }//if( SpecUtils::is_file( outcsv ) ) / else
+      
+      if( options.track_peaks_over_time && !fit_results.time_series.empty() )
+      {
+        const string outts = output_time_series_path( options.output_dir, filename );
+        
+        if( SpecUtils::is_file( outts ) )
+        {
+          warnings.push_back( "Not writing '" + outts + "', as it would overwrite a file.");
+        }else
+        {
+#ifdef _WIN32
+          const std::wstring woutts = SpecUtils::convert_from_utf8_to_utf16(outts);
+          std::ofstream output_ts( woutts.c_str() );
+#else
+          std::ofstream output_ts( outts.c_str() );
+#endif
+          if( !output_ts )
+          {
+            warnings.push_back( "Failed to open '" + outts + "', for writing.");
+          }else
+          {
+            write_time_series_csv( output_ts, fit_results.fit_peaks, fit_results.time_series );
+            cout << "Have written '" << outts << "'" << endl;
+          }
+        }//if( SpecUtils::is_file( outts ) ) / else
+      }//if( options.track_peaks_over_time && ... )
+      
+      if( !chart_format.empty() && fit_results.spectrum )
+      {
+        const string outspec = output_chart_path( options.output_dir, filename, "_spectrum", chart_format );
+        const string outtime = output_chart_path( options.output_dir, filename, "_time_series", chart_format );
+        
+        try
+        {
+          if( SpecUtils::is_file( outspec ) )
+          {
+            warnings.push_back( "Not writing '" + outspec + "', as it would overwrite a file.");
+          }else
+          {
+            ChartImageRenderer::SpectrumImageOptions chart_options;
+            chart_options.title = leaf_name;
+            ChartImageRenderer::write_spectrum_image( outspec, fit_results.spectrum, nullptr,
+                                                      fit_peaks, chart_options );
+            cout << "Have written '" << outspec << "'" << endl;
+          }
+          
+          if( fit_results.measurement && (fit_results.measurement->sample_numbers().size() > 1) )
+          {
+            if( SpecUtils::is_file( outtime ) )
+            {
+              warnings.push_back( "Not writing '" + outtime + "', as it would overwrite a file.");
+            }else
+            {
+              ChartImageRenderer::ChartImageOptions chart_options;
+              chart_options.title = leaf_name;
+              chart_options.height_px = 250;
+              ChartImageRenderer::write_time_series_image( outtime, *fit_results.measurement,
+                                                           chart_options );
+              cout << "Have written '" << outtime << "'" << endl;
+            }
+          }//if( more than one sample )
+        }catch( std::exception &e )
+        {
+          warnings.push_back( "Failed to write chart image for '" + filename + "': " + e.what() );
+        }
+      }//if( !chart_format.empty() )
     }//if( !options.output_dir.empty() )
     
     if( options.to_stdout )
@@ -250,7 +643,61 @@ void fit_peaks_in_files( const std::string &exemplar_filename,
       PeakModel::write_peak_csv( cout, leaf_name, fit_peaks, fit_results.spectrum );
       cout << endl;
     }
-  }//for( const string filename : files )
+    
+    if( results_stream )
+    {
+      if( stream_json )
+      {
+        write_json_line( *results_stream, filename, fit_results, fit_peaks );
+      }else
+      {
+        // The CSV has a two line header, that we only want at the top of the file
+        stringstream csv;
+        PeakModel::write_peak_csv( csv, SpecUtils::filename(filename), fit_peaks, fit_results.spectrum );
+        string csv_str = csv.str();
+        for( int i = 0; !stream_needs_csv_header && (i < 2); ++i )
+        {
+          const size_t pos = csv_str.find( '\n' );
+          csv_str = (pos == string::npos) ? string() : csv_str.substr( pos + 1 );
+        }
+        stream_needs_csv_header = false;
+        (*results_stream) << csv_str;
+      }//if( stream_json ) / else
+      
+      results_stream->flush();
+      if( !(*results_stream) )
+        warnings.push_back( "Error writing results for '" + filename + "' to '" + stream_path + "'." );
+    }//if( results_stream )
+  };//write_results lambda
+  
+  // We will fit the first file by itself, so that the exemplar file gets parsed just once, and
+  //  then shared (read-only) by the fits of all the other files.
+  std::shared_ptr<const SpecMeas> cached_exemplar_n42;
+  {
+    const BatchPeakFitResult fit_results
+                 = fit_peaks_in_file( exemplar_filename, exemplar_sample_nums,
+                                     cached_exemplar_n42, files_to_fit.front(), nullptr, {}, options );
+    cached_exemplar_n42 = fit_results.exemplar;
+    write_results( files_to_fit.front(), fit_results );
+  }
+  
+  // Results are only held on to until they are written, so we will only have at most a few
+  //  files worth of results in memory at a time.
+  const size_t num_remaining = files_to_fit.size() - 1;
+  const size_t num_threads = resolve_num_threads( options.num_threads );
+  const size_t max_in_flight = 2*num_threads;
+  vector<unique_ptr<BatchPeakFitResult>> results( num_remaining );
+  
+  run_in_order( num_remaining, num_threads, max_in_flight,
+    [&]( const size_t index ){
+      results[index].reset( new BatchPeakFitResult( fit_peaks_in_file( exemplar_filename,
+                       exemplar_sample_nums, cached_exemplar_n42, files_to_fit[index + 1], nullptr, {}, options ) ) );
+    },
+    [&]( const size_t index ){
+      assert( results[index] );
+      write_results( files_to_fit[index + 1], *results[index] );
+      results[index].reset();
+    } );
     
   if( !warnings.empty() )
     cerr << endl << endl;
@@ -638,8 +1085,8 @@ BatchPeak::BatchPeakFitResult fit_peaks_in_file( const std::string &exemplar_fil
            && (*results.background->energy_calibration()) != (*spec->energy_calibration()) )
         {
           auto new_backchan = make_shared<vector<float>>( fore_counts->size(), 0.0f );
-          SpecUtils::rebin_by_lower_edge( *results.background->channel_energies(), *back_counts,
-                                         *spec->channel_energies(), *new_backchan );
+          RebinMapping::rebin( results.background->energy_calibration(), *back_counts,
+                               spec->energy_calibration(), *new_backchan );
           back_counts = new_backchan;
         }
         
@@ -869,10 +1316,251 @@ BatchPeak::BatchPeakFitResult fit_peaks_in_file( const std::string &exemplar_fil
                                         begin(unused_exemplar_peaks), end(unused_exemplar_peaks) );
     std::sort( begin(results.unfit_exemplar_peaks), end(results.unfit_exemplar_peaks),
               &PeakDef::lessThanByMeanShrdPtr );
+    
+    if( options.track_peaks_over_time )
+    {
+      // A 3-sigma consistency check means roughly 1 in 370 unchanged samples still gets refit,
+      //  while a real change in a peak is picked up right away.
+      const double consistency_nsigma = 3.0;
+      results.time_series = fit_peak_time_series( *specfile, spec, fit_peaks_ptrs, used_sample_nums,
+                                                  specfile->detector_names(), consistency_nsigma );
+    }//if( options.track_peaks_over_time )
   }
   
   return results;
 }//fit_peaks_in_file(...)
+
+
+vector<PeakTimeSeriesSample> fit_peak_time_series( const SpecMeas &meas,
+                                            const shared_ptr<const SpecUtils::Measurement> &summed,
+                                            const deque<shared_ptr<const PeakDef>> &peaks,
+                                            const set<int> &sample_numbers,
+                                            const vector<string> &detectors,
+                                            const double consistency_nsigma )
+{
+  // The peaks that share a continuum are fit together; we'll also keep the last fit of each ROI
+  //  around, so the following samples can be checked against it.
+  struct TrackedRoi
+  {
+    shared_ptr<const PeakContinuum> continuum;
+    vector<size_t> peak_indices;
+    vector<double> means, sigmas;
+    PeakDef::SkewType skew_type = PeakDef::SkewType::NoSkew;
+    vector<double> skew_pars;
+    int num_polynomial_terms = 0;
+    bool step_continuum = false;
+    
+    bool have_fit = false;
+    double fit_counts = 0.0, fit_live_time = 0.0;
+    vector<double> fit_areas, fit_uncerts;
+  };//struct TrackedRoi
+  
+  vector<TrackedRoi> rois;
+  for( size_t peak_index = 0; peak_index < peaks.size(); ++peak_index )
+  {
+    const shared_ptr<const PeakDef> &peak = peaks[peak_index];
+    assert( peak );
+    const shared_ptr<const PeakContinuum> &cont = peak->continuum();
+    
+    if( !peak->gausPeak() || !cont || (cont->type() == PeakContinuum::External) )
+      continue;
+    
+    auto roi = std::find_if( begin(rois), end(rois), [&cont]( const TrackedRoi &r ){
+      return (r.continuum == cont);
+    } );
+    
+    if( roi == end(rois) )
+    {
+      rois.emplace_back();
+      roi = end(rois) - 1;
+      roi->continuum = cont;
+      
+      // The skew is the same for all peaks in a ROI, when fitting amplitudes, so we'll take it from
+      //  the first peak
+      roi->skew_type = peak->skewType();
+      const size_t num_skew = PeakDef::num_skew_parameters( roi->skew_type );
+      for( size_t i = 0; i < num_skew; ++i )
+      {
+        const auto coef = static_cast<PeakDef::CoefficientType>( PeakDef::SkewPar0 + i );
+        roi->skew_pars.push_back( peak->coefficient(coef) );
+      }
+      
+      switch( cont->type() )
+      {
+        case PeakContinuum::NoOffset: case PeakContinuum::External:
+          roi->num_polynomial_terms = 0;
+          break;
+          
+        case PeakContinuum::Constant: case PeakContinuum::Linear:
+        case PeakContinuum::Quadratic: case PeakContinuum::Cubic:
+          roi->num_polynomial_terms = cont->type() - PeakContinuum::NoOffset;
+          break;
+          
+        case PeakContinuum::FlatStep:
+        case PeakContinuum::LinearStep:
+        case PeakContinuum::BiLinearStep:
+          roi->num_polynomial_terms = 2 + (cont->type() - PeakContinuum::FlatStep);
+          roi->step_continuum = true;
+          break;
+      }//switch( cont->type() )
+    }//if( roi == end(rois) )
+    
+    roi->peak_indices.push_back( peak_index );
+    roi->means.push_back( peak->mean() );
+    roi->sigmas.push_back( peak->sigma() );
+  }//for( loop over peaks )
+  
+  vector<PeakTimeSeriesSample> answer;
+  if( rois.empty() )
+    return answer;
+  
+  const shared_ptr<const vector<float>> summed_energies = summed ? summed->channel_energies() : nullptr;
+  
+  const vector<PeakDef> fixedAmpPeaks;
+  vector<double> amplitudes, continuum_coeffs, amplitudes_uncerts, continuum_coeffs_uncerts;
+  vector<float> counts;
+  vector<shared_ptr<const SpecUtils::Measurement>> sample_meas;
+  
+  for( const int sample_number : sample_numbers )
+  {
+    sample_meas.clear();
+    for( const string &det_name : detectors )
+    {
+      const shared_ptr<const SpecUtils::Measurement> m = meas.measurement( sample_number, det_name );
+      if( m && (m->num_gamma_channels() > 0) )
+        sample_meas.push_back( m );
+    }
+    
+    if( sample_meas.empty() )
+      continue;
+    
+    // If all the detectors share the same energy calibration (the usual case), we can just add up
+    //  their channel counts, otherwise we'll have SpecUtils rebin and sum them.
+    bool same_cal = true;
+    for( size_t i = 1; same_cal && (i < sample_meas.size()); ++i )
+      same_cal = (sample_meas[i]->energy_calibration() == sample_meas[0]->energy_calibration());
+    
+    float live_time = 0.0f, real_time = 0.0f;
+    shared_ptr<const vector<float>> energies;
+    
+    if( same_cal )
+    {
+      counts.assign( sample_meas[0]->num_gamma_channels(), 0.0f );
+      for( const shared_ptr<const SpecUtils::Measurement> &m : sample_meas )
+      {
+        const vector<float> &channel_counts = *m->gamma_counts();
+        for( size_t i = 0; i < counts.size(); ++i )
+          counts[i] += channel_counts[i];
+        live_time += m->live_time();
+        real_time += m->real_time();
+      }
+      energies = sample_meas[0]->channel_energies();
+    }else
+    {
+      const shared_ptr<SpecUtils::Measurement> sum
+                                  = meas.sum_measurements( {sample_number}, detectors, nullptr );
+      if( !sum || !sum->gamma_counts() )
+        continue;
+      
+      counts = *sum->gamma_counts();
+      live_time = sum->live_time();
+      real_time = sum->real_time();
+      energies = sum->channel_energies();
+    }//if( same_cal ) / else
+    
+    // Use the energy calibration the peaks were fit with, if possible.
+    if( summed_energies && (summed_energies->size() == (counts.size() + 1)) )
+      energies = summed_energies;
+    
+    if( !energies || (energies->size() < (counts.size() + 1)) || (counts.size() < 2) )
+      continue;
+    
+    PeakTimeSeriesSample sample;
+    sample.sample_number = sample_number;
+    sample.live_time = live_time;
+    sample.real_time = real_time;
+    sample.areas.resize( peaks.size(), 0.0 );
+    sample.area_uncerts.resize( peaks.size(), 0.0 );
+    sample.num_rois_fit = 0;
+    
+    const float * const energies_begin = energies->data();
+    const float * const energies_end = energies_begin + counts.size();
+    
+    for( TrackedRoi &roi : rois )
+    {
+      // Same channel rounding as the peak fit; the ROI goes from the channel containing the lower
+      //  energy, through the channel containing the upper energy.
+      const float *lower = std::upper_bound( energies_begin, energies_end, roi.continuum->lowerEnergy() );
+      const float *upper = std::upper_bound( energies_begin, energies_end, roi.continuum->upperEnergy() );
+      lower = std::max( energies_begin, lower - 1 );
+      upper = std::max( energies_begin, upper - 1 );
+      
+      const size_t lower_channel = static_cast<size_t>( lower - energies_begin );
+      const size_t nbin = static_cast<size_t>( upper - lower ) + 1;
+      if( (lower_channel + nbin) > counts.size() )
+        continue;
+      
+      const float * const roi_energies = lower;
+      const float * const roi_counts = counts.data() + lower_channel;
+      const double total_counts = std::accumulate( roi_counts, roi_counts + nbin, 0.0 );
+      
+      if( roi.have_fit && (consistency_nsigma > 0.0) && (live_time > 0.0f) && (roi.fit_live_time > 0.0) )
+      {
+        const double scale = live_time / roi.fit_live_time;
+        const double expected = scale * roi.fit_counts;
+        
+        // Poisson variance of this sample, plus that of the (scaled) counts of the sample it is
+        //  being compared to.
+        const double variance = std::max( expected, 1.0 ) + scale*scale*roi.fit_counts;
+        
+        if( fabs(total_counts - expected) <= consistency_nsigma*sqrt(variance) )
+        {
+          for( size_t i = 0; i < roi.peak_indices.size(); ++i )
+          {
+            sample.areas[roi.peak_indices[i]] = scale * roi.fit_areas[i];
+            sample.area_uncerts[roi.peak_indices[i]] = scale * roi.fit_uncerts[i];
+          }
+          continue;
+        }//if( counts consistent with last fit )
+      }//if( we can check if ROI needs to be refit )
+      
+      try
+      {
+        fit_amp_and_offset( roi_energies, roi_counts, nbin, roi.num_polynomial_terms,
+                            roi.step_continuum, roi.continuum->referenceEnergy(),
+                            roi.means, roi.sigmas, fixedAmpPeaks, roi.skew_type,
+                            roi.skew_pars.empty() ? nullptr : roi.skew_pars.data(),
+                            amplitudes, continuum_coeffs, amplitudes_uncerts, continuum_coeffs_uncerts );
+      }catch( std::exception & )
+      {
+        // Leave the areas for this ROI as zero, and try again next sample
+        roi.have_fit = false;
+        continue;
+      }//try / catch
+      
+      assert( amplitudes.size() == roi.peak_indices.size() );
+      assert( amplitudes_uncerts.size() == roi.peak_indices.size() );
+      
+      roi.have_fit = true;
+      roi.fit_counts = total_counts;
+      roi.fit_live_time = live_time;
+      roi.fit_areas = amplitudes;
+      roi.fit_uncerts = amplitudes_uncerts;
+      
+      for( size_t i = 0; i < roi.peak_indices.size(); ++i )
+      {
+        sample.areas[roi.peak_indices[i]] = amplitudes[i];
+        sample.area_uncerts[roi.peak_indices[i]] = amplitudes_uncerts[i];
+      }
+      
+      sample.num_rois_fit += 1;
+    }//for( TrackedRoi &roi : rois )
+    
+    answer.push_back( std::move(sample) );
+  }//for( const int sample_number : sample_numbers )
+  
+  return answer;
+}//fit_peak_time_series(...)
   
 }//namespace BatchPeak
 
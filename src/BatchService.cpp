@@ -0,0 +1,629 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cassert>
+#include <sstream>
+#include <ostream>
+#include <stdexcept>
+#include <condition_variable>
+
+#include <boost/filesystem.hpp>
+
+#include <Wt/WServer>
+#include <Wt/WResource>
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+
+#include "rapidxml/rapidxml.hpp"
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+#include "SpecUtils/RapidXmlUtils.hpp"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/BatchPeak.h"
+#include "InterSpec/BatchService.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/BatchActivity.h"
+#include "InterSpec/ComputeScheduler.h"
+#include "InterSpec/DetectorPeakResponse.h"
+#include "InterSpec/ShieldingSourceFitCalc.h"
+
+#if( USE_REL_ACT_TOOL )
+#include "InterSpec/RelActCalcAuto.h"
+#endif
+
+using namespace std;
+
+namespace
+{
+  /** The longest we will wait for a queued analysis to finish, before giving up on the request. */
+  const std::chrono::minutes ns_max_request_wait( 15 );
+  
+  /** The maximum number of exemplar files, and of DRFs, to keep parsed in memory. */
+  const size_t ns_max_cached_exemplars = 16;
+  
+  
+  /** Thrown for invalid request parameters; results in a HTTP 400 response. */
+  struct BadRequest : public std::runtime_error
+  {
+    explicit BadRequest( const std::string &msg ) : std::runtime_error( msg ) {}
+  };//struct BadRequest
+  
+  
+  struct CachedExemplar
+  {
+    std::time_t m_mtime;
+    boost::uintmax_t m_size;
+    
+    /** Will be nullptr if the file is not a N42 file (e.g., is a peak CSV file). */
+    std::shared_ptr<SpecMeas> m_meas;
+  };//struct CachedExemplar
+  
+  std::mutex ns_exemplar_mutex;
+  std::map<std::string,CachedExemplar> ns_exemplars;
+  
+  std::mutex ns_drf_mutex;
+  std::map<std::string,std::shared_ptr<DetectorPeakResponse>> ns_drfs;
+  
+  
+  /** Returns the parsed N42 exemplar file at `path`, or nullptr if the file exists, but is not a
+   N42 file.  Throws BadRequest if the file does not exist.
+   */
+  shared_ptr<SpecMeas> exemplar_n42( const string &path )
+  {
+#ifdef _WIN32
+    const boost::filesystem::path p( SpecUtils::convert_from_utf8_to_utf16(path) );
+#else
+    const boost::filesystem::path p( path );
+#endif
+    
+    boost::system::error_code ec;
+    const std::time_t mtime = boost::filesystem::last_write_time( p, ec );
+    const boost::uintmax_t size = ec ? 0 : boost::filesystem::file_size( p, ec );
+    if( ec || !SpecUtils::is_file(path) )
+      throw BadRequest( "Exemplar file '" + path + "' could not be accessed." );
+    
+    {
+      std::lock_guard<std::mutex> lock( ns_exemplar_mutex );
+      const auto pos = ns_exemplars.find( path );
+      if( (pos != end(ns_exemplars)) && (pos->second.m_mtime == mtime) && (pos->second.m_size == size) )
+        return pos->second.m_meas;
+    }
+    
+    // Parse outside of the lock; if two requests parse the same file at the same time, the second
+    //  one to finish will just replace the first ones entry.
+    CachedExemplar entry;
+    entry.m_mtime = mtime;
+    entry.m_size = size;
+    entry.m_meas = make_shared<SpecMeas>();
+    if( !entry.m_meas->load_N42_file( path ) )
+      entry.m_meas.reset();
+    
+    std::lock_guard<std::mutex> lock( ns_exemplar_mutex );
+    if( ns_exemplars.size() >= ns_max_cached_exemplars )
+      ns_exemplars.clear();
+    ns_exemplars[path] = entry;
+    
+    return entry.m_meas;
+  }//shared_ptr<SpecMeas> exemplar_n42( const string &path )
+  
+  
+  shared_ptr<DetectorPeakResponse> drf_from_name( const string &drf_file, const string &drf_name )
+  {
+    if( drf_file.empty() && drf_name.empty() )
+      return nullptr;
+    
+    const string key = drf_file + "\n" + drf_name;
+    {
+      std::lock_guard<std::mutex> lock( ns_drf_mutex );
+      const auto pos = ns_drfs.find( key );
+      if( pos != end(ns_drfs) )
+        return pos->second;
+    }
+    
+    shared_ptr<DetectorPeakResponse> drf;
+    try
+    {
+      drf = BatchActivity::init_drf_from_name( drf_file, drf_name );
+    }catch( std::exception &e )
+    {
+      throw BadRequest( e.what() );
+    }
+    
+    std::lock_guard<std::mutex> lock( ns_drf_mutex );
+    if( ns_drfs.size() >= ns_max_cached_exemplars )
+      ns_drfs.clear();
+    ns_drfs[key] = drf;
+    
+    return drf;
+  }//shared_ptr<DetectorPeakResponse> drf_from_name(...)
+  
+  
+  set<int> sample_numbers_param( const Wt::Http::Request &request, const string &name )
+  {
+    set<int> answer;
+    const string *value = request.getParameter( name );
+    if( !value || value->empty() )
+      return answer;
+    
+    vector<int> samples;
+    if( !SpecUtils::split_to_ints( value->c_str(), value->size(), samples ) )
+      throw BadRequest( "Invalid '" + name + "' parameter: '" + *value + "'" );
+    answer.insert( begin(samples), end(samples) );
+    
+    return answer;
+  }//set<int> sample_numbers_param(...)
+  
+  
+  string string_param( const Wt::Http::Request &request, const string &name )
+  {
+    const string *value = request.getParameter( name );
+    return value ? *value : string();
+  }
+  
+  
+  bool bool_param( const Wt::Http::Request &request, const string &name )
+  {
+    const string value = string_param( request, name );
+    return (value == "1") || SpecUtils::iequals_ascii( value, "true" );
+  }
+  
+  
+#if( USE_REL_ACT_TOOL )
+  /** Returns the foreground spectrum of `meas` for the given sample numbers; if `samples` is empty,
+   uses all samples if there is only one, and otherwise the samples marked as foreground.
+   */
+  shared_ptr<const SpecUtils::Measurement> foreground_spectrum( const SpecMeas &meas, set<int> samples )
+  {
+    if( samples.empty() )
+    {
+      const set<int> &all_samples = meas.sample_numbers();
+      if( all_samples.size() == 1 )
+      {
+        samples = all_samples;
+      }else
+      {
+        for( const shared_ptr<const SpecUtils::Measurement> &m : meas.measurements() )
+        {
+          if( m && (m->source_type() == SpecUtils::SourceType::Foreground) )
+            samples.insert( m->sample_number() );
+        }
+      }//if( all_samples.size() == 1 ) / else
+    }//if( samples.empty() )
+    
+    if( samples.empty() )
+      throw BadRequest( "Could not determine the foreground samples; please specify 'samples'." );
+    
+    shared_ptr<const SpecUtils::Measurement> spectrum
+                                  = meas.sum_measurements( samples, meas.detector_names(), nullptr );
+    if( !spectrum || (spectrum->num_gamma_channels() < 16) )
+      throw BadRequest( "Could not get a gamma spectrum for the foreground samples." );
+    
+    return spectrum;
+  }//foreground_spectrum(...)
+#endif //USE_REL_ACT_TOOL
+  
+  
+  /** The inputs, parsed from the request parameters, common to all the analysis types. */
+  struct AnalysisRequest
+  {
+    std::string m_exemplar_path;
+    std::shared_ptr<SpecMeas> m_exemplar;
+    std::set<int> m_exemplar_samples;
+    
+    /** The path to read the spectrum file from; either given by the "file" parameter, or the
+     spool file of the uploaded "spectrum".
+     */
+    std::string m_spectrum_path;
+    
+    /** The name to report the spectrum file as, in the results. */
+    std::string m_display_name;
+    
+    std::set<int> m_samples;
+    
+    BatchActivity::BatchActivityFitOptions m_options;
+  };//struct AnalysisRequest
+  
+  
+  AnalysisRequest parse_request( const Wt::Http::Request &request, const bool exemplar_must_be_n42 )
+  {
+    AnalysisRequest input;
+    
+    input.m_exemplar_path = string_param( request, "exemplar" );
+    if( input.m_exemplar_path.empty() )
+      throw BadRequest( "The 'exemplar' parameter must be specified." );
+    
+    input.m_exemplar = exemplar_n42( input.m_exemplar_path );
+    if( exemplar_must_be_n42 && !input.m_exemplar )
+      throw BadRequest( "Exemplar file '" + input.m_exemplar_path + "' is not a N42 file." );
+    
+    input.m_exemplar_samples = sample_numbers_param( request, "exemplar_samples" );
+    input.m_samples = sample_numbers_param( request, "samples" );
+    
+    const Wt::Http::UploadedFileMap &uploads = request.uploadedFiles();
+    const auto upload = uploads.find( "spectrum" );
+    if( upload != end(uploads) )
+    {
+      input.m_spectrum_path = upload->second.spoolFileName();
+      input.m_display_name = upload->second.clientFileName();
+    }else
+    {
+      input.m_spectrum_path = string_param( request, "file" );
+      input.m_display_name = input.m_spectrum_path;
+    }
+    
+    if( input.m_spectrum_path.empty() )
+      throw BadRequest( "Either the 'file' parameter, or an uploaded 'spectrum', must be specified." );
+    
+    BatchActivity::BatchActivityFitOptions &options = input.m_options;
+    options.to_stdout = false;
+    options.refit_energy_cal = bool_param( request, "refit_energy_cal" );
+    options.use_exemplar_energy_cal = bool_param( request, "use_exemplar_energy_cal" );
+    options.write_n42_with_peaks = false;
+    options.show_nonfit_peaks = false;
+    options.num_threads = 1;
+    
+    return input;
+  }//AnalysisRequest parse_request(...)
+  
+  
+  void write_peak_results( ostream &json, const AnalysisRequest &input )
+  {
+    const BatchPeak::BatchPeakFitResult results
+              = BatchPeak::fit_peaks_in_file( input.m_exemplar_path, input.m_exemplar_samples,
+                                              input.m_exemplar, input.m_spectrum_path, nullptr,
+                                              input.m_samples, input.m_options );
+    
+    BatchPeak::write_json_line( json, input.m_display_name, results, results.fit_peaks );
+  }//void write_peak_results(...)
+  
+  
+  void write_activity_results( ostream &json, const AnalysisRequest &input )
+  {
+    using BatchActivity::BatchActivityFitResult;
+    using BatchPeak::json_escape;
+    
+    const BatchActivityFitResult results
+          = BatchActivity::fit_activities_in_file( input.m_exemplar_path, input.m_exemplar_samples,
+                                                   input.m_exemplar, input.m_spectrum_path,
+                                                   input.m_options );
+    
+    const bool success = (results.m_result_code == BatchActivityFitResult::ResultCode::Success)
+                         && results.m_fit_results;
+    
+    json << "{\"file\":\"" << json_escape(input.m_display_name) << "\""
+         << ",\"success\":" << (success ? "true" : "false")
+         << ",\"resultCode\":" << static_cast<int>(results.m_result_code);
+    if( !results.m_error_msg.empty() )
+      json << ",\"error\":\"" << json_escape(results.m_error_msg) << "\"";
+    
+    json << ",\"warnings\":[";
+    for( size_t i = 0; i < results.m_warnings.size(); ++i )
+      json << (i ? "," : "") << "\"" << json_escape(results.m_warnings[i]) << "\"";
+    json << "]";
+    
+    if( success )
+    {
+      const ShieldingSourceFitCalc::ModelFitResults &fit = *results.m_fit_results;
+      json << ",\"chi2\":" << fit.chi2
+           << ",\"distanceCm\":" << (fit.distance / PhysicalUnits::cm)
+           << ",\"sources\":[";
+      for( size_t i = 0; i < fit.fit_src_info.size(); ++i )
+      {
+        const ShieldingSourceFitCalc::IsoFitStruct &src = fit.fit_src_info[i];
+        json << (i ? "," : "") << "{\"nuclide\":\""
+             << json_escape(src.nuclide ? src.nuclide->symbol : string()) << "\""
+             << ",\"activityBq\":" << (src.activity / PhysicalUnits::bq)
+             << ",\"activityUncertBq\":" << (src.activityUncertainty / PhysicalUnits::bq)
+             << ",\"activityFit\":" << (src.fitActivity ? "true" : "false")
+             << ",\"ageSeconds\":" << (src.age / PhysicalUnits::second)
+             << ",\"ageUncertSeconds\":" << (src.ageUncertainty / PhysicalUnits::second)
+             << ",\"ageFit\":" << (src.fitAge ? "true" : "false")
+             << "}";
+      }//for( loop over fit sources )
+      json << "]";
+    }//if( success )
+    
+    json << "}\n";
+  }//void write_activity_results(...)
+  
+  
+#if( USE_REL_ACT_TOOL )
+  void write_relact_results( ostream &json, const AnalysisRequest &input )
+  {
+    using BatchPeak::json_escape;
+    using namespace rapidxml;
+    
+    assert( input.m_exemplar );
+    const rapidxml::xml_document<char> * const state = input.m_exemplar->relActAutoGuiState();
+    const xml_node<char> * const base_node = state ? XML_FIRST_NODE(state, "RelActCalcAuto") : nullptr;
+    if( !base_node )
+      throw BadRequest( "Exemplar file does not contain an 'Isotopics by nuclides' analysis." );
+    
+    const xml_node<char> *node = XML_FIRST_NODE(base_node, "Options");
+    if( !node )
+      throw BadRequest( "Exemplar 'Isotopics by nuclides' analysis has no <Options> node." );
+    
+    RelActCalcAuto::Options options;
+    options.fromXml( node );
+    
+    vector<RelActCalcAuto::RoiRange> rois;
+    node = XML_FIRST_NODE(base_node, "RoiRangeList");
+    if( node )
+    {
+      XML_FOREACH_CHILD( roi_node, node, "RoiRange" )
+      {
+        RelActCalcAuto::RoiRange roi;
+        roi.fromXml( roi_node );
+        rois.push_back( roi );
+      }
+    }//if( node )
+    
+    vector<RelActCalcAuto::NucInputInfo> nucs;
+    node = XML_FIRST_NODE(base_node, "NucInputInfoList");
+    if( node )
+    {
+      XML_FOREACH_CHILD( nuc_node, node, "NucInputInfo" )
+      {
+        RelActCalcAuto::NucInputInfo nuc;
+        nuc.fromXml( nuc_node );
+        nucs.push_back( nuc );
+      }
+    }//if( node )
+    
+    vector<RelActCalcAuto::FloatingPeak> floating_peaks;
+    node = XML_FIRST_NODE(base_node, "FloatingPeakList");
+    if( node )
+    {
+      XML_FOREACH_CHILD( peak_node, node, "FloatingPeak" )
+      {
+        RelActCalcAuto::FloatingPeak peak;
+        peak.fromXml( peak_node );
+        floating_peaks.push_back( peak );
+      }
+    }//if( node )
+    
+    SpecMeas meas;
+    if( !meas.load_file( input.m_spectrum_path, SpecUtils::ParserType::Auto, input.m_display_name ) )
+      throw BadRequest( "Could not read '" + input.m_display_name + "' as a spectrum file." );
+    
+    const shared_ptr<const SpecUtils::Measurement> foreground = foreground_spectrum( meas, input.m_samples );
+    
+    const RelActCalcAuto::RelActAutoSolution solution
+                     = RelActCalcAuto::solve( options, rois, nucs, floating_peaks, foreground,
+                                              nullptr, nullptr, {} );
+    
+    const bool success = (solution.m_status == RelActCalcAuto::RelActAutoSolution::Status::Success);
+    
+    json << "{\"file\":\"" << json_escape(input.m_display_name) << "\""
+         << ",\"success\":" << (success ? "true" : "false");
+    if( !solution.m_error_message.empty() )
+      json << ",\"error\":\"" << json_escape(solution.m_error_message) << "\"";
+    
+    json << ",\"warnings\":[";
+    for( size_t i = 0; i < solution.m_warnings.size(); ++i )
+      json << (i ? "," : "") << "\"" << json_escape(solution.m_warnings[i]) << "\"";
+    json << "]";
+    
+    if( success )
+    {
+      const vector<double> mass_fractions = solution.mass_enrichment_fractions();
+      
+      json << ",\"chi2\":" << solution.m_chi2
+           << ",\"dof\":" << solution.m_dof
+           << ",\"nuclides\":[";
+      for( size_t i = 0; i < solution.m_rel_activities.size(); ++i )
+      {
+        const RelActCalcAuto::NuclideRelAct &act = solution.m_rel_activities[i];
+        json << (i ? "," : "") << "{\"nuclide\":\""
+             << json_escape(act.nuclide ? act.nuclide->symbol : string()) << "\""
+             << ",\"relActivity\":" << act.rel_activity
+             << ",\"relActivityUncert\":" << act.rel_activity_uncertainty
+             << ",\"ageSeconds\":" << (act.age / PhysicalUnits::second)
+             << ",\"ageFit\":" << (act.age_was_fit ? "true" : "false");
+        if( i < mass_fractions.size() )
+          json << ",\"massFraction\":" << mass_fractions[i];
+        json << "}";
+      }//for( loop over nuclides )
+      json << "]";
+    }//if( success )
+    
+    json << "}\n";
+  }//void write_relact_results(...)
+#endif //USE_REL_ACT_TOOL
+  
+  
+  /** Serves one of the analysis types; see BatchService.h for the parameters. */
+  class BatchAnalysisResource : public Wt::WResource
+  {
+  public:
+    enum class Analysis { Peaks, Activity, RelAct };
+    
+    explicit BatchAnalysisResource( const Analysis type )
+      : Wt::WResource(),
+        m_type( type )
+    {
+    }
+    
+    virtual ~BatchAnalysisResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request, Wt::Http::Response &response )
+    {
+      const std::string client = request.clientAddress();
+      if( (client != "127.0.0.1") && (client != "::1") && (client != "::ffff:127.0.0.1") )
+      {
+        response.setStatus( 403 );
+        return;
+      }
+      
+      response.setMimeType( "application/json" );
+      response.addHeader( "Cache-Control", "no-store" );
+      
+      struct Result
+      {
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_done = false;
+        bool m_abandoned = false;
+        int m_status = 200;
+        std::string m_json;
+      };//struct Result
+      
+      auto result = std::make_shared<Result>();
+      
+      shared_ptr<AnalysisRequest> input;
+      try
+      {
+        input = make_shared<AnalysisRequest>( parse_request( request, (m_type != Analysis::Peaks) ) );
+        
+        if( m_type == Analysis::Activity )
+        {
+          input->m_options.drf_override = drf_from_name( string_param( request, "drf_file" ),
+                                                        string_param( request, "drf_name" ) );
+          const string max_time = string_param( request, "max_fit_seconds" );
+          if( !max_time.empty() && !SpecUtils::parse_double( max_time.c_str(), max_time.size(),
+                                                              input->m_options.max_fit_seconds ) )
+            throw BadRequest( "Invalid 'max_fit_seconds' parameter: '" + max_time + "'" );
+        }//if( m_type == Analysis::Activity )
+      }catch( std::exception &e )
+      {
+        const bool bad_request = (dynamic_cast<const BadRequest *>( &e ) != nullptr);
+        response.setStatus( bad_request ? 400 : 500 );
+        response.out() << "{\"success\":false,\"error\":\"" << BatchPeak::json_escape(e.what()) << "\"}";
+        return;
+      }//try / catch
+      
+      const Analysis type = m_type;
+      ComputeScheduler::post( "batch-service:" + client, ComputeScheduler::Priority::Batch,
+        [result, input, type](){
+          {
+            std::lock_guard<std::mutex> lock( result->m_mutex );
+            if( result->m_abandoned )
+              return;
+          }
+          
+          int status = 200;
+          std::ostringstream json;
+          try
+          {
+            switch( type )
+            {
+              case Analysis::Peaks:
+                write_peak_results( json, *input );
+                break;
+                
+              case Analysis::Activity:
+                write_activity_results( json, *input );
+                break;
+                
+              case Analysis::RelAct:
+#if( USE_REL_ACT_TOOL )
+                write_relact_results( json, *input );
+#else
+                throw BadRequest( "This build does not include the relative activity tools." );
+#endif
+                break;
+            }//switch( type )
+          }catch( std::exception &e )
+          {
+            status = (dynamic_cast<const BadRequest *>( &e ) != nullptr) ? 400 : 500;
+            json.str( "" );
+            json << "{\"file\":\"" << BatchPeak::json_escape(input->m_display_name) << "\""
+                 << ",\"success\":false,\"error\":\"" << BatchPeak::json_escape(e.what()) << "\"}";
+          }//try / catch
+          
+          std::lock_guard<std::mutex> lock( result->m_mutex );
+          result->m_status = status;
+          result->m_json = json.str();
+          result->m_done = true;
+          result->m_cv.notify_all();
+        } );
+      
+      std::unique_lock<std::mutex> lock( result->m_mutex );
+      if( !result->m_cv.wait_for( lock, ns_max_request_wait, [&result](){ return result->m_done; } ) )
+      {
+        // If the job hasnt started yet, it wont be ran; if it has started, its result is discarded.
+        result->m_abandoned = true;
+        response.setStatus( 503 );
+        response.out() << "{\"success\":false,\"error\":\"Timed out waiting for the analysis.\"}";
+        return;
+      }
+      
+      response.setStatus( result->m_status );
+      response.out() << result->m_json;
+    }//void handleRequest(...)
+    
+  private:
+    const Analysis m_type;
+  };//class BatchAnalysisResource
+  
+  
+  std::mutex ns_resources_mutex;
+  std::vector<std::unique_ptr<BatchAnalysisResource>> ns_resources;
+}//namespace
+
+
+namespace BatchService
+{
+void add_resources_to_server( Wt::WServer *server )
+{
+  assert( server );
+  if( !server )
+    return;
+  
+  std::lock_guard<std::mutex> lock( ns_resources_mutex );
+  if( !ns_resources.empty() )
+    return;
+  
+  const pair<BatchAnalysisResource::Analysis,const char *> endpoints[] = {
+    { BatchAnalysisResource::Analysis::Peaks,    "/api/batch/peaks" },
+    { BatchAnalysisResource::Analysis::Activity, "/api/batch/activity" },
+#if( USE_REL_ACT_TOOL )
+    { BatchAnalysisResource::Analysis::RelAct,   "/api/batch/relact" },
+#endif
+  };
+  
+  for( const auto &endpoint : endpoints )
+  {
+    ns_resources.emplace_back( new BatchAnalysisResource( endpoint.first ) );
+    server->addResource( ns_resources.back().get(), endpoint.second );
+  }
+}//void add_resources_to_server( Wt::WServer *server )
+}//namespace BatchService
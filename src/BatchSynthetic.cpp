@@ -0,0 +1,415 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/GadrasSpecFunc.h"
+#include "InterSpec/BatchSynthetic.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+using namespace std;
+
+namespace
+{
+  /** The number of peak sigma, on either side of the mean, the Gaussian is integrated over. */
+  const double ns_peak_num_sigma = 8.0;
+  
+  
+  shared_ptr<SpecUtils::EnergyCalibration> make_energy_cal( const BatchSynthetic::SyntheticSpectrumOptions &options )
+  {
+    if( options.num_channels < 16 )
+      throw runtime_error( "Synthetic spectra must have at least 16 channels." );
+    
+    if( !(options.max_energy > 0.0f) || !std::isfinite(options.max_energy) )
+      throw runtime_error( "Synthetic spectra max energy must be positive." );
+    
+    const float gain = options.max_energy / static_cast<float>(options.num_channels);
+    
+    auto cal = make_shared<SpecUtils::EnergyCalibration>();
+    cal->set_polynomial( options.num_channels, {0.0f, gain}, {} );
+    
+    return cal;
+  }//make_energy_cal(...)
+  
+  
+  /** Returns the DRF efficiency at the given energy, or zero if the DRF gives an invalid value. */
+  double drf_efficiency( const DetectorPeakResponse &drf, const float energy, const double distance )
+  {
+    const double eff = drf.efficiency( energy, distance );
+    return (std::isfinite(eff) && (eff > 0.0)) ? eff : 0.0;
+  }//drf_efficiency(...)
+  
+  
+  string source_description( const BatchSynthetic::SyntheticSource &src )
+  {
+    return src.nuclide->symbol + " " + PhysicalUnits::printToBestActivityUnits( src.activity, 4 )
+           + " aged " + PhysicalUnits::printToBestTimeUnits( src.age, 4 );
+  }//source_description(...)
+  
+  
+  void write_truth_csv( const string &filename,
+                        const BatchSynthetic::SyntheticSpectrumOptions &options,
+                        const vector<BatchSynthetic::SyntheticLine> &lines,
+                        const vector<double> &record_counts,
+                        const double expected_total )
+  {
+#ifdef _WIN32
+    const std::wstring wfilename = SpecUtils::convert_from_utf8_to_utf16(filename);
+    ofstream output( wfilename.c_str(), ios::binary | ios::out );
+#else
+    ofstream output( filename.c_str(), ios::binary | ios::out );
+#endif
+    if( !output )
+      throw runtime_error( "Unable to open '" + filename + "' for writing." );
+    
+    output << "# Synthetic spectrum ground truth\n"
+           << "# DRF," << options.drf->name() << "\n"
+           << "# Distance (cm)," << options.distance/PhysicalUnits::cm << "\n"
+           << "# Live time (s)," << options.live_time/PhysicalUnits::second << "\n"
+           << "# Shielding atomic number," << options.shield_atomic_number << "\n"
+           << "# Shielding areal density (g/cm2)," << options.shield_areal_density << "\n"
+           << "# Seed," << options.seed << "\n";
+    for( const BatchSynthetic::SyntheticSource &src : options.sources )
+      output << "# Source," << source_description( src ) << "\n";
+    
+    output << "\nNuclide,Energy (keV),Source Gammas/s,Expected Peak Counts,FWHM (keV)\n";
+    for( const BatchSynthetic::SyntheticLine &line : lines )
+    {
+      output << (line.parent ? line.parent->symbol : string()) << "," << line.energy
+             << "," << line.source_rate << "," << line.expected_counts << "," << line.fwhm << "\n";
+    }
+    
+    output << "\nSample Number,Expected Total Counts,Actual Total Counts\n";
+    for( size_t i = 0; i < record_counts.size(); ++i )
+      output << (i + 1) << "," << expected_total << "," << record_counts[i] << "\n";
+    
+    if( !output )
+      throw runtime_error( "Error writing '" + filename + "'." );
+  }//void write_truth_csv(...)
+}//namespace
+
+
+namespace BatchSynthetic
+{
+SyntheticSource source_from_string( const std::string &input )
+{
+  vector<string> fields;
+  SpecUtils::split( fields, input, "," );
+  for( string &field : fields )
+    SpecUtils::trim( field );
+  
+  if( (fields.size() < 2) || (fields.size() > 3) )
+    throw runtime_error( "Invalid source '" + input + "': must be of the form"
+                         " 'nuclide,activity[,age]' (ex. 'Cs137,1uCi,20y')." );
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  if( !db )
+    throw runtime_error( "Unable to load the nuclide decay database." );
+  
+  SyntheticSource src;
+  src.nuclide = db->nuclide( fields[0] );
+  if( !src.nuclide )
+    throw runtime_error( "Invalid nuclide '" + fields[0] + "'." );
+  
+  try
+  {
+    src.activity = PhysicalUnits::stringToActivity( fields[1] );
+  }catch( std::exception & )
+  {
+    throw runtime_error( "Invalid activity '" + fields[1] + "' for " + src.nuclide->symbol + "." );
+  }
+  
+  if( !(src.activity > 0.0) )
+    throw runtime_error( "Activity for " + src.nuclide->symbol + " must be positive." );
+  
+  if( fields.size() > 2 )
+  {
+    try
+    {
+      src.age = PhysicalUnits::stringToTimeDurationPossibleHalfLife( fields[2], src.nuclide->halfLife );
+    }catch( std::exception & )
+    {
+      throw runtime_error( "Invalid age '" + fields[2] + "' for " + src.nuclide->symbol + "." );
+    }
+    
+    if( (src.age < 0.0) || !std::isfinite(src.age) )
+      throw runtime_error( "Age for " + src.nuclide->symbol + " must not be negative." );
+  }else
+  {
+    src.age = PeakDef::defaultDecayTime( src.nuclide );
+  }//if( age specified ) / else
+  
+  return src;
+}//SyntheticSource source_from_string( const std::string &input )
+  
+  
+void expected_spectrum( const SyntheticSpectrumOptions &options,
+                        std::vector<float> &lower_channel_energies,
+                        std::vector<double> &expected_counts,
+                        std::vector<SyntheticLine> &lines )
+{
+  lines.clear();
+  
+  if( !options.drf || !options.drf->isValid() )
+    throw runtime_error( "A valid detector response function must be specified." );
+  
+  if( !options.drf->hasResolutionInfo() )
+    throw runtime_error( "The detector response function must have resolution information." );
+  
+  if( options.sources.empty() )
+    throw runtime_error( "At least one source must be specified." );
+  
+  if( !(options.live_time > 0.0) )
+    throw runtime_error( "Live time must be positive." );
+  
+  if( !options.drf->isFixedGeometry() && !(options.distance > 0.0) )
+    throw runtime_error( "Distance must be positive." );
+  
+  if( (options.shield_areal_density < 0.0f) || !std::isfinite(options.shield_areal_density) )
+    throw runtime_error( "Shielding areal density must not be negative." );
+  
+  const shared_ptr<SpecUtils::EnergyCalibration> cal = make_energy_cal( options );
+  const size_t nchannel = options.num_channels;
+  
+  lower_channel_energies = *cal->channel_energies();
+  assert( lower_channel_energies.size() == (nchannel + 1) );
+  
+  expected_counts.clear();
+  expected_counts.resize( nchannel, 0.0 );
+  
+  const float min_energy = lower_channel_energies.front();
+  const float max_energy = lower_channel_energies.back();
+  
+  // Collect gamma and x-ray lines, from all sources, that are in the spectrum energy range
+  vector<float> energies, intensities;
+  for( const SyntheticSource &src : options.sources )
+  {
+    if( !src.nuclide )
+      throw runtime_error( "Invalid (null) source nuclide." );
+    
+    const vector<SandiaDecay::EnergyRatePair> photons
+        = DecayedPhotonCache::photons_for_aged_activity( src.nuclide, src.activity, src.age,
+                                                         DecayedPhotonCache::Emissions::Photons,
+                                                         SandiaDecay::NuclideMixture::OrderByEnergy );
+    
+    for( const SandiaDecay::EnergyRatePair &photon : photons )
+    {
+      const float energy = static_cast<float>( photon.energy );
+      if( (energy <= min_energy) || (energy >= max_energy) || !(photon.numPerSecond > 0.0) )
+        continue;
+      
+      SyntheticLine line;
+      line.parent = src.nuclide;
+      line.energy = energy;
+      line.source_rate = photon.numPerSecond;
+      line.fwhm = 2.35482f * options.drf->peakResolutionSigma( energy );
+      lines.push_back( line );
+      
+      energies.push_back( energy );
+      intensities.push_back( static_cast<float>(photon.numPerSecond * options.live_time) );
+    }//for( const SandiaDecay::EnergyRatePair &photon : photons )
+  }//for( const SyntheticSource &src : options.sources )
+  
+  // Attenuate the lines, and compute the scatter continuum, through the shielding
+  vector<float> uncollided = intensities;
+  if( options.shield_areal_density > 0.0f )
+  {
+    const string datafile = SpecUtils::append_path( InterSpec::staticDataDirectory(), "GadrasContinuum.lib" );
+    const shared_ptr<const GadrasScatterTable> scatter = GadrasScatterTable::instance( datafile );
+    
+    // The continuum is the number of scattered gammas (into 4 pi) with energy in each channel;
+    //  `addContinuum` requires the answer to be the same size as the binning, so the last entry
+    //  holds the gammas above the last channel, and is discarded.
+    vector<double> continuum( lower_channel_energies.size(), 0.0 );
+    scatter->addContinuum( continuum, uncollided, energies, intensities,
+                           options.shield_atomic_number, options.shield_areal_density,
+                           0.0f, lower_channel_energies );
+    
+    for( size_t i = 0; i < nchannel; ++i )
+    {
+      if( continuum[i] <= 0.0 )
+        continue;
+      const float mid_energy = 0.5f*(lower_channel_energies[i] + lower_channel_energies[i+1]);
+      expected_counts[i] += continuum[i] * drf_efficiency( *options.drf, mid_energy, options.distance );
+    }
+  }//if( options.shield_areal_density > 0.0f )
+  
+  assert( uncollided.size() == lines.size() );
+  
+  // Add the full-energy peaks
+  for( size_t i = 0; i < lines.size(); ++i )
+  {
+    SyntheticLine &line = lines[i];
+    const double eff = drf_efficiency( *options.drf, line.energy, options.distance );
+    line.expected_counts = uncollided[i] * eff;
+    
+    const double sigma = line.fwhm / 2.35482;
+    if( !(line.expected_counts > 0.0) || !(sigma > 0.0) )
+      continue;
+    
+    const PeakDef peak( line.energy, sigma, line.expected_counts );
+    
+    const float lower_energy = static_cast<float>( line.energy - ns_peak_num_sigma*sigma );
+    const float upper_energy = static_cast<float>( line.energy + ns_peak_num_sigma*sigma );
+    const auto lower_pos = std::upper_bound( begin(lower_channel_energies), end(lower_channel_energies), lower_energy );
+    const auto upper_pos = std::upper_bound( begin(lower_channel_energies), end(lower_channel_energies), upper_energy );
+    
+    const size_t start_channel = (lower_pos == begin(lower_channel_energies))
+                                  ? size_t(0)
+                                  : static_cast<size_t>( (lower_pos - begin(lower_channel_energies)) - 1 );
+    const size_t end_channel = std::min( nchannel,
+                                  static_cast<size_t>( upper_pos - begin(lower_channel_energies) ) );
+    
+    if( end_channel > start_channel )
+      peak.gauss_integral( &(lower_channel_energies[start_channel]),
+                           &(expected_counts[start_channel]), end_channel - start_channel );
+  }//for( size_t i = 0; i < lines.size(); ++i )
+}//void expected_spectrum(...)
+  
+  
+std::vector<std::string> generate_synthetic_files( const SyntheticSpectrumOptions &options )
+{
+  if( (options.format != SpecUtils::SaveSpectrumAsType::N42_2012)
+     && (options.format != SpecUtils::SaveSpectrumAsType::Pcf) )
+    throw runtime_error( "Synthetic spectra can only be written as N42-2012 or PCF files." );
+  
+  if( options.output_dir.empty() || !SpecUtils::is_directory(options.output_dir) )
+    throw runtime_error( "Output directory '" + options.output_dir + "' is not a valid directory." );
+  
+  if( options.records_per_file < 1 )
+    throw runtime_error( "There must be at least one record per file." );
+  
+  if( options.num_files < 1 )
+    throw runtime_error( "At least one file must be written." );
+  
+  vector<float> lower_energies;
+  vector<double> expected;
+  vector<SyntheticLine> lines;
+  expected_spectrum( options, lower_energies, expected, lines );
+  
+  const shared_ptr<SpecUtils::EnergyCalibration> cal = make_energy_cal( options );
+  const double expected_total = std::accumulate( begin(expected), end(expected), 0.0 );
+  const size_t nchannel = expected.size();
+  
+  vector<string> remarks;
+  remarks.push_back( "Synthetic spectrum generated by InterSpec" );
+  for( const SyntheticSource &src : options.sources )
+    remarks.push_back( "Source: " + source_description(src) );
+  
+  const string extension = (options.format == SpecUtils::SaveSpectrumAsType::Pcf) ? ".pcf" : ".n42";
+  
+  std::mt19937 rng( options.seed );
+  vector<string> written_files;
+  
+  for( size_t file_index = 0; file_index < options.num_files; ++file_index )
+  {
+    const string base_name = options.base_name + "_" + std::to_string(file_index + 1);
+    const string spec_filename = SpecUtils::append_path( options.output_dir, base_name + extension );
+    const string truth_filename = SpecUtils::append_path( options.output_dir, base_name + "_truth.csv" );
+    
+    if( options.refuse_overwrite
+       && (SpecUtils::is_file(spec_filename) || SpecUtils::is_file(truth_filename)) )
+      throw runtime_error( "Refusing to overwrite existing file '" + spec_filename + "'." );
+    
+    auto meas = make_shared<SpecMeas>();
+    meas->setDetector( options.drf );
+    
+    vector<double> record_counts;
+    for( size_t record = 0; record < options.records_per_file; ++record )
+    {
+      auto counts = make_shared<vector<float>>( nchannel, 0.0f );
+      double total = 0.0;
+      for( size_t i = 0; i < nchannel; ++i )
+      {
+        if( !(expected[i] > 0.0) )
+          continue;
+        
+        std::poisson_distribution<long long> poisson( expected[i] );
+        const float value = static_cast<float>( poisson(rng) );
+        (*counts)[i] = value;
+        total += value;
+      }//for( size_t i = 0; i < nchannel; ++i )
+      
+      record_counts.push_back( total );
+      
+      auto m = make_shared<SpecUtils::Measurement>();
+      m->set_gamma_counts( counts, static_cast<float>(options.live_time), static_cast<float>(options.live_time) );
+      m->set_energy_calibration( cal );
+      m->set_sample_number( static_cast<int>(record + 1) );
+      m->set_detector_name( "Aa1" );
+      m->set_source_type( SpecUtils::SourceType::Foreground );
+      m->set_remarks( remarks );
+      
+      meas->add_measurement( m, false );
+    }//for( size_t record = 0; record < options.records_per_file; ++record )
+    
+    meas->cleanup_after_load( SpecUtils::SpecFile::DontChangeOrReorderSamples );
+    
+    bool wrote = false;
+    if( options.format == SpecUtils::SaveSpectrumAsType::N42_2012 )
+    {
+      wrote = meas->save2012N42File( spec_filename );
+    }else
+    {
+#ifdef _WIN32
+      const std::wstring wfilename = SpecUtils::convert_from_utf8_to_utf16(spec_filename);
+      ofstream output( wfilename.c_str(), ios::binary | ios::out );
+#else
+      ofstream output( spec_filename.c_str(), ios::binary | ios::out );
+#endif
+      wrote = output.is_open() && meas->write_pcf( output );
+    }//if( N42 ) / else( PCF )
+    
+    if( !wrote )
+      throw runtime_error( "Error writing '" + spec_filename + "'." );
+    
+    write_truth_csv( truth_filename, options, lines, record_counts, expected_total );
+    
+    written_files.push_back( spec_filename );
+  }//for( size_t file_index = 0; file_index < options.num_files; ++file_index )
+  
+  return written_files;
+}//std::vector<std::string> generate_synthetic_files( const SyntheticSpectrumOptions &options )
+}//namespace BatchSynthetic
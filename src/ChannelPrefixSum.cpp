@@ -0,0 +1,273 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/ChannelPrefixSum.h"
+
+using namespace std;
+
+namespace
+{
+  struct CachedPrefixSum
+  {
+    std::weak_ptr<const std::vector<float>> m_counts;
+    std::weak_ptr<const SpecUtils::EnergyCalibration> m_cal;
+    std::shared_ptr<const ChannelPrefixSum> m_sums;
+  };//struct CachedPrefixSum
+  
+  /** Maximum number of spectra to keep sums for; sums for a 16k channel spectrum are ~256 kB.
+   Foreground, background, and secondary, for a handful of sessions, should all fit.
+   */
+  const size_t ns_max_cached_sums = 24;
+  
+  std::mutex ns_cache_mutex;
+  
+  /** Most recently used sums at the front. */
+  std::list<CachedPrefixSum> ns_cached_sums;
+}//namespace
+
+
+ChannelPrefixSum::ChannelPrefixSum( const std::shared_ptr<const std::vector<float>> &counts,
+                                    const std::shared_ptr<const SpecUtils::EnergyCalibration> &cal )
+  : m_counts( counts ),
+  m_energies( nullptr )
+{
+  if( !counts )
+    throw runtime_error( "ChannelPrefixSum: null channel counts." );
+  
+  const vector<float> &c = *counts;
+  const size_t nchannel = c.size();
+  
+  if( cal && cal->valid() )
+  {
+    m_energies = cal->channel_energies();
+    if( m_energies && (m_energies->size() < (nchannel + 1)) )
+      throw runtime_error( "ChannelPrefixSum: energy calibration has too few channels." );
+  }//if( cal && cal->valid() )
+  
+  m_cumulative.resize( nchannel + 1, 0.0 );
+  for( size_t i = 0; i < nchannel; ++i )
+    m_cumulative[i+1] = m_cumulative[i] + c[i];
+  
+  if( m_energies )
+  {
+    const vector<float> &energies = *m_energies;
+    m_cumulative_energy.resize( nchannel + 1, 0.0 );
+    for( size_t i = 0; i < nchannel; ++i )
+    {
+      const double center = 0.5*(static_cast<double>(energies[i]) + energies[i+1]);
+      m_cumulative_energy[i+1] = m_cumulative_energy[i] + center*c[i];
+    }
+  }//if( m_energies )
+}//ChannelPrefixSum constructor
+
+
+size_t ChannelPrefixSum::numChannels() const
+{
+  return m_cumulative.size() - 1;
+}
+
+
+bool ChannelPrefixSum::hasEnergyCalibration() const
+{
+  return !!m_energies;
+}
+
+
+double ChannelPrefixSum::channelSum( size_t first, size_t last ) const
+{
+  const size_t nchannel = numChannels();
+  if( first > last )
+    std::swap( first, last );
+  
+  if( first >= nchannel )
+    return 0.0;
+  
+  last = std::min( last, nchannel - 1 );
+  
+  return m_cumulative[last + 1] - m_cumulative[first];
+}//double channelSum( size_t first, size_t last ) const
+
+
+void ChannelPrefixSum::channel_and_fraction( const double energy, size_t &channel, double &fraction ) const
+{
+  assert( m_energies );
+  const vector<float> &energies = *m_energies;
+  const size_t nchannel = numChannels();
+  
+  fraction = 0.0;
+  
+  if( !nchannel || (energy <= energies[0]) )
+  {
+    channel = 0;
+    return;
+  }
+  
+  if( energy >= energies[nchannel] )
+  {
+    channel = nchannel;
+    return;
+  }
+  
+  const auto begin_energy = std::begin(energies);
+  channel = static_cast<size_t>( std::upper_bound( begin_energy, begin_energy + nchannel + 1, energy ) - begin_energy ) - 1;
+  assert( channel < nchannel );
+  
+  const double width = energies[channel+1] - energies[channel];
+  fraction = (width > 0.0) ? ((energy - energies[channel]) / width) : 0.0;
+}//void channel_and_fraction(...)
+
+
+double ChannelPrefixSum::integral( double lower_energy, double upper_energy ) const
+{
+  if( !m_energies )
+    return 0.0;
+  
+  if( lower_energy > upper_energy )
+    std::swap( lower_energy, upper_energy );
+  
+  const vector<float> &counts = *m_counts;
+  
+  const auto counts_below = [&]( const double energy ) -> double {
+    size_t channel;
+    double fraction;
+    channel_and_fraction( energy, channel, fraction );
+    return m_cumulative[channel] + ((fraction > 0.0) ? fraction*counts[channel] : 0.0);
+  };
+  
+  return counts_below( upper_energy ) - counts_below( lower_energy );
+}//double integral(...)
+
+
+double ChannelPrefixSum::energyWeightedIntegral( double lower_energy, double upper_energy ) const
+{
+  if( !m_energies )
+    return 0.0;
+  
+  if( lower_energy > upper_energy )
+    std::swap( lower_energy, upper_energy );
+  
+  const vector<float> &counts = *m_counts;
+  const vector<float> &energies = *m_energies;
+  
+  // For the partial channel, the counts are uniform in energy, so the integral of counts times energy,
+  //  from the lower edge of the channel up to `energy` is: counts*(energy^2 - lower^2)/(2*width).
+  const auto weighted_below = [&]( const double energy ) -> double {
+    size_t channel;
+    double fraction;
+    channel_and_fraction( energy, channel, fraction );
+    if( fraction <= 0.0 )
+      return m_cumulative_energy[channel];
+    
+    const double lower = energies[channel];
+    return m_cumulative_energy[channel] + fraction*counts[channel]*0.5*(lower + energy);
+  };
+  
+  return weighted_below( upper_energy ) - weighted_below( lower_energy );
+}//double energyWeightedIntegral(...)
+
+
+std::shared_ptr<const ChannelPrefixSum> ChannelPrefixSum::get( const std::shared_ptr<const SpecUtils::Measurement> &meas )
+{
+  if( !meas )
+    return nullptr;
+  
+  const shared_ptr<const vector<float>> counts = meas->gamma_counts();
+  const shared_ptr<const SpecUtils::EnergyCalibration> cal = meas->energy_calibration();
+  if( !counts || counts->empty() )
+    return nullptr;
+  
+  {//begin lock on ns_cache_mutex
+    std::lock_guard<std::mutex> lock( ns_cache_mutex );
+    
+    for( auto iter = begin(ns_cached_sums); iter != end(ns_cached_sums); )
+    {
+      const shared_ptr<const vector<float>> cached_counts = iter->m_counts.lock();
+      if( !cached_counts )
+      {
+        // The spectrum is no longer in use anywhere - clean up the entry
+        iter = ns_cached_sums.erase( iter );
+        continue;
+      }
+      
+      if( (cached_counts == counts) && (iter->m_cal.lock() == cal) )
+      {
+        ns_cached_sums.splice( begin(ns_cached_sums), ns_cached_sums, iter );
+        return ns_cached_sums.front().m_sums;
+      }
+      
+      ++iter;
+    }//for( loop over cached sums )
+  }//end lock on ns_cache_mutex
+  
+  // Compute outside the lock; if another thread computes the same sums at the same time, thats
+  //  harmless.
+  auto answer = make_shared<const ChannelPrefixSum>( counts, cal );
+  
+  {//begin lock on ns_cache_mutex
+    std::lock_guard<std::mutex> lock( ns_cache_mutex );
+    
+    CachedPrefixSum entry;
+    entry.m_counts = counts;
+    entry.m_cal = cal;
+    entry.m_sums = answer;
+    ns_cached_sums.push_front( std::move(entry) );
+    
+    while( ns_cached_sums.size() > ns_max_cached_sums )
+      ns_cached_sums.pop_back();
+  }//end lock on ns_cache_mutex
+  
+  return answer;
+}//get(...)
+
+
+double ChannelPrefixSum::gamma_integral( const std::shared_ptr<const SpecUtils::Measurement> &meas,
+                                         double lower_energy, double upper_energy )
+{
+  const shared_ptr<const ChannelPrefixSum> sums = get( meas );
+  if( !sums || !sums->hasEnergyCalibration() )
+    return meas ? meas->gamma_integral( static_cast<float>(lower_energy), static_cast<float>(upper_energy) ) : 0.0;
+  
+  return sums->integral( lower_energy, upper_energy );
+}//gamma_integral(...)
+
+
+double ChannelPrefixSum::gamma_channels_sum( const std::shared_ptr<const SpecUtils::Measurement> &meas,
+                                             size_t first, size_t last )
+{
+  const shared_ptr<const ChannelPrefixSum> sums = get( meas );
+  return sums ? sums->channelSum( first, last ) : 0.0;
+}//gamma_channels_sum(...)
@@ -0,0 +1,724 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+
+#include <Wt/WPen>
+#include <Wt/WFont>
+#include <Wt/WBrush>
+#include <Wt/WColor>
+#include <Wt/WRectF>
+#include <Wt/WConfig.h>
+#include <Wt/WPainter>
+#include <Wt/WSvgImage>
+#include <Wt/WPainterPath>
+#ifdef WT_HAS_WRASTERIMAGE
+#include <Wt/WRasterImage>
+#endif
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/ColorTheme.h"
+#include "InterSpec/ChartImageRenderer.h"
+
+using namespace std;
+using namespace Wt;
+
+namespace
+{
+  /** The colors to draw with; the defaults are used for any color the theme leaves as default. */
+  struct ChartColors
+  {
+    WColor foreground, background, neutron, peak, axis, text, chart_background, margin;
+    
+    ChartColors( const shared_ptr<const ColorTheme> &theme, const bool time_chart )
+      : foreground( WColor(0, 0, 0) ),
+        background( WColor(0, 204, 255) ),
+        neutron( WColor(0, 153, 0) ),
+        peak( WColor(0, 51, 255) ),
+        axis( WColor(0, 0, 0) ),
+        text( WColor(0, 0, 0) ),
+        chart_background( WColor(255, 255, 255) ),
+        margin( WColor(255, 255, 255) )
+    {
+      if( !theme )
+        return;
+      
+      const auto use = []( WColor &dest, const WColor &src ){
+        if( !src.isDefault() )
+          dest = src;
+      };
+      
+      if( time_chart )
+      {
+        use( foreground, theme->timeChartGammaLine );
+        use( neutron, theme->timeChartNeutronLine );
+        use( axis, theme->timeAxisLines );
+        use( text, theme->timeChartText );
+        use( chart_background, theme->timeChartBackground );
+        use( margin, theme->timeChartMargins );
+      }else
+      {
+        use( foreground, theme->foregroundLine );
+        use( background, theme->backgroundLine );
+        use( peak, theme->defaultPeakLine );
+        use( axis, theme->spectrumAxisLines );
+        use( text, theme->spectrumChartText );
+        use( chart_background, theme->spectrumChartBackground );
+        use( margin, theme->spectrumChartMargins );
+      }//if( time_chart ) / else
+    }//ChartColors constructor
+  };//struct ChartColors
+  
+  
+  /** Maps data coordinates to pixels, for the plot area of the chart. */
+  struct PlotArea
+  {
+    double left, top, width, height;
+    double x_min, x_max, y_min, y_max;
+    bool log_y;
+    
+    double px( const double x ) const
+    {
+      return left + width * (x - x_min) / (x_max - x_min);
+    }
+    
+    double py( double y ) const
+    {
+      if( log_y )
+      {
+        y = std::max( y, y_min );
+        return top + height - height * (log10(y) - log10(y_min)) / (log10(y_max) - log10(y_min));
+      }
+      
+      y = std::min( std::max( y, y_min ), y_max );
+      return top + height - height * (y - y_min) / (y_max - y_min);
+    }
+  };//struct PlotArea
+  
+  
+  PlotArea layout_plot_area( const ChartImageRenderer::ChartImageOptions &options,
+                             const bool right_axis )
+  {
+    PlotArea area;
+    const double left_pad = options.compact ? 35.0 : 65.0;
+    const double right_pad = right_axis ? left_pad : (options.compact ? 4.0 : 12.0);
+    const double top_pad = options.title.empty() ? (options.compact ? 4.0 : 10.0) : 24.0;
+    const double bottom_pad = options.compact ? 16.0 : 40.0;
+    
+    area.left = left_pad;
+    area.top = top_pad;
+    area.width = std::max( 10.0, options.width_px - left_pad - right_pad );
+    area.height = std::max( 10.0, options.height_px - top_pad - bottom_pad );
+    area.x_min = 0.0;
+    area.x_max = 1.0;
+    area.y_min = 0.0;
+    area.y_max = 1.0;
+    area.log_y = false;
+    
+    return area;
+  }//layout_plot_area(...)
+  
+  
+  /** Returns "nice" (1, 2, or 5 times a power of ten) tick positions within [lower, upper]. */
+  vector<double> linear_ticks( const double lower, const double upper, const int approx_num )
+  {
+    vector<double> ticks;
+    const double range = upper - lower;
+    if( !(range > 0.0) || std::isinf(range) || (approx_num < 1) )
+      return ticks;
+    
+    const double rough = range / approx_num;
+    const double mag = std::pow( 10.0, std::floor( std::log10(rough) ) );
+    const double rel = rough / mag;
+    const double step = mag * ((rel < 1.5) ? 1.0 : ((rel < 3.5) ? 2.0 : ((rel < 7.5) ? 5.0 : 10.0)));
+    
+    for( double tick = std::ceil(lower / step) * step; tick <= (upper + 1.0E-9*range); tick += step )
+      ticks.push_back( (fabs(tick) < 1.0E-9*step) ? 0.0 : tick );
+    
+    return ticks;
+  }//linear_ticks(...)
+  
+  
+  /** Returns the powers of ten within [lower, upper]. */
+  vector<double> log_ticks( const double lower, const double upper )
+  {
+    vector<double> ticks;
+    if( !(lower > 0.0) || !(upper > lower) )
+      return ticks;
+    
+    for( int exp = static_cast<int>( std::ceil( std::log10(lower) - 1.0E-9 ) );
+        exp <= static_cast<int>( std::floor( std::log10(upper) + 1.0E-9 ) ); ++exp )
+      ticks.push_back( std::pow( 10.0, exp ) );
+    
+    return ticks;
+  }//log_ticks(...)
+  
+  
+  WFont chart_font( const ChartImageRenderer::ChartImageOptions &options )
+  {
+    WFont font( WFont::SansSerif );
+    font.setSize( WLength( options.compact ? 8 : 11, WLength::Unit::Pixel ) );
+    return font;
+  }//chart_font(...)
+  
+  
+  /** Fills the chart margin and plot background, and draws the title. */
+  void draw_chart_frame( WPainter &painter, const PlotArea &area,
+                         const ChartImageRenderer::ChartImageOptions &options,
+                         const ChartColors &colors )
+  {
+    painter.fillRect( WRectF(0, 0, options.width_px, options.height_px), WBrush(colors.margin) );
+    painter.fillRect( WRectF(area.left, area.top, area.width, area.height),
+                      WBrush(colors.chart_background) );
+    
+    if( !options.title.empty() )
+    {
+      painter.setPen( WPen(colors.text) );
+      painter.drawText( WRectF(0, 2, options.width_px, 20), AlignCenter | AlignMiddle,
+                        WString::fromUTF8(options.title) );
+    }
+  }//draw_chart_frame(...)
+  
+  
+  /** Draws the x-axis, and left (or right, if `right_side`) y-axis, with ticks, labels, and titles. */
+  void draw_axes( WPainter &painter, const PlotArea &area,
+                  const ChartImageRenderer::ChartImageOptions &options,
+                  const WColor &axis_color, const WColor &text_color,
+                  const string &x_title, const string &y_title,
+                  const bool draw_x, const bool right_side )
+  {
+    const double tick_len = options.compact ? 3.0 : 5.0;
+    const double label_height = options.compact ? 10.0 : 14.0;
+    const double bottom = area.top + area.height;
+    const double axis_x = right_side ? (area.left + area.width) : area.left;
+    
+    WPen axis_pen( axis_color );
+    axis_pen.setWidth( 1 );
+    
+    painter.setPen( axis_pen );
+    painter.drawLine( axis_x, area.top, axis_x, bottom );
+    
+    const vector<double> yticks = area.log_y ? log_ticks( area.y_min, area.y_max )
+                                             : linear_ticks( area.y_min, area.y_max,
+                                                  std::max( 2, static_cast<int>(area.height / 40) ) );
+    for( const double tick : yticks )
+    {
+      const double y = area.py( tick );
+      const double x_end = right_side ? (axis_x + tick_len) : (axis_x - tick_len);
+      painter.setPen( axis_pen );
+      painter.drawLine( axis_x, y, x_end, y );
+      
+      painter.setPen( WPen(text_color) );
+      const string label = SpecUtils::printCompact( tick, 3 );
+      if( right_side )
+        painter.drawText( WRectF(x_end + 2, y - 0.5*label_height, 60, label_height),
+                          AlignLeft | AlignMiddle, WString::fromUTF8(label) );
+      else
+        painter.drawText( WRectF(x_end - 62, y - 0.5*label_height, 60, label_height),
+                          AlignRight | AlignMiddle, WString::fromUTF8(label) );
+    }//for( const double tick : yticks )
+    
+    if( !options.compact && !y_title.empty() )
+    {
+      painter.save();
+      painter.setPen( WPen(text_color) );
+      const double x = right_side ? (options.width_px - 14.0) : 14.0;
+      painter.translate( x, area.top + 0.5*area.height );
+      painter.rotate( right_side ? 90.0 : -90.0 );
+      painter.drawText( WRectF(-0.5*area.height, -8, area.height, 16), AlignCenter | AlignMiddle,
+                        WString::fromUTF8(y_title) );
+      painter.restore();
+    }//if( !options.compact && !y_title.empty() )
+    
+    if( !draw_x )
+      return;
+    
+    painter.setPen( axis_pen );
+    painter.drawLine( area.left, bottom, area.left + area.width, bottom );
+    
+    const vector<double> xticks = linear_ticks( area.x_min, area.x_max,
+                                                std::max( 2, static_cast<int>(area.width / 80) ) );
+    for( const double tick : xticks )
+    {
+      const double x = area.px( tick );
+      painter.setPen( axis_pen );
+      painter.drawLine( x, bottom, x, bottom + tick_len );
+      
+      painter.setPen( WPen(text_color) );
+      painter.drawText( WRectF(x - 40, bottom + tick_len, 80, label_height), AlignCenter | AlignTop,
+                        WString::fromUTF8( SpecUtils::printCompact(tick, 5) ) );
+    }//for( const double tick : xticks )
+    
+    if( !options.compact && !x_title.empty() )
+    {
+      painter.setPen( WPen(text_color) );
+      painter.drawText( WRectF(area.left, options.height_px - 18, area.width, 16),
+                        AlignCenter | AlignMiddle, WString::fromUTF8(x_title) );
+    }
+  }//draw_axes(...)
+  
+  
+  /** Draws the histogram defined by the bin lower edges `x` (which must have `npoints + 1`
+   entries), and contents `y`.
+   
+   When there are more bins than pixel columns the min/max envelope of each column is drawn,
+   otherwise the histogram is drawn as steps.
+   */
+  void draw_histogram( WPainter &painter, const PlotArea &area, const float *x, const float *y,
+                       const size_t npoints, const WColor &color )
+  {
+    if( !npoints )
+      return;
+    
+    const size_t first = std::lower_bound( x, x + npoints, static_cast<float>(area.x_min) ) - x;
+    const size_t last = std::upper_bound( x, x + npoints, static_cast<float>(area.x_max) ) - x;
+    const size_t begin_bin = (first > 0) ? (first - 1) : 0;
+    const size_t end_bin = std::min( npoints, last );
+    
+    WPainterPath path;
+    const int ncolumns = std::max( 1, static_cast<int>( std::ceil(area.width) ) );
+    
+    if( (end_bin - begin_bin) <= static_cast<size_t>(ncolumns) )
+    {
+      bool started = false;
+      for( size_t i = begin_bin; i < end_bin; ++i )
+      {
+        const double x0 = std::max( area.px( x[i] ), area.left );
+        const double x1 = std::min( area.px( x[i+1] ), area.left + area.width );
+        const double py = area.py( y[i] );
+        if( !started )
+          path.moveTo( x0, py );
+        else
+          path.lineTo( x0, py );
+        path.lineTo( x1, py );
+        started = true;
+      }//for( size_t i = begin_bin; i < end_bin; ++i )
+    }else
+    {
+      const vector<ChartImageRenderer::MinMaxColumn> columns
+           = ChartImageRenderer::decimate_min_max( x, y, npoints, area.x_min, area.x_max, ncolumns );
+      
+      for( size_t i = 0; i < columns.size(); ++i )
+      {
+        const double px = area.px( columns[i].x );
+        if( i == 0 )
+          path.moveTo( px, area.py( columns[i].min_y ) );
+        else
+          path.lineTo( px, area.py( columns[i].min_y ) );
+        path.lineTo( px, area.py( columns[i].max_y ) );
+      }//for( size_t i = 0; i < columns.size(); ++i )
+    }//if( few enough bins to draw each one ) / else
+    
+    WPen pen( color );
+    pen.setWidth( 1 );
+    painter.setPen( pen );
+    painter.setBrush( WBrush() );
+    painter.drawPath( path );
+  }//draw_histogram(...)
+  
+  
+  /** Draws the gaussian peaks, and their continuums, grouped by ROI. */
+  void draw_peaks( WPainter &painter, const PlotArea &area,
+                   const shared_ptr<const SpecUtils::Measurement> &data,
+                   const deque<shared_ptr<const PeakDef>> &peaks, const WColor &color )
+  {
+    map<const PeakContinuum *, vector<const PeakDef *>> rois;
+    for( const shared_ptr<const PeakDef> &peak : peaks )
+    {
+      if( peak && peak->gausPeak() && (peak->upperX() > area.x_min) && (peak->lowerX() < area.x_max) )
+        rois[peak->continuum().get()].push_back( peak.get() );
+    }
+    
+    const auto energies = data->gamma_channel_energies();
+    if( rois.empty() || !energies || energies->size() < 2 )
+      return;
+    
+    WPen peak_pen( color );
+    peak_pen.setWidth( 2 );
+    WPen cont_pen( color );
+    cont_pen.setWidth( 1 );
+    cont_pen.setStyle( DashLine );
+    painter.setBrush( WBrush() );
+    
+    const size_t nchannel = data->num_gamma_channels();
+    
+    for( const auto &roi : rois )
+    {
+      const PeakDef &first_peak = *roi.second.front();
+      const size_t first = data->find_gamma_channel( std::max( first_peak.lowerX(), area.x_min ) );
+      const size_t last = std::min( nchannel - 1,
+                                    data->find_gamma_channel( std::min( first_peak.upperX(), area.x_max ) ) );
+      
+      WPainterPath peak_path, cont_path;
+      for( size_t channel = first; channel <= last; ++channel )
+      {
+        const double x0 = (*energies)[channel];
+        const double x1 = (*energies)[channel + 1];
+        const double cont = first_peak.offset_integral( x0, x1, data );
+        double total = cont;
+        for( const PeakDef *peak : roi.second )
+          total += peak->gauss_integral( x0, x1 );
+        
+        const double px = area.px( 0.5*(x0 + x1) );
+        if( channel == first )
+        {
+          peak_path.moveTo( px, area.py( total ) );
+          cont_path.moveTo( px, area.py( cont ) );
+        }else
+        {
+          peak_path.lineTo( px, area.py( total ) );
+          cont_path.lineTo( px, area.py( cont ) );
+        }
+      }//for( loop over channels of ROI )
+      
+      painter.setPen( cont_pen );
+      painter.drawPath( cont_path );
+      painter.setPen( peak_pen );
+      painter.drawPath( peak_path );
+    }//for( const auto &roi : rois )
+  }//draw_peaks(...)
+  
+  
+  /** Creates the image, paints it with `draw`, and writes it to `output`. */
+  template<class DrawFcn>
+  void paint_and_write( std::ostream &output, const ChartImageRenderer::ChartImageOptions &options,
+                        DrawFcn draw )
+  {
+    if( (options.width_px < 16) || (options.height_px < 16) )
+      throw runtime_error( "Chart image must be at least 16x16 pixels." );
+    
+    const WLength width( options.width_px, WLength::Unit::Pixel );
+    const WLength height( options.height_px, WLength::Unit::Pixel );
+    
+    switch( options.format )
+    {
+      case ChartImageRenderer::ImageFormat::Svg:
+      {
+        WSvgImage image( width, height, nullptr, false );
+        {
+          WPainter painter( &image );
+          draw( painter );
+          painter.end();
+        }
+        image.write( output );
+        break;
+      }//case ImageFormat::Svg
+        
+      case ChartImageRenderer::ImageFormat::Png:
+      {
+#ifdef WT_HAS_WRASTERIMAGE
+        WRasterImage image( "png", width, height );
+        {
+          WPainter painter( &image );
+          draw( painter );
+          painter.end();
+        }
+        image.write( output );
+#else
+        throw runtime_error( "PNG chart images require Wt to be built with WRasterImage support." );
+#endif
+        break;
+      }//case ImageFormat::Png
+    }//switch( options.format )
+    
+    if( !output )
+      throw runtime_error( "Error writing chart image." );
+  }//paint_and_write(...)
+  
+  
+  /** Determines the image format from the filename extension, and opens the file for writing. */
+  void open_image_file( const string &filename, ChartImageRenderer::ChartImageOptions &options,
+                        std::ofstream &output )
+  {
+    const string ext = SpecUtils::file_extension( filename );
+    if( SpecUtils::iequals_ascii( ext, ".png" ) )
+      options.format = ChartImageRenderer::ImageFormat::Png;
+    else if( SpecUtils::iequals_ascii( ext, ".svg" ) )
+      options.format = ChartImageRenderer::ImageFormat::Svg;
+    else
+      throw runtime_error( "Chart image filename must end in '.svg' or '.png'." );
+    
+#ifdef _WIN32
+    const std::wstring wfilename = SpecUtils::convert_from_utf8_to_utf16( filename );
+    output.open( wfilename.c_str(), ios::out | ios::binary );
+#else
+    output.open( filename.c_str(), ios::out | ios::binary );
+#endif
+    
+    if( !output )
+      throw runtime_error( "Failed to open '" + filename + "' for writing." );
+  }//open_image_file(...)
+}//namespace
+
+
+namespace ChartImageRenderer
+{
+
+bool png_supported()
+{
+#ifdef WT_HAS_WRASTERIMAGE
+  return true;
+#else
+  return false;
+#endif
+}//bool png_supported()
+
+
+std::vector<MinMaxColumn> decimate_min_max( const float *x, const float *y, const size_t npoints,
+                                            const double x_lower, const double x_upper,
+                                            const int ncolumns )
+{
+  vector<MinMaxColumn> columns;
+  if( !x || !y || !npoints || (ncolumns < 1) || !(x_upper > x_lower) )
+    return columns;
+  
+  const double col_width = (x_upper - x_lower) / ncolumns;
+  const size_t first = std::lower_bound( x, x + npoints, static_cast<float>(x_lower) ) - x;
+  
+  columns.reserve( ncolumns );
+  int current_col = -1;
+  for( size_t i = first; (i < npoints) && (x[i] <= x_upper); ++i )
+  {
+    const int col = std::min( ncolumns - 1, static_cast<int>( (x[i] - x_lower) / col_width ) );
+    const double val = y[i];
+    
+    if( col != current_col )
+    {
+      MinMaxColumn column;
+      column.x = x_lower + col*col_width;
+      column.min_y = column.max_y = val;
+      columns.push_back( column );
+      current_col = col;
+    }else
+    {
+      MinMaxColumn &column = columns.back();
+      column.min_y = std::min( column.min_y, val );
+      column.max_y = std::max( column.max_y, val );
+    }
+  }//for( loop over points in range )
+  
+  return columns;
+}//decimate_min_max(...)
+
+
+void render_spectrum( std::ostream &output,
+                      const std::shared_ptr<const SpecUtils::Measurement> &foreground,
+                      const std::shared_ptr<const SpecUtils::Measurement> &background,
+                      const std::deque<std::shared_ptr<const PeakDef>> &peaks,
+                      const SpectrumImageOptions &options )
+{
+  const auto energies = foreground ? foreground->gamma_channel_energies() : nullptr;
+  const auto counts = foreground ? foreground->gamma_counts() : nullptr;
+  if( !energies || !counts || (counts->size() < 2) || (energies->size() < (counts->size() + 1)) )
+    throw runtime_error( "render_spectrum: invalid foreground spectrum." );
+  
+  const ChartColors colors( options.theme, false );
+  PlotArea area = layout_plot_area( options, false );
+  area.log_y = options.log_y;
+  area.x_min = options.lower_energy;
+  area.x_max = options.upper_energy;
+  if( !(area.x_max > area.x_min) )
+  {
+    area.x_min = energies->front();
+    area.x_max = energies->back();
+  }
+  
+  // Scale the background to the foreground live-time
+  vector<float> back_counts;
+  shared_ptr<const vector<float>> back_energies;
+  if( background && background->gamma_counts() && background->gamma_channel_energies()
+     && (background->live_time() > 0.0f) && (foreground->live_time() > 0.0f) )
+  {
+    const float scale = foreground->live_time() / background->live_time();
+    back_counts = *background->gamma_counts();
+    for( float &val : back_counts )
+      val *= scale;
+    back_energies = background->gamma_channel_energies();
+    if( back_energies->size() < (back_counts.size() + 1) )
+    {
+      back_counts.clear();
+      back_energies.reset();
+    }
+  }//if( background )
+  
+  // Find the y-range of the data in the displayed energy range
+  double min_y = std::numeric_limits<double>::max(), min_positive_y = min_y;
+  double max_y = -std::numeric_limits<double>::max();
+  const auto update_range = [&]( const float *x, const float *y, const size_t n ){
+    const size_t first = std::lower_bound( x, x + n, static_cast<float>(area.x_min) ) - x;
+    for( size_t i = first; (i < n) && (x[i] <= area.x_max); ++i )
+    {
+      min_y = std::min( min_y, static_cast<double>(y[i]) );
+      max_y = std::max( max_y, static_cast<double>(y[i]) );
+      if( y[i] > 0.0f )
+        min_positive_y = std::min( min_positive_y, static_cast<double>(y[i]) );
+    }
+  };//update_range lambda
+  
+  update_range( &((*energies)[0]), &((*counts)[0]), counts->size() );
+  if( !back_counts.empty() )
+    update_range( &((*back_energies)[0]), &(back_counts[0]), back_counts.size() );
+  
+  if( max_y < min_y )
+  {
+    min_y = 0.0;
+    max_y = 1.0;
+  }
+  
+  if( area.log_y )
+  {
+    area.y_min = (min_positive_y < std::numeric_limits<double>::max()) ? 0.5*min_positive_y : 0.1;
+    area.y_min = std::max( 0.1, std::min( area.y_min, 1.0 ) );
+    area.y_max = std::max( 2.0*area.y_min, 2.0*max_y );
+  }else
+  {
+    area.y_min = std::min( 0.0, min_y );
+    area.y_max = std::max( area.y_min + 1.0, 1.1*max_y );
+  }//if( area.log_y ) / else
+  
+  paint_and_write( output, options, [&]( WPainter &painter ){
+    painter.setFont( chart_font( options ) );
+    draw_chart_frame( painter, area, options, colors );
+    
+    WPainterPath clip_path;
+    clip_path.addRect( area.left, area.top, area.width, area.height );
+    
+    painter.save();
+    painter.setClipPath( clip_path );
+    painter.setClipping( true );
+    
+    if( !back_counts.empty() )
+      draw_histogram( painter, area, &((*back_energies)[0]), &(back_counts[0]),
+                      back_counts.size(), colors.background );
+    draw_histogram( painter, area, &((*energies)[0]), &((*counts)[0]), counts->size(),
+                    colors.foreground );
+    draw_peaks( painter, area, foreground, peaks, colors.peak );
+    painter.restore();
+    
+    draw_axes( painter, area, options, colors.axis, colors.text, "Energy (keV)", "Counts",
+               true, false );
+  } );
+}//render_spectrum(...)
+
+
+void render_time_series( std::ostream &output,
+                         const SpecUtils::SpecFile &spec,
+                         const ChartImageOptions &options )
+{
+  const set<int> &sample_numbers = spec.sample_numbers();
+  if( sample_numbers.empty() )
+    throw runtime_error( "render_time_series: no samples." );
+  
+  // The x-values are the cumulative real-time at the start of each sample, with one extra entry at
+  //  the end, same as channel energies for a spectrum.
+  vector<float> times( 1, 0.0f ), gamma_cps, neutron_cps;
+  bool have_neutrons = false;
+  
+  for( const int sample : sample_numbers )
+  {
+    double gammas = 0.0, neutrons = 0.0;
+    float real_time = 0.0f;
+    for( const shared_ptr<const SpecUtils::Measurement> &m : spec.sample_measurements( sample ) )
+    {
+      gammas += m->gamma_count_sum();
+      neutrons += m->neutron_counts_sum();
+      have_neutrons |= m->contained_neutron();
+      real_time = std::max( real_time, (m->real_time() > 0.0f) ? m->real_time() : m->live_time() );
+    }//for( loop over measurements of sample )
+    
+    const float duration = (real_time > 0.0f) ? real_time : 1.0f;
+    times.push_back( times.back() + duration );
+    gamma_cps.push_back( static_cast<float>( gammas / duration ) );
+    neutron_cps.push_back( static_cast<float>( neutrons / duration ) );
+  }//for( const int sample : sample_numbers )
+  
+  const ChartColors colors( options.theme, true );
+  PlotArea gamma_area = layout_plot_area( options, have_neutrons );
+  gamma_area.x_min = 0.0;
+  gamma_area.x_max = times.back();
+  
+  const auto max_of = []( const vector<float> &vals ) -> double {
+    return vals.empty() ? 1.0 : *std::max_element( begin(vals), end(vals) );
+  };
+  
+  gamma_area.y_min = 0.0;
+  gamma_area.y_max = std::max( 1.0, 1.1*max_of(gamma_cps) );
+  
+  PlotArea neutron_area = gamma_area;
+  neutron_area.y_max = std::max( 1.0, 1.1*max_of(neutron_cps) );
+  
+  paint_and_write( output, options, [&]( WPainter &painter ){
+    painter.setFont( chart_font( options ) );
+    draw_chart_frame( painter, gamma_area, options, colors );
+    
+    draw_histogram( painter, gamma_area, &(times[0]), &(gamma_cps[0]), gamma_cps.size(),
+                    colors.foreground );
+    if( have_neutrons )
+      draw_histogram( painter, neutron_area, &(times[0]), &(neutron_cps[0]), neutron_cps.size(),
+                      colors.neutron );
+    
+    draw_axes( painter, gamma_area, options, colors.axis, colors.text, "Real Time (s)",
+               "Gamma cps", true, false );
+    if( have_neutrons )
+      draw_axes( painter, neutron_area, options, colors.axis, colors.text, "", "Neutron cps",
+                 false, true );
+  } );
+}//render_time_series(...)
+
+
+void write_spectrum_image( const std::string &filename,
+                           const std::shared_ptr<const SpecUtils::Measurement> &foreground,
+                           const std::shared_ptr<const SpecUtils::Measurement> &background,
+                           const std::deque<std::shared_ptr<const PeakDef>> &peaks,
+                           SpectrumImageOptions options )
+{
+  std::ofstream output;
+  open_image_file( filename, options, output );
+  render_spectrum( output, foreground, background, peaks, options );
+}//write_spectrum_image(...)
+
+
+void write_time_series_image( const std::string &filename,
+                              const SpecUtils::SpecFile &spec,
+                              ChartImageOptions options )
+{
+  std::ofstream output;
+  open_image_file( filename, options, output );
+  render_time_series( output, spec, options );
+}//write_time_series_image(...)
+
+}//namespace ChartImageRenderer
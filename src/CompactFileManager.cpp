@@ -32,7 +32,9 @@
 #include <Wt/WText>
 #include <Wt/WImage>
 #include <Wt/WLabel>
+#include <Wt/WServer>
 #include <Wt/WSlider>
+#include <Wt/WIOService>
 #include <Wt/WLineEdit>
 #include <Wt/WComboBox>
 #include <Wt/WTabWidget>
@@ -66,6 +68,57 @@ using namespace Wt;
 using namespace std;
 
 
+namespace
+{
+  /** Number of samples, in each direction, that are summed in the background when the user steps
+   through samples, so stepping forward or back can use the already summed spectrum.
+   */
+  const size_t ns_num_prefetch_samples = 3;
+  
+  
+  /** Posts summing the samples before and after `sample` (wrapping around, same as stepping does)
+   to the servers thread pool; see SpecMeas::prefetch_sum.
+   */
+  void prefetch_adjacent_samples( const std::shared_ptr<SpecMeas> &meas, const int sample,
+                                  const std::vector<std::string> &detectors )
+  {
+    WServer *server = WServer::instance();
+    if( !meas || detectors.empty() || !server )
+      return;
+    
+    const set<int> all_samples = meas->sample_numbers();
+    const set<int>::const_iterator current = all_samples.find( sample );
+    if( (current == end(all_samples)) || (all_samples.size() < 2) )
+      return;
+    
+    const size_t nprefetch = std::min( ns_num_prefetch_samples, (all_samples.size() - 1) / 2 + 1 );
+    
+    vector<set<int>> to_prefetch;
+    set<int>::const_iterator next = current, prev = current;
+    for( size_t i = 0; i < nprefetch; ++i )
+    {
+      ++next;
+      if( next == end(all_samples) )
+        next = begin(all_samples);
+      
+      if( prev == begin(all_samples) )
+        prev = end(all_samples);
+      --prev;
+      
+      // Stepping forward is most common, so do that first
+      to_prefetch.push_back( {*next} );
+      if( prev != next )
+        to_prefetch.push_back( {*prev} );
+    }//for( size_t i = 0; i < nprefetch; ++i )
+    
+    server->ioService().boost::asio::io_service::post( [meas, detectors, to_prefetch](){
+      for( const set<int> &samples : to_prefetch )
+        meas->prefetch_sum( samples, detectors );
+    } );
+  }//void prefetch_adjacent_samples(...)
+}//namespace
+
+
 CompactFileManager::CompactFileManager( SpecMeasManager *fileManager,
                                         InterSpec *hostViewer,
                                         CompactFileManager::DisplayMode mode,
@@ -638,6 +691,8 @@ void CompactFileManager::handleUserIncrementSampleNum( SpecUtils::SpectrumType t
       pos = total_sample_nums.begin();
 
     changeToSampleNum( *pos, type , hostViewer, cfm);
+    
+    prefetch_adjacent_samples( meas, *pos, hostViewer->detectorsToDisplay(type) );
   }catch( std::runtime_error e )
   {
     cerr << "CompactFileManager::handleUserIncrementSampleNum(...): caught "
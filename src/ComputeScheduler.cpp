@@ -0,0 +1,346 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+
+#include <Wt/WLogger>
+
+#include "InterSpec/ComputeScheduler.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
+#include "InterSpec/SharedThreadPool.h"
+
+using namespace std;
+
+namespace
+{
+  struct Job
+  {
+    std::string m_key;
+    std::function<void()> m_job;
+    std::chrono::steady_clock::time_point m_queued;
+  };//struct Job
+  
+  
+  /** The queues and worker threads; only accessed through #scheduler_state(). */
+  class SchedulerState
+  {
+  public:
+    SchedulerState()
+      : m_max_running( std::max( size_t(2), SharedThreadPool::available_cpu_count() ) ),
+        m_num_running{ 0, 0 },
+        m_stop( false )
+    {
+      const char * const priority_labels[2] = { "priority=\"interactive\"", "priority=\"batch\"" };
+      for( size_t i = 0; i < 2; ++i )
+      {
+        m_queue_depth[i] = &ServerMetrics::gauge( "interspec_compute_jobs_queued",
+                                                 "Number of compute jobs waiting to run.", priority_labels[i] );
+        m_running_gauge[i] = &ServerMetrics::gauge( "interspec_compute_jobs_running",
+                                                   "Number of compute jobs currently running.", priority_labels[i] );
+        m_wait_time[i] = &ServerMetrics::histogram( "interspec_compute_job_wait_seconds",
+                                                   "Time compute jobs waited in the queue before running.", priority_labels[i] );
+        m_run_time[i] = &ServerMetrics::histogram( "interspec_compute_job_run_seconds",
+                                                  "Time compute jobs took to run.", priority_labels[i] );
+      }
+    }
+    
+    ~SchedulerState()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+        for( size_t i = 0; i < 2; ++i )
+        {
+          m_queues[i].clear();
+          m_session_order[i].clear();
+        }
+      }
+      m_cv.notify_all();
+      
+      for( std::thread &t : m_threads )
+      {
+        if( t.joinable() )
+          t.join();
+      }
+    }//~SchedulerState()
+    
+    
+    void post( const std::string &session_id, const ComputeScheduler::Priority priority,
+               std::function<void()> &&job, const std::string &key )
+    {
+      const size_t index = static_cast<size_t>( priority );
+      assert( index < 2 );
+      
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if( m_stop )
+          return;
+        
+        std::deque<Job> &queue = m_queues[index][session_id];
+        
+        if( !key.empty() )
+        {
+          queue.erase( std::remove_if( begin(queue), end(queue),
+                                       [&key]( const Job &j ){ return j.m_key == key; } ),
+                       end(queue) );
+        }//if( !key.empty() )
+        
+        if( queue.empty() )
+        {
+          std::deque<std::string> &order = m_session_order[index];
+          if( std::find( begin(order), end(order), session_id ) == end(order) )
+            order.push_back( session_id );
+        }
+        
+        queue.push_back( Job{key, std::move(job), std::chrono::steady_clock::now()} );
+        update_metrics();
+        
+        // Start another thread, if we can run more jobs than we have threads
+        const size_t num_queued = num_queued_jobs();
+        if( (m_threads.size() < m_max_running) && (m_threads.size() < (m_num_running[0] + m_num_running[1] + num_queued)) )
+          m_threads.emplace_back( &SchedulerState::worker, this );
+      }
+      
+      m_cv.notify_one();
+    }//void post(...)
+    
+    
+    void removeQueuedJobs( const std::string &session_id )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      for( size_t i = 0; i < 2; ++i )
+      {
+        m_queues[i].erase( session_id );
+        std::deque<std::string> &order = m_session_order[i];
+        order.erase( std::remove( begin(order), end(order), session_id ), end(order) );
+      }
+      update_metrics();
+    }//void removeQueuedJobs( const std::string &session_id )
+    
+    
+    size_t maxConcurrency()
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      return m_max_running;
+    }
+    
+    
+    void setMaxConcurrency( const size_t max_jobs )
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_max_running = std::max( max_jobs, size_t(1) );
+        
+        const size_t num_wanted = std::min( m_max_running, m_num_running[0] + m_num_running[1] + num_queued_jobs() );
+        while( m_threads.size() < num_wanted )
+          m_threads.emplace_back( &SchedulerState::worker, this );
+      }
+      m_cv.notify_all();
+    }//void setMaxConcurrency( const size_t max_jobs )
+    
+    
+  protected:
+    /** Must be called with m_mutex held. */
+    size_t num_queued_jobs() const
+    {
+      size_t num = 0;
+      for( size_t i = 0; i < 2; ++i )
+        for( const auto &session_queue : m_queues[i] )
+          num += session_queue.second.size();
+      return num;
+    }
+    
+    
+    /** Updates the queue depth and running job gauges; must be called with m_mutex held. */
+    void update_metrics()
+    {
+      for( size_t i = 0; i < 2; ++i )
+      {
+        size_t num = 0;
+        for( const auto &session_queue : m_queues[i] )
+          num += session_queue.second.size();
+        m_queue_depth[i]->set( static_cast<int64_t>(num) );
+        m_running_gauge[i]->set( static_cast<int64_t>(m_num_running[i]) );
+      }
+    }//void update_metrics()
+    
+    
+    /** Returns the priority index of the next job that can be started, or -1 if none; must be
+     called with m_mutex held.
+     */
+    int next_priority() const
+    {
+      const size_t num_running = m_num_running[0] + m_num_running[1];
+      if( num_running >= m_max_running )
+        return -1;
+      
+      if( !m_session_order[0].empty() )
+        return 0;
+      
+      // Leave a slot open for interactive jobs.
+      const size_t max_batch = (m_max_running > 1) ? (m_max_running - 1) : size_t(1);
+      if( !m_session_order[1].empty() && (m_num_running[1] < max_batch) )
+        return 1;
+      
+      return -1;
+    }//int next_priority() const
+    
+    
+    void worker()
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      
+      while( true )
+      {
+        int priority = -1;
+        m_cv.wait( lock, [this,&priority](){
+          priority = next_priority();
+          return m_stop || (priority >= 0);
+        } );
+        
+        if( m_stop )
+          return;
+        
+        // Take the next job from the session whose turn it is
+        std::deque<std::string> &order = m_session_order[priority];
+        const std::string session_id = order.front();
+        order.pop_front();
+        
+        const auto queue_pos = m_queues[priority].find( session_id );
+        assert( (queue_pos != end(m_queues[priority])) && !queue_pos->second.empty() );
+        if( (queue_pos == end(m_queues[priority])) || queue_pos->second.empty() )
+          continue;
+        
+        Job job = std::move( queue_pos->second.front() );
+        queue_pos->second.pop_front();
+        if( queue_pos->second.empty() )
+          m_queues[priority].erase( queue_pos );
+        else
+          order.push_back( session_id );
+        
+        m_num_running[priority] += 1;
+        update_metrics();
+        lock.unlock();
+        
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        m_wait_time[priority]->observe( std::chrono::duration<double>(start - job.m_queued).count() );
+        
+        try
+        {
+          INTERSPEC_TRACE_SESSION( session_id );
+          INTERSPEC_TRACE_SCOPE( "ComputeScheduler job" );
+          
+          if( job.m_job )
+            job.m_job();
+        }catch( std::exception &e )
+        {
+          Wt::log("error") << "ComputeScheduler: caught exception from job: " << e.what();
+        }catch( ... )
+        {
+          Wt::log("error") << "ComputeScheduler: caught unknown exception from job.";
+        }
+        
+        m_run_time[priority]->observe( std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() );
+        
+        // Release anything the job captured before re-taking the lock
+        job.m_job = nullptr;
+        
+        lock.lock();
+        m_num_running[priority] -= 1;
+        update_metrics();
+        
+        // A slot opened up, so a different kind of job may now be able to run.
+        m_cv.notify_all();
+      }//while( true )
+    }//void worker()
+    
+    
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    
+    /** Indexed by priority, the queued jobs of each session. */
+    std::map<std::string,std::deque<Job>> m_queues[2];
+    
+    /** Indexed by priority, the order sessions will get to run their next job. */
+    std::deque<std::string> m_session_order[2];
+    
+    size_t m_max_running;
+    size_t m_num_running[2];
+    bool m_stop;
+    
+    // Metrics, for each priority; owned by the ServerMetrics registry.
+    ServerMetrics::Gauge *m_queue_depth[2];
+    ServerMetrics::Gauge *m_running_gauge[2];
+    ServerMetrics::Histogram *m_wait_time[2];
+    ServerMetrics::Histogram *m_run_time[2];
+    
+    std::vector<std::thread> m_threads;
+  };//class SchedulerState
+  
+  
+  SchedulerState &scheduler_state()
+  {
+    static SchedulerState state;
+    return state;
+  }
+}//namespace
+
+
+void ComputeScheduler::post( const std::string &session_id,
+                             const Priority priority,
+                             std::function<void()> job,
+                             const std::string &supersede_key )
+{
+  scheduler_state().post( session_id, priority, std::move(job), supersede_key );
+}//void post(...)
+
+
+void ComputeScheduler::removeQueuedJobs( const std::string &session_id )
+{
+  scheduler_state().removeQueuedJobs( session_id );
+}
+
+
+size_t ComputeScheduler::maxConcurrency()
+{
+  return scheduler_state().maxConcurrency();
+}
+
+
+void ComputeScheduler::setMaxConcurrency( const size_t max_jobs )
+{
+  scheduler_state().setMaxConcurrency( max_jobs );
+}
@@ -23,9 +23,14 @@
 
 #include "InterSpec_config.h"
 
+#include <set>
 #include <memory>
+#include <string>
 #include <vector>
+#include <cstdio>
 #include <utility>
+#include <algorithm>
+#include <functional>
 
 #include <Wt/WPoint>
 #include <Wt/WServer>
@@ -44,6 +49,7 @@
 #include "SpecUtils/D3SpectrumExport.h"
 
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/PerfTrace.h"
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/PopupDiv.h"
 #include "InterSpec/SpecMeas.h"
@@ -94,6 +100,39 @@ namespace
     }
   };//class PeakRangePopupMenu
   
+  
+#if( LOW_MEMORY_PROFILE )
+  /** The maximum number of channels sent to the client for a spectrum; on low memory devices the
+   JSON (and the resulting JS arrays) for 16k+ channel spectra are a noticeable fraction of the memory
+   the WebView is allowed to use, while the chart cant show more than a few thousand points anyway.
+   */
+  const size_t ns_max_client_channels = 4096;
+#endif
+  
+  /** Returns the Measurement whose data should be sent to the client; for `LOW_MEMORY_PROFILE` builds
+   this is a copy with channels combined to at most #ns_max_client_channels, otherwise `meas` is returned.
+   */
+  std::shared_ptr<const Measurement> client_payload( const std::shared_ptr<const Measurement> &meas )
+  {
+#if( LOW_MEMORY_PROFILE )
+    const size_t nchannel = meas ? meas->num_gamma_channels() : size_t(0);
+    if( nchannel > ns_max_client_channels )
+    {
+      try
+      {
+        const size_t ncombine = (nchannel + ns_max_client_channels - 1) / ns_max_client_channels;
+        auto reduced = std::make_shared<Measurement>( *meas );
+        reduced->combine_gamma_channels( ncombine );
+        return reduced;
+      }catch( std::exception &e )
+      {
+        cerr << "D3SpectrumDisplayDiv: failed to combine channels for display: " << e.what() << endl;
+      }
+    }//if( nchannel > ns_max_client_channels )
+#endif
+    
+    return meas;
+  }//client_payload(...)
 }//namespace
 
 
@@ -246,9 +285,13 @@ D3SpectrumDisplayDiv::D3SpectrumDisplayDiv( WContainerWidget *parent )
   m_defaultPeakColor( 0, 51, 255, 155 ),
   m_cssRules{},
   m_pendingJs{},
+  m_foregroundJsHash( 0 ),
+  m_backgroundJsHash( 0 ),
+  m_secondaryJsHash( 0 ),
   m_last_drag_time{},
   m_continuum_being_drug( nullptr ),
-  m_last_being_drug_peaks()
+  m_last_being_drug_peaks(),
+  m_last_drag_channels( 0, 0 )
 {
   addStyleClass( "D3SpectrumDisplayDiv" );
   
@@ -271,11 +314,11 @@ D3SpectrumDisplayDiv::D3SpectrumDisplayDiv( WContainerWidget *parent )
   const string resource_base = "external_libs/SpecUtils/d3_resources/";
 #endif
   
-  wApp->useStyleSheet( resource_base + "SpectrumChartD3.css" );
+  wApp->useStyleSheet( InterSpecApp::fingerprintedResourceUrl(resource_base + "SpectrumChartD3.css") );
   initChangeableCssRules();
   
   wApp->require( "InterSpec_resources/d3.v3.min.js", "d3.v3.js" );
-  wApp->require( resource_base + "SpectrumChartD3.js" );
+  wApp->require( InterSpecApp::fingerprintedResourceUrl(resource_base + "SpectrumChartD3.js") );
   
   
   for( SpectrumChart::PeakLabels label = SpectrumChart::PeakLabels(0);
@@ -348,6 +391,47 @@ void D3SpectrumDisplayDiv::defineJavaScript()
   
   setJavaScriptMember( "chart", "new SpectrumChartD3(" + jsRef() + "," + options + ");");
   
+  // The new chart doesnt have any spectra yet
+  m_foregroundJsHash = m_backgroundJsHash = m_secondaryJsHash = 0;
+  
+  // Client-side cache of ROI and reference line JSON; see keyedStoreDeltaJs(...).
+  if( !m_keyedStoreResyncJS )
+  {
+    m_keyedStoreResyncJS.reset( new JSignal<std::string>( this, "keyedStoreResync", true ) );
+    m_keyedStoreResyncJS->connect( boost::bind( &D3SpectrumDisplayDiv::keyedStoreResyncCallback, this,
+                                               boost::placeholders::_1 ) );
+  }
+  
+  const string resync_js = m_keyedStoreResyncJS->createCall( "name" );
+  setJavaScriptMember( "applyKeyedDelta",
+    "function(name,base,version,keys,added){"
+      "if(!this.keyedStores) this.keyedStores={};"
+      "const prev=(base ? this.keyedStores[name] : null);"
+      "if( base && (!prev || (prev.version!==base)) ){"
+        "delete this.keyedStores[name];"
+        + resync_js + ";"
+        "return null;"
+      "}"
+      "const items={}, arr=[];"
+      "for(let i=0; i<keys.length; ++i){"
+        "const k=keys[i];"
+        "const f=(added.hasOwnProperty(k) ? added[k] : (prev ? prev.items[k] : null));"
+        "if( typeof f!=='function' ){"
+          "delete this.keyedStores[name];"
+          + resync_js + ";"
+          "return null;"
+        "}"
+        "items[k]=f;"
+        "arr.push(f());"  //A new object each time, incase the chart modifies what we give it
+      "}"
+      "this.keyedStores[name]={version:version, items:items};"
+      "return arr;"
+    "}"
+  );
+  
+  m_clientRoiStore = ClientKeyedStore();
+  m_clientRefLineStore = ClientKeyedStore();
+  
   setJavaScriptMember( "resizeObserver",
     "new ResizeObserver(entries => {"
       "for (let entry of entries) {"
@@ -648,14 +732,13 @@ void D3SpectrumDisplayDiv::clearAllReferncePhotoPeakLines()
 
 void D3SpectrumDisplayDiv::setReferenceLinesToClient()
 {
-  string result = "[";
+  vector<string> lines;
   const ReferenceLineInfo &showingNuclide = m_referencePhotoPeakLines;
   
-  bool addComma = false;
   if( !showingNuclide.m_ref_lines.empty() )
   {
-    showingNuclide.toJson(result);
-    addComma = true;
+    lines.emplace_back();
+    showingNuclide.toJson( lines.back() );
   }
   
   for (const ReferenceLineInfo &ref : m_persistedPhotoPeakLines)
@@ -663,17 +746,15 @@ void D3SpectrumDisplayDiv::setReferenceLinesToClient()
     if( showingNuclide.m_ref_lines.empty()
         || (ref.m_input.m_input_txt != showingNuclide.m_input.m_input_txt) )
     {
-      if( addComma )
-        result += ",";
-      addComma = true;
-      ref.toJson(result);
+      lines.emplace_back();
+      ref.toJson( lines.back() );
     }
   }
-  result += "]";
   
   const string js =
   "try{"
-    + m_jsgraph + ".setReferenceLines(" + result + ");"
+    "const lines=" + keyedStoreDeltaJs( "reflines", lines, m_clientRefLineStore ) + ";"
+    "if(lines) " + m_jsgraph + ".setReferenceLines(lines);"
   "}catch(e){ console.log('Exception setting ref lines: ' + e ); }";
   
   if( isRendered() )
@@ -1023,23 +1104,31 @@ void D3SpectrumDisplayDiv::doSecondaryLiveTimeNormalization()
 
 void D3SpectrumDisplayDiv::setForegroundPeaksToClient()
 {
-  string js;
+  INTERSPEC_TRACE_SCOPE( "D3SpectrumDisplayDiv::setForegroundPeaksToClient" );
+  
+  // We will send the JSON of each ROI as a separate item, so only ROIs that changed get sent.
+  vector<string> rois;
   
   if( m_peakModel )
   {
     std::shared_ptr<const std::deque< PeakModel::PeakShrdPtr > > peaks = m_peakModel->peaks();
     if( peaks )
     {
-      vector< std::shared_ptr<const PeakDef> > inpeaks( peaks->begin(), peaks->end() );
+      // Group the same way as PeakDef::peak_json(...)
+      map<shared_ptr<const PeakContinuum>,vector<shared_ptr<const PeakDef>>> continuum_to_peaks;
+      for( const PeakModel::PeakShrdPtr &peak : *peaks )
+        continuum_to_peaks[peak->continuum()].push_back( peak );
+      
       const std::shared_ptr<const Measurement> &foreground = m_foreground;
-      js = PeakDef::peak_json( inpeaks, foreground );
+      for( const auto &roi : continuum_to_peaks )
+        rois.push_back( PeakDef::gaus_peaks_to_json( roi.second, foreground ) );
     }
   }
   
-  if( js.empty() )
-    js = "[]";
-  
-  js = m_jsgraph + ".setRoiData(" + js + ", 'FOREGROUND');";
+  const string js = "{"
+    "const rois=" + keyedStoreDeltaJs( "rois", rois, m_clientRoiStore ) + ";"
+    "if(rois) " + m_jsgraph + ".setRoiData(rois, 'FOREGROUND');"
+  "}";
   
   if( isRendered() )
     doJavaScript( js );
@@ -1047,6 +1136,60 @@ void D3SpectrumDisplayDiv::setForegroundPeaksToClient()
     m_pendingJs.push_back( js );
 }//void setForegroundPeaksToClient();
 
+std::string D3SpectrumDisplayDiv::keyedStoreDeltaJs( const std::string &name,
+                                                     const std::vector<std::string> &items,
+                                                     ClientKeyedStore &store )
+{
+  // If the JS wont be executed until the chart is created, the client store wont exist yet.
+  if( !isRendered() )
+    store = ClientKeyedStore();
+  
+  const unsigned int base_version = store.m_version;
+  const unsigned int version = std::max( base_version + 1u, 1u ); //zero is reserved for "unknown"
+  
+  set<string> keys;
+  string keys_js = "[", added_js = "{";
+  
+  for( const string &item : items )
+  {
+    char key[32] = { '\0' };
+    snprintf( key, sizeof(key), "k%zx", std::hash<std::string>()(item) );
+    
+    keys_js += ((keys_js.size() > 1) ? ",'" : "'") + string(key) + "'";
+    
+    const bool client_has = (base_version && store.m_keys.count(key));
+    if( !client_has && !keys.count(key) )
+      added_js += ((added_js.size() > 1) ? "," : "") + string(key) + ":function(){return " + item + ";}";
+    
+    keys.insert( key );
+  }//for( const string &item : items )
+  
+  keys_js += "]";
+  added_js += "}";
+  
+  store.m_version = version;
+  store.m_keys.swap( keys );
+  
+  return jsRef() + ".applyKeyedDelta('" + name + "'," + std::to_string(base_version)
+         + "," + std::to_string(version) + "," + keys_js + "," + added_js + ")";
+}//std::string keyedStoreDeltaJs(...)
+
+
+void D3SpectrumDisplayDiv::keyedStoreResyncCallback( const std::string &name )
+{
+  if( name == "rois" )
+  {
+    m_clientRoiStore = ClientKeyedStore();
+    scheduleForegroundPeakRedraw();
+  }else if( name == "reflines" )
+  {
+    m_clientRefLineStore = ClientKeyedStore();
+    m_renderFlags |= D3RenderActions::UpdateRefLines;
+    scheduleRender();
+  }
+}//void keyedStoreResyncCallback( const std::string &name )
+
+
 void D3SpectrumDisplayDiv::scheduleForegroundPeakRedraw()
 {
   m_renderFlags |= UpdateForegroundPeaks;
@@ -1428,6 +1571,8 @@ void D3SpectrumDisplayDiv::scheduleUpdateSecondData()
 
 void D3SpectrumDisplayDiv::renderForegroundToClient()
 {
+  INTERSPEC_TRACE_SCOPE( "D3SpectrumDisplayDiv::renderForegroundToClient" );
+  
   const std::shared_ptr<const Measurement> &data_hist = m_foreground;
   
   string js;
@@ -1460,7 +1605,8 @@ void D3SpectrumDisplayDiv::renderForegroundToClient()
       foregroundOptions.peaks_json = PeakDef::peak_json( inpeaks, data_hist );
     }
     
-    measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(data_hist.get(),foregroundOptions) );
+    const std::shared_ptr<const Measurement> payload = client_payload( data_hist );
+    measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(payload.get(),foregroundOptions) );
     
     // Set the data on the JS side
     if ( D3SpectrumExport::write_and_set_data_for_chart(ostr, id(), measurements) ) {
@@ -1474,16 +1620,42 @@ void D3SpectrumDisplayDiv::renderForegroundToClient()
     js = m_jsgraph + ".setData(null,true);";
   }//if ( data_hist ) / else
   
+  // If the x-range should be reset, we need to send the JS even if the data is unchanged, since the
+  //  user may have zoomed since we last sent it.
+  if( m_renderFlags.testFlag(ResetXDomain) )
+    m_foregroundJsHash = 0;
   
-  if( isRendered() )
-    doJavaScript( js );
-  else
-    m_pendingJs.push_back( js );
+  sendSpectrumJsToClient( js, m_foregroundJsHash );
+  
+  // `setData(null,...)` clears all spectra on the client, so they will need to be re-sent.
+  if( !data_hist )
+    m_backgroundJsHash = m_secondaryJsHash = 0;
 }//void D3SpectrumDisplayDiv::updateData()
 
 
+void D3SpectrumDisplayDiv::sendSpectrumJsToClient( const std::string &js, size_t &last_hash )
+{
+  if( !isRendered() )
+  {
+    // Will be executed from defineJavaScript(), once the chart is created.
+    m_pendingJs.push_back( js );
+    last_hash = 0;
+    return;
+  }//if( !isRendered() )
+  
+  const size_t hash = std::hash<std::string>()( js );
+  if( hash && (hash == last_hash) )
+    return;
+  
+  last_hash = hash;
+  doJavaScript( js );
+}//void sendSpectrumJsToClient( const std::string &js, size_t &last_hash )
+
+
 void D3SpectrumDisplayDiv::renderBackgroundToClient()
 {
+  INTERSPEC_TRACE_SCOPE( "D3SpectrumDisplayDiv::renderBackgroundToClient" );
+  
   string js;
   const std::shared_ptr<const Measurement> &background = m_background;
   
@@ -1508,7 +1680,8 @@ void D3SpectrumDisplayDiv::renderBackgroundToClient()
     //vector< std::shared_ptr<const PeakDef> > inpeaks( backpeaks->begin(), backpeaks->end() );
     //backgroundOptions.peaks_json = PeakDef::peak_json( inpeaks );
     
-    measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(background.get(), backgroundOptions) );
+    const std::shared_ptr<const Measurement> payload = client_payload( background );
+    measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(payload.get(), backgroundOptions) );
     
     // Set the data on the JS side
     if ( D3SpectrumExport::write_and_set_data_for_chart(ostr, id(), measurements) ) {
@@ -1521,15 +1694,14 @@ void D3SpectrumDisplayDiv::renderBackgroundToClient()
     js = m_jsgraph + ".removeSpectrumDataByType(false, 'BACKGROUND' );";
   }//if ( background )
   
-  if( isRendered() )
-    doJavaScript( js );
-  else
-    m_pendingJs.push_back( js );
+  sendSpectrumJsToClient( js, m_backgroundJsHash );
 }//void D3SpectrumDisplayDiv::updateBackground()
 
 
 void D3SpectrumDisplayDiv::renderSecondDataToClient()
 {
+  INTERSPEC_TRACE_SCOPE( "D3SpectrumDisplayDiv::renderSecondDataToClient" );
+  
   string js;
   const std::shared_ptr<const Measurement> &hist = m_secondary;
   
@@ -1546,7 +1718,8 @@ void D3SpectrumDisplayDiv::renderSecondDataToClient()
     secondaryOptions.spectrum_type = SpecUtils::SpectrumType::SecondForeground;
     secondaryOptions.display_scale_factor = displayScaleFactor( SpecUtils::SpectrumType::SecondForeground );
     
-    measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(hist.get(), secondaryOptions) );
+    const std::shared_ptr<const Measurement> payload = client_payload( hist );
+    measurements.push_back( pair<const Measurement *,D3SpectrumExport::D3SpectrumOptions>(payload.get(), secondaryOptions) );
     
     // Set the data on the JS side
     if ( D3SpectrumExport::write_and_set_data_for_chart(ostr, id(), measurements) ) {
@@ -1559,10 +1732,7 @@ void D3SpectrumDisplayDiv::renderSecondDataToClient()
     js = m_jsgraph + ".removeSpectrumDataByType(false, 'SECONDARY' );";
   }//if ( hist )
   
-  if( isRendered() )
-    doJavaScript( js );
-  else
-    m_pendingJs.push_back( js );
+  sendSpectrumJsToClient( js, m_secondaryJsHash );
 }//void D3SpectrumDisplayDiv::updateSecondData()
 
 
@@ -1982,10 +2152,29 @@ void D3SpectrumDisplayDiv::performExistingRoiEdgeDragWork(
       //  original peaks chi2/dof; instead we should compare to the last peaks fit that were used, and the original ones
       const auto now = chrono::steady_clock::now();
       const auto dt = now - m_last_drag_time;
-      if( (m_continuum_being_drug == continuum)
+      const bool have_last_drag_fit = ((m_continuum_being_drug == continuum)
          && (new_roi_initial_peaks.size() == m_last_being_drug_peaks.size())
          && !m_last_being_drug_peaks.empty()
-         && (dt < std::chrono::seconds(15)) )
+         && (dt < std::chrono::seconds(15)));
+      
+      const pair<size_t,size_t> drag_channels{ foreground->find_gamma_channel(new_lower_energy),
+                                               foreground->find_gamma_channel(new_upper_energy) };
+      
+      // If the ROI still covers the same channels as the last fit, the fit would come out the same,
+      //  so skip it and just update the ROI range of the previous result.
+      vector<shared_ptr<const PeakDef>> refitpeaks;
+      if( have_last_drag_fit && (drag_channels == m_last_drag_channels) )
+      {
+        auto new_continuum = std::make_shared<PeakContinuum>( *m_last_being_drug_peaks.front()->continuum() );
+        new_continuum->setRange( new_lower_energy, new_upper_energy );
+        
+        for( const auto &p : m_last_being_drug_peaks )
+        {
+          auto newpeak = make_shared<PeakDef>( *p );
+          newpeak->setContinuum( new_continuum );
+          refitpeaks.push_back( newpeak );
+        }
+      }else if( have_last_drag_fit )
       {
         //cout << "Using previously drug-n-fit peaks" << endl;
         
@@ -2001,13 +2190,14 @@ void D3SpectrumDisplayDiv::performExistingRoiEdgeDragWork(
           newpeak->setContinuum( new_continuum );
           new_roi_initial_peaks.push_back( newpeak );
         }
-      }//if( we should start from the peaks we last fit while dragging )
+      }//if( channels unchanged ) / else if( we should start from the peaks we last fit while dragging )
       
-      vector<shared_ptr<const PeakDef>> refitpeaks
-                  = refitPeaksThatShareROI( foreground, detector, new_roi_initial_peaks, 3.0 );
+      if( refitpeaks.empty() )
+        refitpeaks = refitPeaksThatShareROI( foreground, detector, new_roi_initial_peaks, 3.0 );
       
       m_continuum_being_drug = continuum;
       m_last_being_drug_peaks = refitpeaks;
+      m_last_drag_channels = drag_channels;
       m_last_drag_time = chrono::steady_clock::now();
       
       
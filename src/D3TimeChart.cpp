@@ -23,11 +23,15 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <set>
 #include <array>
 #include <tuple>
 #include <limits>
 #include <memory>
+#include <string>
 #include <vector>
+#include <sstream>
 #include <utility>
 
 #include <boost/optional.hpp>
@@ -39,6 +43,7 @@
 #include <Wt/WCheckBox>
 #include <Wt/WPushButton>
 #include <Wt/WJavaScript>
+#include <Wt/WMemoryResource>
 #include <Wt/WApplication>
 #include <Wt/WStringStream>
 #include <Wt/WContainerWidget>
@@ -46,12 +51,14 @@
 #include "SpecUtils/DateTime.h"
 #include "SpecUtils/SpecFile.h"
 #include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
 
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/ColorTheme.h"
 #include "InterSpec/D3TimeChart.h"
 #include "InterSpec/UndoRedoManager.h"
+#include "InterSpec/ChartImageRenderer.h"
 
 using namespace Wt;
 using namespace std;
@@ -1023,6 +1030,7 @@ D3TimeChart::D3TimeChart( Wt::WContainerWidget *parent )
   m_chartMarginColor( 0x00, 0x00, 0x00 ),
   m_chartBackgroundColor( 0x00, 0x00, 0x00 ),
   m_cssRules{},
+  m_imageResource( nullptr ),
   m_pendingJs{},
   m_displayedSampleNumbers{-1,-1},
   m_displayedTimes{ 0.0, 0.0 }
@@ -1210,12 +1218,156 @@ void D3TimeChart::setData( std::shared_ptr<const SpecUtils::SpecFile> data,
     scheduleRenderAll();
   }//if( this is a different spectrum file )
   
+  if( (m_spec != data) || (m_detectors_to_display != det_to_display) )
+    m_energyRangeSums.clear();
+  
   m_spec = data;
   m_detectors_to_display = det_to_display;
 }//void setData(...)
   
 
 
+struct D3TimeChart::EnergyRangeSums
+{
+  /** Detector name to the sum for each sample sent to the client (i.e., samples with a record for any
+   displayed detector); NaN where that detector doesnt have a record for the sample.
+   */
+  std::map<std::string,std::vector<double>> m_sums;
+  
+  /** The gamma counts, and energy calibration, of each {sample, detector} visited, in order, so we
+   can tell if the data has changed since the sums were computed.
+   */
+  std::vector<std::weak_ptr<const std::vector<float>>> m_counts;
+  std::vector<std::weak_ptr<const SpecUtils::EnergyCalibration>> m_cals;
+};//struct D3TimeChart::EnergyRangeSums
+
+
+std::shared_ptr<const D3TimeChart::EnergyRangeSums> D3TimeChart::energyRangeSums(
+                                                        const boost::optional<float> &lowerEnergy,
+                                                        const boost::optional<float> &upperEnergy,
+                                                        const bool use_full_sum )
+{
+  if( !m_spec )
+    return nullptr;
+  
+  const auto key = std::make_tuple( !!lowerEnergy, (lowerEnergy ? *lowerEnergy : 0.0f),
+                                    !!upperEnergy, (upperEnergy ? *upperEnergy : 0.0f), use_full_sum );
+  
+  const set<int> &sample_numbers = m_spec->sample_numbers();
+  const vector<string> &detNames = m_detectors_to_display;
+  
+  shared_ptr<EnergyRangeSums> answer;
+  auto first_uncached_sample = begin(sample_numbers);
+  
+  const auto pos = m_energyRangeSums.find( key );
+  if( pos != end(m_energyRangeSums) )
+  {
+    // Check the data hasnt changed (e.g., energy calibration) since we computed the sums.  If samples
+    //  have only been added to the end of the file (e.g., during a live acquisition), we'll keep the
+    //  cached sums, and just compute the new samples.
+    const EnergyRangeSums &cached = *pos->second;
+    bool valid = true;
+    size_t index = 0;
+    auto sample_iter = begin(sample_numbers);
+    for( ; valid && (sample_iter != end(sample_numbers)) && (index < cached.m_counts.size()); ++sample_iter )
+    {
+      bool haveAnyDataThisSample = false;
+      for( size_t i = 0; !haveAnyDataThisSample && (i < detNames.size()); ++i )
+        haveAnyDataThisSample = !!m_spec->measurement( *sample_iter, detNames[i] );
+      
+      if( !haveAnyDataThisSample )
+        continue;
+      
+      for( size_t i = 0; valid && (i < detNames.size()); ++i, ++index )
+      {
+        const auto m = m_spec->measurement( *sample_iter, detNames[i] );
+        valid = ((index < cached.m_counts.size())
+                 && (cached.m_counts[index].lock() == (m ? m->gamma_counts() : nullptr))
+                 && (cached.m_cals[index].lock() == (m ? m->energy_calibration() : nullptr)));
+      }
+    }//for( loop over samples )
+    
+    if( valid && (index == cached.m_counts.size()) )
+    {
+      if( sample_iter == end(sample_numbers) )
+        return pos->second;
+      
+      answer = pos->second;
+      first_uncached_sample = sample_iter;
+    }else
+    {
+      m_energyRangeSums.erase( pos );
+    }
+  }//if( we have this energy range cached )
+  
+#define Q_DBL_NaN std::numeric_limits<double>::quiet_NaN()
+  
+  if( !answer )
+    answer = make_shared<EnergyRangeSums>();
+  
+  for( auto sample_iter = first_uncached_sample; sample_iter != end(sample_numbers); ++sample_iter )
+  {
+    const int sample_num = *sample_iter;
+    
+    // Same selection of samples as setDataToClient()
+    bool haveAnyDataThisSample = false;
+    for( size_t i = 0; !haveAnyDataThisSample && (i < detNames.size()); ++i )
+      haveAnyDataThisSample = !!m_spec->measurement( sample_num, detNames[i] );
+    
+    if( !haveAnyDataThisSample )
+      continue;
+    
+    for( const string &detName : detNames )
+    {
+      const auto m = m_spec->measurement( sample_num, detName );
+      if( !m )
+      {
+        answer->m_sums[detName].push_back( Q_DBL_NaN );
+        answer->m_counts.emplace_back();
+        answer->m_cals.emplace_back();
+        continue;
+      }//if( !m )
+      
+      answer->m_counts.push_back( m->gamma_counts() );
+      answer->m_cals.push_back( m->energy_calibration() );
+      
+      const float specMinEnergy = m->gamma_energy_min();
+      const float specMaxEnergy = m->gamma_energy_max();
+      
+      double gamma_sum = use_full_sum ? m->gamma_count_sum() : 1.0;
+      
+      if( use_full_sum
+         && (!lowerEnergy || (lowerEnergy.get() < specMinEnergy) )
+         && (!upperEnergy || (upperEnergy.get() > specMaxEnergy)) )
+      {
+        // gamma_sum = m->gamma_count_sum();
+      }else if( lowerEnergy && upperEnergy )
+      {
+        gamma_sum = m->gamma_integral(*lowerEnergy, *upperEnergy);
+      }else if( lowerEnergy )
+      {
+        gamma_sum = m->gamma_integral(*lowerEnergy, specMaxEnergy + 1000);
+      }else if( upperEnergy )
+      {
+        gamma_sum = m->gamma_integral( specMinEnergy - 1000, *upperEnergy);
+      }
+      
+      answer->m_sums[detName].push_back( gamma_sum );
+    }//for( const string &detName : detNames )
+  }//for( const int sample_num : sample_numbers )
+  
+#undef Q_DBL_NaN
+  
+  // Users will typically only try a handful of ranges, but lets not grow without bound.
+  if( (m_energyRangeSums.size() >= 8) && !m_energyRangeSums.count(key) )
+    m_energyRangeSums.clear();
+  
+  m_energyRangeSums[key] = answer;
+  
+  return answer;
+}//energyRangeSums(...)
+
+
 void D3TimeChart::setDataToClient()
 {
   if( !m_spec )
@@ -1366,6 +1518,14 @@ void D3TimeChart::setDataToClient()
   }//if( m_options )
 
   const bool isCps = ((!lowerEnergy && !upperEnergy) || (!normLowerEnergy && !normUpperEnergy));
+  
+  shared_ptr<const EnergyRangeSums> gammaRangeSums, normRangeSums;
+  if( lowerEnergy || upperEnergy )
+  {
+    gammaRangeSums = energyRangeSums( lowerEnergy, upperEnergy, true );
+    if( normLowerEnergy || normUpperEnergy )
+      normRangeSums = energyRangeSums( normLowerEnergy, normUpperEnergy, false );
+  }//if( lowerEnergy || upperEnergy )
 
 #define Q_DBL_NaN std::numeric_limits<double>::quiet_NaN()
   
@@ -1394,6 +1554,7 @@ void D3TimeChart::setDataToClient()
       continue;
     
     sampleNumbers.push_back( sample_num );
+    const size_t sample_index = sampleNumbers.size() - 1;
     
     for( const string &detName : detNames )
     {
@@ -1437,46 +1598,17 @@ void D3TimeChart::setDataToClient()
       
       if( lowerEnergy || upperEnergy )
       {
-        const float specMinEnergy = m->gamma_energy_min();
-        const float specMaxEnergy = m->gamma_energy_max();
-        
-        double gamma_sum = m->gamma_count_sum();
-        
-        if( (!lowerEnergy || (lowerEnergy.get() < specMinEnergy) )
-           && (!upperEnergy || (upperEnergy.get() > specMaxEnergy)) )
-        {
-          // gamma_sum = m->gamma_count_sum();
-        }else if( lowerEnergy && upperEnergy )
-        {
-          gamma_sum = m->gamma_integral(*lowerEnergy, *upperEnergy);
-        }else if( lowerEnergy )
-        {
-          gamma_sum = m->gamma_integral(*lowerEnergy, specMaxEnergy + 1000);
-        }else if( upperEnergy )
-        {
-          gamma_sum = m->gamma_integral( specMinEnergy - 1000, *upperEnergy);
-        }
-
-        gammaCounts[detName].push_back( gamma_sum );
+        assert( gammaRangeSums );
+        const vector<double> &gamma_sums = gammaRangeSums->m_sums.at( detName );
+        assert( sample_index < gamma_sums.size() );
+        gammaCounts[detName].push_back( gamma_sums[sample_index] );
 
         if (normLowerEnergy || normUpperEnergy)
         {
-          double denominator = 1.0;
-          if (normLowerEnergy && normUpperEnergy)
-          {
-            denominator = m->gamma_integral(*normLowerEnergy, *normUpperEnergy);
-          }else if (normLowerEnergy)
-          {
-            denominator = m->gamma_integral(*normLowerEnergy, specMaxEnergy + 1000);
-          }else if (normUpperEnergy)
-          {
-            denominator = m->gamma_integral(specMinEnergy - 1000, *normUpperEnergy);
-          }else
-          {
-            assert(0);
-          }
-
-          gammaNormCounts[detName].push_back(denominator);
+          assert( normRangeSums );
+          const vector<double> &denominators = normRangeSums->m_sums.at( detName );
+          assert( sample_index < denominators.size() );
+          gammaNormCounts[detName].push_back( denominators[sample_index] );
         }//if (normLowerEnergy || normUpperEnergy)
       }else
       {
@@ -2094,7 +2226,53 @@ void D3TimeChart::setHighlightRegionsToClient()
 
 void D3TimeChart::saveChartToPng( const std::string &filename )
 {
-  // \TODO: implement - see D3SpectrumDisplayDiv for a starting point, although it isnt finished
+  if( !m_spec )
+    return;
+  
+  auto theme = make_shared<ColorTheme>();
+  theme->timeChartGammaLine = m_gammaLineColor;
+  theme->timeChartNeutronLine = m_neutronLineColor;
+  theme->timeAxisLines = m_axisColor;
+  theme->timeChartBackground = m_chartBackgroundColor;
+  theme->timeChartMargins = m_chartMarginColor;
+  theme->timeChartText = m_textColor;
+  
+  ChartImageRenderer::ChartImageOptions options;
+  options.width_px = (m_layoutWidth > 100) ? m_layoutWidth : 800;
+  options.height_px = (m_layoutHeight > 50) ? m_layoutHeight : 250;
+  options.theme = theme;
+  options.format = ChartImageRenderer::png_supported() ? ChartImageRenderer::ImageFormat::Png
+                                                       : ChartImageRenderer::ImageFormat::Svg;
+  
+  string download_name = filename;
+  if( options.format == ChartImageRenderer::ImageFormat::Svg )
+  {
+    const string ext = SpecUtils::file_extension( download_name );
+    if( SpecUtils::iequals_ascii( ext, ".png" ) )
+      download_name = download_name.substr( 0, download_name.size() - ext.size() );
+    download_name += ".svg";
+  }//if( no PNG support )
+  
+  try
+  {
+    std::stringstream strm;
+    ChartImageRenderer::render_time_series( strm, *m_spec, options );
+    const string data = strm.str();
+    
+    if( m_imageResource )
+      delete m_imageResource;
+    
+    const bool is_png = (options.format == ChartImageRenderer::ImageFormat::Png);
+    m_imageResource = new WMemoryResource( is_png ? "image/png" : "image/svg+xml", this );
+    m_imageResource->setData( reinterpret_cast<const unsigned char *>( data.data() ),
+                              static_cast<int>( data.size() ) );
+    m_imageResource->suggestFileName( download_name, WResource::DispositionType::Attachment );
+    
+    doJavaScript( "window.location.href = " + WString(m_imageResource->url()).jsStringLiteral() + ";" );
+  }catch( std::exception &e )
+  {
+    cerr << "D3TimeChart::saveChartToPng: " << e.what() << endl;
+  }//try / catch
 }//void saveChartToPng( const std::string &filename )
 
 
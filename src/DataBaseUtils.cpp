@@ -24,7 +24,10 @@
 
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <vector>
 #include <iostream>
+#include <condition_variable>
 
 #if( !USE_GLOBAL_DATABASE_CONNECTION_POOL )
 #include <Wt/WTimer>
@@ -64,6 +67,117 @@ namespace
   std::string PreferenceDatabaseFile = "InterSpecUserData.db";
 #endif
 
+#if( USE_GLOBAL_DATABASE_CONNECTION_POOL && !USE_SQLITE3_DB )
+  /** A fixed-size connection pool, like Wt::Dbo::FixedSqlConnectionPool, that checks connections
+   which have been idle for a while before handing them out, replacing them if they have gone stale.
+   
+   Database servers (e.g., MySQL, via its "wait_timeout") will drop connections that have been idle
+   for too long; without checking, the next transaction on that connection would fail.
+   
+   Wt::Dbo caches prepared statements per-connection, so reusing connections from this pool (rather
+   than opening a new connection for each DbSession) also means query statements are prepared only
+   once per connection.
+   */
+  class HealthCheckedConnectionPool : public Wt::Dbo::SqlConnectionPool
+  {
+  public:
+    /** Takes ownership of `connection`, which is cloned to make the rest of the connections. */
+    HealthCheckedConnectionPool( Wt::Dbo::SqlConnection *connection, const size_t size )
+    {
+      assert( connection && size );
+      
+      m_connections.push_back( Connection{connection,chrono::steady_clock::now()} );
+      for( size_t i = 1; i < size; ++i )
+        m_connections.push_back( Connection{connection->clone(),chrono::steady_clock::now()} );
+    }//HealthCheckedConnectionPool constructor
+    
+    virtual ~HealthCheckedConnectionPool()
+    {
+      for( const Connection &c : m_connections )
+        delete c.m_connection;
+    }
+    
+    virtual Wt::Dbo::SqlConnection *getConnection()
+    {
+      Connection c;
+      
+      {//begin lock on m_mutex
+        std::unique_lock<std::mutex> lock( m_mutex );
+        if( !m_cv.wait_for( lock, sm_timeout, [this](){ return !m_connections.empty(); } ) )
+          throw Wt::Dbo::Exception( "HealthCheckedConnectionPool: no connection available" );
+        
+        c = m_connections.back();
+        m_connections.pop_back();
+      }//end lock on m_mutex
+      
+      if( (chrono::steady_clock::now() - c.m_lastUsed) > sm_maxIdleWithoutCheck )
+      {
+        try
+        {
+          c.m_connection->executeSql( "SELECT 1" );
+        }catch( std::exception &e )
+        {
+          cerr << "Database connection failed health check (" << e.what() << ") - reconnecting." << endl;
+          
+          Wt::Dbo::SqlConnection *fresh = nullptr;
+          try
+          {
+            fresh = c.m_connection->clone();
+          }catch( std::exception & )
+          {
+            returnConnection( c.m_connection );
+            throw;
+          }
+          
+          delete c.m_connection;
+          c.m_connection = fresh;
+        }//try / catch
+      }//if( connection has been idle for a while )
+      
+      return c.m_connection;
+    }//getConnection()
+    
+    virtual void returnConnection( Wt::Dbo::SqlConnection *connection )
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_connections.push_back( Connection{connection,chrono::steady_clock::now()} );
+      }
+      m_cv.notify_one();
+    }//returnConnection(...)
+    
+    virtual void prepareForDropTables() const
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      for( const Connection &c : m_connections )
+        c.m_connection->prepareForDropTables();
+    }//prepareForDropTables()
+    
+  protected:
+    struct Connection
+    {
+      Wt::Dbo::SqlConnection *m_connection;
+      chrono::steady_clock::time_point m_lastUsed;
+    };//struct Connection
+    
+    /** Connections idle longer than this are checked before being handed out; this is well below
+     the default MySQL "wait_timeout" of 8 hours, as well as the shorter values often configured.
+     */
+    static constexpr chrono::seconds sm_maxIdleWithoutCheck{ 5*60 };
+    
+    /** Longest to wait for a connection to become available before throwing an exception. */
+    static constexpr chrono::seconds sm_timeout{ 30 };
+    
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<Connection> m_connections;
+  };//class HealthCheckedConnectionPool
+  
+  constexpr chrono::seconds HealthCheckedConnectionPool::sm_maxIdleWithoutCheck;
+  constexpr chrono::seconds HealthCheckedConnectionPool::sm_timeout;
+#endif //USE_GLOBAL_DATABASE_CONNECTION_POOL && !USE_SQLITE3_DB
+  
+  
 #if( USE_GLOBAL_DATABASE_CONNECTION_POOL )
   //We need a mechanism to ensure that the database connection stays alive until
   //  the database is finished being written; this is what DbPoolManager does.
@@ -121,22 +235,26 @@ namespace
 #if( defined(IOS) || defined(ANDROID) )
           const int nconn = 1;
 #else
-          const int nconn = 5;
+          // Shared by all sessions of this process; sessions only hold a connection for the
+          //  duration of a transaction.
+          const int nconn = 10;
 #endif
 #endif
           Dbo::SqlConnection *connection = DataBaseUtils::getDatabaseConnection();
           connection->setProperty( "show-queries", "false" );
           
+#if( USE_SQLITE3_DB )
           Dbo::FixedSqlConnectionPool *pool
                     = new Wt::Dbo::FixedSqlConnectionPool( connection, nconn );
-          m_numconnection.store( nconn, std::memory_order_seq_cst );
-          m_pool.reset( pool );
           
-#if( USE_SQLITE3_DB )
           // Incase we are somehow are dead-locked in a transaction, we'll only wait 5 seconds,
           //  before having Wt throw an exception when trying to get the connection.
-          m_pool->setTimeout( 5000 );
+          pool->setTimeout( 5000 );
+#else
+          Dbo::SqlConnectionPool *pool = new HealthCheckedConnectionPool( connection, nconn );
 #endif
+          m_numconnection.store( nconn, std::memory_order_seq_cst );
+          m_pool.reset( pool );
           
           Dbo::Session sesh;
           sesh.setConnectionPool( *pool );
@@ -147,6 +265,7 @@ namespace
             //creates Tables if none of them already exist.  We are managing
             //and keeping the database always updated in main.cpp
             sesh.createTables();
+            createDbIndices( &sesh );
             
             {//add version to registry
               Wt::Dbo::Transaction transaction( sesh );
@@ -172,7 +291,7 @@ namespace
   protected:
     std::mutex m_mutex;
     std::atomic<int> m_numconnection;
-    std::unique_ptr<Wt::Dbo::FixedSqlConnectionPool> m_pool;
+    std::unique_ptr<Wt::Dbo::SqlConnectionPool> m_pool;
   };//class DbPoolManager
   
   DbPoolManager DbConnectionPoolManager;
@@ -248,6 +367,7 @@ DbSession::DbSession()
     try
     {
       m_session->createTables();  //will throw if any tables already exist
+      createDbIndices( m_session.get() );
       
       {//add version to registry
         Wt::Dbo::Transaction transaction( *m_session );
@@ -71,6 +71,7 @@ namespace DataBaseVersionUpgrade
           std::shared_ptr<Wt::Dbo::Session> sqlSession = getSession( database );
           mapDbClasses( sqlSession.get() );
           sqlSession->createTables();
+          createDbIndices( sqlSession.get() );
           
           //If the previous statment didnt throw, then this is a brand new
           //  database, so lets set the version to current
@@ -96,6 +97,9 @@ namespace DataBaseVersionUpgrade
     if( version == DB_SCHEMA_VERSION )
     {
       std::cerr<<"No need to update database, everything in sync"<<std::endl;
+      
+      removeUnreferencedBlobs( database );
+      
       return;
     } //no need to update database
 
@@ -303,9 +307,62 @@ namespace DataBaseVersionUpgrade
       setDBVersion( version, sqlSession );
     }//if( version<11 && version<DB_SCHEMA_VERSION )
     
+    if( version<13 && version<DB_SCHEMA_VERSION )
+    {
+      //Version 13 adds content-addressed storage of spectrum file data, so
+      //  duplicate copies (e.g., from saving states) are only stored once.
+      std::shared_ptr<Wt::Dbo::Session> sqlSession = getSession( database );
+      
+      //The following has only been checked for SQLite3.
+      const char *sql_statement = R"sql(create table "SpectrumFileBlob" (
+      "id" integer primary key autoincrement,
+      "version" integer not null,
+      "ContentHash" varchar(64) not null,
+      "FileData" blob not null
+      ))sql";
+      executeSQL( sql_statement, sqlSession );
+      
+      sql_statement = "ALTER TABLE UserFileInDbData ADD COLUMN BlobHash text default '' not null;";
+      executeSQL( sql_statement, sqlSession );
+      
+      version = 13;
+      setDBVersion( version, sqlSession );
+    }//if( version<13 && version<DB_SCHEMA_VERSION )
+    
+    if( version<14 && version<DB_SCHEMA_VERSION )
+    {
+      //Version 14 adds indices so listing a users states or files doesnt scan the whole table.
+      std::shared_ptr<Wt::Dbo::Session> sqlSession = getSession( database );
+      createDbIndices( sqlSession.get() );
+      
+      version = 14;
+      setDBVersion( version, sqlSession );
+    }//if( version<14 && version<DB_SCHEMA_VERSION )
+    
+    if( version<15 && version<DB_SCHEMA_VERSION )
+    {
+      //Version 15 adds a unique index on SpectrumFileBlob.ContentHash, and an index on
+      //  UserFileInDbData.BlobHash.  Before the unique index, two sessions could insert the same
+      //  contents, so remove any duplicates first (entries are referenced by hash, not id).
+      std::shared_ptr<Wt::Dbo::Session> sqlSession = getSession( database );
+      
+      const char *sql_statement = "DELETE FROM SpectrumFileBlob WHERE id NOT IN"
+                                  " (SELECT keep_id FROM (SELECT MIN(id) AS keep_id FROM SpectrumFileBlob"
+                                  " GROUP BY ContentHash) AS keep_ids);";
+      executeSQL( sql_statement, sqlSession );
+      
+      createDbIndices( sqlSession.get() );
+      
+      version = 15;
+      setDBVersion( version, sqlSession );
+    }//if( version<15 && version<DB_SCHEMA_VERSION )
+    
     /// ******************************************************************
-    /// DB_SCHEMA_VERSION is at 11.  Add Version 12 here.  Update InterSpecUser.h!
+    /// DB_SCHEMA_VERSION is at 15.  Add Version 16 here.  Update InterSpecUser.h!
     /// ******************************************************************
+    
+    //Also clean up after deletions for databases we just upgraded.
+    removeUnreferencedBlobs( database );
   }//void checkAndUpgradeVersion()
   
   
@@ -352,6 +409,20 @@ namespace DataBaseVersionUpgrade
       transaction.commit();
     }//add version to registry
   } //setDBVersion(int version, std::shared_ptr<Wt::Dbo::Session> m_sqlSession)
+  
+  //Deleting files or states from the database doesnt cascade to the spectrum
+  //  data they referenced in the SpectrumFileBlob table, so this cleans it up.
+  void removeUnreferencedBlobs( std::unique_ptr<Wt::Dbo::SqlConnection> &database )
+  {
+    try
+    {
+      std::shared_ptr<Wt::Dbo::Session> sqlSession = getSession( database );
+      UserFileInDbData::removeUnreferencedBlobs( *sqlSession );
+    }catch( std::exception &e )
+    {
+      std::cerr << "Failed to remove unreferenced SpectrumFileBlob entries: " << e.what() << std::endl;
+    }
+  }//void removeUnreferencedBlobs( std::unique_ptr<Wt::Dbo::SqlConnection> &database )
 
   
 }//namespace DataBaseVersionUpgrade
@@ -973,7 +973,7 @@ std::shared_ptr<SpecMeas> SnapshotBrowser::retrieveMeas( const int dbid )
         data = *(dbsnapshot->filedata.begin());
       transaction.commit();
       if( data )
-        snapshotmeas = data->decodeSpectrum();
+        snapshotmeas = data->decodeSpectrum( *m_session );
     }catch( std::exception &e )
     {
       cerr << "retrieveMeas() caught (while trying to load snaphot): "
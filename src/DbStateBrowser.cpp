@@ -23,11 +23,18 @@
 #include "InterSpec_config.h"
 
 
+#include <string>
+#include <vector>
+#include <cassert>
+
+#include <boost/tuple/tuple.hpp>
+
 #include <Wt/Dbo/ptr>
+#include <Wt/WDateTime>
 #include <Wt/WTreeView>
 #include <Wt/WPushButton>
 #include <Wt/WGridLayout>
-#include <Wt/Dbo/QueryModel>
+#include <Wt/WAbstractTableModel>
 
 
 #include "InterSpec/AuxWindow.h"
@@ -43,6 +50,263 @@
 using namespace std;
 using namespace Wt;
 
+
+namespace DbStateBrowserImp
+{
+  /** A read-only model of a users saved states.
+   
+   Only the columns that are displayed are selected from the UserState table (i.e., never the large
+   XML/JSON columns, or any of the spectrum file data), and rows are only fetched a page at a time,
+   as the view asks for them.  Pages are found using "keyset" pagination on {sort column, id}
+   (rather than an OFFSET), so fetching a page, with the {user, type, time} index, doesnt depend on
+   how many states the user has.
+   */
+  class StateListModel : public Wt::WAbstractTableModel
+  {
+  public:
+    enum Column
+    {
+      NameCol,
+      DescriptionCol,
+      SerializeTimeCol,
+      IdCol,
+      NumColumns
+    };//enum Column
+    
+    StateListModel( std::shared_ptr<DataBaseUtils::DbSession> session,
+                    const long long user_id,
+                    const bool testStatesOnly,
+                    Wt::WObject *parent )
+    : WAbstractTableModel( parent ),
+      m_session( session ),
+      m_userId( user_id ),
+      m_testStatesOnly( testStatesOnly ),
+      m_numRows( 0 ),
+      m_sortColumn( SerializeTimeCol ),
+      m_sortOrder( Wt::DescendingOrder ),
+      m_allFetched( false )
+    {
+      DataBaseUtils::DbTransaction transaction( *m_session );
+      Dbo::Query<int> query = m_session->session()->query<int>( "SELECT COUNT(1) FROM \"UserState\"" );
+      addWhereClauses( query );
+      m_numRows = query.resultValue();
+      transaction.commit();
+    }//StateListModel constructor
+    
+    
+    virtual int columnCount( const Wt::WModelIndex &parent = Wt::WModelIndex() ) const
+    {
+      return parent.isValid() ? 0 : static_cast<int>(NumColumns);
+    }
+    
+    
+    virtual int rowCount( const Wt::WModelIndex &parent = Wt::WModelIndex() ) const
+    {
+      return parent.isValid() ? 0 : m_numRows;
+    }
+    
+    
+    virtual boost::any data( const Wt::WModelIndex &index, int role = Wt::DisplayRole ) const
+    {
+      if( (role != Wt::DisplayRole) || !index.isValid() || (index.row() >= m_numRows) )
+        return boost::any();
+      
+      const Row *row = fetchRow( index.row() );
+      if( !row )
+        return boost::any();
+      
+      switch( Column(index.column()) )
+      {
+        case NameCol:          return boost::any( WString::fromUTF8(row->name) );
+        case DescriptionCol:   return boost::any( WString::fromUTF8(row->description) );
+        case SerializeTimeCol: return boost::any( row->serializeTime );
+        case IdCol:            return boost::any( row->id );
+        case NumColumns:       break;
+      }//switch( Column(index.column()) )
+      
+      return boost::any();
+    }//data(...)
+    
+    
+    virtual boost::any headerData( int section, Wt::Orientation orientation = Wt::Horizontal,
+                                   int role = Wt::DisplayRole ) const
+    {
+      if( (orientation != Wt::Horizontal) || (role != Wt::DisplayRole) )
+        return boost::any();
+      
+      switch( Column(section) )
+      {
+        case NameCol:          return boost::any( WString("Snapshot") );
+        case DescriptionCol:   return boost::any( WString("Description") );
+        case SerializeTimeCol: return boost::any( WString("Save Time") );
+        case IdCol:            return boost::any( WString("State ID") );
+        case NumColumns:       break;
+      }//switch( Column(section) )
+      
+      return boost::any();
+    }//headerData(...)
+    
+    
+    virtual void sort( int column, Wt::SortOrder order = Wt::AscendingOrder )
+    {
+      if( (column < 0) || (column >= NumColumns) )
+        return;
+      
+      layoutAboutToBeChanged().emit();
+      m_sortColumn = Column( column );
+      m_sortOrder = order;
+      m_rows.clear();
+      m_allFetched = false;
+      layoutChanged().emit();
+    }//sort(...)
+    
+    
+    /** Returns the database id of the state at `row`, or -1 if invalid (or error). */
+    long long stateId( const int row ) const
+    {
+      const Row *info = ((row >= 0) && (row < m_numRows)) ? fetchRow( row ) : nullptr;
+      return info ? info->id : -1;
+    }
+    
+  protected:
+    typedef boost::tuple<long long,std::string,std::string,Wt::WDateTime> RowTuple;
+    
+    struct Row
+    {
+      long long id;
+      std::string name;
+      std::string description;
+      Wt::WDateTime serializeTime;
+    };//struct Row
+    
+    
+    template<class T>
+    void addWhereClauses( Dbo::Query<T> &query ) const
+    {
+      query.where( "\"InterSpecUser_id\" = ?" ).bind( m_userId );
+      if( m_testStatesOnly )
+        query.where( "\"StateType\" = ?" ).bind( int(UserState::kForTest) );
+      else
+        query.where( "\"StateType\" <> ?" ).bind( int(UserState::kForTest) );
+    }//addWhereClauses(...)
+    
+    
+    /** Returns the row, fetching pages from the database until it is available; returns nullptr
+     if the row isnt available (e.g., states were deleted since counting them, or a DB error).
+     */
+    const Row *fetchRow( const int row ) const
+    {
+      while( !m_allFetched && (static_cast<size_t>(row) >= m_rows.size()) )
+        fetchNextPage();
+      
+      return (static_cast<size_t>(row) < m_rows.size()) ? &(m_rows[row]) : nullptr;
+    }//fetchRow(...)
+    
+    
+    void fetchNextPage() const
+    {
+      const bool ascending = (m_sortOrder == Wt::AscendingOrder);
+      const string cmp = ascending ? " > ?" : " < ?";
+      const string order = ascending ? " ASC" : " DESC";
+      
+      string column;
+      switch( m_sortColumn )
+      {
+        case NameCol:          column = "\"Name\"";          break;
+        case DescriptionCol:   column = "\"Description\"";   break;
+        case SerializeTimeCol: column = "\"SerializeTime\""; break;
+        case IdCol:
+        case NumColumns:       column = "";                  break;
+      }//switch( m_sortColumn )
+      
+      try
+      {
+        DataBaseUtils::DbTransaction transaction( *m_session );
+        
+        Dbo::Query<RowTuple> query = m_session->session()->query<RowTuple>(
+                    "SELECT \"id\", \"Name\", \"Description\", \"SerializeTime\" FROM \"UserState\"" );
+        addWhereClauses( query );
+        
+        if( !m_rows.empty() )
+        {
+          //Continue on from the last row we have; ties in the sort column are broken by id.
+          const Row &last = m_rows.back();
+          
+          if( column.empty() )
+          {
+            query.where( "\"id\"" + cmp ).bind( last.id );
+          }else
+          {
+            query.where( "(" + column + cmp + " OR (" + column + " = ? AND \"id\"" + cmp + "))" );
+            
+            switch( m_sortColumn )
+            {
+              case NameCol:
+                query.bind( last.name ).bind( last.name );
+                break;
+              case DescriptionCol:
+                query.bind( last.description ).bind( last.description );
+                break;
+              case SerializeTimeCol:
+                query.bind( last.serializeTime ).bind( last.serializeTime );
+                break;
+              case IdCol:
+              case NumColumns:
+                assert( 0 );
+                break;
+            }//switch( m_sortColumn )
+            
+            query.bind( last.id );
+          }//if( column.empty() ) / else
+        }//if( !m_rows.empty() )
+        
+        if( column.empty() )
+          query.orderBy( "\"id\"" + order );
+        else
+          query.orderBy( column + order + ", \"id\"" + order );
+        query.limit( static_cast<int>(sm_pageSize) );
+        
+        const Dbo::collection<RowTuple> results = query.resultList();
+        
+        size_t nfetched = 0;
+        for( const RowTuple &result : results )
+        {
+          Row row;
+          row.id = result.get<0>();
+          row.name = result.get<1>();
+          row.description = result.get<2>();
+          row.serializeTime = result.get<3>();
+          m_rows.push_back( row );
+          ++nfetched;
+        }//for( const RowTuple &result : results )
+        
+        transaction.commit();
+        
+        if( nfetched < sm_pageSize )
+          m_allFetched = true;
+      }catch( std::exception &e )
+      {
+        m_allFetched = true;
+        cerr << "DbStateBrowser: error fetching saved states: " << e.what() << endl;
+      }//try / catch
+    }//void fetchNextPage() const
+    
+    
+    std::shared_ptr<DataBaseUtils::DbSession> m_session;
+    const long long m_userId;
+    const bool m_testStatesOnly;
+    int m_numRows;
+    Column m_sortColumn;
+    Wt::SortOrder m_sortOrder;
+    
+    /** The rows fetched so far, in the current sort order. */
+    mutable std::vector<Row> m_rows;
+    mutable bool m_allFetched;
+    
+    static const size_t sm_pageSize = 50;
+  };//class StateListModel
+}//namespace DbStateBrowserImp
+
 DbStateBrowser::DbStateBrowser( InterSpec *viewer, bool testStatesOnly )
   : AuxWindow( "Restore Previously Saved State", (Wt::WFlags<AuxWindowProperties>(AuxWindowProperties::IsModal) | AuxWindowProperties::DisableCollapse | AuxWindowProperties::EnableResize) ),
     m_viewer( viewer ),
@@ -70,29 +334,10 @@ DbStateBrowser::DbStateBrowser( InterSpec *viewer, bool testStatesOnly )
       m_table->setRootIsDecorated( false ); //makes the tree look like a table! :)
       
       m_table->addStyleClass( "DbSpecFileSelectTable" );
-      m_model = new Dbo::QueryModel< Dbo::ptr<UserState> >( m_table );
+      m_model = new DbStateBrowserImp::StateListModel( m_session, user.id(), testStatesOnly, m_table );
       
-      WStringStream query;
-      query << "InterSpecUser_id = " << user.id();
-      if( testStatesOnly )
-        query << " AND StateType = " << int(UserState::kForTest);
-      else
-        query << " AND StateType <> " << int(UserState::kForTest);
-      m_model->setQuery( m_session->session()->find<UserState>().where( query.str() ) );
-      m_model->addColumn( "Name" );
-      m_model->addColumn( "Description" );
-      m_model->addColumn( "SerializeTime" );
-      m_model->addColumn( "id" );
-      
-      //        m_model->setColumnFlags( 0, ItemIsEditable | ItemIsSelectable );
-      //        m_model->setColumnFlags( 1, ItemIsEditable | ItemIsSelectable );
-      
-      m_model->setHeaderData(  0, Horizontal, WString("Snapshot"), DisplayRole );
-      m_model->setHeaderData(  1, Horizontal, WString("Description"), DisplayRole );
       m_table->setColumnWidth( 1, 130 );
-      m_model->setHeaderData(  2, Horizontal, WString("Save Time"), DisplayRole );
       m_table->setColumnWidth( 2, 130 );
-      m_model->setHeaderData(  2, Horizontal, WString("State ID"), DisplayRole );
       m_table->setColumnWidth( 3, 20 );
       
       LocalTimeDelegate *dtDelegate = new LocalTimeDelegate( m_table );
@@ -100,7 +345,6 @@ DbStateBrowser::DbStateBrowser( InterSpec *viewer, bool testStatesOnly )
       
       m_table->setModel( m_model );
       m_table->setAlternatingRowColors( true );
-      m_table->sortByColumn( 1, Wt::AscendingOrder );
       m_table->setSelectionMode( SingleSelection );
       
       for( int col = 0; col < m_model->columnCount(); ++col )
@@ -175,18 +419,19 @@ DbStateBrowser::DbStateBrowser( InterSpec *viewer, bool testStatesOnly )
     
     WModelIndex index = *indices.begin();
     
-    Dbo::ptr<UserState> dbstate = m_model->stableResultRow( index.row() );
+    const long long state_id = m_model->stateId( index.row() );
     
-    //Now we have to make 'dbfile' be associated with same session of
+    //The model only holds the id; get the full state using the same session as
     //  m_viewer->m_user.session()  {I dont know what would happen otherwise)
-    if( dbstate.id() >= 0 )
+    Dbo::ptr<UserState> dbstate;
+    if( state_id >= 0 )
     {
       std::shared_ptr<DataBaseUtils::DbSession> sql = m_viewer->sql();
       DataBaseUtils::DbTransaction transaction( *sql );
       dbstate = sql->session()->find< UserState >()
-                                .where( "id = ?").bind( dbstate.id() );
+                                .where( "id = ?").bind( state_id );
       transaction.commit();
-    }//if( dbfile.id() >= 0 )
+    }//if( state_id >= 0 )
     
     if( !dbstate || dbstate.id() < 0 )
     {
@@ -102,8 +102,53 @@ namespace
     input.erase( std::remove_if(input.begin(), input.end(), [](char a){return isspace(a);}), input.end() );
     return input;
   }
-
-
+  
+  
+  /** The maximum number of charted time-ranges DecayActivityDiv will keep the values of. */
+  const size_t ns_max_cached_activity_tables = 4;
+  
+  /** Evaluates the activity of every nuclide, at times `row*dt` for rows 0 through `num_rows - 1`.
+   
+   Instead of calling NuclideTimeEvolution::activity(...) for every nuclide at every time, each
+   exponential term of the Bateman solution is stepped from one time to the next by multiplying by
+   its per-step factor, so there is about one call to exp(...) per term, rather than per term per
+   time; every #ns_exact_reeval_rows rows the term is evaluated exactly to keep round-off from
+   accumulating.
+   
+   @returns the activities, indexed as `row*evolutions.size() + evolution_index`.
+   */
+  vector<double> evaluate_activities( const vector<const SandiaDecay::NuclideTimeEvolution *> &evolutions,
+                                      const double dt, const int num_rows )
+  {
+    const int ns_exact_reeval_rows = 64;
+    
+    const size_t nevo = evolutions.size();
+    vector<double> activities( nevo * std::max(num_rows,0), 0.0 );
+    
+    for( size_t evo_index = 0; evo_index < nevo; ++evo_index )
+    {
+      const SandiaDecay::NuclideTimeEvolution &evo = *evolutions[evo_index];
+      const double lambda = evo.nuclide->decayConstant();
+      
+      for( const SandiaDecay::TimeEvolutionTerm &term : evo.evolutionTerms )
+      {
+        const double coef = lambda * term.termCoeff;
+        const double step = exp( -term.exponentialCoeff * dt );
+        
+        double value = coef;
+        for( int row = 0; row < num_rows; ++row )
+        {
+          if( (row % ns_exact_reeval_rows) == 0 )
+            value = coef * exp( -term.exponentialCoeff * row * dt );
+          
+          activities[row*nevo + evo_index] += value;
+          value *= step;
+        }//for( loop over rows )
+      }//for( loop over exponential terms )
+    }//for( loop over nuclides )
+    
+    return activities;
+  }//evaluate_activities(...)
 }//namespace
 
 class DecayActivityModel : public Wt::WStandardItemModel
@@ -2541,6 +2586,18 @@ void DecayActivityDiv::updateInitialMixture() const
   using SandiaDecay::NuclideNumAtomsPair;
   const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
 
+  // Re-building the mixture throws away SandiaDecays solution to the decay chains, so only do it if
+  //  the inputs have actually changed.
+  stringstream keystrm;
+  keystrm << setprecision(17);
+  for( const Nuclide &nuc : m_nuclides )
+    keystrm << nuc.z << "," << nuc.a << "," << nuc.iso << "," << nuc.age << "," << nuc.activity << ";";
+  const string key = keystrm.str();
+  
+  if( (key == m_currentMixtureKey) && (m_currentMixture->numInitialNuclides() == static_cast<int>(m_nuclides.size())) )
+    return;
+  
+  m_currentMixtureKey = key;
   m_currentMixture->clear();
 
   for( const Nuclide &nuc : m_nuclides )
@@ -3094,6 +3151,83 @@ WContainerWidget *DecayActivityDiv::nuclideInformation(
 }//WContainerWidget *nuclideInformation( const Nuclide &nuclide ) const;
 
 
+std::shared_ptr<const DecayActivityDiv::ActivityTable> DecayActivityDiv::activityTable(
+                                                          const int y_axis_type,
+                                                          const double end_time,
+                                                          const int num_rows )
+{
+  for( size_t i = 0; i < m_activityTableCache.size(); ++i )
+  {
+    const shared_ptr<const ActivityTable> table = m_activityTableCache[i];
+    if( (table->mixture_key == m_currentMixtureKey)
+       && (table->end_time == end_time)
+       && (table->num_rows == num_rows)
+       && (table->y_axis_type == y_axis_type) )
+    {
+      m_activityTableCache.erase( begin(m_activityTableCache) + i );
+      m_activityTableCache.push_front( table );
+      return table;
+    }
+  }//for( loop over cached tables )
+  
+  auto table = make_shared<ActivityTable>();
+  table->mixture_key = m_currentMixtureKey;
+  table->end_time = end_time;
+  table->num_rows = num_rows;
+  table->y_axis_type = y_axis_type;
+  
+  vector<const SandiaDecay::NuclideTimeEvolution *> evolutions;
+  for( const SandiaDecay::NuclideTimeEvolution &evo : m_currentMixture->decayedToNuclidesEvolutions() )
+  {
+    if( evo.nuclide && !IsInf(evo.nuclide->halfLife) && !IsNan( evo.nuclide->halfLife ) )
+    {
+      evolutions.push_back( &evo );
+      table->nuclides.push_back( evo.nuclide );
+    }
+  }//for( const SandiaDecay::NuclideTimeEvolution &evo : decayedToNuclidesEvolutions() )
+  
+  const double dt = (num_rows > 0) ? (end_time / num_rows) : 0.0;
+  table->values = evaluate_activities( evolutions, dt, num_rows );
+  
+  const YAxisType yaxis = YAxisType( y_axis_type );
+  if( yaxis != ActivityAxis )
+  {
+    SandiaDecay::ProductType particletype = SandiaDecay::GammaParticle;
+    switch( yaxis )
+    {
+      case ActivityAxis:  case NumYAxisType:                         break;
+      case GammasAxis:    particletype = SandiaDecay::GammaParticle; break;
+      case BetasAxis:     particletype = SandiaDecay::BetaParticle;  break;
+      case AlphasAxis:    particletype = SandiaDecay::AlphaParticle; break;
+    }//switch( yaxis )
+    
+    // The number of particles per decay only depends on the nuclide, so compute it once per nuclide
+    const size_t nnuc = table->nuclides.size();
+    vector<double> particles_per_decay( nnuc, 0.0 );
+    for( size_t i = 0; i < nnuc; ++i )
+    {
+      for( const SandiaDecay::Transition *trans : table->nuclides[i]->decaysToChildren )
+      {
+        for( const SandiaDecay::RadParticle &particle : trans->products )
+        {
+          if( particle.type == particletype )
+            particles_per_decay[i] += trans->branchRatio * particle.intensity;
+        }
+      }//for( const SandiaDecay::Transition *trans : decays )
+    }//for( loop over nuclides )
+    
+    for( size_t i = 0; i < table->values.size(); ++i )
+      table->values[i] *= particles_per_decay[i % nnuc] / SandiaDecay::becquerel;
+  }//if( yaxis != ActivityAxis )
+  
+  m_activityTableCache.push_front( table );
+  if( m_activityTableCache.size() > ns_max_cached_activity_tables )
+    m_activityTableCache.resize( ns_max_cached_activity_tables );
+  
+  return table;
+}//activityTable(...)
+
+
 void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
 {
   checkTimeRangeValid();
@@ -3187,16 +3321,10 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
     return;
   
   const int nRows = m_currentNumXPoints;
-  const vector<SandiaDecay::NuclideTimeEvolution> &origEvolutions
-                              = m_currentMixture->decayedToNuclidesEvolutions();
-  vector<SandiaDecay::NuclideTimeEvolution> evolutions;
-  for( const SandiaDecay::NuclideTimeEvolution &evo : origEvolutions )
-  {
-    if( evo.nuclide && !IsInf(evo.nuclide->halfLife) && !IsNan( evo.nuclide->halfLife ) )
-      evolutions.push_back( evo );
-  }//for( const SandiaDecay::NuclideTimeEvolution &evo : origEvolutions )
+  const shared_ptr<const ActivityTable> table = activityTable( yaxis, maxDiplayTime, nRows );
+  assert( table );
   
-  const int nElements = static_cast<int>( evolutions.size() );
+  const int nElements = static_cast<int>( table->nuclides.size() );
 
   const double dt = maxDiplayTime / nRows;
   m_decayModel->insertColumns( 0, nElements + 2 );
@@ -3215,8 +3343,6 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
   
   for( int row = 0; row < nRows; ++row )
   {
-    const double row_time = (row * dt);
-
     //We will set the x-axis data as a formatted string since
     //  WAxis::setLabelFormat( "%.3g" ); doesnt seem to work
     stringstream labelText;
@@ -3227,34 +3353,9 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
     for( int elN = 0; elN < nElements; ++elN )
     {
       const int column = elN + 1;
-      double yval = 0;
-      double activity = evolutions[elN].activity(row_time);
-
+      double yval = table->values[row*nElements + elN];
       if( yaxis == ActivityAxis )
-      {
-        yval = activity / actunit;
-      }else
-      {
-        SandiaDecay::ProductType particletype = SandiaDecay::GammaParticle;
-        
-        switch( yaxis )
-        {
-          case ActivityAxis:  case NumYAxisType:                         break;
-          case GammasAxis:    particletype = SandiaDecay::GammaParticle; break;
-          case BetasAxis:     particletype = SandiaDecay::BetaParticle;  break;
-          case AlphasAxis:    particletype = SandiaDecay::AlphaParticle; break;
-        }//switch( yaxis )
-        
-        activity /= SandiaDecay::becquerel;
-        for( const SandiaDecay::Transition *trans : evolutions[elN].nuclide->decaysToChildren )
-        {
-          for( const SandiaDecay::RadParticle &particle : trans->products )
-          {
-            if( particle.type == particletype )
-              yval += activity * trans->branchRatio * particle.intensity;
-          }
-        }//for( const SandiaDecay::Transition *trans : decays )
-      }//if( yaxis == ActivityAxis ) / else
+        yval /= actunit;
 
       if( IsInf(yval) || IsNan(yval) )
         continue;
@@ -3286,8 +3387,8 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
 
   for( int column = 1; column <= nElements; ++column )
   {
-    const WString name = evolutions[column-1].nuclide->symbol;
-    m_decayModel->setNuclide( column, evolutions[column-1].nuclide->symbol ); //duplicating lots here
+    const WString name = table->nuclides[column-1]->symbol;
+    m_decayModel->setNuclide( column, table->nuclides[column-1]->symbol ); //duplicating lots here
     m_decayModel->setHeaderData( column, boost::any( name ) );
     m_decayModel->setHeaderData( column, Wt::Horizontal, true, Wt::UserRole );
   }//for( int column = 0; column < nElements; ++column )
@@ -3334,7 +3435,7 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
   for( int column = 1; column <= nElements; ++column )
   {
     //nuclide also containted in m_decayModel->headerData(column, Wt::Horizontal, Wt::UserRole);
-    const string name = evolutions[column-1].nuclide->symbol;
+    const string name = table->nuclides[column-1]->symbol;
     nuclidesset.push_back( name );
   }
   
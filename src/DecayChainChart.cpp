@@ -23,10 +23,14 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <list>
+#include <mutex>
 #include <tuple>
+#include <atomic>
 #include <math.h>
 #include <ctype.h>
+#include <memory>
 #include <algorithm>
 
 #include <Wt/WText>
@@ -37,6 +41,7 @@
 #include <Wt/WLength>
 #include <Wt/WPainter>
 #include <Wt/WRectArea>
+#include <Wt/WServer>
 #include <Wt/WResource>
 #include <Wt/WTableCell>
 #include <Wt/WGridLayout>
@@ -44,6 +49,7 @@
 #include <Wt/WPushButton>
 #include <Wt/WPaintDevice>
 #include <Wt/WApplication>
+#include <Wt/Http/Request>
 #include <Wt/Http/Response>
 #include <Wt/WStringStream>
 #include <Wt/WContainerWidget>
@@ -286,6 +292,70 @@ private:
   }//handleRequest(...)
   
 };//class DecayChainHtmlResource
+  
+  
+  /** Process-wide cache of the decay chain JSON sent to clients.
+   
+   The JSON depends on the nuclide, the chart type (decay from vs through), Ci vs Bq, and the locale
+   (half-lives and text info are localized), so these make up the key; it does not depend on anything
+   else about the session.
+   */
+  std::mutex ns_chain_json_mutex;
+  std::map<std::string,std::shared_ptr<const std::string>> ns_chain_json;
+  size_t ns_chain_json_bytes = 0;
+  
+  /** If the cache gets larger than this, it is cleared (entries are just re-created when needed). */
+  const size_t ns_max_chain_json_bytes = 32*1024*1024;
+  
+  /** Path, relative to the server root, that #DecayChainJsonResource is served at. */
+  const char * const ns_chain_json_path = "/decay-chain-json";
+  
+  /** Serves entries of #ns_chain_json, using the "key" parameter of the request.
+   
+   The URLs given to clients also contain a hash of the JSON, so the response for a given URL never
+   changes, and can be cached indefinitely.
+   */
+  class DecayChainJsonResource : public Wt::WResource
+  {
+  public:
+    DecayChainJsonResource()
+     : Wt::WResource()
+    {
+    }
+    
+    virtual ~DecayChainJsonResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request, Wt::Http::Response &response )
+    {
+      const string *key = request.getParameter( "key" );
+      
+      shared_ptr<const string> json;
+      if( key )
+      {
+        std::lock_guard<std::mutex> lock( ns_chain_json_mutex );
+        const auto pos = ns_chain_json.find( *key );
+        if( pos != end(ns_chain_json) )
+          json = pos->second;
+      }//if( key )
+      
+      if( !json )
+      {
+        response.setStatus( 404 );
+        return;
+      }
+      
+      response.setMimeType( "application/json" );
+      response.addHeader( "Cache-Control", "public, max-age=31536000, immutable" );
+      response.out() << *json;
+    }//handleRequest(...)
+  };//class DecayChainJsonResource
+  
+  
+  std::unique_ptr<DecayChainJsonResource> ns_chain_json_resource;
+  std::atomic<bool> ns_chain_json_resource_added( false );
 }//namespace
 
 
@@ -539,24 +609,23 @@ void DecayChainChart::setJsonForDecaysFrom( const SandiaDecay::Nuclide * const n
 {
   if( !nuclide )
   {
-    doJavaScript( jsRef() + ".chart.setDecayData('[]',true);" );
+    doJavaScript( jsRef() + ".chart.setDecayDataFromUrl(null,true);" );
     return;
   }
   
-  vector<const SandiaDecay::Nuclide *> descendants = nuclide->descendants();
-  
-  WStringStream js;
-  js << "[";
-  for( size_t i = 0; i < descendants.size(); ++i )
-  {
-    js << std::string(i ? "," : "");
-    jsonInfoForNuclide( descendants[i], js );
-  }
-  js << "]";
+  assert( nuclide == m_nuclide );
   
-  //cout << "JSON=" << js.str() << endl;
-  
-  doJavaScript( jsRef() + ".chart.setDecayData('" + js.str() + "',true);" );
+  setDecayDataJson( true, [this,nuclide]( WStringStream &js ){
+    const vector<const SandiaDecay::Nuclide *> descendants = nuclide->descendants();
+    
+    js << "[";
+    for( size_t i = 0; i < descendants.size(); ++i )
+    {
+      js << std::string(i ? "," : "");
+      jsonInfoForNuclide( descendants[i], js );
+    }
+    js << "]";
+  } );
 }//void setJsonForDecaysFrom( const SandiaDecay::Nuclide * const nuclide )
 
 
@@ -564,30 +633,101 @@ void DecayChainChart::setJsonForDecaysThrough( const SandiaDecay::Nuclide * cons
 {
   if( !nuclide )
   {
-    doJavaScript( jsRef() + ".chart.setDecayData('[]',false);" );
+    doJavaScript( jsRef() + ".chart.setDecayDataFromUrl(null,false);" );
     return;
   }
   
-  vector<const SandiaDecay::Nuclide *> forebearers = nuclide->forebearers();
+  assert( nuclide == m_nuclide );
   
-  //Get rid of elements above Californium since they arent typically encountered
-  forebearers.erase( std::remove_if( begin(forebearers), end(forebearers),
-                     [](const SandiaDecay::Nuclide *nuc) -> bool { return nuc->atomicNumber>98;} ),
-                     end(forebearers) );
+  setDecayDataJson( false, [this,nuclide]( WStringStream &js ){
+    vector<const SandiaDecay::Nuclide *> forebearers = nuclide->forebearers();
+    
+    //Get rid of elements above Californium since they arent typically encountered
+    forebearers.erase( std::remove_if( begin(forebearers), end(forebearers),
+                       [](const SandiaDecay::Nuclide *nuc) -> bool { return nuc->atomicNumber>98;} ),
+                       end(forebearers) );
+    
+    js << "[";
+    for( size_t i = 0; i < forebearers.size(); ++i )
+    {
+      js << std::string(i ? "," : "");
+      jsonInfoForNuclide( forebearers[i], js );
+    }
+    js << "]";
+  } );
+}//void setJsonForDecaysThrough( const SandiaDecay::Nuclide * const nuc )
+
+
+void DecayChainChart::setDecayDataJson( const bool decayFrom,
+                                        const std::function<void(Wt::WStringStream &)> &write_json )
+{
+  assert( m_nuclide );
+  if( !m_nuclide )
+    return;
   
-  WStringStream js;
-  js << "[";
-  for( size_t i = 0; i < forebearers.size(); ++i )
+  string key = m_nuclide->symbol + (decayFrom ? "_from" : "_through") + (m_useCurie ? "_ci" : "_bq");
+  WApplication *app = WApplication::instance();
+  if( app )
+    key += "_" + app->locale().name();
+  
+  shared_ptr<const string> json;
   {
-    js << std::string(i ? "," : "");
-    jsonInfoForNuclide( forebearers[i], js );
+    std::lock_guard<std::mutex> lock( ns_chain_json_mutex );
+    const auto pos = ns_chain_json.find( key );
+    if( pos != end(ns_chain_json) )
+      json = pos->second;
   }
-  js << "]";
   
-  //cout << "JSON=" << js.str() << endl;
+  if( !json )
+  {
+    // Build the JSON outside of the lock; if another session builds the same entry at the same time
+    //  we'll just use whichever was inserted first.
+    WStringStream js;
+    write_json( js );
+    json = make_shared<const string>( js.str() );
+    
+    std::lock_guard<std::mutex> lock( ns_chain_json_mutex );
+    if( (ns_chain_json_bytes + json->size()) > ns_max_chain_json_bytes )
+    {
+      ns_chain_json.clear();
+      ns_chain_json_bytes = 0;
+    }
+    
+    const auto inserted = ns_chain_json.insert( make_pair(key, json) );
+    if( inserted.second )
+      ns_chain_json_bytes += json->size();
+    else
+      json = inserted.first->second;
+  }//if( !json )
   
-  doJavaScript( jsRef() + ".chart.setDecayData('" + js.str() + "',false);" );
-}//void setJsonForDecaysThrough( const SandiaDecay::Nuclide * const nuc )
+  const string decay_from_str = decayFrom ? "true" : "false";
+  
+  if( !ns_chain_json_resource_added )
+  {
+    doJavaScript( jsRef() + ".chart.setDecayData('" + *json + "'," + decay_from_str + ");" );
+    return;
+  }
+  
+  // Including a hash of the content in the URL lets it be cached indefinitely, even if the JSON
+  //  changes with a new version of InterSpec, or nuclear data.
+  char hashstr[32];
+  snprintf( hashstr, sizeof(hashstr), "%zx", std::hash<string>()( *json ) );
+  
+  const string url = string(ns_chain_json_path) + "?key=" + Wt::Utils::urlEncode(key) + "&h=" + hashstr;
+  doJavaScript( jsRef() + ".chart.setDecayDataFromUrl('" + url + "'," + decay_from_str + ");" );
+}//void setDecayDataJson(...)
+
+
+void DecayChainChart::addJsonResourceToServer( Wt::WServer *server )
+{
+  assert( server );
+  if( !server || ns_chain_json_resource_added )
+    return;
+  
+  ns_chain_json_resource.reset( new DecayChainJsonResource() );
+  server->addResource( ns_chain_json_resource.get(), ns_chain_json_path );
+  ns_chain_json_resource_added = true;
+}//void addJsonResourceToServer( Wt::WServer *server )
   
   
 std::vector<std::string> DecayChainChart::getTextInfoForNuclide( const SandiaDecay::Nuclide * const nuc,
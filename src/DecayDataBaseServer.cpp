@@ -23,7 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <list>
+#include <cmath>
+#include <tuple>
 #include <string>
+#include <cassert>
 #include <iostream>
 #include <algorithm>
 #include <boost/filesystem.hpp>
@@ -38,25 +43,38 @@ string DecayDataBaseServer::sm_decayXrayXmlLocation = "data/sandia.decay.xml";
 
 std::mutex DecayDataBaseServer::sm_dataBaseMutex;
 SandiaDecay::SandiaDecayDataBase DecayDataBaseServer::sm_dataBase;
+std::atomic<bool> DecayDataBaseServer::sm_initialized( false );
 
 std::mutex EnergyToNuclideServer::sm_mutex;
 std::shared_ptr<const EnergyToNuclideServer::EnergyNuclidePairVec> EnergyToNuclideServer::sm_energyToNuclide;
+std::shared_ptr<const EnergyToNuclideServer::GammaIndex> EnergyToNuclideServer::sm_gammaIndex;
+std::atomic<bool> EnergyToNuclideServer::sm_gammaIndexReady( false );
 
 
 
 const SandiaDecay::SandiaDecayDataBase *DecayDataBaseServer::database()
 {
+  // This function is called very often (many times per user action, from every session), so
+  //  once the database is ready, avoid serializing all callers on the mutex.
+  if( sm_initialized.load( std::memory_order_acquire ) )
+    return &sm_dataBase;
+  
   std::lock_guard<std::mutex> lock( sm_dataBaseMutex );
 
   if( !sm_dataBase.initialized() )
     sm_dataBase.initialize( sm_decayXrayXmlLocation );
   
+  sm_initialized.store( true, std::memory_order_release );
+  
   return &sm_dataBase;
 }//const SandiaDecayDataBase *database()
 
 
 void DecayDataBaseServer::initialize()
 {
+  if( sm_initialized.load( std::memory_order_acquire ) )
+    return;
+  
   std::lock_guard<std::mutex> lock( sm_dataBaseMutex );
 
   if( sm_dataBase.initialized() )
@@ -71,6 +89,8 @@ void DecayDataBaseServer::initialize()
     
     if( !sm_dataBase.xmlContainedElementalXRayInfo() )
       throw std::runtime_error( "InterSpec requires nuclear decay XML file to contain flouresnce x-ray info" );
+    
+    sm_initialized.store( true, std::memory_order_release );
   }catch(...)
   {
     sm_dataBase.reset();
@@ -83,6 +103,9 @@ void DecayDataBaseServer::initialize()
 
 bool DecayDataBaseServer::initialized()
 {
+  if( sm_initialized.load( std::memory_order_acquire ) )
+    return true;
+  
   std::lock_guard<std::mutex> lock( sm_dataBaseMutex );
   return sm_dataBase.initialized();
 }//bool initialized()
@@ -123,6 +146,124 @@ void DecayDataBaseServer::setXmlFileDirectory( const std::string &dir )  //assum
 }//void setXmlFileDirectory( const std::string &dir )
 
 
+namespace
+{
+  /** Key of DecayedPhotonCache entries: {nuclide, quantized age, emissions, ordering}. */
+  typedef std::tuple<const SandiaDecay::Nuclide *,double,int,int> DecayedPhotonKey;
+  
+  typedef std::pair<DecayedPhotonKey,DecayedPhotonCache::PhotonsPtr> DecayedPhotonEntry;
+  
+  /** Most recently used entry at the front. */
+  std::mutex ns_decayed_photon_mutex;
+  std::list<DecayedPhotonEntry> ns_decayed_photon_lru;
+  std::map<DecayedPhotonKey,std::list<DecayedPhotonEntry>::iterator> ns_decayed_photon_lookup;
+}//namespace
+
+
+double DecayedPhotonCache::quantize_age( const double age )
+{
+  if( (age == 0.0) || !std::isfinite(age) )
+    return age;
+  
+  const double magnitude = std::floor( std::log10( std::fabs(age) ) );
+  const double scale = std::pow( 10.0, sm_ageSignificantFigures - 1 - magnitude );
+  return std::round( age * scale ) / scale;
+}//double quantize_age( const double age )
+
+
+DecayedPhotonCache::PhotonsPtr DecayedPhotonCache::photons( const SandiaDecay::Nuclide *nuclide,
+                                                     const double age, const Emissions emissions,
+                                                     const SandiaDecay::NuclideMixture::HowToOrder order )
+{
+  if( !nuclide )
+    throw runtime_error( "DecayedPhotonCache::photons: null nuclide" );
+  
+  if( (age < 0.0) || !std::isfinite(age) )
+    throw runtime_error( "DecayedPhotonCache::photons: invalid age" );
+  
+  const double quantized_age = quantize_age( age );
+  const DecayedPhotonKey key( nuclide, quantized_age, static_cast<int>(emissions), static_cast<int>(order) );
+  
+  {//begin lock on ns_decayed_photon_mutex
+    std::lock_guard<std::mutex> lock( ns_decayed_photon_mutex );
+    const auto pos = ns_decayed_photon_lookup.find( key );
+    if( pos != end(ns_decayed_photon_lookup) )
+    {
+      ns_decayed_photon_lru.splice( begin(ns_decayed_photon_lru), ns_decayed_photon_lru, pos->second );
+      return pos->second->second;
+    }
+  }//end lock on ns_decayed_photon_mutex
+  
+  // Decay outside of the lock; if another thread computes the same key meanwhile, we'll use its
+  //  result, so all callers share the same vector.
+  SandiaDecay::NuclideMixture mix;
+  mix.addNuclideByActivity( nuclide, 1.0*SandiaDecay::becquerel );
+  
+  auto result = make_shared<vector<SandiaDecay::EnergyRatePair>>();
+  switch( emissions )
+  {
+    case Emissions::Photons:
+      *result = mix.photons( quantized_age, order );
+      break;
+      
+    case Emissions::GammasAndAnnihilation:
+      *result = mix.gammas( quantized_age, order, true );
+      break;
+      
+    case Emissions::Gammas:
+      *result = mix.gammas( quantized_age, order, false );
+      break;
+  }//switch( emissions )
+  
+  std::lock_guard<std::mutex> lock( ns_decayed_photon_mutex );
+  const auto pos = ns_decayed_photon_lookup.find( key );
+  if( pos != end(ns_decayed_photon_lookup) )
+    return pos->second->second;
+  
+  ns_decayed_photon_lru.emplace_front( key, PhotonsPtr(result) );
+  ns_decayed_photon_lookup[key] = begin(ns_decayed_photon_lru);
+  
+  while( ns_decayed_photon_lru.size() > sm_maxEntries )
+  {
+    ns_decayed_photon_lookup.erase( ns_decayed_photon_lru.back().first );
+    ns_decayed_photon_lru.pop_back();
+  }
+  
+  return result;
+}//DecayedPhotonCache::photons(...)
+
+
+vector<SandiaDecay::EnergyRatePair> DecayedPhotonCache::photons_for_aged_activity(
+                                       const SandiaDecay::Nuclide *nuclide, const double activity,
+                                       const double age, const Emissions emissions,
+                                       const SandiaDecay::NuclideMixture::HowToOrder order )
+{
+  const PhotonsPtr unit_photons = photons( nuclide, age, emissions, order );
+  
+  // Activity of the parent, at `age`, for each becquerel at time zero
+  const double remaining_frac = std::exp( -quantize_age(age) * nuclide->decayConstant() );
+  const double scale = activity / remaining_frac;
+  
+  vector<SandiaDecay::EnergyRatePair> answer;
+  if( !(remaining_frac > 0.0) || !std::isfinite(scale) )
+    return answer;
+  
+  answer = *unit_photons;
+  for( SandiaDecay::EnergyRatePair &photon : answer )
+    photon.numPerSecond *= scale;
+  
+  return answer;
+}//photons_for_aged_activity(...)
+
+
+void DecayedPhotonCache::clear()
+{
+  std::lock_guard<std::mutex> lock( ns_decayed_photon_mutex );
+  ns_decayed_photon_lookup.clear();
+  ns_decayed_photon_lru.clear();
+}//void DecayedPhotonCache::clear()
+
+
 
 double EnergyToNuclideServer::sm_halfLife = 6000.0*SandiaDecay::second;
 double EnergyToNuclideServer::sm_branchRatio = 0.0;
@@ -134,16 +275,43 @@ const std::shared_ptr< const EnergyToNuclideServer::EnergyNuclidePairVec > &
 
   if( !sm_energyToNuclide )
   {
+    // Changing the limits only requires re-filtering the index, not rebuilding it.
+    const shared_ptr<const GammaIndex> index = gammaIndexLocked();
     auto result = make_shared<EnergyNuclidePairVec>();
-    result->reserve( 79264 );
-    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
-    EnergyToNuclideServer::initGammaToNuclideMatches( db, *result, sm_halfLife, sm_branchRatio );
+    EnergyToNuclideServer::filterGammaIndex( *index, *result, sm_halfLife, sm_branchRatio );
     sm_energyToNuclide = result;
   }//if( sm_energyToNuclide.empty() )
 
   return sm_energyToNuclide;
 }//const EnergyNuclidePairVec &energyToNuclide()
 
+
+std::shared_ptr<const EnergyToNuclideServer::GammaIndex> EnergyToNuclideServer::gammaIndex()
+{
+  // Called for every nuclide-by-energy lookup; once built, the index is never re-assigned, so
+  //  it can be copied without the lock.
+  if( sm_gammaIndexReady.load( std::memory_order_acquire ) )
+    return sm_gammaIndex;
+  
+  std::lock_guard<std::mutex> lock( sm_mutex );
+  return gammaIndexLocked();
+}//gammaIndex()
+
+
+std::shared_ptr<const EnergyToNuclideServer::GammaIndex> EnergyToNuclideServer::gammaIndexLocked()
+{
+  if( !sm_gammaIndex )
+  {
+    auto index = make_shared<GammaIndex>();
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    EnergyToNuclideServer::initGammaIndex( db, *index );
+    sm_gammaIndex = index;
+    sm_gammaIndexReady.store( true, std::memory_order_release );
+  }//if( !sm_gammaIndex )
+  
+  return sm_gammaIndex;
+}//gammaIndexLocked()
+
 bool EnergyToNuclideServer::initialized()
 {
   std::lock_guard<std::mutex> lock( sm_mutex );
@@ -192,6 +360,28 @@ bool EnergyToNuclideServer::EnergyNuclidePair::operator<( const EnergyToNuclideS
 }
 
 
+bool EnergyToNuclideServer::IndexedGamma::passes( const double min_halflife,
+                                                  const double min_gamma_intensity ) const
+{
+  // Same logic as the original initGammaToNuclideMatches(...) implementation: nuclides with
+  //  short half-lives are kept if any of their forebearers is long lived, and if there is
+  //  an intensity limit, lines with less than that fraction of the nuclides photons are dropped
+  if( (halfLife < min_halflife) && !(maxForebearerHalfLife > min_halflife) )
+    return false;
+  
+  if( (min_gamma_intensity > 0.0) && (intensity < min_gamma_intensity) )
+    return false;
+  
+  return true;
+}//bool IndexedGamma::passes(...)
+
+
+bool EnergyToNuclideServer::IndexedGamma::operator<( const EnergyToNuclideServer::IndexedGamma &rhs ) const
+{
+  return energy < rhs.energy;
+}
+
+
 std::vector<const SandiaDecay::Nuclide *> EnergyToNuclideServer::nuclidesWithGammaInRange( const float lowE,
                                                       const float highE,
                                                       const std::vector<const SandiaDecay::Nuclide *> &candidates,
@@ -275,57 +465,94 @@ vector<const SandiaDecay::Nuclide *> EnergyToNuclideServer::nuclidesWithGammaInR
 }//nuclidesWithGammaInRange
 
 
+vector<const SandiaDecay::Nuclide *> EnergyToNuclideServer::nuclidesWithGammaInRange( float lowE,
+                                                 float highE,
+                                                 const double min_halflife,
+                                                 const double min_gamma_intensity )
+{
+  if( highE < lowE )
+    swap( highE, lowE );
+  
+  const shared_ptr<const GammaIndex> index = gammaIndex();
+  assert( index );
+  
+  IndexedGamma lowerE, upperE;
+  lowerE.energy = lowE;
+  upperE.energy = highE;
+  
+  const GammaIndex::const_iterator lower = lower_bound( index->begin(), index->end(), lowerE );
+  const GammaIndex::const_iterator upper = upper_bound( lower, index->end(), upperE );
+  
+  vector<const SandiaDecay::Nuclide *> answer;
+  for( GammaIndex::const_iterator iter = lower; iter != upper; ++iter )
+  {
+    if( iter->passes( min_halflife, min_gamma_intensity ) )
+      answer.push_back( iter->nuclide );
+  }
+  
+  return answer;
+}//nuclidesWithGammaInRange( lowE, highE, min_halflife, min_gamma_intensity )
+
+
 
 void EnergyToNuclideServer::initGammaToNuclideMatches( const SandiaDecay::SandiaDecayDataBase *database,
                                EnergyNuclidePairVec &results,
                                const double min_halflife,
                                const double min_gamma_intensity )
 {
-  if( !results.empty() )
-    results.clear();
-  
-  vector<const SandiaDecay::Nuclide *>::const_iterator nuclideIter = database->nuclides().begin();
-  const vector<const SandiaDecay::Nuclide *>::const_iterator end = database->nuclides().end();
+  GammaIndex index;
+  initGammaIndex( database, index );
+  filterGammaIndex( index, results, min_halflife, min_gamma_intensity );
+}//void initGammaToNuclideMatches(...)
+
+
+void EnergyToNuclideServer::filterGammaIndex( const GammaIndex &index,
+                                              EnergyNuclidePairVec &results,
+                                              const double min_halflife,
+                                              const double min_gamma_intensity )
+{
+  results.clear();
   
+  //Since the index is already sorted, the results will be too
+  for( const IndexedGamma &gamma : index )
+  {
+    if( gamma.passes( min_halflife, min_gamma_intensity ) )
+      results.emplace_back( gamma.energy, gamma.nuclide );
+  }
+}//void filterGammaIndex(...)
+
+
+void EnergyToNuclideServer::initGammaIndex( const SandiaDecay::SandiaDecayDataBase *database,
+                                            GammaIndex &results )
+{
+  results.clear();
+  results.reserve( 79264 );
   
-  for( ; nuclideIter != end; ++nuclideIter )
+  for( const SandiaDecay::Nuclide * const nuclide : database->nuclides() )
   {
-    const SandiaDecay::Nuclide * const nuclide = (*nuclideIter);
     const vector<const SandiaDecay::Transition *> &transitions = nuclide->decaysToChildren;
     
-    if( nuclide->halfLife < min_halflife )
+    double max_forebearer_hl = 0.0;
+    const vector<const SandiaDecay::Nuclide *> forbears = nuclide->forebearers();
+    if( forbears.size() >= 2 )
     {
-      const vector<const SandiaDecay::Nuclide *> forbears = nuclide->forebearers();
-      if( forbears.size() < 2 )
-        continue;
-      bool keep = false;
       for( size_t i = 0; i < forbears.size(); ++i )
-      {
-        if( forbears[i]->halfLife > min_halflife )
-          keep = true;
-      }
-      
-      if( !keep )
-        continue;
-    }//if( nuclide->halfLife < min_halflife )
+        max_forebearer_hl = std::max( max_forebearer_hl, forbears[i]->halfLife );
+    }//if( forbears.size() >= 2 )
     
     float gamma_br_sum = 0.0;
-    if( min_gamma_intensity > 0.0 )
+    for( size_t trans = 0; trans < transitions.size(); ++trans )
     {
-      for( size_t trans = 0; trans < transitions.size(); ++trans )
+      const SandiaDecay::Transition *transition = transitions[trans];
+      const vector<SandiaDecay::RadParticle> &products = transition->products;
+      for( size_t part = 0; part < products.size(); ++part )
       {
-        const SandiaDecay::Transition *transition = transitions[trans];
-        const vector<SandiaDecay::RadParticle> &products = transition->products;
-        for( size_t part = 0; part < products.size(); ++part )
-        {
-          if( products[part].type == SandiaDecay::GammaParticle )
-            gamma_br_sum += products[part].intensity * transition->branchRatio;
-          else if( products[part].type == SandiaDecay::PositronParticle )
-            gamma_br_sum += 2.0f * products[part].intensity * transition->branchRatio;
-        }//for( size_t part = 0; part < products.size(); ++part )
-      }//for( size_t trans = 0; trans < transitions.size(); ++trans )
-    }//if( min_gamma_intensity > 0.0 )
-    
+        if( products[part].type == SandiaDecay::GammaParticle )
+          gamma_br_sum += products[part].intensity * transition->branchRatio;
+        else if( products[part].type == SandiaDecay::PositronParticle )
+          gamma_br_sum += 2.0f * products[part].intensity * transition->branchRatio;
+      }//for( size_t part = 0; part < products.size(); ++part )
+    }//for( size_t trans = 0; trans < transitions.size(); ++trans )
     
     for( size_t trans = 0; trans < transitions.size(); ++trans )
     {
@@ -335,26 +562,22 @@ void EnergyToNuclideServer::initGammaToNuclideMatches( const SandiaDecay::Sandia
       {
         if( products[part].type == SandiaDecay::GammaParticle || products[part].type == SandiaDecay::PositronParticle )
         {
-          if( min_gamma_intensity > 0.0 )
-          {
-            const float mult = 1.0f + static_cast<float>(products[part].type==SandiaDecay::PositronParticle);
-            const float intensity = mult * products[part].intensity * transition->branchRatio / gamma_br_sum;
-            if( intensity < min_gamma_intensity )
-              continue;
-          }//if( min_gamma_intensity > 0.0 )
-          
-          const double energy = (products[part].type==SandiaDecay::GammaParticle ? products[part].energy : static_cast<float>(510.99891*SandiaDecay::keV) );
-          const EnergyNuclidePair enPair( energy, nuclide );
-          std::vector<EnergyNuclidePair>::iterator begin, end, pos;
+          const float mult = 1.0f + static_cast<float>(products[part].type==SandiaDecay::PositronParticle);
           
-          begin = results.begin();
-          end = results.end();
-          pos = upper_bound(  begin, end, enPair );
+          IndexedGamma gamma;
+          gamma.energy = (products[part].type==SandiaDecay::GammaParticle ? products[part].energy : static_cast<float>(510.99891*SandiaDecay::keV) );
+          gamma.nuclide = nuclide;
+          gamma.intensity = mult * products[part].intensity * transition->branchRatio / gamma_br_sum;
+          gamma.halfLife = nuclide->halfLife;
+          gamma.maxForebearerHalfLife = max_forebearer_hl;
           
-          results.insert( pos, enPair );
+          results.push_back( gamma );
         }//if( products[part].type == GammaParticle )
       }//for( loop over RadParticles, part )
     }//for( loop over transitions, trans )
   }//for( loop over nuclides in database )
   
-}//void NuclidePeakMatcher() constructor
+  // A stable sort gives the same ordering (for equal energies) as the inserting at the
+  //  upper_bound that was previously done for each line, but in O(N log N) instead of O(N^2).
+  std::stable_sort( begin(results), end(results) );
+}//void initGammaIndex(...)
@@ -23,8 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <mutex>
+#include <limits>
 #include <vector>
+#include <algorithm>
 #include <iostream>
+#include <exception>
 #include <stdexcept>
 
 #include <boost/math/tools/roots.hpp>
@@ -52,8 +56,10 @@
 #include "SpecUtils/EnergyCalibration.h"
 
 #include "InterSpec/PeakFit.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/PeakFitChi2Fcn.h"
+#include "InterSpec/ChannelPrefixSum.h"
 #include "InterSpec/DetectionLimitCalc.h"
 #include "InterSpec/GammaInteractionCalc.h"
 #include "InterSpec/DetectorPeakResponse.h"
@@ -837,9 +843,9 @@ CurrieMdaResult currie_mda_calc( const CurrieMdaInput &input )
   if( result.last_upper_continuum_channel >= nchannel  )
     throw std::runtime_error( "mda_counts_calc: upper peak region is outside spectrum energy range" );
   
-  result.lower_continuum_counts_sum = spec->gamma_channels_sum(result.first_lower_continuum_channel, result.last_lower_continuum_channel);
-  result.peak_region_counts_sum = spec->gamma_channels_sum(result.first_peak_region_channel, result.last_peak_region_channel);
-  result.upper_continuum_counts_sum = spec->gamma_channels_sum(result.first_upper_continuum_channel, result.last_upper_continuum_channel);
+  result.lower_continuum_counts_sum = ChannelPrefixSum::gamma_channels_sum(spec, result.first_lower_continuum_channel, result.last_lower_continuum_channel);
+  result.peak_region_counts_sum = ChannelPrefixSum::gamma_channels_sum(spec, result.first_peak_region_channel, result.last_peak_region_channel);
+  result.upper_continuum_counts_sum = ChannelPrefixSum::gamma_channels_sum(spec, result.first_upper_continuum_channel, result.last_upper_continuum_channel);
   
   /*
    cout << "Lower region:\n\tChan\tEne\tCounts" << endl;
@@ -858,8 +864,8 @@ CurrieMdaResult currie_mda_calc( const CurrieMdaInput &input )
    cout << "\tSum: " << result.upper_continuum_counts_sum << endl;
    */
   
-  const double lower_cont_counts = spec->gamma_channels_sum(result.first_lower_continuum_channel, result.last_lower_continuum_channel);
-  const double upper_cont_counts = spec->gamma_channels_sum(result.first_upper_continuum_channel, result.last_upper_continuum_channel);
+  const double lower_cont_counts = ChannelPrefixSum::gamma_channels_sum(spec, result.first_lower_continuum_channel, result.last_lower_continuum_channel);
+  const double upper_cont_counts = ChannelPrefixSum::gamma_channels_sum(spec, result.first_upper_continuum_channel, result.last_upper_continuum_channel);
   const double lower_cont_width = spec->gamma_channel_upper(result.last_lower_continuum_channel)
   - spec->gamma_channel_lower(result.first_lower_continuum_channel);
   const double upper_cont_width = spec->gamma_channel_upper(result.last_upper_continuum_channel)
@@ -985,6 +991,245 @@ CurrieMdaResult currie_mda_calc( const CurrieMdaInput &input )
 };//mda_counts_calc
 
 
+vector<CurrieMdaResult> currie_mda_calc( const vector<CurrieMdaInput> &inputs )
+{
+  // Identical inputs (e.g., the same ROI for every distance or activity of a sweep) are only
+  //  computed once; `unique_index[i]` is the index into `unique_inputs` for `inputs[i]`.
+  vector<size_t> unique_index( inputs.size() );
+  vector<const CurrieMdaInput *> unique_inputs;
+  
+  for( size_t i = 0; i < inputs.size(); ++i )
+  {
+    const CurrieMdaInput &input = inputs[i];
+    
+    size_t index = 0;
+    for( ; index < unique_inputs.size(); ++index )
+    {
+      const CurrieMdaInput &other = *unique_inputs[index];
+      if( (input.spectrum == other.spectrum)
+         && (input.gamma_energy == other.gamma_energy)
+         && (input.roi_lower_energy == other.roi_lower_energy)
+         && (input.roi_upper_energy == other.roi_upper_energy)
+         && (input.num_lower_side_channels == other.num_lower_side_channels)
+         && (input.num_upper_side_channels == other.num_upper_side_channels)
+         && (input.detection_probability == other.detection_probability)
+         && (input.additional_uncertainty == other.additional_uncertainty) )
+        break;
+    }//for( loop over already seen inputs )
+    
+    if( index == unique_inputs.size() )
+      unique_inputs.push_back( &input );
+    unique_index[i] = index;
+  }//for( size_t i = 0; i < inputs.size(); ++i )
+  
+  vector<CurrieMdaResult> unique_results( unique_inputs.size() );
+  
+  std::mutex error_mutex;
+  std::exception_ptr first_error;
+  
+  SharedThreadPool::TaskGroup pool;
+  for( size_t i = 0; i < unique_inputs.size(); ++i )
+  {
+    pool.post( [i, &unique_inputs, &unique_results, &error_mutex, &first_error](){
+      try
+      {
+        unique_results[i] = currie_mda_calc( *unique_inputs[i] );
+      }catch( ... )
+      {
+        std::lock_guard<std::mutex> lock( error_mutex );
+        if( !first_error )
+          first_error = std::current_exception();
+      }//try / catch
+    } );
+  }//for( size_t i = 0; i < unique_inputs.size(); ++i )
+  
+  pool.join();
+  
+  if( first_error )
+    std::rethrow_exception( first_error );
+  
+  vector<CurrieMdaResult> results( inputs.size() );
+  for( size_t i = 0; i < inputs.size(); ++i )
+    results[i] = unique_results[unique_index[i]];
+  
+  return results;
+}//vector<CurrieMdaResult> currie_mda_calc( const vector<CurrieMdaInput> &inputs )
+
+
+NuclideCurrieMdaInput::NuclideCurrieMdaInput()
+  : spectrum( nullptr ),
+  nuclide( nullptr ),
+  age( 0.0 ),
+  drf( nullptr ),
+  distance( 0.0 ),
+  transmission(),
+  min_relative_yield( 0.001 ),
+  num_fwhm( 1.25f ),
+  num_side_channels( 4 ),
+  detection_probability( 0.95 ),
+  additional_uncertainty( 0.0f )
+{
+}
+
+
+vector<NuclideLineCurrieMda> currie_mda_all_lines( const NuclideCurrieMdaInput &input )
+{
+  const shared_ptr<const SpecUtils::Measurement> &spec = input.spectrum;
+  const shared_ptr<const DetectorPeakResponse> &drf = input.drf;
+  
+  if( !spec || (spec->num_gamma_channels() < 16) || !(spec->live_time() > 0.0f) )
+    throw runtime_error( "currie_mda_all_lines: invalid spectrum." );
+  
+  if( !input.nuclide )
+    throw runtime_error( "currie_mda_all_lines: no nuclide." );
+  
+  if( !drf || !drf->isValid() || !drf->hasResolutionInfo() )
+    throw runtime_error( "currie_mda_all_lines: DRF must be valid, and have resolution information." );
+  
+  if( !(input.num_fwhm > 0.0f) || (input.num_side_channels < 1) )
+    throw runtime_error( "currie_mda_all_lines: invalid ROI width." );
+  
+  const bool fixed_geom = drf->isFixedGeometry();
+  const double live_time = spec->live_time();
+  
+  SandiaDecay::NuclideMixture mixture;
+  const double dummy_activity = 0.001*SandiaDecay::curie;
+  mixture.addAgedNuclideByActivity( input.nuclide, dummy_activity, input.age );
+  
+  vector<SandiaDecay::EnergyRatePair> photons = mixture.xrays( 0.0, SandiaDecay::NuclideMixture::HowToOrder::OrderByEnergy );
+  const vector<SandiaDecay::EnergyRatePair> gammas = mixture.gammas( 0.0, SandiaDecay::NuclideMixture::HowToOrder::OrderByEnergy, true );
+  photons.insert( end(photons), begin(gammas), end(gammas) );
+  std::sort( begin(photons), end(photons),
+            []( const SandiaDecay::EnergyRatePair &lhs, const SandiaDecay::EnergyRatePair &rhs ){
+    return lhs.energy < rhs.energy;
+  } );
+  
+  // The photopeaks within the spectrum, with their expected detected counts per Bq
+  struct LineInfo
+  {
+    float energy;
+    double yield;
+    double counts_per_bq;
+  };//struct LineInfo
+  
+  vector<LineInfo> lines;
+  double max_counts_per_bq = 0.0;
+  const float min_energy = std::max( 10.0f, spec->gamma_energy_min() );
+  const float max_energy = spec->gamma_energy_max();
+  
+  for( const SandiaDecay::EnergyRatePair &erp : photons )
+  {
+    const float energy = static_cast<float>( erp.energy );
+    const double yield = erp.numPerSecond / dummy_activity;
+    if( (energy < min_energy) || (energy > max_energy) || !(yield > 0.0) )
+      continue;
+    
+    const double det_eff = fixed_geom ? drf->intrinsicEfficiency(energy)
+                                      : drf->efficiency(energy, input.distance);
+    const double shield_transmission = input.transmission ? input.transmission(energy) : 1.0;
+    const double air_transmission = (fixed_geom || (input.distance <= 0.0)) ? 1.0
+                   : exp( -1.0*GammaInteractionCalc::transmission_coefficient_air( energy, input.distance ) );
+    
+    LineInfo line;
+    line.energy = energy;
+    line.yield = yield;
+    line.counts_per_bq = yield * shield_transmission * air_transmission * det_eff * live_time;
+    if( !(line.counts_per_bq > 0.0) || SpecUtils::IsInf(line.counts_per_bq) || SpecUtils::IsNan(line.counts_per_bq) )
+      continue;
+    
+    max_counts_per_bq = std::max( max_counts_per_bq, line.counts_per_bq );
+    lines.push_back( line );
+  }//for( const SandiaDecay::EnergyRatePair &erp : photons )
+  
+  // Combine photopeaks into ROIs; lines whose regions overlap go into the same ROI.
+  vector<NuclideLineCurrieMda> rois;
+  vector<CurrieMdaInput> inputs;
+  vector<double> weighted_energy_sums; //For the count-weighted mean energy of each ROI
+  float current_upper = -1.0f;
+  
+  for( const LineInfo &line : lines )
+  {
+    if( line.counts_per_bq < input.min_relative_yield*max_counts_per_bq )
+      continue;
+    
+    const float fwhm = drf->peakResolutionFWHM( line.energy );
+    if( !(fwhm > 0.0f) || SpecUtils::IsInf(fwhm) )
+      continue;
+    
+    const float lower = line.energy - input.num_fwhm*fwhm;
+    const float upper = line.energy + input.num_fwhm*fwhm;
+    
+    if( rois.empty() || (lower > current_upper) )
+    {
+      rois.emplace_back();
+      rois.back().counts_per_bq = 0.0;
+      inputs.emplace_back();
+      inputs.back().spectrum = spec;
+      inputs.back().roi_lower_energy = lower;
+      inputs.back().num_lower_side_channels = input.num_side_channels;
+      inputs.back().num_upper_side_channels = input.num_side_channels;
+      inputs.back().detection_probability = input.detection_probability;
+      inputs.back().additional_uncertainty = input.additional_uncertainty;
+      weighted_energy_sums.push_back( 0.0 );
+    }//if( start a new ROI )
+    
+    current_upper = std::max( current_upper, upper );
+    inputs.back().roi_upper_energy = current_upper;
+    rois.back().energies_and_yields.emplace_back( line.energy, line.yield );
+    rois.back().counts_per_bq += line.counts_per_bq;
+    weighted_energy_sums.back() += line.energy * line.counts_per_bq;
+  }//for( const LineInfo &line : lines )
+  
+  // Drop the ROIs the continuum regions dont fit into the spectrum for (batch calculation would throw for them)
+  const size_t nchannel = spec->num_gamma_channels();
+  vector<NuclideLineCurrieMda> valid_rois;
+  vector<CurrieMdaInput> valid_inputs;
+  for( size_t i = 0; i < rois.size(); ++i )
+  {
+    CurrieMdaInput &roi_input = inputs[i];
+    // The reference energy of combined ROIs is the count-weighted mean energy
+    roi_input.gamma_energy = static_cast<float>( weighted_energy_sums[i] / rois[i].counts_per_bq );
+    roi_input.gamma_energy = std::min( std::max( roi_input.gamma_energy, roi_input.roi_lower_energy ), roi_input.roi_upper_energy );
+    
+    if( (roi_input.roi_lower_energy <= spec->gamma_energy_min())
+       || (roi_input.roi_upper_energy >= spec->gamma_energy_max()) )
+      continue;
+    
+    const pair<size_t,size_t> channels = round_roi_to_channels( spec, roi_input.roi_lower_energy, roi_input.roi_upper_energy );
+    if( (channels.first < (input.num_side_channels + 1))
+       || (channels.second < channels.first)
+       || ((channels.second + input.num_side_channels) >= nchannel) )
+      continue;
+    
+    valid_rois.push_back( rois[i] );
+    valid_inputs.push_back( roi_input );
+  }//for( size_t i = 0; i < rois.size(); ++i )
+  
+  if( valid_inputs.empty() )
+    throw runtime_error( "currie_mda_all_lines: no photopeaks of " + input.nuclide->symbol + " could be evaluated." );
+  
+  const vector<CurrieMdaResult> results = currie_mda_calc( valid_inputs );
+  assert( results.size() == valid_rois.size() );
+  
+  for( size_t i = 0; i < valid_rois.size(); ++i )
+  {
+    NuclideLineCurrieMda &roi = valid_rois[i];
+    roi.result = results[i];
+    roi.mda = (roi.result.detection_limit < 0.0f) ? std::numeric_limits<double>::infinity()
+                                                   : (roi.result.detection_limit / roi.counts_per_bq);
+    roi.upper_limit_activity = roi.result.upper_limit / roi.counts_per_bq;
+    roi.lower_limit_activity = roi.result.lower_limit / roi.counts_per_bq;
+  }//for( size_t i = 0; i < valid_rois.size(); ++i )
+  
+  std::stable_sort( begin(valid_rois), end(valid_rois),
+                    []( const NuclideLineCurrieMda &lhs, const NuclideLineCurrieMda &rhs ){
+    return lhs.mda < rhs.mda;
+  } );
+  
+  return valid_rois;
+}//vector<NuclideLineCurrieMda> currie_mda_all_lines( const NuclideCurrieMdaInput &input )
+
+
 DeconRoiInfo::DeconRoiInfo()
 : roi_start( 0.0f ),
   roi_end( 0.0f ),
@@ -1018,48 +1263,55 @@ DeconComputeInput::DeconComputeInput()
 }
 
 
-DeconComputeResults decon_compute_peaks( const DeconComputeInput &input )
+namespace
 {
-  DeconComputeResults result;
-  result.input = input;
-  result.chi2 = 0.0;
-  result.num_degree_of_freedom = 0;
-  
-  // Lets sanity check input
-  if( (input.distance < 0.0) || IsNan(input.distance) || IsInf(input.distance) )
-    throw runtime_error( "decon_compute_peaks: invalid input distance" );
-  
-  // Lets sanity check input
-  if( (input.activity < 0.0) || IsNan(input.activity) || IsInf(input.activity) )
-    throw runtime_error( "decon_compute_peaks: invalid input activity" );
-  
-  if( input.include_air_attenuation
-      && ((input.shielding_thickness < 0.0)
-          || IsNan(input.shielding_thickness)
-          || IsInf(input.shielding_thickness)
-          || (input.shielding_thickness >= input.distance)) )
-    throw runtime_error( "decon_compute_peaks: invalid input shielding thickness" );
-  
-  if( !input.drf || !input.drf->isValid() || !input.drf->hasResolutionInfo() )
-    throw runtime_error( "decon_compute_peaks: invalid DRF input" );
-  
+  /** Checks the parts of the input needed to create the ROI continuums. */
+  void check_decon_drf_and_spectrum( const DeconComputeInput &input )
+  {
+    if( !input.drf || !input.drf->isValid() || !input.drf->hasResolutionInfo() )
+      throw runtime_error( "decon_compute_peaks: invalid DRF input" );
+    
+    
+    if( !input.measurement || (input.measurement->num_gamma_channels() < 2)
+       || !input.measurement->energy_calibration() //ptr should always be valid anyway
+       || !input.measurement->energy_calibration()->valid() )
+      throw runtime_error( "decon_compute_peaks: invalid spectrum input" );
+  }//void check_decon_drf_and_spectrum( const DeconComputeInput &input )
   
-  if( !input.measurement || (input.measurement->num_gamma_channels() < 2)
-     || !input.measurement->energy_calibration() //ptr should always be valid anyway
-     || !input.measurement->energy_calibration()->valid() )
-    throw runtime_error( "decon_compute_peaks: invalid spectrum input" );
   
-  // Check if there is anything to do
-  if( input.roi_info.empty() )
-    return result;
+  void check_decon_input( const DeconComputeInput &input )
+  {
+    // Lets sanity check input
+    if( (input.distance < 0.0) || IsNan(input.distance) || IsInf(input.distance) )
+      throw runtime_error( "decon_compute_peaks: invalid input distance" );
+    
+    // Lets sanity check input
+    if( (input.activity < 0.0) || IsNan(input.activity) || IsInf(input.activity) )
+      throw runtime_error( "decon_compute_peaks: invalid input activity" );
+    
+    if( input.include_air_attenuation
+        && ((input.shielding_thickness < 0.0)
+            || IsNan(input.shielding_thickness)
+            || IsInf(input.shielding_thickness)
+            || (input.shielding_thickness >= input.distance)) )
+      throw runtime_error( "decon_compute_peaks: invalid input shielding thickness" );
     
-  const bool fixed_geom = input.drf->isFixedGeometry();
+    check_decon_drf_and_spectrum( input );
+  }//void check_decon_input( const DeconComputeInput &input )
   
-  // We should be good to go,
-  vector<PeakDef> inputPeaks, fittedPeaks;
   
-  for( const DeconRoiInfo &roi : input.roi_info )
+  /** Creates the continuum for a ROI, as it should be before the peaks are fit.
+   
+   The continuum only depends on the spectrum, the DRF resolution, and the ROI definition; it does not depend on activity, distance, or
+   shielding, so when computing many points for the same ROIs, this only needs to be done once.
+   
+   Returns nullptr if the ROI has no peaks.
+   */
+  shared_ptr<const PeakContinuum> decon_roi_continuum( const DeconRoiInfo &roi, const DeconComputeInput &input )
   {
+    if( roi.peak_infos.empty() )
+      return nullptr;
+    
     const float  &roi_start = roi.roi_start; //This _should_ already be rounded to nearest bin edge; TODO: check that this is rounded
     const float  &roi_end = roi.roi_end; //This _should_ already be rounded to nearest bin edge; TODO: check that this is rounded
     
@@ -1080,10 +1332,6 @@ DeconComputeResults decon_compute_peaks( const DeconComputeInput &input )
     const size_t &num_lower_side_channels = roi.num_lower_side_channels;
     const size_t &num_upper_side_channels = roi.num_upper_side_channels;
     
-    
-    shared_ptr<PeakContinuum> peak_continuum;
-    std::shared_ptr<const SpecUtils::Measurement> computed_global_cont;
-    
     // Find the largest peak in the ROIs, energy to use as the continuum "reference energy"
     float reference_energy = 0.0f;
     for( const DeconRoiInfo::PeakInfo &peak_info : roi.peak_infos )
@@ -1091,238 +1339,379 @@ DeconComputeResults decon_compute_peaks( const DeconComputeInput &input )
     
     assert( reference_energy != 0.0f );
     
-    for( const DeconRoiInfo::PeakInfo &peak_info : roi.peak_infos )
+    // The first peak of the ROI is used for the peak width when fitting the continuum
+    const DeconRoiInfo::PeakInfo &first_peak = roi.peak_infos.front();
+    const float fwhm = (first_peak.fwhm > 0.0f) ? first_peak.fwhm : input.drf->peakResolutionFWHM( first_peak.energy );
+    const float sigma = fwhm / 2.634;
+    
+    shared_ptr<PeakContinuum> peak_continuum = make_shared<PeakContinuum>();
+    peak_continuum->setType( continuum_type );
+    peak_continuum->setRange( roi_start, roi_end );
+    
+    size_t nlowerside = num_lower_side_channels;
+    size_t nupperside = num_upper_side_channels;
+    if( roi.cont_norm_method != DeconContinuumNorm::FixedByEdges )
     {
-      const float &energy = peak_info.energy;
-      const float fwhm = (peak_info.fwhm > 0.0f) ? peak_info.fwhm : input.drf->peakResolutionFWHM( energy );
-      const float sigma = fwhm / 2.634;
-      const double det_eff = fixed_geom ? input.drf->intrinsicEfficiency(energy)
-                                        : input.drf->efficiency( energy, input.distance );
-      const double counts_4pi = peak_info.counts_per_bq_into_4pi;
-      double air_atten = 1.0;
-      
-      if( input.include_air_attenuation && !fixed_geom )
-      {
-        const double air_len = input.distance - input.shielding_thickness;
-        const double mu_air = GammaInteractionCalc::transmission_coefficient_air( energy, air_len );
-        air_atten = exp( -1.0 * mu_air );
-      }
+      //if no value provided, use 4 channels
+      if( !nlowerside )
+        nlowerside = 4;
+      if( !nupperside )
+        nupperside = 4;
       
-      const float amplitude = input.activity * counts_4pi * det_eff * air_atten;
+      // Clamp between 2 and 16 channels
+      nupperside = ((nupperside < 2) ? size_t(2) : ((nupperside > 16) ? size_t(16) : nupperside)); //std::clamp(...), C++17
+      nlowerside = ((nlowerside < 2) ? size_t(2) : ((nlowerside > 16) ? size_t(16) : nlowerside)); //std::clamp(...), C++17
+    }else
+    {
+      assert( num_lower_side_channels > 0 );
+      assert( num_upper_side_channels > 0 );
+    }
     
-      PeakDef peak( energy, sigma, amplitude );
-      peak.setFitFor( PeakDef::CoefficientType::Mean, false );
-      peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
-      peak.setFitFor( PeakDef::CoefficientType::GaussAmplitude, false );
+    // First, we'll find a linear continuum as the starting point, and then go through
+    //  and modify it how we need
+    peak_continuum->calc_linear_continuum_eqn( input.measurement, reference_energy,
+                                              roi_start, roi_end, nlowerside, nupperside );
+    
+    peak_continuum->setType( continuum_type );
+    
+    
+    if( cont_norm_method == DeconContinuumNorm::FixedByFullRange )
+    {
+      // We'll set a peaks amplitude for zero
+      for( size_t order = 0; order < peak_continuum->parameters().size(); ++order )
+        peak_continuum->setPolynomialCoefFitFor( order, true );
       
-      if( peak_continuum )
+      PeakDef worker_peak( 0.5*(roi_start + roi_end), sigma, 0.0 );
+      worker_peak.setContinuum( peak_continuum );
+      worker_peak.setFitFor( PeakDef::CoefficientType::Mean, false );
+      worker_peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
+      worker_peak.setFitFor( PeakDef::CoefficientType::GaussAmplitude, false );
+      
+      std::vector<PeakDef> fit_peak;
+      fitPeaks( {worker_peak}, -1.0, -1.0, input.measurement, fit_peak, {}, false );
+      
+      assert( fit_peak.size() == 1 );
+      if( fit_peak.size() == 1 )
       {
-        peak.setContinuum( peak_continuum );
+        peak_continuum = fit_peak[0].continuum();
       }else
       {
-        peak_continuum = peak.continuum();
-        peak_continuum->setType( continuum_type );
-        peak_continuum->setRange( roi_start, roi_end );
-        
-        size_t nlowerside = num_lower_side_channels;
-        size_t nupperside = num_upper_side_channels;
-        if( roi.cont_norm_method != DeconContinuumNorm::FixedByEdges )
-        {
-          //if no value provided, use 4 channels
-          if( !nlowerside )
-            nlowerside = 4;
-          if( !nupperside )
-            nupperside = 4;
-          
-          // Clamp between 2 and 16 channels
-          nupperside = ((nupperside < 2) ? size_t(2) : ((nupperside > 16) ? size_t(16) : nupperside)); //std::clamp(...), C++17
-          nlowerside = ((nlowerside < 2) ? size_t(2) : ((nlowerside > 16) ? size_t(16) : nlowerside)); //std::clamp(...), C++17
-        }else
-        {
-          assert( num_lower_side_channels > 0 );
-          assert( num_upper_side_channels > 0 );
-        }
-        
-        // First, we'll find a linear continuum as the starting point, and then go through
-        //  and modify it how we need
-        peak_continuum->calc_linear_continuum_eqn( input.measurement, reference_energy,
-                                                  roi_start, roi_end, nlowerside, nupperside );
-        
-        peak_continuum->setType( continuum_type );
-        
-        
-        if( cont_norm_method == DeconContinuumNorm::FixedByFullRange )
-        {
-          // We'll set a peaks amplitude for zero
-          for( size_t order = 0; order < peak_continuum->parameters().size(); ++order )
-            peak_continuum->setPolynomialCoefFitFor( order, true );
-          
-          PeakDef worker_peak( 0.5*(roi_start + roi_end), sigma, 0.0 );
-          worker_peak.setContinuum( peak_continuum );
-          worker_peak.setFitFor( PeakDef::CoefficientType::Mean, false );
-          worker_peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
-          worker_peak.setFitFor( PeakDef::CoefficientType::GaussAmplitude, false );
-          
-          std::vector<PeakDef> fit_peak;
-          fitPeaks( {worker_peak}, -1.0, -1.0, input.measurement, fit_peak, {}, false );
-          
-          assert( fit_peak.size() == 1 );
-          if( fit_peak.size() == 1 )
-          {
-            peak_continuum = fit_peak[0].continuum();
-            peak.setContinuum( peak_continuum );
-          }else
-          {
-            string msg = "Error fitting DeconContinuumNorm::FixedByFullRange continuum - failed to"
-                        " get a peak out - expected 1, got " + std::to_string(fit_peak.size());
-            cerr << msg << endl;
+        string msg = "Error fitting DeconContinuumNorm::FixedByFullRange continuum - failed to"
+                    " get a peak out - expected 1, got " + std::to_string(fit_peak.size());
+        cerr << msg << endl;
 #if( PERFORM_DEVELOPER_CHECKS )
-            log_developer_error( __func__, msg.c_str() );
-            throw runtime_error( msg );
+        log_developer_error( __func__, msg.c_str() );
+        throw runtime_error( msg );
 #endif
-          }//if( fit_peak.size() == 1 ) / else
-        }//if( cont_norm_method == DeconContinuumNorm::FixedByFullRange )
+      }//if( fit_peak.size() == 1 ) / else
+    }//if( cont_norm_method == DeconContinuumNorm::FixedByFullRange )
+    
+    
+    for( size_t order = 0; order < peak_continuum->parameters().size(); ++order )
+    {
+      switch( cont_norm_method )
+      {
+        case DeconContinuumNorm::Floating:
+          peak_continuum->setPolynomialCoefFitFor( order, true );
+          break;
+          
+        case DeconContinuumNorm::FixedByFullRange:
+        case DeconContinuumNorm::FixedByEdges:
+          peak_continuum->setPolynomialCoefFitFor( order, false );
+          break;
+      }//switch( cont_norm_method )
+    }//for( size_t order = 0; order < peak_continuum->parameters().size(); ++order )
+    
+    
+    switch( continuum_type )
+    {
+      case PeakContinuum::Linear:
+      case PeakContinuum::Quadratic:
+        break;
+      
+      case PeakContinuum::NoOffset:
+      case PeakContinuum::Constant:
+      case PeakContinuum::Cubic:
+      case PeakContinuum::FlatStep:
+      case PeakContinuum::LinearStep:
+      case PeakContinuum::BiLinearStep:
+        assert( 0 );
+        break;
         
+      case PeakContinuum::External:
+        peak_continuum->setExternalContinuum( estimateContinuum( input.measurement ) );
+        break;
+    }//switch( assign continuum )
+    
+    return peak_continuum;
+  }//shared_ptr<const PeakContinuum> decon_roi_continuum( const DeconRoiInfo &roi, const DeconComputeInput &input )
+  
+  
+  /** Returns the un-fit continuum for each ROI of the input; see #decon_roi_continuum. */
+  vector<shared_ptr<const PeakContinuum>> decon_roi_continuums( const DeconComputeInput &input )
+  {
+    check_decon_drf_and_spectrum( input );
+    
+    vector<shared_ptr<const PeakContinuum>> continuums;
+    for( const DeconRoiInfo &roi : input.roi_info )
+      continuums.push_back( decon_roi_continuum( roi, input ) );
+    return continuums;
+  }//decon_roi_continuums(...)
+  
+  
+  /** Does the actual work of #decon_compute_peaks, using the continuums from #decon_roi_continuums; the continuums are copied
+   for each call, so they may be shared between calls (and threads) with different activities, distances, or shieldings.
+   
+   If \p fit_continuums is non-null, it will be filled with the fit continuum of each ROI; these can be passed back in as
+   \p roi_continuums, to start the fit of a nearby activity or distance from this solution.
+   */
+  DeconComputeResults decon_compute_peaks_with_continuums( const DeconComputeInput &input,
+                                                    const vector<shared_ptr<const PeakContinuum>> &roi_continuums,
+                                                    vector<shared_ptr<const PeakContinuum>> *fit_continuums = nullptr )
+  {
+    if( fit_continuums )
+      *fit_continuums = roi_continuums;
+    
+    DeconComputeResults result;
+    result.input = input;
+    result.chi2 = 0.0;
+    result.num_degree_of_freedom = 0;
+    
+    check_decon_input( input );
+    
+    // Check if there is anything to do
+    if( input.roi_info.empty() )
+      return result;
+    
+    assert( roi_continuums.size() == input.roi_info.size() );
+    if( roi_continuums.size() != input.roi_info.size() )
+      throw logic_error( "decon_compute_peaks: continuums dont match ROIs" );
+    
+    const bool fixed_geom = input.drf->isFixedGeometry();
+    
+    // We should be good to go,
+    vector<PeakDef> inputPeaks, fittedPeaks;
+    vector<size_t> peak_roi_index;
+    
+    for( size_t roi_index = 0; roi_index < input.roi_info.size(); ++roi_index )
+    {
+      const DeconRoiInfo &roi = input.roi_info[roi_index];
+      if( roi.peak_infos.empty() )
+        continue;
+      
+      assert( roi_continuums[roi_index] );
+      const shared_ptr<PeakContinuum> peak_continuum = make_shared<PeakContinuum>( *roi_continuums[roi_index] );
+      
+      for( const DeconRoiInfo::PeakInfo &peak_info : roi.peak_infos )
+      {
+        const float &energy = peak_info.energy;
+        const float fwhm = (peak_info.fwhm > 0.0f) ? peak_info.fwhm : input.drf->peakResolutionFWHM( energy );
+        const float sigma = fwhm / 2.634;
+        const double det_eff = fixed_geom ? input.drf->intrinsicEfficiency(energy)
+                                          : input.drf->efficiency( energy, input.distance );
+        const double counts_4pi = peak_info.counts_per_bq_into_4pi;
+        double air_atten = 1.0;
         
-        for( size_t order = 0; order < peak_continuum->parameters().size(); ++order )
+        if( input.include_air_attenuation && !fixed_geom )
         {
-          switch( cont_norm_method )
-          {
-            case DeconContinuumNorm::Floating:
-              peak_continuum->setPolynomialCoefFitFor( order, true );
-              break;
-              
-            case DeconContinuumNorm::FixedByFullRange:
-            case DeconContinuumNorm::FixedByEdges:
-              peak_continuum->setPolynomialCoefFitFor( order, false );
-              break;
-          }//switch( cont_norm_method )
-        }//for( size_t order = 0; order < peak_continuum->parameters().size(); ++order )
-        
+          const double air_len = input.distance - input.shielding_thickness;
+          const double mu_air = GammaInteractionCalc::transmission_coefficient_air( energy, air_len );
+          air_atten = exp( -1.0 * mu_air );
+        }
         
-        switch( continuum_type )
-        {
-          case PeakContinuum::Linear:
-          case PeakContinuum::Quadratic:
-            break;
-          
-          case PeakContinuum::NoOffset:
-          case PeakContinuum::Constant:
-          case PeakContinuum::Cubic:
-          case PeakContinuum::FlatStep:
-          case PeakContinuum::LinearStep:
-          case PeakContinuum::BiLinearStep:
-            assert( 0 );
-            break;
-            
-          case PeakContinuum::External:
-            if( !computed_global_cont )
-              computed_global_cont = estimateContinuum( input.measurement );
-            peak_continuum->setExternalContinuum( computed_global_cont );
-            break;
-        }//switch( assign continuum )
-      }//if( peak_continuum ) / else
+        const float amplitude = input.activity * counts_4pi * det_eff * air_atten;
       
-      inputPeaks.push_back( std::move(peak) );
-    }//for( const DeconRoiInfo::PeakInfo &peak_info : roi.peak_infos )
-  }//for( size_t i = 0; i < energies.size(); ++i )
-  
-  if( inputPeaks.empty() )
-    throw runtime_error( "decon_compute_peaks: No peaks given in ROI(s)" );
+        PeakDef peak( energy, sigma, amplitude );
+        peak.setFitFor( PeakDef::CoefficientType::Mean, false );
+        peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
+        peak.setFitFor( PeakDef::CoefficientType::GaussAmplitude, false );
+        peak.setContinuum( peak_continuum );
+        
+        inputPeaks.push_back( std::move(peak) );
+        peak_roi_index.push_back( roi_index );
+      }//for( const DeconRoiInfo::PeakInfo &peak_info : roi.peak_infos )
+    }//for( size_t roi_index = 0; roi_index < input.roi_info.size(); ++roi_index )
+    
+    if( inputPeaks.empty() )
+      throw runtime_error( "decon_compute_peaks: No peaks given in ROI(s)" );
 
-  ROOT::Minuit2::MnUserParameters inputFitPars;
-  PeakFitChi2Fcn::addPeaksToFitter( inputFitPars, inputPeaks, input.measurement, PeakFitChi2Fcn::kFitForPeakParameters );
+    ROOT::Minuit2::MnUserParameters inputFitPars;
+    PeakFitChi2Fcn::addPeaksToFitter( inputFitPars, inputPeaks, input.measurement, PeakFitChi2Fcn::kFitForPeakParameters );
   
-  const int npeaks = static_cast<int>( inputPeaks.size() );
-  PeakFitChi2Fcn chi2Fcn( npeaks, input.measurement, nullptr );
-  chi2Fcn.useReducedChi2( false );
+    const int npeaks = static_cast<int>( inputPeaks.size() );
+    PeakFitChi2Fcn chi2Fcn( npeaks, input.measurement, nullptr );
+    chi2Fcn.useReducedChi2( false );
   
-  if( inputFitPars.VariableParameters() == 0 )
-  {
-    // If we choose to "Fix continuum" we can get here
-    result.chi2 = chi2Fcn.chi2( inputFitPars.Params().data() );
-    result.num_degree_of_freedom = 0;
+    if( inputFitPars.VariableParameters() == 0 )
+    {
+      // If we choose to "Fix continuum" we can get here
+      result.chi2 = chi2Fcn.chi2( inputFitPars.Params().data() );
+      result.num_degree_of_freedom = 0;
+    
+      for( auto &peak : inputPeaks )
+      {
+        peak.setFitFor( PeakDef::CoefficientType::Mean, false );
+        peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
+      }
     
-    for( auto &peak : inputPeaks )
+      result.fit_peaks = inputPeaks;
+    
+      return result;
+    }//if( inputFitPars.VariableParameters() == 0 )
+  
+    assert( inputFitPars.VariableParameters() != 0 );
+  
+    ROOT::Minuit2::MnUserParameterState inputParamState( inputFitPars );
+    ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
+    ROOT::Minuit2::MnMinimize fitter( chi2Fcn, inputParamState, strategy );
+  
+    unsigned int maxFcnCall = 5000;
+    double tolerance = 2.5;
+    tolerance = 0.5;
+    ROOT::Minuit2::FunctionMinimum minimum = fitter( maxFcnCall, tolerance );
+    const ROOT::Minuit2::MnUserParameters &fitParams = fitter.Parameters();
+    //  minimum.IsValid()
+    //      ROOT::Minuit2::MinimumState minState = minimum.State();
+    //      ROOT::Minuit2::MinimumParameters minParams = minState.Parameters();
+  
+    //    cerr << endl << endl << "EDM=" << minimum.Edm() << endl;
+    //    cerr << "MinValue=" <<  minimum.Fval() << endl << endl;
+  
+    if( !minimum.IsValid() )
+      minimum = fitter( maxFcnCall, tolerance );
+  
+    if( !minimum.IsValid() )
+    {
+      //XXX - should we try to re-fit here? Or do something to handle the
+      //      faliure in some reasonable way?
+      cerr << endl << endl << "status is not valid"
+      << "\n\tHasMadePosDefCovar: " << minimum.HasMadePosDefCovar()
+      << "\n\tHasAccurateCovar: " << minimum.HasAccurateCovar()
+      << "\n\tHasReachedCallLimit: " << minimum.HasReachedCallLimit()
+      << "\n\tHasValidCovariance: " << minimum.HasValidCovariance()
+      << "\n\tHasValidParameters: " << minimum.HasValidParameters()
+      << "\n\tIsAboveMaxEdm: " << minimum.IsAboveMaxEdm()
+      << endl;
+      if( minimum.IsAboveMaxEdm() )
+        cout << "\t\tEDM=" << minimum.Edm() << endl;
+    }//if( !minimum.IsValid() )
+  
+  
+    vector<double> fitpars = fitParams.Params();
+    vector<double> fiterrors = fitParams.Errors();
+    chi2Fcn.parametersToPeaks( fittedPeaks, &fitpars[0], &fiterrors[0] );
+  
+    double initialChi2 = chi2Fcn.chi2( &fitpars[0] );
+  
+    //Lets try to keep whether or not to fit parameters should be the same for
+    //  the output peaks as the input peaks.
+    //Note that this doesnt account for peaks swapping with each other in the fit
+    assert( fittedPeaks.size() == inputPeaks.size() );
+  
+    //for( size_t i = 0; i < near_peaks.size(); ++i )
+    //  fittedPeaks[i].inheritUserSelectedOptions( near_peaks[i], true );
+    //for( size_t i = 0; i < fixedpeaks.size(); ++i )
+    //  fittedPeaks[i+near_peaks.size()].inheritUserSelectedOptions( fixedpeaks[i], true );
+  
+    const double totalNDF = set_chi2_dof( input.measurement, fittedPeaks, 0, fittedPeaks.size() );
+  
+    if( fit_continuums )
+    {
+      assert( peak_roi_index.size() == fittedPeaks.size() );
+      for( size_t i = 0; i < fittedPeaks.size(); ++i )
+      {
+        const size_t roi_index = peak_roi_index[i];
+        if( (i == 0) || (peak_roi_index[i-1] != roi_index) )
+          (*fit_continuums)[roi_index] = make_shared<const PeakContinuum>( *fittedPeaks[i].continuum() );
+      }
+    }//if( fit_continuums )
+    
+    result.chi2 = initialChi2;
+    result.num_degree_of_freedom = static_cast<int>( std::round(totalNDF) );
+  
+    for( auto &peak : fittedPeaks )
     {
       peak.setFitFor( PeakDef::CoefficientType::Mean, false );
       peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
     }
-    
-    result.fit_peaks = inputPeaks;
-    
-    return result;
-  }//if( inputFitPars.VariableParameters() == 0 )
   
-  assert( inputFitPars.VariableParameters() != 0 );
+    result.fit_peaks = fittedPeaks;
   
-  ROOT::Minuit2::MnUserParameterState inputParamState( inputFitPars );
-  ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
-  ROOT::Minuit2::MnMinimize fitter( chi2Fcn, inputParamState, strategy );
+    return result;
+  }//DeconComputeResults decon_compute_peaks_with_continuums(...)
+}//namespace
+
+
+DeconComputeResults decon_compute_peaks( const DeconComputeInput &input )
+{
+  check_decon_input( input );
   
-  unsigned int maxFcnCall = 5000;
-  double tolerance = 2.5;
-  tolerance = 0.5;
-  ROOT::Minuit2::FunctionMinimum minimum = fitter( maxFcnCall, tolerance );
-  const ROOT::Minuit2::MnUserParameters &fitParams = fitter.Parameters();
-  //  minimum.IsValid()
-  //      ROOT::Minuit2::MinimumState minState = minimum.State();
-  //      ROOT::Minuit2::MinimumParameters minParams = minState.Parameters();
+  return decon_compute_peaks_with_continuums( input, decon_roi_continuums( input ) );
+}//DeconComputeResults decon_compute_peaks( const DeconComputeInput &input )
+
+
+DeconGridPoint::DeconGridPoint()
+ : distance( 0.0 ),
+   activity( 0.0 ),
+   shielding_thickness( 0.0 ),
+   transmission( nullptr )
+{
+}
+
+
+vector<DeconComputeResults> decon_compute_peaks_grid( const DeconComputeInput &base_input,
+                                                      const vector<DeconGridPoint> &points )
+{
+  vector<DeconComputeResults> results( points.size() );
+  if( points.empty() )
+    return results;
   
-  //    cerr << endl << endl << "EDM=" << minimum.Edm() << endl;
-  //    cerr << "MinValue=" <<  minimum.Fval() << endl << endl;
+  // The ROI continuums (and their fits, for DeconContinuumNorm::FixedByFullRange) are the same
+  //  for every point, so we only compute them once.
+  const vector<shared_ptr<const PeakContinuum>> roi_continuums = decon_roi_continuums( base_input );
   
-  if( !minimum.IsValid() )
-    minimum = fitter( maxFcnCall, tolerance );
+  std::mutex error_mutex;
+  std::exception_ptr first_error;
   
-  if( !minimum.IsValid() )
-  {
-    //XXX - should we try to re-fit here? Or do something to handle the
-    //      faliure in some reasonable way?
-    cerr << endl << endl << "status is not valid"
-    << "\n\tHasMadePosDefCovar: " << minimum.HasMadePosDefCovar()
-    << "\n\tHasAccurateCovar: " << minimum.HasAccurateCovar()
-    << "\n\tHasReachedCallLimit: " << minimum.HasReachedCallLimit()
-    << "\n\tHasValidCovariance: " << minimum.HasValidCovariance()
-    << "\n\tHasValidParameters: " << minimum.HasValidParameters()
-    << "\n\tIsAboveMaxEdm: " << minimum.IsAboveMaxEdm()
-    << endl;
-    if( minimum.IsAboveMaxEdm() )
-      cout << "\t\tEDM=" << minimum.Edm() << endl;
-  }//if( !minimum.IsValid() )
-  
-  
-  vector<double> fitpars = fitParams.Params();
-  vector<double> fiterrors = fitParams.Errors();
-  chi2Fcn.parametersToPeaks( fittedPeaks, &fitpars[0], &fiterrors[0] );
-  
-  double initialChi2 = chi2Fcn.chi2( &fitpars[0] );
-  
-  //Lets try to keep whether or not to fit parameters should be the same for
-  //  the output peaks as the input peaks.
-  //Note that this doesnt account for peaks swapping with each other in the fit
-  assert( fittedPeaks.size() == inputPeaks.size() );
-  
-  //for( size_t i = 0; i < near_peaks.size(); ++i )
-  //  fittedPeaks[i].inheritUserSelectedOptions( near_peaks[i], true );
-  //for( size_t i = 0; i < fixedpeaks.size(); ++i )
-  //  fittedPeaks[i+near_peaks.size()].inheritUserSelectedOptions( fixedpeaks[i], true );
-  
-  const double totalNDF = set_chi2_dof( input.measurement, fittedPeaks, 0, fittedPeaks.size() );
-  
-  result.chi2 = initialChi2;
-  result.num_degree_of_freedom = static_cast<int>( std::round(totalNDF) );
-  
-  for( auto &peak : fittedPeaks )
+  SharedThreadPool::TaskGroup pool;
+  for( size_t i = 0; i < points.size(); ++i )
   {
-    peak.setFitFor( PeakDef::CoefficientType::Mean, false );
-    peak.setFitFor( PeakDef::CoefficientType::Sigma, false );
-  }
+    pool.post( [i, &points, &results, &base_input, &roi_continuums, &error_mutex, &first_error](){
+      try
+      {
+        const DeconGridPoint &point = points[i];
+        
+        DeconComputeInput input = base_input;
+        input.distance = point.distance;
+        input.activity = point.activity;
+        input.shielding_thickness = point.shielding_thickness;
+        
+        if( point.transmission )
+        {
+          for( DeconRoiInfo &roi : input.roi_info )
+          {
+            for( DeconRoiInfo::PeakInfo &peak_info : roi.peak_infos )
+              peak_info.counts_per_bq_into_4pi *= point.transmission( peak_info.energy );
+          }
+        }//if( point.transmission )
+        
+        results[i] = decon_compute_peaks_with_continuums( input, roi_continuums );
+      }catch( ... )
+      {
+        std::lock_guard<std::mutex> lock( error_mutex );
+        if( !first_error )
+          first_error = std::current_exception();
+      }//try / catch
+    } );
+  }//for( size_t i = 0; i < points.size(); ++i )
+  
+  pool.join();
   
-  result.fit_peaks = fittedPeaks;
+  if( first_error )
+    std::rethrow_exception( first_error );
   
-  return result;
-}//DeconComputeResults decon_compute_peaks( const DeconComputeInput &input )
+  return results;
+}//decon_compute_peaks_grid(...)
 
   
 DeconActivityOrDistanceLimitResult::DeconActivityOrDistanceLimitResult()
@@ -1404,57 +1793,83 @@ DeconActivityOrDistanceLimitResult get_activity_or_distance_limits( const float
   std::atomic<size_t> num_iterations( 0 );
   
   //The boost::math::tools::bisect(...) function will make calls using the same value of activity,
-  //  so we will cache those values to save some time.
-  map<double,double> chi2cache;
+  //  so we will cache the results to save some time.  We also keep the fit continuums, so each
+  //  new quantity can start its fit from the solution of the nearest already computed quantity; the
+  //  chi2 is quadratic in the continuum parameters, so this doesnt change the answer, but neighboring
+  //  quantities have nearly identical continuums, so the fit converges in a lot fewer calls.
+  struct CachedQuantityResult
+  {
+    shared_ptr<const DetectionLimitCalc::DeconComputeResults> results;
+    vector<shared_ptr<const PeakContinuum>> fit_continuums;
+  };//struct CachedQuantityResult
+  
+  map<double,CachedQuantityResult> chi2cache;
   std::mutex chi2cache_mutex;
   
   if( !base_input )
     throw runtime_error( "missing input quantity." );
   
-  auto compute_chi2 = [is_dist_limit,&base_input]( const double quantity, int *numDOF = nullptr ) -> double {
+  // The ROI continuums dont depend on the activity or distance, so we'll compute them just once
+  const vector<shared_ptr<const PeakContinuum>> roi_continuums = decon_roi_continuums( *base_input );
+  
+  auto compute_results = [is_dist_limit,&base_input,&roi_continuums,&chi2cache,&chi2cache_mutex,&num_iterations]( const double quantity )
+                                                          -> shared_ptr<const DetectionLimitCalc::DeconComputeResults> {
     assert( base_input );
+    
+    vector<shared_ptr<const PeakContinuum>> start_continuums = roi_continuums;
+    
+    {//begin lock on chi2cache_mutex
+      std::lock_guard<std::mutex> lock( chi2cache_mutex );
+      auto pos = chi2cache.lower_bound( quantity );
+      if( (pos != end(chi2cache)) && (pos->first == quantity) )
+        return pos->second.results;
+      
+      // Find the closest quantity we have already computed
+      if( (pos == end(chi2cache))
+         || ((pos != begin(chi2cache)) && ((quantity - std::prev(pos)->first) < (pos->first - quantity))) )
+      {
+        if( pos != begin(chi2cache) )
+          --pos;
+      }
+      
+      if( pos != end(chi2cache) )
+        start_continuums = pos->second.fit_continuums;
+    }//end lock on chi2cache_mutex
+    
     DetectionLimitCalc::DeconComputeInput input = *base_input;
     if( is_dist_limit )
       input.distance = quantity;
     else
       input.activity = quantity;
-    const DetectionLimitCalc::DeconComputeResults results
-                                                = DetectionLimitCalc::decon_compute_peaks( input );
     
-    if( (results.num_degree_of_freedom == 0) && (results.chi2 == 0.0) )
-      throw runtime_error( "No DOF" );
+    CachedQuantityResult entry;
+    entry.results = make_shared<const DetectionLimitCalc::DeconComputeResults>(
+                  decon_compute_peaks_with_continuums( input, start_continuums, &entry.fit_continuums ) );
     
-    if( numDOF )
-      *numDOF = results.num_degree_of_freedom;
+    ++num_iterations;
     
-    return results.chi2;
-  };//compute_chi2
+    {//begin lock on chi2cache_mutex
+      // If another thread computed this same quantity in the meantime, we'll use its result so all
+      //  callers see identical values.
+      std::lock_guard<std::mutex> lock( chi2cache_mutex );
+      return chi2cache.insert( std::make_pair(quantity, std::move(entry)) ).first->second.results;
+    }//end lock on chi2cache_mutex
+  };//compute_results
   
   
   // This next lambda takes either distance or activity for its argument, depending which
   //  limit is being computed
-  auto chi2ForQuantity = [&num_iterations,&chi2cache,&chi2cache_mutex,compute_chi2]( double const &quantity ) -> double {
-    
-    {//begin lock on achi2cache_mutex
-      std::lock_guard<std::mutex> lock( chi2cache_mutex );
-      const auto pos = chi2cache.find(quantity);
-      if( pos != end(chi2cache) )
-        return pos->second;
-    }//end lock on chi2cache_mutex
-    
+  auto chi2ForQuantity = [compute_results]( double const &quantity ) -> double {
     if( quantity < 0.0 )
       return std::numeric_limits<double>::max();
     
-    const double chi2 = compute_chi2( quantity );
-    
-    ++num_iterations;
+    const shared_ptr<const DetectionLimitCalc::DeconComputeResults> results = compute_results( quantity );
+    assert( results );
     
-    {//begin lock on chi2cache_mutex
-      std::lock_guard<std::mutex> lock( chi2cache_mutex );
-      chi2cache.insert( std::pair<double,double>{quantity,chi2} );
-    }//end lock on chi2cache_mutex
+    if( (results->num_degree_of_freedom == 0) && (results->chi2 == 0.0) )
+      throw runtime_error( "No DOF" );
     
-    return chi2;
+    return results->chi2;
   };//chi2ForQuantity
   
   
@@ -1521,7 +1936,7 @@ DeconActivityOrDistanceLimitResult get_activity_or_distance_limits( const float
   
   //cout << "chi2ForCL(min_search_quantity)=" << chi2ForCL(min_search_quantity) << endl;
   
-  SpecUtilsAsync::ThreadPool pool;
+  SharedThreadPool::TaskGroup pool;
   
   //Before trying to find lower-bounding activity, make sure the best value isnt the lowest
   //  possible value (i.e., zero in this case), and that if we go to the lowest possible value,
@@ -1738,25 +2153,18 @@ DeconActivityOrDistanceLimitResult get_activity_or_distance_limits( const float
   const double activity = is_dist_limit ? base_input->activity : upperLimit;
   const double other_quantity = is_dist_limit ? activity : distance;
   
-  const auto localComputeForActivity = [base_input]( const double activity, const double distance,
+  const auto localComputeForActivity = [is_dist_limit,&compute_results]( const double activity, const double distance,
                                               double &chi2, int &numDOF )
       -> std::shared_ptr<const DetectionLimitCalc::DeconComputeResults> {
-    chi2 = 0.0;
-    numDOF = 0;
-    std::vector<PeakDef> peaks;
-    
-    shared_ptr<DetectionLimitCalc::DeconComputeInput> input = make_shared<DetectionLimitCalc::DeconComputeInput>( *base_input );
-    input->activity = activity;
-    input->distance = distance;
-    
-    DetectionLimitCalc::DeconComputeResults results
-                  = DetectionLimitCalc::decon_compute_peaks( *input );
+    // The other quantity is always the base input value, so we can use the cached results
+    const shared_ptr<const DetectionLimitCalc::DeconComputeResults> results
+                                                  = compute_results( is_dist_limit ? distance : activity );
+    assert( results );
     
-    peaks = results.fit_peaks;
-    chi2 = results.chi2;
-    numDOF = results.num_degree_of_freedom;
+    chi2 = results->chi2;
+    numDOF = results->num_degree_of_freedom;
     
-    return make_shared<const DetectionLimitCalc::DeconComputeResults>(results);
+    return results;
   };//void localComputeForActivity(...)
   
   
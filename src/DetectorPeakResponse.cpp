@@ -23,9 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <mutex>
 #include <cmath>
 #include <ctime>
+#include <algorithm>
+#include <locale>
 #include <memory>
 #include <cctype>
 #include <string>
@@ -244,6 +247,499 @@ namespace
     
     return result.str();
   }//url_encode(...)
+
+  /** A simple compiler of efficiency formulas into a flat, stack-based, byte-code, with constant folding.
+ 
+   Supports the subset of muparserx syntax that is used for DRF efficiency formulas: numbers, the energy variable, the "pi" and "e"
+   constants, the +, -, *, /, and ^ operators (with muparserx precedence, i.e., unary signs bind tighter than * and /, but
+   looser than ^), parenthesis, and the common math functions.  Anything else causes the constructor to throw, in which case
+   muparserx should be used instead.
+ 
+   Evaluation does not need any locking, and a whole array of energies can be evaluated at once (instruction by instruction over
+   blocks of energies, which lets the compiler vectorize the arithmetic).
+   */
+  class CompiledFormula
+  {
+  public:
+    CompiledFormula( const std::string &formula, const std::string &var_name )
+      : m_formula( formula ), m_var_name( var_name ), m_pos( 0 ), m_max_stack( 0 )
+    {
+      std::unique_ptr<Node> root = parseExpression();
+      skipSpaces();
+      if( m_pos != m_formula.size() )
+        throw runtime_error( "CompiledFormula: unexpected character" );
+    
+      size_t depth = 0;
+      emit( *root, depth );
+      assert( depth == 1 );
+    
+      if( m_max_stack > sm_max_stack )
+        throw runtime_error( "CompiledFormula: formula too deeply nested" );
+    }//CompiledFormula constructor
+  
+  
+    double evaluate( const double x ) const
+    {
+      double stack[sm_max_stack];
+      size_t top = 0;
+    
+      for( const Instruction &inst : m_code )
+      {
+        switch( inst.op )
+        {
+          case OpCode::Constant: stack[top++] = inst.value; break;
+          case OpCode::Variable: stack[top++] = x; break;
+          case OpCode::Add:      --top; stack[top-1] += stack[top]; break;
+          case OpCode::Subtract: --top; stack[top-1] -= stack[top]; break;
+          case OpCode::Multiply: --top; stack[top-1] *= stack[top]; break;
+          case OpCode::Divide:   --top; stack[top-1] /= stack[top]; break;
+          case OpCode::Negate:   stack[top-1] = -stack[top-1]; break;
+          case OpCode::Unary:    stack[top-1] = inst.unary( stack[top-1] ); break;
+          case OpCode::Binary:   --top; stack[top-1] = inst.binary( stack[top-1], stack[top] ); break;
+        }//switch( inst.op )
+      }//for( const Instruction &inst : m_code )
+    
+      assert( top == 1 );
+      return stack[0];
+    }//double evaluate( const double x ) const
+  
+  
+    void evaluate( const float * const x, float * const results, const size_t n ) const
+    {
+      const size_t block_size = 64;
+      vector<double> stack( m_max_stack * block_size );
+    
+      for( size_t start = 0; start < n; start += block_size )
+      {
+        const size_t nblock = std::min( block_size, n - start );
+        size_t top = 0;
+      
+        for( const Instruction &inst : m_code )
+        {
+          switch( inst.op )
+          {
+            case OpCode::Constant:
+            case OpCode::Variable:
+            {
+              double * const dest = &stack[block_size*top];
+              if( inst.op == OpCode::Constant )
+                std::fill( dest, dest + nblock, inst.value );
+              else
+                for( size_t i = 0; i < nblock; ++i )
+                  dest[i] = x[start + i];
+              ++top;
+              break;
+            }//case OpCode::Constant / Variable:
+            
+            case OpCode::Negate:
+            case OpCode::Unary:
+            {
+              double * const arg = &stack[block_size*(top-1)];
+              if( inst.op == OpCode::Negate )
+                for( size_t i = 0; i < nblock; ++i )
+                  arg[i] = -arg[i];
+              else
+                for( size_t i = 0; i < nblock; ++i )
+                  arg[i] = inst.unary( arg[i] );
+              break;
+            }//case OpCode::Negate / Unary:
+            
+            case OpCode::Add:
+            case OpCode::Subtract:
+            case OpCode::Multiply:
+            case OpCode::Divide:
+            case OpCode::Binary:
+            {
+              --top;
+              double * const lhs = &stack[block_size*(top-1)];
+              const double * const rhs = &stack[block_size*top];
+              switch( inst.op )
+              {
+                case OpCode::Add:      for( size_t i = 0; i < nblock; ++i ) lhs[i] += rhs[i]; break;
+                case OpCode::Subtract: for( size_t i = 0; i < nblock; ++i ) lhs[i] -= rhs[i]; break;
+                case OpCode::Multiply: for( size_t i = 0; i < nblock; ++i ) lhs[i] *= rhs[i]; break;
+                case OpCode::Divide:   for( size_t i = 0; i < nblock; ++i ) lhs[i] /= rhs[i]; break;
+                default:               for( size_t i = 0; i < nblock; ++i ) lhs[i] = inst.binary( lhs[i], rhs[i] ); break;
+              }
+              break;
+            }//case binary operations
+          }//switch( inst.op )
+        }//for( const Instruction &inst : m_code )
+      
+        assert( top == 1 );
+        for( size_t i = 0; i < nblock; ++i )
+          results[start + i] = static_cast<float>( stack[i] );
+      }//for( loop over blocks of energies )
+    }//void evaluate( const float *x, float *results, const size_t n ) const
+  
+  
+  private:
+    enum class OpCode : uint8_t
+    {
+      Constant, Variable, Add, Subtract, Multiply, Divide, Negate, Unary, Binary
+    };
+  
+    typedef double (*UnaryFcn)( double );
+    typedef double (*BinaryFcn)( double, double );
+  
+    struct Instruction
+    {
+      OpCode op;
+      double value;
+      UnaryFcn unary;
+      BinaryFcn binary;
+    };//struct Instruction
+  
+    struct Node
+    {
+      Instruction inst;
+      std::unique_ptr<Node> lhs, rhs;
+    
+      bool isConstant() const { return inst.op == OpCode::Constant; }
+    };//struct Node
+  
+    static const size_t sm_max_stack = 32;
+  
+    //The muparserx "^" operator special cases small integer exponents; we'll do the same, to get identical answers.
+    static double power( const double a, const double b )
+    {
+      const int ib = static_cast<int>( b );
+      if( (b - ib) != 0.0 )
+        return std::pow( a, b );
+    
+      switch( ib )
+      {
+        case 1: return a;
+        case 2: return a*a;
+        case 3: return a*a*a;
+        case 4: return a*a*a*a;
+        case 5: return a*a*a*a*a;
+        default: return std::pow( a, ib );
+      }
+    }//power(...)
+  
+    static double min_fcn( const double a, const double b ) { return std::min( a, b ); }
+    static double max_fcn( const double a, const double b ) { return std::max( a, b ); }
+    static double sum_fcn( const double a, const double b ) { return a + b; }
+  
+  
+    static std::unique_ptr<Node> makeConstant( const double value )
+    {
+      std::unique_ptr<Node> node( new Node() );
+      node->inst.op = OpCode::Constant;
+      node->inst.value = value;
+      return node;
+    }
+  
+  
+    /** Creates operation node, folding it into a constant if its arguments are constants. */
+    static std::unique_ptr<Node> makeNode( const OpCode op, std::unique_ptr<Node> lhs, std::unique_ptr<Node> rhs,
+                                           const UnaryFcn unary = nullptr, const BinaryFcn binary = nullptr )
+    {
+      std::unique_ptr<Node> node( new Node() );
+      node->inst.op = op;
+      node->inst.value = 0.0;
+      node->inst.unary = unary;
+      node->inst.binary = binary;
+      node->lhs = std::move( lhs );
+      node->rhs = std::move( rhs );
+    
+      if( node->lhs && node->lhs->isConstant() && (!node->rhs || node->rhs->isConstant()) )
+      {
+        const double a = node->lhs->inst.value;
+        const double b = node->rhs ? node->rhs->inst.value : 0.0;
+        switch( op )
+        {
+          case OpCode::Add:      return makeConstant( a + b );
+          case OpCode::Subtract: return makeConstant( a - b );
+          case OpCode::Multiply: return makeConstant( a * b );
+          case OpCode::Divide:   return makeConstant( a / b );
+          case OpCode::Negate:   return makeConstant( -a );
+          case OpCode::Unary:    return makeConstant( unary(a) );
+          case OpCode::Binary:   return makeConstant( binary(a, b) );
+          case OpCode::Constant:
+          case OpCode::Variable:
+            break;
+        }//switch( op )
+      }//if( we can fold this node to a constant )
+    
+      return node;
+    }//makeNode(...)
+  
+  
+    void emit( const Node &node, size_t &depth )
+    {
+      if( node.lhs )
+        emit( *node.lhs, depth );
+      if( node.rhs )
+        emit( *node.rhs, depth );
+    
+      switch( node.inst.op )
+      {
+        case OpCode::Constant:
+        case OpCode::Variable:
+          ++depth;
+          break;
+        
+        case OpCode::Add:
+        case OpCode::Subtract:
+        case OpCode::Multiply:
+        case OpCode::Divide:
+        case OpCode::Binary:
+          --depth;
+          break;
+        
+        case OpCode::Negate:
+        case OpCode::Unary:
+          break;
+      }//switch( node.inst.op )
+    
+      m_max_stack = std::max( m_max_stack, depth );
+      m_code.push_back( node.inst );
+    }//void emit( const Node &node, size_t &depth )
+  
+  
+    void skipSpaces()
+    {
+      while( (m_pos < m_formula.size()) && (m_formula[m_pos] == ' ') )
+        ++m_pos;
+    }
+  
+  
+    bool accept( const char c )
+    {
+      skipSpaces();
+      if( (m_pos < m_formula.size()) && (m_formula[m_pos] == c) )
+      {
+        ++m_pos;
+        return true;
+      }
+      return false;
+    }//bool accept( const char c )
+  
+  
+    // expression := term (('+'|'-') term)*
+    std::unique_ptr<Node> parseExpression()
+    {
+      std::unique_ptr<Node> lhs = parseTerm();
+      while( true )
+      {
+        if( accept('+') )
+          lhs = makeNode( OpCode::Add, std::move(lhs), parseTerm() );
+        else if( accept('-') )
+          lhs = makeNode( OpCode::Subtract, std::move(lhs), parseTerm() );
+        else
+          return lhs;
+      }
+    }//parseExpression()
+  
+  
+    // term := signed (('*'|'/') signed)*
+    std::unique_ptr<Node> parseTerm()
+    {
+      std::unique_ptr<Node> lhs = parseSigned();
+      while( true )
+      {
+        if( accept('*') )
+          lhs = makeNode( OpCode::Multiply, std::move(lhs), parseSigned() );
+        else if( accept('/') )
+          lhs = makeNode( OpCode::Divide, std::move(lhs), parseSigned() );
+        else
+          return lhs;
+      }
+    }//parseTerm()
+  
+  
+    // signed := ('-'|'+') signed | power
+    std::unique_ptr<Node> parseSigned()
+    {
+      if( accept('-') )
+        return makeNode( OpCode::Negate, parseSigned(), nullptr );
+      if( accept('+') )
+        return parseSigned();
+      return parsePower();
+    }//parseSigned()
+  
+  
+    // power := primary ('^' signed-power)?     (right associative)
+    std::unique_ptr<Node> parsePower()
+    {
+      std::unique_ptr<Node> base = parsePrimary();
+      if( !accept('^') )
+        return base;
+    
+      std::unique_ptr<Node> exponent;
+      if( accept('-') )
+        exponent = makeNode( OpCode::Negate, parsePower(), nullptr );
+      else
+      {
+        accept( '+' );
+        exponent = parsePower();
+      }
+    
+      return makeNode( OpCode::Binary, std::move(base), std::move(exponent), nullptr, &power );
+    }//parsePower()
+  
+  
+    // primary := number | constant | variable | function '(' args ')' | '(' expression ')'
+    std::unique_ptr<Node> parsePrimary()
+    {
+      skipSpaces();
+      if( m_pos >= m_formula.size() )
+        throw runtime_error( "CompiledFormula: unexpected end of formula" );
+    
+      if( accept('(') )
+      {
+        std::unique_ptr<Node> node = parseExpression();
+        if( !accept(')') )
+          throw runtime_error( "CompiledFormula: missing closing parenthesis" );
+        return node;
+      }//if( accept('(') )
+    
+      const char c = m_formula[m_pos];
+      if( isdigit(static_cast<unsigned char>(c)) || (c == '.') )
+        return makeConstant( parseNumber() );
+    
+      if( !isalpha(static_cast<unsigned char>(c)) && (c != '_') )
+        throw runtime_error( "CompiledFormula: unexpected character" );
+    
+      const size_t start = m_pos;
+      while( (m_pos < m_formula.size())
+            && (isalnum(static_cast<unsigned char>(m_formula[m_pos])) || (m_formula[m_pos] == '_')) )
+        ++m_pos;
+      const string name = m_formula.substr( start, m_pos - start );
+    
+      if( accept('(') )
+        return parseFunction( name );
+    
+      if( name == m_var_name )
+      {
+        std::unique_ptr<Node> node( new Node() );
+        node->inst.op = OpCode::Variable;
+        node->inst.value = 0.0;
+        node->inst.unary = nullptr;
+        node->inst.binary = nullptr;
+        return node;
+      }//if( name == m_var_name )
+    
+      if( name == "pi" )
+        return makeConstant( 3.141592653589793238462643 );
+      if( name == "e" )
+        return makeConstant( 2.718281828459045235360287 );
+    
+      throw runtime_error( "CompiledFormula: unknown identifier '" + name + "'" );
+    }//parsePrimary()
+  
+  
+    double parseNumber()
+    {
+      const size_t start = m_pos;
+      auto digits = [this](){
+        while( (m_pos < m_formula.size()) && isdigit(static_cast<unsigned char>(m_formula[m_pos])) )
+          ++m_pos;
+      };
+    
+      digits();
+      if( (m_pos < m_formula.size()) && (m_formula[m_pos] == '.') )
+      {
+        ++m_pos;
+        digits();
+      }
+    
+      if( (m_pos < m_formula.size()) && (m_formula[m_pos] == 'e') )
+      {
+        size_t exp_pos = m_pos + 1;
+        if( (exp_pos < m_formula.size()) && ((m_formula[exp_pos] == '+') || (m_formula[exp_pos] == '-')) )
+          ++exp_pos;
+        if( (exp_pos < m_formula.size()) && isdigit(static_cast<unsigned char>(m_formula[exp_pos])) )
+        {
+          m_pos = exp_pos;
+          digits();
+        }
+      }//if( an exponent )
+    
+      //Avoid locale issues with the decimal point
+      double value = 0.0;
+      std::istringstream strm( m_formula.substr( start, m_pos - start ) );
+      strm.imbue( std::locale::classic() );
+      if( !(strm >> value) )
+        throw runtime_error( "CompiledFormula: invalid number" );
+    
+      return value;
+    }//double parseNumber()
+  
+  
+    std::unique_ptr<Node> parseFunction( const string &name )
+    {
+      vector<std::unique_ptr<Node>> args;
+      if( !accept(')') )
+      {
+        do
+        {
+          args.push_back( parseExpression() );
+        }while( accept(',') );
+      
+        if( !accept(')') )
+          throw runtime_error( "CompiledFormula: missing closing parenthesis for function" );
+      }//if( function has arguments )
+    
+      static const std::map<string,UnaryFcn> unary_fcns{
+        {"sin", &::sin}, {"cos", &::cos}, {"tan", &::tan},
+        {"asin", &::asin}, {"acos", &::acos}, {"atan", &::atan},
+        {"sinh", &::sinh}, {"cosh", &::cosh}, {"tanh", &::tanh},
+        {"asinh", &::asinh}, {"acosh", &::acosh}, {"atanh", &::atanh},
+        {"log", &::log}, {"ln", &::log}, {"log10", &::log10}, {"log2", &::log2},
+        {"sqrt", &::sqrt}, {"cbrt", &::cbrt}, {"exp", &::exp}, {"abs", &::fabs}
+      };
+    
+      static const std::map<string,BinaryFcn> binary_fcns{
+        {"pow", &::pow}, {"hypot", &::hypot}, {"atan2", &::atan2},
+        {"fmod", &::fmod}, {"remainder", &::remainder}
+      };
+    
+      const auto unary_pos = unary_fcns.find( name );
+      if( unary_pos != end(unary_fcns) )
+      {
+        if( args.size() != 1 )
+          throw runtime_error( "CompiledFormula: wrong number of arguments to " + name );
+        return makeNode( OpCode::Unary, std::move(args[0]), nullptr, unary_pos->second, nullptr );
+      }//if( unary function )
+    
+      const auto binary_pos = binary_fcns.find( name );
+      if( binary_pos != end(binary_fcns) )
+      {
+        if( args.size() != 2 )
+          throw runtime_error( "CompiledFormula: wrong number of arguments to " + name );
+        return makeNode( OpCode::Binary, std::move(args[0]), std::move(args[1]), nullptr, binary_pos->second );
+      }//if( binary function )
+    
+      BinaryFcn chain_fcn = nullptr;
+      if( name == "min" )
+        chain_fcn = &min_fcn;
+      else if( name == "max" )
+        chain_fcn = &max_fcn;
+      else if( name == "sum" )
+        chain_fcn = &sum_fcn;
+    
+      if( !chain_fcn || args.empty() )
+        throw runtime_error( "CompiledFormula: unsupported function " + name );
+    
+      std::unique_ptr<Node> node = std::move( args[0] );
+      for( size_t i = 1; i < args.size(); ++i )
+        node = makeNode( OpCode::Binary, std::move(node), std::move(args[i]), nullptr, chain_fcn );
+    
+      return node;
+    }//parseFunction(...)
+  
+  
+    const std::string m_formula;
+    const std::string m_var_name;
+    size_t m_pos;
+  
+    std::vector<Instruction> m_code;
+    size_t m_max_stack;
+  };//class CompiledFormula
+
 }//namespace
 
 
@@ -262,6 +758,11 @@ Three expression evaluators have been tried; all have benefits and drawbacks.
   + 12.9980559362*log(x)^3 + -1.0068649823*log(x)^4 + 0.0311640084*log(x)^5)
   muparser x took:  cpu=0.143294s, wall=0.14341s  (1.4 us/eval)
   evaluator x took: cpu=1.10172s, wall=1.10209s   (11 us/eval)
+
+ Since muparserx evaluation isnt thread-safe (so needs a mutex) and walks its
+ token list each evaluation, formulas are also compiled by CompiledFormula,
+ which is used for evaluation if it gives the same answers as muparserx for a
+ range of energies; otherwise muparserx is used.
 */
 struct FormulaWrapper
 {
@@ -278,6 +779,9 @@ struct FormulaWrapper
   float efficiency( const float x );
   double operator()( const float x );
   
+  /** Evaluates the efficiency of \p n energies \p x, placing the results in \p results. */
+  void efficiencies( const float *x, float *results, const size_t n );
+  
   /** Finds the variable the user most likely intended to be the energy variable
    for detector response functions, by looking for arguments inside
    paranthesis.
@@ -299,8 +803,25 @@ struct FormulaWrapper
   
   std::unique_ptr<mup::ParserX> m_parser;
   std::unique_ptr<mup::Value> m_value;
+  
+  /** The byte-code compiled formula; nullptr if the formula couldnt be compiled, or didnt agree with muparserx. */
+  std::unique_ptr<const CompiledFormula> m_compiled;
 };//struct FormulaWrapper
 
+
+/** The efficiency function used for formula based DRFs; a named type (instead of a lambda or bind expression) so
+ DetectorPeakResponse::intrinsicEfficiencies(...) can get at the FormulaWrapper for batch evaluation.
+ */
+struct FormulaEfficiencyFcn
+{
+  std::shared_ptr<FormulaWrapper> m_expression;
+  
+  float operator()( const float x ) const
+  {
+    return m_expression->efficiency( x );
+  }
+};//struct FormulaEfficiencyFcn
+
   
 FormulaWrapper::FormulaWrapper( const std::string &fcnstr, const bool isMev )
   : m_fcnstr( fcnstr ), m_var_name( "x" )
@@ -387,6 +908,37 @@ FormulaWrapper::FormulaWrapper( const std::string &fcnstr, const bool isMev )
     throw std::runtime_error( "Error parsing expression: " + string(e.what()) );
   }//try / catch
   
+  
+  // Now try to compile the formula, and make sure it gives the same answers as muparserx
+  try
+  {
+    std::unique_ptr<const CompiledFormula> compiled( new CompiledFormula( m_fcnstr, m_var_name ) );
+    
+    const double lower_energy = (isMev ? 0.01 : 10.0), upper_energy = (isMev ? 10.0 : 10000.0);
+    const size_t num_check_points = 25;
+    bool agrees = true;
+    for( size_t i = 0; agrees && (i < num_check_points); ++i )
+    {
+      const double energy = lower_energy * std::pow( upper_energy / lower_energy, i / (num_check_points - 1.0) );
+      *m_value = energy;
+      const double expected = m_parser->Eval().GetFloat();
+      const double value = compiled->evaluate( energy );
+      
+      if( IsNan(expected) || IsNan(value) )
+        agrees = (IsNan(expected) && IsNan(value));
+      else if( IsInf(expected) || IsInf(value) )
+        agrees = (expected == value);
+      else
+        agrees = (fabs(expected - value) <= 1.0E-9*std::max(fabs(expected), fabs(value)));
+    }//for( loop over energies to check )
+    
+    if( agrees )
+      m_compiled = std::move( compiled );
+  }catch( std::exception & )
+  {
+    //Formula uses syntax CompiledFormula doesnt support, or muparserx threw evaluating an energy;
+    //  we'll just use muparserx.
+  }//try / catch
 }//FormulaWrapper
   
 FormulaWrapper::~FormulaWrapper()
@@ -466,6 +1018,9 @@ std::string FormulaWrapper::find_variable_name( std::string eqn )
   
 float FormulaWrapper::efficiency( const float x )
 {
+  if( m_compiled )
+    return static_cast<float>( m_compiled->evaluate( x ) );
+  
   try
   {
     std::lock_guard<std::mutex> lock( m_mutex );
@@ -482,6 +1037,198 @@ double FormulaWrapper::operator()( const float x )
   return efficiency(x);
 }
 
+
+void FormulaWrapper::efficiencies( const float *x, float *results, const size_t n )
+{
+  if( m_compiled )
+  {
+    m_compiled->evaluate( x, results, n );
+    return;
+  }
+  
+  for( size_t i = 0; i < n; ++i )
+    results[i] = efficiency( x[i] );
+}//void efficiencies( const float *x, float *results, const size_t n )
+
+/** A monotone (Fritsch-Carlson) cubic interpolation of a function of energy, on a grid uniform in log(energy).
+ 
+ Used to make repeated evaluations of DRF efficiency or FWHM cheap; see DetectorPeakResponse::setLookupTableAccuracy(...).
+ */
+class LogEnergyGridTable
+{
+public:
+  /** Builds the table for \p fcn over [lower_energy, upper_energy], doubling the grid density until the interpolated value at
+   the midpoint of every interval is within \p rel_accuracy of the actual function value.
+   
+   Throws exception if the required accuracy can not be reached with a reasonable number of points, or the function gives a
+   non-finite value.
+   */
+  LogEnergyGridTable( const std::function<float(float)> &fcn, const float lower_energy,
+                      const float upper_energy, const double rel_accuracy )
+  : m_lower_energy( lower_energy ),
+    m_upper_energy( upper_energy ),
+    m_lower_log( std::log(static_cast<double>(lower_energy)) ),
+    m_inv_delta( 0.0 )
+  {
+    if( !(lower_energy > 0.0f) || !(upper_energy > lower_energy) || !(rel_accuracy > 0.0) )
+      throw runtime_error( "LogEnergyGridTable: invalid range or accuracy" );
+    
+    const double upper_log = std::log( static_cast<double>(upper_energy) );
+    const size_t max_intervals = 16384;
+    
+    for( size_t nintervals = 64; nintervals <= max_intervals; nintervals *= 2 )
+    {
+      const double delta = (upper_log - m_lower_log) / nintervals;
+      m_inv_delta = 1.0 / delta;
+      
+      m_values.resize( nintervals + 1 );
+      for( size_t i = 0; i <= nintervals; ++i )
+      {
+        const double val = fcn( static_cast<float>( std::exp(m_lower_log + i*delta) ) );
+        if( IsNan(val) || IsInf(val) )
+          throw runtime_error( "LogEnergyGridTable: non-finite function value" );
+        m_values[i] = val;
+      }//for( size_t i = 0; i <= nintervals; ++i )
+      
+      computeTangents();
+      
+      bool accurate = true;
+      for( size_t i = 0; accurate && (i < nintervals); ++i )
+      {
+        const float energy = static_cast<float>( std::exp(m_lower_log + (i + 0.5)*delta) );
+        const double exact = fcn( energy );
+        const double interp = (*this)( energy );
+        const double scale = std::max( std::fabs(exact), 1.0E-30 );
+        accurate = (std::fabs(interp - exact) <= rel_accuracy*scale);
+      }//for( loop over intervals to check accuracy )
+      
+      if( accurate )
+        return;
+    }//for( loop over number of intervals )
+    
+    throw runtime_error( "LogEnergyGridTable: could not reach required accuracy" );
+  }//LogEnergyGridTable constructor
+  
+  
+  bool inRange( const float energy ) const
+  {
+    return (energy >= m_lower_energy) && (energy <= m_upper_energy);
+  }
+  
+  
+  /** Returns interpolated value; energy must be within range (see #inRange). */
+  double operator()( const float energy ) const
+  {
+    const size_t nintervals = m_values.size() - 1;
+    const double x = (std::log( static_cast<double>(energy) ) - m_lower_log) * m_inv_delta;
+    const double xfloor = std::floor( x );
+    size_t i = (xfloor <= 0.0) ? size_t(0) : static_cast<size_t>( xfloor );
+    if( i >= nintervals )
+      i = nintervals - 1;
+    
+    const double t = std::min( std::max( x - i, 0.0 ), 1.0 );
+    const double t2 = t*t, t3 = t2*t;
+    
+    //Cubic Hermite basis functions; tangents are already scaled by the interval width
+    const double h00 = 2.0*t3 - 3.0*t2 + 1.0;
+    const double h10 = t3 - 2.0*t2 + t;
+    const double h01 = -2.0*t3 + 3.0*t2;
+    const double h11 = t3 - t2;
+    
+    return h00*m_values[i] + h10*m_tangents[i] + h01*m_values[i+1] + h11*m_tangents[i+1];
+  }//double operator()( const float energy ) const
+  
+private:
+  /** Computes the Fritsch-Carlson tangents (in units of value per grid interval) for the current #m_values. */
+  void computeTangents()
+  {
+    const size_t npoints = m_values.size();
+    assert( npoints >= 2 );
+    
+    vector<double> secants( npoints - 1 );
+    for( size_t i = 0; i + 1 < npoints; ++i )
+      secants[i] = m_values[i+1] - m_values[i];
+    
+    m_tangents.resize( npoints );
+    m_tangents.front() = secants.front();
+    m_tangents.back() = secants.back();
+    for( size_t i = 1; i + 1 < npoints; ++i )
+    {
+      const double &lhs = secants[i-1], &rhs = secants[i];
+      m_tangents[i] = ((lhs*rhs) <= 0.0) ? 0.0 : 0.5*(lhs + rhs);
+    }
+    
+    //Limit tangents so each interval stays monotonic
+    for( size_t i = 0; i + 1 < npoints; ++i )
+    {
+      const double d = secants[i];
+      if( d == 0.0 )
+      {
+        m_tangents[i] = m_tangents[i+1] = 0.0;
+        continue;
+      }
+      
+      const double a = m_tangents[i] / d;
+      const double b = m_tangents[i+1] / d;
+      const double r = a*a + b*b;
+      if( r > 9.0 )
+      {
+        const double tau = 3.0 / std::sqrt( r );
+        m_tangents[i] = tau * a * d;
+        m_tangents[i+1] = tau * b * d;
+      }
+    }//for( size_t i = 0; i + 1 < npoints; ++i )
+  }//void computeTangents()
+  
+  float m_lower_energy;
+  float m_upper_energy;
+  double m_lower_log;
+  double m_inv_delta;
+  std::vector<double> m_values;
+  std::vector<double> m_tangents;
+};//class LogEnergyGridTable
+
+
+/** The lazily computed lookup tables of a DetectorPeakResponse, for a specific DRF hash value. */
+struct DrfLookupTables
+{
+  DrfLookupTables( const double rel_accuracy, const uint64_t hash )
+   : m_rel_accuracy( rel_accuracy ), m_hash( hash )
+  {
+  }
+  
+  const double m_rel_accuracy;
+  const uint64_t m_hash;
+  
+  std::once_flag m_efficiency_flag;
+  std::unique_ptr<const LogEnergyGridTable> m_efficiency;
+  
+  std::once_flag m_fwhm_flag;
+  std::unique_ptr<const LogEnergyGridTable> m_fwhm;
+  
+  /** Returns the table (building it on first call), or nullptr if a table couldnt be made. */
+  static const LogEnergyGridTable *table( std::once_flag &flag,
+                                          std::unique_ptr<const LogEnergyGridTable> &table,
+                                          const std::function<float(float)> &fcn,
+                                          const float lower_energy, const float upper_energy,
+                                          const double rel_accuracy )
+  {
+    std::call_once( flag, [&](){
+      try
+      {
+        table.reset( new LogEnergyGridTable( fcn, lower_energy, upper_energy, rel_accuracy ) );
+      }catch( std::exception & )
+      {
+        //Function not smooth enough, or not finite, over the range; we'll just evaluate it directly
+        table.reset();
+      }
+    } );
+    
+    return table.get();
+  }//table(...)
+};//struct DrfLookupTables
+
+
 const std::string &DetectorPeakResponse::det_eff_geom_type_postfix( const DetectorPeakResponse::EffGeometryType type )
 {
   static const string s_empty{}, s_cm2{"/cm2"}, s_m2{"/m2"}, s_gram{"/g"};
@@ -517,7 +1264,9 @@ DetectorPeakResponse::DetectorPeakResponse()
     m_upperEnergy( 0.0 ),
     m_createdUtc( 0 ),
     m_lastUsedUtc( 0 ),
-    m_geomType(EffGeometryType::FarField)
+    m_geomType(EffGeometryType::FarField),
+    m_lookupTableAccuracy( 0.0 ),
+    m_lookupTables( nullptr )
 {
 } //DetectorPeakResponse()
 
@@ -538,7 +1287,9 @@ DetectorPeakResponse::DetectorPeakResponse( const std::string &name,
     m_upperEnergy( 0.0 ),
     m_createdUtc( 0 ),
     m_lastUsedUtc( 0 ),
-    m_geomType(EffGeometryType::FarField)
+    m_geomType(EffGeometryType::FarField),
+    m_lookupTableAccuracy( 0.0 ),
+    m_lookupTables( nullptr )
 {
 }//DetectorPeakResponse( const std::string &name, const std::string &descrip )
 
@@ -562,9 +1313,35 @@ uint64_t DetectorPeakResponse::parentHashValue() const
 void DetectorPeakResponse::setParentHashValue( const uint64_t val )
 {
   m_parentHash = val;
+  resetLookupTables();
 }
 
 
+void DetectorPeakResponse::setLookupTableAccuracy( const double rel_accuracy )
+{
+  if( IsNan(rel_accuracy) || IsInf(rel_accuracy) || (rel_accuracy < 0.0) )
+    throw runtime_error( "DetectorPeakResponse::setLookupTableAccuracy: invalid accuracy" );
+  
+  m_lookupTableAccuracy = rel_accuracy;
+  resetLookupTables();
+}//void setLookupTableAccuracy( const double rel_accuracy )
+
+
+double DetectorPeakResponse::lookupTableAccuracy() const
+{
+  return m_lookupTableAccuracy;
+}
+
+
+void DetectorPeakResponse::resetLookupTables()
+{
+  if( m_lookupTableAccuracy > 0.0 )
+    m_lookupTables = make_shared<DrfLookupTables>( m_lookupTableAccuracy, m_hash );
+  else
+    m_lookupTables.reset();
+}//void resetLookupTables()
+
+
 void DetectorPeakResponse::computeHash()
 {
   std::size_t seed = 0;
@@ -609,6 +1386,8 @@ void DetectorPeakResponse::computeHash()
     boost::hash_combine( seed, m_geomType );
   
   m_hash = seed;
+  
+  resetLookupTables();
 }//void computeHash()
 
 
@@ -671,6 +1450,7 @@ void DetectorPeakResponse::reset()
   m_efficiencySource = DrfSource::UnknownDrfSource;
   m_createdUtc = m_lastUsedUtc = 0;
   m_geomType = EffGeometryType::FarField;
+  m_lookupTables.reset();
   
 /*
   m_name = "Flat";
@@ -907,8 +1687,7 @@ void DetectorPeakResponse::setIntrinsicEfficiencyFormula( const string &fcnstr,
   
   m_efficiencyForm = kFunctialEfficienyForm;
   m_efficiencyFormula = fcnstr;
-  m_efficiencyFcn = boost::bind( &FormulaWrapper::efficiency, expression,
-                                boost::placeholders::_1  );
+  m_efficiencyFcn = FormulaEfficiencyFcn{ expression };
   m_detectorDiameter = diameter;
   m_efficiencyEnergyUnits = energyUnits;
   
@@ -931,7 +1710,7 @@ function<float(float)> DetectorPeakResponse::makeEfficiencyFunctionFromFormula(
                                                                      const bool isMeV )
 {
   shared_ptr<FormulaWrapper> expression = make_shared<FormulaWrapper>( formula, isMeV );
-  return [expression](float a) -> float { return expression->efficiency(a); };
+  return FormulaEfficiencyFcn{ expression };
 }
 
 
@@ -1307,6 +2086,49 @@ std::string DetectorPeakResponse::toAppUrl() const
   if( !isValid() )
     throw runtime_error( "Invalid DRF." );
   
+  // Showing a QR code, or copying a share link, asks for the same DRF over and over, and the
+  //  float printing and URL encoding below are not cheap, so we'll cache the results by a hash of
+  //  everything that goes into the URL (m_hash doesnt include all of these, and may be stale).
+  static std::mutex s_url_cache_mutex;
+  static map<size_t,string> s_url_cache;
+  
+  size_t cache_key = 0;
+  boost::hash_combine( cache_key, m_hash );
+  boost::hash_combine( cache_key, m_parentHash );
+  boost::hash_combine( cache_key, m_name );
+  boost::hash_combine( cache_key, m_description );
+  boost::hash_combine( cache_key, m_detectorDiameter );
+  boost::hash_combine( cache_key, m_efficiencyEnergyUnits );
+  boost::hash_combine( cache_key, m_efficiencyForm );
+  for( const EnergyEfficiencyPair &a : m_energyEfficiencies )
+  {
+    boost::hash_combine( cache_key, a.energy );
+    boost::hash_combine( cache_key, a.efficiency );
+  }
+  boost::hash_combine( cache_key, m_efficiencyFormula );
+  for( const float val : m_expOfLogPowerSeriesCoeffs )
+    boost::hash_combine( cache_key, val );
+  for( const float val : m_expOfLogPowerSeriesUncerts )
+    boost::hash_combine( cache_key, val );
+  boost::hash_combine( cache_key, m_resolutionForm );
+  for( const float val : m_resolutionCoeffs )
+    boost::hash_combine( cache_key, val );
+  for( const float val : m_resolutionUncerts )
+    boost::hash_combine( cache_key, val );
+  boost::hash_combine( cache_key, m_efficiencySource );
+  boost::hash_combine( cache_key, m_lowerEnergy );
+  boost::hash_combine( cache_key, m_upperEnergy );
+  boost::hash_combine( cache_key, m_createdUtc );
+  boost::hash_combine( cache_key, m_lastUsedUtc );
+  boost::hash_combine( cache_key, m_geomType );
+  
+  {//begin lock on s_url_cache_mutex
+    std::lock_guard<std::mutex> lock( s_url_cache_mutex );
+    const auto pos = s_url_cache.find( cache_key );
+    if( pos != end(s_url_cache) )
+      return pos->second;
+  }//end lock on s_url_cache_mutex
+  
   map<string,string> parts;
   parts["VER"] = "1";
   
@@ -1450,10 +2272,24 @@ std::string DetectorPeakResponse::toAppUrl() const
   };//current_url_len(...)
 
   
-  auto combine_parts = [&parts]() -> string {
+  auto combine_parts = [&parts,&current_url_len,cache_key]() -> string {
     string answer;
+    answer.reserve( current_url_len() );
     for( const auto &p : parts )
-      answer += (answer.size() ? "&" : "") + p.first + "=" + p.second;
+    {
+      if( !answer.empty() )
+        answer += '&';
+      answer += p.first;
+      answer += '=';
+      answer += p.second;
+    }
+    
+    {//begin lock on s_url_cache_mutex
+      std::lock_guard<std::mutex> lock( s_url_cache_mutex );
+      if( s_url_cache.size() > 32 )
+        s_url_cache.clear();
+      s_url_cache[cache_key] = answer;
+    }//end lock on s_url_cache_mutex
     
     /*
      //If we wanted to check if it was QR ASCII
@@ -1651,7 +2487,7 @@ void DetectorPeakResponse::fromAppUrl( std::string url_query )
     {
       const bool isMeV = (efficiencyEnergyUnits > 10.0f);
       auto expression = std::make_shared<FormulaWrapper>( m_efficiencyFormula, isMeV );
-      efficiencyFcn = boost::bind( &FormulaWrapper::efficiency, expression, boost::placeholders::_1  );
+      efficiencyFcn = FormulaEfficiencyFcn{ expression };
     }catch( std::exception &e )
     {
       throw runtime_error( "fromAppUrl: Invalid detector efficiency formula: " + string(e.what()) );
@@ -1826,6 +2662,7 @@ void DetectorPeakResponse::fromAppUrl( std::string url_query )
        
   m_hash = hash;
   m_parentHash = parent_hash;
+  resetLookupTables();
   m_createdUtc = createdUtc;
   m_lastUsedUtc = lastUsedUtc;
        
@@ -2702,8 +3539,7 @@ void DetectorPeakResponse::fromXml( const ::rapidxml::xml_node<char> *parent )
       try
       {
         auto expression = std::make_shared<FormulaWrapper>( m_efficiencyFormula, isMeV );
-        m_efficiencyFcn = boost::bind( &FormulaWrapper::efficiency, expression,
-                                      boost::placeholders::_1  );
+        m_efficiencyFcn = FormulaEfficiencyFcn{ expression };
       }catch( std::exception &e )
       {
         throw runtime_error( "Invalid detector efficiency formula in XML: " + string(e.what()) );
@@ -2733,6 +3569,7 @@ void DetectorPeakResponse::fromXml( const ::rapidxml::xml_node<char> *parent )
     throw runtime_error( "DetectorPeakResponse missing Hash node" );
   if( !(stringstream(node->value()) >> m_hash) )
     throw runtime_error( "DetectorPeakResponse invalid Hash" );
+  resetLookupTables();
   
   node = parent->first_node( "ParentHash", 10 );
   if( !node || !node->value() )
@@ -3046,12 +3883,25 @@ double DetectorPeakResponse::fractionalSolidAngle( const double detDiam,
     diameters are somewhat comparable to distance of source from detector
     An unverified implementation of that is:
   */
-  const double alpha = pow(source_rad/D,2.0);
-  const double beta = pow(0.5*detDiam/D,2.0);
-  const double F1 = ((5.0/16.0)*beta/pow(1.0+beta,3.5)) - ((35.0/64.0)*beta*beta/pow(1.0+beta,4.5));
-  const double F2 = ((35.0/128.0)*beta/pow(1.0+beta,4.5)) - ((315.0/256.0)*beta*beta/pow(1.0+beta,11.0/12.0)) + ((1155.0/1024.0)*beta*beta*beta/pow(1.0+beta,6.5));
-
-  const double omega = 0.5 * ( 1.0 - (1.0/sqrt(1.0+beta)) - ((3.0/8.0)*alpha*beta/pow(1.0+beta,2.5))
+  const double source_ratio = source_rad / D;
+  const double det_ratio = 0.5*detDiam / D;
+  const double alpha = source_ratio * source_ratio;
+  const double beta = det_ratio * det_ratio;
+  
+  // All the powers of (1+beta) are half-integer, so we'll get them from a single sqrt, rather than
+  //  calling pow(...) six times.
+  const double one_plus_beta = 1.0 + beta;
+  const double inv_sqrt = 1.0 / sqrt( one_plus_beta );            // (1+beta)^-0.5
+  const double inv_2_5 = inv_sqrt / (one_plus_beta*one_plus_beta); // (1+beta)^-2.5
+  const double inv_3_5 = inv_2_5 / one_plus_beta;
+  const double inv_4_5 = inv_3_5 / one_plus_beta;
+  const double inv_5_5 = inv_4_5 / one_plus_beta;
+  const double inv_6_5 = inv_5_5 / one_plus_beta;
+  
+  const double F1 = ((5.0/16.0)*beta*inv_3_5) - ((35.0/64.0)*beta*beta*inv_4_5);
+  const double F2 = ((35.0/128.0)*beta*inv_4_5) - ((315.0/256.0)*beta*beta*inv_5_5) + ((1155.0/1024.0)*beta*beta*beta*inv_6_5);
+
+  const double omega = 0.5 * ( 1.0 - inv_sqrt - ((3.0/8.0)*alpha*beta*inv_2_5)
                        + alpha*alpha*F1 - alpha*alpha*alpha*F2 );
 
   return omega;
@@ -3180,7 +4030,32 @@ float DetectorPeakResponse::expOfLogPowerSeriesEfficiency( const float energy,
 
 float DetectorPeakResponse::intrinsicEfficiency( const float energy ) const
 {
+  // Efficiencies from energy-efficiency pairs are already a cheap interpolation, so we wont
+  //  bother with a lookup table for them.
+  if( m_lookupTables && m_hash && (m_lookupTables->m_hash == m_hash)
+     && (m_efficiencyForm != kEnergyEfficiencyPairs) && isValid() )
+  {
+    float lower_energy = static_cast<float>( m_lowerEnergy ), upper_energy = static_cast<float>( m_upperEnergy );
+    if( !(lower_energy > 0.0f) || !(upper_energy > lower_energy) )
+    {
+      lower_energy = static_cast<float>( 10.0*PhysicalUnits::keV );
+      upper_energy = static_cast<float>( 3000.0*PhysicalUnits::keV );
+    }
+    
+    const LogEnergyGridTable *table = DrfLookupTables::table( m_lookupTables->m_efficiency_flag,
+                                           m_lookupTables->m_efficiency,
+                                           [this]( float x ) -> float { return intrinsicEfficiencyNoLookup(x); },
+                                           lower_energy, upper_energy, m_lookupTables->m_rel_accuracy );
+    if( table && table->inRange(energy) )
+      return static_cast<float>( (*table)(energy) );
+  }//if( we can use lookup tables )
   
+  return intrinsicEfficiencyNoLookup( energy );
+}//float intrinsicEfficiency( const float energy ) const
+
+
+float DetectorPeakResponse::intrinsicEfficiencyNoLookup( const float energy ) const
+{
   switch( m_efficiencyForm )
   {
     case kEnergyEfficiencyPairs:
@@ -3199,10 +4074,35 @@ float DetectorPeakResponse::intrinsicEfficiency( const float energy ) const
   
   throw runtime_error( "DetectorPeakResponse::intrinsicEfficiency:"
                        " undefined efficiency" );
-}//float intrinsicEfficiency( const float energy ) const;
+}//float intrinsicEfficiencyNoLookup( const float energy ) const;
 
 
 
+vector<float> DetectorPeakResponse::intrinsicEfficiencies( const vector<float> &energies ) const
+{
+  vector<float> answer( energies.size() );
+  
+  // Formula based efficiencies can be evaluated for all energies at once, if we arent using a
+  //  lookup table, and the function hasnt been wrapped (e.g., by convertFixedGeometryToFarField).
+  const bool use_lookup_table = (m_lookupTables && m_hash && (m_lookupTables->m_hash == m_hash));
+  const FormulaEfficiencyFcn * const formula = m_efficiencyFcn.target<FormulaEfficiencyFcn>();
+  
+  if( (m_efficiencyForm == kFunctialEfficienyForm) && formula && !use_lookup_table )
+  {
+    vector<float> scaled_energies( energies.size() );
+    for( size_t i = 0; i < energies.size(); ++i )
+      scaled_energies[i] = energies[i] / m_efficiencyEnergyUnits;
+    formula->m_expression->efficiencies( scaled_energies.data(), answer.data(), answer.size() );
+    return answer;
+  }//if( can evaluate formula for all energies at once )
+  
+  for( size_t i = 0; i < energies.size(); ++i )
+    answer[i] = intrinsicEfficiency( energies[i] );
+  
+  return answer;
+}//vector<float> intrinsicEfficiencies( const vector<float> &energies ) const
+
+
 std::function<float( float )> DetectorPeakResponse::intrinsicEfficiencyFcn() const
 {
   const double energy_units = m_efficiencyEnergyUnits;
@@ -3367,6 +4267,25 @@ float DetectorPeakResponse::peakResolutionSigma( const float energy,
 
 float DetectorPeakResponse::peakResolutionFWHM( const float energy ) const
 {
+  if( m_lookupTables && m_hash && (m_lookupTables->m_hash == m_hash) && hasResolutionInfo() )
+  {
+    float lower_energy = static_cast<float>( m_lowerEnergy ), upper_energy = static_cast<float>( m_upperEnergy );
+    if( !(lower_energy > 0.0f) || !(upper_energy > lower_energy) )
+    {
+      lower_energy = static_cast<float>( 10.0*PhysicalUnits::keV );
+      upper_energy = static_cast<float>( 3000.0*PhysicalUnits::keV );
+    }
+    
+    const ResolutionFnctForm form = m_resolutionForm;
+    const vector<float> &coefs = m_resolutionCoeffs;
+    const LogEnergyGridTable *table = DrfLookupTables::table( m_lookupTables->m_fwhm_flag,
+                                           m_lookupTables->m_fwhm,
+                                           [form,&coefs]( float x ) -> float { return peakResolutionFWHM(x, form, coefs); },
+                                           lower_energy, upper_energy, m_lookupTables->m_rel_accuracy );
+    if( table && table->inRange(energy) )
+      return static_cast<float>( (*table)(energy) );
+  }//if( we can use lookup tables )
+  
   return peakResolutionFWHM( energy, m_resolutionForm, m_resolutionCoeffs );
 }//double peakResolutionFWHM( float energy ) const
 
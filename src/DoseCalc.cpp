@@ -24,15 +24,20 @@
 #include "InterSpec_config.h"
 
 #include <cmath>
+#include <mutex>
 #include <string>
 #include <vector>
+#include <exception>
 #include <sstream>
 #include <fstream>
 #include <assert.h>
 #include <iostream>
 #include <algorithm>
 
+#include "SpecUtils/SpecUtilsAsync.h"
+
 #include "InterSpec/DoseCalc.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/MaterialDB.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/GadrasSpecFunc.h"
@@ -154,33 +159,24 @@ namespace DoseCalc
     double dose_nonscatter = 0.0f;
     vector< pair<float,float> > uncollided_lines;
     
+    // Compute the continuum from all lines in one go.
+    const float hydrogen_frac_ad = 0.0f;
+    vector<float> uncollided;
+    scatter.addContinuum( continuum, uncollided, energies, intensity,
+                          an, areal_density_g_cm2, hydrogen_frac_ad, energy_groups );
+    assert( uncollided.size() == energies.size() );
+    
+    if( !(ad > 0) )
+      std::fill( begin(continuum), end(continuum), 0.0 );
+    
     for( size_t energyInd = 0; energyInd < energies.size(); ++energyInd )
     {
       const float energy = energies[energyInd];
-      const float I_0 = intensity[energyInd];
-//      const double mu = MassAttenuation::massAttenuationCoeficientFracAN( an, energy );
-//      const double transmittion = exp( -mu * areal_density );
-      
-      const float hydrogen_frac_ad = 0.0f;
-      vector<float> thiscontinuum;
-      const float uncollided
-             = scatter.getContinuum( thiscontinuum, energy, I_0,
-                                     an, areal_density_g_cm2, hydrogen_frac_ad,
-                                     energy_groups );
       
-      uncollided_lines.push_back( make_pair(energy, uncollided) ) ;
-      
-      assert( thiscontinuum.size() == energy_groups.size() );
-      assert( continuum.size() == thiscontinuum.size() );
+      uncollided_lines.push_back( make_pair(energy, uncollided[energyInd]) ) ;
       
       //Add in the dose from the uncoloided gamma, pre geom factor
-      dose_nonscatter += uncollided * gamma_dose( energy );
-      
-      if( ad > 0 )
-      {
-        for( size_t i = 0; i < thiscontinuum.size(); ++i )
-          continuum[i] += thiscontinuum[i];
-      }
+      dose_nonscatter += uncollided[energyInd] * gamma_dose( energy );
     }//for( size_t energyGroup = 0; energyGroup < energies.size(); ++energyGroup )
     
     if( false )
@@ -217,6 +213,88 @@ namespace DoseCalc
     
     return (dose_nonscatter + dose_continuum) / surfacearea;
   }//double gamma_dose_with_shielding(...)
+  
+  
+  vector<double> gamma_dose_with_shielding( const vector<float> &energies,
+                                    const vector<float> &intensity,
+                                    const vector<ShieldingConfiguration> &configurations,
+                                    const GadrasScatterTable &scatter )
+  {
+    // Beyond this distance gamma_dose_with_shielding(...) accounts for air attenuation, so the
+    //  shielding then depends on the distance.
+    const double max_no_air_distance = 300.0f*PhysicalUnits::cm;
+    
+    // Find the unique calculations needed; within max_no_air_distance configurations with the same
+    //  shielding are computed once, at the first distance seen, and scaled by 1/r^2.
+    vector<const ShieldingConfiguration *> unique_configs;
+    vector<size_t> unique_index( configurations.size() );
+    
+    for( size_t i = 0; i < configurations.size(); ++i )
+    {
+      const ShieldingConfiguration &config = configurations[i];
+      const bool has_air = (config.distance > max_no_air_distance);
+      
+      size_t index = 0;
+      for( ; index < unique_configs.size(); ++index )
+      {
+        const ShieldingConfiguration &other = *unique_configs[index];
+        const bool other_has_air = (other.distance > max_no_air_distance);
+        
+        if( (config.areal_density == other.areal_density)
+           && (config.atomic_number == other.atomic_number)
+           && (has_air == other_has_air)
+           && (!has_air || (config.distance == other.distance)) )
+          break;
+      }//for( loop over already seen configurations )
+      
+      if( index == unique_configs.size() )
+        unique_configs.push_back( &config );
+      unique_index[i] = index;
+    }//for( size_t i = 0; i < configurations.size(); ++i )
+    
+    vector<double> unique_doses( unique_configs.size(), 0.0 );
+    
+    std::mutex error_mutex;
+    std::exception_ptr first_error;
+    
+    SharedThreadPool::TaskGroup pool;
+    for( size_t i = 0; i < unique_configs.size(); ++i )
+    {
+      pool.post( [i, &unique_configs, &unique_doses, &energies, &intensity, &scatter, &error_mutex, &first_error](){
+        try
+        {
+          const ShieldingConfiguration &config = *unique_configs[i];
+          unique_doses[i] = gamma_dose_with_shielding( energies, intensity, config.areal_density,
+                                                      config.atomic_number, config.distance, scatter );
+        }catch( ... )
+        {
+          std::lock_guard<std::mutex> lock( error_mutex );
+          if( !first_error )
+            first_error = std::current_exception();
+        }//try / catch
+      } );
+    }//for( size_t i = 0; i < unique_configs.size(); ++i )
+    
+    pool.join();
+    
+    if( first_error )
+      std::rethrow_exception( first_error );
+    
+    vector<double> doses( configurations.size(), 0.0 );
+    for( size_t i = 0; i < configurations.size(); ++i )
+    {
+      const ShieldingConfiguration &config = configurations[i];
+      const ShieldingConfiguration &computed = *unique_configs[unique_index[i]];
+      
+      if( config.distance <= 0.0f )
+        throw runtime_error( "gamma_dose_with_shielding(): Distance must be greater than zero." );
+      
+      const double distance_ratio = static_cast<double>(computed.distance) / config.distance;
+      doses[i] = unique_doses[unique_index[i]] * distance_ratio * distance_ratio;
+    }//for( size_t i = 0; i < configurations.size(); ++i )
+    
+    return doses;
+  }//vector<double> gamma_dose_with_shielding(...)
 }//namespace DoseCalc
 
 
@@ -327,7 +327,7 @@ void DoseCalcWidget::init()
   {
     string continuumData = SpecUtils::append_path( InterSpec::staticDataDirectory(), "GadrasContinuum.lib" );
     
-    m_scatter.reset( new GadrasScatterTable( continuumData ) );
+    m_scatter = GadrasScatterTable::instance( continuumData );
   }catch( std::exception &e )
   {
     WString msg = "<div><b>Error initializing resources:</b></div><div>";
@@ -24,6 +24,9 @@
 #include "InterSpec_config.h"
 
 
+#include <cstdlib>
+#include <algorithm>
+
 #include <Wt/WContainerWidget>
 #include <Wt/WStandardItemModel>
 #include <Wt/Chart/WCartesianChart>
@@ -39,8 +42,12 @@ using namespace Wt;
 
 
 DrfChart::DrfChart( WContainerWidget *parent )
-: Wt::Chart::WCartesianChart( parent )
+: Wt::Chart::WCartesianChart( parent ),
+  m_numSampledPoints( 0 ),
+  m_layoutWidth( -1 )
 {
+  setLayoutSizeAware( true );
+  
   setBackground(Wt::WColor(220, 220, 220));
   setXSeriesColumn(0);
   setType(Wt::Chart::ScatterPlot);
@@ -185,10 +192,45 @@ void DrfChart::handleColorThemeChange( std::shared_ptr<const ColorTheme> theme )
 }//handleColorThemeChange(...)
 
 
+int DrfChart::numSamplePoints() const
+{
+  if( m_layoutWidth <= 0 )
+    return 400;
+  
+  return std::max( 100, std::min( 1000, m_layoutWidth / 2 ) );
+}//int numSamplePoints() const
+
+
+void DrfChart::layoutSizeChanged( int width, int height )
+{
+  Wt::Chart::WCartesianChart::layoutSizeChanged( width, height );
+  
+  m_layoutWidth = width;
+  
+  // Only re-sample if the resolution changes appreciably
+  const int wanted = numSamplePoints();
+  if( m_numSampledPoints && (std::abs(wanted - m_numSampledPoints) > (m_numSampledPoints / 4)) )
+    sampleCurves();
+}//void layoutSizeChanged( int width, int height )
+
+
 void DrfChart::updateChart( std::shared_ptr<const DetectorPeakResponse> det )
 {
+  const bool same_drf = (det == m_detector)
+                        || (det && m_detector && det->hashValue() && (det->hashValue() == m_detector->hashValue()));
   m_detector = det;
   
+  if( same_drf && (!det || m_numSampledPoints) )
+    return;
+  
+  sampleCurves();
+}//void updateChart( std::shared_ptr<const DetectorPeakResponse> det )
+
+
+void DrfChart::sampleCurves()
+{
+  m_numSampledPoints = 0;
+  
   // clear series if any
   removeSeries(1);
   removeSeries(2);
@@ -215,14 +257,12 @@ void DrfChart::updateChart( std::shared_ptr<const DetectorPeakResponse> det )
       }
       
       
-      // TODO: pick this better using the chart width or whatever
-      int numEnergyPoints = floor(maxEnergy - minEnergy) / 2.5; //max of 8k points, but usually 12.5
-      if( numEnergyPoints > 4500 ) //4500 chosen arbitrarily
-        numEnergyPoints = 4500;
+      const int numEnergyPoints = numSamplePoints();
       
       m_efficiencyModel->clear();
       m_efficiencyModel->insertRows( 0, numEnergyPoints );
       m_efficiencyModel->insertColumns( 0, hasResloution? 3 : 2 );
+      m_numSampledPoints = numEnergyPoints;
       float energy = 0.0f, efficiency = 0.0f;
       for( int row = 0; row < numEnergyPoints; ++row )
       {
@@ -289,8 +329,8 @@ void DrfChart::updateChart( std::shared_ptr<const DetectorPeakResponse> det )
       }//no ResolutionInfo
     }catch( std::exception &e )
     {
-      cerr << "DrfSelect::updateChart()\n\tCaught: " << e.what() << endl;
+      cerr << "DrfChart::sampleCurves()\n\tCaught: " << e.what() << endl;
     }//try / catch
   }//if( hasEfficiency )
-} //DrfChart::updateChart()
+}//void DrfChart::sampleCurves()
 
@@ -23,14 +23,18 @@
 
 #include "InterSpec_config.h"
 
+#include <set>
 #include <map>
+#include <mutex>
 #include <regex>
 #include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <cassert>
 #include <algorithm>
+#include <functional>
 
 #include <boost/tokenizer.hpp>
 #include <boost/filesystem.hpp>
@@ -633,7 +637,333 @@ public:
     }
   }
 };//class DrfDownloadResource
-
+  
+  
+  /** A summary of a GADRAS DRF directory, so the GADRAS DRF selection tab can list the DRFs in a directory, and
+   match against the current DRF (using its hash), without having to fully parse every DRF; a DRF is only fully
+   parsed once the user selects it (or if it has changed since it was last indexed).
+   
+   Entries are kept in a persistent index file, in InterSpec::writableDataDirectory(), and are keyed by the DRF
+   directory path, and the modification times and sizes of its "Efficiency.csv" and "Detector.dat" files.
+   */
+  struct GadrasDrfIndexEntry
+  {
+    std::string m_path;
+    std::string m_name;
+    std::string m_description;
+    uint64_t m_hash = 0;
+    
+    int64_t m_csv_mtime = 0, m_csv_size = 0;
+    int64_t m_dat_mtime = 0, m_dat_size = 0;
+  };//struct GadrasDrfIndexEntry
+  
+  
+  /** Version of the index file; if the DRF hashing, or file format, changes, this should be incremented.
+   
+   We also include the boost version in the file header, since the DRF hash uses `boost::hash_combine`, so a
+   different boost version will cause the index to be rebuilt.
+   */
+  const int ns_gadras_drf_index_version = 1;
+  
+  std::mutex ns_gadras_drf_index_mutex;
+  bool ns_gadras_drf_index_loaded = false;
+  std::map<std::string,GadrasDrfIndexEntry> ns_gadras_drf_index;
+  
+  
+  std::string gadras_drf_index_header()
+  {
+    return "GadrasDrfIndex\t" + std::to_string(ns_gadras_drf_index_version)
+           + "\t" + std::to_string(BOOST_VERSION);
+  }//gadras_drf_index_header()
+  
+  
+  /** Returns path to the persistent index file, or empty string if InterSpec::writableDataDirectory() isnt set. */
+  std::string gadras_drf_index_filename()
+  {
+    try
+    {
+      const string datadir = InterSpec::writableDataDirectory();
+      if( !datadir.empty() && SpecUtils::is_directory(datadir) )
+        return SpecUtils::append_path( datadir, "GadrasDrfIndex.tsv" );
+    }catch( std::exception & )
+    {
+      //InterSpec::writableDataDirectory() hasnt been set - we'll just keep the index in memory
+    }
+    
+    return "";
+  }//gadras_drf_index_filename()
+  
+  
+  /** Fills out the modification time and size of a file; returns false if file doesnt exist or cant be accessed. */
+  bool gadras_drf_file_stats( const std::string &filename, int64_t &mtime, int64_t &size )
+  {
+#ifdef _WIN32
+    const boost::filesystem::path p( SpecUtils::convert_from_utf8_to_utf16(filename) );
+#else
+    const boost::filesystem::path p( filename );
+#endif
+    
+    boost::system::error_code ec;
+    const std::time_t t = boost::filesystem::last_write_time( p, ec );
+    if( ec )
+      return false;
+    
+    const boost::uintmax_t s = boost::filesystem::file_size( p, ec );
+    if( ec )
+      return false;
+    
+    mtime = static_cast<int64_t>( t );
+    size = static_cast<int64_t>( s );
+    
+    return true;
+  }//gadras_drf_file_stats(...)
+  
+  
+  /** Fills out the path and file stats of the returned entry; returns false if files cant be accessed. */
+  bool gadras_drf_dir_stats( const std::string &path, GadrasDrfIndexEntry &entry )
+  {
+    entry.m_path = path;
+    return gadras_drf_file_stats( SpecUtils::append_path(path, "Efficiency.csv"), entry.m_csv_mtime, entry.m_csv_size )
+           && gadras_drf_file_stats( SpecUtils::append_path(path, "Detector.dat"), entry.m_dat_mtime, entry.m_dat_size );
+  }//gadras_drf_dir_stats(...)
+  
+  
+  bool gadras_drf_same_files( const GadrasDrfIndexEntry &lhs, const GadrasDrfIndexEntry &rhs )
+  {
+    return (lhs.m_path == rhs.m_path)
+           && (lhs.m_csv_mtime == rhs.m_csv_mtime) && (lhs.m_csv_size == rhs.m_csv_size)
+           && (lhs.m_dat_mtime == rhs.m_dat_mtime) && (lhs.m_dat_size == rhs.m_dat_size);
+  }//gadras_drf_same_files(...)
+  
+  
+  /** Loads the persistent index from disk, if it hasnt been already.
+   
+   ns_gadras_drf_index_mutex must be locked before calling.
+   */
+  void load_gadras_drf_index()
+  {
+    if( ns_gadras_drf_index_loaded )
+      return;
+    
+    ns_gadras_drf_index_loaded = true;
+    
+    const string filename = gadras_drf_index_filename();
+    if( filename.empty() )
+      return;
+    
+#ifdef _WIN32
+    ifstream input( SpecUtils::convert_from_utf8_to_utf16(filename).c_str(), ios_base::binary|ios_base::in );
+#else
+    ifstream input( filename.c_str(), ios_base::binary|ios_base::in );
+#endif
+    if( !input.is_open() )
+      return;
+    
+    string line;
+    if( !SpecUtils::safe_get_line( input, line ) || (line != gadras_drf_index_header()) )
+      return;
+    
+    while( SpecUtils::safe_get_line( input, line ) )
+    {
+      vector<string> fields;
+      SpecUtils::split_no_delim_compress( fields, line, "\t" );
+      if( fields.size() == 7 )
+        fields.push_back( "" ); //empty description
+      if( fields.size() != 8 )
+        continue;
+      
+      try
+      {
+        GadrasDrfIndexEntry entry;
+        entry.m_path = fields[0];
+        entry.m_csv_mtime = std::stoll( fields[1] );
+        entry.m_csv_size = std::stoll( fields[2] );
+        entry.m_dat_mtime = std::stoll( fields[3] );
+        entry.m_dat_size = std::stoll( fields[4] );
+        entry.m_hash = std::stoull( fields[5] );
+        entry.m_name = fields[6];
+        entry.m_description = fields[7];
+        
+        ns_gadras_drf_index[entry.m_path] = entry;
+      }catch( std::exception & )
+      {
+        //Corrupted line - will just re-parse this DRF
+      }
+    }//while( SpecUtils::safe_get_line( input, line ) )
+  }//void load_gadras_drf_index()
+  
+  
+  /** Writes the index to disk, replacing the previous file.
+   
+   ns_gadras_drf_index_mutex must be locked before calling.
+   */
+  void save_gadras_drf_index()
+  {
+    const string filename = gadras_drf_index_filename();
+    if( filename.empty() )
+      return;
+    
+    const auto clean_field = []( string val ) -> string {
+      for( char &c : val )
+      {
+        if( (c == '\t') || (c == '\n') || (c == '\r') )
+          c = ' ';
+      }
+      return val;
+    };//clean_field lambda
+    
+    const string tmpname = filename + ".tmp";
+    
+    {//begin scope to write temp file
+#ifdef _WIN32
+      ofstream output( SpecUtils::convert_from_utf8_to_utf16(tmpname).c_str(), ios_base::binary|ios_base::out );
+#else
+      ofstream output( tmpname.c_str(), ios_base::binary|ios_base::out );
+#endif
+      if( !output.is_open() )
+        return;
+      
+      output << gadras_drf_index_header() << "\n";
+      for( const auto &path_entry : ns_gadras_drf_index )
+      {
+        const GadrasDrfIndexEntry &entry = path_entry.second;
+        if( entry.m_path.find_first_of("\t\r\n") != string::npos )
+          continue;
+        
+        output << entry.m_path
+               << "\t" << entry.m_csv_mtime << "\t" << entry.m_csv_size
+               << "\t" << entry.m_dat_mtime << "\t" << entry.m_dat_size
+               << "\t" << entry.m_hash
+               << "\t" << clean_field(entry.m_name)
+               << "\t" << clean_field(entry.m_description) << "\n";
+      }//for( loop over entries )
+      
+      if( !output )
+      {
+        output.close();
+        SpecUtils::remove_file( tmpname );
+        return;
+      }
+    }//end scope to write temp file
+    
+    if( SpecUtils::is_file( filename ) )
+      SpecUtils::remove_file( filename );
+    
+    if( !SpecUtils::rename_file( tmpname, filename ) )
+    {
+      cerr << "Failed to rename '" << tmpname << "' to '" << filename << "'" << endl;
+      SpecUtils::remove_file( tmpname );
+    }
+  }//void save_gadras_drf_index()
+  
+  
+  /** Returns the index entries for the GADRAS DRF directories, `drf_dirs`, found in `basedir`.
+   
+   DRFs that arent in the index, or whose files have changed, are parsed (in parallel) using `parse`; these parsed
+   DRFs are placed into `parsed_drfs` (same ordering as the returned entries, with nullptr for DRFs not parsed), so
+   they wont need to be parsed again if selected.  DRFs that fail to parse are not returned.
+   Entries for DRFs under `basedir` that no longer exist are removed from the index.
+   */
+  vector<GadrasDrfIndexEntry> gadras_drf_index_entries( const string &basedir, const vector<string> &drf_dirs,
+                                      const std::function<shared_ptr<DetectorPeakResponse>(const string &)> &parse,
+                                      vector<shared_ptr<DetectorPeakResponse>> &parsed_drfs )
+  {
+    vector<GadrasDrfIndexEntry> previous( drf_dirs.size() );
+    
+    {//begin lock on ns_gadras_drf_index_mutex
+      std::lock_guard<std::mutex> lock( ns_gadras_drf_index_mutex );
+      load_gadras_drf_index();
+      
+      for( size_t i = 0; i < drf_dirs.size(); ++i )
+      {
+        const auto pos = ns_gadras_drf_index.find( drf_dirs[i] );
+        if( pos != end(ns_gadras_drf_index) )
+          previous[i] = pos->second;
+      }
+    }//end lock on ns_gadras_drf_index_mutex
+    
+    vector<GadrasDrfIndexEntry> entries( drf_dirs.size() );
+    vector<shared_ptr<DetectorPeakResponse>> drfs( drf_dirs.size() );
+    vector<char> valid( drf_dirs.size(), 0 );
+    
+    SpecUtilsAsync::ThreadPool pool;
+    for( size_t i = 0; i < drf_dirs.size(); ++i )
+    {
+      pool.post( [i,&drf_dirs,&previous,&entries,&drfs,&valid,&parse](){
+        GadrasDrfIndexEntry &entry = entries[i];
+        if( !gadras_drf_dir_stats( drf_dirs[i], entry ) )
+          return;
+        
+        if( gadras_drf_same_files( entry, previous[i] ) )
+        {
+          entry = previous[i];
+          valid[i] = 1;
+          return;
+        }
+        
+        drfs[i] = parse( drf_dirs[i] );
+        if( !drfs[i] )
+          return;
+        
+        entry.m_name = drfs[i]->name();
+        entry.m_description = drfs[i]->description();
+        entry.m_hash = drfs[i]->hashValue();
+        valid[i] = 1;
+      } );
+    }//for( size_t i = 0; i < drf_dirs.size(); ++i )
+    pool.join();
+    
+    vector<GadrasDrfIndexEntry> answer;
+    parsed_drfs.clear();
+    
+    {//begin lock on ns_gadras_drf_index_mutex
+      std::lock_guard<std::mutex> lock( ns_gadras_drf_index_mutex );
+      
+      bool index_changed = false;
+      
+      for( size_t i = 0; i < drf_dirs.size(); ++i )
+      {
+        if( !valid[i] )
+          continue;
+        
+        answer.push_back( entries[i] );
+        parsed_drfs.push_back( drfs[i] );
+        
+        if( drfs[i] )
+        {
+          ns_gadras_drf_index[entries[i].m_path] = entries[i];
+          index_changed = true;
+        }
+      }//for( size_t i = 0; i < drf_dirs.size(); ++i )
+      
+      // Remove entries for DRFs that no longer exist under this directory
+      const bool basedir_ends_in_sep = (!basedir.empty() && ((basedir.back() == '/') || (basedir.back() == '\\')));
+      const std::set<string> current_dirs( begin(drf_dirs), end(drf_dirs) );
+      for( auto iter = begin(ns_gadras_drf_index); iter != end(ns_gadras_drf_index); )
+      {
+        const string &path = iter->first;
+        const bool in_basedir = SpecUtils::starts_with( path, basedir.c_str() )
+                                && (basedir_ends_in_sep
+                                    || (path.size() == basedir.size())
+                                    || (path[basedir.size()] == '/')
+                                    || (path[basedir.size()] == '\\'));
+        
+        if( in_basedir && !current_dirs.count(path) )
+        {
+          iter = ns_gadras_drf_index.erase( iter );
+          index_changed = true;
+        }else
+        {
+          ++iter;
+        }
+      }//for( loop over index entries )
+      
+      if( index_changed )
+        save_gadras_drf_index();
+    }//end lock on ns_gadras_drf_index_mutex
+    
+    return answer;
+  }//gadras_drf_index_entries(...)
 }//namespace
 
 
@@ -740,6 +1070,7 @@ public:
 
 class GadrasDirectory : public Wt::WContainerWidget
 {
+  friend class DrfSelect;
   friend class GadrasDetSelect;
   
 protected:
@@ -753,6 +1084,13 @@ protected:
   DrfSelect *m_drfSelect;
   
   Wt::WComboBox *m_detectorSelect;
+  
+  /** The index entries of the DRFs in this directory, sorted by name; the DRF for entry `i` is at index `i + 1` of
+   #m_detectorSelect.
+   */
+  std::vector<GadrasDrfIndexEntry> m_drfs;
+  
+  /** The fully parsed DRFs, for each entry of #m_drfs; lazily filled (see #detector) as DRFs are selected. */
   std::vector<std::shared_ptr<DetectorPeakResponse> > m_responses;
 
   Wt::WText *m_msg;
@@ -780,6 +1118,9 @@ protected:
   static std::shared_ptr<DetectorPeakResponse> parseDetector( const string directory );
   static vector<string> recursive_list_gadras_drfs( const string &sourcedir );
   
+  /** Returns the DRF for entry `index` of #m_drfs, parsing it if it hasnt been already; returns null on error. */
+  std::shared_ptr<DetectorPeakResponse> detector( const size_t index );
+  
   void initDetectors();
   void detectorSelected( const int index );
 };//class GadrasDirectory
@@ -1589,16 +1930,14 @@ MatchDetectorStatus GadrasDetSelect::trySelectDetector( std::shared_ptr<Detector
     if( !d )
       continue;  //shouldnt ever happen, but JIC
     
-    for( size_t i = 0; i < d->m_responses.size(); ++i )
+    for( size_t i = 0; i < d->m_drfs.size(); ++i )
     {
-      auto response = d->m_responses[i];
-      
-      if( (response == det) || (det->hashValue() == response->hashValue()) )
+      if( (d->m_responses[i] == det) || (det->hashValue() == d->m_drfs[i].m_hash) )
       {
         d->m_detectorSelect->setCurrentIndex( static_cast<int>(i) + 1 );
         return MatchDetectorStatus::Match;
       }
-    }//for( size_t i = 0; i < d->m_responses.size(); ++i )
+    }//for( size_t i = 0; i < d->m_drfs.size(); ++i )
     
     d->m_detectorSelect->setCurrentIndex( 0 );
   }//for( auto w : m_directories->children() )
@@ -1938,8 +2277,8 @@ void GadrasDirectory::detectorSelectCallback()
   const int index = m_detectorSelect->currentIndex();
   
   //Item at index 0 is always a non-detector.
-  if( index > 0 && (index-1) < m_responses.size() )
-    det = m_responses[index-1];
+  if( index > 0 && (index-1) < m_drfs.size() )
+    det = detector( index - 1 );
   
   if( m_parent )
     m_parent->detectorSelected( this, det );
@@ -1957,14 +2296,15 @@ MatchDetectorStatus GadrasDirectory::trySelectDetector( std::shared_ptr<Detector
     return MatchDetectorStatus::NoMatch;
   }//if( !det )
   
-  for( size_t i = 0; i < m_responses.size(); ++i )
+  const uint64_t hash = det->hashValue();
+  for( size_t i = 0; i < m_drfs.size(); ++i )
   {
-    if( m_responses[i]->hashValue() == det->hashValue() )
+    if( m_drfs[i].m_hash == hash )
     {
       m_detectorSelect->setCurrentIndex( static_cast<int>(i) + 1 );
       return MatchDetectorStatus::Match;
     }
-  }//for( size_t i = 0; i < m_responses.size(); ++i )
+  }//for( size_t i = 0; i < m_drfs.size(); ++i )
   
   m_detectorSelect->setCurrentIndex( 0 );
   
@@ -1998,6 +2338,20 @@ std::shared_ptr<DetectorPeakResponse> GadrasDirectory::parseDetector( string pat
 }//shared_ptr<DetectorPeakResponse> parseDetector( const string directory )
 
 
+std::shared_ptr<DetectorPeakResponse> GadrasDirectory::detector( const size_t index )
+{
+  if( index >= m_drfs.size() )
+    return nullptr;
+  
+  assert( m_responses.size() == m_drfs.size() );
+  
+  if( !m_responses[index] )
+    m_responses[index] = parseDetector( m_drfs[index].m_path );
+  
+  return m_responses[index];
+}//shared_ptr<DetectorPeakResponse> detector( const size_t index )
+
+
 vector<string> GadrasDirectory::recursive_list_gadras_drfs( const string &sourcedir )
 {
   vector<string> files;
@@ -2051,6 +2405,7 @@ using namespace boost::filesystem;
 void GadrasDirectory::initDetectors()
 {
   m_detectorSelect->clear();
+  m_drfs.clear();
   m_responses.clear();
   
   m_msg->setText( "" );
@@ -2080,7 +2435,8 @@ void GadrasDirectory::initDetectors()
   const std::string objname = objectName();
   const std::string sessid = wApp->sessionId();
   
-  auto updategui = [this,objname]( std::vector<std::shared_ptr<DetectorPeakResponse> > drfs ){
+  auto updategui = [this,objname]( std::vector<GadrasDrfIndexEntry> entries,
+                                   std::vector<std::shared_ptr<DetectorPeakResponse> > drfs ){
     
     //Lets make sure this widget hasnt been deleted, by looking for it in the DOM
     WWidget *w = wApp->findWidget(objname);
@@ -2092,13 +2448,24 @@ void GadrasDirectory::initDetectors()
     
     //cout << "Found widget '" << objname << "' in the DOM!" << endl;
     
-    for( auto drf : drfs )
+    assert( entries.size() == drfs.size() );
+    
+    vector<size_t> sorted_indices( entries.size() );
+    for( size_t i = 0; i < sorted_indices.size(); ++i )
+      sorted_indices[i] = i;
+    
+    std::sort( begin(sorted_indices), end(sorted_indices),
+               [&entries]( const size_t lhs, const size_t rhs ) -> bool {
+      return entries[lhs].m_name < entries[rhs].m_name;
+    } );
+    
+    for( const size_t index : sorted_indices )
     {
-      if( drf )
-        m_responses.push_back( drf );
+      m_drfs.push_back( entries[index] );
+      m_responses.push_back( drfs[index] );
     }
     
-    if( m_responses.empty() )
+    if( m_drfs.empty() )
     {
       m_detectorSelect->addItem( WString("<{1}>").arg( WString::tr("reds-no-drf-in-dir") ) );
       m_detectorSelect->disable();
@@ -2108,20 +2475,17 @@ void GadrasDirectory::initDetectors()
       m_detectorSelect->enable();
     }
     
-    std::sort( begin(m_responses), end(m_responses),
-               []( const shared_ptr<DetectorPeakResponse> &lhs,
-                   const shared_ptr<DetectorPeakResponse> &rhs ) -> bool {
-     if( !lhs || !rhs )
-       return false;
-      return lhs->name() < rhs->name();
-    } );
-    
-    
-    for( const auto drf : m_responses )
-      m_detectorSelect->addItem( drf->name() );
+    // We'll set the DRF path as the UserRole data, which GadrasDetSelect::selectedDetector() uses
+    WAbstractItemModel *model = m_detectorSelect->model();
+    for( const GadrasDrfIndexEntry &entry : m_drfs )
+    {
+      m_detectorSelect->addItem( entry.m_name );
+      if( model )
+        model->setData( m_detectorSelect->count() - 1, 0, boost::any(entry.m_path), Wt::UserRole );
+    }
     m_detectorSelect->setCurrentIndex( 0 );
     
-    if( m_responses.empty() )
+    if( m_drfs.empty() )
     {
       m_msg->setText( WString("<span style=\"color:red;\">{1}</span>").arg("reds-recursive-no-drfs-in-dir") );
       m_msg->show();
@@ -2142,24 +2506,16 @@ void GadrasDirectory::initDetectors()
   
   auto searchpaths = [basedir, objname, sessid, updategui](){
     const vector<string> dirs = recursive_list_gadras_drfs( basedir );
-    std::vector<std::shared_ptr<DetectorPeakResponse> > dets( dirs.size(), nullptr );
-    
-    SpecUtilsAsync::ThreadPool pool;
-    for( size_t i = 0; i < dirs.size(); ++i )
-      pool.post( [i,&dets,&dirs](){ dets[i] = GadrasDirectory::parseDetector( dirs[i] ); } );
-    pool.join();
     
-    //for( const auto &d : dirs )
-    //{
-    //  auto drf = parseDetector( d );
-    //  if( drf )
-    //    m_responses.push_back( drf );
-    //}
-    //end section that should be done off the main thread
+    // Only DRFs that arent in the index (or have changed since being indexed) get parsed here; the
+    //  rest are parsed only when the user selects them.
+    std::vector<std::shared_ptr<DetectorPeakResponse> > dets;
+    const std::vector<GadrasDrfIndexEntry> entries
+                       = gadras_drf_index_entries( basedir, dirs, &GadrasDirectory::parseDetector, dets );
     
     Wt::WServer *server = Wt::WServer::instance();
     if( server )
-      server->post(sessid, std::bind( [updategui,dets](){ updategui(dets); } ) );
+      server->post(sessid, std::bind( [updategui,entries,dets](){ updategui(entries,dets); } ) );
   };//searchpaths lamda
   
   
@@ -2173,7 +2529,7 @@ void GadrasDirectory::detectorSelected( const int index )
 {
   std::shared_ptr<DetectorPeakResponse> det;
   if( index > 0 )
-    det = m_responses.at( index - 1 );
+    det = detector( static_cast<size_t>(index - 1) );
   
   m_drfSelect->setDetector( det );
   m_drfSelect->emitChangedSignal();
@@ -5115,6 +5471,16 @@ std::shared_ptr<DetectorPeakResponse> DrfSelect::initAGadrasDetectorFromDirector
 }//std::shared_ptr<DetectorPeakResponse> initAGadrasDetectorFromDirectory()
 
 
+void DrfSelect::indexGenericGadrasDetectors()
+{
+  const string basedir = SpecUtils::append_path( InterSpec::staticDataDirectory(), "GenericGadrasDetectors" );
+  const vector<string> dirs = GadrasDirectory::recursive_list_gadras_drfs( basedir );
+  
+  vector<shared_ptr<DetectorPeakResponse>> parsed_drfs;
+  gadras_drf_index_entries( basedir, dirs, &GadrasDirectory::parseDetector, parsed_drfs );
+}//void indexGenericGadrasDetectors()
+
+
 void DrfSelect::emitChangedSignal()
 {
   //Make sure this is a necessary signal to emit
@@ -25,6 +25,7 @@
 #include <set>
 #include <map>
 #include <deque>
+#include <exception>
 
 #include <Wt/WText>
 #include <Wt/WLabel>
@@ -39,6 +40,7 @@
 
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/SpecUtilsAsync.h"
 #include "SpecUtils/EnergyCalibration.h"
 
 #include "InterSpec/PeakDef.h"
@@ -1234,68 +1236,83 @@ void EnergyCalMultiFileModel::refreshData()
     endRemoveRows();
   }//if( m_peaks.size() )
   
-  vector<vector<SamplesPeakInfo_t>> newdata;
-  
   const int nfile = m_fileModel->rowCount();
+  
+  vector<shared_ptr<SpectraFileHeader>> headers( nfile );
+  for( int filenum = 0; filenum < nfile; ++filenum )
+    headers[filenum] = m_fileModel->fileHeader( filenum );
+  
+  // Parsing the files (which may need to be loaded from disk), and getting the energy calibration
+  //  for each set of sample numbers can take a while when there are a lot of files, so we'll do
+  //  each file in parallel.
+  vector<vector<SamplesPeakInfo_t>> newdata( nfile );
+  vector<std::exception_ptr> errors( nfile );
+  
+  SpecUtilsAsync::ThreadPool pool;
   for( int filenum = 0; filenum < nfile; ++filenum )
   {
-    vector<SamplesPeakInfo_t> peaks;
-    shared_ptr<SpectraFileHeader> header = m_fileModel->fileHeader( filenum );
-    
-    if( !header )
-    {
-      newdata.push_back( peaks );
-      continue;
-    }//if( !header )
-    
-    std::shared_ptr<SpecMeas> spec = header->parseFile();
-    
-    if( !spec )
-    {
-      newdata.push_back( peaks );
-      continue;
-    }//if( !header )
-    
-    const auto gammaDetNames = spec->gamma_detector_names();
-    
-    typedef std::shared_ptr<const PeakDef> PeakPtr;
-    const set<set<int>> peaksamplenums = spec->sampleNumsWithPeaks();
-    for( const set<int> &samplnums : peaksamplenums )
-    {
-      SamplesPeakInfo_t samplesinfo;
-      
-      get<0>(samplesinfo) = header;
-      get<1>(samplesinfo) = samplnums;
-      shared_ptr<const SpecUtils::EnergyCalibration> &cal = get<2>(samplesinfo);
-      vector<UsePeakInfo_t> &samplespeaks = get<3>(samplesinfo);
-      
+    pool.post( [filenum,&headers,&newdata,&errors](){
       try
       {
-        cal = spec->suggested_sum_energy_calibration( samplnums, gammaDetNames );
-      }catch( std::exception & )
-      {
+        const shared_ptr<SpectraFileHeader> &header = headers[filenum];
+        if( !header )
+          return;
+        
+        std::shared_ptr<SpecMeas> spec = header->parseFile();
+        if( !spec )
+          return;
+        
+        vector<SamplesPeakInfo_t> &peaks = newdata[filenum];
+        const auto gammaDetNames = spec->gamma_detector_names();
+        
+        typedef std::shared_ptr<const PeakDef> PeakPtr;
+        const set<set<int>> peaksamplenums = spec->sampleNumsWithPeaks();
+        for( const set<int> &samplnums : peaksamplenums )
+        {
+          SamplesPeakInfo_t samplesinfo;
+          
+          get<0>(samplesinfo) = header;
+          get<1>(samplesinfo) = samplnums;
+          shared_ptr<const SpecUtils::EnergyCalibration> &cal = get<2>(samplesinfo);
+          vector<UsePeakInfo_t> &samplespeaks = get<3>(samplesinfo);
+          
+          try
+          {
+            cal = spec->suggested_sum_energy_calibration( samplnums, gammaDetNames );
+          }catch( std::exception & )
+          {
 #if( PERFORM_DEVELOPER_CHECKS )
-        log_developer_error( __func__, "Unexpected failure of suggested_sum_energy_calibration" );
+            log_developer_error( "EnergyCalMultiFileModel::refreshData()", "Unexpected failure of suggested_sum_energy_calibration" );
 #endif
-      }//try / catch
-      
-      auto measpeaks = spec->peaks( samplnums );
-      if( cal && measpeaks )
+          }//try / catch
+          
+          auto measpeaks = spec->peaks( samplnums );
+          if( cal && measpeaks )
+          {
+            for( const PeakPtr &peak : *measpeaks )
+            {
+              if( peak && peak->hasSourceGammaAssigned() )
+                samplespeaks.emplace_back( peak->useForEnergyCalibration(), peak );
+            }
+          }
+          
+          if( !samplespeaks.empty() )
+            peaks.push_back( samplesinfo );
+        }//for( const IntSet &samplnums : peaksamplenums )
+      }catch( ... )
       {
-        for( const PeakPtr &peak : *measpeaks )
-        {
-          if( peak && peak->hasSourceGammaAssigned() )
-            samplespeaks.emplace_back( peak->useForEnergyCalibration(), peak );
-        }
+        errors[filenum] = std::current_exception();
       }
-      
-      if( !samplespeaks.empty() )
-        peaks.push_back( samplesinfo );
-    }//for( const IntSet &samplnums : peaksamplenums )
-    
-    newdata.push_back( peaks );
+    } );
   }//for( int filenum = 0; filenum < nfile; ++filenum )
-
+  pool.join();
+  
+  for( const std::exception_ptr &error : errors )
+  {
+    if( error )
+      std::rethrow_exception( error );
+  }
+  
   m_data.swap( newdata );
   reset();
   
@@ -161,6 +161,9 @@ namespace
       return;
     }
     
+    vector<pair<shared_ptr<const Measurement>,shared_ptr<const SpecUtils::EnergyCalibration>>> new_meas_cals;
+    new_meas_cals.reserve( meas_old_new_cal.size() );
+    
     for( const auto &m_o_n : meas_old_new_cal )
     {
       const shared_ptr<const Measurement> lm = get<0>(m_o_n).lock();
@@ -185,8 +188,10 @@ namespace
       }
       
       assert( lm && (lm->energy_calibration() == from_cal) );
-      specfile->set_energy_calibration( to_cal, m );
+      new_meas_cals.emplace_back( m, to_cal );
     }//for( const auto &m_o_n : meas_old_new_cal )
+    
+    specfile->set_energy_calibrations( new_meas_cals );
       
     
     for( const auto &m_o_n : meas_old_new_peaks )
@@ -2480,11 +2485,17 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
   
   // const vector<MeasToApplyCoefChangeTo> changemeas = measurementsToApplyCoeffChangeTo();
   
+  // The measurements of each change getting its calibration changed, so when there are thousands
+  //  of records, we dont have to look them up a second time when setting the calibrations.
+  vector<vector<shared_ptr<const Measurement>>> change_measurements( changemeas.size() );
+  
   //We will loop over the changes to apply twice.  Once to calculate new calibrations, and make sure
   //  they are valid, then a second time to actually set them.  If a new calibration is invalid,
   //  an exception will be thrown so we will catch that.
-  for( const MeasToApplyCoefChangeTo &change : changemeas )
+  for( size_t change_index = 0; change_index < changemeas.size(); ++change_index )
   {
+    const MeasToApplyCoefChangeTo &change = changemeas[change_index];
+    vector<shared_ptr<const Measurement>> &measurements = change_measurements[change_index];
     assert( change.meas );
     
     //string dbgmsg = "For '" + change.meas->filename() + "' will apply changes to Detectors: {";
@@ -2507,6 +2518,8 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
           if( !m || m->num_gamma_channels() <= 4 )
             continue;
           
+          measurements.push_back( m );
+          
           const auto meas_old_cal = m->energy_calibration();
           assert( meas_old_cal );
           
@@ -2654,13 +2667,26 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
       display_detectors.insert( end(display_detectors), begin(change.detectors), end(change.detectors) );
     }//if( foreground being change ) / else background / else
     
+    // The peaks and hint peaks usually share sample numbers, so we'll only find the calibration for
+    //  each set of sample numbers once, since this can be slow for many samples.
+    map<set<int>,shared_ptr<const EnergyCalibration>> samples_cals;
+    const auto suggested_sum_cal = [&samples_cals,&change,&display_detectors]( const set<int> &samples )
+                                                                -> shared_ptr<const EnergyCalibration> {
+      const auto pos = samples_cals.find( samples );
+      if( pos != end(samples_cals) )
+        return pos->second;
+      
+      auto cal = change.meas->suggested_sum_energy_calibration( samples, display_detectors );
+      samples_cals[samples] = cal;
+      return cal;
+    };//suggested_sum_cal lambda
     
     for( const set<int> &samples : peaksamples )
     {
       //If there is any overlap between 'samples' and 'change.sample_numbers', then apply the change
       //  Note: this isnt correct, but I cant think of a better solution at the moment.
       auto oldpeaks = change.meas->peaks(samples);
-      auto oldcal = change.meas->suggested_sum_energy_calibration( samples, display_detectors );
+      auto oldcal = suggested_sum_cal( samples );
       
       if( !oldpeaks || oldpeaks->empty() || !oldcal || !oldcal->valid() )
       {
@@ -2712,7 +2738,7 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
     for( const set<int> &samples : hintPeakSamples )
     {
       auto oldHintPeaks = change.meas->automatedSearchPeaks(samples);
-      auto oldcal = change.meas->suggested_sum_energy_calibration( samples, display_detectors );
+      auto oldcal = suggested_sum_cal( samples );
       
       if( !oldHintPeaks || oldHintPeaks->empty() || !oldcal || !oldcal->valid() )
       {
@@ -2748,7 +2774,7 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
   #endif
       }//try / catch
     }//for( const set<int> &samples : hintPeakSamples )
-  }//for( const MeasToApplyCoefChangeTo &change : changemeas )
+  }//for( loop over changemeas )
   
   if( old_to_new_cals.find(disp_prev_cal) == end(old_to_new_cals) )
   {
@@ -2768,49 +2794,47 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
   
   // Now go through and actually set the energy calibrations; they should all be valid and computed,
   //  as should all the shifted peaks.
-  for( const MeasToApplyCoefChangeTo &change : changemeas )
+  for( size_t change_index = 0; change_index < changemeas.size(); ++change_index )
   {
+    const MeasToApplyCoefChangeTo &change = changemeas[change_index];
     assert( change.meas );
     
     meas_old_new_cal_t &meas_old_new_cal = undo_sentry.cal_info( change.meas );
     meas_old_new_peaks_t &meas_old_new_peaks = undo_sentry.peak_info( change.meas );
     meas_old_new_peaks_t &meas_old_new_hint_peaks = undo_sentry.hint_peak_info( change.meas );
     
+    const vector<shared_ptr<const Measurement>> &measurements = change_measurements[change_index];
+    vector<pair<shared_ptr<const Measurement>,shared_ptr<const EnergyCalibration>>> new_meas_cals;
+    new_meas_cals.reserve( measurements.size() );
     
-    for( const int sample : change.sample_numbers )
+    for( const shared_ptr<const Measurement> &m : measurements )
     {
-      for( const string &detname : change.detectors )
+      const auto measoldcal = m->energy_calibration();
+      assert( measoldcal );
+      
+      auto iter = old_to_new_cals.find( measoldcal );
+      if( iter == end(old_to_new_cals) )
       {
-        auto m = change.meas->measurement( sample, detname );
-        if( !m || m->num_gamma_channels() <= 4 )
-          continue;
-        
-        const auto measoldcal = m->energy_calibration();
-        assert( measoldcal );
-        
-        auto iter = old_to_new_cals.find( measoldcal );
-        if( iter == end(old_to_new_cals) )
-        {
-          //Shouldnt ever happen
-          string msg = "There was an internal error updating energy calibration - precomputed"
-          " calibration couldnt be found - energy calibration will not be fully updated";
+        //Shouldnt ever happen
+        string msg = "There was an internal error updating energy calibration - precomputed"
+        " calibration couldnt be found - energy calibration will not be fully updated";
 #if( PERFORM_DEVELOPER_CHECKS )
-          log_developer_error( __func__, msg.c_str() );
+        log_developer_error( __func__, msg.c_str() );
 #endif
-          
-          m_interspec->logMessage( msg, 3 );
-          assert( 0 );
-          continue;
-        }//if( we havent already computed a new energy cal )
         
-        assert( iter->second );
-        assert( iter->second->num_channels() == m->num_gamma_channels() );
-        
-        meas_old_new_cal.emplace_back( m, measoldcal, iter->second );
-        
-        change.meas->set_energy_calibration( iter->second, m );
-      }//for( loop over detector names )
-    }//for( loop over sample numbers )
+        m_interspec->logMessage( msg, 3 );
+        assert( 0 );
+        continue;
+      }//if( we havent already computed a new energy cal )
+      
+      assert( iter->second );
+      assert( iter->second->num_channels() == m->num_gamma_channels() );
+      
+      meas_old_new_cal.emplace_back( m, measoldcal, iter->second );
+      new_meas_cals.emplace_back( m, iter->second );
+    }//for( const shared_ptr<const Measurement> &m : measurements )
+    
+    change.meas->set_energy_calibrations( new_meas_cals );
     
     
     //Now actually set the updated peaks
@@ -3061,6 +3085,8 @@ void EnergyCalTool::setEnergyCal( shared_ptr<const SpecUtils::EnergyCalibration>
   
   // Now go through and actually set the energy calibrations; they should all be valid and computed,
   //  as should all the shifted peaks
+  vector<pair<shared_ptr<const Measurement>,shared_ptr<const EnergyCalibration>>> new_meas_cals;
+  
   for( const int sample : changemeas.sample_numbers )
   {
     meas_old_new_cal_t &meas_old_new_cal = undo_sentry.cal_info(changemeas.meas);
@@ -3094,9 +3120,11 @@ void EnergyCalTool::setEnergyCal( shared_ptr<const SpecUtils::EnergyCalibration>
         
       meas_old_new_cal.emplace_back( m, measoldcal, iter->second );
       
-      changemeas.meas->set_energy_calibration( iter->second, m );
+      new_meas_cals.emplace_back( m, iter->second );
     }//for( loop over detector names )
   }//for( loop over sample numbers )
+  
+  changemeas.meas->set_energy_calibrations( new_meas_cals );
     
     
   //Now actually set the updated peaks
@@ -3362,6 +3390,8 @@ void EnergyCalTool::addDeviationPair( const std::pair<float,float> &new_pair )
     assert( change.meas );
     meas_old_new_cal_t &meas_old_new_cal = undo_sentry.cal_info( change.meas );
     
+    vector<pair<shared_ptr<const Measurement>,shared_ptr<const EnergyCalibration>>> new_meas_cals;
+    
     for( const int sample : change.sample_numbers )
     {
       for( const string &detname : change.detectors )
@@ -3391,12 +3421,14 @@ void EnergyCalTool::addDeviationPair( const std::pair<float,float> &new_pair )
         assert( iter->second );
         assert( iter->second->num_channels() == m->num_gamma_channels() );
         
-        change.meas->set_energy_calibration( iter->second, m );
+        new_meas_cals.emplace_back( m, iter->second );
         
         meas_old_new_cal.emplace_back( m, measoldcal, iter->second );
       }//for( loop over detector names )
     }//for( loop over sample numbers )
     
+    change.meas->set_energy_calibrations( new_meas_cals );
+    
     
     //Now actually set the updated peaks
     const set<set<int>> peaksamples = change.meas->sampleNumsWithPeaks();
@@ -3785,6 +3817,8 @@ void EnergyCalTool::userChangedDeviationPair( EnergyCalImp::CalDisplay *display,
   meas_old_new_peaks_t &meas_old_new_peaks = undo_sentry.peak_info(forgrnd);
   meas_old_new_peaks_t &meas_old_new_hint_peaks = undo_sentry.hint_peak_info(forgrnd);
   
+  vector<pair<shared_ptr<const Measurement>,shared_ptr<const EnergyCalibration>>> new_meas_cals;
+  
   for( auto &m : specfile->measurements() )
   {
     // I'm a little torn if we should update just the one energy calibration, or all occurances of
@@ -3810,10 +3844,12 @@ void EnergyCalTool::userChangedDeviationPair( EnergyCalImp::CalDisplay *display,
     
     meas_old_new_cal.emplace_back( m, cal, calpos->second );
     
-    specfile->set_energy_calibration( calpos->second, m );
+    new_meas_cals.emplace_back( m, calpos->second );
     ++num_updated;
   }//for( loop over measurements )
   
+  specfile->set_energy_calibrations( new_meas_cals );
+  
   if( num_updated == 0 )
   {
     display->updateToGui( old_cal );
@@ -68,6 +68,7 @@
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/SimpleDialog.h"
+#include "InterSpec/RebinMapping.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/ExportSpecFile.h"
@@ -2447,6 +2448,23 @@ std::shared_ptr<const SpecMeas> ExportSpecFileTool::generateFileToSave()
   const bool sumDetectorsPerSample = (sum_per_sample && !sum_per_det && ((max_records >= samples.size()) && (detectors.size() > 1)));
   const bool sumSamplesPerDetector = (sum_per_det && !sum_per_sample && ((max_records >= detectors.size()) && (samples.size() > 1)));
   
+  // If every sample and detector is selected, and nothing is to be summed, subtracted, or
+  //  stripped of GPS, the output is just the input file; in this case we can avoid making a deep
+  //  copy of every record (which for hour-long search-mode files can be hundreds of MB, and
+  //  takes longer than writing the file out).  The writers already strip InterSpec specific
+  //  information, if wanted, when serializing.
+  const bool any_transform = (remove_gps || backgroundSub || sumAll || fore_plus_back_files
+                              || foreToSingleRecord || backToSingleRecord || secoToSingleRecord
+                              || sumDetectorsPerSample || sumSamplesPerDetector
+                              || (max_records <= 2));
+  if( !any_transform && (samples == start_spec->sample_numbers()) )
+  {
+    const vector<string> &all_dets = start_spec->detector_names();
+    const set<string> wanted_dets( begin(detectors), end(detectors) );
+    if( wanted_dets == set<string>( begin(all_dets), end(all_dets) ) )
+      return start_spec;
+  }//if( no changes need to be made to the file )
+  
   
   shared_ptr<SpecMeas> answer = make_shared<SpecMeas>();
   answer->uniqueCopyContents( *start_spec );
@@ -2625,8 +2643,8 @@ std::shared_ptr<const SpecMeas> ExportSpecFileTool::generateFileToSave()
                && (*background->energy_calibration()) != (*foreground->energy_calibration()) )
             {
               auto new_backchan = make_shared<vector<float>>( fore_counts->size(), 0.0f );
-              SpecUtils::rebin_by_lower_edge( *background->channel_energies(), *back_counts,
-                                             *foreground->channel_energies(), *new_backchan );
+              RebinMapping::rebin( background->energy_calibration(), *back_counts,
+                                   foreground->energy_calibration(), *new_backchan );
               back_counts = new_backchan;
             }
             
@@ -27,6 +27,7 @@
 #pragma warning(disable:4996)
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -93,8 +94,11 @@ Wt::Signal<std::string,std::string > &FileDragUploadResource::fileDrop() //<disp
 void FileDragUploadResource::handleRequest( const Http::Request& request,
                                             Http::Response& response )
 {
-// TODO: It's assuming handleRequest(...) is only called once all the data is uploaded; this needs
-//       to be verified.
+// Note: Wt only calls handleRequest(...) once the entire request body has been received (progress
+//       while the upload is in-flight is only available as byte-counts, via WResource::dataReceived(),
+//       see SpecMeasManager::handleDataRecievedStatus(...)), so we can not start parsing the
+//       spectrum file until the upload is complete; what we can do is get the data into the spool
+//       file and handed off to the (off-session-thread) parsing as quickly as possible.
   
 // TODO: Currently the client side JS FileUploadFcn(...) function just puts file contents inside the
 //  the POST body, so it doesnt look like files, for all the handling we do here.
@@ -212,8 +216,36 @@ void FileDragUploadResource::handleRequest( const Http::Request& request,
     
     if( spool_file.is_open() )
     {
-      spool_file << request.in().rdbuf();
+      // Copy the request body over in large blocks, making sure the full body actually made it to
+      //  disk - otherwise (e.g., if the disk is full) we would end up trying to parse a truncated
+      //  file, which for large list-mode or PCF files can take a while before failing.
+      int64_t num_written = 0;
+      {
+        std::istream &body = request.in();
+        std::vector<char> buffer( 1024*1024 );
+        while( body.good() && spool_file.good() )
+        {
+          body.read( buffer.data(), static_cast<streamsize>(buffer.size()) );
+          const streamsize nread = body.gcount();
+          if( nread <= 0 )
+            break;
+          spool_file.write( buffer.data(), nread );
+          num_written += nread;
+        }//while( body.good() && spool_file.good() )
+      }
+      
+      const bool wrote_ok = spool_file.good();
       spool_file.close();
+      
+      if( !wrote_ok || ((datalen > 0) && (num_written < datalen)) )
+      {
+        SpecUtils::remove_file( temp_name );
+        
+        response.setStatus( 500 );  //Internal Server error
+        output << "Failed to write uploaded file to temporary file on server.";
+        return;
+      }//if( we didnt get the whole file to disk )
+      
       const string userNameEncoded = request.headerValue( "X-File-Name" );
       const string userName = Wt::Utils::urlDecode(userNameEncoded);
       
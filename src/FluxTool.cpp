@@ -58,6 +58,8 @@
 #include "InterSpec/AppUtils.h"
 #include "InterSpec/FluxTool.h"
 #include "InterSpec/DrfSelect.h"
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/DetectorPeakResponse.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/AuxWindow.h"
 #include "InterSpec/PeakModel.h"
@@ -352,6 +354,26 @@ namespace FluxToolImp
     
     void handleFluxToolWidgetUpdated()
     {
+      const vector<bool> &changed = m_fluxtool->m_rowChanged;
+      const size_t nrows = m_fluxtool->m_data.size();
+      
+      // If only the values of some rows changed, and this doesnt change the sort order, we'll
+      //  just let the view know which rows to re-render.
+      if( nrows && (changed.size() == nrows) && (m_sort_indices.size() == nrows) )
+      {
+        const vector<size_t> new_indices = sortedIndices();
+        if( new_indices == m_sort_indices )
+        {
+          const int ncols = columnCount();
+          for( size_t row = 0; row < nrows; ++row )
+          {
+            if( changed[m_sort_indices[row]] )
+              dataChanged().emit( index(static_cast<int>(row), 0), index(static_cast<int>(row), ncols - 1) );
+          }
+          return;
+        }//if( sort order didnt change )
+      }//if( same number of rows )
+      
       if( !m_sort_indices.empty() )
       {
         beginRemoveRows( WModelIndex(), 0, static_cast<int>(m_sort_indices.size() - 1) );
@@ -453,17 +475,24 @@ namespace FluxToolImp
       return WAbstractItemModel::createIndex(row, column, nullptr);
     }
     
-    void doSortWork()
+    vector<size_t> sortedIndices() const
     {
       assert( m_fluxtool->m_data.size() == m_fluxtool->m_nucNames.size() );
       
-      m_sort_indices.resize( m_fluxtool->m_data.size() );
+      vector<size_t> indices( m_fluxtool->m_data.size() );
       
-      for( size_t i = 0; i < m_sort_indices.size(); ++i )
-        m_sort_indices[i] = i;
+      for( size_t i = 0; i < indices.size(); ++i )
+        indices[i] = i;
       
-      std::stable_sort( m_sort_indices.begin(), m_sort_indices.end(),
+      std::stable_sort( indices.begin(), indices.end(),
                        index_compare_sort( m_fluxtool->m_data, m_fluxtool->m_nucNames, m_sortColumn, m_sortOrder) );
+      
+      return indices;
+    }//vector<size_t> sortedIndices() const
+    
+    void doSortWork()
+    {
+      m_sort_indices = sortedIndices();
     }//void doSortWork()
     
     virtual void sort( int column, Wt::SortOrder order = Wt::AscendingOrder )
@@ -1250,13 +1279,111 @@ void FluxToolWidget::setTableNeedsUpdating()
 }//void setTableNeedsUpdating()
 
 
+std::vector<FluxToolImp::FluxRow> FluxToolImp::compute_fluxes( const std::vector<PeakDef> &peaks,
+                                                               const DetectorPeakResponse &det,
+                                                               const double distance,
+                                                               const float live_time )
+{
+  if( !det.isValid() )
+    throw runtime_error( "Invalid detector response function." );
+  
+  if( live_time <= 0.0f )
+    throw runtime_error( "Invalid live-time." );
+  
+  const size_t npeaks = peaks.size();
+  const bool fixed_geom = det.isFixedGeometry();
+  const double geomEff = fixed_geom ? 1.0 : det.fractionalSolidAngle( det.detectorDiameter(), distance );
+  
+  vector<float> energies( npeaks );
+  for( size_t i = 0; i < npeaks; ++i )
+    energies[i] = static_cast<float>( peaks[i].mean() );
+  
+  const vector<float> intrinsic_effs = det.intrinsicEfficiencies( energies );
+  assert( intrinsic_effs.size() == npeaks );
+  
+  vector<FluxRow> rows( npeaks );
+  
+  for( size_t i = 0; i < npeaks; ++i )
+  {
+    FluxRow &row = rows[i];
+    row.data.fill( 0.0 );
+    row.uncertainties.fill( 0.0 );
+    
+    const PeakDef &peak = peaks[i];
+    
+    const double energy = peak.mean();
+    
+    const double amp = peak.peakArea();  //ToDO: make sure this works for non-Gaussian peaks
+    const double ampUncert = peak.peakAreaUncert();
+    const double cps = amp / live_time;
+    const double cpsUncert = ampUncert / live_time;
+    const double intrinsic = intrinsic_effs[i];
+    const double totaleff = fixed_geom ? intrinsic : (geomEff * intrinsic);
+    
+    
+    if( peak.parentNuclide() )
+      row.nuclide = peak.parentNuclide()->symbol;
+    else if( peak.xrayElement() )
+      row.nuclide = peak.xrayElement()->symbol;
+    else if( peak.reaction() )
+      row.nuclide = peak.reaction()->name();
+    
+    row.data[FluxToolWidget::FluxEnergyCol] = energy;
+    row.data[FluxToolWidget::FluxPeakCpsCol] = cps;
+    row.uncertainties[FluxToolWidget::FluxPeakCpsCol] = cpsUncert;
+    
+    row.data[FluxToolWidget::FluxGeometricEffCol] = geomEff;
+    row.data[FluxToolWidget::FluxIntrinsicEffCol] = intrinsic;
+    
+    // TODO: Check if there is an uncertainty on DRF, and if so include that.
+    
+    if( totaleff <= 0.0 || intrinsic <= 0.0 )
+    {
+      row.data[FluxToolWidget::FluxFluxOnDetCol]      = std::numeric_limits<double>::infinity();
+      row.data[FluxToolWidget::FluxFluxPerCm2PerSCol] = std::numeric_limits<double>::infinity();
+      row.data[FluxToolWidget::FluxGammasInto4PiCol]  = std::numeric_limits<double>::infinity();
+    }else
+    {
+      const double fluxOnDet = cps / intrinsic;
+      const double fluxOnDetUncert = cpsUncert / intrinsic;
+      
+      //gammas into 4pi
+      const double gammaInto4pi = cps / totaleff;
+      const double gammaInto4piUncert = cpsUncert / totaleff;
+      
+      //Flux in g/cm2/s
+      const double distance_cm = distance / PhysicalUnits::cm;
+      const double flux = gammaInto4pi / (4*M_PI*distance_cm*distance_cm);
+      const double fluxUncert = gammaInto4piUncert / (4*M_PI*distance_cm*distance_cm);
+      
+      
+      row.data[FluxToolWidget::FluxFluxOnDetCol] = fluxOnDet;
+      row.uncertainties[FluxToolWidget::FluxFluxOnDetCol] = fluxOnDetUncert;
+      
+      row.data[FluxToolWidget::FluxFluxPerCm2PerSCol] = flux;
+      row.uncertainties[FluxToolWidget::FluxFluxPerCm2PerSCol] = fluxUncert;
+      
+      row.data[FluxToolWidget::FluxGammasInto4PiCol] = gammaInto4pi;
+      row.uncertainties[FluxToolWidget::FluxGammasInto4PiCol] = gammaInto4piUncert;
+    }//if( eff > 0 ) / else
+  }//for( size_t i = 0; i < npeaks; ++i )
+  
+  return rows;
+}//std::vector<FluxRow> compute_fluxes(...)
+
+
 void FluxToolWidget::refreshPeakTable()
 {
   PeakModel *peakmodel = m_interspec->peakModel();
   
+  const vector<string> prev_nuc_names = std::move( m_nucNames );
+  const vector<array<double,FluxColumns::FluxNumColumns>> prev_data = std::move( m_data );
+  const vector<array<double,FluxColumns::FluxNumColumns>> prev_uncerts = std::move( m_uncertainties );
+  
   m_nucNames.clear();
   m_data.clear();
   m_uncertainties.clear();
+  m_rowChanged.clear();
   
   m_msg->setText( "" );
   
@@ -1297,77 +1424,42 @@ void FluxToolWidget::refreshPeakTable()
   
   const vector<PeakDef> peaks = peakmodel->peakVec();
   
-  const size_t npeaks = peaks.size();
+  vector<FluxToolImp::FluxRow> rows;
+  try
+  {
+    rows = FluxToolImp::compute_fluxes( peaks, *det, distance, live_time );
+  }catch( std::exception &e )
+  {
+    m_msg->setText( WString::fromUTF8( e.what() ) );
+    m_rowChanged.clear();
+    m_tableUpdated.emit();
+    return;
+  }//try / catch
+  
+  const size_t npeaks = rows.size();
+  
+  // If the number of peaks didnt change (e.g., a peak was re-fit, or distance changed), keep track
+  //  of which rows actually changed, so the table only needs to update those.
+  const bool same_num_rows = (npeaks == prev_data.size()) && (npeaks == prev_nuc_names.size());
+  m_rowChanged.clear();
+  if( same_num_rows )
+    m_rowChanged.resize( npeaks, false );
+  
   m_nucNames.resize( npeaks );
   m_data.resize( npeaks );
   m_uncertainties.resize( npeaks );
   
-  const bool fixed_geom = det->isFixedGeometry();
-
-  for( int i = 0; i < static_cast<int>(npeaks); ++i )
+  for( size_t i = 0; i < npeaks; ++i )
   {
-    m_data[i].fill( 0.0 );
-    m_uncertainties[i].fill( 0.0 );
-    
-    const PeakDef &peak = peaks[i];
-    
-    const double energy = peak.mean();
-    
-    const double amp = peak.peakArea();  //ToDO: make sure this works for non-Gaussian peaks
-    const double ampUncert = peak.peakAreaUncert();
-    const double cps = amp / live_time;
-    const double cpsUncert = ampUncert / live_time;
-    const double intrinsic = det->intrinsicEfficiency(energy);
-    const double geomEff = fixed_geom ? 1.0 : det->fractionalSolidAngle( det->detectorDiameter(), distance );
-    const double totaleff = fixed_geom ? intrinsic : det->efficiency(energy, distance );
-    
+    m_nucNames[i] = rows[i].nuclide;
+    m_data[i] = rows[i].data;
+    m_uncertainties[i] = rows[i].uncertainties;
     
-    if( peak.parentNuclide() )
-      m_nucNames[i] = peak.parentNuclide()->symbol;
-    else if( peak.xrayElement() )
-      m_nucNames[i] = peak.xrayElement()->symbol;
-    else if( peak.reaction() )
-      m_nucNames[i] = peak.reaction()->name();
-    
-    m_data[i][FluxColumns::FluxEnergyCol] = energy;
-    m_data[i][FluxColumns::FluxPeakCpsCol] = cps;
-    m_uncertainties[i][FluxColumns::FluxPeakCpsCol] = cpsUncert;
-    
-    m_data[i][FluxColumns::FluxGeometricEffCol] = geomEff;
-    m_data[i][FluxColumns::FluxIntrinsicEffCol] = intrinsic;
-    
-    // TODO: Check if there is an uncertainty on DRF, and if so include that.
-    
-    if( totaleff <= 0.0 || intrinsic <= 0.0 )
-    {
-      m_data[i][FluxColumns::FluxFluxOnDetCol]      = std::numeric_limits<double>::infinity();
-      m_data[i][FluxColumns::FluxFluxPerCm2PerSCol] = std::numeric_limits<double>::infinity();
-      m_data[i][FluxColumns::FluxGammasInto4PiCol]  = std::numeric_limits<double>::infinity();
-    }else
-    {
-      const double fluxOnDet = cps / intrinsic;
-      const double fluxOnDetUncert = cpsUncert / intrinsic;
-      
-      //gammas into 4pi
-      const double gammaInto4pi = cps / totaleff;
-      const double gammaInto4piUncert = cpsUncert / totaleff;
-      
-      //Flux in g/cm2/s
-      const double distance_cm = distance / PhysicalUnits::cm;
-      const double flux = gammaInto4pi / (4*M_PI*distance_cm*distance_cm);
-      const double fluxUncert = gammaInto4piUncert / (4*M_PI*distance_cm*distance_cm);
-      
-      
-      m_data[i][FluxColumns::FluxFluxOnDetCol] = fluxOnDet;
-      m_uncertainties[i][FluxColumns::FluxFluxOnDetCol] = fluxOnDetUncert;
-      
-      m_data[i][FluxColumns::FluxFluxPerCm2PerSCol] = flux;
-      m_uncertainties[i][FluxColumns::FluxFluxPerCm2PerSCol] = fluxUncert;
-      
-      m_data[i][FluxColumns::FluxGammasInto4PiCol] = gammaInto4pi;
-      m_uncertainties[i][FluxColumns::FluxGammasInto4PiCol] = gammaInto4piUncert;
-    }//if( eff > 0 ) / else
-  }//for( const PeakDef &peak : peaks )
+    if( same_num_rows )
+      m_rowChanged[i] = ((m_data[i] != prev_data[i])
+                         || (m_uncertainties[i] != prev_uncerts[i])
+                         || (m_nucNames[i] != prev_nuc_names[i]));
+  }//for( size_t i = 0; i < npeaks; ++i )
   
 #if( FLUX_USE_COPY_TO_CLIPBOARD )
   stringstream pastebrdtxt;
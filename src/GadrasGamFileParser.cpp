@@ -26,15 +26,66 @@
 #include <string>
 #include <vector>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
 #include <iomanip>
+#include <streambuf>
 #include <stdexcept>
 
+#if( !defined(_WIN32) )
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "SpecUtils/ParseUtils.h"
 #include "SpecUtils/StringAlgo.h"
 #include "InterSpec/GadrasGamFileParser.h"
 
 using namespace std;
 
+namespace
+{
+  /** A read-only streambuf over a range of memory, so records of a #GadrasGamLibrary can be parsed by
+   #GadrasGamFile::parse_data without copying them.
+   */
+  struct MemoryRangeBuf : public std::streambuf
+  {
+    MemoryRangeBuf( const char *begin, const char *end )
+    {
+      char * const b = const_cast<char *>( begin );
+      setg( b, b, b + (end - begin) );
+    }
+  };//struct MemoryRangeBuf
+  
+  
+  /** Returns true if `line` is the first line of a .gam record. */
+  bool is_gam_record_start( const char *line, const size_t len )
+  {
+    if( (len >= 14) && (memcmp( line, "GamFileVersion", 14 ) == 0) )
+      return true;
+    
+    // Version 1 files start with "0 0", e.x., "0 0 ! NewFormat, ModelGeometry"; but make sure to not
+    //  match the counts line of a source with no photon lines or groups, e.x., "0 0 46 ! photon lines, ..."
+    const char * const comment = "photon lines";
+    if( std::search( line, line + len, comment, comment + strlen(comment) ) != (line + len) )
+      return false;
+    
+    size_t pos = 0;
+    while( (pos < len) && ((line[pos] == ' ') || (line[pos] == '\t')) )
+      ++pos;
+    if( (pos + 2 >= len) || (line[pos] != '0') || ((line[pos+1] != ' ') && (line[pos+1] != '\t')) )
+      return false;
+    pos += 1;
+    while( (pos < len) && ((line[pos] == ' ') || (line[pos] == '\t')) )
+      ++pos;
+    return (pos < len) && (line[pos] == '0')
+           && (((pos + 1) == len) || (line[pos+1] == ' ') || (line[pos+1] == '\t') || (line[pos+1] == '\r'));
+  }//is_gam_record_start(...)
+}//namespace
+
 //std::istream& SpecUtils::safe_get_line(std::istream& is, std::string& t)
 
 GadrasGamFile::GadrasGamFile()
@@ -256,8 +307,6 @@ void GadrasGamFile::parse_data( std::istream &strm )
    0.767265975475311 ! k-eff
    4.29675034427086 ! multiplication
    */
-  
-  cerr << "photon_lines=" << photon_lines << ", photon_groups=" << photon_groups << ", neutron_groups=" << neutron_groups << endl;
 }//void parse_data( std::istream &strm )
 
 
@@ -367,3 +416,173 @@ void GadrasGamFile::write_gam( std::ostream &output, const GadrasGamFile::GamFil
   output << "2.2 ! multiplication" << endline;
   output << endline;
 }//void write_gam( std::ofstream &output, const GamFileVersion version )
+
+
+GadrasGamLibrary::GadrasGamLibrary( const std::string &filename )
+  : m_data( nullptr ),
+    m_size( 0 ),
+    m_buffer(),
+    m_mapped( false ),
+    m_records()
+{
+#if( defined(_WIN32) )
+  ifstream input( filename.c_str(), ios_base::binary | ios_base::in | ios_base::ate );
+  if( !input.is_open() )
+    throw runtime_error( "GadrasGamLibrary: couldnt open " + filename );
+  
+  const std::streamoff filesize = input.tellg();
+  m_buffer.resize( static_cast<size_t>(filesize) );
+  input.seekg( 0, ios::beg );
+  if( filesize && !input.read( m_buffer.data(), filesize ) )
+    throw runtime_error( "GadrasGamLibrary: error reading " + filename );
+  
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+#else
+  const int fd = ::open( filename.c_str(), O_RDONLY );
+  if( fd < 0 )
+    throw runtime_error( "GadrasGamLibrary: couldnt open " + filename );
+  
+  struct stat statbuf;
+  if( (fstat( fd, &statbuf ) != 0) || (statbuf.st_size <= 0) )
+  {
+    ::close( fd );
+    throw runtime_error( "GadrasGamLibrary: invalid size of " + filename );
+  }
+  
+  m_size = static_cast<size_t>( statbuf.st_size );
+  void *mapping = mmap( nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );  //The mapping stays valid after closing the file descriptor
+  
+  if( mapping == MAP_FAILED )
+    throw runtime_error( "GadrasGamLibrary: failed to memory-map " + filename );
+  
+  m_data = static_cast<const char *>( mapping );
+  m_mapped = true;
+#endif
+  
+  try
+  {
+    build_index();
+  }catch( std::exception & )
+  {
+#if( !defined(_WIN32) )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+    m_mapped = false;
+    throw;
+  }
+}//GadrasGamLibrary( filename )
+
+
+GadrasGamLibrary::GadrasGamLibrary( std::vector<char> &&contents )
+  : m_data( nullptr ),
+    m_size( 0 ),
+    m_buffer( std::move(contents) ),
+    m_mapped( false ),
+    m_records()
+{
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+  build_index();
+}//GadrasGamLibrary( contents )
+
+
+GadrasGamLibrary::~GadrasGamLibrary()
+{
+#if( !defined(_WIN32) )
+  if( m_mapped && m_data )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+}//~GadrasGamLibrary()
+
+
+void GadrasGamLibrary::build_index()
+{
+  m_records.clear();
+  
+  const char * const data_end = m_data + m_size;
+  const char *line = m_data;
+  
+  while( line < data_end )
+  {
+    const char *line_end = static_cast<const char *>( memchr( line, '\n', data_end - line ) );
+    if( !line_end )
+      line_end = data_end;
+    
+    size_t len = line_end - line;
+    if( len && (line[len-1] == '\r') )
+      --len;
+    
+    if( is_gam_record_start( line, len ) )
+    {
+      if( !m_records.empty() )
+        m_records.back().m_end = line - m_data;
+      
+      RecordInfo info;
+      info.m_begin = line - m_data;
+      info.m_end = m_size;
+      info.m_version = GadrasGamFile::GamFileVersion::Version_1;
+      
+      if( line[0] == 'G' )
+      {
+        const string header( line, len );
+        if( header.find( "2.1" ) != string::npos )
+          info.m_version = GadrasGamFile::GamFileVersion::Version_2_1;
+        else if( header.find( "2.0" ) != string::npos )
+          info.m_version = GadrasGamFile::GamFileVersion::Version_2_0;
+        else
+          info.m_version = GadrasGamFile::GamFileVersion::NumGamFileVersions;
+        
+        // The description is within the next few header lines
+        const char *header_line = (line_end < data_end) ? (line_end + 1) : data_end;
+        for( int i = 0; (i < 4) && (header_line < data_end); ++i )
+        {
+          const char *header_end = static_cast<const char *>( memchr( header_line, '\n', data_end - header_line ) );
+          if( !header_end )
+            header_end = data_end;
+          
+          string value( header_line, header_end );
+          if( SpecUtils::starts_with( value, "Description " ) )
+          {
+            const size_t eq_pos = value.find( '=' );
+            value = (eq_pos == string::npos) ? string() : value.substr( eq_pos + 1 );
+            SpecUtils::trim( value );
+            info.m_description = value;
+            break;
+          }
+          header_line = (header_end < data_end) ? (header_end + 1) : data_end;
+        }//for( look for description )
+      }//if( GamFileVersion header )
+      
+      m_records.push_back( info );
+    }//if( is_gam_record_start( line, len ) )
+    
+    line = line_end + 1;
+  }//while( line < data_end )
+  
+  if( m_records.empty() )
+    throw runtime_error( "GadrasGamLibrary: no .gam records found" );
+}//void build_index()
+
+
+const std::vector<GadrasGamLibrary::RecordInfo> &GadrasGamLibrary::records() const
+{
+  return m_records;
+}
+
+
+GadrasGamFile GadrasGamLibrary::record( const size_t index ) const
+{
+  if( index >= m_records.size() )
+    throw runtime_error( "GadrasGamLibrary: invalid record index" );
+  
+  const RecordInfo &info = m_records[index];
+  MemoryRangeBuf buf( m_data + info.m_begin, m_data + info.m_end );
+  std::istream strm( &buf );
+  
+  GadrasGamFile gam;
+  gam.parse_data( strm );
+  
+  return gam;
+}//GadrasGamFile record( const size_t index ) const
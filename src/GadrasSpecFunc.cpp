@@ -23,7 +23,10 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <cmath>
+#include <mutex>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <fstream>
@@ -133,6 +136,21 @@ GadrasScatterTable::~GadrasScatterTable()
 }
 
 
+std::shared_ptr<const GadrasScatterTable> GadrasScatterTable::instance( const std::string &datafile )
+{
+  static std::mutex s_mutex;
+  static std::map<std::string,std::shared_ptr<const GadrasScatterTable>> s_tables;
+  
+  std::lock_guard<std::mutex> lock( s_mutex );
+  
+  shared_ptr<const GadrasScatterTable> &table = s_tables[datafile];
+  if( !table )
+    table = make_shared<const GadrasScatterTable>( datafile );
+  
+  return table;
+}//instance( const std::string &datafile )
+
+
 float GadrasScatterTable::getContinuum( std::vector<float> &answer,
                                        const float sourceEnergy,
                                        const float sourceIntensity,
@@ -141,14 +159,93 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
                                        const float fracHydrogen,
                                        const std::vector<float> &output_binning ) const
 {
-  const float energyMesh[sm_num_input_energy] = { 60.0f, 87.0f, 89.0f, 115.0f, 116.0f, 121.0f, 122.0f, 200.0f, 300.0f, 400.0f, 600.0f, 1000.0f, 1600.0f, 2600.0f, 4000.0f, 9000.0f };
-  const float anMesh[sm_num_atomic_number] = { 5.28f, 13.0f, 26.0f, 82.0f, 92.0f, 94.0f }; // J (PE,Al,Fe,Pb,U,Pu)
-  const float adMesh[sm_num_areal_density] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f, 128.0f, 256.0f };
-
   answer.resize( output_binning.size() );
   for( size_t i = 0; i < output_binning.size(); ++i )
     answer[i] = 0.0f;
   
+  float flux[32];
+  const float uncollided = scatteredFlux( flux, sourceEnergy, sourceIntensity,
+                                          atomicNumber, arealDensity, fracHydrogen );
+  
+  const float sc = sourceEnergy / 31.0f;
+  vector<float> orig_binning(32);
+  for (int l = 0; l < 32; ++l)
+    orig_binning[l] = sc*l;
+  
+  const vector<float> f( flux, flux + 32 );
+  SpecUtils::rebin_by_lower_edge( orig_binning, f, output_binning, answer );
+  
+  for( size_t i = 0; i < answer.size(); ++i)
+    answer[i] /= 3.7E10f;
+  
+  return uncollided;
+}//void getContinuum(...)
+
+
+void GadrasScatterTable::addContinuum( std::vector<double> &answer,
+                                       std::vector<float> &uncollided,
+                                       const std::vector<float> &sourceEnergies,
+                                       const std::vector<float> &sourceIntensities,
+                                       const float atomicNumber,
+                                       const float arealDensity,
+                                       const float fracHydrogen,
+                                       const std::vector<float> &output_binning ) const
+{
+  if( sourceEnergies.size() != sourceIntensities.size() )
+    throw runtime_error( "GadrasScatterTable::addContinuum: energies and intensities must be same size." );
+  
+  if( answer.size() != output_binning.size() )
+    throw runtime_error( "GadrasScatterTable::addContinuum: answer must be same size as binning." );
+  
+  uncollided.resize( sourceEnergies.size() );
+  
+  // Buffers re-used for every line
+  float flux[32];
+  vector<float> f( 32 ), orig_binning( 32 ), out_binning, line_answer;
+  out_binning.reserve( output_binning.size() );
+  line_answer.reserve( output_binning.size() );
+  
+  for( size_t line = 0; line < sourceEnergies.size(); ++line )
+  {
+    const float sourceEnergy = sourceEnergies[line];
+    uncollided[line] = scatteredFlux( flux, sourceEnergy, sourceIntensities[line],
+                                      atomicNumber, arealDensity, fracHydrogen );
+    
+    const float sc = sourceEnergy / 31.0f;
+    for( int l = 0; l < 32; ++l )
+    {
+      orig_binning[l] = sc*l;
+      f[l] = flux[l];
+    }
+    
+    // The flux is zero above the upper edge of the last group, so only rebin onto output bins
+    //  that start below it, plus one more bin so the last of those has its real upper edge.
+    const float upper_energy = 32.0f*sc;
+    const size_t nabove = static_cast<size_t>( std::upper_bound( begin(output_binning), end(output_binning), upper_energy )
+                                               - begin(output_binning) );
+    const size_t nbin = std::min( output_binning.size(), std::max( nabove + 1, size_t(4) ) );
+    
+    out_binning.assign( begin(output_binning), begin(output_binning) + nbin );
+    line_answer.resize( nbin );
+    
+    SpecUtils::rebin_by_lower_edge( orig_binning, f, out_binning, line_answer );
+    
+    for( size_t i = 0; i < nbin; ++i )
+      answer[i] += line_answer[i] / 3.7E10f;
+  }//for( loop over lines )
+}//void addContinuum(...)
+
+
+float GadrasScatterTable::scatteredFlux( float (&f)[32],
+                                         const float sourceEnergy,
+                                         const float sourceIntensity,
+                                         const float atomicNumber,
+                                         const float arealDensity,
+                                         const float fracHydrogen ) const
+{
+  const float energyMesh[sm_num_input_energy] = { 60.0f, 87.0f, 89.0f, 115.0f, 116.0f, 121.0f, 122.0f, 200.0f, 300.0f, 400.0f, 600.0f, 1000.0f, 1600.0f, 2600.0f, 4000.0f, 9000.0f };
+  const float anMesh[sm_num_atomic_number] = { 5.28f, 13.0f, 26.0f, 82.0f, 92.0f, 94.0f }; // J (PE,Al,Fe,Pb,U,Pu)
+  const float adMesh[sm_num_areal_density] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f, 128.0f, 256.0f };
   
 //Greg T. C# translation used the following to find i
 //  int i = 6;
@@ -226,8 +323,9 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   const float rj = 1.0f - fj;
   const float rk = 1.0f - fk;
   
-  vector<float> f( 32 );
   // get the flux distribution by matrix interpolation.
+  //  Each of the table rows used is contiguous in memory, so these loops over the 32 output
+  //  groups are straightforward for the compiler to vectorize.
   if( k == -1 )
   {
     //No shielding
@@ -288,11 +386,11 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   }//if( frac_pe > 0.0f )
 
   
-  // rebin the flux to the proper energy group structure.
+  // the flux groups have lower energies of sc*l, for l = 0 to 31
   const float sc = sourceEnergy / 31.0f;
 //  double edge = sourceEnergy - sourceEnergy*(sourceEnergy/255.5)/(1 + sourceEnergy/255.5);
   
-  vector<float> orig_binning(32);
+  float orig_binning[32];
   for (int l = 0; l < 32; ++l)
     orig_binning[l] = sc*l;
   
@@ -341,7 +439,7 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   const float trans = TransmissionH( sourceEnergy, atomicNumber, arealDensity, fracHydrogen );
 
   float sumf = 0.0f;
-  for( size_t i = 0; i < f.size(); ++i)
+  for( size_t i = 0; i < 32; ++i)
   {
     f[i] *= sourceIntensity*trans;
     sumf += f[i];
@@ -365,10 +463,5 @@ float GadrasScatterTable::getContinuum( std::vector<float> &answer,
   //C	Attenuate the continuum for HPGe with thin dead layer.
   //
   
-  SpecUtils::rebin_by_lower_edge( orig_binning, f, output_binning, answer );
-  
-  for( size_t i = 0; i < answer.size(); ++i)
-    answer[i] /= 3.7E10f;
-  
   return trans * sourceIntensity;
-}//void getContinuum(...)
+}//float scatteredFlux(...)
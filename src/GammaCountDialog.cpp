@@ -47,6 +47,7 @@
 #include "InterSpec/AuxWindow.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/HelpSystem.h"
+#include "InterSpec/ChannelPrefixSum.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/SpectrumChart.h"
 #include "InterSpec/UndoRedoManager.h"
@@ -536,8 +537,8 @@ void GammaCountDialog::setUnceraintyText( std::shared_ptr<const SpecUtils::Measu
     return;
   }//if( !foreground || !background )
   
-  const double nfore = gamma_integral( foreground, minEnergy, maxEnergy );
-  const double nback = gamma_integral( background, minEnergy, maxEnergy );
+  const double nfore = ChannelPrefixSum::gamma_integral( foreground, minEnergy, maxEnergy );
+  const double nback = ChannelPrefixSum::gamma_integral( background, minEnergy, maxEnergy );
   const double scaleback = nback * backSF;
   const double backsigma = sqrt(nback);
   const double forsigma = sqrt(nfore);
@@ -577,7 +578,7 @@ void GammaCountDialog::setGammaCountText( Wt::WText *text, std::shared_ptr<const
     return;
   }//if( !hist )
 
-  const double count = scale_factor * gamma_integral( hist, minEnergy, maxEnergy );
+  const double count = scale_factor * ChannelPrefixSum::gamma_integral( hist, minEnergy, maxEnergy );
   
   char buffer[32];
   if( count > 1.0E5 )
@@ -26,9 +26,12 @@
 #include <set>
 #include <cmath>
 #include <string>
+#include <limits>
 #include <vector>
 #include <memory>
 #include <cctype>
+#include <list>
+#include <mutex>
 #include <istream>
 #include <fstream>
 #include <sstream>
@@ -65,6 +68,7 @@
 #include "SpecUtils/SpecUtilsAsync.h"
 
 #include "InterSpec/DrfSelect.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/Integrate.h"
 #include "InterSpec/MaterialDB.h"
@@ -187,6 +191,34 @@ double transmition_coefficient_material( const Material *material, float energy,
 }
 
 
+std::vector<double> transmition_length_coefficients( const Material *material,
+                                                     const std::vector<float> &energies )
+{
+  if( !material )
+    throw std::runtime_error( "transmition_length_coefficients(...): null material" );
+  
+  vector<pair<int,float>> densities;
+  densities.reserve( material->elements.size() + material->nuclides.size() );
+  
+  for( const Material::ElementFractionPair &p : material->elements )
+    densities.emplace_back( p.first->atomicNumber, static_cast<float>(p.second * material->density) );
+  
+  for( const Material::NuclideFractionPair &p : material->nuclides )
+    densities.emplace_back( p.first->atomicNumber, static_cast<float>(p.second * material->density) );
+  
+  for( const pair<int,float> &p : densities )
+  {
+    if( p.first > MassAttenuation::sm_max_xs_atomic_number )
+      throw std::runtime_error( "transmition_length_coefficients(...): invalid atomic number" );
+  }
+  
+  const shared_ptr<const vector<float>> mus
+                 = MassAttenuation::massAttenuationCoeficients( densities, energies );
+  
+  return vector<double>( begin(*mus), end(*mus) );
+}//std::vector<double> transmition_length_coefficients(...)
+
+
 double transmission_length_coefficient_air( float energy )
 {
   double mu = 0.0;
@@ -241,114 +273,229 @@ double transmition_coefficient_generic( float atomic_number, float areal_density
 }
   
   
-vector<SandiaDecay::EnergyRatePair> decay_during_meas_corrected_gammas(
+namespace
+{
+  /** Key of (parent nuclide, initial age, measurement duration) for the decay-during-measurement cache. */
+  typedef std::tuple<const SandiaDecay::Nuclide *,double,double> DecayCorrGammasKey;
+  
+  /** The maximum number of entries in the decay-during-measurement cache. */
+  const size_t sm_decay_corr_cache_max_size = 1024;
+  
+  /** Protects #s_decay_corr_cache and #s_decay_corr_cache_index. */
+  std::mutex s_decay_corr_cache_mutex;
+  
+  /** Least-recently-used cache of decay-during-measurement corrected gammas, normalized to unit
+   initial parent activity; most recently used entries at the front.
+   */
+  std::list<std::pair<DecayCorrGammasKey,vector<SandiaDecay::EnergyRatePair>>> s_decay_corr_cache;
+  std::map<DecayCorrGammasKey,decltype(s_decay_corr_cache)::iterator> s_decay_corr_cache_index;
+  
+  
+  /** Computes the average gamma rates during the measurement by numerically integrating, with the
+   midpoint rule, over at least 50 time slices.
+   
+   Only used if #analytic_decay_corrected_gammas fails.
+   */
+  vector<SandiaDecay::EnergyRatePair> numeric_decay_corrected_gammas(
                                                       const SandiaDecay::NuclideMixture &mixture,
                                                       const double age,
                                                       const double measDuration )
-{
+  {
+    // We want to get the activity at the beginning of the measurement, but we want
+    //  to account for decay (or build up!) throughout the measurement; rather than
+    //  being intelligent about it, we'll just average throughout the dwell time
+    //
+    // TODO: figure out how many time slices are needed for reasonable accuracy.
+    //       A first quick go at this, for In110 (hl=4.9h), over a 2.8 hour measurement,
+    //       gave corrections of
+    //            For 250: 0.826922  (which matches analytical answer of 0.826922)
+    //            For 50:  0.82692
+    //            For 25:  0.826913
+    //            For 10:  0.826869
+    //
+    //  A spot check using Mn56 (hl=9283.8s), and a meas duration of 86423.86s, with 50 timeslices
+    //    gives a correction factor of 0.15473519892011101, vs analytical answer of 0.1547364350135815
+  
+    const size_t characteristic_time_slices = 50; // Maybe at least ~5 sig figs
+  
+    const SandiaDecay::Nuclide *nuclide = mixture.initialNuclide(0);
+    assert( nuclide );
   
-  // This section of code takes up a good amount of CPU time, and is really begging for optimizations
-  //
-  // TODO: if nuclide decays to stable children, then just use standard formula to correct for decay (see below developer check for this)
-  //
-  // We want to get the activity at the beginning of the measurement, but we want
-  //  to account for decay (or build up!) throughout the measurement; rather than
-  //  being intelligent about it, we'll just average throughout the dwell time
-  //
-  // TODO: figure out how many time slices are needed for reasonable accuracy.
-  //       A first quick go at this, for In110 (hl=4.9h), over a 2.8 hour measurement,
-  //       gave corrections of
-  //            For 250: 0.826922  (which matches analytical answer of 0.826922)
-  //            For 50:  0.82692
-  //            For 25:  0.826913
-  //            For 10:  0.826869
-  //
-  //  A spot check using Mn56 (hl=9283.8s), and a meas duration of 86423.86s, with 50 timeslices
-  //    gives a correction factor of 0.15473519892011101, vs analytical answer of 0.1547364350135815
+    // TODO: the parent half-life may not be the relevant one; should check down the chain
+    const double halflife = std::max( nuclide->halfLife, 0.01*PhysicalUnits::second );
+    const double characteristicTime = std::min( measDuration, halflife );
+    const double dt = characteristicTime / characteristic_time_slices;
   
-  const size_t characteristic_time_slices = 50; // Maybe at least ~5 sig figs
+    const int num_time_slices = std::max( 50, static_cast<int>( std::ceil( measDuration / dt ) ) );
+    const int nthread = SpecUtilsAsync::num_logical_cpu_cores();
+
   
-  if( mixture.numInitialNuclides() != 1 )
-    throw runtime_error( "ShieldingSourceChi2Fcn::decayCorrectedGammas():"
-                        " passed in mixture must have exactly one parent nuclide" );
-  const SandiaDecay::Nuclide *nuclide = mixture.initialNuclide(0);
-  assert( nuclide );
-  if( !nuclide )
-    throw std::logic_error( "decayCorrectedGammas: nullptr nuc" );
+    vector<SandiaDecay::EnergyRatePair> gammas
+                               = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
   
+    assert( std::is_sorted(begin(gammas), end(gammas),
+           []( const SandiaDecay::EnergyRatePair &lhs, const SandiaDecay::EnergyRatePair &rhs ){
+      return lhs.energy < rhs.energy;
+    }) );
   
-  // TODO: the parent half-life may not be the relevant one; should check down the chain
-  const double halflife = std::max( nuclide->halfLife, 0.01*PhysicalUnits::second );
-  const double characteristicTime = std::min( measDuration, halflife );
-  const double dt = characteristicTime / characteristic_time_slices;
+    vector<vector<SandiaDecay::EnergyRatePair>> energy_rate_pairs( nthread,
+                                                                  vector<SandiaDecay::EnergyRatePair>(gammas.size(), {0.0,0.0}) );
   
-  const int num_time_slices = std::max( 50, static_cast<int>( std::ceil( measDuration / dt ) ) );
-  const int nthread = SpecUtilsAsync::num_logical_cpu_cores();
-
   
-  vector<SandiaDecay::EnergyRatePair> gammas
-                             = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
+    SharedThreadPool::TaskGroup pool;
   
-  assert( std::is_sorted(begin(gammas), end(gammas),
-         []( const SandiaDecay::EnergyRatePair &lhs, const SandiaDecay::EnergyRatePair &rhs ){
-    return lhs.energy < rhs.energy;
-  }) );
+    for( int threadnum = 0; threadnum < nthread; ++threadnum )
+    {
+      pool.post( [threadnum, nthread, &energy_rate_pairs, num_time_slices, measDuration, age, &mixture](){
+      
+        vector<SandiaDecay::EnergyRatePair> &result = energy_rate_pairs[threadnum];
+      
+        // TODO: right now using simple midpoint integration; should boost::math::quadrature::trapezoidal, or boost::math::quadrature::gauss::integrate, or something, but then evaluating things becomes a little tricky (I think we need to decay to the set number of points beforehand, and then make a function to retireve these inside the boost integration routine
+        for( int timeslice = threadnum; timeslice < num_time_slices; timeslice += nthread )
+        {
+          const double this_age = age + measDuration*(2.0*timeslice + 1.0)/(2.0*num_time_slices);
+          vector<SandiaDecay::EnergyRatePair> these_gammas
+          = mixture.photons( this_age, SandiaDecay::NuclideMixture::OrderByEnergy );
+        
+          assert( these_gammas.size() == result.size() );
+          if( these_gammas.size() != result.size() )
+            throw std::logic_error( "gamma result size doesnt match expected." );
+        
+          for( size_t i = 0; i < these_gammas.size(); ++i )
+            result[i].numPerSecond += these_gammas[i].numPerSecond;
+        }//for( loop over timeslices )
+      
+        for( size_t i = 0; i < result.size(); ++i )
+          result[i].numPerSecond /= num_time_slices;
+      } );
+    }//for( int threadnum = 0; threadnum < nthread; ++threadnum )
   
-  vector<vector<SandiaDecay::EnergyRatePair>> energy_rate_pairs( nthread,
-                                                                vector<SandiaDecay::EnergyRatePair>(gammas.size(), {0.0,0.0}) );
+    pool.join();
   
+    vector<SandiaDecay::EnergyRatePair> corrected_gammas = gammas;
+    for( size_t i = 0; i < corrected_gammas.size(); ++i )
+    {
+      corrected_gammas[i].numPerSecond = 0.0;
+      for( size_t threadnum = 0; threadnum < nthread; ++threadnum )
+      {
+        assert( corrected_gammas.size() == energy_rate_pairs[threadnum].size() );
+        corrected_gammas[i].numPerSecond += energy_rate_pairs[threadnum][i].numPerSecond;
+      }
+    }//for( size_t i = 0; i < corrected_gammas.size(); ++i )
+  
+    return corrected_gammas;
+  }//numeric_decay_corrected_gammas(...)
   
-  SpecUtilsAsync::ThreadPool pool;
   
-  for( int threadnum = 0; threadnum < nthread; ++threadnum )
+  /** Computes the average gamma rates during the measurement by analytically integrating the
+   Bateman solution: the number of atoms of each nuclide in the decay chain is a sum of exponentials,
+   N(t) = sum_k c_k*exp(-a_k*t), so its average over [age, age + duration] is
+   sum_k c_k*exp(-a_k*age)*(1 - exp(-a_k*duration))/(a_k*duration).
+   The gamma rates are linear in the activities of the nuclides in the chain, so we then sum the
+   gammas of each nuclide at its average activity.
+   
+   Returns false if the gammas of each nuclide could not be matched up to the gammas of the mixture.
+   */
+  bool analytic_decay_corrected_gammas( const SandiaDecay::NuclideMixture &mixture,
+                                        const double age,
+                                        const double measDuration,
+                                        vector<SandiaDecay::EnergyRatePair> &corrected_gammas )
   {
-    pool.post( [threadnum, nthread, &energy_rate_pairs, num_time_slices, measDuration, age, &mixture](){
+    corrected_gammas = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
+    for( SandiaDecay::EnergyRatePair &gamma : corrected_gammas )
+      gamma.numPerSecond = 0.0;
+    
+    const auto energy_less = []( const SandiaDecay::EnergyRatePair &lhs, const double energy ){
+      return lhs.energy < energy;
+    };
+    
+    const vector<SandiaDecay::NuclideTimeEvolution> &evolutions = mixture.decayedToNuclidesEvolutions();
+    for( const SandiaDecay::NuclideTimeEvolution &evo : evolutions )
+    {
+      if( !evo.nuclide || IsInf(evo.nuclide->halfLife) || (evo.nuclide->halfLife <= 0.0) )
+        continue;
+      
+      double avrg_atoms = 0.0;
+      for( const SandiaDecay::TimeEvolutionTerm &term : evo.evolutionTerms )
+      {
+        const double x = term.exponentialCoeff * measDuration;
+        const double frac = (fabs(x) < 1.0E-9) ? (1.0 - 0.5*x) : (-std::expm1(-x) / x);
+        avrg_atoms += term.termCoeff * exp( -term.exponentialCoeff * age ) * frac;
+      }//for( loop over Bateman terms )
       
-      vector<SandiaDecay::EnergyRatePair> &result = energy_rate_pairs[threadnum];
+      const double avrg_activity = avrg_atoms * evo.nuclide->decayConstant();
+      if( !(avrg_activity > 0.0) || IsInf(avrg_activity) )
+        continue;
       
-      // TODO: right now using simple midpoint integration; should boost::math::quadrature::trapezoidal, or boost::math::quadrature::gauss::integrate, or something, but then evaluating things becomes a little tricky (I think we need to decay to the set number of points beforehand, and then make a function to retireve these inside the boost integration routine
-      for( int timeslice = threadnum; timeslice < num_time_slices; timeslice += nthread )
+      // At time zero, none of the descendants have built up, so these are just the gammas of
+      //  this nuclide (for 1 Bq, so we'll scale them by `avrg_activity`).
+      const DecayedPhotonCache::PhotonsPtr nuc_gammas
+                   = DecayedPhotonCache::photons( evo.nuclide, 0.0, DecayedPhotonCache::Emissions::Photons,
+                                                  SandiaDecay::NuclideMixture::OrderByEnergy );
+      for( SandiaDecay::EnergyRatePair gamma : *nuc_gammas )
       {
-        const double this_age = age + measDuration*(2.0*timeslice + 1.0)/(2.0*num_time_slices);
-        vector<SandiaDecay::EnergyRatePair> these_gammas
-        = mixture.photons( this_age, SandiaDecay::NuclideMixture::OrderByEnergy );
+        gamma.numPerSecond *= avrg_activity;
+        if( gamma.numPerSecond <= 0.0 )
+          continue;
         
-        assert( these_gammas.size() == result.size() );
-        if( these_gammas.size() != result.size() )
-          throw std::logic_error( "gamma result size doesnt match expected." );
+        const auto pos = std::lower_bound( begin(corrected_gammas), end(corrected_gammas),
+                                           gamma.energy, energy_less );
+        if( (pos == end(corrected_gammas)) || (pos->energy != gamma.energy) )
+          return false;
         
-        for( size_t i = 0; i < these_gammas.size(); ++i )
-          result[i].numPerSecond += these_gammas[i].numPerSecond;
-      }//for( loop over timeslices )
-      
-      for( size_t i = 0; i < result.size(); ++i )
-        result[i].numPerSecond /= num_time_slices;
-    } );
-  }//for( int threadnum = 0; threadnum < nthread; ++threadnum )
+        pos->numPerSecond += gamma.numPerSecond;
+      }//for( const SandiaDecay::EnergyRatePair &gamma : nuc_gammas )
+    }//for( const SandiaDecay::NuclideTimeEvolution &evo : evolutions )
+    
+    return true;
+  }//bool analytic_decay_corrected_gammas(...)
+}//namespace
+
+
+vector<SandiaDecay::EnergyRatePair> decay_during_meas_corrected_gammas(
+                                                      const SandiaDecay::NuclideMixture &mixture,
+                                                      const double age,
+                                                      const double measDuration )
+{
+  if( mixture.numInitialNuclides() != 1 )
+    throw runtime_error( "ShieldingSourceChi2Fcn::decayCorrectedGammas():"
+                        " passed in mixture must have exactly one parent nuclide" );
+  const SandiaDecay::Nuclide *nuclide = mixture.initialNuclide(0);
+  assert( nuclide );
+  if( !nuclide )
+    throw std::logic_error( "decayCorrectedGammas: nullptr nuc" );
   
-  pool.join();
+  // This function is called a lot while fitting, usually with the same few ages, so we cache the
+  //  results normalized to the initial activity of the parent nuclide (the rates are linear in it).
+  const double initial_activity = mixture.activity( 0.0, nuclide );
+  const bool use_cache = ((initial_activity > 0.0) && !IsInf(initial_activity));
+  const DecayCorrGammasKey key{ nuclide, age, measDuration };
   
-  vector<SandiaDecay::EnergyRatePair> corrected_gammas = gammas;
-  for( size_t i = 0; i < corrected_gammas.size(); ++i )
+  if( use_cache )
   {
-    corrected_gammas[i].numPerSecond = 0.0;
-    for( size_t threadnum = 0; threadnum < nthread; ++threadnum )
+    std::lock_guard<std::mutex> lock( s_decay_corr_cache_mutex );
+    const auto pos = s_decay_corr_cache_index.find( key );
+    if( pos != end(s_decay_corr_cache_index) )
     {
-      assert( corrected_gammas.size() == energy_rate_pairs[threadnum].size() );
-      corrected_gammas[i].numPerSecond += energy_rate_pairs[threadnum][i].numPerSecond;
-    }
-  }//for( size_t i = 0; i < corrected_gammas.size(); ++i )
+      s_decay_corr_cache.splice( begin(s_decay_corr_cache), s_decay_corr_cache, pos->second );
+      
+      vector<SandiaDecay::EnergyRatePair> corrected_gammas = pos->second->second;
+      for( SandiaDecay::EnergyRatePair &gamma : corrected_gammas )
+        gamma.numPerSecond *= initial_activity;
+      
+      return corrected_gammas;
+    }//if( we have this result cached )
+  }//if( use_cache )
   
-  //cout << "For " << nuclide->symbol << " the time corrections are:" << endl;
-  //for( size_t i = 0; i < corrected_gammas.size(); ++i )
-  //  cout << std::setw(15) << corrected_gammas[i].energy << ": "
-  //       << corrected_gammas[i].numPerSecond/gammas[i].numPerSecond
-  //       << " (" << corrected_gammas[i].numPerSecond << " vs orig "
-  //       << gammas[i].numPerSecond << ")" << endl;
+  vector<SandiaDecay::EnergyRatePair> corrected_gammas;
+  if( !analytic_decay_corrected_gammas( mixture, age, measDuration, corrected_gammas ) )
+    corrected_gammas = numeric_decay_corrected_gammas( mixture, age, measDuration );
   
 #if( PERFORM_DEVELOPER_CHECKS )
   if( nuclide->decaysToStableChildren() )
   {
+    const vector<SandiaDecay::EnergyRatePair> gammas
+                             = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
     const double lambda = nuclide->decayConstant();
     const double corr_factor = (1.0 - exp(-1.0*lambda*measDuration)) / (lambda * measDuration);
     
@@ -384,6 +531,26 @@ vector<SandiaDecay::EnergyRatePair> decay_during_meas_corrected_gammas(
     return lhs.energy < rhs.energy;
   }) );
   
+  if( use_cache )
+  {
+    vector<SandiaDecay::EnergyRatePair> normalized = corrected_gammas;
+    for( SandiaDecay::EnergyRatePair &gamma : normalized )
+      gamma.numPerSecond /= initial_activity;
+    
+    std::lock_guard<std::mutex> lock( s_decay_corr_cache_mutex );
+    if( s_decay_corr_cache_index.find( key ) == end(s_decay_corr_cache_index) )
+    {
+      s_decay_corr_cache.emplace_front( key, std::move(normalized) );
+      s_decay_corr_cache_index[key] = begin(s_decay_corr_cache);
+      
+      while( s_decay_corr_cache.size() > sm_decay_corr_cache_max_size )
+      {
+        s_decay_corr_cache_index.erase( s_decay_corr_cache.back().first );
+        s_decay_corr_cache.pop_back();
+      }
+    }//if( another thread didnt already add this result )
+  }//if( use_cache )
+  
   return corrected_gammas;
 }//decay_during_meas_corrected_gammas(...)
   
@@ -693,6 +860,53 @@ int DistributedSrcCalc_integrand_rectangular( const int *ndim, const double xx[]
 }//DistributedSrcCalc_integrand_rectangular(...)
 
 
+int DistributedSrcCalc_batch_integrand( const int *ndim, const double xx[], const int *ncomp,
+                                        double ff[], void *userdata, const int *nvec )
+{
+  const DistributedSrcCalc * const objToIntegrate = (DistributedSrcCalc *)userdata;
+  
+  assert( objToIntegrate );
+  assert( ndim && ncomp && nvec );
+  
+  const size_t npoints = static_cast<size_t>( *nvec );
+  const size_t xstride = static_cast<size_t>( *ndim );
+  const size_t fstride = static_cast<size_t>( *ncomp );
+  
+  switch( objToIntegrate->m_geometry )
+  {
+    case GeometryType::Spherical:
+      for( size_t i = 0; i < npoints; ++i )
+        objToIntegrate->eval_spherical( xx + i*xstride, ndim, ff + i*fstride, ncomp );
+      break;
+      
+    case GeometryType::CylinderEndOn:
+      if( objToIntegrate->m_dimensionsTransLenAndType.size() == 1 )
+      {
+        for( size_t i = 0; i < npoints; ++i )
+          objToIntegrate->eval_single_cyl_end_on( xx + i*xstride, ndim, ff + i*fstride, ncomp );
+        break;
+      }
+      // fall through to general cylinder case
+      
+    case GeometryType::CylinderSideOn:
+      for( size_t i = 0; i < npoints; ++i )
+        objToIntegrate->eval_cylinder( xx + i*xstride, ndim, ff + i*fstride, ncomp );
+      break;
+      
+    case GeometryType::Rectangular:
+      for( size_t i = 0; i < npoints; ++i )
+        objToIntegrate->eval_rect( xx + i*xstride, ndim, ff + i*fstride, ncomp );
+      break;
+      
+    case GeometryType::NumGeometryType:
+      assert( 0 );
+      return -999; //Cuba's ABORT value
+  }//switch( objToIntegrate->m_geometry )
+  
+  return 0;
+}//DistributedSrcCalc_batch_integrand(...)
+
+
 
 
 DistributedSrcCalc::DistributedSrcCalc()
@@ -706,8 +920,32 @@ DistributedSrcCalc::DistributedSrcCalc()
   m_isInSituExponential = false;
   m_inSituRelaxationLength = 0.0;
   m_nuclide = NULL;
+  integral = 0.0;
 }//DistributedSrcCalc()
 
+
+void DistributedSrcCalc::eval_extra_components( double ff[], const int ncomp,
+                                                const double *path_lengths,
+                                                const double geom_factor ) const noexcept
+{
+  const size_t stride = m_dimensionsTransLenAndType.size() + 1;
+  assert( ncomp >= 1 );
+  assert( m_componentTransLenCoefs.size() == (static_cast<size_t>(ncomp) - 1)*stride );
+  
+  // We compute all the exponents first, so the exp(...) loop can be vectorized by the compiler.
+  for( int comp = 1; comp < ncomp; ++comp )
+  {
+    const double * const coefs = &(m_componentTransLenCoefs[(comp - 1)*stride]);
+    double trans = 0.0;
+    for( size_t i = 0; i < stride; ++i )
+      trans += coefs[i] * path_lengths[i];
+    ff[comp] = -trans;
+  }//for( int comp = 1; comp < ncomp; ++comp )
+  
+  for( int comp = 1; comp < ncomp; ++comp )
+    ff[comp] = geom_factor * exp( ff[comp] );
+}//void eval_extra_components(...)
+
   
   
 double point_to_line_dist( const double point[3],
@@ -746,6 +984,7 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
   const double pi = PhysicalUnits::pi;
   
   const int ndim = (ndimptr ? (*ndimptr) : 3);
+  const int ncomp = (ncompptr ? (*ncompptr) : 1);
 
   const double source_inner_rad = ((m_sourceIndex>0)
                             ? std::get<0>(m_dimensionsTransLenAndType[m_sourceIndex-1])[0]
@@ -785,6 +1024,10 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
 
   double trans = 0.0;
   
+  // When integrating multiple energies at once (i.e., ncomp > 1), we track the path length through
+  //  each layer, and then air as the last entry, to compute the other components from.
+  vector<double> path_lengths( (ncomp > 1) ? (m_dimensionsTransLenAndType.size() + 1) : size_t(0), 0.0 );
+  
   {//begin code-block to compute distance through source
     // - this could probably be cleaned up and made more efficient
     double exit_point[3];
@@ -843,6 +1086,8 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
         srcDist2 += diff*diff;
       }//for( int i = 0; i < 3; ++i )
       trans += (srcTransCoef * sqrt(srcDist2));
+      if( !path_lengths.empty() )
+        path_lengths[m_sourceIndex] += sqrt(srcDist2);
      
       //find inner most sphere the ray passes through
       size_t start_index = 0;
@@ -881,12 +1126,16 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
               dist = 2.0*dist;
             
             trans += (transCoef * dist);
+            if( !path_lengths.empty() )
+              path_lengths[index] += dist;
             break;
           }//case ShellType::Material:
             
           case ShellType::Generic:
           {
             trans += transCoef;
+            if( !path_lengths.empty() )
+              path_lengths[index] += 1.0;
             
             // Make sure this is a zero dimension shell
             assert( !index || (dims == std::get<0>(m_dimensionsTransLenAndType[index-1])) );
@@ -900,6 +1149,8 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
     {
       memcpy( source_point, exit_point, 3*sizeof(double) );
       trans += (srcTransCoef * dist_in_src);
+      if( !path_lengths.empty() )
+        path_lengths[m_sourceIndex] += dist_in_src;
     }//if( line actually goes into child sphere ) / else
   }//end codeblock to compute distance through source
   
@@ -918,6 +1169,8 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
         const double dist_in_sphere = exit_point_of_sphere_z( source_point,
                                                              source_point, sphereRad, m_observationDist );
         trans += (transLenCoef * dist_in_sphere);
+        if( !path_lengths.empty() )
+          path_lengths[i] += dist_in_sphere;
         
         break;
       }//case ShellType::Material:
@@ -925,6 +1178,8 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
       case ShellType::Generic:
       {
         trans += transLenCoef;
+        if( !path_lengths.empty() )
+          path_lengths[i] += 1.0;
         
         // Make sure this is a zero dimension shell
         assert( !i || (dims == std::get<0>(m_dimensionsTransLenAndType[i-1])) );
@@ -933,9 +1188,7 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
     }//switch( type )
   }//for( size_t i = 0; i < m_dimensionsTransLenAndType.size(); ++i )
 
-  trans = exp( -trans );
-  
-  
+  double air_dist = 0.0;
   if( m_attenuateForAir )
   {
     // source_point is the exit point on the last of the shielding, and the detector is at
@@ -944,15 +1197,18 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
     const double dy = -source_point[1];
     const double dz = source_point[2] - m_observationDist;
     
-    const double air_dist = sqrt( dx*dx + dy*dy + dz*dz );
+    air_dist = sqrt( dx*dx + dy*dy + dz*dz );
     
-    trans *= exp( -m_airTransLenCoef * air_dist );
+    trans += m_airTransLenCoef * air_dist;
   }//if( m_attenuateForAir )
   
+  // The energy-independent part of the integrand
+  double geom_factor = dV;
+  
   if( m_isInSituExponential )
   {
     assert( m_inSituRelaxationLength > 0.0 );
-    trans *= exp( -(source_outer_rad - r) / m_inSituRelaxationLength );
+    geom_factor *= exp( -(source_outer_rad - r) / m_inSituRelaxationLength );
   }
   
   const double z_dist = (z - m_observationDist);
@@ -960,9 +1216,15 @@ void DistributedSrcCalc::eval_spherical( const double xx[], const int *ndimptr,
   
   // Note: previous to 20211104 m_observationDist was used instead of dist_to_det; I believe this
   //       change is an appropriate correction, but still needs to be validated/ensured.
-  trans *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, dist_to_det );
+  geom_factor *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, dist_to_det );
 
-  ff[0] = trans * dV;
+  ff[0] = geom_factor * exp( -trans );
+  
+  if( ncomp > 1 )
+  {
+    path_lengths.back() = air_dist;
+    eval_extra_components( ff, ncomp, path_lengths.data(), geom_factor );
+  }
 }//eval_spherical(...)
 
 
@@ -984,6 +1246,7 @@ void DistributedSrcCalc::eval_single_cyl_end_on( const double xx[], const int *n
   
   // This just integrates a right circular cylinder
   const int ndim = (ndimptr ? (*ndimptr) : 2);
+  const int ncomp = (ncompptr ? (*ncompptr) : 1);
   assert( ndim == 2 ); // ndim==3 is also valid and this function will work for that as well
   
   
@@ -1026,6 +1289,7 @@ void DistributedSrcCalc::eval_single_cyl_end_on( const double xx[], const int *n
 
   double exit_radius = 0.0;
   double trans = 0.0;
+  double dist_in_src = 0.0;
   
   {//begin code-block to compute distance through source
     // Take advantage of theta symmetry here
@@ -1033,44 +1297,52 @@ void DistributedSrcCalc::eval_single_cyl_end_on( const double xx[], const int *n
     const double r_dist_in_src = r * z_dist_in_src / eval_z_dist_to_det;
     exit_radius = r - r_dist_in_src;
     
-    const double dist_in_src = sqrt(z_dist_in_src*z_dist_in_src + r_dist_in_src*r_dist_in_src);
+    dist_in_src = sqrt(z_dist_in_src*z_dist_in_src + r_dist_in_src*r_dist_in_src);
     
     trans += (trans_len_coef * dist_in_src);
   }//end codeblock to compute distance through source
 
-  trans = exp( -trans );
-  
+  double air_dist = 0.0;
   if( m_attenuateForAir )
   {
     const double dz = m_observationDist - source_half_z;
     
-    const double air_dist = sqrt( exit_radius*exit_radius + dz*dz );
+    air_dist = sqrt( exit_radius*exit_radius + dz*dz );
     
-    trans *= exp( -m_airTransLenCoef * air_dist );
+    trans += m_airTransLenCoef * air_dist;
   }//if( m_attenuateForAir )
   
+  // The energy-independent part of the integrand
+  double geom_factor = dV;
   
   if( m_isInSituExponential )
   {
     assert( m_inSituRelaxationLength > 0.0 );
-    trans *= exp( -(source_half_z - z) / m_inSituRelaxationLength );
+    geom_factor *= exp( -(source_half_z - z) / m_inSituRelaxationLength );
   }
   
   // Finally toss in the geometric factor (e.g., 1/r2 from where we are evaluating to to detector).
   const double eval_dist_to_det = sqrt( r*r + eval_z_dist_to_det*eval_z_dist_to_det );
-  trans *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, eval_dist_to_det );
+  geom_factor *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, eval_dist_to_det );
   
   
   // For debug builds, also check against the more general transport
 #ifndef NDEBUG
   double test_ff[1];
-  eval_cylinder( xx, ndimptr, test_ff, ncompptr );
-  const double this_answer = trans * dV;
+  const int test_ncomp = 1;
+  eval_cylinder( xx, ndimptr, test_ff, &test_ncomp );
+  const double this_answer = geom_factor * exp( -trans );
   assert( fabs(test_ff[0] - this_answer) < 1.0E-9*std::max(0.001,std::max( fabs(test_ff[0]), fabs(this_answer))) );
 #endif
 
   
-  ff[0] = trans * dV;
+  ff[0] = geom_factor * exp( -trans );
+  
+  if( ncomp > 1 )
+  {
+    const double lengths[2] = { dist_in_src, air_dist };
+    eval_extra_components( ff, ncomp, lengths, geom_factor );
+  }
 }//void eval_single_cyl_end_on(...)
 
 
@@ -1772,6 +2044,7 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
   
   // This just integrates a right circular cylinder
   const int ndim = (ndimptr ? (*ndimptr) : 3);
+  const int ncomp = (ncompptr ? (*ncompptr) : 1);
   assert( ((m_geometry == GeometryType::CylinderEndOn) && ((ndim == 2) || (ndim == 3)))
          || ((m_geometry == GeometryType::CylinderSideOn) && (ndim == 3)) );
   
@@ -1802,7 +2075,8 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
     
     if( (r < inner_rad) && (fabs(z) < inner_half_height) )
     {
-      ff[0] = 0.0;
+      for( int comp = 0; comp < ncomp; ++comp )
+        ff[comp] = 0.0;
       return;
     }
   }//if( m_sourceIndex > 0 )
@@ -1828,6 +2102,10 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
   
   double trans = 0.0;
   
+  // When integrating multiple energies at once (i.e., ncomp > 1), we track the path length through
+  //  each layer, and then air as the last entry, to compute the other components from.
+  vector<double> path_lengths( (ncomp > 1) ? (m_dimensionsTransLenAndType.size() + 1) : size_t(0), 0.0 );
+  
   // Do transport through inner cylinders, and also subtract off that distance through source
   //  cylinder
   double inner_distance = 0.0;
@@ -1890,10 +2168,14 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
     {
       case ShellType::Material:
         trans += (local_trans_len_coef * (local_distance - inner_distance));
+        if( !path_lengths.empty() )
+          path_lengths[i] += (local_distance - inner_distance);
         break;
         
       case ShellType::Generic:
         trans += local_trans_len_coef;
+        if( !path_lengths.empty() )
+          path_lengths[i] += 1.0;
         
         // Make sure zero thickness shell
         assert( !i || (local_dims == std::get<0>(m_dimensionsTransLenAndType[i-1])) );
@@ -1904,6 +2186,8 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
   }//for( size_t i = 0; i < m_sourceIndex; ++i )
   
   trans += (trans_len_coef * (dist_in_cyl - inner_distance));
+  if( !path_lengths.empty() )
+    path_lengths[m_sourceIndex] += (dist_in_cyl - inner_distance);
   
   // Do transport through outer cylinders
   for( size_t i = m_sourceIndex + 1; i < m_dimensionsTransLenAndType.size(); ++i )
@@ -1919,6 +2203,8 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
       case ShellType::Generic:
       {
         trans += shield_trans_len_coef;
+        if( !path_lengths.empty() )
+          path_lengths[i] += 1.0;
         
         // Make sure zero thickness shell
         assert( shield_dims == std::get<0>(m_dimensionsTransLenAndType[i-1]) );
@@ -1935,6 +2221,8 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
                                                                  CylExitDir::TowardDetector, outer_exit_point );
         
         trans += (shield_trans_len_coef * dist_in_shield);
+        if( !path_lengths.empty() )
+          path_lengths[i] += dist_in_shield;
         
         exit_point[0] = outer_exit_point[0];
         exit_point[1] = outer_exit_point[1];
@@ -1946,32 +2234,38 @@ void DistributedSrcCalc::eval_cylinder( const double xx[], const int *ndimptr,
   }//for( loop over outer shielding )
   
   
-  trans = exp( -trans );
-  
+  double air_dist = 0.0;
   if( m_attenuateForAir )
   {
-    const double dz = m_observationDist - source_half_z;
-    const double air_dist = distance( exit_point, detector_pos );
+    air_dist = distance( exit_point, detector_pos );
     
-    trans *= exp( -m_airTransLenCoef * air_dist );
+    trans += m_airTransLenCoef * air_dist;
   }//if( m_attenuateForAir )
   
+  // The energy-independent part of the integrand
+  double geom_factor = dV;
   
   if( m_isInSituExponential )
   {
     assert( m_inSituRelaxationLength > 0.0 );
     if( is_side_on )
-      trans *= exp( -(source_outer_rad - r) / m_inSituRelaxationLength );
+      geom_factor *= exp( -(source_outer_rad - r) / m_inSituRelaxationLength );
     else
-      trans *= exp( -(source_half_z - z) / m_inSituRelaxationLength );
+      geom_factor *= exp( -(source_half_z - z) / m_inSituRelaxationLength );
   }//if( m_isInSituExponential )
   
   
   // Finally toss in the geometric factor (e.g., 1/r2 from where we are evaluating to to detector).
   const double eval_dist_to_det = distance( eval_point, detector_pos );
-  trans *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, eval_dist_to_det );
+  geom_factor *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, eval_dist_to_det );
+  
+  ff[0] = geom_factor * exp( -trans );
   
-  ff[0] = trans * dV;
+  if( ncomp > 1 )
+  {
+    path_lengths.back() = air_dist;
+    eval_extra_components( ff, ncomp, path_lengths.data(), geom_factor );
+  }
 }//void eval_cylinder(...)
 
 #if( DEBUG_RAYTRACE_CALCS )
@@ -2527,6 +2821,7 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
   assert( std::get<2>(m_dimensionsTransLenAndType[m_sourceIndex]) == ShellType::Material );
   
   const int ndim = (ndimptr ? (*ndimptr) : 2);
+  const int ncomp = (ncompptr ? (*ncompptr) : 1);
   assert( ndim == 3 );
   
   const std::array<double,3> &dimensions = std::get<0>(m_dimensionsTransLenAndType[m_sourceIndex]);
@@ -2552,7 +2847,8 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
     const array<double,3> &dims = std::get<0>(m_dimensionsTransLenAndType[m_sourceIndex-1]);
     if( (fabs(eval_x) < dims[0]) && (fabs(eval_y) < dims[1]) && (fabs(eval_z) < dims[2]) )
     {
-      ff[0] = 0.0;
+      for( int comp = 0; comp < ncomp; ++comp )
+        ff[comp] = 0.0;
       return;
     }
   }//if( m_sourceIndex > 0 )
@@ -2569,6 +2865,10 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
   
   double trans = 0.0;
   
+  // When integrating multiple energies at once (i.e., ncomp > 1), we track the path length through
+  //  each layer, and then air as the last entry, to compute the other components from.
+  vector<double> path_lengths( (ncomp > 1) ? (m_dimensionsTransLenAndType.size() + 1) : size_t(0), 0.0 );
+  
   // Do transport through inner shielding's, and also subtract off that distance through source
   //  Note: integrating over a 4cmx4cmx4cm void takes 381 evaluations; making the inner 2x2x2cm
   //        portion an inner void, and integrating over the outer cube (with outer dimensions still
@@ -2593,6 +2893,8 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
         case ShellType::Generic:
         {
           trans += trans_len_coef_shield;
+          if( !path_lengths.empty() )
+            path_lengths[i] += 1.0;
           assert( !i || (dims == std::get<0>(m_dimensionsTransLenAndType[i-1])) );
           break;
         }//case ShellType::Generic:
@@ -2600,6 +2902,8 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
         case ShellType::Material:
         {
           trans += (trans_len_coef_shield * (dist - inner_rect_dist));
+          if( !path_lengths.empty() )
+            path_lengths[i] += (dist - inner_rect_dist);
           break;
         }//case ShellType::Material:
       }//switch( type )
@@ -2610,6 +2914,8 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
   
   
   trans += (trans_len_coef * (dist_in_src - inner_rect_dist));
+  if( !path_lengths.empty() )
+    path_lengths[m_sourceIndex] += (dist_in_src - inner_rect_dist);
   
   
   // Account for additional external shielding's
@@ -2624,6 +2930,8 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
       case ShellType::Generic:
       {
         trans += trans_len_coef_shield;
+        if( !path_lengths.empty() )
+          path_lengths[i] += 1.0;
         assert( outer_dims == std::get<0>(m_dimensionsTransLenAndType[i-1]) );
         break;
       }
@@ -2634,6 +2942,8 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
                                                               outer_dims[2], exit_point, detector_loc, exit_point );
         
         trans += (trans_len_coef_shield * dist_in_shield);
+        if( !path_lengths.empty() )
+          path_lengths[i] += dist_in_shield;
         break;
       }//case ShellType::Material:
     }//switch( type )
@@ -2642,28 +2952,283 @@ void DistributedSrcCalc::eval_rect( const double xx[], const int *ndimptr,
   }//for( loop over outer shieldings )
   
   
-  trans = exp( -trans );
-  
+  double air_dist = 0.0;
   if( m_attenuateForAir )
   {
-    const double air_dist = distance( exit_point, detector_loc ); 
-    trans *= exp( -m_airTransLenCoef * air_dist );
+    air_dist = distance( exit_point, detector_loc );
+    trans += m_airTransLenCoef * air_dist;
   }//if( m_attenuateForAir )
   
+  // The energy-independent part of the integrand
+  double geom_factor = dV;
   
   if( m_isInSituExponential )
   {
     assert( m_inSituRelaxationLength > 0.0 );
-    trans *= exp( -(half_depth - eval_z) / m_inSituRelaxationLength );
+    geom_factor *= exp( -(half_depth - eval_z) / m_inSituRelaxationLength );
   }
   
   const double eval_dist_to_det = distance(eval_loc, detector_loc);
-  trans *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, eval_dist_to_det );
+  geom_factor *= DetectorPeakResponse::fractionalSolidAngle( 2.0*m_detectorRadius, eval_dist_to_det );
+  
+  ff[0] = geom_factor * exp( -trans );
   
-  ff[0] = trans * dV;
+  if( ncomp > 1 )
+  {
+    path_lengths.back() = air_dist;
+    eval_extra_components( ff, ncomp, path_lengths.data(), geom_factor );
+  }
 }//void eval_rect(...)
 
 
+namespace
+{
+  /** Returns the number of dimensions the self-attenuation integral is performed over, for a geometry. */
+  int self_atten_integral_ndim( const GeometryType geom )
+  {
+    switch( geom )
+    {
+      case GeometryType::Spherical:
+      case GeometryType::CylinderEndOn:
+        return 2;
+        
+      case GeometryType::CylinderSideOn:
+      case GeometryType::Rectangular:
+        return 3;
+        
+      case GeometryType::NumGeometryType:
+        break;
+    }//switch( geom )
+    
+    throw runtime_error( "self_atten_integral_ndim: invalid geometry" );
+  }//int self_atten_integral_ndim( GeometryType )
+  
+  
+  /** Evaluates the integrand (single component) of `calc` at the unit hyper-cube coordinate `xx`. */
+  double eval_distributed_src( const DistributedSrcCalc &calc, const int ndim, const double xx[] )
+  {
+    const int ncomp = 1;
+    double ff = 0.0;
+    
+    switch( calc.m_geometry )
+    {
+      case GeometryType::Spherical:
+        calc.eval_spherical( xx, &ndim, &ff, &ncomp );
+        break;
+        
+      case GeometryType::CylinderEndOn:
+        if( calc.m_dimensionsTransLenAndType.size() == 1 )
+          calc.eval_single_cyl_end_on( xx, &ndim, &ff, &ncomp );
+        else
+          calc.eval_cylinder( xx, &ndim, &ff, &ncomp );
+        break;
+        
+      case GeometryType::CylinderSideOn:
+        calc.eval_cylinder( xx, &ndim, &ff, &ncomp );
+        break;
+        
+      case GeometryType::Rectangular:
+        calc.eval_rect( xx, &ndim, &ff, &ncomp );
+        break;
+        
+      case GeometryType::NumGeometryType:
+        assert( 0 );
+        break;
+    }//switch( calc.m_geometry )
+    
+    return ff;
+  }//double eval_distributed_src(...)
+  
+  
+  /** Fills `nodes` and `weights` with the `n` point Gauss-Legendre quadrature, mapped onto the interval [0,1]. */
+  void gauss_legendre_unit_interval( const size_t n, vector<double> &nodes, vector<double> &weights )
+  {
+    assert( n > 0 );
+    nodes.resize( n, 0.0 );
+    weights.resize( n, 0.0 );
+    
+    for( size_t i = 0; i < (n + 1)/2; ++i )
+    {
+      // Newton-Raphson on P_n(x), starting from the usual approximation of the i'th root
+      double x = cos( PhysicalUnits::pi * (i + 0.75) / (n + 0.5) );
+      double dpdx = 1.0;
+      
+      for( int iter = 0; iter < 100; ++iter )
+      {
+        double p_prev = 1.0, p = x;
+        for( size_t k = 2; k <= n; ++k )
+        {
+          const double p_next = ((2.0*k - 1.0)*x*p - (k - 1.0)*p_prev) / k;
+          p_prev = p;
+          p = p_next;
+        }
+        
+        dpdx = (n == 1) ? 1.0 : (n * (x*p - p_prev) / (x*x - 1.0));
+        const double dx = p / dpdx;
+        x -= dx;
+        
+        if( fabs(dx) < 1.0E-15 )
+          break;
+      }//for( Newton-Raphson iterations )
+      
+      const double w = 2.0 / ((1.0 - x*x) * dpdx * dpdx);
+      
+      nodes[i] = 0.5*(1.0 - x);
+      nodes[n - 1 - i] = 0.5*(1.0 + x);
+      weights[i] = weights[n - 1 - i] = 0.5*w;
+    }//for( size_t i = 0; i < (n + 1)/2; ++i )
+  }//void gauss_legendre_unit_interval(...)
+}//namespace
+
+
+DistributedSrcPathLengths::DistributedSrcPathLengths( const DistributedSrcCalc &calc, const size_t num_points )
+  : m_calc( calc ),
+    m_weights(),
+    m_path_lengths()
+{
+  const int ndim = self_atten_integral_ndim( calc.m_geometry );
+  const size_t num_layers = calc.m_dimensionsTransLenAndType.size();
+  const size_t stride = num_layers + 1;
+  
+  if( !num_points || !num_layers )
+    throw runtime_error( "DistributedSrcPathLengths: no integration points or layers" );
+  
+  vector<double> nodes, weights;
+  gauss_legendre_unit_interval( num_points, nodes, weights );
+  
+  size_t num_nodes = 1;
+  for( int i = 0; i < ndim; ++i )
+    num_nodes *= num_points;
+  
+  m_weights.resize( num_nodes, 0.0 );
+  m_path_lengths.resize( num_nodes * stride, 0.0 );
+  
+  // The path lengths are extracted from exp(-probe*L)/exp(0), so we want probe*L to be of order
+  //  unity for the best numerical accuracy.
+  double max_dim = 0.0;
+  for( const auto &layer : calc.m_dimensionsTransLenAndType )
+  {
+    const array<double,3> &dims = std::get<0>(layer);
+    max_dim = std::max( max_dim, *std::max_element( begin(dims), end(dims) ) );
+  }
+  
+  if( !(max_dim > 0.0) || !(calc.m_observationDist > 0.0) )
+    throw runtime_error( "DistributedSrcPathLengths: invalid dimensions" );
+  
+  const double layer_probe = 1.0 / max_dim;
+  const double air_probe = 1.0 / calc.m_observationDist;
+  
+  DistributedSrcCalc probe = calc;
+  probe.m_airTransLenCoef = 0.0;
+  for( auto &layer : probe.m_dimensionsTransLenAndType )
+    std::get<1>(layer) = 0.0;
+  
+  double xx[3] = { 0.5, 0.5, 0.5 };
+  for( size_t node = 0; node < num_nodes; ++node )
+  {
+    double w = 1.0;
+    size_t remainder = node;
+    for( int dim = 0; dim < ndim; ++dim )
+    {
+      const size_t index = remainder % num_points;
+      remainder /= num_points;
+      xx[dim] = nodes[index];
+      w *= weights[index];
+    }//for( int dim = 0; dim < ndim; ++dim )
+    
+    const double unattenuated = eval_distributed_src( probe, ndim, xx );
+    if( !(unattenuated > 0.0) || IsInf(unattenuated) )
+      continue;
+    
+    m_weights[node] = w * unattenuated;
+    double * const lengths = &(m_path_lengths[node*stride]);
+    
+    for( size_t layer = 0; layer < num_layers; ++layer )
+    {
+      double &coef = std::get<1>( probe.m_dimensionsTransLenAndType[layer] );
+      coef = layer_probe;
+      const double attenuated = eval_distributed_src( probe, ndim, xx );
+      coef = 0.0;
+      
+      if( attenuated > 0.0 )
+        lengths[layer] = std::max( 0.0, -log(attenuated / unattenuated) / layer_probe );
+    }//for( size_t layer = 0; layer < num_layers; ++layer )
+    
+    if( calc.m_attenuateForAir )
+    {
+      probe.m_airTransLenCoef = air_probe;
+      const double attenuated = eval_distributed_src( probe, ndim, xx );
+      probe.m_airTransLenCoef = 0.0;
+      
+      if( attenuated > 0.0 )
+        lengths[num_layers] = std::max( 0.0, -log(attenuated / unattenuated) / air_probe );
+    }//if( calc.m_attenuateForAir )
+  }//for( size_t node = 0; node < num_nodes; ++node )
+}//DistributedSrcPathLengths constructor
+
+
+bool DistributedSrcPathLengths::same_geometry( const DistributedSrcCalc &lhs, const DistributedSrcCalc &rhs )
+{
+  if( (lhs.m_geometry != rhs.m_geometry)
+     || (lhs.m_sourceIndex != rhs.m_sourceIndex)
+     || (lhs.m_detectorRadius != rhs.m_detectorRadius)
+     || (lhs.m_observationDist != rhs.m_observationDist)
+     || (lhs.m_attenuateForAir != rhs.m_attenuateForAir)
+     || (lhs.m_isInSituExponential != rhs.m_isInSituExponential)
+     || (lhs.m_isInSituExponential && (lhs.m_inSituRelaxationLength != rhs.m_inSituRelaxationLength))
+     || (lhs.m_dimensionsTransLenAndType.size() != rhs.m_dimensionsTransLenAndType.size()) )
+    return false;
+  
+  for( size_t i = 0; i < lhs.m_dimensionsTransLenAndType.size(); ++i )
+  {
+    const auto &lhs_layer = lhs.m_dimensionsTransLenAndType[i];
+    const auto &rhs_layer = rhs.m_dimensionsTransLenAndType[i];
+    if( (std::get<0>(lhs_layer) != std::get<0>(rhs_layer))
+       || (std::get<2>(lhs_layer) != std::get<2>(rhs_layer)) )
+      return false;
+  }//for( loop over layers )
+  
+  return true;
+}//bool same_geometry(...)
+
+
+bool DistributedSrcPathLengths::matches( const DistributedSrcCalc &calc ) const
+{
+  return same_geometry( m_calc, calc );
+}
+
+
+double DistributedSrcPathLengths::integrate( const DistributedSrcCalc &calc ) const
+{
+  assert( matches(calc) );
+  
+  const size_t num_layers = m_calc.m_dimensionsTransLenAndType.size();
+  const size_t stride = num_layers + 1;
+  
+  vector<double> coefs( stride, 0.0 );
+  for( size_t layer = 0; layer < num_layers; ++layer )
+    coefs[layer] = std::get<1>( calc.m_dimensionsTransLenAndType[layer] );
+  coefs[num_layers] = calc.m_attenuateForAir ? calc.m_airTransLenCoef : 0.0;
+  
+  double integral = 0.0;
+  for( size_t node = 0; node < m_weights.size(); ++node )
+  {
+    const double w = m_weights[node];
+    if( w == 0.0 )
+      continue;
+    
+    const double * const lengths = &(m_path_lengths[node*stride]);
+    double trans = 0.0;
+    for( size_t layer = 0; layer < stride; ++layer )
+      trans += coefs[layer] * lengths[layer];
+    
+    integral += w * exp( -trans );
+  }//for( size_t node = 0; node < m_weights.size(); ++node )
+  
+  return integral;
+}//double DistributedSrcPathLengths::integrate(...) const
+
+
 std::pair<std::shared_ptr<ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParameters> ShieldingSourceChi2Fcn::create(
                                 const double distance,
                                 const GeometryType geom,
@@ -2674,7 +3239,8 @@ std::pair<std::shared_ptr<ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParamete
                                 std::shared_ptr<const SpecUtils::Measurement> background,
                                 std::deque<std::shared_ptr<const PeakDef>> foreground_peaks,
                                 std::shared_ptr<const std::deque<std::shared_ptr<const PeakDef>>> background_peaks,
-                                const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options )
+                                const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options,
+                                std::shared_ptr<const FitContext> context )
 {
   using GammaInteractionCalc::ShieldingSourceChi2Fcn;
     
@@ -2708,7 +3274,7 @@ std::pair<std::shared_ptr<ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParamete
   
   shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> answer;
   answer.reset( new GammaInteractionCalc::ShieldingSourceChi2Fcn( distance, liveTime, realTime,
-                                                    peaks, detector, shieldings, geom, options ) );
+                                                    peaks, detector, shieldings, geom, options, context ) );
   
   //I think num_fit_params will end up same as inputPrams.VariableParameters()
   size_t num_fit_params = 0;
@@ -2973,7 +3539,8 @@ ShieldingSourceChi2Fcn::ShieldingSourceChi2Fcn(
                                  std::shared_ptr<const DetectorPeakResponse> detector,
                                  const std::vector<ShieldingSourceFitCalc::ShieldingInfo> &shieldings,
                                  const GeometryType geometry,
-                                 const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options )
+                                 const ShieldingSourceFitCalc::ShieldingSourceFitOptions &options,
+                                 std::shared_ptr<const FitContext> context )
   : ROOT::Minuit2::FCNBase(),
     m_cancel( CalcStatus::NotCanceled ),
     m_isFitting( false ),
@@ -3121,9 +3688,156 @@ ShieldingSourceChi2Fcn::ShieldingSourceChi2Fcn(
     //  gui doesnt currently allow this, I *think* the computation will work out fine, maybe.
     
   }//for( const TraceSourceInfo &info : traceSources )
+  
+  cache_attenuation_coefficients( context );
 }//ShieldingSourceChi2Fcn
 
 
+bool ShieldingSourceChi2Fcn::FitContext::matches( const std::vector<double> &sorted_energies,
+                                  const std::vector<std::shared_ptr<const Material>> &layer_materials,
+                                  const std::shared_ptr<const DetectorPeakResponse> &drf ) const
+{
+  return (detector == drf) && (materials == layer_materials) && (energies == sorted_energies);
+}//bool FitContext::matches(...)
+
+
+std::shared_ptr<const ShieldingSourceChi2Fcn::FitContext> ShieldingSourceChi2Fcn::createFitContext(
+                                  const std::vector<PeakDef> &peaks,
+                                  const std::vector<std::shared_ptr<const Material>> &materials,
+                                  std::shared_ptr<const DetectorPeakResponse> detector )
+{
+  // The energies we compute attenuations for are always the photopeak energies of the peaks, and
+  //  the material of non-generic shieldings does not change during a fit (only the thickness),
+  //  so we can compute the attenuation coefficients once, and then each evaluation only needs
+  //  to multiply by the thickness.
+  auto context = make_shared<FitContext>();
+  context->materials = materials;
+  context->detector = detector;
+  
+  vector<double> &energies = context->energies;
+  for( const pair<double,double> &energy_width : observedPeakEnergyWidths( peaks ) )
+    energies.push_back( energy_width.first );
+  
+  std::sort( begin(energies), end(energies) );
+  energies.erase( std::unique( begin(energies), end(energies) ), end(energies) );
+  
+  const size_t num_energies = energies.size();
+  
+  context->material_atten_coefs.resize( materials.size() * num_energies );
+  for( size_t material_index = 0; material_index < materials.size(); ++material_index )
+  {
+    const Material * const material = materials[material_index].get();
+    double * const coefs = context->material_atten_coefs.data() + material_index*num_energies;
+    
+    for( size_t i = 0; i < num_energies; ++i )
+    {
+      // Note: `transmition_length_coefficient` takes a float energy
+      const float energy = static_cast<float>( energies[i] );
+      coefs[i] = material ? transmition_length_coefficient( material, energy )
+                          : std::numeric_limits<double>::quiet_NaN();
+    }
+  }//for( loop over materials )
+  
+  context->air_atten_coefs.resize( num_energies );
+  for( size_t i = 0; i < num_energies; ++i )
+  {
+    const float energy = static_cast<float>( energies[i] );
+    context->air_atten_coefs[i] = transmission_length_coefficient_air( energy );
+  }
+  
+  if( detector && detector->isValid() )
+  {
+    context->detector_intrinsic_effs.resize( num_energies );
+    for( size_t i = 0; i < num_energies; ++i )
+      context->detector_intrinsic_effs[i] = detector->intrinsicEfficiency( static_cast<float>(energies[i]) );
+  }//if( detector && detector->isValid() )
+  
+  return context;
+}//createFitContext(...)
+
+
+void ShieldingSourceChi2Fcn::cache_attenuation_coefficients( shared_ptr<const FitContext> context )
+{
+  vector<shared_ptr<const Material>> materials;
+  for( const ShieldLayerInfo &layer : m_materials )
+    materials.push_back( layer.material );
+  
+  if( context )
+  {
+    vector<double> energies;
+    for( const pair<double,double> &energy_width : observedPeakEnergyWidths( m_peaks ) )
+      energies.push_back( energy_width.first );
+    std::sort( begin(energies), end(energies) );
+    energies.erase( std::unique( begin(energies), end(energies) ), end(energies) );
+    
+    if( !context->matches( energies, materials, m_detector ) )
+      context.reset();
+  }//if( context )
+  
+  m_context = context ? context : createFitContext( m_peaks, materials, m_detector );
+}//void cache_attenuation_coefficients( shared_ptr<const FitContext> context )
+
+
+shared_ptr<const ShieldingSourceChi2Fcn::FitContext> ShieldingSourceChi2Fcn::fitContext() const
+{
+  return m_context;
+}
+
+
+double ShieldingSourceChi2Fcn::material_attenuation_coef( const size_t material_index,
+                                                          const Material *material,
+                                                          const double energy ) const
+{
+  assert( material );
+  assert( m_context );
+  
+  const vector<double> &energies = m_context->energies;
+  const auto pos = std::lower_bound( begin(energies), end(energies), energy );
+  if( (pos != end(energies)) && ((*pos) == energy)
+     && (material_index < m_context->materials.size())
+     && (m_context->materials[material_index].get() == material) )
+  {
+    const size_t energy_index = pos - begin(energies);
+    const double coef = m_context->material_atten_coefs[material_index*energies.size() + energy_index];
+    assert( !IsNan(coef) );
+    return coef;
+  }
+  
+  return transmition_length_coefficient( material, static_cast<float>(energy) );
+}//double material_attenuation_coef(...)
+
+
+double ShieldingSourceChi2Fcn::air_attenuation_coef( const double energy ) const
+{
+  assert( m_context );
+  
+  const vector<double> &energies = m_context->energies;
+  const auto pos = std::lower_bound( begin(energies), end(energies), energy );
+  if( (pos != end(energies)) && ((*pos) == energy) )
+    return m_context->air_atten_coefs[pos - begin(energies)];
+  
+  return transmission_length_coefficient_air( static_cast<float>(energy) );
+}//double air_attenuation_coef( const double energy ) const
+
+
+double ShieldingSourceChi2Fcn::detector_intrinsic_eff( const double energy ) const
+{
+  assert( m_context );
+  assert( m_detector );
+  
+  const vector<double> &energies = m_context->energies;
+  const vector<double> &effs = m_context->detector_intrinsic_effs;
+  if( effs.size() == energies.size() )
+  {
+    const auto pos = std::lower_bound( begin(energies), end(energies), energy );
+    if( (pos != end(energies)) && ((*pos) == energy) )
+      return effs[pos - begin(energies)];
+  }
+  
+  return m_detector->intrinsicEfficiency( static_cast<float>(energy) );
+}//double detector_intrinsic_eff( const double energy ) const
+
+
 ShieldingSourceChi2Fcn::~ShieldingSourceChi2Fcn()
 {
   {//begin lock on m_zombieCheckTimerMutex
@@ -3161,6 +3875,12 @@ void ShieldingSourceChi2Fcn::cancelFitWithNoUpdate()
   
 
 
+void ShieldingSourceChi2Fcn::cancelFitWithTimeout()
+{
+  m_cancel = CalcStatus::Timeout;
+}
+
+
 void ShieldingSourceChi2Fcn::setGuiProgressUpdater( std::shared_ptr<GuiProgressUpdateInfo> updateInfo )
 {
   m_guiUpdateInfo = updateInfo;
@@ -3475,6 +4195,7 @@ ShieldingSourceChi2Fcn &ShieldingSourceChi2Fcn::operator=( const ShieldingSource
   m_materials = rhs.m_materials;
   m_nuclides = rhs.m_nuclides;
   m_options = rhs.m_options;
+  m_context = rhs.m_context;
   
   //m_isFitting
   //m_guiUpdateInfo
@@ -4907,7 +5628,7 @@ ShieldingSourceChi2Fcn::CancelException::CancelException( const ShieldingSourceC
 }
 
 
-double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
+void ShieldingSourceChi2Fcn::throwIfCancelled() const
 {
   const CalcStatus cancelCode = m_cancel.load();
   switch( cancelCode )
@@ -4922,6 +5643,22 @@ double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
       throw CancelException( cancelCode );
       break;
   }//switch( m_cancel.load() )
+}//void throwIfCancelled() const
+
+
+double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
+{
+  // The mixtures only depend on the nuclide, not this object, so a cache per thread can be shared
+  //  by all instances, and avoids the races of a shared mutable cache.
+  static thread_local NucMixtureCache tl_mixture_cache;
+  
+  return DoEval( x, tl_mixture_cache );
+}//double DoEval( const std::vector<double> &x ) const
+
+
+double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x, NucMixtureCache &workspace ) const
+{
+  throwIfCancelled();
 
   try
   {
@@ -4935,11 +5672,11 @@ double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
       }
     }//for( size_t i = 0; i < x.size(); ++i )
     
-    if( m_mixtureCache.size() > sm_maxMixtureCacheSize )
-      m_mixtureCache.clear();
+    if( workspace.size() > sm_maxMixtureCacheSize )
+      workspace.clear();
     
     const vector< tuple<double,double,double,Wt::WColor,double> > chi2s
-                                           = energy_chi_contributions( x, m_mixtureCache, nullptr );
+                                           = energy_chi_contributions( x, workspace, nullptr );
     double chi2 = 0.0;
     
     const size_t npoints = chi2s.size();
@@ -4955,12 +5692,16 @@ double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
     //cout << "}" << endl;
     
     return chi2;
+  }catch( CancelException & )
+  {
+    //A cancel from within energy_chi_contributions(...) needs to make it to the fitter
+    throw;
   }catch(...)
   {
   }
 
   return std::numeric_limits<double>::max();
-}//double DoEval( const std::vector<double> &x ) const
+}//double DoEval( const std::vector<double> &x, NucMixtureCache &workspace ) const
 
 
 namespace
@@ -5031,7 +5772,19 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
       non_decay_cor_gammas = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
   }else
   {
-    gammas = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
+    // This is evaluated for every source, on every chi2 evaluation while fitting, so use the
+    //  shared cache of decayed photons, scaled by the initial activity of the parent.
+    const double initial_activity = mixture.activity( 0.0, nuclide );
+    if( (age >= 0.0) && (initial_activity > 0.0) && !IsInf(initial_activity) && !IsInf(age) && !IsNan(age) )
+    {
+      gammas = *DecayedPhotonCache::photons( nuclide, age, DecayedPhotonCache::Emissions::Photons,
+                                             SandiaDecay::NuclideMixture::OrderByEnergy );
+      for( SandiaDecay::EnergyRatePair &gamma : gammas )
+        gamma.numPerSecond *= initial_activity;
+    }else
+    {
+      gammas = mixture.photons( age, SandiaDecay::NuclideMixture::OrderByEnergy );
+    }
   }//if( accountForDecayDuringMeas ) / else
   
   
@@ -5343,63 +6096,78 @@ void ShieldingSourceChi2Fcn::selfShieldingIntegration( DistributedSrcCalc &calcu
   const int mineval = 0; //the minimum number of integrand evaluations required.
   const int maxeval = 5000000; //the (approximate) maximum number of integrand evaluations allowed.
 
-  int nregions, neval, fail;
-  double error, prob;
+  int nregions = 0, neval = 0, fail = 0;
+  
+  // Each additional energy for this geometry is an additional component of the integrand
+  const size_t coefs_per_comp = calculator.m_dimensionsTransLenAndType.size() + 1;
+  assert( (calculator.m_componentTransLenCoefs.size() % coefs_per_comp) == 0 );
+  const int ncomp = 1 + static_cast<int>( calculator.m_componentTransLenCoefs.size() / coefs_per_comp );
+  
+  // If there are more energies than Cuba can integrate at once, integrate each energy by itself,
+  //  rather than have CuhreIntegrate throw and all the energies come out as zero.
+  if( ncomp > std::max( 1, Integrate::cuhre_max_components() ) )
+  {
+    const size_t num_layers = calculator.m_dimensionsTransLenAndType.size();
+    
+    DistributedSrcCalc single = calculator;
+    single.m_componentTransLenCoefs.clear();
+    single.m_componentIntegrals.clear();
+    
+    calculator.m_componentIntegrals.assign( ncomp - 1, 0.0 );
+    for( int comp = 1; comp < ncomp; ++comp )
+    {
+      const double * const coefs = &(calculator.m_componentTransLenCoefs[(comp - 1)*coefs_per_comp]);
+      for( size_t layer = 0; layer < num_layers; ++layer )
+        std::get<1>( single.m_dimensionsTransLenAndType[layer] ) = coefs[layer];
+      single.m_airTransLenCoef = coefs[num_layers];
+      
+      selfShieldingIntegration( single );
+      calculator.m_componentIntegrals[comp - 1] = single.integral;
+    }//for( int comp = 1; comp < ncomp; ++comp )
+    
+    // And finally the primary energy
+    single = calculator;
+    single.m_componentTransLenCoefs.clear();
+    single.m_componentIntegrals.clear();
+    selfShieldingIntegration( single );
+    calculator.integral = single.integral;
+    
+    return;
+  }//if( ncomp > Integrate::cuhre_max_components() )
+  
+  vector<double> integrals( ncomp, 0.0 ), errors( ncomp, 0.0 ), probs( ncomp, 0.0 );
 
   calculator.integral = 0.0;
+  calculator.m_componentIntegrals.clear();
 
   try
   {
     // For the moment, we know cylinders and rectange wont throw exception.
     // TODO: need to make it so DistributedSrcCalc::eval_spherical doesnt ever throw exception
     
-    switch( calculator.m_geometry )
-    {
-      case GeometryType::Spherical:
-        Integrate::CuhreIntegrate( ndim, DistributedSrcCalc_integrand_spherical, userdata, epsrel, epsabs,
-                                  Integrate::LastImportanceFcnt,
-                                  mineval, maxeval, nregions, neval,
-                                  fail, calculator.integral, error, prob );
-        break;
-        
-      case GeometryType::CylinderEndOn:
-        if( calculator.m_dimensionsTransLenAndType.size() == 1 )
-        {
-          // For a single end-on cylinder we can use the ever-so-slightly faster function
-          //  to evaluate this (debug builds will validate gives same answer as
-          //  DistributedSrcCalc::eval_cylinder)
-          
-          Integrate::CuhreIntegrate( ndim, DistributedSrcCalc_integrand_single_cyl_end_on, userdata, epsrel, epsabs,
-                                    Integrate::LastImportanceFcnt,
-                                    mineval, maxeval, nregions, neval,
-                                    fail, calculator.integral, error, prob );
-        }else
-        {
-          Integrate::CuhreIntegrate( ndim, DistributedSrcCalc_integrand_cylindrical, userdata, epsrel, epsabs,
-                                    Integrate::LastImportanceFcnt,
-                                    mineval, maxeval, nregions, neval,
-                                    fail, calculator.integral, error, prob );
-        }
-        break;
-        
-      case GeometryType::CylinderSideOn:
-        Integrate::CuhreIntegrate( ndim, DistributedSrcCalc_integrand_cylindrical, userdata, epsrel, epsabs,
-                                  Integrate::LastImportanceFcnt,
-                                  mineval, maxeval, nregions, neval,
-                                  fail, calculator.integral, error, prob );
-        break;
-        
-      case GeometryType::Rectangular:
-        Integrate::CuhreIntegrate( ndim, DistributedSrcCalc_integrand_rectangular, userdata, epsrel, epsabs,
-                                  Integrate::LastImportanceFcnt,
-                                  mineval, maxeval, nregions, neval,
-                                  fail, calculator.integral, error, prob );
-        break;
-        
-      case GeometryType::NumGeometryType:
-        assert( 0 );
-        break;
-    }//switch( objToIntegrate->m_geometry )
+    if( calculator.m_geometry == GeometryType::NumGeometryType )
+      throw runtime_error( "Invalid geometry" );
+    
+    // Cuhre evaluates all the points of its cubature rule for a region at once (65 for 2D, 127
+    //  for 3D), so with this batch size the integrand is called once per region.
+    const int nvec = 128;
+    
+    Integrate::CuhreIntegrate( ndim, ncomp, nvec, DistributedSrcCalc_batch_integrand, userdata,
+                              epsrel, epsabs,
+                              Integrate::LastImportanceFcnt,
+                              mineval, maxeval, nregions, neval,
+                              fail, integrals.data(), errors.data(), probs.data() );
+    
+    // Cuba sets `fail` positive if the requested accuracy was not reached within `maxeval`
+    //  evaluations, and negative for an error (e.g., invalid dimension, or the integrand aborted).
+    if( fail != 0 )
+      throw runtime_error( "Cuhre returned fail=" + std::to_string(fail) + " after "
+                           + std::to_string(neval) + " evaluations and "
+                           + std::to_string(nregions) + " regions, with integral "
+                           + std::to_string(integrals[0]) + " +- " + std::to_string(errors[0]) );
+    
+    calculator.integral = integrals[0];
+    calculator.m_componentIntegrals.assign( begin(integrals) + 1, end(integrals) );
   }catch( std::exception &e )
   {
 #if( PERFORM_DEVELOPER_CHECKS )
@@ -5435,12 +6203,9 @@ void ShieldingSourceChi2Fcn::selfShieldingIntegration( DistributedSrcCalc &calcu
     
     cerr << "Integration failed: " << e.what() << endl;
     calculator.integral = 0.0;
+    calculator.m_componentIntegrals.assign( ncomp - 1, 0.0 );
   }//try / catch
   
-
-  
-  //should check for fails and stuff all over here
-  
 /*
   static std::mutex m;
   std::lock_guard<std::mutex> scoped_lock( m );
@@ -5595,7 +6360,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
   const size_t nMaterials = m_materials.size();
   for( size_t materialN = 0; materialN < nMaterials; ++materialN )
   {
-    boost::function<double(float)> att_coef_fcn;
+    boost::function<double(double)> att_coef_fcn;
     const ShieldLayerInfo &shielding = m_materials[materialN];
     const shared_ptr<const Material> &material = shielding.material;
 
@@ -5649,8 +6414,13 @@ vector< tuple<double,double,double,Wt::WColor,double> >
       }//switch( m_geometry )
       
       shield_outer_rad += thickness;
-      att_coef_fcn = boost::bind( &transmition_coefficient_material, material.get(),
-                                 boost::placeholders::_1, static_cast<float>(thickness) );
+      
+      // Equivalent to `transmition_coefficient_material(...)`, but using cached coefficients
+      const float length = static_cast<float>( thickness );
+      const Material * const mat = material.get();
+      att_coef_fcn = [this,materialN,mat,length]( const double energy ) -> double {
+        return length * material_attenuation_coef( materialN, mat, energy );
+      };
     }//if( generic material ) / else
 
 /*
@@ -5763,7 +6533,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
     
     for( EnergyCountMap::value_type &energy_count : energy_count_map )
     {
-      const double coef = transmission_length_coefficient_air( energy_count.first );
+      const double coef = air_attenuation_coef( energy_count.first );
       energy_count.second *= exp( -1.0 * coef * air_dist );
     }
   }//if( m_options.attenuate_for_air )
@@ -5783,7 +6553,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
 //           << m_detector->intrinsicEfficiency( energy_count.first ) << " and the "
 //           << " total efficiency is " << m_detector->efficiency( energy_count.first, m_distance ) << endl;
       
-      const double eff = fixed_geom ? m_detector->intrinsicEfficiency(energy_count.first)
+      const double eff = fixed_geom ? detector_intrinsic_eff(energy_count.first)
                                     : m_detector->efficiency( energy_count.first, m_distance );
       
       if( info )
@@ -6088,7 +6858,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
         calculator.m_srcVolumetricActivity = energy_count.second;
         
         if( m_options.attenuate_for_air )
-          calculator.m_airTransLenCoef = transmission_length_coefficient_air( energy_count.first );
+          calculator.m_airTransLenCoef = air_attenuation_coef( energy_count.first );
         else
           calculator.m_airTransLenCoef = 0.0;
         
@@ -6183,7 +6953,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
           if( pastDetector )
             throw runtime_error( "energy_chi_contributions: radius > distance" );
           
-          const double transLenCoef = transmition_length_coefficient( material.get(), calculator.m_energy );
+          const double transLenCoef = material_attenuation_coef( subMat, material.get(), calculator.m_energy );
 
 #if( defined(__GNUC__) && __GNUC__ < 5 )
           calculator.m_dimensionsTransLenAndType.push_back( tuple<array<double,3>,double,DistributedSrcCalc::ShellType>{outer_dims, transLenCoef, DistributedSrcCalc::ShellType::Material} );
@@ -6202,18 +6972,170 @@ vector< tuple<double,double,double,Wt::WColor,double> >
 
   if( calculators.size() )
   {
-    if( m_options.multithread_self_atten )
+    // The calculators we will use the adaptive Cuhre integration for
+    vector<DistributedSrcCalc *> cuhre_calculators;
+    
+    if( m_options.fast_self_atten_integration )
+    {
+      // All the calculators with the same dimensions (i.e., the different energies of a source)
+      //  share a geometry tabulation; we also re-use tabulations from the previous call, since often
+      //  only densities or atomic numbers have changed.
+      vector<size_t> tabulation_index( calculators.size(), 0 );
+      vector<const DistributedSrcCalc *> tabulation_calcs;
+      vector<shared_ptr<const DistributedSrcPathLengths>> tabulations;
+      
+      for( size_t i = 0; i < calculators.size(); ++i )
+      {
+        size_t index = 0;
+        while( (index < tabulation_calcs.size())
+              && !DistributedSrcPathLengths::same_geometry( *tabulation_calcs[index], calculators[i] ) )
+          ++index;
+        
+        if( index == tabulation_calcs.size() )
+        {
+          shared_ptr<const DistributedSrcPathLengths> prev;
+          std::lock_guard<std::mutex> cache_lock( m_pathLengthCacheMutex );
+          for( const shared_ptr<const DistributedSrcPathLengths> &cached : m_pathLengthCache )
+          {
+            if( cached->matches( calculators[i] ) )
+            {
+              prev = cached;
+              break;
+            }
+          }//for( loop over previous tabulations )
+          
+          tabulation_calcs.push_back( &(calculators[i]) );
+          tabulations.push_back( prev );
+        }//if( we havent seen this geometry yet )
+        
+        tabulation_index[i] = index;
+      }//for( size_t i = 0; i < calculators.size(); ++i )
+      
+      const auto tabulate = [&tabulation_calcs, &tabulations]( const size_t index ){
+        const DistributedSrcCalc &calc = *tabulation_calcs[index];
+        try
+        {
+          size_t num_points = sm_numGaussLegendrePoints3D;
+          if( self_atten_integral_ndim(calc.m_geometry) == 2 )
+            num_points = sm_numGaussLegendrePoints2D;
+          
+          tabulations[index] = make_shared<const DistributedSrcPathLengths>( calc, num_points );
+        }catch( std::exception &e )
+        {
+          // We'll fall back to the Cuhre integration for calculators with this geometry
+          cerr << "Failed to tabulate self-attenuation geometry: " << e.what() << endl;
+        }
+      };//tabulate lambda
+      
+      throwIfCancelled();
+      
+      if( m_options.multithread_self_atten )
+      {
+        SharedThreadPool::TaskGroup pool;
+        for( size_t index = 0; index < tabulations.size(); ++index )
+        {
+          if( !tabulations[index] )
+            pool.post( [index,&tabulate](){ tabulate(index); } );
+        }
+        pool.join();
+      }else
+      {
+        for( size_t index = 0; index < tabulations.size(); ++index )
+        {
+          if( !tabulations[index] )
+            tabulate( index );
+        }
+      }//if( m_options.multithread_self_atten ) / else
+      
+      for( size_t i = 0; i < calculators.size(); ++i )
+      {
+        const shared_ptr<const DistributedSrcPathLengths> &tabulation = tabulations[tabulation_index[i]];
+        if( tabulation )
+          calculators[i].integral = tabulation->integrate( calculators[i] );
+        else
+          cuhre_calculators.push_back( &(calculators[i]) );
+      }//for( size_t i = 0; i < calculators.size(); ++i )
+      
+      std::lock_guard<std::mutex> cache_lock( m_pathLengthCacheMutex );
+      m_pathLengthCache.clear();
+      for( const shared_ptr<const DistributedSrcPathLengths> &tabulation : tabulations )
+      {
+        if( tabulation )
+          m_pathLengthCache.push_back( tabulation );
+      }
+    }else
     {
-      SpecUtilsAsync::ThreadPool pool;
       for( DistributedSrcCalc &calculator : calculators )
-        pool.post( boost::bind( &ShieldingSourceChi2Fcn::selfShieldingIntegration, boost::ref(calculator) ) );
+        cuhre_calculators.push_back( &calculator );
+    }//if( m_options.fast_self_atten_integration ) / else
+    
+    // Calculators with the same geometry (i.e., the different energies of a source) are integrated
+    //  together, as components of a single integrand, so the ray-tracing is only done once per
+    //  integration point, for all energies.  When multi-threading, we limit the number of energies
+    //  per integral, so there are still enough integrals to keep all the threads busy.
+    //  Cuba also has a compile-time limit on the number of components.
+    size_t max_components = cuhre_calculators.size();
+    if( m_options.multithread_self_atten )
+    {
+      const size_t nthread = static_cast<size_t>( std::max( 1, SpecUtilsAsync::num_logical_cpu_cores() ) );
+      max_components = std::max( size_t(1), cuhre_calculators.size() / nthread );
+    }
+    max_components = std::min( max_components,
+                               static_cast<size_t>( std::max( 1, Integrate::cuhre_max_components() ) ) );
+    
+    vector<vector<DistributedSrcCalc *>> calc_groups;
+    for( DistributedSrcCalc *calculator : cuhre_calculators )
+    {
+      size_t index = 0;
+      while( (index < calc_groups.size())
+            && ((calc_groups[index].size() >= max_components)
+                || !DistributedSrcPathLengths::same_geometry( *calc_groups[index].front(), *calculator )) )
+        ++index;
+      
+      if( index == calc_groups.size() )
+        calc_groups.emplace_back();
+      calc_groups[index].push_back( calculator );
+    }//for( DistributedSrcCalc *calculator : cuhre_calculators )
+    
+    for( const vector<DistributedSrcCalc *> &group : calc_groups )
+    {
+      DistributedSrcCalc &primary = *group.front();
+      primary.m_componentTransLenCoefs.clear();
+      
+      for( size_t comp = 1; comp < group.size(); ++comp )
+      {
+        const DistributedSrcCalc &other = *group[comp];
+        for( const auto &layer : other.m_dimensionsTransLenAndType )
+          primary.m_componentTransLenCoefs.push_back( std::get<1>(layer) );
+        primary.m_componentTransLenCoefs.push_back( other.m_attenuateForAir ? other.m_airTransLenCoef : 0.0 );
+      }//for( size_t comp = 1; comp < group.size(); ++comp )
+    }//for( const vector<DistributedSrcCalc *> &group : calc_groups )
+    
+    throwIfCancelled();
+    
+    if( m_options.multithread_self_atten )
+    {
+      SharedThreadPool::TaskGroup pool;
+      for( const vector<DistributedSrcCalc *> &group : calc_groups )
+        pool.post( boost::bind( &ShieldingSourceChi2Fcn::selfShieldingIntegration, boost::ref(*group.front()) ) );
       pool.join();
     }else
     {
-      for( DistributedSrcCalc &calculator : calculators )
-        selfShieldingIntegration(calculator);
+      for( const vector<DistributedSrcCalc *> &group : calc_groups )
+        selfShieldingIntegration( *group.front() );
     }
     
+    for( const vector<DistributedSrcCalc *> &group : calc_groups )
+    {
+      const DistributedSrcCalc &primary = *group.front();
+      assert( primary.m_componentIntegrals.size() == (group.size() - 1) );
+      
+      for( size_t comp = 1; comp < group.size(); ++comp )
+        group[comp]->integral = (comp <= primary.m_componentIntegrals.size())
+                                  ? primary.m_componentIntegrals[comp - 1]
+                                  : 0.0;
+    }//for( const vector<DistributedSrcCalc *> &group : calc_groups )
+    
 //    vector<boost::function<void()> > workers;
 //    for( DistributedSrcCalc &calculator : calculators )
 //    {
@@ -6244,7 +7166,7 @@ vector< tuple<double,double,double,Wt::WColor,double> >
 
       
       if( m_detector && m_detector->isValid() )
-        contrib *= m_detector->intrinsicEfficiency( calculator.m_energy );
+        contrib *= detector_intrinsic_eff( calculator.m_energy );
 
       if( energy_count_map.find( calculator.m_energy ) != energy_count_map.end() )
       {
@@ -6362,7 +7284,7 @@ void ShieldingSourceChi2Fcn::GuiProgressUpdateInfo::completed_eval( const double
   
   m_currentTime = SpecUtils::get_wall_time();
   const double elapsed_time = m_currentTime - m_fitStartTime;
-  if( elapsed_time > 0.001*m_update_frequency_ms )
+  if( (m_currentTime - m_lastGuiUpdateTime) > 0.001*m_update_frequency_ms )
   {
     m_lastGuiUpdateTime = m_currentTime;
     m_gui_updater( m_num_fcn_calls, elapsed_time, m_bestChi2, m_bestParameters );
@@ -664,6 +664,7 @@ void GammaXsGui::calculateCrossSections()
   
   energy *= static_cast<float>(PhysicalUnits::keV);
 
+  vector<pair<int,float>> mass_fractions;
   for( Material::ElementFractionPair &nf : chemFormula )
   {
     const SandiaDecay::Element *el = nf.first;
@@ -672,49 +673,38 @@ void GammaXsGui::calculateCrossSections()
     
     atomicMass +=  xsmult * AN;
     totalMass += xsmult;
-    
+    mass_fractions.emplace_back( AN, static_cast<float>(xsmult) );
+  }//for( Material::NuclideFractionPair &nf : chemFormula )
+  
+  // The vectorized calls cache their results, so, e.g., re-typing the same formula or energy
+  //  doesnt re-interpolate the cross-section tables
+  const vector<float> energies( 1, energy );
+  const auto process_mu = [&mass_fractions,&energies]( const MassAttenuation::GammaEmProcces *process ) -> double {
     try
     {
-      comptonMu  += xsmult * MassAttenuation::massAttenuationCoeficient( AN, energy, MassAttenuation::GammaEmProcces::ComptonScatter ) ;
+      const shared_ptr<const vector<float>> mu = process
+                ? MassAttenuation::massAttenuationCoeficients( mass_fractions, energies, *process )
+                : MassAttenuation::massAttenuationCoeficients( mass_fractions, energies );
+      return mu->at(0);
     }catch(exception &e)
     {
       passMessage( WString("gxsg-warn-suspect").arg(e.what()) , 3 );
     }
-
+    return 0.0;
+  };//process_mu lambda
+  
+  const MassAttenuation::GammaEmProcces compton = MassAttenuation::GammaEmProcces::ComptonScatter;
+  const MassAttenuation::GammaEmProcces photo = MassAttenuation::GammaEmProcces::PhotoElectric;
+  const MassAttenuation::GammaEmProcces pair_prod = MassAttenuation::GammaEmProcces::PairProduction;
+  
+  comptonMu = process_mu( &compton );
 #if( !USE_SNL_GAMMA_ATTENUATION_VALUES )
-    try
-    {
-      rayleighMu += xsmult * MassAttenuation::massAttenuationCoeficient( AN, energy, MassAttenuation::GammaEmProcces::RayleighScatter );
-    }catch(exception &e)
-    {
-      passMessage( WString("gxsg-warn-suspect").arg(e.what()) , 3 );
-    }
+  const MassAttenuation::GammaEmProcces rayleigh = MassAttenuation::GammaEmProcces::RayleighScatter;
+  rayleighMu = process_mu( &rayleigh );
 #endif
-
-    try
-    {
-      photoMu    += xsmult * MassAttenuation::massAttenuationCoeficient( AN, energy, MassAttenuation::GammaEmProcces::PhotoElectric );
-    }catch(exception &e)
-    {
-      passMessage( WString("gxsg-warn-suspect").arg(e.what()) , 3 );
-    }
-
-    try
-    {
-      pairMu     += xsmult * MassAttenuation::massAttenuationCoeficient( AN, energy, MassAttenuation::GammaEmProcces::PairProduction );
-    }catch(exception &e)
-    {
-      passMessage( WString("gxsg-warn-suspect").arg(e.what()) , 3 );
-    }
-    
-    try
-    {
-      totalMu += xsmult * MassAttenuation::massAttenuationCoeficient( AN, energy );
-    }catch(exception &e)
-    {
-      passMessage( WString("gxsg-warn-suspect").arg(e.what()) , 3 );
-    }
-  }//for( Material::NuclideFractionPair &nf : chemFormula )
+  photoMu = process_mu( &photo );
+  pairMu = process_mu( &pair_prod );
+  totalMu = process_mu( nullptr );
 
   comptonMu  *= PhysicalUnits::g / PhysicalUnits::cm2;
 #if( !USE_SNL_GAMMA_ATTENUATION_VALUES )
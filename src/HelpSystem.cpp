@@ -23,6 +23,9 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <mutex>
+#include <memory>
 #include <string>
 #include <fstream>
 
@@ -93,11 +96,23 @@ namespace
     }
   };//RmHelpFromDom
   
+  /** The help files, and help.json index, are the same for every session, so we read each
+   localized variant from disk at most once per process, and then serve it from memory.
+   A nullptr value indicates the path doesnt exist, so we dont keep re-looking for locale
+   variants that arent there.
+   */
+  std::mutex ns_help_file_cache_mutex;
+  std::map<string,std::shared_ptr<const string>> ns_help_file_cache;
+  
+  
   /** Returns the contents of the localized, specified file, as a string.
    
    It doesn't directly open the file you specify, but uses the same logic as wt-3.7.1/src/Wt/WMessageResources.C
    to find the version of the specified file closest to the current locale.
    
+   File contents (or that the file doesnt exist) are cached for the life of the process, so help
+   files changed on disk wont be picked up until InterSpec is restarted.
+   
    Throws exception, with descriptive message, if couldn't open file.
    */
   string getInternationalizedFileContents( const string &orig_filepath )
@@ -115,40 +130,60 @@ namespace
     {
       const string trial_path = filepath + (locale.length() > 0 ? "_" : "") + locale + extension;
       
+      bool tried_before = false;
+      
+      {//begin check cache
+        std::lock_guard<std::mutex> lock( ns_help_file_cache_mutex );
+        const auto pos = ns_help_file_cache.find( trial_path );
+        if( pos != end(ns_help_file_cache) )
+        {
+          if( pos->second )
+            return *pos->second;
+          tried_before = true;
+        }//if( we have already tried this path )
+      }//end check cache
+      
+      if( !tried_before )
+      {
 #ifdef _WIN32
-      const std::wstring wfilepath = SpecUtils::convert_from_utf8_to_utf16(trial_path);
-      ifstream infile( wfilepath.c_str() );
+        const std::wstring wfilepath = SpecUtils::convert_from_utf8_to_utf16(trial_path);
+        ifstream infile( wfilepath.c_str() );
 #else
-      ifstream infile( trial_path.c_str() );
+        ifstream infile( trial_path.c_str() );
 #endif
-      
-      if( !infile.is_open() )
-      {
-        if( locale.empty() )
-          break;
         
-        /* try a lesser specified variant */
-        std::string::size_type l = locale.rfind('-');
-        if( l != std::string::npos )
-          locale.erase(l);
-        else
-          locale = "";
+        if( infile.is_open() )
+        {
+          infile.seekg(0, std::ios::end);
+          const size_t size = infile.tellg();
+          infile.seekg(0);
+          
+          if( size >= 128*1024 )
+            throw runtime_error( "'" + filepath + "' is too large a file - not loading contents." );
+          
+          auto contents = std::make_shared<string>( size, ' ' );
+          if( size )
+            infile.read( &((*contents)[0]), size );
+          
+          std::lock_guard<std::mutex> lock( ns_help_file_cache_mutex );
+          ns_help_file_cache[trial_path] = contents;
+          
+          return *contents;
+        }//if( infile.is_open() )
         
-        continue;
-      }//if( !infile.is_open() )
-
-      infile.seekg(0, std::ios::end);
-      const size_t size = infile.tellg();
-      infile.seekg(0);
+        std::lock_guard<std::mutex> lock( ns_help_file_cache_mutex );
+        ns_help_file_cache[trial_path] = nullptr;
+      }//if( !tried_before )
       
-      if( size < 128*1024 )
-      {
-        string contents( size, ' ' );
-        infile.read( &(contents[0]), size );
-        return contents;
-      }
+      if( locale.empty() )
+        break;
       
-      throw runtime_error( "'" + filepath + "' is too large a file - not loading contents." );
+      /* try a lesser specified variant */
+      std::string::size_type l = locale.rfind('-');
+      if( l != std::string::npos )
+        locale.erase(l);
+      else
+        locale = "";
     }//for( ; ; )
     
     throw runtime_error( "Could not open expected file: '" + orig_filepath + "'" );
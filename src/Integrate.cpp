@@ -63,4 +63,74 @@ void CuhreIntegrate( const int ndim,
          &integral, &error, &prob );
 }//CuhreIntegrate(...)
 
+
+void CuhreIntegrate( const int ndim,
+                       const int ncomp,
+                       Integrate::Integrand integrand,
+                       void *userdata,
+                       const double epsrel,
+                       const double epsabs,
+                       const unsigned int flags,
+                       const size_t mineval,
+                       const size_t maxeval,
+                       int &pnregions,
+                       int &pneval,
+                       int &pfail,
+                       double *integral,
+                       double *error,
+                       double *prob )
+{
+  if( (ncomp < 1) || (ncomp > cuhre_max_components()) )
+    throw std::runtime_error( "CuhreIntegrate: invalid number of components" );
+  
+  const int key = 0;
+  
+  Cuhre( ndim, ncomp, integrand, userdata,
+         epsrel, epsabs, flags, mineval, maxeval, key,
+         &pnregions, &pneval, &pfail,
+         integral, error, prob );
+}//CuhreIntegrate(...)
+
+
+void CuhreIntegrate( const int ndim,
+                       const int ncomp,
+                       const int nvec,
+                       Integrate::BatchIntegrand integrand,
+                       void *userdata,
+                       const double epsrel,
+                       const double epsabs,
+                       const unsigned int flags,
+                       const size_t mineval,
+                       const size_t maxeval,
+                       int &pnregions,
+                       int &pneval,
+                       int &pfail,
+                       double *integral,
+                       double *error,
+                       double *prob )
+{
+  if( (ncomp < 1) || (ncomp > cuhre_max_components()) )
+    throw std::runtime_error( "CuhreIntegrate: invalid number of components" );
+  
+  if( nvec < 1 )
+    throw std::runtime_error( "CuhreIntegrate: invalid batch size" );
+  
+  const int key = 0;
+  
+  CuhreVec( ndim, ncomp, integrand, userdata, nvec,
+            epsrel, epsabs, flags, mineval, maxeval, key,
+            &pnregions, &pneval, &pfail,
+            integral, error, prob );
+}//CuhreIntegrate(...)
+
+
+int cuhre_max_components()
+{
+#ifdef CUBA_MAX_NCOMP
+  return CUBA_MAX_NCOMP;
+#else
+  return 1;
+#endif
+}//int cuhre_max_components()
+
 }//namespace Integrate
@@ -87,6 +87,8 @@
 #include "SpecUtils/SpecUtilsAsync.h"
 
 #include "InterSpec/MakeDrf.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/AppUtils.h"
 #include "InterSpec/FluxTool.h"
@@ -98,6 +100,7 @@
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/IsotopeId.h"
 #include "InterSpec/PeakModel.h"
+#include "InterSpec/RebinMapping.h"
 #include "InterSpec/ColorTheme.h"
 #include "InterSpec/GammaXsGui.h"
 #include "InterSpec/HelpSystem.h"
@@ -619,8 +622,8 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_spectrum->existingRoiEdgeDragUpdate().connect( m_spectrum, &D3SpectrumDisplayDiv::performExistingRoiEdgeDragWork );
   m_spectrum->dragCreateRoiUpdate().connect( m_spectrum, &D3SpectrumDisplayDiv::performDragCreateRoiWork );
       
-  m_nuclideSearch = new IsotopeSearchByEnergy( this, m_spectrum );
-  m_nuclideSearch->setLoadLaterWhenInvisible(true);
+  // m_nuclideSearch is created by nuclideSearch() the first time it is needed (e.g., when its
+  //  tab is selected), as most sessions never use it.
 
   m_warnings = new WarningWidget( this );
 
@@ -914,7 +917,6 @@ InterSpec::InterSpec( WContainerWidget *parent )
     WGridLayout *isoSearchLayout = new WGridLayout();
     m_nuclideSearchContainer->setLayout( isoSearchLayout );
     isoSearchLayout->setContentsMargins( 0, 0, 0, 0 );
-    isoSearchLayout->addWidget( m_nuclideSearch, 0, 0 );
     m_nuclideSearchContainer->setMargin( 0 );
     m_nuclideSearchContainer->setPadding( 0 );
     isoSearchLayout->setRowStretch( 0, 1 );
@@ -1325,6 +1327,14 @@ InterSpec::~InterSpec() noexcept(true)
   del_ptr_set_null( m_undo );
   del_ptr_set_null( m_licenseWindow );
   
+  try
+  {
+    InterSpecUser::flushPendingPreferenceWrites( this );
+  }catch( std::exception &e )
+  {
+    cerr << "Caught exception writing preferences to database: " << e.what() << endl;
+  }
+  
   try
   {
     closeShieldingSourceFit();
@@ -2897,9 +2907,6 @@ void InterSpec::deletePeakEdit()
 
 void InterSpec::setIsotopeSearchEnergy( double energy )
 {
-  if( !m_nuclideSearch )
-    return;
-  
   double sigma = -1.0;
 
   if( m_toolsTabs )
@@ -2930,7 +2937,7 @@ void InterSpec::setIsotopeSearchEnergy( double energy )
     }//if( within 3 sigma of peak )
   }//if( !!peak )
   
-  m_nuclideSearch->setNextSearchEnergy( energy, sigma );
+  nuclideSearch()->setNextSearchEnergy( energy, sigma );
 }//void setIsotopeSearchEnergy( double energy );
 
 
@@ -3146,6 +3153,11 @@ WModelIndex InterSpec::addPeak( PeakDef peak,
 #if( USE_DB_TO_STORE_SPECTRA )
 void InterSpec::saveStateToDb( Wt::Dbo::ptr<UserState> entry )
 {
+  INTERSPEC_TRACE_SCOPE( "InterSpec::saveStateToDb" );
+  static ServerMetrics::Histogram &save_durations = ServerMetrics::histogram( "interspec_db_save_duration_seconds",
+                                            "Time taken to write to the database.", "type=\"user_state\"" );
+  const ServerMetrics::ScopedLatency save_latency( save_durations );
+  
   if( !entry || entry->user != m_user || !m_user.session() )
     throw runtime_error( "Invalid input to saveStateToDb()" );
   
@@ -3477,6 +3489,7 @@ void InterSpec::saveStateToDb( Wt::Dbo::ptr<UserState> entry )
    */
 
     Json::Array userOptions;
+    InterSpecUser::flushPendingPreferenceWrites( this );
     const Wt::Dbo::collection< Wt::Dbo::ptr<UserOption> > &prefs
                                                      = m_user->m_dbPreferences;
     
@@ -3709,17 +3722,17 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
 //      }
       
       if( dbforeground && dbforeground->filedata.size() )
-        snapforeground = (*dbforeground->filedata.begin())->decodeSpectrum();
+        snapforeground = (*dbforeground->filedata.begin())->decodeSpectrum( *m_sql );
     
       if( dbsecond && dbsecond->filedata.size() && dbsecond != dbforeground )
-        snapsecond = (*dbsecond->filedata.begin())->decodeSpectrum();
+        snapsecond = (*dbsecond->filedata.begin())->decodeSpectrum( *m_sql );
       else if( dbsecond == dbforeground )
         snapsecond = snapforeground;
     
       if( dbbackground && dbbackground->filedata.size()
           && dbbackground != dbforeground
           && dbbackground != dbsecond  )
-        snapbackground = (*dbbackground->filedata.begin())->decodeSpectrum();
+        snapbackground = (*dbbackground->filedata.begin())->decodeSpectrum( *m_sql );
       else if( dbbackground == dbforeground )
         snapbackground = snapforeground;
       else if( dbbackground == dbsecond )
@@ -3904,7 +3917,8 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
     
     if( m_nuclideSearchWindow )
     {
-      m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+      if( m_nuclideSearch )
+        m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
       delete m_nuclideSearchContainer;
       m_nuclideSearchContainer = nullptr;
     }
@@ -4128,7 +4142,7 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
         closeGammaLinesWindow();
     }//if( entry->gammaLinesXml.size() )
     
-    if( m_nuclideSearch && entry->isotopeSearchEnergiesXml.size() )
+    if( entry->isotopeSearchEnergiesXml.size() )
     {
       string data = entry->isotopeSearchEnergiesXml;
       
@@ -4141,8 +4155,8 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
           showNuclideSearchWindow();
       }//if( !wasDocked )
       
-      m_nuclideSearch->deSerialize( data, display );
-    }//if( m_nuclideSearch && entry->isotopeSearchEnergiesXml.size() )
+      nuclideSearch()->deSerialize( data, display );
+    }//if( entry->isotopeSearchEnergiesXml.size() )
 
     for( SpectrumChart::PeakLabels label = SpectrumChart::PeakLabels(0);
         label < SpectrumChart::kNumPeakLabels;
@@ -6368,8 +6382,11 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     
     if( m_nuclideSearchWindow )
     {
-      m_nuclideSearch->clearSearchEnergiesOnClient();
-      m_nuclideSearchWindow->stretcher()->removeWidget( m_nuclideSearch );
+      if( m_nuclideSearch )
+      {
+        m_nuclideSearch->clearSearchEnergiesOnClient();
+        m_nuclideSearchWindow->stretcher()->removeWidget( m_nuclideSearch );
+      }
       delete m_nuclideSearchWindow;
       m_nuclideSearchWindow = 0;
     }//if( m_nuclideSearchWindow )
@@ -6380,7 +6397,8 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     WGridLayout *isoSearchLayout = new WGridLayout();
     m_nuclideSearchContainer->setLayout( isoSearchLayout );
     isoSearchLayout->setContentsMargins( 0, 0, 0, 0 );
-    isoSearchLayout->addWidget( m_nuclideSearch, 0, 0 );
+    if( m_nuclideSearch )
+      isoSearchLayout->addWidget( m_nuclideSearch, 0, 0 );
     m_nuclideSearchContainer->setMargin( 0 );
     m_nuclideSearchContainer->setPadding( 0 );
     isoSearchLayout->setRowStretch( 0, 1 );
@@ -6433,8 +6451,11 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     }
 #endif
     
-    m_nuclideSearch->clearSearchEnergiesOnClient();
-    m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+    if( m_nuclideSearch )
+    {
+      m_nuclideSearch->clearSearchEnergiesOnClient();
+      m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+    }
     m_toolsTabs->removeTab( m_nuclideSearchContainer );
     delete m_nuclideSearchContainer;
     m_nuclideSearchContainer = nullptr;
@@ -7108,8 +7129,8 @@ void InterSpec::finishHardBackgroundSub( std::shared_ptr<bool> truncate_neg, std
        && (*background->energy_calibration()) != (*foreground->energy_calibration()) )
     {
       auto new_backchan = make_shared<vector<float>>( fore_counts->size(), 0.0f );
-      SpecUtils::rebin_by_lower_edge( *background->channel_energies(), *back_counts,
-                                     *foreground->channel_energies(), *new_backchan );
+      RebinMapping::rebin( background->energy_calibration(), *back_counts,
+                           foreground->energy_calibration(), *new_backchan );
       back_counts = new_backchan;
     }
     
@@ -7321,6 +7342,25 @@ ReferencePhotopeakDisplay *InterSpec::referenceLinesWidget()
 
 IsotopeSearchByEnergy *InterSpec::nuclideSearch()
 {
+  if( m_nuclideSearch )
+    return m_nuclideSearch;
+  
+  m_nuclideSearch = new IsotopeSearchByEnergy( this, m_spectrum );
+  m_nuclideSearch->setLoadLaterWhenInvisible(true);
+  
+  // Put the widget wherever it is currently supposed to be shown; if the tool tabs are hidden,
+  //  and there is no window, it will be placed when showNuclideSearchWindow() is called.
+  if( m_nuclideSearchWindow )
+  {
+    m_nuclideSearchWindow->stretcher()->addWidget( m_nuclideSearch, 0, 0 );
+  }else if( m_nuclideSearchContainer )
+  {
+    WGridLayout *isoSearchLayout = dynamic_cast<WGridLayout *>( m_nuclideSearchContainer->layout() );
+    assert( isoSearchLayout );
+    if( isoSearchLayout )
+      isoSearchLayout->addWidget( m_nuclideSearch, 0, 0 );
+  }
+  
   return m_nuclideSearch;
 }//IsotopeSearchByEnergy *nuclideSearch();
 
@@ -8368,6 +8408,7 @@ void InterSpec::searchOnEnergyFromRightClick()
     }
   }//if( m_toolsTabs ) / else
   
+  nuclideSearch();
   assert( m_nuclideSearch );
   
   vector<IsotopeSearchByEnergy::SearchEnergy *> orig_searchs = m_nuclideSearch->searches();
@@ -9495,12 +9536,11 @@ void InterSpec::fillMaterialDb( std::shared_ptr<MaterialDB> materialDB,
                                      const std::string sessionid,
                                      boost::function<void(void)> update )
 {
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
   try
   {
     //materialDB can get destructed if the session ends immediately....
-    const string materialfile = SpecUtils::append_path(ns_staticDataDirectory, "MaterialDataBase.txt" );
-    materialDB->parseGadrasMaterialFile( materialfile, db, false );
+    const shared_ptr<const MaterialDB> parsed = staticMaterialDb();
+    materialDB->copyMaterialsFrom( *parsed );
     
     WServer::instance()->post( sessionid, update );
   }catch( std::exception &e )
@@ -9514,6 +9554,27 @@ void InterSpec::fillMaterialDb( std::shared_ptr<MaterialDB> materialDB,
 }//void fillMaterialDb(...)
 
 
+std::shared_ptr<const MaterialDB> InterSpec::staticMaterialDb()
+{
+  static std::mutex s_mutex;
+  static std::shared_ptr<const MaterialDB> s_materialDb;
+  
+  // We'll hold the lock while parsing, so concurrent callers just wait on the one parse.
+  std::lock_guard<std::mutex> lock( s_mutex );
+  if( s_materialDb )
+    return s_materialDb;
+  
+  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  const string materialfile = SpecUtils::append_path( ns_staticDataDirectory, "MaterialDataBase.txt" );
+  
+  auto materials = std::make_shared<MaterialDB>();
+  materials->parseGadrasMaterialFile( materialfile, db, false );
+  s_materialDb = materials;
+  
+  return s_materialDb;
+}//std::shared_ptr<const MaterialDB> staticMaterialDb()
+
+
 void InterSpec::pushMaterialSuggestionsToUsers()
 {
   if( !m_materialDB || !m_shieldingSuggestion )
@@ -9816,8 +9877,11 @@ void InterSpec::closeNuclideSearchWindow()
   if( !m_nuclideSearchWindow )
     return;
   
-  m_nuclideSearch->clearSearchEnergiesOnClient();
-  m_nuclideSearchWindow->stretcher()->removeWidget( m_nuclideSearch );
+  if( m_nuclideSearch )
+  {
+    m_nuclideSearch->clearSearchEnergiesOnClient();
+    m_nuclideSearchWindow->stretcher()->removeWidget( m_nuclideSearch );
+  }
   
   delete m_nuclideSearchWindow;
   m_nuclideSearchWindow = 0;
@@ -9828,7 +9892,8 @@ void InterSpec::closeNuclideSearchWindow()
     WGridLayout *isotopeSearchGridLayout = new WGridLayout();
     m_nuclideSearchContainer->setLayout( isotopeSearchGridLayout );
 
-    isotopeSearchGridLayout->addWidget( m_nuclideSearch, 0, 0 );
+    if( m_nuclideSearch )
+      isotopeSearchGridLayout->addWidget( m_nuclideSearch, 0, 0 );
     isotopeSearchGridLayout->setRowStretch( 0, 1 );
     isotopeSearchGridLayout->setColumnStretch( 0, 1 );
 
@@ -9844,13 +9909,14 @@ void InterSpec::showNuclideSearchWindow()
     m_nuclideSearchWindow->show();
     m_nuclideSearchWindow->resizeToFitOnScreen();
     m_nuclideSearchWindow->centerWindow();
-    m_nuclideSearch->loadSearchEnergiesToClient();
+    nuclideSearch()->loadSearchEnergiesToClient();
     return;
   }//if( m_nuclideSearchWindow )
   
   if( m_toolsTabs && m_nuclideSearchContainer )
   {
-    m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+    if( m_nuclideSearch )
+      m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
     m_toolsTabs->removeTab( m_nuclideSearchContainer );
     delete m_nuclideSearchContainer;
     m_nuclideSearchContainer = 0;
@@ -9871,7 +9937,8 @@ void InterSpec::showNuclideSearchWindow()
   //}//if( isPhone() )
   
   m_nuclideSearchWindow->stretcher()->setContentsMargins( 0, 0, 0, 0 );
-  m_nuclideSearchWindow->stretcher()->addWidget( m_nuclideSearch, 0, 0 );
+  if( m_nuclideSearch )
+    m_nuclideSearchWindow->stretcher()->addWidget( m_nuclideSearch, 0, 0 );
   
   //We need to set the footer height explicitly, or else the window->resize()
   //  messes up.
@@ -9889,7 +9956,7 @@ void InterSpec::showNuclideSearchWindow()
   m_nuclideSearchWindow->centerWindow();
   m_nuclideSearchWindow->show();
   
-  m_nuclideSearch->loadSearchEnergiesToClient(); //clear the isotope search on the canvas
+  nuclideSearch()->loadSearchEnergiesToClient(); //clear the isotope search on the canvas
   
   if( m_toolsTabs )
     m_currentToolsTab = m_toolsTabs->currentIndex();
@@ -10155,8 +10222,8 @@ void InterSpec::handleToolTabChanged( int tab )
     if( m_nuclideSearch && (m_currentToolsTab==searchTab) )
       m_nuclideSearch->clearSearchEnergiesOnClient();
     
-    if( m_nuclideSearch && (current_tab==searchTab) )
-      m_nuclideSearch->loadSearchEnergiesToClient();
+    if( current_tab == searchTab )
+      nuclideSearch()->loadSearchEnergiesToClient();
     
     if( focus && (current_tab == calibtab) )
     {
@@ -10335,6 +10402,37 @@ void InterSpec::changeDisplayedSampleNums( const std::set<int> &samples,
 }//void InterSpec::changeDisplayedSampleNums( const std::set<int> &samples )
 
 
+std::set<int> InterSpec::appendForegroundMeasurements(
+                                const std::vector<std::shared_ptr<SpecUtils::Measurement>> &meas )
+{
+  if( !m_dataMeasurement || meas.empty() )
+    return {};
+  
+  // If the user is displaying the most recent sample, we'll keep displaying the most recent
+  //  samples as new ones come in; otherwise we'll leave the displayed spectrum alone.
+  const set<int> &prev_samples = m_dataMeasurement->sample_numbers();
+  const bool following_latest = prev_samples.empty()
+                                || m_displayedSamples.count( *prev_samples.rbegin() );
+  
+  const set<int> added_samples = m_dataMeasurement->appendMeasurements( meas );
+  if( added_samples.empty() )
+    return added_samples;
+  
+  // The time chart keeps its per-sample energy range sums, so only the new samples get summed.
+  displayTimeSeriesData();
+  m_timeSeries->scheduleRenderAll();
+  
+  if( following_latest )
+  {
+    set<int> samples = m_displayedSamples;
+    samples.insert( begin(added_samples), end(added_samples) );
+    changeDisplayedSampleNums( samples, SpecUtils::SpectrumType::Foreground );
+  }//if( following_latest )
+  
+  return added_samples;
+}//std::set<int> appendForegroundMeasurements(...)
+
+
 void InterSpec::timeChartClicked( const int sample_number, Wt::WFlags<Wt::KeyboardModifier> modifiers )
 {
   timeChartDragged( sample_number, sample_number, modifiers );
@@ -11998,7 +12096,8 @@ void InterSpec::searchForHintPeaks( const std::shared_ptr<SpecMeas> &data,
                                                    searchresults,
                                                    callback,
                                                    wApp->sessionId(),
-                                                   true );
+                                                   true,
+                                                   std::function<void(size_t,size_t)>() );
 
   if( m_findingHintPeaks )
   {
@@ -12837,7 +12936,7 @@ void InterSpec::displayForegroundData( const bool current_energy_range )
   std::shared_ptr<SpecUtils::Measurement> dataH;
   
   if( energy_cal )
-    dataH = m_dataMeasurement->sum_measurements( sample_nums, detectors, energy_cal );
+    dataH = m_dataMeasurement->sum_measurements_indexed( sample_nums, detectors, energy_cal );
   
   if( dataH )
     dataH->set_title( WString::tr("Foreground").toUTF8() );
@@ -12875,7 +12974,7 @@ void InterSpec::displaySecondForegroundData()
   if( !meas->num_measurements() )
     throw runtime_error( "Serious logic error in InterSpec::displaySecondForegroundData()" );
 
-  auto histH = meas->sum_measurements( sample_nums, disp_dets, energy_cal );
+  auto histH = meas->sum_measurements_indexed( sample_nums, disp_dets, energy_cal );
   if( histH )
     histH->set_title( WString::tr("second-foreground").toUTF8() );
     
@@ -12914,7 +13013,7 @@ void InterSpec::displayBackgroundData()
     return;
   }//if( !energy_cal || !m_dataMeasurement )
   
-  auto backgroundH = meas->sum_measurements( disp_samples, disp_dets, energy_cal );
+  auto backgroundH = meas->sum_measurements_indexed( disp_samples, disp_dets, energy_cal );
   if( backgroundH )
     backgroundH->set_title( WString::tr("Background").toUTF8() );
     
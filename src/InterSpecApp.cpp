@@ -23,8 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <mutex>
+#include <atomic>
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <stdio.h>
 
 #if( !(defined(WIN32) || defined(UNDER_CE) || defined(_WIN32) || defined(WIN64)) )
@@ -62,11 +66,15 @@
 #include "SpecUtils/StringAlgo.h"
 
 #include "InterSpec/AuxWindow.h"
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/InterSpecUser.h"
 #include "InterSpec/DataBaseUtils.h"
+#include "InterSpec/ReferenceLineInfo.h"
+#include "InterSpec/DecayDataBaseServer.h"
 #include "InterSpec/WarningWidget.h"
+#include "InterSpec/SpecMeasManager.h"
 
 #if( BUILD_AS_ELECTRON_APP )
 #include "target/electron/ElectronUtils.h"
@@ -105,6 +113,17 @@ WT_DECLARE_WT_MEMBER
 
 namespace
 {
+#if( BUILD_FOR_WEB_DEPLOYMENT )
+  std::atomic<int> ns_idle_memory_release_seconds( 15*60 );
+#elif( LOW_MEMORY_PROFILE )
+  std::atomic<int> ns_idle_memory_release_seconds( 5*60 );
+#else
+  std::atomic<int> ns_idle_memory_release_seconds( 0 );
+#endif
+  
+  /** How often sessions check if they have been idle long enough to release memory. */
+  const int ns_idle_check_interval_ms = 60*1000;
+  
 #if( !BUILD_FOR_WEB_DEPLOYMENT )
   std::mutex AppInstancesMutex;
   std::set<InterSpecApp *> AppInstances;
@@ -120,6 +139,7 @@ InterSpecApp::InterSpecApp( const WEnvironment &env )
     m_layout( nullptr ),
     m_lastAccessTime( std::chrono::steady_clock::now() ),
     m_activeTimeInSession{ std::chrono::seconds(0) },
+    m_idleMemoryReleased( false ),
     m_hotkeySignal( domRoot(), "hotkey", false )
 #if( IOS )
     , m_orientation( InterSpecApp::DeviceOrientation::Unknown )
@@ -146,6 +166,9 @@ InterSpecApp::InterSpecApp( const WEnvironment &env )
 InterSpecApp::~InterSpecApp()
 {
   Wt::log("debug") << "Entering ~InterSpecApp() destructor.";
+  
+  // Any analysis jobs not yet started would just be wasted work now.
+  ComputeScheduler::removeQueuedJobs( sessionId() );
 
 #if( !BUILD_FOR_WEB_DEPLOYMENT )
   if( !m_externalToken.empty() )
@@ -254,7 +277,7 @@ void InterSpecApp::setupDomEnvironment()
   // For older browsers (primarily the WkWebView for macOS Mojave (10.14) and older).
   require("InterSpec_resources/assets/js/resize-observer-polyfill/ResizeObserver.js", "ResizeObserver");
   
-  useStyleSheet( "InterSpec_resources/InterSpec.css" );
+  useStyleSheet( fingerprintedResourceUrl("InterSpec_resources/InterSpec.css") );
   doJavaScript( "if(typeof console==='undefined'){console={log:function(){}};}" );
   
   styleSheet().addRule( "input[type=\"text\"]", "font-size:0.95em;" );
@@ -906,6 +929,10 @@ void InterSpecApp::setupWidgets( const bool attemptStateLoad  )
   }
 #endif
   
+  if( (ns_idle_memory_release_seconds > 0) && WServer::instance() )
+    WServer::instance()->schedule( ns_idle_check_interval_ms, sessionId(),
+                                   boost::bind( &InterSpecApp::checkIfIdle, this ) );
+  
   if( m_viewer->m_user )
     Wt::log("debug") << "Have started session " << sessionId() << " for user "
     << m_viewer->m_user->userName() << ".";
@@ -995,6 +1022,55 @@ std::string InterSpecApp::tempDirectory()
 }//void tempDirectory()
 
 
+std::string InterSpecApp::fingerprintedResourceUrl( const std::string &resource )
+{
+  static std::mutex s_fingerprint_mutex;
+  static std::map<std::string,std::string> s_fingerprinted_urls;
+  
+  {
+    std::lock_guard<std::mutex> lock( s_fingerprint_mutex );
+    const auto pos = s_fingerprinted_urls.find( resource );
+    if( pos != end(s_fingerprinted_urls) )
+      return pos->second;
+  }
+  
+  string url = resource;
+  
+  WApplication *app = WApplication::instance();
+  const string docroot = app ? app->docRoot() : string();
+  const string path = docroot.empty() ? resource : SpecUtils::append_path( docroot, resource );
+  
+  std::vector<char> data;
+  try
+  {
+    SpecUtils::load_file_data( path.c_str(), data );
+  }catch( std::exception & )
+  {
+    data.clear();
+  }
+  
+  if( !data.empty() )
+  {
+    // 64-bit FNV-1a of the file contents; only needs to change when the file does.
+    uint64_t hash = 14695981039346656037ULL;
+    for( const char c : data )
+    {
+      hash ^= static_cast<uint8_t>( c );
+      hash *= 1099511628211ULL;
+    }
+    
+    char buffer[24] = { '\0' };
+    snprintf( buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash) );
+    url += "?v=" + string( buffer, buffer + 12 );
+  }//if( !data.empty() )
+  
+  std::lock_guard<std::mutex> lock( s_fingerprint_mutex );
+  s_fingerprinted_urls[resource] = url;
+  
+  return url;
+}//std::string fingerprintedResourceUrl( const std::string &resource )
+
+
 uint32_t InterSpecApp::compileDateAsInt()
 {
   //The below YEAR MONTH DAY macros are taken from
@@ -1125,6 +1201,45 @@ std::set<InterSpecApp *> InterSpecApp::runningInstances()
   return AppInstances;
 }//set<InterSpecApp *> runningInstances()
 
+
+void InterSpecApp::releaseMemoryOfAllSessions()
+{
+  DecayedPhotonCache::clear();
+  ReferenceLineInfo::clearCache();
+  
+  WServer *server = WServer::instance();
+  if( !server )
+    return;
+  
+  std::vector<std::string> sessionids;
+  {
+    std::lock_guard<std::mutex> lock( AppInstancesMutex );
+    for( InterSpecApp *app : AppInstances )
+      sessionids.push_back( app->sessionId() );
+  }
+  
+  for( const std::string &sessionid : sessionids )
+  {
+    server->post( sessionid, [](){
+      InterSpecApp *app = dynamic_cast<InterSpecApp *>( wApp );
+      InterSpec *viewer = app ? app->viewer() : nullptr;
+      SpecMeasManager *manager = viewer ? viewer->fileManager() : nullptr;
+      if( !manager )
+        return;
+      
+      try
+      {
+        manager->releaseIdleMemory();
+      }catch( std::exception &e )
+      {
+        Wt::log("error") << "Error releasing session memory: " << e.what();
+      }
+    } );
+  }//for( const std::string &sessionid : sessionids )
+  
+  Wt::log("info") << "Requested memory release of " << sessionids.size() << " sessions.";
+}//void releaseMemoryOfAllSessions()
+
 #endif //#if( !BUILD_FOR_WEB_DEPLOYMENT )
 
 #if( defined(WIN32) && BUILD_AS_ELECTRON_APP )
@@ -1199,6 +1314,48 @@ void InterSpecApp::getSafeAreaInsets( InterSpecApp::DeviceOrientation &orientati
 }//getSafeAreaInsets(...)
 #endif
 
+int InterSpecApp::idleMemoryReleaseSeconds()
+{
+  return ns_idle_memory_release_seconds;
+}
+
+
+void InterSpecApp::setIdleMemoryReleaseSeconds( const int seconds )
+{
+  ns_idle_memory_release_seconds = seconds;
+}
+
+
+void InterSpecApp::checkIfIdle()
+{
+  const int idle_seconds = ns_idle_memory_release_seconds;
+  if( idle_seconds <= 0 )
+    return;
+  
+  const auto idle_time = std::chrono::steady_clock::now() - m_lastAccessTime;
+  if( !m_idleMemoryReleased && (idle_time > std::chrono::seconds(idle_seconds)) )
+  {
+    m_idleMemoryReleased = true;
+    
+    SpecMeasManager *manager = m_viewer ? m_viewer->fileManager() : nullptr;
+    if( manager )
+    {
+      try
+      {
+        manager->releaseIdleMemory();
+        Wt::log("debug") << "Released memory for idle session " << sessionId() << ".";
+      }catch( std::exception &e )
+      {
+        Wt::log("error") << "Error releasing memory of idle session: " << e.what();
+      }
+    }//if( manager )
+  }//if( session has been idle long enough )
+  
+  WServer::instance()->schedule( ns_idle_check_interval_ms, sessionId(),
+                                 boost::bind( &InterSpecApp::checkIfIdle, this ) );
+}//void checkIfIdle()
+
+
 void InterSpecApp::notify( const Wt::WEvent& event )
 {
 #if( !BUILD_AS_UNIT_TEST_SUITE )
@@ -1213,6 +1370,7 @@ void InterSpecApp::notify( const Wt::WEvent& event )
       if( duration < std::chrono::seconds(300) )
         m_activeTimeInSession += duration;
       m_lastAccessTime = thistime;
+      m_idleMemoryReleased = false;
     }//if( userEvent )
 
      WApplication::notify( event );
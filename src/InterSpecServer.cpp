@@ -26,11 +26,17 @@
 #include <map>
 #include <mutex>
 #include <string>
+#include <vector>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <sstream>
 #include <fstream>
 #include <cstdlib>
 #include <stdlib.h>
 #include <iostream>
+#include <condition_variable>
 
 
 #if __APPLE__
@@ -39,6 +45,7 @@
 #include <Wt/WApplication>
 #include <Wt/WServer>
 #include <Wt/WResource>
+#include <Wt/WLogger>
 #include <Wt/WIOService>
 #include <Wt/Http/Client>
 #include <Wt/Utils>
@@ -59,14 +66,30 @@
 #include "SpecUtils/SerialToDetectorModel.h"
 
 #include "InterSpec/InterSpec.h"
+#include "InterSpec/DrfSelect.h"
+#include "InterSpec/PeakModel.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/InterSpecApp.h"
+#include "InterSpec/GadrasSpecFunc.h"
+#include "InterSpec/SpecMeasManager.h"
+#include "InterSpec/MoreNuclideInfo.h"
+#include "InterSpec/UndoRedoManager.h"
+#include "InterSpec/SpectraFileModel.h"
+#include "InterSpec/MassAttenuationTool.h"
 #include "InterSpec/DataBaseUtils.h"
 #include "InterSpec/ReactionGamma.h"
 #include "InterSpec/InterSpecServer.h"
+#include "InterSpec/DecayChainChart.h"
 #include "InterSpec/ReferenceLineInfo.h"
 #include "InterSpec/DecayDataBaseServer.h"
 #include "InterSpec/DataBaseVersionUpgrade.h"
 
+#if( USE_BATCH_TOOLS )
+#include "InterSpec/BatchService.h"
+#endif
+
 
 using namespace std;
 
@@ -116,6 +139,378 @@ bool ns_allow_untokened_sessions = true;
   {
     return new InterSpecApp( env );
   }// Wt::WApplication *createApplication(const Wt::WEnvironment& env)
+  
+  
+  /** Reports the approximate memory used by each session, as JSON, at "/admin/memory".
+   
+   Only requests from the local machine are answered.  Each sessions numbers are collected by posting
+   to the session (so its state isnt accessed from this thread), and waiting up to a few seconds for
+   all sessions to respond; sessions that dont respond in time are reported as not responding.
+   */
+  class SessionMemoryResource : public Wt::WResource
+  {
+  public:
+    SessionMemoryResource()
+      : Wt::WResource()
+    {
+    }
+    
+    virtual ~SessionMemoryResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request, Wt::Http::Response &response )
+    {
+      const std::string client = request.clientAddress();
+      if( (client != "127.0.0.1") && (client != "::1") && (client != "::ffff:127.0.0.1") )
+      {
+        response.setStatus( 403 );
+        return;
+      }
+      
+      Wt::WServer *server = Wt::WServer::instance();
+      if( !server )
+      {
+        response.setStatus( 503 );
+        return;
+      }
+      
+      struct Results
+      {
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        size_t m_num_done = 0;
+        std::vector<std::string> m_session_json;
+        size_t m_total_bytes = 0;
+      };//struct Results
+      
+      auto results = std::make_shared<Results>();
+      
+      const std::vector<Wt::WServer::SessionInfo> sessions = server->sessions();
+      for( const Wt::WServer::SessionInfo &info : sessions )
+      {
+        // The session ID is a credential, so we'll only report the start of it.
+        const std::string id = info.sessionId.substr( 0, 8 );
+        
+        auto done = [results]( std::string json, const size_t bytes ){
+          std::lock_guard<std::mutex> lock( results->m_mutex );
+          results->m_num_done += 1;
+          results->m_total_bytes += bytes;
+          if( !json.empty() )
+            results->m_session_json.push_back( std::move(json) );
+          results->m_cv.notify_all();
+        };//done
+        
+        server->post( info.sessionId, [id,done](){
+          InterSpec *viewer = InterSpec::instance();
+          if( !viewer )
+          {
+            done( "", 0 );
+            return;
+          }
+          
+          const SpecMeasManager *manager = viewer->fileManager();
+          const SpectraFileModel *files = manager ? manager->model() : nullptr;
+          const PeakModel *peaks = viewer->peakModel();
+          const UndoRedoManager *undo = viewer->undoRedoManager();
+          
+          const size_t files_size = files ? files->memsize() : size_t(0);
+          const size_t peaks_size = peaks ? peaks->memsize() : size_t(0);
+          const size_t undo_size = undo ? undo->memsize() : size_t(0);
+          const size_t total = files_size + peaks_size + undo_size;
+          
+          std::ostringstream json;
+          json << "{\"session\": \"" << id << "\", \"spectrum_files\": " << files_size
+               << ", \"peak_model\": " << peaks_size << ", \"undo_redo\": " << undo_size
+               << ", \"total\": " << total << "}";
+          done( json.str(), total );
+        }, [done](){ done( "", 0 ); } );
+      }//for( const Wt::WServer::SessionInfo &info : sessions )
+      
+      std::unique_lock<std::mutex> lock( results->m_mutex );
+      results->m_cv.wait_for( lock, std::chrono::seconds(5),
+                              [&results,&sessions](){ return results->m_num_done >= sessions.size(); } );
+      
+      response.setMimeType( "application/json" );
+      response.out() << "{\"num_sessions\": " << sessions.size()
+                     << ", \"num_not_responding\": " << (sessions.size() - results->m_num_done)
+                     << ", \"total_bytes\": " << results->m_total_bytes
+                     << ", \"sessions\": [";
+      for( size_t i = 0; i < results->m_session_json.size(); ++i )
+        response.out() << (i ? ", " : "") << results->m_session_json[i];
+      response.out() << "]}";
+    }//void handleRequest(...)
+  };//class SessionMemoryResource
+  
+  
+  std::unique_ptr<SessionMemoryResource> ns_memory_resource;
+  
+  
+  /** Serves the ServerMetrics counters, gauges, and histograms, in the Prometheus text exposition
+   format, at "/metrics".
+   
+   Only requests from the local machine are answered.  Unlike "/admin/memory", this never posts to
+   sessions, so is cheap enough to be scraped every few seconds.
+   */
+  class MetricsResource : public Wt::WResource
+  {
+  public:
+    MetricsResource()
+      : Wt::WResource()
+    {
+    }
+    
+    virtual ~MetricsResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request, Wt::Http::Response &response )
+    {
+      const std::string client = request.clientAddress();
+      if( (client != "127.0.0.1") && (client != "::1") && (client != "::ffff:127.0.0.1") )
+      {
+        response.setStatus( 403 );
+        return;
+      }
+      
+      static ServerMetrics::Gauge &active_sessions = ServerMetrics::gauge( "interspec_active_sessions",
+                                                          "Number of currently active sessions." );
+      Wt::WServer *server = Wt::WServer::instance();
+      if( server )
+        active_sessions.set( static_cast<double>( server->sessions().size() ) );
+      
+      response.setMimeType( "text/plain; version=0.0.4" );
+      response.addHeader( "Cache-Control", "no-store" );
+      response.out() << ServerMetrics::prometheus_text();
+    }//void handleRequest(...)
+  };//class MetricsResource
+  
+  
+  std::unique_ptr<MetricsResource> ns_metrics_resource;
+  
+  
+#if( PERFORMANCE_TRACING )
+  /** Serves the recorded PerfTrace events, as Chrome trace-event JSON, at "/admin/trace".
+   
+   Only requests from the local machine are answered.  Add a "session" argument with the first
+   eight characters of a session ID (as reported by "/admin/memory") to get just that sessions
+   events, and "clear=1" to discard the events after returning them.
+   */
+  class PerfTraceResource : public Wt::WResource
+  {
+  public:
+    PerfTraceResource()
+      : Wt::WResource()
+    {
+    }
+    
+    virtual ~PerfTraceResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request, Wt::Http::Response &response )
+    {
+      const std::string client = request.clientAddress();
+      if( (client != "127.0.0.1") && (client != "::1") && (client != "::ffff:127.0.0.1") )
+      {
+        response.setStatus( 403 );
+        return;
+      }
+      
+      const std::string *session = request.getParameter( "session" );
+      const std::string *clear = request.getParameter( "clear" );
+      
+      response.setMimeType( "application/json" );
+      response.addHeader( "Cache-Control", "no-store" );
+      response.addHeader( "Content-Disposition", "attachment; filename=\"interspec_trace.json\"" );
+      response.out() << PerfTrace::chrome_trace_json( session ? *session : std::string() );
+      
+      if( clear && ((*clear) == "1") )
+        PerfTrace::clear();
+    }//void handleRequest(...)
+  };//class PerfTraceResource
+  
+  
+  std::unique_ptr<PerfTraceResource> ns_trace_resource;
+#endif //PERFORMANCE_TRACING
+  
+  
+  /** The state of each static data set loaded by #start_warm_up; values are "pending", "ready", or
+   "failed".  Protected by #ns_warm_up_mutex.
+   */
+  std::mutex ns_warm_up_mutex;
+  std::map<std::string,std::string> ns_warm_up_state;
+  std::atomic<size_t> ns_warm_ups_pending( 0 );
+  std::atomic<bool> ns_warm_up_started( false );
+  
+  
+  /** Applies the "analysis-threads" and "analysis-thread-pinning" properties of the Wt config
+   file, if present, to the SharedThreadPool; must be called before any analysis is ran.
+   */
+  void configure_analysis_threads( Wt::WServer *server )
+  {
+    if( !server )
+      return;
+    
+    size_t num_workers = SHARED_THREAD_POOL_WORKERS;
+    bool pin_workers = SHARED_THREAD_POOL_PIN_WORKERS;
+    
+    string value;
+    if( server->readConfigurationProperty( "analysis-threads", value ) )
+    {
+      try
+      {
+        num_workers = static_cast<size_t>( std::stoul( value ) );
+      }catch( std::exception & )
+      {
+        Wt::log("error") << "Invalid 'analysis-threads' config value: '" << value << "'";
+      }
+    }//if( read "analysis-threads" )
+    
+    if( server->readConfigurationProperty( "analysis-thread-pinning", value ) )
+      pin_workers = ((value == "true") || (value == "1"));
+    
+    if( !SharedThreadPool::configure( num_workers, pin_workers ) )
+      Wt::log("warning") << "Analysis thread pool was started before it could be configured.";
+  }//void configure_analysis_threads( Wt::WServer *server )
+  
+  
+  /** Posts loading the process-wide static data (nuclear data, cross-sections, etc.) to the server
+   thread pool, each data set as its own job so they load in parallel; this way the first session
+   to use them doesnt have to wait on parsing them.
+   
+   Must be called after the server is started.
+   */
+  void start_warm_up( Wt::WServer *server )
+  {
+    if( !server || ns_warm_up_started )
+      return;
+    
+    vector<pair<string,function<void()>>> tasks;
+    
+    // See remarks in startServer() on the timing of initializing the decay database.
+    tasks.emplace_back( "decay-database", [](){
+      DecayDataBaseServer::database();
+      ReferenceLineInfo::load_nuclide_mixtures();
+    } );
+    
+    // The reaction gamma database depends on the decay database, so this will mostly just wait
+    //  on the above, but it avoids the first session that shows a reaction having to parse it.
+    tasks.emplace_back( "reaction-gammas", [](){ ReactionGammaServer::database(); } );
+    
+    tasks.emplace_back( "languages", [](){ InterSpecApp::languagesAvailable(); } );
+    
+    // Each session copies its materials from this database, rather than parsing the file itself.
+    tasks.emplace_back( "materials", [](){ InterSpec::staticMaterialDb(); } );
+    
+#if( !IOS && !ANDROID )
+    // On mobile platforms we'll save the memory of data sets the user may not use.
+    tasks.emplace_back( "gamma-index", [](){ EnergyToNuclideServer::gammaIndex(); } );
+    
+    tasks.emplace_back( "more-nuclide-info", [](){
+      if( !MoreNuclideInfo::MoreNucInfoDb::instance() )
+        throw runtime_error( "failed to load" );
+    } );
+    
+    // Any valid coefficient request loads the cross-section data for all elements.
+    tasks.emplace_back( "cross-sections", [](){
+      MassAttenuation::massAttenuationCoeficient( 26, 661.0f );
+    } );
+    
+    tasks.emplace_back( "drf-index", [](){ DrfSelect::indexGenericGadrasDetectors(); } );
+    
+    tasks.emplace_back( "scatter-table", [](){
+      GadrasScatterTable::instance( SpecUtils::append_path( InterSpec::staticDataDirectory(), "GadrasContinuum.lib" ) );
+    } );
+#endif
+    
+    {
+      std::lock_guard<std::mutex> lock( ns_warm_up_mutex );
+      for( const auto &task : tasks )
+        ns_warm_up_state[task.first] = "pending";
+    }
+    ns_warm_ups_pending = tasks.size();
+    ns_warm_up_started = true;
+    
+    for( const auto &task : tasks )
+    {
+      const string name = task.first;
+      const function<void()> load = task.second;
+      
+      server->ioService().boost::asio::io_service::post( [name,load](){
+        const auto start = std::chrono::steady_clock::now();
+        string state = "ready";
+        try
+        {
+          load();
+        }catch( std::exception &e )
+        {
+          state = "failed";
+          Wt::log("error") << "Failed to warm up " << name << ": " << e.what();
+        }
+        
+        const auto end = std::chrono::steady_clock::now();
+        Wt::log("info") << "Warm up of " << name << " " << state << " after "
+                        << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms";
+        
+        {
+          std::lock_guard<std::mutex> lock( ns_warm_up_mutex );
+          ns_warm_up_state[name] = state;
+        }
+        ns_warm_ups_pending -= 1;
+      } );
+    }//for( const auto &task : tasks )
+  }//void start_warm_up( Wt::WServer *server )
+  
+  
+  /** Readiness probe: returns HTTP 200 once every static data set posted by #start_warm_up has
+   finished loading (or failed to load - a missing optional data file shouldnt keep the server out
+   of service), or 503 while any are still loading.  The body gives the state of each data set.
+   */
+  class WarmUpReadinessResource : public Wt::WResource
+  {
+  public:
+    WarmUpReadinessResource()
+      : Wt::WResource()
+    {
+    }
+    
+    virtual ~WarmUpReadinessResource()
+    {
+      beingDeleted();
+    }
+    
+    virtual void handleRequest( const Wt::Http::Request &request, Wt::Http::Response &response )
+    {
+      const bool ready = ns_warm_up_started && (ns_warm_ups_pending == 0);
+      
+      response.setStatus( ready ? 200 : 503 );
+      response.setMimeType( "application/json" );
+      response.addHeader( "Cache-Control", "no-store" );
+      
+      response.out() << "{\"ready\": " << (ready ? "true" : "false") << ", \"data\": {";
+      
+      std::lock_guard<std::mutex> lock( ns_warm_up_mutex );
+      for( auto iter = begin(ns_warm_up_state); iter != end(ns_warm_up_state); ++iter )
+        response.out() << (iter == begin(ns_warm_up_state) ? "" : ", ")
+                       << "\"" << iter->first << "\": \"" << iter->second << "\"";
+      response.out() << "}}";
+    }//void handleRequest(...)
+  };//class WarmUpReadinessResource
+  
+  
+  std::unique_ptr<WarmUpReadinessResource> ns_readiness_resource;
+  
+  
+  void add_readiness_resource( Wt::WServer *server )
+  {
+    if( !ns_readiness_resource )
+      ns_readiness_resource.reset( new WarmUpReadinessResource() );
+    server->addResource( ns_readiness_resource.get(), "/ready" );
+  }//void add_readiness_resource( Wt::WServer *server )
 }
 
 namespace InterSpecServer
@@ -127,6 +522,9 @@ namespace InterSpecServer
   Wt::WServer *ns_server = nullptr;
   std::mutex ns_servermutex;
   
+  /** Protected by ns_servermutex. */
+  std::string ns_session_id_prefix;
+  
   
   int portBeingServedOn()
   {
@@ -275,9 +673,12 @@ namespace InterSpecServer
     
     ns_server->addEntryPoint( Wt::Application, boost::bind( &createAppForServer, _1, createApplication ) );
     
+    DecayChainChart::addJsonResourceToServer( ns_server );
+    add_readiness_resource( ns_server );
+    
     if( ns_server->start() )
     {
-      // Start initializing DecayDataBaseServer.
+      // Start initializing DecayDataBaseServer, and the other static data.
       //  Previous to 20230203, we did this in the beginning of InterSpecApp constructor.
       //  On a 2019 macBook pro, release build of the native app, it took about 485 ms from the
       //  start of starting the server, to when the decay database was done initializing.
@@ -289,12 +690,8 @@ namespace InterSpecServer
       //  to wait to access the database.
       //  Using the minimized coincidence version of sandia.decay.xml increases parse time
       //  by about 170 ms.
-      ns_server->ioService().boost::asio::io_service::post( &DecayDataBaseServer::initialize );
-      
-      // Checking for available languages probably doesnt take too long, but lets do it now anyway.
-      ns_server->ioService().boost::asio::io_service::post( [](){
-        InterSpecApp::languagesAvailable();
-      } );
+      configure_analysis_threads( ns_server );
+      start_warm_up( ns_server );
       
       const int port = ns_server->httpPort();
       std::string this_url = "http://127.0.0.1:" + boost::lexical_cast<string>(port);
@@ -361,31 +758,54 @@ namespace InterSpecServer
     char accesslog_param_value[]  = "--accesslog=-";  //quite down printing all the GET and POST and such
 
     
-    char *argv_wthttp[] = { exe_param_name,
+    std::vector<char *> argv_wthttp = { exe_param_name,
       httpaddr_param_name, httpaddr_param_value,
       httpport_param_name, httpport_param_value,
       docroot_param_name, docroot_param_value,
       approot_param_name, approot_param_value,
       accesslog_param_value
     };
-    const int argc_wthttp = sizeof(argv_wthttp)/sizeof(argv_wthttp[0]);
     
-    ns_server->setServerConfiguration( argc_wthttp, argv_wthttp, WTHTTP_CONFIGURATION );
+    char sessionprefix_param_name[] = "--session-id-prefix";
+    std::string sessionprefix_param_value = ns_session_id_prefix;
+    if( !sessionprefix_param_value.empty() )
+    {
+      argv_wthttp.push_back( sessionprefix_param_name );
+      argv_wthttp.push_back( &(sessionprefix_param_value[0]) );
+    }
+    
+    const int argc_wthttp = static_cast<int>( argv_wthttp.size() );
+    
+    ns_server->setServerConfiguration( argc_wthttp, &(argv_wthttp[0]), WTHTTP_CONFIGURATION );
     
     ns_server->addEntryPoint( Wt::Application, boost::bind( &createAppForServer, _1, create_application ) );
     
+    if( !ns_memory_resource )
+      ns_memory_resource.reset( new SessionMemoryResource() );
+    ns_server->addResource( ns_memory_resource.get(), "/admin/memory" );
+    
+    if( !ns_metrics_resource )
+      ns_metrics_resource.reset( new MetricsResource() );
+    ns_server->addResource( ns_metrics_resource.get(), "/metrics" );
+    
+#if( USE_BATCH_TOOLS )
+    BatchService::add_resources_to_server( ns_server );
+#endif
+    
+#if( PERFORMANCE_TRACING )
+    if( !ns_trace_resource )
+      ns_trace_resource.reset( new PerfTraceResource() );
+    ns_server->addResource( ns_trace_resource.get(), "/admin/trace" );
+#endif
+    
+    DecayChainChart::addJsonResourceToServer( ns_server );
+    add_readiness_resource( ns_server );
+    
     if( ns_server->start() )
     {
       // See remarks in startServer() on performance and reason for this next call
-      ns_server->ioService().boost::asio::io_service::post( [](){
-        DecayDataBaseServer::initialize();
-        ReferenceLineInfo::load_nuclide_mixtures();
-      } );
-      
-      // Checking for available languages probably doesnt take too long, but lets do it now anyway.
-      ns_server->ioService().boost::asio::io_service::post( [](){
-        InterSpecApp::languagesAvailable();
-      } );
+      configure_analysis_threads( ns_server );
+      start_warm_up( ns_server );
       
       const int port = ns_server->httpPort();
       assert( !server_port_num || (server_port_num == port) );
@@ -686,6 +1106,15 @@ int start_server( const char *process_name,
   }//bool allow_untokened_sessions()
 
 
+  void set_session_id_prefix( const std::string &prefix )
+  {
+    std::lock_guard<std::mutex> serverlock( ns_servermutex );
+    if( ns_server )
+      throw std::logic_error( "set_session_id_prefix: must be called before the server is started" );
+    ns_session_id_prefix = prefix;
+  }//void set_session_id_prefix( const std::string &prefix )
+  
+  
   void set_require_tokened_sessions( const bool require )
   {
     lock_guard<mutex> lock( ns_sessions_mutex );
@@ -813,13 +1242,25 @@ int start_server( const char *process_name,
       int numopened = 0;
       Wt::WApplication::UpdateLock applock( app );
       
-      for( const string &filename : files )
+      InterSpec *viewer = app->viewer();
+      SpecMeasManager *manager = viewer ? viewer->fileManager() : nullptr;
+      
+      if( (files.size() > 1) && manager )
       {
-        if( app->userOpenFromFileSystem( filename ) )
-          numopened += 1;
-        else
-          cerr << "InterSpec failed to open file: '" << filename << "'" << endl;
-      }
+        // Files are parsed concurrently, and opened asynchronously, so we'll count them all as
+        //  opened; any failures are reported to the user by the SpecMeasManager.
+        manager->openFilesFromFilesystem( files );
+        numopened += static_cast<int>( files.size() );
+      }else
+      {
+        for( const string &filename : files )
+        {
+          if( app->userOpenFromFileSystem( filename ) )
+            numopened += 1;
+          else
+            cerr << "InterSpec failed to open file: '" << filename << "'" << endl;
+        }
+      }//if( multiple files ) / else
       
       for( const string &url : appurls )
       {
@@ -895,6 +1336,43 @@ int start_server( const char *process_name,
 
     return used;
   }//pass_app_url_to_session(....)
+  
+  
+  int append_file_to_session( const char *session_token, const std::string &file_path )
+  {
+    // Parse the file before locking the session, so the GUI isnt blocked while we do this.
+    SpecUtils::SpecFile spec;
+    if( !SpecUtils::is_file( file_path ) || !spec.load_file( file_path, SpecUtils::ParserType::Auto, file_path ) )
+    {
+      cerr << "append_file_to_session: failed to parse '" << file_path << "'" << endl;
+      return -1;
+    }
+    
+    vector<shared_ptr<SpecUtils::Measurement>> meas;
+    for( const shared_ptr<const SpecUtils::Measurement> &m : spec.measurements() )
+    {
+      if( m )
+        meas.push_back( make_shared<SpecUtils::Measurement>( *m ) );
+    }
+    
+    InterSpecApp *app = InterSpecApp::instanceFromExtenalToken( session_token );
+    if( !app )
+    {
+      cerr << "append_file_to_session: failed to find session with token '" << session_token << "'" << endl;
+      return -2;
+    }
+    
+    Wt::WApplication::UpdateLock applock( app );
+    
+    InterSpec *viewer = app->viewer();
+    if( !viewer || !viewer->measurment(SpecUtils::SpectrumType::Foreground) )
+      return 0;
+    
+    const set<int> added = viewer->appendForegroundMeasurements( meas );
+    app->triggerUpdate();
+    
+    return static_cast<int>( added.size() );
+  }//int append_file_to_session(...)
 
 
 void set_file_to_open_on_load( const char *session_token, const std::string file_path )
@@ -36,8 +36,10 @@
 #include <boost/iostreams/device/back_inserter.hpp>
 
 
+#include <Wt/Utils>
 #include <Wt/Dbo/Dbo>
 #include <Wt/WSpinBox>
+#include <Wt/WServer>
 #include <Wt/WCheckBox>
 #include <Wt/WApplication>
 #include <Wt/WRadioButton>
@@ -82,6 +84,24 @@ using namespace Wt;
 using namespace std;
 
 
+#if( ALLOW_SAVE_TO_DB_COMPRESSION )
+namespace
+{
+  /** The zlib compression level used when writing spectrum files to the database.
+   
+   Files are re-serialized to the database on every auto-save and state save, so compression CPU
+   time matters: for N42 channel-data XML, level 3 compresses ~6x faster than the zlib default (6),
+   while the result is only ~4% larger.  The output is still plain gzip, so this has no effect on
+   reading back files already in the database.
+   */
+  const int ns_db_gzip_level = 3;
+  
+  /** The buffer size to use for the gzip filters; the boost::iostreams default for filters is only
+   128 bytes, which causes a lot of per-call overhead for multi-megabyte N42 files.
+   */
+  const std::streamsize ns_db_gzip_buffer_size = 64*1024;
+}//namespace
+#endif //ALLOW_SAVE_TO_DB_COMPRESSION
 
 
 namespace Wt
@@ -348,6 +368,7 @@ void mapDbClasses( Wt::Dbo::Session *session )
   session->mapClass<UserOption>( "UserOption" );
   session->mapClass<UserFileInDb>( "UserFileInDb" );
   session->mapClass<UserFileInDbData>( "UserFileInDbData" );
+  session->mapClass<SpectrumFileBlob>( "SpectrumFileBlob" );
   session->mapClass<ShieldingSourceModel>( "ShieldingSourceModel" );
   session->mapClass<UserState>( "UserState" );
   session->mapClass<DetectorPeakResponse>( "DetectorPeakResponse");
@@ -356,6 +377,67 @@ void mapDbClasses( Wt::Dbo::Session *session )
 }//void mapDbClasses( Wt::Dbo::Session *session )
 
 
+void createDbIndices( Wt::Dbo::Session *session )
+{
+  struct IndexDef
+  {
+    const char *name;
+    const char *table;
+    bool unique;
+    
+    /** Comma separated, unquoted, column names. */
+    const char *sqlite_columns;
+    
+    /** MySQL can only index the first N characters of a TEXT column, so they need a length. */
+    const char *mysql_columns;
+  };//struct IndexDef
+  
+  const IndexDef indices[] = {
+    { "UserState_user_type_time", "UserState", false,
+      "InterSpecUser_id, StateType, SerializeTime", "InterSpecUser_id, StateType, SerializeTime" },
+    { "UserFileInDb_user_time", "UserFileInDb", false,
+      "InterSpecUser_id, UploadTime", "InterSpecUser_id, UploadTime" },
+    { "SpectrumFileBlob_hash", "SpectrumFileBlob", true, "ContentHash", "ContentHash" },
+    { "UserFileInDbData_blob_hash", "UserFileInDbData", false, "BlobHash", "BlobHash(64)" }
+  };
+  
+  for( const IndexDef &index : indices )
+  {
+    string sql;
+    
+    try
+    {
+      Wt::Dbo::Transaction transaction( *session );
+      
+#if( USE_MYSQL_DB )
+      // MySQL doesnt support "IF NOT EXISTS" for indices, so check for it first.
+      const int nexisting = session->query<int>( "SELECT COUNT(1) FROM information_schema.statistics"
+                                                 " WHERE table_schema = DATABASE() AND table_name = ?"
+                                                 " AND index_name = ?" )
+                                    .bind( string(index.table) )
+                                    .bind( string(index.name) );
+      if( nexisting == 0 )
+      {
+        sql = string("CREATE ") + (index.unique ? "UNIQUE " : "") + "INDEX `" + index.name
+              + "` ON `" + index.table + "` (" + index.mysql_columns + ")";
+        session->execute( sql );
+      }
+#else
+      sql = string("CREATE ") + (index.unique ? "UNIQUE " : "") + "INDEX IF NOT EXISTS \""
+            + index.name + "\" ON \"" + index.table + "\" (" + index.sqlite_columns + ")";
+      session->execute( sql );
+#endif
+      
+      transaction.commit();
+    }catch( std::exception &e )
+    {
+      cerr << "createDbIndices: failed to create index " << index.name << " on " << index.table
+           << (sql.empty() ? string() : (" using '" + sql + "'")) << ": " << e.what() << endl;
+    }
+  }//for( const IndexDef &index : indices )
+}//void createDbIndices( Wt::Dbo::Session *session )
+
+
 UserState::UserState()
   : stateType( kUndefinedStateType ),
     creationTime( Wt::WDateTime::currentDateTime() ),
@@ -434,28 +516,127 @@ boost::any InterSpecUser::preferenceValueAny( const std::string &name, InterSpec
   if( pos != prefs.end() )
     return pos->second;
   
-  UserOption *option_raw = getDefaultUserPreference( name, user->m_deviceType );
-  Wt::Dbo::ptr<UserOption> option( option_raw );
-  option.modify()->m_user = user;
+  // Preference not yet used by this user; use the default value, and record it to the database
+  //  after the current event is handled, so rendering doesnt wait on a database transaction.
+  std::unique_ptr<UserOption> option( getDefaultUserPreference( name, user->m_deviceType ) );
+  const boost::any value = option->value();
+  
+  queuePreferenceWrite( user, name, option->m_type, option->m_value, viewer );
   
+  return value;
+}//boost::any preferenceValue( const std::string &name, InterSpec *viewer );
+
+
+void InterSpecUser::queuePreferenceWrite( Wt::Dbo::ptr<InterSpecUser> user,
+                                          const std::string &name,
+                                          const UserOption::DataType type,
+                                          const std::string &value,
+                                          InterSpec *viewer )
+{
+  UserOption option;
+  option.m_name = name;
+  option.m_type = type;
+  option.m_value = value;
+  user->m_preferences[name] = option.value();
+  
+  user->m_pendingPreferenceWrites[name] = std::make_pair( type, value );
+  
+  Wt::WApplication *app = Wt::WApplication::instance();
+  Wt::WServer *server = Wt::WServer::instance();
+  if( !app || !server )
+  {
+    flushPendingPreferenceWrites( viewer );
+    return;
+  }
+  
+  if( user->m_preferenceWriteScheduled )
+    return;
+  
+  user->m_preferenceWriteScheduled = true;
+  
+  // Posted functions are executed with the session lock held, once the current event is done,
+  //  so we dont need to worry about concurrent Dbo::Session access.
+  server->post( app->sessionId(), [](){
+    InterSpec *viewer = InterSpec::instance();
+    if( viewer )
+      flushPendingPreferenceWrites( viewer );
+  } );
+}//void queuePreferenceWrite(...)
+
+
+void InterSpecUser::flushPendingPreferenceWrites( InterSpec *viewer )
+{
+  Dbo::ptr<InterSpecUser> &user = userFromViewer( viewer );
+  std::shared_ptr<DataBaseUtils::DbSession> sql = sqlFromViewer( viewer );
+  if( !user || !sql )
+    return;
+  
+  user->m_preferenceWriteScheduled = false;
+  if( user->m_pendingPreferenceWrites.empty() )
+    return;
+  
+  std::map<std::string,std::pair<UserOption::DataType,std::string>> pending;
+  pending.swap( user->m_pendingPreferenceWrites );
+  
+  for( const auto &name_val : pending )
+  {
+    try
+    {
+      writePreferenceToDb( user, sql, name_val.first, name_val.second.first, name_val.second.second );
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to write preference '" << name_val.first << "' to database: "
+           << e.what() << endl;
+    }//try / catch
+  }//for( const auto &name_val : pending )
+}//void flushPendingPreferenceWrites( InterSpec *viewer )
+
+
+void InterSpecUser::writePreferenceToDb( Wt::Dbo::ptr<InterSpecUser> user,
+                                         std::shared_ptr<DataBaseUtils::DbSession> sql,
+                                         const std::string &name,
+                                         const UserOption::DataType type,
+                                         const std::string &value )
+{
   DataBaseUtils::DbTransaction transaction( *sql );
-  boost::any value;
-  try
+  
+  vector< Dbo::ptr<UserOption> > options;
+  Dbo::collection< Dbo::ptr<UserOption> > optioncol
+                             = user->m_dbPreferences.find().where( "name=?" ).bind( name );
+  std::copy( optioncol.begin(), optioncol.end(), std::back_inserter(options) );
+  
+  const size_t noptions = options.size();
+  if( noptions == 0 )
   {
-    sql->session()->add( option );
-    value = option->value();
-    user->m_preferences[name] = value;
-  }catch( std::exception &e )
+    UserOption *newoption = new UserOption();
+    newoption->m_name = name;
+    newoption->m_user = user;
+    newoption->m_type = type;
+    newoption->m_value = value;
+    sql->session()->add( newoption );
+  }else
   {
-    //
-    transaction.rollback();
-    throw e;
-  }//try / catch
+    if( noptions > 1 )
+    {
+      //Hmmm, not sure how this happened, but I have made it here for "ColorThemeIndex".
+      //  We will take the first option and remove the rest.
+#if( PERFORM_DEVELOPER_CHECKS )
+      char buffer[1024];
+      snprintf( buffer, sizeof(buffer), "Invalid number of preferences (%i) for %s for user %s; will"
+                                        " remove all of them after the first from the database.",
+                static_cast<int>(noptions), name.c_str(), user->userName().c_str() );
+      log_developer_error( __func__, buffer );
+#endif
+      for( size_t i = 1; i < noptions; ++i )
+        options[i].remove();
+    }//if( noptions > 1 )
+    
+    if( options.front()->m_value != value )
+      options.front().modify()->m_value = value;
+  }//if( noptions == 0 ) / else
   
   transaction.commit();
-  
-  return value;
-}//boost::any preferenceValue( const std::string &name, InterSpec *viewer );
+}//void writePreferenceToDb(...)
 
 
 boost::any InterSpecUser::preferenceValueAny( const std::string &name ) const
@@ -615,6 +796,7 @@ void UserFileInDbData::setFileData( const std::string &path,
                                     const SerializedFileFormat format )
 {
   fileData.clear();
+  blobHash.clear();
 #ifdef _WIN32
   const std::wstring wpath = SpecUtils::convert_from_utf8_to_utf16(path);
   std::ifstream file( wpath.c_str() );
@@ -643,9 +825,9 @@ void UserFileInDbData::setFileData( const std::string &path,
       throw FileToLargeForDbException( filelen, pre_mem_size_size );
 
     io::filtering_ostream compressor;
-    compressor.push( io::gzip_compressor() );
+    compressor.push( io::gzip_compressor( io::gzip_params(ns_db_gzip_level) ), ns_db_gzip_buffer_size );
     compressor.push( io::back_inserter( fileData ) );
-    io::copy( file, compressor );  //default uses 4 kb buffer
+    io::copy( file, compressor, ns_db_gzip_buffer_size );
     
     if( format == UserFileInDbData::k2012N42 )
       compressor << static_cast<unsigned char>(0);
@@ -755,6 +937,11 @@ Dbo::ptr<UserFileInDb> UserFileInDb::makeDeepWriteProtectedCopyInDatabase(
     for( Dbo::collection< Dbo::ptr<UserFileInDbData> >::const_iterator iter = orig->filedata.begin();
         iter != orig->filedata.end(); ++iter )
     {
+      // Move the original data into the content-addressed blob table (if it isnt already), so the
+      //  copy will just reference the same bytes.
+      if( (*iter)->blobHash.empty() && !(*iter)->fileData.empty() )
+        iter->modify()->moveDataToBlobStore( *session );
+      
       UserFileInDbData *newdata = new UserFileInDbData( **iter );
       newdata->fileInfo = answer;
       session->add( newdata );
@@ -900,6 +1087,7 @@ void UserFileInDbData::setFileData( std::shared_ptr<const SpecMeas> spectrumFile
     return;
   
   fileData.clear();
+  blobHash.clear();
   const size_t memsize = spectrumFile->memmorysize();
     
   //XXX - below guess on how much memorry to reserve is based on almost
@@ -924,7 +1112,7 @@ void UserFileInDbData::setFileData( std::shared_ptr<const SpecMeas> spectrumFile
     gzipCompressed = true;
     io::stream_buffer< io::back_insert_device< FileData_t > > buff( fileData );
     io::filtering_stream<io::output> outStream;
-    outStream.push( io::gzip_compressor() );
+    outStream.push( io::gzip_compressor( io::gzip_params(ns_db_gzip_level) ), ns_db_gzip_buffer_size );
     outStream.push( buff );
 #else
     gzipCompressed = false;
@@ -957,6 +1145,97 @@ void UserFileInDbData::setFileData( std::shared_ptr<const SpecMeas> spectrumFile
 }//void UserFileInDbData::setFileData( std::shared_ptr<SpecMeas> spectrumFile )
 
 
+std::string SpectrumFileBlob::hashOf( const FileData_t &data )
+{
+  const string bytes( data.begin(), data.end() );
+  return Wt::Utils::hexEncode( Wt::Utils::sha1(bytes) ) + "-" + std::to_string( data.size() );
+}//std::string hashOf( const FileData_t &data )
+
+
+void UserFileInDbData::moveDataToBlobStore( Wt::Dbo::Session &session )
+{
+  if( !blobHash.empty() || fileData.empty() )
+    return;
+  
+  const string hash = SpectrumFileBlob::hashOf( fileData );
+  
+  const auto blob_exists = [&session,&hash]() -> bool {
+    const int nblob = session.query<int>( "select count(1) from SpectrumFileBlob where ContentHash = ?" )
+                             .bind( hash );
+    return (nblob > 0);
+  };//blob_exists lambda
+  
+  if( !blob_exists() )
+  {
+    // We insert the row directly, rather than through session.add(...), so if another session
+    //  inserted the same contents since we checked (ContentHash has a unique index), we can catch
+    //  the failure here, and just use their entry, without leaving an un-insertable object in
+    //  this session to make the commit fail.
+    try
+    {
+      session.execute( "insert into SpectrumFileBlob (version, ContentHash, FileData) values (0, ?, ?)" )
+             .bind( hash )
+             .bind( fileData );
+    }catch( std::exception &e )
+    {
+      if( !blob_exists() )
+        throw runtime_error( "Failed to add spectrum data to SpectrumFileBlob table: " + string(e.what()) );
+    }//try / catch
+  }//if( !blob_exists() )
+  
+  fileData.clear();
+  blobHash = hash;
+}//void moveDataToBlobStore( Wt::Dbo::Session &session )
+
+
+void UserFileInDbData::removeBlobIfUnreferenced( Wt::Dbo::Session &session, const std::string &hash )
+{
+  if( hash.empty() )
+    return;
+  
+  const int nref = session.query<int>( "select count(1) from UserFileInDbData where BlobHash = ?" )
+                          .bind( hash );
+  if( nref == 0 )
+    session.execute( "delete from SpectrumFileBlob where ContentHash = ?" ).bind( hash );
+}//void removeBlobIfUnreferenced(...)
+
+
+void UserFileInDbData::removeUnreferencedBlobs( Wt::Dbo::Session &session )
+{
+  Wt::Dbo::Transaction transaction( session );
+  session.execute( "delete from SpectrumFileBlob where ContentHash not in"
+                   " (select BlobHash from UserFileInDbData where BlobHash <> '')" );
+  transaction.commit();
+}//void removeUnreferencedBlobs( Wt::Dbo::Session &session )
+
+
+std::shared_ptr<SpecMeas> UserFileInDbData::decodeSpectrum( DataBaseUtils::DbSession &sql ) const
+{
+  if( blobHash.empty() )
+    return decodeSpectrum();
+  
+  UserFileInDbData resolved;
+  resolved.gzipCompressed = gzipCompressed;
+  resolved.fileFormat = fileFormat;
+  
+  {//begin interact with database
+    DataBaseUtils::DbTransaction transaction( sql );
+    Dbo::ptr<SpectrumFileBlob> blob = sql.session()->find<SpectrumFileBlob>()
+                                                    .where( "ContentHash = ?" )
+                                                    .bind( blobHash )
+                                                    .limit( 1 )
+                                                    .resultValue();
+    if( !blob )
+      throw runtime_error( "UserFileInDbData::decodeSpectrum(): spectrum data for '"
+                           + blobHash + "' missing from database" );
+    resolved.fileData = blob->fileData;
+    transaction.commit();
+  }//end interact with database
+  
+  return resolved.decodeSpectrum();
+}//std::shared_ptr<SpecMeas> decodeSpectrum( DataBaseUtils::DbSession &sql ) const
+
+
 std::shared_ptr<SpecMeas> UserFileInDbData::decodeSpectrum() const
 {
   namespace io = boost::iostreams;
@@ -964,6 +1243,9 @@ std::shared_ptr<SpecMeas> UserFileInDbData::decodeSpectrum() const
 
   try
   {
+    if( !blobHash.empty() )
+      throw runtime_error( "data is held in SpectrumFileBlob table" );
+    
     if( !fileData.size() )
       throw runtime_error( "no data" );
     
@@ -981,7 +1263,7 @@ std::shared_ptr<SpecMeas> UserFileInDbData::decodeSpectrum() const
 #if( ALLOW_SAVE_TO_DB_COMPRESSION )
       io::filtering_stream<io::input> *instrmptr = new io::filtering_stream<io::input>();
       instrm.reset( instrmptr );
-      instrmptr->push( io::gzip_decompressor() );
+      instrmptr->push( io::gzip_decompressor(), ns_db_gzip_buffer_size );
       instrmptr->push( boost::make_iterator_range( start, end ) );
 #else
       throw runtime_error( "InterSpec built without zlip support,"
@@ -1063,6 +1345,7 @@ boost::any UserOption::value() const
 
 
 InterSpecUser::InterSpecUser()
+  : m_preferenceWriteScheduled( false )
 {
 }
 
@@ -1073,7 +1356,8 @@ InterSpecUser::InterSpecUser( const std::string &username,
    m_deviceType( type ),
    m_accessCount( 0 ),
    m_spectraFilesOpened( 0 ),
-   m_firstAccessUTC( boost::posix_time::second_clock::universal_time() )
+   m_firstAccessUTC( boost::posix_time::second_clock::universal_time() ),
+   m_preferenceWriteScheduled( false )
 {
 }//InterSpecUser::InterSpecUser(...)
 
@@ -1464,6 +1748,8 @@ void InterSpecUser::restoreUserPrefsFromXml(
   
   vector< Dbo::ptr<UserOption> > options;
   
+  flushPendingPreferenceWrites( viewer );
+  
   {//begin codeblock to retrieve prefernces from database
     std::shared_ptr<DataBaseUtils::DbSession> sql = viewer->sql();
     DataBaseUtils::DbTransaction transaction( *sql );
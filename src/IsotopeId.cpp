@@ -24,15 +24,19 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <cmath>
 #include <mutex>
+#include <cfloat>
 #include <vector>
 #include <string>
+#include <algorithm>
 
 #include <Wt/WServer>
 
 #include "SandiaDecay/SandiaDecay.h"
 
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/PeakFit.h"
 #include "SpecUtils/SpecFile.h"
 #include "InterSpec/IsotopeId.h"
@@ -154,6 +158,33 @@ const vector<tuple<string, const SandiaDecay::Nuclide *, float>> &characteristic
 }//const vector<...> &characteristicGammas()
 
 
+/** Returns the range of (energy sorted) #characteristicGammas() entries with energy in
+ `[lower_energy, upper_energy]`, found by binary search.
+ 
+ The returned iterators stay valid for the life of the process, since the vector is only filled
+ once, on first use, and never modified after that.
+ */
+pair<vector<tuple<string, const SandiaDecay::Nuclide *, float>>::const_iterator,
+     vector<tuple<string, const SandiaDecay::Nuclide *, float>>::const_iterator>
+characteristicGammasInRange( const float lower_energy, const float upper_energy )
+{
+  typedef tuple<string, const SandiaDecay::Nuclide *, float> CharLine_t;
+  const vector<CharLine_t> &lines = characteristicGammas();
+  
+  const auto begin_pos = std::lower_bound( begin(lines), end(lines), lower_energy,
+                                          []( const CharLine_t &line, const float energy ) -> bool {
+    return get<2>(line) < energy;
+  } );
+  
+  const auto end_pos = std::upper_bound( begin_pos, end(lines), upper_energy,
+                                        []( const float energy, const CharLine_t &line ) -> bool {
+    return energy < get<2>(line);
+  } );
+  
+  return { begin_pos, end_pos };
+}//characteristicGammasInRange(...)
+
+
 
 std::mutex sm_PhotPeakLis_mutex;
 bool sm_PhotPeakLis_inited = false;
@@ -505,26 +536,25 @@ map<const SandiaDecay::Nuclide *, int> characteristics(
       std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks )
 {
   //Now go through CharacteristicGammas.txt, and possibly augment weights
-  const vector<tuple<string, const SandiaDecay::Nuclide *, float>> &characlines = characteristicGammas();
-  
   map<const SandiaDecay::Nuclide *, int> answer;
   
   for( std::shared_ptr<const PeakDef> peak : *all_peaks )
   {
     const double lowe = (peak->gausPeak() ? (peak->mean()-1.5*peak->sigma()) : peak->lowerX());
     const double highe = (peak->gausPeak() ? (peak->mean() + 1.5*peak->sigma()) : peak->upperX());
-    for( const tuple<string, const SandiaDecay::Nuclide *, float> &enp : characlines )
+    
+    // The comparisons below are done in double precision, so we'll widen the binary-search range
+    //  by a float ulp to not miss lines the float comparisons would exclude.
+    const auto range = characteristicGammasInRange( std::nextafter(static_cast<float>(lowe), -FLT_MAX),
+                                                    std::nextafter(static_cast<float>(highe), FLT_MAX) );
+    for( auto iter = range.first; iter != range.second; ++iter )
     {
-      const float energy = get<2>(enp);
-      const SandiaDecay::Nuclide *nuc = get<1>(enp);
+      const float energy = get<2>(*iter);
+      const SandiaDecay::Nuclide *nuc = get<1>(*iter);
       
       if( nuc && (energy >= lowe) && (energy <= highe) )
-      {
-        if( answer.find(nuc) == answer.end() )
-          answer[nuc] = 0;
-        answer[nuc] = answer[nuc] + 1;
-      }
-    }//for( const EnergyNucPair &enp : characlines )
+        answer[nuc] += 1;
+    }//for( loop over characteristic lines near the peak )
   }//for( std::shared_ptr<const PeakDef> peak : all_peaks )
   
   return answer;
@@ -539,133 +569,224 @@ map<const SandiaDecay::Nuclide *, int> characteristics(
 
 
 
-double fractionDetectedWeight( const std::vector<SandiaDecay::EnergyRatePair> &source_gammas, //normailization doent matter
-                           std::shared_ptr<const DetectorPeakResponse> response,
-                           double shielding_an,
-                           double shielding_ad,
-                           std::shared_ptr<const SpecUtils::Measurement> data,
-                           std::shared_ptr<const PeakDef> test_peak,
-                           std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks
-                          )
+namespace
 {
-  //loop over all expected gamma lines for nuclide, and count the fraction of
-  //  counts expected to be detected, that actually where
-  //  -if photopeak exists under a peak, then assume photopeak was detectable if
-  //   expected counts is greater than 2.33*continuum_area.
-  //  -if photopeak is not under a detected peak, assume photopeak was
-  //   detectable if its counts is greater than 2.33*data_area in region.
-  
-  //get all gammas between +-1.5 sigma of the mean;
-  const double mean  = test_peak->mean();
-  const double lowE  = (test_peak->gausPeak() ? (mean-1.5*fabs(test_peak->sigma())) : test_peak->lowerX());
-  const double highE = (test_peak->gausPeak() ? (mean+1.5*fabs(test_peak->sigma())) : test_peak->upperX());
-  const double distance = 1.0*PhysicalUnits::m;
-  const bool hasResolutionResponse = (!!response && response->hasResolutionInfo());
-  
-  
-  vector<SandiaDecay::EnergyRatePair>::const_iterator start, end, iter;
-  
-  SandiaDecay::EnergyRatePair aep( 0.0, lowE );
-  start = lower_bound( source_gammas.begin(), source_gammas.end(), aep,
-                         &SandiaDecay::EnergyRatePair::lessThanByEnergy );
-  aep.energy = highE;
-  end = upper_bound( source_gammas.begin(), source_gammas.end(), aep,
-                         &SandiaDecay::EnergyRatePair::lessThanByEnergy );
-  
-  double expectedAbund = 0.0;
-//  for( iter = source_gammas.begin(); iter != source_gammas.end(); ++iter )
-  for( iter = start; iter != end; ++iter )
-    if( iter->energy >= lowE && iter->energy <= highE )
-      expectedAbund += iter->numPerSecond;
-  
-//  cerr << "In fractionDetectedWeight for peak->mean()=" << test_peak->mean()
-//       << " and AN=" << shielding_an << "\texpectedAbund=" << expectedAbund
-//       << endl;
-  
-  if( expectedAbund == 0.0 )
-    return 0.0;
-
-  if( expectedAbund == 0.0 )
-    throw runtime_error( "fractionDetectedWeight(...): Peak with no candidates" );
-  
-  const double det_sf = (response ? (response->isFixedGeometry() ? response->intrinsicEfficiency(mean)
-                                                                 : response->efficiency( mean, distance ))
-                                  : 1.0);
-  const double xs = MassAttenuation::massAttenuationCoeficient( shielding_an, mean );
-  const double shielding_sf = exp( -shielding_ad * xs );
-  const double sf = test_peak->peakArea() / shielding_sf / det_sf /expectedAbund;
+  /** Decayed photon spectrum (sorted by energy) of 1 MBq of a nuclide, aged
+   #PeakDef::defaultDecayTime(nuc).
+   
+   The result is cached process-wide, as suggestNuclides(...) is called for
+   every peak in a spectrum, and the same nuclides are candidates for most of
+   them.
+   */
+  std::shared_ptr<const vector<SandiaDecay::EnergyRatePair>> decayed_gammas( const SandiaDecay::Nuclide *nuc )
+  {
+    typedef std::shared_ptr<const vector<SandiaDecay::EnergyRatePair>> GammasPtr;
+    
+    static std::mutex s_cache_mutex;
+    static map<const SandiaDecay::Nuclide *,GammasPtr> s_cache;
+    
+    {
+      std::lock_guard<std::mutex> lock( s_cache_mutex );
+      const auto pos = s_cache.find( nuc );
+      if( pos != end(s_cache) )
+        return pos->second;
+    }
+    
+    //Compute outside the lock; if another thread beats us to it, we'll just
+    //  use its result.
+    const double age = PeakDef::defaultDecayTime( nuc );
+    const DecayedPhotonCache::PhotonsPtr unit_gammas
+                  = DecayedPhotonCache::photons( nuc, age, DecayedPhotonCache::Emissions::GammasAndAnnihilation,
+                                                 SandiaDecay::NuclideMixture::OrderByEnergy );
+    auto gammas = make_shared<vector<SandiaDecay::EnergyRatePair>>( *unit_gammas );
+    for( SandiaDecay::EnergyRatePair &gamma : *gammas )
+      gamma.numPerSecond *= 1.0E6*SandiaDecay::becquerel;
+    
+    std::lock_guard<std::mutex> lock( s_cache_mutex );
+    return s_cache.insert( std::make_pair( nuc, GammasPtr(gammas) ) ).first->second;
+  }//decayed_gammas(...)
   
-  double total_expected = 0.0;
-  double accounted_for = 0.0;
-  int num_accounted_for = 0;
-  int num_total = 0;
   
-  for( size_t i = 0; i < source_gammas.size(); ++i )
+  /** The shielding independent parts of #fractionDetectedWeight, for a single
+   nuclide and test peak; lets us evaluate multiple shieldings without
+   re-computing detector efficiencies, nearest peaks, or detection limits.
+   */
+  struct FractionDetectedTable
   {
-    //check to see if there is a peak cooresponding to this 'aep'
-    //check to see if this 'aep' should have been detectable.
-    //  if it was, increment total_expected.  If it was actually detected,
-    //  increment accounted_for
+    struct ExpectedGamma
+    {
+      double energy;
+      double num_per_second;
+      double det_eff;
+      double min_detectable;
+      std::shared_ptr<const PeakDef> nearest_peak;
+    };//struct ExpectedGamma
     
-    const double energy = source_gammas[i].energy;
-    if( energy < 1.0 )
-      continue;
+    double peak_mean;
+    double peak_area;
+    double peak_det_eff;
+    double expected_abundance;
+    vector<ExpectedGamma> gammas;
+  };//struct FractionDetectedTable
+  
+  
+  void fill_fraction_detected_table( FractionDetectedTable &table,
+                                 const std::vector<SandiaDecay::EnergyRatePair> &source_gammas,
+                                 std::shared_ptr<const DetectorPeakResponse> response,
+                                 std::shared_ptr<const SpecUtils::Measurement> data,
+                                 std::shared_ptr<const PeakDef> test_peak,
+                                 std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks )
+  {
+    //get all gammas between +-1.5 sigma of the mean;
+    const double mean  = test_peak->mean();
+    const double lowE  = (test_peak->gausPeak() ? (mean-1.5*fabs(test_peak->sigma())) : test_peak->lowerX());
+    const double highE = (test_peak->gausPeak() ? (mean+1.5*fabs(test_peak->sigma())) : test_peak->upperX());
+    const double distance = 1.0*PhysicalUnits::m;
+    const bool hasResolutionResponse = (!!response && response->hasResolutionInfo());
+    
+    table.peak_mean = mean;
+    table.peak_area = test_peak->peakArea();
+    table.peak_det_eff = 1.0;
+    table.expected_abundance = 0.0;
+    table.gammas.clear();
+    
+    vector<SandiaDecay::EnergyRatePair>::const_iterator start, end, iter;
+    
+    SandiaDecay::EnergyRatePair aep( 0.0, lowE );
+    start = lower_bound( source_gammas.begin(), source_gammas.end(), aep,
+                           &SandiaDecay::EnergyRatePair::lessThanByEnergy );
+    aep.energy = highE;
+    end = upper_bound( source_gammas.begin(), source_gammas.end(), aep,
+                           &SandiaDecay::EnergyRatePair::lessThanByEnergy );
     
-    const double exp_resolution = (hasResolutionResponse ? response->peakResolutionSigma( energy ) : float((highE-lowE)/3.0) );
-    const double det_eff = (response ? (response->isFixedGeometry() ? response->intrinsicEfficiency(energy)
-                                                                    : response->efficiency(energy, distance))
-                                     : 1.0);
-    const double xs = MassAttenuation::massAttenuationCoeficient( shielding_an, energy );
-    const double transmition = exp( -shielding_ad * xs );
+    for( iter = start; iter != end; ++iter )
+      if( iter->energy >= lowE && iter->energy <= highE )
+        table.expected_abundance += iter->numPerSecond;
     
-    typedef deque< std::shared_ptr<const PeakDef> >::const_iterator Iter_t;
-    Iter_t iter, nearest = all_peaks->end();
+    if( table.expected_abundance == 0.0 )
+      return;
     
-    //Inefficiently loop over all the 
-    double min_dx = 10000000.0*PhysicalUnits::keV;
-    for( iter = all_peaks->begin(); iter != all_peaks->end(); ++iter )
+    table.peak_det_eff = (response ? (response->isFixedGeometry() ? response->intrinsicEfficiency(mean)
+                                                                  : response->efficiency( mean, distance ))
+                                   : 1.0);
+    
+    table.gammas.reserve( source_gammas.size() );
+    
+    for( size_t i = 0; i < source_gammas.size(); ++i )
     {
-      const std::shared_ptr<const PeakDef> &peak = *iter;
-      const double mean = peak->mean();
-      const double sigma = (peak->gausPeak() ? peak->sigma() : 0.25*peak->roiWidth());
-      const double dx = fabs(mean - energy);
-      if( (distance < min_dx) && (dx < 1.5*sigma) )
+      const double energy = source_gammas[i].energy;
+      if( energy < 1.0 )
+        continue;
+      
+      FractionDetectedTable::ExpectedGamma gamma;
+      gamma.energy = energy;
+      gamma.num_per_second = source_gammas[i].numPerSecond;
+      
+      const double exp_resolution = (hasResolutionResponse ? response->peakResolutionSigma( energy ) : float((highE-lowE)/3.0) );
+      gamma.det_eff = (response ? (response->isFixedGeometry() ? response->intrinsicEfficiency(energy)
+                                                               : response->efficiency(energy, distance))
+                                : 1.0);
+      
+      typedef deque< std::shared_ptr<const PeakDef> >::const_iterator Iter_t;
+      Iter_t iter, nearest = all_peaks->end();
+      
+      //Inefficiently loop over all the
+      double min_dx = 10000000.0*PhysicalUnits::keV;
+      for( iter = all_peaks->begin(); iter != all_peaks->end(); ++iter )
+      {
+        const std::shared_ptr<const PeakDef> &peak = *iter;
+        const double mean = peak->mean();
+        const double sigma = (peak->gausPeak() ? peak->sigma() : 0.25*peak->roiWidth());
+        const double dx = fabs(mean - energy);
+        if( (distance < min_dx) && (dx < 1.5*sigma) )
+        {
+          min_dx = dx;
+          nearest = iter;
+        }
+      }//for( iter = all_peaks->begin(); iter != all_peaks->end(); ++iter )
+      
+      if( nearest != all_peaks->end() )
+      {
+        gamma.nearest_peak = *nearest;
+        gamma.min_detectable = minDetectableCounts( *nearest, data );
+      }else
       {
-        min_dx = dx;
-        nearest = iter;
+        gamma.min_detectable = minDetectableCounts( energy, exp_resolution, data );
       }
-    }//for( iter = all_peaks->begin(); iter != all_peaks->end(); ++iter )
+      
+      table.gammas.push_back( std::move(gamma) );
+    }//for( size_t i = 0; i < source_gammas.size(); ++i )
+  }//fill_fraction_detected_table(...)
+  
+  
+  double fraction_detected_weight( const FractionDetectedTable &table,
+                                   const double shielding_an,
+                                   const double shielding_ad )
+  {
+    if( table.expected_abundance == 0.0 )
+      return 0.0;
     
-    double minDetectable = 0.0;
-    if( nearest != all_peaks->end() )
-      minDetectable = minDetectableCounts( *nearest, data );
-    else
-      minDetectable = minDetectableCounts( energy, exp_resolution, data );
+    const double xs = MassAttenuation::massAttenuationCoeficient( shielding_an, table.peak_mean );
+    const double shielding_sf = exp( -shielding_ad * xs );
+    const double sf = table.peak_area / shielding_sf / table.peak_det_eff / table.expected_abundance;
     
-    double expected = sf * det_eff * transmition * source_gammas[i].numPerSecond;
+    double total_expected = 0.0;
+    double accounted_for = 0.0;
+    int num_accounted_for = 0;
+    int num_total = 0;
     
-    if( expected > minDetectable )
+    for( const FractionDetectedTable::ExpectedGamma &gamma : table.gammas )
     {
-      ++num_total;
-      total_expected += source_gammas[i].numPerSecond;
-      if( nearest != all_peaks->end() )
+      //check to see if this gamma should have been detectable.
+      //  if it was, increment total_expected.  If it was actually detected,
+      //  increment accounted_for
+      const double xs = MassAttenuation::massAttenuationCoeficient( shielding_an, gamma.energy );
+      const double transmition = exp( -shielding_ad * xs );
+      const double expected = sf * gamma.det_eff * transmition * gamma.num_per_second;
+      
+      if( expected > gamma.min_detectable )
       {
-        ++num_accounted_for;
-        const std::shared_ptr<const PeakDef> &nearest_peak = *nearest;
-        const double peakmean = nearest_peak->mean();
-        const double peaksigma = (nearest_peak->gausPeak() ? nearest_peak->sigma() : 0.25*nearest_peak->roiWidth());
-        const double calib_sf = 1.0 - 0.5*fabs(energy - peakmean) / peaksigma;
-        accounted_for += calib_sf * source_gammas[i].numPerSecond;
-      }//if( nearest != all_peaks->end() )
-    }//if( expected > minDetectable )
-  }//for( size_t i = 0; i < source_gammas.size(); ++i )
-  
-  const double fracDetected = accounted_for / total_expected;
-//  cerr << "\tsf=" << fracDetected << endl << endl;
-  
-  const double nphotopeak_sf = pow(1.0*num_accounted_for, 3.0) / num_total;
-  
-  return nphotopeak_sf * fracDetected;
+        ++num_total;
+        total_expected += gamma.num_per_second;
+        if( gamma.nearest_peak )
+        {
+          ++num_accounted_for;
+          const PeakDef &nearest_peak = *gamma.nearest_peak;
+          const double peakmean = nearest_peak.mean();
+          const double peaksigma = (nearest_peak.gausPeak() ? nearest_peak.sigma() : 0.25*nearest_peak.roiWidth());
+          const double calib_sf = 1.0 - 0.5*fabs(gamma.energy - peakmean) / peaksigma;
+          accounted_for += calib_sf * gamma.num_per_second;
+        }//if( gamma.nearest_peak )
+      }//if( expected > gamma.min_detectable )
+    }//for( const FractionDetectedTable::ExpectedGamma &gamma : table.gammas )
+    
+    const double fracDetected = accounted_for / total_expected;
+    const double nphotopeak_sf = pow(1.0*num_accounted_for, 3.0) / num_total;
+    
+    return nphotopeak_sf * fracDetected;
+  }//fraction_detected_weight(...)
+}//namespace
+
+
+double fractionDetectedWeight( const std::vector<SandiaDecay::EnergyRatePair> &source_gammas, //normailization doent matter
+                           std::shared_ptr<const DetectorPeakResponse> response,
+                           double shielding_an,
+                           double shielding_ad,
+                           std::shared_ptr<const SpecUtils::Measurement> data,
+                           std::shared_ptr<const PeakDef> test_peak,
+                           std::shared_ptr<const std::deque< std::shared_ptr<const PeakDef> > > all_peaks
+                          )
+{
+  //loop over all expected gamma lines for nuclide, and count the fraction of
+  //  counts expected to be detected, that actually where
+  //  -if photopeak exists under a peak, then assume photopeak was detectable if
+  //   expected counts is greater than 2.33*continuum_area.
+  //  -if photopeak is not under a detected peak, assume photopeak was
+  //   detectable if its counts is greater than 2.33*data_area in region.
+  FractionDetectedTable table;
+  fill_fraction_detected_table( table, source_gammas, response, data, test_peak, all_peaks );
+  
+  return fraction_detected_weight( table, shielding_an, shielding_ad );
 }//fractionDetectedWeight(...)
 
 
@@ -779,7 +900,6 @@ void suggestNuclides(
   for( size_t i = 0; i < nearNucs.size(); ++i )
   {
     const SandiaDecay::Nuclide *nuc = nearNucs[i].nuclide;
-    const double age = PeakDef::defaultDecayTime( nuc );
     
     if( nucschecked.count(nuc) )
       continue;
@@ -787,21 +907,42 @@ void suggestNuclides(
     
     max_hl = max( max_hl, nuc->halfLife );
     
-    SandiaDecay::NuclideMixture mix;
-    mix.addNuclideByActivity( nuc, 1.0E6*SandiaDecay::becquerel );
-    const vector<SandiaDecay::EnergyRatePair> gammas = mix.gammas( age,
-                                       SandiaDecay::NuclideMixture::OrderByEnergy, true );
     nearNucs[i].weight = 0.0;
+    candidates.push_back( nearNucs[i] );
+  }//for( size_t i = 0; i < nearNucs.size(); ++i )
+  
+  //Scoring each candidate is independent of the others, so spread them across
+  //  threads; the decayed spectrum for each nuclide is cached between calls,
+  //  and the detector/peak dependent quantities are computed once per
+  //  candidate, and then re-used for each shielding.
+  auto score_candidate = [&candidates,&response,&data,&peak,&peaks,&atomic_nums,&areal_density]( const size_t index ){
+    NuclideStatWeightPair &candidate = candidates[index];
+    const auto gammas = decayed_gammas( candidate.nuclide );
+    
+    FractionDetectedTable table;
+    fill_fraction_detected_table( table, *gammas, response, data, peak, peaks );
+    
     for( int j = 0; j < 3; ++j )
     {
-      const double val = fractionDetectedWeight( gammas, response,
-                                           atomic_nums[j], areal_density[j],
-                                           data, peak, peaks );
-      nearNucs[i].weight = max( nearNucs[i].weight, val );
+      const double val = fraction_detected_weight( table, atomic_nums[j], areal_density[j] );
+      candidate.weight = max( candidate.weight, val );
     }//for( int j = 0; j < 3; ++j )
-    
-    candidates.push_back( nearNucs[i] );
-  }//for( size_t i = 0; i < nearNucs.size(); ++i )
+  };//score_candidate
+  
+  //Only bother with threads when there is enough work to make it worthwhile
+  const size_t min_candidates_for_threading = 8;
+  
+  if( candidates.size() < min_candidates_for_threading )
+  {
+    for( size_t i = 0; i < candidates.size(); ++i )
+      score_candidate( i );
+  }else
+  {
+    SharedThreadPool::TaskGroup pool;
+    for( size_t i = 0; i < candidates.size(); ++i )
+      pool.post( [i,&score_candidate](){ score_candidate(i); } );
+    pool.join();
+  }//if( not many candidates ) / else
   
   // The characteristics(...) gives weight based on number of peaks that
   // nuclides in CharacteristicGammas.txt - it doesnt single out the single
@@ -824,18 +965,11 @@ void suggestNuclides(
     const float lower_e = static_cast<float>(energy - 2.0*sigma);
     const float upper_e = static_cast<float>(energy + 2.0*sigma);
    
-    // We could use lower/upper_bound, since characteristicGammas() is sorted by energy,
-    //  but its few enough elements I wont bother with this at the moment.
-    map<const SandiaDecay::Nuclide *, size_t> n_times_nuc;
-    for( const tuple<string, const SandiaDecay::Nuclide *, float> &line : characteristicGammas() )
+    const auto range = characteristicGammasInRange( lower_e, upper_e );
+    for( auto iter = range.first; iter != range.second; ++iter )
     {
-      const SandiaDecay::Nuclide * const nuc = get<1>(line);
-      if( n_times_nuc.count(nuc) )
-        n_times_nuc[nuc] = 0;
-      n_times_nuc[nuc] += 1;
-      
-      const float line_energy = get<2>(line);
-      if( nuc && (line_energy >= lower_e) && (line_energy <= upper_e) )
+      const SandiaDecay::Nuclide * const nuc = get<1>(*iter);
+      if( nuc )
       {
         bool found_candidate = false;
         for( NuclideStatWeightPair &n : candidates )
@@ -852,7 +986,7 @@ void suggestNuclides(
         {
           NuclideStatWeightPair nuswp;
           nuswp.nuclide = nuc;
-          nuswp.weight = 0.5*max_weight / n_times_nuc[nuc]; //Weight is arbitrarily decided, without testing
+          nuswp.weight = 0.5*max_weight; //Weight is arbitrarily decided, without testing
           candidates.push_back( std::move(nuswp) );
         }
       }//if( our peak matches this characteristic line )
@@ -1486,7 +1620,7 @@ void populateCandidateNuclides( std::shared_ptr<const SpecUtils::Measurement> da
   set<string> entries;
   vector<string> suggestednucs, characteristicnucs, otherpeaksnucs;
   
-  SpecUtilsAsync::ThreadPool pool;
+  SharedThreadPool::TaskGroup pool;
   
   /*
   std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > allpeaks
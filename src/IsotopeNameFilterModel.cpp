@@ -23,6 +23,8 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <algorithm>
@@ -67,6 +69,99 @@ namespace
     const T arr;
   };//struct index_compare
   
+  
+  /** Process-wide index of the names suggestions are matched against, so each keystroke doesnt
+   have to lower-case every element name, or walk and format every nuclide in the database.
+   
+   Built once, on first use, from #DecayDataBaseServer::database(); it is never modified after
+   that, so may be used from any session without locking.
+   */
+  struct SuggestionNameIndex
+  {
+    struct NuclideEntry
+    {
+      const SandiaDecay::Nuclide *nuc;
+      std::string mass_number;
+    };//struct NuclideEntry
+    
+    struct ElementEntry
+    {
+      std::string name;   //lowercase
+      std::string symbol; //lowercase
+      
+      /** Nuclides of this element that may be suggested (i.e., not stable, and have children), in
+       the order given by `SandiaDecayDataBase::nuclides(element)`.
+       */
+      std::vector<NuclideEntry> nuclides;
+    };//struct ElementEntry
+    
+    /** Lowercase element symbols and names, sorted, so the elements matching a prefix are a
+     contiguous range found with a binary search.
+     */
+    std::vector<std::pair<std::string,const SandiaDecay::Element *>> sorted_keys;
+    
+    std::map<const SandiaDecay::Element *,ElementEntry> elements;
+    
+    /** All suggestible nuclides, with their mass number, in the database order. */
+    std::vector<std::pair<int,const SandiaDecay::Nuclide *>> all_nuclides;
+    
+    SuggestionNameIndex()
+    {
+      const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+      if( !db )
+        return;
+      
+      for( const SandiaDecay::Element *el : db->elements() )
+      {
+        ElementEntry &entry = elements[el];
+        entry.name = SpecUtils::to_lower_ascii_copy( el->name );
+        entry.symbol = SpecUtils::to_lower_ascii_copy( el->symbol );
+        sorted_keys.emplace_back( entry.name, el );
+        sorted_keys.emplace_back( entry.symbol, el );
+        
+        for( const SandiaDecay::Nuclide *nuc : db->nuclides( el ) )
+        {
+          if( !IsInf(nuc->halfLife) && !nuc->decaysToChildren.empty() )
+            entry.nuclides.push_back( { nuc, std::to_string(nuc->massNumber) } );
+        }
+      }//for( const SandiaDecay::Element *el : db->elements() )
+      
+      std::sort( begin(sorted_keys), end(sorted_keys) );
+      
+      for( const SandiaDecay::Nuclide *nuc : db->nuclides() )
+      {
+        if( !IsInf(nuc->halfLife) && !nuc->decaysToChildren.empty() )
+          all_nuclides.emplace_back( nuc->massNumber, nuc );
+      }
+    }//SuggestionNameIndex()
+  };//struct SuggestionNameIndex
+  
+  
+  const SuggestionNameIndex &suggestion_name_index()
+  {
+    static const SuggestionNameIndex s_index;
+    return s_index;
+  }
+  
+  
+  /** Returns if the elements lowercase symbol or name starts with any of the (lowercase) strings. */
+  bool element_matches_alpha_strs( const SandiaDecay::Element *el, const vector<string> &alphastrs )
+  {
+    const SuggestionNameIndex &index = suggestion_name_index();
+    const auto pos = index.elements.find( el );
+    if( pos == end(index.elements) )
+      return false;
+    
+    for( const string &str : alphastrs )
+    {
+      if( SpecUtils::starts_with( pos->second.symbol, str.c_str() )
+         || SpecUtils::starts_with( pos->second.name, str.c_str() ) )
+        return true;
+    }
+    
+    return false;
+  }//element_matches_alpha_strs(...)
+  
 }//namespace
 
 IsotopeNameFilterModel::IsotopeNameFilterModel( WObject *parent )
@@ -382,7 +477,29 @@ void IsotopeNameFilterModel::filter( const Wt::WString &text )
 
   vector<const SandiaDecay::Nuclide *> suggestions;
   vector< const SandiaDecay::Element * > suggest_elements;
-  set<const SandiaDecay::Element *> candidate_elements = possibleElements( alphastrs );
+  
+  // As the user types more characters, each alpha sub-string usually just gets longer; in that
+  //  case the candidate elements can only be a subset of the last candidates, so we just narrow
+  //  those down, rather than looking through all the elements again.
+  bool can_narrow = !m_prevAlphaStrs.empty() && (alphastrs.size() == m_prevAlphaStrs.size());
+  for( size_t i = 0; can_narrow && (i < alphastrs.size()); ++i )
+    can_narrow = SpecUtils::starts_with( alphastrs[i], m_prevAlphaStrs[i].c_str() );
+  
+  set<const SandiaDecay::Element *> candidate_elements;
+  if( can_narrow )
+  {
+    for( const SandiaDecay::Element *el : m_prevCandidateElements )
+    {
+      if( element_matches_alpha_strs( el, alphastrs ) )
+        candidate_elements.insert( el );
+    }
+  }else
+  {
+    candidate_elements = possibleElements( alphastrs );
+  }//if( can_narrow ) / else
+  
+  m_prevAlphaStrs = alphastrs;
+  m_prevCandidateElements = candidate_elements;
   
   suggestNuclides( alphastrs, numericstrs, metalevel,
                    candidate_elements, suggestions, suggest_elements );
@@ -494,23 +611,20 @@ std::set<const SandiaDecay::Element *> IsotopeNameFilterModel::possibleElements(
                                         const std::vector<string> &alphastrs )
 {
   std::set<const SandiaDecay::Element *> candidate_elements;
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
-  
-  //suggest based off of alphastrs
-  const std::vector<const SandiaDecay::Element *> &elements = db->elements();
+  const SuggestionNameIndex &index = suggestion_name_index();
   
-  for( const SandiaDecay::Element *el : elements )
+  //suggest based off of alphastrs; any element whose lowercase symbol or name starts with one of
+  //  them is a candidate.
+  for( const string &str : alphastrs )
   {
-    const string name   = SpecUtils::to_lower_ascii_copy( el->name );
-    const string symbol = SpecUtils::to_lower_ascii_copy( el->symbol );
+    auto pos = std::lower_bound( begin(index.sorted_keys), end(index.sorted_keys), str,
+                  []( const pair<string,const SandiaDecay::Element *> &lhs, const string &rhs ){
+      return lhs.first < rhs;
+    } );
     
-    for( string str : alphastrs )
-    {
-      if( SpecUtils::starts_with( symbol, str.c_str() )
-         || SpecUtils::starts_with( name, str.c_str() ) )
-        candidate_elements.insert( el );
-    }//for( const string &str : alphastrs )
-  }//for( const SandiaDecay::Element *el : elements )
+    for( ; (pos != end(index.sorted_keys)) && SpecUtils::starts_with( pos->first, str.c_str() ); ++pos )
+      candidate_elements.insert( pos->second );
+  }//for( const string &str : alphastrs )
   
   return candidate_elements;
 }//possibleElements
@@ -523,17 +637,20 @@ void IsotopeNameFilterModel::suggestNuclides(
                                           vector<const SandiaDecay::Nuclide *> &suggestions,
                                           vector< const SandiaDecay::Element * > &suggest_elements )
 {
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  const SuggestionNameIndex &index = suggestion_name_index();
   
   for( const SandiaDecay::Element *el : candidate_elements )
   {
+    const auto entry_pos = index.elements.find( el );
+    if( entry_pos == end(index.elements) )
+      continue;
+    const SuggestionNameIndex::ElementEntry &entry = entry_pos->second;
+    
     bool is_exact_element = false;
     if( numericstrs.empty() )
     {
-      const string name   = SpecUtils::to_lower_ascii_copy( el->name );
-      const string symbol = SpecUtils::to_lower_ascii_copy( el->symbol );
-      for( string str : alphastrs )
-        is_exact_element |= (symbol==str || name==str);
+      for( const string &str : alphastrs )
+        is_exact_element |= (entry.symbol==str || entry.name==str);
     }//if( numericstrs.empty() )
     
     if( numericstrs.empty() && !is_exact_element )
@@ -545,46 +662,49 @@ void IsotopeNameFilterModel::suggestNuclides(
       if( numericstrs.empty() && is_exact_element )
         suggest_elements.push_back( el );
       
-      const vector<const SandiaDecay::Nuclide *> nuclides = db->nuclides( el );
-      
-      for( const SandiaDecay::Nuclide *nuc : nuclides )
+      for( const SuggestionNameIndex::NuclideEntry &nuc_entry : entry.nuclides )
       {
-        if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
-          continue;
+        const SandiaDecay::Nuclide *nuc = nuc_entry.nuc;
         
         bool numeric_compat = false;
         for( const string &str : numericstrs )
-          numeric_compat |= SpecUtils::contains( std::to_string(nuc->massNumber), str.c_str() );
+          numeric_compat |= SpecUtils::contains( nuc_entry.mass_number, str.c_str() );
         
         if( metalevel > 0 && metalevel!=nuc->isomerNumber )
           numeric_compat = false;
         
         if( numeric_compat || numericstrs.empty() )
           suggestions.push_back( nuc );
-      }//for( const SandiaDecay::Nuclide *nuc : nuclides )
+      }//for( const SuggestionNameIndex::NuclideEntry &nuc_entry : entry.nuclides )
     }//if( there are no numbers, and start of an element name ) / else
   }//for( const SandiaDecay::Element *el : candidate_elements )
   
   
   if( alphastrs.empty() )
   {
-    const std::vector<const SandiaDecay::Nuclide *> &nucs = db->nuclides();
-    std::vector<const SandiaDecay::Nuclide *>::const_iterator pos;
-    for( pos = nucs.begin(); pos != nucs.end(); ++pos )
+    vector<int> mass_numbers;
+    for( const string &str : numericstrs )
     {
-      const SandiaDecay::Nuclide *nuc = (*pos);
-      if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
-        continue;
-      
-      for( string str : numericstrs )
+      try
       {
-        try
+        mass_numbers.push_back( std::stoi(str) );
+      }catch(...)
+      {
+        //Digit strings too long to be an int will never match a mass number.
+      }
+    }//for( const string &str : numericstrs )
+    
+    if( !mass_numbers.empty() )
+    {
+      for( const pair<int,const SandiaDecay::Nuclide *> &mass_nuc : index.all_nuclides )
+      {
+        for( const int mass_number : mass_numbers )
         {
-          if( nuc->massNumber==std::stoi(str) )
-            suggestions.push_back( nuc );
-        }catch(...){ cerr << "Shouldnt ever be here" << endl; }
-      }//for( string str : numericstrs )
-    }//for( pos = nucs.begin(); pos != nucs.end(); ++pos )
+          if( mass_nuc.first == mass_number )
+            suggestions.push_back( mass_nuc.second );
+        }
+      }//for( const pair<int,const SandiaDecay::Nuclide *> &mass_nuc : index.all_nuclides )
+    }//if( !mass_numbers.empty() )
   }//if( the user has only typed in numbers )
 
 }//suggestNuclides(...)
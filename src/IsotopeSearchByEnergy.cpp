@@ -281,6 +281,7 @@ IsotopeSearchByEnergy::IsotopeSearchByEnergy( InterSpec *viewer,
   m_clearRefLines( nullptr ),
   m_assignPeakToSelected( nullptr ),
   m_currentSearch( 0 ),
+  m_latestSearchNumber( std::make_shared<std::atomic<int>>( 0 ) ),
   m_searching( NULL ),
   m_results( NULL ),
   m_minBranchRatio( NULL ),
@@ -509,10 +510,8 @@ void IsotopeSearchByEnergy::render( Wt::WFlags<Wt::RenderFlag> flags )
   {
     // Initialize the mapping from energies to nuclides when we render this widget the first
     //  time, so this way it will be ever so slightly quicker when the user does the first search.
-    const double minHl = m_minHl, minBr = m_minBr;
-    WServer::instance()->ioService().boost::asio::io_service::post( [minHl,minBr](){
-      EnergyToNuclideServer::setLowerLimits( minHl, minBr );
-      EnergyToNuclideServer::energyToNuclide();
+    WServer::instance()->ioService().boost::asio::io_service::post( [](){
+      EnergyToNuclideServer::gammaIndex();
     } );
   }
 }//void render( Wt::WFlags<Wt::RenderFlag> flags )
@@ -1645,13 +1644,23 @@ void IsotopeSearchByEnergy::startSearch( const bool refreshBr )
   }//for( const WWebWidget *w : children )
   
   WFlags<IsotopeSearchByEnergyModel::RadSource> srcs;
+  int rad_sources = 0;
   
   if( m_gammas->isChecked() )
+  {
     srcs |= IsotopeSearchByEnergyModel::kGamma;
+    rad_sources |= IsotopeSearchByEnergyModel::kGamma;
+  }
   if( m_xrays->isChecked() )
+  {
     srcs |= IsotopeSearchByEnergyModel::kXRay;
+    rad_sources |= IsotopeSearchByEnergyModel::kXRay;
+  }
   if( m_reactions->isChecked() )
+  {
     srcs |= IsotopeSearchByEnergyModel::kReaction;
+    rad_sources |= IsotopeSearchByEnergyModel::kReaction;
+  }
   
   
   WApplication *app = wApp;
@@ -1661,6 +1670,9 @@ void IsotopeSearchByEnergy::startSearch( const bool refreshBr )
   workingspace->sortColumn = m_model->sortColumn();
   workingspace->sortOrder = m_model->sortOrder();
   workingspace->undoSentry = getDisableUndoRedoSentry(); //m_undo_redo_sentry.lock();
+  workingspace->min_br = m_minBr;
+  workingspace->min_halflife = m_minHl;
+  workingspace->rad_sources = rad_sources;
   
   std::shared_ptr<SpecMeas> foreground = m_viewer->measurment( SpecUtils::SpectrumType::Foreground );
   if( foreground )
@@ -1684,10 +1696,36 @@ void IsotopeSearchByEnergy::startSearch( const bool refreshBr )
   }//if( foreground )
   
   ++m_currentSearch;
+  m_latestSearchNumber->store( m_currentSearch );
+  workingspace->search_number = m_currentSearch;
+  workingspace->latest_search_number = m_latestSearchNumber;
   workingspace->searchdoneCallback = app->bind(
                           boost::bind( &IsotopeSearchByEnergy::hideSearchingTxt,
                                        this, m_currentSearch ) );
   
+  // If we have already done this exact search, just re-use the results.
+  const shared_ptr<const IsotopeSearchByEnergyModel::SearchWorkingSpace> cached
+                                                      = m_model->cachedSearch( *workingspace );
+  if( cached )
+  {
+    workingspace->matches = cached->matches;
+    m_model->updateSearchResults( workingspace );
+    return;
+  }//if( cached )
+  
+  // Let the search send us the nuclide matches, before it finishes x-rays and reactions
+  auto partial = make_shared<IsotopeSearchByEnergyModel::SearchWorkingSpace>();
+  partial->energies = energies;
+  partial->windows = windows;
+  partial->sortColumn = workingspace->sortColumn;
+  partial->sortOrder = workingspace->sortOrder;
+  partial->search_number = workingspace->search_number;
+  partial->latest_search_number = m_latestSearchNumber;
+  workingspace->partial_results = partial;
+  workingspace->partial_update_fcn = app->bind( boost::bind(
+                            &IsotopeSearchByEnergyModel::updateSearchResults,
+                            m_model, partial ) );
+  
   //Verified below is safe if the WApplication instance is terminated before
   //  search results are completed, as well as if the WApplication isnt
   //  terminated but m_model is deleted.
@@ -28,6 +28,7 @@
 #include <deque>
 #include <vector>
 #include <sstream>
+#include <algorithm>
 
 #include <Wt/WServer>
 #include <Wt/WApplication>
@@ -143,10 +144,10 @@ namespace
     
     NuclideMatches filteredNuclides;
     
-    //Get isotopes with gammas in all ranges...
-    EnergyToNuclideServer::setLowerLimits( minHalfLife, minbr );
-    
-    auto nucnuc = EnergyToNuclideServer::energyToNuclide();
+    //Get isotopes with gammas in all ranges; we filter the (shared) unfiltered index here, rather
+    //  than using EnergyToNuclideServer::setLowerLimits(...), so sessions using different limits
+    //  dont cause the filtered list to be recomputed for each search.
+    auto nucnuc = EnergyToNuclideServer::gammaIndex();
     if( !nucnuc )
       throw runtime_error( "Couldnt get EnergyToNuclideServer" );
     
@@ -157,15 +158,19 @@ namespace
       
       const bool canBeAnnih = (510.99891f>=minenergy && 510.99891f<=maxenergy);
       
-      EnergyToNuclideServer::EnergyNuclidePair enPair( minenergy, NULL );
-      vector<EnergyToNuclideServer::EnergyNuclidePair>::const_iterator begin, end, pos;
+      EnergyToNuclideServer::IndexedGamma enPair;
+      enPair.energy = minenergy;
+      EnergyToNuclideServer::GammaIndex::const_iterator begin, end, pos;
       
-      //nucnuc should be sorted by energy (EnergyNuclidePair::operator<)
+      //nucnuc should be sorted by energy (IndexedGamma::operator<)
       begin = lower_bound( nucnuc->begin(), nucnuc->end(), enPair );
       enPair.energy = maxenergy;
       end = upper_bound( begin, nucnuc->end(), enPair );
       for( pos = begin; pos != end; ++pos )
       {
+        if( !pos->passes( minHalfLife, minbr ) )
+          continue;
+        
         //nucnuc actually only contians the nuclides that they themselves give
         //  off the requested energies, meaning we have to go through and inspect
         //  all the nuclides that could decay to the nuclide in nucnuc to see
@@ -658,7 +663,8 @@ void IsotopeSearchByEnergyModel::nuclidesWithAllEnergies(
             const std::shared_ptr<const SpecUtils::Measurement> displayed_measurement,
             const std::vector<std::shared_ptr<const PeakDef>> &user_peaks,
             const std::vector<std::shared_ptr<const PeakDef>> &automated_search_peaks,
-            std::vector< vector<IsotopeSearchByEnergyModel::IsotopeMatch> > &answer )
+            std::vector< vector<IsotopeSearchByEnergyModel::IsotopeMatch> > &answer,
+            const boost::function<bool(void)> &cancelled )
 {
   // Note: most parts of this function are wrapped in try/catch blocks, but exceptions are really
   //       not expected.
@@ -674,6 +680,9 @@ void IsotopeSearchByEnergyModel::nuclidesWithAllEnergies(
   
   for( const NucToEnergiesMap::value_type &nm : filteredNuclides )
   {
+    if( cancelled && cancelled() )
+      return;
+    
     //check to see if this nuclide has gammas for each energy, not strictly
     //  necessary, but probably computationally faster (do we care about this
     //  here though)
@@ -1221,9 +1230,79 @@ void IsotopeSearchByEnergyModel::clearResults()
 }//void clearResults();
 
 
+bool IsotopeSearchByEnergyModel::SearchWorkingSpace::superseded() const
+{
+  return latest_search_number && (latest_search_number->load() != search_number);
+}//bool superseded() const
+
+
+bool IsotopeSearchByEnergyModel::SearchWorkingSpace::sameInputs( const SearchWorkingSpace &rhs ) const
+{
+  return (energies == rhs.energies)
+         && (windows == rhs.windows)
+         && (min_br == rhs.min_br)
+         && (min_halflife == rhs.min_halflife)
+         && (rad_sources == rhs.rad_sources)
+         && (sortColumn == rhs.sortColumn)
+         && (sortOrder == rhs.sortOrder)
+         && (detector_response_function == rhs.detector_response_function)
+         && (displayed_measurement == rhs.displayed_measurement)
+         && (user_peaks == rhs.user_peaks)
+         && (automated_search_peaks == rhs.automated_search_peaks);
+}//bool sameInputs( const SearchWorkingSpace &rhs ) const
+
+
+std::shared_ptr<const IsotopeSearchByEnergyModel::SearchWorkingSpace>
+                IsotopeSearchByEnergyModel::cachedSearch( const SearchWorkingSpace &inputs ) const
+{
+  for( const shared_ptr<const SearchWorkingSpace> &cached : m_searchCache )
+  {
+    if( cached->sameInputs( inputs ) )
+      return cached;
+  }
+  
+  return nullptr;
+}//cachedSearch(...)
+
+
 void IsotopeSearchByEnergyModel::updateSearchResults(
                                                      std::shared_ptr<IsotopeSearchByEnergyModel::SearchWorkingSpace> workingspace )
 {
+  // If the user has started another search since this one, dont show these (now stale) results;
+  //  the newer search will update the table.
+  if( workingspace->superseded() )
+    return;
+  
+  // Partial (streamed) results dont have a search-done callback
+  const bool is_partial = !workingspace->searchdoneCallback;
+  
+  if( !is_partial && workingspace->error_msg.empty() )
+  {
+    // Memoize the inputs and results, so an identical search later in this session is instant.
+    auto cached = make_shared<SearchWorkingSpace>();
+    cached->energies = workingspace->energies;
+    cached->windows = workingspace->windows;
+    cached->detector_response_function = workingspace->detector_response_function;
+    cached->user_peaks = workingspace->user_peaks;
+    cached->automated_search_peaks = workingspace->automated_search_peaks;
+    cached->displayed_measurement = workingspace->displayed_measurement;
+    cached->matches = workingspace->matches;
+    cached->sortColumn = workingspace->sortColumn;
+    cached->sortOrder = workingspace->sortOrder;
+    cached->min_br = workingspace->min_br;
+    cached->min_halflife = workingspace->min_halflife;
+    cached->rad_sources = workingspace->rad_sources;
+    
+    m_searchCache.erase( std::remove_if( begin(m_searchCache), end(m_searchCache),
+                    [&cached]( const shared_ptr<const SearchWorkingSpace> &prev ) -> bool {
+                      return prev->sameInputs( *cached );
+                    } ), end(m_searchCache) );
+    
+    m_searchCache.push_front( cached );
+    while( m_searchCache.size() > 8 )
+      m_searchCache.pop_back();
+  }//if( !is_partial && workingspace->error_msg.empty() )
+  
   const vector<double> &energies = workingspace->energies;
   const vector<double> &windows = workingspace->windows;
   
@@ -1260,7 +1339,8 @@ void IsotopeSearchByEnergyModel::updateSearchResults(
   layoutAboutToBeChanged().emit();
   layoutChanged().emit();
   
-  workingspace->searchdoneCallback();
+  if( workingspace->searchdoneCallback )
+    workingspace->searchdoneCallback();
   
   
   if( !workingspace->error_msg.empty() )
@@ -1304,6 +1384,9 @@ void IsotopeSearchByEnergyModel::setSearchEnergies(
       return;
     }//if( energies.empty() )
     
+    if( workingspace->superseded() )
+      return;
+    
     
     using SandiaDecay::Element;
     using SandiaDecay::Nuclide;
@@ -1355,13 +1438,33 @@ void IsotopeSearchByEnergyModel::setSearchEnergies(
     // TODO: if searching for more than one source type (e.g., gamma, xray, reaction) use separate
     //       threads and then combine results
     
+    const boost::function<bool(void)> cancelled = [workingspace]() -> bool {
+      return workingspace->superseded();
+    };
+    
     //Nuclides that match all energies
     if( srcs & kGamma )
     {
       // nuclidesWithAllEnergies probably wont throw - it will discard any sub-results that cause
       //  unexpected (and there really are none expected) exceptions.
       const auto filteredNuclides = filter_nuclides( minbr, minHalfLife, energies, windows );
-      nuclidesWithAllEnergies( filteredNuclides, energies, windows, minbr, drf, meas, user_peaks, auto_peaks, matches );
+      nuclidesWithAllEnergies( filteredNuclides, energies, windows, minbr, drf, meas, user_peaks,
+                               auto_peaks, matches, cancelled );
+      
+      if( workingspace->superseded() )
+        return;
+      
+      // Nuclide matching is usually the slow part, so send the (sorted) nuclide matches to the
+      //  GUI now, if x-rays or reactions still need to be searched.  The partial results are only
+      //  written to here, before being posted, so the GUI thread can safely use them.
+      const shared_ptr<SearchWorkingSpace> &partial = workingspace->partial_results;
+      if( partial && workingspace->partial_update_fcn && !matches.empty()
+         && (srcs.testFlag(kXRay) || srcs.testFlag(kReaction)) )
+      {
+        partial->matches = matches;
+        sortData( partial->matches, energies, workingspace->sortColumn, workingspace->sortOrder );
+        WServer::instance()->post( appid, workingspace->partial_update_fcn );
+      }
     }//if( srcs & kGamma )
     
     //Get elements with x-rays which match all energies
@@ -1393,6 +1496,9 @@ void IsotopeSearchByEnergyModel::setSearchEnergies(
     cerr << msg.str() << endl;
   }//try / catch
   
+  if( workingspace && workingspace->superseded() )
+    return;
+  
   WServer::instance()->post(  appid, updatefcn );
 }//void setSearchEnergies( const vector<double> &energies, const double window )
 
@@ -23,7 +23,11 @@
 
 #include "InterSpec_config.h"
 
+#include <cmath>
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
 #include <iostream>
 #include <algorithm>
 
@@ -84,6 +88,463 @@ namespace
 }//namespace
 
 
+namespace
+{
+  /** The GPS location, and count rate information, for a single sample number. */
+  struct GpsSampleInfo
+  {
+    int sample = 0;
+    double latitude = 0.0, longitude = 0.0;
+    bool has_time = false;
+    long long time_offset = 0; //milliseconds from first sample with a valid time
+    int num_gamma_det = 0, num_neut_det = 0;
+    double gamma_counts = 0.0, gamma_real_time = 0.0, gamma_live_time = 0.0;
+    double neutron_counts = 0.0, neutron_real_time = 0.0;
+    float real_time = 0.0f;
+    int source_type = 0;
+    int display_type = 3;
+    
+    double gamma_cps() const
+    {
+      return gamma_counts / ((gamma_live_time > 0.0) ? gamma_live_time : 1.0);
+    }
+  };//struct GpsSampleInfo
+  
+  
+  /** Files with more than this many GPS points will have only the points in the current viewport
+   sent to the client, with points aggregated into clusters when zoomed out.
+   */
+  const size_t ns_max_samples_to_send_all = 5000;
+  
+  /** When the current viewport contains more than this many points, the points will be clustered
+   into grid cells, instead of sent individually.
+   */
+  const size_t ns_max_individual_samples_in_view = 1500;
+  
+  /** The zoom level, past the map zoom level, to define cluster cells at; each zoom level
+   is a factor of two, so a value of 2 gives cells 64 pixels on a side (map tiles are 256 px).
+   */
+  const int ns_cluster_cell_zoom_offset = 2;
+  
+  /** The zoom level points are indexed at; at zoom 24 a cell is about 2 cm at the equator. */
+  const int ns_index_zoom = 24;
+  
+  
+  /** Returns the Web Mercator (i.e., the map tile) x and y coordinate, at #ns_index_zoom. */
+  pair<uint32_t,uint32_t> gps_to_tile_coords( double latitude, double longitude )
+  {
+    const double pi = 3.14159265358979323846;
+    const double max_lat = 85.0511287798; //The limit of Web Mercator
+    
+    latitude = std::max( -max_lat, std::min( max_lat, latitude ) );
+    longitude = std::max( -180.0, std::min( 180.0, longitude ) );
+    
+    const double lat_rad = latitude * pi / 180.0;
+    const double n = static_cast<double>( uint64_t(1) << ns_index_zoom );
+    const double x = n * (longitude + 180.0) / 360.0;
+    const double y = n * (1.0 - std::log( std::tan(lat_rad) + 1.0/std::cos(lat_rad) ) / pi) / 2.0;
+    
+    const double max_coord = n - 1.0;
+    const uint32_t ix = static_cast<uint32_t>( std::max( 0.0, std::min( max_coord, x ) ) );
+    const uint32_t iy = static_cast<uint32_t>( std::max( 0.0, std::min( max_coord, y ) ) );
+    
+    return { ix, iy };
+  }//gps_to_tile_coords(...)
+  
+  
+  /** Interleaves the bits of x and y, so that sorting by the result groups points in the same
+   grid cell together, at every zoom level (i.e., the key is a "quadkey", similar to geohashes).
+   */
+  uint64_t morton_key( const uint32_t x, const uint32_t y )
+  {
+    uint64_t answer = 0;
+    for( int bit = 0; bit < ns_index_zoom; ++bit )
+    {
+      answer |= (static_cast<uint64_t>((x >> bit) & 1u) << (2*bit));
+      answer |= (static_cast<uint64_t>((y >> bit) & 1u) << (2*bit + 1));
+    }
+    return answer;
+  }//uint64_t morton_key( const uint32_t x, const uint32_t y )
+  
+  
+  /** Collects GPS and count rate information for each sample; see #LeafletRadMap::createGeoLocationJson
+   for arguments.
+   */
+  vector<GpsSampleInfo> gps_sample_infos( const std::shared_ptr<const SpecMeas> &meas,
+                                          const std::set<int> &sample_to_include,
+                                          const std::vector<std::string> &det_to_include,
+                                          const std::set<int> &foreground_samples,
+                                          const std::set<int> &background_samples,
+                                          const std::set<int> &secondary_samples,
+                                          SpecUtils::time_point_t &start_times_offset )
+  {
+    vector<GpsSampleInfo> answer;
+    start_times_offset = SpecUtils::time_point_t{};
+    
+    if( !meas || !meas->has_gps_info() )
+      return answer;
+    
+    const vector<string> &det_names = meas->detector_names();
+    
+    for( const int sample : meas->sample_numbers() )
+    {
+      if( !sample_to_include.count(sample) && !sample_to_include.empty() )
+        continue;
+      
+      vector<shared_ptr<const SpecUtils::Measurement>> meass = meas->sample_measurements(sample);
+      
+      meass.erase( std::remove_if(meass.begin(), meass.end(),
+        [&](shared_ptr<const SpecUtils::Measurement> a){
+          return !a || (end(det_names) == std::find(begin(det_names), end(det_names), a->detector_name()));
+      }), meass.end() );
+      
+      
+      bool hadGps = false;
+      GpsSampleInfo info;
+      info.sample = sample;
+      info.latitude = info.longitude = -999.99;
+      SpecUtils::SourceType source_type = SpecUtils::SourceType::Unknown;
+      
+      SpecUtils::time_point_t meas_start_time{};
+      
+      for( const shared_ptr<const SpecUtils::Measurement> &m : meass )
+      {
+        const string &det_name = m->detector_name();
+        if( !det_to_include.empty()
+           && std::find( begin(det_to_include), end(det_to_include), det_name ) == end(det_to_include) )
+          continue;
+          
+        if( m->has_gps_info() )
+        {
+          hadGps = true;
+          // TODO: we could average or something here... not sure it matters much
+          info.latitude = m->latitude();
+          info.longitude = m->longitude();
+        }
+        
+        if( SpecUtils::is_special(meas_start_time) && !SpecUtils::is_special(m->start_time()) )
+        {
+          meas_start_time = m->start_time();
+          if( SpecUtils::is_special(start_times_offset) )
+            start_times_offset = meas_start_time;
+        }
+        
+        if( m->num_gamma_channels() >= 1 )
+        {
+          info.num_gamma_det += 1;
+          info.real_time = std::max( info.real_time, m->real_time() );
+          info.gamma_live_time += m->live_time();
+          info.gamma_real_time += m->real_time();
+          info.gamma_counts += m->gamma_count_sum();
+        }
+        
+        if( m->contained_neutron() )
+        {
+          info.num_neut_det += 1;
+          info.neutron_real_time += m->real_time();
+          info.neutron_counts += m->neutron_counts_sum();
+        }
+        
+        info.real_time = std::max( info.real_time, m->real_time() );
+        
+        if( m->source_type() != SpecUtils::SourceType::Unknown )
+          source_type = m->source_type();
+      }//for( const auto m : meass )
+      
+      if( !hadGps )
+        continue;
+      
+      if( !info.num_neut_det && !info.num_gamma_det )
+        continue;
+      
+      if( !SpecUtils::is_special(meas_start_time) )
+      {
+        const auto duration = meas_start_time - start_times_offset;
+        const auto millisecs = chrono::duration_cast<chrono::milliseconds>(duration);
+        info.has_time = true;
+        info.time_offset = static_cast<long long int>( millisecs.count() );
+      }//if( SpecUtils::is_special(meas_start_time) )
+      
+      info.source_type = static_cast<int>(source_type);
+      
+      if( foreground_samples.count(sample) )
+        info.display_type = 0;
+      else if( secondary_samples.count(sample) )
+        info.display_type = 1;
+      else if( background_samples.count(sample) )
+        info.display_type = 2;
+      
+      answer.push_back( info );
+    }//for( const int sample : meas->sample_numbers() )
+    
+    return answer;
+  }//vector<GpsSampleInfo> gps_sample_infos(...)
+  
+  
+  Wt::Json::Object sample_info_to_json( const GpsSampleInfo &info )
+  {
+    Wt::Json::Object sample_json;
+    if( info.has_time )
+      sample_json["timeOffset"] = info.time_offset;
+    
+    sample_json["nGDet"] = info.num_gamma_det;
+    if( info.num_gamma_det )
+    {
+      sample_json["gSum"] = info.gamma_counts;
+      sample_json["gRT"] = info.gamma_real_time;
+      sample_json["gLT"] = info.gamma_live_time;
+    }
+    
+    sample_json["nNDet"] = info.num_neut_det;
+    if( info.num_neut_det )
+    {
+      sample_json["nSum"] = info.neutron_counts;
+      sample_json["nRT"] = info.neutron_real_time;
+    }
+    
+    sample_json["rt"] = info.real_time;
+    sample_json["src"] = info.source_type;
+    sample_json["disp"] = info.display_type;
+    
+    Wt::Json::Array gps;
+    gps.push_back( info.latitude );
+    gps.push_back( info.longitude );
+    sample_json["gps"] = gps;
+    sample_json["sample"] = info.sample;
+    
+    return sample_json;
+  }//Wt::Json::Object sample_info_to_json( const GpsSampleInfo &info )
+  
+  
+  Wt::Json::Object geo_location_json_header( const std::shared_ptr<const SpecMeas> &meas,
+                                             const SpecUtils::time_point_t &start_times_offset )
+  {
+    Wt::Json::Object json;
+    json["fileName"] = Wt::WString::fromUTF8( meas->filename() );
+    
+    Wt::Json::Array detectors;
+    for( const auto det : meas->detector_names() )
+      detectors.push_back( Wt::WString::fromUTF8(det) );
+    json["detectors"] = detectors;
+    
+    if( !SpecUtils::is_special(start_times_offset) )
+    {
+      const auto dur = start_times_offset.time_since_epoch();
+      const auto millisecs = chrono::duration_cast<chrono::milliseconds>(dur);
+      json["startTime"] = static_cast<long long int>( millisecs.count() );
+    }//if( !SpecUtils::is_special(start_times_offset) )
+    
+    return json;
+  }//geo_location_json_header(...)
+  
+  
+  /** Returns if a {longitude,latitude} point is inside any of the outline polygons, while not
+   being inside any of their exclude polygons; each polygon is a vector of rings, with the first
+   ring the outline, and the rest the excluded regions, matching the GeoJSON the client sends.
+   */
+  bool in_selection( const vector<vector<vector<pair<double,double>>>> &polygons,
+                     const double lon, const double lat )
+  {
+    auto in_ring = []( const vector<pair<double,double>> &ring, const double x, const double y ) -> bool {
+      bool inside = false;
+      for( size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++ )
+      {
+        const double xi = ring[i].first, yi = ring[i].second;
+        const double xj = ring[j].first, yj = ring[j].second;
+        if( ((yi > y) != (yj > y)) && (x < ((xj - xi) * (y - yi) / (yj - yi) + xi)) )
+          inside = !inside;
+      }
+      return inside;
+    };//in_ring lambda
+    
+    bool in_any_outline = false, in_any_exclude = false;
+    for( const vector<vector<pair<double,double>>> &rings : polygons )
+    {
+      for( size_t i = 0; i < rings.size(); ++i )
+      {
+        if( rings[i].size() < 3 || !in_ring( rings[i], lon, lat ) )
+          continue;
+        
+        if( i == 0 )
+          in_any_outline = true;
+        else
+          in_any_exclude = true;
+      }//for( loop over rings )
+    }//for( loop over polygons )
+    
+    return in_any_outline && !in_any_exclude;
+  }//bool in_selection(...)
+}//namespace
+
+
+/** Spatial index of GPS points, for files with too many points to send all of them to the client.
+ 
+ Points are sorted by their Morton key, at #ns_index_zoom, so all points within a map tile, at any
+ zoom level, are a contiguous range of #samples, which can be found using binary search.
+ */
+struct LeafletRadMap::GpsIndex
+{
+  vector<GpsSampleInfo> samples;
+  vector<uint64_t> keys;
+  double min_gamma_cps = 0.0, max_gamma_cps = 0.0;
+  double min_lat = 0.0, max_lat = 0.0, min_lon = 0.0, max_lon = 0.0;
+  
+  explicit GpsIndex( const vector<GpsSampleInfo> &infos )
+   : samples(), keys()
+  {
+    vector<pair<uint64_t,size_t>> sorted_keys( infos.size() );
+    for( size_t i = 0; i < infos.size(); ++i )
+    {
+      const pair<uint32_t,uint32_t> xy = gps_to_tile_coords( infos[i].latitude, infos[i].longitude );
+      sorted_keys[i] = { morton_key( xy.first, xy.second ), i };
+    }
+    std::sort( begin(sorted_keys), end(sorted_keys) );
+    
+    samples.reserve( infos.size() );
+    keys.reserve( infos.size() );
+    for( const pair<uint64_t,size_t> &k : sorted_keys )
+    {
+      keys.push_back( k.first );
+      samples.push_back( infos[k.second] );
+    }
+    
+    bool first_gamma = true;
+    for( size_t i = 0; i < samples.size(); ++i )
+    {
+      const GpsSampleInfo &info = samples[i];
+      min_lat = (i ? std::min(min_lat, info.latitude) : info.latitude);
+      max_lat = (i ? std::max(max_lat, info.latitude) : info.latitude);
+      min_lon = (i ? std::min(min_lon, info.longitude) : info.longitude);
+      max_lon = (i ? std::max(max_lon, info.longitude) : info.longitude);
+      
+      if( info.num_gamma_det )
+      {
+        const double cps = info.gamma_cps();
+        min_gamma_cps = first_gamma ? cps : std::min( min_gamma_cps, cps );
+        max_gamma_cps = first_gamma ? cps : std::max( max_gamma_cps, cps );
+        first_gamma = false;
+      }
+    }//for( size_t i = 0; i < samples.size(); ++i )
+  }//GpsIndex constructor
+  
+  
+  /** Returns the JSON for the points within the given map viewport; if there are more than
+   #ns_max_individual_samples_in_view points, then neighboring points are aggregated into clusters.
+   */
+  string viewportJson( double south, double west, double north, double east, const int zoom ) const
+  {
+    // Leaflet will give longitudes outside [-180,180] when the map wraps around
+    if( (west < -180.0) || (east > 180.0) || (west > east) )
+    {
+      west = -180.0;
+      east = 180.0;
+    }
+    
+    const pair<uint32_t,uint32_t> nw = gps_to_tile_coords( north, west );
+    const pair<uint32_t,uint32_t> se = gps_to_tile_coords( south, east );
+    
+    // Cells should be about #ns_cluster_cell_zoom_offset zoom levels smaller than map tiles, but
+    //  we'll limit the number of cells, in case the client sent a viewport inconsistent with zoom
+    int cell_zoom = std::max( 0, std::min( ns_index_zoom, zoom + ns_cluster_cell_zoom_offset ) );
+    while( (cell_zoom > 0)
+          && ((uint64_t(((se.first - nw.first) >> (ns_index_zoom - cell_zoom)) + 1)
+               * uint64_t(((se.second - nw.second) >> (ns_index_zoom - cell_zoom)) + 1)) > 16384) )
+      --cell_zoom;
+    
+    const int shift = ns_index_zoom - cell_zoom;
+    const uint32_t x0 = (nw.first >> shift), x1 = (se.first >> shift);
+    const uint32_t y0 = (nw.second >> shift), y1 = (se.second >> shift);
+    
+    // Find the range of samples in each cell of the viewport
+    vector<pair<size_t,size_t>> cell_ranges;
+    size_t num_in_view = 0;
+    for( uint32_t x = x0; x <= x1; ++x )
+    {
+      for( uint32_t y = y0; y <= y1; ++y )
+      {
+        const uint64_t first_key = (morton_key(x, y) << (2*shift));
+        const uint64_t last_key = first_key + (uint64_t(1) << (2*shift));
+        const size_t start = std::lower_bound( begin(keys), end(keys), first_key ) - begin(keys);
+        const size_t stop = std::lower_bound( begin(keys) + start, end(keys), last_key ) - begin(keys);
+        if( stop > start )
+        {
+          cell_ranges.emplace_back( start, stop );
+          num_in_view += (stop - start);
+        }
+      }//for( loop over y )
+    }//for( loop over x )
+    
+    const bool cluster = (num_in_view > ns_max_individual_samples_in_view);
+    
+    Wt::Json::Array samples_json, clusters_json;
+    for( const pair<size_t,size_t> &range : cell_ranges )
+    {
+      if( !cluster || ((range.second - range.first) == 1) )
+      {
+        for( size_t i = range.first; i < range.second; ++i )
+          samples_json.push_back( sample_info_to_json( samples[i] ) );
+        continue;
+      }
+      
+      double sum_lat = 0.0, sum_lon = 0.0, max_cps = 0.0;
+      double gamma_counts = 0.0, gamma_live_time = 0.0, neutron_counts = 0.0, neutron_real_time = 0.0;
+      int num_gamma = 0, num_neutron = 0, display_type = 3;
+      for( size_t i = range.first; i < range.second; ++i )
+      {
+        const GpsSampleInfo &info = samples[i];
+        sum_lat += info.latitude;
+        sum_lon += info.longitude;
+        display_type = std::min( display_type, info.display_type );
+        if( info.num_gamma_det )
+        {
+          num_gamma += 1;
+          gamma_counts += info.gamma_counts;
+          gamma_live_time += info.gamma_live_time;
+          max_cps = std::max( max_cps, info.gamma_cps() );
+        }
+        if( info.num_neut_det )
+        {
+          num_neutron += 1;
+          neutron_counts += info.neutron_counts;
+          neutron_real_time += info.neutron_real_time;
+        }
+      }//for( size_t i = range.first; i < range.second; ++i )
+      
+      const double n = static_cast<double>( range.second - range.first );
+      
+      Wt::Json::Object cluster_json;
+      Wt::Json::Array gps;
+      gps.push_back( sum_lat / n );
+      gps.push_back( sum_lon / n );
+      cluster_json["gps"] = gps;
+      cluster_json["n"] = static_cast<int>( range.second - range.first );
+      cluster_json["disp"] = display_type;
+      if( num_gamma )
+      {
+        cluster_json["gSum"] = gamma_counts;
+        cluster_json["gLT"] = gamma_live_time;
+        cluster_json["maxGCps"] = max_cps;
+      }
+      if( num_neutron )
+      {
+        cluster_json["nSum"] = neutron_counts;
+        cluster_json["nRT"] = neutron_real_time;
+      }
+      
+      clusters_json.push_back( cluster_json );
+    }//for( const pair<size_t,size_t> &range : cell_ranges )
+    
+    Wt::Json::Object json;
+    json["zoom"] = zoom;
+    json["numInView"] = static_cast<int>( num_in_view );
+    json["samples"] = samples_json;
+    json["clusters"] = clusters_json;
+    
+    return Wt::Json::serialize( json );
+  }//string viewportJson(...)
+};//struct LeafletRadMap::GpsIndex
+
+
 SimpleDialog *LeafletRadMap::showForMeasurement( const std::shared_ptr<const SpecMeas> meas,
                                                  const set<int> &sample_numbers,
                                                  const vector<string> &detector_names,
@@ -206,7 +667,10 @@ LeafletRadMap::LeafletRadMap( Wt::WContainerWidget *parent )
   m_meas(),
   m_jsmap( jsRef() + ".map" ),
   m_displaySamples( this, "loadSamples", false),
-  m_loadSelected( this )
+  m_viewChanged( this, "viewChanged", false ),
+  m_loadSamplesInArea( this, "loadSamplesInArea", false ),
+  m_loadSelected( this ),
+  m_gps_index()
 {
   addStyleClass( "LeafletRadMap" );
       
@@ -248,6 +712,12 @@ LeafletRadMap::LeafletRadMap( Wt::WContainerWidget *parent )
   
   m_displaySamples.connect( boost::bind( &LeafletRadMap::handleLoadSamples, this,
                                         boost::placeholders::_1, boost::placeholders::_2 ) );
+  m_viewChanged.connect( boost::bind( &LeafletRadMap::handleViewChanged, this,
+                                     boost::placeholders::_1, boost::placeholders::_2,
+                                     boost::placeholders::_3, boost::placeholders::_4,
+                                     boost::placeholders::_5 ) );
+  m_loadSamplesInArea.connect( boost::bind( &LeafletRadMap::handleLoadSamplesInArea, this,
+                                           boost::placeholders::_1, boost::placeholders::_2 ) );
   
   InterSpec *viewer = InterSpec::instance();
   assert( viewer );
@@ -399,7 +869,6 @@ void LeafletRadMap::render( Wt::WFlags<Wt::RenderFlag> flags )
 }//void render( Wt::WFlags<Wt::RenderFlag> flags )
 
 
-
 std::string LeafletRadMap::createGeoLocationJson( const std::shared_ptr<const SpecMeas> &meas,
                                                  const std::set<int> &sample_to_include,
                                                  const std::vector<std::string> &det_to_include,
@@ -413,152 +882,142 @@ std::string LeafletRadMap::createGeoLocationJson( const std::shared_ptr<const Sp
     return "null";
   }
   
-  Wt::Json::Object json;//( {{"userLabel", Wt::Json::Value( Wt::WString::fromUTF8(label) )} } );
-  json["fileName"] = Wt::WString::fromUTF8( meas->filename() );
+  SpecUtils::time_point_t start_times_offset{};
+  const vector<GpsSampleInfo> infos = gps_sample_infos( meas, sample_to_include, det_to_include,
+                                  foreground_samples, background_samples, secondary_samples,
+                                  start_times_offset );
   
-  const vector<string> &det_names = meas->detector_names();
-  Wt::Json::Array detectors;
-  for( const auto det : det_names )
-    detectors.push_back( Wt::WString::fromUTF8(det) );
-  json["detectors"] = detectors;
+  Wt::Json::Object json = geo_location_json_header( meas, start_times_offset );
   
   Wt::Json::Array samplesData;
+  for( const GpsSampleInfo &info : infos )
+    samplesData.push_back( sample_info_to_json( info ) );
+  json["samples"] = samplesData;
+  
+  return Wt::Json::serialize(json);
+}//void createGeoLocationJson(...)
+
+
+void LeafletRadMap::setMapData( const std::set<int> &sample_to_include,
+                                const std::vector<std::string> &det_to_include,
+                                const std::set<int> &foreground_samples,
+                                const std::set<int> &background_samples,
+                                const std::set<int> &secondary_samples,
+                                const bool dont_update_zoom )
+{
+  m_gps_index.reset();
+  
+  if( !m_meas || !m_meas->has_gps_info() )
+  {
+    doJavaScript( m_jsmap +  ".setData( null, " + string(dont_update_zoom ? "true" : "false") + " );" );
+    return;
+  }
   
-  size_t numSamplesNoGps = 0;
   SpecUtils::time_point_t start_times_offset{};
+  const vector<GpsSampleInfo> infos = gps_sample_infos( m_meas, sample_to_include, det_to_include,
+                                  foreground_samples, background_samples, secondary_samples,
+                                  start_times_offset );
+  
+  Wt::Json::Object json = geo_location_json_header( m_meas, start_times_offset );
   
-  for( const int sample : meas->sample_numbers() )
+  if( infos.size() <= ns_max_samples_to_send_all )
   {
-    if( !sample_to_include.count(sample) && !sample_to_include.empty() )
-      continue;
-    
-    vector<shared_ptr<const SpecUtils::Measurement>> meass = meas->sample_measurements(sample);
-    
-    meass.erase( std::remove_if(meass.begin(), meass.end(),
-      [&](shared_ptr<const SpecUtils::Measurement> a){
-        return !a || (end(det_names) == std::find(begin(det_names), end(det_names), a->detector_name()));
-    }), meass.end() );
+    Wt::Json::Array samplesData;
+    for( const GpsSampleInfo &info : infos )
+      samplesData.push_back( sample_info_to_json( info ) );
+    json["samples"] = samplesData;
+  }else
+  {
+    // Too many points to send all of them; the client will request the points in its current
+    //  viewport, via #m_viewChanged, once it has zoomed to the data bounds.
+    m_gps_index.reset( new GpsIndex( infos ) );
     
+    Wt::Json::Array bounds, south_west, north_east;
+    south_west.push_back( m_gps_index->min_lat );
+    south_west.push_back( m_gps_index->min_lon );
+    north_east.push_back( m_gps_index->max_lat );
+    north_east.push_back( m_gps_index->max_lon );
+    bounds.push_back( south_west );
+    bounds.push_back( north_east );
     
-    bool hadGps = false;
-    double latitude = -999.99, longitude = -999.99;
-    int numGammaDet = 0, numNeutDet = 0;
-    float realTime = 0.0f;
-    SpecUtils::SourceType source_type = SpecUtils::SourceType::Unknown;
-    double gammaRealTime = 0.0, gammaLiveTime = 0.0, gammaCounts = 0.0;
-    double neutronRealTime = 0.0, neutronCounts = 0.0;
+    json["tiled"] = true;
+    json["bounds"] = bounds;
+    json["numSamples"] = static_cast<int>( m_gps_index->samples.size() );
+    json["minGammaCps"] = m_gps_index->min_gamma_cps;
+    json["maxGammaCps"] = m_gps_index->max_gamma_cps;
+    json["samples"] = Wt::Json::Array();
+  }//if( send all points ) / else
+  
+  doJavaScript( m_jsmap +  ".setData( " + Wt::Json::serialize(json) + ", "
+                + string(dont_update_zoom ? "true" : "false") + " );" );
+}//void setMapData(...)
+
+
+void LeafletRadMap::handleViewChanged( double south, double west, double north, double east, int zoom )
+{
+  if( !m_gps_index )
+    return;
+  
+  if( IsNan(south) || IsNan(west) || IsNan(north) || IsNan(east) || IsInf(south) || IsInf(west)
+     || IsInf(north) || IsInf(east) || (zoom < 0) || (zoom > 30) )
+    return;
+  
+  const string json = m_gps_index->viewportJson( south, west, north, east, zoom );
+  doJavaScript( m_jsmap +  ".setViewData( " + json + " );" );
+}//void handleViewChanged(...)
+
+
+void LeafletRadMap::handleLoadSamplesInArea( const std::string &polygons_json,
+                                             const std::string &meas_type )
+{
+  try
+  {
+    if( !m_gps_index )
+      throw runtime_error( "no spatial index." );
     
-    SpecUtils::time_point_t meas_start_time{};
+    // Decode the GeoJSON coordinates: array of polygons, that are each an array of rings, that
+    //  are each an array of [lon,lat].
+    Wt::Json::Value parsed;
+    Wt::Json::parse( polygons_json, parsed );
     
-    for( const shared_ptr<const SpecUtils::Measurement> &m : meass )
+    vector<vector<vector<pair<double,double>>>> polygons;
+    const Wt::Json::Array &polys_arr = parsed;
+    for( const Wt::Json::Value &poly_val : polys_arr )
     {
-      const string &det_name = m->detector_name();
-      if( !det_to_include.empty()
-         && std::find( begin(det_to_include), end(det_to_include), det_name ) == end(det_to_include) )
-        continue;
-        
-      if( m->has_gps_info() )
-      {
-        hadGps = true;
-        // TODO: we could average or something here... not sure it matters much
-        latitude = m->latitude();
-        longitude = m->longitude();
-      }
-      
-      if( SpecUtils::is_special(meas_start_time) && !SpecUtils::is_special(m->start_time()) )
-      {
-        meas_start_time = m->start_time();
-        if( SpecUtils::is_special(start_times_offset) )
-          start_times_offset = meas_start_time;
-      }
-      
-      if( m->num_gamma_channels() >= 1 )
+      polygons.emplace_back();
+      const Wt::Json::Array &rings_arr = poly_val;
+      for( const Wt::Json::Value &ring_val : rings_arr )
       {
-        numGammaDet += 1;
-        realTime = std::max( realTime, m->real_time() );
-        gammaLiveTime += m->live_time();
-        gammaRealTime += m->real_time();
-        gammaCounts += m->gamma_count_sum();
-      }
-      
-      if( m->contained_neutron() )
-      {
-        numNeutDet += 1;
-        neutronRealTime += m->real_time();
-        neutronCounts += m->neutron_counts_sum();
-      }
-      
-      realTime = std::max( realTime, m->real_time() );
-      
-      if( m->source_type() != SpecUtils::SourceType::Unknown )
-        source_type = m->source_type();
-    }//for( const auto m : meass )
-    
-    if( !hadGps )
-    {
-      numSamplesNoGps += 1;
-      continue;
-    }
-    
-    if( !numNeutDet && !numGammaDet )
-      continue;
-    
-    Wt::Json::Object sample_json;
-    if( !SpecUtils::is_special(meas_start_time) )
-    {
-      const auto duration = meas_start_time - start_times_offset;
-      const auto millisecs = chrono::duration_cast<chrono::milliseconds>(duration);
-      sample_json["timeOffset"] = static_cast<long long int>( millisecs.count() );
-    }//if( SpecUtils::is_special(meas_start_time) )
+        polygons.back().emplace_back();
+        const Wt::Json::Array &pts_arr = ring_val;
+        for( const Wt::Json::Value &pt_val : pts_arr )
+        {
+          const Wt::Json::Array &pt = pt_val;
+          if( pt.size() < 2 )
+            throw runtime_error( "invalid polygon point." );
+          polygons.back().back().emplace_back( pt[0].toNumber().orIfNull(0.0),
+                                               pt[1].toNumber().orIfNull(0.0) );
+        }//for( loop over points )
+      }//for( loop over rings )
+    }//for( loop over polygons )
     
-    sample_json["nGDet"] = numGammaDet;
-    if( numGammaDet )
+    set<int> samplenums;
+    for( const GpsSampleInfo &info : m_gps_index->samples )
     {
-      sample_json["gSum"] = gammaCounts;
-      sample_json["gRT"] = gammaRealTime;
-      sample_json["gLT"] = gammaLiveTime;
+      if( polygons.empty() || in_selection( polygons, info.longitude, info.latitude ) )
+        samplenums.insert( info.sample );
     }
     
-    sample_json["nNDet"] = numNeutDet;
-    if( numNeutDet )
-    {
-      sample_json["nSum"] = neutronCounts;
-      sample_json["nRT"] = neutronRealTime;
-    }
-    
-    sample_json["rt"] = realTime;
-    sample_json["src"] = static_cast<int>(source_type);
-    
-    int displ_type = 3;
-    if( foreground_samples.count(sample) )
-      displ_type = 0;
-    else if( secondary_samples.count(sample) )
-      displ_type = 1;
-    else if( background_samples.count(sample) )
-      displ_type = 2;
-    sample_json["disp"] = displ_type;
-    
-    
-    Wt::Json::Array gps;
-    gps.push_back(latitude);
-    gps.push_back(longitude);
-    sample_json["gps"] = gps;
-    sample_json["sample"] = sample;
+    if( samplenums.empty() )
+      throw runtime_error( "no measurements in selected area." );
     
-    samplesData.push_back( sample_json );
-  }//for( const int sample : meas->sample_numbers() )
-  
-  if( !SpecUtils::is_special(start_times_offset) )
+    loadSamples( samplenums, meas_type );
+  }catch( std::exception &e )
   {
-    const auto dur = start_times_offset.time_since_epoch();
-    const auto millisecs = chrono::duration_cast<chrono::milliseconds>(dur);
-    json["startTime"] = static_cast<long long int>( millisecs.count() );
-  }//if( !SpecUtils::is_special(start_times_offset) )
-  
-  json["samples"] = samplesData;
-  
-  return Wt::Json::serialize(json);
-}//void createGeoLocationJson(...)
+    passMessage( WString::tr("lrm-err-loading-samples").arg(e.what()),
+                WarningWidget::WarningMsgLevel:: WarningMsgHigh );
+  }//try / catch
+}//void handleLoadSamplesInArea(...)
 
 
 void LeafletRadMap::handleDisplayedSpectrumChanged()
@@ -588,11 +1047,8 @@ void LeafletRadMap::handleDisplayedSpectrumChanged()
   if( fore_meas != m_meas )
     det_to_include = m_meas->detector_names();
   
-  const string json = createGeoLocationJson( m_meas, m_meas->sample_numbers(),
-                                             det_to_include, foreground_samples,
-                                             background_samples, secondary_samples );
-  
-  doJavaScript( m_jsmap +  ".setData( " + json + ", true );" );
+  setMapData( m_meas->sample_numbers(), det_to_include, foreground_samples,
+              background_samples, secondary_samples, true );
 }//void handleDisplayedSpectrumChanged();
 
 
@@ -600,17 +1056,6 @@ void LeafletRadMap::handleLoadSamples( const std::string &samples, const std::st
 {
   try
   {
-    SpecUtils::SpectrumType type = SpecUtils::SpectrumType::Foreground;
-    
-    if( meas_type == "foreground" )
-      type = SpecUtils::SpectrumType::Foreground;
-    else if( meas_type == "background" )
-      type = SpecUtils::SpectrumType::Background;
-    else if( meas_type == "secondary" )
-      type = SpecUtils::SpectrumType::SecondForeground;
-    else
-      throw runtime_error( "couldnt decode spectrum type '" + meas_type + "'." );
-    
     vector<int> sample_numbers;
     SpecUtils::split_to_ints( samples.c_str(), samples.length(), sample_numbers );
     
@@ -624,35 +1069,7 @@ void LeafletRadMap::handleLoadSamples( const std::string &samples, const std::st
     
     const set<int> samplenums( begin(sample_numbers), end(sample_numbers) );
     
-    InterSpec *viewer = InterSpec::instance();
-    assert( viewer );
-    if( !viewer )
-      throw logic_error( "No valid InterSpec instance" );
-    
-    const std::shared_ptr<SpecMeas> prev_meas = viewer->measurment( type );
-    
-    if( prev_meas && (prev_meas == m_meas) )
-    {
-      viewer->changeDisplayedSampleNums( samplenums, type );
-    }else
-    {
-      const std::shared_ptr<SpecMeas> fore_meas = viewer->measurment( SpecUtils::SpectrumType::Foreground );
-      const std::shared_ptr<SpecMeas> back_meas = viewer->measurment( SpecUtils::SpectrumType::Background );
-      const std::shared_ptr<SpecMeas> second_meas = viewer->measurment( SpecUtils::SpectrumType::SecondForeground );
-      
-      std::shared_ptr<SpecMeas> non_const_meas;
-      if( m_meas == fore_meas )
-        non_const_meas = fore_meas;
-      else if( m_meas == back_meas )
-        non_const_meas = back_meas;
-      else if( m_meas == second_meas )
-        non_const_meas = second_meas;
-      
-      if( !non_const_meas )
-        throw runtime_error( "Spectrum file map was loaded from is not currently displayed." );
-      
-      viewer->setSpectrum( non_const_meas, samplenums, type );
-    }
+    loadSamples( samplenums, meas_type );
   }catch( std::exception &e )
   {
     passMessage( WString::tr("lrm-err-loading-samples").arg(e.what()),
@@ -661,6 +1078,51 @@ void LeafletRadMap::handleLoadSamples( const std::string &samples, const std::st
 }//void handleLoadSamples( const std::vector<int> &samples, std::string meas_type );
 
 
+void LeafletRadMap::loadSamples( const std::set<int> &samplenums, const std::string &meas_type )
+{
+  SpecUtils::SpectrumType type = SpecUtils::SpectrumType::Foreground;
+  
+  if( meas_type == "foreground" )
+    type = SpecUtils::SpectrumType::Foreground;
+  else if( meas_type == "background" )
+    type = SpecUtils::SpectrumType::Background;
+  else if( meas_type == "secondary" )
+    type = SpecUtils::SpectrumType::SecondForeground;
+  else
+    throw runtime_error( "couldnt decode spectrum type '" + meas_type + "'." );
+  
+  InterSpec *viewer = InterSpec::instance();
+  assert( viewer );
+  if( !viewer )
+    throw logic_error( "No valid InterSpec instance" );
+  
+  const std::shared_ptr<SpecMeas> prev_meas = viewer->measurment( type );
+  
+  if( prev_meas && (prev_meas == m_meas) )
+  {
+    viewer->changeDisplayedSampleNums( samplenums, type );
+  }else
+  {
+    const std::shared_ptr<SpecMeas> fore_meas = viewer->measurment( SpecUtils::SpectrumType::Foreground );
+    const std::shared_ptr<SpecMeas> back_meas = viewer->measurment( SpecUtils::SpectrumType::Background );
+    const std::shared_ptr<SpecMeas> second_meas = viewer->measurment( SpecUtils::SpectrumType::SecondForeground );
+    
+    std::shared_ptr<SpecMeas> non_const_meas;
+    if( m_meas == fore_meas )
+      non_const_meas = fore_meas;
+    else if( m_meas == back_meas )
+      non_const_meas = back_meas;
+    else if( m_meas == second_meas )
+      non_const_meas = second_meas;
+    
+    if( !non_const_meas )
+      throw runtime_error( "Spectrum file map was loaded from is not currently displayed." );
+    
+    viewer->setSpectrum( non_const_meas, samplenums, type );
+  }
+}//void loadSamples( const std::set<int> &samplenums, const std::string &meas_type )
+
+
 void LeafletRadMap::displayMeasurementOnMap( const std::shared_ptr<const SpecMeas> &meas,
                                             std::set<int> sample_numbers,
                                             std::vector<std::string> detector_names )
@@ -689,12 +1151,7 @@ void LeafletRadMap::displayMeasurementOnMap( const std::shared_ptr<const SpecMea
   if( meas == secondmeas )
     secon_samples = viewer->displayedSamples(SpecUtils::SpectrumType::SecondForeground);
   
-  const string json = createGeoLocationJson( meas, sample_numbers, detector_names,
-                                            fore_samples, back_samples, secon_samples );
-  
-  //cout << "displayMeasurementOnMap --> " << json << endl;
-  
-  doJavaScript( m_jsmap +  ".setData( " + json + ", false );" );
+  setMapData( sample_numbers, detector_names, fore_samples, back_samples, secon_samples, false );
 }//void displayMeasurementOnMap(...)
 
 
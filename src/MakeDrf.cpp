@@ -64,6 +64,7 @@
 
 #include "SandiaDecay/SandiaDecay.h"
 
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/QrCode.h"
 #include "InterSpec/MakeDrf.h"
 #include "InterSpec/SpecMeas.h"
@@ -2740,7 +2741,8 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
     }//try / catch fit FWHM
   };
   
-  WServer::instance()->ioService().boost::asio::io_service::post( worker );
+  // Only the most recent fit matters, so drop any not-yet-started fit for this widget
+  ComputeScheduler::post( sessionId, ComputeScheduler::Priority::Interactive, worker, "MakeDrf-fwhm-" + thisid );
 }//void fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks )
 
 
@@ -2886,7 +2888,7 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
     }//try / catch fit FWHM
   };
   
-  WServer::instance()->ioService().boost::asio::io_service::post( worker );
+  ComputeScheduler::post( sessionId, ComputeScheduler::Priority::Interactive, worker, "MakeDrf-eff-" + thisid );
 }//void fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
 
 
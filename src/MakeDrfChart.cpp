@@ -66,6 +66,12 @@ namespace
    points.
    */
   const int sm_num_eqn_energy_rows = 125; //ToDo: customize this based on chart size...
+  
+  /** The energy the equation curves are evaluated at for model `row` (`0 <= row < sm_num_eqn_energy_rows`). */
+  double eqn_energy( const int row, const double lower_energy, const double upper_energy )
+  {
+    return lower_energy + ((upper_energy - lower_energy) * row) / (sm_num_eqn_energy_rows - 1.0);
+  }
 }//namespace
 
 
@@ -401,7 +407,7 @@ void MakeDrfChart::updateEqnEnergyToModel()
   
   for( int row = 0; row < sm_num_eqn_energy_rows; ++row )
   {
-    const double energy = m_det_lower_energy + ((m_det_upper_energy * row) / (sm_num_eqn_energy_rows - 1.0f));
+    const double energy = eqn_energy( row, m_det_lower_energy, m_det_upper_energy );
     m->setData( row, sm_energy_col, boost::any(energy) );
   }//for( int row = 0; row < sm_num_eqn_energy_rows; ++row )
 }//void updateEqnEnergyToModel()
@@ -440,7 +446,7 @@ void MakeDrfChart::updateEffEquationToModel()
   
   for( int row = 0; row < sm_num_eqn_energy_rows; ++row )
   {
-    const float energy = static_cast<float>( m_det_lower_energy + ((m_det_upper_energy * row) / (sm_num_eqn_energy_rows - 1.0)) );
+    const float energy = static_cast<float>( eqn_energy( row, m_det_lower_energy, m_det_upper_energy ) );
     const double eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy*units, m_efficiencyCoefs );
     
     if( IsNan(eff) || IsInf(eff) )
@@ -543,7 +549,7 @@ void MakeDrfChart::updateFwhmEquationToModel()
 
   for( int row = 0; row < sm_num_eqn_energy_rows; ++row )
   {
-    const float energy = static_cast<float>( m_det_lower_energy + ((m_det_upper_energy * row) / (sm_num_eqn_energy_rows - 1.0)) );
+    const float energy = static_cast<float>( eqn_energy( row, m_det_lower_energy, m_det_upper_energy ) );
     const double fwhm = DetectorPeakResponse::peakResolutionFWHM( units*energy, eqnType, m_fwhmCoefs );
     m->setData( row, sm_equation_fwhm_col, boost::any(fwhm) );
   }//for( loop over eqn rows )
@@ -766,6 +772,12 @@ void MakeDrfChart::setFwhmCoefficients( const std::vector<float> &coeffs,
                                         const FwhmCoefType eqnType,
                                         const EqnEnergyUnits units )
 {
+  // MakeDrf sets all the coefficients whenever any input changes, so avoid re-sending the
+  //  (unchanged) curve to the client.
+  if( (coeffs == m_fwhmCoefs) && (uncerts == m_fwhmCoefUncerts)
+     && (eqnType == m_fwhmEqnType) && (units == m_fwhmEnergyUnits) )
+    return;
+  
   m_fwhmCoefs = coeffs;
   m_fwhmCoefUncerts = uncerts;
   m_fwhmEqnType = eqnType;
@@ -779,6 +791,10 @@ void MakeDrfChart::setEfficiencyCoefficients( const std::vector<float> &coeffs,
                                               const std::vector<float> &uncerts,
                                               const EqnEnergyUnits units )
 {
+  if( (coeffs == m_efficiencyCoefs) && (uncerts == m_efficiencyCoefUncerts)
+     && (units == m_efficiencyEnergyUnits) )
+    return;
+  
   m_efficiencyCoefs = coeffs;
   m_efficiencyCoefUncerts = uncerts;
   m_efficiencyEnergyUnits = units;
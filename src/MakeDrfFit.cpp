@@ -24,6 +24,7 @@
 #include "InterSpec_config.h"
 
 #include <vector>
+#include <string>
 
 #define BOOST_UBLAS_TYPE_CHECK 0
 #include <boost/numeric/ublas/lu.hpp>
@@ -44,7 +45,10 @@
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMinimize.h"
 
+#include "SpecUtils/SpecUtilsAsync.h"
+
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/MakeDrfFit.h"
 
 
@@ -1112,5 +1116,130 @@ double performEfficiencyFit( const std::vector<DetEffDataPoint> data,
   
   return (fcnOrder == data.size()) ? chi2 : (chi2 / (data.size() - fcnOrder));
 }//performEfficiencyFit(...)
+
+
+DrfFitInput::DrfFitInput()
+  : peaks( nullptr ),
+    fwhm_form( DetectorPeakResponse::kSqrtPolynomial ),
+    high_resolution( true ),
+    sqrt_eqn_order( 3 ),
+    fwhm_starting_values{},
+    eff_data{},
+    eff_fcn_order( 0 )
+{
+}
+
+
+DrfFitResult::DrfFitResult()
+  : fwhm_fit( false ),
+    fwhm_chi2( -1.0 ),
+    fwhm_coefficients{},
+    fwhm_uncertainties{},
+    fwhm_error{},
+    eff_fit( false ),
+    eff_chi2_dof( -1.0 ),
+    eff_coefficients{},
+    eff_uncertainties{},
+    eff_error{}
+{
+}
+
+
+std::vector<DrfFitResult> performDrfFits( const std::vector<DrfFitInput> &inputs )
+{
+  vector<DrfFitResult> results( inputs.size() );
+  
+  // Many DRFs in a batch may have been characterized with the same efficiency data, so we'll only
+  //  fit each unique efficiency data set once.
+  const auto same_eff_input = []( const DrfFitInput &lhs, const DrfFitInput &rhs ) -> bool {
+    if( (lhs.eff_fcn_order != rhs.eff_fcn_order) || (lhs.eff_data.size() != rhs.eff_data.size()) )
+      return false;
+    
+    for( size_t i = 0; i < lhs.eff_data.size(); ++i )
+    {
+      const DetEffDataPoint &l = lhs.eff_data[i], &r = rhs.eff_data[i];
+      if( (l.energy != r.energy) || (l.efficiency != r.efficiency) || (l.efficiency_uncert != r.efficiency_uncert) )
+        return false;
+    }
+    
+    return true;
+  };//same_eff_input lambda
+  
+  vector<size_t> eff_source( inputs.size() );
+  for( size_t i = 0; i < inputs.size(); ++i )
+  {
+    eff_source[i] = i;
+    for( size_t j = 0; j < i; ++j )
+    {
+      if( (eff_source[j] == j) && same_eff_input( inputs[i], inputs[j] ) )
+      {
+        eff_source[i] = j;
+        break;
+      }
+    }
+  }//for( size_t i = 0; i < inputs.size(); ++i )
+  
+  SharedThreadPool::TaskGroup pool;
+  
+  for( size_t i = 0; i < inputs.size(); ++i )
+  {
+    const DrfFitInput &input = inputs[i];
+    DrfFitResult &result = results[i];
+    
+    if( input.peaks && !input.peaks->empty() )
+    {
+      pool.post( [&input,&result](){
+        try
+        {
+          result.fwhm_coefficients = input.fwhm_starting_values;
+          result.fwhm_chi2 = performResolutionFit( input.peaks, input.fwhm_form, input.high_resolution,
+                                                   input.sqrt_eqn_order, result.fwhm_coefficients,
+                                                   result.fwhm_uncertainties );
+          result.fwhm_fit = true;
+        }catch( std::exception &e )
+        {
+          result.fwhm_coefficients.clear();
+          result.fwhm_uncertainties.clear();
+          result.fwhm_error = e.what();
+        }
+      } );
+    }//if( fit FWHM )
+    
+    if( !input.eff_data.empty() && (eff_source[i] == i) )
+    {
+      pool.post( [&input,&result](){
+        try
+        {
+          result.eff_chi2_dof = performEfficiencyFit( input.eff_data, input.eff_fcn_order,
+                                                      result.eff_coefficients, result.eff_uncertainties );
+          result.eff_fit = true;
+        }catch( std::exception &e )
+        {
+          result.eff_coefficients.clear();
+          result.eff_uncertainties.clear();
+          result.eff_error = e.what();
+        }
+      } );
+    }//if( fit efficiency )
+  }//for( size_t i = 0; i < inputs.size(); ++i )
+  
+  pool.join();
+  
+  for( size_t i = 0; i < inputs.size(); ++i )
+  {
+    if( inputs[i].eff_data.empty() || (eff_source[i] == i) )
+      continue;
+    
+    const DrfFitResult &src = results[eff_source[i]];
+    DrfFitResult &result = results[i];
+    result.eff_fit = src.eff_fit;
+    result.eff_chi2_dof = src.eff_chi2_dof;
+    result.eff_coefficients = src.eff_coefficients;
+    result.eff_uncertainties = src.eff_uncertainties;
+    result.eff_error = src.eff_error;
+  }//for( size_t i = 0; i < inputs.size(); ++i )
+  
+  return results;
+}//std::vector<DrfFitResult> performDrfFits( const std::vector<DrfFitInput> &inputs )
   
 }//namespace MakeDrfFit
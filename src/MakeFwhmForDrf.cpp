@@ -37,7 +37,10 @@
 
 #include "SpecUtils/SpecFile.h"
 #include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/SpecUtilsAsync.h"
 
+#include "InterSpec/ComputeScheduler.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/SpecMeas.h"
@@ -456,6 +459,9 @@ MakeFwhmForDrf::MakeFwhmForDrf( const bool auto_fit_peaks,
   m_fwhmEqnType( nullptr ),
   m_sqrtEqnOrder( nullptr ),
   m_parEdits{},
+  m_fitCache{},
+  m_fitCachePeaks{},
+  m_fitCacheHighRes( false ),
   m_error( nullptr ),
   m_equation( nullptr ),
   m_table( nullptr ),
@@ -680,7 +686,7 @@ void MakeFwhmForDrf::startAutomatedPeakSearch()
   const string seshid = wApp->sessionId();
   const shared_ptr<const DetectorPeakResponse> drf = m_orig_drf;
     
-  server->ioService().boost::asio::io_service::post( std::bind( [=](){
+  ComputeScheduler::post( seshid, ComputeScheduler::Priority::Interactive, std::bind( [=](){
     const bool singleThread = false;
     auto existingPeaks = make_shared<deque<shared_ptr<const PeakDef>>>();
     existingPeaks->insert( end(*existingPeaks), begin(user_peaks), end(user_peaks) );
@@ -708,9 +714,7 @@ void MakeFwhmForDrf::doRefitWork()
   
   try
   {
-    vector<shared_ptr<const PeakDef>> peaks = m_model->peaks_to_use();
-    auto peaks_deque = make_shared<deque<shared_ptr<const PeakDef>>>();
-    peaks_deque->insert( end(*peaks_deque), begin(peaks), end(peaks) );
+    const vector<shared_ptr<const PeakDef>> peaks = m_model->peaks_to_use();
     
     int sqrtEqnOrder = -1;
     
@@ -749,9 +753,19 @@ void MakeFwhmForDrf::doRefitWork()
     auto meas = m_interspec->displayedHistogram(SpecUtils::SpectrumType::Foreground);
     const bool highres = PeakFitUtils::is_high_res(meas);
     
-    vector<float> result, uncerts;
-    const double chi2 = MakeDrfFit::performResolutionFit( peaks_deque, fwhm_type, highres,
-                                                         sqrtEqnOrder, result, uncerts );
+    if( m_fitCache.empty() || (peaks != m_fitCachePeaks) || (highres != m_fitCacheHighRes) )
+      fitAllFwhmForms( peaks, highres );
+    
+    const auto fit_pos = m_fitCache.find( std::make_pair( fwhm_type_int, sqrtEqnOrder ) );
+    if( fit_pos == end(m_fitCache) )
+      throw runtime_error( "Invalid function type" );
+    
+    const FwhmFormFit &fit = fit_pos->second;
+    if( !fit.success )
+      throw runtime_error( fit.error_msg );
+    
+    const vector<float> &result = fit.parameters;
+    const vector<float> &uncerts = fit.uncertainties;
     
     m_parameters = result;
     m_uncertainties = uncerts;
@@ -838,6 +852,56 @@ void MakeFwhmForDrf::doRefitWork()
 }//void doRefitWork()
 
 
+void MakeFwhmForDrf::fitAllFwhmForms( const vector<shared_ptr<const PeakDef>> &peaks, const bool highres )
+{
+  auto peaks_deque = make_shared<deque<shared_ptr<const PeakDef>>>( begin(peaks), end(peaks) );
+  
+  vector<pair<int,int>> forms;
+  for( int i = 0; i < DetectorPeakResponse::ResolutionFnctForm::kNumResolutionFnctForm; ++i )
+  {
+    if( i == DetectorPeakResponse::kSqrtPolynomial )
+    {
+      for( int order = 1; order <= m_sqrtEqnOrder->count(); ++order )
+        forms.push_back( std::make_pair( i, order ) );
+    }else
+    {
+      forms.push_back( std::make_pair( i, -1 ) );
+    }
+  }//for( loop over functional forms )
+  
+  // The fits are independent, and each fairly quick, so we do them all at once, so the user can
+  //  change between equation types without waiting.
+  vector<FwhmFormFit> fits( forms.size() );
+  
+  SharedThreadPool::TaskGroup pool;
+  for( size_t i = 0; i < forms.size(); ++i )
+  {
+    pool.post( [i,highres,&forms,&fits,&peaks_deque](){
+      FwhmFormFit &fit = fits[i];
+      const auto fwhm_type = DetectorPeakResponse::ResolutionFnctForm( forms[i].first );
+      try
+      {
+        fit.chi2 = MakeDrfFit::performResolutionFit( peaks_deque, fwhm_type, highres,
+                                                     forms[i].second, fit.parameters, fit.uncertainties );
+        fit.success = true;
+      }catch( std::exception &e )
+      {
+        fit.success = false;
+        fit.error_msg = e.what();
+      }
+    } );
+  }//for( size_t i = 0; i < forms.size(); ++i )
+  pool.join();
+  
+  m_fitCache.clear();
+  for( size_t i = 0; i < forms.size(); ++i )
+    m_fitCache[forms[i]] = std::move( fits[i] );
+  
+  m_fitCachePeaks = peaks;
+  m_fitCacheHighRes = highres;
+}//void fitAllFwhmForms(...)
+
+
 void MakeFwhmForDrf::setEquationToChart()
 {
   auto meas = m_interspec->displayedHistogram(SpecUtils::SpectrumType::Foreground);
@@ -24,16 +24,28 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <list>
 #include <mutex>
 #include <cstdio>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstring>
 #include <utility>
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#if( !defined(_WIN32) )
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include <boost/fusion/adapted.hpp>
 #include <boost/spirit/include/qi.hpp>
 
@@ -125,9 +137,23 @@ namespace
   struct ElementProccessCoeffients
   {
     MassAttenuation::GammaEmProcces m_proccess;
+    
+    /** Storage of the data, when read in from the text files; empty when the data is from the
+     memory-mapped binary file.
+     */
     std::vector<float> m_logEnergies;
     std::vector<float> m_logAttenuationCoeffs;
     
+    /** The data actually used; points either into the above vectors, or into the memory-mapped
+     binary file.
+     */
+    const float *m_logEnergiesData = nullptr;
+    const float *m_logAttenuationCoeffsData = nullptr;
+    size_t m_numPoints = 0;
+    
+    /** Points #m_logEnergiesData and #m_logAttenuationCoeffsData to the owned vectors. */
+    void use_owned_data();
+    
     size_t memsize() const;
   };//struct ElementProccessCoeffients
   
@@ -148,6 +174,116 @@ namespace
     void loadTxt( std::string datapath, const int atomicNumber );
 #endif
   };//struct ElementAttenuation
+  
+  
+  /** The layout of the binary cross-section file written by
+   #MassAttenuation::write_binary_xs_data.
+   
+   The file is a #XsBinaryHeader, followed by `num_elements` #XsBinaryElement entries, followed
+   by `num_floats` floats.  Each process of each element has its `count` log-energies starting at
+   float index `offset`, immediately followed by its `count` log-attenuation coefficients.
+   All values are in native byte order; `byte_order_mark` is used to reject files written on a
+   machine with a different byte order.
+   
+   Each element also records the FNV-1a hash of the text file it was made from, so if the text
+   files are changed without re-writing the binary file, the text files will be used instead.
+   */
+  const char sm_xs_binary_magic[8] = { 'I', 'S', 'X', 'S', 'D', 'A', 'T', '\0' };
+  const uint32_t sm_xs_binary_version = 2;
+  const uint32_t sm_xs_binary_byte_order_mark = 0x01020304;
+  const char * const sm_xs_binary_filename = "em_xs_data.bin";
+  
+  struct XsBinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint32_t num_elements;
+    uint32_t num_floats;
+    /** FNV-1a hash of everything in the file after this header. */
+    uint32_t checksum;
+    uint32_t reserved;
+  };//struct XsBinaryHeader
+  
+  struct XsBinaryElement
+  {
+    char symbol[4];
+    float atomic_mass;
+    int32_t atomic_number;
+    uint32_t offset[static_cast<int>(MassAttenuation::GammaEmProcces::NumGammaEmProcces)];
+    uint32_t count[static_cast<int>(MassAttenuation::GammaEmProcces::NumGammaEmProcces)];
+    /** FNV-1a hash of the "<atomic_number>.xs.txt" file the data was made from. */
+    uint32_t source_hash;
+  };//struct XsBinaryElement
+  
+  static_assert( sizeof(XsBinaryHeader) == 32, "Unexpected XsBinaryHeader padding" );
+  static_assert( sizeof(XsBinaryElement) == 48, "Unexpected XsBinaryElement padding" );
+  
+  
+  uint32_t fnv1a_hash( const char *data, const size_t len )
+  {
+    uint32_t hash = 2166136261u;
+    for( size_t i = 0; i < len; ++i )
+    {
+      hash ^= static_cast<uint8_t>( data[i] );
+      hash *= 16777619u;
+    }
+    return hash;
+  }//uint32_t fnv1a_hash( const char *data, const size_t len )
+  
+  
+  /** Computes the #fnv1a_hash of the contents of the "<atomic_number>.xs.txt" file in `dir`.
+   
+   Returns false if the file could not be read.
+   */
+#ifdef _WIN32
+  bool xs_text_file_hash( const std::wstring &dir, const int atomic_number, uint32_t &hash );
+#else
+  bool xs_text_file_hash( const std::string &dir, const int atomic_number, uint32_t &hash );
+#endif
+  
+  
+  /** A read-only, validated, binary cross-section file.
+   
+   On POSIX systems the file is memory-mapped, so the pages are shared between all processes
+   using the same file; on Windows the file is read in with a single bulk read.
+   */
+  class XsBinaryData
+  {
+  public:
+    /** Opens and validates the file; throws std::exception if the file can not be read, or is
+     not a valid, current version, file.
+     */
+#ifdef _WIN32
+    explicit XsBinaryData( const std::wstring &filename );
+#else
+    explicit XsBinaryData( const std::string &filename );
+#endif
+    
+    XsBinaryData( const XsBinaryData & ) = delete;
+    XsBinaryData &operator=( const XsBinaryData & ) = delete;
+    
+    ~XsBinaryData();
+    
+    /** Returns the data for the element, with its processes pointing into this objects memory.
+     
+     Returns nullptr if the file does not contain the element, or if the text file for the element
+     in `txt_dir` exists, but is not the one the binary data was made from.
+     */
+#ifdef _WIN32
+    ElementAttenuation *element( const int atomic_number, const std::wstring &txt_dir ) const;
+#else
+    ElementAttenuation *element( const int atomic_number, const std::string &txt_dir ) const;
+#endif
+    
+  protected:
+    const char *m_data;
+    size_t m_size;
+    
+#if( defined(_WIN32) )
+    std::vector<char> m_buffer;
+#endif
+  };//class XsBinaryData
 
 
   /**
@@ -205,10 +341,37 @@ namespace
      */
     float massAttenuationCoeficientFracAN( const float atomic_number, const float energy );
     
+    /** Adds `weight` times the coefficient of `atomic_number`, at each of the `energies`, to
+     `answer`.
+     
+     \param process The process to use, or GammaEmProcces::NumGammaEmProcces for the total, the
+            same as #massAttenuationCoeficient.
+     */
+    void addMassAttenuationCoeficients( const int atomic_number, const float weight,
+                                        const std::vector<float> &energies,
+                                        const MassAttenuation::GammaEmProcces process,
+                                        std::vector<float> &answer );
+    
     
     static float logLogInterpolate( const float energy,
-                                   const std::vector<float> &logenergy,
-                                   const std::vector<float> &logxs );
+                                   const float *logenergy,
+                                   const float *logxs,
+                                   const size_t num_points );
+    
+    /** Same as the other #logLogInterpolate, but for all of `energies`, adding `weight` times the
+     results into `answer`.  Sorted energies are located by walking forward through the tables,
+     rather than a full binary search for each energy.
+     
+     \param zero_out_of_range If true, out of range energies contribute zero; otherwise an
+            exception is thrown, the same as the single-energy version.
+     */
+    static void logLogInterpolate( const std::vector<float> &energies,
+                                   const float *logenergy,
+                                   const float *logxs,
+                                   const size_t num_points,
+                                   const float weight,
+                                   const bool zero_out_of_range,
+                                   std::vector<float> &answer );
     
     /** Gives approximatly how much memorry is being taken up by this object.
      * Gives ~722 kb on my 64 bit mac.
@@ -229,18 +392,26 @@ namespace
 #endif
     
     std::atomic<const ElementAttenuation *> m_atten[98];
+    
+    /** Attempts to load the binary cross-section file the first time any element is needed. */
+    std::once_flag m_binaryDataLoad;
+    
+    /** The binary cross-section file, if it was found and valid; otherwise the text files are
+     used.
+     */
+    std::unique_ptr<const XsBinaryData> m_binaryData;
   };//class MassAttenuationTool
   
   inline float calcMassAttenuationCoeficient( const float energy,
                                              const MassAttenuation::GammaEmProcces process,
                                              const ElementAttenuation * const data )
   {
-    if( data->m_proccesses[static_cast<int>(process)].m_logEnergies.empty() ) //wont happen unless catasrophy
+    const ElementProccessCoeffients &coefs = data->m_proccesses[static_cast<int>(process)];
+    if( !coefs.m_numPoints ) //wont happen unless catasrophy
       throw runtime_error( "Not-loaded data" );
     
-    return MassAttenuationTool::logLogInterpolate( energy,
-                                                  data->m_proccesses[static_cast<int>(process)].m_logEnergies,
-                                                  data->m_proccesses[static_cast<int>(process)].m_logAttenuationCoeffs );
+    return MassAttenuationTool::logLogInterpolate( energy, coefs.m_logEnergiesData,
+                                                  coefs.m_logAttenuationCoeffsData, coefs.m_numPoints );
   }//calcMassAttenuationCoeficient(...)
 }//namespace
 
@@ -447,6 +618,83 @@ namespace MassAttenuation
   {
     return sm_xs_tool.massAttenuationCoeficientFracAN( atomic_number, energy );
   }
+  
+  
+  /** Process-wide LRU cache of computed attenuation curves; GammaXsGui, and shielding previews,
+   re-evaluate the same material at the same energies every time some input changes.
+   */
+  static std::mutex sm_curve_cache_mutex;
+  static std::list<std::pair<std::string,std::shared_ptr<const std::vector<float>>>> sm_curve_cache;
+  static std::map<std::string,decltype(sm_curve_cache)::iterator> sm_curve_cache_index;
+  static const size_t sm_max_curve_cache_size = 128;
+  
+  
+  static std::shared_ptr<const std::vector<float>>
+  cached_attenuation_coefficients( const std::vector<std::pair<int,float>> &mass_fractions,
+                                   const std::vector<float> &energies,
+                                   const GammaEmProcces process )
+  {
+    std::string key;
+    key.reserve( 1 + mass_fractions.size()*(sizeof(int) + sizeof(float)) + energies.size()*sizeof(float) );
+    key += static_cast<char>( static_cast<int>(process) );
+    for( const pair<int,float> &frac : mass_fractions )
+    {
+      key.append( reinterpret_cast<const char *>(&frac.first), sizeof(frac.first) );
+      key.append( reinterpret_cast<const char *>(&frac.second), sizeof(frac.second) );
+    }
+    key += '\x1f';
+    if( !energies.empty() )
+      key.append( reinterpret_cast<const char *>(energies.data()), energies.size()*sizeof(float) );
+    
+    {//begin lock on sm_curve_cache_mutex
+      std::lock_guard<std::mutex> lock( sm_curve_cache_mutex );
+      const auto pos = sm_curve_cache_index.find( key );
+      if( pos != end(sm_curve_cache_index) )
+      {
+        sm_curve_cache.splice( begin(sm_curve_cache), sm_curve_cache, pos->second );
+        return pos->second->second;
+      }
+    }//end lock on sm_curve_cache_mutex
+    
+    auto answer = make_shared<vector<float>>( energies.size(), 0.0f );
+    for( const pair<int,float> &frac : mass_fractions )
+      sm_xs_tool.addMassAttenuationCoeficients( frac.first, frac.second, energies, process, *answer );
+    
+    std::lock_guard<std::mutex> lock( sm_curve_cache_mutex );
+    if( sm_curve_cache_index.count( key ) )
+      return answer;
+    
+    sm_curve_cache.emplace_front( key, answer );
+    sm_curve_cache_index[key] = begin(sm_curve_cache);
+    
+    while( sm_curve_cache.size() > sm_max_curve_cache_size )
+    {
+      sm_curve_cache_index.erase( sm_curve_cache.back().first );
+      sm_curve_cache.pop_back();
+    }
+    
+    return answer;
+  }//cached_attenuation_coefficients(...)
+  
+  
+  std::shared_ptr<const std::vector<float>>
+  massAttenuationCoeficients( const std::vector<std::pair<int,float>> &mass_fractions,
+                              const std::vector<float> &energies )
+  {
+    return cached_attenuation_coefficients( mass_fractions, energies, GammaEmProcces::NumGammaEmProcces );
+  }
+  
+  
+  std::shared_ptr<const std::vector<float>>
+  massAttenuationCoeficients( const std::vector<std::pair<int,float>> &mass_fractions,
+                              const std::vector<float> &energies,
+                              MassAttenuation::GammaEmProcces process )
+  {
+    if( static_cast<int>(process) >= static_cast<int>(GammaEmProcces::NumGammaEmProcces) )
+      throw runtime_error( "Invalis EM Proccess" );
+    
+    return cached_attenuation_coefficients( mass_fractions, energies, process );
+  }
 
 
 /*
@@ -492,13 +740,14 @@ namespace
 {
 
 float MassAttenuationTool::logLogInterpolate( const float energy,
-                                              const vector<float> &logenergy,
-                                              const vector<float> &logxs )
+                                              const float *logenergy,
+                                              const float *logxs,
+                                              const size_t num_points )
 {
   const float log_x = log10(energy);
-  vector<float>::const_iterator ebegin = logenergy.begin();
-  vector<float>::const_iterator eend = logenergy.end();
-  const vector<float>::const_iterator iter = lower_bound( ebegin, eend, log_x );
+  const float * const ebegin = logenergy;
+  const float * const eend = logenergy + num_points;
+  const float * const iter = lower_bound( ebegin, eend, log_x );
 
   //Note: the (iter == (eend-1)) test below excludes values exactly equal
   //      to the highest energy value in the data file, but this is a detail
@@ -537,6 +786,63 @@ float MassAttenuationTool::logLogInterpolate( const float energy,
 }//float logLogInterpolate(...)
 
 
+void MassAttenuationTool::logLogInterpolate( const std::vector<float> &energies,
+                                             const float *logenergy,
+                                             const float *logxs,
+                                             const size_t num_points,
+                                             const float weight,
+                                             const bool zero_out_of_range,
+                                             std::vector<float> &answer )
+{
+  assert( answer.size() == energies.size() );
+  
+  const float * const ebegin = logenergy;
+  const float * const eend = logenergy + num_points;
+  const float *search_start = ebegin;
+  float prev_log_x = -std::numeric_limits<float>::infinity();
+  
+  for( size_t i = 0; i < energies.size(); ++i )
+  {
+    const float energy = energies[i];
+    const float log_x = log10(energy);
+    
+    // For sorted input we only need to search forward from the last position
+    if( log_x < prev_log_x )
+      search_start = ebegin;
+    prev_log_x = log_x;
+    
+    const float * const iter = lower_bound( search_start, eend, log_x );
+    search_start = (iter == ebegin) ? ebegin : (iter - 1);
+    
+    //Same range logic as the single-energy version.
+    if( iter == eend || (iter == (eend-1)) || iter == ebegin )
+    {
+      if( zero_out_of_range || (energy > 1.01*PhysicalUnits::keV && energy < 100.0*PhysicalUnits::MeV) )
+        continue;
+      
+      throw runtime_error( "logLogInterpolatedValue(...): Out of range" );
+    }//if( out of range )
+    
+    const size_t bin = iter - ebegin - 1;
+    const float f = (log_x - logenergy[bin])/(logenergy[bin+1] - logenergy[bin]);
+    const float value = logxs[bin] + (logxs[bin+1] - logxs[bin])*f;
+    const float xs = pow(float(10.0),value);
+    
+    if( !IsNan(xs) )
+      answer[i] += weight * xs;
+  }//for( size_t i = 0; i < energies.size(); ++i )
+}//void logLogInterpolate(...)
+
+
+void ElementProccessCoeffients::use_owned_data()
+{
+  assert( m_logEnergies.size() == m_logAttenuationCoeffs.size() );
+  m_logEnergiesData = m_logEnergies.data();
+  m_logAttenuationCoeffsData = m_logAttenuationCoeffs.data();
+  m_numPoints = m_logEnergies.size();
+}//void use_owned_data()
+
+
 size_t ElementProccessCoeffients::memsize() const
 {
   return sizeof(*this)
@@ -604,16 +910,16 @@ void ElementAttenuation::saveTxt( std::string path )
   
   for( const auto &proccess : m_proccesses )
   {
-    const vector<float> &energies = proccess.m_logEnergies;
-    for( size_t pos = 0; pos < energies.size(); ++pos )
+    const float * const energies = proccess.m_logEnergiesData;
+    for( size_t pos = 0; pos < proccess.m_numPoints; ++pos )
     {
       exact_short_float( energies[pos], buffer, sizeof(buffer) );
       fprintf( pFile, (pos ? " %s" : "%s"), buffer );
     }
     fprintf( pFile, "\n" );
     
-    const vector<float> &attcoefs = proccess.m_logAttenuationCoeffs;
-    for( size_t pos = 0; pos < attcoefs.size(); ++pos )
+    const float * const attcoefs = proccess.m_logAttenuationCoeffsData;
+    for( size_t pos = 0; pos < proccess.m_numPoints; ++pos )
     {
       exact_short_float( attcoefs[pos], buffer, sizeof(buffer) );
       fprintf( pFile, (pos ? " %s" : "%s"), buffer );
@@ -709,6 +1015,9 @@ void ElementAttenuation::loadTxt( std::string datapath, const int atomicNumber )
     
     if( attcoefs.size() != energies.size() )
       throw runtime_error( "Attenuation coefficient size != energy size" );
+    
+    m_proccesses[i].m_proccess = MassAttenuation::GammaEmProcces(i);
+    m_proccesses[i].use_owned_data();
   }//for( get proccess )
 }//void loadTxt( std::string datapath, const int atomicNumber )
 
@@ -763,12 +1072,33 @@ const ElementAttenuation *MassAttenuationTool::attenuationData(
   if( origptr )
     return origptr;
   
+  std::call_once( m_binaryDataLoad, [this](){
+    try
+    {
+#ifdef _WIN32
+      const wstring filename = append_path( m_dataPath, L"em_xs_data.bin" );
+#else
+      const string filename = append_path( m_dataPath, sm_xs_binary_filename );
+#endif
+      m_binaryData.reset( new XsBinaryData( filename ) );
+    }catch( std::exception & )
+    {
+      // No (valid) binary file - we'll use the text files.
+    }
+  } );
+  
   ElementAttenuation *thisData = nullptr;
   
   try
   {
-    thisData = new ElementAttenuation();
-    thisData->loadTxt( m_dataPath, atomic_number );
+    if( m_binaryData )
+      thisData = m_binaryData->element( atomic_number, m_dataPath );
+    
+    if( !thisData )
+    {
+      thisData = new ElementAttenuation();
+      thisData->loadTxt( m_dataPath, atomic_number );
+    }
 
     const bool changed = m_atten[atomic_number-1].compare_exchange_strong( origptr, thisData );
       
@@ -938,12 +1268,310 @@ float MassAttenuationTool::massAttenuationCoeficient( const int atomic_number,
 
   const ElementAttenuation *data = attenuationData( atomic_number );
 
-  if( data->m_proccesses[static_cast<int>(process)].m_logEnergies.empty() )
-    throw runtime_error( "Not-loaded data" );
-
-  return logLogInterpolate( energy,
-                         data->m_proccesses[static_cast<int>(process)].m_logEnergies,
-                         data->m_proccesses[static_cast<int>(process)].m_logAttenuationCoeffs );
+  return calcMassAttenuationCoeficient( energy, process, data );
 }//float massAttenuationCoeficient(...)
 
-}
+
+void MassAttenuationTool::addMassAttenuationCoeficients( const int atomic_number,
+                                                         const float weight,
+                                                         const std::vector<float> &energies,
+                                                         const MassAttenuation::GammaEmProcces process,
+                                                         std::vector<float> &answer )
+{
+  assert( answer.size() == energies.size() );
+  
+#if( USE_SNL_GAMMA_ATTENUATION_VALUES )
+  for( size_t i = 0; i < energies.size(); ++i )
+  {
+    if( process == MassAttenuation::GammaEmProcces::NumGammaEmProcces )
+      answer[i] += weight * massAttenuationCoeficient( atomic_number, energies[i] );
+    else
+      answer[i] += weight * massAttenuationCoeficient( atomic_number, energies[i], process );
+  }
+#else
+  const ElementAttenuation * const data = attenuationData( atomic_number );
+  
+  const auto add_process = [&]( const MassAttenuation::GammaEmProcces proc, const bool zero_out_of_range ){
+    const ElementProccessCoeffients &coefs = data->m_proccesses[static_cast<int>(proc)];
+    if( !coefs.m_numPoints ) //wont happen unless catasrophy
+      throw runtime_error( "Not-loaded data" );
+    
+    logLogInterpolate( energies, coefs.m_logEnergiesData, coefs.m_logAttenuationCoeffsData,
+                       coefs.m_numPoints, weight, zero_out_of_range, answer );
+  };//add_process lambda
+  
+  if( process == MassAttenuation::GammaEmProcces::NumGammaEmProcces )
+  {
+    //The pair production tables start at ~1025 keV, so lower energies get zero from it, same as
+    //  the single-energy version.
+    add_process( MassAttenuation::GammaEmProcces::ComptonScatter, true );
+    add_process( MassAttenuation::GammaEmProcces::PhotoElectric, true );
+    add_process( MassAttenuation::GammaEmProcces::PairProduction, true );
+  }else
+  {
+    if( static_cast<int>(process) > static_cast<int>(MassAttenuation::GammaEmProcces::NumGammaEmProcces) )
+      throw runtime_error( "Invalis EM Proccess" );
+    add_process( process, false );
+  }
+#endif
+}//void addMassAttenuationCoeficients(...)
+
+
+#ifdef _WIN32
+XsBinaryData::XsBinaryData( const std::wstring &filename )
+#else
+XsBinaryData::XsBinaryData( const std::string &filename )
+#endif
+  : m_data( nullptr ),
+    m_size( 0 )
+{
+#if( defined(_WIN32) )
+  ifstream input( filename.c_str(), ios_base::binary | ios_base::in | ios_base::ate );
+  if( !input.is_open() )
+    throw runtime_error( "Couldnt open binary cross-section file" );
+  
+  const std::streamoff filesize = input.tellg();
+  if( filesize < static_cast<std::streamoff>(sizeof(XsBinaryHeader)) )
+    throw runtime_error( "Binary cross-section file too small" );
+  
+  m_buffer.resize( static_cast<size_t>(filesize) );
+  input.seekg( 0, ios::beg );
+  if( !input.read( m_buffer.data(), filesize ) )
+    throw runtime_error( "Error reading binary cross-section file" );
+  
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+#else
+  const int fd = ::open( filename.c_str(), O_RDONLY );
+  if( fd < 0 )
+    throw runtime_error( "Couldnt open " + filename );
+  
+  struct stat statbuf;
+  if( (fstat( fd, &statbuf ) != 0)
+     || (statbuf.st_size < static_cast<off_t>(sizeof(XsBinaryHeader))) )
+  {
+    ::close( fd );
+    throw runtime_error( "Invalid size of " + filename );
+  }
+  
+  m_size = static_cast<size_t>( statbuf.st_size );
+  void *mapping = mmap( nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );  //The mapping stays valid after closing the file descriptor
+  
+  if( mapping == MAP_FAILED )
+    throw runtime_error( "Failed to memory-map " + filename );
+  
+  m_data = static_cast<const char *>( mapping );
+#endif
+  
+  try
+  {
+    XsBinaryHeader header;
+    memcpy( &header, m_data, sizeof(header) );
+    
+    if( memcmp( header.magic, sm_xs_binary_magic, sizeof(header.magic) ) != 0 )
+      throw runtime_error( "Not a binary cross-section file" );
+    
+    if( header.byte_order_mark != sm_xs_binary_byte_order_mark )
+      throw runtime_error( "Binary cross-section file has different byte order" );
+    
+    if( header.version != sm_xs_binary_version )
+      throw runtime_error( "Binary cross-section file is version "
+                           + std::to_string(header.version) + ", but expected version "
+                           + std::to_string(sm_xs_binary_version) );
+    
+    const size_t expected_size = sizeof(XsBinaryHeader)
+                                 + header.num_elements*sizeof(XsBinaryElement)
+                                 + header.num_floats*sizeof(float);
+    if( m_size != expected_size )
+      throw runtime_error( "Binary cross-section file size inconsistent with header" );
+    
+    const char * const payload = m_data + sizeof(XsBinaryHeader);
+    if( fnv1a_hash( payload, m_size - sizeof(XsBinaryHeader) ) != header.checksum )
+      throw runtime_error( "Binary cross-section file checksum failure" );
+    
+    for( uint32_t i = 0; i < header.num_elements; ++i )
+    {
+      XsBinaryElement el;
+      memcpy( &el, payload + i*sizeof(XsBinaryElement), sizeof(el) );
+      
+      if( (el.atomic_number < MassAttenuation::sm_min_xs_atomic_number)
+         || (el.atomic_number > MassAttenuation::sm_max_xs_atomic_number) )
+        throw runtime_error( "Binary cross-section file has invalid atomic number" );
+      
+      for( int proc = 0; proc < static_cast<int>(MassAttenuation::GammaEmProcces::NumGammaEmProcces); ++proc )
+      {
+        if( !el.count[proc]
+           || ((static_cast<uint64_t>(el.offset[proc]) + 2*static_cast<uint64_t>(el.count[proc])) > header.num_floats) )
+          throw runtime_error( "Binary cross-section file has invalid data range" );
+      }
+    }//for( loop over elements )
+  }catch( std::exception & )
+  {
+#if( !defined(_WIN32) )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+    throw;
+  }//try / catch
+}//XsBinaryData constructor
+
+
+XsBinaryData::~XsBinaryData()
+{
+#if( !defined(_WIN32) )
+  if( m_data )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+}//~XsBinaryData()
+
+
+#ifdef _WIN32
+ElementAttenuation *XsBinaryData::element( const int atomic_number, const std::wstring &txt_dir ) const
+#else
+ElementAttenuation *XsBinaryData::element( const int atomic_number, const std::string &txt_dir ) const
+#endif
+{
+  XsBinaryHeader header;
+  memcpy( &header, m_data, sizeof(header) );
+  
+  const char * const elements = m_data + sizeof(XsBinaryHeader);
+  const float * const floats = reinterpret_cast<const float *>( elements
+                                             + header.num_elements*sizeof(XsBinaryElement) );
+  
+  for( uint32_t i = 0; i < header.num_elements; ++i )
+  {
+    XsBinaryElement el;
+    memcpy( &el, elements + i*sizeof(XsBinaryElement), sizeof(el) );
+    
+    if( el.atomic_number != atomic_number )
+      continue;
+    
+    // If the text file has been changed since the binary file was written, we'll use the text file.
+    uint32_t txt_hash = 0;
+    if( xs_text_file_hash( txt_dir, atomic_number, txt_hash ) && (txt_hash != el.source_hash) )
+    {
+      cerr << "Binary cross-section data for Z=" << atomic_number
+           << " is out of date with its text file; using text file." << endl;
+      return nullptr;
+    }
+    
+    ElementAttenuation *answer = new ElementAttenuation();
+    answer->m_symbol = string( el.symbol, strnlen( el.symbol, sizeof(el.symbol) ) );
+    answer->m_atomicMass = el.atomic_mass;
+    answer->m_atomicNumber = el.atomic_number;
+    
+    for( int proc = 0; proc < static_cast<int>(MassAttenuation::GammaEmProcces::NumGammaEmProcces); ++proc )
+    {
+      ElementProccessCoeffients &coefs = answer->m_proccesses[proc];
+      coefs.m_proccess = MassAttenuation::GammaEmProcces(proc);
+      coefs.m_logEnergiesData = floats + el.offset[proc];
+      coefs.m_logAttenuationCoeffsData = floats + el.offset[proc] + el.count[proc];
+      coefs.m_numPoints = el.count[proc];
+    }
+    
+    return answer;
+  }//for( loop over elements )
+  
+  return nullptr;
+}//ElementAttenuation *element( const int atomic_number ) const
+
+
+#ifdef _WIN32
+bool xs_text_file_hash( const std::wstring &dir, const int atomic_number, uint32_t &hash )
+#else
+bool xs_text_file_hash( const std::string &dir, const int atomic_number, uint32_t &hash )
+#endif
+{
+#ifdef _WIN32
+  wchar_t filename[12];
+  _snwprintf( filename, sizeof(filename), L"%i.xs.txt", atomic_number );
+#else
+  char filename[12];
+  snprintf( filename, sizeof(filename), "%i.xs.txt", atomic_number );
+#endif
+  
+  ifstream file( append_path( dir, filename ).c_str(), ios_base::binary | ios_base::in );
+  if( !file.is_open() )
+    return false;
+  
+  const string contents( (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>() );
+  if( file.bad() )
+    return false;
+  
+  hash = fnv1a_hash( contents.data(), contents.size() );
+  return true;
+}//bool xs_text_file_hash(...)
+
+}//namespace
+
+
+namespace MassAttenuation
+{
+#ifdef _WIN32
+  void write_binary_xs_data( const std::wstring &txt_dir, const std::wstring &filename )
+#else
+  void write_binary_xs_data( const std::string &txt_dir, const std::string &filename )
+#endif
+  {
+    vector<XsBinaryElement> elements;
+    vector<float> floats;
+    
+    for( int an = sm_min_xs_atomic_number; an <= sm_max_xs_atomic_number; ++an )
+    {
+      ElementAttenuation data;
+      data.loadTxt( txt_dir, an );
+      
+      XsBinaryElement el;
+      memset( &el, 0, sizeof(el) );
+      if( data.m_symbol.size() > sizeof(el.symbol) )
+        throw runtime_error( "Element symbol too long: " + data.m_symbol );
+      memcpy( el.symbol, data.m_symbol.c_str(), data.m_symbol.size() );
+      el.atomic_mass = data.m_atomicMass;
+      el.atomic_number = data.m_atomicNumber;
+      
+      if( el.atomic_number != an )
+        throw runtime_error( "Cross-section file for Z=" + std::to_string(an)
+                             + " has atomic number " + std::to_string(el.atomic_number) );
+      
+      if( !xs_text_file_hash( txt_dir, an, el.source_hash ) )
+        throw runtime_error( "Couldnt read cross-section file for Z=" + std::to_string(an) );
+      
+      for( int proc = 0; proc < static_cast<int>(GammaEmProcces::NumGammaEmProcces); ++proc )
+      {
+        const ElementProccessCoeffients &coefs = data.m_proccesses[proc];
+        el.offset[proc] = static_cast<uint32_t>( floats.size() );
+        el.count[proc] = static_cast<uint32_t>( coefs.m_numPoints );
+        floats.insert( end(floats), coefs.m_logEnergiesData, coefs.m_logEnergiesData + coefs.m_numPoints );
+        floats.insert( end(floats), coefs.m_logAttenuationCoeffsData,
+                       coefs.m_logAttenuationCoeffsData + coefs.m_numPoints );
+      }
+      
+      elements.push_back( el );
+    }//for( loop over atomic numbers )
+    
+    string payload( elements.size()*sizeof(XsBinaryElement) + floats.size()*sizeof(float), '\0' );
+    memcpy( &payload[0], elements.data(), elements.size()*sizeof(XsBinaryElement) );
+    memcpy( &payload[elements.size()*sizeof(XsBinaryElement)], floats.data(), floats.size()*sizeof(float) );
+    
+    XsBinaryHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, sm_xs_binary_magic, sizeof(header.magic) );
+    header.version = sm_xs_binary_version;
+    header.byte_order_mark = sm_xs_binary_byte_order_mark;
+    header.num_elements = static_cast<uint32_t>( elements.size() );
+    header.num_floats = static_cast<uint32_t>( floats.size() );
+    header.checksum = fnv1a_hash( payload.data(), payload.size() );
+    
+    ofstream output( filename.c_str(), ios_base::binary | ios_base::out | ios_base::trunc );
+    if( !output.is_open() )
+#ifdef _WIN32
+      throw runtime_error( "Couldnt open output binary cross-section file" );
+#else
+      throw runtime_error( "Couldnt open " + filename );
+#endif
+    
+    if( !output.write( reinterpret_cast<const char *>(&header), sizeof(header) )
+       || !output.write( payload.data(), payload.size() ) )
+      throw runtime_error( "Error writing binary cross-section file" );
+  }//void write_binary_xs_data(...)
+}//namespace MassAttenuation
@@ -23,6 +23,7 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <mutex>
 #include <cmath>
 #include <memory>
@@ -41,6 +42,7 @@
 #include "InterSpec/MaterialDB.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/ServerMetrics.h"
 #include "InterSpec/WarningWidget.h"
 #include "SandiaDecay/SandiaDecay.h"
 
@@ -696,6 +698,48 @@ void MaterialDB::parseGadrasMaterialFile( const std::string &file,
 }//void parseGadrasMaterialFile(...)
 
 
+void MaterialDB::copyMaterialsFrom( const MaterialDB &other )
+{
+  if( &other == this )
+    return;
+  
+  vector<Material *> materials;
+  
+  {//begin lock on other.m_mutex
+    std::unique_lock<std::mutex> lock( other.m_mutex );
+    materials.reserve( other.m_materials.size() );
+    for( const Material *m : other.m_materials )
+    {
+      if( m != &sm_voidMaterial )
+        materials.push_back( new Material(*m) );
+    }
+  }//end lock on other.m_mutex
+  
+  {//begin lock on m_mutex
+    std::unique_lock<std::mutex> lock( m_mutex );
+    
+    const size_t norig = m_materials.size();
+    for( Material *material : materials )
+    {
+      const auto orig_end = begin(m_materials) + norig;
+      const auto pos = lower_bound( begin(m_materials), orig_end,
+                                    material, &MaterialDB::less_than_by_name );
+      
+      if( (pos != orig_end) && MaterialDB::equal_by_name(material, *pos) )
+        delete material;
+      else
+        m_materials.push_back( material );
+    }//for( Material *material : materials )
+    
+    sort( m_materials.begin(), m_materials.end(), &MaterialDB::less_than_by_name );
+  }//end lock on m_mutex
+  
+  refreshMaterialNames();
+  
+  m_condition.notify_all();
+}//void copyMaterialsFrom( const MaterialDB &other )
+
+
 
 void MaterialDB::parseG4MaterialFile( const std::string &file,
                             const SandiaDecay::SandiaDecayDataBase *db )
@@ -898,6 +942,16 @@ const Material *MaterialDB::parseChemicalFormula( string text,
       throw runtime_error( "Material '" + text + "' already exists in database" );
   }catch(...){}
 
+  //Shielding models loaded from XML or URLs, and batch configs, will give us the same formulas
+  //  over and over, so return the Material we already made for a formula, rather than parsing it
+  //  again, and adding a duplicate entry to the database.
+  {
+    std::unique_lock<std::mutex> lock( m_mutex );
+    const auto pos = m_formulaMaterials.find( text );
+    if( pos != end(m_formulaMaterials) )
+      return pos->second;
+  }
+  
   //If we're here, we have to parse the chemical formula, which might look like
   Material *material = new Material();
 
@@ -907,8 +961,18 @@ const Material *MaterialDB::parseChemicalFormula( string text,
     
     {
       std::unique_lock<std::mutex> lock( m_mutex );
+      
+      //Another thread may have parsed the same formula while we were parsing it
+      const auto pos = m_formulaMaterials.find( text );
+      if( pos != end(m_formulaMaterials) )
+      {
+        delete material;
+        return pos->second;
+      }
+      
       auto iter = lower_bound( m_materials.begin(), m_materials.end(), material, &MaterialDB::less_than_by_name );
       m_materials.insert( iter, material );
+      m_formulaMaterials[text] = material;
     }
     
     refreshMaterialNames();
@@ -927,8 +991,37 @@ const Material *MaterialDB::parseChemicalFormula( string text,
 Material MaterialDB::materialFromChemicalFormula( const std::string &formula,
                                             const SandiaDecay::SandiaDecayDataBase *db )
 {
+  //Parsed materials are cached process-wide; there are only ever a handful of distinct formulas
+  //  used this way, so we dont bother limiting the cache size.
+  typedef pair<string,const SandiaDecay::SandiaDecayDataBase *> FormulaKey_t;
+  static std::mutex s_cache_mutex;
+  static map<FormulaKey_t,Material> s_cache;
+  
+  static ServerMetrics::Counter &cache_hits = ServerMetrics::counter( "interspec_cache_lookups_total",
+                                  "Lookups into process-wide caches.", "cache=\"materials\",result=\"hit\"" );
+  static ServerMetrics::Counter &cache_misses = ServerMetrics::counter( "interspec_cache_lookups_total",
+                                  "Lookups into process-wide caches.", "cache=\"materials\",result=\"miss\"" );
+  
+  const FormulaKey_t key( formula, db );
+  
+  {
+    std::lock_guard<std::mutex> lock( s_cache_mutex );
+    const auto pos = s_cache.find( key );
+    if( pos != end(s_cache) )
+    {
+      cache_hits.increment();
+      return pos->second;
+    }
+  }
+  
+  cache_misses.increment();
+  
   Material answer;
   answer.parseChemicalFormula( formula, db );
+  
+  std::lock_guard<std::mutex> lock( s_cache_mutex );
+  s_cache.insert( std::make_pair( key, answer ) );
+  
   return answer;
 }
 
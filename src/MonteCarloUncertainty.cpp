@@ -0,0 +1,318 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+
+#include "SpecUtils/SpecFile.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/PeakFit.h"
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/MonteCarloUncertainty.h"
+
+using namespace std;
+
+namespace MonteCarloUncertainty
+{
+
+Distribution::Distribution()
+  : nominal(),
+    samples(),
+    num_failed( 0 )
+{
+}
+
+
+vector<double> Distribution::sorted_values( const size_t index ) const
+{
+  if( index >= nominal.size() )
+    throw runtime_error( "Distribution: invalid quantity index" );
+  
+  vector<double> values( samples.size() );
+  for( size_t i = 0; i < samples.size(); ++i )
+    values[i] = samples[i][index];
+  std::sort( begin(values), end(values) );
+  
+  return values;
+}//sorted_values(...)
+
+
+double Distribution::mean( const size_t index ) const
+{
+  if( index >= nominal.size() )
+    throw runtime_error( "Distribution: invalid quantity index" );
+  
+  if( samples.empty() )
+    throw runtime_error( "Distribution: no successful trials" );
+  
+  double sum = 0.0;
+  for( const vector<double> &sample : samples )
+    sum += sample[index];
+  
+  return sum / samples.size();
+}//mean(...)
+
+
+double Distribution::standard_deviation( const size_t index ) const
+{
+  if( samples.size() < 2 )
+    throw runtime_error( "Distribution: need at least two successful trials for standard deviation" );
+  
+  const double avrg = mean( index );
+  double sum2 = 0.0;
+  for( const vector<double> &sample : samples )
+    sum2 += (sample[index] - avrg) * (sample[index] - avrg);
+  
+  return sqrt( sum2 / (samples.size() - 1) );
+}//standard_deviation(...)
+
+
+double Distribution::quantile( const size_t index, const double p ) const
+{
+  if( (p < 0.0) || (p > 1.0) || std::isnan(p) )
+    throw runtime_error( "Distribution: quantile must be between 0 and 1" );
+  
+  const vector<double> values = sorted_values( index );
+  if( values.empty() )
+    throw runtime_error( "Distribution: no successful trials" );
+  
+  const double pos = p * (values.size() - 1);
+  const size_t lower = static_cast<size_t>( std::floor(pos) );
+  const size_t upper = std::min( lower + 1, values.size() - 1 );
+  const double frac = pos - lower;
+  
+  return values[lower] + frac*(values[upper] - values[lower]);
+}//quantile(...)
+
+
+Distribution run_trials( const vector<double> &nominal,
+                         const TrialFunction &trial,
+                         const size_t num_trials,
+                         const uint64_t seed,
+                         const std::atomic<bool> *cancel )
+{
+  if( !trial )
+    throw runtime_error( "run_trials: invalid trial function" );
+  
+  vector<vector<double>> results( num_trials );
+  vector<char> succeeded( num_trials, 0 ), ran( num_trials, 0 );
+  
+  std::mutex error_mutex;
+  std::exception_ptr size_error;
+  
+  SharedThreadPool::TaskGroup pool;
+  for( size_t i = 0; i < num_trials; ++i )
+  {
+    pool.post( [i, seed, cancel, &nominal, &trial, &results, &succeeded, &ran, &error_mutex, &size_error](){
+      if( cancel && cancel->load() )
+        return;
+      
+      ran[i] = 1;
+      
+      // Each trial gets its own generator, seeded from the trial number, so results dont depend on
+      //  thread scheduling.
+      std::seed_seq seq{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                         static_cast<uint32_t>(i), static_cast<uint32_t>(static_cast<uint64_t>(i) >> 32) };
+      std::mt19937_64 rng( seq );
+      
+      try
+      {
+        results[i] = trial( rng, i );
+      }catch( std::exception & )
+      {
+        return;
+      }
+      
+      if( results[i].size() != nominal.size() )
+      {
+        std::lock_guard<std::mutex> lock( error_mutex );
+        if( !size_error )
+          size_error = std::make_exception_ptr( runtime_error( "run_trials: trial returned "
+                                                + std::to_string(results[i].size()) + " values, but expected "
+                                                + std::to_string(nominal.size()) ) );
+        return;
+      }
+      
+      succeeded[i] = 1;
+    } );
+  }//for( size_t i = 0; i < num_trials; ++i )
+  
+  pool.join();
+  
+  if( size_error )
+    std::rethrow_exception( size_error );
+  
+  Distribution answer;
+  answer.nominal = nominal;
+  for( size_t i = 0; i < num_trials; ++i )
+  {
+    if( succeeded[i] )
+      answer.samples.push_back( std::move(results[i]) );
+    else if( ran[i] )
+      answer.num_failed += 1;
+  }//for( size_t i = 0; i < num_trials; ++i )
+  
+  return answer;
+}//run_trials(...)
+
+
+shared_ptr<SpecUtils::Measurement> poisson_resample( const SpecUtils::Measurement &nominal, std::mt19937_64 &rng )
+{
+  auto answer = make_shared<SpecUtils::Measurement>( nominal );
+  
+  const shared_ptr<const vector<float>> &counts = nominal.gamma_counts();
+  if( !counts || counts->empty() )
+    return answer;
+  
+  auto fluctuated = make_shared<vector<float>>( counts->size(), 0.0f );
+  for( size_t i = 0; i < counts->size(); ++i )
+  {
+    const double mean = (*counts)[i];
+    if( mean > 0.0 )
+    {
+      std::poisson_distribution<long long> poisson( mean );
+      (*fluctuated)[i] = static_cast<float>( poisson( rng ) );
+    }
+  }//for( size_t i = 0; i < counts->size(); ++i )
+  
+  answer->set_gamma_counts( fluctuated, nominal.live_time(), nominal.real_time() );
+  
+  return answer;
+}//poisson_resample(...)
+
+
+vector<double> gaussian_resample( const vector<double> &values,
+                                  const vector<vector<double>> &covariance,
+                                  std::mt19937_64 &rng )
+{
+  const size_t npar = values.size();
+  if( covariance.size() != npar )
+    throw runtime_error( "gaussian_resample: covariance matrix is wrong size" );
+  for( const vector<double> &row : covariance )
+  {
+    if( row.size() != npar )
+      throw runtime_error( "gaussian_resample: covariance matrix is not square" );
+  }
+  
+  // Cholesky decomposition, covariance = L*L^T; columns for parameters with no variance are left as zeros
+  vector<vector<double>> lower( npar, vector<double>(npar, 0.0) );
+  for( size_t j = 0; j < npar; ++j )
+  {
+    double diag = covariance[j][j];
+    for( size_t k = 0; k < j; ++k )
+      diag -= lower[j][k] * lower[j][k];
+    
+    const double tolerance = 1.0E-12 * std::max( 1.0, fabs(covariance[j][j]) );
+    if( diag < -tolerance )
+      throw runtime_error( "gaussian_resample: covariance matrix is not positive semi-definite" );
+    
+    if( diag <= tolerance )
+      continue;
+    
+    lower[j][j] = sqrt( diag );
+    for( size_t i = j + 1; i < npar; ++i )
+    {
+      double sum = covariance[i][j];
+      for( size_t k = 0; k < j; ++k )
+        sum -= lower[i][k] * lower[j][k];
+      lower[i][j] = sum / lower[j][j];
+    }
+  }//for( size_t j = 0; j < npar; ++j )
+  
+  std::normal_distribution<double> normal( 0.0, 1.0 );
+  vector<double> z( npar );
+  for( double &v : z )
+    v = normal( rng );
+  
+  vector<double> answer( values );
+  for( size_t i = 0; i < npar; ++i )
+  {
+    for( size_t k = 0; k <= i; ++k )
+      answer[i] += lower[i][k] * z[k];
+  }
+  
+  return answer;
+}//gaussian_resample(...)
+
+
+Distribution peak_amplitude_distribution( const shared_ptr<const SpecUtils::Measurement> &spectrum,
+                                          const vector<shared_ptr<const PeakDef>> &peaks,
+                                          const size_t num_trials,
+                                          const uint64_t seed )
+{
+  if( !spectrum || !spectrum->gamma_counts() )
+    throw runtime_error( "peak_amplitude_distribution: invalid spectrum" );
+  
+  if( peaks.empty() )
+    throw runtime_error( "peak_amplitude_distribution: no peaks" );
+  
+  // The nominal peaks are shared, immutable, starting points for every trial
+  vector<PeakDef> nominal_peaks;
+  for( const shared_ptr<const PeakDef> &p : peaks )
+  {
+    if( !p || (p->continuum() != peaks[0]->continuum()) )
+      throw runtime_error( "peak_amplitude_distribution: peaks must all share a continuum" );
+    nominal_peaks.push_back( *p );
+  }
+  std::sort( begin(nominal_peaks), end(nominal_peaks), &PeakDef::lessThanByMean );
+  
+  const double lower_energy = nominal_peaks.front().lowerX();
+  const double upper_energy = nominal_peaks.front().upperX();
+  
+  vector<double> nominal;
+  for( const PeakDef &p : nominal_peaks )
+    nominal.push_back( p.amplitude() );
+  
+  const TrialFunction trial = [&]( std::mt19937_64 &rng, const size_t ) -> vector<double> {
+    const shared_ptr<const SpecUtils::Measurement> resampled = poisson_resample( *spectrum, rng );
+    
+    // Starting from the nominal peaks; thresholds of zero keep insignificant peaks in the fit
+    const vector<PeakDef> fixed_peaks;
+    vector<PeakDef> fit_peaks = fitPeaksInRange( lower_energy, upper_energy, 0.0, 0.0, 0.0,
+                                                 nominal_peaks, resampled, fixed_peaks, true );
+    if( fit_peaks.size() != nominal_peaks.size() )
+      throw runtime_error( "peak lost in refit" );
+    
+    std::sort( begin(fit_peaks), end(fit_peaks), &PeakDef::lessThanByMean );
+    
+    vector<double> amplitudes;
+    for( const PeakDef &p : fit_peaks )
+      amplitudes.push_back( p.amplitude() );
+    return amplitudes;
+  };//trial
+  
+  return run_trials( nominal, trial, num_trials, seed );
+}//peak_amplitude_distribution(...)
+
+}//namespace MonteCarloUncertainty
@@ -24,10 +24,13 @@
 #include "InterSpec_config.h"
 
 #include <chrono> // just for timing things
+#include <mutex>
 #include <string>
+#include <cctype>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <iterator>
 #include <algorithm>
 
 #include "rapidxml/rapidxml.hpp"
@@ -51,6 +54,113 @@ namespace
   std::mutex sm_mutex;
   MoreNuclideInfo::InfoStatus sm_status = MoreNuclideInfo::InfoStatus::NotInited;
   std::shared_ptr<const MoreNuclideInfo::MoreNucInfoDb> sm_db;
+  
+  /** Protects the decoded-entry caches of `MoreNucInfoDb` instances. */
+  std::mutex sm_cache_mutex;
+  
+  
+  /** Returns the position of the next "<tag" element opening (i.e., followed by whitespace, '>' or
+   '/') in `data`, at or after `pos`, skipping over comments and CDATA sections.
+   
+   Returns std::string::npos if not found.
+   */
+  size_t find_element_start( const string &data, const string &tag, size_t pos )
+  {
+    while( pos < data.size() )
+    {
+      pos = data.find( '<', pos );
+      if( pos == string::npos )
+        return string::npos;
+      
+      if( data.compare( pos, 4, "<!--" ) == 0 )
+      {
+        pos = data.find( "-->", pos + 4 );
+        if( pos == string::npos )
+          return string::npos;
+        pos += 3;
+        continue;
+      }//if( a comment )
+      
+      if( data.compare( pos, 9, "<![CDATA[" ) == 0 )
+      {
+        pos = data.find( "]]>", pos + 9 );
+        if( pos == string::npos )
+          return string::npos;
+        pos += 3;
+        continue;
+      }//if( a CDATA section )
+      
+      const size_t after = pos + 1 + tag.size();
+      if( (data.compare( pos + 1, tag.size(), tag ) == 0)
+         && (after < data.size())
+         && (std::isspace( static_cast<unsigned char>(data[after]) ) || (data[after] == '>') || (data[after] == '/')) )
+      {
+        return pos;
+      }
+      
+      pos += 1;
+    }//while( pos < data.size() )
+    
+    return string::npos;
+  }//find_element_start(...)
+  
+  
+  /** Returns one past the end of the element whose opening starts at `start` (as found by
+   #find_element_start) - i.e., its closing tag, or end of a self-closing tag.
+   
+   Returns std::string::npos if the element isnt closed.
+   */
+  size_t find_element_end( const string &data, const string &tag, const size_t start )
+  {
+    const size_t open_end = data.find( '>', start );
+    if( open_end == string::npos )
+      return string::npos;
+    
+    if( data[open_end - 1] == '/' )
+      return open_end + 1;
+    
+    const string close_tag = "</" + tag + ">";
+    const size_t close_pos = data.find( close_tag, open_end );
+    return (close_pos == string::npos) ? string::npos : (close_pos + close_tag.size());
+  }//find_element_end(...)
+  
+  
+  /** Returns the raw (entities not translated) value of the `attrib` attribute of the element opening tag starting
+   at `start`, or an empty string if not found.
+   */
+  string opening_tag_attribute( const string &data, const size_t start, const string &attrib )
+  {
+    const size_t open_end = data.find( '>', start );
+    if( open_end == string::npos )
+      return string();
+    
+    size_t pos = start;
+    while( (pos = data.find( attrib, pos + 1 )) != string::npos && (pos < open_end) )
+    {
+      if( !std::isspace( static_cast<unsigned char>(data[pos - 1]) ) )
+        continue;
+      
+      size_t eq = pos + attrib.size();
+      while( (eq < open_end) && std::isspace( static_cast<unsigned char>(data[eq]) ) )
+        ++eq;
+      if( (eq >= open_end) || (data[eq] != '=') )
+        continue;
+      
+      size_t quote = eq + 1;
+      while( (quote < open_end) && std::isspace( static_cast<unsigned char>(data[quote]) ) )
+        ++quote;
+      if( (quote >= open_end) || ((data[quote] != '"') && (data[quote] != '\'')) )
+        continue;
+      
+      const size_t value_end = data.find( data[quote], quote + 1 );
+      if( (value_end == string::npos) || (value_end > open_end) )
+        return string();
+      
+      return data.substr( quote + 1, value_end - quote - 1 );
+    }//while( find attribute name )
+    
+    return string();
+  }//opening_tag_attribute(...)
 }
 
 
@@ -95,19 +205,28 @@ namespace MoreNuclideInfo
   size_t MoreNucInfoDb::memsize() const
   {
     size_t len = sizeof( this )
-      + (m_nuc_infos.size() * sizeof( const SandiaDecay::Nuclide * ))
-      + (m_other_infos.size() * sizeof( string ))
+      + m_filename.capacity()
+      + (m_nuc_index.size() * (sizeof( const SandiaDecay::Nuclide * ) + sizeof( NucLocation )))
+      + (m_other_index.size() * (sizeof( string ) + sizeof( NucLocation )))
       + (m_references.size() * sizeof( string ));
     
+    for( const auto &v : m_other_index )
+      len += v.first.capacity();
+    
+    for( const auto &v : m_references )
+      len += v.first.capacity() + v.second.memsize();
+    
+    std::lock_guard<std::mutex> lock( sm_cache_mutex );
+    
+    len += (m_nuc_infos.size() * sizeof( const SandiaDecay::Nuclide * ))
+         + (m_other_infos.size() * sizeof( string ));
+    
     for( const auto &v : m_nuc_infos )
       len += v.second.memsize();
 
     for( const auto &v : m_other_infos )
       len += v.first.capacity() + v.second.memsize();
 
-    for( const auto &v : m_references )
-      len += v.first.capacity() + v.second.memsize();
-
     return len;
   }//size_t MoreNucInfoDb::memsize()
 
@@ -174,6 +293,9 @@ namespace MoreNuclideInfo
     //  computers.  Debug mode takes 24 ms to initualize.
     const auto start_time = std::chrono::steady_clock::now();
     
+    m_filename.clear();
+    m_nuc_index.clear();
+    m_other_index.clear();
     m_nuc_infos.clear();
     m_other_infos.clear();
     m_references.clear();
@@ -204,6 +326,8 @@ namespace MoreNuclideInfo
 #else
         infile.open( file_path.c_str(), ios::in | ios::binary );
 #endif
+        if( infile.is_open() )
+          m_filename = file_path;
       }catch(std::exception &)
       {
         //InterSpec::writableDataDirectory throws exception if it hasnt been set
@@ -221,6 +345,8 @@ namespace MoreNuclideInfo
 #else
       infile.open( file_path.c_str(), ios::in | ios::binary );
 #endif
+      if( infile.is_open() )
+        m_filename = file_path;
     }//if( try to open default more_nuclide_info.xml )
     
     // Finally, try the CWD
@@ -231,13 +357,29 @@ namespace MoreNuclideInfo
 #else
       infile.open( filename.c_str(), ios::in | ios::binary );
 #endif
+      if( infile.is_open() )
+        m_filename = filename;
     }//if( try to open default more_nuclide_info.xml )
 
     
     if( !infile.is_open() )
       throw runtime_error( "MoreNucInfoDb::init: couldnt open '" + filename + "'" );
 
-    rapidxml::file<char> input_data( infile );
+    const string data( (std::istreambuf_iterator<char>( infile )), std::istreambuf_iterator<char>() );
+    
+    const size_t base_pos = find_element_start( data, "AddNucInfo", 0 );
+    if( base_pos == string::npos )
+      throw runtime_error( filename + " doesnt have base-node 'AddNucInfo'" );
+    
+    // The references are small, and all needed whenever any notes are displayed, so we'll parse
+    //  them now.
+    const size_t refs_start = find_element_start( data, "References", base_pos );
+    const size_t refs_end = (refs_start == string::npos) ? string::npos
+                                                         : find_element_end( data, "References", refs_start );
+    if( refs_end == string::npos )
+      throw runtime_error( filename + " doesnt have node 'References'" );
+    
+    string refs_data = data.substr( refs_start, refs_end - refs_start );
     rapidxml::xml_document<char> doc;
 
     try
@@ -245,14 +387,14 @@ namespace MoreNuclideInfo
       // We'll parse non-destructively, meaning we will have to use
       // xml_base::name_size() and xml_base::value_size() and also entities
       // will not be translated
-      doc.parse<rapidxml::parse_trim_whitespace | rapidxml::parse_non_destructive>( input_data.data() );
+      doc.parse<rapidxml::parse_trim_whitespace | rapidxml::parse_non_destructive>( &(refs_data[0]) );
     }catch( rapidxml::parse_error &e )
     {
       string msg = "Error parsing MoreNucInfoDb XML: " + string( e.what() );
       const char *const position = e.where<char>();
       if( position && *position )
       {
-        const char *end_pos = (const char *)input_data.data() + input_data.size();
+        const char *end_pos = refs_data.c_str() + refs_data.size();
         end_pos = std::min( position + 80, end_pos );
 
         msg += "\n\tAt: " + std::string( position, end_pos );
@@ -261,16 +403,12 @@ namespace MoreNuclideInfo
       throw runtime_error( msg );
     }//try / catch
  
-    const rapidxml::xml_node<char> * const base_node = XML_FIRST_NODE( &doc, "AddNucInfo" );
-    if( !base_node )
-      throw runtime_error( filename + " doesnt have base-node 'AddNucInfo'" );
-
-    const rapidxml::xml_node<char> * const references_node = XML_FIRST_NODE( base_node, "References" );
+    const rapidxml::xml_node<char> * const references_node = XML_FIRST_NODE( &doc, "References" );
     if( !references_node )
       throw runtime_error( filename + " doesnt have node 'References'" );
 
-    const rapidxml::xml_node<char> * const nuclides_node = XML_FIRST_NODE( base_node, "Nuclides" );
-    if( !nuclides_node )
+    const size_t nucs_start = find_element_start( data, "Nuclides", base_pos );
+    if( nucs_start == string::npos )
       throw runtime_error( filename + " doesnt have node 'Nuclides'" );
 
 
@@ -297,46 +435,38 @@ namespace MoreNuclideInfo
       m_references.emplace( std::move(key), RefInfo{std::move(key_cpy), std::move(url), std::move(desc)} );
     }//for( loop over <Ref> nodes )
 
-
-    XML_FOREACH_CHILD( nuc_node, nuclides_node, "Nuc" )
+    
+    // For the nuclides, we'll only record where each <Nuc> element is; they are decoded on demand.
+    const size_t nucs_end = find_element_end( data, "Nuclides", nucs_start );
+    size_t pos = find_element_start( data, "Nuc", nucs_start );
+    while( (pos != string::npos) && (pos < nucs_end) )
     {
-      const rapidxml::xml_attribute<char> *const name_att = XML_FIRST_ATTRIB( nuc_node, "name" );
+      const size_t nuc_end = find_element_end( data, "Nuc", pos );
+      if( nuc_end == string::npos )
+        throw runtime_error( filename + " has an unclosed <Nuc> element" );
+      
+      const string name = opening_tag_attribute( data, pos, "name" );
       
       // The following assert is for developing the XML, not coding logic
-      assert( name_att && name_att->value_size() );
-
-      if( !name_att || !name_att->value_size() )
-        continue;
-
-      const rapidxml::xml_node<char> *const assoc_node = XML_FIRST_NODE( nuc_node, "Associated" );
-      const rapidxml::xml_node<char> *const notes_node = XML_FIRST_NODE( nuc_node, "Notes" );
-
-      NucInfo info;
-      info.m_nuclide = SpecUtils::xml_value_str( name_att );
-      info.m_notes = SpecUtils::xml_value_str( notes_node );
-
-      const string associated = SpecUtils::xml_value_str( assoc_node );
-      SpecUtils::split( info.m_associated, associated, ";" );
-      for( std::string &val : info.m_associated )
-        SpecUtils::trim( val );
-
-      // The following assert is for developing the XML, not coding logic
-      assert( !info.m_notes.empty() || !info.m_associated.empty() );
-
-      const SandiaDecay::Nuclide * nuc = db->nuclide( info.m_nuclide );
-      if( nuc )
-      {
-        m_nuc_infos.emplace( nuc, std::move( info ) );
-      } else
+      assert( !name.empty() );
+      
+      if( !name.empty() )
       {
-        // I think the next line would be fine, but havent checked it
-        //m_other_infos[info.m_nuclide] = std::move( info );
-        const string nucstr = info.m_nuclide;
-        m_other_infos.emplace( std::move(nucstr), std::move( info ) );
-      }
-    }//XML_FOREACH_CHILD( nuc_node, nuclides_node, "Nuc" )
+        NucLocation location;
+        location.m_offset = pos;
+        location.m_length = nuc_end - pos;
+        
+        const SandiaDecay::Nuclide * nuc = db->nuclide( name );
+        if( nuc )
+          m_nuc_index.emplace( nuc, location );
+        else
+          m_other_index.emplace( name, location );
+      }//if( !name.empty() )
+      
+      pos = find_element_start( data, "Nuc", nuc_end );
+    }//while( loop over <Nuc> elements )
 
-    if( m_nuc_infos.empty() )
+    if( m_nuc_index.empty() )
       throw runtime_error( "MoreNucInfoDb::init: Failed to read in any nuclides" );
 
     const auto finish_time = std::chrono::steady_clock::now();
@@ -347,6 +477,48 @@ namespace MoreNuclideInfo
   }//void init()
 
   
+  NucInfo MoreNucInfoDb::decode( const NucLocation &location ) const
+  {
+#ifdef _WIN32
+    ifstream infile( SpecUtils::convert_from_utf8_to_utf16( m_filename ).c_str(), ios::in | ios::binary );
+#else
+    ifstream infile( m_filename.c_str(), ios::in | ios::binary );
+#endif
+    if( !infile.is_open() )
+      throw runtime_error( "couldnt open '" + m_filename + "'" );
+    
+    string data( location.m_length, '\0' );
+    if( !infile.seekg( static_cast<streamoff>(location.m_offset), ios::beg )
+       || !infile.read( &(data[0]), static_cast<streamsize>(location.m_length) ) )
+      throw runtime_error( "failed to read entry from '" + m_filename + "'" );
+    
+    rapidxml::xml_document<char> doc;
+    doc.parse<rapidxml::parse_trim_whitespace | rapidxml::parse_non_destructive>( &(data[0]) );
+    
+    const rapidxml::xml_node<char> * const nuc_node = XML_FIRST_NODE( &doc, "Nuc" );
+    const rapidxml::xml_attribute<char> *const name_att = nuc_node ? XML_FIRST_ATTRIB( nuc_node, "name" ) : nullptr;
+    if( !name_att || !name_att->value_size() )
+      throw runtime_error( "invalid <Nuc> element in '" + m_filename + "'" );
+    
+    const rapidxml::xml_node<char> *const assoc_node = XML_FIRST_NODE( nuc_node, "Associated" );
+    const rapidxml::xml_node<char> *const notes_node = XML_FIRST_NODE( nuc_node, "Notes" );
+
+    NucInfo info;
+    info.m_nuclide = SpecUtils::xml_value_str( name_att );
+    info.m_notes = SpecUtils::xml_value_str( notes_node );
+
+    const string associated = SpecUtils::xml_value_str( assoc_node );
+    SpecUtils::split( info.m_associated, associated, ";" );
+    for( std::string &val : info.m_associated )
+      SpecUtils::trim( val );
+
+    // The following assert is for developing the XML, not coding logic
+    assert( !info.m_notes.empty() || !info.m_associated.empty() );
+    
+    return info;
+  }//NucInfo decode( const NucLocation &location ) const
+  
+  
   const NucInfo *MoreNucInfoDb::info( const std::string &nucstr ) const
   {
     const SandiaDecay::SandiaDecayDataBase *const db = DecayDataBaseServer::database();
@@ -358,9 +530,23 @@ namespace MoreNuclideInfo
         return info( nuc );
     }
 
-    const auto pos = m_other_infos.find( nucstr );
-    if( pos == end( m_other_infos ) )
+    const auto index_pos = m_other_index.find( nucstr );
+    if( index_pos == end( m_other_index ) )
       return nullptr;
+    
+    std::lock_guard<std::mutex> lock( sm_cache_mutex );
+    auto pos = m_other_infos.find( nucstr );
+    if( pos == end( m_other_infos ) )
+    {
+      try
+      {
+        pos = m_other_infos.emplace( nucstr, decode( index_pos->second ) ).first;
+      }catch( std::exception &e )
+      {
+        cerr << "MoreNucInfoDb: failed to decode '" << nucstr << "': " << e.what() << endl;
+        return nullptr;
+      }
+    }//if( not decoded yet )
 
     return &(pos->second);
   }//info(...)
@@ -371,9 +557,23 @@ namespace MoreNuclideInfo
     if( !nuc )
       return nullptr;
 
-    const auto pos = m_nuc_infos.find( nuc );
-    if( pos == end( m_nuc_infos ) )
+    const auto index_pos = m_nuc_index.find( nuc );
+    if( index_pos == end( m_nuc_index ) )
       return nullptr;
+    
+    std::lock_guard<std::mutex> lock( sm_cache_mutex );
+    auto pos = m_nuc_infos.find( nuc );
+    if( pos == end( m_nuc_infos ) )
+    {
+      try
+      {
+        pos = m_nuc_infos.emplace( nuc, decode( index_pos->second ) ).first;
+      }catch( std::exception &e )
+      {
+        cerr << "MoreNucInfoDb: failed to decode '" << nuc->symbol << "': " << e.what() << endl;
+        return nullptr;
+      }
+    }//if( not decoded yet )
 
     return &(pos->second);
   }//info(...)
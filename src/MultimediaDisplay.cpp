@@ -23,14 +23,26 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
 #include <Wt/Utils>
 #include <Wt/WText>
 #include <Wt/WImage>
 #include <Wt/WLabel>
 #include <Wt/WCheckBox>
+#include <Wt/WResource>
 #include <Wt/WPushButton>
 #include <Wt/WApplication>
-#include <Wt/WMemoryResource>
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
 #include <Wt/WContainerWidget>
 
 #include "SpecUtils/DateTime.h"
@@ -53,6 +65,235 @@ extern void android_download_workaround( Wt::WResource *resource, std::string de
 
 namespace
 {
+/** A decoded (i.e., from hex or base64) image from a spectrum file. */
+struct DecodedMultimedia
+{
+  std::vector<unsigned char> data;
+  std::string mime;
+  
+  /** The thumbnail embedded in the EXIF data of JPEG images, if there was one; we dont have an
+   image library available to scale images ourselves, but camera frames nearly always have one.
+   */
+  std::vector<unsigned char> thumbnail;
+};//struct DecodedMultimedia
+
+
+/** Returns the EXIF thumbnail (the JPEG pointed to by IFD1 of the APP1 segment) of a JPEG image,
+ or an empty vector if there isnt one.
+ */
+std::vector<unsigned char> exif_thumbnail( const std::vector<unsigned char> &jpeg )
+{
+  const size_t size = jpeg.size();
+  if( (size < 4) || (jpeg[0] != 0xFF) || (jpeg[1] != 0xD8) )
+    return {};
+  
+  size_t pos = 2;
+  while( (pos + 4) <= size )
+  {
+    if( jpeg[pos] != 0xFF )
+      return {};
+    
+    const unsigned char marker = jpeg[pos+1];
+    const size_t seglen = (size_t(jpeg[pos+2]) << 8) | jpeg[pos+3];
+    
+    // Start of scan, or end of image, means no more metadata segments
+    if( (marker == 0xDA) || (marker == 0xD9) || (seglen < 2) || ((pos + 2 + seglen) > size) )
+      return {};
+    
+    const size_t seg_start = pos + 4;
+    const size_t seg_end = pos + 2 + seglen;
+    
+    if( (marker == 0xE1) && ((seg_start + 14) <= seg_end)
+       && !memcmp( &jpeg[seg_start], "Exif\0\0", 6 ) )
+    {
+      const unsigned char * const tiff = &jpeg[seg_start + 6];
+      const size_t tiff_len = seg_end - (seg_start + 6);
+      const bool little_endian = (tiff[0] == 'I') && (tiff[1] == 'I');
+      if( !little_endian && !((tiff[0] == 'M') && (tiff[1] == 'M')) )
+        return {};
+      
+      const auto read16 = [=]( const size_t off ) -> uint32_t {
+        return little_endian ? (tiff[off] | (uint32_t(tiff[off+1]) << 8))
+                             : ((uint32_t(tiff[off]) << 8) | tiff[off+1]);
+      };
+      const auto read32 = [=]( const size_t off ) -> uint32_t {
+        return little_endian ? (read16(off) | (read16(off+2) << 16))
+                             : ((read16(off) << 16) | read16(off+2));
+      };
+      
+      // Skip IFD0, to get to IFD1, which describes the thumbnail
+      const size_t ifd0 = read32( 4 );
+      if( (ifd0 + 2) > tiff_len )
+        return {};
+      const size_t ifd0_entries = read16( ifd0 );
+      const size_t next_ifd_pos = ifd0 + 2 + 12*ifd0_entries;
+      if( (next_ifd_pos + 4) > tiff_len )
+        return {};
+      const size_t ifd1 = read32( next_ifd_pos );
+      if( !ifd1 || ((ifd1 + 2) > tiff_len) )
+        return {};
+      
+      size_t thumb_offset = 0, thumb_length = 0;
+      const size_t ifd1_entries = read16( ifd1 );
+      for( size_t i = 0; i < ifd1_entries; ++i )
+      {
+        const size_t entry = ifd1 + 2 + 12*i;
+        if( (entry + 12) > tiff_len )
+          return {};
+        
+        const uint32_t tag = read16( entry );
+        if( tag == 0x0201 )      //JPEGInterchangeFormat
+          thumb_offset = read32( entry + 8 );
+        else if( tag == 0x0202 ) //JPEGInterchangeFormatLength
+          thumb_length = read32( entry + 8 );
+      }//for( loop over IFD1 entries )
+      
+      if( !thumb_offset || (thumb_length < 4) || ((thumb_offset + thumb_length) > tiff_len)
+         || (tiff[thumb_offset] != 0xFF) || (tiff[thumb_offset+1] != 0xD8) )
+        return {};
+      
+      return std::vector<unsigned char>( tiff + thumb_offset, tiff + thumb_offset + thumb_length );
+    }//if( an EXIF APP1 segment )
+    
+    pos = seg_end;
+  }//while( (pos + 4) <= size )
+  
+  return {};
+}//std::vector<unsigned char> exif_thumbnail( const std::vector<unsigned char> &jpeg )
+
+
+/** Process-wide LRU cache of decoded images, keyed by a hash of their encoded data, so an image
+ is only decoded once, no matter how many times it is viewed, or how many sessions view it.
+ Limited by total decoded size.
+ */
+std::mutex s_decoded_cache_mutex;
+typedef std::pair<uint64_t,size_t> DecodedCacheKey_t;
+std::list<std::pair<DecodedCacheKey_t,std::shared_ptr<const DecodedMultimedia>>> s_decoded_cache;
+std::map<DecodedCacheKey_t,decltype(s_decoded_cache)::iterator> s_decoded_cache_index;
+size_t s_decoded_cache_bytes = 0;
+const size_t s_max_decoded_cache_bytes = 64*1024*1024;
+
+
+/** Returns the decoded image (cached), or nullptr if the data isnt an image we can decode. */
+std::shared_ptr<const DecodedMultimedia> decode_multimedia( const SpecUtils::MultimediaData &data )
+{
+  //FNV-1a hash of the data, and encoding
+  uint64_t hash = 14695981039346656037ULL;
+  const auto hash_byte = [&hash]( const unsigned char c ){ hash = (hash ^ c) * 1099511628211ULL; };
+  for( const char c : data.data_ )
+    hash_byte( static_cast<unsigned char>(c) );
+  hash_byte( static_cast<unsigned char>(data.data_encoding_) );
+  
+  const DecodedCacheKey_t key{ hash, data.data_.size() };
+  
+  {//begin lock on s_decoded_cache_mutex
+    std::lock_guard<std::mutex> lock( s_decoded_cache_mutex );
+    const auto pos = s_decoded_cache_index.find( key );
+    if( pos != end(s_decoded_cache_index) )
+    {
+      s_decoded_cache.splice( begin(s_decoded_cache), s_decoded_cache, pos->second );
+      return pos->second->second;
+    }
+  }//end lock on s_decoded_cache_mutex
+  
+  string data_str( begin(data.data_), end(data.data_) );
+  
+  switch( data.data_encoding_ )
+  {
+    case SpecUtils::MultimediaData::EncodingType::BinaryUTF8:
+      data_str.clear();
+      break;
+      
+    case SpecUtils::MultimediaData::EncodingType::BinaryHex:
+      data_str = Wt::Utils::hexDecode(data_str);
+      break;
+      
+    case SpecUtils::MultimediaData::EncodingType::BinaryBase64:
+      data_str = Wt::Utils::base64Decode(data_str);
+      break;
+  }//switch( data->data_encoding_ )
+  
+  auto decoded = make_shared<DecodedMultimedia>();
+  decoded->data.assign( (const unsigned char *)data_str.c_str(),
+                        (const unsigned char *)(data_str.c_str() + data_str.size()) );
+  decoded->mime = decoded->data.empty() ? string() : Wt::Utils::guessImageMimeTypeData(decoded->data);
+  if( SpecUtils::icontains(decoded->mime, "jpeg") )
+    decoded->thumbnail = exif_thumbnail( decoded->data );
+  
+  const size_t nbytes = decoded->data.size() + decoded->thumbnail.size();
+  
+  std::lock_guard<std::mutex> lock( s_decoded_cache_mutex );
+  if( s_decoded_cache_index.count( key ) || (nbytes > s_max_decoded_cache_bytes) )
+    return decoded;
+  
+  s_decoded_cache.emplace_front( key, decoded );
+  s_decoded_cache_index[key] = begin(s_decoded_cache);
+  s_decoded_cache_bytes += nbytes;
+  
+  while( s_decoded_cache_bytes > s_max_decoded_cache_bytes )
+  {
+    const shared_ptr<const DecodedMultimedia> &old = s_decoded_cache.back().second;
+    s_decoded_cache_bytes -= (old->data.size() + old->thumbnail.size());
+    s_decoded_cache_index.erase( s_decoded_cache.back().first );
+    s_decoded_cache.pop_back();
+  }
+  
+  return decoded;
+}//decode_multimedia(...)
+
+
+/** Serves a decoded image (or its thumbnail), without copying the image into the resource; the
+ image data is shared with the process-wide cache.
+ */
+class DecodedImageResource : public Wt::WResource
+{
+  std::mutex m_mutex;
+  std::shared_ptr<const DecodedMultimedia> m_image;
+  const bool m_thumbnail;
+  
+public:
+  DecodedImageResource( const bool thumbnail, Wt::WObject *parent )
+  : WResource( parent ),
+    m_image( nullptr ),
+    m_thumbnail( thumbnail )
+  {
+  }
+  
+  virtual ~DecodedImageResource()
+  {
+    beingDeleted();
+  }
+  
+  void setImage( std::shared_ptr<const DecodedMultimedia> image )
+  {
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_image = image;
+    }
+    setChanged();
+  }//void setImage(...)
+  
+  virtual void handleRequest( const Wt::Http::Request &, Wt::Http::Response &response )
+  {
+    std::shared_ptr<const DecodedMultimedia> image;
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      image = m_image;
+    }
+    
+    const std::vector<unsigned char> * const data = !image ? nullptr
+                                                : (m_thumbnail ? &image->thumbnail : &image->data);
+    if( !data || data->empty() )
+    {
+      response.setStatus( 404 );
+      return;
+    }
+    
+    response.setMimeType( m_thumbnail ? string("image/jpeg") : image->mime );
+    response.out().write( reinterpret_cast<const char *>(data->data()), data->size() );
+  }//void handleRequest(...)
+};//class DecodedImageResource
+
 
 //Class to display a DetectorAnalysis; just a first go at it
 //  Some sort of model and table, or something might be a better implementation.
@@ -60,7 +301,7 @@ class MultimediaDisplay : public WContainerWidget
 {
   std::shared_ptr<const SpecMeas> m_meas;
   size_t m_current_index;
-  WMemoryResource *m_resource;
+  DecodedImageResource *m_resource;
   WImage *m_image;
   WText *m_error;
   WContainerWidget *m_add_info;
@@ -71,6 +312,13 @@ class MultimediaDisplay : public WContainerWidget
   WPushButton *m_prev;
   WText *m_pos_txt;
   WPushButton *m_next;
+  
+  /** When there are multiple images, a clickable thumbnail (if embedded in the image), or a
+   numbered button, for each image; the full-size image is only sent when it is selected.
+   */
+  WContainerWidget *m_thumbs;
+  std::vector<WWebWidget *> m_thumb_btns;
+  
 #if( BUILD_AS_OSX_APP || IOS )
   WAnchor *m_download;
 #else
@@ -93,6 +341,8 @@ public:
   m_prev( nullptr ),
   m_pos_txt( nullptr ),
   m_next( nullptr ),
+  m_thumbs( nullptr ),
+  m_thumb_btns{},
   m_download( nullptr )
   {
     wApp->useStyleSheet( "InterSpec_resources/MultimediaDisplay.css" );
@@ -101,7 +351,7 @@ public:
     
     addStyleClass( "MultimediaDisplay" );
   
-    m_resource = new WMemoryResource( this );
+    m_resource = new DecodedImageResource( false, this );
     
     m_image = new WImage( WLink(m_resource), this );
     m_image->addStyleClass( "SpecImage" );
@@ -136,6 +386,10 @@ public:
     m_next->addStyleClass( "Next" );
     m_next->clicked().connect( this, &MultimediaDisplay::nextIndex );
     
+    m_thumbs = new WContainerWidget( this );
+    m_thumbs->addStyleClass( "Thumbs" );
+    m_thumbs->hide();
+    
     
     WContainerWidget *footer = new WContainerWidget( this );
     footer->addStyleClass( "PrefAndDownload" );
@@ -211,7 +465,7 @@ public:
     
     auto showErrorMsg = [this]( const WString &msg ){
       m_image->hide();
-      m_resource->setData( {} );
+      m_resource->setImage( nullptr );
       m_add_info->hide();
       m_nav->hide();
       m_error->show();
@@ -230,6 +484,9 @@ public:
     index = (index % all_data.size());
     m_current_index = index;
     
+    for( size_t i = 0; i < m_thumb_btns.size(); ++i )
+      m_thumb_btns[i]->toggleStyleClass( "Selected", (i == index) );
+    
     shared_ptr<const SpecUtils::MultimediaData> data = all_data[index];
     
     if( !data || (data->data_.size() < 25) )
@@ -242,42 +499,22 @@ public:
       return;
     }//if( !data || (data->data_.size() < 25) )
     
-    string data_str( begin(data->data_), end(data->data_) );
-      
-    switch( data->data_encoding_ )
-    {
-      case SpecUtils::MultimediaData::EncodingType::BinaryUTF8:
-        data_str.clear();
-        break;
-          
-      case SpecUtils::MultimediaData::EncodingType::BinaryHex:
-        data_str = Wt::Utils::hexDecode(data_str);
-        break;
-          
-      case SpecUtils::MultimediaData::EncodingType::BinaryBase64:
-        data_str = Wt::Utils::base64Decode(data_str);
-        break;
-    }//switch( data->data_encoding_ )
-      
-    vector<unsigned char> data_uchar( (const unsigned char *)data_str.c_str(),
-                                      (const unsigned char *)(data_str.c_str() + data_str.size()) );
-      
-    const string mime = Wt::Utils::guessImageMimeTypeData(data_uchar);
+    const shared_ptr<const DecodedMultimedia> decoded = decode_multimedia( *data );
       
-    if( data_str.empty() )
+    if( decoded->data.empty() )
     {
       showErrorMsg( WString::tr("smmd-err-encoding-not-supported") );
       return;
     }
       
+    const string &mime = decoded->mime;
     if( mime.empty() )
     {
       showErrorMsg( WString::tr("smmd-err-not-image") );
       return;
     }
       
-    m_resource->setData( data_uchar );
-    m_resource->setMimeType( mime );
+    m_resource->setImage( decoded );
     
     string filename = "image_" + to_string(m_current_index + 1) + "_of_" + to_string(all_data.size());
     
@@ -353,10 +590,54 @@ public:
   }//void setIndex( size_t index )
   
   
+  void updateThumbnails()
+  {
+    m_thumbs->clear();
+    m_thumb_btns.clear();
+    
+    const vector<shared_ptr<const SpecUtils::MultimediaData>> all_data
+                        = m_meas ? m_meas->multimedia_data() : vector<shared_ptr<const SpecUtils::MultimediaData>>{};
+    
+    m_thumbs->setHidden( all_data.size() < 2 );
+    if( all_data.size() < 2 )
+      return;
+    
+    for( size_t i = 0; i < all_data.size(); ++i )
+    {
+      const shared_ptr<const SpecUtils::MultimediaData> &data = all_data[i];
+      shared_ptr<const DecodedMultimedia> decoded;
+      if( data && (data->data_.size() >= 25) )
+        decoded = decode_multimedia( *data );
+      
+      WWebWidget *btn = nullptr;
+      if( decoded && !decoded->thumbnail.empty() )
+      {
+        DecodedImageResource *thumb_resource = new DecodedImageResource( true, m_thumbs );
+        thumb_resource->setImage( decoded );
+        WImage *thumb = new WImage( WLink(thumb_resource), m_thumbs );
+        thumb->clicked().connect( std::bind( [this,i](){ setIndex( i ); } ) );
+        btn = thumb;
+      }else
+      {
+        WPushButton *numbtn = new WPushButton( std::to_string(i + 1), m_thumbs );
+        numbtn->clicked().connect( std::bind( [this,i](){ setIndex( i ); } ) );
+        btn = numbtn;
+      }
+      
+      btn->addStyleClass( "Thumb" );
+      btn->setToolTip( WString::tr("smmd-image-index")
+                        .arg( static_cast<int>(i + 1) )
+                        .arg( static_cast<int>(all_data.size()) ) );
+      m_thumb_btns.push_back( btn );
+    }//for( size_t i = 0; i < all_data.size(); ++i )
+  }//void updateThumbnails()
+  
+  
   void updateDisplay( std::shared_ptr<const SpecMeas> meas )
   {
     m_meas = meas;
     m_current_index = 0;
+    updateThumbnails();
     setIndex( m_current_index );
   }//void updateDisplay( std::shared_ptr<const SpecMeas> meas )
 
@@ -622,10 +622,9 @@ std::vector< std::pair<float,float> > NuclideSourceEnter::photonEnergyAndIntensi
     return answer;
   }
   
-  SandiaDecay::NuclideMixture mix;
-  mix.addAgedNuclideByActivity( nuc, activity, age );
-  
-  const auto results = mix.photons(0.0, SandiaDecay::NuclideMixture::OrderByEnergy);
+  const auto results = DecayedPhotonCache::photons_for_aged_activity( nuc, activity, age,
+                                                   DecayedPhotonCache::Emissions::Photons,
+                                                   SandiaDecay::NuclideMixture::OrderByEnergy );
   
   for( const SandiaDecay::EnergyRatePair &aep : results )
     answer.push_back( make_pair( static_cast<float>(aep.energy), static_cast<float>(aep.numPerSecond) ) );
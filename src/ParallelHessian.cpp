@@ -0,0 +1,260 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <exception>
+
+#define BOOST_UBLAS_TYPE_CHECK 0
+#include <boost/numeric/ublas/lu.hpp>
+#include <boost/numeric/ublas/matrix.hpp>
+#include <boost/numeric/ublas/triangular.hpp>
+
+#include "Minuit2/FCNBase.h"
+
+#include "SpecUtils/SpecUtilsAsync.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/PeakFitChi2Fcn.h"
+#include "InterSpec/ParallelHessian.h"
+
+using namespace std;
+
+
+namespace
+{
+template<class T>
+bool matrix_invert( const boost::numeric::ublas::matrix<T>& input,
+                   boost::numeric::ublas::matrix<T> &inverse )
+{
+  using namespace boost::numeric;
+  ublas::matrix<T> A( input );
+  ublas::permutation_matrix<std::size_t> pm( A.size1() );
+  const size_t res = lu_factorize(A, pm);
+  if( res != 0 )
+    return false;
+  inverse.assign( ublas::identity_matrix<T>( A.size1() ) );
+  lu_substitute(A, pm, inverse);
+  return true;
+}//matrix_invert
+}//namespace
+
+
+namespace ParallelHessian
+{
+HessianResult compute( const EvaluatorFactory &factory,
+                       const std::vector<double> &x,
+                       const std::vector<double> &steps,
+                       const double up,
+                       size_t num_threads )
+{
+  if( !factory )
+    throw runtime_error( "ParallelHessian::compute: invalid evaluator factory." );
+  
+  if( x.size() != steps.size() )
+    throw runtime_error( "ParallelHessian::compute: number of steps must match number of parameters." );
+  
+  const size_t npar = x.size();
+  
+  vector<size_t> free_pars;
+  for( size_t i = 0; i < npar; ++i )
+  {
+    if( (steps[i] < 0.0) || std::isnan(steps[i]) || std::isinf(steps[i]) )
+      throw runtime_error( "ParallelHessian::compute: invalid step for parameter "
+                           + std::to_string(i) + "." );
+    if( steps[i] > 0.0 )
+      free_pars.push_back( i );
+  }//for( size_t i = 0; i < npar; ++i )
+  
+  HessianResult result;
+  result.hessian.resize( npar, vector<double>(npar, 0.0) );
+  
+  if( free_pars.empty() )
+    return result;
+  
+  // Each (i,j) pair, with i <= j, is its own task; diagonal elements take two function
+  //  evaluations, and off-diagonal elements four.
+  vector<pair<size_t,size_t>> tasks;
+  for( size_t i = 0; i < free_pars.size(); ++i )
+  {
+    for( size_t j = i; j < free_pars.size(); ++j )
+      tasks.emplace_back( free_pars[i], free_pars[j] );
+  }
+  
+  const double f0 = factory()( x );
+  
+  std::atomic<size_t> next_task( 0 );
+  std::atomic<size_t> num_calls( 1 );
+  
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  
+  auto worker = [&](){
+    try
+    {
+      const Evaluator eval = factory();
+      vector<double> trial( x );
+      
+      for( size_t task = next_task++; task < tasks.size(); task = next_task++ )
+      {
+        {
+          std::lock_guard<std::mutex> lock( error_mutex );
+          if( error )
+            return;
+        }
+        
+        const size_t i = tasks[task].first, j = tasks[task].second;
+        const double hi = steps[i], hj = steps[j];
+        
+        double value = 0.0;
+        if( i == j )
+        {
+          trial[i] = x[i] + hi;
+          const double fp = eval( trial );
+          trial[i] = x[i] - hi;
+          const double fm = eval( trial );
+          trial[i] = x[i];
+          
+          value = (fp - 2.0*f0 + fm) / (hi*hi);
+          num_calls += 2;
+        }else
+        {
+          double f[4];
+          const double si[4] = { 1.0, 1.0, -1.0, -1.0 }, sj[4] = { 1.0, -1.0, 1.0, -1.0 };
+          for( size_t k = 0; k < 4; ++k )
+          {
+            trial[i] = x[i] + si[k]*hi;
+            trial[j] = x[j] + sj[k]*hj;
+            f[k] = eval( trial );
+          }
+          trial[i] = x[i];
+          trial[j] = x[j];
+          
+          value = (f[0] - f[1] - f[2] + f[3]) / (4.0*hi*hj);
+          num_calls += 4;
+        }//if( diagonal ) / else
+        
+        // Each element is only written by a single task, so no locking needed
+        result.hessian[i][j] = value;
+        result.hessian[j][i] = value;
+      }//for( loop over tasks )
+    }catch( ... )
+    {
+      std::lock_guard<std::mutex> lock( error_mutex );
+      if( !error )
+        error = std::current_exception();
+    }//try / catch
+  };//worker lambda
+  
+  if( num_threads == 0 )
+    num_threads = static_cast<size_t>( std::max( 1, SpecUtilsAsync::num_logical_cpu_cores() ) );
+  num_threads = std::min( num_threads, tasks.size() );
+  
+  if( num_threads <= 1 )
+  {
+    worker();
+  }else
+  {
+    SharedThreadPool::TaskGroup pool;
+    for( size_t i = 0; i < num_threads; ++i )
+      pool.post( worker );
+    pool.join();
+  }//if( single thread ) / else
+  
+  if( error )
+    std::rethrow_exception( error );
+  
+  result.num_fcn_calls = num_calls;
+  
+  // Invert the Hessian of just the free parameters
+  const size_t nfree = free_pars.size();
+  boost::numeric::ublas::matrix<double> hess( nfree, nfree ), inv( nfree, nfree );
+  for( size_t i = 0; i < nfree; ++i )
+  {
+    for( size_t j = 0; j < nfree; ++j )
+      hess(i,j) = result.hessian[free_pars[i]][free_pars[j]];
+  }
+  
+  if( !matrix_invert( hess, inv ) )
+    return result;
+  
+  for( size_t i = 0; i < nfree; ++i )
+  {
+    if( !(inv(i,i) > 0.0) || std::isinf(inv(i,i)) )
+      return result;
+  }
+  
+  result.covariance.resize( npar, vector<double>(npar, 0.0) );
+  result.errors.resize( npar, 0.0 );
+  for( size_t i = 0; i < nfree; ++i )
+  {
+    for( size_t j = 0; j < nfree; ++j )
+      result.covariance[free_pars[i]][free_pars[j]] = 2.0*up*inv(i,j);
+    result.errors[free_pars[i]] = std::sqrt( result.covariance[free_pars[i]][free_pars[i]] );
+  }
+  
+  return result;
+}//HessianResult compute(...)
+
+
+EvaluatorFactory evaluator_factory( const ROOT::Minuit2::FCNBase &fcn )
+{
+  const ROOT::Minuit2::FCNBase *fcn_ptr = &fcn;
+  return [fcn_ptr]() -> Evaluator {
+    return [fcn_ptr]( const vector<double> &x ) -> double { return (*fcn_ptr)( x ); };
+  };
+}//EvaluatorFactory evaluator_factory( const ROOT::Minuit2::FCNBase &fcn )
+
+
+EvaluatorFactory evaluator_factory( const PeakFitChi2Fcn &fcn )
+{
+  const PeakFitChi2Fcn *fcn_ptr = &fcn;
+  return [fcn_ptr]() -> Evaluator {
+    auto peaks = std::make_shared<vector<PeakDef>>();
+    return [fcn_ptr,peaks]( const vector<double> &x ) -> double {
+      return fcn_ptr->chi2( x.data(), *peaks );
+    };
+  };
+}//EvaluatorFactory evaluator_factory( const PeakFitChi2Fcn &fcn )
+
+
+EvaluatorFactory evaluator_factory( const MultiPeakFitChi2Fcn &fcn )
+{
+  const MultiPeakFitChi2Fcn *fcn_ptr = &fcn;
+  return [fcn_ptr]() -> Evaluator {
+    auto peaks = std::make_shared<vector<PeakDef>>();
+    return [fcn_ptr,peaks]( const vector<double> &x ) -> double {
+      return fcn_ptr->DoEval( x.data(), *peaks );
+    };
+  };
+}//EvaluatorFactory evaluator_factory( const MultiPeakFitChi2Fcn &fcn )
+}//namespace ParallelHessian
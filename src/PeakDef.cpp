@@ -1697,32 +1697,44 @@ void PeakContinuum::toXml( rapidxml::xml_node<char> *parent, const int contId )
   
   if( m_type != NoOffset && m_type != External )
   {
-    stringstream valsstrm, uncertstrm, fitstrm;
+    // Format the values directly into strings, rather than using streams, as this is done for
+    //  every ROI whenever a state, or undo/redo step, is saved.
+    string valsstr, uncertstr, fitstr;
+    valsstr.reserve( 16*m_values.size() );
+    uncertstr.reserve( 16*m_values.size() );
+    fitstr.reserve( 2*m_values.size() );
+    
     for( size_t i = 0; i < m_values.size(); ++i )
     {
-      const char *spacer = (i ? " " : "");
-      snprintf( buffer, sizeof(buffer), "%1.8e", m_values[i] );  
-      valsstrm << spacer << buffer;
+      if( i )
+      {
+        valsstr += ' ';
+        uncertstr += ' ';
+        fitstr += ' ';
+      }
+      
+      int nchar = snprintf( buffer, sizeof(buffer), "%1.8e", m_values[i] );
+      valsstr.append( buffer, std::min( static_cast<size_t>(std::max(nchar,0)), sizeof(buffer) - 1 ) );
     
-      snprintf( buffer, sizeof(buffer), "%1.8e", m_uncertainties[i] );  
-      uncertstrm << spacer << buffer;
+      nchar = snprintf( buffer, sizeof(buffer), "%1.8e", m_uncertainties[i] );
+      uncertstr.append( buffer, std::min( static_cast<size_t>(std::max(nchar,0)), sizeof(buffer) - 1 ) );
     
-      fitstrm << spacer << (m_fitForValue[i] ? '1': '0');
+      fitstr += (m_fitForValue[i] ? '1': '0');
     }//for( size_t i = 0; i < m_values.size(); ++i )
     
     xml_node<char> *coeffs_node = doc->allocate_node( node_element, "Coefficients" );
     cont_node->append_node( coeffs_node );
         
-    val = doc->allocate_string( valsstrm.str().c_str() );
-    node = doc->allocate_node( node_element, "Values", val );
+    val = doc->allocate_string( valsstr.c_str(), valsstr.size() + 1 );
+    node = doc->allocate_node( node_element, "Values", val, 0, valsstr.size() );
     coeffs_node->append_node( node );
     
-    val = doc->allocate_string( uncertstrm.str().c_str() );
-    node = doc->allocate_node( node_element, "Uncertainties", val );
+    val = doc->allocate_string( uncertstr.c_str(), uncertstr.size() + 1 );
+    node = doc->allocate_node( node_element, "Uncertainties", val, 0, uncertstr.size() );
     coeffs_node->append_node( node );
     
-    val = doc->allocate_string( fitstrm.str().c_str() );
-    node = doc->allocate_node( node_element, "Fittable", val );
+    val = doc->allocate_string( fitstr.c_str(), fitstr.size() + 1 );
+    node = doc->allocate_node( node_element, "Fittable", val, 0, fitstr.size() );
     coeffs_node->append_node( node );
   }//if( m_type != NoOffset && m_type != External )
   
@@ -1803,17 +1815,17 @@ void PeakContinuum::fromXml( const rapidxml::xml_node<char> *cont_node, int &con
   
   float dummyval;
   node = cont_node->first_node( "LowerEnergy", 11 );
-  if( !node || !node->value() || (sscanf(node->value(),"%e",&dummyval) != 1) )
+  if( !node || !node->value() || !SpecUtils::parse_float(node->value(), node->value_size(), dummyval) )
     throw runtime_error( "Continuum didnt have LowerEnergy" );
   m_lowerEnergy = dummyval;
     
   node = cont_node->first_node( "UpperEnergy", 11 );
-  if( !node || !node->value() || (sscanf(node->value(),"%e",&dummyval) != 1) )
+  if( !node || !node->value() || !SpecUtils::parse_float(node->value(), node->value_size(), dummyval) )
     throw runtime_error( "Continuum didnt have UpperEnergy" );
   m_upperEnergy = dummyval;
   
   node = cont_node->first_node( "ReferenceEnergy", 15 );
-  if( !node || !node->value() || (sscanf(node->value(),"%e",&dummyval) != 1) )
+  if( !node || !node->value() || !SpecUtils::parse_float(node->value(), node->value_size(), dummyval) )
     throw runtime_error( "Continuum didnt have ReferenceEnergy" );
   m_referenceEnergy = dummyval;
   
@@ -2296,6 +2308,7 @@ void PeakDef::fromXml( const rapidxml::xml_node<char> *peak_node,
   else
     throw runtime_error( "Invalid peak skew type" );
   
+  vector<float> coef_vals;
   for( CoefficientType t = CoefficientType(0); 
       t < NumCoefficientTypes; t = CoefficientType(t+1) )
   {
@@ -2335,13 +2348,14 @@ void PeakDef::fromXml( const rapidxml::xml_node<char> *peak_node,
     if( !node || !node->value() )
       throw runtime_error( "No coefficient " + string(label) );
     
-    float dblval = 0.0f, dbluncrt = 0.0f;
-    const int nread = sscanf(node->value(), "%g %g", &dblval, &dbluncrt);
-    if( (nread != 1) && (nread != 2) )
+    // The value is written as "value uncertainty", but older files may only have the value
+    coef_vals.clear();
+    SpecUtils::split_to_floats( node->value(), node->value_size(), coef_vals );
+    if( coef_vals.empty() || (coef_vals.size() > 2) )
       throw runtime_error( "unable to read value or uncert for " + string(label) );
     
-    m_coefficients[t] = dblval;
-    m_uncertainties[t] = dbluncrt;
+    m_coefficients[t] = coef_vals[0];
+    m_uncertainties[t] = (coef_vals.size() > 1) ? coef_vals[1] : 0.0f;
     
     att = node->first_attribute("fit",3);
     if( !att || !att->value() )
@@ -2442,7 +2456,7 @@ void PeakDef::fromXml( const rapidxml::xml_node<char> *peak_node,
           throw runtime_error( "Invalid nuclide name " + string(name_node->value()) );
     
         float decay_gamma_energy;
-        if( sscanf( e_node->value(), "%g", &decay_gamma_energy ) != 1 )
+        if( !SpecUtils::parse_float( e_node->value(), e_node->value_size(), decay_gamma_energy ) )
           throw runtime_error( "Invalid nuclide gamma energy" );
     
         for( size_t i = 0; i < parent->decaysToChildren.size(); ++i )
@@ -2508,7 +2522,7 @@ void PeakDef::fromXml( const rapidxml::xml_node<char> *peak_node,
         throw std::runtime_error( "Couldnt retrieve x-ray element" );
     
       float dummyval;
-      if( sscanf( energy_node->value(), "%g", &dummyval ) != 1 )
+      if( !SpecUtils::parse_float( energy_node->value(), energy_node->value_size(), dummyval ) )
         throw runtime_error( "non numeric xray energy" );
       m_xrayEnergy = dummyval;
     }//if( xray_node )
@@ -2525,7 +2539,7 @@ void PeakDef::fromXml( const rapidxml::xml_node<char> *peak_node,
         throw runtime_error( "Ill specified reaction" );
     
       float dummyval;
-      if( sscanf( energy_node->value(), "%g", &dummyval ) != 1 )
+      if( !SpecUtils::parse_float( energy_node->value(), energy_node->value_size(), dummyval ) )
         throw runtime_error( "non numeric reaction energy" );
       m_reactionEnergy = dummyval;
   
@@ -24,7 +24,11 @@
 #include "InterSpec_config.h"
 
 #include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdint>
 #include <iostream>
+#include <algorithm>
 
 #include <boost/math/constants/constants.hpp>
 #include <boost/math/special_functions/erf.hpp>
@@ -36,24 +40,32 @@
 using namespace std;
 
 
+/** On x86-64 Linux, with GCC, we'll have the compiler generate an AVX2 version, as well as a
+ baseline version, of the array erf/erfc functions, and pick between them at runtime (using ifunc),
+ based on the CPU the code is running on.  Other compilers/platforms will just use the baseline
+ instruction set (e.g., NEON on arm64), which the erf/erfc loops are still written to vectorize with.
+ */
+#if( defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__) )
+#define ERF_ARRAY_TARGET_CLONES __attribute__((target_clones("avx2","default")))
+// The helper functions must be inlined into each clone, or else they would only get compiled once,
+//  for the baseline instruction set.
+#define ERF_ARRAY_INLINE inline __attribute__((always_inline))
+#else
+#define ERF_ARRAY_TARGET_CLONES
+#define ERF_ARRAY_INLINE inline
+#endif
+
+
 namespace PeakDists
 {
-  /** 20191230: wcjohns extracted the boost::math::erf() function implementation
-   from boost 1.65.1 for double precision (53 bit mantissa) into this function,
-   boost_erf_imp(). Removing some of the supporting code structure, and
-   explicitly writing out the polynomial equation evaluation seems to speed
-   things up by about a factor of ~3 over calling boost::math::erf().
-   
-   Using the commented out erf_approx() function looks to be about 25% faster than
-   this boost version, but I havent carefully checked out the precision implications
-   so not switching to it yet.
-   
-   Surprisingly, the erf() function is the major bottleneck for peak fitting.
-   */
-  double boost_erf_imp( double z )
+  namespace
   {
-    /* Since this function is a (slight) modification of boost source code, it
-     is subject to the Boost Version 1 Software License, whose text is:
+    /* The functions in this anonymous namespace are the rational approximations boost uses for
+     erf and erfc, split out so the scalar and the array versions of `boost_erf_imp(...)` and
+     `boost_erfc_imp(...)` share identical arithmetic (and hence give bit-for-bit identical answers).
+     
+     Since these functions are a (slight) modification of boost source code, they
+     are subject to the Boost Version 1 Software License, whose text is:
      
      Boost Software License - Version 1.0 - August 17th, 2003
      
@@ -79,144 +91,25 @@ namespace PeakDists
      ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
      DEALINGS IN THE SOFTWARE.
      */
-    if(z < 0)
-      return -boost_erf_imp( -z );
     
-    if( z < 0.5 )
-    {
-      if( z < 1e-10 )
-      {
-        return z * 1.125f + z * 0.003379167095512573896158903121545171688;
-      }else
-      {
-        const double zz = z * z;
-        const double P_eval = (((zz*-0.000322780120964605683831 + -0.00772758345802133288487)*zz + -0.0509990735146777432841)*zz + -0.338165134459360935041)*zz + 0.0834305892146531832907;
-        const double Q_eval = (((zz*0.000370900071787748000569 + 0.00858571925074406212772)*zz + 0.0875222600142252549554)*zz + 0.455004033050794024546)*zz + 1.0;
-        
-        return z * (1.044948577880859375f + P_eval / Q_eval);
-      }
-    }else if( z < 5.8f )
+    /** erf for 0 <= z < 1E-10 */
+    ERF_ARRAY_INLINE double erf_tiny_z( const double z )
     {
-      if(z < 1.5f)
-      {
-        static const double Y = 0.405935764312744140625f;
-        static const double P[] = { -0.098090592216281240205, 0.178114665841120341155,
-          0.191003695796775433986, 0.0888900368967884466578, 0.0195049001251218801359,
-          0.00180424538297014223957
-        };
-        static const double Q[] = { 1.0, 1.84759070983002217845,
-          1.42628004845511324508, 0.578052804889902404909, 0.12385097467900864233,
-          0.0113385233577001411017, 0.337511472483094676155e-5
-        };
-        
-        const double zarg = z - 0.5;
-        const double P_eval = ((((zarg*P[5] + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
-        const double Q_eval = (((((Q[6]*zarg + Q[5])*zarg + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
-        
-        return 1 - (Y + P_eval / Q_eval) * (exp(-z * z) / z);
-      }else if(z < 2.5f)
-      {
-        static const double Y = 0.50672817230224609375f;
-        static const double P[] = { -0.0243500476207698441272, 0.0386540375035707201728,
-          0.04394818964209516296, 0.0175679436311802092299, 0.00323962406290842133584,
-          0.000235839115596880717416
-        };
-        static const double Q[] = { 1.0, 1.53991494948552447182, 0.982403709157920235114,
-          0.325732924782444448493, 0.0563921837420478160373, 0.00410369723978904575884
-        };
-        
-        const double zarg = z - 1.5;
-        const double P_eval = ((((zarg*P[5] + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
-        const double Q_eval = ((((zarg*Q[5] + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
-        
-        return 1 - (Y + P_eval / Q_eval) * (exp(-z * z) / z);
-      }
-      else if(z < 4.5f)
-      {
-        static const double Y = 0.5405750274658203125f;
-        static const double P[] = { 0.00295276716530971662634, 0.0137384425896355332126,
-          0.00840807615555585383007, 0.00212825620914618649141, 0.000250269961544794627958,
-          0.113212406648847561139e-4
-        };
-        static const double Q[] = { 1.0, 1.04217814166938418171,
-          0.442597659481563127003, 0.0958492726301061423444, 0.0105982906484876531489,
-          0.000479411269521714493907
-        };
-        
-        const double zarg = z - 3.5;
-        const double P_eval = ((((zarg*P[5] + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
-        const double Q_eval = ((((zarg*Q[5] + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
-        
-        return 1 - (Y + P_eval / Q_eval) * (exp(-z * z) / z);
-      }else
-      {
-        static const double Y = 0.5579090118408203125f;
-        static const double P[] = { 0.00628057170626964891937, 0.0175389834052493308818,
-          -0.212652252872804219852, -0.687717681153649930619, -2.5518551727311523996,
-          -3.22729451764143718517, -2.8175401114513378771
-        };
-        static const double Q[] = { 1.0, 2.79257750980575282228, 11.0567237927800161565,
-          15.930646027911794143, 22.9367376522880577224, 13.5064170191802889145,
-          5.48409182238641741584
-        };
-        
-        const double zarg = 1.0 / z;
-        const double P_eval = (((((P[6]*zarg + P[5])*zarg + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
-        const double Q_eval = (((((Q[6]*zarg + Q[5])*zarg + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
-        
-        return 1 - (Y + P_eval / Q_eval) * (exp(-z * z) / z);
-      }
+      return z * 1.125f + z * 0.003379167095512573896158903121545171688;
     }
     
-    return 1;
-  }//double boost_erf_imp( double z )
-  
-  
-  /** 20231123: The JavaScript needed a better `erfc` implementation than just `1-erf`, or otherwise there were huge
-   artifacts, and regions that just wouldnt draw, so wcjohns extracted this `erfc` function from boost; boost implements `erf`
-   and `erfc` in the same function, but since the JS just needs `erfc`, wcjohns separated the erf and erf implementation, even
-   though they are largely duplicate - saves some small amount of code/overhead.
-   */
-  double boost_erfc_imp( double z )
-  {
-    /* Since this function is a (slight) modification of boost source code, it
-     is subject to the Boost Version 1 Software License, whose text is:
-     
-     Boost Software License - Version 1.0 - August 17th, 2003
-     
-     Permission is hereby granted, free of charge, to any person or organization
-     obtaining a copy of the software and accompanying documentation covered by
-     this license (the "Software") to use, reproduce, display, distribute,
-     execute, and transmit the Software, and to prepare derivative works of the
-     Software, and to permit third-parties to whom the Software is furnished to
-     do so, all subject to the following:
-     
-     The copyright notices in the Software and this entire statement, including
-     the above license grant, this restriction and the following disclaimer,
-     must be included in all copies of the Software, in whole or in part, and
-     all derivative works of the Software, unless such copies or derivative
-     works are solely in the form of machine-executable object code generated by
-     a source language processor.
-     
-     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-     IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-     FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
-     SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
-     FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
-     ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
-     DEALINGS IN THE SOFTWARE.
-     */
-
-    if( z < 0 )
-      return (z < -0.5) ? (2 - boost_erfc_imp( -z )) : (1 + boost_erf_imp( -z ));
-    
-    if( z < 0.5 )
-      return 1 - boost_erf_imp( z );
-    
-    if( z >= 28 )
-      return 0;
+    /** erf for 1E-10 <= z < 0.5 */
+    ERF_ARRAY_INLINE double erf_small_z( const double z )
+    {
+      const double zz = z * z;
+      const double P_eval = (((zz*-0.000322780120964605683831 + -0.00772758345802133288487)*zz + -0.0509990735146777432841)*zz + -0.338165134459360935041)*zz + 0.0834305892146531832907;
+      const double Q_eval = (((zz*0.000370900071787748000569 + 0.00858571925074406212772)*zz + 0.0875222600142252549554)*zz + 0.455004033050794024546)*zz + 1.0;
+      
+      return z * (1.044948577880859375f + P_eval / Q_eval);
+    }
     
-    if(z < 1.5f)
+    /** erfc for 0.5 <= z < 1.5 is `erfc_ratio_0p5_to_1p5(z) * exp(-z*z) / z` */
+    ERF_ARRAY_INLINE double erfc_ratio_0p5_to_1p5( const double z )
     {
       static const double P[] = { -0.098090592216281240205, 0.178114665841120341155,
         0.191003695796775433986, 0.0888900368967884466578, 0.0195049001251218801359,
@@ -231,10 +124,16 @@ namespace PeakDists
       const double P_eval = ((((zarg*P[5] + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
       const double Q_eval = (((((Q[6]*zarg + Q[5])*zarg + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
       
-      return (0.405935764312744140625f + P_eval / Q_eval) * (exp(-z * z) / z);
-    }//if(z < 1.5f)
+      return 0.405935764312744140625f + P_eval / Q_eval;
+    }
     
-    if( z < 2.5f )
+    inline double erfc_z_0p5_to_1p5( const double z )
+    {
+      return erfc_ratio_0p5_to_1p5( z ) * (exp(-z * z) / z);
+    }
+    
+    /** erfc for 1.5 <= z < 2.5 is `erfc_ratio_1p5_to_2p5(z) * exp(-z*z) / z` */
+    ERF_ARRAY_INLINE double erfc_ratio_1p5_to_2p5( const double z )
     {
       static const double P[] = { -0.0243500476207698441272, 0.0386540375035707201728,
         0.04394818964209516296, 0.0175679436311802092299, 0.00323962406290842133584,
@@ -248,11 +147,17 @@ namespace PeakDists
       const double P_eval = ((((zarg*P[5] + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
       const double Q_eval = ((((zarg*Q[5] + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
       
-      return (0.50672817230224609375f + P_eval / Q_eval) * (exp(-z * z) / z);
+      return 0.50672817230224609375f + P_eval / Q_eval;
       // Boost implementation has an additional minor error correction here
-    }//if( z < 2.5f
+    }
     
-    if( z < 4.5f )
+    inline double erfc_z_1p5_to_2p5( const double z )
+    {
+      return erfc_ratio_1p5_to_2p5( z ) * (exp(-z * z) / z);
+    }
+    
+    /** erfc for 2.5 <= z < 4.5 is `erfc_ratio_2p5_to_4p5(z) * exp(-z*z) / z` */
+    ERF_ARRAY_INLINE double erfc_ratio_2p5_to_4p5( const double z )
     {
       static const double P[] = { 0.00295276716530971662634, 0.0137384425896355332126,
         0.00840807615555585383007, 0.00212825620914618649141, 0.000250269961544794627958,
@@ -266,26 +171,358 @@ namespace PeakDists
       const double zarg = z - 3.5;
       const double P_eval = ((((zarg*P[5] + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
       const double Q_eval = ((((zarg*Q[5] + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
-      return (0.5405750274658203125f + P_eval / Q_eval) * (exp(-z * z) / z);
+      
+      return 0.5405750274658203125f + P_eval / Q_eval;
+      // Boost implementation has an additional minor error correction here
+    }
+    
+    inline double erfc_z_2p5_to_4p5( const double z )
+    {
+      return erfc_ratio_2p5_to_4p5( z ) * (exp(-z * z) / z);
+    }
+    
+    /** erfc for 4.5 <= z is `erfc_ratio_above_4p5(z) * exp(-z*z) / z` (boost uses this up to z of 28 for erfc, and 5.8 for erf) */
+    ERF_ARRAY_INLINE double erfc_ratio_above_4p5( const double z )
+    {
+      static const double P[] = { 0.00628057170626964891937, 0.0175389834052493308818,
+        -0.212652252872804219852, -0.687717681153649930619, -2.5518551727311523996,
+        -3.22729451764143718517, -2.8175401114513378771
+      };
+      static const double Q[] = { 1.0, 2.79257750980575282228, 11.0567237927800161565,
+        15.930646027911794143, 22.9367376522880577224, 13.5064170191802889145,
+        5.48409182238641741584
+      };
+      
+      const double zarg = 1.0 / z;
+      const double P_eval = (((((P[6]*zarg + P[5])*zarg + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
+      const double Q_eval = (((((Q[6]*zarg + Q[5])*zarg + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
+      
+      return 0.5579090118408203125f + P_eval / Q_eval;
       // Boost implementation has an additional minor error correction here
-    }//if( z < 4.5f )
+    }
+    
+    inline double erfc_z_above_4p5( const double z )
+    {
+      return erfc_ratio_above_4p5( z ) * (exp(-z * z) / z);
+    }
+    
     
-    static const double P[] = { 0.00628057170626964891937, 0.0175389834052493308818,
-      -0.212652252872804219852, -0.687717681153649930619, -2.5518551727311523996,
-      -3.22729451764143718517, -2.8175401114513378771
+    /** The intervals of |z| that use a distinct approximation for erf.  Used by the array version of
+     `boost_erf_imp(...)` to group consecutive arguments into runs evaluated with a single
+     (branch-free) expression.
+     */
+    enum class ErfInterval : int
+    {
+      Tiny, Small, From0p5, From1p5, From2p5, From4p5, Saturated
     };
-    static const double Q[] = { 1.0, 2.79257750980575282228, 11.0567237927800161565,
-      15.930646027911794143, 22.9367376522880577224, 13.5064170191802889145,
-      5.48409182238641741584
+    
+    ERF_ARRAY_INLINE ErfInterval erf_interval( const double abs_z )
+    {
+      if( abs_z < 0.5 )
+        return (abs_z < 1e-10) ? ErfInterval::Tiny : ErfInterval::Small;
+      if( abs_z < 5.8f )
+      {
+        if( abs_z < 1.5f )
+          return ErfInterval::From0p5;
+        if( abs_z < 2.5f )
+          return ErfInterval::From1p5;
+        if( abs_z < 4.5f )
+          return ErfInterval::From2p5;
+        return ErfInterval::From4p5;
+      }
+      
+      return ErfInterval::Saturated; //Also NaN, which the scalar version also returns 1.0 for.
+    }//erf_interval(...)
+    
+    
+    /** Same idea as `ErfInterval`, but for the branches of `boost_erfc_imp(double)`. */
+    enum class ErfcInterval : int
+    {
+      BelowHalf, From0p5, From1p5, From2p5, From4p5, From26, Zero
     };
     
-    const double zarg = 1.0 / z;
-    const double P_eval = (((((P[6]*zarg + P[5])*zarg + P[4])*zarg + P[3])*zarg + P[2])*zarg + P[1])*zarg + P[0];
-    const double Q_eval = (((((Q[6]*zarg + Q[5])*zarg + Q[4])*zarg + Q[3])*zarg + Q[2])*zarg + Q[1])*zarg + Q[0];
+    ERF_ARRAY_INLINE ErfcInterval erfc_interval( const double z )
+    {
+      // Arguments below 0.5 are evaluated using erf (or the reflection formula), and above 26
+      //  `exp(-z*z)` is in the denormal range; these are rare for the arguments we actually see,
+      //  so the array version just uses the scalar version for these.
+      if( z < 0.5 )
+        return ErfcInterval::BelowHalf;
+      if( z >= 28 )
+        return ErfcInterval::Zero;
+      if( z < 1.5f )
+        return ErfcInterval::From0p5;
+      if( z < 2.5f )
+        return ErfcInterval::From1p5;
+      if( z < 4.5f )
+        return ErfcInterval::From2p5;
+      if( z >= 26 )
+        return ErfcInterval::From26;
+      return ErfcInterval::From4p5; //Also NaN, same as the scalar version
+    }//erfc_interval(...)
+    
+    
+    /** Evaluates `sign * f(sign * z[i])` for `n` elements.
+     
+     The loop body has no branches, so is friendly to compiler auto-vectorization (the polynomial
+     evaluation vectorizes; whether `exp` does depends on the compiler and math library).
+     */
+    template<double (*f)(const double)>
+    ERF_ARRAY_INLINE void eval_run( const double * const z, double * const result, const size_t n,
+                                    const double sign )
+    {
+      for( size_t i = 0; i < n; ++i )
+        result[i] = sign * f( sign * z[i] );
+    }
+    
+    
+    /** An `exp(x)` implementation, valid for -700 <= x <= 0, that does not call into the math
+     library, so that loops calling it can be vectorized by the compiler (a loop containing a call
+     to `std::exp` generally will not be).
+     
+     Uses Cody-Waite range reduction, `x = k*ln(2) + r` with |r| <= 0.5*ln(2), a 13th order Taylor
+     series for `exp(r)`, and then constructs 2^k directly from its bits.  Agrees with `std::exp`
+     to within ~2.3E-16 (relative) over its valid range.
+     */
+    ERF_ARRAY_INLINE double exp_non_positive( const double x )
+    {
+      const double log2e = 1.4426950408889634074;
+      const double ln2_hi = 6.93147180369123816490e-01; //trailing zeros so `k*ln2_hi` is exact
+      const double ln2_lo = 1.90821492927058770002e-10;
+      const double round_shift = 6755399441055744.0; // 1.5 * 2^52; adding this rounds to integer
+      
+      const double kd = x*log2e + round_shift;
+      const double k = kd - round_shift;
+      const double r = (x - k*ln2_hi) - k*ln2_lo;
+      
+      double p = 1.0/6227020800.0;
+      p = p*r + 1.0/479001600.0;
+      p = p*r + 1.0/39916800.0;
+      p = p*r + 1.0/3628800.0;
+      p = p*r + 1.0/362880.0;
+      p = p*r + 1.0/40320.0;
+      p = p*r + 1.0/5040.0;
+      p = p*r + 1.0/720.0;
+      p = p*r + 1.0/120.0;
+      p = p*r + 1.0/24.0;
+      p = p*r + 1.0/6.0;
+      p = p*r + 0.5;
+      p = p*r + 1.0;
+      p = p*r + 1.0;
+      
+      // The low bits of `kd` hold the integer `k`; build the double 2^k from it.
+      int64_t kd_bits, shift_bits;
+      memcpy( &kd_bits, &kd, sizeof(kd) );
+      memcpy( &shift_bits, &round_shift, sizeof(round_shift) );
+      const int64_t scale_bits = (kd_bits - shift_bits + 1023) << 52;
+      double scale;
+      memcpy( &scale, &scale_bits, sizeof(scale) );
+      
+      return p * scale;
+    }//exp_non_positive(...)
+    
+    
+    /** Evaluates erf (if `as_erf` is true), or erfc, for `n` elements of an interval whose
+     approximation is `ratio(x) * exp(-x*x) / x`, where `x = sign*z[i]`, and |x| < 26.
+     */
+    template<double (*ratio)(const double)>
+    ERF_ARRAY_INLINE void eval_erfc_run( const double * const z, double * const result, const size_t n,
+                                         const double sign, const bool as_erf )
+    {
+      for( size_t i = 0; i < n; ++i )
+      {
+        const double x = sign * z[i];
+        result[i] = exp_non_positive(-x * x) / x;
+      }
+      
+      if( as_erf )
+      {
+        for( size_t i = 0; i < n; ++i )
+          result[i] = sign * (1 - ratio( sign * z[i] ) * result[i]);
+      }else
+      {
+        for( size_t i = 0; i < n; ++i )
+          result[i] = ratio( z[i] ) * result[i];
+      }
+    }//eval_erfc_run(...)
+  }//namespace
+  
+  
+  /** 20191230: wcjohns extracted the boost::math::erf() function implementation
+   from boost 1.65.1 for double precision (53 bit mantissa) into this function,
+   boost_erf_imp(). Removing some of the supporting code structure, and
+   explicitly writing out the polynomial equation evaluation seems to speed
+   things up by about a factor of ~3 over calling boost::math::erf().
+   
+   Using the commented out erf_approx() function looks to be about 25% faster than
+   this boost version, but I havent carefully checked out the precision implications
+   so not switching to it yet.
+   
+   Surprisingly, the erf() function is the major bottleneck for peak fitting.
+   */
+  double boost_erf_imp( double z )
+  {
+    if(z < 0)
+      return -boost_erf_imp( -z );
+    
+    if( z < 0.5 )
+    {
+      if( z < 1e-10 )
+        return erf_tiny_z( z );
+      
+      return erf_small_z( z );
+    }else if( z < 5.8f )
+    {
+      if( z < 1.5f )
+        return 1 - erfc_z_0p5_to_1p5( z );
+      
+      if( z < 2.5f )
+        return 1 - erfc_z_1p5_to_2p5( z );
+      
+      if( z < 4.5f )
+        return 1 - erfc_z_2p5_to_4p5( z );
+      
+      return 1 - erfc_z_above_4p5( z );
+    }
+    
+    return 1;
+  }//double boost_erf_imp( double z )
+  
+  
+  /** 20231123: The JavaScript needed a better `erfc` implementation than just `1-erf`, or otherwise there were huge
+   artifacts, and regions that just wouldnt draw, so wcjohns extracted this `erfc` function from boost; boost implements `erf`
+   and `erfc` in the same function, but since the JS just needs `erfc`, wcjohns separated the erf and erf implementation, even
+   though they are largely duplicate - saves some small amount of code/overhead.
+   */
+  double boost_erfc_imp( double z )
+  {
+    if( z < 0 )
+      return (z < -0.5) ? (2 - boost_erfc_imp( -z )) : (1 + boost_erf_imp( -z ));
+    
+    if( z < 0.5 )
+      return 1 - boost_erf_imp( z );
+    
+    if( z >= 28 )
+      return 0;
+    
+    if( z < 1.5f )
+      return erfc_z_0p5_to_1p5( z );
+    
+    if( z < 2.5f )
+      return erfc_z_1p5_to_2p5( z );
+    
+    if( z < 4.5f )
+      return erfc_z_2p5_to_4p5( z );
     
-    return (0.5579090118408203125f + P_eval / Q_eval) * (exp(-z * z) / z);
-    // Boost implementation has an additional minor error correction here
-}//double boost_erfc_imp( double z )
+    return erfc_z_above_4p5( z );
+  }//double boost_erfc_imp( double z )
+  
+  
+  ERF_ARRAY_TARGET_CLONES
+  void boost_erf_imp( const double * const z, double * const result, const size_t n )
+  {
+    size_t start = 0;
+    while( start < n )
+    {
+      const bool negative = (z[start] < 0);
+      const double sign = negative ? -1.0 : 1.0;
+      const ErfInterval interval = erf_interval( sign * z[start] );
+      
+      // Find the end of the run of arguments with the same sign, and in the same interval.
+      size_t end = start + 1;
+      while( (end < n) && ((z[end] < 0) == negative) && (erf_interval( sign * z[end] ) == interval) )
+        ++end;
+      
+      const double * const run_z = z + start;
+      double * const run_result = result + start;
+      const size_t run_n = end - start;
+      
+      switch( interval )
+      {
+        case ErfInterval::Tiny:
+          eval_run<erf_tiny_z>( run_z, run_result, run_n, sign );
+          break;
+          
+        case ErfInterval::Small:
+          eval_run<erf_small_z>( run_z, run_result, run_n, sign );
+          break;
+          
+        case ErfInterval::From0p5:
+          eval_erfc_run<erfc_ratio_0p5_to_1p5>( run_z, run_result, run_n, sign, true );
+          break;
+          
+        case ErfInterval::From1p5:
+          eval_erfc_run<erfc_ratio_1p5_to_2p5>( run_z, run_result, run_n, sign, true );
+          break;
+          
+        case ErfInterval::From2p5:
+          eval_erfc_run<erfc_ratio_2p5_to_4p5>( run_z, run_result, run_n, sign, true );
+          break;
+          
+        case ErfInterval::From4p5:
+          eval_erfc_run<erfc_ratio_above_4p5>( run_z, run_result, run_n, sign, true );
+          break;
+          
+        case ErfInterval::Saturated:
+          for( size_t i = 0; i < run_n; ++i )
+            run_result[i] = sign;
+          break;
+      }//switch( interval )
+      
+      start = end;
+    }//while( start < n )
+  }//void boost_erf_imp( array version )
+  
+  
+  ERF_ARRAY_TARGET_CLONES
+  void boost_erfc_imp( const double * const z, double * const result, const size_t n )
+  {
+    size_t start = 0;
+    while( start < n )
+    {
+      const ErfcInterval interval = erfc_interval( z[start] );
+      
+      size_t end = start + 1;
+      while( (end < n) && (erfc_interval( z[end] ) == interval) )
+        ++end;
+      
+      const double * const run_z = z + start;
+      double * const run_result = result + start;
+      const size_t run_n = end - start;
+      
+      switch( interval )
+      {
+        case ErfcInterval::BelowHalf:
+        case ErfcInterval::From26:
+          for( size_t i = 0; i < run_n; ++i )
+            run_result[i] = boost_erfc_imp( run_z[i] );
+          break;
+          
+        case ErfcInterval::From0p5:
+          eval_erfc_run<erfc_ratio_0p5_to_1p5>( run_z, run_result, run_n, 1.0, false );
+          break;
+          
+        case ErfcInterval::From1p5:
+          eval_erfc_run<erfc_ratio_1p5_to_2p5>( run_z, run_result, run_n, 1.0, false );
+          break;
+          
+        case ErfcInterval::From2p5:
+          eval_erfc_run<erfc_ratio_2p5_to_4p5>( run_z, run_result, run_n, 1.0, false );
+          break;
+          
+        case ErfcInterval::From4p5:
+          eval_erfc_run<erfc_ratio_above_4p5>( run_z, run_result, run_n, 1.0, false );
+          break;
+          
+        case ErfcInterval::Zero:
+          for( size_t i = 0; i < run_n; ++i )
+            run_result[i] = 0.0;
+          break;
+      }//switch( interval )
+      
+      start = end;
+    }//while( start < n )
+  }//void boost_erfc_imp( array version )
   
   /*
   double erf_approx( double x )
@@ -344,6 +581,100 @@ namespace PeakDists
     }//switch( skew_type )
   }//void photopeak_function_integral(...)
   
+  
+  void photopeak_function_integral_derivatives( const double mean,
+                                                const double sigma,
+                                                const double amp,
+                                                const PeakDef::SkewType skew_type,
+                                                const double * const skew_parameters,
+                                                const size_t nchannel,
+                                                const float * const energies,
+                                                double *d_mean,
+                                                double *d_sigma,
+                                                double *d_skew )
+  {
+    assert( (skew_type == PeakDef::SkewType::NoSkew) || skew_parameters );
+    
+    if( !nchannel )
+      return;
+    
+    if( skew_type == PeakDef::SkewType::NoSkew )
+    {
+      // With u = (x - mean)/(sqrt(2)*sigma), the channel integral is 0.5*A*(erf(u1) - erf(u0)), so
+      //   d/dmean  = A/(sqrt(2*pi)*sigma) * (exp(-u0^2) - exp(-u1^2))
+      //   d/dsigma = A/(sqrt(pi)*sigma) * (u0*exp(-u0^2) - u1*exp(-u1^2))
+      const double one_div_root_two = boost::math::constants::one_div_root_two<double>();
+      const double one_div_root_pi = boost::math::constants::one_div_root_pi<double>();
+      
+      const double u_factor = one_div_root_two / sigma;
+      const double mean_factor = amp * one_div_root_two * one_div_root_pi / sigma;
+      const double sigma_factor = amp * one_div_root_pi / sigma;
+      
+      double u0 = (energies[0] - mean) * u_factor;
+      double exp0 = std::exp( -u0*u0 );
+      for( size_t i = 0; i < nchannel; ++i )
+      {
+        const double u1 = (energies[i+1] - mean) * u_factor;
+        const double exp1 = std::exp( -u1*u1 );
+        
+        if( d_mean )
+          d_mean[i] += mean_factor * (exp0 - exp1);
+        if( d_sigma )
+          d_sigma[i] += sigma_factor * (u0*exp0 - u1*exp1);
+        
+        u0 = u1;
+        exp0 = exp1;
+      }//for( size_t i = 0; i < nchannel; ++i )
+      
+      return;
+    }//if( skew_type == PeakDef::SkewType::NoSkew )
+    
+    // The skewed distributions are piece-wise combinations of erf, exp, and pow, with the pieces
+    //  joined at skew-dependent points, so instead of carrying closed-form derivatives of each
+    //  piece, we take central differences of just this one peaks channel integrals.
+    const size_t num_skew = PeakDef::num_skew_parameters( skew_type );
+    assert( num_skew <= 4 );
+    
+    double pars[6] = { mean, sigma, 0.0, 0.0, 0.0, 0.0 };
+    for( size_t i = 0; i < num_skew; ++i )
+      pars[2 + i] = skew_parameters[i];
+    
+    std::vector<double> upper( nchannel ), lower( nchannel );
+    
+    auto central_difference = [&]( const size_t par_index, const double h, double *result ){
+      const double orig = pars[par_index];
+      
+      std::fill( std::begin(upper), std::end(upper), 0.0 );
+      pars[par_index] = orig + h;
+      photopeak_function_integral( pars[0], pars[1], amp, skew_type, pars + 2, nchannel, energies, &(upper[0]) );
+      
+      std::fill( std::begin(lower), std::end(lower), 0.0 );
+      pars[par_index] = orig - h;
+      photopeak_function_integral( pars[0], pars[1], amp, skew_type, pars + 2, nchannel, energies, &(lower[0]) );
+      
+      pars[par_index] = orig;
+      
+      const double one_div_2h = 0.5 / h;
+      for( size_t i = 0; i < nchannel; ++i )
+        result[i] += (upper[i] - lower[i]) * one_div_2h;
+    };//central_difference lambda
+    
+    if( d_mean )
+      central_difference( 0, 1.0E-4*sigma, d_mean );
+    
+    if( d_sigma )
+      central_difference( 1, 1.0E-4*sigma, d_sigma );
+    
+    if( d_skew )
+    {
+      for( size_t i = 0; i < num_skew; ++i )
+      {
+        const double h = 1.0E-4 * std::max( std::fabs(skew_parameters[i]), 1.0E-3 );
+        central_difference( 2 + i, h, d_skew + i*nchannel );
+      }
+    }//if( d_skew )
+  }//void photopeak_function_integral_derivatives(...)
+  
   /** Returns the PDF for a unit-area Bortel function.
    */
   double bortel_pdf( const double mean, const double sigma, const double skew_low, const double x )
@@ -1106,6 +1437,58 @@ namespace PeakDists
   }//double gaussian_integral(...)
 
 
+  namespace
+  {
+    /** The number of channel edges we evaluate at a time when using the array version of
+     `boost_erf_imp(...)`; large enough to amortize the per-call overhead, and small enough the
+     scratch arrays can live on the stack.
+     */
+    const size_t sm_erf_block_size = 256;
+    
+    
+    /** Adds the Gaussian-core portion of a photopeak distribution to `channels`, for channels in
+     the range [`channel`, `end_channel`).
+     
+     The indefinite integral at energy `x` is taken as `indef_amp * erf( one_div_root_two*(x - mean)/sigma )`,
+     and `norm * (indefinite_high - indefinite_low)` is added to each channel.
+     
+     @param indefinite_low The indefinite integral at the lower edge of `channel`; on return will be
+            the indefinite integral at the upper edge of the last channel.
+     */
+    void add_gauss_core_channels( const double mean, const double sigma,
+                                  const double indef_amp, const double norm,
+                                  const float * const energies, double * const channels,
+                                  size_t channel, const size_t end_channel,
+                                  double &indefinite_low )
+    {
+      const double one_div_root_two = boost::math::constants::one_div_root_two<double>();
+      
+      double args[sm_erf_block_size], erfs[sm_erf_block_size];
+      
+      while( channel < end_channel )
+      {
+        const size_t nblock = std::min( sm_erf_block_size, end_channel - channel );
+        for( size_t i = 0; i < nblock; ++i )
+        {
+          const double t = (energies[channel + i + 1] - mean) / sigma;
+          args[i] = one_div_root_two * t;
+        }
+        
+        boost_erf_imp( args, erfs, nblock );
+        
+        for( size_t i = 0; i < nblock; ++i )
+        {
+          const double indefinite_high = indef_amp * erfs[i];
+          channels[channel + i] += norm * (indefinite_high - indefinite_low);
+          indefinite_low = indefinite_high;
+        }
+        
+        channel += nblock;
+      }//while( channel < end_channel )
+    }//add_gauss_core_channels(...)
+  }//namespace
+  
+  
   void gaussian_integral( const double peak_mean,
                               const double peak_sigma,
                               const double peak_amplitude,
@@ -1129,22 +1512,170 @@ namespace PeakDists
     if( channel == nchannel )
       return;
     
+    size_t end_channel = channel;
+    while( (end_channel < nchannel) && (energies[end_channel] < stop_energy) )
+      end_channel += 1;
+    
     const double sqrt2 = boost::math::constants::root_two<double>();
     
     // We will keep track of the channels lower value of erf, so we dont have to re-compute
     //  it for each channel (this is the who advantage of )
     double erflow = boost_erf_imp( (energies[channel] - peak_mean)/(sqrt2*peak_sigma) );
     
-    while( (channel < nchannel) && (energies[channel] < stop_energy) )
+    // Evaluate erf at the upper edges of the channels a block at a time, using the array version
+    //  of `boost_erf_imp(...)`, since this is what dominates the time of peak fitting.
+    double erf_args[sm_erf_block_size], erf_vals[sm_erf_block_size];
+    
+    while( channel < end_channel )
+    {
+      const size_t nblock = std::min( sm_erf_block_size, end_channel - channel );
+      for( size_t i = 0; i < nblock; ++i )
+        erf_args[i] = (energies[channel+i+1] - peak_mean)/(sqrt2*peak_sigma);
+      
+      boost_erf_imp( erf_args, erf_vals, nblock );
+      
+      for( size_t i = 0; i < nblock; ++i )
+      {
+        const double erfhigh = erf_vals[i];
+        channels[channel+i] += 0.5 * peak_amplitude * (erfhigh - erflow);
+        erflow = erfhigh;
+      }
+      
+      channel += nblock;
+    }//while( channel < end_channel )
+  }//gaus_integral(...)
+  
+  
+  namespace
+  {
+    /** Tabulated erf(z), for 0 <= z <= #sm_erf_table_max_z, on a uniform grid; values between
+     nodes are found by cubic Hermite interpolation using the tabulated derivatives.
+     
+     The interpolation error is bounded by `h^4 max|erf''''| / 384`, or about 5E-11 for the step
+     size used here, while the table (~12 kB) still fits easily in L1 cache.
+     */
+    const double sm_erf_table_nodes_per_unit = 128.0;
+    const double sm_erf_table_max_z = 6.0;  // erf(6) = 1 - 2E-17
+    
+    struct ErfTable
+    {
+      /** erf at each node. */
+      std::vector<double> values;
+      
+      /** Derivative of erf at each node, multiplied by the node spacing. */
+      std::vector<double> scaled_derivs;
+      
+      ErfTable()
+      {
+        const size_t nnodes = 1 + static_cast<size_t>( sm_erf_table_max_z * sm_erf_table_nodes_per_unit );
+        const double step = 1.0 / sm_erf_table_nodes_per_unit;
+        const double two_div_root_pi = boost::math::constants::two_div_root_pi<double>();
+        
+        values.resize( nnodes );
+        scaled_derivs.resize( nnodes );
+        for( size_t i = 0; i < nnodes; ++i )
+        {
+          const double z = i * step;
+          values[i] = boost_erf_imp( z );
+          scaled_derivs[i] = step * two_div_root_pi * std::exp( -z*z );
+        }
+      }//ErfTable()
+    };//struct ErfTable
+    
+    
+    const ErfTable &erf_table()
+    {
+      static const ErfTable table;
+      return table;
+    }
+    
+    
+    inline double erf_from_table( const ErfTable &table, const double z )
     {
-      const double erfhigharg = (energies[channel+1] - peak_mean)/(sqrt2*peak_sigma);
-      const double erfhigh = boost_erf_imp( erfhigharg );
+      const double abs_z = std::fabs( z );
+      const double u = abs_z * sm_erf_table_nodes_per_unit;
+      const size_t nnodes = table.values.size();
+      
+      if( !(u < static_cast<double>(nnodes - 1)) )
+        return (z < 0.0) ? -1.0 : 1.0;  //Also catches NaN, as a +-1
+      
+      const size_t i = static_cast<size_t>( u );
+      const double t = u - static_cast<double>( i );
+      const double t2 = t*t;
+      const double t3 = t2*t;
+      
+      const double h00 = 2.0*t3 - 3.0*t2 + 1.0;
+      const double h10 = t3 - 2.0*t2 + t;
+      const double h01 = -2.0*t3 + 3.0*t2;
+      const double h11 = t3 - t2;
       
-      channels[channel] += 0.5 * peak_amplitude * (erfhigh - erflow);
+      const double val = h00*table.values[i] + h10*table.scaled_derivs[i]
+                         + h01*table.values[i+1] + h11*table.scaled_derivs[i+1];
+      
+      return (z < 0.0) ? -val : val;
+    }//erf_from_table(...)
+  }//namespace
+  
+  
+  double erf_tabulated( const double z )
+  {
+    return erf_from_table( erf_table(), z );
+  }
+  
+  
+  double gaussian_integral_tabulated( const double peak_mean, const double peak_sigma,
+                                      const double x0, const double x1 )
+  {
+    if( peak_sigma == 0.0 )
+      return 0.0;
+    
+    const ErfTable &table = erf_table();
+    const double one_div_root_two = boost::math::constants::one_div_root_two<double>();
+    const double erflowarg = one_div_root_two * (x0 - peak_mean) / peak_sigma;
+    const double erfhigharg = one_div_root_two * (x1 - peak_mean) / peak_sigma;
+    
+    return 0.5 * (erf_from_table(table, erfhigharg) - erf_from_table(table, erflowarg));
+  }//double gaussian_integral_tabulated(...)
+  
+  
+  void gaussian_integral_tabulated( const double peak_mean,
+                                    const double peak_sigma,
+                                    const double peak_amplitude,
+                                    const float * const energies,
+                                    double *channels,
+                                    const size_t nchannel )
+  {
+    if( peak_sigma==0.0 || peak_amplitude==0.0 )
+      return;
+    
+    // Same channel range logic as `gaussian_integral(...)`, so the two can be used interchangeably
+    const double zero_amp_point_nsigma = 8.0;
+    const float start_energy = static_cast<float>( peak_mean - zero_amp_point_nsigma*peak_sigma );
+    const float stop_energy = static_cast<float>( peak_mean + zero_amp_point_nsigma*peak_sigma );
+    
+    size_t channel = 0;
+    while( (channel < nchannel) && (energies[channel+1] < start_energy) )
       channel += 1;
+    
+    if( channel == nchannel )
+      return;
+    
+    size_t end_channel = channel;
+    while( (end_channel < nchannel) && (energies[end_channel] < stop_energy) )
+      end_channel += 1;
+    
+    const ErfTable &table = erf_table();
+    const double arg_mult = boost::math::constants::one_div_root_two<double>() / peak_sigma;
+    const double half_amp = 0.5 * peak_amplitude;
+    
+    double erflow = erf_from_table( table, arg_mult*(energies[channel] - peak_mean) );
+    for( ; channel < end_channel; ++channel )
+    {
+      const double erfhigh = erf_from_table( table, arg_mult*(energies[channel+1] - peak_mean) );
+      channels[channel] += half_amp * (erfhigh - erflow);
       erflow = erfhigh;
-    }//while( (channel < nchannel) && (energies[channel] < stop_energy) )
-  }//gaus_integral(...)
+    }
+  }//void gaussian_integral_tabulated(...)
 
   
   
@@ -1170,18 +1701,57 @@ namespace PeakDists
     if( channel == nchannel )
       return;
     
+    size_t end_channel = channel;
+    while( (end_channel < nchannel) && (energies[end_channel] < stop_energy) )
+      end_channel += 1;
+    
     // We will keep track of the channels lower value indefinite integral, so we dont have to
     //  re-compute it for each channel
     double val_low = bortel_indefinite_integral(energies[channel], mean, sigma, skew );
     
-    while( (channel < nchannel) && (energies[channel] < stop_energy) )
+    // The below is `bortel_indefinite_integral(...)` evaluated for a block of channel edges at a
+    //  time, so we can use the array versions of erf and erfc.
+    const double one_div_root_two = boost::math::constants::one_div_root_two<double>();
+    double erf_args[sm_erf_block_size], erf_vals[sm_erf_block_size];
+    double erfc_args[sm_erf_block_size], erfc_vals[sm_erf_block_size];
+    double exp_args[sm_erf_block_size];
+    
+    while( channel < end_channel )
     {
-      const double val_high = bortel_indefinite_integral(energies[channel+1], mean, sigma, skew );
+      const size_t nblock = std::min( sm_erf_block_size, end_channel - channel );
+      for( size_t i = 0; i < nblock; ++i )
+      {
+        const double x = energies[channel+i+1];
+        const double t = (x - mean) / sigma;
+        erf_args[i] = one_div_root_two*t;
+        exp_args[i] = sigma*(2*skew*t + sigma) / (2*skew*skew);
+        erfc_args[i] = one_div_root_two*(t + (sigma/skew));
+      }
       
-      channels[channel] += amp*(val_high - val_low);
-      val_low = val_high;
-      channel += 1;
-    }//while( (channel < nchannel) && (energies[channel] < stop_energy) )
+      boost_erf_imp( erf_args, erf_vals, nblock );
+      
+      // Both `exp_args` and `erfc_args` increase with energy, so the channels that need the
+      //  exponential tail term are the leading part of the block, and the rest just need erf.
+      size_t ntail = 0;
+      while( (skew > 0.0) && (ntail < nblock) && !(exp_args[ntail] > 87.0) && !(erfc_args[ntail] > 10.0) )
+        ntail += 1;
+      
+      boost_erfc_imp( erfc_args, erfc_vals, ntail );
+      
+      for( size_t i = 0; i < nblock; ++i )
+      {
+        double val_high;
+        if( (i >= ntail) || (skew <= 0.0) || (exp_args[i] > 87.0) || (erfc_args[i] > 10.0) )
+          val_high = 0.5 * erf_vals[i];
+        else
+          val_high = 0.5*(erf_vals[i] + (std::exp(exp_args[i]) * erfc_vals[i]));
+        
+        channels[channel+i] += amp*(val_high - val_low);
+        val_low = val_high;
+      }
+      
+      channel += nblock;
+    }//while( channel < end_channel )
   }//bortel_integral( to array values)
 
 
@@ -1395,15 +1965,15 @@ namespace PeakDists
     assert( energies[channel+1] >= tail_end );
     double indefinite_low = gaus_indefinite_non_norm( std::max(1.0*energies[channel],tail_end) );
     
-    while( (channel < nchannel) && (energies[channel] < stop_energy) )
-    {
-      const double upper_energy = energies[channel+1];
-      const double indefinite_high = gaus_indefinite_non_norm( upper_energy );
-      
-      channels[channel] += norm * (indefinite_high - indefinite_low);
-      indefinite_low = indefinite_high;
-      channel += 1;
-    }//while( (channel < nchannel) && (energies[channel] < stop_energy) )
+    size_t end_channel = channel;
+    while( (end_channel < nchannel) && (energies[end_channel] < stop_energy) )
+      end_channel += 1;
+    
+    // Equivalent to looping over channels, calling `gaus_indefinite_non_norm(...)` for each upper
+    //  channel edge, but evaluates erf a block of channels at a time.
+    const double root_half_pi = boost::math::constants::root_half_pi<double>();
+    add_gauss_core_channels( peak_mean, peak_sigma, peak_sigma*root_half_pi, norm,
+                             energies, channels, channel, end_channel, indefinite_low );
 #endif  //USE_SIMPLE_GAUSS_EXP_IMP
   }//void PeakDef::gauss_exp_integral( ... array ... )
   
@@ -1710,17 +2280,17 @@ namespace PeakDists
     assert( energies[channel+1] >= tail_end );
     double indefinite_low = gauss_indefinite( std::max(1.0*energies[channel],tail_end) );
     
-    while( (channel < nchannel) && (energies[channel] < stop_energy) )
+    size_t end_channel = channel;
+    while( (end_channel < nchannel) && (energies[end_channel] < stop_energy) )
     {
-      assert( energies[channel] < energies[channel+1] );
-      const double upper_energy = energies[channel+1];
-      
-      const double indefinite_high = gauss_indefinite( upper_energy );
-      const double val = (indefinite_high - indefinite_low);
-      channels[channel] += val;
-      indefinite_low = indefinite_high;
-      channel += 1;
-    }//while( (channel < nchannel) && (energies[channel] < stop_energy) )
+      assert( energies[end_channel] < energies[end_channel+1] );
+      end_channel += 1;
+    }
+    
+    // Equivalent to looping over channels, calling `gauss_indefinite(...)` for each upper
+    //  channel edge, but evaluates erf a block of channels at a time.
+    add_gauss_core_channels( peak_mean, peak_sigma, gauss_indef_amp, 1.0,
+                             energies, channels, channel, end_channel, indefinite_low );
 #endif //USE_SIMPLE_CB_IMP
     
     
@@ -23,13 +23,18 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <list>
 #include <mutex>
+#include <tuple>
+#include <atomic>
 #include <memory>
 #include <limits>
 #include <vector>
 #include <utility>
 #include <cstdlib>
 
+#include <boost/functional/hash.hpp>
 #include <boost/math/constants/constants.hpp>
 
 #define BOOST_UBLAS_TYPE_CHECK 0
@@ -58,6 +63,9 @@
 #include "Minuit2/MnMinimize.h"
 
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
 #include "InterSpec/PeakFit.h"
 #include "SpecUtils/SpecFile.h"
 #include "InterSpec/PeakDists.h"
@@ -103,6 +111,341 @@ bool matrix_invert( const boost::numeric::ublas::matrix<T>& input,
 }//matrix_invert
 
 
+namespace
+{
+  /** Scratch space for the weighted linear least-squares solves done by fit_to_polynomial(...) and
+   fit_amp_and_offset(...).
+   
+   These functions are called on every objective-function evaluation of the non-linear peak fits
+   (e.g., LinearProblemSubSolveChi2Fcn), so rather than allocating, multiplying, and LU-inverting
+   ublas matrices every call, one workspace is kept per thread; its buffers only ever grow, so after
+   the first few calls no memory is allocated.  The normal equations are formed directly from the
+   design matrix (skipping the explicit transpose), and solved using a Cholesky decomposition.
+   */
+  struct LinearLeastSquaresWorkspace
+  {
+    /** The design matrix, nbin rows by nterms columns, row-major; each row already divided by the
+     data uncertainty of that channel.
+     */
+    std::vector<double> design;
+    
+    /** The data of each channel, divided by its uncertainty. */
+    std::vector<double> rhs;
+    
+    /** The normal-equations matrix (A^T A), nterms by nterms. */
+    std::vector<double> alpha;
+    
+    /** A^T b */
+    std::vector<double> beta;
+    
+    /** Lower-triangular Cholesky factor of #alpha, and then its inverse. */
+    std::vector<double> factor;
+    std::vector<double> factor_inverse;
+    
+    /** The inverse of #alpha; i.e., the covariance matrix of the solution. */
+    std::vector<double> covariance;
+    
+    /** The least-squares solution, #covariance times #beta. */
+    std::vector<double> solution;
+    
+    /** Per-channel counts of the fixed-amplitude peaks, and unit-amplitude fit peaks, used by
+     fit_amp_and_offset(...).
+     */
+    std::vector<double> fixed_peak_counts;
+    std::vector<double> peak_counts;
+    
+    
+    void resize( const size_t nbin, const size_t nterms )
+    {
+      design.resize( nbin * nterms );
+      rhs.resize( nbin );
+      alpha.resize( nterms * nterms );
+      beta.resize( nterms );
+      factor.resize( nterms * nterms );
+      factor_inverse.resize( nterms * nterms );
+      covariance.resize( nterms * nterms );
+      solution.resize( nterms );
+    }//void resize(...)
+    
+    
+    /** Computes #alpha and #beta from #design and #rhs. */
+    void formNormalEquations( const size_t nbin, const size_t nterms )
+    {
+      std::fill( begin(alpha), begin(alpha) + nterms*nterms, 0.0 );
+      std::fill( begin(beta), begin(beta) + nterms, 0.0 );
+      
+      for( size_t row = 0; row < nbin; ++row )
+      {
+        const double * const a = &(design[row*nterms]);
+        const double b = rhs[row];
+        
+        for( size_t i = 0; i < nterms; ++i )
+        {
+          beta[i] += a[i] * b;
+          double * const alpha_row = &(alpha[i*nterms]);
+          for( size_t j = 0; j <= i; ++j )
+            alpha_row[j] += a[i] * a[j];
+        }//for( size_t i = 0; i < nterms; ++i )
+      }//for( size_t row = 0; row < nbin; ++row )
+      
+      for( size_t i = 0; i < nterms; ++i )
+        for( size_t j = i + 1; j < nterms; ++j )
+          alpha[i*nterms + j] = alpha[j*nterms + i];
+    }//void formNormalEquations(...)
+    
+    
+    /** Inverts #alpha into #covariance, and computes #solution.
+     
+     Uses a Cholesky decomposition; if #alpha isnt numerically positive-definite (e.g., nearly
+     degenerate peaks), falls back to LU decomposition.
+     Returns false if #alpha is singular.
+     */
+    bool solveNormalEquations( const size_t nterms )
+    {
+      bool positive_definite = true;
+      
+      for( size_t j = 0; positive_definite && (j < nterms); ++j )
+      {
+        double diag = alpha[j*nterms + j];
+        for( size_t k = 0; k < j; ++k )
+          diag -= factor[j*nterms + k] * factor[j*nterms + k];
+        
+        if( !(diag > 0.0) || IsInf(diag) )
+        {
+          positive_definite = false;
+          break;
+        }
+        
+        const double l_jj = std::sqrt( diag );
+        factor[j*nterms + j] = l_jj;
+        
+        for( size_t i = j + 1; i < nterms; ++i )
+        {
+          double val = alpha[i*nterms + j];
+          for( size_t k = 0; k < j; ++k )
+            val -= factor[i*nterms + k] * factor[j*nterms + k];
+          factor[i*nterms + j] = val / l_jj;
+        }//for( size_t i = j + 1; i < nterms; ++i )
+      }//for( size_t j = 0; j < nterms; ++j )
+      
+      if( positive_definite )
+      {
+        // Invert the lower-triangular factor, L, column by column, then alpha^{-1} = L^{-T} L^{-1}
+        for( size_t j = 0; j < nterms; ++j )
+        {
+          for( size_t i = 0; i < j; ++i )
+            factor_inverse[i*nterms + j] = 0.0;
+          
+          factor_inverse[j*nterms + j] = 1.0 / factor[j*nterms + j];
+          
+          for( size_t i = j + 1; i < nterms; ++i )
+          {
+            double val = 0.0;
+            for( size_t k = j; k < i; ++k )
+              val -= factor[i*nterms + k] * factor_inverse[k*nterms + j];
+            factor_inverse[i*nterms + j] = val / factor[i*nterms + i];
+          }//for( size_t i = j + 1; i < nterms; ++i )
+        }//for( size_t j = 0; j < nterms; ++j )
+        
+        for( size_t i = 0; i < nterms; ++i )
+        {
+          for( size_t j = 0; j <= i; ++j )
+          {
+            double val = 0.0;
+            for( size_t k = i; k < nterms; ++k )
+              val += factor_inverse[k*nterms + i] * factor_inverse[k*nterms + j];
+            covariance[i*nterms + j] = covariance[j*nterms + i] = val;
+          }
+        }//for( size_t i = 0; i < nterms; ++i )
+      }else
+      {
+        using namespace boost::numeric;
+        
+        ublas::matrix<double> alpha_mat( nterms, nterms ), inverse( nterms, nterms );
+        for( size_t i = 0; i < nterms; ++i )
+          for( size_t j = 0; j < nterms; ++j )
+            alpha_mat(i,j) = alpha[i*nterms + j];
+        
+        try
+        {
+          if( !matrix_invert( alpha_mat, inverse ) )
+            return false;
+        }catch( std::exception &e )
+        {
+          cerr << "LinearLeastSquaresWorkspace: caught inverting matrix: " << e.what() << endl;
+          return false;
+        }//try / catch
+        
+        for( size_t i = 0; i < nterms; ++i )
+          for( size_t j = 0; j < nterms; ++j )
+            covariance[i*nterms + j] = inverse(i,j);
+      }//if( positive_definite ) / else
+      
+      for( size_t i = 0; i < nterms; ++i )
+      {
+        double val = 0.0;
+        for( size_t j = 0; j < nterms; ++j )
+          val += covariance[i*nterms + j] * beta[j];
+        solution[i] = val;
+      }//for( size_t i = 0; i < nterms; ++i )
+      
+      return true;
+    }//bool solveNormalEquations( const size_t nterms )
+  };//struct LinearLeastSquaresWorkspace
+  
+  
+  LinearLeastSquaresWorkspace &linear_lsq_workspace()
+  {
+    static thread_local LinearLeastSquaresWorkspace workspace;
+    return workspace;
+  }
+  
+  
+  std::mutex sm_peak_screen_mutex;
+  PeakScreenThresholds sm_peak_screen_thresholds;
+  
+  
+  /** Result of the closed-form screen of a candidate peak; see #linear_peak_screen. */
+  struct LinearPeakScreen
+  {
+    /** If false, the screen couldnt be performed (too few channels, singular matrix, etc), and the
+     other members are not meaningful.
+     */
+    bool valid = false;
+    
+    /** Best-fit amplitude of the peak, with its shape (mean, sigma, skew) fixed. */
+    double amplitude = 0.0;
+    
+    /** The likelihood-ratio statistic between the continuum-only and continuum-plus-peak
+     hypothesis; i.e., the improvement in chi2 by adding the peak (amplitude^2 / variance).
+     */
+    double likelihood_ratio = 0.0;
+    
+    /** The chi2 of the continuum-plus-peak, and continuum-only, solutions. */
+    double chi2_with_peak = 0.0;
+    double chi2_without_peak = 0.0;
+    
+    /** Number of channels used. */
+    size_t nchannel = 0;
+  };//struct LinearPeakScreen
+  
+  
+  /** Solves, in closed form, for the amplitude of `peak` (keeping its shape fixed) and a linear
+   continuum, over `[lower_energy, upper_energy]`, with `other_peaks` held at their current
+   amplitudes.
+   
+   This is a single 3x3 weighted linear least-squares solve, so is a lot cheaper than evaluating
+   the chi2 of the PeakFitChi2Fcn, or fitting; it is used to screen out (or in) candidate peaks
+   whose significance is clear, before doing the full evaluation.
+   */
+  LinearPeakScreen linear_peak_screen( const PeakDef &peak,
+                                       const std::vector<PeakDef> &other_peaks,
+                                       const Measurement &data,
+                                       const double lower_energy, const double upper_energy )
+  {
+    LinearPeakScreen answer;
+    
+    const size_t nchannel = data.num_gamma_channels();
+    if( !peak.gausPeak() || (nchannel < 8) || !(upper_energy > lower_energy) )
+      return answer;
+    
+    const size_t first_channel = data.find_gamma_channel( static_cast<float>(lower_energy) );
+    const size_t last_channel = std::min( nchannel - 1,
+                                    data.find_gamma_channel( static_cast<float>(upper_energy) ) );
+    if( (last_channel < first_channel) || ((last_channel - first_channel) < 4) )
+      return answer;
+    
+    const size_t nbin = 1 + last_channel - first_channel;
+    const size_t nterms = 3;
+    const double ref_energy = peak.mean();
+    
+    PeakDef unit_peak = peak;
+    unit_peak.setAmplitude( 1.0 );
+    
+    vector<const PeakDef *> overlapping;
+    for( const PeakDef &other : other_peaks )
+    {
+      if( other.gausPeak()
+         && ((other.mean() + 5.0*other.sigma()) > lower_energy)
+         && ((other.mean() - 5.0*other.sigma()) < upper_energy) )
+        overlapping.push_back( &other );
+    }//for( const PeakDef &other : other_peaks )
+    
+    LinearLeastSquaresWorkspace &ws = linear_lsq_workspace();
+    ws.resize( nbin, nterms );
+    
+    for( size_t row = 0; row < nbin; ++row )
+    {
+      const size_t channel = first_channel + row;
+      const double x0 = data.gamma_channel_lower( channel ) - ref_energy;
+      const double x1 = data.gamma_channel_upper( channel ) - ref_energy;
+      const double y = data.gamma_channel_content( channel );
+      
+      double fixed_counts = 0.0;
+      for( const PeakDef *other : overlapping )
+        fixed_counts += other->gauss_integral( x0 + ref_energy, x1 + ref_energy );
+      
+      const double uncert = (y > 0.0) ? std::sqrt( y ) : 1.0;
+      double * const a = &(ws.design[row*nterms]);
+      a[0] = (x1 - x0) / uncert;
+      a[1] = 0.5*(x1*x1 - x0*x0) / uncert;
+      a[2] = unit_peak.gauss_integral( x0 + ref_energy, x1 + ref_energy ) / uncert;
+      ws.rhs[row] = (y - fixed_counts) / uncert;
+    }//for( size_t row = 0; row < nbin; ++row )
+    
+    ws.formNormalEquations( nbin, nterms );
+    if( !ws.solveNormalEquations( nterms ) )
+      return answer;
+    
+    const double amp_variance = ws.covariance[2*nterms + 2];
+    if( !(amp_variance > 0.0) || IsInf(amp_variance) || IsNan(ws.solution[2]) )
+      return answer;
+    
+    double chi2 = 0.0;
+    for( size_t row = 0; row < nbin; ++row )
+    {
+      const double * const a = &(ws.design[row*nterms]);
+      const double resid = ws.rhs[row] - (a[0]*ws.solution[0] + a[1]*ws.solution[1]
+                                           + a[2]*ws.solution[2]);
+      chi2 += resid*resid;
+    }//for( size_t row = 0; row < nbin; ++row )
+    
+    // For a linear least-squares problem, removing a term increases the chi2 by exactly
+    //  coef^2 / variance(coef), so we dont need to solve the continuum-only problem separately.
+    answer.valid = true;
+    answer.amplitude = ws.solution[2];
+    answer.likelihood_ratio = ws.solution[2] * ws.solution[2] / amp_variance;
+    answer.chi2_with_peak = chi2;
+    answer.chi2_without_peak = chi2 + answer.likelihood_ratio;
+    answer.nchannel = nbin;
+    
+    return answer;
+  }//LinearPeakScreen linear_peak_screen(...)
+}//namespace
+
+
+PeakScreenThresholds::PeakScreenThresholds()
+  : enabled( true ),
+    reject_below_likelihood_ratio( 1.0 ),
+    accept_above_likelihood_ratio( 400.0 )
+{
+}
+
+
+void set_peak_screen_thresholds( const PeakScreenThresholds &thresholds )
+{
+  std::lock_guard<std::mutex> lock( sm_peak_screen_mutex );
+  sm_peak_screen_thresholds = thresholds;
+}
+
+
+PeakScreenThresholds peak_screen_thresholds()
+{
+  std::lock_guard<std::mutex> lock( sm_peak_screen_mutex );
+  return sm_peak_screen_thresholds;
+}
+
+
 #if( PRINT_DEBUG_INFO_FOR_PEAK_SEARCH_FIT_LEVEL )
 namespace
 {
@@ -127,6 +470,85 @@ namespace
 
 namespace ExperimentalAutomatedPeakSearch
 {
+namespace
+{
+  /** See #set_coarse_candidate_search_min_channels. */
+  std::atomic<size_t> ns_coarse_candidate_search_min_channels( 16385 );
+  
+  /** The minimum FWHM, in (combined) channels, at the low-energy end of the spectrum, we will allow
+   combining channels down to; the second-derivative candidate search is tuned for peaks a handful of
+   channels wide, so going much narrower than this starts to miss (or merge) peaks.
+   */
+  const double ns_coarse_min_fwhm_channels = 5.0;
+  
+  
+  /** Finds candidate peaks using #secondDerivativePeakCanidatesWithROI.
+   
+   For spectra with at least #ns_coarse_candidate_search_min_channels channels, the candidates are
+   found on a copy of the spectrum with channels combined by a power of two, so most of the (mostly
+   peak-free) spectrum costs a fraction of the time; the candidate means, widths, and amplitudes are
+   all in energy/counts, so are unaffected by the combining, and each candidate is then fit against
+   the full resolution data.
+   */
+  vector<std::shared_ptr<PeakDef>> search_candidates( const std::shared_ptr<const Measurement> &meas,
+                                                      const std::shared_ptr<const DetectorPeakResponse> &drf )
+  {
+    size_t lower_channel = 0, upper_channel = 0;
+    
+    const size_t nchannel = meas ? meas->num_gamma_channels() : size_t(0);
+    const size_t min_channels = ns_coarse_candidate_search_min_channels;
+    
+    size_t ncombine = 1;
+    if( min_channels && (nchannel >= min_channels) && meas->energy_calibration()
+       && meas->energy_calibration()->valid() )
+    {
+      while( ((nchannel / (2*ncombine)) >= (min_channels / 2)) && ((nchannel % (2*ncombine)) == 0) )
+        ncombine *= 2;
+      
+      // Make sure peaks will still be a few channels wide, if we know the resolution
+      if( drf && drf->hasResolutionInfo() )
+      {
+        const float lower_energy = std::max( 50.0f, meas->gamma_energy_min() );
+        const size_t lower_chan = meas->find_gamma_channel( lower_energy );
+        const float chan_width = meas->gamma_channel_width( lower_chan );
+        const float fwhm = drf->peakResolutionFWHM( lower_energy );
+        
+        while( (ncombine > 1) && (chan_width > 0.0f) && !IsNan(fwhm)
+              && ((fwhm / (ncombine * chan_width)) < ns_coarse_min_fwhm_channels) )
+          ncombine /= 2;
+      }//if( drf && drf->hasResolutionInfo() )
+    }//if( a lot of channels )
+    
+    if( ncombine > 1 )
+    {
+      try
+      {
+        auto reduced = std::make_shared<Measurement>( *meas );
+        reduced->combine_gamma_channels( ncombine );
+        return secondDerivativePeakCanidatesWithROI( reduced, lower_channel, upper_channel );
+      }catch( std::exception &e )
+      {
+        cerr << "search_candidates: failed to combine channels (" << e.what()
+             << "), will search at full resolution." << endl;
+      }
+    }//if( ncombine > 1 )
+    
+    return secondDerivativePeakCanidatesWithROI( meas, lower_channel, upper_channel );
+  }//search_candidates(...)
+}//namespace
+  
+  
+void set_coarse_candidate_search_min_channels( const size_t nchannels )
+{
+  ns_coarse_candidate_search_min_channels = nchannels;
+}
+  
+  
+size_t coarse_candidate_search_min_channels()
+{
+  return ns_coarse_candidate_search_min_channels;
+}
+  
   
 bool largerByAmplitude( const std::shared_ptr<const PeakDef> &lhs, const std::shared_ptr<const PeakDef> &rhs )
 {
@@ -344,23 +766,67 @@ std::vector<std::shared_ptr<const PeakDef> > filter_anomolous_width_peaks_highre
   
   
 
+/** Returns if adding or removing `changed` from the peaks passed into
+ `do_peak_automated_searchfit(...)` could change the result of fitting a candidate at `x`.
+ 
+ `searchForPeakFromUser(...)` only looks at candidates within 20 max-expected-sigma of the
+ clicked energy, at peaks whose ROI could overlap its ROI, and at the nearest Gaussian peak on
+ either side (to interpolate a starting width), so we are conservative around each of these.
+ 
+ `stable_peaks` are the peaks that were present both when the speculative fit was started, and
+ now; a stable Gaussian peak between `x` and `changed` means `changed` isnt a nearest neighbor.
+ */
+bool change_may_affect_fit( const PeakDef &changed, const double x, const bool highres,
+                            const vector<std::shared_ptr<const PeakDef>> &stable_peaks )
+{
+  float min_sigma, max_sigma;
+  expected_peak_width_limits( x, highres, min_sigma, max_sigma );
+  
+  const double changed_sigma = changed.gausPeak() ? changed.sigma() : 0.25*changed.roiWidth();
+  const double reach = 25.0 * std::max( static_cast<double>(max_sigma), changed_sigma );
+  
+  if( fabs(changed.mean() - x) < reach )
+    return true;
+  
+  if( ((changed.lowerX() - reach) < x) && ((changed.upperX() + reach) > x) )
+    return true;
+  
+  if( !changed.gausPeak() )
+    return false;
+  
+  const double lower = std::min( x, changed.mean() );
+  const double upper = std::max( x, changed.mean() );
+  for( const std::shared_ptr<const PeakDef> &p : stable_peaks )
+  {
+    if( p->gausPeak() && (p->mean() > lower) && (p->mean() < upper) )
+      return false;
+  }
+  
+  return true;
+}//change_may_affect_fit(...)
+  
+
+/** Gives the same answer as `search_for_peaks_singlethread(...)`, but fits candidates concurrently.
+ 
+ The serial algorithm fits candidates one at a time, largest amplitude first, with each fit seeing
+ the peaks from all the previous fits.  Here we speculatively fit a wave of the next candidates
+ in parallel, all against the peaks as they were at the start of the wave, then commit results
+ in the serial order.  When committing a result, if any peak added or removed by an earlier
+ commit in the wave could have influenced it (see `change_may_affect_fit(...)`), the fit is
+ re-done against the current peaks, exactly as the serial algorithm would.
+ */
 std::vector<std::shared_ptr<const PeakDef> > search_for_peaks_multithread(
                                        const std::shared_ptr<const Measurement> meas,
                                        const std::shared_ptr<const DetectorPeakResponse> &drf,
-                                       std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > origpeaks )
+                                       std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > origpeaks,
+                                       const std::function<void(size_t,size_t)> &progress )
 {
   typedef std::shared_ptr<PeakDef> PeakPtr;
   typedef std::shared_ptr<const PeakDef> PeakConstPtr;
   
   const bool highres = PeakFitUtils::is_high_res( meas );
   
-  size_t lower_channel = 0, upper_channel = 0;
-  //    ExperimentalPeakSearch::find_spectroscopic_extent( meas, lower_channel, upper_channel );
-  //    cout << "Start at " << meas->gamma_channel_center( lower_channel ) << " and going through "
-  //    << meas->gamma_channel_center( upper_channel ) << endl;
-  
-  const vector<std::shared_ptr<PeakDef> > initialcandidates
-    = secondDerivativePeakCanidatesWithROI( meas, lower_channel, upper_channel );
+  vector<PeakPtr> initialcandidates = search_candidates( meas, drf );
   
 #if( PRINT_DEBUG_INFO_FOR_PEAK_SEARCH_FIT_LEVEL > 0 )
   {
@@ -372,6 +838,26 @@ std::vector<std::shared_ptr<const PeakDef> > search_for_peaks_multithread(
   }
 #endif
   
+  //The serial version repeatedly takes the first largest-amplitude candidate, which is the order
+  //  a stable sort gives.
+  std::stable_sort( begin(initialcandidates), end(initialcandidates), &largerByAmplitude );
+  
+  vector<double> candidate_means;
+  for( const PeakPtr &p : initialcandidates )
+  {
+    if( !!origpeaks )
+    {
+      bool originalnear = false;
+      for( const PeakConstPtr &orig : *origpeaks )
+        originalnear |= (orig->gausPeak() && fabs((orig->mean()-p->mean())/std::min(orig->sigma(),p->sigma())) < 0.75);
+      
+      if( originalnear )
+        continue;
+    }//if( !!origpeaks )
+    
+    candidate_means.push_back( p->mean() );
+  }//for( const PeakPtr &p : initialcandidates )
+  
   vector<std::shared_ptr<const PeakDef> > fitpeakvec;
   
   if( !!origpeaks )
@@ -380,148 +866,76 @@ std::vector<std::shared_ptr<const PeakDef> > search_for_peaks_multithread(
       fitpeakvec.push_back( p );
   }//if( !!origpeaks )
   
-  vector<std::shared_ptr<const PeakDef> > candidates;
-  if( !fitpeakvec.empty() )
-  {
-    for( const PeakPtr &p : initialcandidates )
-    {
-      bool isnear = false;
-      for( const PeakConstPtr &orig : fitpeakvec )
-      {
-        if( orig->gausPeak() )
-        {
-          const double meandiff = orig->mean() - p->mean();
-          const double minsigma = std::min( orig->sigma(), p->sigma() );
-          isnear |= (fabs(meandiff/minsigma) < 0.75);
-        }
-      }//for( const PeakConstPtr &orig : fitpeakvec )
-      
-      if( !isnear )
-        candidates.push_back( p );
-    }//for( const PeakDef &p : candidates )
-  }else
-  {
-    for( const PeakPtr &p : initialcandidates )
-      candidates.push_back( p );
-  }//if( !fitpeakvec.empty() ) / else
-
+  const size_t wave_size = std::max( size_t(2), 2*static_cast<size_t>(std::thread::hardware_concurrency()) );
   
-  while( !candidates.empty() )
+  for( size_t wave_start = 0; wave_start < candidate_means.size(); wave_start += wave_size )
   {
-    std::sort( candidates.begin(), candidates.end(), &largerByAmplitude );
+    const size_t wave_end = std::min( wave_start + wave_size, candidate_means.size() );
+    const vector<PeakConstPtr> snapshot = fitpeakvec;
     
-    //So this is kinda messy.  If we select a candidate peak for fitting, we
-    //  have to not only make sure that neighboring candidate peaks wont also be
-    //  fit at in this same iteration of the while loop (in another thread), but
-    //  we have to make sure the peaks that the potentially connected candidate
-    //  peaks are connected to, wont be fit - keeping in mind peaks in
-    //  'fitpeakvec' can cause two previously un-connected candidate peaks, to
-    //  now become connected.
-    vector<std::shared_ptr<const PeakDef> > candidatesBeingFitFor;
-    vector<std::shared_ptr<const PeakDef> > candidatesNotFitForDueToCausality;
+    vector< pair< PeakShrdVec, PeakShrdVec > > results( wave_end - wave_start );
     
+    {
+      SharedThreadPool::TaskGroup pool;
+      for( size_t i = wave_start; i < wave_end; ++i )
+        pool.post( boost::bind( &do_peak_automated_searchfit, candidate_means[i],
+                               boost::cref(meas), boost::cref(drf),
+                               boost::cref(snapshot), boost::ref(results[i - wave_start]) ) );
+      pool.join();
+    }
     
-    for( size_t i = 0; i < candidates.size(); ++i )
+    //Peaks added or removed by commits so far in this wave
+    PeakShrdVec changed_peaks;
+    
+    for( size_t i = wave_start; i < wave_end; ++i )
     {
-      std::shared_ptr<const PeakDef> peak = candidates[i];
-      
-      if( std::find( candidatesNotFitForDueToCausality.begin(),
-                     candidatesNotFitForDueToCausality.end(), peak )
-          != candidatesNotFitForDueToCausality.end() )
-        continue;
-      
-      vector<std::shared_ptr<const PeakDef> > inpeaks;
-//      inpeaks.insert( inpeaks.end(), candidatesBeingFitFor.begin(), candidatesBeingFitFor.end() );
-      inpeaks.insert( inpeaks.end(), candidatesNotFitForDueToCausality.begin(), candidatesNotFitForDueToCausality.end() );
-      inpeaks.insert( inpeaks.end(), fitpeakvec.begin(), fitpeakvec.end() );
-      inpeaks.insert( inpeaks.end(), candidates.begin()+i+1, candidates.end() );
-      inpeaks.push_back( peak );
+      pair< PeakShrdVec, PeakShrdVec > &result = results[i - wave_start];
       
-      const double nsigma = highres ? 10.0 : 5.0;
-      const vector< vector<std::shared_ptr<const PeakDef> > > disconnectedpeaks
-                              = causilyDisconnectedPeaks(  nsigma, true, inpeaks );
-      
-      for( size_t j = 0; j < disconnectedpeaks.size(); ++j )
+      if( !changed_peaks.empty() )
       {
-        const vector<std::shared_ptr<const PeakDef> > &peaks = disconnectedpeaks[j];
-        if( std::find( peaks.begin(), peaks.end(), peak ) == peaks.end() )
-          continue;
-        
-        for( const PeakConstPtr &p : peaks )
+        vector<PeakConstPtr> stable_peaks;
+        for( const PeakConstPtr &p : snapshot )
         {
-          if( p == peak )
-            continue;
-          
-          if( std::find( fitpeakvec.begin(), fitpeakvec.end(), p ) != fitpeakvec.end() )
-            continue;
-          
-          if( std::find( candidatesNotFitForDueToCausality.begin(),
-                         candidatesNotFitForDueToCausality.end(), p )
-              != candidatesNotFitForDueToCausality.end() )
-            continue;
-          
-          candidatesNotFitForDueToCausality.push_back( p );
+          if( std::find( begin(fitpeakvec), end(fitpeakvec), p ) != end(fitpeakvec) )
+            stable_peaks.push_back( p );
         }
-      }//for( size_t j = 0; j < disconnectedpeaks.size(); ++j )
+        
+        bool affected = false;
+        for( size_t j = 0; !affected && (j < changed_peaks.size()); ++j )
+          affected = change_may_affect_fit( *changed_peaks[j], candidate_means[i], highres, stable_peaks );
+        
+        if( affected )
+          do_peak_automated_searchfit( candidate_means[i], meas, drf, fitpeakvec, result );
+      }//if( !changed_peaks.empty() )
+      
+      const PeakShrdVec &toadd = result.first;
+      const PeakShrdVec &toremove = result.second;
       
-      candidatesBeingFitFor.push_back( peak );
-    }//for( size_t i = 0; i < candidates.size(); ++i )
-    
-    SpecUtilsAsync::ThreadPool pool;
-    
-    vector< pair< PeakShrdVec, PeakShrdVec > > results( candidatesBeingFitFor.size() );
-    
-    for( size_t i = 0; i < candidatesBeingFitFor.size(); ++i )
-    {
-      const double mean = candidatesBeingFitFor[i]->mean();
-      pool.post( boost::bind( &do_peak_automated_searchfit, mean,
-                             boost::cref(meas), boost::cref(drf),
-                             boost::cref(fitpeakvec), boost::ref(results[i]) ));
-    }//for( size_t i = 0; i < peaksToTryIndices.size(); ++i )
-    
-    pool.join();
-    
-    bool was_collision = false;
-    
-    for( size_t i = 0; i < results.size(); ++i )
-    {
-      const PeakShrdVec &toadd = results[i].first;
-      const PeakShrdVec &toremove = results[i].second;
-
       for( const PeakConstPtr &p : toremove )
       {
-        vector<std::shared_ptr<const PeakDef> >::iterator pos
-                            = std::find(fitpeakvec.begin(),fitpeakvec.end(),p);
-        if( pos != fitpeakvec.end() )
+        const auto pos = std::find( begin(fitpeakvec), end(fitpeakvec), p );
+        if( pos != end(fitpeakvec) )
           fitpeakvec.erase( pos );
-        else
-        {
-          cerr << "There was a collision in the fit" << endl;
-          was_collision = true;
-        }
+        changed_peaks.push_back( p );
       }
       
       for( const PeakConstPtr &p : toadd )
+      {
         fitpeakvec.push_back( p );
-    }//for( size_t i = 0; i < peaksToTryIndices.size(); ++i )
-  
-    std::sort( fitpeakvec.begin(), fitpeakvec.end(),
-            &PeakDef::lessThanByMeanShrdPtr );
-  
-    vector<PeakConstPtr> nextcandidates;
-    for( const PeakConstPtr &peak : candidates )
-    {
-      if( !std::count(candidatesBeingFitFor.begin(), candidatesBeingFitFor.end(), peak) )
-        nextcandidates.push_back( peak );
-    }//for( size_t i = 0; i < candidates.size(); ++i )
-  
-    candidates.swap( nextcandidates );
-  }//while( !candidates.empty() )
+        changed_peaks.push_back( p );
+      }
+      
+      std::sort( fitpeakvec.begin(), fitpeakvec.end(),
+                &PeakDef::lessThanByMeanShrdPtr );
+    }//for( size_t i = wave_start; i < wave_end; ++i )
+    
+    if( progress )
+      progress( wave_end, candidate_means.size() );
+  }//for( loop over waves of candidates )
   
   if( highres )
     fitpeakvec = filter_anomolous_width_peaks_highres( meas, fitpeakvec );
   
-  
   return fitpeakvec;
 }//search_for_peaks_multithread(...)
   
@@ -530,16 +944,15 @@ std::vector<std::shared_ptr<const PeakDef> > search_for_peaks_multithread(
 vector<std::shared_ptr<const PeakDef> > search_for_peaks_singlethread(
                         const std::shared_ptr<const Measurement> meas,
                         const std::shared_ptr<const DetectorPeakResponse> &drf,
-                        std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > origpeaks )
+                        std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > origpeaks,
+                        const std::function<void(size_t,size_t)> &progress )
 {
   typedef std::shared_ptr<PeakDef> PeakPtr;
   typedef std::shared_ptr<const PeakDef> PeakConstPtr;
   
   const bool highres = PeakFitUtils::is_high_res( meas );
   
-  size_t lower_channel = 0, upper_channel = 0;
-  vector<PeakPtr> candidates
-   = secondDerivativePeakCanidatesWithROI( meas, lower_channel, upper_channel );
+  vector<PeakPtr> candidates = search_candidates( meas, drf );
   
 #if( PRINT_DEBUG_INFO_FOR_PEAK_SEARCH_FIT_LEVEL > 0 )
   {
@@ -559,9 +972,13 @@ vector<std::shared_ptr<const PeakDef> > search_for_peaks_singlethread(
       fitpeakvec.push_back( p );
   }//if( !!origpeaks )
   
+  const size_t num_candidates = candidates.size();
   
   while( !candidates.empty() )
   {
+    if( progress )
+      progress( num_candidates - candidates.size(), num_candidates );
+    
     size_t largest_index = 0;
     for( size_t i = 1; i < candidates.size(); ++i )
     {
@@ -614,6 +1031,9 @@ vector<std::shared_ptr<const PeakDef> > search_for_peaks_singlethread(
               &PeakDef::lessThanByMeanShrdPtr );
   }//while( !candidates.empty() )
   
+  if( progress )
+    progress( num_candidates, num_candidates );
+  
   if( highres )
     fitpeakvec = filter_anomolous_width_peaks_highres( meas, fitpeakvec );
   
@@ -625,14 +1045,15 @@ vector<std::shared_ptr<const PeakDef> > search_for_peaks(
                               const std::shared_ptr<const Measurement> meas,
                               const std::shared_ptr<const DetectorPeakResponse> drf,
                               std::shared_ptr<const deque< std::shared_ptr<const PeakDef> > > origpeaks,
-                              const bool singleThreaded  )
+                              const bool singleThreaded,
+                              const std::function<void(size_t,size_t)> &progress )
 {
   vector<std::shared_ptr<const PeakDef> > answer;
   
   if( singleThreaded )
-    answer = search_for_peaks_singlethread( meas, drf, origpeaks );
+    answer = search_for_peaks_singlethread( meas, drf, origpeaks, progress );
   else
-    answer = search_for_peaks_multithread( meas, drf, origpeaks );
+    answer = search_for_peaks_multithread( meas, drf, origpeaks, progress );
   
   return answer;
 }
@@ -707,42 +1128,148 @@ coeffs( bins_left + bins_right + 1, 0.0 )
 }//SavitzyGolayCoeffs constructor
 
 
+namespace
+{
+  /** Applies `NFilter` sets of Savitzy-Golay coefficients, that all share the same window, to
+   `input` in a single pass; `coeffs[i]` is applied to produce `outputs[i]`.
+   
+   The data is assumed flat on either end of the input.
+   
+   The channels within `num_left` or `num_right` of the ends need clamped indexes, so are done
+   the straightforward way; the interior channels are done in blocks, with the loop over channels
+   innermost, so the compiler can vectorize it, while each channels sum is still accumulated (in
+   double precision) in the same order as the straightforward way, so results are identical.
+   */
+  template<size_t NFilter>
+  void savitzy_golay_filter( const float * const input, const int nSamples,
+                             const int num_left, const int num_right,
+                             const double * const (&coeffs)[NFilter],
+                             float * const (&outputs)[NFilter] )
+  {
+    const int nCoeffs = num_left + num_right + 1;
+    
+    if( nSamples < nCoeffs || nSamples==0 )
+      throw runtime_error( "SavitzyGolayCoeffs::smooth(...)\n\tInvalid input size" );
+    
+    const auto edge_channel = [&]( const int pos ){
+      double sums[NFilter] = { 0.0 };
+      for( int coeff = 0; coeff < nCoeffs; ++coeff )
+      {
+        int dataInd = pos - num_left + coeff;
+        if( dataInd < 0 )
+          dataInd = 0;
+        else if( dataInd >= nSamples )
+          dataInd = nSamples-1;
+        
+        for( size_t filter = 0; filter < NFilter; ++filter )
+          sums[filter] += (coeffs[filter][coeff] * input[dataInd]);
+      }//for( loop over coefficients )
+      
+      for( size_t filter = 0; filter < NFilter; ++filter )
+        outputs[filter][pos] = static_cast<float>( sums[filter] );
+    };//edge_channel lambda
+    
+    const int interior_end = nSamples - num_right;
+    
+    for( int pos = 0; pos < num_left; ++pos )
+      edge_channel( pos );
+    
+    const int block_size = 64;
+    double sums[NFilter][block_size];
+    
+    for( int block_start = num_left; block_start < interior_end; block_start += block_size )
+    {
+      const int nblock = std::min( block_size, interior_end - block_start );
+      
+      for( size_t filter = 0; filter < NFilter; ++filter )
+        std::fill( sums[filter], sums[filter] + nblock, 0.0 );
+      
+      for( int coeff = 0; coeff < nCoeffs; ++coeff )
+      {
+        const float * const data = input + (block_start - num_left + coeff);
+        
+        for( size_t filter = 0; filter < NFilter; ++filter )
+        {
+          const double c = coeffs[filter][coeff];
+          double * const sum = sums[filter];
+          for( int i = 0; i < nblock; ++i )
+            sum[i] += c * data[i];
+        }
+      }//for( loop over coefficients )
+      
+      for( size_t filter = 0; filter < NFilter; ++filter )
+      {
+        for( int i = 0; i < nblock; ++i )
+          outputs[filter][block_start + i] = static_cast<float>( sums[filter][i] );
+      }
+    }//for( loop over blocks of interior channels )
+    
+    for( int pos = std::max(interior_end, num_left); pos < nSamples; ++pos )
+      edge_channel( pos );
+  }//savitzy_golay_filter(...)
+}//namespace
+
+
+std::shared_ptr<const SavitzyGolayCoeffs> SavitzyGolayCoeffs::cached( int bins_left,
+                                                                     int bins_right,
+                                                                     int order,
+                                                                     int derivative )
+{
+  typedef std::tuple<int,int,int,int> CoefKey_t;
+  static std::mutex s_cache_mutex;
+  static std::map<CoefKey_t,std::shared_ptr<const SavitzyGolayCoeffs>> s_cache;
+  
+  const CoefKey_t key{ bins_left, bins_right, order, derivative };
+  
+  {
+    std::lock_guard<std::mutex> lock( s_cache_mutex );
+    const auto pos = s_cache.find( key );
+    if( pos != end(s_cache) )
+      return pos->second;
+  }
+  
+  // We'll compute outside of the lock; if two threads race, both get valid, identical, coeffs.
+  auto coefs = make_shared<const SavitzyGolayCoeffs>( bins_left, bins_right, order, derivative );
+  
+  std::lock_guard<std::mutex> lock( s_cache_mutex );
+  
+  // Low resolution spectra choose `side_bins` based on the energy calibration, so in principle
+  //  there isnt a bound on the number of entries; be a little defensive against this.
+  if( s_cache.size() > 128 )
+    s_cache.clear();
+  
+  s_cache[key] = coefs;
+  
+  return coefs;
+}//SavitzyGolayCoeffs::cached(...)
+
+
 void SavitzyGolayCoeffs::smooth( const vector<float> &input,
                                 vector<float> &output ) const
 {
-  smooth( &(input[0]), static_cast<int>(input.size()), output );
+  smooth( input.data(), static_cast<int>(input.size()), output );
 }
 
 
 void SavitzyGolayCoeffs::smooth( const float *input,
                                 const int nSamples,
                                 vector<float> &output ) const
+{
+  output.resize( std::max(nSamples,0) );
+  smooth( input, nSamples, output.data() );
+}//SavitzyGolayCoeffs::smooth(...)
+
+
+void SavitzyGolayCoeffs::smooth( const float *input,
+                                const int nSamples,
+                                float *output ) const
 {
   //Performs the Savitzy-Golay filtering with provided coeffs.
   //This function assumes data is flat on either end of the input
-  output.clear();
-  output.resize( nSamples );
-  const int nCoeffs = static_cast<int>( coeffs.size() );
-  
-  if( nSamples < nCoeffs || nSamples==0 )
-    throw runtime_error( "SavitzyGolayCoeffs::smooth(...)\n\tInvalid input size" );
+  const double * const filter_coefs[1] = { coeffs.data() };
+  float * const filter_outputs[1] = { output };
   
-  for( int pos = 0; pos < nSamples; ++pos )
-  {
-    double sum = 0.0;
-    for( int coeff = 0; coeff < nCoeffs; ++coeff )
-    {
-      int dataInd = pos - num_left + coeff;
-      if( dataInd < 0 )
-        dataInd = 0;
-      else if( dataInd >= nSamples )
-        dataInd = nSamples-1;
-      
-      sum += (coeffs[coeff] * input[dataInd]);
-    }//for( loop over coefficients )
-    
-    output[pos] = sum;
-  }//for( loop over input points )
+  savitzy_golay_filter<1>( input, nSamples, num_left, num_right, filter_coefs, filter_outputs );
 }//SavitzyGolayCoeffs::smooth(...)
 
 std::vector< std::vector<std::shared_ptr<const PeakDef> > >
@@ -1522,9 +2049,9 @@ void smoothSpectrum( const std::vector<float> &spectrum, const int side_bins,
                     const int order, const int derivative,
                     std::vector<float> &results )
 {
-  results.clear();
-  SavitzyGolayCoeffs sgcoeffs( side_bins, side_bins, order, derivative );
-  sgcoeffs.smooth( spectrum, results );
+  const shared_ptr<const SavitzyGolayCoeffs> sgcoeffs
+                         = SavitzyGolayCoeffs::cached( side_bins, side_bins, order, derivative );
+  sgcoeffs->smooth( spectrum, results );
   
   //  if( derivative )
   //  {
@@ -1547,6 +2074,42 @@ void smoothSpectrum( std::shared_ptr<const Measurement> dataH,
 }//void smoothSpectrum(...)
 
 
+void smoothSpectrumAndSecondDerivative( const std::vector<float> &spectrum,
+                                        const int side_bins, const int order,
+                                        std::vector<float> &smoothed,
+                                        std::vector<float> &second_deriv )
+{
+  const shared_ptr<const SavitzyGolayCoeffs> smooth_coeffs
+                                   = SavitzyGolayCoeffs::cached( side_bins, side_bins, order, 0 );
+  const shared_ptr<const SavitzyGolayCoeffs> deriv_coeffs
+                                   = SavitzyGolayCoeffs::cached( side_bins, side_bins, order, 2 );
+  
+  const int nSamples = static_cast<int>( spectrum.size() );
+  smoothed.resize( spectrum.size() );
+  second_deriv.resize( spectrum.size() );
+  
+  const double * const filter_coefs[2] = { smooth_coeffs->coeffs.data(), deriv_coeffs->coeffs.data() };
+  float * const filter_outputs[2] = { smoothed.data(), second_deriv.data() };
+  
+  savitzy_golay_filter<2>( spectrum.data(), nSamples, side_bins, side_bins,
+                           filter_coefs, filter_outputs );
+}//void smoothSpectrumAndSecondDerivative(...)
+
+
+void smoothSpectrumAndSecondDerivative( std::shared_ptr<const Measurement> dataH,
+                                        const int side_bins, const int order,
+                                        std::vector<float> &smoothed,
+                                        std::vector<float> &second_deriv )
+{
+  smoothed.clear();
+  second_deriv.clear();
+  if( !dataH || !dataH->gamma_counts() )
+    return;
+  
+  smoothSpectrumAndSecondDerivative( *dataH->gamma_counts(), side_bins, order, smoothed, second_deriv );
+}//void smoothSpectrumAndSecondDerivative(...)
+
+
 
 std::vector<PeakDef> fitPeaksInRange( const double x0,
                                      const double x1,
@@ -1631,7 +2194,7 @@ std::vector<PeakDef> fitPeaksInRange( const double x0,
   
   //Fit each of the ranges
   vector< PeakVec > fit_peak_ranges( seperated_peaks.size() );
-  SpecUtilsAsync::ThreadPool threadpool;
+  SharedThreadPool::TaskGroup threadpool;
   //  vector< boost::function<void()> > fit_jobs( seperated_peaks.size() );
   for( size_t peakn = 0; peakn < seperated_peaks.size(); ++peakn )
   {
@@ -1695,32 +2258,77 @@ std::shared_ptr<Measurement> estimateContinuum( std::shared_ptr<const Measuremen
   if( !data )
     throw runtime_error( "estimateContinuum: invalid data" );
   
-  int smoothWindow = kBackSmoothing3;  //can be {3, 5, 7, 9, 11, 13, 15}
-  int filterOrder = 6; //can be {2, 4, 6, 8}
-  const int numIteration = 125; //can be from 1 to 500, roughle
-  const bool compton     = false;
-  const bool smoothing   = false;
-  const int direction    = kBackIncreasingWindow; //kBackDecreasingWindow
-  
-  const size_t nchannels = data->num_gamma_channels();
-  auto source = std::make_shared<vector<float>>( nchannels ) ;
+  const shared_ptr<const vector<float>> continuum = estimateContinuumCounts( data );
   
-  for( size_t i = 0; i < nchannels; ++i )
-    (*source)[i] = data->gamma_channel_content(i);
-
-  calculateContinuum( &(source->operator[](0)), nchannels, numIteration, direction,
-                     filterOrder, smoothing, smoothWindow, compton );
   auto background = make_shared<Measurement>();
   *background = *data;
   
-  assert( background->num_gamma_channels() == nchannels );
-  
-  background->set_gamma_counts( source, data->live_time(), data->real_time() );
+  if( continuum )
+  {
+    assert( background->num_gamma_channels() == continuum->size() );
+    background->set_gamma_counts( continuum, data->live_time(), data->real_time() );
+  }
   
   return background;
 }//std::shared_ptr<Measurement> estimateContinuum( std::shared_ptr<const Measurement> data )
 
 
+std::shared_ptr<const std::vector<float>> estimateContinuumCounts( const std::shared_ptr<const Measurement> &data )
+{
+  const int filterOrder = kBackOrder6; //can be {2, 4, 6, 8}
+  const int numIteration = 125; //can be from 1 to 500, roughle
+  const bool increasingWindow = true;
+  
+  // The continuum of a spectrum often gets asked for several times (auto-search, isotope ID,
+  //  display, detection limits, ...), and when batch-processing files its the same few
+  //  backgrounds over and over, so we keep a small LRU cache keyed on the channel contents.
+  const size_t max_cache_entries = 32;
+  
+  struct CachedContinuum
+  {
+    size_t hash;
+    shared_ptr<const vector<float>> counts;
+    shared_ptr<const vector<float>> continuum;
+  };//struct CachedContinuum
+  
+  static std::mutex s_cache_mutex;
+  static std::list<CachedContinuum> s_cache; //most recently used at front
+  
+  const shared_ptr<const vector<float>> counts = data ? data->gamma_counts() : nullptr;
+  if( !counts || counts->empty() )
+    return nullptr;
+  
+  const size_t hash = boost::hash_range( begin(*counts), end(*counts) );
+  
+  {
+    std::lock_guard<std::mutex> lock( s_cache_mutex );
+    for( auto iter = begin(s_cache); iter != end(s_cache); ++iter )
+    {
+      if( (iter->hash == hash)
+         && ((iter->counts == counts) || (*iter->counts == *counts)) )
+      {
+        s_cache.splice( begin(s_cache), s_cache, iter );
+        return s_cache.front().continuum;
+      }
+    }//for( loop over cache entries )
+  }
+  
+  // We'll compute outside of the lock; if two threads race, both get valid, identical, answers.
+  auto continuum = make_shared<vector<float>>( *counts );
+  
+  // If the spectrum is too short for the clipping window, we (historically) just returned the
+  //  data as the continuum.
+  snipContinuum( continuum->data(), continuum->size(), numIteration, filterOrder, increasingWindow );
+  
+  std::lock_guard<std::mutex> lock( s_cache_mutex );
+  s_cache.push_front( CachedContinuum{ hash, counts, continuum } );
+  while( s_cache.size() > max_cache_entries )
+    s_cache.pop_back();
+  
+  return continuum;
+}//estimateContinuumCounts(...)
+
+
 
 //chi2_for_region(...): gives the chi2 or a region of data, given
 //  the input peaks
@@ -2030,10 +2638,17 @@ PeakShrdVec refitPeaksThatShareROI( const std::shared_ptr<const Measurement> &da
 }//PeakShrdVec refitPeaksThatShareROI(...)
 
 
+/** Returns the chi2/dof of the peaks, and their continuums, to the data in the given range.
+ 
+ If `tabulated_gaussian` is true, peaks without skew use `PeakDists::gaussian_integral_tabulated(...)`
+ rather than evaluating erf exactly; this is intended for low-resolution spectra, where the
+ difference (~1E-10 relative) is irrelevant.
+ */
 double evaluate_chi2dof_for_range( const std::vector<PeakDef> &peaks,
                                   const std::shared_ptr<const Measurement> &dataH,
                                   const double startx,
-                                  const double endx )
+                                  const double endx,
+                                  const bool tabulated_gaussian = false )
 {
   const size_t lowerchannel = dataH->find_gamma_channel( startx );
   const size_t upperchannel = dataH->find_gamma_channel( endx );
@@ -2057,7 +2672,11 @@ double evaluate_chi2dof_for_range( const std::vector<PeakDef> &peaks,
       if( x1 < peaks[j].lowerX() || x0 > peaks[j].upperX() )
         continue;
       
-      y_pred += peaks[j].gauss_integral(x0, x1);
+      if( tabulated_gaussian && peaks[j].gausPeak() && (peaks[j].skewType() == PeakDef::SkewType::NoSkew) )
+        y_pred += peaks[j].amplitude()
+                  * PeakDists::gaussian_integral_tabulated( peaks[j].mean(), peaks[j].sigma(), x0, x1 );
+      else
+        y_pred += peaks[j].gauss_integral(x0, x1);
       
       if( !continuums.count( contptr ) )
       {
@@ -2185,8 +2804,7 @@ void find_roi_for_2nd_deriv_candidate(
   
 
   vector<float> smoothed, second_deriv;
-  smoothSpectrum( data, static_cast<int>(side_bins), order, 0, smoothed );
-  smoothSpectrum( data, static_cast<int>(side_bins), order, 2, second_deriv );
+  smoothSpectrumAndSecondDerivative( data, static_cast<int>(side_bins), order, smoothed, second_deriv );
   
   
   //This next part should be kept the same as in
@@ -2197,8 +2815,7 @@ void find_roi_for_2nd_deriv_candidate(
     
     const size_t index = (nchannel/15);
     vector<float> second_deriv_lower, smoothed_lower;
-    smoothSpectrum( data, 4, order, 0, smoothed_lower );
-    smoothSpectrum( data, 4, order, 2, second_deriv_lower );
+    smoothSpectrumAndSecondDerivative( data, 4, order, smoothed_lower, second_deriv_lower );
     
     for( size_t i = 0; i < (index-side_bins); ++i )
     {
@@ -3565,13 +4182,33 @@ bool check_lowres_single_peak_fit( const std::shared_ptr<const PeakDef> peak,
   const double sigma = peak->sigma();
   const double core_start = std::max( mean - fwhm, peak->lowerX() );
   const double core_end = std::min( mean + fwhm, peak->upperX() );
+  
+  // Before evaluating all the chi2s below, and fitting a line, see if the data can support having
+  //  a peak here at all; during automated searches most candidates get rejected right here.
+  const PeakScreenThresholds screen_thresholds = peak_screen_thresholds();
+  if( screen_thresholds.enabled && !peak->continuum()->externalContinuum() )
+  {
+    const LinearPeakScreen screen = linear_peak_screen( *peak, vector<PeakDef>(), *dataH,
+                                                        peak->lowerX(), peak->upperX() );
+    if( screen.valid
+       && ((screen.amplitude <= 0.0)
+           || (screen.likelihood_ratio < screen_thresholds.reject_below_likelihood_ratio)) )
+    {
+#if( PRINT_DEBUG_INFO_FOR_PEAK_SEARCH_FIT_LEVEL > 0 )
+      DebugLog(cout) << "check_lowres_single_peak_fit: Failed to fit a peak for the closed-form "
+           << "screen likelihood ratio being " << screen.likelihood_ratio << "\n";
+#endif
+      return false;
+    }
+  }//if( screen_thresholds.enabled )
       
   vector<PeakDef> fitpeaks( 1, *peak ), fitpeaksnoamp( 1, *peak );
   fitpeaksnoamp[0].setAmplitude( 0.0 );
+  // Low resolution spectra dont need exact erf evaluations, so use the tabulated Gaussian integral
   const double core_chi2dof = evaluate_chi2dof_for_range( fitpeaks,
-                                                             dataH, core_start, core_end );
+                                                             dataH, core_start, core_end, true );
   const double no_peak_chi2dof = evaluate_chi2dof_for_range( fitpeaksnoamp,
-                                                                dataH, core_start, core_end );
+                                                                dataH, core_start, core_end, true );
   
   if( (no_peak_chi2dof - core_chi2dof) < lowres_min_core_chi2dof_peak_improvment )
   {
@@ -3584,8 +4221,8 @@ bool check_lowres_single_peak_fit( const std::shared_ptr<const PeakDef> peak,
     return false;
   }//if( (no_peak_chi2dof - core_chi2dof) < 0.5 )
       
-  const double withpeakchi2dof = evaluate_chi2dof_for_range( fitpeaks, dataH, mean-sigma, mean+sigma );
-  const double withoutpeakschi2dof = evaluate_chi2dof_for_range( fitpeaksnoamp, dataH, mean-sigma, mean+sigma );
+  const double withpeakchi2dof = evaluate_chi2dof_for_range( fitpeaks, dataH, mean-sigma, mean+sigma, true );
+  const double withoutpeakschi2dof = evaluate_chi2dof_for_range( fitpeaksnoamp, dataH, mean-sigma, mean+sigma, true );
         
   //Isnt this just a duplicate of the above???
   if( !lowstatregion && withoutpeakschi2dof < (withpeakchi2dof+lowres_min_withinsigma_chi2dof_peak_improvment) )
@@ -5842,13 +6479,38 @@ double set_chi2_dof( std::shared_ptr<const Measurement> data,
       roigroups[fitpeaks[i].continuum()].push_back( &(fitpeaks[i]) );
   }
   
+  // Each ROI is independent, so when there are a number of them (e.g., the final fit of a whole
+  //  spectrum in batch peak fitting), evaluate them in parallel; the results are summed in the
+  //  same order either way, so the total DOF doesnt depend on the number of threads.
+  vector<const vector<PeakDef *> *> rois;
   for( auto i = begin(roigroups); i != end(roigroups); ++i )
+    rois.push_back( &(i->second) );
+  
+  vector<double> roi_chi2s( rois.size(), 0.0 ), roi_dofs( rois.size(), 0.0 );
+  
+  if( rois.size() > 2 )
   {
-    const vector<PeakDef *> &peakptrs = i->second;
+    SharedThreadPool::TaskGroup pool;
+    for( size_t i = 0; i < rois.size(); ++i )
+    {
+      pool.post( [i,&rois,&roi_chi2s,&roi_dofs,&data](){
+        get_chi2_and_dof_for_roi( roi_chi2s[i], roi_dofs[i], data, *rois[i] );
+      } );
+    }//for( size_t i = 0; i < rois.size(); ++i )
+    pool.join();
+  }else
+  {
+    for( size_t i = 0; i < rois.size(); ++i )
+      get_chi2_and_dof_for_roi( roi_chi2s[i], roi_dofs[i], data, *rois[i] );
+  }//if( rois.size() > 2 ) / else
+  
+  for( size_t roi_index = 0; roi_index < rois.size(); ++roi_index )
+  {
+    const vector<PeakDef *> &peakptrs = *rois[roi_index];
     assert( peakptrs.size() );
     
-    double chi2, dof;
-    get_chi2_and_dof_for_roi( chi2, dof, data, peakptrs );
+    const double chi2 = roi_chi2s[roi_index];
+    const double dof = roi_dofs[roi_index];
     
     totalDOF += dof;
     const double chi2Dof = chi2 / dof;
@@ -6254,36 +6916,36 @@ double fit_to_polynomial( const float *x, const float *data, const size_t nbin,
                                  std::vector<double> &coeff_uncerts )
 {
   //Using variable names of section 15.4 of Numerical Recipes, 3rd edition
-  //Implementation is quite inneficient
-  using namespace boost::numeric;
+  if( polynomial_order < 0 )
+    throw runtime_error( "fit_to_polynomial(...): invalid polynomial order" );
+  
   const int poly_terms = polynomial_order + 1;
-  ublas::matrix<double> A( nbin, poly_terms );
-  ublas::vector<double> b( nbin );
+  const size_t nterms = static_cast<size_t>( poly_terms );
+  
+  LinearLeastSquaresWorkspace &ws = linear_lsq_workspace();
+  ws.resize( nbin, nterms );
   
   for( size_t row = 0; row < nbin; ++row )
   {
     const double uncert = (data[row] > 0.0 ? sqrt( data[row] ) : 1.0);
-    b(row) = (data[row] > 0.0 ? sqrt( data[row] ) : 0.0);
+    ws.rhs[row] = (data[row] > 0.0 ? sqrt( data[row] ) : 0.0);
+    double * const design_row = &(ws.design[row*nterms]);
     for( int col = 0; col < poly_terms; ++col )
-      A(row,col) = std::pow( double(x[row]), double(col)) / uncert;
+      design_row[col] = std::pow( double(x[row]), double(col)) / uncert;
   }//for( int col = 0; col < poly_terms; ++col )
   
-  const ublas::matrix<double> A_transpose = ublas::trans( A );
-  const ublas::matrix<double> alpha = prod( A_transpose, A );
-  ublas::matrix<double> C( alpha.size1(), alpha.size2() );
-  const bool success = matrix_invert( alpha, C );
-  if( !success )
+  ws.formNormalEquations( nbin, nterms );
+  if( !ws.solveNormalEquations( nterms ) )
     throw runtime_error( "fit_to_polynomial(...): trouble inverting matrix" );
   
-  const ublas::vector<double> beta = prod( A_transpose, b );
-  const ublas::vector<double> a = prod( C, beta );
+  const double * const a = ws.solution.data();
   
   poly_coeffs.resize( poly_terms );
   coeff_uncerts.resize( poly_terms );
   for( int coef = 0; coef < poly_terms; ++coef )
   {
-    poly_coeffs[coef] = a(coef);
-    coeff_uncerts[coef] = std::sqrt( C(coef,coef) );
+    poly_coeffs[coef] = a[coef];
+    coeff_uncerts[coef] = std::sqrt( ws.covariance[coef*nterms + coef] );
   }//for( int coef = 0; coef < poly_terms; ++coef )
   
   double chi2 = 0;
@@ -6291,7 +6953,7 @@ double fit_to_polynomial( const float *x, const float *data, const size_t nbin,
   {
     double y_pred = 0.0;
     for( int i = 0; i < poly_terms; ++i )
-      y_pred += a(i) * std::pow( double(x[bin]), double(i) );
+      y_pred += a[i] * std::pow( double(x[bin]), double(i) );
     const double uncert = (data[bin] > 0.0 ? sqrt( data[bin] ) : 1.0);
     chi2 += std::pow( (y_pred - data[bin]) / uncert, 2.0 );
   }//for( int bin = 0; bin < nbin; ++bin )
@@ -6332,7 +6994,8 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
   
   //Using variable names of section 15.4 of Numerical Recipes, 3rd edition
   //
-  //Implementation is quite inefficient
+  //The design matrix, normal equations, and their solution use a per-thread workspace, so
+  //  repeated calls from within non-linear fits dont allocate memory.
   //
   //Current implementation is not necessarily numerically the most accurate or
   //  the best when there are near degeneracies.  Should switch to using SVD for
@@ -6341,34 +7004,13 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
   //When uncertainties are not needed (e.g., while fitting means), could save
   //  maybe a factor of three or so in computations.
   //
-  //Could use Eigen and do things a bit better, see
-  // https://eigen.tuxfamily.org/dox/group__LeastSquares.html
-  //
-  
-  
-//For experimentation to see how much all the allocations are actually slowing
-//  things done - horribly thread un-safe, and will explode if used from GUI!
-#define TRIAL_MINIMIZE_MATRIX_ALLOCATIONS 0
   
-  
-  using namespace boost::numeric;
   const size_t npeaks = sigmas.size();
   const size_t npoly = static_cast<size_t>( num_polynomial_terms );
-  const int nfit_terms = static_cast<int>( npoly + npeaks );
+  const size_t nfit_terms = npoly + npeaks;
   
-#if( TRIAL_MINIMIZE_MATRIX_ALLOCATIONS )
-#warning "TRIAL_MINIMIZE_MATRIX_ALLOCATIONS Is enabled - this will blow up if making an InterSpec GUI"
-  static ublas::matrix<double> A( nbin, nfit_terms );
-  static ublas::vector<double> b( nbin );
-  
-  if( A.size1() != nbin || A.size2() != nfit_terms )
-    A.resize( nbin, nfit_terms, false );
-  if( b.size() != nbin )
-    b.resize( nbin, false );
-#else
-  ublas::matrix<double> A( nbin, nfit_terms );
-  ublas::vector<double> b( nbin );
-#endif
+  LinearLeastSquaresWorkspace &ws = linear_lsq_workspace();
+  ws.resize( nbin, nfit_terms );
   
   //  cerr << endl << "Input: " << ref_energy << ", ";
   //  for( size_t i = 0; i < npeaks; ++i )
@@ -6398,7 +7040,8 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
   //
   const size_t nfixedpeak = fixedAmpPeaks.size();
   const bool do_mt_fixed_peak = (nfixedpeak > 4); // 4 chosen arbitrarily
-  vector<double> mt_fixed_peak_contrib( do_mt_fixed_peak ? nbin : size_t(0), 0.0f );
+  vector<double> &mt_fixed_peak_contrib = ws.fixed_peak_counts;
+  mt_fixed_peak_contrib.assign( do_mt_fixed_peak ? nbin : size_t(0), 0.0 );
   
   //peak.gauss_integral( const float * const energies, double *channels, const size_t nchannel )
   if( do_mt_fixed_peak )
@@ -6406,7 +7049,7 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
     const size_t nthread = std::thread::hardware_concurrency();
     double * const fixed_contrib = &(mt_fixed_peak_contrib[0]);
     
-    SpecUtilsAsync::ThreadPool pool;
+    SharedThreadPool::TaskGroup pool;
     
     // 20240325: for complicated problems, it kinda looks like multiple cores arent being used that
     //           efficiently (perhaps because each thread is only getting <10 channels to work on).
@@ -6499,8 +7142,9 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
       }
     }//if( do_mt_fixed_peak )
     
-    b(row) = ((dataval > 0.0 ? dataval : 0.0) / uncert);
+    ws.rhs[row] = ((dataval > 0.0 ? dataval : 0.0) / uncert);
     
+    double * const design_row = &(ws.design[row*nfit_terms]);
     for( size_t col = 0; col < npoly; ++col )
     {
       const double exp = col + 1.0;
@@ -6514,7 +7158,7 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
         const double frac_data = (step_cumulative_data - 0.5*data[row]) / step_roi_data_sum;
         const double contribution = frac_data * (x1 - x0);
         
-        A(row,col) = contribution / uncert;
+        design_row[col] = contribution / uncert;
       }else if( step_continuum && (num_polynomial_terms == 4) )
       {
         const double frac_data = (step_cumulative_data - 0.5*data[row]) / step_roi_data_sum;
@@ -6529,12 +7173,12 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
           default: assert( 0 ); break;
         }//switch( col )
         
-        A(row,col) = contrib / uncert;
+        design_row[col] = contrib / uncert;
       }else
       {
         const double contribution = (1.0/exp) * (pow(x1_rel,exp) - pow(x0_rel,exp));
         
-        A(row,col) = contribution / uncert;
+        design_row[col] = contribution / uncert;
       }
     }//for( int order = 0; order < maxorder; ++order )
   }//for( size_t row = 0; row < nbin; ++row )
@@ -6543,12 +7187,13 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
   // If we have more than 2 peaks (arbitrarily chosen), we'll compute the peak contributions
   //  in parallel.
   //  TODO: investigate performance impact of computing peak integrals multithread - e.g., should we do this only if a skew is being used?  Or if we have more than X peaks, etc.
-  vector<double> unit_peak_counts( nbin * npeaks, 0.0 );
+  vector<double> &unit_peak_counts = ws.peak_counts;
+  unit_peak_counts.assign( nbin * npeaks, 0.0 );
   
   const bool parallelize_peak_sum = (npeaks > 2);
   if( parallelize_peak_sum )
   {
-    SpecUtilsAsync::ThreadPool pool;
+    SharedThreadPool::TaskGroup pool;
     for( size_t i = 0; i < npeaks; ++i )
     {
       double *peak_areas = &(unit_peak_counts[i*nbin]);
@@ -6578,99 +7223,13 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
     {
       const double dataval = data[channel];
       const double uncert = (dataval > 0.0 ? sqrt(dataval) : 1.0);
-      A(channel,npoly + i) = peak_areas[channel] / uncert;
+      ws.design[channel*nfit_terms + npoly + i] = peak_areas[channel] / uncert;
     }//for( size_t channel = 0; channel < nbin; ++channel )
   }//for( size_t i = 0; i < npeaks; ++i )
   
-#if( TRIAL_MINIMIZE_MATRIX_ALLOCATIONS )
-  const ublas::matrix<double> A_transpose = ublas::trans( A );
-  static ublas::matrix<double> alpha;
-  
-  if( alpha.size1() != A.size2() )
-    alpha.resize( A.size2(), A.size2(), false );
+  ws.formNormalEquations( nbin, nfit_terms );
   
-  prod( A_transpose, A, alpha );
-  
-  static ublas::matrix<double> C;
-  if( C.size1() != alpha.size1() || C.size2() != alpha.size2() )
-    C.resize( alpha.size1(), alpha.size2(), false );
-#else
-  const ublas::matrix<double> A_transpose = ublas::trans( A );
-  const ublas::matrix<double> alpha = prod( A_transpose, A );
-  ublas::matrix<double> C( alpha.size1(), alpha.size2() );
-#endif
-  
-  bool success = false;
-  
-  try
-  {
-    //See http://viennacl.sourceforge.net/doc/least-squares_8cpp-example.html#a8 for example
-    //  of better solving things following the below commented out lines
-    //typedef boost::numeric::ublas::matrix<double>              MatrixType;
-    //typedef boost::numeric::ublas::vector<double>              VectorType;
-    //boost::numeric::ublas::range ublas_range(0, 3);
-    //boost::numeric::ublas::matrix_range<MatrixType> ublas_R(ublas_A, ublas_range, ublas_range);
-    //boost::numeric::ublas::vector_range<VectorType> ublas_b2(ublas_b, ublas_range);
-    //boost::numeric::ublas::inplace_solve(ublas_R, ublas_b2, boost::numeric::ublas::upper_tag());
-
-#if( TRIAL_MINIMIZE_MATRIX_ALLOCATIONS )
-    static boost::numeric::ublas::matrix<double> local_alpha;
-    if( local_alpha.size1() != alpha.size1() || local_alpha.size2() != alpha.size2() )
-      local_alpha.resize( alpha.size1(), alpha.size2());
-    local_alpha.assign( alpha );
-    
-    ublas::permutation_matrix<std::size_t> pm( local_alpha.size1() );
-    //if( pm.size() != local_alpha.size1() )
-    //  pm.resize( local_alpha.size1(), false );
-    
-    const size_t res = boost::numeric::ublas::lu_factorize(local_alpha, pm);
-    //const size_t res = boost::numeric::ublas::axpy_lu_factorize(local_alpha, pm);  //sometimes faster?
-    success = (res == 0);
-    if( success )
-    {
-      C.assign( boost::numeric::ublas::identity_matrix<double>( local_alpha.size1() ) );
-      lu_substitute(local_alpha, pm, C);
-    }
-#else
-    success = matrix_invert( alpha, C );
-#endif
-  }catch( std::exception &e )
-  {
-    cerr << "fit_amp_and_offset(...): caught: " << e.what() << endl;
-    cerr << "For means = {";
-    for( double m : means )
-      cerr << m << ", ";
-    cerr << "}, sigmas={";
-    for( double m : sigmas )
-      cerr << m << ", ";
-    cerr << "}" << endl;
-    
-    printf( "b=" );
-    for( size_t row = 0; row < b.size(); ++row )
-      printf( "%.2f, ", b(row) );
-    printf( "\n" );
-    
-    printf( "Alpha=\n" );
-    for( size_t row = 0; row < alpha.size1(); ++row )
-    {
-      for( size_t col = 0; col < alpha.size2(); ++col )
-        printf( "%12.2f, ", alpha(row,col) );
-      printf( "\n" );
-    }
-    printf( "\n" );
-    
-    
-    printf( "\nC=\n" );
-    for( size_t row = 0; row < C.size1(); ++row )
-    {
-      for( size_t col = 0; col < C.size2(); ++col )
-        printf( "%12.2f, ", C(row,col) );
-      printf( "\n" );
-    }
-    printf( "\n\n\n" );
-  }//try / catch
-  
-  if( !success )
+  if( !ws.solveNormalEquations( nfit_terms ) )
   {
     cerr << "For means = {";
     for( double m : means )
@@ -6680,17 +7239,17 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
       cerr << m << ", ";
     cerr << "}" << endl;
     throw runtime_error( "fit_amp_and_offset(...): trouble inverting matrix" );
-  }
+  }//if( !ws.solveNormalEquations( nfit_terms ) )
   
-  const ublas::vector<double> beta = prod( A_transpose, b );
-  const ublas::vector<double> a = prod( C, beta );
+  const double * const a = ws.solution.data();
+  const double * const C = ws.covariance.data();
   
   continuum_coeffs.resize( npoly );
   continuum_coeffs_uncerts.resize( npoly );
   for( size_t coef = 0; coef < npoly; ++coef )
   {
-    continuum_coeffs[coef] = a(coef);
-    continuum_coeffs_uncerts[coef] = std::sqrt( C(coef,coef) );
+    continuum_coeffs[coef] = a[coef];
+    continuum_coeffs_uncerts[coef] = std::sqrt( C[coef*nfit_terms + coef] );
   }//for( int coef = 0; coef < poly_terms; ++coef )
   
   amplitudes.resize( npeaks );
@@ -6699,8 +7258,8 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
   for( size_t i = 0; i < npeaks; ++i )
   {
     const size_t coef = npoly + i;
-    amplitudes[i] = a(coef);
-    amplitudes_uncerts[i] = std::sqrt( C(coef,coef) );
+    amplitudes[i] = a[coef];
+    amplitudes_uncerts[i] = std::sqrt( C[coef*nfit_terms + coef] );
   }//for( size_t i = 0; i < npeaks; ++i )
   
   double chi2 = 0;
@@ -6736,7 +7295,7 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
         const double frac_data = (step_cumulative_data - 0.5*data[bin]) / step_roi_data_sum;
         const double contribution = frac_data * (x1 - x0);
         
-        y_pred += a(col)*contribution;
+        y_pred += a[col]*contribution;
       }else if( step_continuum && (num_polynomial_terms == 4) )
       {
         // This logic mirrors that of PeakContinuum::offset_integral(...) and above code in this
@@ -6754,10 +7313,10 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
           default: assert( 0 ); break;
         }//switch( col )
         
-        y_pred += a(col) * contrib;
+        y_pred += a[col] * contrib;
       }else
       {
-        y_pred += a(col) * (1.0/exp) * (pow(x1_rel,exp) - pow(x0_rel,exp));
+        y_pred += a[col] * (1.0/exp) * (pow(x1_rel,exp) - pow(x0_rel,exp));
       }//if( step_continuum ) / else
     }//for( int order = 0; order < maxorder; ++order )
     
@@ -6767,7 +7326,7 @@ double fit_amp_and_offset( const float *x, const float *data, const size_t nbin,
     for( size_t i = 0; i < npeaks; ++i )
     {
       const size_t col = npoly + i;
-      y_pred += a(col) * PeakDists::gaussian_integral( means[i], sigmas[i], x0, x1 );
+      y_pred += a[col] * PeakDists::gaussian_integral( means[i], sigmas[i], x0, x1 );
     }
     
     for( size_t i = 0; i < fixedAmpPeaks.size(); ++i )
@@ -6820,15 +7379,6 @@ bool chi2_significance_test( PeakDef peak,
   }//switch( peak.continuum()->type() )
   
   
-  if( !isStepContinuum )
-  {
-    double ux = peak.upperX();
-    double lx = peak.lowerX();
-    ux = std::min( ux, peak.mean() + 2.5*peak.sigma() );
-    lx = std::max( lx, peak.mean() - 2.5*peak.sigma() );
-    peak.continuum()->setRange( lx, ux );
-  }//if( !isStepContinuum )
-  
   //For section of code below here, please see notes in searchForPeaks()
   std::vector<PeakDef>::iterator pos = other_peaks.end();
   for( size_t i = 0; i < other_peaks.size(); ++i )
@@ -6865,6 +7415,48 @@ bool chi2_significance_test( PeakDef peak,
     if( peak.fitFor(PeakDef::CoefficientType::Sigma) && ((peak.sigma() <= 0.0)) )
       return false;
   }//if( peak.gausPeak() )
+  
+  // Before building up the PeakFitChi2Fcn parameters and evaluating it, do a closed-form solve
+  //  for the peak amplitude and a linear continuum over the whole ROI; if this makes clear the
+  //  data either doesnt support a peak here, or very clearly does, we can skip the full test.
+  //  Only borderline candidates get the full evaluation.
+  const bool noDeltaTestRequired = ((withoutPeakDSigma <= 0.0) && (chi2ratioRequired <= 0.0));
+  const PeakScreenThresholds screen_thresholds = peak_screen_thresholds();
+  if( screen_thresholds.enabled && !noDeltaTestRequired && data
+     && !peak.continuum()->externalContinuum() )
+  {
+    const LinearPeakScreen screen = linear_peak_screen( peak, other_peaks, *data,
+                                                        peak.lowerX(), peak.upperX() );
+    if( screen.valid )
+    {
+      if( (screen.amplitude <= 0.0)
+         || (screen.likelihood_ratio < screen_thresholds.reject_below_likelihood_ratio) )
+        return false;
+      
+      // To accept without the full test, the peaks amplitude must also be consistent with the
+      //  best-fit amplitude (the full test evaluates the peak as given), and the continuum must
+      //  not have a step (which a linear continuum cant represent).
+      const double dof = std::max( 1.0, static_cast<double>(screen.nchannel) - 3.0 );
+      const double chi2_ratio = screen.chi2_without_peak / std::max( screen.chi2_with_peak, 1.0 );
+      if( !isStepContinuum
+         && (screen.likelihood_ratio > screen_thresholds.accept_above_likelihood_ratio)
+         && (peak.amplitude() > 0.5*screen.amplitude)
+         && (peak.amplitude() < 2.0*screen.amplitude)
+         && ((screen.likelihood_ratio/dof) > withoutPeakDSigma)
+         && ((chi2_ratio >= chi2ratioRequired) || ((screen.chi2_without_peak/dof) < 5.0)) )
+        return true;
+    }//if( screen.valid )
+  }//if( screen_thresholds.enabled && ... )
+  
+  
+  if( !isStepContinuum )
+  {
+    double ux = peak.upperX();
+    double lx = peak.lowerX();
+    ux = std::min( ux, peak.mean() + 2.5*peak.sigma() );
+    lx = std::max( lx, peak.mean() - 2.5*peak.sigma() );
+    peak.continuum()->setRange( lx, ux );
+  }//if( !isStepContinuum )
           
   vector<double> paramsForOtherPeaks, zeroPeakParams, paramsForPeak;
           
@@ -7010,9 +7602,9 @@ size_t AutoPeakSearchChi2Fcn::num_initial_candidate_peaks() const { return m_num
 
 void AutoPeakSearchChi2Fcn::second_derivative( const vector<float> &input, vector<float> &results )
 {
-  results.clear();
-  SavitzyGolayCoeffs sgcoeffs( m_side_bins, m_side_bins, m_smooth_order, 2 );
-  sgcoeffs.smooth( &(input[0]), input.size(), results );
+  const shared_ptr<const SavitzyGolayCoeffs> sgcoeffs
+                       = SavitzyGolayCoeffs::cached( m_side_bins, m_side_bins, m_smooth_order, 2 );
+  sgcoeffs->smooth( input.data(), static_cast<int>(input.size()), results );
 }//void smoothSpectrum(...)
 
 
@@ -7036,8 +7628,9 @@ std::vector<PeakDef> AutoPeakSearchChi2Fcn::candidate_peaks( const vector<float>
   
   {
     vector<float> results;
-    SavitzyGolayCoeffs sgcoeffs( m_side_bins, m_side_bins, m_smooth_order, 0 );
-    sgcoeffs.smooth( &(channel_counts[0]), static_cast<int>(channel_counts.size()), results );
+    const shared_ptr<const SavitzyGolayCoeffs> sgcoeffs
+                       = SavitzyGolayCoeffs::cached( m_side_bins, m_side_bins, m_smooth_order, 0 );
+    sgcoeffs->smooth( channel_counts.data(), static_cast<int>(channel_counts.size()), results );
     
 #if( WRITE_CANDIDATE_PEAK_INFO_TO_FILE )
     ofstream fileout( "smoothout.csv" );
@@ -7816,7 +8409,7 @@ double AutoPeakSearchChi2Fcn::pars_to_peaks( std::vector<PeakDef> &resultpeaks,
   
   size_t peakn = 0;
   
-  SpecUtilsAsync::ThreadPool pool;
+  SharedThreadPool::TaskGroup pool;
   
   for( size_t group = 0; group < m_grouped_candidates.size(); ++group )
   {
@@ -8179,6 +8772,10 @@ std::vector<PeakDef> search_for_peaks( const std::shared_ptr<const Measurement>
 #endif
 )
 {
+  INTERSPEC_TRACE_SCOPE( "search_for_peaks" );
+  static ServerMetrics::Histogram &fit_durations = ServerMetrics::histogram( "interspec_fit_duration_seconds",
+                                            "Time taken by analysis fits and searches.", "type=\"peak_search\"" );
+  const ServerMetrics::ScopedLatency fit_latency( fit_durations );
   
   vector<PeakDef> finalpeaks;
   
@@ -8758,6 +9355,114 @@ std::vector<PeakDef> search_for_peaks( const std::shared_ptr<const Measurement>
 }//namespace ExperimentalPeakSearch
         
 
+namespace
+{
+  /** One clipping pass of snipContinuum(...) for a half-window of `w` channels: sets `dest[j]` to
+   the smaller of `src[j]` and the largest of the filter estimates up to `order`, for
+   w <= j < nchannels - w.
+   
+   The same floating point operations are done, in the same order, as calculateContinuum(...), so
+   results are identical.  `src` and `dest` must not overlap (the `__restrict` lets the compiler
+   vectorize without having to check for this at run time).
+   */
+  template<int order>
+  void snip_clip_pass( const float * __restrict src, float * __restrict dest,
+                       const ptrdiff_t w, const ptrdiff_t nchannels )
+  {
+    static_assert( (order == kBackOrder2) || (order == kBackOrder4)
+                   || (order == kBackOrder6) || (order == kBackOrder8), "Invalid order" );
+    
+    const ptrdiff_t c1 = w / 2, d1 = w / 3, e1 = w / 4;
+    const ptrdiff_t c2 = 2*c1, d2 = 2*d1, d3 = 3*d1, e2 = 2*e1, e3 = 3*e1, e4 = 4*e1;
+    
+    for( ptrdiff_t j = w; j < (nchannels - w); ++j )
+    {
+      float b = (src[j - w] + src[j + w]) * 0.5f;
+      
+      if( order >= kBackOrder8 )
+      {
+        float e = 0;
+        e -= src[j - e4] / 70;
+        e += 8 * src[j - e3] / 70;
+        e -= 28 * src[j - e2] / 70;
+        e += 56 * src[j - e1] / 70;
+        e += 56 * src[j + e1] / 70;
+        e -= 28 * src[j + e2] / 70;
+        e += 8 * src[j + e3] / 70;
+        e -= src[j + e4] / 70;
+        b = std::max( b, e );
+      }//if( order >= kBackOrder8 )
+      
+      if( order >= kBackOrder6 )
+      {
+        float d = 0;
+        d += src[j - d3] / 20;
+        d -= 6 * src[j - d2] / 20;
+        d += 15 * src[j - d1] / 20;
+        d += 15 * src[j + d1] / 20;
+        d -= 6 * src[j + d2] / 20;
+        d += src[j + d3] / 20;
+        b = std::max( b, d );
+      }//if( order >= kBackOrder6 )
+      
+      if( order >= kBackOrder4 )
+      {
+        float c = 0;
+        c -= src[j - c2] / 6;
+        c += 4 * src[j - c1] / 6;
+        c += 4 * src[j + c1] / 6;
+        c -= src[j + c2] / 6;
+        b = std::max( b, c );
+      }//if( order >= kBackOrder4 )
+      
+      dest[j] = std::min( src[j], b );
+    }//for( loop over channels )
+  }//snip_clip_pass(...)
+}//namespace
+
+
+const char *snipContinuum( float *spectrum, const size_t nchannels, const int maxWindow,
+                           const int filterOrder, const bool increasingWindow )
+{
+  // This is the same clipping as calculateContinuum(...) does without smoothing or Compton edge
+  //  estimation, and gives identical results; the difference is that all the per-channel
+  //  branching is hoisted out of the channel loop, so each pass vectorizes.
+  if( !nchannels || (nchannels > static_cast<size_t>(std::numeric_limits<int>::max())) )
+    return "Wrong Parameters";
+  if( maxWindow < 1 )
+    return "Width of Clipping Window Must Be Positive";
+  if( nchannels < (2 * static_cast<size_t>(maxWindow) + 1) )
+    return "Too Large Clipping Window";
+  
+  void (*clip_pass)( const float *, float *, const ptrdiff_t, const ptrdiff_t ) = nullptr;
+  switch( filterOrder )
+  {
+    case kBackOrder2: clip_pass = &snip_clip_pass<kBackOrder2>; break;
+    case kBackOrder4: clip_pass = &snip_clip_pass<kBackOrder4>; break;
+    case kBackOrder6: clip_pass = &snip_clip_pass<kBackOrder6>; break;
+    case kBackOrder8: clip_pass = &snip_clip_pass<kBackOrder8>; break;
+    default:
+      return "Invalid filter order";
+  }//switch( filterOrder )
+  
+  static thread_local vector<float> s_working_space;
+  s_working_space.resize( nchannels );
+  float * const working = s_working_space.data();
+  
+  const ptrdiff_t ssize = static_cast<ptrdiff_t>( nchannels );
+  
+  for( int window = (increasingWindow ? 1 : maxWindow);
+      increasingWindow ? (window <= maxWindow) : (window >= 1);
+      window += (increasingWindow ? 1 : -1) )
+  {
+    clip_pass( spectrum, working, window, ssize );
+    std::copy( working + window, working + (ssize - window), spectrum + window );
+  }//for( loop over clipping windows )
+  
+  return nullptr;
+}//const char *snipContinuum(...)
+
+
 const char *calculateContinuum( float *spectrum, int ssize,
                                int numberIterations,
                                int direction, int filterOrder,
@@ -9614,8 +10319,10 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
   
   i = (int)(7 * sigma + 0.5);
   i = 2 * i;
-  double *working_space = new double [7 * (ssize + i)];
-  for (j=0;j<7 * (ssize + i);j++) working_space[j] = 0;
+  // The working space is kept per-thread, so repeated calls dont allocate.
+  static thread_local std::vector<double> s_working_space;
+  s_working_space.assign( 7 * (ssize + i), 0.0 );
+  double * const working_space = &(s_working_space[0]);
   for(i = 0; i < size_ext; i++){
     if(i < shift){
       a = i - shift;
@@ -9637,17 +10344,16 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
   
   if(backgroundRemove == true){
     for(i = 1; i <= numberIterations; i++){
-      for(j = i; j < size_ext - i; j++){
-        if(markov == false){
-          a = working_space[size_ext + j];
-          b = (working_space[size_ext + j - i] + working_space[size_ext + j + i]) / 2.0;
-          if(b < a)
-            a = b;
-          
-          working_space[j]=a;
-        }
-        
-        else{
+      if(markov == false){
+        // Branch-free clipping over contiguous memory, so this can be vectorized; gives identical
+        //  results to the original `if(b < a) a = b;` formulation.
+        const double * const in = working_space + size_ext;
+        double * const out = working_space;
+        const int jend = size_ext - i;
+        for(j = i; j < jend; j++)
+          out[j] = std::min( in[j], 0.5*(in[j - i] + in[j + i]) );
+      }else{
+        for(j = i; j < size_ext - i; j++){
           a = working_space[size_ext + j];
           av = 0;
           men = 0;
@@ -9681,7 +10387,7 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
             av = b;
           working_space[j]=av;
         }
-      }
+      }//if(markov == false) / else
       for(j = i; j < size_ext - i; j++)
       working_space[size_ext + j] = working_space[j];
     }
@@ -9724,7 +10430,6 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
       plocha += working_space[2 * size_ext + i];
     }
     if(maxch == 0) {
-      delete [] working_space;
       fPositionX.clear();
       return fPositionX;;
     }
@@ -9783,13 +10488,11 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
     }
     if(backgroundRemove == true){
       for(i = 1; i <= numberIterations; i++){
-        for(j = i; j < size_ext - i; j++){
-          a = working_space[size_ext + j];
-          b = (working_space[size_ext + j - i] + working_space[size_ext + j + i]) / 2.0;
-          if(b < a)
-            a = b;
-          working_space[j] = a;
-        }
+        const double * const in = working_space + size_ext;
+        double * const out = working_space;
+        const int jend = size_ext - i;
+        for(j = i; j < jend; j++)
+          out[j] = std::min( in[j], 0.5*(in[j - i] + in[j + i]) );
         for(j = i; j < size_ext - i; j++)
         working_space[size_ext + j] = working_space[j];
       }
@@ -9867,6 +10570,7 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
   for(i = 0; i < size_ext; i++)
   working_space[i] = 1;
   //START OF ITERATIONS
+  const double * const toeplitz = working_space + lh_gold - 1 + size_ext;
   for(lindex = 0; lindex < deconIterations; lindex++){
     for(i = 0; i < size_ext; i++){
       if(fabs(working_space[2 * size_ext + i]) > 0.00001 && fabs(working_space[i]) > 0.00001){
@@ -9880,11 +10584,9 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
         if(jmax > (size_ext - 1 - i))
           jmax=size_ext-1-i;
         
-        for(j = jmin; j <= jmax; j++){
-          ldb = working_space[j + lh_gold - 1 + size_ext];
-          ldc = working_space[i + j];
-          lda = lda + ldb * ldc;
-        }
+        const double * const x = working_space + i;
+        for(j = jmin; j <= jmax; j++)
+          lda += toeplitz[j] * x[j];
         ldb = working_space[2 * size_ext + i];
         if(lda != 0)
           lda = ldb / lda;
@@ -9897,9 +10599,15 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
         working_space[3 * size_ext + i] = lda;
       }
     }
+    // If an iteration didnt change anything, we have reached the fixed point, and all further
+    //  iterations would give this same answer, so we can stop early.
+    bool changed = false;
     for(i = 0; i < size_ext; i++){
+      changed |= (working_space[i] != working_space[3 * size_ext + i]);
       working_space[i] = working_space[3 * size_ext + i];
     }
+    if( !changed )
+      break;
   }
   //shift resulting spectrum
   for(i=0;i<size_ext;i++){
@@ -9976,7 +10684,6 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
   }
   
   for(i = 0; i < ssize; i++) destVector[i] = working_space[i + shift];
-  delete [] working_space;
   
   if(peak_index == fMaxPeaks)
     cerr << "findPeaksByRelaxation(...)\n\tPeak buffer full" << endl;
@@ -9987,6 +10694,51 @@ vector<float> findPeaksByRelaxation( float *source,float *destVector, int ssize,
 }//vector<float> findPeaksByRelaxation(...)
 
 
+vector<float> findPeaksByRelaxation( const std::shared_ptr<const SpecUtils::Measurement> &data,
+                                     std::vector<float> &dest,
+                                     float sigma, double threshold,
+                                     bool bckgrndRemove, int nIterations,
+                                     bool markov, int averWindow,
+                                     const bool limitToSpectroscopicExtent )
+{
+  dest.clear();
+  
+  const shared_ptr<const vector<float>> counts = data ? data->gamma_counts() : nullptr;
+  if( !counts || counts->empty() )
+    return vector<float>();
+  
+  const size_t nchannel = counts->size();
+  size_t lower_channel = 0, upper_channel = nchannel - 1;
+  if( limitToSpectroscopicExtent
+     && !ExperimentalPeakSearch::find_spectroscopic_extent( data, lower_channel, upper_channel ) )
+  {
+    lower_channel = 0;
+    upper_channel = nchannel - 1;
+  }
+  
+  upper_channel = std::min( upper_channel, nchannel - 1 );
+  if( lower_channel > upper_channel )
+    return vector<float>();
+  
+  // The relaxation works in-place on its input, so we need a copy of the counts regardless
+  vector<float> source( begin(*counts) + lower_channel, begin(*counts) + upper_channel + 1 );
+  vector<float> subdest( source.size(), 0.0f );
+  
+  vector<float> positions = findPeaksByRelaxation( &(source[0]), &(subdest[0]),
+                                                   static_cast<int>(source.size()), sigma,
+                                                   threshold, bckgrndRemove, nIterations,
+                                                   markov, averWindow );
+  
+  dest.resize( nchannel, 0.0f );
+  std::copy( begin(subdest), end(subdest), begin(dest) + lower_channel );
+  
+  for( float &pos : positions )
+    pos += static_cast<float>( lower_channel );
+  
+  return positions;
+}//vector<float> findPeaksByRelaxation(...)
+
+
 
 
 
@@ -26,6 +26,7 @@
 // Block out some warnings occurring in boost files.
 #pragma warning(disable:4800) // warning C4800: 'int' : forcing value to bool 'true' or 'false' (performance warning)
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <iostream>
@@ -38,6 +39,7 @@
 
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PeakFit.h"
+#include "InterSpec/PeakDists.h"
 #include "SpecUtils/SpecFile.h"
 #include "InterSpec/SpectrumChart.h"
 #include "InterSpec/PeakFitChi2Fcn.h"
@@ -332,6 +334,18 @@ void PeakFitChi2Fcn::parametersToPeaks( std::vector<PeakDef> &peaks,
       PeakContinuum::OffsetType offset = continuumInfoToOffsetType( contInfo );
       const double lowx = these_params[RangeStartEnergy];
       const double highx = these_params[RangeEndEnergy];
+      
+      //If `peaks` is being re-used, this peak may still point to the continuum of a peak it
+      //  previously shared with; we dont want to modify that peaks continuum.
+      for( int prevpeakn = 0; prevpeakn < peakn; ++prevpeakn )
+      {
+        if( peaks[prevpeakn].continuum() == candidate_peak.continuum() )
+        {
+          candidate_peak.makeUniqueNewContinuum();
+          break;
+        }
+      }//for( int prevpeakn = 0; prevpeakn < peakn; ++prevpeakn )
+      
       std::shared_ptr<PeakContinuum> continuum = candidate_peak.continuum();
       continuum->setRange( lowx, highx );
       continuum->setType( offset );
@@ -460,6 +474,12 @@ double PeakFitChi2Fcn::evalMultiPeakPunishment( const vector<const PeakDef *> &p
 
 
 double PeakFitChi2Fcn::chi2( const double *params ) const
+{
+  return chi2( params, m_workingPeaks );
+}//double chi2( const double *params ) const
+
+
+double PeakFitChi2Fcn::chi2( const double *params, std::vector<PeakDef> &peaks ) const
 {
   assert( m_data );
   if( m_continium )
@@ -473,7 +493,7 @@ double PeakFitChi2Fcn::chi2( const double *params ) const
     const double p = params[i];
     if( IsInf(p) || IsNan(p) )
     {
-      static int ncalls = 0;
+      static std::atomic<int> ncalls( 0 );
       if( ncalls++ < 10 )
         cerr << "\nPeakFitChi2Fcn::chi2(...): received invalid "
              << "input parameter " << i << endl;
@@ -485,7 +505,6 @@ double PeakFitChi2Fcn::chi2( const double *params ) const
   int num_effective_bins = 0;
   
 //  vector<double> gaussians( nbin, 0.0 );
-  std::vector<PeakDef> peaks;
   parametersToPeaks( peaks, params );
   
   typedef map< std::shared_ptr<const PeakContinuum>, vector<const PeakDef *> > ContToPeakMap_t;
@@ -596,6 +615,224 @@ double PeakFitChi2Fcn::chi2( const double *params ) const
 }//double chi2( const std::vector<double>& params ) const
 
 
+vector<double> PeakFitChi2Fcn::Gradient( const vector<double> &x ) const
+{
+  return Gradient( x, m_workingPeaks );
+}//vector<double> Gradient( const vector<double> &x ) const
+
+
+vector<double> PeakFitChi2Fcn::Gradient( const vector<double> &x, std::vector<PeakDef> &peaks ) const
+{
+  assert( m_data );
+  
+  const size_t nfitpar = static_cast<size_t>( m_npeaks * NumFitPars );
+  if( x.size() != nfitpar )
+    throw runtime_error( "PeakFitChi2Fcn::Gradient: invalid number of parameters" );
+  
+  vector<double> gradient( nfitpar, 0.0 );
+  
+  //chi2(...) returns DBL_MAX for non-finite input, so there isnt a meaningful gradient
+  for( const double p : x )
+  {
+    if( IsInf(p) || IsNan(p) )
+      return gradient;
+  }
+  
+  const shared_ptr<const vector<float>> &channel_energies = m_data->channel_energies();
+  if( !channel_energies || channel_energies->empty() )
+    return gradient;
+  
+  const double * const params = &(x[0]);
+  
+  parametersToPeaks( peaks, params );
+  
+  //Group the peaks by continuum the same way chi2(...) does, but keep track of peak indexes so we
+  //  know where in the parameters to put their gradients.
+  typedef map< std::shared_ptr<const PeakContinuum>, vector<int> > ContToPeakIndexMap_t;
+  ContToPeakIndexMap_t contToPeakMap;
+  
+  for( int peakn = 0; peakn < m_npeaks; ++peakn )
+  {
+    std::shared_ptr<const PeakContinuum> continuum = peaks[peakn].continuum();
+    if( continuum->type() == PeakContinuum::External )
+      continuum.reset();
+    contToPeakMap[continuum].push_back( peakn );
+  }//for( int peakn = 0; peakn < m_npeaks; ++peakn )
+  
+  int num_effective_bins = 0;
+  vector<double> peak_counts, dchi2_dmodel, d_amp, d_mean, d_sigma, d_skew;
+  
+  for( const ContToPeakIndexMap_t::value_type &vt : contToPeakMap )
+  {
+    const vector<int> &peak_indexes = vt.second;
+    const std::shared_ptr<const PeakContinuum> continuum = peaks[peak_indexes[0]].continuum();
+    
+    std::set<size_t> binsToEval;
+    size_t nranges = 0;
+    
+    for( const int peakn : peak_indexes )
+    {
+      size_t lower_channel, upper_channel;
+      estimatePeakFitRange( peaks[peakn], m_data, lower_channel, upper_channel );
+      
+      if( m_lower_channel != m_upper_channel )
+      {
+        lower_channel = std::max( m_lower_channel, lower_channel );
+        upper_channel = std::min( m_upper_channel, upper_channel );
+      }//if( m_lowerbin != m_upperbin )
+      
+      for( size_t channel = lower_channel; channel <= upper_channel; ++channel )
+        binsToEval.insert( channel );
+      
+      ++nranges;
+      if( continuum->energyRangeDefined() )
+        break;
+    }//for( const int peakn : peak_indexes )
+    
+    num_effective_bins += static_cast<int>( binsToEval.size() );
+    if( binsToEval.empty() )
+      continue;
+    
+    //We'll evaluate over the contiguous span of channels, but only accumulate for `binsToEval`
+    const size_t start_channel = *begin(binsToEval);
+    const size_t nchannel = 1 + (*rbegin(binsToEval) - start_channel);
+    assert( channel_energies->size() > (start_channel + nchannel) );
+    const float * const energies = &((*channel_energies)[start_channel]);
+    
+    peak_counts.assign( nchannel, 0.0 );
+    for( const int peakn : peak_indexes )
+      peaks[peakn].gauss_integral( energies, &(peak_counts[0]), nchannel );
+    
+    //The derivative of the chi2 with respect to the predicted counts in each channel
+    dchi2_dmodel.assign( nchannel, 0.0 );
+    for( const size_t channel : binsToEval )
+    {
+      const size_t i = channel - start_channel;
+      const double ndata = m_data->gamma_channel_content(channel);
+      const double ncontinuum = continuum->offset_integral( energies[i], energies[i+1], m_data );
+      const double nmodel = ncontinuum + peak_counts[i];
+      
+      if( ndata > 0.000001 )
+        dchi2_dmodel[i] = -2.0 * (ndata - nmodel) / ndata;
+      else
+        dchi2_dmodel[i] = (nmodel > 0.0) ? 1.0 : ((nmodel < 0.0) ? -1.0 : 0.0);
+    }//for( const size_t channel : binsToEval )
+    
+    for( const int peakn : peak_indexes )
+    {
+      const PeakDef &peak = peaks[peakn];
+      const PeakDef::SkewType skew_type = peak.skewType();
+      const size_t nskew = PeakDef::num_skew_parameters( skew_type );
+      const double * const skew_pars = params + NumFitPars*peakn + SkewPar0;
+      
+      d_amp.assign( nchannel, 0.0 );
+      d_mean.assign( nchannel, 0.0 );
+      d_sigma.assign( nchannel, 0.0 );
+      d_skew.assign( nskew*nchannel, 0.0 );
+      
+      PeakDists::photopeak_function_integral( peak.mean(), peak.sigma(), 1.0, skew_type, skew_pars,
+                                              nchannel, energies, &(d_amp[0]) );
+      PeakDists::photopeak_function_integral_derivatives( peak.mean(), peak.sigma(),
+                                              peak.amplitude(), skew_type, skew_pars,
+                                              nchannel, energies, &(d_mean[0]), &(d_sigma[0]),
+                                              (nskew ? &(d_skew[0]) : nullptr) );
+      
+      double *peak_gradient = &(gradient[NumFitPars*peakn]);
+      for( const size_t channel : binsToEval )
+      {
+        const size_t i = channel - start_channel;
+        const double dchi2 = dchi2_dmodel[i];
+        peak_gradient[Mean] += dchi2 * d_mean[i];
+        peak_gradient[Sigma] += dchi2 * d_sigma[i];
+        peak_gradient[GaussAmplitude] += dchi2 * d_amp[i];
+        for( size_t skew_index = 0; skew_index < nskew; ++skew_index )
+          peak_gradient[SkewPar0 + skew_index] += dchi2 * d_skew[skew_index*nchannel + i];
+      }//for( const size_t channel : binsToEval )
+    }//for( const int peakn : peak_indexes )
+    
+    //The continuum coefficients live with the first peak that uses the continuum; the continuum
+    //  is linear in them, so we can just evaluate it with unit coefficients.
+    const int owner_peakn = peak_indexes[0];
+    if( vt.first && continuum->isPolynomial()
+        && (continuumInfoToSharedIndex(params[NumFitPars*owner_peakn + ContinuumInfoField]) < 0) )
+    {
+      const size_t npoly = PeakContinuum::num_parameters( continuum->type() );
+      assert( npoly <= 5 );
+      
+      PeakContinuum unit_continuum( *continuum );
+      vector<double> coefs( npoly, 0.0 );
+      const vector<double> uncerts;
+      
+      for( size_t coef = 0; coef < npoly; ++coef )
+      {
+        std::fill( begin(coefs), end(coefs), 0.0 );
+        coefs[coef] = 1.0;
+        unit_continuum.setParameters( continuum->referenceEnergy(), coefs, uncerts );
+        
+        double dchi2 = 0.0;
+        for( const size_t channel : binsToEval )
+        {
+          const size_t i = channel - start_channel;
+          dchi2 += dchi2_dmodel[i] * unit_continuum.offset_integral( energies[i], energies[i+1], m_data );
+        }
+        
+        gradient[NumFitPars*owner_peakn + OffsetPolynomial0 + coef] += dchi2;
+      }//for( size_t coef = 0; coef < npoly; ++coef )
+    }//if( this group owns a polynomial continuum )
+    
+    //chi2(...) only adds the multi-peak punishment when it doesnt take the single range path
+    if( m_useMultiPeakPunishment && (nranges != 1) && (peak_indexes.size() > 1) )
+    {
+      vector<PeakDef> working_peaks;
+      for( const int peakn : peak_indexes )
+        working_peaks.push_back( peaks[peakn] );
+      
+      vector<const PeakDef *> working_ptrs;
+      for( const PeakDef &peak : working_peaks )
+        working_ptrs.push_back( &peak );
+      
+      for( size_t i = 0; i < working_peaks.size(); ++i )
+      {
+        PeakDef &peak = working_peaks[i];
+        
+        for( const FitPars par : { Mean, Sigma, GaussAmplitude } )
+        {
+          const auto coef_type = static_cast<PeakDef::CoefficientType>( par );
+          const double orig = peak.coefficient( coef_type );
+          const double h = 1.0E-6 * std::max( fabs(orig), 1.0 );
+          
+          peak.set_coefficient( orig + h, coef_type );
+          const double upper = evalMultiPeakPunishment( working_ptrs );
+          peak.set_coefficient( orig - h, coef_type );
+          const double lower = evalMultiPeakPunishment( working_ptrs );
+          peak.set_coefficient( orig, coef_type );
+          
+          gradient[NumFitPars*peak_indexes[i] + par] += (upper - lower) / (2.0*h);
+        }//for( const FitPars par : { Mean, Sigma, GaussAmplitude } )
+      }//for( size_t i = 0; i < working_peaks.size(); ++i )
+    }//if( m_useMultiPeakPunishment && ... )
+  }//for( const ContToPeakIndexMap_t::value_type &vt : contToPeakMap )
+  
+  if( m_useReducedChi2 )
+  {
+    //Same (not quite right) DOF as chi2(...)
+    const int ndof = ((num_effective_bins - static_cast<int>(nfitpar)) > 0)
+                     ? (num_effective_bins - static_cast<int>(nfitpar))
+                     : 1;
+    for( double &g : gradient )
+      g /= ndof;
+  }//if( m_useReducedChi2 )
+  
+  return gradient;
+}//vector<double> Gradient( const vector<double> &x, std::vector<PeakDef> &peaks ) const
+
+
+bool PeakFitChi2Fcn::CheckGradient() const
+{
+  return false;
+}
+
+
 void PeakFitChi2Fcn::addPeaksToFitter( ROOT::Minuit2::MnUserParameters &params,
                       const std::vector<PeakDef> &near_peaks,
                       std::shared_ptr<const SpecUtils::Measurement> data,
@@ -1018,7 +1255,9 @@ MultiPeakFitChi2Fcn::MultiPeakFitChi2Fcn( const int npeaks,
     m_skewType( skewType ),
     m_data( data ),
     m_reldiff_punish_start( 1.25 ),
-    m_reldiff_punish_weight( 2.0 )
+    m_reldiff_punish_weight( 2.0 ),
+    m_numPolyContinuumPars( 0 ),
+    m_continuumBasis{}
 {
   if( !m_data )
     throw std::runtime_error( "MultiPeakFitChi2Fcn null data passed in" );
@@ -1073,6 +1312,38 @@ MultiPeakFitChi2Fcn::MultiPeakFitChi2Fcn( const int npeaks,
   
   const size_t num_skew_pars = PeakDef::num_skew_parameters( m_skewType );
   m_numOffset += static_cast<int>( num_skew_pars );
+  
+  
+  // Precompute the per-channel integrals of each polynomial term, in the same form as
+  //  `PeakContinuum::offset_eqn_integral(...)`, so we dont have to do this for every channel
+  //  on every call to DoEval.  Step continuums depend on the data, so we wont bother for them.
+  switch( m_offsetType )
+  {
+    case PeakContinuum::Constant:   case PeakContinuum::Linear:
+    case PeakContinuum::Quadratic: case PeakContinuum::Cubic:
+      m_numPolyContinuumPars = static_cast<size_t>( m_offsetType );
+      break;
+      
+    default:
+      m_numPolyContinuumPars = 0;
+      break;
+  }//switch( m_offsetType )
+  
+  m_continuumBasis.resize( m_nbin * m_numPolyContinuumPars );
+  for( size_t i = 0; (m_numPolyContinuumPars > 0) && (i < m_nbin); ++i )
+  {
+    const double x0 = m_energies[i] - m_rangeLow;
+    const double x1 = m_energies[i+1] - m_rangeLow;
+    double * const basis = &(m_continuumBasis[i*m_numPolyContinuumPars]);
+    
+    switch( m_numPolyContinuumPars )
+    {
+      case 4: basis[3] = 0.25*(x1*x1*x1*x1 - x0*x0*x0*x0);              //fallthrough intentional
+      case 3: basis[2] = 0.333333333333333*(x1*x1*x1 - x0*x0*x0);       //fallthrough intentional
+      case 2: basis[1] = 0.5*(x1*x1 - x0*x0);                           //fallthrough intentional
+      case 1: basis[0] = (x1 - x0);                                     break;
+    }//switch( m_numPolyContinuumPars )
+  }//for( size_t i = 0; i < m_nbin; ++i )
 }//MultiPeakFitChi2Fcn constructor
 
 
@@ -1095,6 +1366,8 @@ MultiPeakFitChi2Fcn &MultiPeakFitChi2Fcn::operator=( const MultiPeakFitChi2Fcn &
   m_data = rhs.m_data;
   m_reldiff_punish_start = rhs.m_reldiff_punish_start;
   m_reldiff_punish_weight = rhs.m_reldiff_punish_weight;
+  m_numPolyContinuumPars = rhs.m_numPolyContinuumPars;
+  m_continuumBasis = rhs.m_continuumBasis;
   
   return *this;
 }//operator=
@@ -1309,12 +1582,46 @@ double MultiPeakFitChi2Fcn::evalRelBinRange( const size_t beginRelChannel,
   
   double chi2 = 0.0;
   
-  // We will get the peak contributions using the slightly more efficient methods
+  // All peaks in the ROI are accumulated into a single array (each peak only touches the
+  //  channels it has non-negligible contribution to), and then we make a single pass over the
+  //  channels to compute the continuum and chi2.
   const size_t nchan = endRelChannel - beginRelChannel;
   vector<double> peak_sum( endRelChannel - beginRelChannel, 0.0 );
   for( size_t i = 0; i < peaks.size(); ++i )
     peaks[i].gauss_integral( &(m_energies[beginRelChannel]), &(peak_sum[0]), nchan );
   
+  // If the continuum is a polynomial relative to the start of the ROI (which is always the case
+  //  when `parametersToPeaks(...)` creates the peaks), we can use the precomputed basis.
+  const std::shared_ptr<const PeakContinuum> continuum = peaks[0].continuum();
+  const size_t npoly = m_numPolyContinuumPars;
+  const bool use_basis = (npoly > 0)
+                         && (continuum->type() == m_offsetType)
+                         && (continuum->referenceEnergy() == m_rangeLow)
+                         && (continuum->parameters().size() >= npoly)
+                         && (m_continuumBasis.size() == (m_nbin * npoly));
+  
+  if( use_basis )
+  {
+    const double * const coefs = &(continuum->parameters()[0]);
+    
+    for( size_t relchannel = beginRelChannel; relchannel < endRelChannel; ++relchannel )
+    {
+      const double * const basis = &(m_continuumBasis[relchannel*npoly]);
+      double ncontinuim = 0.0;
+      for( size_t order = npoly; order > 0; --order )
+        ncontinuim += coefs[order-1] * basis[order-1];
+      ncontinuim = std::max( ncontinuim, 0.0 ); //same as PeakContinuum::offset_eqn_integral(...)
+      
+      const double nfitpeak = peak_sum[relchannel - beginRelChannel];
+      const double ndata = m_dataCounts[relchannel];
+      const double datauncert = std::max( ndata, 1.0 );
+      const double nabove = (ndata - ncontinuim - nfitpeak);
+      chi2 += nabove*nabove / datauncert;
+    }//for( loop over channels )
+    
+    return chi2;
+  }//if( use_basis )
+  
   for( size_t relchannel = beginRelChannel; relchannel < endRelChannel; ++relchannel )
   {
     double nfitpeak = peak_sum[relchannel - beginRelChannel];
@@ -1420,29 +1727,7 @@ double MultiPeakFitChi2Fcn::evalMultiPeakInsentive(
 
 double MultiPeakFitChi2Fcn::DoEval( const double *x ) const
 {
-  ++sm_ncalls;
-  
-  double chi2 = 0.0;
-  vector<PeakDef> peaks( m_npeak );
-  
-  const size_t npars = static_cast<size_t>(m_numOffset + 3*m_npeak);
-  for( size_t i = 0; i < npars; ++i )
-    if( IsNan(x[i]) || IsInf(x[i]) )
-      return DBL_MAX;
-  
-  parametersToPeaks( peaks, x );
-  
-  std::sort( peaks.begin(), peaks.end(), &PeakDef::lessThanByMean );
-  
-  chi2 += evalRelBinRange( 0, m_nbin, peaks );
-  
-  if( m_reldiff_punish_weight > 0.0 )
-    chi2 += evalMultiPeakInsentive( peaks );
-  
-  if( IsInf(chi2) || IsNan(chi2) )
-    return DBL_MAX;
-  
-  return chi2;
+  return DoEval( x, m_workingpeaks );
 }//double DoEval( const double *x ) const
 
 
@@ -38,6 +38,7 @@
 #include "SpecUtils/SpecFile.h"
 #include "InterSpec/PeakFitLM.h"
 #include "InterSpec/PeakFitUtils.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "SpecUtils/EnergyCalibration.h"
 #include "InterSpec/DetectorPeakResponse.h"
 
@@ -87,6 +88,7 @@ struct PeakFitDiffCostFunction
     assert( m_data->gamma_counts() && !m_data->gamma_counts()->empty() );
     assert( m_upper_channel >= m_lower_channel );
     assert( m_upper_channel < m_data->num_gamma_channels() );
+    assert( m_data->channel_energies() && (m_data->channel_energies()->size() > (m_upper_channel + 1)) );
     assert( m_roi_lower_energy < m_roi_upper_energy );
     
     assert( m_num_peaks > 0 );
@@ -105,6 +107,9 @@ struct PeakFitDiffCostFunction
     if( m_upper_channel >= counts.size() )
       throw runtime_error( "PeakFitDiffCostFunction: m_upper_channel >= counts.size()" );
     
+    if( !m_data->channel_energies() || (m_data->channel_energies()->size() <= (m_upper_channel + 1)) )
+      throw runtime_error( "PeakFitDiffCostFunction: invalid channel energies" );
+    
     if( !m_num_peaks )
       throw runtime_error( "PeakFitDiffCostFunction: no peaks to fit" );
     
@@ -190,7 +195,14 @@ struct PeakFitDiffCostFunction
   }//size_t number_residuals() const
   
   
-  vector<PeakDef> parametersToPeaks( const double * const params, const double * const uncertainties, double *residuals ) const
+  /** Converts the parameters to peaks, and fills out the residuals.
+   
+   If `inherit_user_options` is false, the returned peaks will not have nuclide assignments, colors,
+   etc from the starting peaks; this is what the residual evaluations during the solve use, since
+   they only need the residuals.
+   */
+  vector<PeakDef> parametersToPeaks( const double * const params, const double * const uncertainties,
+                                     double *residuals, const bool inherit_user_options = true ) const
   {
     const size_t num_continuum_pars = PeakContinuum::num_parameters( m_offset_type );
     const size_t last_data_residual = m_upper_channel - m_lower_channel;
@@ -284,17 +296,23 @@ struct PeakFitDiffCostFunction
     
     double chi2 = 0.0;
     
+    // Summing each peak over the whole ROI at once shares the erf evaluations between adjacent
+    //  channels, so is about twice as fast as calling `PeakDef::gauss_integral(x0,x1)` per channel.
+    const size_t nchannel = 1 + m_upper_channel - m_lower_channel;
+    const float * const energies = &((*m_data->channel_energies())[m_lower_channel]);
+    vector<double> peak_counts( nchannel, 0.0 );
+    for( const PeakDef &peak : peaks )
+      peak.gauss_integral( energies, &(peak_counts[0]), nchannel );
+    
     for( size_t channel = m_lower_channel; channel <= m_upper_channel; ++channel )
     {
       const float ndata = m_data->gamma_channel_content(channel);
-      const float channel_lower_energy = m_data->gamma_channel_lower( channel );
-      const float channel_upper_energy = m_data->gamma_channel_upper( channel );
+      const float channel_lower_energy = energies[channel - m_lower_channel];
+      const float channel_upper_energy = energies[channel - m_lower_channel + 1];
       
       const double ncontinuum = peaks[0].continuum()->offset_integral(channel_lower_energy, channel_upper_energy, m_data);
       
-      double peak_gaus_contribution = 0.0;
-      for( const PeakDef &peak : peaks )
-        peak_gaus_contribution += peak.gauss_integral( channel_lower_energy, channel_upper_energy );
+      const double peak_gaus_contribution = peak_counts[channel - m_lower_channel];
       
       const size_t residual_num = channel - m_lower_channel;
       assert( residual_num < number_residuals() );
@@ -343,6 +361,8 @@ struct PeakFitDiffCostFunction
     
     // TODO: PeakFitChi2Fcn also punishes for peak being statistically insignificant
     
+    if( !inherit_user_options )
+      return peaks;
     
     // Now inherit all the assigned nuclides, colors, whatever from the starting peaks.
     //  However, ordering of peaks could swap, etc, so we need to match the original
@@ -416,7 +436,7 @@ struct PeakFitDiffCostFunction
     for( size_t i = 0; i < npar; ++i )
       pars[i] = parameters[i][0];
     
-    parametersToPeaks( pars.data(), nullptr, residuals );
+    parametersToPeaks( pars.data(), nullptr, residuals, false );
     
     return true;
   }//operator()
@@ -440,6 +460,240 @@ public:
 };//struct PeakFitDiffCostFunction
 
 
+/** The cost function for #fit_peaks_jointly.
+ 
+ Parameters are (each its own size-1 block):
+   - the mean of each peak,
+   - the width at the lower ROI edge, and (if more than one peak) the change in width across the ROI,
+   - for each detector after the first: its energy offset, and width multiplier.
+ 
+ Residuals are the channel residuals of each detectors ROI, in the order of the detectors; the peak
+ amplitudes and continuum of each detector are solved for linearly for every evaluation.
+ */
+struct JointPeakFitCostFunction
+{
+  struct DetectorRoi
+  {
+    std::shared_ptr<const SpecUtils::Measurement> data;
+    size_t num_channels;
+    const float *energies;
+    const float *counts;
+    size_t first_residual;
+  };//struct DetectorRoi
+  
+  
+  JointPeakFitCostFunction( const std::vector< std::shared_ptr<const SpecUtils::Measurement> > &detectors,
+                            const std::vector< std::shared_ptr<const PeakDef> > &starting_peaks )
+  : m_starting_peaks( starting_peaks ),
+    m_num_residuals( 0 ),
+    m_ncalls( 0 )
+  {
+    if( detectors.empty() )
+      throw runtime_error( "JointPeakFitCostFunction: no detectors" );
+    
+    if( starting_peaks.empty() )
+      throw runtime_error( "JointPeakFitCostFunction: no peaks to fit" );
+    
+    std::sort( begin(m_starting_peaks), end(m_starting_peaks), &PeakDef::lessThanByMeanShrdPtr );
+    
+    const shared_ptr<const PeakContinuum> continuum = m_starting_peaks[0]->continuum();
+    for( const shared_ptr<const PeakDef> &p : m_starting_peaks )
+    {
+      if( !p || !p->gausPeak() || (p->continuum() != continuum) )
+        throw runtime_error( "JointPeakFitCostFunction: input peaks must be Gaussian, and all share a continuum" );
+    }
+    
+    m_offset_type = continuum->type();
+    if( (m_offset_type == PeakContinuum::OffsetType::External)
+       || (m_offset_type == PeakContinuum::OffsetType::NoOffset) )
+      throw runtime_error( "JointPeakFitCostFunction: continuum type not supported" );
+    
+    m_roi_lower_energy = continuum->lowerEnergy();
+    m_roi_upper_energy = continuum->upperEnergy();
+    if( !(m_roi_lower_energy < m_roi_upper_energy) )
+      throw runtime_error( "JointPeakFitCostFunction: invalid ROI range" );
+    
+    m_skew_type = m_starting_peaks[0]->skewType();
+    for( size_t i = 0; i < PeakDef::num_skew_parameters(m_skew_type); ++i )
+    {
+      const auto ct = static_cast<PeakDef::CoefficientType>( PeakDef::SkewPar0 + i );
+      m_skew_pars.push_back( m_starting_peaks[0]->coefficient(ct) );
+    }
+    
+    const size_t num_linear_pars = m_starting_peaks.size() + PeakContinuum::num_parameters( m_offset_type );
+    
+    for( const shared_ptr<const SpecUtils::Measurement> &data : detectors )
+    {
+      if( !data || !data->gamma_counts() || !data->channel_energies()
+         || (data->num_gamma_channels() < 8) )
+        throw runtime_error( "JointPeakFitCostFunction: invalid detector spectrum" );
+      
+      const size_t lower_channel = data->find_gamma_channel( m_roi_lower_energy );
+      const size_t upper_channel = data->find_gamma_channel( m_roi_upper_energy );
+      if( upper_channel < (lower_channel + num_linear_pars + 2) )
+        throw runtime_error( "JointPeakFitCostFunction: ROI has too few channels in detector '"
+                             + data->detector_name() + "'" );
+      
+      DetectorRoi roi;
+      roi.data = data;
+      roi.num_channels = 1 + upper_channel - lower_channel;
+      roi.energies = data->channel_energies()->data() + lower_channel;
+      roi.counts = data->gamma_counts()->data() + lower_channel;
+      roi.first_residual = m_num_residuals;
+      m_detectors.push_back( roi );
+      
+      m_num_residuals += roi.num_channels;
+    }//for( loop over detectors )
+  }//JointPeakFitCostFunction constructor
+  
+  
+  size_t number_peaks() const { return m_starting_peaks.size(); }
+  
+  size_t number_sigma_parameters() const { return (m_starting_peaks.size() > 1) ? 2 : 1; }
+  
+  size_t detector_par_index( const size_t detector ) const
+  {
+    assert( detector > 0 );
+    return number_peaks() + number_sigma_parameters() + 2*(detector - 1);
+  }
+  
+  size_t number_parameters() const
+  {
+    return number_peaks() + number_sigma_parameters() + 2*(m_detectors.size() - 1);
+  }
+  
+  size_t number_residuals() const { return m_num_residuals; }
+  
+  
+  /** Solves for the amplitudes and continuum of a detector, given all the non-linear parameters,
+   and fills out that detectors residuals.  Returns the detectors peaks, and sets `chi2`.
+   */
+  vector<PeakDef> detector_peaks( const double * const params, const size_t detector,
+                                  double *residuals, double &chi2 ) const
+  {
+    const DetectorRoi &roi = m_detectors.at( detector );
+    const size_t npeaks = number_peaks();
+    const double offset = detector ? params[detector_par_index(detector)] : 0.0;
+    const double scale = detector ? params[detector_par_index(detector) + 1] : 1.0;
+    
+    vector<double> means( npeaks ), sigmas( npeaks );
+    for( size_t i = 0; i < npeaks; ++i )
+    {
+      const double mean = params[i];
+      double sigma = m_starting_peaks[i]->sigma();
+      if( m_starting_peaks[i]->fitFor(PeakDef::Sigma) )
+      {
+        sigma = params[npeaks];
+        if( npeaks > 1 )
+        {
+          const double frac = (mean - m_roi_lower_energy) / (m_roi_upper_energy - m_roi_lower_energy);
+          sigma += frac * params[npeaks + 1];
+        }
+      }//if( fit sigma )
+      
+      means[i] = mean + offset;
+      sigmas[i] = sigma * scale;
+    }//for( loop over peaks )
+    
+    const int num_polynomial_terms = static_cast<int>( PeakContinuum::num_parameters(m_offset_type) );
+    const bool step_continuum = PeakContinuum::is_step_continuum( m_offset_type );
+    
+    vector<double> amps, offsets, amps_uncerts, offsets_uncerts;
+    chi2 = fit_amp_and_offset( roi.energies, roi.counts, roi.num_channels, num_polynomial_terms,
+                               step_continuum, m_roi_lower_energy, means, sigmas, vector<PeakDef>{},
+                               m_skew_type, (m_skew_pars.empty() ? nullptr : m_skew_pars.data()),
+                               amps, offsets, amps_uncerts, offsets_uncerts );
+    
+    auto continuum = std::make_shared<PeakContinuum>();
+    continuum->setType( m_offset_type );
+    continuum->setParameters( m_roi_lower_energy, offsets, offsets_uncerts );
+    continuum->setRange( m_roi_lower_energy, m_roi_upper_energy );
+    
+    vector<PeakDef> peaks( npeaks );
+    vector<double> model( roi.num_channels, 0.0 );
+    for( size_t i = 0; i < npeaks; ++i )
+    {
+      peaks[i].setMean( means[i] );
+      peaks[i].setSigma( sigmas[i] );
+      peaks[i].setAmplitude( amps[i] );
+      peaks[i].setAmplitudeUncert( amps_uncerts[i] );
+      peaks[i].setSkewType( m_skew_type );
+      for( size_t j = 0; j < m_skew_pars.size(); ++j )
+        peaks[i].set_coefficient( m_skew_pars[j], static_cast<PeakDef::CoefficientType>(PeakDef::SkewPar0 + j) );
+      peaks[i].setContinuum( continuum );
+      peaks[i].gauss_integral( roi.energies, model.data(), roi.num_channels );
+    }//for( loop over peaks )
+    
+    if( residuals )
+    {
+      for( size_t channel = 0; channel < roi.num_channels; ++channel )
+      {
+        const double ndata = roi.counts[channel];
+        const double npred = model[channel]
+                   + continuum->offset_integral( roi.energies[channel], roi.energies[channel+1], roi.data );
+        
+        // Same convention as PeakFitDiffCostFunction
+        if( ndata > 0.000001 )
+          residuals[roi.first_residual + channel] = (ndata - npred) / sqrt(ndata);
+        else
+          residuals[roi.first_residual + channel] = npred;
+      }//for( loop over channels )
+    }//if( residuals )
+    
+    return peaks;
+  }//detector_peaks(...)
+  
+  
+  bool operator()( double const *const *parameters, double *residuals ) const
+  {
+    m_ncalls += 1;
+    
+    const size_t npar = number_parameters();
+    vector<double> pars( npar );
+    for( size_t i = 0; i < npar; ++i )
+      pars[i] = parameters[i][0];
+    
+    std::atomic<bool> failed( false );
+    const auto eval_detector = [&]( const size_t detector ){
+      try
+      {
+        double chi2 = 0.0;
+        detector_peaks( pars.data(), detector, residuals, chi2 );
+      }catch( std::exception & )
+      {
+        failed = true;
+      }
+    };//eval_detector lambda
+    
+    if( m_detectors.size() == 1 )
+    {
+      eval_detector( 0 );
+    }else
+    {
+      SharedThreadPool::TaskGroup pool;
+      for( size_t detector = 0; detector < m_detectors.size(); ++detector )
+        pool.post( [&eval_detector,detector](){ eval_detector( detector ); } );
+      pool.join();
+    }//if( single detector ) / else
+    
+    return !failed;
+  }//operator()
+  
+  
+public:
+  std::vector< std::shared_ptr<const PeakDef> > m_starting_peaks;
+  std::vector<DetectorRoi> m_detectors;
+  PeakContinuum::OffsetType m_offset_type;
+  double m_roi_lower_energy;
+  double m_roi_upper_energy;
+  PeakDef::SkewType m_skew_type;
+  std::vector<double> m_skew_pars;
+  size_t m_num_residuals;
+  
+  mutable std::atomic<unsigned int> m_ncalls;
+};//struct JointPeakFitCostFunction
+
+
 
 void fit_peak_for_user_click_LM( PeakShrdVec &results,
                              double &chi2Dof,
@@ -782,4 +1036,170 @@ void fit_peak_for_user_click_LM( PeakShrdVec &results,
 }//void fit_peak_for_user_click_LM(...)
 
 
+std::vector<JointDetectorFit> fit_peaks_jointly(
+                          const std::vector< std::shared_ptr<const SpecUtils::Measurement> > &detectors,
+                          const std::vector< std::shared_ptr<const PeakDef> > &starting_peaks )
+{
+  auto cost_functor = new JointPeakFitCostFunction( detectors, starting_peaks );
+  auto cost_function = new ceres::DynamicNumericDiffCostFunction<JointPeakFitCostFunction>( cost_functor );
+  
+  const size_t num_pars = cost_functor->number_parameters();
+  const size_t npeaks = cost_functor->number_peaks();
+  const vector< shared_ptr<const PeakDef> > &peaks0 = cost_functor->m_starting_peaks;
+  const double roi_lower = cost_functor->m_roi_lower_energy;
+  const double roi_upper = cost_functor->m_roi_upper_energy;
+  
+  for( size_t i = 0; i < num_pars; ++i )
+    cost_function->AddParameterBlock( 1 );
+  cost_function->SetNumResiduals( static_cast<int>(cost_functor->number_residuals()) );
+  
+  vector<double> parameters( num_pars, 0.0 );
+  double * const pars = parameters.data();
+  vector<double *> parameter_blocks( num_pars );
+  for( size_t i = 0; i < num_pars; ++i )
+    parameter_blocks[i] = pars + i;
+  
+  ceres::Problem problem;
+  problem.AddResidualBlock( cost_function, nullptr, parameter_blocks );
+  
+  double min_sigma = std::numeric_limits<double>::max(), max_sigma = 0.0;
+  bool any_sigma_fit = false;
+  for( size_t i = 0; i < npeaks; ++i )
+  {
+    const double mean = peaks0[i]->mean();
+    const double sigma = peaks0[i]->sigma();
+    parameters[i] = mean;
+    
+    if( peaks0[i]->fitFor(PeakDef::Mean) )
+    {
+      problem.SetParameterLowerBound( pars + i, 0, mean - 0.5*sigma );
+      problem.SetParameterUpperBound( pars + i, 0, mean + 0.5*sigma );
+    }else
+    {
+      problem.SetParameterBlockConstant( pars + i );
+    }
+    
+    min_sigma = std::min( min_sigma, sigma );
+    max_sigma = std::max( max_sigma, sigma );
+    any_sigma_fit |= peaks0[i]->fitFor(PeakDef::Sigma);
+  }//for( loop over peaks )
+  
+  // Starting width at the lower ROI edge, and across the ROI, from the starting peaks
+  if( npeaks > 1 )
+  {
+    const double dx = (peaks0.back()->mean() - peaks0.front()->mean()) / (roi_upper - roi_lower);
+    const double slope = (dx > 0.0) ? (peaks0.back()->sigma() - peaks0.front()->sigma()) / dx : 0.0;
+    const double frac0 = (peaks0.front()->mean() - roi_lower) / (roi_upper - roi_lower);
+    parameters[npeaks] = peaks0.front()->sigma() - frac0*slope;
+    parameters[npeaks + 1] = slope;
+    problem.SetParameterLowerBound( pars + npeaks + 1, 0, -0.5*max_sigma );
+    problem.SetParameterUpperBound( pars + npeaks + 1, 0, 0.5*max_sigma );
+  }else
+  {
+    parameters[npeaks] = peaks0[0]->sigma();
+  }//if( npeaks > 1 ) / else
+  
+  problem.SetParameterLowerBound( pars + npeaks, 0, 0.5*min_sigma );
+  problem.SetParameterUpperBound( pars + npeaks, 0, 2.0*max_sigma );
+  
+  if( !any_sigma_fit )
+  {
+    for( size_t i = 0; i < cost_functor->number_sigma_parameters(); ++i )
+      problem.SetParameterBlockConstant( pars + npeaks + i );
+  }
+  
+  for( size_t detector = 1; detector < detectors.size(); ++detector )
+  {
+    const size_t index = cost_functor->detector_par_index( detector );
+    parameters[index] = 0.0;
+    parameters[index + 1] = 1.0;
+    problem.SetParameterLowerBound( pars + index, 0, -2.0*min_sigma );
+    problem.SetParameterUpperBound( pars + index, 0, 2.0*min_sigma );
+    problem.SetParameterLowerBound( pars + index + 1, 0, 0.5 );
+    problem.SetParameterUpperBound( pars + index + 1, 0, 2.0 );
+  }//for( loop over detectors after first )
+  
+  ceres::Solver::Options options;
+  options.linear_solver_type = ceres::DENSE_QR;
+  options.minimizer_progress_to_stdout = false;
+  options.logging_type = ceres::SILENT;
+  
+  ceres::Solver::Summary summary;
+  ceres::Solve( options, &problem, &summary );
+  
+  switch( summary.termination_type )
+  {
+    case ceres::CONVERGENCE:
+    case ceres::USER_SUCCESS:
+      break;
+      
+    case ceres::NO_CONVERGENCE:
+    case ceres::FAILURE:
+    case ceres::USER_FAILURE:
+      throw runtime_error( "fit_peaks_jointly: the L-M solve failed: " + summary.message );
+  }//switch( summary.termination_type )
+  
+  // The uncertainties of the shared means and widths
+  vector<double> uncertainties( num_pars, 0.0 );
+  {
+    ceres::Covariance::Options cov_options;
+    cov_options.algorithm_type = ceres::CovarianceAlgorithmType::SPARSE_QR;
+    ceres::Covariance covariance( cov_options );
+    vector<pair<const double*, const double*> > covariance_blocks;
+    for( size_t i = 0; i < num_pars; ++i )
+    {
+      if( !problem.IsParameterBlockConstant( pars + i ) )
+        covariance_blocks.push_back( make_pair( pars + i, pars + i ) );
+    }
+    
+    if( covariance.Compute( covariance_blocks, &problem ) )
+    {
+      for( const auto &block : covariance_blocks )
+      {
+        double variance = 0.0;
+        covariance.GetCovarianceBlock( block.first, block.second, &variance );
+        if( variance > 0.0 )
+          uncertainties[block.first - pars] = sqrt( variance );
+      }
+    }else
+    {
+      cerr << "fit_peaks_jointly: failed to compute covariance" << endl;
+    }
+  }
+  
+  const double num_nonlinear_per_detector = static_cast<double>(num_pars) / detectors.size();
+  const double num_linear_pars = npeaks + PeakContinuum::num_parameters( cost_functor->m_offset_type );
+  
+  vector<JointDetectorFit> answer( detectors.size() );
+  for( size_t detector = 0; detector < detectors.size(); ++detector )
+  {
+    JointDetectorFit &result = answer[detector];
+    result.energy_offset = detector ? parameters[cost_functor->detector_par_index(detector)] : 0.0;
+    result.fwhm_scale = detector ? parameters[cost_functor->detector_par_index(detector) + 1] : 1.0;
+    result.chi2 = 0.0;
+    
+    const vector<PeakDef> peaks = cost_functor->detector_peaks( pars, detector, nullptr, result.chi2 );
+    result.dof = cost_functor->m_detectors[detector].num_channels - num_linear_pars - num_nonlinear_per_detector;
+    
+    for( size_t i = 0; i < peaks.size(); ++i )
+    {
+      auto peak = std::make_shared<PeakDef>( peaks[i] );
+      peak->inheritUserSelectedOptions( *peaks0[i], true );
+      peak->setMean( peaks[i].mean() );
+      peak->setSigma( peaks[i].sigma() );
+      peak->setAmplitude( std::max( 0.0, peaks[i].amplitude() ) );
+      if( uncertainties[i] > 0.0 )
+        peak->setMeanUncert( uncertainties[i] );
+      if( uncertainties[npeaks] > 0.0 )
+        peak->setSigmaUncert( uncertainties[npeaks] * result.fwhm_scale );
+      if( result.dof > 0.0 )
+        peak->set_coefficient( result.chi2 / result.dof, PeakDef::Chi2DOF );
+      result.peaks.push_back( peak );
+    }//for( loop over peaks )
+  }//for( loop over detectors )
+  
+  return answer;
+}//fit_peaks_jointly(...)
+
+
 }//namespace PeakFitLM
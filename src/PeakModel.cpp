@@ -23,12 +23,14 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <deque>
 #include <string>
 #include <vector>
 #include <memory>
 #include <cctype>
 #include <algorithm>
+#include <functional>
 
 #include <Wt/WResource>
 #include <Wt/WModelIndex>
@@ -1214,6 +1216,16 @@ std::shared_ptr<const deque< PeakModel::PeakShrdPtr > > PeakModel::peaks() const
 }//const deque<PeakDef> &peaks() const
 
 
+size_t PeakModel::memsize() const
+{
+  size_t size = sizeof(PeakModel);
+  if( m_peaks )
+    size += sizeof(PeakShrdPtr) * m_peaks->size();
+  size += sizeof(PeakShrdPtr) * m_sortedPeaks.size();
+  return size;
+}//size_t memsize() const
+
+
 std::vector<PeakDef> PeakModel::peakVec() const
 {
   vector<PeakDef> answer;
@@ -1661,6 +1673,55 @@ std::vector<std::shared_ptr<const PeakDef>> PeakModel::peaksNotSharingRoi( const
 
 void PeakModel::updatePeak( const std::shared_ptr<const PeakDef> &originalPeak, const PeakDef &newPeak )
 {
+  // Refitting a peak usually doesnt change where it sorts to, so in that case we'll replace the
+  //  peak in-place and just emit dataChanged() for its row, rather than removing and inserting a
+  //  row, which causes attached views to re-create the row.
+  if( m_peaks && originalPeak && isWithinRange( newPeak ) )
+  {
+    const auto mean_pos = std::find( begin(*m_peaks), end(*m_peaks), originalPeak );
+    const auto sort_pos = std::find( begin(m_sortedPeaks), end(m_sortedPeaks), originalPeak );
+    
+    if( (mean_pos != end(*m_peaks)) && (sort_pos != end(m_sortedPeaks)) )
+    {
+      auto new_peak_ptr = std::make_shared<PeakDef>( newPeak );
+      definePeakXRange( *new_peak_ptr );
+      const PeakShrdPtr peak_ptr = new_peak_ptr;
+      
+      const shared_ptr<const SpecUtils::Measurement> &data = m_foreground;
+      const auto sortfcn = [this,&data]( const PeakShrdPtr &lhs, const PeakShrdPtr &rhs ) -> bool {
+        return PeakModel::compare( lhs, rhs, m_sortColumn, m_sortOrder, data );
+      };
+      const auto meansort = [&data]( const PeakShrdPtr &lhs, const PeakShrdPtr &rhs ) -> bool {
+        return PeakModel::compare( lhs, rhs, kMean, Wt::AscendingOrder, data );
+      };
+      
+      // Same position #addNewPeakInternal would insert the new peak at, if the original peak was
+      //  removed: everything before it compares less, and nothing after it does.
+      const auto stays_in_place = [&peak_ptr]( const deque<PeakShrdPtr> &peaks,
+                                               const deque<PeakShrdPtr>::const_iterator pos,
+                                               const std::function<bool(const PeakShrdPtr &, const PeakShrdPtr &)> &less ) -> bool {
+        if( (pos != begin(peaks)) && !less( *(pos - 1), peak_ptr ) )
+          return false;
+        if( ((pos + 1) != end(peaks)) && less( *(pos + 1), peak_ptr ) )
+          return false;
+        return true;
+      };//stays_in_place
+      
+      if( stays_in_place( *m_peaks, mean_pos, meansort )
+         && stays_in_place( m_sortedPeaks, sort_pos, sortfcn ) )
+      {
+        const int row = static_cast<int>( sort_pos - begin(m_sortedPeaks) );
+        
+        notifySpecMeasOfPeakChange();
+        (*m_peaks)[mean_pos - begin(*m_peaks)] = peak_ptr;
+        m_sortedPeaks[row] = peak_ptr;
+        
+        dataChanged().emit( index(row, 0), index(row, kNumColumns - 1) );
+        return;
+      }//if( the updated peak would keep the same position )
+    }//if( we found the original peak )
+  }//if( we can possibly update peak in-place )
+  
   removePeakInternal( originalPeak );
   addNewPeak( newPeak );
 }//updatePeak( originalPeak, newPeak )
@@ -3165,8 +3226,46 @@ void PeakModel::sort( int col, Wt::SortOrder order )
 
   boost::function<bool(const PeakShrdPtr &, const PeakShrdPtr &)> sortfcn;
   const shared_ptr<const SpecUtils::Measurement> &data = m_foreground;
-  sortfcn = boost::bind( &PeakModel::compare, boost::placeholders::_1, boost::placeholders::_2,
-                        m_sortColumn, order, data );
+  
+  // Sorting by ROI counts, or line color, would otherwise integrate the spectrum, or format a CSS
+  //  string, on every comparison, so compute these keys once per peak.
+  map<const PeakDef *,double> roi_counts;
+  map<const PeakDef *,string> colors;
+  if( (m_sortColumn == kRoiCounts) && data )
+  {
+    for( const PeakShrdPtr &p : m_sortedPeaks )
+    {
+      if( p )
+        roi_counts[p.get()] = data->gamma_integral( p->lowerX(), p->upperX() );
+    }
+    
+    const bool asscend = (order == AscendingOrder);
+    sortfcn = [asscend,&roi_counts]( const PeakShrdPtr &lhs, const PeakShrdPtr &rhs ) -> bool {
+      if( !lhs || !rhs )
+        return (asscend ? lhs.get()<rhs.get() : lhs.get()>rhs.get());
+      const double lhs_area = roi_counts[lhs.get()], rhs_area = roi_counts[rhs.get()];
+      return (asscend ? (lhs_area<rhs_area) : (lhs_area>rhs_area));
+    };
+  }else if( m_sortColumn == kPeakLineColor )
+  {
+    for( const PeakShrdPtr &p : m_sortedPeaks )
+    {
+      if( p )
+        colors[p.get()] = p->lineColor().cssText();
+    }
+    
+    const bool asscend = (order == AscendingOrder);
+    sortfcn = [asscend,&colors]( const PeakShrdPtr &lhs, const PeakShrdPtr &rhs ) -> bool {
+      if( !lhs || !rhs )
+        return (asscend ? lhs.get()<rhs.get() : lhs.get()>rhs.get());
+      const string &lhs_color = colors[lhs.get()], &rhs_color = colors[rhs.get()];
+      return (asscend ? (lhs_color<rhs_color) : (lhs_color>rhs_color));
+    };
+  }else
+  {
+    sortfcn = boost::bind( &PeakModel::compare, boost::placeholders::_1, boost::placeholders::_2,
+                          m_sortColumn, order, data );
+  }//if( m_sortColumn == kRoiCounts ) / else ...
 
   layoutAboutToBeChanged().emit();
   stable_sort( m_sortedPeaks.begin(), m_sortedPeaks.end(), sortfcn );
@@ -3229,7 +3328,9 @@ bool PeakModel::compare( const PeakShrdPtr &lhs, const PeakShrdPtr &rhs,
     case kHasSkew:
       return (asscend ? lhs->skewType()<rhs->skewType() : lhs->skewType()>rhs->skewType());
     case kSkewAmount:
-      return true;
+      // Skew amount isnt comparable between skew types; treat all as equal (returning true here
+      //  would not be a valid strict weak ordering for std::sort)
+      return false;
     case kType:
       return (asscend ? lhs->gausPeak()<rhs->gausPeak() : lhs->gausPeak()>rhs->gausPeak());
     case kLowerX:
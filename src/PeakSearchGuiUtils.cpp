@@ -26,6 +26,7 @@
 #include <deque>
 #include <string>
 #include <memory>
+#include <atomic>
 #include <functional>
 
 #include <Wt/WText>
@@ -48,6 +49,7 @@
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/StringAlgo.h"
 
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/SpecMeas.h"
@@ -2493,8 +2495,18 @@ void automated_search_for_peaks( InterSpec *viewer,
                         "</div>";
   SimpleDialog *msg = new SimpleDialog( title, content );
   msg->rejectWhenEscapePressed();
+  
+  //We'll show how far along the search is, as each wave of candidate peaks gets fit.
+  WText *progressTxt = new WText( "", msg->contents() );
+  progressTxt->addStyleClass( "content" );
+  progressTxt->setInline( false );
+  
   msg->addButton( "Close" );
   
+  //The dialog (and hence progressTxt) is deleted once it is closed, so keep track of this
+  auto msg_closed = std::make_shared<bool>( false );
+  msg->finished().connect( std::bind( [msg_closed](){ *msg_closed = true; } ) );
+  
   //Make it so users cant keep clicking the search button
   viewer->automatedPeakSearchStarted();
   
@@ -2530,11 +2542,28 @@ void automated_search_for_peaks( InterSpec *viewer,
   std::weak_ptr<const SpecUtils::Measurement> weakdata = dataPtr;
   const string seshid = wApp->sessionId();
   
-  server->ioService().boost::asio::io_service::post( std::bind( [=](){
-    search_for_peaks_worker( weakdata, drf, startingPeaks, displayed, setColor,
-                            searchresults, callback, seshid, false );
+  //Called from the worker thread, so we post the text update to the session; there is no point
+  //  posting an update if one is already pending.
+  auto progress_pending = std::make_shared<std::atomic<bool>>( false );
+  const std::function<void(size_t,size_t)> progress = [=]( size_t ndone, size_t ntotal ){
+    if( progress_pending->exchange( true ) )
+      return;
     
-  } ) );
+    server->post( seshid, [=](){
+      progress_pending->store( false );
+      if( *msg_closed )
+        return;
+      
+      progressTxt->setText( "Fit " + std::to_string(ndone) + " of " + std::to_string(ntotal)
+                            + " candidate peaks." );
+      wApp->triggerUpdate();
+    } );
+  };//progress
+  
+  ComputeScheduler::post( seshid, ComputeScheduler::Priority::Interactive, [=](){
+    search_for_peaks_worker( weakdata, drf, startingPeaks, displayed, setColor,
+                            searchresults, callback, seshid, false, progress );
+  } );
 }//void automated_search_for_peaks( InterSpec *interspec, const bool keep_old_peaks )
 
   
@@ -2696,7 +2725,8 @@ void search_for_peaks_worker( std::weak_ptr<const SpecUtils::Measurement> weak_d
                                std::shared_ptr<std::vector<std::shared_ptr<const PeakDef> > > resultpeaks,
                                boost::function<void(void)> callback,
                                const std::string sessionID,
-                               const bool singleThread )
+                               const bool singleThread,
+                               const std::function<void(size_t,size_t)> progress )
 {
   Wt::WServer *server = Wt::WServer::instance();
   if( !server )  //shouldnt ever happen,
@@ -2712,7 +2742,7 @@ void search_for_peaks_worker( std::weak_ptr<const SpecUtils::Measurement> weak_d
   
   try
   {
-    *resultpeaks = ExperimentalAutomatedPeakSearch::search_for_peaks( data, drf, existingPeaks, singleThread );
+    *resultpeaks = ExperimentalAutomatedPeakSearch::search_for_peaks( data, drf, existingPeaks, singleThread, progress );
     
     assign_srcs_from_ref_lines( data, resultpeaks, displayed, setColor, false, true );
   }catch( std::exception &e )
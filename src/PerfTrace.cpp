@@ -0,0 +1,249 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+#include <Wt/WApplication>
+
+#include "InterSpec/PerfTrace.h"
+
+using namespace std;
+
+namespace
+{
+  /** Number of events each thread keeps; at 40 bytes each, this is ~160 kB a thread. */
+  const size_t ns_events_per_thread = 4096;
+  
+  /** Buffers of exited threads are kept (so their events can still be downloaded) until there are
+   more than this many buffers.
+   */
+  const size_t ns_max_thread_buffers = 128;
+  
+  struct TraceEvent
+  {
+    const char *m_name;
+    int64_t m_start_us;
+    int64_t m_duration_us;
+    
+    /** First 8 characters of the session ID, null terminated; empty if unknown. */
+    char m_session[9];
+  };//struct TraceEvent
+  
+  
+  struct ThreadBuffer
+  {
+    /** Only contended while traces are being retrieved. */
+    std::mutex m_mutex;
+    int m_thread_index;
+    size_t m_next;
+    bool m_wrapped;
+    std::vector<TraceEvent> m_events;
+    
+    explicit ThreadBuffer( const int index )
+      : m_thread_index( index ), m_next( 0 ), m_wrapped( false ), m_events( ns_events_per_thread )
+    {
+    }
+  };//struct ThreadBuffer
+  
+  
+  std::mutex ns_buffers_mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> ns_buffers;
+  int ns_next_thread_index = 0;
+  
+  thread_local std::shared_ptr<ThreadBuffer> tl_buffer;
+  thread_local const std::string *tl_session = nullptr;
+  
+  
+  ThreadBuffer &thread_buffer()
+  {
+    if( !tl_buffer )
+    {
+      std::lock_guard<std::mutex> lock( ns_buffers_mutex );
+      
+      // Drop buffers of threads that have exited, oldest first, if we have too many.
+      for( auto iter = begin(ns_buffers); (ns_buffers.size() >= ns_max_thread_buffers) && (iter != end(ns_buffers)); )
+        iter = (iter->use_count() == 1) ? ns_buffers.erase( iter ) : (iter + 1);
+      
+      tl_buffer = make_shared<ThreadBuffer>( ns_next_thread_index++ );
+      ns_buffers.push_back( tl_buffer );
+    }//if( !tl_buffer )
+    
+    return *tl_buffer;
+  }//ThreadBuffer &thread_buffer()
+  
+  
+  void append_json_string( std::ostream &out, const char *str )
+  {
+    out << '"';
+    for( ; str && *str; ++str )
+    {
+      const char c = *str;
+      if( (c == '"') || (c == '\\') )
+        out << '\\' << c;
+      else if( static_cast<unsigned char>(c) >= 0x20 )
+        out << c;
+    }
+    out << '"';
+  }//append_json_string(...)
+}//namespace
+
+
+namespace PerfTrace
+{
+int64_t now_us()
+{
+  const auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>( since_epoch ).count();
+}//int64_t now_us()
+
+
+void record( const char *name, const int64_t start_us, const int64_t duration_us )
+{
+  ThreadBuffer &buffer = thread_buffer();
+  
+  TraceEvent event;
+  event.m_name = name;
+  event.m_start_us = start_us;
+  event.m_duration_us = duration_us;
+  event.m_session[0] = '\0';
+  
+  const std::string *session = tl_session;
+  
+  Wt::WApplication *app = session ? nullptr : Wt::WApplication::instance();
+  if( app )
+    session = &app->sessionId();
+  
+  if( session )
+  {
+    const size_t len = std::min( session->size(), sizeof(event.m_session) - 1 );
+    std::copy( session->data(), session->data() + len, event.m_session );
+    event.m_session[len] = '\0';
+  }//if( session )
+  
+  std::lock_guard<std::mutex> lock( buffer.m_mutex );
+  buffer.m_events[buffer.m_next] = event;
+  buffer.m_next += 1;
+  if( buffer.m_next >= buffer.m_events.size() )
+  {
+    buffer.m_next = 0;
+    buffer.m_wrapped = true;
+  }
+}//void record(...)
+
+
+std::string chrome_trace_json( const std::string &session_prefix )
+{
+  vector<shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock( ns_buffers_mutex );
+    buffers = ns_buffers;
+  }
+  
+  std::ostringstream json;
+  json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  
+  bool first_event = true;
+  for( const shared_ptr<ThreadBuffer> &buffer : buffers )
+  {
+    vector<TraceEvent> events;
+    {
+      std::lock_guard<std::mutex> lock( buffer->m_mutex );
+      if( buffer->m_wrapped )
+        events.insert( end(events), begin(buffer->m_events) + buffer->m_next, end(buffer->m_events) );
+      events.insert( end(events), begin(buffer->m_events), begin(buffer->m_events) + buffer->m_next );
+    }
+    
+    for( const TraceEvent &event : events )
+    {
+      if( !session_prefix.empty()
+         && (strncmp( event.m_session, session_prefix.c_str(), std::min(session_prefix.size(), size_t(8)) ) != 0) )
+        continue;
+      
+      json << (first_event ? "\n" : ",\n") << "{\"name\": ";
+      append_json_string( json, event.m_name );
+      json << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->m_thread_index
+           << ", \"ts\": " << event.m_start_us << ", \"dur\": " << event.m_duration_us;
+      if( event.m_session[0] )
+      {
+        json << ", \"args\": {\"session\": ";
+        append_json_string( json, event.m_session );
+        json << "}";
+      }
+      json << "}";
+      first_event = false;
+    }//for( const TraceEvent &event : events )
+  }//for( const shared_ptr<ThreadBuffer> &buffer : buffers )
+  
+  json << "\n]}";
+  
+  return json.str();
+}//std::string chrome_trace_json( const std::string &session_prefix )
+
+
+void clear()
+{
+  std::lock_guard<std::mutex> lock( ns_buffers_mutex );
+  for( const shared_ptr<ThreadBuffer> &buffer : ns_buffers )
+  {
+    std::lock_guard<std::mutex> buffer_lock( buffer->m_mutex );
+    buffer->m_next = 0;
+    buffer->m_wrapped = false;
+  }
+}//void clear()
+
+
+ScopedTimer::ScopedTimer( const char *name )
+  : m_name( name ),
+  m_start_us( now_us() )
+{
+}
+
+
+ScopedTimer::~ScopedTimer()
+{
+  record( m_name, m_start_us, now_us() - m_start_us );
+}
+
+
+SessionScope::SessionScope( const std::string &session_id )
+  : m_previous( tl_session )
+{
+  tl_session = &session_id;
+}
+
+
+SessionScope::~SessionScope()
+{
+  tl_session = m_previous;
+}
+}//namespace PerfTrace
@@ -771,7 +771,7 @@ double stringToTimeDurationPossibleHalfLife( std::string str,
     //  ex 'P1Y2M2W3DT10H30M10.1S', '-P1347M', 'PT1M'
     
     boost::smatch matches;
-    boost::regex expression( ISO_8601_DURATION_REGEX );
+    static const boost::regex expression( ISO_8601_DURATION_REGEX );
     if( boost::regex_search( str, matches, expression ) )
     {
       assert( matches.size() == 9 );
@@ -842,7 +842,7 @@ double stringToTimeDurationPossibleHalfLife( std::string str,
   
   
 
-  const string time_regex ="\\s*((\\+|\\-)?((\\d+(\\.\\d*)?)|(\\.\\d*))(?:[Ee][+\\-]?\\d+)?)"
+  const char * const time_regex ="\\s*((\\+|\\-)?((\\d+(\\.\\d*)?)|(\\.\\d*))(?:[Ee][+\\-]?\\d+)?)"
                             "\\s*("
                             "ps|picosecond|pico\\-*sec|pico\\-*second"
                             "|ns|nano\\-*second|nano\\-*sec"
@@ -855,7 +855,7 @@ double stringToTimeDurationPossibleHalfLife( std::string str,
                             "\\s*((\\+|\\-)?(((\\d+(\\.\\d*)?)|(\\.\\d*)).*))?";
   
   boost::smatch matches;
-  boost::regex expression( time_regex );
+  static const boost::regex expression( time_regex );
   if( boost::regex_match( str, matches, expression ) )
   {
     //for( size_t i = 0; i < matches.size(); ++i )
@@ -920,9 +920,9 @@ double stringToTimeDurationPossibleHalfLife( std::string str,
     //If we are here, it may be the case the user didnt enter any units
     //  which is okay only if they mean for zero time, so well check
     //  for that case, and if not throw an exception.
-    const string zero_regex ="(?|\\+|\\-)?0+(?|\\.0*)*";
+    const char * const zero_regex ="(?|\\+|\\-)?0+(?|\\.0*)*";
     boost::smatch zeromatches;
-    boost::regex xeroexpression( zero_regex );
+    static const boost::regex xeroexpression( zero_regex );
     if( boost::regex_match( str, zeromatches, xeroexpression ) )
       time_dur = 0.0;
     else
@@ -941,7 +941,7 @@ double stringToActivity( std::string str, double bq_def )
 {
   SpecUtils::trim( str );
   boost::smatch mtch;
-  boost::regex expr( "(" POS_DECIMAL_REGEX ")" "\\s*([a-zA-Z \\-]+)" );
+  static const boost::regex expr( "(" POS_DECIMAL_REGEX ")" "\\s*([a-zA-Z \\-]+)" );
   
   /*
    // 20231113: A shorter and probably more robust implementation of this function is commented
@@ -1081,7 +1081,7 @@ double stringToDistance( std::string str, double cm_definition )
   = "\\s*(([+\\-]?\\s*0\\s*)|(((" POS_DECIMAL_REGEX ")\\s*(" DIST_UNITS_REGEX "))(\\s*" POS_DECIMAL_REGEX ".+)*\\s*))";
   
   boost::smatch matches;
-  boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
+  static const boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
 
   if( !boost::regex_match( str, matches, expression ) )
   {
@@ -1177,14 +1177,14 @@ double stringToAbsorbedDose( const std::string &str, const double gray_definitio
   }
   */
   
-  const string regex_str ="\\s*\\+?(\\d+(\\.\\d*)?(?:[Ee][+\\-]?\\d+)?)"
+  const char * const regex_str ="\\s*\\+?(\\d+(\\.\\d*)?(?:[Ee][+\\-]?\\d+)?)"
                             "\\s*(" METRIC_PREFIX_UNITS ")*?"
                             "\\s*\\-*\\s*"
                             ABSORBED_DOSE_UNIT_REGEX
                             "\\s*(\\d.+)?";
   
   boost::smatch matches;
-  boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
+  static const boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
 
   if( !boost::regex_match( str, matches, expression ) )
   {
@@ -1251,14 +1251,14 @@ double stringToEquivalentDose( const std::string &str, const double sievert_defi
                << " and " << PhysicalUnits::printToBestEquivalentDoseUnits(val,4,false) << std::endl;
    }
    */
-  const string regex_str = "\\s*\\+?(\\d+(\\.\\d*)?(?:[Ee][+\\-]?\\d+)?)"
+  const char * const regex_str = "\\s*\\+?(\\d+(\\.\\d*)?(?:[Ee][+\\-]?\\d+)?)"
                              "\\s*(" METRIC_PREFIX_UNITS ")*?"
                              "\\s*\\-*\\s*"
                              EQUIVALENT_DOSE_UNIT_REGEX
                              "\\s*(\\d.+)?";
   
   boost::smatch matches;
-  boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
+  static const boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
 
   if( !boost::regex_match( str, matches, expression ) )
   {
@@ -1313,7 +1313,7 @@ double stringToEquivalentDose( const std::string &str, const double sievert_defi
 
 double stringToMass( const std::string &str, const double gram_def )
 {
-  const string regex_str =
+  const char * const regex_str =
   "(" DECIMAL_REGEX ")\\s*"
   "(" METRIC_PREFIX_UNITS ")*?"
   "\\s*\\-*\\s*"
@@ -1321,7 +1321,7 @@ double stringToMass( const std::string &str, const double gram_def )
   "(" DECIMAL_REGEX ".+)?";
   
   boost::smatch matches;
-  boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
+  static const boost::regex expression( regex_str, boost::regex::ECMAScript|boost::regex::icase );
 
   if( !boost::regex_match( str, matches, expression ) )
   {
@@ -1371,14 +1371,14 @@ double stringToMass( const std::string &str, const double gram_def )
 
 double stringToEnergy( const std::string &str, const double keV_def )
 {
-  const string regex_str = "(" DECIMAL_REGEX ")"
+  const char * const regex_str = "(" DECIMAL_REGEX ")"
                            "\\s*(k|M|killo|mega)?"
                            "\\s*\\-*\\s*"
                            "(eV|electron-volts|electronvolts)"
                            "\\s*(" DECIMAL_REGEX ".+)?";
 
   boost::smatch matches;
-  boost::regex expression( regex_str, boost::regex::ECMAScript | boost::regex::icase );
+  static const boost::regex expression( regex_str, boost::regex::ECMAScript | boost::regex::icase );
 
   if( !boost::regex_match( str, matches, expression ) )
   {
@@ -181,7 +181,7 @@ namespace PhysicalUnitsLocalized
     
     // "[^\\s\\d\\+-]" means anything but space number , or +-.  We want something like \\w, but
     //  \\w wont work for non-ascii characters forming a word.  Also, we want to allow like "half lives", or "demi vie"
-    std::regex regex( "(?:^|\\s|,|\\+|-)((" PARTIAL_DECIMAL_REGEX ")\\s*([^\\s\\d\\+]+([\\s-]?[^\\s\\d\\+-]+)?))" );
+    static const std::regex regex( "(?:^|\\s|,|\\+|-)((" PARTIAL_DECIMAL_REGEX ")\\s*([^\\s\\d\\+]+([\\s-]?[^\\s\\d\\+-]+)?))" );
     std::sregex_iterator iter( begin(str), end(str), regex );
     const std::sregex_iterator str_end;
     
@@ -268,7 +268,7 @@ namespace PhysicalUnitsLocalized
   {
     const string en_val = PhysicalUnits::printToBestTimeUnits( time, maxNpostDecimal, sec_def );
 
-    std::regex regex( "(?:^|\\s|,|\\+|-)((" PARTIAL_DECIMAL_REGEX "\\s*)([^\\s\\d\\+-]+))" );
+    static const std::regex regex( "(?:^|\\s|,|\\+|-)((" PARTIAL_DECIMAL_REGEX "\\s*)([^\\s\\d\\+-]+))" );
     std::sregex_iterator iter( begin(en_val), end(en_val), regex );
     const std::sregex_iterator str_end;
     
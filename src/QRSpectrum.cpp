@@ -24,6 +24,7 @@
 #include "InterSpec_config.h"
 
 #include <cstdio>
+#include <memory>
 #include <fstream>
 #include <iomanip>
 #include <numeric>
@@ -48,9 +49,10 @@
 #include "InterSpec/QRSpectrum.h"
 
 
+#include "SpecUtils/SpecUtilsAsync.h"
+
 // Headers only needed for `int dev_code();`
 #include <mutex>
-#include "SpecUtils/SpecUtilsAsync.h"
 
 
 using namespace std;
@@ -62,6 +64,40 @@ namespace
 {
   const int sm_qr_quite_area = 3;
   
+  
+  /** Returns if the text could possibly be encoded into a (version 40, the largest) QR code at the
+   given error correction level.
+   
+   This mirrors the segment choice of qrcodegen::QrCode::encodeText (a single numeric,
+   alphanumeric, or byte segment), so is exact, but only takes a pass over the text, rather than
+   actually running the QR generator (which is relatively expensive).
+   */
+  bool fits_in_qr_code( const std::string &text, const qrcodegen::QrCode::Ecc ecc )
+  {
+    // Data codewords, for version 40, at each error correction level
+    size_t num_data_bytes = 0;
+    switch( ecc )
+    {
+      case qrcodegen::QrCode::Ecc::LOW:      num_data_bytes = 2956; break;
+      case qrcodegen::QrCode::Ecc::MEDIUM:   num_data_bytes = 2334; break;
+      case qrcodegen::QrCode::Ecc::QUARTILE: num_data_bytes = 1666; break;
+      case qrcodegen::QrCode::Ecc::HIGH:     num_data_bytes = 1276; break;
+    }//switch( ecc )
+    
+    const size_t nchars = text.size();
+    
+    // 4 bits mode indicator, plus the character count field size (for versions 27 through 40)
+    size_t num_bits = 0;
+    if( qrcodegen::QrSegment::isNumeric( text.c_str() ) )
+      num_bits = 4 + 14 + 10*(nchars/3) + (((nchars % 3) == 2) ? 7 : (((nchars % 3) == 1) ? 4 : 0));
+    else if( qrcodegen::QrSegment::isAlphanumeric( text.c_str() ) )
+      num_bits = 4 + 13 + 11*(nchars/2) + 6*(nchars % 2);
+    else
+      num_bits = 4 + 16 + 8*nchars;
+    
+    return (num_bits <= 8*num_data_bytes);
+  }//bool fits_in_qr_code( const std::string &text, const qrcodegen::QrCode::Ecc ecc )
+  
 
   void make_example_qr_codes()
   {
@@ -380,62 +416,87 @@ std::vector<QrCodeEncodedSpec> qr_code_encode_spectra( const std::vector<SpecUti
   vector<string> urls;
   vector<qrcodegen::QrCode> qrs;
 
+  // We will start with the fewest number of parts the data could possibly fit in (any fewer parts
+  //  and some part would be too large, by just counting characters); for large spectra this
+  //  avoids re-encoding (i.e., re-DEFLATE'ing) the spectrum, and running the QR generator, for
+  //  part-counts that cant possibly work.
+  const size_t max_parts = (measurements.size() == 1) ? 9 : 1;
+  
+  vector<string> single_url = SpecUtils::url_encode_spectra( measurements, encode_options, 1 );
+  assert( single_url.size() == 1 );
+  if( single_url.size() != 1 )
+    throw std::logic_error( "Unexpected number of URLs" );
+  
+  // Splitting into parts changes the per-part overhead and compression a little, so be
+  //  conservative, and assume the parts could be about 10% smaller than an even split.
+  const size_t single_len = single_url[0].size();
+  size_t min_parts = 1;
+  while( (min_parts < max_parts)
+        && !fits_in_qr_code( single_url[0].substr( 0, (9*single_len) / (10*min_parts) ), ecc ) )
+    ++min_parts;
   
   //Now need to check that it will encode into a QR
   bool success_encoding = false;
-  const size_t max_parts = (measurements.size() == 1) ? 9 : 1;
-  for( size_t num_parts = 1; !success_encoding && (num_parts <= max_parts); ++num_parts )
+  for( size_t num_parts = min_parts; !success_encoding && (num_parts <= max_parts); ++num_parts )
   {
-    urls = SpecUtils::url_encode_spectra( measurements, encode_options, num_parts );
+    urls = (num_parts == 1) ? single_url : SpecUtils::url_encode_spectra( measurements, encode_options, num_parts );
     assert( urls.size() == num_parts );
     if( urls.size() != num_parts )
       throw std::logic_error( "Unexpected number of URLs" );
     
     qrs.clear();
     
+    // Skip running the QR generator if we already know a part wont fit
     bool all_urls_small_enough = true;
+    for( size_t url_num = 0; all_urls_small_enough && (url_num < urls.size()); ++url_num )
+      all_urls_small_enough = fits_in_qr_code( urls[url_num], ecc );
     
-    for( size_t url_num = 0; url_num < urls.size(); ++url_num )
-    {
+    if( !all_urls_small_enough )
+      continue;
+    
+    // The QR codes for each part are independent, so generate them in parallel.
+    // It looks like qrcodegen::QrCode::encodeText(...) will default to binary if the input isnt text
+    vector<unique_ptr<qrcodegen::QrCode>> part_qrs( urls.size() );
+    
+    auto encode_part = [&urls,&part_qrs,ecc]( const size_t url_num ){
       try
       {
-        // It looks like qrcodegen::QrCode::encodeText(...) will default to binary if the input isnt text
-        //if( alpha_num_qr_encode )
-        //{
-        qrs.push_back( qrcodegen::QrCode::encodeText( urls[url_num].c_str(), ecc ) );
-        //}else
-        //{
-        // qrcodegen::QrCode::encodeBinary: The maximum number of bytes allowed is 2953
-        //  vector<uint8_t> data( url.size() );
-        //  memcpy( &(data[0]), &(url[0]), url.size() );
-        //  qrs.push_back( qrcodegen::QrCode::encodeBinary( data, ecc ) );
-        //}
+        part_qrs[url_num].reset( new qrcodegen::QrCode( qrcodegen::QrCode::encodeText( urls[url_num].c_str(), ecc ) ) );
       }catch( ... )
       {
-        all_urls_small_enough = false;
-        break;
+        // Leave part_qrs[url_num] as nullptr to indicate failure
       }
+    };//encode_part
+    
+    if( urls.size() == 1 )
+    {
+      encode_part( 0 );
+    }else
+    {
+      SpecUtilsAsync::ThreadPool pool;
+      for( size_t url_num = 0; url_num < urls.size(); ++url_num )
+        pool.post( [&encode_part,url_num](){ encode_part( url_num ); } );
+      pool.join();
+    }//if( urls.size() == 1 ) / else
+    
+    for( size_t url_num = 0; all_urls_small_enough && (url_num < urls.size()); ++url_num )
+    {
+      if( part_qrs[url_num] )
+        qrs.push_back( std::move( *part_qrs[url_num] ) );
+      else
+        all_urls_small_enough = false;
     }//for( size_t url_num = 0; url_num < urls.size(); ++url_num )
     
     success_encoding = all_urls_small_enough;
-  }//for( size_t num_parts = 0; num_parts < 10; ++num_parts )
+  }//for( size_t num_parts = min_parts; ...; ++num_parts )
   
   if( !success_encoding )
   {
-    vector<string> urlv;
-    try
-    {
-      urlv = url_encode_spectra( measurements, encode_options, 1 );
-    }catch( std::exception & )
-    {
-      assert( 0 );
-    }
-    
     throw runtime_error( "qr_code_encode_spectra: Failed to encode "
                         + std::to_string(measurements.size())+ " spectra into a max of "
                         + std::to_string(max_parts) + "QR codes at the desired error"
                         " correction level (len(url)="
-                        + std::to_string( urlv.empty() ? size_t(0) : urlv[0].size() ) + ")" );
+                        + std::to_string( single_url[0].size() ) + ")" );
   }//if( !success_encoding )
   
   // See how much data we are actually getting into a URL
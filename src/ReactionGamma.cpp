@@ -25,6 +25,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -41,9 +42,30 @@
 
 using namespace std;
 
+namespace
+{
+  /** Parses a float from the start of a (null terminated) string, ignoring leading whitespace;
+   used instead of a stringstream since the reaction file has tens of thousands of values.
+   */
+  bool parse_float( const char *str, float &value )
+  {
+    if( !str )
+      return false;
+    
+    char *end = nullptr;
+    const float val = strtof( str, &end );
+    if( end == str )
+      return false;
+    
+    value = val;
+    return true;
+  }//bool parse_float( const char *str, float &value )
+}//namespace
+
 string ReactionGammaServer::sm_xmlFileLocation = "data/sandia.reactiongamma.xml";
 std::mutex ReactionGammaServer::sm_dataBaseMutex;
 std::unique_ptr<ReactionGamma> ReactionGammaServer::sm_dataBase;
+std::atomic<const ReactionGamma *> ReactionGammaServer::sm_dataBasePtr( nullptr );
 
 /*
 void print_reaction( std::string name )
@@ -74,9 +96,10 @@ void ReactionGammaServer::set_xml_file_location( const std::string &filename )
 
 const ReactionGamma *ReactionGammaServer::database()
 {
-  //is it thread safe to test if a scoped_ptr is valid?
-  //  -if so we could avoid getting the thread lock here, and only get it if
-  //   we have to create the ReactionGamma object
+  const ReactionGamma *ready = sm_dataBasePtr.load( std::memory_order_acquire );
+  if( ready )
+    return ready;
+  
   std::unique_lock<std::mutex> lock( sm_dataBaseMutex );
 
   if( sm_dataBase )
@@ -85,11 +108,25 @@ const ReactionGamma *ReactionGammaServer::database()
   const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
 
   sm_dataBase.reset( new ReactionGamma( sm_xmlFileLocation, db ) );
+  sm_dataBasePtr.store( sm_dataBase.get(), std::memory_order_release );
 
   return sm_dataBase.get();
 }//database()
 
 
+void ReactionGammaServer::initialize()
+{
+  try
+  {
+    database();
+  }catch( std::exception &e )
+  {
+    cerr << "ReactionGammaServer::initialize(): failed to load '" << sm_xmlFileLocation
+         << "': " << e.what() << endl;
+  }
+}//void initialize()
+
+
 ReactionGammaServer::ReactionGammaServer()
 {
   throw runtime_error( "A ReactionGammaServer object "
@@ -336,9 +373,13 @@ std::string ReactionGamma::gammas( const string &name,
 
   const SandiaDecay::SandiaDecayDataBase *db = m_decayDatabase;
 
-  const vector<const Reaction *> &reactions = m_reactions[reaction_type];
-  for( const Reaction *rctn : reactions )
+  // Only reactions on this element (or its nuclides) can match
+  const int atomic_number = el ? static_cast<int>(el->atomicNumber) : static_cast<int>(nuc->atomicNumber);
+  for( const Reaction *rctn : reactions_for_atomic_number( atomic_number ) )
   {
+    if( rctn->type != reaction_type )
+      continue;
+    
     const SandiaDecay::Element *rctn_el = rctn->targetElement;
     const SandiaDecay::Nuclide *rctn_nuc = rctn->targetNuclide;
 
@@ -397,18 +438,13 @@ void ReactionGamma::reactions( const SandiaDecay::Element *el,
   if( !el )
     return;
 
-  for( ReactionType type = ReactionType(0);
-       type < NumReactionType;
-       type = ReactionType(type+1) )
+  for( const Reaction *rctn : reactions_for_atomic_number( el->atomicNumber ) )
   {
-    for( const Reaction *rctn : m_reactions[type] )
-    {
-      const SandiaDecay::Nuclide *nuc = rctn->targetNuclide;
-      if( (rctn->targetElement==el)
-          || (nuc && (nuc->atomicNumber==el->atomicNumber)) )
-        answer.push_back( rctn );
-    }//for( const Reaction *rctn : rctns )
-  }//for( loop over ReactionType )
+    const SandiaDecay::Nuclide *nuc = rctn->targetNuclide;
+    if( (rctn->targetElement==el)
+        || (nuc && (nuc->atomicNumber==el->atomicNumber)) )
+      answer.push_back( rctn );
+  }//for( const Reaction *rctn : reactions_for_atomic_number(...) )
 }//reactions(...)
 
 
@@ -418,19 +454,27 @@ void ReactionGamma::reactions( const SandiaDecay::Nuclide *nuc,
   if( !nuc )
     return;
 
-  for( ReactionType type = ReactionType(0);
-       type < NumReactionType;
-       type = ReactionType(type+1) )
+  for( const Reaction *rctn : reactions_for_atomic_number( nuc->atomicNumber ) )
   {
-    for( const Reaction *rctn : m_reactions[type] )
-    {
-      if( rctn->targetNuclide == nuc )
-        answer.push_back( rctn );
-    }//for( const Reaction *rctn : rctns )
-  }//for( loop over ReactionType )
+    if( rctn->targetNuclide == nuc )
+      answer.push_back( rctn );
+  }//for( const Reaction *rctn : reactions_for_atomic_number(...) )
 }//reactions(...)
 
 
+const vector<const ReactionGamma::Reaction *> &ReactionGamma::reactions_for_atomic_number(
+                                                              const int atomic_number ) const
+{
+  static const vector<const Reaction *> s_empty;
+  
+  if( (atomic_number < 0)
+     || (static_cast<size_t>(atomic_number) >= m_reactionsByAtomicNumber.size()) )
+    return s_empty;
+  
+  return m_reactionsByAtomicNumber[atomic_number];
+}//reactions_for_atomic_number(...)
+
+
 const vector<const ReactionGamma::Reaction *> &ReactionGamma::reactions(
                                                        ReactionType type ) const
 {
@@ -603,7 +647,7 @@ void ReactionGamma::populate_reaction( const rapidxml::xml_node<char> *parent,
         {
           const string str = enode->value();
           Reaction::EnergyYield val;
-          if( !(stringstream(str) >> val.energy) )
+          if( !parse_float( enode->value(), val.energy ) )
             throw runtime_error( "ReactionGamma::populate_reaction(...) "
                                  "Couldnt convert " + str + " to a float" );
           val.energy *= static_cast<float>(PhysicalUnits::keV);
@@ -628,7 +672,7 @@ void ReactionGamma::populate_reaction( const rapidxml::xml_node<char> *parent,
                                  "energies than yields" );
 
           const string str = ynode->value();
-          if( !(stringstream(str) >> rctn.gammas[yeild_num].abundance) )
+          if( !parse_float( ynode->value(), rctn.gammas[yeild_num].abundance ) )
             throw runtime_error( "ReactionGamma::populate_reaction(...) Couldnt"
                                  " convert '" + str + "' to a float" );
           rctn.gammas[yeild_num].abundance /= 100.0;
@@ -699,4 +743,22 @@ void ReactionGamma::init( const string &input )
   annrctn->gammas.back().energy = 510.99891f;
   annrctn->gammas.back().abundance = 1.0f;
   m_reactions[AnnihilationReaction].push_back( annrctn );
+  
+  for( ReactionType type = ReactionType(0);
+       type < NumReactionType;
+       type = ReactionType(type+1) )
+  {
+    for( const Reaction *rctn : m_reactions[type] )
+    {
+      const SandiaDecay::Element *el = rctn->targetElement;
+      const SandiaDecay::Nuclide *nuc = rctn->targetNuclide;
+      if( !el && !nuc )
+        continue;
+      
+      const size_t atomic_number = nuc ? nuc->atomicNumber : el->atomicNumber;
+      if( atomic_number >= m_reactionsByAtomicNumber.size() )
+        m_reactionsByAtomicNumber.resize( atomic_number + 1 );
+      m_reactionsByAtomicNumber[atomic_number].push_back( rctn );
+    }//for( const Reaction *rctn : m_reactions[type] )
+  }//for( loop over ReactionType )
 }//void ReactionGamma::init(...)
@@ -0,0 +1,230 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/RebinMapping.h"
+
+using namespace std;
+
+namespace
+{
+  struct CachedMapping
+  {
+    std::weak_ptr<const SpecUtils::EnergyCalibration> m_orig_cal;
+    std::weak_ptr<const SpecUtils::EnergyCalibration> m_new_cal;
+    std::shared_ptr<const RebinMapping> m_mapping;
+  };//struct CachedMapping
+  
+  /** Maximum number of mappings to keep; a mapping for two 16k channel spectra is ~200 kB. */
+  const size_t ns_max_cached_mappings = 32;
+  
+  std::mutex ns_cache_mutex;
+  
+  /** Most recently used mapping at the front. */
+  std::list<CachedMapping> ns_cached_mappings;
+}//namespace
+
+
+RebinMapping::RebinMapping( const std::vector<float> &orig_edges,
+                            const std::vector<float> &new_edges )
+  : m_num_input_channels( 0 ),
+    m_first_input(),
+    m_weight_start(),
+    m_weights()
+{
+  if( orig_edges.size() < 3 )
+    throw runtime_error( "RebinMapping: input binning must have at least two channels." );
+  
+  if( new_edges.size() < 3 )
+    throw runtime_error( "RebinMapping: output binning must have at least two channels." );
+  
+  if( !std::is_sorted( begin(orig_edges), end(orig_edges) )
+      || !std::is_sorted( begin(new_edges), end(new_edges) ) )
+    throw runtime_error( "RebinMapping: channel energies must be non-decreasing." );
+  
+  m_num_input_channels = orig_edges.size() - 1;
+  const size_t num_output = new_edges.size() - 1;
+  
+  m_first_input.resize( num_output, 0 );
+  m_weight_start.resize( num_output + 1, 0 );
+  m_weights.reserve( num_output + m_num_input_channels );
+  
+  // Both binnings are sorted, so we can walk them together, only ever moving forward.
+  size_t first_input = 0;
+  for( size_t out = 0; out < num_output; ++out )
+  {
+    const double out_lower = new_edges[out];
+    const double out_upper = new_edges[out+1];
+    
+    while( (first_input < m_num_input_channels) && (orig_edges[first_input+1] <= out_lower) )
+      ++first_input;
+    
+    m_first_input[out] = static_cast<uint32_t>( std::min(first_input, m_num_input_channels - 1) );
+    m_weight_start[out] = static_cast<uint32_t>( m_weights.size() );
+    
+    for( size_t in = first_input; (in < m_num_input_channels) && (orig_edges[in] < out_upper); ++in )
+    {
+      const double in_lower = orig_edges[in];
+      const double in_upper = orig_edges[in+1];
+      const double in_width = in_upper - in_lower;
+      const double overlap = std::min(in_upper, out_upper) - std::max(in_lower, out_lower);
+      
+      // Every weight after the first must be stored (even if zero) so the input channels stay
+      //  contiguous; a zero-width input channel's counts all go to the channel containing it.
+      double frac = (in_width > 0.0) ? (overlap / in_width) : ((in_lower >= out_lower) ? 1.0 : 0.0);
+      frac = std::max( 0.0, std::min( 1.0, frac ) );
+      
+      if( m_weights.size() == m_weight_start[out] )
+        m_first_input[out] = static_cast<uint32_t>( in );
+      m_weights.push_back( static_cast<float>(frac) );
+    }//for( loop over overlapping input channels )
+  }//for( size_t out = 0; out < num_output; ++out )
+  
+  m_weight_start[num_output] = static_cast<uint32_t>( m_weights.size() );
+  m_weights.shrink_to_fit();
+}//RebinMapping constructor
+
+
+void RebinMapping::rebin( const std::vector<float> &orig_counts, std::vector<float> &new_counts ) const
+{
+  if( orig_counts.size() != m_num_input_channels )
+    throw runtime_error( "RebinMapping::rebin: expected " + std::to_string(m_num_input_channels)
+                         + " input channels, but got " + std::to_string(orig_counts.size()) );
+  
+  const size_t num_output = m_first_input.size();
+  new_counts.resize( num_output );
+  
+  const float * const in_counts = orig_counts.data();
+  const float * const weights = m_weights.data();
+  const uint32_t * const first_input = m_first_input.data();
+  const uint32_t * const weight_start = m_weight_start.data();
+  float * const out_counts = new_counts.data();
+  
+  for( size_t out = 0; out < num_output; ++out )
+  {
+    const uint32_t begin_weight = weight_start[out];
+    const uint32_t num_weights = weight_start[out+1] - begin_weight;
+    const float * const in = in_counts + first_input[out];
+    const float * const w = weights + begin_weight;
+    
+    // A plain, fixed-stride inner product, to make it easy for the compiler to vectorize
+    float sum = 0.0f;
+    for( uint32_t i = 0; i < num_weights; ++i )
+      sum += w[i] * in[i];
+    
+    out_counts[out] = sum;
+  }//for( size_t out = 0; out < num_output; ++out )
+}//void rebin(...)
+
+
+size_t RebinMapping::numInputChannels() const
+{
+  return m_num_input_channels;
+}
+
+
+size_t RebinMapping::numOutputChannels() const
+{
+  return m_first_input.size();
+}
+
+
+std::shared_ptr<const RebinMapping> RebinMapping::mapping(
+                           const std::shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                           const std::shared_ptr<const SpecUtils::EnergyCalibration> &new_cal )
+{
+  if( !orig_cal || !new_cal || !orig_cal->valid() || !new_cal->valid() )
+    throw runtime_error( "RebinMapping::mapping: invalid energy calibration." );
+  
+  const shared_ptr<const vector<float>> orig_edges = orig_cal->channel_energies();
+  const shared_ptr<const vector<float>> new_edges = new_cal->channel_energies();
+  if( !orig_edges || !new_edges )
+    throw runtime_error( "RebinMapping::mapping: energy calibration doesnt have channel energies." );
+  
+  {//begin lock on ns_cache_mutex
+    std::lock_guard<std::mutex> lock( ns_cache_mutex );
+    
+    for( auto iter = begin(ns_cached_mappings); iter != end(ns_cached_mappings); )
+    {
+      const shared_ptr<const SpecUtils::EnergyCalibration> cached_orig = iter->m_orig_cal.lock();
+      const shared_ptr<const SpecUtils::EnergyCalibration> cached_new = iter->m_new_cal.lock();
+      
+      if( !cached_orig || !cached_new )
+      {
+        // The calibrations are no longer in use anywhere - clean up the entry
+        iter = ns_cached_mappings.erase( iter );
+        continue;
+      }
+      
+      if( (cached_orig == orig_cal) && (cached_new == new_cal) )
+      {
+        ns_cached_mappings.splice( begin(ns_cached_mappings), ns_cached_mappings, iter );
+        return ns_cached_mappings.front().m_mapping;
+      }
+      
+      ++iter;
+    }//for( loop over cached mappings )
+  }//end lock on ns_cache_mutex
+  
+  // Compute the mapping outside the lock; if another thread computes the same mapping at the same
+  //  time, that is harmless.
+  auto answer = make_shared<const RebinMapping>( *orig_edges, *new_edges );
+  
+  {//begin lock on ns_cache_mutex
+    std::lock_guard<std::mutex> lock( ns_cache_mutex );
+    
+    CachedMapping entry;
+    entry.m_orig_cal = orig_cal;
+    entry.m_new_cal = new_cal;
+    entry.m_mapping = answer;
+    ns_cached_mappings.push_front( std::move(entry) );
+    
+    while( ns_cached_mappings.size() > ns_max_cached_mappings )
+      ns_cached_mappings.pop_back();
+  }//end lock on ns_cache_mutex
+  
+  return answer;
+}//mapping(...)
+
+
+void RebinMapping::rebin( const std::shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                          const std::vector<float> &orig_counts,
+                          const std::shared_ptr<const SpecUtils::EnergyCalibration> &new_cal,
+                          std::vector<float> &new_counts )
+{
+  const shared_ptr<const RebinMapping> map = mapping( orig_cal, new_cal );
+  assert( map );
+  map->rebin( orig_counts, new_counts );
+}//void rebin(...)
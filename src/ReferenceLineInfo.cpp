@@ -23,9 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <list>
 #include <mutex>
 #include <vector>
 #include <string>
+#include <cstring>
 #include <stdexcept>
 
 #include <Wt/WLocale>
@@ -44,8 +47,10 @@
 #include "SpecUtils/RapidXmlUtils.hpp"
 
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/SharedThreadPool.h"
 #include "InterSpec/Integrate.h"
 #include "InterSpec/InterSpec.h"
+#include "InterSpec/ServerMetrics.h"
 #include "InterSpec/MaterialDB.h"
 #include "InterSpec/ReactionGamma.h"
 #include "InterSpec/PhysicalUnits.h"
@@ -673,7 +678,7 @@ const vector<OtherRefLine> &getBackgroundRefLines()
     
     size_t calc_index = 0;
 #if( !USE_PRE_COMPUTED_BACKGROUND_LINE_TRANSPORT )
-    SpecUtilsAsync::ThreadPool pool;
+    SharedThreadPool::TaskGroup pool;
 #endif
     
     for( const SandiaDecay::NuclideActivityPair &nap : activities )
@@ -1790,7 +1795,155 @@ void RefLineInput::setShieldingAttFcn( const MaterialDB *db )
 }//void ReferenceLineInfo::setShieldingAttFcn( const MaterialDB *db )
 
 
+namespace
+{
+  /** Process-wide LRU cache of generated reference lines; the same sources (Cs137, Co60, U235,
+   etc) are looked at over and over, by many sessions, on a busy server.
+   */
+  std::mutex s_ref_line_cache_mutex;
+  std::list<std::pair<std::string,std::shared_ptr<const ReferenceLineInfo>>> s_ref_line_cache;
+  std::map<std::string,decltype(s_ref_line_cache)::iterator> s_ref_line_cache_index;
+  const size_t s_max_ref_line_cache_size = 256;
+  
+  
+  /** Returns a string that uniquely identifies the reference lines that will be generated for
+   `input`.
+   
+   The DRF and shielding functions can not be compared directly, so we instead include their
+   values at a set of energies spanning the range of interest (along with the detector and
+   shielding names); the locale is included since default ages are printed using it.
+   */
+  std::string ref_line_cache_key( const RefLineInput &input )
+  {
+    std::string key;
+    key.reserve( 512 );
+    
+    const auto add_str = [&key]( const std::string &str ){
+      key += str;
+      key += '\x1f';
+    };
+    
+    const auto add_double = [&key]( const double val ){
+      char buffer[sizeof(double)];
+      memcpy( buffer, &val, sizeof(val) );
+      key.append( buffer, sizeof(buffer) );
+    };
+    
+    add_str( SpecUtils::trim_copy( input.m_input_txt ) );
+    add_str( SpecUtils::trim_copy( input.m_age ) );
+    add_str( input.m_color.isDefault() ? std::string() : input.m_color.cssText(true) );
+    add_double( input.m_lower_br_cutt_off );
+    key += input.m_promptLinesOnly ? '1' : '0';
+    key += input.m_showGammas ? '1' : '0';
+    key += input.m_showXrays ? '1' : '0';
+    key += input.m_showAlphas ? '1' : '0';
+    key += input.m_showBetas ? '1' : '0';
+    key += input.m_showCascades ? '1' : '0';
+    add_str( input.m_detector_name );
+    add_str( input.m_shielding_name );
+    add_str( input.m_shielding_thickness );
+    add_str( input.m_shielding_an );
+    add_str( input.m_shielding_ad );
+    add_str( Wt::WLocale::currentLocale().name() );
+    
+    key += input.m_det_intrinsic_eff ? 'D' : 'd';
+    key += input.m_shielding_att ? 'S' : 's';
+    
+    if( input.m_det_intrinsic_eff || input.m_shielding_att )
+    {
+      for( float energy = 10.0f; energy < 10000.0f; energy *= 1.5f )
+      {
+        if( input.m_det_intrinsic_eff )
+          add_double( input.m_det_intrinsic_eff( energy ) );
+        if( input.m_shielding_att )
+          add_double( input.m_shielding_att( energy ) );
+      }
+    }//if( input.m_det_intrinsic_eff || input.m_shielding_att )
+    
+    return key;
+  }//std::string ref_line_cache_key( const RefLineInput &input )
+}//namespace
+
+
 std::shared_ptr<ReferenceLineInfo> ReferenceLineInfo::generateRefLineInfo( RefLineInput input )
+{
+  std::string key;
+  try
+  {
+    key = ref_line_cache_key( input );
+  }catch( std::exception &e )
+  {
+    // The DRF or shielding function may throw for some energies - just dont cache.
+    cerr << "ReferenceLineInfo::generateRefLineInfo: not using cache: " << e.what() << endl;
+  }//try / catch
+  
+  static ServerMetrics::Counter &cache_hits = ServerMetrics::counter( "interspec_cache_lookups_total",
+                                  "Lookups into process-wide caches.", "cache=\"ref_lines\",result=\"hit\"" );
+  static ServerMetrics::Counter &cache_misses = ServerMetrics::counter( "interspec_cache_lookups_total",
+                                  "Lookups into process-wide caches.", "cache=\"ref_lines\",result=\"miss\"" );
+  
+  if( !key.empty() )
+  {
+    std::lock_guard<std::mutex> lock( s_ref_line_cache_mutex );
+    const auto pos = s_ref_line_cache_index.find( key );
+    if( pos != end(s_ref_line_cache_index) )
+    {
+      cache_hits.increment();
+      s_ref_line_cache.splice( begin(s_ref_line_cache), s_ref_line_cache, pos->second );
+      
+      // Callers may modify the returned lines, so we return a copy, with the callers DRF and
+      //  shielding functions (the cached copy doesnt hold these, as they may reference
+      //  per-session objects).
+      auto answer = make_shared<ReferenceLineInfo>( *pos->second->second );
+      answer->m_input.m_det_intrinsic_eff = input.m_det_intrinsic_eff;
+      answer->m_input.m_shielding_att = input.m_shielding_att;
+      return answer;
+    }//if( in cache )
+    
+    cache_misses.increment();
+  }//if( !key.empty() )
+  
+  shared_ptr<ReferenceLineInfo> answer = generateRefLineInfoNoCache( std::move(input) );
+  
+  if( !key.empty() && answer && (answer->m_validity == InputValidity::Valid) )
+  {
+    auto cached = make_shared<ReferenceLineInfo>( *answer );
+    // Dont keep the DRF, shielding material, or anything else they may reference, alive
+    cached->m_input.m_det_intrinsic_eff = nullptr;
+    cached->m_input.m_shielding_att = nullptr;
+    
+    std::lock_guard<std::mutex> lock( s_ref_line_cache_mutex );
+    const auto pos = s_ref_line_cache_index.find( key );
+    if( pos != end(s_ref_line_cache_index) )
+    {
+      // Another thread generated these same lines while we were; keep its copy
+      s_ref_line_cache.splice( begin(s_ref_line_cache), s_ref_line_cache, pos->second );
+    }else
+    {
+      s_ref_line_cache.emplace_front( key, cached );
+      s_ref_line_cache_index[key] = begin(s_ref_line_cache);
+      
+      while( s_ref_line_cache.size() > s_max_ref_line_cache_size )
+      {
+        s_ref_line_cache_index.erase( s_ref_line_cache.back().first );
+        s_ref_line_cache.pop_back();
+      }
+    }//if( another thread already inserted ) / else
+  }//if( we should cache the answer )
+  
+  return answer;
+}//std::shared_ptr<ReferenceLineInfo> generateRefLineInfo( RefLineInput input )
+
+
+void ReferenceLineInfo::clearCache()
+{
+  std::lock_guard<std::mutex> lock( s_ref_line_cache_mutex );
+  s_ref_line_cache_index.clear();
+  s_ref_line_cache.clear();
+}//void ReferenceLineInfo::clearCache()
+
+
+std::shared_ptr<ReferenceLineInfo> ReferenceLineInfo::generateRefLineInfoNoCache( RefLineInput input )
 {
   // The gamma or xray energy below which we wont show lines for.
   //  x-rays for nuclides were limited at above 10 keV, so we'll just impose this
@@ -2799,7 +2952,7 @@ std::shared_ptr<ReferenceLineInfo> ReferenceLineInfo::generateRefLineInfo( RefLi
   answer.sortByEnergy();
   
   return answer_ptr;
-}//std::shared_ptr<ReferenceLineInfo> generateRefLineInfo()
+}//std::shared_ptr<ReferenceLineInfo> generateRefLineInfoNoCache()
 
 
 vector<string> ReferenceLineInfo::additional_ref_line_sources()
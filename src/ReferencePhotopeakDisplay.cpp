@@ -53,6 +53,7 @@
 
 #include "SandiaDecay/SandiaDecay.h"
 
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/DrfSelect.h"
@@ -1867,7 +1868,12 @@ void ReferencePhotopeakDisplay::updateOtherNucsDisplay()
       case MoreNuclideInfo::InfoStatus::NotInited:
       {
         const string sessionid = wApp->sessionId();
-        boost::function<void()> update_gui = wApp->bind( boost::bind(&ReferencePhotopeakDisplay::updateAssociatedNuclides, this) );
+        const size_t generation = ++m_associatedNucsGeneration;
+        boost::function<void()> update_gui = wApp->bind( boost::function<void()>( [this,generation](){
+          // If the user has since typed in another nuclide, a newer job will do the update
+          if( generation == m_associatedNucsGeneration )
+            updateAssociatedNuclides();
+        } ) );
        
         auto worker = [update_gui, sessionid](){
           const auto infoDb = MoreNuclideInfo::MoreNucInfoDb::instance();
@@ -1885,7 +1891,10 @@ void ReferencePhotopeakDisplay::updateOtherNucsDisplay()
           Wt::WServer::instance()->post( sessionid, inner_worker );
         };//worker
 
-        Wt::WServer::instance()->ioService().boost::asio::io_service::post( worker );
+        // Only the most recent input matters, so drop any not-yet-started job for this widget; this
+        //  keeps rapid typing in the nuclide box from backing up the compute threads.
+        ComputeScheduler::post( sessionid, ComputeScheduler::Priority::Interactive, worker,
+                                "RefPhotopeakDisplay-assoc-" + id() );
         break;
       }//case MoreNuclideInfo::InfoStatus::NotInited:
     }//switch( status )
@@ -24,6 +24,10 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <iterator>
+#include <functional>
+
+#include <boost/functional/hash.hpp>
 
 #include "rapidxml/rapidxml.hpp"
 #include "rapidxml/rapidxml_print.hpp"
@@ -32,6 +36,7 @@
 #include <Wt/WMenu>
 #include <Wt/WText>
 #include <Wt/WLabel>
+#include <Wt/WTimer>
 #include <Wt/WPoint>
 #include <Wt/WServer>
 #include <Wt/WCheckBox>
@@ -55,6 +60,7 @@
 #include "SpecUtils/SpecUtilsAsync.h"
 #include "SpecUtils/RapidXmlUtils.hpp"
 
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/PopupDiv.h"
 #include "InterSpec/SpecMeas.h"
@@ -91,6 +97,48 @@ using namespace std;
 
 namespace
 {
+  /** The maximum number of recent solutions RelActAutoGui keeps around to reuse. */
+  const size_t ns_max_cached_solutions = 8;
+  
+  
+  /** Returns a hash of everything that goes into a `RelActCalcAuto::solve(...)` call.
+   
+   The options and inputs are hashed via their XML representation, so as new options are added,
+   they are automatically included.  The spectra are hashed by pointer, which is safe since cached
+   solutions hold a reference to them, so their addresses can not be reused.
+   */
+  size_t calc_inputs_hash( const RelActCalcAuto::Options &options,
+                           const vector<RelActCalcAuto::RoiRange> &rois,
+                           const vector<RelActCalcAuto::NucInputInfo> &nuclides,
+                           const vector<RelActCalcAuto::FloatingPeak> &floating_peaks,
+                           const shared_ptr<const SpecUtils::Measurement> &foreground,
+                           const shared_ptr<const SpecUtils::Measurement> &background,
+                           const shared_ptr<const DetectorPeakResponse> &drf )
+  {
+    rapidxml::xml_document<char> doc;
+    rapidxml::xml_node<char> *base_node = doc.allocate_node( rapidxml::node_element, "RelActCalcAuto" );
+    doc.append_node( base_node );
+    
+    options.toXml( base_node );
+    for( const auto &range : rois )
+      range.toXml( base_node );
+    for( const auto &nuc : nuclides )
+      nuc.toXml( base_node );
+    for( const auto &peak : floating_peaks )
+      peak.toXml( base_node );
+    
+    string xml;
+    rapidxml::print( std::back_inserter(xml), doc, rapidxml::print_no_indenting );
+    
+    size_t seed = std::hash<string>()( xml );
+    boost::hash_combine( seed, foreground.get() );
+    boost::hash_combine( seed, background.get() );
+    boost::hash_combine( seed, drf ? drf->hashValue() : uint64_t(0) );
+    
+    return seed;
+  }//size_t calc_inputs_hash(...)
+  
+  
   //DeleteOnClosePopupMenu - same class as from D3SpectrumDisplayDiv... should refactor
   class DeleteOnClosePopupMenu : public PopupDivMenu
   {
@@ -1222,6 +1270,9 @@ RelActAutoGui::RelActAutoGui( InterSpec *viewer, Wt::WContainerWidget *parent )
   m_is_calculating( false ),
   m_cancel_calc{},
   m_solution{},
+  m_calc_debounce_timer( nullptr ),
+  m_calc_inputs_hash( 0 ),
+  m_solution_cache{},
   m_calc_started( this ),
   m_calc_successful( this ),
   m_calc_failed( this ),
@@ -1693,6 +1744,11 @@ RelActAutoGui::RelActAutoGui( InterSpec *viewer, Wt::WContainerWidget *parent )
   m_solution_updated.connect( boost::bind( &RelActAutoReportResource::updateSolution,
                                           html_rsc, boost::placeholders::_1 ) );
   
+  m_calc_debounce_timer = new WTimer( this );
+  m_calc_debounce_timer->setSingleShot( true );
+  m_calc_debounce_timer->setInterval( 400 );
+  m_calc_debounce_timer->timeout().connect( this, &RelActAutoGui::startUpdatingCalculation );
+  
   m_render_flags |= RenderActions::UpdateSpectra;
   m_render_flags |= RenderActions::UpdateCalculations;
 }//RelActAutoGui constructor
@@ -1751,8 +1807,23 @@ void RelActAutoGui::render( Wt::WFlags<Wt::RenderFlag> flags )
   
   if( m_render_flags.testFlag(RenderActions::UpdateCalculations) )
   {
-    startUpdatingCalculation();
-  }
+    // If a calculation is running, or one was just requested, the user is probably still
+    //  changing things, so we'll abandon the running calculation, and wait for a pause.
+    if( m_is_calculating || m_calc_debounce_timer->isActive() )
+    {
+      if( m_cancel_calc )
+        m_cancel_calc->store( true );
+      
+      // A new flag, so the abandoned calculations result, or error, is ignored.
+      m_cancel_calc = make_shared<std::atomic_bool>( false );
+      
+      m_calc_debounce_timer->stop();
+      m_calc_debounce_timer->start();
+    }else
+    {
+      startUpdatingCalculation();
+    }
+  }//if( m_render_flags.testFlag(RenderActions::UpdateCalculations) )
   
   m_render_flags = 0;
   m_loading_preset = false;
@@ -4471,6 +4542,8 @@ void RelActAutoGui::updateDuringRenderForEnergyRangeChange()
 
 void RelActAutoGui::startUpdatingCalculation()
 {
+  m_calc_debounce_timer->stop();
+  
   m_error_msg->setText("");
   m_error_msg->hide();
   m_status_indicator->hide();
@@ -4520,18 +4593,9 @@ void RelActAutoGui::startUpdatingCalculation()
     return;
   }//try / catch
   
-  m_status_indicator->setText( "Calculating..." );
-  m_status_indicator->show();
-  
   if( m_cancel_calc )
     m_cancel_calc->store( true );
   
-  const string sessionid = wApp->sessionId();
-  m_is_calculating = true;
-  m_cancel_calc = make_shared<std::atomic_bool>();
-  m_cancel_calc->store( false );
-  shared_ptr<atomic_bool> cancel_calc = m_cancel_calc;
-  
   shared_ptr<const DetectorPeakResponse> cached_drf = m_cached_drf;
   if( !cached_drf )
   {
@@ -4540,11 +4604,62 @@ void RelActAutoGui::startUpdatingCalculation()
       cached_drf = m->detector();
   }
   
+  // If we have recently solved this exact problem, we'll just re-use that solution.
+  size_t inputs_hash = 0;
+  try
+  {
+    inputs_hash = calc_inputs_hash( options, rois, nuclides, floating_peaks,
+                                    foreground, background, cached_drf );
+  }catch( std::exception &e )
+  {
+    // Shouldnt happen, but we'll just not use the cache
+    cerr << "RelActAutoGui: failed to hash calculation inputs: " << e.what() << endl;
+    assert( 0 );
+  }
+  
+  const auto cached_pos = std::find_if( begin(m_solution_cache), end(m_solution_cache),
+    [inputs_hash]( const pair<size_t,shared_ptr<RelActCalcAuto::RelActAutoSolution>> &val ){
+      return val.first == inputs_hash;
+  } );
+  
+  if( inputs_hash && (cached_pos != end(m_solution_cache)) )
+  {
+    m_solution_cache.splice( begin(m_solution_cache), m_solution_cache, cached_pos );
+    
+    m_is_calculating = true;
+    m_calc_inputs_hash = inputs_hash;
+    m_cancel_calc = make_shared<std::atomic_bool>( false );
+    m_calc_started.emit();
+    updateFromCalc( m_solution_cache.front().second, m_cancel_calc );
+    return;
+  }//if( we have a cached solution for these inputs )
+  
+  m_status_indicator->setText( "Calculating..." );
+  m_status_indicator->show();
+  
+  const string sessionid = wApp->sessionId();
+  m_is_calculating = true;
+  m_calc_inputs_hash = inputs_hash;
+  m_cancel_calc = make_shared<std::atomic_bool>();
+  m_cancel_calc->store( false );
+  shared_ptr<atomic_bool> cancel_calc = m_cancel_calc;
+  
   WApplication *app = WApplication::instance();
   const string sessionId = app->sessionId();
   
   vector<shared_ptr<const PeakDef>> cached_all_peaks = m_cached_all_peaks;
   
+  // If the current solution is for the same spectra, we'll start the new calculation from it,
+  //  which usually brings the fit to convergence a lot quicker.
+  shared_ptr<const RelActCalcAuto::RelActAutoSolution> warm_start;
+  if( m_solution
+     && (m_solution->m_status == RelActCalcAuto::RelActAutoSolution::Status::Success)
+     && (m_solution->m_foreground == foreground)
+     && (m_solution->m_background == background) )
+  {
+    warm_start = m_solution;
+  }
+  
   auto solution = make_shared<RelActCalcAuto::RelActAutoSolution>();
   auto error_msg = make_shared<string>();
   
@@ -4558,7 +4673,7 @@ void RelActAutoGui::startUpdatingCalculation()
       RelActCalcAuto::RelActAutoSolution answer
         = RelActCalcAuto::solve( options, rois, nuclides, floating_peaks,
                                 foreground, background, cached_drf,
-                                cached_all_peaks, cancel_calc );
+                                cached_all_peaks, cancel_calc, warm_start );
       
       WServer::instance()->post( sessionId, [=](){
         WApplication *app = WApplication::instance();
@@ -4595,7 +4710,7 @@ void RelActAutoGui::startUpdatingCalculation()
   
   m_calc_started.emit();
   
-  WServer::instance()->ioService().boost::asio::io_service::post( worker );
+  ComputeScheduler::post( sessionId, ComputeScheduler::Priority::Batch, worker );
 }//void startUpdatingCalculation()
 
 
@@ -4646,6 +4761,17 @@ void RelActAutoGui::updateFromCalc( std::shared_ptr<RelActCalcAuto::RelActAutoSo
   
   m_solution = answer;
   
+  if( m_calc_inputs_hash
+     && (m_solution_cache.empty() || (m_solution_cache.front().second != answer)) )
+  {
+    m_solution_cache.remove_if( [this]( const pair<size_t,shared_ptr<RelActCalcAuto::RelActAutoSolution>> &val ){
+      return val.first == m_calc_inputs_hash;
+    } );
+    m_solution_cache.emplace_front( m_calc_inputs_hash, answer );
+    while( m_solution_cache.size() > ns_max_cached_solutions )
+      m_solution_cache.pop_back();
+  }//if( add solution to cache )
+  
   m_txt_results->updateResults( *answer );
   
   m_peak_model->setPeaks( answer->m_fit_peaks );
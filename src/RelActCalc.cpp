@@ -367,144 +367,144 @@ double eval_eqn( const double energy, const RelEffEqnForm eqn_form,
 }//eval_eqn(...)
 
 
-double eval_eqn_uncertainty( const double energy, const RelEffEqnForm eqn_form,
-                            const std::vector<std::vector<double>> &covariance )
+namespace
 {
-  if( covariance.empty() )
-    throw runtime_error( "eval_eqn_uncertainty: empty coefficients passed in." );
-  
-  switch( eqn_form )
+  /** Fills `terms` with the value of each term of the (linearized) equation at `energy`, so that
+   the equation, or its log, is `sum_i coef[i]*terms[i]`.
+   */
+  void eqn_basis_terms( const double energy, const RelActCalc::RelEffEqnForm eqn_form,
+                        const size_t num_terms, double * const terms )
   {
-    case RelEffEqnForm::LnX:
+    using RelActCalc::RelEffEqnForm;
+    
+    switch( eqn_form )
     {
-      // y = a + b*ln(x) + c*(ln(x))^2 + d*(ln(x))^3 + ...
-      const double log_energy = std::log(energy);
-      
-      double uncert_sq = 0.0;
-      
-      for( size_t i = 0; i < covariance.size(); ++i )
+      case RelEffEqnForm::LnX:
+      case RelEffEqnForm::LnXLnY:
       {
-        assert( covariance[i].size() == covariance.size() );
-        if( covariance[i].size() != covariance.size() )  //JIC for release builds
-          throw runtime_error( "eval_eqn_uncertainty: covariance not a square matrix." );
+        // y = a + b*ln(x) + c*(ln(x))^2 + d*(ln(x))^3 + ...
+        //  and
+        // y = exp(a  + b*(lnx) + c*(lnx)^2 + d*(lnx)^3 + ... )
+        const double log_energy = std::log(energy);
+        double term = 1.0;
+        for( size_t i = 0; i < num_terms; ++i, term *= log_energy )
+          terms[i] = term;
+        break;
+      }//case LnX and LnXLnY
         
-        for( size_t j = 0; j <= covariance.size(); ++j )
-        uncert_sq += std::pow(log_energy,1.0*i) * covariance[i][j] * std::pow(log_energy,1.0*j);
-      }//for( size_t i = 0; i < coefs.size(); ++i )
-      
-      assert( uncert_sq >= 0.0 );
-      
-      return sqrt(uncert_sq);
-    }//case RelEffEqnForm::LnX:
-      
-      
-    case RelEffEqnForm::LnY:
-    {
-      // y = exp( a + b*x + c/x + d/x^2 + e/x^3 + ... )
-      const auto eval_term_log = [energy]( const size_t order ) -> double {
-        switch( order )
-        {
-          case 0:  return 1.0;
-          case 1:  return energy;
-          default:
-            break;
-        }//switch( order )
-        
-        return std::pow( energy, 1.0 - order );
-      };//eval_term_log
-      
-      double log_uncert_sq = 0.0;
-      
-      for( size_t i = 0; i < covariance.size(); ++i )
+      case RelEffEqnForm::LnY:
       {
-        assert( covariance[i].size() == covariance.size() );
-        if( covariance[i].size() != covariance.size() )  //JIC for release builds
-          throw runtime_error( "eval_eqn_uncertainty: covariance not a square matrix." );
+        // y = exp( a + b*x + c/x + d/x^2 + e/x^3 + ... )
+        for( size_t i = 0; i < num_terms; ++i )
+        {
+          switch( i )
+          {
+            case 0:  terms[i] = 1.0;    break;
+            case 1:  terms[i] = energy; break;
+            default: terms[i] = std::pow( energy, 1.0 - i ); break;
+          }//switch( i )
+        }//for( size_t i = 0; i < num_terms; ++i )
+        break;
+      }//case RelEffEqnForm::LnY:
         
-        for( size_t j = 0; j <= covariance.size(); ++j )
-        log_uncert_sq += eval_term_log(i) * covariance[i][j] * eval_term_log(j);
-      }//for( size_t i = 0; i < coefs.size(); ++i )
-      
-      assert( log_uncert_sq >= 0.0 );
-      
-      return exp( sqrt(log_uncert_sq) );
-    }//case RelEffEqnForm::LnY:
-      
-    case RelEffEqnForm::LnXLnY:
-    {
-      // y = exp(a  + b*(lnx) + c*(lnx)^2 + d*(lnx)^3 + ... )
-      const double log_energy = std::log(energy);
-      
-      double log_uncert_sq = 0.0;
-      
-      for( size_t i = 0; i < covariance.size(); ++i )
+      case RelEffEqnForm::FramEmpirical:
       {
-        assert( covariance[i].size() == covariance.size() );
-        if( covariance[i].size() != covariance.size() )  //JIC for release builds
-          throw runtime_error( "eval_eqn_uncertainty: covariance not a square matrix." );
+        // y = exp( a + b/x^2 + c*(lnx) + d*(lnx)^2 + e*(lnx)^3 )
+        const double log_energy = std::log(energy);
         
-        for( size_t j = 0; j <= covariance.size(); ++j )
-        log_uncert_sq += std::pow(log_energy,1.0*i) * covariance[i][j] * std::pow(log_energy,1.0*j);
-      }//for( size_t i = 0; i < coefs.size(); ++i )
-      
-      assert( log_uncert_sq >= 0.0 );
-      
-      return exp( sqrt(log_uncert_sq) );
-    }//case RelEffEqnForm::LnXLnY:
-      
-    case RelEffEqnForm::FramEmpirical:
-    {
-      // y = exp( a + b/x^2 + c*(lnx) + d*(lnx)^2 + e*(lnx)^3 )
-      const double log_energy = std::log(energy);
-      
 #ifdef _MSC_VER
 #pragma message( "eval_eqn_uncertainty with RelEffEqnForm::FramEmpirical not tested!" )
 #else
 #warning "eval_eqn_uncertainty with RelEffEqnForm::FramEmpirical not tested!"
 #endif
-      
-      double log_uncert_sq = 0.0;
-      
-      for( size_t i = 0; i < covariance.size(); ++i )
-      {
-        assert( covariance[i].size() == covariance.size() );
-        if( covariance[i].size() != covariance.size() )  //JIC for release builds
-          throw runtime_error( "eval_eqn_uncertainty: covariance not a square matrix." );
         
-        double i_component = 0.0;
-        switch( i )
+        for( size_t i = 0; i < num_terms; ++i )
         {
-          case 0:  i_component = 1.0;  break;
-          case 1:  i_component = 1.0 / (energy*energy); break;
-          default: i_component = std::pow(log_energy, i - 1.0); break;
-        }//switch( i )
-        
-        for( size_t j = 0; j <= covariance.size(); ++j )
-        {
-          double j_component = 0.0;
-          switch( j )
+          switch( i )
           {
-            case 0:  j_component = 1.0;  break;
-            case 1:  j_component = 1.0 / (energy*energy); break;
-            default: j_component = std::pow(log_energy, j - 1.0); break;
+            case 0:  terms[i] = 1.0; break;
+            case 1:  terms[i] = 1.0 / (energy*energy); break;
+            default: terms[i] = std::pow( log_energy, i - 1.0 ); break;
           }//switch( i )
-          
-          log_uncert_sq += i_component * covariance[i][j] * j_component;
-        }
-      }//for( size_t i = 0; i < coefs.size(); ++i )
-      
-      assert( log_uncert_sq >= 0.0 );
-      
-      return exp( sqrt(log_uncert_sq) );
-    }//case RelEffEqnForm::FramEmpirical:
-  }//switch( eqn_form )
+        }//for( size_t i = 0; i < num_terms; ++i )
+        break;
+      }//case RelEffEqnForm::FramEmpirical:
+    }//switch( eqn_form )
+  }//void eqn_basis_terms(...)
   
   
-  assert( 0 );   //shouldnt ever get here
-  return -999.9; //avoid compiler warning
+  void check_covariance_square( const std::vector<std::vector<double>> &covariance )
+  {
+    if( covariance.empty() )
+      throw runtime_error( "eval_eqn_uncertainty: empty coefficients passed in." );
+    
+    for( const vector<double> &row : covariance )
+    {
+      assert( row.size() == covariance.size() );
+      if( row.size() != covariance.size() )  //JIC for release builds
+        throw runtime_error( "eval_eqn_uncertainty: covariance not a square matrix." );
+    }
+  }//void check_covariance_square(...)
+  
+  
+  /** Returns `terms^T * covariance * terms`, converted to the uncertainty of the equation. */
+  double uncertainty_from_terms( const RelActCalc::RelEffEqnForm eqn_form,
+                                 const std::vector<std::vector<double>> &covariance,
+                                 const double * const terms )
+  {
+    const size_t nterms = covariance.size();
+    
+    double uncert_sq = 0.0;
+    for( size_t i = 0; i < nterms; ++i )
+    {
+      const vector<double> &row = covariance[i];
+      double row_sum = 0.0;
+      for( size_t j = 0; j < nterms; ++j )
+        row_sum += row[j] * terms[j];
+      uncert_sq += terms[i] * row_sum;
+    }//for( size_t i = 0; i < nterms; ++i )
+    
+    assert( uncert_sq >= 0.0 );
+    
+    if( eqn_form == RelActCalc::RelEffEqnForm::LnX )
+      return sqrt( uncert_sq );
+    
+    return exp( sqrt(uncert_sq) );
+  }//double uncertainty_from_terms(...)
+}//namespace
+
+
+double eval_eqn_uncertainty( const double energy, const RelEffEqnForm eqn_form,
+                            const std::vector<std::vector<double>> &covariance )
+{
+  check_covariance_square( covariance );
+  
+  vector<double> terms( covariance.size() );
+  eqn_basis_terms( energy, eqn_form, terms.size(), &(terms[0]) );
+  
+  return uncertainty_from_terms( eqn_form, covariance, &(terms[0]) );
 }//double eval_eqn_uncertainty(...)
 
 
+vector<double> eval_eqn_uncertainty( const vector<double> &energies, const RelEffEqnForm eqn_form,
+                                     const std::vector<std::vector<double>> &covariance )
+{
+  check_covariance_square( covariance );
+  
+  const size_t nterms = covariance.size();
+  vector<double> terms( nterms );
+  vector<double> answer( energies.size() );
+  
+  for( size_t i = 0; i < energies.size(); ++i )
+  {
+    eqn_basis_terms( energies[i], eqn_form, nterms, &(terms[0]) );
+    answer[i] = uncertainty_from_terms( eqn_form, covariance, &(terms[0]) );
+  }
+  
+  return answer;
+}//vector<double> eval_eqn_uncertainty(...)
+
+
 const std::string &to_str( const PuCorrMethod method )
 {
   const static std::string s_Bignan95_PWR{ "Bignan95_PWR" };
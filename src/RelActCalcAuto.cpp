@@ -23,13 +23,16 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <set>
 #include <deque>
 #include <tuple>
 #include <chrono>
 #include <thread>
 #include <limits>
+#include <mutex>
 #include <fstream>
+#include <exception>
 #include <sstream>
 #include <algorithm>
 #include <functional>
@@ -64,6 +67,9 @@
 #include "SpecUtils/EnergyCalibration.h"
 
 #include "InterSpec/PeakFit.h"
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/EnergyCal.h"
 #include "InterSpec/RelActCalc.h"
@@ -737,6 +743,16 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
   std::vector<RoiRangeChannels> m_energy_ranges;
   std::vector<RelActCalcAuto::FloatingPeak> m_extra_peaks;
   
+  /** For each entry of #m_energy_ranges, and then for each entry of #m_nuclides, the [begin,end)
+   indexes into `NucInputGamma::nominal_gammas` of the gammas with energies within the ROI.
+   
+   Since `nominal_gammas` is sorted by energy, and the ROI energy ranges (not the adjusted
+   energies) dont change during the fit, we compute these once in the constructor, rather than
+   looping over every gamma of every nuclide, for every ROI, on each evaluation.  Only used for
+   nuclides whose age is fixed.
+   */
+  std::vector<std::vector<std::pair<size_t,size_t>>> m_roi_nominal_gamma_ranges;
+  
   const std::shared_ptr<const SpecUtils::Measurement> m_spectrum;
   
   const float m_live_time;
@@ -777,15 +793,59 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
   
   
   // If class to implement cancelling a calculation
+  /** Callback for each ceres iteration that checks if the user has cancelled the calculation,
+   reports progress, and keeps track of the best parameters so far (so if the calculation is
+   cancelled, we can use them).
+   
+   Requires `ceres::Solver::Options::update_state_every_iteration` be true, so that
+   `parameters` will be current when the callback is called.
+   */
   class CheckCeresTerminateCallback : public ceres::IterationCallback
   {
     shared_ptr<atomic_bool> m_cancel;
+    const vector<double> &m_parameters;
+    std::function<void(const RelActCalcAuto::SolveProgress &)> m_progress_fcn;
     
   public:
-    CheckCeresTerminateCallback( shared_ptr<atomic_bool> &cancel_calc ) : m_cancel( cancel_calc ) {}
+    /** The lowest cost (i.e., 0.5*chi2) seen, before the calculation was cancelled. */
+    double m_best_cost;
+    
+    /** The parameters corresponding to #m_best_cost; empty if no iterations were completed. */
+    vector<double> m_best_parameters;
+    
+    CheckCeresTerminateCallback( shared_ptr<atomic_bool> &cancel_calc,
+                                 const vector<double> &parameters,
+                                 std::function<void(const RelActCalcAuto::SolveProgress &)> progress_fcn )
+     : m_cancel( cancel_calc ),
+       m_parameters( parameters ),
+       m_progress_fcn( progress_fcn ),
+       m_best_cost( std::numeric_limits<double>::infinity() ),
+       m_best_parameters{}
+    {
+    }
     
-    virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary & )
+    virtual ceres::CallbackReturnType operator()( const ceres::IterationSummary &summary )
     {
+      // If the calculation was cancelled during this iteration, the cost function will have
+      //  returned garbage, so we wont record this iteration.
+      if( m_cancel && m_cancel->load() )
+        return ceres::CallbackReturnType::SOLVER_ABORT;
+      
+      if( summary.cost < m_best_cost )
+      {
+        m_best_cost = summary.cost;
+        m_best_parameters = m_parameters;
+      }
+      
+      if( m_progress_fcn )
+      {
+        RelActCalcAuto::SolveProgress progress;
+        progress.iteration = static_cast<size_t>( std::max( summary.iteration, 0 ) );
+        progress.chi2 = 2.0*summary.cost;
+        progress.parameters = m_parameters;
+        m_progress_fcn( progress );
+      }//if( m_progress_fcn )
+      
       return (m_cancel && m_cancel->load()) ? ceres::CallbackReturnType::SOLVER_ABORT
                                             : ceres::CallbackReturnType::SOLVER_CONTINUE;
     }
@@ -1049,6 +1109,13 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     }//for( const auto &peak : m_extra_peaks )
     
     
+    for( const RoiRangeChannels &range : m_energy_ranges )
+    {
+      m_roi_nominal_gamma_ranges.emplace_back();
+      for( const NucInputGamma &nucinfo : m_nuclides )
+        m_roi_nominal_gamma_ranges.back().push_back( gammas_in_range( nucinfo.nominal_gammas, range ) );
+    }//for( const RoiRangeChannels &range : m_energy_ranges )
+    
     // TODO: Figure out a proper value to set m_rel_eff_anchor_enhancement to, like maybe largest peak area divided m_live_time, or something like that
     m_rel_eff_anchor_enhancement = 0.0;
     for( const auto &r : m_energy_ranges )
@@ -1097,6 +1164,62 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
   }//size_t number_residuals() const
   
   /** Solve the problem, using the Ceres optimizer. */
+  /** Returns whether the second set of skew parameters (i.e., for the upper energy of the problem)
+   should be fit for the given skew coefficient, given the energy ranges of the problem.
+   */
+  static bool fit_skew_energy_dependence( const PeakDef::SkewType skew_type,
+                                          const PeakDef::CoefficientType ct,
+                                          const std::vector<RelActCalcAuto::RoiRange> &energy_ranges )
+  {
+    bool fit_energy_dep = PeakDef::is_energy_dependent( skew_type, ct );
+    
+    if( fit_energy_dep && (energy_ranges.size() == 1) )
+    {
+      // TODO: if statistically significant peaks across less than ~100 keV, then set fit_energy_dep to false
+#ifdef _MSC_VER
+#pragma message( "if statistically significant peaks across less than ~100 keV, then set fit_energy_dep to false" )
+#else
+#warning "if statistically significant peaks across less than ~100 keV, then set fit_energy_dep to false"
+#endif
+      const double dx = (energy_ranges.front().upper_energy - energy_ranges.front().lower_energy);
+      fit_energy_dep = (dx > 100.0);
+    }
+    
+    return fit_energy_dep;
+  }//fit_skew_energy_dependence(...)
+  
+  
+  /** Returns the upper limit we will allow the age of `nuclides[nuc_num]` to be fit to. */
+  static double max_fit_age( const std::vector<RelActCalcAuto::NucInputInfo> &nuclides,
+                             const size_t nuc_num,
+                             const bool nucs_of_el_same_age )
+  {
+    // TODO: maybe figure out a better method of setting upper age bound
+    const RelActCalcAuto::NucInputInfo &nuc = nuclides[nuc_num];
+    
+    // If we are tying the ages of all nuclides in an element together, we dont want to
+    //  accidentally limit the max age based on the shortest nuclides half-life (think U-237 for
+    //  uranium).
+    double half_life = nuc.nuclide->halfLife;
+    if( nucs_of_el_same_age )
+    {
+      for( size_t i = 0; i < nuclides.size(); ++i )
+      {
+        if( nuclides[i].nuclide->atomicNumber == nuc.nuclide->atomicNumber )
+          half_life = std::max(half_life, nuclides[i].nuclide->halfLife);
+      }
+    }//if( nucs_of_el_same_age )
+    
+    double max_age = std::max( 5.0*nuc.age, 15.0*half_life );
+    
+    // We'll clamp the upper age, to the range where humans may have done the seperation
+    // TODO: is there any problem with a nuclide >100 years, that isnt effectively infinite?
+    max_age = std::min( max_age, 120*PhysicalUnits::year );
+    
+    return max_age;
+  }//max_fit_age(...)
+  
+  
   static RelActCalcAuto::RelActAutoSolution solve_ceres( RelActCalcAuto::Options options,
                                                         std::vector<RelActCalcAuto::RoiRange> energy_ranges,
                                                         std::vector<RelActCalcAuto::NucInputInfo> nuclides,
@@ -1105,7 +1228,9 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
                                                         std::shared_ptr<const SpecUtils::Measurement> background,
                                                         const std::shared_ptr<const DetectorPeakResponse> input_drf,
                                                         std::vector<std::shared_ptr<const PeakDef>> all_peaks,
-                                                        std::shared_ptr<std::atomic_bool> cancel_calc
+                                                        std::shared_ptr<std::atomic_bool> cancel_calc,
+                                                        std::shared_ptr<const RelActCalcAuto::RelActAutoSolution> warm_start,
+                                                        std::function<void(const RelActCalcAuto::SolveProgress &)> progress_fcn
                                                         )
   {
     const auto start_time = std::chrono::high_resolution_clock::now();
@@ -1684,6 +1809,81 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     
     
     
+    // The parameters will have entries for two sets of peak-skew parameters; one for
+    //  the lowest energy of the problem, and one for the highest; in-between we will
+    //  scale the energy-dependent skew parameters.  If there is no energy dependence for
+    //  a parameter, or the problem doesnt span a large enough energy range to have a
+    //  dependence, parameters for the second skew will be fixed garbage values (i.e.,
+    //  unused)
+    for( size_t i = 0; i < num_skew_coefs; ++i )
+    {
+      const auto ct = PeakDef::CoefficientType( PeakDef::CoefficientType::SkewPar0 + i );
+      double lower, upper, starting, step;
+      const bool use = PeakDef::skew_parameter_range( options.skew_type, ct,
+                                                     lower, upper, starting, step );
+      assert( use );
+      if( !use )
+        throw logic_error( "Inconsistent skew parameter thing" );
+      
+      const bool fit_energy_dep = fit_skew_energy_dependence( options.skew_type, ct, energy_ranges );
+      
+      // If we will be fitting an energy dependence, make sure the cost functor knows this
+      cost_functor->m_skew_has_energy_dependance |= fit_energy_dep;
+      
+      
+      parameters[skew_start + i] = starting;
+      problem.SetParameterLowerBound(pars + skew_start + i, 0, lower );
+      problem.SetParameterUpperBound(pars + skew_start + i, 0, upper );
+      
+      // Specify ranges for second set of skew parameters
+      if( !fit_energy_dep )
+      {
+        parameters[skew_start + i + num_skew_coefs] = -999.9;
+        problem.SetParameterBlockConstant( pars + skew_start + i + num_skew_coefs );
+      }else
+      {
+        parameters[skew_start + i + num_skew_coefs] = starting;
+        problem.SetParameterLowerBound(pars + skew_start + i + num_skew_coefs, 0, lower );
+        problem.SetParameterUpperBound(pars + skew_start + i + num_skew_coefs, 0, upper );
+      }
+    }//for( size_t i = 0; i < (num_skew_par/2); ++i )
+    
+
+
+    // If we were given a previous solution to start from, check which parts of it we can use; we
+    //  will only skip estimating the relative efficiency and activities if we can get all of them
+    //  from the previous solution.
+    if( warm_start
+       && ((warm_start->m_status != RelActCalcAuto::RelActAutoSolution::Status::Success)
+           || warm_start->m_final_parameters.empty()) )
+    {
+      solution.m_warnings.push_back( "The solution given to start from was not a successful"
+                                     " solution, so it will not be used." );
+      warm_start = nullptr;
+    }//if( warm_start is not a valid solution )
+    
+    const bool warm_start_rel_eff = (warm_start
+                 && (warm_start->m_options.rel_eff_eqn_type == options.rel_eff_eqn_type)
+                 && (warm_start->m_rel_eff_coefficients.size() == (options.rel_eff_eqn_order + 1)));
+    
+    // Returns the previous solutions result for a nuclide, or nullptr if not in previous solution.
+    const auto warm_start_nuc = [&warm_start]( const SandiaDecay::Nuclide * const nuc )
+                                  -> const RelActCalcAuto::NuclideRelAct * {
+      if( !warm_start || !nuc )
+        return nullptr;
+      for( const RelActCalcAuto::NuclideRelAct &prev : warm_start->m_rel_activities )
+      {
+        if( prev.nuclide == nuc )
+          return &prev;
+      }
+      return nullptr;
+    };//warm_start_nuc lambda
+    
+    bool warm_start_all_acts = !nuclides.empty();
+    for( const RelActCalcAuto::NucInputInfo &nuc : nuclides )
+      warm_start_all_acts = (warm_start_all_acts && warm_start_nuc(nuc.nuclide));
+    
+    
     // Estimate the initial rel-eff equation
     //  Some things to consider are that we have a really poor estimate of activities right now
     //  and that we want the Rel Eff curve to be 1.0 at the lower energy of the lowest ROI...
@@ -1691,289 +1891,245 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     //   and assigning of gammas to peaks, then use that to first solve for relative activity and
     //   relative efficiency
     bool succesfully_estimated_re_and_ra = false;
-    try
+    if( warm_start_rel_eff && warm_start_all_acts )
     {
-      const double base_rel_eff_uncert = 1.0;
-      
-      // Filter peaks to those in ranges we want
-      vector<RelActCalcManual::GenericPeakInfo> peaks_in_range;
-      vector<std::shared_ptr<const PeakDef> > debug_manual_display_peaks;
-      for( const shared_ptr<const PeakDef> &p : all_peaks )
+      // The values will be set from `warm_start`, after the parameter limits are all set up.
+      succesfully_estimated_re_and_ra = true;
+    }else
+    {
+      try
       {
-        bool use_peak = energy_ranges.empty();
-        for( const auto &r : energy_ranges )
+        const double base_rel_eff_uncert = 1.0;
+      
+        // Filter peaks to those in ranges we want
+        vector<RelActCalcManual::GenericPeakInfo> peaks_in_range;
+        vector<std::shared_ptr<const PeakDef> > debug_manual_display_peaks;
+        for( const shared_ptr<const PeakDef> &p : all_peaks )
         {
-          if( (p->mean() >= r.lower_energy) && (p->mean() <= r.upper_energy) )
-            use_peak = true;
-        }
+          bool use_peak = energy_ranges.empty();
+          for( const auto &r : energy_ranges )
+          {
+            if( (p->mean() >= r.lower_energy) && (p->mean() <= r.upper_energy) )
+              use_peak = true;
+          }
         
-        if( use_peak )
-        {
-          RelActCalcManual::GenericPeakInfo peak;
-          peak.m_energy = p->mean();
-          peak.m_fwhm = p->gausPeak() ? p->fwhm() : (2.35482 * 0.25 * p->roiWidth());
-          peak.m_counts = p->amplitude();
-          peak.m_counts_uncert = p->amplitudeUncert();
-          peak.m_base_rel_eff_uncert = 0.5;
-          peaks_in_range.push_back( peak );
+          if( use_peak )
+          {
+            RelActCalcManual::GenericPeakInfo peak;
+            peak.m_energy = p->mean();
+            peak.m_fwhm = p->gausPeak() ? p->fwhm() : (2.35482 * 0.25 * p->roiWidth());
+            peak.m_counts = p->amplitude();
+            peak.m_counts_uncert = p->amplitudeUncert();
+            peak.m_base_rel_eff_uncert = 0.5;
+            peaks_in_range.push_back( peak );
           
-          debug_manual_display_peaks.push_back( p );
-        }//if( use_peak )
-      }//for( const shared_ptr<const PeakDef> &p : all_peaks )
-      
-      const double real_time = (foreground && (foreground->real_time() > 0))
-                                 ? foreground->real_time() : -1.0f;
-      // TODO: add something like `options.correct_for_decay_during_meas` or maybe this option should be a per-nuclide option.
-      //const bool correct_for_decay = (real_time > 0.0) ? options.correct_for_decay_during_meas : false;
-      const bool correct_for_decay = false;
-      
-      vector<RelActCalcManual::SandiaDecayNuc> nuc_sources;
-      for( const RelActCalcAuto::NucInputInfo &info : nuclides )
-      {
-        RelActCalcManual::SandiaDecayNuc nucinfo;
-        nucinfo.nuclide = info.nuclide;
-        nucinfo.age = info.age;
-        nucinfo.correct_for_decay_during_meas = correct_for_decay;
-        nuc_sources.push_back( nucinfo );
-      }
+            debug_manual_display_peaks.push_back( p );
+          }//if( use_peak )
+        }//for( const shared_ptr<const PeakDef> &p : all_peaks )
+      
+        const double real_time = (foreground && (foreground->real_time() > 0))
+                                   ? foreground->real_time() : -1.0f;
+        // TODO: add something like `options.correct_for_decay_during_meas` or maybe this option should be a per-nuclide option.
+        //const bool correct_for_decay = (real_time > 0.0) ? options.correct_for_decay_during_meas : false;
+        const bool correct_for_decay = false;
+      
+        vector<RelActCalcManual::SandiaDecayNuc> nuc_sources;
+        for( const RelActCalcAuto::NucInputInfo &info : nuclides )
+        {
+          RelActCalcManual::SandiaDecayNuc nucinfo;
+          nucinfo.nuclide = info.nuclide;
+          nucinfo.age = info.age;
+          nucinfo.correct_for_decay_during_meas = correct_for_decay;
+          nuc_sources.push_back( nucinfo );
+        }
       
       
-      vector<RelActCalcManual::PeakCsvInput::NucAndAge> isotopes;
-      for( const auto &n : nuc_sources )
-      {
-        if( n.nuclide )
-          isotopes.emplace_back( n.nuclide->symbol, n.age, correct_for_decay );
-      }
+        vector<RelActCalcManual::PeakCsvInput::NucAndAge> isotopes;
+        for( const auto &n : nuc_sources )
+        {
+          if( n.nuclide )
+            isotopes.emplace_back( n.nuclide->symbol, n.age, correct_for_decay );
+        }
       
       
-      // TODO: For cbnm9375, fill_in_nuclide_info() and add_nuclides_to_peaks() produce nearly identical results (like tiny rounding errors on yields), but this causes a notable difference in the final "auto" solution, although this manual solution apears the same - really should figure this out - and then get rid of add_nuclides_to_peaks(...) - maybe this is all a testimate to how brittle somethign else is...
-      const double cluster_sigma = 1.5;
-      const auto peaks_with_nucs = add_nuclides_to_peaks( peaks_in_range, nuc_sources, real_time, cluster_sigma );
+        // TODO: For cbnm9375, fill_in_nuclide_info() and add_nuclides_to_peaks() produce nearly identical results (like tiny rounding errors on yields), but this causes a notable difference in the final "auto" solution, although this manual solution apears the same - really should figure this out - and then get rid of add_nuclides_to_peaks(...) - maybe this is all a testimate to how brittle somethign else is...
+        const double cluster_sigma = 1.5;
+        const auto peaks_with_nucs = add_nuclides_to_peaks( peaks_in_range, nuc_sources, real_time, cluster_sigma );
       
-      //RelActCalcManual::PeakCsvInput::NucMatchResults matched_res
-      //  = RelActCalcManual::PeakCsvInput::fill_in_nuclide_info( peaks_in_range,
-      //                                    RelActCalcManual::PeakCsvInput::NucDataSrc::SandiaDecay,
-      //                                    {}, isotopes, cluster_sigma, {}, real_time );
-      // const auto peaks_with_nucs = matched_res.peaks_matched;
+        //RelActCalcManual::PeakCsvInput::NucMatchResults matched_res
+        //  = RelActCalcManual::PeakCsvInput::fill_in_nuclide_info( peaks_in_range,
+        //                                    RelActCalcManual::PeakCsvInput::NucDataSrc::SandiaDecay,
+        //                                    {}, isotopes, cluster_sigma, {}, real_time );
+        // const auto peaks_with_nucs = matched_res.peaks_matched;
       
-      /*
-        // Code to help debug difference between matching stuff...
-      for( auto &p : peaks_with_nucs )
-      {
-        std::sort( begin(p.m_source_gammas), end(p.m_source_gammas), []( auto &lhs, auto &rhs ){
-          return lhs.m_isotope < rhs.m_isotope;
-        } );
-      }
+        /*
+          // Code to help debug difference between matching stuff...
+        for( auto &p : peaks_with_nucs )
+        {
+          std::sort( begin(p.m_source_gammas), end(p.m_source_gammas), []( auto &lhs, auto &rhs ){
+            return lhs.m_isotope < rhs.m_isotope;
+          } );
+        }
       
-      for( auto &p : matched_res.peaks_matched )
-      {
-        std::sort( begin(p.m_source_gammas), end(p.m_source_gammas), []( auto &lhs, auto &rhs ){
-          return lhs.m_isotope < rhs.m_isotope;
-        } );
-      }
+        for( auto &p : matched_res.peaks_matched )
+        {
+          std::sort( begin(p.m_source_gammas), end(p.m_source_gammas), []( auto &lhs, auto &rhs ){
+            return lhs.m_isotope < rhs.m_isotope;
+          } );
+        }
       
-      assert( matched_res.peaks_matched.size() == peaks_with_nucs.size() );
+        assert( matched_res.peaks_matched.size() == peaks_with_nucs.size() );
       
       
-      for( size_t i = 0; i < std::max(matched_res.peaks_matched.size(), peaks_with_nucs.size()); ++i )
-      {
-        const auto newp = matched_res.peaks_matched[i];
-        const auto oldp = peaks_with_nucs[i];
-        assert( newp.m_energy == oldp.m_energy );
-        assert( newp.m_counts == oldp.m_counts );
-        assert( newp.m_counts_uncert == oldp.m_counts_uncert );
-        assert( newp.m_fwhm == oldp.m_fwhm );
-        assert( newp.m_base_rel_eff_uncert == oldp.m_base_rel_eff_uncert );
-        assert( newp.m_source_gammas.size() == oldp.m_source_gammas.size() );
-        for( size_t j = 0; j < newp.m_source_gammas.size(); ++j )
+        for( size_t i = 0; i < std::max(matched_res.peaks_matched.size(), peaks_with_nucs.size()); ++i )
         {
-          assert( newp.m_source_gammas[j].m_isotope == oldp.m_source_gammas[j].m_isotope );
-          
-          double diff = fabs( newp.m_source_gammas[j].m_yield - oldp.m_source_gammas[j].m_yield );
-          assert( diff <= 0.00001*newp.m_source_gammas[j].m_yield );
-          assert( diff <= 0.00001*oldp.m_source_gammas[j].m_yield );
-          if( newp.m_source_gammas[j].m_yield != oldp.m_source_gammas[j].m_yield )
+          const auto newp = matched_res.peaks_matched[i];
+          const auto oldp = peaks_with_nucs[i];
+          assert( newp.m_energy == oldp.m_energy );
+          assert( newp.m_counts == oldp.m_counts );
+          assert( newp.m_counts_uncert == oldp.m_counts_uncert );
+          assert( newp.m_fwhm == oldp.m_fwhm );
+          assert( newp.m_base_rel_eff_uncert == oldp.m_base_rel_eff_uncert );
+          assert( newp.m_source_gammas.size() == oldp.m_source_gammas.size() );
+          for( size_t j = 0; j < newp.m_source_gammas.size(); ++j )
           {
-            double brnew = newp.m_source_gammas[j].m_yield;
-            double brold = oldp.m_source_gammas[j].m_yield;
-            cout << "Mismatcht BR: " << brnew << " vs " << brold << " for " << newp.m_energy << " keV" << endl;
-            cout << endl;
+            assert( newp.m_source_gammas[j].m_isotope == oldp.m_source_gammas[j].m_isotope );
+          
+            double diff = fabs( newp.m_source_gammas[j].m_yield - oldp.m_source_gammas[j].m_yield );
+            assert( diff <= 0.00001*newp.m_source_gammas[j].m_yield );
+            assert( diff <= 0.00001*oldp.m_source_gammas[j].m_yield );
+            if( newp.m_source_gammas[j].m_yield != oldp.m_source_gammas[j].m_yield )
+            {
+              double brnew = newp.m_source_gammas[j].m_yield;
+              double brold = oldp.m_source_gammas[j].m_yield;
+              cout << "Mismatcht BR: " << brnew << " vs " << brold << " for " << newp.m_energy << " keV" << endl;
+              cout << endl;
+            }
+            //assert( newp.m_source_gammas[j].m_yield == oldp.m_source_gammas[j].m_yield );
           }
-          //assert( newp.m_source_gammas[j].m_yield == oldp.m_source_gammas[j].m_yield );
-        }
         
-        if( i < matched_res.peaks_matched.size() )
-        {
-          const auto p = matched_res.peaks_matched[i];
-          cout << "new " << i << ": e=" << p.m_energy << ", fwhm=" << p.m_fwhm << endl;
-          for( const auto g : p.m_source_gammas )
-            cout << "\tsource: " << g.m_isotope << ": " << g.m_yield << endl;
-        }
+          if( i < matched_res.peaks_matched.size() )
+          {
+            const auto p = matched_res.peaks_matched[i];
+            cout << "new " << i << ": e=" << p.m_energy << ", fwhm=" << p.m_fwhm << endl;
+            for( const auto g : p.m_source_gammas )
+              cout << "\tsource: " << g.m_isotope << ": " << g.m_yield << endl;
+          }
         
-        if( i < peaks_with_nucs.size() )
-        {
-          const auto p = peaks_with_nucs[i];
-          cout << "old " << i << ": e=" << p.m_energy << ", fwhm=" << p.m_fwhm << endl;
-          for( const auto g : p.m_source_gammas )
-            cout << "\tsource: " << g.m_isotope << ": " << g.m_yield << endl;
+          if( i < peaks_with_nucs.size() )
+          {
+            const auto p = peaks_with_nucs[i];
+            cout << "old " << i << ": e=" << p.m_energy << ", fwhm=" << p.m_fwhm << endl;
+            for( const auto g : p.m_source_gammas )
+              cout << "\tsource: " << g.m_isotope << ": " << g.m_yield << endl;
+          }
         }
-      }
-      cout << endl << endl;
-      //peaks_with_nucs = matched_res.peaks_matched;
-      */
+        cout << endl << endl;
+        //peaks_with_nucs = matched_res.peaks_matched;
+        */
       
-      vector<RelActCalcManual::GenericPeakInfo> peaks_with_sources;
-      for( const auto &p : peaks_with_nucs )
-      {
-        bool is_floater_peak = false;
-        // TODO: - Need to deal with extra floater peaks in getting the initial "manual" solution
-        //         Right now were just removing the "fit" peak if its within 1 sigma of a floating
-        //         peak (since if the peak is floating, it wont add any info to the manual solution)
-        //         but maybe there is a better way of dealing with things?
-        for( const RelActCalcAuto::FloatingPeak &floater : extra_peaks )
+        vector<RelActCalcManual::GenericPeakInfo> peaks_with_sources;
+        for( const auto &p : peaks_with_nucs )
         {
-          if( fabs(floater.energy - p.m_energy) < 1.0*(p.m_fwhm/2.35482) )
-            is_floater_peak = true;
-        }//for( const RelActCalcAuto::FloatingPeak &floater : extra_peaks )
+          bool is_floater_peak = false;
+          // TODO: - Need to deal with extra floater peaks in getting the initial "manual" solution
+          //         Right now were just removing the "fit" peak if its within 1 sigma of a floating
+          //         peak (since if the peak is floating, it wont add any info to the manual solution)
+          //         but maybe there is a better way of dealing with things?
+          for( const RelActCalcAuto::FloatingPeak &floater : extra_peaks )
+          {
+            if( fabs(floater.energy - p.m_energy) < 1.0*(p.m_fwhm/2.35482) )
+              is_floater_peak = true;
+          }//for( const RelActCalcAuto::FloatingPeak &floater : extra_peaks )
         
         
-        if( !is_floater_peak && !p.m_source_gammas.empty() )
-          peaks_with_sources.push_back( p );
-      }//for( const auto &p : peaks_with_nucs )
+          if( !is_floater_peak && !p.m_source_gammas.empty() )
+            peaks_with_sources.push_back( p );
+        }//for( const auto &p : peaks_with_nucs )
       
-      size_t manual_rel_eff_order = options.rel_eff_eqn_order;
-      set<string> manual_nucs;
-      for( const auto &p : peaks_with_sources )
-      {
-        for( const auto &l : p.m_source_gammas )
-          manual_nucs.insert( l.m_isotope );
-      }
+        size_t manual_rel_eff_order = options.rel_eff_eqn_order;
+        set<string> manual_nucs;
+        for( const auto &p : peaks_with_sources )
+        {
+          for( const auto &l : p.m_source_gammas )
+            manual_nucs.insert( l.m_isotope );
+        }
       
-      int manual_num_peaks = static_cast<int>( peaks_with_sources.size() );
-      int manual_num_isos = static_cast<int>( manual_nucs.size() );
-      int manual_num_rel_eff = static_cast<int>( manual_rel_eff_order + 1 );
-      int num_free_pars = manual_num_peaks - (manual_num_rel_eff + manual_num_isos - 1);
+        int manual_num_peaks = static_cast<int>( peaks_with_sources.size() );
+        int manual_num_isos = static_cast<int>( manual_nucs.size() );
+        int manual_num_rel_eff = static_cast<int>( manual_rel_eff_order + 1 );
+        int num_free_pars = manual_num_peaks - (manual_num_rel_eff + manual_num_isos - 1);
       
-      if( (manual_num_peaks - manual_num_isos) < 1 )
-        throw runtime_error( "Not enough fit-peaks to perform initial manual rel. eff. estimation of parameters." );
+        if( (manual_num_peaks - manual_num_isos) < 1 )
+          throw runtime_error( "Not enough fit-peaks to perform initial manual rel. eff. estimation of parameters." );
       
-      if( num_free_pars < 0 )
-        manual_rel_eff_order = manual_num_peaks - manual_num_isos;
+        if( num_free_pars < 0 )
+          manual_rel_eff_order = manual_num_peaks - manual_num_isos;
         
-      RelActCalcManual::RelEffSolution manual_solution
-                 = RelActCalcManual::solve_relative_efficiency( peaks_with_sources,
-                                              options.rel_eff_eqn_type, manual_rel_eff_order );
+        RelActCalcManual::RelEffSolution manual_solution
+                   = RelActCalcManual::solve_relative_efficiency( peaks_with_sources,
+                                                options.rel_eff_eqn_type, manual_rel_eff_order );
       
-      if( manual_rel_eff_order < options.rel_eff_eqn_order )
-        solution.m_warnings.push_back( "Due to a lack of manually fit peaks, the relative"
-                                       " efficiency equation order had to be reduced for initial"
-                                       " estimate of relative efficiencies and activities." );
+        if( manual_rel_eff_order < options.rel_eff_eqn_order )
+          solution.m_warnings.push_back( "Due to a lack of manually fit peaks, the relative"
+                                         " efficiency equation order had to be reduced for initial"
+                                         " estimate of relative efficiencies and activities." );
       
-      cout << "Initial estimates:" << endl;
-      manual_solution.print_summary( cout );
+        cout << "Initial estimates:" << endl;
+        manual_solution.print_summary( cout );
       
-      //ofstream debug_manual_html( "/Users/wcjohns/rad_ana/InterSpec_RelAct/RelActTest/initial_manual_estimate.html" );
-      //manual_solution.print_html_report( debug_manual_html, options.spectrum_title, spectrum, debug_manual_display_peaks );
+        //ofstream debug_manual_html( "/Users/wcjohns/rad_ana/InterSpec_RelAct/RelActTest/initial_manual_estimate.html" );
+        //manual_solution.print_html_report( debug_manual_html, options.spectrum_title, spectrum, debug_manual_display_peaks );
       
-      //Need to fill out rel eff starting values and rel activities starting values
+        //Need to fill out rel eff starting values and rel activities starting values
       
-      if( manual_solution.m_status != RelActCalcManual::ManualSolutionStatus::Success )
-        throw runtime_error( manual_solution.m_error_message );
+        if( manual_solution.m_status != RelActCalcManual::ManualSolutionStatus::Success )
+          throw runtime_error( manual_solution.m_error_message );
       
-      assert( manual_solution.m_rel_eff_eqn_coefficients.size() == (manual_rel_eff_order + 1) );
+        assert( manual_solution.m_rel_eff_eqn_coefficients.size() == (manual_rel_eff_order + 1) );
       
-      if( manual_rel_eff_order != options.rel_eff_eqn_order )
-      {
-        manual_solution.m_rel_eff_eqn_coefficients.resize( options.rel_eff_eqn_order + 1, 0.0 );
-        manual_solution.m_rel_eff_eqn_covariance.resize( options.rel_eff_eqn_order + 1 );
-        for( auto &v : manual_solution.m_rel_eff_eqn_covariance )
-          v.resize( options.rel_eff_eqn_order + 1, 0.0 );
-      }//
+        if( manual_rel_eff_order != options.rel_eff_eqn_order )
+        {
+          manual_solution.m_rel_eff_eqn_coefficients.resize( options.rel_eff_eqn_order + 1, 0.0 );
+          manual_solution.m_rel_eff_eqn_covariance.resize( options.rel_eff_eqn_order + 1 );
+          for( auto &v : manual_solution.m_rel_eff_eqn_covariance )
+            v.resize( options.rel_eff_eqn_order + 1, 0.0 );
+        }//
       
-      const string rel_eff_eqn_str = RelActCalc::rel_eff_eqn_text( manual_solution.m_rel_eff_eqn_form, manual_solution.m_rel_eff_eqn_coefficients );
-      cout << "Starting with initial rel. eff. eqn = " << rel_eff_eqn_str << endl;
+        const string rel_eff_eqn_str = RelActCalc::rel_eff_eqn_text( manual_solution.m_rel_eff_eqn_form, manual_solution.m_rel_eff_eqn_coefficients );
+        cout << "Starting with initial rel. eff. eqn = " << rel_eff_eqn_str << endl;
       
-      for( size_t i = 0; i <= options.rel_eff_eqn_order; ++i )
-        parameters[rel_eff_start + i] = manual_solution.m_rel_eff_eqn_coefficients[i];
+        for( size_t i = 0; i <= options.rel_eff_eqn_order; ++i )
+          parameters[rel_eff_start + i] = manual_solution.m_rel_eff_eqn_coefficients[i];
 
-      // The parameters will have entries for two sets of peak-skew parameters; one for
-      //  the lowest energy of the problem, and one for the highest; in-between we will
-      //  scale the energy-dependent skew parameters.  If there is no energy dependence for
-      //  a parameter, or the problem doesnt span a large enough energy range to have a
-      //  dependence, parameters for the second skew will be fixed garbage values (i.e.,
-      //  unused)
-      for( size_t i = 0; i < num_skew_coefs; ++i )
-      {
-        const auto ct = PeakDef::CoefficientType( PeakDef::CoefficientType::SkewPar0 + i );
-        double lower, upper, starting, step;
-        const bool use = PeakDef::skew_parameter_range( options.skew_type, ct,
-                                                       lower, upper, starting, step );
-        assert( use );
-        if( !use )
-          throw logic_error( "Inconsistent skew parameter thing" );
-        
-        bool fit_energy_dep = PeakDef::is_energy_dependent( options.skew_type, ct );
-        
-        if( fit_energy_dep && (energy_ranges.size() == 1) )
+        // Manual "relative_activity" assumes a measurement of 1-second (or rather peaks are in CPS),
+        //  but this "auto" relative activity takes into account live_time
+        const double live_time = spectrum->live_time();
+      
+        for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
         {
-          // TODO: if statistically significant peaks across less than ~100 keV, then set fit_energy_dep to false
-#ifdef _MSC_VER
-#pragma message( "if statistically significant peaks across less than ~100 keV, then set fit_energy_dep to false" )
-#else
-#warning "if statistically significant peaks across less than ~100 keV, then set fit_energy_dep to false"
-#endif
-          const double dx = (energy_ranges.front().upper_energy - energy_ranges.front().lower_energy);
-          fit_energy_dep = (dx > 100.0);
-        }
-        
-        // If we will be fitting an energy dependence, make sure the cost functor knows this
-        cost_functor->m_skew_has_energy_dependance |= fit_energy_dep;
-        
+          const RelActCalcAuto::NucInputInfo &nuc = nuclides[nuc_num];
+          const double rel_act = manual_solution.relative_activity( nuc.nuclide->symbol ) / live_time;
         
-        parameters[skew_start + i] = starting;
-        problem.SetParameterLowerBound(pars + skew_start + i, 0, lower );
-        problem.SetParameterUpperBound(pars + skew_start + i, 0, upper );
+          const size_t act_index = acts_start + 2*nuc_num;
+          cout << "Updating initial activity estimate for " << nuc.nuclide->symbol << " from "
+          << parameters[act_index] << " to " << rel_act << endl;
         
-        // Specify ranges for second set of skew parameters
-        if( !fit_energy_dep )
-        {
-          parameters[skew_start + i + num_skew_coefs] = -999.9;
-          problem.SetParameterBlockConstant( pars + skew_start + i + num_skew_coefs );
-        }else
-        {
-          parameters[skew_start + i + num_skew_coefs] = starting;
-          problem.SetParameterLowerBound(pars + skew_start + i + num_skew_coefs, 0, lower );
-          problem.SetParameterUpperBound(pars + skew_start + i + num_skew_coefs, 0, upper );
+          parameters[act_index] = rel_act;
         }
-      }//for( size_t i = 0; i < (num_skew_par/2); ++i )
-      
-      // Manual "relative_activity" assumes a measurement of 1-second (or rather peaks are in CPS),
-      //  but this "auto" relative activity takes into account live_time
-      const double live_time = spectrum->live_time();
       
-      for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
+        succesfully_estimated_re_and_ra = true;
+      }catch( std::exception &e )
       {
-        const RelActCalcAuto::NucInputInfo &nuc = nuclides[nuc_num];
-        const double rel_act = manual_solution.relative_activity( nuc.nuclide->symbol ) / live_time;
-        
-        const size_t act_index = acts_start + 2*nuc_num;
-        cout << "Updating initial activity estimate for " << nuc.nuclide->symbol << " from "
-        << parameters[act_index] << " to " << rel_act << endl;
-        
-        parameters[act_index] = rel_act;
-      }
-      
-      succesfully_estimated_re_and_ra = true;
-    }catch( std::exception &e )
-    {
-      cerr << "Failed to do initial estimate ov RelEff curve: " << e.what() << endl;
+        cerr << "Failed to do initial estimate ov RelEff curve: " << e.what() << endl;
       
-      solution.m_warnings.push_back( "Initial estimate of relative efficiency curve failed ('"
-                                     + string(e.what())
-                                     + "'), using a flat line as a starting point" );
+        solution.m_warnings.push_back( "Initial estimate of relative efficiency curve failed ('"
+                                       + string(e.what())
+                                       + "'), using a flat line as a starting point" );
       
  
-    }//try / catch
+      }//try / catch
+    }//if( warm_start_rel_eff && warm_start_all_acts ) / else
     
     
     for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
@@ -2020,27 +2176,7 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       
       if( fit_age )
       {
-        // TODO: maybe figure out a better method of setting upper age bound
-        
-        // If we are tying the ages of all nuclides in an element together, we dont want to
-        //  accidentally limit the max age based on the shortest nuclides half-life (think U-237 for
-        //  uranium).
-        double half_life = nuc.nuclide->halfLife;
-        if( options.nucs_of_el_same_age )
-        {
-          for( size_t i = 0; i < nuclides.size(); ++i )
-          {
-            if( nuclides[i].nuclide->atomicNumber == nuc.nuclide->atomicNumber )
-              half_life = std::max(half_life, nuclides[i].nuclide->halfLife);
-          }
-        }//if( options.nucs_of_el_same_age )
-        
-        double max_age = std::max( 5.0*nuc.age, 15.0*half_life );
-        
-        // We'll clamp the upper age, to the range where humans may have done the seperation
-        // TODO: is there any problem with a nuclide >100 years, that isnt effectively infinite?
-        max_age = std::min( max_age, 120*PhysicalUnits::year );
-        
+        const double max_age = max_fit_age( nuclides, nuc_num, options.nucs_of_el_same_age );
         problem.SetParameterUpperBound(pars + age_index, 0, max_age );
         problem.SetParameterLowerBound(pars + age_index, 0, 0.0 );
       }else
@@ -2048,7 +2184,7 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
         problem.SetParameterBlockConstant( pars + age_index );
       }
       
-      if( !succesfully_estimated_re_and_ra )
+      if( !succesfully_estimated_re_and_ra && !warm_start_nuc(nuc.nuclide) )
       {
         // Now do a very rough initial activity estimate; there are two obvious ideas
         //  1) Either take in user peaks, or auto-search peaks, and try to match up.  However, we may
@@ -2122,7 +2258,7 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
                                         " significant gammas for the nuclide in the selected energy"
                                         " ranges." );
         }
-      }//if( !succesfully_estimated_re_and_ra )
+      }//if( !succesfully_estimated_re_and_ra && !warm_start_nuc(nuc.nuclide) )
       
       problem.SetParameterLowerBound(pars + act_index, 0, 0.0 );
     }//for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
@@ -2170,6 +2306,83 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     }//for( size_t extra_peak_index = 0; extra_peak_index < extra_peaks.size(); ++extra_peak_index )
     
     
+    if( warm_start )
+    {
+      // Now that all the parameter limits are set, take the starting values from the previous
+      //  solution, for any of the parameters that are compatible with the current problem.
+      const auto set_start_value = [&problem, pars]( const size_t index, const double value ){
+        if( IsNan(value) || IsInf(value) || problem.IsParameterBlockConstant(pars + index) )
+          return;
+        const double lower = problem.GetParameterLowerBound( pars + index, 0 );
+        const double upper = problem.GetParameterUpperBound( pars + index, 0 );
+        pars[index] = std::min( std::max( value, lower ), upper );
+      };//set_start_value lambda
+      
+      const vector<double> &prev_pars = warm_start->m_final_parameters;
+      const size_t prev_num_skew = PeakDef::num_skew_parameters( warm_start->m_options.skew_type );
+      const size_t prev_num_fwhm = num_parameters( warm_start->m_options.fwhm_form );
+      const size_t prev_num_free_peak_par = 2*warm_start->m_floating_peaks.size();
+      assert( prev_pars.size() >= (2 + prev_num_fwhm + warm_start->m_rel_eff_coefficients.size()
+                                   + prev_num_free_peak_par + 2*prev_num_skew) );
+      const size_t prev_skew_start = prev_pars.size() - 2*prev_num_skew;
+      const size_t prev_free_peak_start = prev_skew_start - prev_num_free_peak_par;
+      
+      for( size_t i = 0; i < 2; ++i )
+      {
+        if( warm_start->m_fit_energy_cal[i] && solution.m_fit_energy_cal[i] )
+          set_start_value( i, warm_start->m_energy_cal_adjustments[i] );
+      }
+      
+      if( (warm_start->m_options.fwhm_form == options.fwhm_form)
+         && (warm_start->m_fwhm_coefficients.size() == num_fwhm_pars) )
+      {
+        for( size_t i = 0; i < num_fwhm_pars; ++i )
+          set_start_value( fwhm_start + i, warm_start->m_fwhm_coefficients[i] );
+      }
+      
+      if( warm_start_rel_eff )
+      {
+        for( size_t i = 0; i < num_rel_eff_par; ++i )
+          set_start_value( rel_eff_start + i, warm_start->m_rel_eff_coefficients[i] );
+      }
+      
+      for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
+      {
+        const RelActCalcAuto::NuclideRelAct *prev = warm_start_nuc( nuclides[nuc_num].nuclide );
+        if( !prev )
+          continue;
+        
+        // Note: ages not being fit, or controlled by another nuclide, are constant parameters.
+        set_start_value( acts_start + 2*nuc_num, prev->rel_activity );
+        if( prev->age_was_fit )
+          set_start_value( acts_start + 2*nuc_num + 1, prev->age );
+      }//for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
+      
+      for( size_t peak_index = 0; peak_index < extra_peaks.size(); ++peak_index )
+      {
+        for( size_t prev_index = 0; prev_index < warm_start->m_floating_peaks.size(); ++prev_index )
+        {
+          const RelActCalcAuto::FloatingPeakResult &prev = warm_start->m_floating_peaks[prev_index];
+          if( fabs(prev.energy - extra_peaks[peak_index].energy) > 0.01 )
+            continue;
+          
+          const size_t prev_fwhm_index = prev_free_peak_start + 2*prev_index + 1;
+          set_start_value( free_peak_start + 2*peak_index, prev.amplitude );
+          set_start_value( free_peak_start + 2*peak_index + 1, prev_pars[prev_fwhm_index] );
+          break;
+        }//for( loop over previous floating peaks )
+      }//for( size_t peak_index = 0; peak_index < extra_peaks.size(); ++peak_index )
+      
+      if( warm_start->m_options.skew_type == options.skew_type )
+      {
+        for( size_t i = 0; i < 2*num_skew_coefs; ++i )
+          set_start_value( skew_start + i, prev_pars[prev_skew_start + i] );
+      }
+      
+      cout << "Took starting parameter values from previous solution." << endl;
+    }//if( warm_start )
+    
+    
     // Okay - we've set our problem up
     ceres::Solver::Options ceres_options;
     ceres_options.linear_solver_type = ceres::DENSE_QR;
@@ -2178,10 +2391,11 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     // TODO: there are a ton of ceres::Solver::Options that might be useful for us to set
     
     std::unique_ptr<CheckCeresTerminateCallback> terminate_callback;
-    if( cancel_calc )
+    if( cancel_calc || progress_fcn )
     {
-      terminate_callback.reset( new CheckCeresTerminateCallback(cancel_calc) );
+      terminate_callback.reset( new CheckCeresTerminateCallback(cancel_calc, parameters, progress_fcn) );
       ceres_options.callbacks.push_back( terminate_callback.get() );
+      ceres_options.update_state_every_iteration = true;
     }
     
     
@@ -2223,6 +2437,17 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
         {
           solution.m_status = RelActCalcAuto::RelActAutoSolution::Status::UserCanceled;
           solution.m_error_message += "Calculation was cancelled.";
+          
+          // The current parameters may be from a step evaluated after cancelling, so we'll go
+          //  back to the best parameters from before cancelling.
+          assert( terminate_callback );
+          if( terminate_callback && (terminate_callback->m_best_parameters.size() == num_pars) )
+          {
+            std::copy( begin(terminate_callback->m_best_parameters),
+                      end(terminate_callback->m_best_parameters), begin(parameters) );
+            solution.m_error_message += "  Results are from the best solution found before"
+                                        " cancelling, and do not have uncertainties.";
+          }
         }else
         {
           // I dont think we should get here.
@@ -2298,18 +2523,48 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     
     solution.m_num_function_eval_total = cost_functor->m_ncalls;
   
+    cost_functor->fill_solution( solution, parameters, uncertainties, uncerts_squared, success );
+    
+    //solution.m_status = RelActCalcAuto::RelActAutoSolution::Status::Success;
+    
+    return solution;
+  }//RelActCalcAuto::RelActAutoSolution solve_ceres( ceres::Problem &problem )
+  
+  
+  /** Fills out `solution` (energy calibration adjustments, fit peaks, relative efficiency,
+   relative activities, FWHM, floating peaks, and chi2) from the final parameter values.
+   
+   Expects the `solution.m_spectrum` to already be set, and `uncertainties` and `uncerts_squared`
+   to have the same size as `parameters` (but may be all zeros, if covariance was not computed).
+   */
+  void fill_solution( RelActCalcAuto::RelActAutoSolution &solution,
+                      const std::vector<double> &parameters,
+                      const std::vector<double> &uncertainties,
+                      const std::vector<double> &uncerts_squared,
+                      const bool success ) const
+  {
+    assert( parameters.size() == number_parameters() );
+    assert( uncertainties.size() == parameters.size() );
+    assert( uncerts_squared.size() == parameters.size() );
+    
+    const size_t fwhm_start = m_fwhm_par_start_index;
+    const size_t num_fwhm_pars = num_parameters( m_options.fwhm_form );
+    const size_t rel_eff_start = m_rel_eff_par_start_index;
+    const size_t acts_start = m_acts_par_start_index;
+    const size_t free_peak_start = m_free_peak_par_start_index;
+    
     solution.m_final_parameters = parameters;
     
     solution.m_energy_cal_adjustments[0] = parameters[0];
     solution.m_energy_cal_adjustments[1] = parameters[1];
     
-    shared_ptr<const SpecUtils::EnergyCalibration> new_cal = cost_functor->m_energy_cal;
-    if( success && options.fit_energy_cal )
+    shared_ptr<const SpecUtils::EnergyCalibration> new_cal = m_energy_cal;
+    if( success && m_options.fit_energy_cal )
     {
-      auto new_cal = make_shared<SpecUtils::EnergyCalibration>( *cost_functor->m_energy_cal );
+      auto new_cal = make_shared<SpecUtils::EnergyCalibration>( *m_energy_cal );
       
-      const size_t num_channel = cost_functor->m_energy_cal->num_channels();
-      const SpecUtils::EnergyCalType energy_cal_type = cost_functor->m_energy_cal->type();
+      const size_t num_channel = m_energy_cal->num_channels();
+      const SpecUtils::EnergyCalType energy_cal_type = m_energy_cal->type();
       
       switch( energy_cal_type )
       {
@@ -2317,12 +2572,12 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
         case SpecUtils::EnergyCalType::FullRangeFraction:
         case SpecUtils::EnergyCalType::UnspecifiedUsingDefaultPolynomial:
         {
-          vector<float> coefs = cost_functor->m_energy_cal->coefficients();
+          vector<float> coefs = m_energy_cal->coefficients();
           assert( coefs.size() >= 2 );
           coefs[0] += parameters[0];
           coefs[1] *= parameters[1];
           
-          const auto &dev_pairs = cost_functor->m_energy_cal->deviation_pairs();
+          const auto &dev_pairs = m_energy_cal->deviation_pairs();
           
           if( energy_cal_type == SpecUtils::EnergyCalType::FullRangeFraction )
             new_cal->set_full_range_fraction( num_channel, coefs, dev_pairs );
@@ -2335,7 +2590,7 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
           
         case SpecUtils::EnergyCalType::LowerChannelEdge:
         {
-          vector<float> lower_energies = *cost_functor->m_energy_cal->channel_energies();
+          vector<float> lower_energies = *m_energy_cal->channel_energies();
           for( float &energy : lower_energies )
             energy = parameters[0] + (parameters[1] * energy);
           
@@ -2350,13 +2605,14 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       
       new_cal = new_cal;
       solution.m_spectrum->set_energy_calibration( new_cal );
-    }//if( options.fit_energy_cal )
+    }//if( m_options.fit_energy_cal )
     
   
     vector<PeakDef> fit_peaks;
-    for( const auto &range : cost_functor->m_energy_ranges )
+    const NuclideGammas nuc_gammas = nuclide_gammas( parameters );
+    for( size_t roi_index = 0; roi_index < m_energy_ranges.size(); ++roi_index )
     {
-      PeaksForEnergyRange these_peaks = cost_functor->peaks_for_energy_range( range, parameters );
+      PeaksForEnergyRange these_peaks = peaks_for_energy_range( roi_index, parameters, nuc_gammas );
       fit_peaks.insert( end(fit_peaks), begin(these_peaks.peaks), end(these_peaks.peaks) );
     }
     
@@ -2364,19 +2620,19 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     
     // \c fit_peaks are in the original energy calibration of the spectrum, we may need to adjust
     //  them to match the new energy calibration
-    if( new_cal != cost_functor->m_energy_cal )
+    if( new_cal != m_energy_cal )
     {
       deque<shared_ptr<const PeakDef>> tmp_peaks;
       for( const auto &p : fit_peaks )
         tmp_peaks.push_back( make_shared<const PeakDef>( p ) );
       
       auto adjusted_peaks = EnergyCal::translatePeaksForCalibrationChange( tmp_peaks,
-                                       cost_functor->m_energy_cal, new_cal );
+                                       m_energy_cal, new_cal );
       
       fit_peaks.clear();
       for( const auto &p : adjusted_peaks )
         fit_peaks.push_back( *p );
-    }//if( new_cal != cost_functor->m_energy_cal )
+    }//if( new_cal != m_energy_cal )
     
     solution.m_fit_peaks = fit_peaks;
     
@@ -2384,22 +2640,21 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     const auto rel_eff_iter = begin(parameters) + rel_eff_start;
     solution.m_rel_eff_coefficients.clear();
     solution.m_rel_eff_coefficients.insert( end(solution.m_rel_eff_coefficients),
-                                      rel_eff_iter, rel_eff_iter + options.rel_eff_eqn_order + 1 );
+                                      rel_eff_iter, rel_eff_iter + m_options.rel_eff_eqn_order + 1 );
     
-    const auto rel_act_iter = begin(parameters) + acts_start;
-    for( size_t act_index = 0; act_index < cost_functor->m_nuclides.size(); ++ act_index )
+    for( size_t act_index = 0; act_index < m_nuclides.size(); ++ act_index )
     {
-      const NucInputGamma &nuc_input = cost_functor->m_nuclides[act_index];
+      const NucInputGamma &nuc_input = m_nuclides[act_index];
       
-      const size_t par_nuc_index = cost_functor->nuclide_index( nuc_input.nuclide );
+      const size_t par_nuc_index = nuclide_index( nuc_input.nuclide );
       const size_t par_act_index = acts_start + 2*par_nuc_index;
       const size_t par_age_index = par_act_index + 1;
       
       RelActCalcAuto::NuclideRelAct nuc_output;
       nuc_output.nuclide = nuc_input.nuclide;
-      nuc_output.age = cost_functor->age( nuc_input.nuclide, parameters );
+      nuc_output.age = age( nuc_input.nuclide, parameters );
       nuc_output.age_was_fit = nuc_input.fit_age;
-      nuc_output.rel_activity = cost_functor->relative_activity( nuc_input.nuclide, parameters );
+      nuc_output.rel_activity = relative_activity( nuc_input.nuclide, parameters );
       
       nuc_output.age_uncertainty = uncertainties[par_age_index];
       nuc_output.rel_activity_uncertainty = uncertainties[par_act_index];
@@ -2429,12 +2684,12 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       }
 
       solution.m_rel_activities.push_back( nuc_output );
-    }//for( size_t act_index = 0; act_index < cost_functor->m_nuclides.size(); ++ act_index )
+    }//for( size_t act_index = 0; act_index < m_nuclides.size(); ++ act_index )
     
     
     // If we want to correct for Pu242, we wont alter solution.m_rel_activities, but place the
     //  corrected Pu mass fractions in solution.m_corrected_pu
-    if( options.pu242_correlation_method != RelActCalc::PuCorrMethod::NotApplicable )
+    if( m_options.pu242_correlation_method != RelActCalc::PuCorrMethod::NotApplicable )
     {
       try
       {
@@ -2484,7 +2739,7 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
         
         const RelActCalc::Pu242ByCorrelationOutput corr_output
                = RelActCalc::correct_pu_mass_fractions_for_pu242( raw_rel_masses,
-                                                                 options.pu242_correlation_method );
+                                                                 m_options.pu242_correlation_method );
         
         if( !corr_output.is_within_range )
           solution.m_warnings.push_back( "The fit Pu enrichment is outside range validated in the"
@@ -2495,70 +2750,435 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       {
         solution.m_warnings.push_back( "Correcting for Pu242 content failed: " + string(e.what()) );
       }//try / catch
-    }//if( options.pu242_correlation_method != RelActCalc::PuCorrMethod::NotApplicable )
+    }//if( m_options.pu242_correlation_method != RelActCalc::PuCorrMethod::NotApplicable )
     
     
-    solution.m_fwhm_form = options.fwhm_form;
+    solution.m_fwhm_form = m_options.fwhm_form;
     solution.m_fwhm_coefficients.clear();
     for( size_t i = 0; i < num_fwhm_pars; ++i )
       solution.m_fwhm_coefficients.push_back( parameters[fwhm_start + i] );
     
-    for( size_t i = 0; i < cost_functor->m_extra_peaks.size(); ++i )
+    for( size_t i = 0; i < m_extra_peaks.size(); ++i )
     {
       const size_t amp_index = free_peak_start + 2*i + 0;
       const size_t fwhm_index = free_peak_start + 2*i + 1;
       
       RelActCalcAuto::FloatingPeakResult peak;
-      peak.energy = cost_functor->m_extra_peaks[i].energy;
+      peak.energy = m_extra_peaks[i].energy;
       peak.amplitude = parameters[amp_index];
       peak.fwhm = parameters[fwhm_index];
       
-      if( !cost_functor->m_extra_peaks[i].release_fwhm )
+      if( !m_extra_peaks[i].release_fwhm )
+      {
+        const double true_energy = un_apply_energy_cal_adjustment( peak.energy, parameters );
+        peak.fwhm = fwhm( true_energy, parameters );
+        
+        // TODO: implement evaluating uncertainty of FWHM, given covariance.
+        peak.fwhm_uncert = -1;
+      }else
+      {
+        peak.fwhm_uncert = uncertainties[fwhm_index];
+        if( IsNan(peak.fwhm_uncert) )
+        {
+          solution.m_warnings.push_back( "Variance for floating peak at " + std::to_string(peak.energy)
+                                        + " FWHM is invalid ("
+                                        + std::to_string(uncerts_squared[fwhm_index]) + ")" );
+        }
+      }//if( we didnt let FWHM float ) / else
+      
+      peak.amplitude_uncert = uncertainties[amp_index];
+      
+      
+      if( IsNan(peak.amplitude_uncert) )
+      {
+        solution.m_warnings.push_back( "Variance for floating peak at " + std::to_string(peak.energy)
+                                      + " amplitude is invalid ("
+                                      + std::to_string(uncerts_squared[amp_index]) + ")" );
+      }
+      
+      solution.m_floating_peaks.push_back( peak );
+    }//for( size_t i = 0; i < m_extra_peaks.size(); ++i )
+    
+    vector<double> residuals( number_residuals(), 0.0 );
+    eval( parameters, residuals.data() );
+    solution.m_chi2 = 0.0;
+    for( const double v : residuals )
+      solution.m_chi2 += v*v;
+    
+    // TODO: need to setup the DOF
+    solution.m_dof = 0;
+    solution.m_warnings.push_back( "Not currently calculating DOF - need to implement" );
+    //solution.m_dof = residuals.size() - ;
+    
+  }//void fill_solution(...)
+  
+  
+  /** Fits multiple spectra simultaneously, with the relative efficiency, and nuclide activities
+   and ages shared between all the spectra, and each spectrum having its own energy calibration
+   adjustment, FWHM, floating peaks, and skew parameters.
+   
+   The individual solutions must all be successful, and are used for the starting parameter values,
+   the energy ranges, and the (background subtracted) channel counts and uncertainties, of each
+   spectrum.
+   */
+  static std::vector<RelActCalcAuto::RelActAutoSolution> solve_ceres_joint(
+                                      const RelActCalcAuto::Options &options,
+                                      const std::vector<RelActCalcAuto::NucInputInfo> &nuclides,
+                                      const std::vector<RelActCalcAuto::FloatingPeak> &extra_peaks,
+                                      const std::vector<RelActCalcAuto::RelActAutoSolution> &individual_sols,
+                                      std::shared_ptr<std::atomic_bool> cancel_calc )
+  {
+    const auto start_time = std::chrono::high_resolution_clock::now();
+    
+    const size_t num_spectra = individual_sols.size();
+    assert( num_spectra > 1 );
+    
+    vector<RelActCalcAuto::RelActAutoSolution> solutions = individual_sols;
+    
+    const size_t num_fwhm_pars = num_parameters( options.fwhm_form );
+    const size_t fwhm_start = 2;
+    const size_t rel_eff_start = fwhm_start + num_fwhm_pars;
+    const size_t num_rel_eff_par = options.rel_eff_eqn_order + 1;
+    const size_t acts_start = rel_eff_start + num_rel_eff_par;
+    const size_t num_acts_par = 2*nuclides.size();
+    const size_t free_peak_start = acts_start + num_acts_par;
+    const size_t num_skew_coefs = PeakDef::num_skew_parameters( options.skew_type );
+    const size_t skew_start = free_peak_start + 2*extra_peaks.size();
+    const size_t num_pars = skew_start + 2*num_skew_coefs;
+    
+    // The relative efficiency and nuclide activities/ages are shared between the spectra; we will
+    //  store the value of the shared parameters in the parameters of the first spectrum.
+    const auto is_shared_par = [rel_eff_start, free_peak_start]( const size_t index ) -> bool {
+      return (index >= rel_eff_start) && (index < free_peak_start);
+    };
+    
+    vector<shared_ptr<SpecUtils::Measurement>> spectra( num_spectra );
+    vector<vector<double>> parameters( num_spectra );
+    vector<RelActAutoCostFcn *> cost_functors( num_spectra, nullptr );
+    
+    ceres::Problem problem;
+    
+    for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    {
+      const RelActCalcAuto::RelActAutoSolution &sol = individual_sols[spec_index];
+      assert( sol.m_status == RelActCalcAuto::RelActAutoSolution::Status::Success );
+      
+      if( !sol.m_foreground || (sol.m_final_parameters.size() != num_pars) )
+        throw runtime_error( "RelActAutoCostFcn::solve_ceres_joint: invalid individual solution." );
+      
+      // Make the same (possibly background subtracted) spectrum that `solve_ceres` did.
+      auto spectrum = make_shared<SpecUtils::Measurement>( *sol.m_foreground );
+      if( sol.m_background )
+        spectrum->set_gamma_counts( make_shared<vector<float>>(sol.m_channel_counts),
+                                   sol.m_foreground->live_time(), sol.m_foreground->real_time() );
+      spectra[spec_index] = spectrum;
+      
+      RelActAutoCostFcn *cost_functor = new RelActAutoCostFcn( options, sol.m_input_roi_ranges,
+                                              nuclides, extra_peaks, spectrum,
+                                              sol.m_channel_counts_uncerts, sol.m_drf,
+                                              sol.m_spectrum_peaks, cancel_calc );
+      // `cost_function` takes ownership of `cost_functor`, and `problem` of `cost_function`
+      auto cost_function = new ceres::DynamicNumericDiffCostFunction<RelActAutoCostFcn>( cost_functor );
+      cost_function->SetNumResiduals( cost_functor->number_residuals() );
+      cost_functors[spec_index] = cost_functor;
+      
+      cost_functor->m_energy_cal_par_start_index = 0;
+      cost_functor->m_fwhm_par_start_index = fwhm_start;
+      cost_functor->m_rel_eff_par_start_index = rel_eff_start;
+      cost_functor->m_acts_par_start_index = acts_start;
+      cost_functor->m_free_peak_par_start_index = free_peak_start;
+      cost_functor->m_skew_par_start_index = skew_start;
+      assert( cost_functor->number_parameters() == num_pars );
+      
+      for( size_t i = 0; i < num_skew_coefs; ++i )
+      {
+        const auto ct = PeakDef::CoefficientType( PeakDef::CoefficientType::SkewPar0 + i );
+        cost_functor->m_skew_has_energy_dependance
+                    |= fit_skew_energy_dependence( options.skew_type, ct, sol.m_input_roi_ranges );
+      }
+      
+      parameters[spec_index] = sol.m_final_parameters;
+      
+      vector<double *> parameter_blocks( num_pars );
+      for( size_t i = 0; i < num_pars; ++i )
+      {
+        cost_function->AddParameterBlock( 1 );
+        
+        const size_t owner = is_shared_par(i) ? 0 : spec_index;
+        parameter_blocks[i] = &(parameters[owner][i]);
+      }
+      
+      problem.AddResidualBlock( cost_function, nullptr, parameter_blocks );
+    }//for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    
+    
+    // Now set the parameter limits; these are the same limits as `solve_ceres` uses.
+    for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    {
+      const RelActCalcAuto::RelActAutoSolution &sol = individual_sols[spec_index];
+      double * const pars = parameters[spec_index].data();
+      
+      if( sol.m_fit_energy_cal[0] )
+      {
+        problem.SetParameterLowerBound( pars + 0, 0, -5.0 );
+        problem.SetParameterUpperBound( pars + 0, 0, +5.0 );
+      }else
+      {
+        problem.SetParameterBlockConstant( pars + 0 );
+      }
+      
+      if( sol.m_fit_energy_cal[1] )
+      {
+        problem.SetParameterLowerBound( pars + 1, 0, 0.985 );
+        problem.SetParameterUpperBound( pars + 1, 0, 1.015 );
+      }else
+      {
+        problem.SetParameterBlockConstant( pars + 1 );
+      }
+      
+      if( spec_index == 0 )
+      {
+        const RelActAutoCostFcn * const cost_functor = cost_functors[0];
+        
+        for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
+        {
+          const RelActCalcAuto::NucInputInfo &nuc = nuclides[nuc_num];
+          const size_t act_index = acts_start + 2*nuc_num;
+          const size_t age_index = act_index + 1;
+          
+          problem.SetParameterLowerBound( pars + act_index, 0, 0.0 );
+          
+          if( nuc.fit_age && (cost_functor->age_controlling_nuc(nuc.nuclide) == nuc.nuclide) )
+          {
+            const double max_age = max_fit_age( nuclides, nuc_num, options.nucs_of_el_same_age );
+            problem.SetParameterUpperBound( pars + age_index, 0, max_age );
+            problem.SetParameterLowerBound( pars + age_index, 0, 0.0 );
+          }else
+          {
+            problem.SetParameterBlockConstant( pars + age_index );
+          }
+        }//for( size_t nuc_num = 0; nuc_num < nuclides.size(); ++nuc_num )
+      }//if( spec_index == 0 )
+      
+      for( size_t peak_index = 0; peak_index < extra_peaks.size(); ++peak_index )
+      {
+        const size_t amp_index = free_peak_start + 2*peak_index;
+        const size_t fwhm_index = amp_index + 1;
+        
+        problem.SetParameterLowerBound( pars + amp_index, 0, 0.0 );
+        
+        if( extra_peaks[peak_index].release_fwhm )
+        {
+          problem.SetParameterLowerBound( pars + fwhm_index, 0, 0.25 );
+          problem.SetParameterUpperBound( pars + fwhm_index, 0, 4.0 );
+        }else
+        {
+          problem.SetParameterBlockConstant( pars + fwhm_index );
+        }
+      }//for( size_t peak_index = 0; peak_index < extra_peaks.size(); ++peak_index )
+      
+      for( size_t i = 0; i < num_skew_coefs; ++i )
+      {
+        const auto ct = PeakDef::CoefficientType( PeakDef::CoefficientType::SkewPar0 + i );
+        double lower, upper, starting, step;
+        const bool use = PeakDef::skew_parameter_range( options.skew_type, ct,
+                                                       lower, upper, starting, step );
+        assert( use );
+        if( !use )
+          throw logic_error( "Inconsistent skew parameter thing" );
+        
+        problem.SetParameterLowerBound( pars + skew_start + i, 0, lower );
+        problem.SetParameterUpperBound( pars + skew_start + i, 0, upper );
+        
+        if( fit_skew_energy_dependence( options.skew_type, ct, sol.m_input_roi_ranges ) )
+        {
+          problem.SetParameterLowerBound( pars + skew_start + i + num_skew_coefs, 0, lower );
+          problem.SetParameterUpperBound( pars + skew_start + i + num_skew_coefs, 0, upper );
+        }else
+        {
+          problem.SetParameterBlockConstant( pars + skew_start + i + num_skew_coefs );
+        }
+      }//for( size_t i = 0; i < num_skew_coefs; ++i )
+    }//for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    
+    
+    ceres::Solver::Options ceres_options;
+    ceres_options.linear_solver_type = ceres::DENSE_QR;
+    ceres_options.minimizer_progress_to_stdout = true;
+    
+    std::unique_ptr<CheckCeresTerminateCallback> terminate_callback;
+    if( cancel_calc )
+    {
+      // The parameters are spread across a vector for each spectrum, so we wont bother tracking
+      //  the best parameters; if cancelled, the parameters from the individual fits will be used.
+      terminate_callback.reset( new CheckCeresTerminateCallback(cancel_calc, parameters[0], nullptr) );
+      ceres_options.callbacks.push_back( terminate_callback.get() );
+    }
+    
+    // Unlike for a single spectrum, we have a residual block for each spectrum, which ceres will
+    //  evaluate in parallel.
+    ceres_options.num_threads = std::thread::hardware_concurrency();
+    if( !ceres_options.num_threads )
+    {
+      assert( 0 );
+      ceres_options.num_threads = 4;
+    }
+    
+    ceres::Solver::Summary summary;
+    ceres::Solve( ceres_options, &problem, &summary );
+    std::cout << summary.FullReport() << "\n";
+    
+    RelActCalcAuto::RelActAutoSolution::Status status
+                                  = RelActCalcAuto::RelActAutoSolution::Status::FailToSolveProblem;
+    string error_message;
+    switch( summary.termination_type )
+    {
+      case ceres::CONVERGENCE:
+      case ceres::USER_SUCCESS:
+        status = RelActCalcAuto::RelActAutoSolution::Status::Success;
+        break;
+        
+      case ceres::NO_CONVERGENCE:
+        error_message = "The L-M solving of all spectra together failed - no convergence.";
+        break;
+        
+      case ceres::FAILURE:
+      case ceres::USER_FAILURE:
+        if( cancel_calc && cancel_calc->load() )
+        {
+          status = RelActCalcAuto::RelActAutoSolution::Status::UserCanceled;
+          error_message = "Calculation was cancelled.";
+        }else
+        {
+          error_message = "The L-M solving of all spectra together failed.";
+        }
+        break;
+    }//switch( summary.termination_type )
+    
+    const bool success = (status == RelActCalcAuto::RelActAutoSolution::Status::Success);
+    
+    // Collect all the unique parameters, so we can get their uncertainties.
+    vector<const double *> unique_pars;
+    for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    {
+      for( size_t i = 0; i < num_pars; ++i )
+      {
+        if( (spec_index == 0) || !is_shared_par(i) )
+          unique_pars.push_back( &(parameters[spec_index][i]) );
+      }
+    }//for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    
+    map<const double *, double> variances;
+    bool computed_covariance = false;
+    ceres::Covariance::Options cov_options;
+    cov_options.algorithm_type = ceres::CovarianceAlgorithmType::SPARSE_QR;
+    cov_options.num_threads = ceres_options.num_threads;
+    ceres::Covariance covariance( cov_options );
+    
+    if( success )
+    {
+      vector<pair<const double*, const double*>> covariance_blocks;
+      for( const double *p : unique_pars )
+        covariance_blocks.push_back( make_pair( p, p ) );
+      
+      const auto add_cov_block = [&covariance_blocks]( const double *start, const size_t num ){
+        for( size_t i = 0; i < num; ++i )
+          for( size_t j = 0; j < i; ++j )
+            covariance_blocks.push_back( make_pair( start + i, start + j ) );
+      };
+      
+      add_cov_block( &(parameters[0][rel_eff_start]), num_rel_eff_par );
+      add_cov_block( &(parameters[0][acts_start]), num_acts_par );
+      for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+        add_cov_block( &(parameters[spec_index][fwhm_start]), num_fwhm_pars );
+      
+      computed_covariance = covariance.Compute( covariance_blocks, &problem );
+      if( computed_covariance )
+      {
+        for( const double *p : unique_pars )
+        {
+          double variance = 0.0;
+          covariance.GetCovarianceBlock( p, p, &variance );
+          variances[p] = variance;
+        }
+      }else
+      {
+        cerr << "Failed to compute final covariances for all spectra!" << endl;
+      }
+    }//if( success )
+    
+    const auto get_cov_block = [&covariance]( const double *start, const size_t num,
+                                              vector<vector<double>> &cov ){
+      cov.clear();
+      cov.resize( num, vector<double>(num,0.0) );
+      for( size_t i = 0; i < num; ++i )
+      {
+        for( size_t j = 0; j <= i; ++j )
+        {
+          covariance.GetCovarianceBlock( start + i, start + j, &(cov[i][j]) );
+          cov[j][i] = cov[i][j];
+        }
+      }
+    };//get_cov_block
+    
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    const double joint_microseconds = std::chrono::duration<double, std::micro>(end_time - start_time).count();
+    
+    for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
+    {
+      RelActCalcAuto::RelActAutoSolution &sol = solutions[spec_index];
+      const RelActAutoCostFcn * const cost_functor = cost_functors[spec_index];
+      
+      vector<double> &pars = parameters[spec_index];
+      vector<double> uncertainties( num_pars, 0.0 ), uncerts_squared( num_pars, 0.0 );
+      for( size_t i = 0; i < num_pars; ++i )
       {
-        const double true_energy = cost_functor->un_apply_energy_cal_adjustment( peak.energy, parameters );
-        peak.fwhm = cost_functor->fwhm( true_energy, parameters );
+        const double *p = &(parameters[is_shared_par(i) ? 0 : spec_index][i]);
+        if( is_shared_par(i) )
+          pars[i] = *p;
         
-        // TODO: implement evaluating uncertainty of FWHM, given covariance.
-        peak.fwhm_uncert = -1;
+        const auto pos = variances.find( p );
+        if( pos == end(variances) )
+          continue;
+        
+        uncerts_squared[i] = pos->second;
+        uncertainties[i] = (pos->second >= 0.0) ? sqrt( pos->second )
+                                                : std::numeric_limits<double>::quiet_NaN();
+      }//for( size_t i = 0; i < num_pars; ++i )
+      
+      sol.m_status = status;
+      sol.m_error_message = error_message;
+      sol.m_warnings.clear();
+      if( success && !computed_covariance )
+        sol.m_warnings.push_back( "Failed to compute final covariances." );
+      
+      if( computed_covariance )
+      {
+        get_cov_block( &(parameters[0][rel_eff_start]), num_rel_eff_par, sol.m_rel_eff_covariance );
+        get_cov_block( &(parameters[0][acts_start]), num_acts_par, sol.m_rel_act_covariance );
+        get_cov_block( &(pars[fwhm_start]), num_fwhm_pars, sol.m_fwhm_covariance );
       }else
       {
-        peak.fwhm_uncert = uncertainties[fwhm_index];
-        if( IsNan(peak.fwhm_uncert) )
-        {
-          solution.m_warnings.push_back( "Variance for floating peak at " + std::to_string(peak.energy)
-                                        + " FWHM is invalid ("
-                                        + std::to_string(uncerts_squared[fwhm_index]) + ")" );
-        }
-      }//if( we didnt let FWHM float ) / else
-      
-      peak.amplitude_uncert = uncertainties[amp_index];
+        sol.m_rel_eff_covariance.clear();
+        sol.m_rel_act_covariance.clear();
+        sol.m_fwhm_covariance.clear();
+      }//if( computed_covariance ) / else
       
+      // `fill_solution` appends to these, and adjusts the energy calibration of `m_spectrum`
+      sol.m_rel_activities.clear();
+      sol.m_floating_peaks.clear();
+      sol.m_corrected_pu.reset();
+      sol.m_spectrum = make_shared<SpecUtils::Measurement>( *spectra[spec_index] );
       
-      if( IsNan(peak.amplitude_uncert) )
-      {
-        solution.m_warnings.push_back( "Variance for floating peak at " + std::to_string(peak.energy)
-                                      + " amplitude is invalid ("
-                                      + std::to_string(uncerts_squared[amp_index]) + ")" );
-      }
+      sol.m_num_function_eval_solution = static_cast<int>( cost_functor->m_ncalls );
+      sol.m_num_function_eval_total = static_cast<int>( cost_functor->m_ncalls );
+      sol.m_num_microseconds_eval += static_cast<int>( joint_microseconds );
       
-      solution.m_floating_peaks.push_back( peak );
-    }//for( size_t i = 0; i < cost_functor->m_extra_peaks.size(); ++i )
-    
-    vector<double> residuals( cost_functor->number_residuals(), 0.0 );
-    cost_functor->eval( parameters, residuals.data() );
-    solution.m_chi2 = 0.0;
-    for( const double v : residuals )
-      solution.m_chi2 += v*v;
-    
-    // TODO: need to setup the DOF
-    solution.m_dof = 0;
-    solution.m_warnings.push_back( "Not currently calculating DOF - need to implement" );
-    //solution.m_dof = residuals.size() - ;
-    
-    //solution.m_status = RelActCalcAuto::RelActAutoSolution::Status::Success;
+      cost_functor->fill_solution( sol, pars, uncertainties, uncerts_squared, success );
+    }//for( size_t spec_index = 0; spec_index < num_spectra; ++spec_index )
     
-    return solution;
-  }//RelActCalcAuto::RelActAutoSolution solve_ceres( ceres::Problem &problem )
+    return solutions;
+  }//solve_ceres_joint(...)
   
 
   float fwhm( const float energy, const std::vector<double> &x ) const
@@ -2870,6 +3490,60 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
   };//struct PeaksForEnergyRange
   
   
+  /** The gammas of each nuclide, given the current nuclide ages.
+   
+   Decaying a nuclide is relatively expensive, so this is computed once per evaluation, and shared
+   by all the ROIs, instead of each ROI decaying each nuclide whose age is being fit.
+   */
+  struct NuclideGammas
+  {
+    /** Indexed same as #m_nuclides; points either to `NucInputGamma::nominal_gammas` (for fixed
+     age nuclides), or into #aged_gammas.
+     */
+    std::vector<const std::vector<NucInputGamma::EnergyYield> *> gammas;
+    
+    /** Storage for the gammas of nuclides whose age isnt fixed; a deque so pointers stay valid. */
+    std::deque<std::vector<NucInputGamma::EnergyYield>> aged_gammas;
+  };//struct NuclideGammas
+  
+  
+  NuclideGammas nuclide_gammas( const std::vector<double> &x ) const
+  {
+    NuclideGammas answer;
+    answer.gammas.resize( m_nuclides.size(), nullptr );
+    
+    for( size_t nuc_index = 0; nuc_index < m_nuclides.size(); ++nuc_index )
+    {
+      const NucInputGamma &nucinfo = m_nuclides[nuc_index];
+      
+      if( is_fixed_age(nucinfo.nuclide) )
+      {
+        answer.gammas[nuc_index] = &(nucinfo.nominal_gammas);
+      }else
+      {
+        const double nuc_age = age( nucinfo.nuclide, x );
+        answer.aged_gammas.push_back( NucInputGamma::decay_gammas( nucinfo.nuclide, nuc_age, nucinfo.gammas_to_exclude ) );
+        answer.gammas[nuc_index] = &(answer.aged_gammas.back());
+      }//if( age is fixed ) / else( age may vary )
+    }//for( loop over nuclides )
+    
+    return answer;
+  }//NuclideGammas nuclide_gammas( const std::vector<double> &x ) const
+  
+  
+  /** Returns the [begin,end) indexes of the energy-sorted `gammas` that are within `range`. */
+  static std::pair<size_t,size_t> gammas_in_range( const std::vector<NucInputGamma::EnergyYield> &gammas,
+                                                   const RoiRangeChannels &range )
+  {
+    const auto begin_iter = std::lower_bound( begin(gammas), end(gammas), range.lower_energy,
+      []( const NucInputGamma::EnergyYield &lhs, const double energy ){ return lhs.energy < energy; } );
+    const auto end_iter = std::upper_bound( begin_iter, end(gammas), range.upper_energy,
+      []( const double energy, const NucInputGamma::EnergyYield &rhs ){ return energy < rhs.energy; } );
+    
+    return { static_cast<size_t>(begin_iter - begin(gammas)), static_cast<size_t>(end_iter - begin(gammas)) };
+  }//gammas_in_range(...)
+  
+  
   /** Creates the peaks for a ROI.
    
    All peaks will share a single continuum, and have amplitudes and FWHM according to input
@@ -2879,15 +3553,24 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
    the original energy calibration - i.e., the mean will not be that of the gamma, but the energy
    that gamma would be observed in the spectrum, with its original energy calibration.
    
-   @param range The energy range to create peaks for.
+   @param roi_index The index, within #m_energy_ranges, of the energy range to create peaks for.
    @param x The vector of parameters that specify relative activities, efficiencies, energy
           calibration, etc. of the problem.
+   @param nuc_gammas The gammas of each nuclide, for the ages specified by `x`; see
+          #nuclide_gammas.
    
    @returns A peak for each gamma, of each nuclide, as well as each free-floating peak, in the
             problem, that is within the specified energy range.
    */
-  PeaksForEnergyRange peaks_for_energy_range( const RoiRangeChannels &range, const std::vector<double> &x ) const
+  PeaksForEnergyRange peaks_for_energy_range( const size_t roi_index,
+                                              const std::vector<double> &x,
+                                              const NuclideGammas &nuc_gammas ) const
   {
+    assert( roi_index < m_energy_ranges.size() );
+    assert( m_roi_nominal_gamma_ranges.size() == m_energy_ranges.size() );
+    assert( nuc_gammas.gammas.size() == m_nuclides.size() );
+    
+    const RoiRangeChannels &range = m_energy_ranges[roi_index];
     const size_t num_channels = range.num_channels;
     
     // We will use "adjusted" to refer to energies that have been mapped into the spectrums original
@@ -2917,31 +3600,27 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     vector<PeakDef> &peaks = answer.peaks;
     
     // Go through and create peaks based on rel act, eff, etc
-    for( const NucInputGamma &nucinfo : m_nuclides )
+    for( size_t nuc_index = 0; nuc_index < m_nuclides.size(); ++nuc_index )
     {
-      const vector<NucInputGamma::EnergyYield> *gammas = nullptr;
-      std::unique_ptr<vector<NucInputGamma::EnergyYield>> aged_gammas_cache;
+      const NucInputGamma &nucinfo = m_nuclides[nuc_index];
+      const vector<NucInputGamma::EnergyYield> * const gammas = nuc_gammas.gammas[nuc_index];
+      assert( gammas );
+      
+      // Only the gammas within the ROI energy range matter
+      const pair<size_t,size_t> gamma_indexes = (gammas == &(nucinfo.nominal_gammas))
+                                                  ? m_roi_nominal_gamma_ranges[roi_index][nuc_index]
+                                                  : gammas_in_range( *gammas, range );
+      if( gamma_indexes.first == gamma_indexes.second )
+        continue;
       
       const double rel_act = relative_activity( nucinfo.nuclide, x );
       
       //cout << "peaks_for_energy_range: Relative activity of " << nucinfo.nuclide->symbol
       //     << " is " << PhysicalUnits::printToBestActivityUnits(rel_act) << endl;
       
-      if( is_fixed_age(nucinfo.nuclide) )
-      {
-        gammas = &(nucinfo.nominal_gammas);
-      }else
-      {
-        const double nuc_age = age(nucinfo.nuclide,x);
-        aged_gammas_cache.reset( new vector<NucInputGamma::EnergyYield>() );
-        *aged_gammas_cache = NucInputGamma::decay_gammas( nucinfo.nuclide, nuc_age, nucinfo.gammas_to_exclude );
-        gammas = aged_gammas_cache.get();
-      }//if( age is fixed ) / else( age may vary )
-      
-      assert( gammas );
-      
-      for( const NucInputGamma::EnergyYield &gamma : *gammas )
+      for( size_t gamma_index = gamma_indexes.first; gamma_index < gamma_indexes.second; ++gamma_index )
       {
+        const NucInputGamma::EnergyYield &gamma = (*gammas)[gamma_index];
         const double energy = gamma.energy;
         const double yield = gamma.yield;
         const size_t transition_index = gamma.transition_index;
@@ -3177,12 +3856,14 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     // We'll do the simplest parallelization we can by computing peaks in multiple threads; this
     //  actually seems to be reasonably effective in filling up the CPU cores during fitting.
     //  (setting ceres_options.num_threads >1 doesnt seem to do much (any?) good)
-    SpecUtilsAsync::ThreadPool pool;
+    const NuclideGammas nuc_gammas = nuclide_gammas( x );
+    
+    SharedThreadPool::TaskGroup pool;
     vector<PeaksForEnergyRange> peaks_in_ranges( m_energy_ranges.size() );
     for( size_t i = 0; i < m_energy_ranges.size(); ++i )
     {
-      pool.post( [i,&peaks_in_ranges,this,&x](){
-        peaks_in_ranges[i] = peaks_for_energy_range( m_energy_ranges[i], x );
+      pool.post( [i,&peaks_in_ranges,this,&x,&nuc_gammas](){
+        peaks_in_ranges[i] = peaks_for_energy_range( i, x, nuc_gammas );
       } );
     }//
     pool.join();
@@ -3194,25 +3875,27 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       return;
     }//if( m_cancel_calc && m_cancel_calc->load() )
     
-    assert( SpecUtilsAsync::num_logical_cpu_cores() > 0 );
-    const size_t nthreads_to_use = static_cast<size_t>( SpecUtilsAsync::num_physical_cpu_cores() );
-    
-    // If there are a bunch of ROIs, we'll evaluate each ROI in their own thread, or else, we'll
-    //  break each ROI up into `nthreads_to_use` chunks and evaluate all those in parallel and each
-    //  ROI in parallel.
-    //
-    // TODO: None of this multithreading of computation has been carefully benchmarked, so for all I know it might actually slow things down!
+    // We'll break each ROI up into contiguous chunks of channels, and evaluate all the chunks, of
+    //  all the ROIs, in parallel.
     //
-    // TODO: the slight numerical rounding differences between the methods yields slightly different end results, and different number of required iterations.  If you cast each residual to a 32-bit float, and then back to a double, both methods yield the exact same answer.  This instability makes me nervous, but it should also maybe be corrected for
-    const bool parallelize_over_rois_only = (m_energy_ranges.size() >= nthreads_to_use);
-    
+    // The chunk size is fixed, and not dependent on the number of CPU cores, so that each
+    //  channels residual is computed by exactly the same arithmetic no matter how many threads
+    //  are used (including none); the skewed `PeakDef::gauss_integral(...)` array functions can
+    //  differ in the last bit for a channel, depending on where the array they are called with
+    //  starts.  Previously the number of ROIs vs CPU cores selected between two different
+    //  calculation methods, so fit results, and number of iterations, varied slightly between
+    //  computers.
+    const size_t chunk_size = 96; //arbitrary, but should be a reasonable amount of work
+    
+    const shared_ptr<const vector<float>> &energies_ptr = m_energy_cal->channel_energies();
+    if( !energies_ptr )
+      throw runtime_error( "RelActAutoCostFcn::eval(): somehow invalid energy cal." );
     
     assert( peaks_in_ranges.size() == m_energy_ranges.size() );
     
     size_t residual_index = 0;
     for( size_t roi_index = 0; roi_index < m_energy_ranges.size(); ++roi_index )
     {
-      const RoiRangeChannels &energy_range = m_energy_ranges[roi_index];
       const PeaksForEnergyRange &info = peaks_in_ranges[roi_index];
       
       assert( info.peaks.size() );
@@ -3221,6 +3904,9 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       assert( info.last_channel >= info.first_channel );
       assert( m_channel_counts.size() == m_channel_count_uncerts.size() );
       
+      if( (info.last_channel + 1) >= energies_ptr->size() )
+        throw runtime_error( "RelActAutoCostFcn::eval(): somehow invalid energy cal." );
+      
       const shared_ptr<const PeakContinuum> continuum = info.peaks.at(0).continuum();
       assert( continuum );
       
@@ -3229,147 +3915,60 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       const size_t nchannels_roi = (info.last_channel - info.first_channel) + 1;
       residual_index += nchannels_roi;
       
-      if( parallelize_over_rois_only )
-      {
-        // Define a lamda to evaluate the residuals for an entire ROI
-        const auto eval_for_roi = [this, residuals, residual_start_index, continuum]( const PeaksForEnergyRange &range ) {
-          
-          const shared_ptr<const vector<float>> &energies_ptr = m_energy_cal->channel_energies();
-          if( !energies_ptr || ((range.last_channel+1) >= energies_ptr->size()) )
-            throw runtime_error( "RelActAutoCostFcn::eval(): somehow invalid energy cal." );
-          
-          const vector<float> &energies = *energies_ptr;
-          
-          // We will use the `residual` array to do our computation in
-          const size_t this_nchannel = 1 + range.last_channel - range.first_channel;
-          
-          double * const this_residual = residuals + residual_start_index;
-          const float * const this_energies = &(energies[range.first_channel]);
-          
-          // I think the memset call is valid...
-          memset( this_residual, 0, sizeof(double) * this_nchannel );
-          //for( size_t i = 0; i < this_nchannel; ++i )
-          //  this_residual[i] = 0.0;
-          
-          // Fill in gaussian values
-          for( const PeakDef &peak : range.peaks )
-            peak.gauss_integral( this_energies, this_residual, this_nchannel );
-          
-          // Fill the continuum values
-          //  TODO: optimize call to computing continuum to take in array for range of energy, or at least combine this loop and the next
-          for( size_t index = 0; index < this_nchannel; ++index )
-          {
-            const double x0 = this_energies[index];
-            const double x1 = this_energies[index + 1];
-            this_residual[index] += continuum->offset_integral( x0, x1, m_spectrum );
-          }
-          
-          
-          for( size_t index = 0; index < this_nchannel; ++index )
-          {
-            const size_t data_index = range.first_channel + index;
-            const double data_counts = m_channel_counts[data_index];
-            const double data_uncert = m_channel_count_uncerts[data_index];
-            const double peak_area = this_residual[index];
-            
-            this_residual[index] = (data_counts - peak_area) / data_uncert;
-          }
-        };//eval_for_roi
+      // Define a lamda to evaluate the residuals for `nchannel` channels, starting at
+      //  `first_channel`, of the ROI
+      const auto eval_channels = [this, residuals, residual_start_index, continuum, &energies_ptr]
+                              ( const PeaksForEnergyRange &range, const size_t first_channel, const size_t nchannel ){
+        assert( first_channel >= range.first_channel );
+        assert( (first_channel + nchannel) <= (range.last_channel + 1) );
         
-        pool.post( [eval_for_roi,roi_index,&peaks_in_ranges](){
-          eval_for_roi( peaks_in_ranges[roi_index] );
-        } );
-      }else
-      {
-        // Define a lamda to evaluate the residuals for every n'th channel in ROI, after an initial
-        //  offset.  This allows us to evaluate a ROI using multiple threads, or evaluate an entire
-        //  ROI in a single thread by setting offset to 0, and skip to 1.
-        const auto eval_nth_channels = [this, residuals, residual_start_index, continuum]
-        ( const size_t channel_offset,
-         const size_t channel_skip,
-         const PeaksForEnergyRange &range ){
-          assert( channel_skip != 0 );
-          const size_t start_channel = range.first_channel + channel_offset;
-          
-          const shared_ptr<const vector<float>> &energies_ptr = m_energy_cal->channel_energies();
-          if( !energies_ptr || ((range.last_channel+1) >= energies_ptr->size()) )
-            throw runtime_error( "RelActAutoCostFcn::eval(): somehow invalid energy cal." );
-          
-          const vector<float> &energies = *energies_ptr;
-          
-          for( size_t channel = start_channel; channel <= range.last_channel; channel += channel_skip )
-          {
-            const double data_counts = m_channel_counts[channel];
-            const double data_uncert = m_channel_count_uncerts[channel];
-            const double lower_energy = energies[channel];
-            const double upper_energy = energies[channel + 1];
-            const double continuum_counts = continuum->offset_integral(lower_energy, upper_energy, m_spectrum);
-            
-            double gaussian_area = 0.0;
-            for( const PeakDef &peak : range.peaks )
-            {
-              // The gauss integral is actually pretty expensive, so we'll avoid it if we are just
-              //  really outside the area where peaks could contribute; 8 sigma chosen arbitrarily.
-              //  I'm sure there is a better way to do this.
-              if( (upper_energy >= (peak.mean() - 8*peak.sigma()))
-                     && (lower_energy <= (peak.mean() + 8*peak.sigma())) )
-              {
-                // TODO: the gauss_integral calls `boost_erf_imp` twice, one of which could be avoided if we fill-out the channels sequentially for each peak; this would require some re-factoring, so we'll do it later.  This also needs to be done for `fit_amp_and_offset`
-                gaussian_area += peak.gauss_integral( lower_energy, upper_energy );
-              }
-            }
-            
-            const size_t index = residual_start_index + (channel - range.first_channel);
-            
-            residuals[index] = (data_counts - continuum_counts - gaussian_area) / data_uncert;
-          }//for( loop over channels in ROI )
-        };//eval_nth_channels
+        const vector<float> &energies = *energies_ptr;
+        
+        // We will use the `residual` array to do our computation in
+        double * const this_residual = residuals + residual_start_index + (first_channel - range.first_channel);
+        const float * const this_energies = &(energies[first_channel]);
         
-        for( size_t thread_num = 0; thread_num < nthreads_to_use; ++thread_num )
+        for( size_t i = 0; i < nchannel; ++i )
+          this_residual[i] = 0.0;
+        
+        // Fill in gaussian values
+        for( const PeakDef &peak : range.peaks )
+          peak.gauss_integral( this_energies, this_residual, nchannel );
+        
+        // Fill the continuum values
+        //  TODO: optimize call to computing continuum to take in array for range of energy, or at least combine this loop and the next
+        for( size_t index = 0; index < nchannel; ++index )
         {
-          pool.post( [eval_nth_channels,thread_num,roi_index,&peaks_in_ranges,nthreads_to_use](){
-            eval_nth_channels( thread_num, nthreads_to_use, peaks_in_ranges[roi_index] );
-          } );
+          const double x0 = this_energies[index];
+          const double x1 = this_energies[index + 1];
+          this_residual[index] += continuum->offset_integral( x0, x1, m_spectrum );
         }
-      }//if( parallelize_over_rois ) / else
-      
-/*
-       //Original non-parallel implementation
-      const shared_ptr<const vector<float>> &energies_ptr = m_energy_cal->channel_energies();
-      const vector<float> &energies = *energies_ptr;
-      for( size_t channel = info.first_channel; channel <= info.last_channel; ++channel )
-      {
-        const double data_counts = m_channel_counts[channel];
-        const double data_uncert = m_channel_count_uncerts[channel];
-        const double lower_energy = energies[channel];
-        const double upper_energy = energies[channel + 1];
-        const double continuum_counts = continuum->offset_integral(lower_energy, upper_energy, m_spectrum);
         
-        double gaussian_area = 0.0;
-        for( const PeakDef &peak : info.peaks )
+        for( size_t index = 0; index < nchannel; ++index )
         {
-          if( (upper_energy >= (peak.mean() - 8*peak.sigma()))
-                 && (lower_energy <= (peak.mean() + 8*peak.sigma())) )
-          {
-            gaussian_area += peak.gauss_integral( lower_energy, upper_energy );
-          }
-        }
+          const size_t data_index = first_channel + index;
+          const double data_counts = m_channel_counts[data_index];
+          const double data_uncert = m_channel_count_uncerts[data_index];
+          const double peak_area = this_residual[index];
           
-        const size_t res_index = residual_start_index + channel - info.first_channel;
-        debug_residuals[res_index] = (data_counts - continuum_counts - gaussian_area) / data_uncert;
-      }//for( loop over channels )
-*/
+          this_residual[index] = (data_counts - peak_area) / data_uncert;
+        }
+      };//eval_channels
+      
+      for( size_t chunk_start = 0; chunk_start < nchannels_roi; chunk_start += chunk_size )
+      {
+        const size_t first_channel = info.first_channel + chunk_start;
+        const size_t nchannel = std::min( chunk_size, nchannels_roi - chunk_start );
+        
+        pool.post( [eval_channels,roi_index,first_channel,nchannel,&peaks_in_ranges](){
+          eval_channels( peaks_in_ranges[roi_index], first_channel, nchannel );
+        } );
+      }//for( loop over chunks of the ROI )
+      
     }//for( loop over m_energy_ranges )
     
     pool.join();
     
-    // See TODO above about calculations methods giving slightly different end-results, unless be
-    //  truncate the accuracy of the residuals to be floats.
-    //cerr << "\n\nRounding residuals to floats for debug\n\n" << endl;
-    //const size_t nresid = number_residuals();
-    //for( size_t i = 0; (i+1) < nresid; ++i )
-    //  residuals[i] = static_cast<float>(residuals[i]);
-    
     assert( (residual_index + 1) == number_residuals() );
     
     // Now make sure the relative efficiency curve is anchored to 1.0 (this removes the degeneracy
@@ -3436,6 +4035,161 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
 }
 
 
+namespace
+{
+/** The auto RelAct HTML report template, split at its `${NAME}` placeholders, along with the
+ static resources (JS/CSS) it embeds.  Loaded from disk once per resource directory, since
+ re-reading and re-scanning the ~200 kB of embedded JS/CSS dominated report generation.
+ */
+struct RelActReportTemplate
+{
+  /** Alternating literal text and placeholder names; even indexes are literal text. */
+  vector<string> m_pieces;
+  
+  /** The contents of the resources embedded in every report, by placeholder name. */
+  map<string,string> m_static_values;
+  
+  /** Returns the report, with placeholders filled from `values`, or #m_static_values. Placeholders
+   found in neither are left as-is.
+   */
+  string fill( const map<string,string> &values ) const
+  {
+    size_t total_size = 0;
+    for( size_t i = 0; i < m_pieces.size(); ++i )
+    {
+      if( (i % 2) == 0 )
+      {
+        total_size += m_pieces[i].size();
+        continue;
+      }
+      
+      const auto dyn_pos = values.find( m_pieces[i] );
+      const auto stat_pos = m_static_values.find( m_pieces[i] );
+      if( dyn_pos != end(values) )
+        total_size += dyn_pos->second.size();
+      else if( stat_pos != end(m_static_values) )
+        total_size += stat_pos->second.size();
+      else
+        total_size += m_pieces[i].size() + 3;
+    }//for( size_t i = 0; i < m_pieces.size(); ++i )
+    
+    string answer;
+    answer.reserve( total_size );
+    
+    for( size_t i = 0; i < m_pieces.size(); ++i )
+    {
+      if( (i % 2) == 0 )
+      {
+        answer += m_pieces[i];
+        continue;
+      }
+      
+      const auto dyn_pos = values.find( m_pieces[i] );
+      const auto stat_pos = m_static_values.find( m_pieces[i] );
+      if( dyn_pos != end(values) )
+        answer += dyn_pos->second;
+      else if( stat_pos != end(m_static_values) )
+        answer += stat_pos->second;
+      else
+        answer += "${" + m_pieces[i] + "}";
+    }//for( size_t i = 0; i < m_pieces.size(); ++i )
+    
+    return answer;
+  }//string fill(...) const
+};//struct RelActReportTemplate
+
+
+/** Returns the parsed report template for the current docroot; throws if the template or any of
+ its resources can not be read.
+ */
+shared_ptr<const RelActReportTemplate> rel_act_report_template()
+{
+  Wt::WApplication *app = Wt::WApplication::instance();
+  const string docroot = app ? app->docRoot() : ".";
+  const string resource_path = SpecUtils::append_path( docroot, "InterSpec_resources" );
+  
+  static std::mutex s_template_mutex;
+  static map<string,shared_ptr<const RelActReportTemplate>> s_templates;
+  
+  std::lock_guard<std::mutex> lock( s_template_mutex );
+  
+  const auto pos = s_templates.find( resource_path );
+  if( pos != end(s_templates) )
+    return pos->second;
+  
+  auto load_file_contents = [&resource_path]( string filename ) -> string {
+    const string filepath = SpecUtils::append_path( resource_path, filename );
+    
+    vector<char> file_data;
+    try
+    {
+      SpecUtils::load_file_data( filepath.c_str(), file_data );
+    }catch( std::exception & )
+    {
+      throw std::runtime_error( "Failed to read " + filename );
+    }
+    
+    // `load_file_data` null-terminates the data
+    while( !file_data.empty() && (file_data.back() == '\0') )
+      file_data.pop_back();
+    
+    return string( begin( file_data ), end( file_data ) );
+  };//load_file_contents(...)
+  
+  auto tmplt = make_shared<RelActReportTemplate>();
+  
+  string html = load_file_contents( "static_text/auto_rel_act_report.tmplt.html" );
+  SpecUtils::ireplace_all( html, "\\;", ";" );
+  
+  tmplt->m_static_values["D3_SCRIPT"] = load_file_contents( "d3.v3.min.js" );
+  tmplt->m_static_values["SPECTRUM_CHART_JS"] = load_file_contents( "SpectrumChartD3.js" );
+  tmplt->m_static_values["SPECTRUM_CHART_CSS"] = load_file_contents( "SpectrumChartD3.css" );
+  tmplt->m_static_values["REL_EFF_PLOT_JS"] = load_file_contents( "RelEffPlot.js" );
+  tmplt->m_static_values["REL_EFF_PLOT_CSS"] = load_file_contents( "RelEffPlot.css" );
+  
+  size_t literal_start = 0;
+  while( literal_start <= html.size() )
+  {
+    size_t open_pos = html.find( "${", literal_start );
+    size_t close_pos = string::npos;
+    
+    // Only upper-case/underscore/digit names count as placeholders
+    while( open_pos != string::npos )
+    {
+      close_pos = open_pos + 2;
+      while( (close_pos < html.size())
+            && (isupper( static_cast<unsigned char>(html[close_pos]) )
+                || isdigit( static_cast<unsigned char>(html[close_pos]) )
+                || (html[close_pos] == '_')) )
+      {
+        ++close_pos;
+      }
+      
+      if( (close_pos < html.size()) && (html[close_pos] == '}') && (close_pos > (open_pos + 2)) )
+        break;
+      
+      open_pos = html.find( "${", open_pos + 2 );
+      close_pos = string::npos;
+    }//while( open_pos != string::npos )
+    
+    if( open_pos == string::npos )
+    {
+      tmplt->m_pieces.push_back( html.substr( literal_start ) );
+      break;
+    }
+    
+    tmplt->m_pieces.push_back( html.substr( literal_start, open_pos - literal_start ) );
+    tmplt->m_pieces.push_back( html.substr( open_pos + 2, close_pos - open_pos - 2 ) );
+    literal_start = close_pos + 1;
+  }//while( literal_start <= html.size() )
+  
+  s_templates[resource_path] = tmplt;
+  
+  return tmplt;
+}//shared_ptr<const RelActReportTemplate> rel_act_report_template()
+}//namespace
+
+
 namespace RelActCalcAuto
 {
 
@@ -4527,9 +5281,12 @@ void RelActAutoSolution::print_html_report( std::ostream &out ) const
                   " </tr></thead>\n";
   results_html << "  <tbody>\n";
   
+  const vector<double> enrichments = mass_enrichment_fractions();
+  assert( enrichments.size() == m_rel_activities.size() );
   
-  for( const auto &act : m_rel_activities )
+  for( size_t act_index = 0; act_index < m_rel_activities.size(); ++act_index )
   {
+    const NuclideRelAct &act = m_rel_activities[act_index];
     const double rel_mass = act.rel_activity / act.nuclide->activityPerGram();
     
     results_html << "  <tr><td>" << act.nuclide->symbol;
@@ -4545,9 +5302,9 @@ void RelActAutoSolution::print_html_report( std::ostream &out ) const
     results_html << "</td>"
     << "<td>" << act.rel_activity << " &plusmn; " << act.rel_activity_uncertainty << "</td>"
     << "<td>" << (100.0*rel_mass/sum_rel_mass) << "%</td>"
-    << "<td>" << (100.0*mass_enrichment_fraction(act.nuclide)) << "%</td>"
+    << "<td>" << (100.0*enrichments[act_index]) << "%</td>"
     << "</tr>\n";
-  }//for( const auto &act : m_rel_activities )
+  }//for( size_t act_index = 0; act_index < m_rel_activities.size(); ++act_index )
   
   results_html << "  </tbody>\n"
   << "</table>\n\n";
@@ -4783,53 +5540,14 @@ void RelActAutoSolution::print_html_report( std::ostream &out ) const
   stringstream rel_eff_plot_values, add_rel_eff_plot_css;
   rel_eff_json_data( rel_eff_plot_values, add_rel_eff_plot_css );
 
-  auto load_file_contents = []( string filename ) -> string {
-    Wt::WApplication *app = Wt::WApplication::instance();
-    const string docroot = app ? app->docRoot() : ".";
-    const string resource_path = SpecUtils::append_path( docroot, "InterSpec_resources" );
-    const string filepath = SpecUtils::append_path( resource_path, filename );
-    
-    vector<char> file_data;
-    try
-    {
-      SpecUtils::load_file_data( filepath.c_str(), file_data );
-    }catch( std::exception & )
-    {
-      throw std::runtime_error( "Failed to read " + filename );
-    }
-    
-    return string( begin( file_data ), end( file_data ) );
-  };//load_file_contents(...)
-  
-  
-  string html = load_file_contents( "static_text/auto_rel_act_report.tmplt.html" );
-  const string d3_js = load_file_contents( "d3.v3.min.js" );
-  const string spectrum_chart_d3_js = load_file_contents( "SpectrumChartD3.js" );
-  const string spectrum_chart_d3_css = load_file_contents( "SpectrumChartD3.css" );
-  //const string spectrum_chart_d3_standalone_css = load_file_contents( "SpectrumChartD3StandAlone.css" );
-  
-  
-  SpecUtils::ireplace_all( html, "\\;", ";" );
-  
-  SpecUtils::ireplace_all( html, "${D3_SCRIPT}", d3_js.c_str() );
-  SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_JS}", spectrum_chart_d3_js.c_str() );
-  SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_CSS}", spectrum_chart_d3_css.c_str() );
-  
-  string html_title = m_options.spectrum_title;
-  SpecUtils::ireplace_all( html, "${TITLE}", html_title.c_str() );
-  
-  const string rel_eff_plot_js = load_file_contents( "RelEffPlot.js" );
-  const string rel_eff_plot_css = load_file_contents( "RelEffPlot.css" );
-  SpecUtils::ireplace_all( html, "${REL_EFF_PLOT_JS}", rel_eff_plot_js.c_str() );
-  SpecUtils::ireplace_all( html, "${REL_EFF_PLOT_CSS}", rel_eff_plot_css.c_str() );
-  SpecUtils::ireplace_all( html, "${REL_EFF_PLOT_ADDITIONAL_CSS}", add_rel_eff_plot_css.str().c_str() );
+  const shared_ptr<const RelActReportTemplate> tmplt = rel_act_report_template();
   
-  SpecUtils::ireplace_all( html, "${REL_EFF_DATA_VALS}", rel_eff_plot_values.str().c_str() );
-  
-  const string rel_eff_eqn_js = RelActCalc::rel_eff_eqn_js_function( m_rel_eff_form, m_rel_eff_coefficients );
-  SpecUtils::ireplace_all( html, "${FIT_REL_EFF_EQUATION}", rel_eff_eqn_js.c_str() );
-  
-  SpecUtils::ireplace_all( html, "${RESULTS_TXT}", results_html.str().c_str() );
+  map<string,string> values;
+  values["TITLE"] = m_options.spectrum_title;
+  values["REL_EFF_PLOT_ADDITIONAL_CSS"] = add_rel_eff_plot_css.str();
+  values["REL_EFF_DATA_VALS"] = rel_eff_plot_values.str();
+  values["FIT_REL_EFF_EQUATION"] = RelActCalc::rel_eff_eqn_js_function( m_rel_eff_form, m_rel_eff_coefficients );
+  values["RESULTS_TXT"] = results_html.str();
   
   
   if( m_spectrum )
@@ -4898,24 +5616,20 @@ void RelActAutoSolution::print_html_report( std::ostream &out ) const
     D3SpectrumExport::write_and_set_data_for_chart( set_js_str, "specchart", { std::make_pair(meas_ptr,spec_options) } );
         
     
-    SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_DIV}",
-                            "<div id=\"specchart\" style=\"height: 30vw; flex: 1 2; overflow: hidden;\" class=\"SpecChart\"></div>" );
-    SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_INIT_JS}", set_js_str.str().c_str() );
+    values["SPECTRUM_CHART_DIV"] = "<div id=\"specchart\" style=\"height: 30vw; flex: 1 2; overflow: hidden;\" class=\"SpecChart\"></div>";
+    values["SPECTRUM_CHART_INIT_JS"] = set_js_str.str();
     
-    
-    SpecUtils::ireplace_all( html, "${CHART_SPACER_LEFT}", "" );
-    SpecUtils::ireplace_all( html, "${CHART_SPACER_RIGHT}", "" );
+    values["CHART_SPACER_LEFT"] = "";
+    values["CHART_SPACER_RIGHT"] = "";
   }else
   {
-    SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_DIV}", "" );
-    //SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_JS}", "" );
-    //SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_CSS}", "" );
-    SpecUtils::ireplace_all( html, "${SPECTRUM_CHART_INIT_JS}", "" );
-    SpecUtils::ireplace_all( html, "${CHART_SPACER_LEFT}", "<div style=\"width: 10%\"> </div>" );
-    SpecUtils::ireplace_all( html, "${CHART_SPACER_RIGHT}", "<div style=\"width: 15%\"> </div>" );
+    values["SPECTRUM_CHART_DIV"] = "";
+    values["SPECTRUM_CHART_INIT_JS"] = "";
+    values["CHART_SPACER_LEFT"] = "<div style=\"width: 10%\"> </div>";
+    values["CHART_SPACER_RIGHT"] = "<div style=\"width: 15%\"> </div>";
   }//if( m_spectrum ) / else
   
-  out << html;
+  out << tmplt->fill( values );
 
 }//void print_html_report( std::ostream &out ) const
 
@@ -5080,6 +5794,61 @@ double RelActAutoSolution::mass_enrichment_fraction( const SandiaDecay::Nuclide
 }//mass_enrichment_fraction
 
 
+std::vector<double> RelActAutoSolution::mass_enrichment_fractions() const
+{
+  // Same conventions as `mass_enrichment_fraction(...)`: Pu isotopes and Am241 are considered
+  //  together, while any other isotope is compared to all isotopes of its element.  Am241 is
+  //  compared to the Pu isotopes, as well as all Am isotopes (e.g., Am243).
+  const auto is_pu = []( const SandiaDecay::Nuclide *nuc ) -> bool {
+    return ((nuc->atomicNumber == 94) || ((nuc->atomicNumber == 95) && (nuc->massNumber == 241)));
+  };
+  
+  double pu_total_mass = 0.0, other_am_mass = 0.0;
+  map<short,double> el_total_masses;
+  for( const NuclideRelAct &nuc : m_rel_activities )
+  {
+    const double rel_mass = nuc.rel_activity / nuc.nuclide->activityPerGram();
+    el_total_masses[nuc.nuclide->atomicNumber] += rel_mass;
+    if( is_pu(nuc.nuclide) )
+      pu_total_mass += rel_mass;
+    else if( nuc.nuclide->atomicNumber == 95 )
+      other_am_mass += rel_mass;
+  }//for( const NuclideRelAct &nuc : m_rel_activities )
+  
+  vector<double> answer( m_rel_activities.size(), 0.0 );
+  for( size_t i = 0; i < m_rel_activities.size(); ++i )
+  {
+    const SandiaDecay::Nuclide * const nuclide = m_rel_activities[i].nuclide;
+    const double rel_mass = m_rel_activities[i].rel_activity / nuclide->activityPerGram();
+    
+    if( !is_pu(nuclide) )
+    {
+      answer[i] = rel_mass / el_total_masses[nuclide->atomicNumber];
+    }else if( !m_corrected_pu )
+    {
+      const bool is_am = (nuclide->atomicNumber == 95);
+      answer[i] = rel_mass / (pu_total_mass + (is_am ? other_am_mass : 0.0));
+    }else if( nuclide->atomicNumber == 95 )
+    {
+      answer[i] = m_corrected_pu->am241_mass_frac;
+    }else
+    {
+      switch( nuclide->massNumber )
+      {
+        case 238: answer[i] = m_corrected_pu->pu238_mass_frac; break;
+        case 239: answer[i] = m_corrected_pu->pu239_mass_frac; break;
+        case 240: answer[i] = m_corrected_pu->pu240_mass_frac; break;
+        case 241: answer[i] = m_corrected_pu->pu241_mass_frac; break;
+        case 242: answer[i] = m_corrected_pu->pu242_mass_frac; break;
+        default:  answer[i] = (1.0 - m_corrected_pu->pu242_mass_frac) * rel_mass / pu_total_mass; break;
+      }//switch( nuclide->massNumber )
+    }//if( not Pu ) / else ...
+  }//for( size_t i = 0; i < m_rel_activities.size(); ++i )
+  
+  return answer;
+}//std::vector<double> mass_enrichment_fractions() const
+
+
 double RelActAutoSolution::mass_ratio( const SandiaDecay::Nuclide *numerator,
                                       const SandiaDecay::Nuclide *denominator ) const
 {
@@ -5113,7 +5882,7 @@ double RelActAutoSolution::activity_ratio( const SandiaDecay::Nuclide *numerator
       const double corr_rel_pu242_act = pu242->activityPerGram() * m_corrected_pu->pu242_mass_frac;
       
       const double raw_pu239_activity = m_rel_activities[nuclide_index(pu239)].rel_activity;
-      return raw_pu239_activity * corr_rel_pu242_act / corr_rel_pu242_act;
+      return raw_pu239_activity * corr_rel_pu242_act / corr_rel_pu239_act;
     }//if( Pu242, and make correction )
     
     return m_rel_activities[nuclide_index(nuc)].rel_activity;
@@ -5143,9 +5912,16 @@ RelActAutoSolution solve( const Options options,
                          std::shared_ptr<const SpecUtils::Measurement> background,
                          std::shared_ptr<const DetectorPeakResponse> input_drf,
                          std::vector<std::shared_ptr<const PeakDef>> all_peaks,
-                         std::shared_ptr<std::atomic_bool> cancel_calc
+                         std::shared_ptr<std::atomic_bool> cancel_calc,
+                         std::shared_ptr<const RelActAutoSolution> warm_start,
+                         std::function<void(const SolveProgress &)> progress_fcn
                          )
 {
+  INTERSPEC_TRACE_SCOPE( "RelActCalcAuto::solve" );
+  static ServerMetrics::Histogram &fit_durations = ServerMetrics::histogram( "interspec_fit_duration_seconds",
+                                            "Time taken by analysis fits and searches.", "type=\"rel_act_auto\"" );
+  const ServerMetrics::ScopedLatency fit_latency( fit_durations );
+  
   const RelActAutoSolution orig_sol = RelActAutoCostFcn::solve_ceres(
                      options,
                      energy_ranges,
@@ -5155,7 +5931,9 @@ RelActAutoSolution solve( const Options options,
                      background,
                      input_drf,
                      all_peaks,
-                     cancel_calc );
+                     cancel_calc,
+                     warm_start,
+                     progress_fcn );
   
   bool all_roi_full_range = true;
   for( const auto &roi : energy_ranges )
@@ -5452,9 +6230,12 @@ RelActAutoSolution solve( const Options options,
     
     try
     {
+      // We'll start from the current solution, since changing the ROIs shouldnt change it much
+      const auto prev_sol = make_shared<const RelActAutoSolution>( current_sol );
       const RelActAutoSolution updated_sol
       = RelActAutoCostFcn::solve_ceres( options, updated_energy_ranges, nuclides, extra_peaks,
-                                       foreground, background, input_drf, all_peaks, cancel_calc );
+                                       foreground, background, input_drf, all_peaks, cancel_calc,
+                                       prev_sol, progress_fcn );
       
       switch( updated_sol.m_status )
       {
@@ -5518,4 +6299,59 @@ RelActAutoSolution solve( const Options options,
 }//RelActAutoSolution
 
 
+std::vector<RelActAutoSolution> solve( const Options options,
+                                       const std::vector<RoiRange> energy_ranges,
+                                       const std::vector<NucInputInfo> nuclides,
+                                       const std::vector<FloatingPeak> extra_peaks,
+                                       const std::vector<SpectrumInput> spectra,
+                                       std::shared_ptr<std::atomic_bool> cancel_calc )
+{
+  if( spectra.empty() )
+    throw runtime_error( "RelActCalcAuto::solve: no spectra specified." );
+  
+  // First solve each spectrum on its own, to get the final energy ranges for each spectrum, and
+  //  starting values for the combined fit.
+  vector<RelActAutoSolution> individual_sols( spectra.size() );
+  vector<std::exception_ptr> errors( spectra.size() );
+  
+  vector<std::thread> threads;
+  for( size_t i = 0; i < spectra.size(); ++i )
+  {
+    threads.emplace_back( [&,i](){
+      try
+      {
+        const SpectrumInput &input = spectra[i];
+        individual_sols[i] = solve( options, energy_ranges, nuclides, extra_peaks,
+                                    input.foreground, input.background, input.drf,
+                                    input.all_peaks, cancel_calc );
+      }catch( ... )
+      {
+        errors[i] = std::current_exception();
+      }
+    } );
+  }//for( size_t i = 0; i < spectra.size(); ++i )
+  
+  for( std::thread &t : threads )
+    t.join();
+  
+  for( const std::exception_ptr &err : errors )
+  {
+    if( err )
+      std::rethrow_exception( err );
+  }
+  
+  if( spectra.size() == 1 )
+    return individual_sols;
+  
+  for( const RelActAutoSolution &sol : individual_sols )
+  {
+    if( sol.m_status != RelActAutoSolution::Status::Success )
+      return individual_sols;
+  }
+  
+  return RelActAutoCostFcn::solve_ceres_joint( options, nuclides, extra_peaks, individual_sols,
+                                              cancel_calc );
+}//std::vector<RelActAutoSolution> solve( ... multiple spectra ... )
+
+
 }//namespace RelActCalcAuto
@@ -604,13 +604,16 @@ void fit_rel_eff_eqn_lls( const RelActCalc::RelEffEqnForm fcn_form, const size_t
   // Only compute covariance if it is wanted
   if( covariance )
   {
-    // TODO: I'm sure Eigen::BDCSVD has the uncertainty matrix in it somewhere already computed, but
-    //       for the moment (See pg 796 in Numerical Recipes for hint - probably has something to do
-    //       with bdc.singularValues(), bdc.matrixV(), or bdc.matrixU()) we'll just be dumb and do
-    //       extra (unstable?) work.
-    const Eigen::MatrixXd A_transpose = A.transpose();
-    const Eigen::MatrixXd alpha = Eigen::Product<Eigen::MatrixXd,Eigen::MatrixXd>( A_transpose, A ); //A_transpose * A;
-    const Eigen::MatrixXd C = alpha.inverse();
+    // With A = U*S*V^T, the covariance (A^T*A)^-1 is V*S^-2*V^T (see pg 796 in Numerical
+    //  Recipes), so we can get it from the SVD we already have, rather than forming and
+    //  inverting A^T*A.  Zero singular values (which would make A^T*A singular) are dropped.
+    const Eigen::VectorXd &sing_vals = bdc.singularValues();
+    Eigen::VectorXd inv_sq_sing_vals( sing_vals.size() );
+    for( Eigen::Index i = 0; i < sing_vals.size(); ++i )
+      inv_sq_sing_vals(i) = (sing_vals(i) > 0.0) ? 1.0 / (sing_vals(i)*sing_vals(i)) : 0.0;
+    
+    const Eigen::MatrixXd &V = bdc.matrixV();
+    const Eigen::MatrixXd C = V * inv_sq_sing_vals.asDiagonal() * V.transpose();
     
     assert( C.rows() == solution.size() );
     assert( C.cols() == solution.size() );
@@ -2489,7 +2492,11 @@ NucMatchResults fill_in_nuclide_info( const vector<RelActCalcManual::GenericPeak
           assert( fabs(ref_act - mix.activity(age, nuc)) < 0.001*ref_act );
           
           vector<SandiaDecay::EnergyRatePair> un_decay_corrected_photons;
-          vector<SandiaDecay::EnergyRatePair> photons = mix.photons( age, SandiaDecay::NuclideMixture::HowToOrder::OrderByEnergy );
+          vector<SandiaDecay::EnergyRatePair> photons
+                      = *DecayedPhotonCache::photons( nuc, age, DecayedPhotonCache::Emissions::Photons,
+                                                      SandiaDecay::NuclideMixture::HowToOrder::OrderByEnergy );
+          for( SandiaDecay::EnergyRatePair &photon : photons )
+            photon.numPerSecond *= initial_activity;
           
           if( isotopes[i].decay_during_measurement )
           {
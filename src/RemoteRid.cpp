@@ -23,11 +23,16 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <list>
 #include <mutex>
+#include <chrono>
 #include <random>
 #include <string>
+#include <cstdint>
 #include <sstream>
 #include <iostream>
+#include <functional>
 
 #if( !ANDROID && !IOS && !BUILD_FOR_WEB_DEPLOYMENT )
 #include <cstdlib>
@@ -187,7 +192,107 @@ std::string run_external_command( const string &exe, const vector<string> &args
    */
 }
 
+
+/** Per-session state of automated (i.e., on spectrum load) analyses using an executable.
+ 
+ Rapidly switching files shouldnt launch a process for every file; instead at most one
+ analysis runs per session, with only the most recently requested one waiting to run, and results
+ for spectra that are no longer the most recent request are discarded.
+ */
+struct AutoExeAnaState
+{
+  bool running = false;
+  uint64_t latest_request = 0;
+  std::function<void()> pending;
+};//struct AutoExeAnaState
+
+std::mutex ns_auto_exe_ana_mutex;
+std::map<std::string,AutoExeAnaState> ns_auto_exe_ana;
 #endif //#if( !ANDROID && !IOS && !BUILD_FOR_WEB_DEPLOYMENT )
+
+
+/** Process-wide cache of successful external RID results.
+ 
+ The same spectrum file is often analyzed repeatedly (e.g., re-loading a file, switching back
+ and forth between files with "always do analysis" on, or multiple sessions looking at the same
+ file), so results are cached keyed off of a hash of the exact N42 file sent for analysis, along
+ with the service and the analysis options.  Entries expire after #ns_rid_cache_ttl, and only the
+ #ns_rid_cache_max_entries most recently used results are kept.
+ */
+struct CachedRidResult
+{
+  std::string key;
+  std::string result;
+  std::chrono::steady_clock::time_point stored;
+};//struct CachedRidResult
+
+const std::chrono::minutes ns_rid_cache_ttl( 60 );
+const size_t ns_rid_cache_max_entries = 128;
+
+std::mutex ns_rid_cache_mutex;
+std::list<CachedRidResult> ns_rid_cache; //Most recently used at the front
+std::map<std::string,std::list<CachedRidResult>::iterator> ns_rid_cache_index;
+
+
+/** Returns the cache key for an analysis.
+ 
+ @param service The REST URL, or executable path, doing the analysis.
+ @param options The analysis options (DRF, synthesize background, etc) sent to the service.
+ @param n42_content The N42 file, as serialized for analysis.
+ */
+std::string rid_cache_key( const std::string &service, const std::string &options,
+                           const std::string &n42_content )
+{
+  const size_t content_hash = std::hash<std::string>()( n42_content );
+  return service + "\n" + options + "\n" + std::to_string( n42_content.size() )
+         + ":" + std::to_string( content_hash );
+}//rid_cache_key(...)
+
+
+/** Retrieves a non-expired cached result, returning true if found. */
+bool cached_rid_result( const std::string &key, std::string &result )
+{
+  std::lock_guard<std::mutex> lock( ns_rid_cache_mutex );
+  
+  const auto pos = ns_rid_cache_index.find( key );
+  if( pos == end(ns_rid_cache_index) )
+    return false;
+  
+  if( (std::chrono::steady_clock::now() - pos->second->stored) > ns_rid_cache_ttl )
+  {
+    ns_rid_cache.erase( pos->second );
+    ns_rid_cache_index.erase( pos );
+    return false;
+  }
+  
+  ns_rid_cache.splice( begin(ns_rid_cache), ns_rid_cache, pos->second );
+  result = pos->second->result;
+  
+  return true;
+}//bool cached_rid_result(...)
+
+
+/** Stores a result in the cache, evicting the least-recently used entry, if necessary. */
+void cache_rid_result( const std::string &key, const std::string &result )
+{
+  std::lock_guard<std::mutex> lock( ns_rid_cache_mutex );
+  
+  const auto pos = ns_rid_cache_index.find( key );
+  if( pos != end(ns_rid_cache_index) )
+  {
+    ns_rid_cache.erase( pos->second );
+    ns_rid_cache_index.erase( pos );
+  }
+  
+  ns_rid_cache.push_front( CachedRidResult{ key, result, std::chrono::steady_clock::now() } );
+  ns_rid_cache_index[key] = begin(ns_rid_cache);
+  
+  while( ns_rid_cache.size() > ns_rid_cache_max_entries )
+  {
+    ns_rid_cache_index.erase( ns_rid_cache.back().key );
+    ns_rid_cache.pop_back();
+  }
+}//void cache_rid_result(...)
 }//namespace
 
 
@@ -311,6 +416,21 @@ FullSpecResults json_to_results( const string &input )
 }//FullSpecResults json_to_results(string)
 
 
+/** Returns true if the analysis response is a successful analysis, and so can be cached. */
+bool is_cacheable_result( const string &input )
+{
+  try
+  {
+    const FullSpecResults results = json_to_results( input );
+    return (results.code == 0) && results.errorMessage.empty() && (results.analysisError == 0);
+  }catch( std::exception & )
+  {
+  }
+  
+  return false;
+}//bool is_cacheable_result( const string &input )
+
+
 /** A class to stream the current spectrum data and analysis options to the JavaScript FormData
  format expected by the FullSpectrum service.
  
@@ -332,12 +452,23 @@ class RestRidInputResource : public Wt::WResource
   Wt::WApplication *m_app; //it looks like WApplication::instance() will be valid in handleRequest, but JIC
   InterSpec *m_interspec;
   
+  /** The analysis options JSON, and N42 file, to send; set by #prepareAnalysisInput. */
+  std::string m_options;
+  std::string m_n42_content;
+  
 public:
   RestRidInputResource( InterSpec *interspec, WObject* parent = 0 );
   
   void setAnaFlags( Wt::WFlags<RemoteRid::AnaFileOptions> flags );
   void setDrf( const std::string &drf );
   
+  /** Serializes the current spectrum file, and analysis options, that will be served by this
+   resource, and returns the key results should be cached under.
+   
+   Must be called from within the application (i.e., with the WApplication lock held).
+   */
+  std::string prepareAnalysisInput( const std::string &ana_service_url );
+  
   virtual ~RestRidInputResource();
   virtual void handleRequest( const Wt::Http::Request &request,
                              Wt::Http::Response &response );
@@ -359,16 +490,31 @@ class RestRidInterface : public Wt::WContainerWidget
 public:
   JSignal<std::string> m_info_response_signal;
   JSignal<std::string> m_info_error_signal;
-  JSignal<std::string> m_analysis_results_signal;
+  JSignal<int,std::string> m_analysis_response_signal;
   JSignal<std::string> m_analysis_error_signal;
   
+  /** Emitted with the analysis results JSON; either from the service, or from the cache. */
+  Wt::Signal<std::string> m_analysis_results_signal;
+  
   RestRidInputResource *m_resource;
   
+  /** Cache keys of in-flight requests, indexed by the request number passed through the JS. */
+  int m_next_request_num;
+  std::map<int,std::string> m_request_cache_keys;
+  
 public:
   RestRidInterface( InterSpec *viewer, Wt::WContainerWidget *parent );
   void setAnaFlags( Wt::WFlags<RemoteRid::AnaFileOptions> flags );
   void setDrf( const string &drf );
-  void startRestAnalysis( const string ana_service_url );
+  
+  /** Starts the analysis; the requests are made from the browser.
+   
+   If `is_automated` is true, any still-pending automated analysis request from this browser
+   window is aborted, as its result would be for a spectrum that is no longer displayed.
+   */
+  void startRestAnalysis( const string ana_service_url, const bool is_automated = false );
+  void handleAnalysisResponse( const int request_num, std::string response );
+  void emitCachedResult( std::string response );
   void requestRestServiceInfo( const string url );
   void deleteSelfForToast();
   void handleAutoAnaResultSuccess( string response );
@@ -1165,7 +1311,87 @@ public:
 public:
 
 #if( !ANDROID && !IOS && !BUILD_FOR_WEB_DEPLOYMENT )
-  static void startExeAnalysis( string exe_path, ExternalRidWidget *parent, string drf, shared_ptr<SpecUtils::SpecFile> spec_file )
+  /** Starts an automated (on spectrum load) analysis using the executable, or if one is already
+   running for this session, queues it (replacing any previously queued one).
+   */
+  static void startAutoExeAnalysis( const string exe_path, shared_ptr<SpecUtils::SpecFile> spec_file )
+  {
+    const string session = wApp->sessionId();
+    
+    uint64_t request_id = 0;
+    bool start_now = false;
+    std::function<void()> runner;
+    
+    {//begin lock on ns_auto_exe_ana_mutex
+      std::lock_guard<std::mutex> lock( ns_auto_exe_ana_mutex );
+      AutoExeAnaState &state = ns_auto_exe_ana[session];
+      request_id = ++state.latest_request;
+      
+      runner = [exe_path,spec_file,request_id](){
+        if( !startExeAnalysis( exe_path, nullptr, "auto", spec_file, request_id ) )
+          autoExeAnalysisFinished( request_id, nullptr, nullptr, nullptr );
+      };
+      
+      start_now = !state.running;
+      state.running = true;
+      if( !start_now )
+        state.pending = runner;
+    }//end lock on ns_auto_exe_ana_mutex
+    
+    if( start_now )
+      runner();
+  }//void startAutoExeAnalysis(...)
+  
+  
+  /** Called from within the session, when an automated executable analysis is done.
+   Displays the result if it is for the latest requested analysis, and starts any queued analysis.
+   */
+  static void autoExeAnalysisFinished( const uint64_t request_id,
+                                       std::shared_ptr<int> rcode,
+                                       std::shared_ptr<string> result,
+                                       std::shared_ptr<std::mutex> m )
+  {
+    if( !wApp )
+      return;
+    
+    const string session = wApp->sessionId();
+    
+    bool is_latest = false;
+    std::function<void()> next;
+    
+    {//begin lock on ns_auto_exe_ana_mutex
+      std::lock_guard<std::mutex> lock( ns_auto_exe_ana_mutex );
+      auto pos = ns_auto_exe_ana.find( session );
+      if( pos != end(ns_auto_exe_ana) )
+      {
+        is_latest = (pos->second.latest_request == request_id);
+        next.swap( pos->second.pending );
+        pos->second.running = static_cast<bool>( next );
+        
+        if( !pos->second.running )
+          ns_auto_exe_ana.erase( pos );
+      }//if( pos != end(ns_auto_exe_ana) )
+    }//end lock on ns_auto_exe_ana_mutex
+    
+    if( is_latest && rcode && result && m )
+      displayAutoRidAnaResult( rcode, result, m );
+    
+    if( next )
+      next();
+  }//void autoExeAnalysisFinished(...)
+  
+  
+  /** Starts the analysis using the executable.
+   
+   @param parent The widget to display results in; if nullptr, results are displayed as a toast,
+          or dialog, as for automated analyses.
+   @param auto_request_id If non-zero, the analysis was started by #startAutoExeAnalysis,
+          and #autoExeAnalysisFinished will be called when it is done.
+   @returns if the analysis was started; if false, an error has already been displayed or logged.
+   */
+  static bool startExeAnalysis( string exe_path, ExternalRidWidget *parent, string drf,
+                                shared_ptr<SpecUtils::SpecFile> spec_file,
+                                const uint64_t auto_request_id = 0 )
   {
     vector<string> arguments;
     arguments.push_back( "--mode=command-line" );
@@ -1187,7 +1413,7 @@ public:
         cerr << __func__ << ": Error locating executable: '" + exe_path + "'" << endl;
       }
       
-      return;
+      return false;
     }//if( !AppUtils::locate_file(exe_path, false, 0, true ) )
     
     
@@ -1206,9 +1432,50 @@ public:
         cerr << __func__ << ": Error creating temp file name." << endl;
       }
       
-      return;
+      return false;
     }//if( SpecUtils::is_file(tmpfilename) || SpecUtils::is_directory(tmpfilename) )
     
+    const string appsession = WApplication::instance()->sessionId();
+    auto result = std::make_shared<string>();
+    auto rcode = std::make_shared<int>(-1);
+    auto m = make_shared<mutex>();
+    boost::function<void()> doUpdateFcn;
+    
+    if( parent )
+      doUpdateFcn = wApp->bind( boost::bind( &ExternalRidWidget::receiveExeAnalysis, parent, rcode, result, m ) );
+    else if( auto_request_id )
+      doUpdateFcn = boost::bind( &ExternalRidWidget::autoExeAnalysisFinished, auto_request_id, rcode, result, m );
+    else
+      doUpdateFcn = boost::bind( &ExternalRidWidget::displayAutoRidAnaResult, rcode, result, m );
+    
+    
+    stringstream n42_content;
+    spec_file->write_2012_N42( n42_content );
+    const string n42_str = n42_content.str();
+    
+    string options;
+    for( const string &arg : arguments )
+      options += arg + " ";
+    const string cache_key = rid_cache_key( exe_path, options, n42_str );
+    
+    string cached_result;
+    if( cached_rid_result( cache_key, cached_result ) )
+    {
+      {
+        std::lock_guard<mutex> lock( *m );
+        *rcode = 0;
+        *result = cached_result;
+      }
+      
+      // Post, rather than call directly, so results are handled the same as a fresh analysis.
+      WServer *server = WServer::instance();
+      if( server )
+        server->post( appsession, doUpdateFcn );
+      
+      return true;
+    }//if( we already have the result for this exact file )
+    
+    
     {//begin writing temp file
       ofstream tmpfile( tmpfilename.c_str(), ios::out | ios::binary );
       if( !tmpfile.is_open() )
@@ -1222,27 +1489,15 @@ public:
           cerr << __func__ << ": Error opening temp file." << endl;
         }
         
-        return;
+        return false;
       }//if( !tmpfile.is_open() )
       
-      spec_file->write_2012_N42( tmpfile );
+      tmpfile.write( n42_str.data(), n42_str.size() );
     }//end writing temp file
     
     arguments.push_back( tmpfilename );
     
-    
-    const string appsession = WApplication::instance()->sessionId();
-    auto result = std::make_shared<string>();
-    auto rcode = std::make_shared<int>(-1);
-    auto m = make_shared<mutex>();
-    boost::function<void()> doUpdateFcn;
-    
-    if( parent )
-      doUpdateFcn = wApp->bind( boost::bind( &ExternalRidWidget::receiveExeAnalysis, parent, rcode, result, m ) );
-    else
-      doUpdateFcn = boost::bind( &ExternalRidWidget::displayAutoRidAnaResult, rcode, result, m );
-    
-    auto commandRunner = [tmpfilename,exe_path,arguments,doUpdateFcn,rcode,result,m,appsession](){
+    auto commandRunner = [tmpfilename,exe_path,arguments,doUpdateFcn,rcode,result,m,appsession,cache_key](){
       try
       {
         string results = run_external_command( exe_path, arguments );
@@ -1251,6 +1506,9 @@ public:
         if( results.empty() )
           throw runtime_error( "No output from running executable." );
         
+        if( RestRidImp::is_cacheable_result( results ) )
+          cache_rid_result( cache_key, results );
+        
         std::lock_guard<mutex> lock( *m );
         *rcode = 0;
         *result = results;
@@ -1273,7 +1531,9 @@ public:
     };//commandRunner lamda
     
     WServer::instance()->ioService().boost::asio::io_service::post( commandRunner );
-  }//void startExeAnalysis()
+    
+    return true;
+  }//bool startExeAnalysis(...)
 #endif
   
   void submitForAnalysis()
@@ -1988,10 +2248,15 @@ RestRidInterface::RestRidInterface( InterSpec *viewer, Wt::WContainerWidget *par
 : Wt::WContainerWidget( parent ),
 m_info_response_signal( this, "info_response", false ),
 m_info_error_signal( this, "info_error", false ),
-m_analysis_results_signal( this, "analysis_results", false ),
+m_analysis_response_signal( this, "analysis_response", false ),
 m_analysis_error_signal( this, "analysis_error", false ),
-m_resource( new RestRidInputResource(viewer, this) )
+m_analysis_results_signal( this ),
+m_resource( new RestRidInputResource(viewer, this) ),
+m_next_request_num( 0 ),
+m_request_cache_keys()
 {
+  m_analysis_response_signal.connect( this, &RestRidInterface::handleAnalysisResponse );
+  
   setPositionScheme( PositionScheme::Absolute ); //or Fixed
   setWidth( 0 );
   setHeight( 0 );
@@ -2008,18 +2273,57 @@ void RestRidInterface::setDrf( const string &drf )
   m_resource->setDrf( drf );
 }
 
-void RestRidInterface::startRestAnalysis( const string ana_service_url )
+void RestRidInterface::startRestAnalysis( const string ana_service_url, const bool is_automated )
 {
   const string &resource_url = m_resource->url();
   
+  const string cache_key = m_resource->prepareAnalysisInput( ana_service_url );
+  
+  string cached_result;
+  if( cached_rid_result( cache_key, cached_result ) )
+  {
+    // A previous automated request would be for a spectrum no longer displayed
+    if( is_automated )
+      doJavaScript( "if( window.InterSpecAutoRidCtrl ){"
+                      " window.InterSpecAutoRidCtrl.abort(); window.InterSpecAutoRidCtrl = null;"
+                    " }" );
+    
+    // Post, instead of emitting right away, so callers can finish setting things up
+    WApplication *app = WApplication::instance();
+    WServer *server = WServer::instance();
+    if( app && server )
+    {
+      server->post( app->sessionId(),
+                    app->bind( boost::bind( &RestRidInterface::emitCachedResult, this, cached_result ) ) );
+      return;
+    }
+  }//if( we already have results for this exact file )
+  
+  const int request_num = ++m_next_request_num;
+  m_request_cache_keys[request_num] = cache_key;
+  
+  // Requests that errored-out never get a response, so dont let their keys accumulate.
+  while( m_request_cache_keys.size() > 16 )
+    m_request_cache_keys.erase( begin(m_request_cache_keys) );
+  
   // Note: the JS is defined in the C++ to avoid having a separate JS file that will end up being
   // packaged in builds that wont use it (i.e., most InterSpec builds); I dont like having various
   // `fetch` commands around that can call off of localhost; if nothing else this is a bad look.
   WStringStream js;
   js <<
   "\n(function(){"
+  "const ctrl = new AbortController();\n";
+  
+  // Automated analyses are triggered on every spectrum change, so if the user is quickly flipping
+  //  through files, abort the previous request, and let the browser re-use the connection.
+  if( is_automated )
+    js <<
+  "if( window.InterSpecAutoRidCtrl ) window.InterSpecAutoRidCtrl.abort();\n"
+  "window.InterSpecAutoRidCtrl = ctrl;\n";
+  
+  js <<
   "let sendAnaRequest = function(formData){\n"
-  "  fetch('" << ana_service_url << "/analysis', {method: 'POST', body: formData})\n"
+  "  fetch('" << ana_service_url << "/analysis', {method: 'POST', body: formData, signal: ctrl.signal})\n"
   "    .then(response => {\n"
   "       if( !response.ok ) {\n"
   "         throw new Error('Server returned status ' + response.status);\n"
@@ -2034,9 +2338,14 @@ void RestRidInterface::startRestAnalysis( const string ana_service_url )
   "    .then(json_results => {\n"
   //"      console.log( 'Got JSON analysis response:', json_results );\n"
   "      const result_str = JSON.stringify(json_results);\n"
-  "      " << m_analysis_results_signal.createCall("result_str") << "\n"
+  "      if( window.InterSpecAutoRidCtrl === ctrl ) window.InterSpecAutoRidCtrl = null;\n"
+  "      " << m_analysis_response_signal.createCall(std::to_string(request_num), "result_str") << "\n"
   "    })\n"
   "  .catch( error => {\n"
+  "    if( error && (error.name === 'AbortError') ){\n"
+  "      " << m_analysis_error_signal.createCall( "'AbortError'" ) << ";\n"
+  "      return;\n"
+  "    }\n"
   "    console.error( 'Error retrieving results from server:', error);\n"
   "    const error_str = 'Error retrieving results from server: ' + error.toString();\n"
   "  " << m_analysis_error_signal.createCall( "error_str" ) << ";\n"
@@ -2045,13 +2354,17 @@ void RestRidInterface::startRestAnalysis( const string ana_service_url )
   
   js <<
   "\n"
-  "fetch('" << resource_url << "', {method: 'POST'})\n"
+  "fetch('" << resource_url << "', {method: 'POST', signal: ctrl.signal})\n"
   "  .then( response => response.formData() )\n"
   "  .then( data => {\n"
   //"  console.log( 'Got FormData wt app!' );\n"
   "    sendAnaRequest(data);\n"
   "  })\n"
   "  .catch( error => {\n"
+  "    if( error && (error.name === 'AbortError') ){\n"
+  "      " << m_analysis_error_signal.createCall( "'AbortError'" ) << ";\n"
+  "      return;\n"
+  "    }\n"
   "    console.error( 'Error getting analysis input:', error);\n"
   "    const error_str = 'Error getting analysis input:' + error.toString();\n"
   "    " << m_analysis_error_signal.createCall( "error_str" ) << ";\n"
@@ -2060,6 +2373,26 @@ void RestRidInterface::startRestAnalysis( const string ana_service_url )
   doJavaScript( js.str() );
 }//void startRestAnalysis()
 
+
+void RestRidInterface::handleAnalysisResponse( const int request_num, std::string response )
+{
+  const auto pos = m_request_cache_keys.find( request_num );
+  if( pos != end(m_request_cache_keys) )
+  {
+    if( RestRidImp::is_cacheable_result( response ) )
+      cache_rid_result( pos->second, response );
+    m_request_cache_keys.erase( pos );
+  }//if( we know the cache key for this request )
+  
+  m_analysis_results_signal.emit( response );
+}//void handleAnalysisResponse( const int request_num, std::string response )
+
+
+void RestRidInterface::emitCachedResult( std::string response )
+{
+  m_analysis_results_signal.emit( response );
+}//void emitCachedResult( std::string response )
+
 void RestRidInterface::requestRestServiceInfo( const string url )
 {
   WStringStream js;
@@ -2124,6 +2457,13 @@ void RestRidInterface::handleAutoAnaResultSuccess( string response )
 
 void RestRidInterface::handleAutoAnaResultFailure( string response )
 {
+  // A newer automated analysis superseded this one; dont show anything to the user
+  if( response == "AbortError" )
+  {
+    deleteSelfForToast();
+    return;
+  }
+  
   auto result = std::make_shared<string>( response );
   auto rcode = std::make_shared<int>( -1 );
   auto m = make_shared<mutex>();
@@ -2154,14 +2494,43 @@ RestRidInputResource::~RestRidInputResource()
 void RestRidInputResource::setAnaFlags( Wt::WFlags<RemoteRid::AnaFileOptions> flags )
 {
   m_flags = flags;
+  m_options.clear();
+  m_n42_content.clear();
 }//void setAnaFlags( Wt::WFlags<RemoteRid::AnaFileOptions> flags )
 
 
 void RestRidInputResource::setDrf( const std::string &drf )
 {
   m_drf = drf;
+  m_options.clear();
+  m_n42_content.clear();
 }
 
+
+std::string RestRidInputResource::prepareAnalysisInput( const std::string &ana_service_url )
+{
+  shared_ptr<SpecUtils::SpecFile> spec_file = RemoteRid::fileForAnalysis(m_interspec, m_flags);
+  assert( spec_file );
+  
+  m_options = "{\"drf\": \"" + m_drf + "\"";
+  if( spec_file && (spec_file->num_measurements() < 2) )
+    m_options += ", \"synthesizeBackground\": true";
+  m_options += "}";
+  
+  if( spec_file )
+  {
+    stringstream n42strm;
+    spec_file->write_2012_N42( n42strm );
+    m_n42_content = n42strm.str();
+  }else
+  {
+    cerr << "RestRidInputResource::prepareAnalysisInput() logic error: invalid SpecUtils::SpecFile\n";
+    m_n42_content = "No Spectrum";
+  }
+  
+  return rid_cache_key( ana_service_url, m_options, m_n42_content );
+}//std::string prepareAnalysisInput( const std::string &ana_service_url )
+
 void RestRidInputResource::handleRequest( const Wt::Http::Request &request,
                                          Wt::Http::Response &response )
 {
@@ -2178,29 +2547,16 @@ void RestRidInputResource::handleRequest( const Wt::Http::Request &request,
     return;
   }//if( !lock )
   
-  // Generate some JSON then
-  shared_ptr<SpecUtils::SpecFile> spec_file = RemoteRid::fileForAnalysis(m_interspec, m_flags);
-  assert( spec_file );
+  // Send exactly what the cache key was computed from; if RestRidInterface::startRestAnalysis
+  //  wasnt used, then generate the content now.
+  if( m_n42_content.empty() )
+    prepareAnalysisInput( "" );
   
-  string options = "{\"drf\": \"" + m_drf + "\"";
-  if( spec_file && (spec_file->num_measurements() < 2) )
-    options += ", \"synthesizeBackground\": true";
-  options += "}";
+  const string &options = m_options;
+  const string &n42_content = m_n42_content;
   
   const string boundary = "InterSpec_MultipartBoundary_InterSpec";
   
-  string n42_content;
-  if( spec_file )
-  {
-    stringstream n42strm;
-    spec_file->write_2012_N42( n42strm );
-    n42_content = n42strm.str();
-  }else
-  {
-    cerr << "RestRidInputResource::handleRequest() logic error: invalid SpecUtils::SpecFile\n";
-    n42_content = "No Spectrum";
-  }
-  
   string body =
   "--" + boundary
   + "\r\nContent-Disposition: form-data; name=\"options\""
@@ -2635,14 +2991,14 @@ void RemoteRid::startAutomatedOnLoadAnalysis( InterSpec *interspec,
       rest->m_resource->setDrf( "auto" );
       rest->m_analysis_results_signal.connect( rest, &RestRidImp::RestRidInterface::handleAutoAnaResultSuccess );
       rest->m_analysis_error_signal.connect( rest, &RestRidImp::RestRidInterface::handleAutoAnaResultFailure );
-      rest->startRestAnalysis( uri );
+      rest->startRestAnalysis( uri, true );
     
       break;
     }//case RestRidImp::ExternalRidWidget::ServiceType::Rest:
       
     case RestRidImp::ExternalRidWidget::ServiceType::Exe:
 #if( !ANDROID && !IOS && !BUILD_FOR_WEB_DEPLOYMENT )
-      RestRidImp::ExternalRidWidget::startExeAnalysis( uri, nullptr, "auto", meas );
+      RestRidImp::ExternalRidWidget::startAutoExeAnalysis( uri, meas );
 #else
       assert( 0 );
       throw runtime_error( "Cannot execute EXE analysis." );
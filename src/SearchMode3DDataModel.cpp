@@ -27,6 +27,8 @@
 #include <string>
 #include <vector>
 #include <cfloat>
+#include <utility>
+#include <algorithm>
 
 #include <Wt/WColor>
 #include <Wt/WString>
@@ -167,13 +169,39 @@ std::pair<float,float> SearchMode3DDataModel::minMaxCounts( const float time_min
   
   answer.first = FLT_MAX;
   answer.second = -FLT_MAX;
-  for( size_t sample = start_time_index; sample < end_time_index && sample < num_samples; ++sample )
+  
+  const size_t row_begin = start_time_index;
+  const size_t row_end = std::min( end_time_index, num_samples );
+  const size_t col_begin = start_energy_index;
+  const size_t col_end = std::min( end_energy_index, num_energies );
+  
+  if( (row_begin >= row_end) || (col_begin >= col_end) )
+    return answer;
+  
+  buildCountRangeTable();
+  
+  const size_t ncols = m_counts.shape()[1];
+  
+  size_t ky = 0, kx = 0;
+  while( (size_t(2) << ky) <= (row_end - row_begin) )
+    ++ky;
+  while( (size_t(2) << kx) <= (col_end - col_begin) )
+    ++kx;
+  
+  if( (ky >= m_countRangeTable.size()) || (kx >= m_countRangeTable[ky].size()) )
+    return answer;  //shouldnt happen
+  
+  const vector<pair<float,float>> &level = m_countRangeTable[ky][kx];
+  const size_t upper_row = row_end - (size_t(1) << ky);
+  const size_t upper_col = col_end - (size_t(1) << kx);
+  
+  for( const size_t row : { row_begin, upper_row } )
   {
-    for( size_t channel = start_energy_index; channel < end_energy_index && channel < num_energies; ++channel )
+    for( const size_t col : { col_begin, upper_col } )
     {
-      const float value = m_counts[sample][channel];
-      answer.first = std::min( answer.first, value );
-      answer.second = std::max( answer.second, value );
+      const pair<float,float> &value = level[row*ncols + col];
+      answer.first = std::min( answer.first, value.first );
+      answer.second = std::max( answer.second, value.second );
     }
   }
   
@@ -181,6 +209,67 @@ std::pair<float,float> SearchMode3DDataModel::minMaxCounts( const float time_min
 }//minMaxCounts(...)
 
 
+void SearchMode3DDataModel::buildCountRangeTable() const
+{
+  if( !m_countRangeTable.empty() )
+    return;
+  
+  const size_t nrows = m_counts.shape()[0];
+  const size_t ncols = m_counts.shape()[1];
+  if( !nrows || !ncols )
+    return;
+  
+  vector<vector<vector<pair<float,float>>>> table;
+  
+  for( size_t ky = 0; (size_t(1) << ky) <= nrows; ++ky )
+  {
+    table.emplace_back();
+    
+    for( size_t kx = 0; (size_t(1) << kx) <= ncols; ++kx )
+    {
+      // Each level combines two blocks of the previous level, either along energy, or along time.
+      vector<pair<float,float>> level( nrows * ncols, pair<float,float>(0.0f,0.0f) );
+      const size_t last_row = nrows - (size_t(1) << ky);
+      const size_t last_col = ncols - (size_t(1) << kx);
+      
+      for( size_t row = 0; row <= last_row; ++row )
+      {
+        for( size_t col = 0; col <= last_col; ++col )
+        {
+          pair<float,float> &value = level[row*ncols + col];
+          
+          if( !ky && !kx )
+          {
+            value.first = value.second = m_counts[row][col];
+            continue;
+          }
+          
+          const pair<float,float> *lhs, *rhs;
+          if( kx )
+          {
+            const vector<pair<float,float>> &prev = table[ky][kx-1];
+            lhs = &prev[row*ncols + col];
+            rhs = &prev[row*ncols + col + (size_t(1) << (kx-1))];
+          }else
+          {
+            const vector<pair<float,float>> &prev = table[ky-1][0];
+            lhs = &prev[row*ncols + col];
+            rhs = &prev[(row + (size_t(1) << (ky-1)))*ncols + col];
+          }
+          
+          value.first = std::min( lhs->first, rhs->first );
+          value.second = std::max( lhs->second, rhs->second );
+        }//for( loop over channels )
+      }//for( loop over time rows )
+      
+      table[ky].push_back( std::move(level) );
+    }//for( loop over energy levels )
+  }//for( loop over time levels )
+  
+  m_countRangeTable.swap( table );
+}//void buildCountRangeTable() const
+
+
 void SearchMode3DDataModel::setMaxNumTimeSamples( const int num )
 {
   if( num < 1 )
@@ -229,6 +318,7 @@ void SearchMode3DDataModel::update( InterSpec *viewer )
     m_counts.resize( extents[0][0] );
   }
     
+  m_countRangeTable.clear();
   m_minCounts = 0.0f;
   m_maxCounts = 1.0f;
     
@@ -250,8 +340,6 @@ void SearchMode3DDataModel::update( InterSpec *viewer )
     if( !energy_cal || energy_cal->num_channels() < 4 )
       throw runtime_error( "Not enough gamma channels to plot" );
     
-    const size_t nsamples = sample_numbers.size();
-    
     size_t nenergies = energy_cal->num_channels();
     size_t ncombine = 1;
     while( (ncombine < nenergies) && (nenergies / ncombine) > m_maxNumChannels )
@@ -268,8 +356,6 @@ void SearchMode3DDataModel::update( InterSpec *viewer )
     m_minCounts = FLT_MAX;
     m_maxCounts = 0.0f;
     vector<float> newtimes;
-    boost::multi_array<float, 2>::extent_gen extentgen;
-    m_counts.resize( extentgen[nsamples][nenergies] );
       
     int samplen = 0;
     double cumulativeRealTime = 0.0;
@@ -285,6 +371,13 @@ void SearchMode3DDataModel::update( InterSpec *viewer )
       --sampleNumDelta;
     
     const size_t numSampleNums = sample_numbers_vec.size();
+    
+    // Only allocate the rows we will actually display, not one per sample number; for search-mode
+    //  or portal data with tens of thousands of samples, this is most of the memory this model uses.
+    const size_t num_display_rows = (numSampleNums + sampleNumDelta - 1) / sampleNumDelta;
+    boost::multi_array<float, 2>::extent_gen extentgen;
+    m_counts.resize( extentgen[num_display_rows][nenergies] );
+    
     for( size_t sampleNumIndex = 0; sampleNumIndex < numSampleNums; sampleNumIndex += sampleNumDelta )
     {
       set<int> thissamplenum;
@@ -0,0 +1,292 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+#include "InterSpec/ServerMetrics.h"
+
+using namespace std;
+
+namespace
+{
+  enum class MetricType{ Counter, Gauge, Histogram };
+  
+  struct MetricFamily
+  {
+    MetricType m_type;
+    std::string m_help;
+    
+    // Keyed by label set; only the map matching m_type is used.
+    std::map<std::string,std::unique_ptr<ServerMetrics::Counter>> m_counters;
+    std::map<std::string,std::unique_ptr<ServerMetrics::Gauge>> m_gauges;
+    std::map<std::string,std::unique_ptr<ServerMetrics::Histogram>> m_histograms;
+  };//struct MetricFamily
+  
+  std::mutex ns_registry_mutex;
+  std::map<std::string,MetricFamily> ns_registry;
+  
+  
+  /** Returns the family for the name, creating it if necessary; ns_registry_mutex must be held. */
+  MetricFamily &family( const std::string &name, const std::string &help, const MetricType type )
+  {
+    auto pos = ns_registry.find( name );
+    if( pos == end(ns_registry) )
+    {
+      pos = ns_registry.insert( std::make_pair( name, MetricFamily() ) ).first;
+      pos->second.m_type = type;
+      pos->second.m_help = help;
+    }
+    
+    if( pos->second.m_type != type )
+      throw runtime_error( "ServerMetrics: metric '" + name + "' already registered as a different type." );
+    
+    return pos->second;
+  }//MetricFamily &family(...)
+  
+  
+  template<class T>
+  T &get_or_create( std::map<std::string,std::unique_ptr<T>> &metrics, const std::string &labels )
+  {
+    std::unique_ptr<T> &metric = metrics[labels];
+    if( !metric )
+      metric.reset( new T() );
+    return *metric;
+  }//get_or_create(...)
+  
+  
+  /** Returns `name{labels}`, or `name{labels,extra}`, or just `name`, as appropriate. */
+  std::string sample_name( const std::string &name, const std::string &labels, const std::string &extra = "" )
+  {
+    if( labels.empty() && extra.empty() )
+      return name;
+    
+    if( labels.empty() || extra.empty() )
+      return name + "{" + labels + extra + "}";
+    
+    return name + "{" + labels + "," + extra + "}";
+  }//sample_name(...)
+}//namespace
+
+
+namespace ServerMetrics
+{
+Counter::Counter()
+  : m_value( 0 )
+{
+}
+
+
+void Counter::increment( const uint64_t n )
+{
+  m_value.fetch_add( n, std::memory_order_relaxed );
+}
+
+
+uint64_t Counter::value() const
+{
+  return m_value.load( std::memory_order_relaxed );
+}
+
+
+Gauge::Gauge()
+  : m_value( 0 )
+{
+}
+
+
+void Gauge::set( const int64_t value )
+{
+  m_value.store( value, std::memory_order_relaxed );
+}
+
+
+void Gauge::add( const int64_t delta )
+{
+  m_value.fetch_add( delta, std::memory_order_relaxed );
+}
+
+
+int64_t Gauge::value() const
+{
+  return m_value.load( std::memory_order_relaxed );
+}
+
+
+const std::array<double,Histogram::sm_num_buckets> Histogram::sm_bucket_bounds = {
+  { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 5.0, 60.0 }
+};
+
+
+Histogram::Histogram()
+  : m_overflow( 0 ),
+  m_count( 0 ),
+  m_sum_us( 0 )
+{
+  for( std::atomic<uint64_t> &bucket : m_buckets )
+    bucket.store( 0, std::memory_order_relaxed );
+}
+
+
+void Histogram::observe( const double seconds )
+{
+  const double value = (seconds > 0.0) ? seconds : 0.0;
+  
+  size_t bucket = 0;
+  while( (bucket < sm_num_buckets) && (value > sm_bucket_bounds[bucket]) )
+    ++bucket;
+  
+  if( bucket < sm_num_buckets )
+    m_buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+  else
+    m_overflow.fetch_add( 1, std::memory_order_relaxed );
+  
+  m_count.fetch_add( 1, std::memory_order_relaxed );
+  m_sum_us.fetch_add( static_cast<uint64_t>( value * 1.0E6 + 0.5 ), std::memory_order_relaxed );
+}//void observe( const double seconds )
+
+
+uint64_t Histogram::bucketCount( const size_t bucket ) const
+{
+  return (bucket < sm_num_buckets) ? m_buckets[bucket].load( std::memory_order_relaxed ) : uint64_t(0);
+}
+
+
+uint64_t Histogram::overflowCount() const
+{
+  return m_overflow.load( std::memory_order_relaxed );
+}
+
+
+uint64_t Histogram::count() const
+{
+  return m_count.load( std::memory_order_relaxed );
+}
+
+
+double Histogram::sum() const
+{
+  return 1.0E-6 * m_sum_us.load( std::memory_order_relaxed );
+}
+
+
+ScopedLatency::ScopedLatency( Histogram &histogram )
+  : m_histogram( histogram ),
+  m_start( std::chrono::steady_clock::now() )
+{
+}
+
+
+ScopedLatency::~ScopedLatency()
+{
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+  m_histogram.observe( elapsed.count() );
+}
+
+
+Counter &counter( const std::string &name, const std::string &help, const std::string &labels )
+{
+  std::lock_guard<std::mutex> lock( ns_registry_mutex );
+  return get_or_create( family( name, help, MetricType::Counter ).m_counters, labels );
+}
+
+
+Gauge &gauge( const std::string &name, const std::string &help, const std::string &labels )
+{
+  std::lock_guard<std::mutex> lock( ns_registry_mutex );
+  return get_or_create( family( name, help, MetricType::Gauge ).m_gauges, labels );
+}
+
+
+Histogram &histogram( const std::string &name, const std::string &help, const std::string &labels )
+{
+  std::lock_guard<std::mutex> lock( ns_registry_mutex );
+  return get_or_create( family( name, help, MetricType::Histogram ).m_histograms, labels );
+}
+
+
+std::string prometheus_text()
+{
+  std::ostringstream out;
+  
+  std::lock_guard<std::mutex> lock( ns_registry_mutex );
+  
+  for( const auto &name_family : ns_registry )
+  {
+    const string &name = name_family.first;
+    const MetricFamily &fam = name_family.second;
+    
+    out << "# HELP " << name << " " << fam.m_help << "\n";
+    
+    switch( fam.m_type )
+    {
+      case MetricType::Counter:
+        out << "# TYPE " << name << " counter\n";
+        for( const auto &labels_metric : fam.m_counters )
+          out << sample_name( name, labels_metric.first ) << " " << labels_metric.second->value() << "\n";
+        break;
+        
+      case MetricType::Gauge:
+        out << "# TYPE " << name << " gauge\n";
+        for( const auto &labels_metric : fam.m_gauges )
+          out << sample_name( name, labels_metric.first ) << " " << labels_metric.second->value() << "\n";
+        break;
+        
+      case MetricType::Histogram:
+      {
+        out << "# TYPE " << name << " histogram\n";
+        for( const auto &labels_metric : fam.m_histograms )
+        {
+          const string &labels = labels_metric.first;
+          const Histogram &hist = *labels_metric.second;
+          
+          // Prometheus buckets are cumulative
+          uint64_t cumulative = 0;
+          for( size_t i = 0; i < Histogram::sm_num_buckets; ++i )
+          {
+            cumulative += hist.bucketCount( i );
+            std::ostringstream le;
+            le << "le=\"" << Histogram::sm_bucket_bounds[i] << "\"";
+            out << sample_name( name + "_bucket", labels, le.str() ) << " " << cumulative << "\n";
+          }
+          cumulative += hist.overflowCount();
+          
+          out << sample_name( name + "_bucket", labels, "le=\"+Inf\"" ) << " " << cumulative << "\n";
+          out << sample_name( name + "_sum", labels ) << " " << hist.sum() << "\n";
+          out << sample_name( name + "_count", labels ) << " " << cumulative << "\n";
+        }//for( loop over label sets )
+        break;
+      }//case MetricType::Histogram:
+    }//switch( fam.m_type )
+  }//for( const auto &name_family : ns_registry )
+  
+  return out.str();
+}//std::string prometheus_text()
+}//namespace ServerMetrics
@@ -0,0 +1,434 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <condition_variable>
+
+#if( defined(__linux__) )
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+#include "SpecUtils/SpecUtilsAsync.h"
+
+#include "InterSpec/SharedThreadPool.h"
+
+using namespace std;
+
+namespace SharedThreadPool
+{
+  struct TaskGroupState
+  {
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    
+    /** Tasks posted, but not yet completed. */
+    size_t m_pending = 0;
+    
+    /** Tasks posted, but not yet started; modified only while the Executor mutex is held. */
+    size_t m_queued = 0;
+    
+    std::exception_ptr m_exception;
+  };//struct TaskGroupState
+}//namespace SharedThreadPool
+
+
+namespace
+{
+  using SharedThreadPool::TaskGroupState;
+  
+  /** The settings #SharedThreadPool::configure sets; protected by #ns_config_mutex. */
+  std::mutex ns_config_mutex;
+  bool ns_executor_started = false;
+  size_t ns_config_num_workers = SHARED_THREAD_POOL_WORKERS;
+  bool ns_config_pin_workers = SHARED_THREAD_POOL_PIN_WORKERS;
+  
+  
+#if( defined(__linux__) )
+  /** Returns the CPUs in this threads affinity mask, or an empty vector on error. */
+  vector<int> allowed_cpus()
+  {
+    vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO( &mask );
+    if( sched_getaffinity( 0, sizeof(mask), &mask ) != 0 )
+      return cpus;
+    
+    for( int cpu = 0; cpu < CPU_SETSIZE; ++cpu )
+    {
+      if( CPU_ISSET( cpu, &mask ) )
+        cpus.push_back( cpu );
+    }
+    
+    return cpus;
+  }//vector<int> allowed_cpus()
+  
+  
+  /** Returns the number of CPUs allowed by the cgroup CPU quota (rounded up), or zero if there is
+   no quota, or it couldnt be determined.
+   
+   Checks cgroup v2 (`cpu.max`, for our cgroup, and then the root of the hierarchy, which is what
+   containers usually see), and then cgroup v1 (`cpu.cfs_quota_us` / `cpu.cfs_period_us`).
+   */
+  size_t cgroup_cpu_limit()
+  {
+    const auto quota_to_cpus = []( const double quota, const double period ) -> size_t {
+      if( !(quota > 0.0) || !(period > 0.0) )
+        return 0;
+      return std::max( size_t(1), static_cast<size_t>( std::ceil( quota / period ) ) );
+    };
+    
+    vector<string> v2_files;
+    {
+      ifstream cgroups( "/proc/self/cgroup" );
+      string line;
+      while( std::getline( cgroups, line ) )
+      {
+        if( (line.size() > 4) && (line.compare( 0, 3, "0::" ) == 0) )
+          v2_files.push_back( "/sys/fs/cgroup" + line.substr(3) + "/cpu.max" );
+      }
+    }
+    v2_files.push_back( "/sys/fs/cgroup/cpu.max" );
+    
+    for( const string &filename : v2_files )
+    {
+      ifstream input( filename.c_str() );
+      string quota;
+      double period = 0.0;
+      if( !(input >> quota >> period) )
+        continue;
+      
+      // A quota of "max" is unlimited
+      if( quota == "max" )
+        return 0;
+      
+      return quota_to_cpus( std::strtod( quota.c_str(), nullptr ), period );
+    }//for( const string &filename : v2_files )
+    
+    for( const char *dir : { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" } )
+    {
+      ifstream quota_file( string(dir) + "/cpu.cfs_quota_us" );
+      ifstream period_file( string(dir) + "/cpu.cfs_period_us" );
+      double quota = 0.0, period = 0.0;
+      if( (quota_file >> quota) && (period_file >> period) )
+        return quota_to_cpus( quota, period );  //quota of -1 is unlimited
+    }
+    
+    return 0;
+  }//size_t cgroup_cpu_limit()
+#endif //#if( defined(__linux__) )
+  
+  struct QueuedTask
+  {
+    std::shared_ptr<TaskGroupState> m_group;
+    std::function<void()> m_task;
+  };//struct QueuedTask
+  
+  
+  /** Runs the task, recording any exception to its group, and then marks it completed. */
+  void run_task( QueuedTask &task )
+  {
+    TaskGroupState &group = *task.m_group;
+    
+    try
+    {
+      task.m_task();
+    }catch( ... )
+    {
+      std::lock_guard<std::mutex> lock( group.m_mutex );
+      if( !group.m_exception )
+        group.m_exception = std::current_exception();
+    }//try / catch
+    
+    // Release any resources the task holds before we signal it is done.
+    task.m_task = nullptr;
+    
+    std::lock_guard<std::mutex> lock( group.m_mutex );
+    assert( group.m_pending > 0 );
+    group.m_pending -= 1;
+    if( group.m_pending == 0 )
+      group.m_condition.notify_all();
+  }//void run_task( QueuedTask &task )
+  
+  
+  class Executor
+  {
+  public:
+    static Executor &instance()
+    {
+      static Executor s_executor;
+      return s_executor;
+    }
+    
+    size_t num_workers() const
+    {
+      return m_workers.size();
+    }
+    
+    void push( QueuedTask &&task )
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        {
+          std::lock_guard<std::mutex> group_lock( task.m_group->m_mutex );
+          task.m_group->m_queued += 1;
+          task.m_group->m_condition.notify_all();
+        }
+        m_queue.push_back( std::move(task) );
+      }
+      m_condition.notify_one();
+    }//void push( QueuedTask &&task )
+    
+    
+    /** Removes the oldest queued task of `group`; returns false if it has none queued. */
+    bool pop_for_group( const TaskGroupState *group, QueuedTask &task )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      for( auto iter = begin(m_queue); iter != end(m_queue); ++iter )
+      {
+        if( iter->m_group.get() == group )
+        {
+          task = std::move( *iter );
+          m_queue.erase( iter );
+          mark_started( task );
+          return true;
+        }
+      }//for( loop over queue )
+      
+      return false;
+    }//bool pop_for_group(...)
+    
+  private:
+    Executor()
+     : m_stop( false )
+    {
+      size_t nthreads = 0;
+      bool pin_workers = false;
+      {
+        std::lock_guard<std::mutex> lock( ns_config_mutex );
+        ns_executor_started = true;
+        nthreads = ns_config_num_workers;
+        pin_workers = ns_config_pin_workers;
+      }
+      
+      if( !nthreads )
+        nthreads = SharedThreadPool::available_cpu_count();
+      
+      for( size_t i = 0; i < nthreads; ++i )
+        m_workers.emplace_back( [this](){ worker_loop(); } );
+      
+#if( defined(__linux__) )
+      const vector<int> cpus = pin_workers ? allowed_cpus() : vector<int>{};
+      for( size_t i = 0; !cpus.empty() && (i < m_workers.size()); ++i )
+      {
+        cpu_set_t mask;
+        CPU_ZERO( &mask );
+        CPU_SET( cpus[i % cpus.size()], &mask );
+        pthread_setaffinity_np( m_workers[i].native_handle(), sizeof(mask), &mask );
+      }
+#else
+      (void)pin_workers;
+#endif
+    }//Executor()
+    
+    ~Executor()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+      }
+      m_condition.notify_all();
+      
+      for( std::thread &worker : m_workers )
+      {
+        if( worker.joinable() )
+          worker.join();
+      }
+    }//~Executor()
+    
+    /** Must be called with #m_mutex held. */
+    static void mark_started( QueuedTask &task )
+    {
+      std::lock_guard<std::mutex> group_lock( task.m_group->m_mutex );
+      assert( task.m_group->m_queued > 0 );
+      task.m_group->m_queued -= 1;
+    }
+    
+    void worker_loop()
+    {
+      while( true )
+      {
+        QueuedTask task;
+        
+        {//begin lock on m_mutex
+          std::unique_lock<std::mutex> lock( m_mutex );
+          m_condition.wait( lock, [this](){ return m_stop || !m_queue.empty(); } );
+          
+          // Any tasks left when stopping will be ran by the TaskGroup that is joining on them.
+          if( m_stop )
+            return;
+          
+          task = std::move( m_queue.front() );
+          m_queue.pop_front();
+          mark_started( task );
+        }//end lock on m_mutex
+        
+        run_task( task );
+      }//while( true )
+    }//void worker_loop()
+    
+    
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<QueuedTask> m_queue;
+    bool m_stop;
+    std::vector<std::thread> m_workers;
+  };//class Executor
+}//namespace
+
+
+namespace SharedThreadPool
+{
+TaskGroup::TaskGroup()
+  : m_state( std::make_shared<TaskGroupState>() )
+{
+}
+
+
+TaskGroup::~TaskGroup()
+{
+  try
+  {
+    join();
+  }catch( ... )
+  {
+    // Exceptions from tasks are only reported from an explicit call to join()
+  }
+}//~TaskGroup()
+
+
+void TaskGroup::post( std::function<void()> task )
+{
+  if( !task )
+    return;
+  
+  {
+    std::lock_guard<std::mutex> lock( m_state->m_mutex );
+    m_state->m_pending += 1;
+  }
+  
+  QueuedTask queued;
+  queued.m_group = m_state;
+  queued.m_task = std::move( task );
+  Executor::instance().push( std::move(queued) );
+}//void TaskGroup::post( std::function<void()> task )
+
+
+void TaskGroup::join()
+{
+  Executor &executor = Executor::instance();
+  
+  while( true )
+  {
+    // Rather than block while our tasks wait in the queue (possibly behind other groups tasks, or
+    //  with every worker blocked in a join of their own), run them on this thread.
+    QueuedTask task;
+    if( executor.pop_for_group( m_state.get(), task ) )
+    {
+      run_task( task );
+      continue;
+    }
+    
+    std::unique_lock<std::mutex> lock( m_state->m_mutex );
+    if( m_state->m_pending == 0 )
+      break;
+    
+    // The remaining tasks are all running on other threads; wait for them to finish, or for one of
+    //  them to post another task to this group.
+    m_state->m_condition.wait( lock, [this](){
+      return (m_state->m_pending == 0) || (m_state->m_queued > 0);
+    } );
+    
+    if( m_state->m_pending == 0 )
+      break;
+  }//while( true )
+  
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock( m_state->m_mutex );
+    std::swap( error, m_state->m_exception );
+  }
+  
+  if( error )
+    std::rethrow_exception( error );
+}//void TaskGroup::join()
+
+
+size_t num_workers()
+{
+  return Executor::instance().num_workers();
+}
+
+
+size_t available_cpu_count()
+{
+  size_t ncpu = static_cast<size_t>( std::max( SpecUtilsAsync::num_logical_cpu_cores(), 1 ) );
+  
+#if( defined(__linux__) )
+  const vector<int> cpus = allowed_cpus();
+  if( !cpus.empty() )
+    ncpu = std::min( ncpu, cpus.size() );
+  
+  const size_t quota = cgroup_cpu_limit();
+  if( quota )
+    ncpu = std::min( ncpu, quota );
+#endif
+  
+  return std::max( ncpu, size_t(1) );
+}//size_t available_cpu_count()
+
+
+bool configure( const size_t num_workers, const bool pin_workers )
+{
+  std::lock_guard<std::mutex> lock( ns_config_mutex );
+  if( ns_executor_started )
+    return false;
+  
+  ns_config_num_workers = num_workers;
+  ns_config_pin_workers = pin_workers;
+  
+  return true;
+}//bool configure(...)
+}//namespace SharedThreadPool
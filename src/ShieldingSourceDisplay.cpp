@@ -85,6 +85,7 @@
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/SpecUtilsAsync.h"
 
+#include "InterSpec/ComputeScheduler.h"
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/PopupDiv.h"
@@ -295,9 +296,7 @@ namespace
       // Now need to remove the block to inserting undo/redo steps
       m_block.reset();
       
-      //cout << "Adding undo/redo step will take approx "
-      //     << (m_description.size() + pre_doc->size() + post_doc->size())
-      //     << " bytes of memory" << endl;
+      const size_t approx_bytes = descrip.size() + pre_doc->size() + post_doc->size();
       
       auto undo = [pre_doc, descrip](){
         ShieldingSourceDisplay *display = InterSpec::instance()->shieldingSourceFit();
@@ -329,7 +328,7 @@ namespace
         }
       };
       
-      undoRedo->addUndoRedoStep( std::move(undo), std::move(redo), descrip );
+      undoRedo->addUndoRedoStep( std::move(undo), std::move(redo), descrip, approx_bytes );
     }//~ShieldSourceChange()
     
     ShieldSourceChange( const ShieldSourceChange & ) = delete; // non construction-copyable
@@ -5006,9 +5005,10 @@ void ShieldingSourceDisplay::showGraphicTypeChanged()
   }//if( undoRedo )
   
   
+  //The chart model has both the chi and scale columns, so we only need to change which is shown,
+  //  not re-evaluate the model.
   const bool chi = m_showChiOnChart->isChecked();
   m_chi2Graphic->setShowChiOnChart( chi );
-  updateChi2Chart();
 }
 
 void ShieldingSourceDisplay::handleUserDistanceChange()
@@ -5569,7 +5569,7 @@ void ShieldingSourceDisplay::updateChi2Chart()
 }//void updateChi2Chart()
 
 
-void ShieldingSourceDisplay::updateChi2ChartActual()
+void ShieldingSourceDisplay::updateChi2ChartActual( std::shared_ptr<const ShieldingSourceFitCalc::ModelFitResults> results )
 {
   try
   {
@@ -5581,28 +5581,40 @@ void ShieldingSourceDisplay::updateChi2ChartActual()
   
   try
   {
-    auto fcnAndPars = shieldingFitnessFcn();
-    
-    std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> &chi2Fcn = fcnAndPars.first;
-    ROOT::Minuit2::MnUserParameters &inputPrams = fcnAndPars.second;
+    const bool use_fit_results = results
+                && (results->successful == ShieldingSourceFitCalc::ModelFitResults::FitStatus::Final)
+                && !results->energy_chi_contributions.empty();
     
-    const unsigned int ndof = inputPrams.VariableParameters();
-    
-    const vector<double> params = inputPrams.Params();
-    const vector<double> errors = inputPrams.Errors();
-    GammaInteractionCalc::ShieldingSourceChi2Fcn::NucMixtureCache mixcache;
+    unsigned int ndof = 0;
+    vector< tuple<double,double,double,Wt::WColor,double> > chis;
     
+    if( use_fit_results )
+    {
+      ndof = results->num_fit_params;
+      chis = results->energy_chi_contributions;
+      m_calcLog = results->energy_chi_calc_log;
+    }else
+    {
+      auto fcnAndPars = shieldingFitnessFcn();
+      
+      std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> &chi2Fcn = fcnAndPars.first;
+      ROOT::Minuit2::MnUserParameters &inputPrams = fcnAndPars.second;
+      
+      ndof = inputPrams.VariableParameters();
+      
+      const vector<double> params = inputPrams.Params();
+      GammaInteractionCalc::ShieldingSourceChi2Fcn::NucMixtureCache mixcache;
+      
+      m_calcLog.clear();
+      chis = chi2Fcn->energy_chi_contributions( params, mixcache, &m_calcLog );
+    }//if( use_fit_results ) / else
     
-    m_calcLog.clear();
     if( m_logDiv )
     {
       m_logDiv->contents()->clear();
       m_logDiv->hide();
     }//if( m_logDiv )
     
-    const vector< tuple<double,double,double,Wt::WColor,double> > chis
-                               = chi2Fcn->energy_chi_contributions( params, mixcache, &m_calcLog );
-    
     m_showLog->setDisabled( m_calcLog.empty() );
 
     typedef tuple<double,double,double,Wt::WColor,double> DDPair;
@@ -8403,7 +8415,8 @@ void ShieldingSourceDisplay::updateGuiWithModelFitResults( std::shared_ptr<Shiel
     }//for( int ison = 0; ison < niso; ++ison )
     */
     
-    updateChi2ChartActual();
+    //The fit already evaluated each peaks contribution, so we dont need to re-evaluate the model
+    updateChi2ChartActual( results );
     m_chi2ChartNeedsUpdating = false;
     updateCalcLogWithFitResults( m_currentFitFcn, results );
   }catch( std::exception &e )
@@ -8485,6 +8498,12 @@ std::shared_ptr<ShieldingSourceFitCalc::ModelFitResults> ShieldingSourceDisplay:
   
   {
     std::lock_guard<std::mutex> lock( m_currentFitFcnMutex );
+    
+    //If a previous fit is still running, its results are now stale, so stop it without having
+    //  it update the GUI.
+    if( m_currentFitFcn && (m_currentFitFcn != chi2Fcn) )
+      m_currentFitFcn->cancelFitWithNoUpdate();
+    
     m_currentFitFcn = chi2Fcn;
   }
   
@@ -8501,8 +8520,8 @@ std::shared_ptr<ShieldingSourceFitCalc::ModelFitResults> ShieldingSourceDisplay:
   const string sessionid = wApp->sessionId();
   if( fitInBackground )
   {
-    Wt::WServer *server = Wt::WServer::instance();
-    server->ioService().boost::asio::io_service::post( boost::bind( &ShieldingSourceFitCalc::fit_model,
+    ComputeScheduler::post( sessionid, ComputeScheduler::Priority::Batch,
+                            boost::bind( &ShieldingSourceFitCalc::fit_model,
                             sessionid, chi2Fcn, inputPrams, progress, progress_updater, results, gui_updater ) );
   }else
   {
@@ -24,6 +24,11 @@
 #include "InterSpec_config.h"
 
 #include <memory>
+#include <random>
+#include <limits>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
 
 #include "rapidxml/rapidxml.hpp"
 #include "rapidxml/rapidxml_utils.hpp"
@@ -36,6 +41,7 @@
 #include "Minuit2/FCNBase.h"
 #include "Minuit2/MnMinos.h"
 #include "Minuit2/MnPrint.h"
+#include "Minuit2/MinosError.h"
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMinimize.h"
@@ -45,6 +51,10 @@
 //#include "Minuit2/Minuit2Minimizer.h"
 #include "Minuit2/MnUserParameterState.h"
 
+#if( USE_REL_ACT_TOOL )
+#include "ceres/ceres.h"
+#endif
+
 
 #include "SpecUtils/StringAlgo.h"
 #include "SpecUtils/RapidXmlUtils.hpp"
@@ -57,6 +67,9 @@
 #include "SpecUtils/SpecUtilsAsync.h"
 
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
 #include "InterSpec/AppUtils.h"
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/MaterialDB.h"
@@ -933,7 +946,7 @@ void TraceSourceInfo::equalEnough( const TraceSourceInfo &lhs, const TraceSource
   }//void serialize( rapidxml::xml_node<char> *parent_node ) const
   
   
-  void ShieldingInfo::deSerialize( const rapidxml::xml_node<char> *shield_node, MaterialDB *materialDb )
+  void ShieldingInfo::deSerialize( const rapidxml::xml_node<char> *shield_node, const MaterialDB *materialDb )
   {
     using GammaInteractionCalc::GeometryType;
     
@@ -1260,7 +1273,7 @@ void TraceSourceInfo::equalEnough( const TraceSourceInfo &lhs, const TraceSource
         m_traceSources.push_back( std::move(trace) );
       }//for( loop over trace nodes )
     }//if( material_node )
-  }//void deSerialize( const rapidxml::xml_node<char> *shield_node, MaterialDB *materialDb )
+  }//void deSerialize( const rapidxml::xml_node<char> *shield_node, const MaterialDB *materialDb )
     
 
   std::string ShieldingInfo::encodeStateToUrl() const
@@ -1707,6 +1720,11 @@ void ShieldingSourceFitOptions::serialize( rapidxml::xml_node<char> *parent_node
   node = doc->allocate_node( rapidxml::node_element, name, value );
   parent_node->append_node( node );
   
+  name = "FastSelfAttenIntegration";
+  value = fast_self_atten_integration ? "1" : "0";
+  node = doc->allocate_node( rapidxml::node_element, name, value );
+  parent_node->append_node( node );
+  
   
   name = "BackgroundPeakSubtraction";
   value = background_peak_subtract ? "1" : "0";
@@ -1760,6 +1778,10 @@ void ShieldingSourceFitOptions::deSerialize( const rapidxml::xml_node<char> *par
   if( node )
     multithread_self_atten = boolval( node );
   
+  node = XML_FIRST_NODE( parent_node, "FastSelfAttenIntegration" );
+  if( node )
+    fast_self_atten_integration = boolval( node );
+  
   node = XML_FIRST_NODE( parent_node, "BackgroundPeakSubtraction" );
   if( node )
     background_peak_subtract = boolval( node );
@@ -1793,6 +1815,9 @@ void ShieldingSourceFitOptions::equalEnough( const ShieldingSourceFitOptions &lh
   if( lhs.multithread_self_atten != rhs.multithread_self_atten )
     throw runtime_error( "ShieldingSourceFitOptions LHS multithread_self_atten != RHS multithread_self_atten" );
   
+  if( lhs.fast_self_atten_integration != rhs.fast_self_atten_integration )
+    throw runtime_error( "ShieldingSourceFitOptions LHS fast_self_atten_integration != RHS fast_self_atten_integration" );
+  
   if( fabs(lhs.photopeak_cluster_sigma - rhs.photopeak_cluster_sigma) > 1.0E-8
      && fabs(lhs.photopeak_cluster_sigma - rhs.photopeak_cluster_sigma) > 1.0E-6*std::max(lhs.photopeak_cluster_sigma,rhs.photopeak_cluster_sigma) )
     throw runtime_error( "ShieldingSourceFitOptions LHS photopeak_cluster_sigma != RHS photopeak_cluster_sigma" );
@@ -1806,6 +1831,179 @@ void ShieldingSourceFitOptions::equalEnough( const ShieldingSourceFitOptions &lh
 #endif
   
   
+namespace
+{
+  std::atomic<bool> ns_least_squares_presolve( true );
+  
+#if( USE_REL_ACT_TOOL )
+  /** The per-peak-energy chi values of a ShieldingSourceChi2Fcn, as residuals for ceres, with only
+   the free (i.e., not fixed) Minuit parameters as parameter blocks.
+   */
+  struct ShieldSourceResidualFcn
+  {
+    const GammaInteractionCalc::ShieldingSourceChi2Fcn &m_chi2Fcn;
+    const std::vector<double> m_all_pars;
+    const std::vector<size_t> m_free_indexes;
+    const size_t m_num_residuals;
+    mutable GammaInteractionCalc::ShieldingSourceChi2Fcn::NucMixtureCache m_mixture_cache;
+    
+    ShieldSourceResidualFcn( const GammaInteractionCalc::ShieldingSourceChi2Fcn &chi2Fcn,
+                             const std::vector<double> &all_pars,
+                             const std::vector<size_t> &free_indexes,
+                             const size_t num_residuals )
+     : m_chi2Fcn( chi2Fcn ),
+       m_all_pars( all_pars ),
+       m_free_indexes( free_indexes ),
+       m_num_residuals( num_residuals ),
+       m_mixture_cache()
+    {
+    }
+    
+    bool operator()( double const *const *parameters, double *residuals ) const
+    {
+      try
+      {
+        vector<double> x = m_all_pars;
+        for( size_t i = 0; i < m_free_indexes.size(); ++i )
+          x[m_free_indexes[i]] = parameters[i][0];
+        
+        const vector<tuple<double,double,double,Wt::WColor,double>> chis
+                                  = m_chi2Fcn.energy_chi_contributions( x, m_mixture_cache, nullptr );
+        if( chis.size() != m_num_residuals )
+          return false;
+        
+        for( size_t i = 0; i < m_num_residuals; ++i )
+        {
+          residuals[i] = std::get<1>( chis[i] );
+          if( IsNan(residuals[i]) || IsInf(residuals[i]) )
+            return false;
+        }
+      }catch( std::exception & )
+      {
+        // Includes the fit being cancelled; Minuit will get the cancel exception once we return.
+        return false;
+      }
+      
+      return true;
+    }//bool operator() - for Ceres
+  };//struct ShieldSourceResidualFcn
+  
+  
+  /** Minimizes the chi2 using ceres' Levenberg-Marquardt, starting from, and updating the values of, `pars`.
+   
+   Minuit2 only sees the chi2 as a single number, so it has to build up the curvature of the problem from
+   many evaluations; instead solving the least-squares problem with the per-peak chis as residuals lets L-M use
+   the Jacobian directly, which for problems with many nuclides and shielding layers gets to the minimum in far
+   fewer evaluations.  Minuit is then run from this point to make the final fit and covariance.
+   
+   Returns true if `pars` were updated (i.e., the chi2 got better).
+   */
+  bool least_squares_presolve( const GammaInteractionCalc::ShieldingSourceChi2Fcn &chi2Fcn,
+                               ROOT::Minuit2::MnUserParameters &pars )
+  {
+    INTERSPEC_TRACE_SCOPE( "ShieldingSourceFitCalc::least_squares_presolve" );
+    
+    const vector<double> all_values = pars.Params();
+    const vector<ROOT::Minuit2::MinuitParameter> &params = pars.Parameters();
+    
+    vector<size_t> free_indexes;
+    for( size_t i = 0; i < params.size(); ++i )
+    {
+      if( !params[i].IsFixed() && !params[i].IsConst() )
+        free_indexes.push_back( i );
+    }
+    
+    if( free_indexes.empty() )
+      return false;
+    
+    size_t num_residuals = 0;
+    double start_chi2 = 0.0;
+    try
+    {
+      GammaInteractionCalc::ShieldingSourceChi2Fcn::NucMixtureCache cache;
+      const auto chis = chi2Fcn.energy_chi_contributions( all_values, cache, nullptr );
+      num_residuals = chis.size();
+      for( const auto &chi : chis )
+        start_chi2 += std::get<1>(chi) * std::get<1>(chi);
+    }catch( std::exception & )
+    {
+      return false;
+    }
+    
+    if( (num_residuals < free_indexes.size()) || IsNan(start_chi2) || IsInf(start_chi2) )
+      return false;
+    
+    auto functor = new ShieldSourceResidualFcn( chi2Fcn, all_values, free_indexes, num_residuals );
+    auto cost_function = new ceres::DynamicNumericDiffCostFunction<ShieldSourceResidualFcn,ceres::CENTRAL>( functor );
+    cost_function->SetNumResiduals( static_cast<int>(num_residuals) );
+    
+    vector<double> values( free_indexes.size() );
+    vector<double *> parameter_blocks( free_indexes.size() );
+    for( size_t i = 0; i < free_indexes.size(); ++i )
+    {
+      const ROOT::Minuit2::MinuitParameter &par = params[free_indexes[i]];
+      double value = par.Value();
+      if( par.HasLowerLimit() )
+        value = std::max( value, par.LowerLimit() );
+      if( par.HasUpperLimit() )
+        value = std::min( value, par.UpperLimit() );
+      
+      values[i] = value;
+      parameter_blocks[i] = &values[i];
+      cost_function->AddParameterBlock( 1 );
+    }//for( loop over free parameters )
+    
+    ceres::Problem problem;
+    problem.AddResidualBlock( cost_function, nullptr, parameter_blocks );
+    
+    for( size_t i = 0; i < free_indexes.size(); ++i )
+    {
+      const ROOT::Minuit2::MinuitParameter &par = params[free_indexes[i]];
+      if( par.HasLowerLimit() )
+        problem.SetParameterLowerBound( parameter_blocks[i], 0, par.LowerLimit() );
+      if( par.HasUpperLimit() )
+        problem.SetParameterUpperBound( parameter_blocks[i], 0, par.UpperLimit() );
+    }//for( loop over free parameters )
+    
+    ceres::Solver::Options ceres_options;
+    ceres_options.linear_solver_type = ceres::DENSE_QR;
+    ceres_options.minimizer_progress_to_stdout = false;
+    ceres_options.logging_type = ceres::SILENT;
+    ceres_options.max_num_iterations = 50;
+    
+    ceres::Solver::Summary summary;
+    ceres::Solve( ceres_options, &problem, &summary );
+    
+    // Ceres cost is half the sum of squared residuals
+    const double final_chi2 = 2.0*summary.final_cost;
+    if( !summary.IsSolutionUsable() || IsNan(final_chi2) || !(final_chi2 < start_chi2) )
+      return false;
+    
+    for( size_t i = 0; i < free_indexes.size(); ++i )
+      pars.SetValue( static_cast<unsigned int>(free_indexes[i]), values[i] );
+    
+    return true;
+  }//bool least_squares_presolve(...)
+#endif //USE_REL_ACT_TOOL
+}//namespace
+  
+  
+void set_least_squares_presolve( const bool use )
+{
+  ns_least_squares_presolve = use;
+}
+  
+  
+bool least_squares_presolve_enabled()
+{
+#if( USE_REL_ACT_TOOL )
+  return ns_least_squares_presolve;
+#else
+  return false;
+#endif
+}
+  
+  
 ModelFitProgress::ModelFitProgress()
   : m_mutex{},
   chi2( std::numeric_limits<double>::max() ),
@@ -1824,6 +2022,11 @@ void fit_model( const std::string wtsession,
                          std::shared_ptr<ShieldingSourceFitCalc::ModelFitResults> results,
                          boost::function<void()> finished_fcn )
 {
+  INTERSPEC_TRACE_SCOPE( "ShieldingSourceFitCalc::fit_model" );
+  static ServerMetrics::Histogram &fit_durations = ServerMetrics::histogram( "interspec_fit_duration_seconds",
+                                            "Time taken by analysis fits and searches.", "type=\"shielding_source\"" );
+  const ServerMetrics::ScopedLatency fit_latency( fit_durations );
+  
   //The self attenuating probing questions are not tested.
   assert( results );
   
@@ -1888,7 +2091,13 @@ void fit_model( const std::string wtsession,
     
     chi2Fcn->fittingIsStarting( sm_max_model_fit_time_ms );
     
-    ROOT::Minuit2::MnUserParameterState inputParamState( *inputPrams );
+    ROOT::Minuit2::MnUserParameters startPrams = *inputPrams;
+#if( USE_REL_ACT_TOOL )
+    if( least_squares_presolve_enabled() )
+      least_squares_presolve( *chi2Fcn, startPrams );
+#endif
+    
+    ROOT::Minuit2::MnUserParameterState inputParamState( startPrams );
     ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
     ROOT::Minuit2::MnMinimize fitter( *chi2Fcn, inputParamState, strategy );
     
@@ -2014,7 +2223,7 @@ void fit_model( const std::string wtsession,
         chi2Fcn->setSelfAttMultiThread( false ); //shouldnt affect anything, but JIC
         
         
-        SpecUtilsAsync::ThreadPool pool;
+        SharedThreadPool::TaskGroup pool;
         
         const int initial_sn_skip = 5;
         for( int an = MassAttenuation::sm_min_xs_atomic_number;
@@ -2432,11 +2641,26 @@ void fit_model( const std::string wtsession,
       results->final_shieldings.push_back( shield );
     }//for( int i = 0; i < nshieldings; ++i )
     
+    results->num_fit_params = fitParams.VariableParameters();
+    results->energy_chi_contributions.clear();
+    results->energy_chi_calc_log.clear();
+    
+    try
+    {
+      GammaInteractionCalc::ShieldingSourceChi2Fcn::NucMixtureCache mixcache;
+      results->energy_chi_contributions
+               = chi2Fcn->energy_chi_contributions( params, mixcache, &results->energy_chi_calc_log );
+    }catch( std::exception & )
+    {
+      //The GUI will re-evaluate the model itself
+      results->energy_chi_contributions.clear();
+      results->energy_chi_calc_log.clear();
+    }//try / catch
   }catch( GammaInteractionCalc::ShieldingSourceChi2Fcn::CancelException &e )
   {
-    const size_t nFunctionCallsSoFar = gui_progress_info->numFunctionCallsSoFar();
-    const double bestChi2SoFar = gui_progress_info->bestChi2SoFar();
-    const vector<double> bestParsSoFar = gui_progress_info->bestParametersSoFar();
+    const size_t nFunctionCallsSoFar = gui_progress_info ? gui_progress_info->numFunctionCallsSoFar() : size_t(0);
+    const double bestChi2SoFar = gui_progress_info ? gui_progress_info->bestChi2SoFar() : -1.0;
+    const vector<double> bestParsSoFar = gui_progress_info ? gui_progress_info->bestParametersSoFar() : vector<double>{};
     
     std::lock_guard<std::mutex> lock( results->m_mutex );
     
@@ -2490,4 +2714,297 @@ void fit_model( const std::string wtsession,
   }//if( finished_fcn )
 }//void fit_model( std::shared_ptr<ROOT::Minuit2::MnUserParameters> inputPrams )
   
+  
+namespace
+{
+  /** Minimizes `chi2Fcn` starting from `pars`, in the same way #fit_model does (i.e., same strategy,
+   tolerance, and re-trying up to two more times if the minimum isnt valid).
+   
+   If there are no free parameters, just evaluates the chi2.
+   */
+  ModelFitSolution minimize_chi2( const GammaInteractionCalc::ShieldingSourceChi2Fcn &chi2Fcn,
+                                  const ROOT::Minuit2::MnUserParameters &pars )
+  {
+    ModelFitSolution solution;
+    solution.startValues = pars.Params();
+    
+    if( pars.VariableParameters() < 1 )
+    {
+      solution.chi2 = chi2Fcn( solution.startValues );
+      solution.is_valid = true;
+      solution.num_fcn_calls = 1;
+      solution.paramValues = solution.startValues;
+      solution.paramErrors = pars.Errors();
+      
+      return solution;
+    }//if( no free parameters )
+    
+    ROOT::Minuit2::MnUserParameterState inputParamState( pars );
+    ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
+    ROOT::Minuit2::MnMinimize fitter( chi2Fcn, inputParamState, strategy );
+    
+    const double tolerance = 2.0*pars.VariableParameters();
+    const unsigned int maxFcnCall = 50000;  //default minuit2: 200 + 100 * npar + 5 * npar**2
+    
+    ROOT::Minuit2::FunctionMinimum minimum = fitter( maxFcnCall, tolerance );
+    for( int i = 0; !minimum.IsValid() && i < 2; ++i )
+      minimum = fitter( maxFcnCall, tolerance );
+    
+    solution.chi2 = minimum.Fval();
+    solution.is_valid = minimum.IsValid();
+    solution.num_fcn_calls = minimum.NFcn();
+    solution.paramValues = minimum.UserParameters().Params();
+    solution.paramErrors = minimum.UserParameters().Errors();
+    
+    return solution;
+  }//ModelFitSolution minimize_chi2(...)
+  
+  
+  /** Runs #minimize_chi2 for each of `starts`, using a thread pool; exceptions (e.g., from the
+   fit being canceled) result in a solution with a chi2 of DBL_MAX that is not valid.
+   */
+  vector<ModelFitSolution> minimize_chi2_parallel( shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                                                   const vector<ROOT::Minuit2::MnUserParameters> &starts )
+  {
+    vector<ModelFitSolution> solutions( starts.size() );
+    if( starts.empty() )
+      return solutions;
+    
+    // The chi2 function caches some things on first evaluation, so do that before evaluating from
+    //  multiple threads.
+    try
+    {
+      (*chi2Fcn)( starts.front().Params() );
+    }catch( std::exception & )
+    {
+      // We'll let the individual minimizations deal with the error
+    }
+    
+    // Each fit is running in its own thread, so dont additionally multi-thread each chi2 evaluation
+    const bool origMultithread = chi2Fcn->options().multithread_self_atten;
+    chi2Fcn->setSelfAttMultiThread( false );
+    
+    chi2Fcn->fittingIsStarting( sm_max_model_fit_time_ms );
+    
+    SharedThreadPool::TaskGroup pool;
+    for( size_t i = 0; i < starts.size(); ++i )
+    {
+      pool.post( [i,&starts,&solutions,chi2Fcn](){
+        try
+        {
+          solutions[i] = minimize_chi2( *chi2Fcn, starts[i] );
+        }catch( std::exception &e )
+        {
+          cerr << "Exception minimizing shielding/source model: " << e.what() << endl;
+          solutions[i].chi2 = std::numeric_limits<double>::max();
+          solutions[i].is_valid = false;
+          solutions[i].num_fcn_calls = 0;
+          solutions[i].startValues = starts[i].Params();
+          solutions[i].paramValues = solutions[i].startValues;
+          solutions[i].paramErrors.clear();
+        }//try / catch
+      } );
+    }//for( size_t i = 0; i < starts.size(); ++i )
+    pool.join();
+    
+    chi2Fcn->fittingIsFinished();
+    chi2Fcn->setSelfAttMultiThread( origMultithread );
+    
+    return solutions;
+  }//vector<ModelFitSolution> minimize_chi2_parallel(...)
+}//namespace
+  
+  
+std::vector<ModelFitSolution> fit_model_multi_start(
+                              std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                              std::shared_ptr<const ROOT::Minuit2::MnUserParameters> inputPrams,
+                              const size_t num_starts,
+                              const unsigned int seed,
+                              std::shared_ptr<ModelFitResults> results )
+{
+  if( !chi2Fcn || !inputPrams || !results )
+    throw runtime_error( "fit_model_multi_start: invalid input." );
+  
+  if( num_starts < 1 )
+    throw runtime_error( "fit_model_multi_start: at least one start is required." );
+  
+  vector<ROOT::Minuit2::MnUserParameters> starts( num_starts, *inputPrams );
+  
+  // Latin-hypercube sample the free parameters, for all but the first start
+  if( num_starts > 1 )
+  {
+    const size_t num_sampled = num_starts - 1;
+    std::mt19937 rng( seed );
+    std::uniform_real_distribution<double> unit_dist( 0.0, 1.0 );
+    
+    const std::vector<ROOT::Minuit2::MinuitParameter> &pars = inputPrams->Parameters();
+    for( size_t par_index = 0; par_index < pars.size(); ++par_index )
+    {
+      const ROOT::Minuit2::MinuitParameter &par = pars[par_index];
+      if( par.IsConst() || par.IsFixed() || (par.GetName().find("_FIXED") != string::npos) )
+        continue;
+      
+      const double value = par.Value();
+      const double step = fabs( par.Error() );
+      double lower = value - 3.0*step, upper = value + 3.0*step;
+      if( par.HasLowerLimit() )
+        lower = par.HasUpperLimit() ? par.LowerLimit() : std::max( lower, par.LowerLimit() );
+      if( par.HasUpperLimit() )
+        upper = par.HasLowerLimit() ? par.UpperLimit() : std::min( upper, par.UpperLimit() );
+      
+      if( !(upper > lower) || IsInf(upper - lower) )
+        continue;
+      
+      vector<size_t> strata( num_sampled );
+      std::iota( begin(strata), end(strata), size_t(0) );
+      std::shuffle( begin(strata), end(strata), rng );
+      
+      for( size_t i = 0; i < num_sampled; ++i )
+      {
+        const double frac = (strata[i] + unit_dist(rng)) / num_sampled;
+        starts[i + 1].SetValue( static_cast<unsigned int>(par_index), lower + frac*(upper - lower) );
+      }
+    }//for( loop over parameters )
+  }//if( num_starts > 1 )
+  
+  vector<ModelFitSolution> solutions = minimize_chi2_parallel( chi2Fcn, starts );
+  
+  std::stable_sort( begin(solutions), end(solutions),
+                   []( const ModelFitSolution &lhs, const ModelFitSolution &rhs ){
+    return lhs.chi2 < rhs.chi2;
+  } );
+  
+  // Do a final fit from the best solution, so `results` is filled out the same as a normal fit.
+  auto best_pars = make_shared<ROOT::Minuit2::MnUserParameters>( *inputPrams );
+  const ModelFitSolution &best = solutions.front();
+  for( size_t i = 0; (best.chi2 < std::numeric_limits<double>::max()) && (i < best.paramValues.size()); ++i )
+  {
+    const ROOT::Minuit2::MinuitParameter &par = best_pars->Parameters()[i];
+    if( !par.IsConst() && !par.IsFixed() )
+      best_pars->SetValue( static_cast<unsigned int>(i), best.paramValues[i] );
+  }
+  
+  fit_model( "", chi2Fcn, best_pars, nullptr, boost::function<void()>(), results, boost::function<void()>() );
+  
+  return solutions;
+}//fit_model_multi_start(...)
+  
+  
+std::vector<ModelFitSolution> chi2_profile_scan(
+                              std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                              const ROOT::Minuit2::MnUserParameters &inputPrams,
+                              const std::string &par_name,
+                              const std::vector<double> &values )
+{
+  if( !chi2Fcn )
+    throw runtime_error( "chi2_profile_scan: invalid chi2 function." );
+  
+  const std::vector<ROOT::Minuit2::MinuitParameter> &pars = inputPrams.Parameters();
+  const auto par_pos = std::find_if( begin(pars), end(pars),
+                                    [&par_name]( const ROOT::Minuit2::MinuitParameter &par ){
+    return par.GetName() == par_name;
+  } );
+  
+  if( par_pos == end(pars) )
+    throw runtime_error( "chi2_profile_scan: no parameter named '" + par_name + "'" );
+  
+  const unsigned int par_index = static_cast<unsigned int>( par_pos - begin(pars) );
+  
+  vector<ROOT::Minuit2::MnUserParameters> starts( values.size(), inputPrams );
+  for( size_t i = 0; i < values.size(); ++i )
+  {
+    if( !par_pos->IsConst() && !par_pos->IsFixed() )
+      starts[i].Fix( par_index );
+    starts[i].SetValue( par_index, values[i] );
+  }//for( size_t i = 0; i < values.size(); ++i )
+  
+  return minimize_chi2_parallel( chi2Fcn, starts );
+}//chi2_profile_scan(...)
+  
+  
+std::vector<ParameterMinosError> minos_errors(
+                              std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn,
+                              const ROOT::Minuit2::MnUserParameters &bestFitPrams )
+{
+  if( !chi2Fcn )
+    throw runtime_error( "minos_errors: invalid chi2 function." );
+  
+  vector<ParameterMinosError> answer;
+  
+  const std::vector<ROOT::Minuit2::MinuitParameter> &pars = bestFitPrams.Parameters();
+  for( size_t i = 0; i < pars.size(); ++i )
+  {
+    const ROOT::Minuit2::MinuitParameter &par = pars[i];
+    if( par.IsConst() || par.IsFixed() || (par.GetName().find("_FIXED") != string::npos) )
+      continue;
+    
+    ParameterMinosError err;
+    err.name = par.GetName();
+    err.index = static_cast<unsigned int>( i );
+    err.value = par.Value();
+    err.lower = err.upper = 0.0;
+    err.lower_valid = err.upper_valid = false;
+    err.num_fcn_calls = 0;
+    answer.push_back( err );
+  }//for( loop over parameters )
+  
+  if( answer.empty() )
+    return answer;
+  
+  // The chi2 function caches some things on first evaluation, so do that before evaluating from
+  //  multiple threads.
+  try
+  {
+    (*chi2Fcn)( bestFitPrams.Params() );
+  }catch( std::exception & )
+  {
+    // We'll let the individual scans deal with the error
+  }
+  
+  // Each parameter is scanned in its own thread, so dont additionally multi-thread each evaluation
+  const bool origMultithread = chi2Fcn->options().multithread_self_atten;
+  chi2Fcn->setSelfAttMultiThread( false );
+  
+  chi2Fcn->fittingIsStarting( sm_max_model_fit_time_ms );
+  
+  SharedThreadPool::TaskGroup pool;
+  for( ParameterMinosError &err : answer )
+  {
+    ParameterMinosError *err_ptr = &err;
+    pool.post( [err_ptr,&bestFitPrams,chi2Fcn](){
+      try
+      {
+        ROOT::Minuit2::MnUserParameterState inputParamState( bestFitPrams );
+        ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
+        ROOT::Minuit2::MnMinimize fitter( *chi2Fcn, inputParamState, strategy );
+        
+        const double tolerance = 2.0*bestFitPrams.VariableParameters();
+        const unsigned int maxFcnCall = 50000;  //default minuit2: 200 + 100 * npar + 5 * npar**2
+        
+        const ROOT::Minuit2::FunctionMinimum minimum = fitter( maxFcnCall, tolerance );
+        
+        const ROOT::Minuit2::MnMinos minos( *chi2Fcn, minimum, strategy );
+        const ROOT::Minuit2::MinosError minos_err = minos.Minos( err_ptr->index, maxFcnCall );
+        
+        err_ptr->value = minos_err.Min();
+        err_ptr->lower = minos_err.Lower();
+        err_ptr->upper = minos_err.Upper();
+        err_ptr->lower_valid = minos_err.LowerValid();
+        err_ptr->upper_valid = minos_err.UpperValid();
+        err_ptr->num_fcn_calls = static_cast<int>( minimum.NFcn() + minos_err.NFcn() );
+      }catch( std::exception &e )
+      {
+        cerr << "Exception computing MINOS error for '" << err_ptr->name << "': " << e.what() << endl;
+        err_ptr->lower_valid = err_ptr->upper_valid = false;
+      }//try / catch
+    } );
+  }//for( ParameterMinosError &err : answer )
+  pool.join();
+  
+  chi2Fcn->fittingIsFinished();
+  chi2Fcn->setSelfAttMultiThread( origMultithread );
+  
+  return answer;
+}//minos_errors(...)
+  
 }//namespace ShieldingSourceFitCalc
@@ -26,6 +26,7 @@
 #include <mutex>
 #include <atomic>
 #include <cerrno>
+#include <cstdio>
 #include <limits>
 #include <sstream>
 #include <functional>
@@ -90,6 +91,57 @@ std::chrono::system_clock::time_point to_time_point( const boost::posix_time::pt
   
   return tp;
 }
+
+
+/** Returns a SQL expression testing `column` against `search`, that gives the same result as
+ SpecFileQuery::SpecTest::test_string, or "NULL" if this cant be done exactly.
+ */
+std::string sql_string_test( const std::string &column, const std::string &search,
+                             const SpecFileQuery::TextFieldSearchType type )
+{
+  using namespace SpecFileQuery;
+  
+  const string unknown = "NULL";
+  
+  if( search.empty() )
+    return "1";
+  
+  // SQLite `LIKE` and `COLLATE NOCASE` are only case-insensitive for ASCII characters
+  for( const char c : search )
+  {
+    if( (c < 0x20) || (c > 0x7E) )
+      return unknown;
+  }
+  
+  string quoted, pattern;
+  for( const char c : search )
+  {
+    quoted += c;
+    if( c == '\'' )
+      quoted += '\'';
+    
+    if( (c == '%') || (c == '_') || (c == '\\') )
+      pattern += '\\';
+    pattern += c;
+    if( c == '\'' )
+      pattern += '\'';
+  }//for( const char c : search )
+  
+  switch( type )
+  {
+    case TextIsExact:          return "(" + column + " = '" + quoted + "' COLLATE NOCASE)";
+    case TextNotEqual:         return "(" + column + " <> '" + quoted + "' COLLATE NOCASE)";
+    case TextIsContained:      return "(" + column + " LIKE '%" + pattern + "%' ESCAPE '\\')";
+    case TextDoesNotContain:   return "(" + column + " NOT LIKE '%" + pattern + "%' ESCAPE '\\')";
+    case TextStartsWith:       return "(" + column + " LIKE '" + pattern + "%' ESCAPE '\\')";
+    case TextDoesNotStartWith: return "(" + column + " NOT LIKE '" + pattern + "%' ESCAPE '\\')";
+    case TextEndsWith:         return "(" + column + " LIKE '%" + pattern + "' ESCAPE '\\')";
+    case TextDoesNotEndWith:   return "(" + column + " NOT LIKE '%" + pattern + "' ESCAPE '\\')";
+    case TextRegex:            return unknown;
+  }//switch( type )
+  
+  return unknown;
+}//sql_string_test(...)
 }//namespace
 
 namespace SpecFileQuery
@@ -1013,6 +1065,160 @@ namespace SpecFileQuery
   }//bool from_string( const std::string &val, NumericFieldMatchType &type )
   
   
+  std::string SpecTest::sql_condition() const
+  {
+    // Note: the column names used here must match SpecFileInfoToQuery::persist(...), and each
+    //  expression must give exactly the same result as SpecTest::test(...); anything we cant be
+    //  sure of, we return "NULL" for, so SpecLogicTest::sql_prefilter() will treat it as unknown.
+    const string unknown = "NULL";
+    
+    const auto number = []( const double value ) -> string {
+      if( IsNan(value) || IsInf(value) )
+        return "NULL";
+      
+      char buffer[64] = { '\0' };
+      snprintf( buffer, sizeof(buffer), "%.17g", value );
+      return buffer;
+    };//number lambda
+    
+    const auto string_test = [this]( const string &column ) -> string {
+      return sql_string_test( column, m_searchString, m_stringSearchType );
+    };//string_test lambda
+    
+    const auto bool_test = [this]( const string &column ) -> string {
+      return (m_discreteOption==1) ? ("(" + column + " <> 0)") : ("(" + column + " = 0)");
+    };
+    
+    const auto numeric_test = [this,&number,&unknown]( const string &column, const string &tolerance ) -> string {
+      const string value = number( m_numeric );
+      if( value == unknown )
+        return unknown;
+      
+      switch( m_compareType )
+      {
+        case ValueIsExact:       return "(abs(" + column + " - " + value + ") < " + tolerance + ")";
+        case ValueIsNotEqual:    return "(abs(" + column + " - " + value + ") >= " + tolerance + ")";
+        case ValueIsLessThan:    return "(" + column + " < " + value + ")";
+        case ValueIsGreaterThan: return "(" + column + " > " + value + ")";
+      }//switch( m_compareType )
+      
+      return unknown;
+    };//numeric_test lambda
+    
+    const auto integer_test = [this,&number,&unknown]( const string &column ) -> string {
+      const string value = number( m_numeric );
+      if( value == unknown )
+        return unknown;
+      
+      switch( m_compareType )
+      {
+        case ValueIsExact:       return "(" + column + " = " + value + ")";
+        case ValueIsNotEqual:    return "(" + column + " <> " + value + ")";
+        case ValueIsLessThan:    return "(" + column + " < " + value + ")";
+        case ValueIsGreaterThan: return "(" + column + " > " + value + ")";
+      }//switch( m_compareType )
+      
+      return unknown;
+    };//integer_test lambda
+    
+    string condition = unknown;
+    
+    switch( m_searchField )
+    {
+      case FileDataField::Filename:     condition = string_test( "filename" );      break;
+      case FileDataField::SerialNumber: condition = string_test( "serial_number" ); break;
+      case FileDataField::Manufacturer: condition = string_test( "manufacturer" );  break;
+      case FileDataField::Model:        condition = string_test( "model" );         break;
+      case FileDataField::Uuid:         condition = string_test( "uuid" );          break;
+      case FileDataField::LocationName: condition = string_test( "location_name" ); break;
+        
+      case FileDataField::HasRIIDAnalysis:          condition = bool_test( "has_riid_analysis" );   break;
+      case FileDataField::ContainedNuetronDetector: condition = bool_test( "contained_neutron" );   break;
+      case FileDataField::ContainedDeviationPairs:  condition = bool_test( "contained_dev_pairs" ); break;
+      case FileDataField::HasGps:                   condition = bool_test( "contained_gps" );       break;
+        
+      case FileDataField::SearchMode:
+        condition = m_discreteOption ? "(passthrough <> 0)" : "(passthrough = 0)";
+        break;
+        
+      case FileDataField::DetectionSystemType:
+        condition = "(detector_type = " + std::to_string(m_discreteOption) + ")";
+        break;
+        
+      case FileDataField::TotalLiveTime:   condition = numeric_test( "total_livetime", "0.001" ); break;
+      case FileDataField::TotalRealTime:   condition = numeric_test( "total_realtime", "0.001" ); break;
+      case FileDataField::NumberOfSamples: condition = integer_test( "number_of_samples" );      break;
+      case FileDataField::NumberOfRecords: condition = integer_test( "number_of_records" );      break;
+        
+      case FileDataField::Latitude:
+      case FileDataField::Longitude:
+      {
+        // SpecTest::test uses strictly-greater for not-equal, for these fields
+        const string column = (m_searchField == FileDataField::Latitude) ? "mean_latitude" : "mean_longitude";
+        const string value = number( m_numeric );
+        if( value == unknown )
+          break;
+        
+        switch( m_compareType )
+        {
+          case ValueIsExact:       condition = "(abs(" + column + " - " + value + ") < 0.000001)"; break;
+          case ValueIsNotEqual:    condition = "(abs(" + column + " - " + value + ") > 0.000001)"; break;
+          case ValueIsLessThan:    condition = "(" + column + " < " + value + ")"; break;
+          case ValueIsGreaterThan: condition = "(" + column + " > " + value + ")"; break;
+        }//switch( m_compareType )
+        
+        if( condition != unknown )
+          condition = "(contained_gps <> 0 AND " + condition + ")";
+        break;
+      }//case Latitude, Longitude
+        
+      case FileDataField::StartTimeIoI:
+      {
+        if( m_time.is_special() )
+          break;
+        
+        const boost::posix_time::ptime epoch(boost::gregorian::date(1970,1,1));
+        const string value = std::to_string( static_cast<long long>( (m_time - epoch).total_seconds() ) );
+        
+        switch( m_compareType )
+        {
+          case ValueIsExact:       condition = "(abs(start_time_ioi - " + value + ") < 60)"; break;
+          case ValueIsNotEqual:    condition = "(abs(start_time_ioi - " + value + ") > 60)"; break;
+          case ValueIsLessThan:    condition = "(start_time_ioi < " + value + ")"; break;
+          case ValueIsGreaterThan: condition = "(start_time_ioi > " + value + ")"; break;
+        }//switch( m_compareType )
+        
+        if( condition != unknown )
+          condition = "(start_time_ioi <> 0 AND " + condition + ")";
+        break;
+      }//case StartTimeIoI:
+        
+      // These fields are either stored as blobs/XML, or need logic we cant do in SQL.
+      case FileDataField::ParentPath:
+      case FileDataField::DetectorName:
+      case FileDataField::Remark:
+      case FileDataField::AnalysisResultText:
+      case FileDataField::AnalysisResultNuclide:
+      case FileDataField::EnergyCalibrationType:
+      case FileDataField::IndividualSpectrumLiveTime:
+      case FileDataField::IndividualSpectrumRealTime:
+      case FileDataField::NumberOfGammaChannels:
+      case FileDataField::MaximumGammaEnergy:
+      case FileDataField::NeutronCountRate:
+      case FileDataField::GammaCountRate:
+      case FileDataField::MeasurementsStartTimes:
+      case FileDataField::NumFileDataFields:
+        break;
+    }//switch( m_searchField )
+    
+    if( condition == unknown )
+      return unknown;
+    
+    // SpecTest::test always fails for files that arent spectrum files
+    return "(is_spectrum_file <> 0 AND " + condition + ")";
+  }//std::string sql_condition() const
+  
+  
   std::string SpecTest::summary() const
   {
     string summary = to_string( m_searchField );
@@ -1341,6 +1547,31 @@ namespace SpecFileQuery
   }//EventXmlTest::test(...)
   
   
+  std::string EventXmlTest::sql_condition() const
+  {
+    // Note: the table and column names must match those created by SpecFileQueryDbCache; #test
+    //  passes if any of the values for the label passes, and fails if there are no values.
+    if( m_testType != TestType::String )
+      return "NULL";
+    
+    const string value_test = sql_string_test( "v.value", m_test_string, m_fieldTestType );
+    if( value_test == "NULL" )
+      return "NULL";
+    
+    string label;
+    for( const char c : m_test_label )
+    {
+      label += c;
+      if( c == '\'' )
+        label += '\'';
+    }
+    
+    return "EXISTS (SELECT 1 FROM \"EventXmlFieldValue\" v"
+           " WHERE v.file_path_hash = \"SpecFileInfoToQuery\".file_path_hash"
+           " AND v.label = '" + label + "' AND " + value_test + ")";
+  }//std::string EventXmlTest::sql_condition() const
+  
+  
   
   std::string EventXmlTest::summary() const
   {
@@ -1643,6 +1874,127 @@ namespace SpecFileQuery
     return evaluate( m_fields, meas );
   }
   
+  bool SpecLogicTest::to_sql( std::vector<boost::any> fields, std::string &sql, bool &any_known )
+  {
+    // Mirrors SpecLogicTest::evaluate(...), but instead of bools, `fields` get turned into
+    //  SQL expressions (std::string), with "NULL" meaning the result is unknown.
+    if( fields.empty() )
+    {
+      sql = "1";
+      return true;
+    }
+    
+    for( size_t i = 0; i < fields.size(); ++i )
+    {
+      if( fields[i].type() == typeid(LogicType) )
+      {
+        if( boost::any_cast<LogicType>( fields[i] ) != LogicalOpenParan )
+          continue;
+        
+        int nparen = 1;
+        size_t closepos = i + 1;
+        for( ; (nparen != 0) && (closepos < fields.size()); ++closepos )
+        {
+          if( fields[closepos].type() != typeid(LogicType) )
+            continue;
+          
+          const LogicType closelogic = boost::any_cast<LogicType>( fields[closepos] );
+          if( closelogic == LogicalOpenParan )
+            ++nparen;
+          else if( closelogic == LogicalCloseParan )
+            --nparen;
+        }//for( ; closepos < fields.size(); ++closepos )
+        
+        if( nparen != 0 )
+          return false;
+        
+        --closepos; //closepos is now the position of the closing parenthesis
+        
+        const vector<boost::any> inside( fields.begin() + i + 1, fields.begin() + closepos );
+        fields.erase( fields.begin() + i, fields.begin() + closepos + 1 );
+        
+        string inside_sql;
+        if( !to_sql( inside, inside_sql, any_known ) )
+          return false;
+        
+        fields.insert( fields.begin() + i, boost::any(inside_sql) );
+      }else if( fields[i].type() == typeid(SpecTest) )
+      {
+        const string condition = boost::any_cast<SpecTest>( fields[i] ).sql_condition();
+        any_known |= (condition != "NULL");
+        fields[i] = boost::any( condition );
+      }else if( fields[i].type() == typeid(EventXmlTest) )
+      {
+        const string condition = boost::any_cast<EventXmlTest>( fields[i] ).sql_condition();
+        any_known |= (condition != "NULL");
+        fields[i] = boost::any( condition );
+      }else
+      {
+        return false;
+      }
+    }//for( size_t i = 0; i < fields.size(); ++i )
+    
+    for( size_t i = 0; i < fields.size(); ++i )
+    {
+      if( (fields[i].type() != typeid(LogicType))
+          || (boost::any_cast<LogicType>( fields[i] ) != LogicalNot) )
+        continue;
+      
+      if( ((i + 1) >= fields.size()) || (fields[i+1].type() != typeid(string)) )
+        return false;
+      
+      fields[i+1] = boost::any( "(NOT " + boost::any_cast<string>( fields[i+1] ) + ")" );
+      fields.erase( fields.begin() + i );
+    }//for( size_t i = 0; i < fields.size(); ++i )
+    
+    if( (fields.size() % 2) == 0 )
+      return false;
+    
+    if( fields[0].type() != typeid(string) )
+      return false;
+    
+    // SpecLogicTest::evaluate combines terms left to right, so we will too.
+    string answer = boost::any_cast<string>( fields[0] );
+    for( size_t i = 1; (i + 1) < fields.size(); i += 2 )
+    {
+      if( (fields[i].type() != typeid(LogicType)) || (fields[i+1].type() != typeid(string)) )
+        return false;
+      
+      const LogicType logic = boost::any_cast<LogicType>( fields[i] );
+      const string &nextval = boost::any_cast<string>( fields[i+1] );
+      if( logic == LogicalOr )
+        answer = "(" + answer + " OR " + nextval + ")";
+      else if( logic == LogicalAnd )
+        answer = "(" + answer + " AND " + nextval + ")";
+      else
+        return false;
+    }//for( size_t i = 1; (i + 1) < fields.size(); i += 2 )
+    
+    sql = answer;
+    
+    return true;
+  }//bool to_sql(...)
+  
+  
+  std::string SpecLogicTest::sql_prefilter() const
+  {
+    string sql;
+    bool any_known = false;
+    
+    try
+    {
+      if( !to_sql( m_fields, sql, any_known ) || !any_known )
+        return "";
+    }catch( std::exception & )
+    {
+      return "";
+    }
+    
+    // SpecLogicTest::evaluate always fails for entries that arent files.
+    return "(is_file <> 0 AND " + sql + ")";
+  }//std::string sql_prefilter() const
+  
+  
   void SpecLogicTest::isvalid()
   {
     if( m_fields.empty() )
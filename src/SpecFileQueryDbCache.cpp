@@ -23,7 +23,19 @@
 
 #include "InterSpec_config.h"
 
+#include <cmath>
+#include <ctime>
+#include <queue>
+#include <cassert>
+#include <algorithm>
+#include <fstream>
 #include <numeric>
+#include <iterator>
+
+#if( !defined(_WIN32) )
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <Wt/Utils>
 #include <Wt/Json/Value>
@@ -52,6 +64,8 @@
 
 #include <boost/config.hpp>
 #include <boost/io/quoted.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/tuple/tuple.hpp>
 
 
 #if( defined(BOOST_NO_CXX11_HDR_CODECVT) )
@@ -213,6 +227,220 @@ namespace
       background.clear();
     }//try / catch to get derived data spectra to use
   }//get_derived_measurements
+  
+  
+  boost::filesystem::path to_fs_path( const std::string &path )
+  {
+#ifdef _WIN32
+    return boost::filesystem::path( SpecUtils::convert_from_utf8_to_utf16(path) );
+#else
+    return boost::filesystem::path( path );
+#endif
+  }//to_fs_path(...)
+  
+  
+  std::string from_fs_path( const boost::filesystem::path &path )
+  {
+#ifdef _WIN32
+    return SpecUtils::convert_from_utf16_to_utf8( path.string<std::wstring>() );
+#else
+    return path.string<std::string>();
+#endif
+  }//from_fs_path(...)
+  
+  
+  /** Returns modification time of a directory, or -1 on error. */
+  int64_t directory_mtime( const std::string &dir )
+  {
+    boost::system::error_code ec;
+    const boost::filesystem::path p = to_fs_path( dir );
+    if( !boost::filesystem::is_directory( p, ec ) || ec )
+      return -1;
+    
+    const std::time_t mtime = boost::filesystem::last_write_time( p, ec );
+    return ec ? int64_t(-1) : static_cast<int64_t>( mtime );
+  }//directory_mtime(...)
+  
+  
+  /** Returns true if `path` is `dir`, or is inside of it. */
+  bool path_in_dir( const std::string &path, const std::string &dir )
+  {
+    if( !SpecUtils::starts_with( path, dir.c_str() ) )
+      return false;
+    
+    return (path.size() == dir.size())
+           || (!dir.empty() && ((dir.back() == '/') || (dir.back() == '\\')))
+           || (path[dir.size()] == '/') || (path[dir.size()] == '\\');
+  }//path_in_dir(...)
+  
+  
+  const char * const ns_dir_index_header = "InterSpecFileQueryDirIndex\t1";
+  
+  
+  /** Table holding one row for each {file, event XML field, value}, so EventXmlTest conditions can be
+   evaluated by SpecFileQueryDbCache::sql_rejected_files, using an index, instead of loading each
+   SpecFileInfoToQuery.  The column names must match SpecFileQuery::EventXmlTest::sql_condition().
+   */
+  const char * const ns_event_xml_value_table = "EventXmlFieldValue";
+  
+  
+  /** Replaces the rows of #ns_event_xml_value_table for `info`.  Must be called within a transaction. */
+  void store_event_xml_values( Wt::Dbo::Session &session, const SpecFileInfoToQuery &info )
+  {
+    const string table = string("\"") + ns_event_xml_value_table + "\"";
+    session.execute( "DELETE FROM " + table + " WHERE file_path_hash = ?" ).bind( info.file_path_hash );
+    
+    for( const auto &label_values : info.event_xml_filter_values )
+    {
+      for( const string &value : label_values.second )
+      {
+        session.execute( "INSERT INTO " + table + " (file_path_hash, label, value) VALUES (?, ?, ?)" )
+          .bind( info.file_path_hash ).bind( label_values.first ).bind( value );
+      }
+    }//for( loop over event XML fields )
+  }//store_event_xml_values(...)
+  
+  
+  /** Creates #ns_event_xml_value_table, and its indexes, if it doesnt exist yet.  If a previously
+   persisted database (from before this table was added) already has entries, the table is filled from
+   their cached values.
+   */
+  void create_event_xml_value_table( Wt::Dbo::Session &session )
+  {
+    const string table = string("\"") + ns_event_xml_value_table + "\"";
+    
+    Wt::Dbo::Transaction trans( session );
+    
+    const int num_existing = session.query<int>( "SELECT count(1) FROM sqlite_master" )
+                                    .where( "type = 'table' AND name = ?" ).bind( ns_event_xml_value_table )
+                                    .resultValue();
+    if( num_existing > 0 )
+    {
+      trans.commit();
+      return;
+    }
+    
+    session.execute( "CREATE TABLE " + table + " (file_path_hash integer not null,"
+                     " label text not null, value text not null)" );
+    session.execute( "CREATE INDEX \"EventXmlFieldValue_label_value\" ON " + table
+                     + " (label, value COLLATE NOCASE)" );
+    session.execute( "CREATE INDEX \"EventXmlFieldValue_file\" ON " + table + " (file_path_hash)" );
+    
+    Wt::Dbo::collection<Wt::Dbo::ptr<SpecFileInfoToQuery>> entries = session.find<SpecFileInfoToQuery>();
+    for( const Wt::Dbo::ptr<SpecFileInfoToQuery> &entry : entries )
+    {
+      if( !entry->event_xml_filter_values.empty() )
+        store_event_xml_values( session, *entry );
+    }
+    
+    trans.commit();
+  }//create_event_xml_value_table(...)
+  
+  
+  /** Finds the Event XML file in `dir`, and extracts the values of each filters xpath from it.
+   
+   Each candidate file is read into memory once, so the base node check, and parsing, dont need to
+   re-open the file.
+   */
+  std::map<std::string,std::vector<std::string>> event_xml_values_in_directory( const std::string &dir,
+                                                    const std::vector<EventXmlFilterInfo> &xmlfilters )
+  {
+    std::map<std::string,std::vector<std::string>> values;
+    
+    if( xmlfilters.empty() )
+      return values;
+    
+    const vector<string> candidates = SpecUtils::ls_files_in_directory( dir, &xml_files_small_enough, nullptr );
+    
+    //Assume all xmlfilters have the same filter.
+    //   ToDo: add development check for this
+    const string &base_node_test = xmlfilters[0].m_base_node_test;
+    
+    for( const auto &xmlfilename : candidates )
+    {
+#ifdef _WIN32
+      const std::wstring wxmlfilename = SpecUtils::convert_from_utf8_to_utf16( xmlfilename );
+      ifstream f( wxmlfilename.c_str(), ios::in | ios::binary );
+#else
+      ifstream f( xmlfilename.c_str(), ios::in | ios::binary );
+#endif
+      
+      if( !f )
+        continue;
+      
+      // Candidates are limited to EventXmlTest::sm_max_event_xml_file_size, so reading the whole
+      //  file is cheap.
+      const string contents( (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>() );
+      
+      if( !base_node_test.empty()
+         && !SpecUtils::icontains( contents.substr(0, std::min(contents.size(), size_t(127))), base_node_test ) )
+        continue;
+      
+      pugi::xml_document doc;
+      if( !doc.load_buffer( contents.data(), contents.size() ) )
+        continue;
+      
+      for( const EventXmlFilterInfo &test : xmlfilters )
+      {
+        try
+        {
+          pugi::xpath_node_set tools = doc.select_nodes( test.m_xpath.c_str() );
+          
+          for( pugi::xpath_node_set::const_iterator it = tools.begin(); it != tools.end(); ++it )
+          {
+            const string strval = it->node().text().as_string();
+            if( !strval.empty() ) //probably shouldnt ever be empty, but could if the xpath is wonky
+              values[test.m_label].push_back( strval );
+          }//for( pugi::xpath_node_set::const_iterator it = tools.begin(); it != tools.end(); ++it )
+        }
+#if( PERFORM_DEVELOPER_CHECKS )
+        catch( std::exception &e ){
+          log_developer_error( __func__, ("Unexpected exception performing xpath query: " + string(e.what())).c_str() );
+        }
+#else
+        catch( std::exception & ){
+          //We should have already checked the xpath - so we really shouldnt ever get here.
+        }
+#endif
+      }//for( const EventXmlFilterInfo &test : xmlfilters )
+      
+      //In principle if we made it here we found a Event XML file - so lets not
+      //  keep wasting time looking in other files (on the other hand, would it be
+      //  reasonable to allow using more than one Event XML file?)
+      break;
+    }//for( const auto &xmlfilename : candidates )
+    
+    return values;
+  }//event_xml_values_in_directory(...)
+  
+  
+  /** Asks the OS to start reading the entire file into its cache, using large sequential reads.
+   
+   The spectrum file parsers do many small reads and seeks (especially when trying multiple formats),
+   which on spinning or network drives is much slower than reading the file once; this also lets the
+   reads overlap with parsing the previous file, when searching with multiple threads.
+   Does nothing on systems without `posix_fadvise`.
+   */
+  void prefetch_file( const std::string &filepath, const size_t filesize )
+  {
+#if( defined(POSIX_FADV_WILLNEED) )
+    // We dont want to evict too much of the cache for huge files, that will probably fail to parse anyway
+    const size_t max_prefetch_file_size = 64*1024*1024;
+    if( !filesize || (filesize > max_prefetch_file_size) )
+      return;
+    
+    const int fd = open( filepath.c_str(), O_RDONLY );
+    if( fd < 0 )
+      return;
+    
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+    posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+    close( fd );
+#else
+    (void)filepath;
+    (void)filesize;
+#endif
+  }//void prefetch_file(...)
 }//namespace
 
 
@@ -373,6 +601,50 @@ namespace Wt {
     }
     
     
+    std::string sql_value_traits<std::vector<float>>::type(SqlConnection *conn, int size)
+    {
+#if( USE_TEXT_FOR_BLOB )
+      return conn->textType(-1);
+#else
+      return conn->blobType();
+#endif
+    }
+    void sql_value_traits<std::vector<float>>::bind(const std::vector<float> &v, SqlStatement *statement, int column, int size)
+    {
+#if( USE_TEXT_FOR_BLOB )
+      WStringStream strm;
+      for( size_t i = 0; i < v.size(); ++i )
+        strm << string(i ? "," : "") << static_cast<double>(v[i]);
+      statement->bind( column, strm.str() );
+#else
+      std::vector<unsigned char> bindata( sizeof(float)*v.size() );
+      if( !v.empty() )
+        memcpy( &(bindata[0]), &(v[0]), bindata.size() );
+      statement->bind( column, bindata );
+#endif
+    }
+    bool sql_value_traits<std::vector<float>>::read(std::vector<float> &v, SqlStatement *statement, int column, int size)
+    {
+      v.clear();
+#if( USE_TEXT_FOR_BLOB )
+      string data;
+      if( !statement->getResult( column, &data, size ) )
+        return false;
+      if( data.empty() )
+        return true;
+      return SpecUtils::split_to_floats( data.c_str(), data.size(), v );
+#else
+      std::vector<unsigned char> bindata;
+      if( !statement->getResult( column, &bindata, size ) || ((bindata.size() % sizeof(float)) != 0) )
+        return false;
+      v.resize( bindata.size() / sizeof(float) );
+      if( !v.empty() )
+        memcpy( &(v[0]), &(bindata[0]), bindata.size() );
+      return true;
+#endif
+    }
+    
+    
     std::string sql_value_traits<std::set<size_t>>::type(SqlConnection *conn, int size)
     {
 #if( USE_TEXT_FOR_BLOB )
@@ -981,6 +1253,7 @@ void SpecFileInfoToQuery::reset()
   start_time_ioi = std::time_t(0);
   
   event_xml_filter_values.clear();
+  spectral_features.clear();
 }//void SpecFileInfoToQuery::reset()
 
 
@@ -996,7 +1269,7 @@ void SpecFileInfoToQuery::fill_info_from_file( const std::string filepath )
   file_size = SpecUtils::file_size(filepath);
   file_path_hash = std::hash<std::string>()(filepath);
   
-  // TODO: For files that are not N42 or XML files (as determined by filename), and less than a number of MB, read the file into memory, and then parse.  This will minimize hard-drive seeks (for spinning drives), and allow multithreaded searches to work better - hopefully.
+  prefetch_file( filepath, static_cast<size_t>(file_size) );
   
   SpecUtils::SpecFile meas;
   const bool loaded = meas.load_file(filepath, SpecUtils::ParserType::Auto, filepath);
@@ -1079,6 +1352,10 @@ void SpecFileInfoToQuery::fill_info_from_file( const std::string filepath )
   
   map<int,vector<shared_ptr<const SpecUtils::Measurement>>> samples_to_meas;
   
+  // The gamma spectra to create #spectral_features from; foreground if there are any, otherwise
+  //  unknown, otherwise background.
+  vector<shared_ptr<const SpecUtils::Measurement>> fore_gamma, unknown_gamma, back_gamma;
+  
   // If this is a system we want derived data from, we will go all-in and
   //  only look at derived data; most fields will then only show derived data,
   //  but some, like number of samples/measurements will show all..
@@ -1153,6 +1430,16 @@ void SpecFileInfoToQuery::fill_info_from_file( const std::string filepath )
         }
         
         number_of_gamma_channels.insert( m->num_gamma_channels() );
+        switch( m->source_type() )
+        {
+          case SpecUtils::SourceType::Foreground: fore_gamma.push_back( m );    break;
+          case SpecUtils::SourceType::Unknown:    unknown_gamma.push_back( m ); break;
+          case SpecUtils::SourceType::Background: back_gamma.push_back( m );    break;
+          case SpecUtils::SourceType::IntrinsicActivity:
+          case SpecUtils::SourceType::Calibration:
+            break;
+        }//switch( m->source_type() )
+        
         const float lt = ((m->live_time() > 0.001f) ? m->live_time() : m->real_time());
         if( lt > 0.001f )
           gamma_count_rate.insert( m->gamma_count_sum() / lt );
@@ -1338,83 +1625,59 @@ void SpecFileInfoToQuery::fill_info_from_file( const std::string filepath )
   else if( !start_times.empty() )
     start_time_ioi = *begin(start_times);
   
+  if( !fore_gamma.empty() )
+    spectral_features = compute_spectral_features( fore_gamma );
+  else if( !unknown_gamma.empty() )
+    spectral_features = compute_spectral_features( unknown_gamma );
+  else if( !back_gamma.empty() )
+    spectral_features = compute_spectral_features( back_gamma );
 }//void fill_info_from_file( const std::string filepath )
 
 
-void SpecFileInfoToQuery::fill_event_xml_filter_values( const std::string &filepath,
-                                                       const std::vector<EventXmlFilterInfo> &xmlfilters )
+std::vector<float> SpecFileInfoToQuery::compute_spectral_features(
+                      const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &meas )
 {
-  event_xml_filter_values.clear();
-  
-  if( xmlfilters.empty() )
-    return;
+  const size_t nbin = sm_num_spectral_features;
+  const double min_energy = 30.0, max_energy = 3000.0;
+  const double log_min_energy = std::log( min_energy );
+  const double bins_per_log_energy = nbin / (std::log( max_energy ) - log_min_energy);
   
-  const auto path = SpecUtils::parent_path( filepath );
-  auto candidates = SpecUtils::ls_files_in_directory( path, &xml_files_small_enough, nullptr );
-  
-  //Assume all xmlfilters have the same filter.
-  //   ToDo: add development check for this
-  const string &base_node_test = xmlfilters[0].m_base_node_test;
-  
-  for( const auto &xmlfilename : candidates )
+  vector<double> bins( nbin, 0.0 );
+  for( const shared_ptr<const SpecUtils::Measurement> &m : meas )
   {
-#ifdef _WIN32
-    const std::wstring wxmlfilename = SpecUtils::convert_from_utf8_to_utf16( xmlfilename );
-    ifstream f( wxmlfilename.c_str() );
-#else
-    ifstream f( xmlfilename.c_str() );
-#endif
-    
-    if( !f )
+    const shared_ptr<const vector<float>> energies = m ? m->channel_energies() : nullptr;
+    const shared_ptr<const vector<float>> counts = m ? m->gamma_counts() : nullptr;
+    if( !energies || !counts || (energies->size() <= counts->size()) )
       continue;
     
-    if( !base_node_test.empty() )
+    for( size_t i = 0; i < counts->size(); ++i )
     {
-      string start( 128, ' ');
-      f.read( &(start[0]), 127 );
-      if( !SpecUtils::icontains(start, base_node_test) )
+      // Assign each channel by its center, which is fine since channels are much narrower than bins
+      const double energy = 0.5*((*energies)[i] + (*energies)[i+1]);
+      if( (energy < min_energy) || (energy >= max_energy) || !((*counts)[i] > 0.0f) )
         continue;
-    }//if( !base_node_test.empty() )
-    
-    pugi::xml_document doc;
-#ifdef _WIN32
-    if( !doc.load_file( wxmlfilename.c_str() ) )
-      continue;
-#else
-    if( !doc.load_file( xmlfilename.c_str() ) )
-      continue;
-#endif
-    
-    for( const EventXmlFilterInfo &test : xmlfilters )
-    {
-      try
-      {
-        pugi::xpath_node_set tools = doc.select_nodes( test.m_xpath.c_str() );
-        
-        for( pugi::xpath_node_set::const_iterator it = tools.begin(); it != tools.end(); ++it )
-        {
-          const string strval = it->node().text().as_string();
-          if( !strval.empty() ) //probably shouldnt ever be empty, but could if the xpath is wonky
-            event_xml_filter_values[test.m_label].push_back( strval );
-        }//for( pugi::xpath_node_set::const_iterator it = tools.begin(); it != tools.end(); ++it )
-      }
-#if( PERFORM_DEVELOPER_CHECKS )
-      catch( std::exception &e ){
-        log_developer_error( __func__, ("Unexpected exception performing xpath query: " + string(e.what())).c_str() );
-      }
-#else
-      catch( std::exception & ){
-        //We should have already checked the xpath - so we really shouldnt ever get here.
-      }
-#endif
-    }//for( const auto &xmlfilename : candidates )
-    
-    //In principle if we made it here we found a Event XML file - so lets not
-    //  keep wasting time looking in other files (on the other hand, would it be
-    //  reasonable to allow using more than one Event XML file?)
-    break;
-  }//for( const EventXmlFilterInfo &test : xmlfilters )
+      
+      const size_t bin = static_cast<size_t>( (std::log(energy) - log_min_energy) * bins_per_log_energy );
+      bins[std::min(bin, nbin - 1)] += (*counts)[i];
+    }//for( loop over channels )
+  }//for( loop over measurements )
+  
+  const double sum = std::accumulate( begin(bins), end(bins), 0.0 );
+  if( !(sum > 0.0) )
+    return vector<float>{};
   
+  vector<float> features( nbin );
+  for( size_t i = 0; i < nbin; ++i )
+    features[i] = static_cast<float>( std::sqrt( bins[i] / sum ) );
+  
+  return features;
+}//compute_spectral_features(...)
+
+
+void SpecFileInfoToQuery::fill_event_xml_filter_values( const std::string &filepath,
+                                                       const std::vector<EventXmlFilterInfo> &xmlfilters )
+{
+  event_xml_filter_values = event_xml_values_in_directory( SpecUtils::parent_path( filepath ), xmlfilters );
 }//void fill_event_xml_filter_values( const std::string filepath )
 
 
@@ -1425,7 +1688,11 @@ SpecFileQueryDbCache::SpecFileQueryDbCache( const bool use_db_caching,
   : m_use_db_caching( use_db_caching ),
     m_using_persist_caching( false ),
     m_fs_path( path ),
-    m_xmlfilters( xmlfilters )
+    m_xmlfilters( xmlfilters ),
+    m_dir_index_loaded( false ),
+    m_dir_index_complete{ false, false },
+    m_dir_index{},
+    m_similarity_index_stale( true )
 {
   m_stop_caching = false;
   m_doing_caching = false;
@@ -1469,7 +1736,7 @@ std::string SpecFileQueryDbCache::construct_persisted_db_filename( std::string p
   SpecUtils::make_canonical_path(persisted_path);
   
   const auto path_hash = std::hash<std::string>()( persisted_path );
-  return SpecUtils::append_path( persisted_path, "InterSpec_file_query_cache_" + std::to_string(path_hash) + "_v1.sqlite3" );
+  return SpecUtils::append_path( persisted_path, "InterSpec_file_query_cache_" + std::to_string(path_hash) + "_v2.sqlite3" );
 }//std::string construct_persisted_db_filename( std::string basepath )
 
 
@@ -1486,6 +1753,7 @@ bool SpecFileQueryDbCache::open_db( const std::string &path, const bool create_t
     db_session->mapClass<SpecFileInfoToQuery>( "SpecFileInfoToQuery" );
     if( create_tables )
       db_session->createTables();
+    create_event_xml_value_table( *db_session );
     
     m_use_db_caching = true;
     m_db_location = path;
@@ -1593,6 +1861,8 @@ bool SpecFileQueryDbCache::init_existing_persisted_db()
         innertrans.commit();
       }
     }//if( !gotentry )
+    
+    create_event_xml_value_table( *db_session );
   
     m_db = std::move( db );
     m_db_session = std::move( db_session );
@@ -1709,6 +1979,14 @@ bool operator==( const SpecFileInfoToQuery &lhs, const SpecFileInfoToQuery &rhs
     return false;
   if( rhs.start_times != lhs.start_times )
     return false;
+  if( rhs.spectral_features.size() != lhs.spectral_features.size() )
+    return false;
+  for( size_t i = 0; i < rhs.spectral_features.size(); ++i )
+  {
+    //Text serialization of floats may not exactly round-trip
+    if( fabs(rhs.spectral_features[i] - lhs.spectral_features[i]) > 1.0E-5f*std::max(1.0f,fabs(rhs.spectral_features[i])) )
+      return false;
+  }
   return true;
 }
 #endif
@@ -1757,7 +2035,7 @@ void SpecFileQueryDbCache::cache_results( const std::vector<std::string> &&files
       {//begin lock on m_db_mutex
         std::lock_guard<std::mutex> lock( m_db_mutex );
         
-        const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filename) );
+        const long long filenamehash = file_path_hash( filename );
         const size_t filesize = SpecUtils::file_size(filename);
         
         Wt::Dbo::Transaction trans( *m_db_session );
@@ -1783,7 +2061,7 @@ void SpecFileQueryDbCache::cache_results( const std::vector<std::string> &&files
       auto dbinforaw = new SpecFileInfoToQuery();;
       Wt::Dbo::ptr<SpecFileInfoToQuery> dbinfo( dbinforaw );
       dbinforaw->fill_info_from_file(filename);
-      dbinforaw->fill_event_xml_filter_values(filename,m_xmlfilters);
+      fill_event_xml_values( *dbinforaw, filename );
       
       {//begin lock on m_db_mutex
         std::lock_guard<std::mutex> lock( m_db_mutex );
@@ -1791,8 +2069,10 @@ void SpecFileQueryDbCache::cache_results( const std::vector<std::string> &&files
         
         //We could be adding this file info uncessarily to the database, but I think end-logic will be fine...
         m_db_session->add( dbinfo );
+        store_event_xml_values( *m_db_session, *dbinforaw );
         
         trans.commit();
+        m_similarity_index_stale = true;
       }//end lock on m_db_mutex
       
 #if( PERFORM_DEVELOPER_CHECKS )
@@ -1955,6 +2235,13 @@ void SpecFileQueryDbCache::set_persist( const bool persist )
 
   
   //if we're here, we want to stop using a persisted database
+  {
+    std::lock_guard<std::mutex> dir_lock( m_dir_index_mutex );
+    const string dir_index_file = construct_persisted_db_filename( m_fs_path ) + ".dirindex";
+    if( SpecUtils::is_file( dir_index_file ) )
+      SpecUtils::remove_file( dir_index_file );
+  }
+  
   if( SpecUtils::is_file(m_db_location) )
   {
     bool create_tables = false;
@@ -2001,6 +2288,33 @@ const std::vector<EventXmlFilterInfo> &SpecFileQueryDbCache::xml_filters() const
 }
 
 
+void SpecFileQueryDbCache::fill_event_xml_values( SpecFileInfoToQuery &info, const std::string &filepath )
+{
+  info.event_xml_filter_values.clear();
+  
+  if( m_xmlfilters.empty() )
+    return;
+  
+  const string dir = SpecUtils::parent_path( filepath );
+  
+  {
+    std::lock_guard<std::mutex> lock( m_event_xml_mutex );
+    const auto pos = m_event_xml_dir_values.find( dir );
+    if( pos != end(m_event_xml_dir_values) )
+    {
+      info.event_xml_filter_values = pos->second;
+      return;
+    }
+  }
+  
+  // Multiple threads may parse the same directory at the same time; this is harmless.
+  info.event_xml_filter_values = event_xml_values_in_directory( dir, m_xmlfilters );
+  
+  std::lock_guard<std::mutex> lock( m_event_xml_mutex );
+  m_event_xml_dir_values[dir] = info.event_xml_filter_values;
+}//void fill_event_xml_values(...)
+
+
 std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const std::string &filepath )
 {
   //ToDo: A copy or two of the results could probably be eliminated in this function.
@@ -2009,11 +2323,11 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
   if( !m_use_db_caching )
   {
     info->fill_info_from_file( filepath );
-    info->fill_event_xml_filter_values(filepath,m_xmlfilters);
+    fill_event_xml_values( *info, filepath );
     return info;
   }
   
-  const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filepath) );
+  const long long filenamehash = file_path_hash( filepath );
   const size_t filesize = SpecUtils::file_size(filepath);
   
   try
@@ -2025,7 +2339,7 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
       {
         //Shouldnt ever get here!
         info->fill_info_from_file( filepath );
-        info->fill_event_xml_filter_values(filepath,m_xmlfilters);
+        fill_event_xml_values( *info, filepath );
         return info;
       }
       
@@ -2049,7 +2363,7 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
     
     //Wasnt in the database
     info->fill_info_from_file( filepath );
-    info->fill_event_xml_filter_values( filepath, m_xmlfilters );
+    fill_event_xml_values( *info, filepath );
     
     auto dbinforaw = new SpecFileInfoToQuery();
     Wt::Dbo::ptr<SpecFileInfoToQuery> dbinfo( dbinforaw );
@@ -2060,23 +2374,590 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
       Wt::Dbo::Transaction trans( *m_db_session );
       
       m_db_session->add( dbinfo );
+      store_event_xml_values( *m_db_session, *dbinforaw );
       trans.commit();
+      m_similarity_index_stale = true;
     }//end check in DB
   }catch( Wt::Dbo::Exception &e )
   {
     cerr << "Caught Dbo::Exception in spec_file_info: '" << e.what() <<"', backend code: '"
          << e.code() << "'" << endl;
     info->fill_info_from_file( filepath );
-    info->fill_event_xml_filter_values( filepath, m_xmlfilters );
+    fill_event_xml_values( *info, filepath );
   }catch( std::exception &e )
   {
     cerr << "Caught std::Exception in spec_file_info: " << e.what() << endl;
     info->fill_info_from_file( filepath );
-    info->fill_event_xml_filter_values( filepath, m_xmlfilters );
+    fill_event_xml_values( *info, filepath );
   }
   
   return info;
 }//SpecFileInfoToQuery spec_file_info( const std::string &filepath )
 
 
+std::unordered_map<long long,SpecFileQueryDbCache::SqlRejectedFile>
+                    SpecFileQueryDbCache::sql_rejected_files( const SpecFileQuery::SpecLogicTest &query )
+{
+  std::unordered_map<long long,SqlRejectedFile> rejected;
+  
+  if( !m_use_db_caching )
+    return rejected;
+  
+  const string prefilter = query.sql_prefilter();
+  if( prefilter.empty() )
+    return rejected;
+  
+  typedef boost::tuple<long long, long long, bool, std::string> RejectedRow;
+  
+  try
+  {
+    std::lock_guard<std::mutex> lock( m_db_mutex );
+    
+    if( !m_db || !m_db_session )
+      return rejected;
+    
+    Wt::Dbo::Transaction trans( *m_db_session );
+    
+    // The prefilter is NULL when the result depends on conditions that can only be evaluated in C++,
+    //  so we only want entries where it is definitely false.
+    Wt::Dbo::collection<RejectedRow> rows = m_db_session->query<RejectedRow>(
+            "SELECT file_path_hash, file_size, is_spectrum_file, uuid FROM \"SpecFileInfoToQuery\"" )
+          .where( "coalesce(" + prefilter + ", 1) = 0" )
+          .resultList();
+    
+    for( const RejectedRow &row : rows )
+    {
+      SqlRejectedFile &info = rejected[boost::get<0>(row)];
+      info.file_size = boost::get<1>(row);
+      info.is_spectrum_file = boost::get<2>(row);
+      info.uuid = boost::get<3>(row);
+    }
+    
+    trans.commit();
+  }catch( Wt::Dbo::Exception &e )
+  {
+    cerr << "Caught Dbo::Exception in sql_rejected_files: '" << e.what() << "', backend code: '"
+         << e.code() << "'" << endl;
+    rejected.clear();
+  }catch( std::exception &e )
+  {
+    cerr << "Caught std::Exception in sql_rejected_files: " << e.what() << endl;
+    rejected.clear();
+  }//try / catch
+  
+  return rejected;
+}//sql_rejected_files(...)
+
+
+long long SpecFileQueryDbCache::file_path_hash( const std::string &filepath )
+{
+  return static_cast<long long>( std::hash<std::string>()(filepath) );
+}//long long file_path_hash( const std::string &filepath )
+
+
+std::vector<std::string> SpecFileQueryDbCache::indexed_files( const bool recursive,
+                                          const size_t max_file_size,
+                                          bool (*name_filter)( const std::string &path ),
+                                          const std::function<void(size_t)> &progress,
+                                          const std::atomic<bool> *stop )
+{
+  std::lock_guard<std::mutex> lock( m_dir_index_mutex );
+  
+  load_directory_index();
+  
+  vector<string> files;
+  bool index_changed = false, stopped = false;
+  
+  vector<string> dirs_to_do( 1, m_fs_path );
+  
+  while( !dirs_to_do.empty() )
+  {
+    if( stop && stop->load() )
+    {
+      stopped = true;
+      break;
+    }
+    
+    const string dir = dirs_to_do.back();
+    dirs_to_do.pop_back();
+    
+    const int64_t mtime = directory_mtime( dir );
+    auto pos = m_dir_index.find( dir );
+    
+    if( mtime < 0 )
+    {
+      if( pos != end(m_dir_index) )
+      {
+        m_dir_index.erase( pos );
+        index_changed = true;
+      }
+      continue;
+    }//if( couldnt get directory modification time )
+    
+    if( (pos == end(m_dir_index)) || (pos->second.m_mtime < 0) || (pos->second.m_mtime != mtime) )
+    {
+      // Directory is new, or has changed, so we need to list it
+      DirectoryIndexEntry entry;
+      
+      const boost::filesystem::path dirpath = to_fs_path( dir );
+      boost::system::error_code ec;
+      boost::filesystem::directory_iterator iter( dirpath, ec ), iter_end;
+      
+      for( ; !ec && (iter != iter_end); iter.increment(ec) )
+      {
+        const boost::filesystem::path &p = iter->path();
+        const string name = from_fs_path( p.filename() );
+        
+        boost::system::error_code stat_ec;
+        const boost::filesystem::file_status status = boost::filesystem::status( p, stat_ec ); //follows symlinks
+        if( stat_ec )
+          continue;
+        
+        if( boost::filesystem::is_directory( status ) )
+        {
+          //If this is a symlink to a directory, check for cyclical links
+          const boost::filesystem::file_status symstat = boost::filesystem::symlink_status( p, stat_ec );
+          if( !stat_ec && (symstat.type() == boost::filesystem::file_type::symlink_file) )
+          {
+            const boost::filesystem::path target = boost::filesystem::canonical( p, stat_ec );
+            boost::system::error_code parent_ec;
+            const boost::filesystem::path parent = boost::filesystem::canonical( dirpath, parent_ec );
+            if( stat_ec || parent_ec || path_in_dir( from_fs_path(parent), from_fs_path(target) ) )
+              continue;
+          }//if( symlink to a directory )
+          
+          entry.m_subdirs.push_back( name );
+        }else if( status.type() == boost::filesystem::file_type::regular_file )
+        {
+          const boost::uintmax_t size = boost::filesystem::file_size( p, stat_ec );
+          if( !stat_ec )
+            entry.m_files.emplace_back( name, static_cast<uint64_t>(size) );
+        }//if( directory ) / else if( file )
+      }//for( loop over directory entries )
+      
+      if( ec )
+        cerr << "SpecFileQueryDbCache::indexed_files: error listing '" << dir << "': " << ec.message() << endl;
+      
+      std::sort( begin(entry.m_files), end(entry.m_files) );
+      std::sort( begin(entry.m_subdirs), end(entry.m_subdirs) );
+      
+      // If the directory was just modified, more changes could happen within the same second, without its
+      //  modification time changing, so we wont trust this listing next time around.
+      entry.m_mtime = (ec || (mtime >= (static_cast<int64_t>(std::time(nullptr)) - 2))) ? int64_t(-1) : mtime;
+      
+      // Remove index entries for sub-directories that no longer exist.
+      if( pos != end(m_dir_index) )
+      {
+        for( const string &oldsub : pos->second.m_subdirs )
+        {
+          if( std::binary_search( begin(entry.m_subdirs), end(entry.m_subdirs), oldsub ) )
+            continue;
+          
+          const string oldpath = SpecUtils::append_path( dir, oldsub );
+          auto subiter = m_dir_index.lower_bound( oldpath );
+          while( (subiter != end(m_dir_index)) && path_in_dir( subiter->first, oldpath ) )
+            subiter = m_dir_index.erase( subiter );
+        }//for( const string &oldsub : pos->second.m_subdirs )
+      }//if( we had a previous entry for this directory )
+      
+      m_dir_index[dir] = std::move( entry );
+      pos = m_dir_index.find( dir );
+      index_changed = true;
+    }//if( need to list directory )
+    
+    assert( pos != end(m_dir_index) );
+    const DirectoryIndexEntry &entry = pos->second;
+    
+    for( const pair<string,uint64_t> &name_size : entry.m_files )
+    {
+      if( name_size.second > max_file_size )
+        continue;
+      
+      string filepath = SpecUtils::append_path( dir, name_size.first );
+      if( !name_filter || name_filter( filepath ) )
+        files.push_back( std::move(filepath) );
+    }//for( loop over files in directory )
+    
+    // Add sub-directories in reverse order, so they will be processed alphabetically
+    if( recursive )
+    {
+      for( auto iter = entry.m_subdirs.rbegin(); iter != entry.m_subdirs.rend(); ++iter )
+        dirs_to_do.push_back( SpecUtils::append_path( dir, *iter ) );
+    }
+    
+    if( progress )
+      progress( files.size() );
+  }//while( !dirs_to_do.empty() )
+  
+  if( !stopped && !m_dir_index_complete[recursive ? 1 : 0] )
+  {
+    m_dir_index_complete[recursive ? 1 : 0] = true;
+    index_changed = true;
+  }
+  
+  if( index_changed )
+    save_directory_index();
+  
+  return files;
+}//std::vector<std::string> indexed_files(...)
+
+
+bool SpecFileQueryDbCache::has_directory_index( const bool recursive )
+{
+  std::lock_guard<std::mutex> lock( m_dir_index_mutex );
+  
+  load_directory_index();
+  
+  return m_dir_index_complete[1] || (!recursive && m_dir_index_complete[0]);
+}//bool has_directory_index( const bool recursive )
+
+
+void SpecFileQueryDbCache::load_directory_index()
+{
+  if( m_dir_index_loaded || !m_using_persist_caching )
+    return;
+  
+  m_dir_index_loaded = true;
+  
+  const string filename = construct_persisted_db_filename( m_fs_path ) + ".dirindex";
+  if( !SpecUtils::is_file( filename ) )
+    return;
+  
+#ifdef _WIN32
+  ifstream input( SpecUtils::convert_from_utf8_to_utf16(filename).c_str(), ios_base::binary|ios_base::in );
+#else
+  ifstream input( filename.c_str(), ios_base::binary|ios_base::in );
+#endif
+  
+  string line;
+  if( !input.is_open() || !SpecUtils::safe_get_line( input, line ) || (line != ns_dir_index_header) )
+  {
+    cerr << "SpecFileQueryDbCache: ignoring invalid directory index '" << filename << "'" << endl;
+    return;
+  }
+  
+  try
+  {
+    std::map<std::string,DirectoryIndexEntry> index;
+    bool complete[2] = { false, false };
+    DirectoryIndexEntry *current = nullptr;
+    
+    while( SpecUtils::safe_get_line( input, line ) )
+    {
+      if( line.size() < 3 || (line[1] != '\t') )
+        throw runtime_error( "invalid line" );
+      
+      const char type = line[0];
+      const string rest = line.substr( 2 );
+      
+      switch( type )
+      {
+        case 'C':
+        {
+          complete[0] = (rest.size() > 0) && (rest[0] == '1');
+          complete[1] = (rest.size() > 2) && (rest[2] == '1');
+          break;
+        }
+          
+        case 'D':
+        {
+          const size_t tab = rest.find( '\t' );
+          if( tab == string::npos )
+            throw runtime_error( "invalid directory line" );
+          DirectoryIndexEntry &entry = index[rest.substr(tab + 1)];
+          entry.m_mtime = std::stoll( rest.substr(0, tab) );
+          current = &entry;
+          break;
+        }
+          
+        case 'F':
+        {
+          const size_t tab = rest.find( '\t' );
+          if( !current || (tab == string::npos) )
+            throw runtime_error( "invalid file line" );
+          current->m_files.emplace_back( rest.substr(tab + 1), std::stoull( rest.substr(0, tab) ) );
+          break;
+        }
+          
+        case 'S':
+        {
+          if( !current )
+            throw runtime_error( "invalid sub-directory line" );
+          current->m_subdirs.push_back( rest );
+          break;
+        }
+          
+        default:
+          throw runtime_error( "invalid line type" );
+      }//switch( type )
+    }//while( SpecUtils::safe_get_line( input, line ) )
+    
+    m_dir_index.swap( index );
+    m_dir_index_complete[0] = complete[0];
+    m_dir_index_complete[1] = complete[1];
+  }catch( std::exception &e )
+  {
+    cerr << "SpecFileQueryDbCache: error reading directory index '" << filename << "': " << e.what() << endl;
+  }//try / catch
+}//void load_directory_index()
+
+
+void SpecFileQueryDbCache::save_directory_index()
+{
+  if( !m_using_persist_caching )
+    return;
+  
+  const string filename = construct_persisted_db_filename( m_fs_path ) + ".dirindex";
+  const string tmpname = filename + ".tmp";
+  
+  {//begin write to temporary file
+#ifdef _WIN32
+    ofstream output( SpecUtils::convert_from_utf8_to_utf16(tmpname).c_str(), ios_base::binary|ios_base::out );
+#else
+    ofstream output( tmpname.c_str(), ios_base::binary|ios_base::out );
+#endif
+    if( !output.is_open() )
+    {
+      cerr << "SpecFileQueryDbCache: couldnt write directory index '" << tmpname << "'" << endl;
+      return;
+    }
+    
+    output << ns_dir_index_header << "\n"
+           << "C\t" << (m_dir_index_complete[0] ? '1' : '0') << "\t" << (m_dir_index_complete[1] ? '1' : '0') << "\n";
+    
+    for( const auto &dir_entry : m_dir_index )
+    {
+      const string &dir = dir_entry.first;
+      const DirectoryIndexEntry &entry = dir_entry.second;
+      
+      if( dir.find_first_of( "\r\n" ) != string::npos )
+        continue;
+      
+      // If any names cant be written, mark the directory as needing to be listed again
+      bool all_names_ok = true;
+      for( const auto &name_size : entry.m_files )
+        all_names_ok = all_names_ok && (name_size.first.find_first_of( "\r\n" ) == string::npos);
+      for( const string &name : entry.m_subdirs )
+        all_names_ok = all_names_ok && (name.find_first_of( "\r\n" ) == string::npos);
+      
+      output << "D\t" << (all_names_ok ? entry.m_mtime : int64_t(-1)) << "\t" << dir << "\n";
+      if( !all_names_ok )
+        continue;
+      
+      for( const auto &name_size : entry.m_files )
+        output << "F\t" << name_size.second << "\t" << name_size.first << "\n";
+      for( const string &name : entry.m_subdirs )
+        output << "S\t" << name << "\n";
+    }//for( const auto &dir_entry : m_dir_index )
+    
+    if( !output )
+    {
+      output.close();
+      SpecUtils::remove_file( tmpname );
+      return;
+    }
+  }//end write to temporary file
+  
+  if( SpecUtils::is_file( filename ) )
+    SpecUtils::remove_file( filename );
+  
+  if( !SpecUtils::rename_file( tmpname, filename ) )
+  {
+    cerr << "SpecFileQueryDbCache: failed to rename '" << tmpname << "' to '" << filename << "'" << endl;
+    SpecUtils::remove_file( tmpname );
+  }
+}//void save_directory_index()
+
+
+void SpecFileQueryDbCache::build_similarity_index()
+{
+  const size_t dim = SpecFileInfoToQuery::sm_num_spectral_features;
+  
+  std::unique_ptr<SpectralSimilarityIndex> index( new SpectralSimilarityIndex() );
+  
+  // Clear the flag before reading, so files added while we read will trigger a rebuild next time
+  m_similarity_index_stale = false;
+  
+  {//begin lock on m_db_mutex
+    std::lock_guard<std::mutex> lock( m_db_mutex );
+    if( !m_db || !m_db_session )
+      return;
+    
+    typedef boost::tuple<std::string,std::vector<float>> PathAndFeatures;
+    
+    Wt::Dbo::Transaction trans( *m_db_session );
+    Wt::Dbo::collection<PathAndFeatures> results = m_db_session->query<PathAndFeatures>(
+                         "select file_path, spectral_features from SpecFileInfoToQuery" ).resultList();
+    
+    for( auto iter = results.begin(); iter != results.end(); ++iter )
+    {
+      const std::vector<float> &features = iter->get<1>();
+      if( features.size() != dim )
+        continue;
+      
+      index->m_paths.push_back( iter->get<0>() );
+      for( const float f : features )
+        index->m_codes.push_back( static_cast<uint8_t>( std::round( 255.0f * std::min( 1.0f, std::max( 0.0f, f ) ) ) ) );
+    }//for( loop over DB entries )
+    
+    trans.commit();
+  }//end lock on m_db_mutex
+  
+  const size_t nentries = index->m_paths.size();
+  
+  const auto entry_dot = [&index,dim]( const size_t entry, const float *vec ) -> float {
+    const uint8_t *code = &(index->m_codes[entry*dim]);
+    float sum = 0.0f;
+    for( size_t i = 0; i < dim; ++i )
+      sum += code[i] * vec[i];
+    return sum / 255.0f;
+  };//entry_dot
+  
+  const auto nearest_centroid = [&index,&entry_dot,dim]( const size_t entry ) -> size_t {
+    size_t best = 0;
+    float best_dot = -1.0f;
+    const size_t ncentroid = index->m_centroids.size() / dim;
+    for( size_t c = 0; c < ncentroid; ++c )
+    {
+      const float dot = entry_dot( entry, &(index->m_centroids[c*dim]) );
+      if( dot > best_dot )
+      {
+        best_dot = dot;
+        best = c;
+      }
+    }
+    return best;
+  };//nearest_centroid
+  
+  // With few entries a brute-force scan is fast enough; otherwise use ~sqrt(N) clusters, found using
+  //  spherical k-means on a (strided) subset of the entries.
+  const size_t nlist = (nentries < 2048) ? size_t(1)
+                    : std::min( size_t(4096), static_cast<size_t>( std::sqrt( static_cast<double>(nentries) ) ) );
+  
+  index->m_centroids.resize( nlist * dim, 0.0f );
+  if( nlist > 1 )
+  {
+    const size_t ntrain = std::min( nentries, 32*nlist );
+    const size_t stride = nentries / ntrain;
+    
+    for( size_t c = 0; c < nlist; ++c )
+    {
+      const size_t entry = ((c * ntrain) / nlist) * stride;
+      for( size_t i = 0; i < dim; ++i )
+        index->m_centroids[c*dim + i] = index->m_codes[entry*dim + i] / 255.0f;
+    }
+    
+    vector<size_t> assignments( ntrain );
+    for( size_t iteration = 0; iteration < 8; ++iteration )
+    {
+      for( size_t i = 0; i < ntrain; ++i )
+        assignments[i] = nearest_centroid( i*stride );
+      
+      vector<double> sums( nlist * dim, 0.0 );
+      vector<size_t> counts( nlist, 0 );
+      for( size_t i = 0; i < ntrain; ++i )
+      {
+        const size_t c = assignments[i];
+        counts[c] += 1;
+        for( size_t j = 0; j < dim; ++j )
+          sums[c*dim + j] += index->m_codes[i*stride*dim + j];
+      }
+      
+      for( size_t c = 0; c < nlist; ++c )
+      {
+        if( !counts[c] )
+          continue; //Keep previous centroid for empty clusters
+        
+        double norm2 = 0.0;
+        for( size_t j = 0; j < dim; ++j )
+          norm2 += sums[c*dim + j] * sums[c*dim + j];
+        const double norm = std::sqrt( norm2 );
+        for( size_t j = 0; j < dim; ++j )
+          index->m_centroids[c*dim + j] = static_cast<float>( sums[c*dim + j] / norm );
+      }//for( loop over centroids )
+    }//for( k-means iterations )
+  }//if( nlist > 1 )
+  
+  index->m_lists.resize( nlist );
+  for( size_t entry = 0; entry < nentries; ++entry )
+  {
+    const size_t c = (nlist > 1) ? nearest_centroid( entry ) : size_t(0);
+    index->m_lists[c].push_back( static_cast<uint32_t>(entry) );
+  }
+  
+  m_similarity_index = std::move( index );
+}//void build_similarity_index()
 
+
+std::vector<SpecFileQueryDbCache::SimilarFile>
+  SpecFileQueryDbCache::similar_files( const std::vector<float> &features, const size_t max_results )
+{
+  const size_t dim = SpecFileInfoToQuery::sm_num_spectral_features;
+  
+  vector<SimilarFile> answer;
+  if( !m_use_db_caching || (features.size() != dim) || !max_results )
+    return answer;
+  
+  vector<float> query( features );
+  const double norm = std::sqrt( std::inner_product( begin(query), end(query), begin(query), 0.0 ) );
+  if( !(norm > 0.0) )
+    return answer;
+  for( float &f : query )
+    f = static_cast<float>( f / norm );
+  
+  std::lock_guard<std::mutex> lock( m_similarity_mutex );
+  
+  if( !m_similarity_index || m_similarity_index_stale )
+    build_similarity_index();
+  
+  if( !m_similarity_index || m_similarity_index->m_paths.empty() )
+    return answer;
+  
+  const SpectralSimilarityIndex &index = *m_similarity_index;
+  const size_t nlist = index.m_lists.size();
+  
+  // Rank the clusters by their centroids similarity, and scan the closest few percent of them
+  vector<pair<float,size_t>> centroid_scores( nlist );
+  for( size_t c = 0; c < nlist; ++c )
+  {
+    const float *centroid = &(index.m_centroids[c*dim]);
+    centroid_scores[c] = { std::inner_product( centroid, centroid + dim, query.data(), 0.0f ), c };
+  }
+  
+  const size_t nprobe = std::min( nlist, 8 + nlist/32 );
+  std::partial_sort( begin(centroid_scores), begin(centroid_scores) + nprobe, end(centroid_scores),
+                     std::greater<pair<float,size_t>>() );
+  
+  // Min-heap of the best results so far
+  std::priority_queue<pair<float,uint32_t>, vector<pair<float,uint32_t>>, std::greater<pair<float,uint32_t>>> best;
+  
+  for( size_t probe = 0; probe < nprobe; ++probe )
+  {
+    for( const uint32_t entry : index.m_lists[centroid_scores[probe].second] )
+    {
+      const uint8_t *code = &(index.m_codes[static_cast<size_t>(entry)*dim]);
+      float dot = 0.0f;
+      for( size_t i = 0; i < dim; ++i )
+        dot += code[i] * query[i];
+      dot /= 255.0f;
+      
+      if( best.size() < max_results )
+        best.push( { dot, entry } );
+      else if( dot > best.top().first )
+      {
+        best.pop();
+        best.push( { dot, entry } );
+      }
+    }//for( loop over entries in cluster )
+  }//for( loop over probed clusters )
+  
+  answer.resize( best.size() );
+  for( size_t i = answer.size(); i > 0; --i )
+  {
+    answer[i-1].file_path = index.m_paths[best.top().second];
+    answer[i-1].similarity = std::min( 1.0f, best.top().first );
+    best.pop();
+  }
+  
+  return answer;
+}//similar_files(...)
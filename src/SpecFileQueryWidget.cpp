@@ -23,11 +23,15 @@
 
 #include "InterSpec_config.h"
 
+#include <deque>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #include <cerrno>
 #include <limits>
+#include <thread>
 #include <sstream>
+#include <condition_variable>
 
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
@@ -131,6 +135,14 @@ namespace
     return true;
   }
   
+  /** Filename-only version of #maybe_spec_file, for use with SpecFileQueryDbCache::indexed_files, which checks
+   file sizes itself.
+   */
+  bool maybe_spec_filename( const std::string &path )
+  {
+    return !SpecUtils::likely_not_spec_file( path );
+  }
+  
   
   void add_logic( SpecFileQuery::SpecLogicTest &test, const Json::Value &cond, const Json::Array &rules,
                   const std::vector<EventXmlFilterInfo> &eventXmlTests )
@@ -994,6 +1006,115 @@ namespace
       return true;
     }
   };//struct HaveSeenUuid
+  
+  
+  /** A bounded queue of files waiting to be tested during a search.
+   
+   The thread listing files pushes onto the queue, and each testing thread pulls one file at a time,
+   so a thread that gets a large, slow, file doesnt hold up the others.  Both the number of queued
+   files, and the total size of files queued or being tested, are limited, so memory use stays
+   bounded when there are many huge files.
+   */
+  class FileTestQueue
+  {
+  public:
+    FileTestQueue( const size_t max_queued, const uint64_t max_bytes )
+      : m_max_queued( std::max( max_queued, size_t(1) ) ),
+        m_max_bytes( max_bytes ),
+        m_bytes( 0 ),
+        m_in_flight( 0 ),
+        m_finished( false )
+    {
+    }
+    
+    /** Adds a file, blocking while the queue is full, or the byte limit would be exceeded (a file is
+     always accepted if no other files are in-flight).
+     
+     Returns false, without adding the file, if `timeout` elapses first, so the caller can do
+     periodic work, like checking if the search has been canceled.
+     */
+    bool push( const std::string &filename, const uint64_t nbytes, const std::chrono::milliseconds timeout )
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      const bool have_room = m_cv.wait_for( lock, timeout, [&](){
+        return (m_queue.size() < m_max_queued)
+               && (!m_in_flight || ((m_bytes + nbytes) <= m_max_bytes));
+      } );
+      
+      if( !have_room )
+        return false;
+      
+      m_queue.emplace_back( filename, nbytes );
+      m_bytes += nbytes;
+      m_in_flight += 1;
+      lock.unlock();
+      
+      m_cv.notify_all();
+      
+      return true;
+    }//push(...)
+    
+    /** Gets the next file to test, blocking until one is available.
+     Returns false once #finish has been called and the queue is empty.
+     */
+    bool pop( std::string &filename, uint64_t &nbytes )
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      m_cv.wait( lock, [&](){ return m_finished || !m_queue.empty(); } );
+      
+      if( m_queue.empty() )
+        return false;
+      
+      filename = std::move( m_queue.front().first );
+      nbytes = m_queue.front().second;
+      m_queue.pop_front();
+      lock.unlock();
+      
+      m_cv.notify_all();
+      
+      return true;
+    }//pop(...)
+    
+    /** Must be called once a file returned by #pop is done being tested. */
+    void release( const uint64_t nbytes )
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        assert( m_in_flight && (m_bytes >= nbytes) );
+        m_bytes -= nbytes;
+        m_in_flight -= 1;
+      }
+      m_cv.notify_all();
+    }//release(...)
+    
+    /** Signals no more files will be pushed. */
+    void finish()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_finished = true;
+      }
+      m_cv.notify_all();
+    }//finish()
+    
+    /** Waits up to `timeout` for all pushed files to be released; returns true if they have been. */
+    bool wait_until_idle( const std::chrono::milliseconds timeout )
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      return m_cv.wait_for( lock, timeout, [&](){ return (m_in_flight == 0); } );
+    }//wait_until_idle(...)
+    
+  protected:
+    const size_t m_max_queued;
+    const uint64_t m_max_bytes;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::pair<std::string,uint64_t>> m_queue;
+    uint64_t m_bytes;
+    size_t m_in_flight;
+    bool m_finished;
+  };//class FileTestQueue
 }//namespace
 
 
@@ -2271,7 +2392,39 @@ void SpecFileQueryWidget::updateNumberFiles( const string srcdir,
 
   try
   {
-
+    if( database )
+    {
+      // Use the directory index so only directories that have changed since the last time get listed
+      double updatetime = SpecUtils::get_wall_time();
+      const std::function<void(size_t)> progress = [&]( const size_t nfiles ){
+        const double nowtime = SpecUtils::get_wall_time();
+        if( ((nowtime - updatetime) > 1.0) && !(*widgetdeleted) )
+        {
+          updatetime = nowtime;
+          WServer::instance()->post( sessionid, boost::bind( &SpecFileQueryWidget::updateNumberFilesInGui,
+            nfiles, false, srcdir, recursive, extfilter, querywidget, widgetdeleted ) );
+        }
+      };//progress lambda
+      
+      files = database->indexed_files( recursive, maxsize, (extfilter ? &maybe_spec_filename : nullptr),
+                                       progress, widgetdeleted.get() );
+      
+      if( *widgetdeleted )
+        return;
+      
+      WServer::instance()->post( sessionid, boost::bind( &SpecFileQueryWidget::updateNumberFilesInGui,
+        files.size(), true, srcdir, recursive, extfilter, querywidget, widgetdeleted ) );
+      
+      if( database->caching_enabled() )
+      {
+        if( files.size() > 100000 )
+          files.resize( 100000 );
+        database->cache_results( std::move(files) );
+      }
+      
+      return;
+    }//if( database )
+    
 #if( USE_DIRECTORY_ITERATOR_METHOD )
     double updatetime = SpecUtils::get_wall_time();
     const bool docache = (database && database->caching_enabled());
@@ -2671,12 +2824,27 @@ void testfile( const string &filename, vector<string> &result,
                const SpecFileQuery::SpecLogicTest &query,
                HaveSeenUuid &uniquecheck,
                std::shared_ptr< SpecFileQueryDbCache > database,
-               const string &base_search_dir )
+               const string &base_search_dir,
+               const std::unordered_map<long long,SpecFileQueryDbCache::SqlRejectedFile> &sql_rejected )
 {
   try
   {
     result.clear();
     
+    // If the database already told us this file fails the query, we can avoid loading it from the
+    //  database, as long as the file hasnt changed since it was cached.
+    if( !sql_rejected.empty() )
+    {
+      const auto pos = sql_rejected.find( SpecFileQueryDbCache::file_path_hash(filename) );
+      if( (pos != end(sql_rejected))
+         && (pos->second.file_size == static_cast<long long>( SpecUtils::file_size(filename) )) )
+      {
+        if( pos->second.is_spectrum_file )
+          uniquecheck.have_seen( pos->second.uuid );
+        return;
+      }
+    }//if( !sql_rejected.empty() )
+    
     std::unique_ptr<SpecFileInfoToQuery> db_test_info = database->spec_file_info( filename );
     
     if( !db_test_info || !db_test_info->is_spectrum_file /*&& !db_test_info.is_event_xml_file*/ )
@@ -2756,6 +2924,11 @@ void SpecFileQueryWidget::doSearch( const std::string basedir,
   if( database )
     database->stop_caching();
   
+  // Let the database reject the files it can, based on the parts of the query that can be done in SQL
+  std::unordered_map<long long,SpecFileQueryDbCache::SqlRejectedFile> sql_rejected;
+  if( database && !stopUpdate->load() )
+    sql_rejected = database->sql_rejected_files( query );
+  
   size_t num_files_pass = 0;
   
   try
@@ -2770,191 +2943,231 @@ void SpecFileQueryWidget::doSearch( const std::string basedir,
     SpecUtils::file_match_function_t filterfcn = extfilter ? &maybe_spec_file : &file_smaller_than;
     
     
-#if( USE_DIRECTORY_ITERATOR_METHOD )
-    if( stopUpdate->load() )
-      throw std::runtime_error( "" );
+    vector<string> files;
+    bool have_files = false;
     
-    WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
-                                                      this, 0, 0, "", result, widgetDeleted ) );
-#else
-    ls_fcn_t lsfcn = &SpecUtils::recursive_ls;
-    if( !recursive )
-      lsfcn = &SpecUtils::ls_files_in_directory;
+    // If we have already listed this directory, only the directories that have changed need to be listed again
+    if( database && database->has_directory_index( recursive ) )
+    {
+      files = database->indexed_files( recursive, maxsize, (extfilter ? &maybe_spec_filename : nullptr),
+                                       nullptr, stopUpdate.get() );
+      have_files = true;
+    }
+    
+#if( !USE_DIRECTORY_ITERATOR_METHOD )
+    if( !have_files )
+    {
+      ls_fcn_t lsfcn = &SpecUtils::recursive_ls;
+      if( !recursive )
+        lsfcn = &SpecUtils::ls_files_in_directory;
+      
+      files = lsfcn( basedir, filterfcn, (void *)&maxsize );
+      have_files = true;
+    }
+#endif //!USE_DIRECTORY_ITERATOR_METHOD
     
-    const vector<string> files = lsfcn( basedir, filterfcn, (void *)&maxsize );
     const int nfiles = static_cast<int>( files.size() );
     
-    description << "There were " << nfiles << " candidate files after pre-filtering\r\n";
+    if( have_files )
+      description << "There were " << nfiles << " candidate files after pre-filtering\r\n";
     
     if( stopUpdate->load() )
       throw std::runtime_error( "" );
     
     WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
                                                       this, nfiles, 0, "", result, widgetDeleted ) );
-#endif //USE_DIRECTORY_ITERATOR_METHOD
-    
-    int nupdates_sent = 0;
-    double lastupdate = SpecUtils::get_wall_time();
     
-    //We could choose something like 100 for nfile_at_a_time with the only
-    //  downsides being N42 files would parse any faster due to not enough
-    //  threads being available, and also the fact that when parsing multiple
-    //  file, hard drive bandwidth is probably the main limiting factor.
+    // Files are tested by a fixed number of threads that each pull the next file from a bounded
+    //  queue as soon as they are done with their previous one, while this thread lists files and
+    //  streams results to the GUI; this keeps all the cores busy even though file sizes, and so
+    //  parse times, vary enormously.
     //
     // Note: the penalty of multiple seeks is ridiculous on spinning drives
     //  so I think the better solution would be to have SpecFileInfoToQuery::fill_info_from_file
     //  read files into a std::stringstream (in memory), and then try to parse from there.  This
     //  would really reduce the number of accesses, and speed things up.
-    const int nfile_at_a_time = SpecUtilsAsync::num_physical_cpu_cores();
+    const size_t nthreads = static_cast<size_t>( std::max( SpecUtilsAsync::num_physical_cpu_cores(), 1 ) );
     
-    SpecUtilsAsync::ThreadPool pool;
+    // Limit the total size of files queued, or being parsed, to keep memory bounded
+    const uint64_t max_bytes_in_flight = 256ull*1024*1024;
+    FileTestQueue queue( 4*nthreads, max_bytes_in_flight );
     
-#if( USE_DIRECTORY_ITERATOR_METHOD )
-    size_t ncheckssubmitted = 0;
     std::mutex result_mutex;
+    std::atomic<size_t> nfiles_tested( 0 );
+    size_t nfiles_submitted = 0;
+    
+    int nupdates_sent = 0;
+    double lastupdate = SpecUtils::get_wall_time();
+    
+    // Posts the results found so far to the GUI, at most once a second
+    auto post_update = [&](){
+      const double now = SpecUtils::get_wall_time();
+      if( nupdates_sent && (now < (lastupdate + 1.0)) )
+        return;
+      
+      ++nupdates_sent;
+      lastupdate = now;
+      
+      std::lock_guard<std::mutex> lock( result_mutex );
+      num_files_pass += result->size();
+      WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
+                                                        this, nfiles, nfiles_tested.load(), "", result, widgetDeleted ) );
+      result = std::make_shared< vector<vector<string> > >();
+    };//post_update lambda
+    
+    auto submit = [&]( const string &filename ){
+      const uint64_t nbytes = SpecUtils::file_size( filename );
+      while( !queue.push( filename, nbytes, std::chrono::milliseconds(250) ) )
+      {
+        if( stopUpdate->load() )
+          throw runtime_error("");
+        post_update();
+      }
+      
+      ++nfiles_submitted;
+      post_update();
+    };//submit lambda
+    
+    auto worker = [&](){
+      string filename;
+      uint64_t nbytes = 0;
+      while( queue.pop( filename, nbytes ) )
+      {
+        if( !stopUpdate->load() )
+        {
+          vector<string> testres;
+          testfile( filename, testres, query, uniqueCheck, database, basedir, sql_rejected );
+          
+          if( !testres.empty() )
+          {
+            std::lock_guard<std::mutex> lock( result_mutex );
+            result->push_back( std::move(testres) );
+          }
+        }//if( !stopUpdate->load() )
+        
+        ++nfiles_tested;
+        queue.release( nbytes );
+      }//while( queue.pop( filename, nbytes ) )
+    };//worker lambda
+    
+    // The workers block waiting on the queue, so we use dedicated threads, rather than tying up
+    //  threads of a SpecUtilsAsync::ThreadPool, which parsing files may use.
+    vector<std::thread> workers;
+    for( size_t i = 0; i < nthreads; ++i )
+      workers.emplace_back( worker );
+    
+    auto stop_workers = [&](){
+      queue.finish();
+      for( std::thread &t : workers )
+        t.join();
+      workers.clear();
+    };//stop_workers lambda
     
+    try
+    {
+#if( USE_DIRECTORY_ITERATOR_METHOD )
+      if( !have_files )
+      {
 #ifdef _WIN32
-    const std::wstring wbasedir = SpecUtils::convert_from_utf8_to_utf16( basedir );
-    boost::filesystem::recursive_directory_iterator diriter( wbasedir, boost::filesystem::symlink_option::recurse );
+        const std::wstring wbasedir = SpecUtils::convert_from_utf8_to_utf16( basedir );
+        boost::filesystem::recursive_directory_iterator diriter( wbasedir, boost::filesystem::symlink_option::recurse );
 #else
 #if BOOST_VERSION >= 108400 && BOOST_FILESYSTEM_VERSION >= 3
-    boost::filesystem::recursive_directory_iterator diriter( basedir, boost::filesystem::directory_options::follow_directory_symlink );
+        boost::filesystem::recursive_directory_iterator diriter( basedir, boost::filesystem::directory_options::follow_directory_symlink );
 #else
-    boost::filesystem::recursive_directory_iterator diriter( basedir, boost::filesystem::symlink_option::recurse );
+        boost::filesystem::recursive_directory_iterator diriter( basedir, boost::filesystem::symlink_option::recurse );
 #endif
 #endif
-    const boost::filesystem::recursive_directory_iterator dirend;
-    
-    while( diriter != dirend )
-    {
-      if( stopUpdate->load() )
-        throw runtime_error("");
-      
+        const boost::filesystem::recursive_directory_iterator dirend;
+        
+        while( diriter != dirend )
+        {
+          if( stopUpdate->load() )
+            throw runtime_error("");
+          
 #ifdef _WIN32
-      const wstring wfilename = diriter->path().string<std::wstring>();
-      const std::string filename = SpecUtils::convert_from_utf16_to_utf8( wfilename );
+          const wstring wfilename = diriter->path().string<std::wstring>();
+          const std::string filename = SpecUtils::convert_from_utf16_to_utf8( wfilename );
 #else
-      string filename = diriter->path().string<std::string>();
+          string filename = diriter->path().string<std::string>();
 #endif
-
-      const bool is_dir = boost::filesystem::is_directory( diriter.status() ); //folows symlinks to see if target of symlink is a directory
-      bool is_file = (diriter.status().type() == boost::filesystem::file_type::regular_file);  //folows symlinks
-     
-      if( !recursive && is_dir )
-      {
-        is_file = false; //JIC
+          
+          const bool is_dir = boost::filesystem::is_directory( diriter.status() ); //folows symlinks to see if target of symlink is a directory
+          bool is_file = (diriter.status().type() == boost::filesystem::file_type::regular_file);  //folows symlinks
+          
+          if( !recursive && is_dir )
+          {
+            is_file = false; //JIC
 #if BOOST_VERSION >= 108400 && BOOST_FILESYSTEM_VERSION >= 3
-        diriter.disable_recursion_pending();
+            diriter.disable_recursion_pending();
 #else
-        diriter.no_push();  //Dont recurse down into directories if we arent doing a recursive search
+            diriter.no_push();  //Dont recurse down into directories if we arent doing a recursive search
 #endif
-      }
-      
-      bool is_simlink_dir = false;
-      if( is_dir && recursive )
-      {
-        //If this is a directory, check if we are actually on a symlink to a
-        //  directory, because if so, we need to check for cyclical links.
-        boost::system::error_code symec;
-        const auto symstat = boost::filesystem::symlink_status( diriter->path(), symec );
-        is_simlink_dir = (!symec && (symstat.type()==boost::filesystem::file_type::symlink_file));
-      }
-      
-      if( is_simlink_dir )
-      {
-        auto resvedpath = boost::filesystem::read_symlink( diriter->path() );
-        if( resvedpath.is_relative() )
-          resvedpath = diriter->path().parent_path() / resvedpath;
-        resvedpath = boost::filesystem::canonical( resvedpath );
-        auto pcanon = boost::filesystem::canonical( diriter->path().parent_path() );
-        if( SpecUtils::starts_with( pcanon.string<string>(), resvedpath.string<string>().c_str() ) )
-        {
+          }
+          
+          bool is_simlink_dir = false;
+          if( is_dir && recursive )
+          {
+            //If this is a directory, check if we are actually on a symlink to a
+            //  directory, because if so, we need to check for cyclical links.
+            boost::system::error_code symec;
+            const auto symstat = boost::filesystem::symlink_status( diriter->path(), symec );
+            is_simlink_dir = (!symec && (symstat.type()==boost::filesystem::file_type::symlink_file));
+          }
+          
+          if( is_simlink_dir )
+          {
+            auto resvedpath = boost::filesystem::read_symlink( diriter->path() );
+            if( resvedpath.is_relative() )
+              resvedpath = diriter->path().parent_path() / resvedpath;
+            resvedpath = boost::filesystem::canonical( resvedpath );
+            auto pcanon = boost::filesystem::canonical( diriter->path().parent_path() );
+            if( SpecUtils::starts_with( pcanon.string<string>(), resvedpath.string<string>().c_str() ) )
+            {
 #if BOOST_VERSION >= 108400 && BOOST_FILESYSTEM_VERSION >= 3
-          diriter.disable_recursion_pending();
+              diriter.disable_recursion_pending();
 #else
-          diriter.no_push();  //Dont recurse down into directories
+              diriter.no_push();  //Dont recurse down into directories
 #endif
-        }
-      }//if( is_simlink_dir && recursive )
-      
-      
-      if( is_file && filterfcn( filename, (void *)&maxsize ) )
-      {
-        if( (ncheckssubmitted % nfile_at_a_time) == 0 )
-        {
-          pool.join();
+            }
+          }//if( is_simlink_dir && recursive )
           
-          const double now = SpecUtils::get_wall_time();
-          if( now > (lastupdate + 1.0) || !nupdates_sent )
-          {
-            ++nupdates_sent;
-            num_files_pass += result->size();
-            
-            std::unique_lock<std::mutex> lock( result_mutex );
-            WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
-                                                              this, 0, ncheckssubmitted, "", result, widgetDeleted ) );
-            result = std::make_shared< vector<vector<string> > >();
-            lastupdate = now;
-          }
-        }
-        
-        pool.post( [filename,&query,&uniqueCheck,&database,&basedir,&result,&result_mutex](){
-          vector<string> testres;
-          testfile( filename, testres, query, uniqueCheck, database, basedir );
-          if( !testres.empty() )
+          if( is_file && filterfcn( filename, (void *)&maxsize ) )
+            submit( filename );
+          
+          boost::system::error_code ec;
+          diriter.increment(ec);
+          while( ec && (diriter!=dirend) )
           {
-            std::unique_lock<std::mutex> lock( result_mutex );
-            result->push_back( testres );
+            std::cerr << "Error While Accessing : " << diriter->path().string() << " :: " << ec.message() << '\n';
+            diriter.increment(ec);
           }
-        } );
-        
-        ++ncheckssubmitted;
-      }//if( this is a potential file we should check on )
+        }//while( diriter != dirend )
+      }//if( !have_files )
+#endif //USE_DIRECTORY_ITERATOR_METHOD
       
-      boost::system::error_code ec;
-      diriter.increment(ec);
-      while( ec && (diriter!=dirend) )
+      for( size_t i = 0; i < files.size(); ++i )
       {
-        std::cerr << "Error While Accessing : " << diriter->path().string() << " :: " << ec.message() << '\n';
-        diriter.increment(ec);
-      }
-    }//while( diriter != dirend )
-    
-    pool.join();
-    
-#else
-    
-    for( int i = 0; i < nfiles; i += nfile_at_a_time )
-    {
-      if( stopUpdate->load() )
-        throw runtime_error("");
-      
-      const int nfilethisone = std::min( nfiles-i, nfile_at_a_time );
-      
-      vector< vector<string> > testres( nfilethisone );
-      
-      for( int j = 0; j < nfilethisone; ++j )
-        pool.post( boost::bind( &testfile, boost::cref(files[i+j]), boost::ref(testres[j]),
-                                boost::cref(query), boost::ref(uniqueCheck), database,
-                                boost::cref(basedir) ) );
-      pool.join();
-      
-      for( int j = 0; j < nfilethisone; ++j )
-        if( testres[j].size() )
-          result->push_back( testres[j] );
+        if( stopUpdate->load() )
+          throw runtime_error("");
+        
+        submit( files[i] );
+      }//for( size_t i = 0; i < files.size(); ++i )
       
-      const double now = SpecUtils::get_wall_time();
-      if( now > (lastupdate + 2.0) || !nupdates_sent )
+      // Keep streaming results to the GUI while the last files get tested
+      while( !queue.wait_until_idle( std::chrono::milliseconds(250) ) )
       {
-        ++nupdates_sent;
-        num_files_pass += result->size();
-        WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
-                                                          this, nfiles, i+nfilethisone, "", result, widgetDeleted ) );
-        result = std::make_shared< vector<vector<string> > >();
-        lastupdate = now;
+        if( stopUpdate->load() )
+          throw runtime_error("");
+        post_update();
       }
-    }//for( size_t i = 0; i < nfiles; ++i  )
-#endif //USE_DIRECTORY_ITERATOR_METHOD
+    }catch( ... )
+    {
+      stop_workers();
+      throw;
+    }//try / catch
+    
+    stop_workers();
   }catch( ... )
   {
     const double total_clock_time = (SpecUtils::get_wall_time() - starttime);
@@ -23,8 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <limits>
 #include <cfloat>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
@@ -38,6 +42,7 @@
 #include <Wt/WTable>
 #include <Wt/WServer>
 #include <Wt/WLineEdit>
+#include <Wt/WTableView>
 #include <Wt/WTextArea>
 #include <Wt/WComboBox>
 #include <Wt/WGroupBox>
@@ -49,11 +54,13 @@
 #include <Wt/WIntValidator>
 #include <Wt/WSelectionBox>
 #include <Wt/WContainerWidget>
+#include <Wt/WAbstractTableModel>
 
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/PopupDiv.h"
 #include "SpecUtils/DateTime.h"
 #include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
 #include "InterSpec/AuxWindow.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/InterSpecApp.h"
@@ -167,6 +174,347 @@ namespace
 }//namespace
 
 
+/** Table model over the records (SpecUtils::Measurement objects) of a SpecMeas.
+
+ The model only holds a vector of indices into SpecMeas::measurements(), ordered and filtered per
+ the users sort column and filter text; the WTableView showing it only requests the rows currently
+ scrolled into view, so even files with tens of thousands of records stay responsive.
+ */
+class SpecFileRecordModel : public Wt::WAbstractTableModel
+{
+public:
+  enum Column
+  {
+    RecordColumn,
+    SampleNumColumn,
+    DetectorColumn,
+    SourceTypeColumn,
+    StartTimeColumn,
+    LiveTimeColumn,
+    RealTimeColumn,
+    GammaCpsColumn,
+    NeutronCpsColumn,
+    TitleColumn,
+    NumColumns
+  };//enum Column
+  
+  SpecFileRecordModel( Wt::WObject *parent )
+   : WAbstractTableModel( parent ),
+     m_meas(),
+     m_filter(),
+     m_rows(),
+     m_recordRows(),
+     m_sortColumn( RecordColumn ),
+     m_sortOrder( Wt::AscendingOrder )
+  {
+  }
+  
+  void setMeasurement( const std::shared_ptr<const SpecMeas> &meas )
+  {
+    m_meas = meas;
+    updateRows();
+    reset();
+  }//void setMeasurement(...)
+  
+  void setFilter( std::string filter )
+  {
+    SpecUtils::trim( filter );
+    if( filter == m_filter )
+      return;
+    
+    m_filter = filter;
+    updateRows();
+    reset();
+  }//void setFilter( std::string filter )
+  
+  /** Returns the index into SpecMeas::measurements() displayed at the given row.
+   
+   Throws std::out_of_range if row is invalid.
+   */
+  size_t recordIndex( const int row ) const
+  {
+    if( row < 0 || static_cast<size_t>(row) >= m_rows.size() )
+      throw std::out_of_range( "Invalid record row" );
+    return m_rows[row];
+  }
+  
+  /** Returns the row the record (index into SpecMeas::measurements()) is displayed at, or -1 if
+   the record is filtered out.
+   */
+  int recordRow( const size_t record ) const
+  {
+    return (record < m_recordRows.size()) ? m_recordRows[record] : -1;
+  }
+  
+  /** Lets the view know record values may have been edited. */
+  void refreshData()
+  {
+    if( !m_rows.empty() )
+      dataChanged().emit( index(0,0), index(rowCount()-1, NumColumns-1) );
+  }
+  
+  virtual int rowCount( const Wt::WModelIndex &parent = Wt::WModelIndex() ) const
+  {
+    return parent.isValid() ? 0 : static_cast<int>( m_rows.size() );
+  }
+  
+  virtual int columnCount( const Wt::WModelIndex &parent = Wt::WModelIndex() ) const
+  {
+    return parent.isValid() ? 0 : static_cast<int>( NumColumns );
+  }
+  
+  virtual boost::any data( const Wt::WModelIndex &index, int role = Wt::DisplayRole ) const
+  {
+    const int row = index.row();
+    if( role != Wt::DisplayRole || !m_meas || row < 0 || static_cast<size_t>(row) >= m_rows.size() )
+      return boost::any();
+    
+    const vector<shared_ptr<const SpecUtils::Measurement>> &measurements = m_meas->measurements();
+    if( m_rows[row] >= measurements.size() || !measurements[m_rows[row]] )
+      return boost::any();
+    
+    const SpecUtils::Measurement &m = *measurements[m_rows[row]];
+    
+    char buffer[64];
+    switch( Column(index.column()) )
+    {
+      case RecordColumn:
+        return boost::any( static_cast<int>(m_rows[row] + 1) );
+        
+      case SampleNumColumn:
+        return boost::any( m.sample_number() );
+        
+      case DetectorColumn:
+        return boost::any( WString::fromUTF8(m.detector_name()) );
+        
+      case SourceTypeColumn:
+        return boost::any( sourceTypeStr(m.source_type()) );
+        
+      case StartTimeColumn:
+        if( SpecUtils::is_special(m.start_time()) )
+          return boost::any();
+        return boost::any( WString::fromUTF8(SpecUtils::to_extended_iso_string(m.start_time())) );
+        
+      case LiveTimeColumn:
+        snprintf( buffer, sizeof(buffer), "%.2f s", m.live_time() / PhysicalUnits::second );
+        return boost::any( WString::fromUTF8(buffer) );
+        
+      case RealTimeColumn:
+        snprintf( buffer, sizeof(buffer), "%.2f s", m.real_time() / PhysicalUnits::second );
+        return boost::any( WString::fromUTF8(buffer) );
+        
+      case GammaCpsColumn:
+      {
+        const double cps = gammaCps( m );
+        if( cps < -FLT_EPSILON )
+          return boost::any( WString::fromUTF8("--") );
+        snprintf( buffer, sizeof(buffer), "%.3f", cps );
+        return boost::any( WString::fromUTF8(buffer) );
+      }
+        
+      case NeutronCpsColumn:
+      {
+        if( !m.contained_neutron() )
+          return boost::any( WString::fromUTF8("N/A") );
+        const double cps = neutronCps( m );
+        if( cps < -FLT_EPSILON )
+          return boost::any( WString::fromUTF8("--") );
+        snprintf( buffer, sizeof(buffer), "%.3f", cps );
+        return boost::any( WString::fromUTF8(buffer) );
+      }
+        
+      case TitleColumn:
+        return boost::any( WString::fromUTF8(m.title()) );
+        
+      case NumColumns:
+        break;
+    }//switch( Column(index.column()) )
+    
+    return boost::any();
+  }//data(...)
+  
+  virtual boost::any headerData( int section, Wt::Orientation orientation = Wt::Horizontal,
+                                 int role = Wt::DisplayRole ) const
+  {
+    if( orientation != Wt::Horizontal || role != Wt::DisplayRole )
+      return boost::any();
+    
+    switch( Column(section) )
+    {
+      case RecordColumn:     return boost::any( WString::tr("sfs-rec-col-record") );
+      case SampleNumColumn:  return boost::any( WString::tr("sfs-rec-col-sample") );
+      case DetectorColumn:   return boost::any( WString::tr("sfs-rec-col-detector") );
+      case SourceTypeColumn: return boost::any( WString::tr("sfs-rec-col-source-type") );
+      case StartTimeColumn:  return boost::any( WString::tr("sfs-rec-col-start-time") );
+      case LiveTimeColumn:   return boost::any( WString::tr("sfs-rec-col-live-time") );
+      case RealTimeColumn:   return boost::any( WString::tr("sfs-rec-col-real-time") );
+      case GammaCpsColumn:   return boost::any( WString::tr("sfs-rec-col-gamma-cps") );
+      case NeutronCpsColumn: return boost::any( WString::tr("sfs-rec-col-neutron-cps") );
+      case TitleColumn:      return boost::any( WString::tr("sfs-rec-col-title") );
+      case NumColumns:       break;
+    }//switch( Column(section) )
+    
+    return boost::any();
+  }//headerData(...)
+  
+  virtual void sort( int column, Wt::SortOrder order = Wt::AscendingOrder )
+  {
+    m_sortColumn = Column( std::max( 0, std::min(column, static_cast<int>(NumColumns) - 1) ) );
+    m_sortOrder = order;
+    
+    layoutAboutToBeChanged().emit();
+    sortRows();
+    layoutChanged().emit();
+  }//void sort(...)
+  
+protected:
+  static double gammaCps( const SpecUtils::Measurement &m )
+  {
+    const double live_time = m.live_time() / PhysicalUnits::second;
+    return (live_time > FLT_EPSILON) ? m.gamma_count_sum() / live_time : -1.0;
+  }
+  
+  static double neutronCps( const SpecUtils::Measurement &m )
+  {
+    const double real_time = m.real_time() / PhysicalUnits::second;
+    if( !m.contained_neutron() )
+      return -2.0;
+    return (real_time > FLT_EPSILON) ? m.neutron_counts_sum() / real_time : -1.0;
+  }
+  
+  static WString sourceTypeStr( const SpecUtils::SourceType type )
+  {
+    switch( type )
+    {
+      case SpecUtils::SourceType::IntrinsicActivity: return WString::tr("intrinsic-activity");
+      case SpecUtils::SourceType::Calibration:       return WString::tr("Calibration");
+      case SpecUtils::SourceType::Background:        return WString::tr("Background");
+      case SpecUtils::SourceType::Foreground:        return WString::tr("Foreground");
+      case SpecUtils::SourceType::Unknown:           break;
+    }//switch( type )
+    
+    return WString::tr("Unknown");
+  }//sourceTypeStr(...)
+  
+  /** Rebuilds #m_rows from the current SpecMeas and filter, then sorts it. */
+  void updateRows()
+  {
+    m_rows.clear();
+    
+    const size_t nmeas = m_meas ? m_meas->measurements().size() : size_t(0);
+    m_rows.reserve( nmeas );
+    
+    if( m_filter.empty() )
+    {
+      for( size_t i = 0; i < nmeas; ++i )
+        m_rows.push_back( i );
+    }else
+    {
+      const vector<shared_ptr<const SpecUtils::Measurement>> &measurements = m_meas->measurements();
+      
+      // A purely numeric filter matches sample numbers exactly, as well as any text fields.
+      int filter_sample = std::numeric_limits<int>::min();
+      if( std::all_of( begin(m_filter), end(m_filter), []( char c ){ return isdigit(c) || c == '-'; } ) )
+      {
+        try
+        {
+          filter_sample = std::stoi( m_filter );
+        }catch( std::exception & )
+        {
+        }
+      }//if( filter looks like a number )
+      
+      //Translating the source type for every record would be slow, so cache them
+      std::map<SpecUtils::SourceType,std::string> source_type_strs;
+      for( size_t i = 0; i < nmeas; ++i )
+      {
+        const shared_ptr<const SpecUtils::Measurement> &m = measurements[i];
+        if( !m )
+          continue;
+        
+        auto type_pos = source_type_strs.find( m->source_type() );
+        if( type_pos == end(source_type_strs) )
+          type_pos = source_type_strs.insert( {m->source_type(), sourceTypeStr(m->source_type()).toUTF8()} ).first;
+        
+        if( (m->sample_number() == filter_sample)
+           || boost::algorithm::icontains( m->detector_name(), m_filter )
+           || boost::algorithm::icontains( m->title(), m_filter )
+           || boost::algorithm::icontains( type_pos->second, m_filter ) )
+        {
+          m_rows.push_back( i );
+        }
+      }//for( size_t i = 0; i < nmeas; ++i )
+    }//if( m_filter.empty() ) / else
+    
+    sortRows();
+  }//void updateRows()
+  
+  /** Sorts #m_rows by the current sort column, and updates #m_recordRows to match. */
+  void sortRows()
+  {
+    const size_t nmeas = m_meas ? m_meas->measurements().size() : size_t(0);
+    
+    if( m_meas && ((m_sortColumn != RecordColumn) || (m_sortOrder != Wt::AscendingOrder)) )
+    {
+      const vector<shared_ptr<const SpecUtils::Measurement>> &meas = m_meas->measurements();
+      const Column col = m_sortColumn;
+      
+      auto less_than = [&meas,col]( const size_t lhs_index, const size_t rhs_index ) -> bool {
+        const SpecUtils::Measurement &lhs = *meas[lhs_index];
+        const SpecUtils::Measurement &rhs = *meas[rhs_index];
+        
+        switch( col )
+        {
+          case RecordColumn:     return lhs_index < rhs_index;
+          case SampleNumColumn:  return lhs.sample_number() < rhs.sample_number();
+          case DetectorColumn:   return lhs.detector_name() < rhs.detector_name();
+          case SourceTypeColumn: return static_cast<int>(lhs.source_type()) < static_cast<int>(rhs.source_type());
+          case StartTimeColumn:  return lhs.start_time() < rhs.start_time();
+          case LiveTimeColumn:   return lhs.live_time() < rhs.live_time();
+          case RealTimeColumn:   return lhs.real_time() < rhs.real_time();
+          case GammaCpsColumn:   return gammaCps(lhs) < gammaCps(rhs);
+          case NeutronCpsColumn: return neutronCps(lhs) < neutronCps(rhs);
+          case TitleColumn:      return lhs.title() < rhs.title();
+          case NumColumns:       break;
+        }//switch( col )
+        
+        return lhs_index < rhs_index;
+      };//less_than
+      
+      if( m_sortOrder == Wt::AscendingOrder )
+        std::stable_sort( begin(m_rows), end(m_rows), less_than );
+      else
+        std::stable_sort( begin(m_rows), end(m_rows), [&less_than]( size_t lhs, size_t rhs ){
+          return less_than( rhs, lhs );
+        } );
+    }else
+    {
+      std::sort( begin(m_rows), end(m_rows) );
+    }//if( need to sort ) / else
+    
+    m_recordRows.assign( nmeas, -1 );
+    for( size_t row = 0; row < m_rows.size(); ++row )
+      m_recordRows[m_rows[row]] = static_cast<int>( row );
+  }//void sortRows()
+  
+protected:
+  std::shared_ptr<const SpecMeas> m_meas;
+  
+  /** Trimmed, user-entered filter text; empty to show all records. */
+  std::string m_filter;
+  
+  /** Indices into SpecMeas::measurements(), in displayed order. */
+  std::vector<size_t> m_rows;
+  
+  /** Inverse of #m_rows: the displayed row of each record, or -1 if filtered out. */
+  std::vector<int> m_recordRows;
+  
+  Column m_sortColumn;
+  Wt::SortOrder m_sortOrder;
+};//class SpecFileRecordModel
+
+
+
 SpecFileSummary::SpecFileSummary( InterSpec *specViewer )
   : AuxWindow( WString::tr("window-title-file-parameters"), AuxWindowProperties::IsModal ),
     m_specViewer( specViewer ),
@@ -178,6 +526,10 @@ SpecFileSummary::SpecFileSummary( InterSpec *specViewer )
     m_nextSampleNumButton( NULL ),
     m_prevSampleNumButton( NULL ),
     m_displaySampleNumValidator( NULL ),
+    m_recordsDiv( NULL ),
+    m_recordFilter( NULL ),
+    m_recordTable( NULL ),
+    m_recordModel( NULL ),
     m_gammaCPS( NULL ),
     m_gammaSum( NULL ),
     m_neutronCPS( NULL ),
@@ -461,8 +813,49 @@ void SpecFileSummary::init()
   
   measTable->addWidget( m_displaySampleDiv, measTable->rowCount(), 0, 1, measTable->columnCount(), AlignBottom );
   
+  m_recordsDiv = new WGroupBox( WString::tr("sfs-records-title") );
+  m_recordsDiv->addStyleClass( "SpecFileRecords" );
+  WGridLayout *recordsLayout = new WGridLayout();
+  recordsLayout->setContentsMargins( 0, 0, 0, 0 );
+  m_recordsDiv->setLayout( recordsLayout );
+  overallLayout->addWidget( m_recordsDiv, 3, 0 );
+  
+  m_recordFilter = new WLineEdit();
+  m_recordFilter->setEmptyText( WString::tr("sfs-records-filter-empty-text") );
+  m_recordFilter->setAutoComplete( false );
+  m_recordFilter->textInput().connect( this, &SpecFileSummary::handleRecordFilterChanged );
+  recordsLayout->addWidget( m_recordFilter, 0, 0 );
+  
+  //The WTableView only asks the model for the rows currently scrolled into view, so this is cheap
+  //  even for search-mode or portal files with tens of thousands of records.
+  m_recordModel = new SpecFileRecordModel( this );
+  m_recordTable = new WTableView();
+  m_recordTable->setModel( m_recordModel );
+  m_recordTable->setSortingEnabled( true );
+  m_recordTable->setAlternatingRowColors( true );
+  m_recordTable->setSelectionMode( Wt::SingleSelection );
+  m_recordTable->setSelectionBehavior( Wt::SelectRows );
+  m_recordTable->setColumnResizeEnabled( true );
+  m_recordTable->setRowHeight( 22 );
+  m_recordTable->setHeaderHeight( 22 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::RecordColumn, 60 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::SampleNumColumn, 60 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::DetectorColumn, 90 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::SourceTypeColumn, 90 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::StartTimeColumn, 170 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::LiveTimeColumn, 80 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::RealTimeColumn, 80 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::GammaCpsColumn, 90 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::NeutronCpsColumn, 90 );
+  m_recordTable->setColumnWidth( SpecFileRecordModel::TitleColumn, 200 );
+  m_recordTable->selectionChanged().connect( this, &SpecFileSummary::handleRecordTableSelection );
+  recordsLayout->addWidget( m_recordTable, 1, 0 );
+  recordsLayout->setRowStretch( 1, 1 );
+  m_recordsDiv->setMinimumSize( WLength::Auto, 175 );
+  
   overallLayout->setRowStretch( 1, 1 );
   overallLayout->setRowStretch( 2, 1 );
+  overallLayout->setRowStretch( 3, 1 );
 
   m_specViewer->displayedSpectrumChanged().connect( boost::bind(
                 &SpecFileSummary::handleSpectrumChange, this,
@@ -855,6 +1248,8 @@ void SpecFileSummary::updateMeasurmentFieldsFromMemory()
     m_sampleNumber->setText( "-" );
     m_measurmentRemarks->setText( "-" );
   }//try / catch
+  
+  syncRecordTableSelection();
 }//void updateMeasurmentFieldsFromMemory()
 
 
@@ -867,6 +1262,9 @@ void SpecFileSummary::updateDisplayFromMemory()
   const size_t nspec = (!!meas ? meas->measurements().size() : 0);
 
   m_displaySampleDiv->setHidden( nspec < 2 );
+  m_recordsDiv->setHidden( nspec < 2 );
+  m_recordModel->setMeasurement( (nspec < 2) ? nullptr : meas );
+  
   const bool hasForeground = !!m_specViewer->measurment(SpecUtils::SpectrumType::Foreground);
   const bool hasSecondFore = !!m_specViewer->measurment(SpecUtils::SpectrumType::SecondForeground);
   const bool hasBackground = !!m_specViewer->measurment(SpecUtils::SpectrumType::Background);
@@ -1238,6 +1636,8 @@ void SpecFileSummary::handleFieldUpdate( EditableFields field )
       meas->set_instrument_id( m_instrument_id->text().toUTF8() );
       break;
   }//switch( field )
+  
+  m_recordModel->refreshData();
 }//void handleFieldUpdate( EditableFields field )
 
 
@@ -1408,3 +1808,62 @@ void SpecFileSummary::handleUserChangeSampleNum()
   updateMeasurmentFieldsFromMemory();
 }//void SpecFileSummary::handleUserChangeSampleNum()
 
+
+void SpecFileSummary::handleRecordTableSelection()
+{
+  const WModelIndexSet selected = m_recordTable->selectedIndexes();
+  if( selected.empty() )
+    return;
+  
+  size_t record = 0;
+  try
+  {
+    record = m_recordModel->recordIndex( selected.begin()->row() );
+  }catch( std::exception & )
+  {
+    return;
+  }
+  
+  const string sampleNumStr = std::to_string( record + 1 );
+  if( m_displaySampleNumEdit->text().toUTF8() == sampleNumStr )
+    return;
+  
+  m_displaySampleNumEdit->setText( sampleNumStr );
+  updateMeasurmentFieldsFromMemory();
+}//void handleRecordTableSelection()
+
+
+void SpecFileSummary::handleRecordFilterChanged()
+{
+  m_recordModel->setFilter( m_recordFilter->text().toUTF8() );
+  syncRecordTableSelection();
+}//void handleRecordFilterChanged()
+
+
+void SpecFileSummary::syncRecordTableSelection()
+{
+  if( !m_recordTable || m_recordsDiv->isHidden() )
+    return;
+  
+  int row = -1;
+  try
+  {
+    const size_t sampleNum = std::stoull( m_displaySampleNumEdit->text().toUTF8() );
+    if( sampleNum > 0 )
+      row = m_recordModel->recordRow( sampleNum - 1 );
+  }catch( std::exception & )
+  {
+  }
+  
+  if( row < 0 )
+  {
+    m_recordTable->clearSelection();
+    return;
+  }
+  
+  const WModelIndex index = m_recordModel->index( row, 0 );
+  if( !m_recordTable->isSelected( index ) )
+    m_recordTable->select( index, Wt::ClearAndSelect );
+  m_recordTable->scrollTo( index );
+}//void syncRecordTableSelection()
+
@@ -23,12 +23,28 @@
 
 #include "InterSpec_config.h"
 
+#include <set>
 #include <deque>
+#include <mutex>
 #include <memory>
 #include <string>
 #include <vector>
+#include <limits>
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#if( !defined(_WIN32) )
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "external_libs/SpecUtils/3rdparty/rapidxml/rapidxml.hpp"
 #include "external_libs/SpecUtils/3rdparty/rapidxml/rapidxml_utils.hpp"
@@ -62,6 +78,70 @@ static_assert( PERFORM_DEVELOPER_CHECKS == SpecUtils_ENABLE_EQUALITY_CHECKS,
 
 namespace
 {
+#if( !defined(_WIN32) )
+  /** A private, copy-on-write, memory mapping of a file, with a zero byte after its contents, so
+   rapidxml can parse the file in-situ without it first being read into a buffer; only the pages
+   rapidxml writes to get copied.
+   
+   Files smaller than #sm_min_size, or whose size is an exact multiple of the page size (so there
+   is no room for the trailing zero byte in the last page), are not mapped; #data will then be
+   nullptr, and the file should be read the normal way.
+   */
+  class PrivateFileMapping
+  {
+  public:
+    /** Below this size, just reading the file is as quick as mapping it. */
+    static const size_t sm_min_size = 256*1024;
+    
+    explicit PrivateFileMapping( const std::string &filename )
+      : m_data( nullptr ),
+        m_size( 0 )
+    {
+      const int fd = ::open( filename.c_str(), O_RDONLY );
+      if( fd < 0 )
+        return;
+      
+      struct stat statbuf;
+      const size_t page_size = static_cast<size_t>( sysconf(_SC_PAGESIZE) );
+      if( (fstat( fd, &statbuf ) != 0)
+         || (static_cast<size_t>(statbuf.st_size) < sm_min_size)
+         || ((static_cast<size_t>(statbuf.st_size) % page_size) == 0) )
+      {
+        ::close( fd );
+        return;
+      }
+      
+      const size_t size = static_cast<size_t>( statbuf.st_size );
+      void *mapping = mmap( nullptr, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+      ::close( fd );  //The mapping stays valid after closing the file descriptor
+      
+      if( mapping == MAP_FAILED )
+        return;
+      
+      m_data = static_cast<char *>( mapping );
+      m_size = size;
+      m_data[m_size] = '\0';  //The rest of the last page is zero-filled anyway.
+    }//PrivateFileMapping constructor
+    
+    ~PrivateFileMapping()
+    {
+      if( m_data )
+        munmap( m_data, m_size + 1 );
+    }
+    
+    PrivateFileMapping( const PrivateFileMapping & ) = delete;
+    PrivateFileMapping &operator=( const PrivateFileMapping & ) = delete;
+    
+    char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    
+  private:
+    char *m_data;
+    size_t m_size;
+  };//class PrivateFileMapping
+#endif //!defined(_WIN32)
+  
+  
   /** source is node to clone, and target is the node that will become
       equivalent of source (its name/attribs/children will become equivalent
       to source node).
@@ -111,7 +191,198 @@ namespace
       clone_node_deep( child, cloned_child );
     }
   }//clone_node_deep(...)
-
+  
+  
+  size_t energy_cal_content_hash( const SpecUtils::EnergyCalibration &cal )
+  {
+    size_t seed = std::hash<int>()( static_cast<int>(cal.type()) );
+    const auto combine = [&seed]( const size_t value ){
+      seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    };
+    
+    combine( cal.num_channels() );
+    for( const float coef : cal.coefficients() )
+      combine( std::hash<float>()(coef) );
+    for( const auto &dev : cal.deviation_pairs() )
+    {
+      combine( std::hash<float>()(dev.first) );
+      combine( std::hash<float>()(dev.second) );
+    }
+    
+    const shared_ptr<const vector<float>> &energies = cal.channel_energies();
+    if( energies && !energies->empty() )
+    {
+      combine( std::hash<float>()(energies->front()) );
+      combine( std::hash<float>()(energies->back()) );
+    }
+    
+    return seed;
+  }//size_t energy_cal_content_hash(...)
+  
+  
+  /** Returns an already existing calibration (from any SpecMeas in the process) that is equal to
+   `cal`, or else `cal` itself, after remembering it.
+   
+   Identical calibrations are common (e.g., every sample and detector of a file, or the same
+   detector across files), and each holds its own channel energies vector, which for 16k channel
+   spectra is 64 kB, so sharing them saves a lot of memory.  Calibrations are held by weak_ptr so
+   this table doesnt keep them alive.
+   */
+  shared_ptr<const SpecUtils::EnergyCalibration> intern_energy_cal( const shared_ptr<const SpecUtils::EnergyCalibration> &cal )
+  {
+    if( !cal || !cal->valid() )
+      return cal;
+    
+    static std::mutex s_intern_mutex;
+    static std::unordered_multimap<size_t,weak_ptr<const SpecUtils::EnergyCalibration>> s_interned;
+    static size_t s_size_at_last_prune = 0;
+    
+    const size_t hash = energy_cal_content_hash( *cal );
+    
+    std::lock_guard<std::mutex> lock( s_intern_mutex );
+    
+    const auto range = s_interned.equal_range( hash );
+    for( auto iter = range.first; iter != range.second; ++iter )
+    {
+      const shared_ptr<const SpecUtils::EnergyCalibration> existing = iter->second.lock();
+      if( existing == cal )
+        return cal;
+      
+      if( existing && ((*existing) == (*cal)) )
+        return existing;
+    }//for( loop over calibrations with same hash )
+    
+    // Remove dead entries, if the table has doubled since we last did this
+    if( s_interned.size() > 2*std::max( s_size_at_last_prune, size_t(64) ) )
+    {
+      for( auto iter = begin(s_interned); iter != end(s_interned); )
+        iter = iter->second.expired() ? s_interned.erase( iter ) : std::next( iter );
+      s_size_at_last_prune = s_interned.size();
+    }//if( time to prune )
+    
+    s_interned.emplace( hash, cal );
+    
+    return cal;
+  }//intern_energy_cal(...)
+  
+  
+  /** Implementation of the XXH64 algorithm; processes 32 bytes per iteration using four independent
+   accumulators, so it runs at close to memory bandwidth for the sizes of spectra we deal with.
+   Assumes a little endian host (as are all our targets).
+   */
+  uint64_t xxh64( const void *input, const size_t len, const uint64_t seed )
+  {
+    const uint64_t p1 = 11400714785074694791ULL, p2 = 14029467366897019727ULL,
+                   p3 = 1609587929392839161ULL, p4 = 9650029242287828579ULL,
+                   p5 = 2870177450012600261ULL;
+    
+    const auto rotl = []( const uint64_t x, const int r ) -> uint64_t { return (x << r) | (x >> (64 - r)); };
+    const auto round = [&]( uint64_t acc, const uint64_t lane ) -> uint64_t {
+      acc += lane * p2;
+      acc = rotl( acc, 31 );
+      return acc * p1;
+    };
+    const auto merge = [&]( uint64_t acc, const uint64_t val ) -> uint64_t {
+      acc ^= round( 0, val );
+      return acc * p1 + p4;
+    };
+    const auto read64 = []( const uint8_t *p ) -> uint64_t { uint64_t v; memcpy( &v, p, 8 ); return v; };
+    const auto read32 = []( const uint8_t *p ) -> uint64_t { uint32_t v; memcpy( &v, p, 4 ); return v; };
+    
+    const uint8_t *p = static_cast<const uint8_t *>( input );
+    const uint8_t * const end = p + len;
+    uint64_t h;
+    
+    if( len >= 32 )
+    {
+      uint64_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+      const uint8_t * const limit = end - 32;
+      do
+      {
+        v1 = round( v1, read64(p) );
+        v2 = round( v2, read64(p + 8) );
+        v3 = round( v3, read64(p + 16) );
+        v4 = round( v4, read64(p + 24) );
+        p += 32;
+      }while( p <= limit );
+      
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = merge( h, v1 );
+      h = merge( h, v2 );
+      h = merge( h, v3 );
+      h = merge( h, v4 );
+    }else
+    {
+      h = seed + p5;
+    }//if( len >= 32 ) / else
+    
+    h += static_cast<uint64_t>( len );
+    
+    for( ; (p + 8) <= end; p += 8 )
+      h = rotl( h ^ round(0, read64(p)), 27 ) * p1 + p4;
+    
+    if( (p + 4) <= end )
+    {
+      h = rotl( h ^ (read32(p) * p1), 23 ) * p2 + p3;
+      p += 4;
+    }
+    
+    for( ; p < end; ++p )
+      h = rotl( h ^ ((*p) * p5), 11 ) * p1;
+    
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
+    
+    return h;
+  }//uint64_t xxh64(...)
+  
+  
+  template<class T>
+  void hash_value_into( uint64_t &seed, const T &value )
+  {
+    seed = xxh64( &value, sizeof(value), seed );
+  }
+  
+  
+  /** Returns the hash of `counts`, computing it only if this vector hasnt been hashed before.
+   
+   Cached by address, with a weak_ptr to make sure the address wasnt re-used by a different vector.
+   */
+  uint64_t cached_counts_hash( const shared_ptr<const vector<float>> &counts )
+  {
+    if( !counts || counts->empty() )
+      return 0;
+    
+    typedef pair<weak_ptr<const vector<float>>,uint64_t> CacheEntry;
+    static std::mutex s_counts_hash_mutex;
+    static std::unordered_map<const vector<float> *,CacheEntry> s_counts_hashes;
+    static size_t s_size_at_last_prune = 0;
+    
+    {
+      std::lock_guard<std::mutex> lock( s_counts_hash_mutex );
+      const auto pos = s_counts_hashes.find( counts.get() );
+      if( (pos != end(s_counts_hashes)) && (pos->second.first.lock() == counts) )
+        return pos->second.second;
+    }
+    
+    // Compute outside the lock, so other threads arent blocked
+    const uint64_t hash = xxh64( counts->data(), counts->size() * sizeof(float), 0 );
+    
+    std::lock_guard<std::mutex> lock( s_counts_hash_mutex );
+    if( s_counts_hashes.size() > 2*std::max( s_size_at_last_prune, size_t(256) ) )
+    {
+      for( auto iter = begin(s_counts_hashes); iter != end(s_counts_hashes); )
+        iter = iter->second.first.expired() ? s_counts_hashes.erase( iter ) : std::next( iter );
+      s_size_at_last_prune = s_counts_hashes.size();
+    }//if( time to prune )
+    
+    s_counts_hashes[counts.get()] = CacheEntry( counts, hash );
+    
+    return hash;
+  }//uint64_t cached_counts_hash(...)
 }//namespace
 
 SpecMeas::SpecMeas()
@@ -477,11 +748,14 @@ void SpecMeas::uniqueCopyContents( const SpecMeas &rhs )
   typedef std::shared_ptr<const PeakDef> PeakShrdPtr;
   if( rhs.m_peaks )
   {
+    // The peaks themselves are immutable, so are shared with rhs; only the containers need to be
+    //  unique, so that adding or removing peaks from one SpecMeas doesnt effect the other.
     for( const SampleNumsToPeakMap::value_type &vt : *(rhs.m_peaks) )
     {
-      (*m_peaks)[vt.first] = std::make_shared<PeakDeque>();
-      for( PeakShrdPtr peak : *(vt.second) )
-        (*m_peaks)[vt.first]->push_back( peak );
+      if( vt.second )
+        (*m_peaks)[vt.first] = std::make_shared<PeakDeque>( *vt.second );
+      else
+        (*m_peaks)[vt.first] = std::make_shared<PeakDeque>();
     }//for( const SampleNumsToPeakMap::value_type &vt : *(rhs.m_peaks) )
   }//if( rhs.m_peaks )
   
@@ -548,6 +822,8 @@ void SpecMeas::uniqueCopyContents( const SpecMeas &rhs )
   m_fileWasFromInterSpec = rhs.m_fileWasFromInterSpec;
   
   m_dbUserStateIndexes = rhs.m_dbUserStateIndexes;
+  
+  m_sampleSumIndexes.clear();
 }//void uniqueCopyContents( const SpecMeas &rhs )
 
 
@@ -1736,10 +2012,23 @@ bool SpecMeas::load_N42_file( const std::string &filename )
   
   try
   {
-    std::vector<char> data;
-    SpecUtils::load_file_data( filename.c_str(), data );
+    bool loaded = false;
     
-    const bool loaded = SpecMeas::load_N42_from_data( &data.front(), (&data.front()) + data.size() );
+#if( !defined(_WIN32) )
+    // Large N42 files are mapped, instead of read, so the OS pages them in as rapidxml goes, and
+    //  we avoid a full copy of the file.
+    const PrivateFileMapping mapping( filename );
+    if( mapping.data() )
+    {
+      loaded = SpecMeas::load_N42_from_data( mapping.data(), mapping.data() + mapping.size() );
+    }else
+#endif
+    {
+      std::vector<char> data;
+      SpecUtils::load_file_data( filename.c_str(), data );
+      
+      loaded = SpecMeas::load_N42_from_data( &data.front(), (&data.front()) + data.size() );
+    }
     
     if( !loaded )
       throw runtime_error( "!loaded" );
@@ -2105,13 +2394,667 @@ void SpecMeas::set_energy_calibration( const std::shared_ptr<const SpecUtils::En
 {
   const shared_ptr<const SpecUtils::EnergyCalibration> oldcal = meas ? meas->energy_calibration() : nullptr;
   
-  SpecFile::set_energy_calibration( cal, meas );
+  SpecFile::set_energy_calibration( intern_energy_cal(cal), meas );
   
   if( (oldcal != cal) && oldcal && cal && ((*oldcal) != (*cal)) )
     setModified();
 }//set_energy_calibration(...)
 
 
+void SpecMeas::set_energy_calibrations( const vector<pair<shared_ptr<const SpecUtils::Measurement>,
+                                                shared_ptr<const SpecUtils::EnergyCalibration>>> &meas_cals )
+{
+  bool changed = false;
+  set<pair<shared_ptr<const SpecUtils::EnergyCalibration>,shared_ptr<const SpecUtils::EnergyCalibration>>> unchanged_cals;
+  
+  for( const auto &meas_cal : meas_cals )
+  {
+    const shared_ptr<const SpecUtils::Measurement> &meas = meas_cal.first;
+    const shared_ptr<const SpecUtils::EnergyCalibration> &cal = meas_cal.second;
+    const shared_ptr<const SpecUtils::EnergyCalibration> oldcal = meas ? meas->energy_calibration() : nullptr;
+    
+    SpecFile::set_energy_calibration( intern_energy_cal(cal), meas );
+    
+    if( changed || (oldcal == cal) || !oldcal || !cal )
+      continue;
+    
+    const auto cal_pair = make_pair( oldcal, cal );
+    if( unchanged_cals.count(cal_pair) )
+      continue;
+    
+    if( (*oldcal) != (*cal) )
+      changed = true;
+    else
+      unchanged_cals.insert( cal_pair );
+  }//for( const auto &meas_cal : meas_cals )
+  
+  if( changed )
+    setModified();
+}//set_energy_calibrations(...)
+
+
+/** Running sums of the gamma channel counts, and live/real times, for a fixed set of detectors, over
+ the samples of a SpecMeas.
+ */
+struct SpecMeas::SampleSumIndex
+{
+  /** State of a record at the time the index was built, used to detect if it has since changed. */
+  struct RecordState
+  {
+    std::shared_ptr<const SpecUtils::Measurement> meas;
+    std::shared_ptr<const std::vector<float>> counts;
+    float live_time;
+    float real_time;
+    double neutron_counts_sum;
+    bool contained_neutron;
+  };//struct RecordState
+  
+  /** Number of samples between stored running sums of the channel counts. */
+  static const size_t sm_blockSize = 64;
+  
+  std::shared_ptr<const SpecUtils::EnergyCalibration> energy_cal;
+  size_t num_channels;
+  
+  /** The (sorted) detector names summed. */
+  std::vector<std::string> det_names;
+  
+  /** All sample numbers of the file, sorted. */
+  std::vector<int> sample_numbers;
+  
+  /** The records of each sample, in the order of `det_names`; indexed same as `sample_numbers`. */
+  std::vector<std::vector<RecordState>> records;
+  
+  /** `block_sums[i]` is the per-channel sum of all the records for samples `[0, i*sm_blockSize)`.
+   
+   Integer counts are summed exactly (up to 2^53), and the running sums are compensated (Neumaier
+   summation) so non-integer counts (e.g., from rebinned or background subtracted spectra) dont
+   accumulate rounding error over thousands of records.
+   */
+  std::vector<std::vector<double>> block_sums;
+  
+  /** Running sums over samples, of size `sample_numbers.size() + 1`; element `i` is the sum over
+   samples `[0, i)`.
+   */
+  std::vector<double> live_times, real_times, neutron_counts, neutron_live_times, num_neutron_records;
+  
+  /** The compensated running sum of the channel counts over all samples in the index, kept so samples
+   can be appended (see #append) without re-summing the samples already indexed.
+   */
+  std::vector<double> running_sum, running_comp;
+  
+  
+  /** Builds the index; returns nullptr if any of the records dont have gamma data, or dont share the
+   same energy calibration object.  The SpecFile mutex must be held by the caller.
+   */
+  static std::shared_ptr<SampleSumIndex> create( const SpecUtils::SpecFile &spec,
+                                                 const std::vector<std::string> &det_names )
+  {
+    auto index = std::make_shared<SampleSumIndex>();
+    index->num_channels = 0;
+    index->det_names = det_names;
+    
+    const set<int> &samples = spec.sample_numbers();
+    if( samples.empty() || det_names.empty() )
+      return nullptr;
+    
+    index->sample_numbers.reserve( samples.size() );
+    index->records.reserve( samples.size() );
+    index->live_times.reserve( samples.size() + 1 );
+    index->real_times.reserve( samples.size() + 1 );
+    index->neutron_counts.reserve( samples.size() + 1 );
+    index->neutron_live_times.reserve( samples.size() + 1 );
+    index->num_neutron_records.reserve( samples.size() + 1 );
+    
+    index->live_times.push_back( 0.0 );
+    index->real_times.push_back( 0.0 );
+    index->neutron_counts.push_back( 0.0 );
+    index->neutron_live_times.push_back( 0.0 );
+    index->num_neutron_records.push_back( 0.0 );
+    index->block_sums.emplace_back();
+    
+    for( const int sample : samples )
+    {
+      if( !index->append_sample( spec, sample ) )
+        return nullptr;
+    }
+    
+    if( !index->energy_cal )
+      return nullptr;
+    
+    return index;
+  }//create(...)
+  
+  
+  /** Adds `new_samples` (sorted, and all larger than the samples already indexed) to the index, at a
+   cost proportional to the number of new samples only.
+   
+   Returns false if the samples cant be appended (out of order, or records without gamma data, or with
+   a different energy calibration); the index is then in an inconsistent state, and must be discarded.
+   The SpecFile mutex must be held by the caller.
+   */
+  bool append( const SpecUtils::SpecFile &spec, const std::set<int> &new_samples )
+  {
+    if( !new_samples.empty() && !sample_numbers.empty() && ((*begin(new_samples)) <= sample_numbers.back()) )
+      return false;
+    
+    for( const int sample : new_samples )
+    {
+      if( !append_sample( spec, sample ) )
+        return false;
+    }
+    
+    return !!energy_cal;
+  }//bool append(...)
+  
+  
+  /** Adds a single sample, that must be larger than any sample already in the index, to the end of the
+   index.  Returns false if the records of the sample cant be indexed.
+   */
+  bool append_sample( const SpecUtils::SpecFile &spec, const int sample )
+  {
+    const size_t i = sample_numbers.size();
+    assert( i == records.size() );
+    assert( live_times.size() == (i + 1) );
+    assert( block_sums.size() == ((i / sm_blockSize) + 1) );
+    
+    sample_numbers.push_back( sample );
+    records.emplace_back();
+    
+    double live_time = 0.0, real_time = 0.0, neutrons = 0.0, neutron_live_time = 0.0, num_neutron = 0.0;
+    
+    vector<RecordState> &sample_records = records.back();
+    sample_records.reserve( det_names.size() );
+    
+    for( const string &det : det_names )
+    {
+      RecordState state;
+      state.meas = spec.measurement( sample, det );
+      
+      if( state.meas )
+      {
+        state.counts = state.meas->gamma_counts();
+        const shared_ptr<const SpecUtils::EnergyCalibration> &cal = state.meas->energy_calibration();
+        if( !state.counts || state.counts->empty() || !cal )
+          return false;
+        
+        if( !energy_cal )
+        {
+          energy_cal = cal;
+          num_channels = state.counts->size();
+          running_sum.resize( num_channels, 0.0 );
+          running_comp.resize( num_channels, 0.0 );
+          for( vector<double> &prev : block_sums )
+            prev.resize( num_channels, 0.0 );
+        }//if( this is the first record )
+        
+        if( (cal != energy_cal) || (state.counts->size() != num_channels) )
+          return false;
+          
+          state.live_time = state.meas->live_time();
+          state.real_time = state.meas->real_time();
+          state.neutron_counts_sum = state.meas->neutron_counts_sum();
+          state.contained_neutron = state.meas->contained_neutron();
+          
+        const vector<float> &counts = *state.counts;
+        for( size_t channel = 0; channel < num_channels; ++channel )
+        {
+          const double value = counts[channel];
+          double &sum = running_sum[channel];
+          const double new_sum = sum + value;
+          running_comp[channel] += (std::fabs(sum) >= std::fabs(value)) ? ((sum - new_sum) + value)
+                                                                       : ((value - new_sum) + sum);
+          sum = new_sum;
+        }//for( loop over channels )
+        
+        live_time += state.live_time;
+        real_time += state.real_time;
+        if( state.contained_neutron )
+        {
+          num_neutron += 1.0;
+          neutrons += state.neutron_counts_sum;
+          neutron_live_time += state.meas->neutron_live_time();
+        }
+      }else
+      {
+        state.live_time = state.real_time = 0.0f;
+        state.neutron_counts_sum = 0.0;
+        state.contained_neutron = false;
+      }//if( state.meas ) / else
+      
+      sample_records.push_back( state );
+    }//for( const string &det : det_names )
+    
+    live_times.push_back( live_times[i] + live_time );
+    real_times.push_back( real_times[i] + real_time );
+    neutron_counts.push_back( neutron_counts[i] + neutrons );
+    neutron_live_times.push_back( neutron_live_times[i] + neutron_live_time );
+    num_neutron_records.push_back( num_neutron_records[i] + num_neutron );
+    
+    // `block_sums[b]` is the sum over samples `[0, b*sm_blockSize)`, so once a block is complete, we
+    //  record the running sum.
+    if( ((i + 1) % sm_blockSize) == 0 )
+    {
+      vector<double> block = running_sum;
+      for( size_t channel = 0; channel < block.size(); ++channel )
+        block[channel] += running_comp[channel];
+      block_sums.push_back( std::move(block) );
+    }//if( we just completed a block )
+    
+    return true;
+  }//bool append_sample(...)
+  
+  
+  /** Returns the sum of the specified samples, or nullptr if any of these samples are not in the index,
+   or if their records have changed since the index was created.  The SpecFile mutex must be held by
+   the caller.
+   */
+  std::shared_ptr<SpecUtils::Measurement> sum( const SpecUtils::SpecFile &spec,
+                                               const std::set<int> &sample_nums ) const
+  {
+    // Map sample numbers to contiguous ranges of indexes, [first,last), checking records as we go.
+    vector<pair<size_t,size_t>> ranges;
+    shared_ptr<const SpecUtils::Measurement> first_record;
+    
+    auto sample_pos = begin(sample_numbers);
+    for( const int sample : sample_nums )
+    {
+      sample_pos = std::lower_bound( sample_pos, end(sample_numbers), sample );
+      if( (sample_pos == end(sample_numbers)) || ((*sample_pos) != sample) )
+        return nullptr;
+      
+      const size_t i = static_cast<size_t>( sample_pos - begin(sample_numbers) );
+      
+      const vector<RecordState> &sample_records = records[i];
+      assert( sample_records.size() == det_names.size() );
+      for( size_t det_index = 0; det_index < det_names.size(); ++det_index )
+      {
+        const RecordState &state = sample_records[det_index];
+        const shared_ptr<const SpecUtils::Measurement> meas = spec.measurement( sample, det_names[det_index] );
+        if( meas != state.meas )
+          return nullptr;
+        
+        if( !meas )
+          continue;
+        
+        if( (meas->gamma_counts() != state.counts)
+           || (meas->energy_calibration() != energy_cal)
+           || (meas->live_time() != state.live_time)
+           || (meas->real_time() != state.real_time)
+           || (meas->contained_neutron() != state.contained_neutron)
+           || (meas->neutron_counts_sum() != state.neutron_counts_sum) )
+          return nullptr;
+        
+        if( !first_record )
+          first_record = meas;
+      }//for( loop over detectors )
+      
+      if( !ranges.empty() && (ranges.back().second == i) )
+        ranges.back().second = i + 1;
+      else
+        ranges.push_back( {i, i + 1} );
+    }//for( const int sample : sample_nums )
+    
+    if( !first_record )
+      return nullptr;
+    
+    vector<double> channel_sums( num_channels, 0.0 );
+    double live_time = 0.0, real_time = 0.0, neutrons = 0.0, neutron_live_time = 0.0, num_neutron = 0.0;
+    
+    const auto add_samples = [this,&channel_sums]( const size_t first, const size_t last ){
+      for( size_t i = first; i < last; ++i )
+      {
+        for( const RecordState &state : records[i] )
+        {
+          if( !state.counts )
+            continue;
+          const vector<float> &counts = *state.counts;
+          for( size_t channel = 0; channel < num_channels; ++channel )
+            channel_sums[channel] += counts[channel];
+        }
+      }//for( size_t i = first; i < last; ++i )
+    };//add_samples
+    
+    for( const pair<size_t,size_t> &range : ranges )
+    {
+      const size_t first = range.first, last = range.second;
+      const size_t first_block = (first + sm_blockSize - 1) / sm_blockSize;
+      const size_t last_block = last / sm_blockSize;
+      
+      if( first_block < last_block )
+      {
+        assert( last_block < block_sums.size() );
+        
+        add_samples( first, first_block * sm_blockSize );
+        
+        const vector<double> &upper = block_sums[last_block];
+        const vector<double> &lower = block_sums[first_block];
+        assert( (upper.size() == num_channels) && (lower.size() == num_channels) );
+        for( size_t channel = 0; channel < num_channels; ++channel )
+          channel_sums[channel] += (upper[channel] - lower[channel]);
+        
+        add_samples( last_block * sm_blockSize, last );
+      }else
+      {
+        add_samples( first, last );
+      }//if( range spans at least one full block ) / else
+      
+      live_time += (live_times[last] - live_times[first]);
+      real_time += (real_times[last] - real_times[first]);
+      neutrons += (neutron_counts[last] - neutron_counts[first]);
+      neutron_live_time += (neutron_live_times[last] - neutron_live_times[first]);
+      num_neutron += (num_neutron_records[last] - num_neutron_records[first]);
+    }//for( const pair<size_t,size_t> &range : ranges )
+    
+    auto counts = make_shared<vector<float>>( num_channels );
+    for( size_t channel = 0; channel < num_channels; ++channel )
+      (*counts)[channel] = static_cast<float>( std::max( channel_sums[channel], 0.0 ) );
+    
+    auto answer = make_shared<SpecUtils::Measurement>( *first_record );
+    answer->set_gamma_counts( counts, static_cast<float>(live_time), static_cast<float>(real_time) );
+    if( num_neutron > 0.5 )
+      answer->set_neutron_counts( vector<float>{ static_cast<float>(neutrons) }, static_cast<float>(neutron_live_time) );
+    
+    return answer;
+  }//sum(...)
+  
+  
+  /** Approximate memory used by the index. */
+  size_t memsize() const
+  {
+    size_t size = sizeof(SampleSumIndex);
+    for( const std::string &name : det_names )
+      size += sizeof(name) + name.capacity();
+    size += sizeof(int) * sample_numbers.capacity();
+    for( const std::vector<RecordState> &r : records )
+      size += sizeof(r) + sizeof(RecordState)*r.capacity();
+    for( const std::vector<double> &b : block_sums )
+      size += sizeof(b) + sizeof(double)*b.capacity();
+    size += sizeof(double) * (live_times.capacity() + real_times.capacity() + neutron_counts.capacity()
+                              + neutron_live_times.capacity() + num_neutron_records.capacity()
+                              + running_sum.capacity() + running_comp.capacity());
+    return size;
+  }//size_t memsize() const
+};//struct SampleSumIndex
+
+
+struct SpecMeas::PrefetchedSum
+{
+  std::set<int> sample_nums;
+  
+  /** Sorted, and unique, detector names. */
+  std::vector<std::string> det_names;
+  
+  std::shared_ptr<const SpecUtils::EnergyCalibration> energy_cal;
+  
+  /** The records that were summed (in sample, then detector, order), and their counts, so we can tell
+   if the file has been changed since the sum was made; holding the shared pointers makes sure the
+   addresses cant be reused by different objects.
+   */
+  std::vector<std::pair<std::shared_ptr<const SpecUtils::Measurement>,
+                        std::shared_ptr<const std::vector<float>>>> records;
+  
+  std::shared_ptr<const SpecUtils::Measurement> sum;
+  
+  
+  static std::vector<std::pair<std::shared_ptr<const SpecUtils::Measurement>,std::shared_ptr<const std::vector<float>>>>
+  current_records( const SpecMeas &spec, const std::set<int> &sample_nums, const std::vector<std::string> &det_names )
+  {
+    std::vector<std::pair<std::shared_ptr<const SpecUtils::Measurement>,std::shared_ptr<const std::vector<float>>>> answer;
+    answer.reserve( sample_nums.size() * det_names.size() );
+    
+    for( const int sample : sample_nums )
+    {
+      for( const string &det : det_names )
+      {
+        shared_ptr<const SpecUtils::Measurement> meas = spec.measurement( sample, det );
+        shared_ptr<const vector<float>> counts = meas ? meas->gamma_counts() : nullptr;
+        answer.emplace_back( std::move(meas), std::move(counts) );
+      }
+    }//for( const int sample : sample_nums )
+    
+    return answer;
+  }//current_records(...)
+  
+  
+  size_t memsize() const
+  {
+    size_t size = sizeof(PrefetchedSum);
+    size += sizeof(int) * sample_nums.size();
+    size += records.capacity() * sizeof(records[0]);
+    if( sum )
+      size += sum->memmorysize();
+    return size;
+  }//size_t memsize() const
+};//struct PrefetchedSum
+
+
+size_t SpecMeas::memsize() const
+{
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  size_t size = SpecUtils::SpecFile::memmorysize();
+  size += sizeof(SpecMeas) - sizeof(SpecUtils::SpecFile);
+  
+  // The same PeakDef is often shared between multiple sample number sets (and user and
+  //  automated-search peaks), so only count the memory of each distinct peak once.
+  std::set<const PeakDef *> counted_peaks;
+  
+  const auto peaks_size = [&counted_peaks]( const SampleNumsToPeakMap &peaks ) -> size_t {
+    size_t answer = 0;
+    for( const SampleNumsToPeakMap::value_type &samples_peaks : peaks )
+    {
+      answer += sizeof(samples_peaks) + sizeof(int)*samples_peaks.first.size();
+      if( !samples_peaks.second )
+        continue;
+      
+      answer += samples_peaks.second->size() * sizeof(PeakDequeShrdPtr::element_type::value_type);
+      for( const std::shared_ptr<const PeakDef> &peak : *samples_peaks.second )
+      {
+        if( peak && counted_peaks.insert( peak.get() ).second )
+          answer += sizeof(PeakDef);
+      }
+    }
+    return answer;
+  };//peaks_size
+  
+  if( m_peaks )
+    size += peaks_size( *m_peaks );
+  size += peaks_size( m_autoSearchPeaks );
+  
+  if( m_detector )
+    size += sizeof(DetectorPeakResponse);
+  
+  for( const auto &dets_index : m_sampleSumIndexes )
+  {
+    if( dets_index.second )
+      size += dets_index.second->memsize();
+  }
+  
+  for( const shared_ptr<const PrefetchedSum> &prefetched : m_prefetchedSums )
+    size += prefetched->memsize();
+  
+  return size;
+}//size_t memsize() const
+
+
+void SpecMeas::clearSumIndexes() const
+{
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  m_sampleSumIndexes.clear();
+  m_prefetchedSums.clear();
+}//void clearSumIndexes() const
+
+
+void SpecMeas::prefetch_sum( const std::set<int> &sample_nums, const std::vector<std::string> &det_names ) const
+{
+  if( sample_nums.empty() || det_names.empty() )
+    return;
+  
+  vector<string> key = det_names;
+  std::sort( begin(key), end(key) );
+  key.erase( std::unique( begin(key), end(key) ), end(key) );
+  
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  for( const shared_ptr<const PrefetchedSum> &prev : m_prefetchedSums )
+  {
+    if( (prev->sample_nums == sample_nums) && (prev->det_names == key)
+       && (prev->records == PrefetchedSum::current_records( *this, sample_nums, key )) )
+      return;
+  }//for( loop over previously prefetched sums )
+  
+  auto prefetched = make_shared<PrefetchedSum>();
+  try
+  {
+    prefetched->energy_cal = suggested_sum_energy_calibration( sample_nums, det_names );
+    if( !prefetched->energy_cal )
+      return;
+    
+    // Remove any stale entries for these samples, so sum_measurements_indexed doesnt find them.
+    m_prefetchedSums.remove_if( [&]( const shared_ptr<const PrefetchedSum> &prev ){
+      return (prev->sample_nums == sample_nums) && (prev->det_names == key);
+    } );
+    
+    prefetched->sum = sum_measurements_indexed( sample_nums, det_names, prefetched->energy_cal );
+  }catch( std::exception &e )
+  {
+    cerr << "SpecMeas::prefetch_sum: " << e.what() << endl;
+    return;
+  }//try / catch
+  
+  if( !prefetched->sum )
+    return;
+  
+  prefetched->sample_nums = sample_nums;
+  prefetched->det_names = key;
+  prefetched->records = PrefetchedSum::current_records( *this, sample_nums, key );
+  
+  m_prefetchedSums.push_front( prefetched );
+  
+  size_t total_bytes = 0;
+  for( auto iter = begin(m_prefetchedSums); iter != end(m_prefetchedSums); )
+  {
+    total_bytes += (*iter)->memsize();
+    if( (total_bytes > sm_maxPrefetchedSumBytes) && (iter != begin(m_prefetchedSums)) )
+      iter = m_prefetchedSums.erase( iter );
+    else
+      ++iter;
+  }//for( loop over prefetched sums, most recent first )
+}//void prefetch_sum(...)
+
+
+std::shared_ptr<SpecUtils::Measurement> SpecMeas::sum_measurements_indexed( const std::set<int> &sample_nums,
+                                   const std::vector<std::string> &det_names,
+                                   const std::shared_ptr<const SpecUtils::EnergyCalibration> &energy_cal ) const
+{
+  if( !energy_cal )
+    return sum_measurements( sample_nums, det_names, energy_cal );
+  
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  vector<string> key = det_names;
+  std::sort( begin(key), end(key) );
+  key.erase( std::unique( begin(key), end(key) ), end(key) );
+  
+  shared_ptr<SpecUtils::Measurement> answer;
+  
+  // Check if these samples have been summed in the background by #prefetch_sum.
+  for( const shared_ptr<const PrefetchedSum> &prefetched : m_prefetchedSums )
+  {
+    if( (prefetched->sample_nums == sample_nums) && (prefetched->det_names == key)
+       && (prefetched->energy_cal == energy_cal)
+       && (prefetched->records == PrefetchedSum::current_records( *this, sample_nums, key )) )
+    {
+      return make_shared<SpecUtils::Measurement>( *prefetched->sum );
+    }
+  }//for( loop over prefetched sums )
+  
+  shared_ptr<SampleSumIndex> index;
+  const auto pos = m_sampleSumIndexes.find( key );
+  if( pos != end(m_sampleSumIndexes) )
+    index = pos->second;
+  
+  // If we already have an index, we'll use it even for small sums, since it sums in double
+  //  precision directly from the records, without the per-record copies `sum_measurements` makes.
+  if( index && (index->energy_cal == energy_cal) )
+    answer = index->sum( *this, sample_nums );
+  
+  // Below about two blocks worth of samples, building an index isnt worth it.
+  if( !answer && (sample_nums.size() < 2*SampleSumIndex::sm_blockSize) )
+    return sum_measurements( sample_nums, det_names, energy_cal );
+  
+  if( !answer )
+  {
+    // Either no index yet, or the file has been changed since it was made; (re)build it.
+    index = SampleSumIndex::create( *this, key );
+    
+    if( m_sampleSumIndexes.size() >= 4 )
+      m_sampleSumIndexes.clear();
+    
+    if( index )
+      m_sampleSumIndexes[key] = index;
+    else
+      m_sampleSumIndexes.erase( key );
+    
+    if( index && (index->energy_cal == energy_cal) )
+      answer = index->sum( *this, sample_nums );
+  }//if( !answer )
+  
+  if( !answer )
+    answer = sum_measurements( sample_nums, det_names, energy_cal );
+  
+  return answer;
+}//sum_measurements_indexed(...)
+
+
+std::set<int> SpecMeas::appendMeasurements( const std::vector<std::shared_ptr<SpecUtils::Measurement>> &meas )
+{
+  set<int> added_samples;
+  
+  std::lock_guard<std::recursive_mutex> scoped_lock( mutex_ );
+  
+  // Shift the sample numbers of the new records, keeping their relative order, to follow the last
+  //  sample currently in the file.
+  int min_new_sample = std::numeric_limits<int>::max();
+  for( const shared_ptr<SpecUtils::Measurement> &m : meas )
+  {
+    if( m )
+      min_new_sample = std::min( min_new_sample, m->sample_number() );
+  }
+  
+  if( min_new_sample == std::numeric_limits<int>::max() )
+    return added_samples;
+  
+  const set<int> &current_samples = sample_numbers();
+  const int first_new_sample = current_samples.empty() ? 1 : ((*current_samples.rbegin()) + 1);
+  
+  for( const shared_ptr<SpecUtils::Measurement> &m : meas )
+  {
+    if( !m )
+      continue;
+    
+    const int sample = first_new_sample + (m->sample_number() - min_new_sample);
+    m->set_sample_number( sample );
+    added_samples.insert( sample );
+    add_measurement( m, false );
+  }//for( const shared_ptr<SpecUtils::Measurement> &m : meas )
+  
+  cleanup_after_load( SpecUtils::SpecFile::DontChangeOrReorderSamples );
+  
+  // Extend the running-sum indexes with just the new samples, rather than letting the next
+  //  sum_measurements_indexed(...) call re-build them from scratch.
+  for( auto iter = begin(m_sampleSumIndexes); iter != end(m_sampleSumIndexes); )
+  {
+    if( iter->second && iter->second->append( *this, added_samples ) )
+      ++iter;
+    else
+      iter = m_sampleSumIndexes.erase( iter );
+  }//for( loop over sum indexes )
+  
+  return added_samples;
+}//appendMeasurements(...)
+
+
 SpecUtils::DetectorType SpecMeas::guessDetectorTypeFromFileName( std::string name )
 {
   SpecUtils::to_lower_ascii( name );
@@ -2162,6 +3105,94 @@ void SpecMeas::setModified()
 }
 
 
+uint64_t SpecMeas::xxh64( const void *data, const size_t len, const uint64_t seed )
+{
+  return ::xxh64( data, len, seed );
+}//uint64_t SpecMeas::xxh64(...)
+
+
+uint64_t SpecMeas::contentHash( const SpecUtils::Measurement &meas, const HashScope scope )
+{
+  uint64_t hash = static_cast<uint64_t>( scope );
+  
+  if( scope != HashScope::Calibration )
+  {
+    hash_value_into( hash, cached_counts_hash( meas.gamma_counts() ) );
+    hash_value_into( hash, meas.live_time() );
+    hash_value_into( hash, meas.real_time() );
+  }//if( include counts )
+  
+  if( scope != HashScope::Counts )
+  {
+    const shared_ptr<const SpecUtils::EnergyCalibration> cal = meas.energy_calibration();
+    if( cal )
+    {
+      hash_value_into( hash, static_cast<int>(cal->type()) );
+      hash_value_into( hash, cal->num_channels() );
+      const vector<float> &coefs = cal->coefficients();
+      if( !coefs.empty() )
+        hash = xxh64( coefs.data(), coefs.size()*sizeof(float), hash );
+      for( const pair<float,float> &dev : cal->deviation_pairs() )
+      {
+        hash_value_into( hash, dev.first );
+        hash_value_into( hash, dev.second );
+      }
+    }//if( cal )
+  }//if( include calibration )
+  
+  if( scope == HashScope::Full )
+  {
+    const vector<float> &neutrons = meas.neutron_counts();
+    if( !neutrons.empty() )
+      hash = xxh64( neutrons.data(), neutrons.size()*sizeof(float), hash );
+    hash_value_into( hash, meas.sample_number() );
+    const string &detname = meas.detector_name();
+    hash = xxh64( detname.data(), detname.size(), hash );
+    hash_value_into( hash, meas.start_time().time_since_epoch().count() );
+  }//if( scope == HashScope::Full )
+  
+  return hash;
+}//uint64_t contentHash( const SpecUtils::Measurement &, const HashScope )
+
+
+uint64_t SpecMeas::contentHash( const HashScope scope ) const
+{
+  uint64_t hash = static_cast<uint64_t>( scope );
+  
+  for( const shared_ptr<const SpecUtils::Measurement> &meas : measurements() )
+  {
+    if( meas )
+      hash_value_into( hash, contentHash( *meas, scope ) );
+  }
+  
+  if( (scope == HashScope::Full) && m_peaks )
+  {
+    for( const SampleNumsToPeakMap::value_type &samples_peaks : *m_peaks )
+    {
+      for( const int sample : samples_peaks.first )
+        hash_value_into( hash, sample );
+      
+      if( !samples_peaks.second )
+        continue;
+      
+      for( const shared_ptr<const PeakDef> &peak : *samples_peaks.second )
+      {
+        if( !peak )
+          continue;
+        
+        hash_value_into( hash, peak->mean() );
+        hash_value_into( hash, peak->sigma() );
+        hash_value_into( hash, peak->amplitude() );
+        hash_value_into( hash, peak->lowerX() );
+        hash_value_into( hash, peak->upperX() );
+      }//for( loop over peaks )
+    }//for( loop over sample number sets )
+  }//if( include peaks )
+  
+  return hash;
+}//uint64_t contentHash( const HashScope scope ) const
+
+
 long long int SpecMeas::dbStateId( const set<int> &samplenums ) const
 {
   const auto pos = m_dbUserStateIndexes.find(samplenums);
@@ -2206,6 +3237,19 @@ void SpecMeas::cleanup_after_load( const unsigned int flags )
   {
     SpecFile::cleanup_after_load( flags );
   }
+  
+  // Share calibrations with any identical ones already loaded; this isnt a change to the data, so
+  //  we'll preserve the modified flags.
+  const bool was_modified = modified_, was_modified_since_decode = modifiedSinceDecode_;
+  for( const shared_ptr<const SpecUtils::Measurement> &meas : measurements() )
+  {
+    const shared_ptr<const SpecUtils::EnergyCalibration> cal = meas ? meas->energy_calibration() : nullptr;
+    const shared_ptr<const SpecUtils::EnergyCalibration> interned = intern_energy_cal( cal );
+    if( interned != cal )
+      SpecFile::set_energy_calibration( interned, meas );
+  }
+  modified_ = was_modified;
+  modifiedSinceDecode_ = was_modified_since_decode;
 
   //should detect if the detector was loaded, and if not, if we know the type,
   //  we could then load it.
@@ -110,6 +110,7 @@
 
 
 #include "InterSpec/MakeDrf.h"
+#include "InterSpec/PerfTrace.h"
 #include "InterSpec/DrfChart.h"
 #include "InterSpec/SpecMeas.h"
 #include "InterSpec/PopupDiv.h"
@@ -1359,7 +1360,15 @@ SpecMeasManager::SpecMeasManager( InterSpec *viewer )
     m_destructed( new bool(false) ),
     m_previousStatesDialog( nullptr ),
     m_processingUploadDialog( nullptr ),
-    m_processingUploadTimer{}
+    m_processingUploadTimer{},
+    m_nextParseSequence( 0 ),
+    m_nextParseToDisplay( 0 ),
+    m_parsedAwaitingDisplay{}
+#if( USE_DB_TO_STORE_SPECTRA )
+    , m_pendingDbSaves{},
+    m_dbSaveScheduled( false ),
+    m_dbSavesInFlight{}
+#endif
 {
   std::unique_ptr<UndoRedoManager::BlockUndoRedoInserts> undo_blocker;
   if( viewer && viewer->undoRedoManager() )
@@ -1517,6 +1526,19 @@ void  SpecMeasManager::startSpectrumManager()
 
 SpecMeasManager::~SpecMeasManager()
 {
+#if( USE_DB_TO_STORE_SPECTRA )
+  try
+  {
+    // We wont get notified of saves finishing anymore, so dont hold any pending saves back; saves
+    //  to the same file still wont run at the same time (see SpectraFileHeader::saveToDatabase).
+    m_dbSavesInFlight.clear();
+    flushPendingDbSaves();
+  }catch( std::exception &e )
+  {
+    cerr << "SpecMeasManager::~SpecMeasManager(): error flushing pending saves: " << e.what() << endl;
+  }
+#endif
+  
   std::lock_guard<std::mutex> lock( *m_destructMutex );
   
   (*m_destructed) = true;
@@ -1581,12 +1603,10 @@ void SpecMeasManager::extractAndOpenFromZip( const std::string &spoolName,
     const string tmppath = SpecUtils::temp_dir();
     string tmpfile = SpecUtils::temp_file_name( "", tmppath );
     
-    ifstream zipfilestrm( spoolName.c_str(), ios::in | ios::binary );
+    const ZipArchive::MappedZipFile zipfile( spoolName );
     
-    ZipArchive::FilenameToZipHeaderMap headers
-                                    = ZipArchive::open_zip_file( zipfilestrm );
-    
-    if( !headers.count(fileInZip) )
+    const shared_ptr<const ZipArchive::ZipFileHeader> header = zipfile.header( fileInZip );
+    if( !header )
       throw runtime_error( "Couldnt find file in zip" );
 
     size_t nbytewritten = 0;
@@ -1598,7 +1618,7 @@ void SpecMeasManager::extractAndOpenFromZip( const std::string &spoolName,
 #else
       ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
 #endif
-      nbytewritten = read_file_from_zip( zipfilestrm, headers[fileInZip], tmpfilestrm );
+      nbytewritten = zipfile.read_file( *header, tmpfilestrm );
     }
     
     handleFileDropWorker( fileInZip, tmpfile, type, nullptr, wApp );
@@ -1638,9 +1658,9 @@ bool SpecMeasManager::handleZippedFile( const std::string &name,
     app->useStyleSheet("InterSpec_resources/SpecMeasManager.css");
 
 
-    ifstream zipfilestrm( spoolName.c_str(), ios::in | ios::binary );
-    
-    ZipArchive::FilenameToZipHeaderMap headers = ZipArchive::open_zip_file( zipfilestrm );
+    // Only the central directory is read here; the entry the user selects gets extracted later
+    const ZipArchive::MappedZipFile zipfile( spoolName );
+    const ZipArchive::FilenameToZipHeaderMap &headers = zipfile.headers();
     
     
     vector<string> filenames;
@@ -3399,12 +3419,17 @@ void SpecMeasManager::handleFileDrop( const std::string &name,
   if( m_previousStatesDialog )
     handleCancelPreviousStatesDialog( m_previousStatesDialog );
   
+  // Multiple files dropped at once may finish parsing out of order, so we will display them in the
+  //  order they were dropped.
+  const size_t seq = m_nextParseSequence++;
+  
   // If file is small, and not csv/txt (these are really slow to parse), dont display the parsing
   //  message.
   if( (SpecUtils::file_size(spoolName) < 512*1024)
      && !SpecUtils::iends_with(name, ".csv") && !SpecUtils::iends_with(name, ".txt") )
   {
-    handleFileDropWorker( name, spoolName, type, nullptr, wApp );
+    displayParsedInOrder( seq, boost::bind( &SpecMeasManager::handleFileDropWorker, this,
+                                            name, spoolName, type, nullptr, wApp ) );
     return;
   }
   
@@ -3414,18 +3439,191 @@ void SpecMeasManager::handleFileDrop( const std::string &name,
   
   wApp->triggerUpdate();
   
-// When using WServer::instance()->post(...) it seems the "Parsing File" isnt always shown, but
-//  posting to the ioService and explicitly taking the WApplication::UpdateLock seems to work a
-//  little more reliable - I didnt look into why this is, or how true it is
-//  WServer::instance()->post( wApp->sessionId(),
-//                             boost::bind( &SpecMeasManager::handleFileDropWorker, this,
-//                                          name, spoolName, type, dialog, wApp ) );
+  // We parse the file on the io_service thread-pool, without holding the WApplication::UpdateLock,
+  //  so the session stays responsive (and so multiple dropped files are parsed concurrently), and
+  //  then post back to the session to actually display it.
+  const string sessionId = wApp->sessionId();
+  const std::shared_ptr<bool> destructed = m_destructed;
   
-  WServer::instance()->ioService().boost::asio::io_service::post( boost::bind( &SpecMeasManager::handleFileDropWorker, this,
-                                                    name, spoolName, type, dialog, wApp ) );
+  WServer::instance()->ioService().boost::asio::io_service::post( [=](){
+    const bool is_zip = ((name.length() > 4)
+                         && SpecUtils::iequals_ascii( name.substr(name.length()-4), ".zip"));
+    
+    shared_ptr<SpecMeas> meas;
+    if( !is_zip )
+      meas = parseFileWorker( name, spoolName );
+    
+    WServer::instance()->post( sessionId, [=](){
+      if( *destructed )
+        return;
+      
+      displayParsedInOrder( seq, boost::bind( &SpecMeasManager::finishFileDrop, this,
+                                              name, spoolName, type, dialog, meas ) );
+      
+      WApplication *app = WApplication::instance();
+      if( app )
+        app->triggerUpdate();
+    } );
+  } );
 }//handleFileDrop(...)
 
 
+std::shared_ptr<SpecMeas> SpecMeasManager::parseFileWorker( const std::string &displayName,
+                                                            const std::string &path )
+{
+  INTERSPEC_TRACE_SCOPE( "SpecMeasManager::parseFileWorker" );
+  
+  try
+  {
+    if( !SpecUtils::is_file(path) )
+      return nullptr;
+    
+    auto meas = make_shared<SpecMeas>();
+    if( meas->load_file( path, SpecUtils::ParserType::Auto, SpecUtils::file_extension(displayName) ) )
+      return meas;
+  }catch( std::exception &e )
+  {
+    cerr << "SpecMeasManager::parseFileWorker('" << displayName << "'): caught exception: "
+         << e.what() << endl;
+  }//try / catch
+  
+  return nullptr;
+}//parseFileWorker(...)
+
+
+void SpecMeasManager::displayParsedInOrder( const size_t seq, boost::function<void()> display )
+{
+  assert( seq >= m_nextParseToDisplay );
+  assert( !m_parsedAwaitingDisplay.count(seq) );
+  
+  m_parsedAwaitingDisplay[seq] = display;
+  
+  while( !m_parsedAwaitingDisplay.empty()
+        && (m_parsedAwaitingDisplay.begin()->first == m_nextParseToDisplay) )
+  {
+    const boost::function<void()> f = m_parsedAwaitingDisplay.begin()->second;
+    m_parsedAwaitingDisplay.erase( m_parsedAwaitingDisplay.begin() );
+    ++m_nextParseToDisplay;
+    
+    try
+    {
+      if( f )
+        f();
+    }catch( std::exception &e )
+    {
+      cerr << "SpecMeasManager::displayParsedInOrder(): caught exception: " << e.what() << endl;
+    }
+  }//while( the next file to display has finished parsing )
+}//void displayParsedInOrder( const size_t seq, boost::function<void()> display )
+
+
+void SpecMeasManager::finishFileDrop( const std::string &name,
+                                      const std::string &spoolName,
+                                      const SpecUtils::SpectrumType type,
+                                      SimpleDialog *dialog,
+                                      std::shared_ptr<SpecMeas> meas )
+{
+  if( !meas )
+  {
+    // Either a zip file, or we couldnt parse it as a spectrum file; let handleFileDropWorker try
+    //  the zip-file and non-spectrum-file handling (for a non-zip file this will attempt to parse
+    //  the file a second time, but this is only on failure).
+    handleFileDropWorker( name, spoolName, type, dialog, wApp );
+    return;
+  }//if( !meas )
+  
+  if( dialog )
+    dialog->accept();
+  
+  try
+  {
+    auto header = std::make_shared<SpectraFileHeader>( m_viewer->m_user, false, m_viewer );
+    header->setFile( name, meas );
+    
+    addToTempSpectrumInfoCache( meas );
+    
+    const int modelRow = m_fileModel->addRow( header );
+    
+    displayFile( modelRow, meas, type, true, true,
+                SpecMeasManager::VariantChecksToDo::DerivedDataAndMultiEnergyAndMultipleVirtualDets );
+  }catch( std::exception &e )
+  {
+    displayInvalidFileMsg( name, e.what() );
+  }
+  
+  wApp->triggerUpdate();
+}//void finishFileDrop(...)
+
+
+void SpecMeasManager::openFilesFromFilesystem( const std::vector<std::string> &paths )
+{
+  WApplication *app = WApplication::instance();
+  
+  if( (paths.size() < 2) || !app )
+  {
+    for( const string &path : paths )
+      m_viewer->userOpenFileFromFilesystem( path );
+    return;
+  }//if( only a single file )
+  
+  // Status dialog, updated as each file finishes parsing; only accessed from the session thread.
+  auto dialog = new SimpleDialog( WString::tr("smm-window-title-parsing") );
+  WText *status = new WText( WString::tr("smm-parsed-n-of-m-files").arg(0).arg( static_cast<int>(paths.size()) ),
+                             dialog->contents() );
+  status->addStyleClass( "content" );
+  
+  const std::shared_ptr<size_t> num_parsed = std::make_shared<size_t>( 0 );
+  const size_t num_files = paths.size();
+  const string sessionId = app->sessionId();
+  const std::shared_ptr<bool> destructed = m_destructed;
+  
+  for( const string &path : paths )
+  {
+    const size_t seq = m_nextParseSequence++;
+    const string displayName = SpecUtils::filename( path );
+    
+    WServer::instance()->ioService().boost::asio::io_service::post( [=](){
+      const shared_ptr<SpecMeas> meas = parseFileWorker( displayName, path );
+      
+      WServer::instance()->post( sessionId, [=](){
+        if( *destructed )
+          return;
+        
+        *num_parsed += 1;
+        if( *num_parsed < num_files )
+          status->setText( WString::tr("smm-parsed-n-of-m-files")
+                            .arg( static_cast<int>(*num_parsed) ).arg( static_cast<int>(num_files) ) );
+        else
+          dialog->accept();
+        
+        displayParsedInOrder( seq, [=](){
+          if( !meas )
+          {
+            displayInvalidFileMsg( displayName, "Could not open '" + displayName
+                                   + "' with any of the available decoders, sorry." );
+            return;
+          }
+          
+          try
+          {
+            m_viewer->userOpenFile( meas, displayName );
+          }catch( std::exception &e )
+          {
+            displayInvalidFileMsg( displayName, e.what() );
+          }
+        } );
+        
+        WApplication *wtapp = WApplication::instance();
+        if( wtapp )
+          wtapp->triggerUpdate();
+      } );
+    } );
+  }//for( const string &path : paths )
+  
+  app->triggerUpdate();
+}//void openFilesFromFilesystem( const std::vector<std::string> &paths )
+
+
 #if( USE_QR_CODES )
 void SpecMeasManager::handleSpectrumUrl( std::string &&unencoded )
 {
@@ -5442,17 +5640,139 @@ void SpecMeasManager::saveToDatabase(
     if( !header->shouldSaveToDb() )
       return;
     
+    // Rapid successive changes (e.g., fitting peaks, or tweaking the energy calibration) can each
+    //  request a save; we coalesce these into a single write, after sm_dbWriteBehindMs.
     std::shared_ptr<SpecMeas> meas = header->parseFile();
-    boost::function<void(void)> worker
-                      = wApp->bind( boost::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header ) );
-    WServer::instance()->post( wApp->sessionId(), worker );
+    m_pendingDbSaves[header] = meas;
     
-//    boost::function<void(void)> worker = boost::bind( &SpectraFileHeader::saveToDatabaseWorker, meas, header );
-//    WServer::instance()->ioService().boost::asio::io_service::post( worker );
-  }//if( headermeas && (headermeas==meas) )
+    scheduleDbSaveFlush();
+  }//if( !!header )
 }//void saveToDatabase( std::shared_ptr<const SpecMeas> meas ) const
 
 
+void SpecMeasManager::scheduleDbSaveFlush() const
+{
+  if( m_dbSaveScheduled || !wApp )
+    return;
+  
+  m_dbSaveScheduled = true;
+  const std::shared_ptr<bool> destructed = m_destructed;
+  WServer::instance()->schedule( sm_dbWriteBehindMs, wApp->sessionId(), [this,destructed](){
+    if( *destructed )
+      return;
+    
+    try
+    {
+      flushPendingDbSaves();
+    }catch( std::exception &e )
+    {
+      cerr << "SpecMeasManager::flushPendingDbSaves() caught: " << e.what() << endl;
+    }
+  } );
+}//void scheduleDbSaveFlush() const
+
+
+void SpecMeasManager::flushPendingDbSaves() const
+{
+  m_dbSaveScheduled = false;
+  
+  if( m_pendingDbSaves.empty() )
+    return;
+  
+  struct SnapshotToSave
+  {
+    shared_ptr<SpecMeas> snapshot;
+    shared_ptr<SpecMeas> meas;
+    shared_ptr<SpectraFileHeader> header;
+  };//struct SnapshotToSave
+  
+  vector<SnapshotToSave> snapshots;
+  
+  for( auto iter = begin(m_pendingDbSaves); iter != end(m_pendingDbSaves); )
+  {
+    const shared_ptr<SpectraFileHeader> header = iter->first;
+    const shared_ptr<SpecMeas> meas = iter->second;
+    
+    // If a previous save of this file hasnt finished, we'll wait for it, so saves of a file are
+    //  written in order, and a file isnt inserted into the database twice; when it finishes,
+    //  another flush will be scheduled.
+    if( m_dbSavesInFlight.count( header ) )
+    {
+      ++iter;
+      continue;
+    }
+    
+    iter = m_pendingDbSaves.erase( iter );
+    
+    if( !meas || !header->shouldSaveToDb() )
+      continue;
+    
+    // Nothing to write if its already in the database, and unchanged since.
+    if( header->dbEntry() && !meas->modified() )
+      continue;
+    
+    // Serialize from a copy, so the user can keep modifying the spectrum while we write.  We
+    //  mark the in-memory spectrum as not modified now; any further changes will mark it as
+    //  modified again, and so be picked up by a later save.  If the save fails, we mark it as
+    //  modified again (see #dbSaveFinished).
+    auto snapshot = make_shared<SpecMeas>();
+    snapshot->uniqueCopyContents( *meas );
+    meas->reset_modified();
+    
+    m_dbSavesInFlight.insert( header );
+    snapshots.push_back( {snapshot, meas, header} );
+  }//for( loop over m_pendingDbSaves )
+  
+  if( snapshots.empty() )
+    return;
+  
+  // Files are written one after another, in a single io_service task; each keeps its own database
+  //  transaction so that a failure saving one file does not roll back the others.  The result of
+  //  each save is posted back to this session.
+  const string sessionId = wApp ? wApp->sessionId() : string();
+  const std::shared_ptr<bool> destructed = m_destructed;
+  
+  WServer::instance()->ioService().boost::asio::io_service::post( [this,snapshots,sessionId,destructed](){
+    for( const SnapshotToSave &to_save : snapshots )
+    {
+      const bool saved = SpectraFileHeader::saveToDatabaseWorker( to_save.snapshot, to_save.header );
+      
+      if( sessionId.empty() )
+        continue;
+      
+      const shared_ptr<SpecMeas> meas = to_save.meas;
+      const shared_ptr<SpectraFileHeader> header = to_save.header;
+      WServer::instance()->post( sessionId, [this,destructed,meas,header,saved](){
+        if( !(*destructed) )
+          dbSaveFinished( header, meas, saved );
+      } );
+    }//for( const SnapshotToSave &to_save : snapshots )
+  } );
+}//void flushPendingDbSaves() const
+
+
+void SpecMeasManager::dbSaveFinished( std::shared_ptr<SpectraFileHeader> header,
+                                      std::shared_ptr<SpecMeas> meas,
+                                      const bool saved ) const
+{
+  m_dbSavesInFlight.erase( header );
+  
+  if( !saved && meas && !meas->modified() )
+  {
+    // The snapshot wasnt written, so the in-memory spectrum still needs saving; setModified()
+    //  also marks it as modified-since-decode, so we'll restore that flag.
+    const bool modified_since_decode = meas->modified_since_decode();
+    meas->setModified();
+    if( !modified_since_decode )
+      meas->reset_modified_since_decode();
+  }//if( save failed )
+  
+  // Saves requested while this one was being written, were held back; write them now.
+  if( m_pendingDbSaves.count( header ) )
+    scheduleDbSaveFlush();
+}//void dbSaveFinished(...)
+
+
 int SpecMeasManager::setDbEntry( Wt::Dbo::ptr<UserFileInDb> dbfile,
                                  std::shared_ptr<SpectraFileHeader> &header,
                                  std::shared_ptr<SpecMeas> &measurement,
@@ -5938,6 +6258,29 @@ void SpecMeasManager::clearTempSpectrumInfoCache()
 } // void SpecMeasManager::clearTempSpectrumInfoCache()
 
 
+void SpecMeasManager::releaseIdleMemory()
+{
+  clearTempSpectrumInfoCache();
+  
+#if( USE_DB_TO_STORE_SPECTRA )
+  flushPendingDbSaves();
+#endif
+  
+  const SpecUtils::SpectrumType types[] = {
+    SpecUtils::SpectrumType::Foreground,
+    SpecUtils::SpectrumType::Background,
+    SpecUtils::SpectrumType::SecondForeground
+  };
+  
+  for( const SpecUtils::SpectrumType type : types )
+  {
+    const shared_ptr<SpecMeas> meas = m_viewer->measurment( type );
+    if( meas )
+      meas->clearSumIndexes();
+  }
+}//void releaseIdleMemory()
+
+
 void SpecMeasManager::serializeToTempFile( std::shared_ptr<const SpecMeas> meas ) const
 {
   for( int row = 0; row < m_fileModel->rowCount(); ++row )
@@ -6347,6 +6690,7 @@ void SpecMeasManager::finishSaveSnapshotInDb(
         transaction.rollback();
       }//try / catch
     
+      data->moveDataToBlobStore( *m_sql->session() );
       Dbo::ptr<UserFileInDbData> dataptr = m_sql->session()->add( data );
       
       UserFileInDb::makeWriteProtected( dbptr );
@@ -72,6 +72,8 @@
 #include <Wt/WAbstractItemModel>
 
 #include "InterSpec/PeakDef.h"
+#include "InterSpec/PerfTrace.h"
+#include "InterSpec/ServerMetrics.h"
 #include "SpecUtils/SpecFile.h"
 #include "InterSpec/PopupDiv.h"
 #include "InterSpec/SpecMeas.h"
@@ -83,7 +85,6 @@
 #include "InterSpec/InterSpecUser.h"
 #include "InterSpec/DataBaseUtils.h"
 #include "InterSpec/WarningWidget.h"
-#include "SpecUtils/SpecUtilsAsync.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "InterSpec/SpectraFileModel.h"
 #include "InterSpec/RowStretchTreeView.h"
@@ -158,6 +159,13 @@ SpectraHeader::SpectraHeader( const std::vector<std::shared_ptr<const SpecUtils:
 
 
 void SpectraHeader::init( const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &measurements )
+{
+  init_summary( measurements );
+  init_details( measurements );
+}//void init(...)
+
+
+void SpectraHeader::init_summary( const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &measurements )
 {
   live_time = real_time = 0.0;
   contained_neutron_ = false;
@@ -173,11 +181,32 @@ void SpectraHeader::init( const std::vector<std::shared_ptr<const SpecUtils::Mea
     contained_neutron_ |= m->contained_neutron();
     gamma_counts_ += m->gamma_count_sum();
     neutron_counts_ += m->neutron_counts_sum();
-    detector_names.push_back( m->detector_name() );
-    detector_numbers_.push_back( m->detector_number() );
     spectra_type = m->source_type();
     if( m->derived_data_properties() )
       is_derived_data = true;
+    sample_number = m->sample_number();
+  }//for( std::shared_ptr<const SpecUtils::Measurement> &m : measurements )
+
+  if( !measurements.empty() )
+  {
+    live_time /= measurements.size();
+    real_time /= measurements.size();
+  }
+}//void init_summary(...)
+
+
+void SpectraHeader::init_details( const std::vector<std::shared_ptr<const SpecUtils::Measurement>> &measurements )
+{
+  speed_ = WString();
+  detector_names.clear();
+  detector_numbers_.clear();
+  remarks.clear();
+  start_time = WDateTime();
+  
+  for( const std::shared_ptr<const SpecUtils::Measurement> &m : measurements )
+  {
+    detector_names.push_back( m->detector_name() );
+    detector_numbers_.push_back( m->detector_number() );
 
     for( size_t i = 0; i < m->remarks().size(); ++i )
     {
@@ -210,13 +239,9 @@ void SpectraHeader::init( const std::vector<std::shared_ptr<const SpecUtils::Mea
     char buffer[32];
     snprintf( buffer, sizeof(buffer), "%.1f m/s", m->speed() );
     speed_ = buffer;
-    sample_number = m->sample_number();
     start_time = WDateTime::fromPosixTime( to_ptime( m->start_time() ) );
   }//for( std::shared_ptr<const SpecUtils::Measurement> &m : measurements )
-
-  live_time /= measurements.size();
-  real_time /= measurements.size();
-}//SpectraHeader constructor
+}//void init_details(...)
 
 
 SpectraHeader::~SpectraHeader()
@@ -340,7 +365,7 @@ std::shared_ptr<SpecMeas> SpectraFileHeader::resetFromDatabase(
   }//end interaction with Database
  
   RecursiveLock lock( m_mutex );
-  std::shared_ptr<SpecMeas> memobj = dbdata->decodeSpectrum();
+  std::shared_ptr<SpecMeas> memobj = dbdata->decodeSpectrum( *m_sql );
   setMeasurmentInfo( memobj );
   
   m_displayName = info->filename;
@@ -491,16 +516,23 @@ void SpectraFileHeader::saveToDatabaseFromTempFileWorker() const
 }//saveToDatabaseFromTempFileWorker(...)
 
 
-void SpectraFileHeader::saveToDatabaseWorker(
+bool SpectraFileHeader::saveToDatabaseWorker(
                             std::shared_ptr<SpecMeas> measurment,
                             std::shared_ptr<SpectraFileHeader> header )
 {
+  INTERSPEC_TRACE_SCOPE( "SpectraFileHeader::saveToDatabaseWorker" );
+  static ServerMetrics::Histogram &save_durations = ServerMetrics::histogram( "interspec_db_save_duration_seconds",
+                                            "Time taken to write to the database.", "type=\"spectrum_file\"" );
+  const ServerMetrics::ScopedLatency save_latency( save_durations );
+  
   string msg;
   WarningWidget::WarningMsgLevel level = WarningWidget::WarningMsgInfo;
+  bool saved = false;
   
   try
   {
     SpectraFileHeader::saveToDatabase( measurment, header );
+    saved = true;
   }catch( FileToLargeForDbException &e )
   {
     msg = error_saving_spectrum_size_msg;
@@ -518,6 +550,7 @@ void SpectraFileHeader::saveToDatabaseWorker(
       }
     
       SpectraFileHeader::saveToDatabase( measurment, header );
+      saved = true;
       
       msg = error_saving_spectrum_stale_msg;
       level = WarningWidget::WarningMsgInfo;
@@ -537,7 +570,9 @@ void SpectraFileHeader::saveToDatabaseWorker(
   
   if( !header->m_appId.empty() && msg.size() )
     postMessageToApp( msg, level, header->m_appId );
-}//void saveToDatabaseWorker( std::shared_ptr<SpecMeas> measurment )
+  
+  return saved;
+}//bool saveToDatabaseWorker( std::shared_ptr<SpecMeas> measurment )
 
 
 void SpectraFileHeader::saveToDatabaseFromTempFile() const
@@ -602,8 +637,14 @@ void SpectraFileHeader::saveToDatabaseFromTempFile() const
                             .where( "UserFileInDb_id = ?" )
                             .bind( data.id() );
     if( data )
+    {
+      const string prevBlobHash = data->blobHash;
       data.modify()->setFileData( m_fileSystemLocation,
                                UserFileInDbData::sm_defaultSerializationFormat );
+      data.modify()->moveDataToBlobStore( *m_sql->session() );
+      if( prevBlobHash != data->blobHash )
+        UserFileInDbData::removeBlobIfUnreferenced( *m_sql->session(), prevBlobHash );
+    }
     transaction.commit();
   }catch( FileToLargeForDbException &e )
   {
@@ -670,21 +711,33 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
   if( !input )
     throw runtime_error( "\n\n\nSpectraFileHeader::saveToDatabase(): !input" );
   
+  // Only one save of this file at a time, so the second of two saves started before the file was
+  //  in the database will see the entry the first one made, rather than inserting another.
+  std::lock_guard<std::mutex> save_lock( m_dbSaveMutex );
+  
   std::shared_ptr<const SpecMeas> meas;
+  
+  //`input` is either the in-memory SpecMeas of this header, or an immutable snapshot (deep copy) of
+  //  it, made by SpecMeasManager::flushPendingDbSaves(), so it can be serialized off of the session
+  //  thread while the user keeps modifying the in-memory SpecMeas.
+  bool isSnapshot = false;
  
   {
     RecursiveLock lock( m_mutex );
     meas = m_weakMeasurmentPtr.lock();
-  
-    if( !m_weakMeasurmentPtr.expired() && meas != m_weakMeasurmentPtr.lock() )
-      throw runtime_error( "SpectraFileHeader::saveToDatabase(): meas != m_weakMeasurmentPtr" );
+    
+    if( input != meas )
+    {
+      isSnapshot = true;
+      meas = input;
+    }
   
     if( !m_user || !m_user.session() )
       throw runtime_error( "SpectraFileHeader::saveToDatabase(): !m_user || !m_user.session()" );
   }
   
-  //In principle we should take a recursive mutex lock on meas for this entire function
-  //  or do a deep copy...
+  //If not a snapshot, in principle we should take a recursive mutex lock on meas for this entire
+  //  function...
   
 #if( PERFORM_DEVELOPER_CHECKS && SpecUtils_ENABLE_EQUALITY_CHECKS )
   {//begin code block to do check
@@ -773,6 +826,7 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
       DataBaseUtils::DbTransaction transaction( *m_sql );
       fileDbEntry = m_sql->session()->add( info_dbo_ptr );
       data->fileInfo = fileDbEntry;
+      data->moveDataToBlobStore( *m_sql->session() );
       Dbo::ptr<UserFileInDbData> dataPtr = m_sql->session()->add( data_dbo_ptr );
       transaction.commit();
     }
@@ -832,8 +886,12 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
       try
       {
         DataBaseUtils::DbTransaction transaction( *m_sql );
+        const string prevBlobHash = data->blobHash;
+        newdata.moveDataToBlobStore( *m_sql->session() );
         (*data.modify()) = newdata;
         fileDbEntry.modify()->userHasModified = modifiedSinceDecode;
+        if( prevBlobHash != newdata.blobHash )
+          UserFileInDbData::removeBlobIfUnreferenced( *m_sql->session(), prevBlobHash );
         transaction.commit();
       }catch( std::exception &e )
       {
@@ -883,6 +941,7 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
       }//try / catch
       
       DataBaseUtils::DbTransaction transaction( *m_sql );
+      dataptr->moveDataToBlobStore( *m_sql->session() );
       data = m_sql->session()->add( dataptr );
       cerr << "Adding spectrum to the database as id " << data.id() << " to parent " << m_fileDbEntry.id() << endl;
       transaction.commit();
@@ -913,6 +972,9 @@ void SpectraFileHeader::saveToDatabase( std::shared_ptr<const SpecMeas> input )
   }
   
   
+  //If we saved a snapshot, the in-memory SpecMeas was already marked non-modified when the
+  //  snapshot was made, and may have been modified since.
+  if( !isSnapshot )
   {
     std::shared_ptr<SpecMeas> ncmeas;
   
@@ -963,7 +1025,7 @@ std::shared_ptr<SpecMeas> SpectraFileHeader::readFromDataBase() const
     transaction.commit();
   }//end interaction with db
   
-  std::shared_ptr<SpecMeas> meas = data->decodeSpectrum();
+  std::shared_ptr<SpecMeas> meas = data->decodeSpectrum( *m_sql );
 
   if( meas )
     cerr << "Read spectrumFile from database" << endl;
@@ -1212,38 +1274,6 @@ void SpectraFileHeader::saveToFileSystem( std::shared_ptr<SpecMeas> measurment )
 }//void saveToFileSystem()
 
 
-struct SpectraHeaderMaker
-{
-  std::shared_ptr<const SpecMeas> m_info;
-  vector<SpectraHeader>::iterator m_headerPos;  //expects m_headerPos through m_headerPos+m_samplenums->size()-1 to be allocated and assinable
-  vector<int>::const_iterator m_sampleNumBegin;
-  vector<int>::const_iterator m_sampleNumEnd;
-
-  SpectraHeaderMaker( std::shared_ptr<const SpecMeas> info,
-                      vector<int>::const_iterator sample_num_begin,
-                      vector<int>::const_iterator sample_num_end,
-                      vector<SpectraHeader>::iterator headerpos )
-    : m_info( info ), m_headerPos( headerpos ),
-      m_sampleNumBegin( sample_num_begin ), m_sampleNumEnd( sample_num_end )
-  {
-  }
-
-  void operator()()
-  {
-    for( vector<int>::const_iterator iter = m_sampleNumBegin;
-         iter != m_sampleNumEnd;
-         ++iter )
-    {
-      const int sample = *iter;
-      vector< std::shared_ptr<const SpecUtils::Measurement> > measurements
-                                      = m_info->sample_measurements( sample );
-      m_headerPos->init( measurements );
-      ++m_headerPos;
-    }//for( const int sample_number : sample_numbers )
-  }//void operator()()
-};//struct SpectraHeaderMaker
-
-
 void SpectraFileHeader::setMeasurmentInfo( std::shared_ptr<SpecMeas> info )
 {
   RecursiveLock lock( m_mutex );
@@ -1271,65 +1301,45 @@ void SpectraFileHeader::setMeasurmentInfo( std::shared_ptr<SpecMeas> info )
   
   // Incase we are updating an already filled out entity, clear out some variables we will fill in
   m_samples.clear();
+  m_sampleDetailsComputed.clear();
   m_hasNeutronDetector = false;
   m_spectrumTime = Wt::WDateTime();
   
-  for( const int sample : sample_numbers )
-  {
-    for( const int detector : detector_numbers )
-    {
-      const std::shared_ptr<const SpecUtils::Measurement> meas = info->measurement( sample, detector );
-      //This next line is not necessary, as long as we properly initialized 'info'
-      m_hasNeutronDetector |= (meas && meas->contained_neutron());
-      if( meas && (sample == (*sample_numbers.begin())) )
-        m_spectrumTime = WDateTime::fromPosixTime( to_ptime( meas->start_time() ) );
-    }//for( const int detector : detector_numbers )
-  }//for( const int sample : sample_numbers )
-
-  const size_t nsamplenums = sample_numbers.size();
-
-
-  if( nsamplenums < 250 ) //250 is arbitrary
+  // We will only compute the summary quantities (live time, counts, source type, etc) of each
+  //  sample now, since they are cheap and needed to pick which samples to display; the
+  //  detector names, remarks, and start times are only needed when the user expands the file in
+  //  the tree view, so they are computed, per-sample, by #sampleHeader.
+  //  We'll group measurements by sample in a single pass, as calling
+  //  SpecMeas::sample_measurements(...) for each sample gets slow for files with many samples.
+  const vector<int> sample_num_vec( begin(sample_numbers), end(sample_numbers) );
+  const size_t nsamplenums = sample_num_vec.size();
+  
+  vector<vector<std::shared_ptr<const SpecUtils::Measurement>>> sample_meass( nsamplenums );
+  for( const std::shared_ptr<const SpecUtils::Measurement> &meas : info->measurements() )
   {
-    for( const int sample_number : sample_numbers )
-    {
-      vector< std::shared_ptr<const SpecUtils::Measurement> > measurements
-                                      = info->sample_measurements( sample_number );
-      m_samples.push_back( SpectraHeader( measurements ) );
-    }//for( const int sample_number : sample_numbers )
-  }else
+    if( !meas )
+      continue;
+    
+    const auto pos = std::lower_bound( begin(sample_num_vec), end(sample_num_vec), meas->sample_number() );
+    if( (pos == end(sample_num_vec)) || ((*pos) != meas->sample_number()) )
+      continue;
+    
+    sample_meass[pos - begin(sample_num_vec)].push_back( meas );
+    
+    //This next line is not necessary, as long as we properly initialized 'info'
+    m_hasNeutronDetector |= meas->contained_neutron();
+    
+    if( (pos == begin(sample_num_vec)) && m_spectrumTime.isNull() )
+      m_spectrumTime = WDateTime::fromPosixTime( to_ptime( meas->start_time() ) );
+  }//for( loop over all measurements )
+  
+  m_samples.resize( nsamplenums );
+  m_sampleDetailsComputed.resize( nsamplenums, false );
+  for( size_t i = 0; i < nsamplenums; ++i )
   {
-    //We'll do this multithreaded
-//    const vector<int> sample_num_vec( sample_numbers.begin(), sample_numbers.end() );
-    vector<int> sample_num_vec( nsamplenums );
-    std::copy( sample_numbers.begin(), sample_numbers.end(),
-               sample_num_vec.begin() );
-
-    const int nthread = SpecUtilsAsync::num_logical_cpu_cores();
-    const size_t meas_per_thread = nsamplenums / nthread;
-
-//    vector<SpectraHeaderMaker> workers;
-    SpecUtilsAsync::ThreadPool pool;
-    m_samples.resize( nsamplenums );
-
-    for( size_t pos = 0; pos < nsamplenums; pos += meas_per_thread )
-    {
-      vector<int>::const_iterator start, end;
-      start = sample_num_vec.begin() + pos;
-
-      if( (pos + meas_per_thread) <= nsamplenums )
-        end = start + meas_per_thread;
-      else
-        end = sample_num_vec.begin() + nsamplenums;
-
-      pool.post( SpectraHeaderMaker( info, start, end, m_samples.begin()+pos ) );
-//      workers.push_back(
-//                SpectraHeaderMaker( info, start, end, m_samples.begin()+pos ) );
-    }//for( size_t pos = 0; pos < nstart; pos += meas_per_thread )
-
-//    SpecUtils::do_asyncronous_work( workers, false );
-    pool.join();
-  }//if( sample_numbers.size() < 250 ) / else
+    m_samples[i].init_summary( sample_meass[i] );
+    m_samples[i].sample_number = sample_num_vec[i];
+  }
 
   if( m_keepCache )
     m_cachedMeasurement = info;
@@ -1414,6 +1424,52 @@ std::shared_ptr<SpecMeas> SpectraFileHeader::setFile(
 }//setFile(...)
 
 
+size_t SpectraFileHeader::memsize() const
+{
+  RecursiveLock lock( m_mutex );
+  
+  size_t size = sizeof(SpectraFileHeader) + m_fileSystemLocation.capacity()
+                + m_displayName.capacity() + m_uuid.capacity();
+  for( const SpectraHeader &sample : m_samples )
+    size += sizeof(SpectraHeader) + sample.remarks.capacity()
+            + sizeof(Wt::WString)*sample.detector_names.size()
+            + sizeof(int)*sample.detector_numbers_.size();
+  
+  const std::shared_ptr<SpecMeas> meas = m_cachedMeasurement ? m_cachedMeasurement
+                                                              : m_weakMeasurmentPtr.lock();
+  if( meas )
+    size += meas->memsize();
+  
+  return size;
+}//size_t memsize() const
+
+
+const SpectraHeader &SpectraFileHeader::sampleHeader( const size_t row ) const
+{
+  RecursiveLock lock( m_mutex );
+  
+  if( row >= m_samples.size() )
+    throw std::out_of_range( "SpectraFileHeader::sampleHeader: invalid row" );
+  
+  if( (row < m_sampleDetailsComputed.size()) && m_sampleDetailsComputed[row] )
+    return m_samples[row];
+  
+  std::shared_ptr<SpecMeas> meas = m_cachedMeasurement ? m_cachedMeasurement
+                                                        : m_weakMeasurmentPtr.lock();
+  if( !meas )
+    meas = parseFile();
+  
+  if( meas )
+  {
+    m_samples[row].init_details( meas->sample_measurements( m_samples[row].sample_number ) );
+    if( row < m_sampleDetailsComputed.size() )
+      m_sampleDetailsComputed[row] = true;
+  }//if( meas )
+  
+  return m_samples[row];
+}//const SpectraHeader &sampleHeader( const size_t row ) const
+
+
 std::shared_ptr<SpecMeas> SpectraFileHeader::parseFile() const
 {
   string filesystemlocation;
@@ -1690,7 +1746,7 @@ boost::any SpectraFileModel::data( const Wt::WModelIndex &index,
       return boost::any();
     }
 
-    const SpectraHeader &spectra_header = fileHeader->m_samples[row];
+    const SpectraHeader &spectra_header = fileHeader->sampleHeader( static_cast<size_t>(row) );
 
     const DisplayFields field = DisplayFields( index.column() );
     
@@ -2242,3 +2298,12 @@ Wt::WFlags<Wt::ItemFlag> SpectraFileModel::flags( const WModelIndex &/*index*/ )
   return ItemIsSelectable;
 }
 
+
+size_t SpectraFileModel::memsize() const
+{
+  size_t size = sizeof(SpectraFileModel);
+  for( const std::shared_ptr<SpectraFileHeader> &header : m_spectra )
+    size += header ? header->memsize() : size_t(0);
+  return size;
+}//size_t memsize() const
+
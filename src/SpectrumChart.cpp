@@ -26,6 +26,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <cmath>
 #include <algorithm>
 
 #include <boost/any.hpp>
@@ -1672,11 +1673,56 @@ void SpectrumChart::iterateSpectrum( SpectrumRenderIterator *iterator,
             painter.setClipPath(clipPath);
             painter.setClipping(true);
             
+            int xcolumn = series.XSeriesColumn();
+            if( xcolumn == -1 )
+              xcolumn = XSeriesColumn();
+            
+            // When there are many channels per pixel, draw through each pixel columns first, min, max,
+            //  and last values, instead of every channel; this gives an identical looking line, but
+            //  for very large spectra is much faster, and the envelope is cached between repaints.
+            const int npixels = static_cast<int>( std::ceil( maxXPx - minXPx ) );
+            const bool drawEnvelope = (!drawHist && (npixels > 0)
+                                       && (xcolumn == SpectrumDataModel::X_AXIS_COLUMN)
+                                       && ((maxRow - minRow) > 2*npixels));
+            
+            if( drawEnvelope )
+            {
+              const int column = series.modelColumn();
+              const vector<SpectrumDataModel::EnvelopeColumn> &env
+                                                    = m->envelope( column, minx, maxx, npixels );
+              
+              for( const SpectrumDataModel::EnvelopeColumn &px : env )
+              {
+                const WModelIndex firstIndex = m->index( px.first_row, column );
+                iterator->newValue( series, px.first_x, px.first_y, 0,
+                                    m->index( px.first_row, xcolumn ), firstIndex );
+                
+                //Add the min and max in the order they occurred, skipping duplicates
+                const bool minFirst = (px.min_row <= px.max_row);
+                const int rows[2] = { (minFirst ? px.min_row : px.max_row), (minFirst ? px.max_row : px.min_row) };
+                const double xs[2] = { (minFirst ? px.min_x : px.max_x), (minFirst ? px.max_x : px.min_x) };
+                const double ys[2] = { (minFirst ? px.min_y : px.max_y), (minFirst ? px.max_y : px.min_y) };
+                
+                for( int j = 0; j < 2; ++j )
+                {
+                  if( (rows[j] != px.first_row) && (rows[j] != px.last_row) && ((j == 0) || (rows[0] != rows[1])) )
+                    iterator->newValue( series, xs[j], ys[j], 0,
+                                        m->index( rows[j], xcolumn ), m->index( rows[j], column ) );
+                }
+                
+                if( px.last_row != px.first_row )
+                  iterator->newValue( series, px.last_x, px.last_y, 0,
+                                      m->index( px.last_row, xcolumn ), m->index( px.last_row, column ) );
+              }//for( loop over pixel columns )
+              
+              iterator->endSegment();
+              painter.restore();
+              continue;
+            }//if( drawEnvelope )
+            
             for( int row = minRow; row <= maxRow; ++row )
             {
-              int c = series.XSeriesColumn();
-              if( c == -1 )
-                c = XSeriesColumn();
+              const int c = xcolumn;
               const int column = series.modelColumn();
               const WModelIndex xIndex = m->index( row, c );
               const WModelIndex yIndex = m->index( row, column );
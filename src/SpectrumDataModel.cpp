@@ -76,6 +76,14 @@ SpectrumDataModel::SpectrumDataModel( Wt::WObject *parent )
     m_dataSet( this ),
     m_seriesColors{ ns_default_foreground_color, ns_default_background_color, ns_default_secondary_color }
 {
+  // Any change to rows, columns, or values invalidates the decimated views
+  dataChanged().connect( this, &SpectrumDataModel::clearEnvelopeCache );
+  modelReset().connect( this, &SpectrumDataModel::clearEnvelopeCache );
+  layoutChanged().connect( this, &SpectrumDataModel::clearEnvelopeCache );
+  rowsInserted().connect( this, &SpectrumDataModel::clearEnvelopeCache );
+  rowsRemoved().connect( this, &SpectrumDataModel::clearEnvelopeCache );
+  columnsInserted().connect( this, &SpectrumDataModel::clearEnvelopeCache );
+  columnsRemoved().connect( this, &SpectrumDataModel::clearEnvelopeCache );
 } // SpectrumDataModel constructor
 
 SpectrumDataModel::~SpectrumDataModel()
@@ -825,6 +833,95 @@ boost::any SpectrumDataModel::headerData( int section, Orientation orientation,
 } // boost::any SpectrumDataModel::headerData( int section, Orientation orientation, int role ) const
 
 
+void SpectrumDataModel::clearEnvelopeCache()
+{
+  m_envelopeCache.clear();
+}//void clearEnvelopeCache()
+
+
+const std::vector<SpectrumDataModel::EnvelopeColumn> &SpectrumDataModel::envelope( const int column,
+                                                            const double xmin, const double xmax,
+                                                            const int npixels ) const
+{
+  // Enough for the foreground, background, and secondary series of one chart
+  const size_t max_cache_entries = 4;
+  
+  for( size_t i = 0; i < m_envelopeCache.size(); ++i )
+  {
+    const shared_ptr<EnvelopeCacheEntry> entry = m_envelopeCache[i];
+    if( (entry->column == column) && (entry->xmin == xmin) && (entry->xmax == xmax)
+       && (entry->npixels == npixels) )
+    {
+      m_envelopeCache.erase( begin(m_envelopeCache) + i );
+      m_envelopeCache.insert( begin(m_envelopeCache), entry );
+      return entry->points;
+    }
+  }//for( loop over cache entries )
+  
+  auto entry = make_shared<EnvelopeCacheEntry>();
+  entry->column = column;
+  entry->xmin = xmin;
+  entry->xmax = xmax;
+  entry->npixels = npixels;
+  
+  const int nrow = rowCount();
+  if( (npixels > 0) && (xmax > xmin) && (nrow > 0) && columnHasData(column) )
+  {
+    const int minRow = std::max( 0, findRow( xmin ) );
+    const int maxRow = std::min( nrow - 1, findRow( xmax ) );
+    const double pxPerX = npixels / (xmax - xmin);
+    
+    int currentPixel = -1;
+    for( int row = minRow; row <= maxRow; ++row )
+    {
+      const WModelIndex yIndex = index( row, column );
+      if( !yIndex.isValid() )
+        continue;
+      
+      const double x = data( row, X_AXIS_COLUMN );
+      const double y = asNumber( data( yIndex ) );
+      if( IsNan(x) || IsNan(y) )
+        continue;
+      
+      const int pixel = std::min( npixels - 1, std::max( 0, static_cast<int>( (x - xmin) * pxPerX ) ) );
+      if( pixel != currentPixel )
+      {
+        currentPixel = pixel;
+        EnvelopeColumn col;
+        col.first_row = col.min_row = col.max_row = col.last_row = row;
+        col.first_x = col.min_x = col.max_x = col.last_x = x;
+        col.first_y = col.min_y = col.max_y = col.last_y = y;
+        entry->points.push_back( col );
+        continue;
+      }//if( starting a new pixel column )
+      
+      EnvelopeColumn &col = entry->points.back();
+      if( y < col.min_y )
+      {
+        col.min_row = row;
+        col.min_x = x;
+        col.min_y = y;
+      }
+      if( y > col.max_y )
+      {
+        col.max_row = row;
+        col.max_x = x;
+        col.max_y = y;
+      }
+      col.last_row = row;
+      col.last_x = x;
+      col.last_y = y;
+    }//for( loop over rows )
+  }//if( valid input )
+  
+  m_envelopeCache.insert( begin(m_envelopeCache), entry );
+  if( m_envelopeCache.size() > max_cache_entries )
+    m_envelopeCache.resize( max_cache_entries );
+  
+  return entry->points;
+}//envelope(...)
+
+
 void SpectrumDataModel::reset()
 {
   // Reset all of the data fields
@@ -35,6 +35,8 @@
 
 #include <regex>
 #include <vector>
+#include <cassert>
+#include <algorithm>
 #include <memory>
 #include <stdio.h>
 #include <sstream>
@@ -50,8 +52,11 @@
 #include "InterSpec/PeakEdit.h"
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/InterSpec.h"
+#include "SpecUtils/SpecFile.h"
+#include "InterSpec/ChannelPrefixSum.h"
 #include "SpecUtils/StringAlgo.h"
 #include "InterSpec/InterSpecApp.h"
+#include "SpecUtils/EnergyCalibration.h"
 #include "InterSpec/TerminalModel.h"
 #include "InterSpec/DetectorPeakResponse.h"
 #include "InterSpec/ReferencePhotopeakDisplay.h"
@@ -87,6 +92,58 @@ namespace {
         return os.str();
     }
     
+    // Arrays (e.g., from the bulk gamma/peak/DRF functions) are formatted like "{1, 2, 3}", with rows separated by "; "
+    std::string convertValueToString(const mup::IValue& value)
+    {
+        if ( !value.IsMatrix() )
+            return convertDoubleTypeToString( value.GetFloat() );
+        
+        const mup::matrix_type& matrix = value.GetArray();
+        std::ostringstream os;
+        os << "{";
+        for ( int row = 0; row < matrix.GetRows(); ++row ) {
+            for ( int col = 0; col < matrix.GetCols(); ++col )
+                os << ((row || col) ? (col ? ", " : "; ") : "") << convertValueToString( matrix.At(row, col) );
+        }
+        os << "}";
+        return os.str();
+    }
+    
+    // Converts a scalar or row/column array function argument into a vector of doubles
+    std::vector<double> convertValueToVector(const mup::IValue& value, const std::string& functionName)
+    {
+        if ( value.IsNonComplexScalar() )
+            return std::vector<double>( 1, value.GetFloat() );
+        
+        if ( !value.IsMatrix() )
+            throw mup::ParserError( "Arguments for function '" + functionName + "' must be of type 'scalar value' or 'array'." );
+        
+        const mup::matrix_type& matrix = value.GetArray();
+        if ( (matrix.GetRows() != 1) && (matrix.GetCols() != 1) )
+            throw mup::ParserError( "Array arguments for function '" + functionName + "' must have a single row or column." );
+        
+        std::vector<double> answer;
+        answer.reserve( matrix.GetRows() * matrix.GetCols() );
+        for ( int row = 0; row < matrix.GetRows(); ++row ) {
+            for ( int col = 0; col < matrix.GetCols(); ++col ) {
+                const mup::Value& element = matrix.At(row, col);
+                if ( !element.IsNonComplexScalar() )
+                    throw mup::ParserError( "Array elements for function '" + functionName + "' must be of type 'scalar value'." );
+                answer.push_back( element.GetFloat() );
+            }
+        }
+        return answer;
+    }
+    
+    // Converts a vector of doubles into a single-row array, the same shape as "{a, b, c}" creates
+    mup::Value convertVectorToValue(const std::vector<double>& values)
+    {
+        mup::Value answer( 1, static_cast<mup::int_type>(values.size()), 0.0 );
+        for ( size_t i = 0; i < values.size(); ++i )
+            answer.At( 0, static_cast<int>(i) ) = mup::Value( values[i] );
+        return answer;
+    }
+    
     std::string errorMessage(const mup::ParserError& e) {
         std::ostringstream message;
         message << "Error code " << e.GetCode() << ": " << e.GetMsg();
@@ -348,6 +405,84 @@ namespace {
     };
     
     
+    /*
+     Array Functions - bulk versions of the gamma, peak, and DRF functions.  Arguments may be arrays (ex. "{100, 200, 300}"),
+     and the result is always an array, so a whole list of ROIs or energies is evaluated with a single interpreter call.
+     */
+    class ArrayFunction : public mup::ICallback
+    {
+    public:
+        ArrayFunction(TerminalModel *model, const std::string &funName)
+        :ICallback( mup::cmFUNC, funName.c_str(),
+                    (funName == "gammaIntegralsFor" || funName == "gammaSumsFor") ? 3
+                      : (funName == "gammaIntegrals" || funName == "gammaSums" || funName == "drfEfficiencies") ? 2
+                      : (funName == "peakAreas" || funName == "peakMeans") ? 0 : 1),
+        tm(model),
+        functionName(funName)
+      {};
+      
+        virtual void Eval( mup::ptr_val_type& ret, const mup::ptr_val_type* argv, int a_iArgc ) {
+            if ( functionName == "peakAreas" )            *ret = convertVectorToValue( tm->peakAreas() );
+            else if ( functionName == "peakMeans" )       *ret = convertVectorToValue( tm->peakMeans() );
+            else if ( functionName == "drfFWHMs" )        *ret = convertVectorToValue( tm->drfFWHMs( convertValueToVector( *argv[0].Get(), functionName ) ) );
+            else if ( functionName == "drfIntrinsicEffs" ) *ret = convertVectorToValue( tm->drfIntrinsicEffs( convertValueToVector( *argv[0].Get(), functionName ) ) );
+            else if ( functionName == "drfEfficiencies" ) {
+                if ( !argv[1]->IsString() )
+                    throw mup::ParserError( "Second argument for function '" + functionName + "' must be a string giving distance (ex \"1m\")." );
+                *ret = convertVectorToValue( tm->drfEfficiencies( convertValueToVector( *argv[0].Get(), functionName ), argv[1]->GetString() ) );
+            } else if ( functionName == "gammaIntegrals" || functionName == "gammaSums" ) {
+                const std::vector<double> arg1 = convertValueToVector( *argv[0].Get(), functionName );
+                const std::vector<double> arg2 = convertValueToVector( *argv[1].Get(), functionName );
+                *ret = convertVectorToValue( (functionName == "gammaSums") ? tm->gammaSumsAt( arg1, arg2 ) : tm->gammaIntegralsAt( arg1, arg2 ) );
+            } else if ( functionName == "gammaIntegralsFor" || functionName == "gammaSumsFor" ) {
+                if ( !argv[0]->IsString() )
+                    throw mup::ParserError( "First argument for function '" + functionName + "' must be of type 'string'." );
+                const std::vector<double> arg1 = convertValueToVector( *argv[1].Get(), functionName );
+                const std::vector<double> arg2 = convertValueToVector( *argv[2].Get(), functionName );
+                *ret = convertVectorToValue( (functionName == "gammaSumsFor") ? tm->gammaSumsFor( argv[0]->GetString(), arg1, arg2 )
+                                                                              : tm->gammaIntegralsFor( argv[0]->GetString(), arg1, arg2 ) );
+            }
+        }
+        const mup::char_type* GetDesc() const {
+            if      ( functionName == "gammaIntegrals" )    return "gammaIntegrals( lowerEnergies, upperEnergies )";
+            else if ( functionName == "gammaIntegralsFor" ) return "gammaIntegralsFor( spectrum, lowerEnergies, upperEnergies )";
+            else if ( functionName == "gammaSums" )         return "gammaSums( startChannels, endChannels )";
+            else if ( functionName == "gammaSumsFor" )      return "gammaSumsFor( spectrum, startChannels, endChannels )";
+            else if ( functionName == "peakAreas" )         return "peakAreas()";
+            else if ( functionName == "peakMeans" )         return "peakMeans()";
+            else if ( functionName == "drfFWHMs" )          return "drfFWHMs( energies )";
+            else if ( functionName == "drfIntrinsicEffs" )  return "drfIntrinsicEffs( energies )";
+            else if ( functionName == "drfEfficiencies" )   return "drfEfficiencies( energies, distance )";
+            return "";
+        }
+        std::string tags() const {
+            if      ( functionName == "gammaIntegrals" || functionName == "gammaIntegralsFor" ) return "arrays vector bulk integrals rois counts sum of channels energies";
+            else if ( functionName == "gammaSums" || functionName == "gammaSumsFor" )           return "arrays vector bulk sums rois counts sum of channels bins";
+            else if ( functionName == "peakAreas" || functionName == "peakMeans" )              return "arrays vector bulk peaks all areas means energies";
+            else if ( functionName == "drfFWHMs" )                                              return "arrays vector bulk fwhm full width at half maximum resolution detector response drf energies";
+            else if ( functionName == "drfIntrinsicEffs" || functionName == "drfEfficiencies" ) return "arrays vector bulk efficiency efficiencies intrinsic detector response drf energies";
+            return "";
+        }
+        std::string toolTip() const {
+            if      ( functionName == "gammaIntegrals" )    return "Returns an <b>array of gamma integrals</b>, one for each pair of <i>lower</i> and <i>upper energies</i>. Returns <b><font color='red'>error message</font></b> if multiple or no spectra detected.";
+            else if ( functionName == "gammaIntegralsFor" ) return "Returns an <b>array of gamma integrals</b> of <i>spectrum</i>, one for each pair of <i>lower</i> and <i>upper energies</i>.";
+            else if ( functionName == "gammaSums" )         return "Returns an <b>array of channel sums</b>, one for each pair of <i>start</i> and <i>end channels</i>. Returns <b><font color='red'>error message</font></b> if multiple or no spectra detected.";
+            else if ( functionName == "gammaSumsFor" )      return "Returns an <b>array of channel sums</b> of <i>spectrum</i>, one for each pair of <i>start</i> and <i>end channels</i>.";
+            else if ( functionName == "peakAreas" )         return "Returns an <b>array of the areas</b> of all peaks, ordered by peak mean.";
+            else if ( functionName == "peakMeans" )         return "Returns an <b>array of the means</b> of all peaks, in the same order as <b>peakAreas()</b>.";
+            else if ( functionName == "drfFWHMs" )          return "Returns an <b>array of the detector FWHM</b> at each of the <i>energies</i>.";
+            else if ( functionName == "drfIntrinsicEffs" )  return "Returns an <b>array of the detector intrinsic efficiency</b> at each of the <i>energies</i>.";
+            else if ( functionName == "drfEfficiencies" )   return "Returns an <b>array of the detector efficiency</b> at each of the <i>energies</i>, for the given <i>distance</i>.";
+            return "";
+        }
+        mup::IToken* Clone() const { return new ArrayFunction(*this); }
+        
+    private:
+      TerminalModel *tm;
+      std::string functionName;
+    };
+    
+    
     /* 
      Gamma Functions - Obtain specific gamma information from the spectrum.
      
@@ -729,6 +864,15 @@ TerminalModel::TerminalModel( InterSpec* viewer )
   addFunction( drfEfficiencyFunc, drfEfficiencyFunc->tags(), drfEfficiencyFunc->toolTip() );
   
   
+  // Define Array functions
+  addDropDownListHeader( "Array Functions" );
+  for( const char *name : { "gammaIntegrals", "gammaIntegralsFor", "gammaSums", "gammaSumsFor",
+                            "peakAreas", "peakMeans", "drfFWHMs", "drfIntrinsicEffs", "drfEfficiencies" } )
+  {
+    ArrayFunction *arrayFunc = new ArrayFunction(this, name);
+    addFunction( arrayFunc, arrayFunc->tags(), arrayFunc->toolTip() );
+  }
+  
     // Define non-built-in statistical functions
     addDropDownListHeader( "Statistical Functions" );
     PValueFromChiSquare* pValFun = new PValueFromChiSquare;      addFunction( pValFun, pValFun->tags(), pValFun->toolTip() );
@@ -755,6 +899,8 @@ TerminalModel::TerminalModel( InterSpec* viewer )
 // Destructor
 TerminalModel::~TerminalModel()
 {
+    m_compiledExpressions.clear();   // cached parsers reference the variables below
+    
     for (auto i : m_variables)       // delete all the pointers to doubles inside the variable map
         delete i.second;
 }
@@ -800,11 +946,9 @@ std::string TerminalModel::evaluate(std::string input)
             return assignVariable(input);
             
         else if (type == Operation) {
-            m_parser->SetExpr( input );                                         // Sets the expression for the parser into the current input
-            
             try {
-                const double result = m_parser->Eval().GetFloat();              // Get the value of the evaluated input
-                return convertDoubleTypeToString(result);                       // Convert result into string format  
+                const mup::Value result = evaluateCachedExpression( input );    // Get the value of the evaluated input
+                return convertValueToString(result);                            // Convert result (scalar or array) into string format
             } catch ( const mup::ParserError& e ) {
                 // These are errors specific to the parser
               return "Error code " + std::to_string(e.GetCode()) + ": " + e.GetMsg();
@@ -1152,7 +1296,8 @@ float TerminalModel::gammaIntegral( std::shared_ptr<const SpecUtils::Measurement
     
     if (energyLow > energyHigh)
         std::swap( energyLow, energyHigh );
-    return histogram->gamma_integral( energyLow, energyHigh );
+  
+  return static_cast<float>( ChannelPrefixSum::gamma_integral( histogram, energyLow, energyHigh ) );
 }
 
 // Gets the gamma channel sum of a specific spectrum
@@ -1163,9 +1308,48 @@ float TerminalModel::gammaSum( std::shared_ptr<const SpecUtils::Measurement> his
   
   //TODO: gamma_channels_sum(...) take integer startBin and endBin - need to rectify and such
   
-    return histogram->gamma_channels_sum( startBin, endBin );
+  // Same semantics as Measurement::gamma_channels_sum: inclusive range, clamped to the spectrum.
+  const size_t first = static_cast<size_t>( std::max( startBin, 0.0 ) );
+  const size_t last = static_cast<size_t>( std::max( endBin, 0.0 ) );
+  
+  return static_cast<float>( ChannelPrefixSum::gamma_channels_sum( histogram, first, last ) );
 }
 
+
+mup::Value TerminalModel::evaluateCachedExpression( const std::string &expression )
+{
+  // Expressions like "gammaIntegral(fg,x,x+10)" in a script loop are evaluated many times; there is
+  //  no point letting the cache grow without bound though.
+  const size_t max_cached_expressions = 128;
+  
+  auto pos = m_compiledExpressions.find( expression );
+  if( pos == std::end(m_compiledExpressions) )
+  {
+    if( m_compiledExpressions.size() >= max_cached_expressions )
+      m_compiledExpressions.clear();
+    
+    std::unique_ptr<mup::ParserX> parser( new mup::ParserX( *m_parser ) );
+    parser->SetExpr( expression );
+    pos = m_compiledExpressions.insert( std::make_pair( expression, std::move(parser) ) ).first;
+  }//if( not already cached )
+  
+  try
+  {
+    // The first Eval() creates the RPN, subsequent calls re-use it.
+    return mup::Value( pos->second->Eval() );
+  }catch( ... )
+  {
+    m_compiledExpressions.erase( pos );
+    throw;
+  }
+}//mup::Value evaluateCachedExpression( const std::string &expression )
+
+
+void TerminalModel::clearCachedExpressions()
+{
+  m_compiledExpressions.clear();
+}//void clearCachedExpressions()
+
 double TerminalModel::numGammaChannels()
 {
     updateHistograms();
@@ -1512,6 +1696,78 @@ double TerminalModel::drfEfficiency( const double energy, const std::string &dis
 }//double drfEfficiency( const double energy, const std::string &distance )
 
 
+std::vector<double> TerminalModel::gammaIntegralsAt( const std::vector<double>& energyLow, const std::vector<double>& energyHigh )
+{ return gammaArrayFunction( energyLow, energyHigh, &TerminalModel::gammaIntegral ); }
+
+std::vector<double> TerminalModel::gammaIntegralsFor( const std::string& histogram, const std::vector<double>& energyLow, const std::vector<double>& energyHigh )
+{ return gammaArrayFunctionFor( histogram, energyLow, energyHigh, &TerminalModel::gammaIntegral ); }
+
+std::vector<double> TerminalModel::gammaSumsAt( const std::vector<double>& startBin, const std::vector<double>& endBin )
+{ return gammaArrayFunction( startBin, endBin, &TerminalModel::gammaSum ); }
+
+std::vector<double> TerminalModel::gammaSumsFor( const std::string& histogram, const std::vector<double>& startBin, const std::vector<double>& endBin )
+{ return gammaArrayFunctionFor( histogram, startBin, endBin, &TerminalModel::gammaSum ); }
+
+
+std::vector<double> TerminalModel::peakAreas()
+{
+  std::vector<double> answer;
+  
+  const std::shared_ptr<const std::deque<PeakModel::PeakShrdPtr>> peaks = m_viewer->peakModel()->peaks();
+  if( peaks )
+  {
+    answer.reserve( peaks->size() );
+    for( const PeakModel::PeakShrdPtr &peak : *peaks )
+      answer.push_back( peak ? peak->peakArea() : 0.0 );
+  }
+  
+  return answer;
+}//std::vector<double> peakAreas()
+
+
+std::vector<double> TerminalModel::peakMeans()
+{
+  std::vector<double> answer;
+  
+  const std::shared_ptr<const std::deque<PeakModel::PeakShrdPtr>> peaks = m_viewer->peakModel()->peaks();
+  if( peaks )
+  {
+    answer.reserve( peaks->size() );
+    for( const PeakModel::PeakShrdPtr &peak : *peaks )
+      answer.push_back( peak ? peak->mean() : 0.0 );
+  }
+  
+  return answer;
+}//std::vector<double> peakMeans()
+
+
+std::vector<double> TerminalModel::drfFWHMs( const std::vector<double>& energies )
+{
+  std::vector<double> answer( energies.size() );
+  for( size_t i = 0; i < energies.size(); ++i )
+    answer[i] = drfFWHM( energies[i] );
+  return answer;
+}//drfFWHMs(...)
+
+
+std::vector<double> TerminalModel::drfIntrinsicEffs( const std::vector<double>& energies )
+{
+  std::vector<double> answer( energies.size() );
+  for( size_t i = 0; i < energies.size(); ++i )
+    answer[i] = drfIntrinsicEff( energies[i] );
+  return answer;
+}//drfIntrinsicEffs(...)
+
+
+std::vector<double> TerminalModel::drfEfficiencies( const std::vector<double>& energies, const std::string& distance )
+{
+  std::vector<double> answer( energies.size() );
+  for( size_t i = 0; i < energies.size(); ++i )
+    answer[i] = drfEfficiency( energies[i], distance );
+  return answer;
+}//drfEfficiencies(...)
+
+
 
 float TerminalModel::gammaFunctionOneArg( const double energy, float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg) )
 {
@@ -1583,6 +1839,75 @@ float TerminalModel::gammaFunctionTwoArg( const double arg1, const double arg2,
         throw mup::ParserError( "Multiple spectra detected. Please specify a spectrum to use." );
 }
 
+std::vector<double> TerminalModel::gammaArrayFunction( const std::vector<double>& arg1, const std::vector<double>& arg2,
+                          float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) )
+{
+    updateHistograms();
+    
+    if (!m_foregroundHistogram && !m_secondaryHistogram && !m_backgroundHistogram)
+        throw mup::ParserError( "No spectra detected. Please add a spectrum to use." );
+    
+    // Like gammaFunctionTwoArg, if multiple spectra are displayed, they must all give the same answer
+    std::vector<double> answer;
+    bool have_answer = false;
+    for( const auto &histogram : { m_foregroundHistogram, m_secondaryHistogram, m_backgroundHistogram } )
+    {
+        if( !histogram )
+            continue;
+        
+        std::vector<double> values = gammaArrayFunctionFor( histogram, arg1, arg2, func );
+        if( have_answer && (values != answer) )
+            throw mup::ParserError( "Multiple spectra detected. Please specify a spectrum to use." );
+        
+        answer.swap( values );
+        have_answer = true;
+    }
+    
+    return answer;
+}
+
+std::vector<double> TerminalModel::gammaArrayFunctionFor( const std::string& histogram, const std::vector<double>& arg1, const std::vector<double>& arg2,
+                          float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) )
+{
+    const std::string& hist (histogram);
+    
+    updateHistograms();
+    
+    if ( std::regex_match( hist, std::regex( "^(\\s*(foreground|fg)\\s*)$", std::regex::icase ) ) ) { // foreground
+        if ( !m_foregroundHistogram ) throw mup::ParserError( "Foreground not detected." );
+        else return gammaArrayFunctionFor( m_foregroundHistogram, arg1, arg2, func );
+        
+    } else if ( std::regex_match( hist, std::regex( "^(\\s*(secondary|sfg|secondaryforeground|secondforeground)\\s*)$", std::regex::icase ) ) ) { // second foreground
+        if ( !m_secondaryHistogram ) throw mup::ParserError( "Secondary foreground not detected." );
+        else return gammaArrayFunctionFor( m_secondaryHistogram, arg1, arg2, func );
+        
+    } else if ( std::regex_match( hist, std::regex( "^(\\s*(background|bg|background|back)\\s*)$", std::regex::icase ) ) ) { // background
+        if ( !m_backgroundHistogram ) throw mup::ParserError( "Background not detected." );
+        else return gammaArrayFunctionFor( m_backgroundHistogram, arg1, arg2, func );
+        
+    }
+    throw mup::ParserError ( "Invalid argument for function." );
+}
+
+std::vector<double> TerminalModel::gammaArrayFunctionFor( std::shared_ptr<const SpecUtils::Measurement> histogram,
+                          const std::vector<double>& arg1, const std::vector<double>& arg2,
+                          float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg1, const double arg2) )
+{
+    if( (arg1.size() != arg2.size()) && (arg1.size() != 1) && (arg2.size() != 1) )
+        throw mup::ParserError( "Array arguments must be the same length." );
+    
+    if( arg1.empty() || arg2.empty() )
+        return std::vector<double>();
+    
+    const size_t num_values = std::max( arg1.size(), arg2.size() );
+    
+    std::vector<double> answer( num_values );
+    for( size_t i = 0; i < num_values; ++i )
+        answer[i] = (this->*func)( histogram, arg1[(arg1.size() == 1) ? 0 : i], arg2[(arg2.size() == 1) ? 0 : i] );
+    
+    return answer;
+}
+
 float TerminalModel::gammaFunctionOneArgFor( const std::string& histogram, const double energy,
                                             float (TerminalModel::*func)(std::shared_ptr<const SpecUtils::Measurement> histogram, const double arg) )
 {
@@ -1822,8 +2147,9 @@ std::string TerminalModel::clearVar( const std::string& args )
         return "Error: Please enter a variable to be removed.";
       
     if ( isVariable(arguments) ) {
-        os << "Removing variable (" << arguments << ") that had value (" << m_variables.at(arguments)->GetFloat() << ")";
+        os << "Removing variable (" << arguments << ") that had value (" << convertValueToString( *m_variables.at(arguments) ) << ")";
         m_parser->RemoveVar( arguments );
+        clearCachedExpressions();   // cached parsers reference the Value we are about to delete
         delete m_variables[ arguments ];
         m_variables.erase( arguments );
     }else if ( std::regex_match(arguments, std::regex(ns_validVariableRegexArg)) ) {
@@ -2179,11 +2505,10 @@ std::string TerminalModel::assignVariable(const std::string& input)
         return errorMessage(e);
     }
     
-    double value = 0;
+    mup::Value value;
     const std::string& expression = match[2];
     
-    m_parser->SetExpr(expression);
-    try { value = double( m_parser->Eval().GetFloat() ); }                               // catch error on right side of variable assignment
+    try { value = evaluateCachedExpression( expression ); }                             // catch error on right side of variable assignment
     catch ( const mup::ParserError& e ) {
         os << "Error code " << e.GetCode() << ": " << e.GetMsg();
         return os.str();
@@ -2195,7 +2520,7 @@ std::string TerminalModel::assignVariable(const std::string& input)
     if ( m_parser->IsVarDefined(variable) ) {    // if variable is already in Variable Map
         
         // if re-assigning variable with same value, don't assign again
-        if (m_variables.find(variable) != m_variables.end() && *(m_variables.at(variable)) == mup::Value(value) ) {
+        if (m_variables.find(variable) != m_variables.end() && *(m_variables.at(variable)) == value ) {
             os << "Variable " << variable << " already initialized with value(" << value << ")";
             return os.str();
         }
@@ -2205,7 +2530,7 @@ std::string TerminalModel::assignVariable(const std::string& input)
         os << "Re-assigned variable " << variable << " from old value(" << *(i->second) << ") to new value(" << value << ")";
         
 //        mup::Value* to_delete = i->second;
-        *m_variables.at( variable ) = mup::Value(value);
+        *m_variables.at( variable ) = value;
 //        delete to_delete;
 //        m_parser->DefineVar(variable, mup::Variable( mup::Value( i->second ) ) );
         
@@ -2215,6 +2540,7 @@ std::string TerminalModel::assignVariable(const std::string& input)
     // add new variable inside the variable map
     m_variables.insert ( std::pair<std::string,mup::Value*> (variable, new mup::Value(value) ) );
     m_parser->DefineVar(variable, mup::Variable( m_variables.at( variable ) ) );
+    clearCachedExpressions();   // cached parsers dont know about the new variable
     os << "Assigned variable " << variable << " to value(" << value << ")";
     
     return os.str();
@@ -48,7 +48,11 @@ namespace
    This value applies to all sessions - in the future we could add a member variable to #UndoRedoManager to allow more
    fine-grained control.
    */
+#if( LOW_MEMORY_PROFILE )
+  std::atomic<int> ns_max_steps( 100 );
+#else
   std::atomic<int> ns_max_steps( 250 );
+#endif
   
   /** The amount of steps we can go over #ns_max_steps, before triggering a cleanup.
    
@@ -57,6 +61,33 @@ namespace
    */
   const int ns_nsteps_histerious = 10;
   
+  /** The approximate maximum memory, in bytes, the undo/redo steps for a session may take up. */
+#if( LOW_MEMORY_PROFILE )
+  std::atomic<size_t> ns_max_bytes( 8*1024*1024 );
+#else
+  std::atomic<size_t> ns_max_bytes( 32*1024*1024 );
+#endif
+  
+  
+  /** Returns the approximate memory of a peak undo/redo step holding both the starting and final peaks.
+   
+   Peaks present in both sets are shared (i.e., we hold a `shared_ptr<const PeakDef>` to the same object), so
+   are only counted once, and peaks still in the PeakModel arent really attributable to undo/redo; but
+   we'll count all unique peaks to be conservative.
+   */
+  size_t peak_step_mem_size( const vector<shared_ptr<const PeakDef>> &starting_peaks,
+                             const vector<shared_ptr<const PeakDef>> &final_peaks )
+  {
+    set<const PeakDef *> unique_peaks;
+    for( const auto &p : starting_peaks )
+      unique_peaks.insert( p.get() );
+    for( const auto &p : final_peaks )
+      unique_peaks.insert( p.get() );
+    
+    return sizeof(shared_ptr<const PeakDef>) * (starting_peaks.size() + final_peaks.size())
+           + sizeof(PeakDef) * unique_peaks.size();
+  }//peak_step_mem_size(...)
+  
   
   struct ClearStateOnDestruct
   {
@@ -100,6 +131,7 @@ UndoRedoManager::UndoRedoManager( InterSpec *parent )
   m_current_samples{},
   m_current_detectors{},
   m_num_steps_in_mem( 0 ),
+  m_num_bytes_in_mem( 0 ),
   m_prev{},
   m_interspec( parent ),
   m_undoMenuDisableUpdate( this ),
@@ -191,7 +223,10 @@ UndoRedoManager::PeakModelChange::~PeakModelChange()
   if( manager->m_PeakModelChange_counter != 0 )
     return;
   
-  const vector<shared_ptr<const PeakDef>> starting_peaks = manager->m_PeakModelChange_starting_peaks;
+  // We'll hold the peaks as shared const vectors so the undo and redo functions (and copies of them) share them
+  const auto starting_peaks_ptr
+            = make_shared<const vector<shared_ptr<const PeakDef>>>( std::move(manager->m_PeakModelChange_starting_peaks) );
+  const vector<shared_ptr<const PeakDef>> &starting_peaks = *starting_peaks_ptr;
   manager->m_PeakModelChange_starting_peaks.clear();
   
   PeakModel *pmodel = manager->m_interspec->peakModel();
@@ -200,14 +235,17 @@ UndoRedoManager::PeakModelChange::~PeakModelChange()
     return;
   
   shared_ptr<const deque<PeakModel::PeakShrdPtr>> peaks_now = pmodel->peaks();
-  vector<shared_ptr<const PeakDef>> final_peaks;
+  auto final_peaks_ptr = make_shared<vector<shared_ptr<const PeakDef>>>();
   if( peaks_now )
-    final_peaks.insert( end(final_peaks), begin(*peaks_now), end(*peaks_now) );
+    final_peaks_ptr->insert( end(*final_peaks_ptr), begin(*peaks_now), end(*peaks_now) );
+  const vector<shared_ptr<const PeakDef>> &final_peaks = *final_peaks_ptr;
   
   if( starting_peaks == final_peaks )
     return;
   
-  function<void(bool)> undo_redo = [starting_peaks,final_peaks]( const bool is_undo ){
+  const shared_ptr<const vector<shared_ptr<const PeakDef>>> final_peaks_const = final_peaks_ptr;
+  
+  function<void(bool)> undo_redo = [starting_peaks_ptr,final_peaks_const]( const bool is_undo ){
     InterSpec *viewer = InterSpec::instance();
     assert( viewer );
     if( !viewer )
@@ -218,7 +256,7 @@ UndoRedoManager::PeakModelChange::~PeakModelChange()
     if( !pmodel )
       return;
     
-    pmodel->setPeaks( is_undo ? starting_peaks : final_peaks );
+    pmodel->setPeaks( is_undo ? *starting_peaks_ptr : *final_peaks_const );
   };//undo_redo
   
   function<void()> undo = [undo_redo](){ undo_redo(true); };
@@ -229,7 +267,7 @@ UndoRedoManager::PeakModelChange::~PeakModelChange()
   if( abs(dpeaks) > 1 )
     desc += "s";
   
-  manager->addUndoRedoStep( undo, redo, desc );
+  manager->addUndoRedoStep( undo, redo, desc, peak_step_mem_size(starting_peaks, final_peaks) );
 }//~PeakModelChange()
 
 
@@ -320,9 +358,22 @@ void UndoRedoManager::setMaxUndoRedoSteps( const int steps )
 }
 
 
+size_t UndoRedoManager::maxUndoRedoMemory()
+{
+  return ns_max_bytes.load();
+}
+
+
+void UndoRedoManager::setMaxUndoRedoMemory( const size_t bytes )
+{
+  ns_max_bytes = bytes;
+}
+
+
 void UndoRedoManager::addUndoRedoStep( std::function<void()> undo,
                                        std::function<void()> redo,
-                                       const std::string &description )
+                                       const std::string &description,
+                                       const size_t approx_bytes )
 {
   assert( undo || redo );
   
@@ -376,13 +427,20 @@ void UndoRedoManager::addUndoRedoStep( std::function<void()> undo,
       UndoRedoStep step = (*m_steps)[num_steps - 1 - index];
       std::swap( step.m_redo, step.m_undo );
       m_num_steps_in_mem += 1;
+      m_num_bytes_in_mem += step.m_num_bytes;
       m_steps->push_back( step );
     }//
   }//if( m_step_offset != 0 )
   
+  // If the caller didnt give us a size, we'll just count the step itself, and a guess for the
+  //  std::function captures (which will usually be heap allocated, if they capture anything).
+  const size_t num_bytes = sizeof(UndoRedoStep) + description.size()
+                           + ((approx_bytes > 0) ? approx_bytes : 256);
+  
   m_step_offset = 0;
   m_num_steps_in_mem += 1;
-  m_steps->push_back( {undo, redo, description, std::chrono::system_clock::now()} );
+  m_num_bytes_in_mem += num_bytes;
+  m_steps->push_back( {undo, redo, description, std::chrono::system_clock::now(), num_bytes} );
   
   m_undoMenuDisableUpdate.emit( false );
   m_undoMenuToolTipUpdate.emit( Wt::WString::fromUTF8(description) );
@@ -393,7 +451,10 @@ void UndoRedoManager::addUndoRedoStep( std::function<void()> undo,
   // Cleaning up the history isnt a super-cheap operation, so we'll We'll wait until we
   //  are #ns_nsteps_histerious over the max limit, to bother to clean things up.
   //  Also, we'll clean things up outside of the main event loop
-  if( (max_steps != 0) && (m_num_steps_in_mem > (max_steps + ns_nsteps_histerious)) )
+  //  The memory limit doesnt have any histeresis, as steps are usually much smaller than the limit.
+  const size_t max_bytes = ns_max_bytes;
+  if( ((max_steps != 0) && (m_num_steps_in_mem > (max_steps + ns_nsteps_histerious)))
+      || ((max_bytes != 0) && (m_num_bytes_in_mem > max_bytes)) )
     Wt::WServer::instance()->schedule( 100, wApp->sessionId(),
                                   boost::bind( &UndoRedoManager::limitTotalStepsInMemory, this ) );
 }//void addUndoRedoStep(...)
@@ -586,12 +647,30 @@ Wt::Signal<Wt::WString> &UndoRedoManager::redoMenuToolTipUpdate()
 void UndoRedoManager::clearUndoRedu()
 {
   if( m_steps )
+  {
+    for( const UndoRedoStep &step : *m_steps )
+    {
+      assert( m_num_steps_in_mem >= 1 );
+      assert( m_num_bytes_in_mem >= step.m_num_bytes );
+      m_num_steps_in_mem -= std::min( m_num_steps_in_mem, size_t(1) );
+      m_num_bytes_in_mem -= std::min( m_num_bytes_in_mem, step.m_num_bytes );
+    }
     m_steps->clear();
+  }//if( m_steps )
+  
+  m_step_offset = 0;
   
   updateMenuItemStates();
 }//void clearUndoRedu()
 
 
+size_t UndoRedoManager::memsize() const
+{
+  return sizeof(UndoRedoManager) + m_num_bytes_in_mem
+         + sizeof(PeakModel::PeakShrdPtr) * m_PeakModelChange_starting_peaks.size();
+}//size_t memsize() const
+
+
 void UndoRedoManager::updateMenuItemStates()
 {
   if( !m_steps || m_steps->empty() )
@@ -764,7 +843,7 @@ void UndoRedoManager::limitTotalStepsInMemory()
     
   const int max_steps = ns_max_steps;
   
-  if( max_steps == 0 )
+  if( (max_steps == 0) && (ns_max_bytes == 0) )
     return;
   
   if( max_steps < 0 )
@@ -775,6 +854,7 @@ void UndoRedoManager::limitTotalStepsInMemory()
       m_prev.clear();
       m_step_offset = 0;
       m_num_steps_in_mem = 0;
+      m_num_bytes_in_mem = 0;
       m_undoMenuDisableUpdate.emit(true);
       m_redoMenuDisableUpdate.emit(true);
       m_undoMenuToolTipUpdate.emit(Wt::WString());
@@ -786,67 +866,67 @@ void UndoRedoManager::limitTotalStepsInMemory()
   }//if( max_steps < 0 )
   
   const size_t umax_steps = static_cast<size_t>( max_steps );
+  const size_t max_bytes = ns_max_bytes;
   
-  m_num_steps_in_mem = 0;
-  if( m_steps )
-  {
-    if( m_steps->size() > umax_steps )
+  // We'll go from the most recent undo/redo steps, to the least recent, keeping steps until we hit
+  //  either the number of steps, or memory limit; the most recent step is always kept.
+  size_t num_steps = 0, num_bytes = 0;
+  bool at_limit = false;
+  
+  // Returns the number of steps, from the back of the deque, to keep.
+  auto num_to_keep = [&]( const deque<UndoRedoStep> &steps ) -> size_t {
+    size_t nkeep = 0;
+    for( auto iter = steps.rbegin(); !at_limit && (iter != steps.rend()); ++iter )
     {
-      // The most recent undo/redo steps are in the back of m_steps (e.g., we always
-      //  do m_steps->push_back(...) )
-      m_steps->erase( std::begin(*m_steps), std::end(*m_steps) - umax_steps );
-      assert( m_steps->size() == umax_steps );
-    }
+      const bool too_many = (umax_steps != 0) && ((num_steps + 1) > umax_steps);
+      const bool too_big = (max_bytes != 0) && ((num_bytes + iter->m_num_bytes) > max_bytes);
+      if( (num_steps != 0) && (too_many || too_big) )
+      {
+        at_limit = true;
+        break;
+      }
+      
+      nkeep += 1;
+      num_steps += 1;
+      num_bytes += iter->m_num_bytes;
+    }//for( loop over steps, most recent first )
     
-    assert( m_steps->size() <= umax_steps );
-    m_num_steps_in_mem = std::min(m_steps->size(), umax_steps);
-  }//if( m_steps )
+    return nkeep;
+  };//num_to_keep lambda
   
-  assert( m_num_steps_in_mem <= umax_steps );
+  if( m_steps )
+  {
+    // The most recent undo/redo steps are in the back of m_steps (e.g., we always
+    //  do m_steps->push_back(...) )
+    const size_t nkeep = num_to_keep( *m_steps );
+    assert( nkeep <= m_steps->size() );
+    m_steps->erase( std::begin(*m_steps), std::end(*m_steps) - nkeep );
+  }//if( m_steps )
   
-  for( auto iter = begin(m_prev); iter != end(m_prev); ++iter )
+  // The most recent spec-file/sample-nums are at the front of m_prev
+  for( auto iter = begin(m_prev); iter != end(m_prev); )
   {
     const auto &deque_ptr = std::get<1>( *iter );
     assert( deque_ptr );
-    if( !deque_ptr )
-      continue;
     
-    if( (deque_ptr->size() + m_num_steps_in_mem) <= umax_steps )
-    {
-      // We can keep all items for this spec-file/sample-num
-      m_num_steps_in_mem += deque_ptr->size();
-      
-      assert( m_num_steps_in_mem <= umax_steps );
-    }else
+    // If the spectrum file has been deleted, there is no way to get back to this history
+    const bool file_gone = std::get<0>( std::get<0>(*iter) ).expired();
+    const size_t nkeep = (deque_ptr && !file_gone) ? num_to_keep( *deque_ptr ) : size_t(0);
+    
+    if( nkeep == 0 )
     {
-      // We have to limit the number of items for this spec-file/sample-num, and then
-      //  remove all subsequent spec-file/sample-nums
-      const size_t num_in_deque = deque_ptr->size();
-      assert( m_num_steps_in_mem <= umax_steps );
-      const size_t num_keep = umax_steps - m_num_steps_in_mem;
-      
-      if( num_keep == 0 )
-      {
-        m_prev.erase( iter, end(m_prev) );
-      }else
-      {
-        assert( num_keep <= num_in_deque );
-        const size_t num_erase = num_in_deque - num_keep;
-        assert( num_erase <= num_in_deque );
-        deque_ptr->erase( std::begin(*deque_ptr), std::begin(*deque_ptr) + num_erase );
-        
-        m_num_steps_in_mem += deque_ptr->size();
-        assert( m_num_steps_in_mem == umax_steps );
-        
-        // Now erase all less-recent spec-file/sample-nums
-        m_prev.erase( iter + 1, end(m_prev) );
-      }//if( num_keep == 0 ) / else
-      
-      // We've deleted all the rest of m_prev, so we are done in this loop
-      break;
-    }//if( we can keep all these items ) / else
-  }//for( auto iter = begin(m_prev); iter != end(m_prev); ++iter )
+      iter = m_prev.erase( iter );
+      continue;
+    }
+    
+    deque_ptr->erase( std::begin(*deque_ptr), std::end(*deque_ptr) - nkeep );
+    ++iter;
+  }//for( auto iter = begin(m_prev); iter != end(m_prev); )
+  
+  assert( (umax_steps == 0) || (num_steps <= umax_steps) );
   
+  m_num_steps_in_mem = num_steps;
+  m_num_bytes_in_mem = num_bytes;
   
   m_step_offset = std::min(m_step_offset, (m_steps ? m_steps->size() : 0) );
 }//void limitTotalStepsInMemory();
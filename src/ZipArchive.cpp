@@ -27,9 +27,21 @@ extern "C"{
 
 #include <string>
 #include <memory>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if( !defined(_WIN32) )
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "SpecUtils/StringAlgo.h"
 
 #include "InterSpec/ZipArchive.h"
 
@@ -51,6 +63,17 @@ inline istream &binaryRead( istream &stream, T &x )
 {
   return stream.read( (char *)(&x), sizeof(T) );
 }
+  
+template<class T>
+inline T memoryRead( const char *data )
+{
+  T x;
+  memcpy( &x, data, sizeof(T) );
+  return x;
+}
+  
+const uint16_t sm_zip_deflate = 8;
+const uint16_t sm_zip_uncompressed = 0;
 
 
 bool ZipFileHeader::init( istream& istream, const bool globalHeader )
@@ -213,10 +236,20 @@ size_t read_file_from_zip( std::istream &instrm,
     return total_uncompressed;
   }else if( header->compression_type == UNCOMPRESSED )
   {
-    const size_t nread = std::min( buffer_size - 4,
-                                   header->uncompressed_size - total_read );
-    instrm.read( (char*)(out+4), nread );
-    return static_cast<size_t>( instrm.gcount() );
+    while( total_read < header->uncompressed_size )
+    {
+      const unsigned int nToRead = std::min( buffer_size,
+                                           header->uncompressed_size - total_read );
+      instrm.read( (char*)out, nToRead );
+      const unsigned int nread = static_cast<unsigned int>( instrm.gcount() );
+      if( !nread )
+        throw runtime_error( "ZipArchive: read size error" );
+      
+      output.write( (const char *)out, nread );
+      total_read += nread;
+    }//while( total_read < header->uncompressed_size )
+    
+    return total_read;
   }else
   {
     throw runtime_error( "ZipArchive: unrecognized compression" );
@@ -301,5 +334,319 @@ std::map<std::string, std::shared_ptr<const ZipFileHeader> >
   
   return answer;
 }
+
+
+MappedZipFile::MappedZipFile( const std::string &filename )
+  : m_data( nullptr ),
+    m_size( 0 )
+{
+#if( defined(_WIN32) )
+  const std::wstring wfilename = SpecUtils::convert_from_utf8_to_utf16( filename );
+  ifstream input( wfilename.c_str(), ios_base::binary | ios_base::in | ios_base::ate );
+  if( !input.is_open() )
+    throw runtime_error( "ZipArchive: couldnt open " + filename );
+  
+  const std::streamoff filesize = input.tellg();
+  if( filesize <= 0 )
+    throw runtime_error( "ZipArchive: invalid file size" );
+  
+  m_buffer.resize( static_cast<size_t>(filesize) );
+  input.seekg( 0, ios::beg );
+  if( !input.read( m_buffer.data(), filesize ) )
+    throw runtime_error( "ZipArchive: error reading " + filename );
+  
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+#else
+  const int fd = ::open( filename.c_str(), O_RDONLY );
+  if( fd < 0 )
+    throw runtime_error( "ZipArchive: couldnt open " + filename );
+  
+  struct stat statbuf;
+  if( (fstat( fd, &statbuf ) != 0) || (statbuf.st_size <= 0) )
+  {
+    ::close( fd );
+    throw runtime_error( "ZipArchive: invalid file size" );
+  }
+  
+  m_size = static_cast<size_t>( statbuf.st_size );
+  void *mapping = mmap( nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0 );
+  ::close( fd );  //The mapping stays valid after closing the file descriptor
+  
+  if( mapping == MAP_FAILED )
+    throw runtime_error( "ZipArchive: failed to memory-map " + filename );
+  
+  m_data = static_cast<const char *>( mapping );
+#endif
+  
+  try
+  {
+    // Find the end of central directory record; it is the last thing in the file, followed by a
+    //  comment of at most 65535 bytes.
+    const size_t eocd_size = 22;
+    if( m_size < eocd_size )
+      throw runtime_error( "ZipArchive: invalid file size" );
+    
+    const size_t max_comment_size = 0xffff;
+    const size_t search_end = (m_size > (eocd_size + max_comment_size)) ? (m_size - eocd_size - max_comment_size) : size_t(0);
+    
+    size_t eocd = m_size;
+    for( size_t i = m_size - eocd_size + 1; i-- > search_end; )
+    {
+      if( memoryRead<uint32_t>( m_data + i ) == 0x06054b50 )
+      {
+        eocd = i;
+        break;
+      }
+    }//for( search backwards for end of central directory signature )
+    
+    if( eocd == m_size )
+      throw runtime_error( "ZipArchive: Couldnt find zip header" );
+    
+    const uint16_t this_disk_num = memoryRead<uint16_t>( m_data + eocd + 4 );
+    const uint16_t end_disk_num = memoryRead<uint16_t>( m_data + eocd + 6 );
+    const uint16_t num_files_this_disk = memoryRead<uint16_t>( m_data + eocd + 8 );
+    const uint16_t num_files = memoryRead<uint16_t>( m_data + eocd + 10 );
+    const uint32_t dir_size = memoryRead<uint32_t>( m_data + eocd + 12 );
+    const uint32_t dir_offset = memoryRead<uint32_t>( m_data + eocd + 16 );
+    
+    if( (this_disk_num != end_disk_num) || (this_disk_num != 0) || (num_files != num_files_this_disk) )
+      throw runtime_error( "ZipArchive: multi-disk zip files not supported" );
+    
+    if( (static_cast<uint64_t>(dir_offset) + dir_size) > eocd )
+      throw runtime_error( "ZipArchive: invalid central directory location" );
+    
+    const size_t central_header_size = 46;
+    size_t pos = dir_offset;
+    for( uint16_t i = 0; i < num_files; ++i )
+    {
+      if( ((pos + central_header_size) > eocd)
+         || (memoryRead<uint32_t>( m_data + pos ) != 0x02014b50) )
+        throw runtime_error( "ZipArchive: invalid central directory entry" );
+      
+      const char * const entry = m_data + pos;
+      
+      // Field assignment mirrors ZipFileHeader::init(...), so headers are identical to
+      //  open_zip_file(...)
+      std::shared_ptr<ZipFileHeader> header = std::make_shared<ZipFileHeader>();
+      header->version = memoryRead<uint16_t>( entry + 6 );
+      header->flags = memoryRead<uint16_t>( entry + 8 );
+      header->compression_type = memoryRead<uint16_t>( entry + 10 );
+      header->stamp_date = memoryRead<uint16_t>( entry + 12 );
+      header->stamp_time = memoryRead<uint16_t>( entry + 14 );
+      header->crc = memoryRead<uint32_t>( entry + 16 );
+      header->compressed_size = memoryRead<uint32_t>( entry + 20 );
+      header->uncompressed_size = memoryRead<uint32_t>( entry + 24 );
+      
+      const uint16_t filename_length = memoryRead<uint16_t>( entry + 28 );
+      const uint16_t extra_length = memoryRead<uint16_t>( entry + 30 );
+      const uint16_t comment_length = memoryRead<uint16_t>( entry + 32 );
+      header->header_offset = memoryRead<uint32_t>( entry + 42 );
+      
+      const size_t entry_size = central_header_size + filename_length + extra_length + comment_length;
+      if( (pos + entry_size) > eocd )
+        throw runtime_error( "ZipArchive: invalid central directory entry" );
+      
+      header->filename = string( entry + central_header_size, entry + central_header_size + filename_length );
+      
+      // Filenames are null-terminated in the stream based reader
+      const size_t null_pos = header->filename.find( '\0' );
+      if( null_pos != string::npos )
+        header->filename.resize( null_pos );
+      
+      m_headers[header->filename] = header;
+      
+      pos += entry_size;
+    }//for( uint16_t i = 0; i < num_files; ++i )
+    
+    if( m_headers.empty() )
+      throw runtime_error( "ZipArchive: no files found in archive" );
+  }catch( std::exception & )
+  {
+#if( !defined(_WIN32) )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+    throw;
+  }//try / catch
+}//MappedZipFile constructor
+
+
+MappedZipFile::~MappedZipFile()
+{
+#if( !defined(_WIN32) )
+  if( m_data )
+    munmap( const_cast<char *>(m_data), m_size );
+#endif
+}//~MappedZipFile()
+
+
+const FilenameToZipHeaderMap &MappedZipFile::headers() const
+{
+  return m_headers;
+}
+
+
+std::shared_ptr<const ZipFileHeader> MappedZipFile::header( const std::string &filename ) const
+{
+  const auto pos = m_headers.find( filename );
+  return (pos == end(m_headers)) ? nullptr : pos->second;
+}
+
+
+std::pair<const char *,size_t> MappedZipFile::stored_data( const ZipFileHeader &header ) const
+{
+  // The local header may have a different length extra field than the central directory, so we
+  //  have to read it to find where the data starts.
+  const size_t local_header_size = 30;
+  const size_t offset = header.header_offset;
+  
+  if( ((offset + local_header_size) > m_size)
+     || (memoryRead<uint32_t>( m_data + offset ) != 0x04034b50) )
+    throw runtime_error( "ZipArchive: error reading local header" );
+  
+  const uint16_t filename_length = memoryRead<uint16_t>( m_data + offset + 26 );
+  const uint16_t extra_length = memoryRead<uint16_t>( m_data + offset + 28 );
+  const size_t data_start = offset + local_header_size + filename_length + extra_length;
+  
+  if( (static_cast<uint64_t>(data_start) + header.compressed_size) > m_size )
+    throw runtime_error( "ZipArchive: entry extends past end of file" );
+  
+  return { m_data + data_start, static_cast<size_t>(header.compressed_size) };
+}//stored_data(...)
+
+
+size_t MappedZipFile::read_file( const ZipFileHeader &header, char *buffer, const size_t buffer_size ) const
+{
+  if( buffer_size < header.uncompressed_size )
+    throw runtime_error( "ZipArchive: output buffer too small" );
+  
+  const pair<const char *,size_t> data = stored_data( header );
+  
+  if( header.compression_type == sm_zip_uncompressed )
+  {
+    if( data.second != header.uncompressed_size )
+      throw runtime_error( "ZipArchive: read size error" );
+    
+    if( data.second )
+      memcpy( buffer, data.first, data.second );
+    return data.second;
+  }//if( header.compression_type == sm_zip_uncompressed )
+  
+  if( header.compression_type != sm_zip_deflate )
+    throw runtime_error( "ZipArchive: unrecognized compression" );
+  
+  if( !header.uncompressed_size )
+    return 0;
+  
+  z_stream strm;
+  strm.zalloc   = Z_NULL;
+  strm.zfree    = Z_NULL;
+  strm.opaque   = Z_NULL;
+  strm.next_in  = (Bytef *)data.first;
+  strm.avail_in = static_cast<uInt>( data.second );
+  strm.next_out = (Bytef *)buffer;
+  strm.avail_out = static_cast<uInt>( std::min( buffer_size, static_cast<size_t>(header.uncompressed_size) ) );
+  
+  if( inflateInit2( &strm, -MAX_WBITS ) != Z_OK )
+    throw runtime_error( "ZipArchive: gzip inflateInit2 didnt return Z_OK" );
+  
+  const int ret = inflate( &strm, Z_FINISH );
+  const size_t nwritten = static_cast<size_t>( strm.total_out );
+  const string msg = strm.msg ? strm.msg : "(no msg)";
+  inflateEnd( &strm );
+  
+  if( ret != Z_STREAM_END )
+    throw runtime_error( "ZipArchive: gzip error " + msg );
+  
+  return nwritten;
+}//read_file( header, buffer, buffer_size )
+
+
+size_t MappedZipFile::read_file( const ZipFileHeader &header, std::vector<char> &output ) const
+{
+  output.resize( header.uncompressed_size );
+  const size_t nwritten = read_file( header, output.data(), output.size() );
+  output.resize( nwritten );
+  return nwritten;
+}//read_file( header, vector<char> )
+
+
+size_t MappedZipFile::read_file( const ZipFileHeader &header, std::ostream &output ) const
+{
+  return decode( header, [&output]( const char *data, size_t len ){
+    output.write( data, len );
+    if( !output )
+      throw runtime_error( "ZipArchive: error writing output" );
+  } );
+}//read_file( header, ostream )
+
+
+size_t MappedZipFile::decode( const ZipFileHeader &header,
+                              const std::function<void(const char *,size_t)> &consumer ) const
+{
+  const pair<const char *,size_t> data = stored_data( header );
+  
+  if( header.compression_type == sm_zip_uncompressed )
+  {
+    consumer( data.first, data.second );
+    return data.second;
+  }
+  
+  if( header.compression_type != sm_zip_deflate )
+    throw runtime_error( "ZipArchive: unrecognized compression" );
+  
+  z_stream strm;
+  strm.zalloc   = Z_NULL;
+  strm.zfree    = Z_NULL;
+  strm.opaque   = Z_NULL;
+  strm.next_in  = (Bytef *)data.first;
+  strm.avail_in = static_cast<uInt>( data.second );
+  
+  if( inflateInit2( &strm, -MAX_WBITS ) != Z_OK )
+    throw runtime_error( "ZipArchive: gzip inflateInit2 didnt return Z_OK" );
+  
+  const size_t chunk_size = 64*1024;
+  std::unique_ptr<char []> out( new char[chunk_size] );
+  
+  size_t total_out = 0;
+  try
+  {
+    int ret = Z_OK;
+    while( ret != Z_STREAM_END )
+    {
+      strm.next_out = (Bytef *)out.get();
+      strm.avail_out = static_cast<uInt>( chunk_size );
+      
+      ret = inflate( &strm, Z_NO_FLUSH );
+      
+      switch( ret )
+      {
+        case Z_OK:
+        case Z_STREAM_END:
+          break;
+          
+        case Z_BUF_ERROR:
+          // No progress possible; since all input is available, the stream is truncated.
+          throw runtime_error( "ZipArchive: read size error" );
+          
+        default:
+          throw runtime_error( "ZipArchive: gzip error " + string(strm.msg ? strm.msg : "(no msg)") );
+      }//switch( ret )
+      
+      const size_t nout = chunk_size - strm.avail_out;
+      if( nout )
+        consumer( out.get(), nout );
+      total_out += nout;
+    }//while( ret != Z_STREAM_END )
+  }catch( ... )
+  {
+    inflateEnd( &strm );
+    throw;
+  }
+  
+  inflateEnd( &strm );
+  
+  return total_out;
+}//decode(...)
 }//namespace ZipArchive
 
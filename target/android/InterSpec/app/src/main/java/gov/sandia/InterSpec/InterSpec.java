@@ -800,6 +800,20 @@ public class InterSpec extends AppCompatActivity
   }//void onPause()
 
 
+  @Override
+  public void onTrimMemory( int level )
+  {
+    super.onTrimMemory( level );
+
+    Log.d("onTrimMemory", "onTrimMemory called with level " + level );
+
+    // Release memory if the system is running low while we are in the foreground, or once we
+    //  are in the background (where we are a candidate to be killed).
+    if( level >= ComponentCallbacks2.TRIM_MEMORY_RUNNING_LOW )
+      releaseMemory();
+  }//void onTrimMemory( int level )
+
+
   @Override
   protected void onResume()
   {
@@ -1096,6 +1110,7 @@ public class InterSpec extends AppCompatActivity
   public static native int openFile( String sessionToken, String filepath);
   public static native boolean openAppUrl( String sessionToken, String url );
   public static native boolean killServer();
+  public static native void releaseMemory();
   public static native boolean setTempDir( String tmpdir );
   public static native boolean setRequireSessionToken( String require );
   public static native boolean addPrimarySessionToken( String token );
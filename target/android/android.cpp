@@ -495,6 +495,16 @@ JNIEXPORT
     __android_log_write( ANDROID_LOG_INFO, "killServer", "Killed server"  );
     return true;
   }
+  
+  
+  JNIEXPORT
+  void
+  JNICALL
+  Java_gov_sandia_InterSpec_InterSpec_releaseMemory(JNIEnv* env, jobject thiz)
+  {
+    InterSpecApp::releaseMemoryOfAllSessions();
+    __android_log_write( ANDROID_LOG_INFO, "releaseMemory", "Requested sessions release memory" );
+  }
 
   
   JNIEXPORT
@@ -0,0 +1,597 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <set>
+#include <deque>
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+
+#include "rapidxml/rapidxml.hpp"
+
+#include "Minuit2/MnUserParameters.h"
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+#include "SpecUtils/RapidXmlUtils.hpp"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/PeakFit.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/PeakDists.h"
+#include "InterSpec/MaterialDB.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/DetectorPeakResponse.h"
+#include "InterSpec/GammaInteractionCalc.h"
+#include "InterSpec/ShieldingSourceFitCalc.h"
+
+#if( USE_REL_ACT_TOOL )
+#include "InterSpec/PeakFitLM.h"
+#include "InterSpec/RelActCalc.h"
+#include "InterSpec/RelActCalcAuto.h"
+#endif
+
+#if( BENCHMARK_SESSION_START )
+#include <Wt/Test/WTestEnvironment>
+
+#include "InterSpec/InterSpecApp.h"
+#include "InterSpec/DataBaseUtils.h"
+#endif
+
+
+/** A small, dependency free, benchmark harness for the hot paths of peak fitting, relative
+ activity, shielding/source fitting, and spectrum parsing.
+
+ Each benchmark is ran repeatedly until at least `--min-time` seconds (default 0.5) have elapsed,
+ and the mean wall and CPU time per iteration are reported.  Results can be written to a JSON
+ file, using the same layout as Google Benchmarks `--benchmark_out_format=json`, so existing
+ tooling can be used to track results over time.
+
+ Arguments:
+   --datadir=path      Path to InterSpecs "data" directory (for sandia.decay.xml, etc).
+   --testfiledir=path  Path to "target/testing" (for the "analysis_tests" spectra).
+   --spectradir=path   Path to "example_spectra".
+   --json=file.json    File to write results to.
+   --filter=text       Only run benchmarks whose name contains this text.
+   --min-time=seconds  Minimum time to run each benchmark for.
+ */
+
+using namespace std;
+
+
+namespace
+{
+  struct BenchmarkResult
+  {
+    string name;
+    size_t iterations = 0;
+    double real_time_us = 0.0;
+    double cpu_time_us = 0.0;
+  };//struct BenchmarkResult
+
+
+  string g_data_dir, g_test_file_dir, g_spectra_dir, g_json_file, g_filter;
+  double g_min_time = 0.5;
+  vector<BenchmarkResult> g_results;
+
+
+  /** Runs `fcn` until at least `g_min_time` seconds have passed, and records the timing. */
+  void run_benchmark( const string &name, const std::function<void()> &fcn )
+  {
+    if( !g_filter.empty() && (name.find(g_filter) == string::npos) )
+      return;
+
+    try
+    {
+      fcn(); //warm-up; also lets us skip benchmarks that throw, before timing them
+    }catch( std::exception &e )
+    {
+      cerr << setw(50) << left << name << " skipped: " << e.what() << endl;
+      return;
+    }
+
+    size_t iterations = 0;
+    const auto start_wall = std::chrono::steady_clock::now();
+    const std::clock_t start_cpu = std::clock();
+    double elapsed = 0.0;
+
+    do
+    {
+      fcn();
+      ++iterations;
+      elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start_wall ).count();
+    }while( elapsed < g_min_time );
+
+    const double cpu_elapsed = static_cast<double>(std::clock() - start_cpu) / CLOCKS_PER_SEC;
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.real_time_us = 1.0E6 * elapsed / iterations;
+    result.cpu_time_us = 1.0E6 * cpu_elapsed / iterations;
+    g_results.push_back( result );
+
+    cout << setw(50) << left << name
+         << setw(14) << right << fixed << setprecision(2) << result.real_time_us << " us"
+         << setw(14) << right << result.cpu_time_us << " us (cpu)"
+         << setw(10) << right << iterations << " iterations" << endl;
+  }//run_benchmark(...)
+
+
+  void write_json_results()
+  {
+    if( g_json_file.empty() )
+      return;
+
+    ofstream output( g_json_file.c_str(), ios::out | ios::binary );
+    if( !output )
+      throw runtime_error( "Could not open '" + g_json_file + "' for writing." );
+
+    const time_t now = std::time( nullptr );
+    char datestr[64] = { '\0' };
+    std::strftime( datestr, sizeof(datestr), "%Y-%m-%dT%H:%M:%S", std::localtime( &now ) );
+
+    output << "{\n"
+           << "  \"context\": {\n"
+           << "    \"date\": \"" << datestr << "\",\n"
+#if( defined(InterSpec_VERSION) )
+           << "    \"interspec_version\": \"" << InterSpec_VERSION << "\",\n"
+#endif
+           << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+           << "    \"min_time\": " << g_min_time << "\n"
+           << "  },\n"
+           << "  \"benchmarks\": [\n";
+
+    for( size_t i = 0; i < g_results.size(); ++i )
+    {
+      const BenchmarkResult &r = g_results[i];
+      output << "    {\n"
+             << "      \"name\": \"" << r.name << "\",\n"
+             << "      \"run_type\": \"iteration\",\n"
+             << "      \"iterations\": " << r.iterations << ",\n"
+             << "      \"real_time\": " << setprecision(6) << r.real_time_us << ",\n"
+             << "      \"cpu_time\": " << r.cpu_time_us << ",\n"
+             << "      \"time_unit\": \"us\"\n"
+             << "    }" << ((i + 1) < g_results.size() ? "," : "") << "\n";
+    }//for( size_t i = 0; i < g_results.size(); ++i )
+
+    output << "  ]\n"
+           << "}\n";
+  }//void write_json_results()
+
+
+  void parse_arguments( int argc, char **argv )
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      const string arg = argv[i];
+      if( SpecUtils::istarts_with( arg, "--datadir=" ) )
+        g_data_dir = arg.substr( 10 );
+      else if( SpecUtils::istarts_with( arg, "--testfiledir=" ) )
+        g_test_file_dir = arg.substr( 14 );
+      else if( SpecUtils::istarts_with( arg, "--spectradir=" ) )
+        g_spectra_dir = arg.substr( 13 );
+      else if( SpecUtils::istarts_with( arg, "--json=" ) )
+        g_json_file = arg.substr( 7 );
+      else if( SpecUtils::istarts_with( arg, "--filter=" ) )
+        g_filter = arg.substr( 9 );
+      else if( SpecUtils::istarts_with( arg, "--min-time=" ) )
+        g_min_time = std::stod( arg.substr( 11 ) );
+      else
+        cerr << "Unrecognized argument '" << arg << "'" << endl;
+    }//for( int i = 1; i < argc; ++i )
+
+    // Search around a little for the directories, if they werent specified
+    if( g_data_dir.empty() )
+    {
+      for( const auto &d : { "data", "../data", "../../data", "../../../data" } )
+      {
+        if( SpecUtils::is_file( SpecUtils::append_path(d, "sandia.decay.xml") ) )
+        {
+          g_data_dir = d;
+          break;
+        }
+      }//for( loop over candidate dirs )
+    }//if( g_data_dir.empty() )
+
+    if( g_test_file_dir.empty() )
+    {
+      for( const auto &d : { "target/testing", "../testing", "../../testing", "../../../target/testing" } )
+      {
+        if( SpecUtils::is_directory( SpecUtils::append_path(d, "analysis_tests") ) )
+        {
+          g_test_file_dir = d;
+          break;
+        }
+      }//for( loop over candidate dirs )
+    }//if( g_test_file_dir.empty() )
+
+    if( g_spectra_dir.empty() )
+    {
+      for( const auto &d : { "example_spectra", "../example_spectra", "../../example_spectra", "../../../example_spectra" } )
+      {
+        if( SpecUtils::is_directory( d ) )
+        {
+          g_spectra_dir = d;
+          break;
+        }
+      }//for( loop over candidate dirs )
+    }//if( g_spectra_dir.empty() )
+
+    if( !SpecUtils::is_file( SpecUtils::append_path(g_data_dir, "sandia.decay.xml") ) )
+      throw runtime_error( "Could not find sandia.decay.xml; please specify --datadir" );
+
+    InterSpec::setStaticDataDirectory( g_data_dir );
+  }//void parse_arguments( int argc, char **argv )
+
+
+  /** The spectrum file, with peaks, DRF and shielding/source model, that most of the benchmarks use. */
+  shared_ptr<SpecMeas> load_analysis_test_file()
+  {
+    const string filename = SpecUtils::append_path( g_test_file_dir,
+                      "analysis_tests/AEGIS_Eu152_surface_contamination.n42_20230622T113239.276178.n42" );
+
+    auto specfile = make_shared<SpecMeas>();
+    if( !specfile->load_N42_file( filename ) )
+      throw runtime_error( "Could not load '" + filename + "'" );
+
+    if( specfile->measurements().empty() )
+      throw runtime_error( "No measurements in '" + filename + "'" );
+
+    return specfile;
+  }//load_analysis_test_file()
+
+
+  void benchmark_peak_dists()
+  {
+    // A HPGe-like 16k channel energy calibration, and a ROI of +-10 sigma around a 661 keV peak
+    vector<float> energies( 16385 );
+    for( size_t i = 0; i < energies.size(); ++i )
+      energies[i] = 0.183f * static_cast<float>(i);
+
+    const double mean = 661.657, sigma = 0.75, amp = 1.0E5;
+    const size_t start_channel = static_cast<size_t>( (mean - 10.0*sigma) / 0.183 );
+    const size_t nchannel = static_cast<size_t>( 20.0*sigma / 0.183 );
+    const float * const lower_energies = &(energies[start_channel]);
+    vector<double> counts( nchannel, 0.0 );
+
+    const vector<pair<PeakDef::SkewType,vector<double>>> dists{
+      { PeakDef::SkewType::NoSkew, {} },
+      { PeakDef::SkewType::Bortel, { 1.1 } },
+      { PeakDef::SkewType::GaussExp, { 1.7 } },
+      { PeakDef::SkewType::CrystalBall, { 1.2, 3.5 } },
+      { PeakDef::SkewType::ExpGaussExp, { 1.4, 2.1 } },
+      { PeakDef::SkewType::DoubleSidedCrystalBall, { 1.2, 3.5, 2.1, 6.0 } }
+    };
+
+    for( const auto &dist : dists )
+    {
+      const PeakDef::SkewType skew_type = dist.first;
+      const double * const skew_pars = dist.second.empty() ? nullptr : dist.second.data();
+
+      run_benchmark( string("PeakDists/photopeak_integral/") + PeakDef::to_string(skew_type), [&](){
+        std::fill( begin(counts), end(counts), 0.0 );
+        PeakDists::photopeak_function_integral( mean, sigma, amp, skew_type, skew_pars,
+                                                nchannel, lower_energies, counts.data() );
+      } );
+    }//for( const auto &dist : dists )
+
+    run_benchmark( "PeakDists/gaussian_integral/per_channel", [&](){
+      for( size_t i = 0; i < nchannel; ++i )
+        counts[i] = amp * PeakDists::gaussian_integral( mean, sigma, lower_energies[i], lower_energies[i+1] );
+    } );
+  }//void benchmark_peak_dists()
+
+
+  void benchmark_spectrum_parsing()
+  {
+    vector<string> files = SpecUtils::recursive_ls( g_spectra_dir );
+    files.push_back( SpecUtils::append_path( g_test_file_dir,
+                      "analysis_tests/AEGIS_Eu152_surface_contamination.n42_20230622T113239.276178.n42" ) );
+
+    for( const string &filename : files )
+    {
+      if( !SpecUtils::is_file( filename ) )
+        continue;
+
+      run_benchmark( "SpecMeas/load_file/" + SpecUtils::filename(filename), [&filename](){
+        SpecMeas spec;
+        if( !spec.load_file( filename, SpecUtils::ParserType::Auto ) )
+          throw runtime_error( "failed to parse" );
+      } );
+    }//for( const string &filename : files )
+  }//void benchmark_spectrum_parsing()
+
+
+  void benchmark_peak_search()
+  {
+    const shared_ptr<SpecMeas> specfile = load_analysis_test_file();
+    const shared_ptr<const SpecUtils::Measurement> foreground = specfile->measurements()[0];
+    const shared_ptr<const DetectorPeakResponse> drf = specfile->detector();
+
+    run_benchmark( "PeakFit/search_for_peaks/single_threaded", [&](){
+      ExperimentalAutomatedPeakSearch::search_for_peaks( foreground, drf, nullptr, true );
+    } );
+
+    run_benchmark( "PeakFit/search_for_peaks/multi_threaded", [&](){
+      ExperimentalAutomatedPeakSearch::search_for_peaks( foreground, drf, nullptr, false );
+    } );
+
+#if( USE_REL_ACT_TOOL )
+    shared_ptr<const deque<shared_ptr<const PeakDef>>> peaks = specfile->peaks( specfile->sample_numbers() );
+    if( !peaks || peaks->empty() )
+      throw runtime_error( "No peaks in analysis test file" );
+
+    // Use the largest peak in the file as the "user click"
+    shared_ptr<const PeakDef> click_peak;
+    for( const shared_ptr<const PeakDef> &p : *peaks )
+    {
+      if( p && p->gausPeak() && (!click_peak || (p->amplitude() > click_peak->amplitude())) )
+        click_peak = p;
+    }
+
+    if( !click_peak )
+      throw runtime_error( "No Gaussian peaks in analysis test file" );
+
+    run_benchmark( "PeakFitLM/fit_peak_for_user_click_LM", [&](){
+      vector<shared_ptr<const PeakDef>> results;
+      double chi2Dof = 0.0;
+      PeakFitLM::fit_peak_for_user_click_LM( results, chi2Dof, foreground, {},
+                                             click_peak->mean(), click_peak->sigma(),
+                                             click_peak->amplitude(),
+                                             static_cast<float>( click_peak->lowerX() ),
+                                             static_cast<float>( click_peak->upperX() ) );
+    } );
+#endif //USE_REL_ACT_TOOL
+  }//void benchmark_peak_search()
+
+
+#if( USE_REL_ACT_TOOL )
+  void benchmark_rel_act_auto()
+  {
+    const shared_ptr<SpecMeas> specfile = load_analysis_test_file();
+    const shared_ptr<const SpecUtils::Measurement> foreground = specfile->measurements()[0];
+    shared_ptr<const deque<shared_ptr<const PeakDef>>> peaks = specfile->peaks( specfile->sample_numbers() );
+    if( !peaks || peaks->empty() )
+      throw runtime_error( "No peaks in analysis test file" );
+
+    // Setup the problem from the analysts peaks, similar to `RelActCalcAuto::run_test()`
+    vector<RelActCalcAuto::RoiRange> energy_ranges;
+    vector<RelActCalcAuto::NucInputInfo> nuclides;
+    vector<RelActCalcAuto::FloatingPeak> extra_peaks;
+    set<shared_ptr<const PeakContinuum>> continuums;
+
+    for( const shared_ptr<const PeakDef> &peak : *peaks )
+    {
+      const SandiaDecay::Nuclide * const nuc = peak->parentNuclide();
+      if( !nuc )
+        continue;
+
+      continuums.insert( peak->continuum() );
+
+      bool have_nuc = false;
+      for( const RelActCalcAuto::NucInputInfo &n : nuclides )
+        have_nuc |= (n.nuclide == nuc);
+
+      if( !have_nuc )
+      {
+        RelActCalcAuto::NucInputInfo nucinfo;
+        nucinfo.nuclide = nuc;
+        nucinfo.age = PeakDef::defaultDecayTime( nuc, nullptr );
+        nucinfo.fit_age = false;
+        nuclides.push_back( nucinfo );
+      }
+    }//for( const shared_ptr<const PeakDef> &peak : *peaks )
+
+    for( const shared_ptr<const PeakContinuum> &cont : continuums )
+    {
+      RelActCalcAuto::RoiRange range;
+      range.lower_energy = cont->lowerEnergy();
+      range.upper_energy = cont->upperEnergy();
+      range.continuum_type = cont->type();
+      range.force_full_range = true;
+      range.allow_expand_for_peak_width = false;
+      energy_ranges.push_back( range );
+    }//for( const auto &cont : continuums )
+
+    if( nuclides.empty() || energy_ranges.empty() )
+      throw runtime_error( "No nuclide assigned peaks in analysis test file" );
+
+    RelActCalcAuto::Options options;
+    options.fit_energy_cal = false;
+    options.rel_eff_eqn_type = RelActCalc::RelEffEqnForm::LnX;
+    options.rel_eff_eqn_order = 3;
+
+    const vector<shared_ptr<const PeakDef>> all_peaks( begin(*peaks), end(*peaks) );
+
+    run_benchmark( "RelActCalcAuto/solve", [&](){
+      const RelActCalcAuto::RelActAutoSolution solution
+                        = RelActCalcAuto::solve( options, energy_ranges, nuclides, extra_peaks,
+                                                 foreground, nullptr, nullptr, all_peaks );
+      if( solution.m_status != RelActCalcAuto::RelActAutoSolution::Status::Success )
+        throw runtime_error( "solve failed: " + solution.m_error_message );
+    } );
+  }//void benchmark_rel_act_auto()
+#endif //USE_REL_ACT_TOOL
+
+
+  void benchmark_shielding_source_chi2()
+  {
+    const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+    if( !db )
+      throw runtime_error( "Error initing SandiaDecayDataBase" );
+
+    MaterialDB matdb;
+    const string materialfile = SpecUtils::append_path( InterSpec::staticDataDirectory(), "MaterialDataBase.txt" );
+    matdb.parseGadrasMaterialFile( materialfile, db, false );
+
+    const shared_ptr<SpecMeas> specfile = load_analysis_test_file();
+    const shared_ptr<const SpecUtils::Measurement> foreground = specfile->measurements()[0];
+    const shared_ptr<const DetectorPeakResponse> detector = specfile->detector();
+    shared_ptr<const deque<shared_ptr<const PeakDef>>> peaks = specfile->peaks( specfile->sample_numbers() );
+
+    if( !peaks || !detector || !detector->isValid() )
+      throw runtime_error( "Analysis test file missing peaks or DRF" );
+
+    rapidxml::xml_document<char> *model_xml = specfile->shieldingSourceModel();
+    const rapidxml::xml_node<char> *base_node = model_xml ? model_xml->first_node() : nullptr;
+    if( !base_node )
+      throw runtime_error( "Analysis test file missing shielding/source model" );
+
+    const rapidxml::xml_node<char> *geom_node = base_node->first_node( "Geometry" );
+    const rapidxml::xml_node<char> *dist_node = base_node->first_node( "Distance" );
+    const rapidxml::xml_node<char> *shieldings_node = base_node->first_node( "Shieldings" );
+    const rapidxml::xml_node<char> *srcs_node = base_node->first_node( "Nuclides" );
+    if( !geom_node || !dist_node || !shieldings_node || !srcs_node )
+      throw runtime_error( "Invalid shielding/source model" );
+
+    const double distance = PhysicalUnits::stringToDistance( SpecUtils::xml_value_str( dist_node ) );
+
+    const string geomstr = SpecUtils::xml_value_str( geom_node );
+    GammaInteractionCalc::GeometryType geometry = GammaInteractionCalc::GeometryType::NumGeometryType;
+    for( GammaInteractionCalc::GeometryType type = GammaInteractionCalc::GeometryType(0);
+        type != GammaInteractionCalc::GeometryType::NumGeometryType;
+        type = GammaInteractionCalc::GeometryType(static_cast<int>(type) + 1) )
+    {
+      if( SpecUtils::iequals_ascii(geomstr, GammaInteractionCalc::to_str(type)) )
+        geometry = type;
+    }
+
+    if( geometry == GammaInteractionCalc::GeometryType::NumGeometryType )
+      throw runtime_error( "Invalid geometry" );
+
+    ShieldingSourceFitCalc::ShieldingSourceFitOptions options;
+    options.deSerialize( base_node );
+
+    vector<ShieldingSourceFitCalc::ShieldingInfo> shield_definitions;
+    XML_FOREACH_CHILD(shield_node, shieldings_node, "Shielding")
+    {
+      ShieldingSourceFitCalc::ShieldingInfo info;
+      info.deSerialize( shield_node, &matdb );
+      shield_definitions.push_back( info );
+    }
+
+    vector<ShieldingSourceFitCalc::SourceFitDef> src_definitions;
+    XML_FOREACH_CHILD( src_node, srcs_node, "Nuclide" )
+    {
+      ShieldingSourceFitCalc::SourceFitDef info;
+      info.deSerialize( src_node );
+      src_definitions.push_back( info );
+    }
+
+    pair<shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParameters> fcn_pars
+          = GammaInteractionCalc::ShieldingSourceChi2Fcn::create( distance, geometry,
+                                  shield_definitions, src_definitions, detector,
+                                  foreground, nullptr, *peaks, nullptr, options );
+
+    const shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> &chi2fcn = fcn_pars.first;
+    const vector<double> params = fcn_pars.second.Params();
+
+    run_benchmark( "ShieldingSourceChi2Fcn/DoEval", [&](){
+      chi2fcn->DoEval( params );
+    } );
+  }//void benchmark_shielding_source_chi2()
+
+
+#if( BENCHMARK_SESSION_START )
+  /** Times creating (and destroying) a session - i.e., a InterSpecApp, and all the widgets
+   constructed when a user first loads the page; this is the per-session cost that limits how
+   many sessions a server can hold.
+   */
+  void benchmark_session_start()
+  {
+    const string prefdb = SpecUtils::temp_file_name( "bench_session_start", SpecUtils::temp_dir() );
+    DataBaseUtils::setPreferenceDatabaseFile( prefdb );
+
+    run_benchmark( "InterSpecApp/session_start", [](){
+      Wt::Test::WTestEnvironment env( Wt::Application );
+      std::unique_ptr<InterSpecApp> app( new InterSpecApp( env ) );
+    } );
+
+    SpecUtils::remove_file( prefdb );
+  }//void benchmark_session_start()
+#endif //BENCHMARK_SESSION_START
+}//namespace
+
+
+int main( int argc, char **argv )
+{
+  try
+  {
+    parse_arguments( argc, argv );
+  }catch( std::exception &e )
+  {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  const vector<pair<string,std::function<void()>>> groups{
+    { "PeakDists", &benchmark_peak_dists },
+    { "SpecMeas", &benchmark_spectrum_parsing },
+    { "PeakFit", &benchmark_peak_search },
+#if( USE_REL_ACT_TOOL )
+    { "RelActCalcAuto", &benchmark_rel_act_auto },
+#endif
+    { "ShieldingSourceChi2Fcn", &benchmark_shielding_source_chi2 },
+#if( BENCHMARK_SESSION_START )
+    { "InterSpecApp", &benchmark_session_start },
+#endif
+  };
+
+  for( const auto &group : groups )
+  {
+    try
+    {
+      group.second();
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to setup " << group.first << " benchmarks: " << e.what() << endl;
+    }
+  }//for( const auto &group : groups )
+
+  try
+  {
+    write_json_results();
+  }catch( std::exception &e )
+  {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}//main(...)
@@ -0,0 +1,470 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#if( defined(__linux__) )
+#include <unistd.h>
+#elif( defined(__APPLE__) )
+#include <mach/mach.h>
+#endif
+
+#include <Wt/WApplication>
+#include <Wt/Test/WTestEnvironment>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/PeakFit.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/PeakModel.h"
+#include "InterSpec/InterSpecApp.h"
+#include "InterSpec/DataBaseUtils.h"
+#include "InterSpec/ShieldingSourceDisplay.h"
+
+
+/** A synthetic load generator: creates a number of simulated sessions (i.e., `InterSpecApp`s, using
+ Wt::Test::WTestEnvironment, so no browser or HTTP is involved), and has each of them repeatedly
+ run a script of the actions a user commonly does, timing each action.
+
+ The actions are the same ones exercised by the SpectrumViewerTester states: opening a spectrum
+ file, automated peak search, opening the relative activity tool, fitting the shielding/source
+ model, and zooming the spectrum chart.  The work the GUI would normally post to the server thread
+ pool (e.g., the peak search) is done synchronously here, so each timing includes the computation.
+
+ Sessions are split between `--threads` worker threads, so the timings reflect the contention of
+ that many sessions being active at once.  Reported are the latency percentiles of each action, and
+ the resident memory of the process per session.
+
+ Arguments:
+   --datadir=path      Path to InterSpecs "data" directory (for sandia.decay.xml, etc).
+   --testfiledir=path  Path to "target/testing" (for the default spectrum file).
+   --file=path         Spectrum file to open; should have peaks and a shielding/source model.
+   --sessions=N        Number of simulated sessions (default 8).
+   --threads=N         Number of worker threads (default: number of sessions, up to the CPU count).
+   --rounds=N          Number of times each session runs the script (default 3).
+   --json=file.json    File to write results to.
+ */
+
+using namespace std;
+
+
+namespace
+{
+  string g_data_dir, g_test_file_dir, g_spectrum_file, g_json_file;
+  size_t g_num_sessions = 8, g_num_threads = 0, g_num_rounds = 3;
+
+
+  /** Returns resident memory of the process, in bytes, or 0 if not known on this platform. */
+  size_t resident_memory_bytes()
+  {
+#if( defined(__linux__) )
+    ifstream statm( "/proc/self/statm" );
+    size_t total_pages = 0, resident_pages = 0;
+    if( !(statm >> total_pages >> resident_pages) )
+      return 0;
+    return resident_pages * static_cast<size_t>( sysconf(_SC_PAGESIZE) );
+#elif( defined(__APPLE__) )
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if( task_info( mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count ) != KERN_SUCCESS )
+      return 0;
+    return static_cast<size_t>( info.resident_size );
+#else
+    return 0;
+#endif
+  }//size_t resident_memory_bytes()
+
+
+  /** Latencies, in milliseconds, of each action, from all sessions. */
+  class ActionTimes
+  {
+  public:
+    void add( const string &action, const double ms )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_times[action].push_back( ms );
+    }
+
+    map<string,vector<double>> times()
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      return m_times;
+    }
+
+  private:
+    std::mutex m_mutex;
+    map<string,vector<double>> m_times;
+  };//class ActionTimes
+
+
+  struct SimulatedSession
+  {
+    std::unique_ptr<Wt::Test::WTestEnvironment> env;
+    std::unique_ptr<InterSpecApp> app;
+    std::mt19937 rng;
+  };//struct SimulatedSession
+
+
+  /** Runs `fcn` with the session locked, recording how long it took under `action`.  Exceptions are
+   counted as failures, rather than stopping the benchmark.
+   */
+  void time_action( SimulatedSession &session, ActionTimes &times, const string &action,
+                    const std::function<void(InterSpec *)> &fcn )
+  {
+    Wt::WApplication::UpdateLock lock( session.app.get() );
+    InterSpec *viewer = session.app->viewer();
+    if( !viewer )
+      throw runtime_error( "Session doesnt have a InterSpec instance" );
+
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+      fcn( viewer );
+    }catch( std::exception &e )
+    {
+      cerr << "Action '" << action << "' failed: " << e.what() << endl;
+      times.add( action + "/failed", 0.0 );
+      return;
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    times.add( action, std::chrono::duration<double,std::milli>( end - start ).count() );
+  }//time_action(...)
+
+
+  /** The actions a simulated user does each round. */
+  void run_script( SimulatedSession &session, ActionTimes &times )
+  {
+    time_action( session, times, "open_file", [&session]( InterSpec *viewer ){
+      if( !session.app->userOpenFromFileSystem( g_spectrum_file ) )
+        throw runtime_error( "failed to open '" + g_spectrum_file + "'" );
+      if( !viewer->measurment( SpecUtils::SpectrumType::Foreground ) )
+        throw runtime_error( "no foreground after opening file" );
+    } );
+
+    for( size_t i = 0; i < 5; ++i )
+    {
+      std::uniform_real_distribution<float> lower_dist( 20.0f, 1500.0f ), width_dist( 10.0f, 500.0f );
+      const float lower = lower_dist( session.rng );
+      const float upper = lower + width_dist( session.rng );
+
+      time_action( session, times, "chart_zoom", [lower,upper]( InterSpec *viewer ){
+        viewer->setDisplayedEnergyRange( lower, upper );
+      } );
+    }//for( size_t i = 0; i < 5; ++i )
+
+    // Fit with the analyst peaks from the file, before the peak search replaces them
+    time_action( session, times, "shielding_fit", []( InterSpec *viewer ){
+      ShieldingSourceDisplay *display = viewer->shieldingSourceFit();
+      if( !display )
+        throw runtime_error( "couldnt create shielding/source fit tool" );
+      display->doModelFit( false );
+      viewer->closeShieldingSourceFit();
+    } );
+
+#if( USE_REL_ACT_TOOL )
+    // The RelActAutoGui solves in the server thread pool, which there isnt one of in the test
+    //  environment, so this only times creating the tool from the files state.
+    time_action( session, times, "rel_act_auto_gui", []( InterSpec *viewer ){
+      if( !viewer->showRelActAutoWindow() )
+        throw runtime_error( "couldnt create relative activity tool" );
+      viewer->handleRelActAutoClose();
+    } );
+#endif
+
+    time_action( session, times, "peak_search", []( InterSpec *viewer ){
+      const shared_ptr<SpecMeas> meas = viewer->measurment( SpecUtils::SpectrumType::Foreground );
+      const shared_ptr<const SpecUtils::Measurement> foreground
+                                    = viewer->displayedHistogram( SpecUtils::SpectrumType::Foreground );
+      if( !meas || !foreground )
+        throw runtime_error( "no foreground" );
+
+      vector<shared_ptr<const PeakDef>> peaks
+               = ExperimentalAutomatedPeakSearch::search_for_peaks( foreground, meas->detector(), nullptr, false );
+      viewer->peakModel()->setPeaks( peaks );
+    } );
+  }//void run_script(...)
+
+
+  /** Runs `fcn` on the sessions of each worker thread, with one thread per worker, and waits for
+   them all to finish.
+   */
+  void for_each_worker( vector<vector<SimulatedSession>> &workers,
+                        const std::function<void(vector<SimulatedSession> &)> &fcn )
+  {
+    vector<std::thread> threads;
+    for( vector<SimulatedSession> &sessions : workers )
+      threads.emplace_back( [&fcn,&sessions](){ fcn( sessions ); } );
+
+    for( std::thread &t : threads )
+      t.join();
+  }//for_each_worker(...)
+
+
+  /** Nearest-rank percentile, of sorted values. */
+  double percentile( const vector<double> &sorted, const double fraction )
+  {
+    if( sorted.empty() )
+      return 0.0;
+
+    const size_t rank = static_cast<size_t>( std::ceil( fraction * sorted.size() ) );
+    return sorted[std::min( std::max( rank, size_t(1) ), sorted.size() ) - 1];
+  }//percentile(...)
+
+
+  void parse_arguments( int argc, char **argv )
+  {
+    for( int i = 1; i < argc; ++i )
+    {
+      const string arg = argv[i];
+      if( SpecUtils::istarts_with( arg, "--datadir=" ) )
+        g_data_dir = arg.substr( 10 );
+      else if( SpecUtils::istarts_with( arg, "--testfiledir=" ) )
+        g_test_file_dir = arg.substr( 14 );
+      else if( SpecUtils::istarts_with( arg, "--file=" ) )
+        g_spectrum_file = arg.substr( 7 );
+      else if( SpecUtils::istarts_with( arg, "--sessions=" ) )
+        g_num_sessions = static_cast<size_t>( std::stoul( arg.substr( 11 ) ) );
+      else if( SpecUtils::istarts_with( arg, "--threads=" ) )
+        g_num_threads = static_cast<size_t>( std::stoul( arg.substr( 10 ) ) );
+      else if( SpecUtils::istarts_with( arg, "--rounds=" ) )
+        g_num_rounds = static_cast<size_t>( std::stoul( arg.substr( 9 ) ) );
+      else if( SpecUtils::istarts_with( arg, "--json=" ) )
+        g_json_file = arg.substr( 7 );
+      else
+        cerr << "Unrecognized argument '" << arg << "'" << endl;
+    }//for( int i = 1; i < argc; ++i )
+
+    if( g_data_dir.empty() )
+    {
+      for( const auto &d : { "data", "../data", "../../data", "../../../data" } )
+      {
+        if( SpecUtils::is_file( SpecUtils::append_path(d, "sandia.decay.xml") ) )
+        {
+          g_data_dir = d;
+          break;
+        }
+      }//for( loop over candidate dirs )
+    }//if( g_data_dir.empty() )
+
+    if( g_test_file_dir.empty() )
+    {
+      for( const auto &d : { "target/testing", "../testing", "../../testing", "../../../target/testing" } )
+      {
+        if( SpecUtils::is_directory( SpecUtils::append_path(d, "analysis_tests") ) )
+        {
+          g_test_file_dir = d;
+          break;
+        }
+      }//for( loop over candidate dirs )
+    }//if( g_test_file_dir.empty() )
+
+    if( g_spectrum_file.empty() )
+      g_spectrum_file = SpecUtils::append_path( g_test_file_dir,
+                      "analysis_tests/AEGIS_Eu152_surface_contamination.n42_20230622T113239.276178.n42" );
+
+    if( !SpecUtils::is_file( SpecUtils::append_path(g_data_dir, "sandia.decay.xml") ) )
+      throw runtime_error( "Could not find sandia.decay.xml; please specify --datadir" );
+
+    if( !SpecUtils::is_file( g_spectrum_file ) )
+      throw runtime_error( "Spectrum file '" + g_spectrum_file + "' doesnt exist; please specify --file" );
+
+    if( !g_num_sessions || !g_num_rounds )
+      throw runtime_error( "--sessions and --rounds must be at least 1" );
+
+    if( !g_num_threads )
+      g_num_threads = std::min( g_num_sessions, static_cast<size_t>( std::max( 1u, std::thread::hardware_concurrency() ) ) );
+    g_num_threads = std::min( g_num_threads, g_num_sessions );
+
+    InterSpec::setStaticDataDirectory( g_data_dir );
+  }//void parse_arguments( int argc, char **argv )
+}//namespace
+
+
+int main( int argc, char **argv )
+{
+  try
+  {
+    parse_arguments( argc, argv );
+  }catch( std::exception &e )
+  {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  const string prefdb = SpecUtils::temp_file_name( "bench_sessions", SpecUtils::temp_dir() );
+  DataBaseUtils::setPreferenceDatabaseFile( prefdb );
+
+  ActionTimes times;
+  vector<vector<SimulatedSession>> workers( g_num_threads );
+  for( size_t i = 0; i < g_num_sessions; ++i )
+    workers[i % g_num_threads].emplace_back();
+
+  const size_t initial_memory = resident_memory_bytes();
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::atomic<size_t> session_num( 0 );
+  for_each_worker( workers, [&times,&session_num]( vector<SimulatedSession> &sessions ){
+    for( SimulatedSession &session : sessions )
+    {
+      session.rng.seed( static_cast<unsigned int>( session_num++ ) );
+
+      const auto create_start = std::chrono::steady_clock::now();
+      session.env.reset( new Wt::Test::WTestEnvironment( Wt::Application ) );
+      session.app.reset( new InterSpecApp( *session.env ) );
+      const auto create_end = std::chrono::steady_clock::now();
+      times.add( "session_start", std::chrono::duration<double,std::milli>( create_end - create_start ).count() );
+    }
+  } );
+
+  const size_t memory_after_start = resident_memory_bytes();
+
+  for_each_worker( workers, [&times]( vector<SimulatedSession> &sessions ){
+    for( size_t round = 0; round < g_num_rounds; ++round )
+    {
+      for( SimulatedSession &session : sessions )
+        run_script( session, times );
+    }
+  } );
+
+  const auto end = std::chrono::steady_clock::now();
+  const size_t memory_after_script = resident_memory_bytes();
+
+  for_each_worker( workers, []( vector<SimulatedSession> &sessions ){
+    for( SimulatedSession &session : sessions )
+    {
+      session.app.reset();
+      session.env.reset();
+    }
+  } );
+
+  SpecUtils::remove_file( prefdb );
+
+  const double elapsed = std::chrono::duration<double>( end - start ).count();
+  const auto mb_per_session = []( const size_t before, const size_t after ) -> double {
+    return (after > before) ? (1.0E-6 * (after - before) / g_num_sessions) : 0.0;
+  };
+
+  cout << g_num_sessions << " sessions, " << g_num_threads << " threads, " << g_num_rounds
+       << " rounds, in " << fixed << setprecision(2) << elapsed << " s" << endl;
+  cout << "Resident memory per session: " << mb_per_session( initial_memory, memory_after_start )
+       << " MB after start-up, " << mb_per_session( initial_memory, memory_after_script )
+       << " MB after running script" << endl << endl;
+
+  cout << setw(24) << left << "action" << setw(8) << right << "count"
+       << setw(12) << "p50 (ms)" << setw(12) << "p90 (ms)" << setw(12) << "p99 (ms)"
+       << setw(12) << "max (ms)" << endl;
+
+  const map<string,vector<double>> all_times = times.times();
+  map<string,vector<double>> sorted_times;
+  for( const auto &action_times : all_times )
+  {
+    vector<double> sorted = action_times.second;
+    std::sort( begin(sorted), end(sorted) );
+
+    cout << setw(24) << left << action_times.first << setw(8) << right << sorted.size()
+         << setw(12) << percentile( sorted, 0.5 ) << setw(12) << percentile( sorted, 0.9 )
+         << setw(12) << percentile( sorted, 0.99 ) << setw(12) << sorted.back() << endl;
+
+    sorted_times[action_times.first] = std::move( sorted );
+  }//for( const auto &action_times : all_times )
+
+  if( g_json_file.empty() )
+    return EXIT_SUCCESS;
+
+  ofstream output( g_json_file.c_str(), ios::out | ios::binary );
+  if( !output )
+  {
+    cerr << "Could not open '" << g_json_file << "' for writing." << endl;
+    return EXIT_FAILURE;
+  }
+
+  const time_t now = std::time( nullptr );
+  char datestr[64] = { '\0' };
+  std::strftime( datestr, sizeof(datestr), "%Y-%m-%dT%H:%M:%S", std::localtime( &now ) );
+
+  // Same layout as bench_hot_paths (i.e., Google Benchmark), with the percentiles as extra fields
+  output << "{\n"
+         << "  \"context\": {\n"
+         << "    \"date\": \"" << datestr << "\",\n"
+         << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+         << "    \"sessions\": " << g_num_sessions << ",\n"
+         << "    \"threads\": " << g_num_threads << ",\n"
+         << "    \"rounds\": " << g_num_rounds << ",\n"
+         << "    \"elapsed_seconds\": " << setprecision(3) << elapsed << ",\n"
+         << "    \"mb_per_session_after_start\": " << mb_per_session( initial_memory, memory_after_start ) << ",\n"
+         << "    \"mb_per_session_after_script\": " << mb_per_session( initial_memory, memory_after_script ) << "\n"
+         << "  },\n"
+         << "  \"benchmarks\": [\n";
+
+  size_t index = 0;
+  for( const auto &action_times : sorted_times )
+  {
+    const vector<double> &sorted = action_times.second;
+    double mean = 0.0;
+    for( const double t : sorted )
+      mean += t / sorted.size();
+
+    output << "    {\n"
+           << "      \"name\": \"Sessions/" << action_times.first << "\",\n"
+           << "      \"run_type\": \"iteration\",\n"
+           << "      \"iterations\": " << sorted.size() << ",\n"
+           << "      \"real_time\": " << setprecision(6) << mean << ",\n"
+           << "      \"cpu_time\": " << mean << ",\n"
+           << "      \"p50\": " << percentile( sorted, 0.5 ) << ",\n"
+           << "      \"p90\": " << percentile( sorted, 0.9 ) << ",\n"
+           << "      \"p99\": " << percentile( sorted, 0.99 ) << ",\n"
+           << "      \"max\": " << sorted.back() << ",\n"
+           << "      \"time_unit\": \"ms\"\n"
+           << "    }" << ((++index < sorted_times.size()) ? "," : "") << "\n";
+  }//for( const auto &action_times : sorted_times )
+
+  output << "  ]\n"
+         << "}\n";
+
+  return EXIT_SUCCESS;
+}//main(...)
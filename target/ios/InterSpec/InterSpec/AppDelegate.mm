@@ -285,6 +285,10 @@ Wt::WApplication *createThisApplication(const Wt::WEnvironment& env)
   
   self.isInBackground = YES;
   
+  //Backgrounded apps are the first to be killed when the system is low on memory, so release
+  //  what we can now.
+  InterSpecApp::releaseMemoryOfAllSessions();
+  
   //If we can run a background thread (typically for at most 180 seconds), lets
   //  not kill the Wt server immediately, and instead wait until we're almost
   //  out of time to do this
@@ -369,6 +373,12 @@ Wt::WApplication *createThisApplication(const Wt::WEnvironment& env)
   }
 }
 
+- (void)applicationDidReceiveMemoryWarning:(UIApplication *)application
+{
+  NSLog(@"applicationDidReceiveMemoryWarning");
+  InterSpecApp::releaseMemoryOfAllSessions();
+}
+
 - (void)applicationWillEnterForeground:(UIApplication *)application
 {
   //Called as part of the transition from the background to the inactive state;
@@ -80,6 +80,35 @@ namespace
   }//hpdf_error_handler(...)
 #endif
   
+  
+  /** Combines channels of `meas`, by a power of two, so it has no more than `max_channels`
+   channels; thumbnails cant show more detail than this anyway, and it saves the copying and
+   rendering of the full resolution spectrum.
+   
+   Only combines by factors that evenly divide the number of channels; leaves `meas` unchanged
+   on any error.
+   */
+  void decimate_for_thumbnail( const std::shared_ptr<SpecUtils::Measurement> &meas, const size_t max_channels )
+  {
+    const size_t nchannel = meas ? meas->num_gamma_channels() : size_t(0);
+    if( !max_channels || (nchannel <= max_channels) )
+      return;
+    
+    size_t ncombine = 1;
+    while( ((nchannel / ncombine) > max_channels) && ((nchannel % (2*ncombine)) == 0) )
+      ncombine *= 2;
+    
+    if( ncombine < 2 )
+      return;
+    
+    try
+    {
+      meas->combine_gamma_channels( ncombine );
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to combine channels for thumbnail: " << e.what() << endl;
+    }
+  }//decimate_for_thumbnail(...)
 }//namespace
 
 vector< pair<double,double> > timeRegionsToHighlight( const vector<float> &binning, const vector<bool> &status )
@@ -126,7 +155,6 @@ bool renderTimeSeries( ImageType &image, std::shared_ptr<QLSpecMeas> meas )
   
   const size_t num_samples = sample_numbers_vec.size();
   const std::vector<int> &det_numbers = meas->detector_numbers();
-  const vector<string> &det_names = meas->detector_names();
   
   if( num_samples < 2 )
   {
@@ -139,36 +167,45 @@ bool renderTimeSeries( ImageType &image, std::shared_ptr<QLSpecMeas> meas )
   auto time_values = std::make_shared< vector<float> >( num_samples + 1, 0.0f );
   vector<bool> is_occupied( num_samples, false );
   
+  // We only need the total counts and times of each sample, so we'll use the per-Measurement sums
+  //  the parser already computed, rather than summing the spectra of each sample (which, for
+  //  large portal files, was most of the time spent making a preview).
   bool contained_neutrons = false;
   float time_sum = 0.0;
   for( size_t i = 0; i < sample_numbers_vec.size(); ++i )
   {
-    bool is_occ = false;
+    bool is_occ = false, has_meas = false;
     int ndet = 0;
+    float real_time = 0.0f;
+    double gamma_sum = 0.0, neutron_sum = 0.0;
     for( int detnum : det_numbers )
     {
       auto thismeas = meas->measurement( sample_numbers_vec[i], detnum );
-      if( thismeas && thismeas->real_time() > 0.0 )
+      if( !thismeas )
+        continue;
+      
+      has_meas = true;
+      if( thismeas->real_time() > 0.0 )
         ++ndet;
-      if( thismeas )
-        is_occ = (is_occ || (thismeas->occupied() == SpecUtils::OccupancyStatus::Occupied));
-    }
-    if( !ndet )
-      ndet = 1;
+      is_occ = (is_occ || (thismeas->occupied() == SpecUtils::OccupancyStatus::Occupied));
+      contained_neutrons = (contained_neutrons || thismeas->contained_neutron());
+      real_time += thismeas->real_time();
+      gamma_sum += thismeas->gamma_count_sum();
+      neutron_sum += thismeas->neutron_counts_sum();
+    }//for( int detnum : det_numbers )
     
-    set<int> thisset;
-    thisset.insert( sample_numbers_vec[i] );
-    auto sum = meas->sum_measurements( thisset, det_names, nullptr );
-    if( !sum )
+    if( !has_meas )
       continue;
     
-    float real_time = sum->real_time() / ndet;
+    if( !ndet )
+      ndet = 1;
+    
+    real_time = real_time / ndet;
     real_time = (real_time>0.0f ? real_time : 0.1f);
     
-    contained_neutrons = (contained_neutrons || sum->contained_neutron());
-    (*gamma_counts)[i] = sum->gamma_count_sum() / real_time;
-    (*neutron_counts)[i] = sum->neutron_counts_sum() / real_time;
-    is_occupied[i] = is_occ;//(sum->occupied() == SpecUtils::Measurement::Occupied);
+    (*gamma_counts)[i] = gamma_sum / real_time;
+    (*neutron_counts)[i] = neutron_sum / real_time;
+    is_occupied[i] = is_occ;
     (*time_values)[i] = time_sum;
     time_sum += real_time;
   }//for( const int sample : sample_numbers )
@@ -610,6 +647,14 @@ void render_spec_file_to_preview( uint8_t **result, size_t *result_size,
   const float width_px = resolution_multiple * width_pt;
   const float height_px = resolution_multiple * height_pt;
   
+  if( type == SpectrumThumbnail )
+  {
+    // Same allowance of two channels per pixel as renderSpectrum(...) uses.
+    const size_t max_channels = 2 * static_cast<size_t>( std::max( width_px, 64.0f ) );
+    decimate_for_thumbnail( foreground, max_channels );
+    decimate_for_thumbnail( background, max_channels );
+  }//if( type == SpectrumThumbnail )
+  
   const bool show_legend = (type == SpectrumPreview && width_px >= 640);  //would work, but need to edit font...
   
 #if( RENDER_PREVIEWS_AS_PDF )
@@ -0,0 +1,184 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <iostream>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ChannelPrefixSum_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/ChannelPrefixSum.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+shared_ptr<SpecUtils::Measurement> make_spectrum( const size_t nchannel, const vector<float> &coefs, std::mt19937 &rng )
+{
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( nchannel, coefs, {} );
+  
+  std::uniform_real_distribution<float> dist( 0.0f, 500.0f );
+  auto counts = make_shared<vector<float>>( nchannel );
+  for( float &c : *counts )
+    c = std::floor( dist(rng) );
+  
+  auto meas = make_shared<SpecUtils::Measurement>();
+  meas->set_gamma_counts( counts, 100.0f, 100.0f );
+  meas->set_energy_calibration( cal );
+  return meas;
+}//make_spectrum(...)
+
+
+/** Counts times channel-center energy over the range, walking every channel, for comparison to
+ ChannelPrefixSum::energyWeightedIntegral; the same fractional-channel convention is used, i.e.,
+ counts are uniform within each channel.
+ */
+double energy_weighted_walk( const SpecUtils::Measurement &meas, double lower, double upper )
+{
+  if( lower > upper )
+    std::swap( lower, upper );
+  
+  const vector<float> &counts = *meas.gamma_counts();
+  const vector<float> &energies = *meas.channel_energies();
+  
+  double answer = 0.0;
+  for( size_t i = 0; i < counts.size(); ++i )
+  {
+    const double low = std::max( lower, static_cast<double>(energies[i]) );
+    const double up = std::min( upper, static_cast<double>(energies[i+1]) );
+    const double width = energies[i+1] - energies[i];
+    if( (up <= low) || (width <= 0.0) )
+      continue;
+    
+    // Integral of (counts/width)*E dE from low to up
+    answer += counts[i] * 0.5 * (up*up - low*low) / width;
+  }
+  
+  return answer;
+}//energy_weighted_walk(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( MatchesMeasurementSums )
+{
+  std::mt19937 rng( 4321 );
+  
+  const vector<shared_ptr<SpecUtils::Measurement>> spectra{
+    make_spectrum( 1024, {0.0f, 3.0f}, rng ),
+    make_spectrum( 16384, {0.0f, 0.183f}, rng ),
+    make_spectrum( 2048, {5.0f, 1.45f, 2.1E-5f}, rng )
+  };
+  
+  for( const shared_ptr<SpecUtils::Measurement> &meas : spectra )
+  {
+    const shared_ptr<const ChannelPrefixSum> sums = ChannelPrefixSum::get( meas );
+    BOOST_REQUIRE( sums );
+    BOOST_REQUIRE( sums->hasEnergyCalibration() );
+    BOOST_CHECK_EQUAL( sums->numChannels(), meas->num_gamma_channels() );
+    
+    const size_t nchannel = meas->num_gamma_channels();
+    const double max_energy = meas->gamma_energy_max();
+    const double sum_tolerance = 1.0E-6 * meas->gamma_count_sum();
+    
+    std::uniform_int_distribution<size_t> channel_dist( 0, nchannel + 10 );
+    for( size_t trial = 0; trial < 500; ++trial )
+    {
+      const size_t first = channel_dist( rng ), last = channel_dist( rng );
+      const double expected = (std::min(first,last) >= nchannel) ? 0.0 : meas->gamma_channels_sum( first, last );
+      BOOST_CHECK_MESSAGE( fabs(sums->channelSum( first, last ) - expected) <= sum_tolerance,
+                           "channelSum(" << first << "," << last << ")=" << sums->channelSum( first, last )
+                           << ", gamma_channels_sum gave " << expected );
+      BOOST_CHECK_EQUAL( ChannelPrefixSum::gamma_channels_sum( meas, first, last ), sums->channelSum( first, last ) );
+    }//for( size_t trial = 0; trial < 500; ++trial )
+    
+    // Energies include some off either end of the spectrum, and in either order
+    std::uniform_real_distribution<double> energy_dist( -50.0, max_energy + 50.0 );
+    for( size_t trial = 0; trial < 500; ++trial )
+    {
+      const float lower = static_cast<float>( energy_dist( rng ) );
+      const float upper = static_cast<float>( energy_dist( rng ) );
+      
+      const double expected = meas->gamma_integral( std::min(lower,upper), std::max(lower,upper) );
+      const double integral = sums->integral( lower, upper );
+      BOOST_CHECK_MESSAGE( fabs(integral - expected) <= sum_tolerance,
+                           "integral(" << lower << "," << upper << ")=" << integral
+                           << ", gamma_integral gave " << expected );
+      BOOST_CHECK_EQUAL( ChannelPrefixSum::gamma_integral( meas, lower, upper ), integral );
+      
+      const double weighted = sums->energyWeightedIntegral( lower, upper );
+      const double expected_weighted = energy_weighted_walk( *meas, lower, upper );
+      BOOST_CHECK_MESSAGE( fabs(weighted - expected_weighted) <= sum_tolerance*max_energy,
+                           "energyWeightedIntegral(" << lower << "," << upper << ")=" << weighted
+                           << ", walking channels gave " << expected_weighted );
+    }//for( size_t trial = 0; trial < 500; ++trial )
+    
+    // Full range
+    BOOST_CHECK_CLOSE( sums->integral( -100.0, max_energy + 100.0 ), meas->gamma_count_sum(), 1.0E-6 );
+  }//for( const shared_ptr<SpecUtils::Measurement> &meas : spectra )
+}//BOOST_AUTO_TEST_CASE( MatchesMeasurementSums )
+
+
+BOOST_AUTO_TEST_CASE( CacheAndNoCalibration )
+{
+  std::mt19937 rng( 99 );
+  shared_ptr<SpecUtils::Measurement> meas = make_spectrum( 512, {0.0f, 6.0f}, rng );
+  
+  const shared_ptr<const ChannelPrefixSum> first = ChannelPrefixSum::get( meas );
+  const shared_ptr<const ChannelPrefixSum> second = ChannelPrefixSum::get( meas );
+  BOOST_REQUIRE( first );
+  BOOST_CHECK( first == second );
+  
+  // Changing the counts gives a new counts object, so must not use the old sums.
+  auto new_counts = make_shared<vector<float>>( *meas->gamma_counts() );
+  for( float &c : *new_counts )
+    c += 1.0f;
+  meas->set_gamma_counts( new_counts, 100.0f, 100.0f );
+  
+  const shared_ptr<const ChannelPrefixSum> third = ChannelPrefixSum::get( meas );
+  BOOST_REQUIRE( third );
+  BOOST_CHECK( third != first );
+  BOOST_CHECK_CLOSE( third->channelSum( 0, 511 ), first->channelSum( 0, 511 ) + 512.0, 1.0E-6 );
+  
+  // Without an energy calibration, only channel sums are available.
+  const ChannelPrefixSum no_cal( new_counts, nullptr );
+  BOOST_CHECK( !no_cal.hasEnergyCalibration() );
+  BOOST_CHECK_EQUAL( no_cal.integral( 0.0, 1000.0 ), 0.0 );
+  BOOST_CHECK_CLOSE( no_cal.channelSum( 10, 20 ), third->channelSum( 20, 10 ), 1.0E-9 );
+  
+  BOOST_CHECK( !ChannelPrefixSum::get( nullptr ) );
+  BOOST_CHECK_THROW( const ChannelPrefixSum bad( nullptr, nullptr ), std::exception );
+}//BOOST_AUTO_TEST_CASE( CacheAndNoCalibration )
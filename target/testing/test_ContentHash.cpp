@@ -0,0 +1,164 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ContentHash_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/SpecMeas.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+shared_ptr<SpecUtils::Measurement> make_spectrum( const vector<float> &counts, const vector<float> &coefs )
+{
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( counts.size(), coefs, {} );
+  
+  auto meas = make_shared<SpecUtils::Measurement>();
+  meas->set_gamma_counts( make_shared<vector<float>>( counts ), 100.0f, 110.0f );
+  meas->set_energy_calibration( cal );
+  
+  return meas;
+}//make_spectrum(...)
+}//namespace
+
+
+// The reference values from the sanity check of the reference XXH64 implementation (xxhsum), which
+//  uses a buffer generated by repeatedly squaring PRIME32_1, and hashes it with seeds of zero and
+//  PRIME32_1.
+BOOST_AUTO_TEST_CASE( Xxh64ReferenceVectors )
+{
+  const uint32_t prime = 2654435761U;
+  
+  unsigned char buffer[101];
+  uint32_t byte_gen = prime;
+  for( size_t i = 0; i < sizeof(buffer); ++i )
+  {
+    buffer[i] = static_cast<unsigned char>( byte_gen >> 24 );
+    byte_gen *= byte_gen;
+  }
+  
+  struct TestVector
+  {
+    size_t len;
+    uint64_t seed;
+    uint64_t hash;
+  };//struct TestVector
+  
+  const TestVector vectors[] = {
+    {   0, 0,     0xEF46DB3751D8E999ULL },
+    {   0, prime, 0xAC75FDA2929B17EFULL },
+    {   1, 0,     0x4FCE394CC88952D8ULL },
+    {   1, prime, 0x739840CB819FA723ULL },
+    {  14, 0,     0xCFFA8DB881BC3A3DULL },
+    {  14, prime, 0x5B9611585EFCC9CBULL },
+    { 101, 0,     0x0EAB543384F878ADULL },
+    { 101, prime, 0xCAA65939306F1E21ULL }
+  };
+  
+  for( const TestVector &v : vectors )
+  {
+    const uint64_t hash = SpecMeas::xxh64( buffer, v.len, v.seed );
+    BOOST_CHECK_MESSAGE( hash == v.hash, "XXH64 of " << v.len << " bytes, with seed " << v.seed
+                         << " gave 0x" << std::hex << hash << ", expected 0x" << v.hash );
+  }
+  
+  // A few well-known string digests (seed of zero), as given by xxhsum and the python xxhash module.
+  const pair<const char *,uint64_t> strings[] = {
+    { "a",   0xD24EC4F1A98C6E5BULL },
+    { "abc", 0x44BC2CF5AD770999ULL },
+    { "Nobody inspects the spammish repetition", 0xFBCEA83C8A378BF1ULL }
+  };
+  
+  for( const auto &s : strings )
+  {
+    const uint64_t hash = SpecMeas::xxh64( s.first, strlen(s.first), 0 );
+    BOOST_CHECK_MESSAGE( hash == s.second, "XXH64 of '" << s.first << "' gave 0x" << std::hex
+                         << hash << ", expected 0x" << s.second );
+  }
+  
+  // The hash must only depend on the bytes, not their alignment in memory.
+  vector<unsigned char> shifted( sizeof(buffer) + 7 );
+  for( size_t offset = 1; offset < 8; ++offset )
+  {
+    memcpy( shifted.data() + offset, buffer, sizeof(buffer) );
+    BOOST_CHECK_EQUAL( SpecMeas::xxh64( shifted.data() + offset, sizeof(buffer), 0 ), 0x0EAB543384F878ADULL );
+  }
+}//BOOST_AUTO_TEST_CASE( Xxh64ReferenceVectors )
+
+
+BOOST_AUTO_TEST_CASE( MeasurementContentHash )
+{
+  typedef SpecMeas::HashScope HashScope;
+  
+  vector<float> counts( 1024 );
+  for( size_t i = 0; i < counts.size(); ++i )
+    counts[i] = static_cast<float>( (i * 7919) % 1000 );
+  
+  const shared_ptr<SpecUtils::Measurement> meas = make_spectrum( counts, { 0.0f, 3.0f } );
+  const shared_ptr<SpecUtils::Measurement> same = make_spectrum( counts, { 0.0f, 3.0f } );
+  
+  // Hashes are of the contents, not the objects, and repeated calls give the same answer.
+  for( const HashScope scope : { HashScope::Counts, HashScope::Calibration, HashScope::Full } )
+  {
+    BOOST_CHECK_EQUAL( SpecMeas::contentHash( *meas, scope ), SpecMeas::contentHash( *same, scope ) );
+    BOOST_CHECK_EQUAL( SpecMeas::contentHash( *meas, scope ), SpecMeas::contentHash( *meas, scope ) );
+  }
+  
+  // Changing a single channel changes the counts hash, but not the calibration hash
+  vector<float> changed_counts = counts;
+  changed_counts[512] += 1.0f;
+  const shared_ptr<SpecUtils::Measurement> changed = make_spectrum( changed_counts, { 0.0f, 3.0f } );
+  BOOST_CHECK_NE( SpecMeas::contentHash( *meas, HashScope::Counts ), SpecMeas::contentHash( *changed, HashScope::Counts ) );
+  BOOST_CHECK_NE( SpecMeas::contentHash( *meas, HashScope::Full ), SpecMeas::contentHash( *changed, HashScope::Full ) );
+  BOOST_CHECK_EQUAL( SpecMeas::contentHash( *meas, HashScope::Calibration ), SpecMeas::contentHash( *changed, HashScope::Calibration ) );
+  
+  // Changing the counts in place, through Measurement, must not give the previous (cached) hash
+  const uint64_t orig_counts_hash = SpecMeas::contentHash( *meas, HashScope::Counts );
+  meas->set_gamma_counts( make_shared<vector<float>>( changed_counts ), 100.0f, 110.0f );
+  BOOST_CHECK_EQUAL( SpecMeas::contentHash( *meas, HashScope::Counts ), SpecMeas::contentHash( *changed, HashScope::Counts ) );
+  BOOST_CHECK_NE( SpecMeas::contentHash( *meas, HashScope::Counts ), orig_counts_hash );
+  
+  // Changing the calibration changes the calibration hash, but not the counts hash
+  const shared_ptr<SpecUtils::Measurement> recal = make_spectrum( counts, { 0.0f, 3.01f } );
+  BOOST_CHECK_NE( SpecMeas::contentHash( *same, HashScope::Calibration ), SpecMeas::contentHash( *recal, HashScope::Calibration ) );
+  BOOST_CHECK_EQUAL( SpecMeas::contentHash( *same, HashScope::Counts ), SpecMeas::contentHash( *recal, HashScope::Counts ) );
+}//BOOST_AUTO_TEST_CASE( MeasurementContentHash )
@@ -0,0 +1,347 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#ifdef _WIN32
+// For some reason, we need to include the following includes, before unit_test.hpp,
+//  or we get a bunch of errors relating to winsock.k being included multiple times,
+//  or something
+#include "winsock2.h"
+#include "Windows.h"
+#endif
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE DetectionLimitCalc_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/DetectionLimitCalc.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/DetectorPeakResponse.h"
+#include "InterSpec/GammaInteractionCalc.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+// We need to set the static data directory, so the code knows where
+//  like sandia.decay.xml is located.
+void set_data_dir()
+{
+  // We only need to initialize things once
+  static bool s_have_set = false;
+  if( s_have_set )
+    return;
+  
+  s_have_set = true;
+  
+  int argc = boost::unit_test::framework::master_test_suite().argc;
+  char **argv = boost::unit_test::framework::master_test_suite().argv;
+  
+  string datadir;
+  
+  for( int i = 1; i < argc; ++i )
+  {
+    const string arg = argv[i];
+    if( SpecUtils::istarts_with( arg, "--datadir=" ) )
+      datadir = arg.substr( 10 );
+  }//for( int arg = 1; arg < argc; ++ arg )
+  
+  SpecUtils::ireplace_all( datadir, "%20", " " );
+  
+  // Search around a little for the data directory, if it wasnt specified
+  if( datadir.empty() )
+  {
+    for( const auto &d : { "data", "../data", "../../data", "../../../data" } )
+    {
+      if( SpecUtils::is_file( SpecUtils::append_path(d, "sandia.decay.xml") ) )
+      {
+        datadir = d;
+        break;
+      }
+    }//for( loop over candidate dirs )
+  }//if( datadir.empty() )
+  
+  const string sandia_deacay_file = SpecUtils::append_path(datadir, "sandia.decay.xml");
+  BOOST_REQUIRE_MESSAGE( SpecUtils::is_file( sandia_deacay_file ), "sandia.decay.xml not at '" << sandia_deacay_file << "'" );
+  
+  BOOST_REQUIRE_NO_THROW( InterSpec::setStaticDataDirectory( datadir ) );
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE_MESSAGE( db, "Error initing SandiaDecayDataBase" );
+  BOOST_REQUIRE_MESSAGE( db->nuclide("U238"), "SandiaDecayDataBase empty?" );
+}//void set_data_dir()
+
+
+/** A NaI-like (so neighboring lines overlap) far-field DRF. */
+shared_ptr<const DetectorPeakResponse> make_drf()
+{
+  auto drf = make_shared<DetectorPeakResponse>();
+  drf->setIntrinsicEfficiencyFormula( "exp(-1.437 - 0.9068*log(x) - 0.1774*log(x)^2 + 0.01744*log(x)^3)",
+                                      5.08f*PhysicalUnits::cm, PhysicalUnits::MeV,
+                                      0.0f, 3000.0f*PhysicalUnits::keV,
+                                      DetectorPeakResponse::EffGeometryType::FarField );
+  drf->setFwhmCoefficients( { 25.0f, 3200.0f }, DetectorPeakResponse::kSqrtPolynomial );
+  
+  return drf;
+}//make_drf()
+
+
+/** A falling continuum with some Ba133-like peaks in it, and Poisson noise. */
+shared_ptr<const SpecUtils::Measurement> make_spectrum()
+{
+  const size_t nchannel = 1024;
+  std::mt19937 rng( 31415 );
+  
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( nchannel, { 0.0f, 3.0f }, {} );
+  
+  auto counts = make_shared<vector<float>>( nchannel );
+  for( size_t i = 0; i < nchannel; ++i )
+  {
+    const double energy = 3.0*(i + 0.5);
+    double expected = 2000.0*exp( -energy/300.0 ) + 20.0;
+    for( const double peak : { 81.0, 356.0, 384.0 } )
+    {
+      const double sigma = 0.425*sqrt( 25.0 + 3.2*energy );
+      expected += 300.0 * (3.0/(sigma*sqrt(2.0*3.141592653589793))) * exp( -0.5*pow((energy - peak)/sigma, 2.0) );
+    }
+    
+    std::poisson_distribution<int> poisson( expected );
+    (*counts)[i] = static_cast<float>( poisson(rng) );
+  }//for( size_t i = 0; i < nchannel; ++i )
+  
+  auto meas = make_shared<SpecUtils::Measurement>();
+  meas->set_gamma_counts( counts, 600.0f, 610.0f );
+  meas->set_energy_calibration( cal );
+  
+  return meas;
+}//make_spectrum()
+
+
+void check_same_result( const CurrieMdaResult &lhs, const CurrieMdaResult &rhs )
+{
+  BOOST_CHECK_EQUAL( lhs.first_lower_continuum_channel, rhs.first_lower_continuum_channel );
+  BOOST_CHECK_EQUAL( lhs.last_lower_continuum_channel, rhs.last_lower_continuum_channel );
+  BOOST_CHECK_EQUAL( lhs.lower_continuum_counts_sum, rhs.lower_continuum_counts_sum );
+  BOOST_CHECK_EQUAL( lhs.first_upper_continuum_channel, rhs.first_upper_continuum_channel );
+  BOOST_CHECK_EQUAL( lhs.last_upper_continuum_channel, rhs.last_upper_continuum_channel );
+  BOOST_CHECK_EQUAL( lhs.upper_continuum_counts_sum, rhs.upper_continuum_counts_sum );
+  BOOST_CHECK_EQUAL( lhs.first_peak_region_channel, rhs.first_peak_region_channel );
+  BOOST_CHECK_EQUAL( lhs.last_peak_region_channel, rhs.last_peak_region_channel );
+  BOOST_CHECK_EQUAL( lhs.peak_region_counts_sum, rhs.peak_region_counts_sum );
+  BOOST_CHECK_EQUAL( lhs.continuum_eqn[0], rhs.continuum_eqn[0] );
+  BOOST_CHECK_EQUAL( lhs.continuum_eqn[1], rhs.continuum_eqn[1] );
+  BOOST_CHECK_EQUAL( lhs.estimated_peak_continuum_counts, rhs.estimated_peak_continuum_counts );
+  BOOST_CHECK_EQUAL( lhs.estimated_peak_continuum_uncert, rhs.estimated_peak_continuum_uncert );
+  BOOST_CHECK_EQUAL( lhs.decision_threshold, rhs.decision_threshold );
+  BOOST_CHECK_EQUAL( lhs.detection_limit, rhs.detection_limit );
+  BOOST_CHECK_EQUAL( lhs.source_counts, rhs.source_counts );
+  BOOST_CHECK_EQUAL( lhs.lower_limit, rhs.lower_limit );
+  BOOST_CHECK_EQUAL( lhs.upper_limit, rhs.upper_limit );
+}//check_same_result(...)
+}//namespace
+
+
+// Each ROI from currie_mda_all_lines(...) must be the same as if we had set up that ROI by hand, and
+//  evaluated it on its own with the single-input currie_mda_calc(...).
+BOOST_AUTO_TEST_CASE( AllLinesMatchesSingleCalcs )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  const SandiaDecay::Nuclide * const ba133 = db->nuclide( "Ba133" );
+  BOOST_REQUIRE( ba133 );
+  
+  NuclideCurrieMdaInput input;
+  input.spectrum = make_spectrum();
+  input.nuclide = ba133;
+  input.age = 0.0;
+  input.drf = make_drf();
+  input.distance = 50.0*PhysicalUnits::cm;
+  input.transmission = []( float energy ) -> double { return 1.0 - 0.5*exp( -energy/100.0 ); };
+  
+  const double live_time = input.spectrum->live_time();
+  
+  vector<NuclideLineCurrieMda> results;
+  BOOST_REQUIRE_NO_THROW( results = currie_mda_all_lines( input ) );
+  BOOST_REQUIRE( !results.empty() );
+  
+  // The 276/303 and 356/384 keV lines overlap at this resolution, so at least one ROI should have
+  //  multiple lines.
+  size_t max_lines_in_roi = 0;
+  
+  for( size_t i = 0; i < results.size(); ++i )
+  {
+    const NuclideLineCurrieMda &roi = results[i];
+    BOOST_REQUIRE( !roi.energies_and_yields.empty() );
+    max_lines_in_roi = std::max( max_lines_in_roi, roi.energies_and_yields.size() );
+    
+    // Results are ranked by MDA
+    if( i )
+      BOOST_CHECK_LE( results[i-1].mda, roi.mda );
+    
+    // Build the single-ROI input by hand
+    CurrieMdaInput single_input;
+    single_input.spectrum = input.spectrum;
+    single_input.num_lower_side_channels = input.num_side_channels;
+    single_input.num_upper_side_channels = input.num_side_channels;
+    single_input.detection_probability = input.detection_probability;
+    single_input.additional_uncertainty = input.additional_uncertainty;
+    single_input.roi_lower_energy = std::numeric_limits<float>::max();
+    single_input.roi_upper_energy = -1.0f;
+    
+    double counts_per_bq = 0.0, weighted_energy = 0.0;
+    for( const pair<float,double> &line : roi.energies_and_yields )
+    {
+      const float energy = line.first;
+      const float fwhm = input.drf->peakResolutionFWHM( energy );
+      single_input.roi_lower_energy = std::min( single_input.roi_lower_energy, energy - input.num_fwhm*fwhm );
+      single_input.roi_upper_energy = std::max( single_input.roi_upper_energy, energy + input.num_fwhm*fwhm );
+      
+      const double air = exp( -GammaInteractionCalc::transmission_coefficient_air( energy, input.distance ) );
+      const double line_counts = line.second * input.transmission(energy) * air
+                                 * input.drf->efficiency( energy, input.distance ) * live_time;
+      counts_per_bq += line_counts;
+      weighted_energy += energy * line_counts;
+    }//for( loop over lines in ROI )
+    
+    single_input.gamma_energy = static_cast<float>( weighted_energy / counts_per_bq );
+    
+    BOOST_CHECK_CLOSE( roi.counts_per_bq, counts_per_bq, 1.0E-6 );
+    BOOST_CHECK_SMALL( roi.result.input.roi_lower_energy - single_input.roi_lower_energy, 1.0E-3f );
+    BOOST_CHECK_SMALL( roi.result.input.roi_upper_energy - single_input.roi_upper_energy, 1.0E-3f );
+    BOOST_CHECK_SMALL( roi.result.input.gamma_energy - single_input.gamma_energy, 1.0E-3f );
+    BOOST_CHECK_EQUAL( roi.result.input.num_lower_side_channels, input.num_side_channels );
+    BOOST_CHECK_EQUAL( roi.result.input.num_upper_side_channels, input.num_side_channels );
+    
+    // The batch result must be exactly what a single evaluation of the same input gives
+    check_same_result( roi.result, currie_mda_calc( roi.result.input ) );
+    
+    // And the hand-built input should give the same answer, up to float rounding of the ROI range
+    const CurrieMdaResult single = currie_mda_calc( single_input );
+    BOOST_CHECK_EQUAL( roi.result.first_peak_region_channel, single.first_peak_region_channel );
+    BOOST_CHECK_EQUAL( roi.result.last_peak_region_channel, single.last_peak_region_channel );
+    BOOST_CHECK_EQUAL( roi.result.peak_region_counts_sum, single.peak_region_counts_sum );
+    BOOST_CHECK_CLOSE( roi.result.detection_limit, single.detection_limit, 1.0E-3 );
+    BOOST_CHECK_CLOSE( roi.result.upper_limit, single.upper_limit, 1.0E-3 );
+    
+    // The activities are just the counts divided by counts-per-Bq
+    BOOST_CHECK_CLOSE( roi.mda, single.detection_limit / counts_per_bq, 1.0E-4 );
+    BOOST_CHECK_CLOSE( roi.upper_limit_activity, single.upper_limit / counts_per_bq, 1.0E-4 );
+    
+    // ROIs dont overlap each other
+    for( size_t j = 0; j < i; ++j )
+    {
+      const CurrieMdaInput &other = results[j].result.input;
+      BOOST_CHECK( (other.roi_upper_energy < roi.result.input.roi_lower_energy)
+                   || (other.roi_lower_energy > roi.result.input.roi_upper_energy) );
+    }
+  }//for( size_t i = 0; i < results.size(); ++i )
+  
+  BOOST_CHECK_GT( max_lines_in_roi, 1 );
+}//BOOST_AUTO_TEST_CASE( AllLinesMatchesSingleCalcs )
+
+
+// Shielding only changes the conversion from counts to activity, not the ROIs or their counts.
+BOOST_AUTO_TEST_CASE( TransmissionScalesActivity )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db && db->nuclide("Ba133") );
+  
+  NuclideCurrieMdaInput input;
+  input.spectrum = make_spectrum();
+  input.nuclide = db->nuclide( "Ba133" );
+  input.drf = make_drf();
+  input.distance = 50.0*PhysicalUnits::cm;
+  
+  const vector<NuclideLineCurrieMda> unshielded = currie_mda_all_lines( input );
+  
+  input.transmission = []( float ) -> double { return 0.25; };
+  const vector<NuclideLineCurrieMda> shielded = currie_mda_all_lines( input );
+  
+  BOOST_REQUIRE_EQUAL( unshielded.size(), shielded.size() );
+  for( size_t i = 0; i < shielded.size(); ++i )
+  {
+    BOOST_CHECK_CLOSE( shielded[i].counts_per_bq, 0.25*unshielded[i].counts_per_bq, 1.0E-6 );
+    BOOST_CHECK_CLOSE( shielded[i].mda, 4.0*unshielded[i].mda, 1.0E-6 );
+    check_same_result( shielded[i].result, unshielded[i].result );
+  }
+}//BOOST_AUTO_TEST_CASE( TransmissionScalesActivity )
+
+
+BOOST_AUTO_TEST_CASE( InvalidInput )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db && db->nuclide("Ba133") );
+  
+  NuclideCurrieMdaInput input;
+  input.spectrum = make_spectrum();
+  input.nuclide = db->nuclide( "Ba133" );
+  input.drf = make_drf();
+  input.distance = 50.0*PhysicalUnits::cm;
+  BOOST_CHECK_NO_THROW( currie_mda_all_lines( input ) );
+  
+  NuclideCurrieMdaInput bad = input;
+  bad.spectrum = nullptr;
+  BOOST_CHECK_THROW( currie_mda_all_lines( bad ), std::exception );
+  
+  bad = input;
+  bad.nuclide = nullptr;
+  BOOST_CHECK_THROW( currie_mda_all_lines( bad ), std::exception );
+  
+  bad = input;
+  bad.drf = make_shared<DetectorPeakResponse>();
+  BOOST_CHECK_THROW( currie_mda_all_lines( bad ), std::exception );
+  
+  bad = input;
+  bad.num_fwhm = 0.0f;
+  BOOST_CHECK_THROW( currie_mda_all_lines( bad ), std::exception );
+}//BOOST_AUTO_TEST_CASE( InvalidInput )
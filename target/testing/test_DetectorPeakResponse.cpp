@@ -0,0 +1,325 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <deque>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE DetectorPeakResponse_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+/** Log-spaced energies, from 20 keV to just below 3 MeV. */
+vector<float> test_energies()
+{
+  vector<float> energies;
+  for( size_t i = 0; i < 500; ++i )
+    energies.push_back( static_cast<float>( 20.0*pow(2990.0/20.0, i/499.0) ) );
+  return energies;
+}//vector<float> test_energies()
+
+
+/** Peaks with FWHM = sqrt( a + b*E + c*E*E ), with E in MeV, and a +-2% pattern of "noise" on the widths. */
+shared_ptr<const deque<shared_ptr<const PeakDef>>> make_fwhm_peaks( const double a, const double b, const double c )
+{
+  const double energies[] = { 59.5, 122.1, 244.7, 344.3, 661.7, 778.9, 964.1, 1173.2, 1332.5, 1408.0, 2614.5 };
+  
+  auto peaks = make_shared<deque<shared_ptr<const PeakDef>>>();
+  for( size_t i = 0; i < sizeof(energies)/sizeof(energies[0]); ++i )
+  {
+    const double e_mev = energies[i] / 1000.0;
+    const double fwhm = sqrt( a + b*e_mev + c*e_mev*e_mev ) * (1.0 + 0.02*((i % 3) - 1.0));
+    auto peak = make_shared<PeakDef>( energies[i], fwhm/2.35482, 1.0E4 );
+    peak->setSigmaUncert( 0.02*peak->sigma() );
+    peaks->push_back( peak );
+  }
+  
+  return peaks;
+}//make_fwhm_peaks(...)
+
+
+/** Efficiency data points, in keV, following exp( c0 + c1*ln(E) + c2*ln(E)^2 ), with E in MeV, with +-3% "noise". */
+vector<MakeDrfFit::DetEffDataPoint> make_eff_data( const double c0, const double c1, const double c2 )
+{
+  const float energies[] = { 59.5f, 88.0f, 122.1f, 244.7f, 344.3f, 661.7f, 898.0f, 1173.2f, 1332.5f, 1836.1f };
+  
+  vector<MakeDrfFit::DetEffDataPoint> data;
+  for( size_t i = 0; i < sizeof(energies)/sizeof(energies[0]); ++i )
+  {
+    const double x = log( energies[i] / 1000.0 );
+    const double eff = exp( c0 + c1*x + c2*x*x ) * (1.0 + 0.03*((i % 3) - 1.0));
+    
+    MakeDrfFit::DetEffDataPoint point;
+    point.energy = energies[i];
+    point.efficiency = static_cast<float>( eff );
+    point.efficiency_uncert = static_cast<float>( 0.03*eff );
+    data.push_back( point );
+  }
+  
+  return data;
+}//make_eff_data(...)
+
+
+void check_same_coefs( const vector<float> &batch, const vector<float> &single, const string &what )
+{
+  BOOST_REQUIRE_EQUAL( batch.size(), single.size() );
+  for( size_t i = 0; i < batch.size(); ++i )
+  {
+    BOOST_CHECK_MESSAGE( fabs(batch[i] - single[i]) <= 1.0E-5*std::max(1.0f, fabs(single[i])),
+                         what << " coefficient " << i << ": batch gave " << batch[i]
+                         << ", individual fit gave " << single[i] );
+  }
+}//check_same_coefs(...)
+}//namespace
+
+
+// The batch evaluation of formula efficiencies must give the same answer as evaluating each energy
+//  by itself, both for formulas that can be compiled to byte-code, and ones that fall back to muparserx.
+BOOST_AUTO_TEST_CASE( FormulaBatchEvaluation )
+{
+  const vector<float> energies = test_energies();
+  
+  const vector<pair<string,float>> formulas{
+    { "exp( 1.2 + 3.2*ln(x) + -2.1*ln(x)^2 )", static_cast<float>(PhysicalUnits::MeV) },
+    { "exp(-1.437 - 0.9068*log(x) - 0.1774*log(x)^2 + 0.01744*log(x)^3)", static_cast<float>(PhysicalUnits::MeV) },
+    { "1/(1 + (x/300)^2)", static_cast<float>(PhysicalUnits::keV) },
+    { "sqrt(x)*exp(-x/500) + abs(sin(x/100))*0.01 + max(0.001, log10(x)/10)", static_cast<float>(PhysicalUnits::keV) },
+    { "0.3*pow(x,-0.8) + min(x,0.5)*0.1", static_cast<float>(PhysicalUnits::MeV) },
+    { "x < 100 ? 0.1 : 0.2*exp(-x/1000)", static_cast<float>(PhysicalUnits::keV) } //May not compile; uses muparserx
+  };
+  
+  for( const pair<string,float> &formula : formulas )
+  {
+    DetectorPeakResponse drf;
+    BOOST_REQUIRE_NO_THROW( drf.setIntrinsicEfficiencyFormula( formula.first, 5.0*PhysicalUnits::cm,
+                                             formula.second, 0.0f, 3000.0f*PhysicalUnits::keV,
+                                             DetectorPeakResponse::EffGeometryType::FarField ) );
+    
+    vector<float> batch;
+    BOOST_REQUIRE_NO_THROW( batch = drf.intrinsicEfficiencies( energies ) );
+    BOOST_REQUIRE_EQUAL( batch.size(), energies.size() );
+    
+    for( size_t i = 0; i < energies.size(); ++i )
+    {
+      const float single = drf.intrinsicEfficiency( energies[i] );
+      BOOST_CHECK_MESSAGE( fabs(batch[i] - single) <= 1.0E-6*fabs(single),
+                           "Formula '" << formula.first << "' at " << energies[i] << " keV: batch gave "
+                           << batch[i] << ", single energy gave " << single );
+    }
+    
+    // Evaluating from multiple threads at once must give the same answers.
+    const size_t nthreads = 4;
+    vector<vector<float>> thread_answers( nthreads, vector<float>(energies.size(), 0.0f) );
+    vector<std::thread> threads;
+    for( size_t t = 0; t < nthreads; ++t )
+    {
+      threads.emplace_back( [&drf, &energies, &thread_answers, t](){
+        for( size_t i = 0; i < energies.size(); ++i )
+          thread_answers[t][i] = drf.intrinsicEfficiency( energies[i] );
+      } );
+    }
+    for( std::thread &t : threads )
+      t.join();
+    
+    for( size_t t = 0; t < nthreads; ++t )
+    {
+      for( size_t i = 0; i < energies.size(); ++i )
+        BOOST_CHECK_EQUAL( thread_answers[t][i], drf.intrinsicEfficiency( energies[i] ) );
+    }
+  }//for( const pair<string,float> &formula : formulas )
+}//BOOST_AUTO_TEST_CASE( FormulaBatchEvaluation )
+
+
+// MakeDrfFit::performDrfFits must give the same answers as fitting each DRF individually, including
+//  for inputs that share efficiency data (which are only fit once), and inputs whose fits fail.
+BOOST_AUTO_TEST_CASE( DrfFitsMatchIndividualFits )
+{
+  vector<MakeDrfFit::DrfFitInput> inputs;
+  
+  {// HPGe-like, with both FWHM and efficiency
+    MakeDrfFit::DrfFitInput input;
+    input.peaks = make_fwhm_peaks( 1.0, 1.5, 0.3 );
+    input.fwhm_form = DetectorPeakResponse::kSqrtPolynomial;
+    input.high_resolution = true;
+    input.sqrt_eqn_order = 3;
+    input.eff_data = make_eff_data( -2.7, -1.2, -0.18 );
+    input.eff_fcn_order = 3;
+    inputs.push_back( input );
+  }
+  
+  {// Same efficiency data as the first input, but different FWHM form
+    MakeDrfFit::DrfFitInput input = inputs.front();
+    input.peaks = make_fwhm_peaks( 1.2, 1.2, 0.2 );
+    input.fwhm_form = DetectorPeakResponse::kGadrasResolutionFcn;
+    inputs.push_back( input );
+  }
+  
+  {// Only efficiency, with a different function order
+    MakeDrfFit::DrfFitInput input;
+    input.eff_data = make_eff_data( -2.2, -0.9, -0.1 );
+    input.eff_fcn_order = 4;
+    inputs.push_back( input );
+  }
+  
+  {// Only FWHM
+    MakeDrfFit::DrfFitInput input;
+    input.peaks = make_fwhm_peaks( 0.8, 1.8, 0.1 );
+    input.fwhm_form = DetectorPeakResponse::kConstantPlusSqrtEnergy;
+    input.high_resolution = true;
+    inputs.push_back( input );
+  }
+  
+  {// Requests more efficiency coefficients than data points, so the efficiency fit will fail
+    MakeDrfFit::DrfFitInput input;
+    input.peaks = make_fwhm_peaks( 1.1, 1.4, 0.25 );
+    input.eff_data = make_eff_data( -2.7, -1.2, -0.18 );
+    input.eff_data.resize( 2 );
+    input.eff_fcn_order = 3;
+    inputs.push_back( input );
+  }
+  
+  const vector<MakeDrfFit::DrfFitResult> results = MakeDrfFit::performDrfFits( inputs );
+  BOOST_REQUIRE_EQUAL( results.size(), inputs.size() );
+  
+  for( size_t i = 0; i < inputs.size(); ++i )
+  {
+    const MakeDrfFit::DrfFitInput &input = inputs[i];
+    const MakeDrfFit::DrfFitResult &result = results[i];
+    const string prefix = "Input " + std::to_string(i);
+    
+    if( input.peaks && !input.peaks->empty() )
+    {
+      vector<float> coefs = input.fwhm_starting_values, uncerts;
+      double chi2 = -1.0;
+      bool fit_ok = true;
+      try
+      {
+        chi2 = MakeDrfFit::performResolutionFit( input.peaks, input.fwhm_form, input.high_resolution,
+                                                 input.sqrt_eqn_order, coefs, uncerts );
+      }catch( std::exception & )
+      {
+        fit_ok = false;
+      }
+      
+      BOOST_CHECK_EQUAL( result.fwhm_fit, fit_ok );
+      BOOST_CHECK_EQUAL( result.fwhm_error.empty(), fit_ok );
+      if( fit_ok && result.fwhm_fit )
+      {
+        BOOST_CHECK_CLOSE( result.fwhm_chi2, chi2, 1.0E-3 );
+        check_same_coefs( result.fwhm_coefficients, coefs, prefix + " FWHM" );
+        check_same_coefs( result.fwhm_uncertainties, uncerts, prefix + " FWHM uncert" );
+      }
+    }else
+    {
+      BOOST_CHECK( !result.fwhm_fit );
+      BOOST_CHECK( result.fwhm_coefficients.empty() );
+    }//if( FWHM fit ) / else
+    
+    if( !input.eff_data.empty() )
+    {
+      vector<float> coefs, uncerts;
+      double chi2_dof = -1.0;
+      bool fit_ok = true;
+      try
+      {
+        chi2_dof = MakeDrfFit::performEfficiencyFit( input.eff_data, input.eff_fcn_order, coefs, uncerts );
+      }catch( std::exception & )
+      {
+        fit_ok = false;
+      }
+      
+      BOOST_CHECK_EQUAL( result.eff_fit, fit_ok );
+      BOOST_CHECK_EQUAL( result.eff_error.empty(), fit_ok );
+      if( fit_ok && result.eff_fit )
+      {
+        BOOST_CHECK_CLOSE( result.eff_chi2_dof, chi2_dof, 1.0E-3 );
+        check_same_coefs( result.eff_coefficients, coefs, prefix + " efficiency" );
+        check_same_coefs( result.eff_uncertainties, uncerts, prefix + " efficiency uncert" );
+      }
+    }else
+    {
+      BOOST_CHECK( !result.eff_fit );
+      BOOST_CHECK( result.eff_coefficients.empty() );
+    }//if( efficiency fit ) / else
+  }//for( size_t i = 0; i < inputs.size(); ++i )
+  
+  // The efficiency fits we know should have worked, and failed
+  BOOST_CHECK( results[0].eff_fit );
+  BOOST_CHECK( results[1].eff_fit );
+  BOOST_CHECK( results[2].eff_fit );
+  BOOST_CHECK( !results[4].eff_fit );
+  BOOST_CHECK( !results[4].eff_error.empty() );
+  BOOST_CHECK( results[4].fwhm_fit );
+}//BOOST_AUTO_TEST_CASE( DrfFitsMatchIndividualFits )
+
+
+// The extended disk-source solid angle (Knoll's series in (source_radius/distance)^2), checked against
+//  the exact on-axis disk-source to disk-detector solid angle.  The reference values were found by
+//  numerically integrating (128-point Gauss-Legendre, in both source radius and azimuth) the point
+//  solid angle, 1 - D/sqrt(D^2 + s(phi)^2) with s(phi) = sqrt(R^2 - rho^2 sin^2(phi)) - rho cos(phi),
+//  over the source area.  Using (1+beta)^(11/12) rather than (1+beta)^(11/2) in the F2 term gives
+//  relative errors of 2.5E-5 to 3E-4 for these geometries.
+BOOST_AUTO_TEST_CASE( DiskSourceSolidAngle )
+{
+  const double cm = PhysicalUnits::cm;
+  const double det_diam = 5.0*cm;
+  
+  // {distance, source radius, exact fractional solid angle, relative tolerance}
+  const double cases[][4] = {
+    { 5.0*cm, 1.0*cm, 0.05173148312005658, 1.0E-6 },
+    { 5.0*cm, 1.5*cm, 0.05046320632064267, 1.0E-5 },
+    { 4.0*cm, 1.0*cm, 0.07403155399954023, 1.0E-5 }
+  };
+  
+  for( const auto &c : cases )
+  {
+    const double frac = DetectorPeakResponse::fractionalSolidAngle( det_diam, c[0], c[1] );
+    BOOST_CHECK_MESSAGE( fabs(frac - c[2]) <= c[3]*c[2],
+                         "Disk source at " << c[0]/cm << " cm, with radius " << c[1]/cm
+                         << " cm, had fractional solid angle " << frac << ", expected " << c[2] );
+  }//for( const auto &c : cases )
+  
+  // A very small source should be the same as a point source.
+  const double point = DetectorPeakResponse::fractionalSolidAngle( det_diam, 5.0*cm );
+  const double small_disk = DetectorPeakResponse::fractionalSolidAngle( det_diam, 5.0*cm, 1.0E-4*cm );
+  BOOST_CHECK_CLOSE( small_disk, point, 1.0E-6 );
+}//BOOST_AUTO_TEST_CASE( DiskSourceSolidAngle )
@@ -39,6 +39,7 @@
 
 #include "InterSpec/DoseCalc.h"
 #include "InterSpec/InterSpec.h"
+#include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/DoseCalcWidget.h"
 #include "InterSpec/GadrasSpecFunc.h"
 #include "InterSpec/DecayDataBaseServer.h"
@@ -126,5 +127,29 @@ BOOST_AUTO_TEST_CASE( RuntimeSanityChecks )
     BOOST_CHECK_MESSAGE( false, e.what() );
   }
   
+  // Check the batched calculation gives the same answers as computing each configuration alone
+  {
+    const vector<float> energies{ 185.7f, 661.7f, 1173.2f, 1332.5f };
+    const vector<float> intensities{ 1.0E6f, 2.0E6f, 5.0E5f, 5.0E5f };
+    const float gcm2 = static_cast<float>( PhysicalUnits::g / PhysicalUnits::cm2 );
+    
+    vector<DoseCalc::ShieldingConfiguration> configs;
+    for( const float an : { 13.0f, 26.0f, 82.0f } )
+      for( const float ad : { 0.0f, 1.0f*gcm2, 10.0f*gcm2 } )
+        for( const float dist : { 50.0f*PhysicalUnits::cm, 1.0f*PhysicalUnits::m, 10.0f*PhysicalUnits::m } )
+          configs.push_back( DoseCalc::ShieldingConfiguration{ad, an, dist} );
+    
+    vector<double> doses;
+    BOOST_REQUIRE_NO_THROW( doses = DoseCalc::gamma_dose_with_shielding( energies, intensities, configs, *scatter_table ) );
+    BOOST_REQUIRE_EQUAL( doses.size(), configs.size() );
+    
+    for( size_t i = 0; i < configs.size(); ++i )
+    {
+      const DoseCalc::ShieldingConfiguration &c = configs[i];
+      const double expected = DoseCalc::gamma_dose_with_shielding( energies, intensities, c.areal_density,
+                                                                   c.atomic_number, c.distance, *scatter_table );
+      BOOST_CHECK_CLOSE( doses[i], expected, 1.0E-3 );
+    }
+  }
 }//BOOST_AUTO_TEST_CASE( RuntimeSanityChecks )
 
@@ -0,0 +1,243 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE GadrasGamLibrary_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/Filesystem.h"
+
+#include "InterSpec/SharedThreadPool.h"
+#include "InterSpec/GadrasGamFileParser.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+/** A GamFileVersion 2.0 record, as written by GadrasGamFile::write_gam (i.e., with CRLF line endings). */
+string written_record( const float scale )
+{
+  GadrasGamFile gam;
+  gam.m_photon_lines_energy = { 59.541f, 185.7f, 661.657f };
+  gam.m_photon_lines_flux = { scale*1.0E4f, scale*5.5E3f, scale*8.1E4f };
+  gam.m_photon_lines_an = { 0.0f, 26.0f, 82.0f };
+  gam.m_photon_lines_ad = { 0.0f, 3.5f, 11.2f };
+  gam.m_photon_group_boundries = { 0.0f, 100.0f, 500.0f, 1000.0f };
+  gam.m_photon_group_flux = { scale*1.5E3f, scale*2.0E3f, scale*3.0E2f, 0.0f };
+  gam.m_neutron_group_boundries = { 1.0f, 100.0f, 2000.0f };
+  gam.m_neutron_group_flux = { scale*10.0f, scale*250.0f, 0.0f };
+  
+  stringstream strm;
+  gam.write_gam( strm, GadrasGamFile::GamFileVersion::Version_2_0 );
+  return strm.str();
+}//written_record(...)
+
+
+/** An old-style record (starting with "0 0") with only neutron groups; its counts line also starts with "0 0". */
+const char * const sm_version1_neutron_only =
+  "0 0 ! NewFormat, ModelGeometry\n"
+  "0 0 3 ! photon lines, photon groups, neutron groups\n"
+  "  1.0000E+00 1.000E+01 ! neutron groups (upper bound (eV), intensity (n/s))\n"
+  "  1.0000E+03 2.000E+02\n"
+  "  1.0000E+06 4.000E+01\n"
+  "  2.0000E+07 0.000E+00\n";
+
+
+/** An old-style record with photon lines. */
+const char * const sm_version1_lines =
+  "0 0 ! NewFormat, ModelGeometry\n"
+  "2 0 0 ! photon lines, photon groups, neutron groups\n"
+  "    661.657   1.000E+05 0.000 0.000 ! photon lines\n"
+  "     32.194   5.100E+03 0.000 0.000\n";
+
+
+/** A GamFileVersion 2.1 record, with six values per photon line and group, and a Description. */
+const char * const sm_version21 =
+  "GamFileVersion = 2.1\n"
+  "DataType = SnTransport 19.2.3.0\n"
+  "Geometry = Spherical\n"
+  "Description = Cs137 in steel\n"
+  "LargestDimension = 2.200E+00\n"
+  "Data = \n"
+  "1 2 0 ! photon lines, photon groups, neutron groups\n"
+  "    661.657   9.000E+04 26.000 7.800 0.000 0.000 ! photon lines\n"
+  "      0.000   1.200E+03 0.000 0.000 0.000 0.000 ! photon groups\n"
+  "    300.000   4.500E+02 0.000 0.000 0.000 0.000\n"
+  "    700.000   0.000E+00 0.000 0.000 0.000 0.000\n"
+  "!\n"
+  "0.5 ! k-eff\n";
+
+
+/** Parses a single record the non-indexed way. */
+GadrasGamFile parse_single( const string &text )
+{
+  stringstream strm( text );
+  GadrasGamFile gam;
+  gam.parse_data( strm );
+  return gam;
+}//parse_single(...)
+
+
+void check_same( const GadrasGamFile &lhs, const GadrasGamFile &rhs )
+{
+  BOOST_CHECK( lhs.m_version == rhs.m_version );
+  BOOST_CHECK( lhs.m_photon_lines_energy == rhs.m_photon_lines_energy );
+  BOOST_CHECK( lhs.m_photon_lines_flux == rhs.m_photon_lines_flux );
+  BOOST_CHECK( lhs.m_photon_lines_an == rhs.m_photon_lines_an );
+  BOOST_CHECK( lhs.m_photon_lines_ad == rhs.m_photon_lines_ad );
+  BOOST_CHECK( lhs.m_photon_group_boundries == rhs.m_photon_group_boundries );
+  BOOST_CHECK( lhs.m_photon_group_flux == rhs.m_photon_group_flux );
+  BOOST_CHECK( lhs.m_neutron_group_boundries == rhs.m_neutron_group_boundries );
+  BOOST_CHECK( lhs.m_neutron_group_flux == rhs.m_neutron_group_flux );
+}//check_same(...)
+
+
+/** The records of the test library, in order. */
+vector<string> library_records()
+{
+  return { written_record( 1.0f ), string( sm_version1_neutron_only ), written_record( 2.0f ),
+           string( sm_version21 ), string( sm_version1_lines ), written_record( 0.5f ) };
+}
+
+
+void check_library( const GadrasGamLibrary &library, const string &contents, const vector<string> &texts )
+{
+  const vector<GadrasGamLibrary::RecordInfo> &records = library.records();
+  BOOST_REQUIRE_EQUAL( records.size(), texts.size() );
+  
+  size_t offset = 0;
+  for( size_t i = 0; i < texts.size(); ++i )
+  {
+    const GadrasGamLibrary::RecordInfo &info = records[i];
+    
+    // Each record covers exactly the text of that record
+    BOOST_CHECK_EQUAL( info.m_begin, offset );
+    BOOST_CHECK_EQUAL( info.m_end, offset + texts[i].size() );
+    BOOST_CHECK( contents.substr( info.m_begin, info.m_end - info.m_begin ) == texts[i] );
+    offset += texts[i].size();
+    
+    const GadrasGamFile single = parse_single( texts[i] );
+    BOOST_CHECK( info.m_version == single.m_version );
+    BOOST_CHECK_EQUAL( info.m_description,
+                       (single.m_version == GadrasGamFile::GamFileVersion::Version_2_1) ? string("Cs137 in steel") : string() );
+    
+    check_same( library.record(i), single );
+  }//for( size_t i = 0; i < texts.size(); ++i )
+  
+  BOOST_CHECK_THROW( library.record( texts.size() ), std::exception );
+}//check_library(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( IndexedMatchesSingleParse )
+{
+  const vector<string> texts = library_records();
+  
+  string contents;
+  for( const string &text : texts )
+    contents += text;
+  
+  // Make sure the test data is what we think it is
+  BOOST_CHECK( parse_single( texts[0] ).m_version == GadrasGamFile::GamFileVersion::Version_2_0 );
+  BOOST_CHECK( parse_single( texts[1] ).m_version == GadrasGamFile::GamFileVersion::Version_1 );
+  BOOST_CHECK_EQUAL( parse_single( texts[1] ).m_neutron_group_flux.size(), 4 );
+  BOOST_CHECK_EQUAL( parse_single( texts[3] ).m_photon_group_flux.size(), 3 );
+  
+  const GadrasGamLibrary from_memory( vector<char>( begin(contents), end(contents) ) );
+  check_library( from_memory, contents, texts );
+  
+  // And from a file, which is memory-mapped on POSIX systems
+  const string filename = SpecUtils::temp_file_name( "test_gam_library", SpecUtils::temp_dir() );
+  {
+    ofstream output( filename.c_str(), ios::binary | ios::out );
+    BOOST_REQUIRE( output.is_open() );
+    output.write( contents.data(), contents.size() );
+  }
+  
+  {
+    const GadrasGamLibrary from_file( filename );
+    check_library( from_file, contents, texts );
+  }
+  
+  SpecUtils::remove_file( filename );
+}//BOOST_AUTO_TEST_CASE( IndexedMatchesSingleParse )
+
+
+// record(...) is documented as thread-safe; decode every record many times from multiple threads.
+BOOST_AUTO_TEST_CASE( ConcurrentRecordAccess )
+{
+  const vector<string> texts = library_records();
+  string contents;
+  for( const string &text : texts )
+    contents += text;
+  
+  const GadrasGamLibrary library( vector<char>( begin(contents), end(contents) ) );
+  
+  vector<GadrasGamFile> expected;
+  for( const string &text : texts )
+    expected.push_back( parse_single( text ) );
+  
+  const size_t num_repeats = 50;
+  vector<GadrasGamFile> decoded( num_repeats * texts.size() );
+  
+  SharedThreadPool::TaskGroup pool;
+  for( size_t i = 0; i < decoded.size(); ++i )
+    pool.post( [i, &library, &decoded, &texts](){ decoded[i] = library.record( i % texts.size() ); } );
+  pool.join();
+  
+  for( size_t i = 0; i < decoded.size(); ++i )
+    check_same( decoded[i], expected[i % texts.size()] );
+}//BOOST_AUTO_TEST_CASE( ConcurrentRecordAccess )
+
+
+BOOST_AUTO_TEST_CASE( InvalidLibraries )
+{
+  BOOST_CHECK_THROW( GadrasGamLibrary{ vector<char>() }, std::exception );
+  
+  const string junk = "Not a gam file\nat all\n";
+  BOOST_CHECK_THROW( GadrasGamLibrary{ vector<char>( begin(junk), end(junk) ) }, std::exception );
+  
+  const string missing_file = SpecUtils::append_path( SpecUtils::temp_dir(), "non_existent_library.gam" );
+  BOOST_CHECK_THROW( GadrasGamLibrary{ missing_file }, std::exception );
+  
+  // A record that is indexed, but fails to parse, only throws when it is decoded
+  const string bad_record = "GamFileVersion = 2.0\nDataType = X\n";
+  const string contents = written_record( 1.0f ) + bad_record;
+  const GadrasGamLibrary library( vector<char>( begin(contents), end(contents) ) );
+  BOOST_REQUIRE_EQUAL( library.records().size(), 2 );
+  BOOST_CHECK_NO_THROW( library.record( 0 ) );
+  BOOST_CHECK_THROW( library.record( 1 ), std::exception );
+}//BOOST_AUTO_TEST_CASE( InvalidLibraries )
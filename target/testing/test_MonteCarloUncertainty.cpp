@@ -0,0 +1,324 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <vector>
+#include <numeric>
+#include <iostream>
+#include <stdexcept>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE MonteCarloUncertainty_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/MonteCarloUncertainty.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+/** Some arbitrary, deterministic given the generator, trial function; trials with an index of 3
+ modulo 7 fail.
+ */
+vector<double> example_trial( std::mt19937_64 &rng, const size_t trial )
+{
+  if( (trial % 7) == 3 )
+    throw runtime_error( "Failed trial" );
+  
+  std::normal_distribution<double> normal( 10.0, 2.0 );
+  std::uniform_real_distribution<double> uniform( 0.0, 1.0 );
+  
+  double sum = 0.0;
+  for( size_t i = 0; i < 100; ++i )
+    sum += uniform( rng );
+  
+  return { normal(rng), sum, static_cast<double>(trial) };
+}//example_trial(...)
+
+
+/** The serial equivalent of MonteCarloUncertainty::run_trials, using the same generator seeding. */
+MonteCarloUncertainty::Distribution serial_trials( const vector<double> &nominal,
+                                                   const MonteCarloUncertainty::TrialFunction &trial,
+                                                   const size_t num_trials, const uint64_t seed )
+{
+  MonteCarloUncertainty::Distribution answer;
+  answer.nominal = nominal;
+  
+  for( size_t i = 0; i < num_trials; ++i )
+  {
+    std::seed_seq seq{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32),
+                       static_cast<uint32_t>(i), static_cast<uint32_t>(static_cast<uint64_t>(i) >> 32) };
+    std::mt19937_64 rng( seq );
+    
+    try
+    {
+      answer.samples.push_back( trial( rng, i ) );
+    }catch( std::exception & )
+    {
+      answer.num_failed += 1;
+    }
+  }//for( size_t i = 0; i < num_trials; ++i )
+  
+  return answer;
+}//serial_trials(...)
+
+
+shared_ptr<const SpecUtils::Measurement> make_spectrum( const double peak_mean, const double peak_sigma,
+                                                        const double peak_area, const double continuum )
+{
+  const size_t nchannel = 1024;
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( nchannel, { 0.0f, 1.0f }, {} );
+  
+  auto counts = make_shared<vector<float>>( nchannel );
+  for( size_t i = 0; i < nchannel; ++i )
+  {
+    const double z0 = (i - peak_mean) / (peak_sigma*sqrt(2.0));
+    const double z1 = (i + 1.0 - peak_mean) / (peak_sigma*sqrt(2.0));
+    (*counts)[i] = static_cast<float>( std::round( continuum + 0.5*peak_area*(erf(z1) - erf(z0)) ) );
+  }
+  
+  auto meas = make_shared<SpecUtils::Measurement>();
+  meas->set_gamma_counts( counts, 300.0f, 300.0f );
+  meas->set_energy_calibration( cal );
+  
+  return meas;
+}//make_spectrum(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( RunTrialsMatchesSerial )
+{
+  const vector<double> nominal{ 10.0, 50.0, 0.0 };
+  const size_t num_trials = 500;
+  
+  for( const uint64_t seed : { uint64_t(0), uint64_t(12345), uint64_t(0xFFFFFFFF00000001ULL) } )
+  {
+    const MonteCarloUncertainty::Distribution parallel
+                     = MonteCarloUncertainty::run_trials( nominal, &example_trial, num_trials, seed );
+    const MonteCarloUncertainty::Distribution serial = serial_trials( nominal, &example_trial, num_trials, seed );
+    
+    BOOST_CHECK( parallel.nominal == nominal );
+    BOOST_CHECK_EQUAL( parallel.num_failed, serial.num_failed );
+    BOOST_CHECK_EQUAL( parallel.num_failed, (num_trials + 3) / 7 );
+    BOOST_REQUIRE_EQUAL( parallel.samples.size(), serial.samples.size() );
+    BOOST_CHECK_EQUAL( parallel.samples.size() + parallel.num_failed, num_trials );
+    
+    // Same values, in the same (trial number) order, regardless of how the trials were scheduled
+    for( size_t i = 0; i < serial.samples.size(); ++i )
+      BOOST_CHECK( parallel.samples[i] == serial.samples[i] );
+    
+    // And the same seed gives the same results again
+    const MonteCarloUncertainty::Distribution again
+                     = MonteCarloUncertainty::run_trials( nominal, &example_trial, num_trials, seed );
+    BOOST_CHECK( again.samples == parallel.samples );
+    
+    for( size_t index = 0; index < nominal.size(); ++index )
+    {
+      BOOST_CHECK_EQUAL( parallel.mean(index), serial.mean(index) );
+      BOOST_CHECK_EQUAL( parallel.standard_deviation(index), serial.standard_deviation(index) );
+    }
+    
+    // Loose sanity check on the statistics of the trials themselves
+    BOOST_CHECK_SMALL( parallel.mean(0) - 10.0, 0.5 );
+    BOOST_CHECK_CLOSE( parallel.standard_deviation(0), 2.0, 15.0 );
+    BOOST_CHECK_SMALL( parallel.mean(1) - 50.0, 0.5 );
+  }//for( loop over seeds )
+  
+  // Different seeds give different results
+  const MonteCarloUncertainty::Distribution seed1 = MonteCarloUncertainty::run_trials( nominal, &example_trial, 20, 1 );
+  const MonteCarloUncertainty::Distribution seed2 = MonteCarloUncertainty::run_trials( nominal, &example_trial, 20, 2 );
+  BOOST_CHECK( seed1.samples != seed2.samples );
+}//BOOST_AUTO_TEST_CASE( RunTrialsMatchesSerial )
+
+
+BOOST_AUTO_TEST_CASE( RunTrialsErrorsAndCancel )
+{
+  const vector<double> nominal{ 1.0, 2.0 };
+  
+  // Wrong number of values returned is an error, not a failed trial
+  const MonteCarloUncertainty::TrialFunction wrong_size = []( std::mt19937_64 &, const size_t trial ) -> vector<double> {
+    return vector<double>( (trial == 17) ? 3 : 2, 0.0 );
+  };
+  BOOST_CHECK_THROW( MonteCarloUncertainty::run_trials( nominal, wrong_size, 50 ), std::exception );
+  
+  BOOST_CHECK_THROW( MonteCarloUncertainty::run_trials( nominal, MonteCarloUncertainty::TrialFunction(), 10 ),
+                     std::exception );
+  
+  // Already cancelled: nothing runs, and nothing is counted as failed
+  std::atomic<bool> cancel( true );
+  std::atomic<size_t> num_called( 0 );
+  const MonteCarloUncertainty::TrialFunction counting = [&num_called]( std::mt19937_64 &, const size_t ) -> vector<double> {
+    ++num_called;
+    return { 1.0, 2.0 };
+  };
+  
+  const MonteCarloUncertainty::Distribution cancelled
+                        = MonteCarloUncertainty::run_trials( nominal, counting, 100, 0, &cancel );
+  BOOST_CHECK_EQUAL( num_called.load(), 0 );
+  BOOST_CHECK( cancelled.samples.empty() );
+  BOOST_CHECK_EQUAL( cancelled.num_failed, 0 );
+  BOOST_CHECK_THROW( cancelled.mean(0), std::exception );
+  
+  cancel = false;
+  const MonteCarloUncertainty::Distribution not_cancelled
+                        = MonteCarloUncertainty::run_trials( nominal, counting, 100, 0, &cancel );
+  BOOST_CHECK_EQUAL( num_called.load(), 100 );
+  BOOST_CHECK_EQUAL( not_cancelled.samples.size(), 100 );
+}//BOOST_AUTO_TEST_CASE( RunTrialsErrorsAndCancel )
+
+
+BOOST_AUTO_TEST_CASE( DistributionStatistics )
+{
+  MonteCarloUncertainty::Distribution dist;
+  dist.nominal = { 0.0 };
+  for( const double v : { 5.0, 1.0, 4.0, 2.0, 3.0 } )
+    dist.samples.push_back( { v } );
+  
+  BOOST_CHECK_CLOSE( dist.mean(0), 3.0, 1.0E-12 );
+  BOOST_CHECK_CLOSE( dist.standard_deviation(0), sqrt(2.5), 1.0E-12 );
+  BOOST_CHECK_CLOSE( dist.quantile(0, 0.0), 1.0, 1.0E-12 );
+  BOOST_CHECK_CLOSE( dist.quantile(0, 0.5), 3.0, 1.0E-12 );
+  BOOST_CHECK_CLOSE( dist.quantile(0, 1.0), 5.0, 1.0E-12 );
+  BOOST_CHECK_CLOSE( dist.quantile(0, 0.125), 1.5, 1.0E-12 );
+  BOOST_CHECK( dist.sorted_values(0) == (vector<double>{ 1.0, 2.0, 3.0, 4.0, 5.0 }) );
+  
+  BOOST_CHECK_THROW( dist.mean(1), std::exception );
+  BOOST_CHECK_THROW( dist.quantile(0, 1.5), std::exception );
+  BOOST_CHECK_THROW( dist.quantile(0, std::nan("")), std::exception );
+  
+  dist.samples.resize( 1 );
+  BOOST_CHECK_THROW( dist.standard_deviation(0), std::exception );
+}//BOOST_AUTO_TEST_CASE( DistributionStatistics )
+
+
+BOOST_AUTO_TEST_CASE( Resampling )
+{
+  std::mt19937_64 rng( 42 );
+  
+  // Gaussian resampling should reproduce the covariance, and leave zero-variance parameters alone
+  const vector<double> values{ 1.0, -2.0, 5.0 };
+  const vector<vector<double>> covariance{ { 4.0, 1.2, 0.0 }, { 1.2, 1.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+  
+  const size_t nsample = 20000;
+  vector<double> sum( 3, 0.0 );
+  vector<vector<double>> sum2( 3, vector<double>(3, 0.0) );
+  for( size_t i = 0; i < nsample; ++i )
+  {
+    const vector<double> sample = MonteCarloUncertainty::gaussian_resample( values, covariance, rng );
+    BOOST_REQUIRE_EQUAL( sample.size(), 3 );
+    BOOST_CHECK_EQUAL( sample[2], 5.0 );
+    for( size_t j = 0; j < 3; ++j )
+    {
+      sum[j] += sample[j];
+      for( size_t k = 0; k < 3; ++k )
+        sum2[j][k] += (sample[j] - values[j]) * (sample[k] - values[k]);
+    }
+  }//for( size_t i = 0; i < nsample; ++i )
+  
+  for( size_t j = 0; j < 2; ++j )
+  {
+    BOOST_CHECK_SMALL( sum[j]/nsample - values[j], 5.0*sqrt(covariance[j][j]/nsample) );
+    for( size_t k = 0; k < 2; ++k )
+      BOOST_CHECK_SMALL( sum2[j][k]/nsample - covariance[j][k], 0.1*sqrt(covariance[j][j]*covariance[k][k]) );
+  }
+  
+  BOOST_CHECK_THROW( MonteCarloUncertainty::gaussian_resample( values, { { 1.0, 0.0 }, { 0.0, 1.0 } }, rng ),
+                     std::exception );
+  BOOST_CHECK_THROW( MonteCarloUncertainty::gaussian_resample( { 0.0, 0.0 }, { { 1.0, 2.0 }, { 2.0, 1.0 } }, rng ),
+                     std::exception );
+  
+  // Poisson resampling keeps everything but the counts, and empty channels stay empty
+  const shared_ptr<const SpecUtils::Measurement> spectrum = make_spectrum( 500.0, 2.0, 1.0E5, 100.0 );
+  auto with_zeros = make_shared<SpecUtils::Measurement>( *spectrum );
+  auto counts = make_shared<vector<float>>( *spectrum->gamma_counts() );
+  for( size_t i = 0; i < 10; ++i )
+    (*counts)[i] = 0.0f;
+  with_zeros->set_gamma_counts( counts, spectrum->live_time(), spectrum->real_time() );
+  
+  const shared_ptr<SpecUtils::Measurement> resampled = MonteCarloUncertainty::poisson_resample( *with_zeros, rng );
+  BOOST_REQUIRE( resampled && resampled->gamma_counts() );
+  BOOST_CHECK( resampled->energy_calibration() == with_zeros->energy_calibration() );
+  BOOST_CHECK_EQUAL( resampled->live_time(), with_zeros->live_time() );
+  BOOST_CHECK_EQUAL( resampled->real_time(), with_zeros->real_time() );
+  BOOST_REQUIRE_EQUAL( resampled->num_gamma_channels(), with_zeros->num_gamma_channels() );
+  BOOST_CHECK( *resampled->gamma_counts() != *with_zeros->gamma_counts() );
+  
+  for( size_t i = 0; i < 10; ++i )
+    BOOST_CHECK_EQUAL( resampled->gamma_channel_content(i), 0.0f );
+  
+  const double orig_sum = with_zeros->gamma_channels_sum( 0, with_zeros->num_gamma_channels() - 1 );
+  const double new_sum = resampled->gamma_channels_sum( 0, resampled->num_gamma_channels() - 1 );
+  BOOST_CHECK_SMALL( new_sum - orig_sum, 5.0*sqrt(orig_sum) );
+}//BOOST_AUTO_TEST_CASE( Resampling )
+
+
+BOOST_AUTO_TEST_CASE( PeakAmplitudeDistribution )
+{
+  const double peak_area = 5000.0, continuum_per_channel = 50.0;
+  const shared_ptr<const SpecUtils::Measurement> spectrum = make_spectrum( 500.0, 2.0, peak_area, continuum_per_channel );
+  
+  auto continuum = make_shared<PeakContinuum>();
+  continuum->setType( PeakContinuum::OffsetType::Linear );
+  continuum->setRange( 485.0, 515.0 );
+  continuum->setParameters( 485.0, { continuum_per_channel, 0.0 }, {} );
+  
+  auto peak = make_shared<PeakDef>( 500.0, 2.0, peak_area );
+  peak->setContinuum( continuum );
+  
+  const size_t num_trials = 64;
+  const MonteCarloUncertainty::Distribution dist
+        = MonteCarloUncertainty::peak_amplitude_distribution( spectrum, { peak }, num_trials, 7 );
+  
+  BOOST_REQUIRE_EQUAL( dist.nominal.size(), 1 );
+  BOOST_CHECK_EQUAL( dist.nominal[0], peak_area );
+  BOOST_CHECK_EQUAL( dist.samples.size() + dist.num_failed, num_trials );
+  BOOST_REQUIRE_GT( dist.samples.size(), num_trials / 2 );
+  
+  // Poisson statistics of the peak, plus the continuum under it (roughly +-3 sigma)
+  const double expected_uncert = sqrt( peak_area + 12.0*continuum_per_channel );
+  BOOST_CHECK_SMALL( dist.mean(0) - peak_area, 5.0*expected_uncert/sqrt(1.0*dist.samples.size()) + 0.01*peak_area );
+  BOOST_CHECK_GT( dist.standard_deviation(0), 0.5*expected_uncert );
+  BOOST_CHECK_LT( dist.standard_deviation(0), 2.0*expected_uncert );
+  
+  // Deterministic for a given seed
+  const MonteCarloUncertainty::Distribution again
+        = MonteCarloUncertainty::peak_amplitude_distribution( spectrum, { peak }, num_trials, 7 );
+  BOOST_CHECK( again.samples == dist.samples );
+  
+  BOOST_CHECK_THROW( MonteCarloUncertainty::peak_amplitude_distribution( spectrum, {}, 10 ), std::exception );
+  BOOST_CHECK_THROW( MonteCarloUncertainty::peak_amplitude_distribution( nullptr, { peak }, 10 ), std::exception );
+}//BOOST_AUTO_TEST_CASE( PeakAmplitudeDistribution )
@@ -0,0 +1,182 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ParallelHessian_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "Minuit2/FCNBase.h"
+#include "Minuit2/MnHesse.h"
+#include "Minuit2/MnStrategy.h"
+#include "Minuit2/MnUserCovariance.h"
+#include "Minuit2/MnUserParameters.h"
+#include "Minuit2/MnUserParameterState.h"
+
+#include "InterSpec/ParallelHessian.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+/** A chi2 that is a quadratic form, 0.5*(x-x0)^T A (x-x0), in the first three parameters, plus a
+ quartic term in the fourth; the Hessian at x0 is exactly A (with a zero for the fourth parameter).
+ */
+class QuadraticFcn : public ROOT::Minuit2::FCNBase
+{
+public:
+  QuadraticFcn()
+   : m_x0{ 1.0, -2.0, 0.5, 3.0 },
+     m_A{ {4.0, 1.0, 0.5}, {1.0, 3.0, -0.8}, {0.5, -0.8, 2.0} },
+     m_num_calls( 0 )
+  {
+  }
+  
+  virtual double operator()( const std::vector<double> &x ) const
+  {
+    if( x.size() != 4 )
+      throw std::runtime_error( "QuadraticFcn: invalid number of parameters" );
+    
+    ++m_num_calls;
+    
+    double answer = 0.0;
+    for( size_t i = 0; i < 3; ++i )
+      for( size_t j = 0; j < 3; ++j )
+        answer += 0.5 * (x[i] - m_x0[i]) * m_A[i][j] * (x[j] - m_x0[j]);
+    answer += std::pow( x[3] - m_x0[3], 4.0 );
+    
+    return answer;
+  }
+  
+  virtual double Up() const { return 1.0; }
+  
+  const double m_x0[4];
+  const double m_A[3][3];
+  mutable std::atomic<size_t> m_num_calls;
+};//class QuadraticFcn
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( QuadraticHessian )
+{
+  const QuadraticFcn fcn;
+  const vector<double> x0( fcn.m_x0, fcn.m_x0 + 4 );
+  
+  // The fourth parameter is fixed by giving it a zero step
+  const vector<double> steps{ 0.01, 0.02, 0.01, 0.0 };
+  
+  for( const size_t num_threads : { size_t(1), size_t(4), size_t(0) } )
+  {
+    ParallelHessian::HessianResult result;
+    BOOST_REQUIRE_NO_THROW( result = ParallelHessian::compute( ParallelHessian::evaluator_factory(fcn),
+                                                              x0, steps, fcn.Up(), num_threads ) );
+    
+    BOOST_REQUIRE_EQUAL( result.hessian.size(), 4 );
+    BOOST_REQUIRE_EQUAL( result.covariance.size(), 4 );
+    BOOST_REQUIRE_EQUAL( result.errors.size(), 4 );
+    BOOST_CHECK( result.num_fcn_calls > 0 );
+    
+    for( size_t i = 0; i < 4; ++i )
+    {
+      BOOST_REQUIRE_EQUAL( result.hessian[i].size(), 4 );
+      for( size_t j = 0; j < 4; ++j )
+      {
+        const double expected = ((i < 3) && (j < 3)) ? fcn.m_A[i][j] : 0.0;
+        BOOST_CHECK_MESSAGE( fabs(result.hessian[i][j] - expected) < 1.0E-5,
+                             "Hessian(" << i << "," << j << ")=" << result.hessian[i][j]
+                             << ", expected " << expected << " (" << num_threads << " threads)" );
+      }
+      
+      // Fixed parameters have a zero row and column in the covariance
+      BOOST_CHECK_EQUAL( result.covariance[i][3], 0.0 );
+      BOOST_CHECK_EQUAL( result.covariance[3][i], 0.0 );
+    }//for( size_t i = 0; i < 4; ++i )
+    
+    // covariance * hessian should be 2*up*identity, for the free parameters
+    for( size_t i = 0; i < 3; ++i )
+    {
+      for( size_t j = 0; j < 3; ++j )
+      {
+        double prod = 0.0;
+        for( size_t k = 0; k < 3; ++k )
+          prod += result.covariance[i][k] * fcn.m_A[k][j];
+        const double expected = (i == j) ? 2.0*fcn.Up() : 0.0;
+        BOOST_CHECK_MESSAGE( fabs(prod - expected) < 1.0E-5,
+                             "(Covariance*Hessian)(" << i << "," << j << ")=" << prod
+                             << ", expected " << expected );
+      }
+      
+      BOOST_CHECK_CLOSE( result.errors[i], sqrt(result.covariance[i][i]), 1.0E-9 );
+    }//for( size_t i = 0; i < 3; ++i )
+  }//for( loop over thread counts )
+}//BOOST_AUTO_TEST_CASE( QuadraticHessian )
+
+
+// The parallel covariance must agree with what Minuit computes serially with MnHesse.
+BOOST_AUTO_TEST_CASE( MatchesMinuitHesse )
+{
+  const QuadraticFcn fcn;
+  
+  ROOT::Minuit2::MnUserParameters pars;
+  pars.Add( "x0", fcn.m_x0[0], 0.1 );
+  pars.Add( "x1", fcn.m_x0[1], 0.1 );
+  pars.Add( "x2", fcn.m_x0[2], 0.1 );
+  pars.Add( "x3", fcn.m_x0[3] );  //constant parameter
+  
+  const ROOT::Minuit2::MnHesse hesse( ROOT::Minuit2::MnStrategy(2) );
+  const ROOT::Minuit2::MnUserParameterState state = hesse( fcn, pars );
+  BOOST_REQUIRE( state.HasCovariance() );
+  const ROOT::Minuit2::MnUserCovariance &minuit_cov = state.Covariance();
+  
+  const vector<double> x0( fcn.m_x0, fcn.m_x0 + 4 );
+  const vector<double> steps{ 0.01, 0.01, 0.01, 0.0 };
+  
+  ParallelHessian::HessianResult result;
+  BOOST_REQUIRE_NO_THROW( result = ParallelHessian::compute( ParallelHessian::evaluator_factory(fcn),
+                                                            x0, steps, fcn.Up(), 4 ) );
+  BOOST_REQUIRE_EQUAL( result.covariance.size(), 4 );
+  
+  // Minuit's covariance only includes the variable parameters, which are the first three here
+  BOOST_REQUIRE_EQUAL( minuit_cov.Nrow(), 3 );
+  for( unsigned int i = 0; i < 3; ++i )
+  {
+    for( unsigned int j = 0; j < 3; ++j )
+    {
+      const double expected = minuit_cov(i,j);
+      BOOST_CHECK_MESSAGE( fabs(result.covariance[i][j] - expected) < 1.0E-4*std::max(1.0, fabs(expected)),
+                           "Covariance(" << i << "," << j << ")=" << result.covariance[i][j]
+                           << ", Minuit gives " << expected );
+    }
+  }//for( unsigned int i = 0; i < 3; ++i )
+}//BOOST_AUTO_TEST_CASE( MatchesMinuitHesse )
@@ -62,6 +62,127 @@ BOOST_AUTO_TEST_CASE( Erfc )
 }//BOOST_AUTO_TEST_CASE( Erfc )
 
 
+BOOST_AUTO_TEST_CASE( ErfArray )
+{
+  // The array versions of erf/erfc should agree with the scalar versions (they use a different
+  //  `exp` implementation, so may differ in the last bits), for sorted (the normal case for
+  //  channel energies), reverse sorted, and unsorted input.
+  vector<double> args;
+  for( double x = -30; x <= 30; x += 0.0037 )
+    args.push_back( x );
+  args.push_back( 0.0 );
+  args.push_back( -0.0 );
+  args.push_back( 1.0E-12 );
+  args.push_back( -1.0E-12 );
+  
+  vector<double> reversed( args.rbegin(), args.rend() );
+  vector<double> shuffled = args;
+  for( size_t i = 0; i < shuffled.size(); i += 3 )
+    std::swap( shuffled[i], shuffled[(7*i + 13) % shuffled.size()] );
+  
+  for( const vector<double> *input : { &args, &reversed, &shuffled } )
+  {
+    const vector<double> &z = *input;
+    vector<double> erf_vals( z.size() ), erfc_vals( z.size() );
+    
+    PeakDists::boost_erf_imp( z.data(), erf_vals.data(), z.size() );
+    PeakDists::boost_erfc_imp( z.data(), erfc_vals.data(), z.size() );
+    
+    for( size_t i = 0; i < z.size(); ++i )
+    {
+      BOOST_CHECK_CLOSE( erf_vals[i], PeakDists::boost_erf_imp(z[i]), 1.0E-12 );
+      BOOST_CHECK_CLOSE( erfc_vals[i], PeakDists::boost_erfc_imp(z[i]), 1.0E-12 );
+    }
+  }
+}//BOOST_AUTO_TEST_CASE( ErfArray )
+
+
+BOOST_AUTO_TEST_CASE( TabulatedGaussian )
+{
+  // The table-interpolated erf is only used for quick chi2 checks, but should still be accurate
+  //  to well below the statistical precision of any realistic spectrum.
+  for( double z = -9.0; z <= 9.0; z += 0.00137 )
+    BOOST_CHECK_SMALL( erf_tabulated(z) - PeakDists::boost_erf_imp(z), 1.0E-10 );
+  
+  const double mean = 661.7, sigma = 22.1, amp = 1.0E4;
+  vector<float> energies;
+  for( float x = 500.0f; x < 820.0f; x += 2.93f )
+    energies.push_back( x );
+  const size_t nchannel = energies.size() - 1;
+  
+  vector<double> exact( nchannel, 0.0 ), tabulated( nchannel, 0.0 );
+  gaussian_integral( mean, sigma, amp, energies.data(), exact.data(), nchannel );
+  gaussian_integral_tabulated( mean, sigma, amp, energies.data(), tabulated.data(), nchannel );
+  
+  for( size_t i = 0; i < nchannel; ++i )
+  {
+    BOOST_CHECK_SMALL( tabulated[i] - exact[i], 1.0E-9*amp );
+    BOOST_CHECK_SMALL( amp*gaussian_integral_tabulated( mean, sigma, energies[i], energies[i+1] ) - exact[i], 1.0E-9*amp );
+  }
+}//BOOST_AUTO_TEST_CASE( TabulatedGaussian )
+
+
+BOOST_AUTO_TEST_CASE( PhotopeakDerivatives )
+{
+  // Check the analytic Gaussian derivatives, and the skewed-distribution differences, against a
+  //  coarser central difference of `photopeak_function_integral(...)`.
+  const double mean = 661.7, sigma = 1.3, amp = 1.0E4;
+  
+  vector<float> energies;
+  for( float x = 650.0f; x < 675.0f; x += 0.37f )
+    energies.push_back( x );
+  const size_t nchannel = energies.size() - 1;
+  
+  const vector<pair<PeakDef::SkewType,vector<double>>> dists{
+    { PeakDef::SkewType::NoSkew, {} },
+    { PeakDef::SkewType::Bortel, { 1.1 } },
+    { PeakDef::SkewType::GaussExp, { 1.7 } },
+    { PeakDef::SkewType::CrystalBall, { 1.2, 3.5 } },
+    { PeakDef::SkewType::ExpGaussExp, { 1.4, 2.1 } },
+    { PeakDef::SkewType::DoubleSidedCrystalBall, { 1.2, 3.5, 2.1, 6.0 } }
+  };
+  
+  for( const auto &dist : dists )
+  {
+    const PeakDef::SkewType skew_type = dist.first;
+    const size_t nskew = PeakDef::num_skew_parameters( skew_type );
+    BOOST_REQUIRE_EQUAL( nskew, dist.second.size() );
+    
+    vector<double> pars{ mean, sigma };
+    pars.insert( end(pars), begin(dist.second), end(dist.second) );
+    
+    vector<double> derivs( (2 + nskew)*nchannel, 0.0 );
+    PeakDists::photopeak_function_integral_derivatives( mean, sigma, amp, skew_type,
+                          pars.data() + 2, nchannel, energies.data(), &(derivs[0]),
+                          &(derivs[nchannel]), (nskew ? &(derivs[2*nchannel]) : nullptr) );
+    
+    for( size_t par = 0; par < pars.size(); ++par )
+    {
+      const double h = 1.0E-3 * ((par == 0) ? sigma : pars[par]);
+      vector<double> up_pars = pars, down_pars = pars;
+      up_pars[par] += h;
+      down_pars[par] -= h;
+      
+      vector<double> upper( nchannel, 0.0 ), lower( nchannel, 0.0 );
+      PeakDists::photopeak_function_integral( up_pars[0], up_pars[1], amp, skew_type,
+                                   up_pars.data() + 2, nchannel, energies.data(), upper.data() );
+      PeakDists::photopeak_function_integral( down_pars[0], down_pars[1], amp, skew_type,
+                                   down_pars.data() + 2, nchannel, energies.data(), lower.data() );
+      
+      double max_deriv = 0.0;
+      for( size_t i = 0; i < nchannel; ++i )
+        max_deriv = std::max( max_deriv, fabs(upper[i] - lower[i]) / (2.0*h) );
+      
+      for( size_t i = 0; i < nchannel; ++i )
+      {
+        const double expected = (upper[i] - lower[i]) / (2.0*h);
+        BOOST_CHECK_SMALL( derivs[par*nchannel + i] - expected, 1.0E-3*max_deriv );
+      }
+    }//for( size_t par = 0; par < pars.size(); ++par )
+  }//for( const auto &dist : dists )
+}//BOOST_AUTO_TEST_CASE( PhotopeakDerivatives )
+
+
 BOOST_AUTO_TEST_CASE( GaussianDist )
 {
   // Check Gaussian has unit area
@@ -0,0 +1,276 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE PeakFitLM_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/PeakFitLM.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+const double sm_roi_lower = 640.0;
+const double sm_roi_upper = 690.0;
+
+struct TruePeak
+{
+  double mean;
+  double sigma;
+  double amplitude;
+};//struct TruePeak
+
+
+/** A 0.5 keV/channel spectrum of Gaussian peaks on a linear continuum, optionally with Poisson noise. */
+shared_ptr<const SpecUtils::Measurement> make_detector( const vector<TruePeak> &peaks,
+                                                        const double cont_offset,
+                                                        const double cont_slope,
+                                                        std::mt19937 *rng )
+{
+  const size_t nchannel = 4096;
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( nchannel, { 0.0f, 0.5f }, {} );
+  
+  auto counts = make_shared<vector<float>>( nchannel, 0.0f );
+  for( size_t i = 0; i < nchannel; ++i )
+  {
+    const double x0 = 0.5*i, x1 = 0.5*(i + 1);
+    
+    // Integral of `cont_offset + cont_slope*(x - sm_roi_lower)` over the channel
+    double expected = std::max( 0.0, (x1 - x0)*(cont_offset + cont_slope*(0.5*(x0 + x1) - sm_roi_lower)) );
+    
+    for( const TruePeak &p : peaks )
+    {
+      const double z0 = (x0 - p.mean) / (p.sigma * std::sqrt(2.0));
+      const double z1 = (x1 - p.mean) / (p.sigma * std::sqrt(2.0));
+      expected += 0.5 * p.amplitude * (std::erf(z1) - std::erf(z0));
+    }
+    
+    if( rng )
+    {
+      std::poisson_distribution<int> poisson( std::max( expected, 1.0E-6 ) );
+      (*counts)[i] = static_cast<float>( poisson( *rng ) );
+    }else
+    {
+      (*counts)[i] = static_cast<float>( expected );
+    }
+  }//for( size_t i = 0; i < nchannel; ++i )
+  
+  auto meas = make_shared<SpecUtils::Measurement>();
+  meas->set_gamma_counts( counts, 300.0f, 300.0f );
+  meas->set_energy_calibration( cal );
+  
+  return meas;
+}//make_detector(...)
+
+
+/** Starting peaks a bit off from the truth, sharing a linear continuum over the ROI. */
+vector<shared_ptr<const PeakDef>> starting_peaks( const vector<TruePeak> &truth )
+{
+  auto continuum = make_shared<PeakContinuum>();
+  continuum->setType( PeakContinuum::OffsetType::Linear );
+  continuum->setRange( sm_roi_lower, sm_roi_upper );
+  
+  vector<shared_ptr<const PeakDef>> peaks;
+  for( const TruePeak &p : truth )
+  {
+    auto peak = make_shared<PeakDef>( p.mean + 0.3, 1.1*p.sigma, 0.7*p.amplitude );
+    peak->setContinuum( continuum );
+    peaks.push_back( peak );
+  }
+  
+  return peaks;
+}//starting_peaks(...)
+
+
+/** Checks that two fits of the same detector agree. */
+void check_same_fit( const PeakFitLM::JointDetectorFit &lhs, const PeakFitLM::JointDetectorFit &rhs,
+                     const double mean_offset, const double fwhm_scale, const double tolerance )
+{
+  BOOST_REQUIRE_EQUAL( lhs.peaks.size(), rhs.peaks.size() );
+  
+  for( size_t i = 0; i < lhs.peaks.size(); ++i )
+  {
+    const PeakDef &l = *lhs.peaks[i];
+    const PeakDef &r = *rhs.peaks[i];
+    
+    BOOST_CHECK_SMALL( l.mean() - (r.mean() + mean_offset), tolerance * r.sigma() );
+    BOOST_CHECK_SMALL( l.sigma() - fwhm_scale*r.sigma(), tolerance * r.sigma() );
+    BOOST_CHECK_SMALL( l.amplitude() - r.amplitude(), tolerance * r.amplitude() );
+    
+    BOOST_REQUIRE( l.continuum() && r.continuum() );
+    BOOST_CHECK( l.continuum() == lhs.peaks[0]->continuum() );
+    
+    const double l_cont = l.continuum()->offset_integral( sm_roi_lower, sm_roi_upper, nullptr );
+    const double r_cont = r.continuum()->offset_integral( sm_roi_lower, sm_roi_upper, nullptr );
+    BOOST_CHECK_SMALL( l_cont - r_cont, tolerance * std::fabs(r_cont) );
+  }//for( loop over peaks )
+}//check_same_fit(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( SingleDetectorRecoversTruth )
+{
+  const vector<TruePeak> truth = { { 658.0, 1.10, 2.0E4 }, { 667.5, 1.16, 8.0E3 } };
+  const shared_ptr<const SpecUtils::Measurement> detector = make_detector( truth, 50.0, -0.2, nullptr );
+  
+  const vector<PeakFitLM::JointDetectorFit> fit
+                      = PeakFitLM::fit_peaks_jointly( { detector }, starting_peaks( truth ) );
+  BOOST_REQUIRE_EQUAL( fit.size(), 1 );
+  BOOST_REQUIRE_EQUAL( fit[0].peaks.size(), truth.size() );
+  BOOST_CHECK_EQUAL( fit[0].energy_offset, 0.0 );
+  BOOST_CHECK_EQUAL( fit[0].fwhm_scale, 1.0 );
+  BOOST_CHECK_GT( fit[0].dof, 0.0 );
+  BOOST_CHECK_LT( fit[0].chi2, 0.01*fit[0].dof );
+  
+  for( size_t i = 0; i < truth.size(); ++i )
+  {
+    BOOST_CHECK_SMALL( fit[0].peaks[i]->mean() - truth[i].mean, 1.0E-3 );
+    BOOST_CHECK_CLOSE( fit[0].peaks[i]->sigma(), truth[i].sigma, 0.1 );
+    BOOST_CHECK_CLOSE( fit[0].peaks[i]->amplitude(), truth[i].amplitude, 0.1 );
+  }
+}//BOOST_AUTO_TEST_CASE( SingleDetectorRecoversTruth )
+
+
+// With noise-free data, each detector of the joint fit should get the same answer as fitting that
+//  detector on its own, including the detector-to-detector energy offset and width scaling.
+BOOST_AUTO_TEST_CASE( JointMatchesIndividualFits )
+{
+  const vector<TruePeak> truth = { { 658.0, 1.10, 2.0E4 }, { 667.5, 1.16, 8.0E3 } };
+  
+  struct DetectorVariation
+  {
+    double amp_scale, offset, width_scale, cont_offset, cont_slope;
+  };
+  
+  const vector<DetectorVariation> variations = {
+    { 1.0, 0.0,  1.00, 50.0, -0.2 },
+    { 2.5, 0.0,  1.00, 20.0,  0.1 },
+    { 0.4, 0.4,  1.00, 80.0,  0.0 },
+    { 1.3, 0.0,  1.10, 35.0, -0.3 },
+    { 0.8, -0.15, 0.95, 60.0, 0.05 }
+  };
+  
+  vector<shared_ptr<const SpecUtils::Measurement>> detectors;
+  for( const DetectorVariation &v : variations )
+  {
+    vector<TruePeak> det_truth = truth;
+    for( TruePeak &p : det_truth )
+    {
+      p.mean += v.offset;
+      p.sigma *= v.width_scale;
+      p.amplitude *= v.amp_scale;
+    }
+    
+    detectors.push_back( make_detector( det_truth, v.cont_offset, v.cont_slope, nullptr ) );
+  }//for( const DetectorVariation &v : variations )
+  
+  const vector<shared_ptr<const PeakDef>> peaks0 = starting_peaks( truth );
+  const vector<PeakFitLM::JointDetectorFit> joint = PeakFitLM::fit_peaks_jointly( detectors, peaks0 );
+  BOOST_REQUIRE_EQUAL( joint.size(), detectors.size() );
+  
+  for( size_t i = 0; i < detectors.size(); ++i )
+  {
+    const vector<PeakFitLM::JointDetectorFit> single = PeakFitLM::fit_peaks_jointly( { detectors[i] }, peaks0 );
+    BOOST_REQUIRE_EQUAL( single.size(), 1 );
+    
+    BOOST_CHECK_SMALL( joint[i].energy_offset - variations[i].offset, 1.0E-3 );
+    BOOST_CHECK_SMALL( joint[i].fwhm_scale - variations[i].width_scale, 1.0E-3 );
+    
+    // Both fits are to exact data, so should agree to well within the fit tolerance; the joint
+    //  fit peak means are `offset` from the first detector, and the single fits are absolute.
+    check_same_fit( joint[i], single[0], 0.0, 1.0, 1.0E-3 );
+    
+    // And the per-detector chi2 should match
+    BOOST_CHECK_SMALL( joint[i].chi2 - single[0].chi2, 0.01 );
+  }//for( loop over detectors )
+}//BOOST_AUTO_TEST_CASE( JointMatchesIndividualFits )
+
+
+// The same noisy spectrum given as several detectors, must give the same answer as fitting it once;
+//  this also checks the multi-threaded evaluation of the detectors against the single-detector path.
+BOOST_AUTO_TEST_CASE( DuplicatedDetectorsMatchSingleFit )
+{
+  std::mt19937 rng( 5489 );
+  
+  const vector<TruePeak> truth = { { 661.66, 1.25, 5.0E3 } };
+  const shared_ptr<const SpecUtils::Measurement> detector = make_detector( truth, 30.0, -0.1, &rng );
+  const vector<shared_ptr<const PeakDef>> peaks0 = starting_peaks( truth );
+  
+  const vector<PeakFitLM::JointDetectorFit> single = PeakFitLM::fit_peaks_jointly( { detector }, peaks0 );
+  BOOST_REQUIRE_EQUAL( single.size(), 1 );
+  
+  const vector<shared_ptr<const SpecUtils::Measurement>> detectors( 6, detector );
+  const vector<PeakFitLM::JointDetectorFit> joint = PeakFitLM::fit_peaks_jointly( detectors, peaks0 );
+  BOOST_REQUIRE_EQUAL( joint.size(), detectors.size() );
+  
+  for( size_t i = 0; i < joint.size(); ++i )
+  {
+    BOOST_CHECK_SMALL( joint[i].energy_offset, 1.0E-3 );
+    BOOST_CHECK_SMALL( joint[i].fwhm_scale - 1.0, 1.0E-3 );
+    check_same_fit( joint[i], single[0], 0.0, 1.0, 1.0E-3 );
+    BOOST_CHECK_CLOSE( joint[i].chi2, single[0].chi2, 0.1 );
+  }
+  
+  // Its also the same data as the first detector, when mixed with other detectors
+  const shared_ptr<const SpecUtils::Measurement> other = make_detector( truth, 30.0, -0.1, &rng );
+  const vector<PeakFitLM::JointDetectorFit> mixed = PeakFitLM::fit_peaks_jointly( { detector, other }, peaks0 );
+  BOOST_REQUIRE_EQUAL( mixed.size(), 2 );
+  BOOST_CHECK_SMALL( mixed[0].peaks[0]->mean() - truth[0].mean, 0.1 );
+  BOOST_CHECK_SMALL( mixed[1].peaks[0]->mean() - truth[0].mean, 0.1 );
+}//BOOST_AUTO_TEST_CASE( DuplicatedDetectorsMatchSingleFit )
+
+
+BOOST_AUTO_TEST_CASE( InvalidInput )
+{
+  const vector<TruePeak> truth = { { 658.0, 1.10, 2.0E4 }, { 667.5, 1.16, 8.0E3 } };
+  const shared_ptr<const SpecUtils::Measurement> detector = make_detector( truth, 50.0, -0.2, nullptr );
+  const vector<shared_ptr<const PeakDef>> peaks0 = starting_peaks( truth );
+  
+  BOOST_CHECK_THROW( PeakFitLM::fit_peaks_jointly( {}, peaks0 ), std::exception );
+  BOOST_CHECK_THROW( PeakFitLM::fit_peaks_jointly( { detector }, {} ), std::exception );
+  BOOST_CHECK_THROW( PeakFitLM::fit_peaks_jointly( { detector, nullptr }, peaks0 ), std::exception );
+  
+  // Peaks that dont share a continuum
+  auto separate = make_shared<PeakDef>( *peaks0[1] );
+  separate->setContinuum( make_shared<PeakContinuum>( *peaks0[1]->continuum() ) );
+  BOOST_CHECK_THROW( PeakFitLM::fit_peaks_jointly( { detector }, { peaks0[0], separate } ), std::exception );
+}//BOOST_AUTO_TEST_CASE( InvalidInput )
@@ -0,0 +1,161 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <memory>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <numeric>
+#include <iostream>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE RebinMapping_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/RebinMapping.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+shared_ptr<const SpecUtils::EnergyCalibration> make_cal( const size_t nchannel, const vector<float> &coefs )
+{
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( nchannel, coefs, {} );
+  return cal;
+}//make_cal(...)
+
+
+vector<float> random_counts( const size_t nchannel, std::mt19937 &rng )
+{
+  std::uniform_real_distribution<float> dist( 0.0f, 1000.0f );
+  vector<float> counts( nchannel );
+  for( float &c : counts )
+    c = dist( rng );
+  return counts;
+}//random_counts(...)
+
+
+/** Checks RebinMapping gives the same answer as SpecUtils::rebin_by_lower_edge(...). */
+void check_matches_specutils( const shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                              const shared_ptr<const SpecUtils::EnergyCalibration> &new_cal,
+                              const vector<float> &counts )
+{
+  const vector<float> &orig_edges = *orig_cal->channel_energies();
+  const vector<float> &new_edges = *new_cal->channel_energies();
+  
+  vector<float> expected, from_mapping, from_cache;
+  SpecUtils::rebin_by_lower_edge( orig_edges, counts, new_edges, expected );
+  
+  const RebinMapping mapping( orig_edges, new_edges );
+  BOOST_CHECK_EQUAL( mapping.numInputChannels(), counts.size() );
+  BOOST_CHECK_EQUAL( mapping.numOutputChannels(), new_cal->num_channels() );
+  
+  mapping.rebin( counts, from_mapping );
+  RebinMapping::rebin( orig_cal, counts, new_cal, from_cache );
+  
+  BOOST_REQUIRE_EQUAL( from_mapping.size(), expected.size() );
+  BOOST_REQUIRE_EQUAL( from_cache.size(), expected.size() );
+  
+  const double max_count = *std::max_element( begin(counts), end(counts) );
+  for( size_t i = 0; i < expected.size(); ++i )
+  {
+    // Allow for float round-off, relative to the largest input channel, since summation order differs.
+    const double tolerance = 1.0E-4 * std::max( max_count, 1.0 );
+    BOOST_CHECK_MESSAGE( fabs(from_mapping[i] - expected[i]) <= tolerance,
+                         "Channel " << i << ": RebinMapping gave " << from_mapping[i]
+                         << ", rebin_by_lower_edge gave " << expected[i] );
+    BOOST_CHECK_EQUAL( from_cache[i], from_mapping[i] );
+  }
+}//check_matches_specutils(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( MatchesRebinByLowerEdge )
+{
+  std::mt19937 rng( 1234 );
+  
+  const auto linear_1k = make_cal( 1024, {0.0f, 3.0f} );
+  const auto linear_4k = make_cal( 4096, {0.0f, 0.75f} );
+  const auto offset_4k = make_cal( 4096, {5.1f, 0.7321f} );
+  const auto nonlinear_2k = make_cal( 2048, {2.0f, 1.45f, 2.1E-5f} );
+  const auto narrow_512 = make_cal( 512, {500.0f, 0.5f} );   //Covers only 500 to 756 keV
+  const auto wide_256 = make_cal( 256, {0.0f, 15.0f} );   //Extends past the upper end of the others
+  
+  const vector<shared_ptr<const SpecUtils::EnergyCalibration>> cals{
+    linear_1k, linear_4k, offset_4k, nonlinear_2k, narrow_512, wide_256
+  };
+  
+  for( const auto &orig_cal : cals )
+  {
+    const vector<float> counts = random_counts( orig_cal->num_channels(), rng );
+    for( const auto &new_cal : cals )
+      check_matches_specutils( orig_cal, new_cal, counts );
+  }
+  
+  // When the output covers the input, all counts should be kept.
+  const vector<float> counts = random_counts( linear_4k->num_channels(), rng );
+  vector<float> rebinned;
+  RebinMapping::rebin( linear_4k, counts, wide_256, rebinned );
+  const double orig_sum = std::accumulate( begin(counts), end(counts), 0.0 );
+  const double new_sum = std::accumulate( begin(rebinned), end(rebinned), 0.0 );
+  BOOST_CHECK_CLOSE( new_sum, orig_sum, 1.0E-3 );
+}//BOOST_AUTO_TEST_CASE( MatchesRebinByLowerEdge )
+
+
+BOOST_AUTO_TEST_CASE( MappingCacheAndErrors )
+{
+  const auto cal_a = make_cal( 1024, {0.0f, 3.0f} );
+  const auto cal_b = make_cal( 2048, {1.0f, 1.49f} );
+  
+  const shared_ptr<const RebinMapping> first = RebinMapping::mapping( cal_a, cal_b );
+  const shared_ptr<const RebinMapping> second = RebinMapping::mapping( cal_a, cal_b );
+  BOOST_REQUIRE( first );
+  BOOST_CHECK( first == second );
+  
+  const shared_ptr<const RebinMapping> reverse = RebinMapping::mapping( cal_b, cal_a );
+  BOOST_REQUIRE( reverse );
+  BOOST_CHECK( reverse != first );
+  BOOST_CHECK_EQUAL( reverse->numInputChannels(), 2048 );
+  BOOST_CHECK_EQUAL( reverse->numOutputChannels(), 1024 );
+  
+  vector<float> output;
+  BOOST_CHECK_THROW( first->rebin( vector<float>(1000, 1.0f), output ), std::exception );
+  
+  const vector<float> one_channel{ 0.0f, 1.0f }, decreasing{ 0.0f, 2.0f, 1.0f }, valid{ 0.0f, 1.0f, 2.0f };
+  BOOST_CHECK_THROW( const RebinMapping bad( one_channel, valid ), std::exception );
+  BOOST_CHECK_THROW( const RebinMapping bad( valid, one_channel ), std::exception );
+  BOOST_CHECK_THROW( const RebinMapping bad( decreasing, valid ), std::exception );
+  
+  auto invalid_cal = make_shared<SpecUtils::EnergyCalibration>();
+  BOOST_CHECK_THROW( RebinMapping::mapping( invalid_cal, cal_a ), std::exception );
+}//BOOST_AUTO_TEST_CASE( MappingCacheAndErrors )
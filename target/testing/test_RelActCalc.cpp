@@ -0,0 +1,525 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#ifdef _WIN32
+// For some reason, we need to include the following includes, before unit_test.hpp,
+//  or we get a bunch of errors relating to winsock.k being included multiple times,
+//  or something
+#include "winsock2.h"
+#include "Windows.h"
+#endif
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE RelActCalc_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/Filesystem.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include <Eigen/Dense>
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/InterSpec.h"
+#include "InterSpec/RelActCalc.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/RelActCalcAuto.h"
+#include "InterSpec/RelActCalcManual.h"
+#include "InterSpec/DecayDataBaseServer.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+// We need to set the static data directory, so the code knows where
+//  like sandia.decay.xml is located.
+void set_data_dir()
+{
+  // We only need to initialize things once
+  static bool s_have_set = false;
+  if( s_have_set )
+    return;
+  
+  s_have_set = true;
+  
+  int argc = boost::unit_test::framework::master_test_suite().argc;
+  char **argv = boost::unit_test::framework::master_test_suite().argv;
+  
+  string datadir;
+  
+  for( int i = 1; i < argc; ++i )
+  {
+    const string arg = argv[i];
+    if( SpecUtils::istarts_with( arg, "--datadir=" ) )
+      datadir = arg.substr( 10 );
+  }//for( int arg = 1; arg < argc; ++ arg )
+  
+  SpecUtils::ireplace_all( datadir, "%20", " " );
+  
+  // Search around a little for the data directory, if it wasnt specified
+  if( datadir.empty() )
+  {
+    for( const auto &d : { "data", "../data", "../../data", "../../../data", "/Users/wcjohns/rad_ana/InterSpec/data" } )
+    {
+      if( SpecUtils::is_file( SpecUtils::append_path(d, "sandia.decay.xml") ) )
+      {
+        datadir = d;
+        break;
+      }
+    }//for( loop over candidate dirs )
+  }//if( datadir.empty() )
+  
+  const string sandia_deacay_file = SpecUtils::append_path(datadir, "sandia.decay.xml");
+  BOOST_REQUIRE_MESSAGE( SpecUtils::is_file( sandia_deacay_file ), "sandia.decay.xml not at '" << sandia_deacay_file << "'" );
+  
+  BOOST_REQUIRE_NO_THROW( InterSpec::setStaticDataDirectory( datadir ) );
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE_MESSAGE( db, "Error initing SandiaDecayDataBase" );
+  BOOST_REQUIRE_MESSAGE( db->nuclide("U238"), "SandiaDecayDataBase empty?" );
+}//void set_data_dir()
+
+
+/** A source to put in the synthetic spectrum. */
+struct SyntheticSource
+{
+  const SandiaDecay::Nuclide *nuclide = nullptr;
+  double activity = 0.0;
+  double age = 0.0;
+};//struct SyntheticSource
+
+
+/** A noise-free synthetic spectrum, along with the peaks in it. */
+struct SyntheticInput
+{
+  shared_ptr<SpecUtils::Measurement> foreground;
+  vector<shared_ptr<const PeakDef>> peaks;
+};//struct SyntheticInput
+
+
+/** Makes a noise-free spectrum, for a 100% efficient (flat efficiency) detector, so the true
+ relative efficiency is flat and the true activity ratios are the input ones.
+ The FWHM is `sqrt( 1.0 + 2.0*E_MeV )`, so about 1.5 keV at 662 keV, and a flat continuum is added.
+ */
+SyntheticInput make_synthetic_input( const vector<SyntheticSource> &sources,
+                                     const double live_time,
+                                     const double continuum_counts_per_channel )
+{
+  const size_t nchannel = 4096;
+  const float max_energy = 3000.0f;
+  
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( nchannel, {0.0f, max_energy/nchannel}, {} );
+  const vector<float> &energies = *cal->channel_energies();
+  
+  vector<double> channel_counts( nchannel, continuum_counts_per_channel );
+  
+  SyntheticInput input;
+  
+  for( const SyntheticSource &src : sources )
+  {
+    SandiaDecay::NuclideMixture mixture;
+    mixture.addAgedNuclideByActivity( src.nuclide, src.activity, src.age );
+    
+    for( const SandiaDecay::EnergyRatePair &gamma : mixture.photons( 0.0, SandiaDecay::NuclideMixture::OrderByEnergy ) )
+    {
+      const double area = gamma.numPerSecond * live_time;
+      if( (gamma.energy < 50.0) || (gamma.energy > 0.95*max_energy) || (area < 1.0) )
+        continue;
+      
+      const double fwhm = sqrt( 1.0 + 2.0*gamma.energy/1000.0 );
+      auto peak = make_shared<PeakDef>( gamma.energy, fwhm/2.35482, area );
+      peak->gauss_integral( &(energies[0]), &(channel_counts[0]), nchannel );
+      
+      if( area > 1000.0 )
+      {
+        peak->setPeakAreaUncert( sqrt(area) );
+        input.peaks.push_back( peak );
+      }
+    }//for( loop over photons )
+  }//for( const SyntheticSource &src : sources )
+  
+  auto counts = make_shared<vector<float>>( channel_counts.begin(), channel_counts.end() );
+  
+  input.foreground = make_shared<SpecUtils::Measurement>();
+  input.foreground->set_gamma_counts( counts, static_cast<float>(live_time), static_cast<float>(live_time) );
+  input.foreground->set_energy_calibration( cal );
+  
+  std::sort( begin(input.peaks), end(input.peaks), &PeakDef::lessThanByMeanShrdPtr );
+  
+  return input;
+}//make_synthetic_input(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( MultiSpectrumSolveMatchesSingle )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  const SandiaDecay::Nuclide * const ba133 = db->nuclide( "Ba133" );
+  const SandiaDecay::Nuclide * const cs137 = db->nuclide( "Cs137" );
+  BOOST_REQUIRE( ba133 && cs137 );
+  
+  vector<SyntheticSource> sources( 2 );
+  sources[0].nuclide = ba133;
+  sources[0].activity = 100.0*PhysicalUnits::bq;
+  sources[0].age = PeakDef::defaultDecayTime( ba133 );
+  sources[1].nuclide = cs137;
+  sources[1].activity = 50.0*PhysicalUnits::bq;
+  sources[1].age = PeakDef::defaultDecayTime( cs137 );
+  
+  const SyntheticInput input = make_synthetic_input( sources, 3000.0*PhysicalUnits::second, 10.0 );
+  BOOST_REQUIRE( input.peaks.size() >= 3 );
+  
+  RelActCalcAuto::Options options;
+  options.fit_energy_cal = false;
+  options.rel_eff_eqn_order = 1;
+  options.fwhm_form = RelActCalcAuto::FwhmForm::Polynomial_2;
+  
+  vector<RelActCalcAuto::RoiRange> rois( 2 );
+  rois[0].lower_energy = 260.0;
+  rois[0].upper_energy = 400.0;
+  rois[0].continuum_type = PeakContinuum::OffsetType::Linear;
+  rois[0].force_full_range = true;
+  rois[1].lower_energy = 640.0;
+  rois[1].upper_energy = 680.0;
+  rois[1].continuum_type = PeakContinuum::OffsetType::Linear;
+  rois[1].force_full_range = true;
+  
+  vector<RelActCalcAuto::NucInputInfo> nuclides( 2 );
+  for( size_t i = 0; i < sources.size(); ++i )
+  {
+    nuclides[i].nuclide = sources[i].nuclide;
+    nuclides[i].age = sources[i].age;
+    nuclides[i].fit_age = false;
+  }
+  
+  const double true_ratio = sources[1].activity / sources[0].activity;
+  
+  const RelActCalcAuto::RelActAutoSolution single
+             = RelActCalcAuto::solve( options, rois, nuclides, {}, input.foreground,
+                                      nullptr, nullptr, input.peaks );
+  BOOST_REQUIRE_MESSAGE( single.m_status == RelActCalcAuto::RelActAutoSolution::Status::Success,
+                         "Single spectrum solve failed: " << single.m_error_message );
+  
+  const double single_ratio = single.activity_ratio( cs137, ba133 );
+  BOOST_CHECK_MESSAGE( fabs(single_ratio - true_ratio) < 0.01*true_ratio,
+                       "Single spectrum Cs137/Ba133 activity ratio " << single_ratio
+                       << " didnt match truth " << true_ratio );
+  
+  // Two copies of the same spectrum are fit jointly; the shared relative activities must come out
+  //  the same as fitting the one spectrum by itself.
+  RelActCalcAuto::SpectrumInput spec_input;
+  spec_input.foreground = input.foreground;
+  spec_input.all_peaks = input.peaks;
+  
+  const vector<RelActCalcAuto::SpectrumInput> spectra( 2, spec_input );
+  
+  vector<RelActCalcAuto::RelActAutoSolution> joint;
+  BOOST_REQUIRE_NO_THROW( joint = RelActCalcAuto::solve( options, rois, nuclides, {}, spectra ) );
+  BOOST_REQUIRE_EQUAL( joint.size(), spectra.size() );
+  
+  for( size_t i = 0; i < joint.size(); ++i )
+  {
+    const RelActCalcAuto::RelActAutoSolution &sol = joint[i];
+    BOOST_REQUIRE_MESSAGE( sol.m_status == RelActCalcAuto::RelActAutoSolution::Status::Success,
+                           "Joint solve of spectrum " << i << " failed: " << sol.m_error_message );
+    
+    const double joint_ratio = sol.activity_ratio( cs137, ba133 );
+    BOOST_CHECK_MESSAGE( fabs(joint_ratio - single_ratio) < 1.0E-3*single_ratio,
+                         "Joint fit Cs137/Ba133 activity ratio " << joint_ratio << " for spectrum "
+                         << i << " didnt match single spectrum fit " << single_ratio );
+    
+    // Each solution reports the chi2 of only its own spectrum
+    BOOST_CHECK_MESSAGE( fabs(sol.m_chi2 - single.m_chi2) <= 0.01*std::max(1.0, single.m_chi2),
+                         "Joint fit chi2 " << sol.m_chi2 << " for spectrum " << i
+                         << " didnt match single spectrum fit chi2 " << single.m_chi2 );
+  }//for( size_t i = 0; i < joint.size(); ++i )
+}//BOOST_AUTO_TEST_CASE( MultiSpectrumSolveMatchesSingle )
+
+
+// The covariance of the relative efficiency fit must be accurate even when A^T*A is too poorly
+//  conditioned to invert accurately; we compare it to an extended precision SVD of the same system.
+BOOST_AUTO_TEST_CASE( RelEffLlsCovariance )
+{
+  const size_t order = 6;
+  const size_t num_points = 16;
+  const vector<double> true_coefs{ 0.5, -0.2, 0.03, 0.001, -0.0002, 0.00001, -0.0000005 };
+  
+  vector<double> energies, values, uncerts;
+  for( size_t i = 0; i < num_points; ++i )
+  {
+    const double energy = 50.0 * pow( 3000.0/50.0, i/(num_points - 1.0) );
+    energies.push_back( energy );
+    values.push_back( RelActCalc::eval_eqn( energy, RelActCalc::RelEffEqnForm::LnX, true_coefs ) );
+    uncerts.push_back( 0.01*(1.0 + 0.1*i) );
+  }
+  
+  vector<double> fit_pars;
+  vector<vector<double>> covariance;
+  RelActCalcManual::fit_rel_eff_eqn_lls( RelActCalc::RelEffEqnForm::LnX, order, energies, values,
+                                         uncerts, fit_pars, &covariance );
+  
+  BOOST_REQUIRE_EQUAL( fit_pars.size(), order + 1 );
+  BOOST_REQUIRE_EQUAL( covariance.size(), order + 1 );
+  for( size_t i = 0; i < num_points; ++i )
+  {
+    const double fit_value = RelActCalc::eval_eqn( energies[i], RelActCalc::RelEffEqnForm::LnX, fit_pars );
+    BOOST_CHECK_CLOSE( fit_value, values[i], 1.0E-4 );
+  }
+  
+  // Reference covariance, (A^T*A)^-1, from a long double SVD of the same weighted design matrix.
+  typedef Eigen::Matrix<long double,Eigen::Dynamic,Eigen::Dynamic> MatrixLD;
+  typedef Eigen::Matrix<long double,Eigen::Dynamic,1> VectorLD;
+  
+  MatrixLD A( num_points, order + 1 );
+  for( size_t row = 0; row < num_points; ++row )
+  {
+    for( size_t col = 0; col <= order; ++col )
+      A(row,col) = std::pow( std::log( static_cast<long double>(energies[row]) ), static_cast<long double>(col) )
+                   / static_cast<long double>( uncerts[row] );
+  }
+  
+  const Eigen::JacobiSVD<MatrixLD> svd( A, Eigen::ComputeThinU | Eigen::ComputeThinV );
+  VectorLD inv_sq_sing_vals = svd.singularValues();
+  for( Eigen::Index i = 0; i < inv_sq_sing_vals.size(); ++i )
+    inv_sq_sing_vals(i) = 1.0L / (inv_sq_sing_vals(i) * inv_sq_sing_vals(i));
+  const MatrixLD ref_cov = svd.matrixV() * inv_sq_sing_vals.asDiagonal() * svd.matrixV().transpose();
+  
+  // Forming and inverting A^T*A for this system gives errors around 1E-5 (relative to the
+  //  coefficient uncertainties); using the SVD directly gives around 1E-10.
+  for( size_t i = 0; i <= order; ++i )
+  {
+    BOOST_REQUIRE_EQUAL( covariance[i].size(), order + 1 );
+    for( size_t j = 0; j <= order; ++j )
+    {
+      const double ref = static_cast<double>( ref_cov(i,j) );
+      const double scale = std::sqrt( static_cast<double>( ref_cov(i,i) * ref_cov(j,j) ) );
+      BOOST_CHECK_MESSAGE( fabs(covariance[i][j] - ref) <= 1.0E-8*scale,
+                           "Covariance[" << i << "][" << j << "]=" << covariance[i][j]
+                           << " differs from reference " << ref );
+    }
+  }//for( size_t i = 0; i <= order; ++i )
+}//BOOST_AUTO_TEST_CASE( RelEffLlsCovariance )
+
+
+// eval_eqn_uncertainty must only use the covariance elements; to catch reading past the end of each
+//  row, we leave a huge value in each rows memory, just past its last element.
+BOOST_AUTO_TEST_CASE( RelEffEqnUncertainty )
+{
+  const vector<vector<double>> cov_values{
+    {  0.04,   -0.01,    0.001  },
+    { -0.01,    0.005,  -0.0004 },
+    {  0.001,  -0.0004,  0.00005 }
+  };
+  
+  vector<vector<double>> covariance( cov_values.size() );
+  for( size_t i = 0; i < cov_values.size(); ++i )
+  {
+    covariance[i].reserve( cov_values[i].size() + 1 );
+    covariance[i] = cov_values[i];
+    covariance[i].push_back( 1.0E30 );
+    covariance[i].pop_back();
+  }
+  
+  const vector<double> energies{ 59.5, 122.1, 185.7, 344.3, 661.7, 1001.0, 1332.5, 2614.5 };
+  
+  const RelActCalc::RelEffEqnForm forms[] = {
+    RelActCalc::RelEffEqnForm::LnX, RelActCalc::RelEffEqnForm::LnY, RelActCalc::RelEffEqnForm::LnXLnY
+  };
+  
+  for( const RelActCalc::RelEffEqnForm form : forms )
+  {
+    const vector<double> batch = RelActCalc::eval_eqn_uncertainty( energies, form, covariance );
+    BOOST_REQUIRE_EQUAL( batch.size(), energies.size() );
+    
+    for( size_t e = 0; e < energies.size(); ++e )
+    {
+      const double energy = energies[e];
+      
+      double terms[3];
+      for( size_t i = 0; i < 3; ++i )
+      {
+        if( form == RelActCalc::RelEffEqnForm::LnY )
+          terms[i] = (i == 0) ? 1.0 : ((i == 1) ? energy : std::pow(energy, 1.0 - i));
+        else
+          terms[i] = std::pow( std::log(energy), static_cast<double>(i) );
+      }
+      
+      double var = 0.0;
+      for( size_t i = 0; i < 3; ++i )
+        for( size_t j = 0; j < 3; ++j )
+          var += terms[i] * cov_values[i][j] * terms[j];
+      
+      const double expected = (form == RelActCalc::RelEffEqnForm::LnX) ? sqrt(var) : exp(sqrt(var));
+      const double single = RelActCalc::eval_eqn_uncertainty( energy, form, covariance );
+      
+      BOOST_CHECK_CLOSE( single, expected, 1.0E-8 );
+      BOOST_CHECK_CLOSE( batch[e], single, 1.0E-10 );
+    }//for( size_t e = 0; e < energies.size(); ++e )
+  }//for( const RelActCalc::RelEffEqnForm form : forms )
+}//BOOST_AUTO_TEST_CASE( RelEffEqnUncertainty )
+
+
+// RelActAutoSolution::mass_enrichment_fractions() must agree with mass_enrichment_fraction(...) for
+//  every nuclide, including Am241 when Am243 is also present, and with and without a Pu242 correction.
+BOOST_AUTO_TEST_CASE( MassEnrichmentFractions )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  const vector<pair<string,double>> nuc_acts{
+    { "Pu238", 1.2E3 }, { "Pu239", 2.1E3 }, { "Pu240", 1.4E3 }, { "Pu241", 5.0E4 },
+    { "Am241", 3.0E3 }, { "Am243", 40.0 }, { "U235", 7.0 }, { "U238", 2.0 }
+  };
+  
+  RelActCalcAuto::RelActAutoSolution solution;
+  map<string,double> rel_masses;
+  for( const auto &nuc_act : nuc_acts )
+  {
+    const SandiaDecay::Nuclide * const nuc = db->nuclide( nuc_act.first );
+    BOOST_REQUIRE( nuc );
+    
+    RelActCalcAuto::NuclideRelAct rel_act;
+    rel_act.nuclide = nuc;
+    rel_act.age = 0.0;
+    rel_act.age_uncertainty = 0.0;
+    rel_act.age_was_fit = false;
+    rel_act.rel_activity = nuc_act.second;
+    rel_act.rel_activity_uncertainty = 0.0;
+    solution.m_rel_activities.push_back( rel_act );
+    
+    rel_masses[nuc_act.first] = nuc_act.second / nuc->activityPerGram();
+  }//for( const auto &nuc_act : nuc_acts )
+  
+  const auto check_consistent = [&solution](){
+    const vector<double> fractions = solution.mass_enrichment_fractions();
+    BOOST_REQUIRE_EQUAL( fractions.size(), solution.m_rel_activities.size() );
+    for( size_t i = 0; i < fractions.size(); ++i )
+    {
+      const SandiaDecay::Nuclide * const nuc = solution.m_rel_activities[i].nuclide;
+      const double single = solution.mass_enrichment_fraction( nuc );
+      BOOST_CHECK_MESSAGE( fabs(fractions[i] - single) <= 1.0E-12*std::max(1.0, fabs(single)),
+                           nuc->symbol << ": mass_enrichment_fractions() gave " << fractions[i]
+                           << ", while mass_enrichment_fraction() gave " << single );
+    }
+  };//check_consistent
+  
+  // Without a Pu242 correction
+  check_consistent();
+  
+  const double pu_mass = rel_masses["Pu238"] + rel_masses["Pu239"] + rel_masses["Pu240"]
+                         + rel_masses["Pu241"] + rel_masses["Am241"];
+  const vector<double> fractions = solution.mass_enrichment_fractions();
+  BOOST_CHECK_CLOSE( fractions[1], rel_masses["Pu239"] / pu_mass, 1.0E-8 );
+  BOOST_CHECK_CLOSE( fractions[4], rel_masses["Am241"] / (pu_mass + rel_masses["Am243"]), 1.0E-8 );
+  BOOST_CHECK_CLOSE( fractions[5], rel_masses["Am243"] / (rel_masses["Am241"] + rel_masses["Am243"]), 1.0E-8 );
+  BOOST_CHECK_CLOSE( fractions[6], rel_masses["U235"] / (rel_masses["U235"] + rel_masses["U238"]), 1.0E-8 );
+  
+  // With a Pu242 correction
+  auto corrected = make_shared<RelActCalc::Pu242ByCorrelationOutput>();
+  corrected->pu238_mass_frac = 0.01f;
+  corrected->pu239_mass_frac = 0.62f;
+  corrected->pu240_mass_frac = 0.25f;
+  corrected->pu241_mass_frac = 0.06f;
+  corrected->am241_mass_frac = 0.02f;
+  corrected->pu242_mass_frac = 0.04f;
+  corrected->is_within_range = true;
+  corrected->pu242_uncert = 0.1f;
+  solution.m_corrected_pu = corrected;
+  
+  check_consistent();
+  BOOST_CHECK_CLOSE( solution.mass_enrichment_fractions()[1], 0.62, 1.0E-4 );
+}//BOOST_AUTO_TEST_CASE( MassEnrichmentFractions )
+
+
+// The activity ratio of Pu242, which comes from the correlation correction, to another nuclide
+BOOST_AUTO_TEST_CASE( Pu242ActivityRatio )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  const SandiaDecay::Nuclide * const pu239 = db->nuclide( "Pu239" );
+  const SandiaDecay::Nuclide * const pu240 = db->nuclide( "Pu240" );
+  const SandiaDecay::Nuclide * const pu242 = db->nuclide( "Pu242" );
+  BOOST_REQUIRE( pu239 && pu240 && pu242 );
+  
+  RelActCalcAuto::RelActAutoSolution solution;
+  for( const auto &nuc_act : vector<pair<const SandiaDecay::Nuclide *,double>>{ {pu239, 2.1E3}, {pu240, 1.4E3} } )
+  {
+    RelActCalcAuto::NuclideRelAct rel_act;
+    rel_act.nuclide = nuc_act.first;
+    rel_act.age = 0.0;
+    rel_act.age_uncertainty = 0.0;
+    rel_act.age_was_fit = false;
+    rel_act.rel_activity = nuc_act.second;
+    rel_act.rel_activity_uncertainty = 0.0;
+    solution.m_rel_activities.push_back( rel_act );
+  }
+  
+  auto corrected = make_shared<RelActCalc::Pu242ByCorrelationOutput>();
+  corrected->pu238_mass_frac = 0.01f;
+  corrected->pu239_mass_frac = 0.62f;
+  corrected->pu240_mass_frac = 0.25f;
+  corrected->pu241_mass_frac = 0.06f;
+  corrected->am241_mass_frac = 0.02f;
+  corrected->pu242_mass_frac = 0.04f;
+  corrected->is_within_range = true;
+  corrected->pu242_uncert = 0.1f;
+  solution.m_corrected_pu = corrected;
+  
+  // Pu242 activity is taken as raw_pu239 * corr_pu242_act / corr_pu239_act
+  const double corr_pu239_act = pu239->activityPerGram() * corrected->pu239_mass_frac;
+  const double corr_pu242_act = pu242->activityPerGram() * corrected->pu242_mass_frac;
+  const double pu242_act = 2.1E3 * corr_pu242_act / corr_pu239_act;
+  
+  BOOST_CHECK_CLOSE( solution.activity_ratio( pu242, pu239 ), corr_pu242_act / corr_pu239_act, 1.0E-6 );
+  BOOST_CHECK_CLOSE( solution.activity_ratio( pu242, pu240 ), pu242_act / 1.4E3, 1.0E-6 );
+  BOOST_CHECK_CLOSE( solution.activity_ratio( pu240, pu242 ), 1.4E3 / pu242_act, 1.0E-6 );
+  
+  // The mass ratio of Pu242 to Pu239 should then be the corrected mass fraction ratio
+  BOOST_CHECK_CLOSE( solution.mass_ratio( pu242, pu239 ), 0.04 / 0.62, 1.0E-4 );
+}//BOOST_AUTO_TEST_CASE( Pu242ActivityRatio )
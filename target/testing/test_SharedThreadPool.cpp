@@ -0,0 +1,172 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <numeric>
+#include <iostream>
+#include <stdexcept>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE SharedThreadPool_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "InterSpec/SharedThreadPool.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+/** Some arbitrary, deterministic, work for a single index. */
+double work_for_index( const size_t index )
+{
+  double answer = 0.0;
+  for( size_t i = 0; i < 1000; ++i )
+    answer += std::sqrt( static_cast<double>(index*1000 + i) ) * std::sin( 0.001*i );
+  return answer;
+}//work_for_index(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( MatchesSerialLoop )
+{
+  BOOST_CHECK_GE( SharedThreadPool::available_cpu_count(), 1 );
+  BOOST_CHECK_GE( SharedThreadPool::num_workers(), 1 );
+  
+  const size_t num_items = 2000;
+  
+  vector<double> serial( num_items );
+  for( size_t i = 0; i < num_items; ++i )
+    serial[i] = work_for_index( i );
+  
+  vector<double> parallel( num_items, 0.0 );
+  SharedThreadPool::TaskGroup group;
+  for( size_t i = 0; i < num_items; ++i )
+    group.post( [i,&parallel](){ parallel[i] = work_for_index( i ); } );
+  group.join();
+  
+  for( size_t i = 0; i < num_items; ++i )
+    BOOST_CHECK_EQUAL( parallel[i], serial[i] );
+  
+  // A group may be reused after joining
+  vector<double> second( num_items, 0.0 );
+  for( size_t i = 0; i < num_items; ++i )
+    group.post( [i,&second](){ second[i] = work_for_index( i ); } );
+  group.join();
+  
+  BOOST_CHECK( second == serial );
+  
+  // Joining an empty group returns right away
+  SharedThreadPool::TaskGroup empty_group;
+  BOOST_CHECK_NO_THROW( empty_group.join() );
+}//BOOST_AUTO_TEST_CASE( MatchesSerialLoop )
+
+
+// Tasks that create and join their own TaskGroups must not deadlock, even with more outer tasks
+//  than there are workers, and must give the same answer as the serial loop.
+BOOST_AUTO_TEST_CASE( NestedGroups )
+{
+  const size_t num_outer = 4*SharedThreadPool::num_workers() + 3;
+  const size_t num_inner = 50;
+  
+  vector<double> serial( num_outer, 0.0 );
+  for( size_t i = 0; i < num_outer; ++i )
+    for( size_t j = 0; j < num_inner; ++j )
+      serial[i] += work_for_index( i*num_inner + j );
+  
+  vector<double> parallel( num_outer, 0.0 );
+  SharedThreadPool::TaskGroup outer;
+  for( size_t i = 0; i < num_outer; ++i )
+  {
+    outer.post( [i,num_inner,&parallel](){
+      vector<double> values( num_inner, 0.0 );
+      SharedThreadPool::TaskGroup inner;
+      for( size_t j = 0; j < num_inner; ++j )
+        inner.post( [i,j,num_inner,&values](){ values[j] = work_for_index( i*num_inner + j ); } );
+      inner.join();
+      
+      // Sum in the same order as the serial loop, so the answer is bit-for-bit the same
+      double sum = 0.0;
+      for( const double v : values )
+        sum += v;
+      parallel[i] = sum;
+    } );
+  }//for( size_t i = 0; i < num_outer; ++i )
+  outer.join();
+  
+  for( size_t i = 0; i < num_outer; ++i )
+    BOOST_CHECK_EQUAL( parallel[i], serial[i] );
+}//BOOST_AUTO_TEST_CASE( NestedGroups )
+
+
+// join() re-throws a tasks exception, but only after all the other tasks have finished.
+BOOST_AUTO_TEST_CASE( ExceptionsAndDestructor )
+{
+  const size_t num_tasks = 200;
+  
+  std::atomic<size_t> num_completed( 0 );
+  SharedThreadPool::TaskGroup group;
+  for( size_t i = 0; i < num_tasks; ++i )
+  {
+    group.post( [i,&num_completed](){
+      if( (i % 50) == 7 )
+        throw std::runtime_error( "Task " + std::to_string(i) + " failed" );
+      work_for_index( i );
+      ++num_completed;
+    } );
+  }//for( size_t i = 0; i < num_tasks; ++i )
+  
+  BOOST_CHECK_THROW( group.join(), std::runtime_error );
+  BOOST_CHECK_EQUAL( num_completed.load(), num_tasks - 4 );
+  
+  // The group is usable again after an exception.
+  std::atomic<size_t> num_after( 0 );
+  for( size_t i = 0; i < 10; ++i )
+    group.post( [&num_after](){ ++num_after; } );
+  BOOST_CHECK_NO_THROW( group.join() );
+  BOOST_CHECK_EQUAL( num_after.load(), 10 );
+  
+  // The destructor waits for outstanding tasks, and discards their exceptions.
+  std::atomic<size_t> num_destructed( 0 );
+  {
+    SharedThreadPool::TaskGroup unjoined;
+    for( size_t i = 0; i < 100; ++i )
+    {
+      unjoined.post( [i,&num_destructed](){
+        work_for_index( i );
+        ++num_destructed;
+        if( i == 3 )
+          throw std::runtime_error( "discarded" );
+      } );
+    }
+  }
+  BOOST_CHECK_EQUAL( num_destructed.load(), 100 );
+}//BOOST_AUTO_TEST_CASE( ExceptionsAndDestructor )
@@ -22,7 +22,10 @@
  */
 #include "InterSpec_config.h"
 
+#include <array>
+#include <tuple>
 #include <string>
+#include <vector>
 #include <iostream>
 
 #include <Wt/Utils>
@@ -47,8 +50,14 @@
 //Roots Minuit2 includes
 #include "Minuit2/MnUserParameters.h"
 #include "Minuit2/MnUserParameterState.h"
+#include "Minuit2/MnMinos.h"
+#include "Minuit2/MnMinimize.h"
+#include "Minuit2/MinosError.h"
+#include "Minuit2/FunctionMinimum.h"
 
 
+#include "SandiaDecay/SandiaDecay.h"
+
 #include "SpecUtils/StringAlgo.h"
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/RapidXmlUtils.hpp"
@@ -513,6 +522,382 @@ BOOST_AUTO_TEST_CASE( SimpleSourceFit )
 }//BOOST_AUTO_TEST_CASE( SimpleSourceFit )
 
 
+// Integrating all the energies of a self-attenuating source as components of a single integrand
+//  must give the same answer as integrating each energy by itself.
+BOOST_AUTO_TEST_CASE( MultiEnergySelfAttenIntegral )
+{
+  set_data_dir();
+  
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  MaterialDB matdb;
+  const string materialfile = SpecUtils::append_path( InterSpec::staticDataDirectory(), "MaterialDataBase.txt" );
+  BOOST_REQUIRE_NO_THROW( matdb.parseGadrasMaterialFile( materialfile, db, false ) );
+  
+  const Material * const uranium = matdb.material( "U (uranium)" );
+  const Material * const iron = matdb.material( "Fe (iron)" );
+  const Material * const air = matdb.material( "Air" );
+  BOOST_REQUIRE( uranium && iron && air );
+  
+  const vector<float> energies{ 143.76f, 163.36f, 185.72f, 205.31f, 766.36f, 1001.03f };
+  
+  const GammaInteractionCalc::GeometryType geometries[] = {
+    GammaInteractionCalc::GeometryType::Spherical,
+    GammaInteractionCalc::GeometryType::CylinderEndOn,
+    GammaInteractionCalc::GeometryType::CylinderSideOn,
+    GammaInteractionCalc::GeometryType::Rectangular
+  };
+  
+  for( const GammaInteractionCalc::GeometryType geom : geometries )
+  {
+    // The source is the inner uranium volume, surrounded by iron.
+    array<double,3> src_dims{ 1.0*PhysicalUnits::cm, 0.0, 0.0 };
+    array<double,3> shield_dims{ 1.5*PhysicalUnits::cm, 0.0, 0.0 };
+    switch( geom )
+    {
+      case GammaInteractionCalc::GeometryType::Spherical:
+        break;
+      
+      case GammaInteractionCalc::GeometryType::CylinderEndOn:
+      case GammaInteractionCalc::GeometryType::CylinderSideOn:
+        src_dims[1] = 2.0*PhysicalUnits::cm;
+        shield_dims[1] = 2.5*PhysicalUnits::cm;
+        break;
+        
+      case GammaInteractionCalc::GeometryType::Rectangular:
+        src_dims = { 1.0*PhysicalUnits::cm, 1.5*PhysicalUnits::cm, 0.5*PhysicalUnits::cm };
+        shield_dims = { 1.5*PhysicalUnits::cm, 2.0*PhysicalUnits::cm, 1.0*PhysicalUnits::cm };
+        break;
+        
+      case GammaInteractionCalc::GeometryType::NumGeometryType:
+        BOOST_REQUIRE( false );
+        break;
+    }//switch( geom )
+    
+    vector<GammaInteractionCalc::DistributedSrcCalc> calcs( energies.size() );
+    for( size_t i = 0; i < energies.size(); ++i )
+    {
+      GammaInteractionCalc::DistributedSrcCalc &calc = calcs[i];
+      calc.m_geometry = geom;
+      calc.m_sourceIndex = 0;
+      calc.m_detectorRadius = 2.0*PhysicalUnits::cm;
+      calc.m_observationDist = 50.0*PhysicalUnits::cm;
+      calc.m_attenuateForAir = true;
+      calc.m_airTransLenCoef = GammaInteractionCalc::transmition_length_coefficient( air, energies[i] );
+      calc.m_srcVolumetricActivity = 1.0;
+      calc.m_energy = energies[i];
+      
+      const double u_coef = GammaInteractionCalc::transmition_length_coefficient( uranium, energies[i] );
+      const double fe_coef = GammaInteractionCalc::transmition_length_coefficient( iron, energies[i] );
+      calc.m_dimensionsTransLenAndType.push_back( std::make_tuple( src_dims, u_coef,
+                                          GammaInteractionCalc::DistributedSrcCalc::ShellType::Material ) );
+      calc.m_dimensionsTransLenAndType.push_back( std::make_tuple( shield_dims, fe_coef,
+                                          GammaInteractionCalc::DistributedSrcCalc::ShellType::Material ) );
+    }//for( size_t i = 0; i < energies.size(); ++i )
+    
+    // First integrate each energy by itself
+    vector<double> single_integrals( energies.size(), 0.0 );
+    for( size_t i = 0; i < calcs.size(); ++i )
+    {
+      GammaInteractionCalc::DistributedSrcCalc calc = calcs[i];
+      GammaInteractionCalc::ShieldingSourceChi2Fcn::selfShieldingIntegration( calc );
+      single_integrals[i] = calc.integral;
+      BOOST_REQUIRE_MESSAGE( calc.integral > 0.0, "Single energy integral failed for "
+                             << GammaInteractionCalc::to_str(geom) << " at " << energies[i] << " keV" );
+    }
+    
+    // Then all the energies as extra components of the first energies integrand
+    GammaInteractionCalc::DistributedSrcCalc primary = calcs[0];
+    for( size_t i = 1; i < calcs.size(); ++i )
+    {
+      for( const auto &layer : calcs[i].m_dimensionsTransLenAndType )
+        primary.m_componentTransLenCoefs.push_back( std::get<1>(layer) );
+      primary.m_componentTransLenCoefs.push_back( calcs[i].m_airTransLenCoef );
+    }
+    
+    GammaInteractionCalc::ShieldingSourceChi2Fcn::selfShieldingIntegration( primary );
+    BOOST_REQUIRE_EQUAL( primary.m_componentIntegrals.size(), energies.size() - 1 );
+    
+    for( size_t i = 0; i < energies.size(); ++i )
+    {
+      const double multi = (i == 0) ? primary.integral : primary.m_componentIntegrals[i-1];
+      const double single = single_integrals[i];
+      
+      // Cuhre is asked for a relative accuracy of 1E-4, but the multi-component integral may
+      //  subdivide the regions differently, so allow a little slop.
+      BOOST_CHECK_MESSAGE( fabs(multi - single) < 1.0E-3*single,
+                           "Multi-component integral (" << multi << ") for "
+                           << GammaInteractionCalc::to_str(geom) << " at " << energies[i]
+                           << " keV didnt match single energy integral (" << single << ")" );
+    }//for( size_t i = 0; i < energies.size(); ++i )
+  }//for( const GammaInteractionCalc::GeometryType geom : geometries )
+}//BOOST_AUTO_TEST_CASE( MultiEnergySelfAttenIntegral )
+
+
+/** Returns a peak, with the given area, attributed to the `nuclide` gamma at `energy`, to use in
+ a shielding/source fit.
+ */
+std::shared_ptr<PeakDef> make_source_peak( const SandiaDecay::Nuclide *nuclide,
+                                           const double energy, const double area )
+{
+  const SandiaDecay::Transition *transition = nullptr;
+  int radParticle = -1;
+  
+  for( size_t i = 0; !transition && (i < nuclide->decaysToChildren.size()); ++i )
+  {
+    const SandiaDecay::Transition *trans = nuclide->decaysToChildren[i];
+    for( size_t j = 0; !transition && (j < trans->products.size()); ++j )
+    {
+      if( (trans->products[j].type == SandiaDecay::GammaParticle)
+         && (fabs(trans->products[j].energy - energy) < 0.001) )
+      {
+        transition = trans;
+        radParticle = static_cast<int>(j);
+      }
+    }
+  }//for( loop over transitions )
+  
+  BOOST_REQUIRE_MESSAGE( transition && (radParticle >= 0),
+                         "No " << energy << " keV gamma for " << nuclide->symbol );
+  
+  auto peak = make_shared<PeakDef>( energy, 0.5, area );
+  peak->setPeakAreaUncert( sqrt(area) );
+  peak->setNuclearTransition( nuclide, transition, radParticle, PeakDef::SourceGammaType::NormalGamma );
+  peak->useForShieldingSourceFit( true );
+  
+  return peak;
+}//make_source_peak(...)
+
+
+/** A Ba133 point source, at 100 cm from a 100% efficient detector, behind 10 g/cm2 of iron, as a
+ generic shielding; the peaks areas are the exact expected values for the 81, 276, 303, 356, and
+ 384 keV lines.
+ */
+struct Ba133GenericShieldProblem
+{
+  const SandiaDecay::Nuclide *nuclide = nullptr;
+  double activity = 0.0;
+  double true_an = 0.0;
+  double true_ad = 0.0;
+  
+  std::shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn> chi2Fcn;
+  std::shared_ptr<ROOT::Minuit2::MnUserParameters> inputPrams;
+};//struct Ba133GenericShieldProblem
+
+
+/** Creates the #Ba133GenericShieldProblem chi2 function, with the fit starting from the given
+ atomic number and areal density; the activity is always fit, and starts at the true value.
+ */
+Ba133GenericShieldProblem make_ba133_generic_shield_problem( const double start_an, const bool fit_an,
+                                                             const double start_ad )
+{
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  BOOST_REQUIRE( db );
+  
+  Ba133GenericShieldProblem problem;
+  problem.nuclide = db->nuclide( "Ba133" );
+  BOOST_REQUIRE( problem.nuclide );
+  
+  const double distance = 100*PhysicalUnits::cm;
+  const double live_time = 100*PhysicalUnits::second;
+  const double age = 0.0;
+  problem.activity = 1.0E4*PhysicalUnits::bq;
+  problem.true_an = 26.0;
+  problem.true_ad = 10.0*PhysicalUnits::g/PhysicalUnits::cm2;
+  
+  // Create a 100% efficient detector at our test distance.
+  auto detector = make_shared<DetectorPeakResponse>();
+  detector->fromExpOfLogPowerSeriesAbsEff( {0.0f, 0.0f}, {}, distance,
+                                          5*PhysicalUnits::cm, PhysicalUnits::keV,
+                                          0, 3000*PhysicalUnits::keV,
+                                          DetectorPeakResponse::EffGeometryType::FarField );
+  
+  SandiaDecay::NuclideMixture mixture;
+  mixture.addAgedNuclideByActivity( problem.nuclide, problem.activity, age );
+  
+  std::deque<std::shared_ptr<const PeakDef>> foreground_peaks;
+  for( const SandiaDecay::EnergyRatePair &gamma : mixture.gammas( 0.0, SandiaDecay::NuclideMixture::OrderByEnergy, true ) )
+  {
+    for( const double energy : { 80.9979, 276.3989, 302.8508, 356.0129, 383.8485 } )
+    {
+      if( fabs(gamma.energy - energy) > 0.01 )
+        continue;
+      
+      const double trans = exp( -GammaInteractionCalc::transmition_coefficient_generic( problem.true_an,
+                                                                problem.true_ad, gamma.energy ) );
+      const double area = gamma.numPerSecond * live_time * trans;
+      foreground_peaks.push_back( make_source_peak( problem.nuclide, gamma.energy, area ) );
+    }
+  }//for( loop over gammas )
+  
+  BOOST_REQUIRE_EQUAL( foreground_peaks.size(), 5 );
+  
+  auto foreground = make_shared<SpecUtils::Measurement>();
+  auto spec = make_shared<vector<float>>( 16, 1.0f );
+  foreground->set_gamma_counts( spec, live_time, live_time );
+  
+  ShieldingSourceFitCalc::SourceFitDef src;
+  src.nuclide = problem.nuclide;
+  src.activity = problem.activity;
+  src.fitActivity = true;
+  src.age = age;
+  src.fitAge = false;
+  src.ageDefiningNuc = nullptr;
+  src.sourceType = ShieldingSourceFitCalc::ModelSourceType::Point;
+  const vector<ShieldingSourceFitCalc::SourceFitDef> src_definitions{ src };
+  
+  ShieldingSourceFitCalc::ShieldingInfo generic;
+  generic.m_isGenericMaterial = true;
+  generic.m_forFitting = true;
+  generic.m_dimensions[0] = start_an;
+  generic.m_dimensions[1] = start_ad;
+  generic.m_fitDimensions[0] = fit_an;
+  generic.m_fitDimensions[1] = true;
+  const vector<ShieldingSourceFitCalc::ShieldingInfo> shieldings{ generic };
+  
+  ShieldingSourceFitCalc::ShieldingSourceFitOptions options;
+  options.attenuate_for_air = false;
+  options.photopeak_cluster_sigma = 0.0; //Only attribute each gamma to the peak at its exact energy
+  
+  pair<shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParameters> fcn_pars =
+                GammaInteractionCalc::ShieldingSourceChi2Fcn::create( distance,
+                                  GammaInteractionCalc::GeometryType::Spherical,
+                                  shieldings, src_definitions, detector,
+                                  foreground, nullptr, foreground_peaks, nullptr, options );
+  
+  problem.chi2Fcn = fcn_pars.first;
+  problem.inputPrams = make_shared<ROOT::Minuit2::MnUserParameters>( fcn_pars.second );
+  
+  return problem;
+}//make_ba133_generic_shield_problem(...)
+
+
+// Fits the atomic number and areal density of a generic shielding over a Ba133 source; because the
+//  81 keV line is right above the K-edge of gold, the chi2 has a local minimum at an atomic number
+//  of about 78, in addition to the true minimum at 26 (iron).  Starting from Z=74, a single fit ends
+//  up in the local minimum, while the multi-start fit finds the true answer.
+BOOST_AUTO_TEST_CASE( MultiStartFindsGlobalMinimum )
+{
+  set_data_dir();
+  
+  const double adUnits = PhysicalUnits::g/PhysicalUnits::cm2;
+  const Ba133GenericShieldProblem problem = make_ba133_generic_shield_problem( 74.0, true, 1.0*adUnits );
+  const double activity = problem.activity, true_an = problem.true_an, true_ad = problem.true_ad;
+  
+  auto inputPrams = problem.inputPrams;
+  
+  // Keep the sampled areal densities to a range where the peaks arent completely attenuated
+  inputPrams->SetLimits( "Generic_0_AD", 0.0, 25.0*adUnits );
+  
+  const unsigned int an_index = inputPrams->Index( "Generic_0_AN" );
+  const unsigned int ad_index = inputPrams->Index( "Generic_0_AD" );
+  
+  // A single minimization, from the input starting values
+  auto single_results = make_shared<ShieldingSourceFitCalc::ModelFitResults>();
+  vector<ShieldingSourceFitCalc::ModelFitSolution> single;
+  BOOST_REQUIRE_NO_THROW( single = ShieldingSourceFitCalc::fit_model_multi_start( problem.chi2Fcn, inputPrams, 1, 42, single_results ) );
+  BOOST_REQUIRE_EQUAL( single.size(), 1 );
+  
+  const ShieldingSourceFitCalc::ModelFitSolution &local = single.front();
+  BOOST_REQUIRE_EQUAL( local.paramValues.size(), inputPrams->Params().size() );
+  BOOST_CHECK_MESSAGE( local.paramValues[an_index] > 60.0,
+                       "Single start fit AN=" << local.paramValues[an_index]
+                       << " was expected to be in the local minimum near 78" );
+  BOOST_CHECK_MESSAGE( local.chi2 > 25.0,
+                       "Single start fit chi2=" << local.chi2 << " was expected to be a local minimum" );
+  
+  // And now with multiple starts
+  auto multi_results = make_shared<ShieldingSourceFitCalc::ModelFitResults>();
+  vector<ShieldingSourceFitCalc::ModelFitSolution> multi;
+  BOOST_REQUIRE_NO_THROW( multi = ShieldingSourceFitCalc::fit_model_multi_start( problem.chi2Fcn, inputPrams, 12, 42, multi_results ) );
+  BOOST_REQUIRE_EQUAL( multi.size(), 12 );
+  
+  for( size_t i = 1; i < multi.size(); ++i )
+    BOOST_CHECK( multi[i-1].chi2 <= multi[i].chi2 );
+  
+  const ShieldingSourceFitCalc::ModelFitSolution &best = multi.front();
+  BOOST_CHECK_MESSAGE( best.chi2 < 1.0, "Multi-start best chi2=" << best.chi2 << " (expected ~0)" );
+  BOOST_CHECK_MESSAGE( best.chi2 < local.chi2, "Multi-start didnt improve on single start" );
+  BOOST_CHECK_MESSAGE( fabs(best.paramValues[an_index] - true_an) < 1.0,
+                       "Multi-start AN=" << best.paramValues[an_index] << " (expected " << true_an << ")" );
+  BOOST_CHECK_MESSAGE( fabs(best.paramValues[ad_index] - true_ad) < 0.02*true_ad,
+                       "Multi-start AD=" << best.paramValues[ad_index]/adUnits << " g/cm2 (expected "
+                       << true_ad/adUnits << ")" );
+  
+  // The final fit, from the best start, fills out the results
+  BOOST_REQUIRE( multi_results->fit_src_info.size() == 1 );
+  const double fit_activity = multi_results->fit_src_info[0].activity;
+  BOOST_CHECK_MESSAGE( fabs(fit_activity - activity) < 0.01*activity,
+                       "Multi-start fit activity " << PhysicalUnits::printToBestActivityUnits(fit_activity,6)
+                       << " didnt match truth " << PhysicalUnits::printToBestActivityUnits(activity,6) );
+}//BOOST_AUTO_TEST_CASE( MultiStartFindsGlobalMinimum )
+
+
+// The MINOS errors computed in parallel must match running MnMinos serially, one parameter at a time.
+BOOST_AUTO_TEST_CASE( ParallelMinosMatchesSerial )
+{
+  set_data_dir();
+  
+  const double adUnits = PhysicalUnits::g/PhysicalUnits::cm2;
+  const Ba133GenericShieldProblem problem = make_ba133_generic_shield_problem( 26.0, false, 8.0*adUnits );
+  
+  auto results = make_shared<ShieldingSourceFitCalc::ModelFitResults>();
+  auto progress = make_shared<ShieldingSourceFitCalc::ModelFitProgress>();
+  ShieldingSourceFitCalc::fit_model( "", problem.chi2Fcn, problem.inputPrams, progress, [](){},
+                                     results, [](){} );
+  BOOST_REQUIRE( results->successful == ShieldingSourceFitCalc::ModelFitResults::FitStatus::Final );
+  
+  ROOT::Minuit2::MnUserParameters bestPrams = *problem.inputPrams;
+  BOOST_REQUIRE_EQUAL( results->paramValues.size(), bestPrams.Params().size() );
+  BOOST_REQUIRE_EQUAL( results->paramErrors.size(), bestPrams.Params().size() );
+  for( unsigned int i = 0; i < bestPrams.Params().size(); ++i )
+  {
+    const ROOT::Minuit2::MinuitParameter &par = bestPrams.Parameters()[i];
+    if( par.IsConst() || par.IsFixed() || (par.GetName().find("_FIXED") != string::npos) )
+      continue;
+    bestPrams.SetValue( i, results->paramValues[i] );
+    bestPrams.SetError( i, results->paramErrors[i] );
+  }
+  
+  vector<ShieldingSourceFitCalc::ParameterMinosError> parallel;
+  BOOST_REQUIRE_NO_THROW( parallel = ShieldingSourceFitCalc::minos_errors( problem.chi2Fcn, bestPrams ) );
+  
+  // The activity and areal density are the only free parameters
+  BOOST_REQUIRE_EQUAL( parallel.size(), 2 );
+  
+  ROOT::Minuit2::MnStrategy strategy( 2 );
+  ROOT::Minuit2::MnMinimize fitter( *problem.chi2Fcn, ROOT::Minuit2::MnUserParameterState(bestPrams), strategy );
+  const double tolerance = 2.0*bestPrams.VariableParameters();
+  const ROOT::Minuit2::FunctionMinimum minimum = fitter( 50000, tolerance );
+  BOOST_REQUIRE( minimum.IsValid() );
+  
+  const ROOT::Minuit2::MnMinos minos( *problem.chi2Fcn, minimum, strategy );
+  
+  for( const ShieldingSourceFitCalc::ParameterMinosError &err : parallel )
+  {
+    BOOST_CHECK( err.lower_valid && err.upper_valid );
+    BOOST_CHECK_MESSAGE( (err.lower < 0.0) && (err.upper > 0.0),
+                         "Invalid MINOS interval for " << err.name << ": [" << err.lower << ", " << err.upper << "]" );
+    
+    const ROOT::Minuit2::MinosError serial = minos.Minos( err.index, 50000 );
+    
+    BOOST_CHECK_MESSAGE( fabs(err.lower - serial.Lower()) < 0.01*fabs(serial.Lower()),
+                         err.name << " parallel lower MINOS error " << err.lower
+                         << " didnt match serial " << serial.Lower() );
+    BOOST_CHECK_MESSAGE( fabs(err.upper - serial.Upper()) < 0.01*fabs(serial.Upper()),
+                         err.name << " parallel upper MINOS error " << err.upper
+                         << " didnt match serial " << serial.Upper() );
+    
+    // For this nearly-linear problem, MINOS should be close to the parabolic errors.
+    const double parabolic = results->paramErrors[err.index];
+    BOOST_CHECK_MESSAGE( fabs(err.upper - parabolic) < 0.1*parabolic,
+                         err.name << " upper MINOS error " << err.upper
+                         << " not close to parabolic error " << parabolic );
+  }//for( const ShieldingSourceFitCalc::ParameterMinosError &err : parallel )
+}//BOOST_AUTO_TEST_CASE( ParallelMinosMatchesSerial )
+
+
 
 std::tuple<bool,int,int,vector<string>> test_fit_against_truth( const ShieldingSourceFitCalc::ModelFitResults &results )
 {
@@ -1374,6 +1759,17 @@ BOOST_AUTO_TEST_CASE( FitAnalystShieldingSourcecases )
                                                          shield_definitions, src_definitions, detector,
                                                          foreground, background, *foreground_peaks, background_peaks, options );
     
+    // A second setup of the same problem should share the first ones precomputed context, and
+    //  give identical chi2 values.
+    pair<shared_ptr<GammaInteractionCalc::ShieldingSourceChi2Fcn>, ROOT::Minuit2::MnUserParameters> shared_fcn_pars =
+    GammaInteractionCalc::ShieldingSourceChi2Fcn::create( distance, geometry,
+                                                         shield_definitions, src_definitions, detector,
+                                                         foreground, background, *foreground_peaks, background_peaks, options,
+                                                         fcn_pars.first->fitContext() );
+    BOOST_CHECK( shared_fcn_pars.first->fitContext() == fcn_pars.first->fitContext() );
+    BOOST_CHECK_EQUAL( (*shared_fcn_pars.first)( fcn_pars.second.Params() ),
+                       (*fcn_pars.first)( fcn_pars.second.Params() ) );
+    
     auto inputPrams = make_shared<ROOT::Minuit2::MnUserParameters>();
     *inputPrams = fcn_pars.second;
     
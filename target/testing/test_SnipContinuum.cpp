@@ -0,0 +1,218 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+ 
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <string>
+#include <iostream>
+
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE SnipContinuum_suite
+//#include <boost/test/unit_test.hpp>
+#include <boost/test/included/unit_test.hpp>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/PeakFit.h"
+
+
+using namespace std;
+using namespace boost::unit_test;
+
+
+namespace
+{
+/** A falling continuum, with a few Gaussian peaks on it, and some noise. */
+vector<float> make_counts( const size_t nchannel, std::mt19937 &rng )
+{
+  std::uniform_real_distribution<float> noise( 0.0f, 1.0f );
+  
+  vector<float> counts( nchannel );
+  for( size_t i = 0; i < nchannel; ++i )
+  {
+    const double x = static_cast<double>( i );
+    double value = 2000.0*std::exp( -x / (0.25*nchannel) ) + 20.0;
+    
+    for( const double frac : { 0.05, 0.2, 0.21, 0.5, 0.8 } )
+    {
+      const double mean = frac*nchannel, sigma = 2.0 + 0.003*mean;
+      value += 5000.0 * std::exp( -0.5*(x - mean)*(x - mean)/(sigma*sigma) );
+    }
+    
+    counts[i] = std::floor( static_cast<float>(value) * (0.9f + 0.2f*noise(rng)) );
+  }//for( size_t i = 0; i < nchannel; ++i )
+  
+  return counts;
+}//make_counts(...)
+
+
+shared_ptr<SpecUtils::Measurement> make_spectrum( const vector<float> &counts )
+{
+  auto cal = make_shared<SpecUtils::EnergyCalibration>();
+  cal->set_polynomial( counts.size(), { 0.0f, 3000.0f/counts.size() }, {} );
+  
+  auto meas = make_shared<SpecUtils::Measurement>();
+  meas->set_gamma_counts( make_shared<vector<float>>( counts ), 100.0f, 100.0f );
+  meas->set_energy_calibration( cal );
+  
+  return meas;
+}//make_spectrum(...)
+
+
+/** Counts the channels that arent exactly equal. */
+size_t num_differing( const vector<float> &lhs, const vector<float> &rhs )
+{
+  BOOST_REQUIRE_EQUAL( lhs.size(), rhs.size() );
+  
+  size_t ndiff = 0;
+  for( size_t i = 0; i < lhs.size(); ++i )
+    ndiff += (lhs[i] != rhs[i]);
+  return ndiff;
+}//num_differing(...)
+}//namespace
+
+
+// snipContinuum(...) claims to do the exact same floating point operations as calculateContinuum(...)
+//  does with smoothing and Compton edges off, so results must be bit-for-bit identical.
+BOOST_AUTO_TEST_CASE( MatchesCalculateContinuum )
+{
+  std::mt19937 rng( 8675309 );
+  
+  for( const size_t nchannel : { size_t(251), size_t(1024), size_t(16384) } )
+  {
+    const vector<float> counts = make_counts( nchannel, rng );
+    
+    for( const int order : { int(kBackOrder2), int(kBackOrder4), int(kBackOrder6), int(kBackOrder8) } )
+    {
+      for( const int window : { 1, 2, 7, 40, 125 } )
+      {
+        for( const bool increasing : { true, false } )
+        {
+          vector<float> scalar = counts, snip = counts;
+          
+          const int direction = increasing ? kBackIncreasingWindow : kBackDecreasingWindow;
+          const char *scalar_err = calculateContinuum( scalar.data(), static_cast<int>(nchannel),
+                                                       window, direction, order,
+                                                       false, kBackSmoothing3, false );
+          const char *snip_err = snipContinuum( snip.data(), nchannel, window, order, increasing );
+          
+          BOOST_REQUIRE_MESSAGE( !scalar_err && !snip_err,
+                                 "Unexpected error for nchannel=" << nchannel << ", order=" << order
+                                 << ", window=" << window << ": '"
+                                 << (scalar_err ? scalar_err : "") << "', '"
+                                 << (snip_err ? snip_err : "") << "'" );
+          
+          BOOST_CHECK_MESSAGE( num_differing( scalar, snip ) == 0,
+                               num_differing( scalar, snip ) << " channels differ for nchannel="
+                               << nchannel << ", order=" << order << ", window=" << window
+                               << ", increasing=" << increasing );
+          
+          // Make sure we compared against something that actually did some clipping.
+          if( window > 1 )
+            BOOST_CHECK( num_differing( counts, snip ) > 0 );
+        }//for( const bool increasing : { true, false } )
+      }//for( loop over windows )
+    }//for( loop over orders )
+  }//for( loop over number of channels )
+}//BOOST_AUTO_TEST_CASE( MatchesCalculateContinuum )
+
+
+BOOST_AUTO_TEST_CASE( InvalidInput )
+{
+  std::mt19937 rng( 42 );
+  const vector<float> counts = make_counts( 100, rng );
+  
+  // A clipping window too large for the spectrum is an error for both, and neither touches the data.
+  vector<float> scalar = counts, snip = counts;
+  BOOST_CHECK( calculateContinuum( scalar.data(), 100, 50, kBackIncreasingWindow, kBackOrder6,
+                                   false, kBackSmoothing3, false ) != nullptr );
+  BOOST_CHECK( snipContinuum( snip.data(), snip.size(), 50, kBackOrder6, true ) != nullptr );
+  BOOST_CHECK( scalar == counts );
+  BOOST_CHECK( snip == counts );
+  
+  BOOST_CHECK( snipContinuum( snip.data(), snip.size(), 10, 5, true ) != nullptr );
+  BOOST_CHECK( snipContinuum( snip.data(), snip.size(), 0, kBackOrder6, true ) != nullptr );
+  BOOST_CHECK( snipContinuum( snip.data(), 0, 10, kBackOrder6, true ) != nullptr );
+  BOOST_CHECK( snip == counts );
+}//BOOST_AUTO_TEST_CASE( InvalidInput )
+
+
+// estimateContinuum(...) and estimateContinuumCounts(...) should give what the scalar code, with
+//  the "standard" parameters, did before; cached results should be the same as fresh ones.
+BOOST_AUTO_TEST_CASE( EstimateContinuum )
+{
+  std::mt19937 rng( 1234 );
+  
+  BOOST_CHECK( !estimateContinuumCounts( nullptr ) );
+  BOOST_CHECK( !estimateContinuumCounts( make_shared<SpecUtils::Measurement>() ) );
+  BOOST_CHECK_THROW( estimateContinuum( nullptr ), std::exception );
+  
+  for( const size_t nchannel : { size_t(512), size_t(8192) } )
+  {
+    const vector<float> counts = make_counts( nchannel, rng );
+    
+    vector<float> expected = counts;
+    BOOST_REQUIRE( !calculateContinuum( expected.data(), static_cast<int>(nchannel), 125,
+                                        kBackIncreasingWindow, kBackOrder6,
+                                        false, kBackSmoothing3, false ) );
+    
+    const shared_ptr<SpecUtils::Measurement> meas = make_spectrum( counts );
+    const shared_ptr<const vector<float>> continuum = estimateContinuumCounts( meas );
+    BOOST_REQUIRE( continuum );
+    BOOST_CHECK_EQUAL( num_differing( *continuum, expected ), 0 );
+    
+    // Same Measurement again, and a different Measurement with the same counts, hit the cache.
+    BOOST_CHECK( estimateContinuumCounts( meas ) == continuum );
+    BOOST_CHECK( estimateContinuumCounts( make_spectrum( counts ) ) == continuum );
+    
+    // Changing a single channel must not give the cached answer.
+    vector<float> changed_counts = counts;
+    changed_counts[nchannel/2] += 1.0f;
+    vector<float> changed_expected = changed_counts;
+    BOOST_REQUIRE( !calculateContinuum( changed_expected.data(), static_cast<int>(nchannel), 125,
+                                        kBackIncreasingWindow, kBackOrder6,
+                                        false, kBackSmoothing3, false ) );
+    const shared_ptr<const vector<float>> changed = estimateContinuumCounts( make_spectrum( changed_counts ) );
+    BOOST_REQUIRE( changed );
+    BOOST_CHECK( changed != continuum );
+    BOOST_CHECK_EQUAL( num_differing( *changed, changed_expected ), 0 );
+    
+    const shared_ptr<SpecUtils::Measurement> background = estimateContinuum( meas );
+    BOOST_REQUIRE( background && background->gamma_counts() );
+    BOOST_CHECK_EQUAL( num_differing( *background->gamma_counts(), expected ), 0 );
+    BOOST_CHECK_EQUAL( background->live_time(), meas->live_time() );
+    BOOST_CHECK_EQUAL( background->real_time(), meas->real_time() );
+    BOOST_CHECK( meas->gamma_counts() && (*meas->gamma_counts() == counts) );
+  }//for( loop over number of channels )
+  
+  // Too few channels for the clipping window: the continuum is just the data.
+  const vector<float> short_counts = make_counts( 200, rng );
+  const shared_ptr<const vector<float>> short_continuum = estimateContinuumCounts( make_spectrum( short_counts ) );
+  BOOST_REQUIRE( short_continuum );
+  BOOST_CHECK( *short_continuum == short_counts );
+}//BOOST_AUTO_TEST_CASE( EstimateContinuum )